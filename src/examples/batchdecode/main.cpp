@@ -0,0 +1,505 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Headless batch decoder: runs the filter graph from a saved session over many waveform files
+ */
+
+#include "../scopehal/scopehal.h"
+#include "../scopehal/MockOscilloscope.h"
+#include "../scopehal/PacketDecoder.h"
+#include "../scopeprotocols/scopeprotocols.h"
+
+#include <filesystem>
+
+using namespace std;
+
+/**
+	@brief One copy of the session's filter graph, used by a single worker thread
+ */
+class DecodeWorker
+{
+public:
+	~DecodeWorker();
+
+	bool LoadGraph(const YAML::Node& root);
+	bool ProcessFile(const string& fname, const string& prefix, const string& outdir);
+
+	///@brief The offline instrument waveform files are loaded into
+	shared_ptr<MockOscilloscope> m_scope;
+
+	///@brief All filters in this copy of the graph
+	set<Filter*> m_filters;
+
+	///@brief Executor for running m_filters
+	FilterGraphExecutor m_executor;
+
+	///@brief Scalar measurement results, as CSV lines
+	vector<string> m_measurements;
+};
+
+bool IsWaveformFile(const filesystem::path& path);
+vector<string> MakeOutputPrefixes(const vector<string>& files);
+string SanitizeName(const string& name);
+string QuoteCSV(const string& str);
+
+int main(int argc, char* argv[])
+{
+	Severity console_verbosity = Severity::NOTICE;
+
+	string sessionPath = "";
+	string outdir = ".";
+	size_t njobs = thread::hardware_concurrency();
+	vector<string> inputs;
+
+	//Parse command-line arguments
+	for(int i=1; i<argc; i++)
+	{
+		string s(argv[i]);
+
+		//Let the logger eat its args first
+		if(ParseLoggerArguments(i, argc, argv, console_verbosity))
+			continue;
+
+		if(s == "--help")
+		{
+			fprintf(stderr,
+				"Usage: batchdecode --session foo.scopesession [--out dir] [--jobs N] files or directories...\n"
+				"\n"
+				"Loads the filter graph from the session, then runs it over each waveform file (CSV, BIN, VCD or WAV).\n"
+				"Packets from each protocol decoder are written to <out>/<file>_<decoder>.csv, and scalar\n"
+				"measurements to <out>/measurements.csv. If several inputs have the same name, <file> also\n"
+				"includes the extension and, if still not unique, a sequence number.\n");
+			return 0;
+		}
+		else if( (s == "--session") && (i+1 < argc) )
+			sessionPath = argv[++i];
+		else if( (s == "--out") && (i+1 < argc) )
+			outdir = argv[++i];
+		else if( (s == "--jobs") && (i+1 < argc) )
+			njobs = stoul(argv[++i]);
+		else if(s[0] == '-')
+		{
+			fprintf(stderr, "Unrecognized command-line argument \"%s\", use --help\n", s.c_str());
+			return 1;
+		}
+		else
+			inputs.push_back(s);
+	}
+
+	//Set up logging
+	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(console_verbosity));
+
+	if(sessionPath.empty())
+	{
+		LogError("No session file specified, use --help\n");
+		return 1;
+	}
+
+	//Initialize object creation tables (no window, so Vulkan is headless)
+	if(!VulkanInit(true))
+		return 1;
+	TransportStaticInit();
+	DriverStaticInit();
+	ScopeProtocolStaticInit();
+	InitializePlugins();
+
+	//Find all of the waveforms to decode
+	vector<string> files;
+	for(auto& in : inputs)
+	{
+		if(filesystem::is_directory(in))
+		{
+			for(auto& entry : filesystem::directory_iterator(in))
+			{
+				if(entry.is_regular_file() && IsWaveformFile(entry.path()))
+					files.push_back(entry.path().string());
+			}
+		}
+		else
+			files.push_back(in);
+	}
+	sort(files.begin(), files.end());
+	files.erase(unique(files.begin(), files.end()), files.end());
+	if(files.empty())
+	{
+		LogError("No waveform files to decode\n");
+		return 1;
+	}
+
+	//Inputs from different directories (or foo.csv and foo.bin) must not overwrite each other's outputs
+	auto prefixes = MakeOutputPrefixes(files);
+
+	YAML::Node root;
+	try
+	{
+		root = YAML::LoadFile(sessionPath);
+	}
+	catch(const YAML::BadFile&)
+	{
+		LogError("Unable to open session file %s\n", sessionPath.c_str());
+		return 1;
+	}
+
+	filesystem::create_directories(outdir);
+
+	//Each worker gets its own copy of the graph so they can run concurrently.
+	//Filter creation goes through global tables, so build them all up front on this thread.
+	njobs = max((size_t)1, min(njobs, files.size()));
+	LogNotice("Decoding %zu files with %zu workers\n", files.size(), njobs);
+	vector<unique_ptr<DecodeWorker>> workers;
+	for(size_t i=0; i<njobs; i++)
+	{
+		auto w = make_unique<DecodeWorker>();
+		if(!w->LoadGraph(root))
+			return 1;
+		workers.push_back(std::move(w));
+	}
+
+	//Hand out files to whichever worker is free
+	atomic<size_t> nextFile(0);
+	atomic<size_t> failures(0);
+	vector<thread> threads;
+	for(auto& w : workers)
+	{
+		auto pw = w.get();
+		threads.push_back(thread([&, pw]
+		{
+			while(true)
+			{
+				size_t i = nextFile ++;
+				if(i >= files.size())
+					break;
+				if(!pw->ProcessFile(files[i], prefixes[i], outdir))
+					failures ++;
+			}
+		}));
+	}
+	for(auto& t : threads)
+		t.join();
+
+	//Merge measurements from all workers
+	auto mpath = (filesystem::path(outdir) / "measurements.csv").string();
+	FILE* fp = fopen(mpath.c_str(), "w");
+	if(fp)
+	{
+		fprintf(fp, "File,Filter,Stream,Value\n");
+		for(auto& w : workers)
+		{
+			for(auto& line : w->m_measurements)
+				fprintf(fp, "%s\n", line.c_str());
+		}
+		fclose(fp);
+	}
+	else
+		LogError("Unable to write %s\n", mpath.c_str());
+
+	//Clean up
+	workers.clear();
+	LogNotice("Done, %zu of %zu files failed\n", (size_t)failures, files.size());
+	return (failures == 0) ? 0 : 1;
+}
+
+/**
+	@brief Checks if a file is one of the formats MockOscilloscope can import
+ */
+bool IsWaveformFile(const filesystem::path& path)
+{
+	auto ext = path.extension().string();
+	for(auto& c : ext)
+		c = tolower(c);
+	return (ext == ".csv") || (ext == ".bin") || (ext == ".vcd") || (ext == ".wav");
+}
+
+/**
+	@brief Picks a unique output file name prefix for each input file
+
+	This is normally the file name without its extension. If several inputs share that, the extension is kept as
+	well, and if it is still not unique (same file name in two directories) a sequence number is appended.
+ */
+vector<string> MakeOutputPrefixes(const vector<string>& files)
+{
+	map<string, size_t> stemCounts;
+	for(auto& f : files)
+		stemCounts[SanitizeName(filesystem::path(f).stem().string())] ++;
+
+	vector<string> ret;
+	set<string> used;
+	for(auto& f : files)
+	{
+		filesystem::path path(f);
+		auto prefix = SanitizeName(path.stem().string());
+		if( (stemCounts[prefix] > 1) && !path.extension().empty() )
+			prefix += "_" + SanitizeName(path.extension().string().substr(1));
+
+		auto base = prefix;
+		for(size_t n=2; used.find(prefix) != used.end(); n++)
+			prefix = base + "_" + to_string(n);
+		used.emplace(prefix);
+
+		if(prefix != path.stem().string())
+			LogNotice("Output for %s will be written as %s_*.csv\n", f.c_str(), prefix.c_str());
+		ret.push_back(prefix);
+	}
+	return ret;
+}
+
+/**
+	@brief Makes a display name safe to use in a file name
+ */
+string SanitizeName(const string& name)
+{
+	string ret;
+	for(auto c : name)
+	{
+		if(isalnum(c) || (c == '-') || (c == '_') )
+			ret += c;
+		else
+			ret += '_';
+	}
+	return ret;
+}
+
+/**
+	@brief Quotes a string for CSV output
+ */
+string QuoteCSV(const string& str)
+{
+	string ret = "\"";
+	for(auto c : str)
+	{
+		if(c == '\"')
+			ret += "\"\"";
+		else
+			ret += c;
+	}
+	ret += "\"";
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DecodeWorker
+
+DecodeWorker::~DecodeWorker()
+{
+	for(auto f : m_filters)
+		f->Release();
+	m_filters.clear();
+}
+
+/**
+	@brief Creates a copy of the session's instruments and filter graph
+
+	This mirrors what Session::PreLoadFromYaml() / LoadFromYaml() do for an offline load, minus the UI. Only
+	oscilloscopes are recreated, as offline mock instruments.
+ */
+bool DecodeWorker::LoadGraph(const YAML::Node& root)
+{
+	int version = 0;
+	if(root["version"].IsDefined())
+		version = root["version"].as<int>();
+
+	IDTable table;
+	ConfigWarningList warnings;
+
+	vector<string> scopeDrivers;
+	Oscilloscope::EnumDrivers(scopeDrivers);
+
+	//Create offline copies of the scopes
+	auto instruments = root["instruments"];
+	vector<pair<shared_ptr<MockOscilloscope>, YAML::Node>> scopes;
+	for(auto it : instruments)
+	{
+		auto node = it.second;
+		auto driver = node["driver"].as<string>();
+		if(find(scopeDrivers.begin(), scopeDrivers.end(), driver) == scopeDrivers.end())
+			continue;
+
+		auto scope = make_shared<MockOscilloscope>(
+			node["name"].as<string>(),
+			node["vendor"].as<string>(),
+			node["serial"].as<string>(),
+			node["transport"].as<string>(),
+			driver,
+			node["args"].as<string>()
+			);
+		table.emplace(node["id"].as<uintptr_t>(), (Instrument*)scope.get());
+		scope->PreLoadConfiguration(version, node, table, warnings);
+		scopes.push_back(make_pair(scope, node));
+	}
+	if(scopes.empty())
+	{
+		LogError("Session has no oscilloscopes to load waveforms into\n");
+		return false;
+	}
+	if(scopes.size() > 1)
+		LogWarning("Session has %zu oscilloscopes, waveforms will only be loaded into the first\n", scopes.size());
+	for(auto& it : scopes)
+		it.first->LoadConfiguration(version, it.second, table);
+	m_scope = scopes[0].first;
+
+	//Create the filters, then hook up their inputs once they all exist
+	auto decodes = root["decodes"];
+	for(auto it : decodes)
+	{
+		auto dnode = it.second;
+		auto proto = dnode["protocol"].as<string>();
+		auto filter = Filter::CreateFilter(proto, dnode["color"].as<string>());
+		if(filter == nullptr)
+		{
+			LogError("Unable to create filter \"%s\"\n", proto.c_str());
+			return false;
+		}
+		filter->AddRef();
+		m_filters.emplace(filter);
+
+		table.emplace(dnode["id"].as<uintptr_t>(), filter);
+		filter->LoadParameters(dnode, table);
+	}
+	for(auto it : decodes)
+	{
+		auto dnode = it.second;
+		auto filter = static_cast<Filter*>(table[dnode["id"].as<uintptr_t>()]);
+		if(filter)
+			filter->LoadInputs(dnode, table);
+	}
+
+	//Instrument channels can have inputs too (e.g. external trigger sources)
+	for(auto& it : scopes)
+	{
+		auto scope = it.first;
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto channelNode = it.second["channels"]["ch" + to_string(i)];
+			if(channelNode)
+				scope->GetChannel(i)->LoadInputs(channelNode, table);
+		}
+	}
+
+	//Packets are written to one file per decoder, named after the decoder, so the names must be unique
+	map<string, string> decoderNames;
+	for(auto f : m_filters)
+	{
+		if(!dynamic_cast<PacketDecoder*>(f))
+			continue;
+		auto name = SanitizeName(f->GetDisplayName());
+		auto it = decoderNames.find(name);
+		if(it != decoderNames.end())
+		{
+			LogError("Protocol decoders \"%s\" and \"%s\" would both write to *_%s.csv, rename one in the session\n",
+				it->second.c_str(), f->GetDisplayName().c_str(), name.c_str());
+			return false;
+		}
+		decoderNames[name] = f->GetDisplayName();
+	}
+
+	return true;
+}
+
+/**
+	@brief Loads one waveform file, runs the graph, and writes out the results
+ */
+bool DecodeWorker::ProcessFile(const string& fname, const string& prefix, const string& outdir)
+{
+	LogNotice("Decoding %s\n", fname.c_str());
+
+	auto ext = filesystem::path(fname).extension().string();
+	for(auto& c : ext)
+		c = tolower(c);
+
+	bool ok = false;
+	if(ext == ".csv")
+		ok = m_scope->LoadCSV(fname);
+	else if(ext == ".bin")
+		ok = m_scope->LoadBIN(fname);
+	else if(ext == ".vcd")
+		ok = m_scope->LoadVCD(fname);
+	else if(ext == ".wav")
+		ok = m_scope->LoadWAV(fname);
+	if(!ok)
+	{
+		LogError("Failed to load %s\n", fname.c_str());
+		return false;
+	}
+
+	m_executor.RunBlocking(m_filters);
+
+	for(auto f : m_filters)
+	{
+		//Packets go to one file per decoder
+		auto pd = dynamic_cast<PacketDecoder*>(f);
+		if(pd)
+		{
+			auto leaf = prefix + "_" + SanitizeName(f->GetDisplayName()) + ".csv";
+			auto path = (filesystem::path(outdir) / leaf).string();
+			FILE* fp = fopen(path.c_str(), "w");
+			if(!fp)
+			{
+				LogError("Unable to write %s\n", path.c_str());
+				return false;
+			}
+
+			auto headers = pd->GetHeaders();
+			fprintf(fp, "Offset");
+			for(auto& h : headers)
+				fprintf(fp, ",%s", QuoteCSV(h).c_str());
+			fprintf(fp, ",Data\n");
+
+			for(auto p : pd->GetPackets())
+			{
+				fprintf(fp, "%" PRId64, p->m_offset);
+				for(auto& h : headers)
+					fprintf(fp, ",%s", QuoteCSV(p->m_headers[h]).c_str());
+				fputc(',', fp);
+				for(auto b : p->m_data)
+					fprintf(fp, "%02x", b);
+				fputc('\n', fp);
+			}
+			fclose(fp);
+		}
+
+		//Scalar outputs are measurements
+		for(size_t i=0; i<f->GetStreamCount(); i++)
+		{
+			if(f->GetType(i) != Stream::STREAM_TYPE_ANALOG_SCALAR)
+				continue;
+
+			StreamDescriptor stream(f, i);
+			m_measurements.push_back(
+				QuoteCSV(fname) + "," +
+				QuoteCSV(f->GetDisplayName()) + "," +
+				QuoteCSV(stream.GetName()) + "," +
+				QuoteCSV(stream.GetYAxisUnits().PrettyPrint(stream.GetScalarValue())));
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,229 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of AcquisitionLatency, AcquisitionLatencyStats, and AcquisitionLatencyTracker
+ */
+#include "ngscopeclient.h"
+#include "AcquisitionLatency.h"
+
+using namespace std;
+
+///@brief Upper edge of the first latency histogram bin, in seconds
+static const double LATENCY_HISTOGRAM_FIRST_EDGE = 1e-3;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AcquisitionLatency
+
+AcquisitionLatency::AcquisitionLatency()
+{
+	for(auto& t : m_times)
+		t = 0;
+}
+
+/**
+	@brief Gets the human readable name of a stage
+ */
+const char* AcquisitionLatency::GetStageName(Stage stage)
+{
+	switch(stage)
+	{
+		case STAGE_TRIGGER:
+			return "Trigger seen";
+
+		case STAGE_DOWNLOADED:
+			return "Downloaded";
+
+		case STAGE_FILTERED:
+			return "Filtered";
+
+		case STAGE_RASTERIZED:
+			return "Rasterized";
+
+		case STAGE_TONE_MAPPED:
+			return "Tone mapped";
+
+		case STAGE_PRESENTED:
+			return "Presented";
+
+		default:
+			return "";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AcquisitionLatencyStats
+
+AcquisitionLatencyStats::AcquisitionLatencyStats()
+	: m_count(0)
+	, m_last(0)
+	, m_min(0)
+	, m_max(0)
+	, m_sum(0)
+{
+	for(size_t i=0; i<AcquisitionLatency::STAGE_COUNT; i++)
+	{
+		m_stageSums[i] = 0;
+		m_stageLast[i] = 0;
+	}
+	for(size_t i=0; i<NUM_BINS; i++)
+		m_bins[i] = 0;
+}
+
+/**
+	@brief Adds a presented acquisition to the statistics
+
+	Stages that were skipped (e.g. no filters) are counted as taking no time, and their time goes to the next stage
+	that was reached.
+
+	@param triggerTime	Time this group's trigger was seen, which may be earlier than other groups in the acquisition
+	@param lat			The acquisition
+ */
+void AcquisitionLatencyStats::Add(double triggerTime, const AcquisitionLatency& lat)
+{
+	double prev = triggerTime;
+	for(size_t i=AcquisitionLatency::STAGE_DOWNLOADED; i<AcquisitionLatency::STAGE_COUNT; i++)
+	{
+		auto stage = static_cast<AcquisitionLatency::Stage>(i);
+		double dt = 0;
+		if(lat.HasReached(stage))
+		{
+			dt = max(0.0, lat.GetStageTime(stage) - prev);
+			prev = max(prev, lat.GetStageTime(stage));
+		}
+		m_stageLast[i] = dt;
+		m_stageSums[i] += dt;
+	}
+
+	double total = prev - triggerTime;
+	m_last = total;
+	m_sum += total;
+	if( (m_count == 0) || (total < m_min) )
+		m_min = total;
+	if( (m_count == 0) || (total > m_max) )
+		m_max = total;
+	m_count ++;
+
+	size_t bin = 0;
+	while( (bin+1 < NUM_BINS) && (total > GetBinUpperEdge(bin)) )
+		bin ++;
+	m_bins[bin] ++;
+}
+
+/**
+	@brief Gets the upper edge of a histogram bin, in seconds
+
+	The first bin holds everything up to 1 ms, and each bin after that is half an octave wide. The last bin also
+	holds everything longer than its nominal upper edge.
+ */
+double AcquisitionLatencyStats::GetBinUpperEdge(size_t bin)
+{
+	return LATENCY_HISTOGRAM_FIRST_EDGE * pow(2, bin * 0.5);
+}
+
+/**
+	@brief Estimates a percentile of total latency from the histogram
+
+	@param frac	Fraction of acquisitions (0 to 1) which should have no more latency than the returned value
+
+	@return Upper edge of the bin the percentile falls in (clamped to the longest latency seen), in seconds
+ */
+double AcquisitionLatencyStats::GetPercentile(double frac) const
+{
+	if(m_count == 0)
+		return 0;
+
+	uint64_t target = ceil(frac * m_count);
+	uint64_t seen = 0;
+	for(size_t i=0; i<NUM_BINS; i++)
+	{
+		seen += m_bins[i];
+		if(seen >= target)
+			return min(m_max, GetBinUpperEdge(i));
+	}
+	return m_max;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AcquisitionLatencyTracker
+
+/**
+	@brief Adds a presented acquisition to the statistics of every trigger group in it
+ */
+void AcquisitionLatencyTracker::Record(const AcquisitionLatency& lat)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	//Forget about groups which have been deleted
+	for(auto it = m_stats.begin(); it != m_stats.end(); )
+	{
+		if(it->second.first.expired())
+			it = m_stats.erase(it);
+		else
+			++it;
+	}
+
+	for(auto& it : lat.m_groups)
+	{
+		auto group = it.first.lock();
+		if(!group)
+			continue;
+
+		auto& entry = m_stats[group.get()];
+		entry.first = group;
+		entry.second.Add(it.second, lat);
+	}
+}
+
+/**
+	@brief Gets the statistics for a trigger group
+
+	@return False if nothing has been recorded for the group
+ */
+bool AcquisitionLatencyTracker::GetStats(TriggerGroup* group, AcquisitionLatencyStats& stats)
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_stats.find(group);
+	if( (it == m_stats.end()) || it->second.first.expired() )
+		return false;
+	stats = it->second.second;
+	return true;
+}
+
+/**
+	@brief Discards all statistics
+ */
+void AcquisitionLatencyTracker::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_stats.clear();
+}
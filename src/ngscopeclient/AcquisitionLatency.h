@@ -0,0 +1,163 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of AcquisitionLatency, AcquisitionLatencyStats, and AcquisitionLatencyTracker
+ */
+#ifndef AcquisitionLatency_h
+#define AcquisitionLatency_h
+
+class TriggerGroup;
+
+/**
+	@brief Timestamps of one acquisition as it makes its way from the instrument to the screen
+
+	Created by Session::DownloadWaveforms() and handed along with the acquisition: the WaveformThread marks the
+	filter and rasterization stages, and the GUI thread the rest. Each stage is only written by one thread, but may be
+	read by another, hence the atomics.
+ */
+class AcquisitionLatency
+{
+public:
+	AcquisitionLatency();
+
+	enum Stage
+	{
+		///@brief The trigger poll first saw the primary instrument had a waveform ready
+		STAGE_TRIGGER,
+
+		///@brief Waveforms were popped off every instrument's queue
+		STAGE_DOWNLOADED,
+
+		///@brief The filter graph finished
+		STAGE_FILTERED,
+
+		///@brief Rasterized waveforms were published to the GUI
+		STAGE_RASTERIZED,
+
+		///@brief Tone mapping was recorded for the frame
+		STAGE_TONE_MAPPED,
+
+		///@brief The first frame containing the acquisition was presented
+		STAGE_PRESENTED,
+
+		STAGE_COUNT
+	};
+
+	///@brief Records that a stage was reached at a given time (from GetTime())
+	void Mark(Stage stage, double t)
+	{ m_times[stage] = t; }
+
+	///@brief Gets the time (from GetTime()) a stage was reached, or zero if it hasn't been yet
+	double GetStageTime(Stage stage) const
+	{ return m_times[stage]; }
+
+	///@brief Checks if a stage has been reached
+	bool HasReached(Stage stage) const
+	{ return m_times[stage] != 0; }
+
+	static const char* GetStageName(Stage stage);
+
+	/**
+		@brief Trigger groups in the acquisition and the time each was first seen triggered
+
+		Only written before the acquisition is handed off, so it needs no locking.
+	 */
+	std::vector<std::pair<std::weak_ptr<TriggerGroup>, double> > m_groups;
+
+protected:
+
+	///@brief Time each stage was reached
+	std::atomic<double> m_times[STAGE_COUNT];
+};
+
+/**
+	@brief Latency statistics of a trigger group, from the trigger being seen to the acquisition being presented
+ */
+class AcquisitionLatencyStats
+{
+public:
+	AcquisitionLatencyStats();
+
+	void Add(double triggerTime, const AcquisitionLatency& lat);
+	double GetPercentile(double frac) const;
+
+	static double GetBinUpperEdge(size_t bin);
+
+	///@brief Number of histogram bins, half an octave each
+	static const size_t NUM_BINS = 24;
+
+	///@brief Number of acquisitions recorded
+	uint64_t m_count;
+
+	///@brief Total latency of the most recent acquisition, in seconds
+	double m_last;
+
+	///@brief Shortest total latency, in seconds
+	double m_min;
+
+	///@brief Longest total latency, in seconds
+	double m_max;
+
+	///@brief Sum of total latencies, in seconds
+	double m_sum;
+
+	///@brief Sum of the time taken to reach each stage from the one before it, in seconds
+	double m_stageSums[AcquisitionLatency::STAGE_COUNT];
+
+	///@brief Time the most recent acquisition took to reach each stage from the one before it, in seconds
+	double m_stageLast[AcquisitionLatency::STAGE_COUNT];
+
+	///@brief Histogram of total latency (see GetBinUpperEdge())
+	uint64_t m_bins[NUM_BINS];
+};
+
+/**
+	@brief Keeps latency statistics for each trigger group
+ */
+class AcquisitionLatencyTracker
+{
+public:
+	void Record(const AcquisitionLatency& lat);
+	bool GetStats(TriggerGroup* group, AcquisitionLatencyStats& stats);
+	void Clear();
+
+protected:
+
+	///@brief Mutex protecting m_stats
+	std::mutex m_mutex;
+
+	///@brief Statistics for each trigger group (weak pointers catch groups deleted since, whose address was reused)
+	std::map<TriggerGroup*, std::pair<std::weak_ptr<TriggerGroup>, AcquisitionLatencyStats> > m_stats;
+};
+
+#endif
@@ -0,0 +1,346 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ArbitraryWaveformUpload
+ */
+
+#include "ngscopeclient.h"
+#include "ArbitraryWaveformUpload.h"
+
+using namespace std;
+
+///@brief Most thread blocks dispatched in X before wrapping into Y
+static const size_t ARB_MAX_X_BLOCKS = 32768;
+
+///@brief Most threads the range pass is split across (bounds the CPU side of the reduction)
+static const size_t ARB_MAX_RANGE_THREADS = 4096;
+
+///@brief Fewest samples given to one thread of the range pass
+static const size_t ARB_MIN_SAMPLES_PER_THREAD = 256;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates an upload of a copy of a waveform
+
+	The caller must hold a shared lock on the waveform data.
+
+	@param channel	Generator channel to upload to
+	@param source	Description of where the waveform came from, for display
+	@param wfm		Waveform to upload
+	@param format	Sample format and commands the generator wants
+ */
+ArbitraryWaveformUpload::ArbitraryWaveformUpload(
+	size_t channel,
+	const string& source,
+	UniformAnalogWaveform* wfm,
+	const ArbitraryWaveformFormat& format)
+	: m_channel(channel)
+	, m_source(source)
+	, m_format(format)
+	, m_state(STATE_PENDING)
+	, m_cancel(false)
+	, m_sent(0)
+	, m_total(0)
+	, m_vmin(0)
+	, m_vmax(0)
+	, m_samples("ArbitraryWaveformUpload.samples")
+	, m_ranges("ArbitraryWaveformUpload.ranges")
+	, m_codes("ArbitraryWaveformUpload.codes")
+	, m_queue(g_vkQueueManager->GetComputeQueue("ArbitraryWaveformUpload.queue"))
+	, m_pool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_pool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+{
+	m_quantizePipeline = make_shared<ComputePipeline>(
+		"shaders/ArbitraryWaveformQuantize.spv", 3, sizeof(ArbitraryWaveformQuantizeArgs));
+
+	//The source is only read by the shader, the codes only by the CPU once converted
+	m_samples.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_UNLIKELY);
+	m_samples.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_ranges.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_ranges.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_codes.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_codes.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	m_samples.CopyFrom(wfm->m_samples);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Uploading
+
+/**
+	@brief Does the next piece of the upload
+
+	The first call converts the waveform, each one after that sends a single chunk. Must be called from the
+	generator's instrument thread.
+
+	@param transport	Transport to send the chunks over
+	@param gen			Generator to set the amplitude and offset of, if the format asks for it
+
+	@return True if anything was done, false if the upload has finished
+ */
+bool ArbitraryWaveformUpload::Step(SCPITransport* transport, FunctionGenerator* gen)
+{
+	if(IsFinished())
+		return false;
+	if(m_cancel)
+	{
+		LogNotice("Arbitrary waveform upload of %s cancelled after %zu of %zu points\n",
+			m_source.c_str(), m_sent.load(), m_total.load());
+		m_state = STATE_CANCELLED;
+		return true;
+	}
+
+	if(m_state == STATE_PENDING)
+	{
+		if(Convert())
+			m_state = STATE_UPLOADING;
+		return true;
+	}
+
+	//Send the next chunk as a definite length block
+	size_t total = m_total;
+	size_t first = m_sent;
+	size_t count = min(max(m_format.m_chunkPoints, (size_t)1), total - first);
+	bool last = (first + count == total);
+
+	size_t nbytes = count * sizeof(uint16_t);
+	string len = to_string(nbytes);
+	string header = ExpandCommand(m_format.m_command, first, count, last) + "#" + to_string(len.size()) + len;
+
+	vector<unsigned char> msg(header.begin(), header.end());
+	auto data = reinterpret_cast<const unsigned char*>(m_codes.GetCpuPointer()) + first*sizeof(uint16_t);
+	msg.insert(msg.end(), data, data + nbytes);
+	msg.push_back('\n');
+
+	{
+		TRACE_ZONE("Arb chunk", m_source.c_str());
+		lock_guard<recursive_mutex> lock(transport->GetMutex());
+		if(!transport->SendRawData(msg.size(), msg.data()))
+		{
+			Fail("Couldn't send chunk at point " + to_string(first));
+			return true;
+		}
+	}
+	m_sent = first + count;
+	if(!last)
+		return true;
+
+	if(!m_format.m_finishCommand.empty())
+		transport->SendCommandQueued(ExpandCommand(m_format.m_finishCommand, 0, total, true));
+	if(m_format.m_matchAmplitude && gen)
+	{
+		gen->SetFunctionChannelAmplitude(m_channel, m_vmax - m_vmin);
+		gen->SetFunctionChannelOffset(m_channel, (m_vmax + m_vmin) / 2);
+	}
+
+	//Nothing else needs the codes once they're out
+	m_codes.clear();
+	m_codes.shrink_to_fit();
+
+	LogDebug("Uploaded %zu points of %s to channel %zu\n", total, m_source.c_str(), m_channel);
+	m_state = STATE_DONE;
+	return true;
+}
+
+/**
+	@brief Resamples and quantizes the source into m_codes
+
+	@return True on success, false (after calling Fail()) if the waveform can't be converted
+ */
+bool ArbitraryWaveformUpload::Convert()
+{
+	size_t inLen = m_samples.size();
+	size_t outLen = m_format.m_points ? m_format.m_points : inLen;
+	if(inLen == 0)
+	{
+		Fail("Source waveform is empty");
+		return false;
+	}
+	if( (inLen > UINT32_MAX) || (outLen > UINT32_MAX) )
+	{
+		Fail("Waveform is too long");
+		return false;
+	}
+
+	size_t samplesPerThread = max<size_t>(
+		ARB_MIN_SAMPLES_PER_THREAD,
+		GetComputeBlockCount(inLen, ARB_MAX_RANGE_THREADS));
+	size_t numThreads = GetComputeBlockCount(inLen, samplesPerThread);
+	size_t words = GetComputeBlockCount(outLen, 2);
+	m_ranges.resize(numThreads * 2);
+	m_codes.resize(words);
+
+	ArbitraryWaveformQuantizeArgs args;
+	args.inLen = inLen;
+	args.outLen = outLen;
+	args.samplesPerThread = samplesPerThread;
+	args.numThreads = numThreads;
+	args.stride = 0;
+	args.bigEndian = m_format.m_bigEndian;
+	args.ratio = inLen * 1.0 / outLen;
+	args.vmin = 0;
+	args.scale = 0;
+	args.codeMin = 0;
+	args.codeMax = 0;
+
+	//Block swapchain recreation while we're using the GPU
+	shared_lock vlock(g_vulkanActivityMutex);
+
+	//Find the span of the source
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	m_samples.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+	AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+	m_quantizePipeline->BindBufferNonblocking(0, m_samples, m_cmdBuf);
+	m_quantizePipeline->BindBufferNonblocking(1, m_ranges, m_cmdBuf, true);
+	m_quantizePipeline->BindBufferNonblocking(2, m_codes, m_cmdBuf, true);
+	args.mode = ArbitraryWaveformQuantizeArgs::MODE_RANGE;
+	m_quantizePipeline->Dispatch(m_cmdBuf, args, GetComputeBlockCount(numThreads, 64));
+	m_ranges.MarkModifiedFromGpu();
+
+	m_cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "arb range");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+
+	m_ranges.PrepareForCpuAccess();
+	m_vmin = m_ranges[0];
+	m_vmax = m_ranges[1];
+	for(size_t i=1; i<numThreads; i++)
+	{
+		m_vmin = min(m_vmin, m_ranges[i*2]);
+		m_vmax = max(m_vmax, m_ranges[i*2 + 1]);
+	}
+
+	//Map the span of the source onto the full code range (a flat waveform goes to the middle)
+	int bits = min(max(m_format.m_bits, 2), 16);
+	if(m_format.m_signed)
+	{
+		args.codeMin = -(1 << (bits-1));
+		args.codeMax = (1 << (bits-1)) - 1;
+	}
+	else
+	{
+		args.codeMin = 0;
+		args.codeMax = (1 << bits) - 1;
+	}
+	float range = m_vmax - m_vmin;
+	if(range > 0)
+	{
+		args.vmin = m_vmin;
+		args.scale = (args.codeMax - args.codeMin) / range;
+	}
+	else
+	{
+		args.vmin = m_vmin - 0.5;
+		args.scale = args.codeMax - args.codeMin;
+	}
+
+	//Resample and quantize
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	size_t xblocks = min<size_t>(GetComputeBlockCount(words, 64), ARB_MAX_X_BLOCKS);
+	size_t yblocks = GetComputeBlockCount(words, xblocks*64);
+	args.stride = xblocks*64;
+	args.mode = ArbitraryWaveformQuantizeArgs::MODE_QUANTIZE;
+	m_quantizePipeline->BindBufferNonblocking(0, m_samples, m_cmdBuf);
+	m_quantizePipeline->BindBufferNonblocking(1, m_ranges, m_cmdBuf);
+	m_quantizePipeline->BindBufferNonblocking(2, m_codes, m_cmdBuf, true);
+	m_quantizePipeline->Dispatch(m_cmdBuf, args, xblocks, yblocks);
+	m_codes.MarkModifiedFromGpu();
+
+	m_cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "arb quantize");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+
+	m_codes.PrepareForCpuAccess();
+	m_total = outLen;
+
+	//The copy of the source isn't needed any more
+	m_samples.clear();
+	m_samples.shrink_to_fit();
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+/**
+	@brief Fills in the placeholders of a command
+ */
+string ArbitraryWaveformUpload::ExpandCommand(const string& command, size_t offset, size_t count, bool last)
+{
+	const pair<string, string> subs[] =
+	{
+		{ "{ch}", to_string(m_channel + 1) },
+		{ "{offset}", to_string(offset) },
+		{ "{count}", to_string(count) },
+		{ "{last}", last ? "1" : "0" }
+	};
+
+	string ret = command;
+	for(auto& s : subs)
+	{
+		size_t pos = 0;
+		while( (pos = ret.find(s.first, pos)) != string::npos)
+		{
+			ret.replace(pos, s.first.length(), s.second);
+			pos += s.second.length();
+		}
+	}
+	return ret;
+}
+
+/**
+	@brief Stops the upload with an error
+ */
+void ArbitraryWaveformUpload::Fail(const string& err)
+{
+	LogError("Arbitrary waveform upload of %s failed: %s\n", m_source.c_str(), err.c_str());
+
+	lock_guard<mutex> lock(m_mutex);
+	m_error = err;
+	m_state = STATE_FAILED;
+}
@@ -0,0 +1,237 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ArbitraryWaveformUpload
+ */
+#ifndef ArbitraryWaveformUpload_h
+#define ArbitraryWaveformUpload_h
+
+///@brief Push constants for ArbitraryWaveformQuantize.glsl
+class ArbitraryWaveformQuantizeArgs
+{
+public:
+	enum Mode
+	{
+		///@brief Find the minimum and maximum of each thread's range of input samples
+		MODE_RANGE,
+
+		///@brief Resample and quantize to the output, two points per word
+		MODE_QUANTIZE
+	};
+
+	uint32_t inLen;
+	uint32_t outLen;
+	uint32_t samplesPerThread;
+	uint32_t numThreads;
+	uint32_t stride;
+	uint32_t mode;
+	uint32_t bigEndian;
+	float ratio;
+	float vmin;
+	float scale;
+	float codeMin;
+	float codeMax;
+};
+
+/**
+	@brief How a particular arbitrary waveform generator wants its sample data
+ */
+class ArbitraryWaveformFormat
+{
+public:
+	ArbitraryWaveformFormat()
+	: m_points(0)
+	, m_bits(14)
+	, m_signed(true)
+	, m_bigEndian(false)
+	, m_chunkPoints(65536)
+	, m_command("SOUR{ch}:TRAC:DATA {offset},")
+	, m_matchAmplitude(false)
+	{}
+
+	///@brief Number of points to resample to (zero to keep the source length)
+	size_t m_points;
+
+	///@brief DAC resolution, from 2 to 16 bits. Codes are always sent as 16-bit words.
+	int m_bits;
+
+	///@brief True for two's complement codes centered on zero, false for offset binary
+	bool m_signed;
+
+	///@brief True to send the most significant byte of each code first
+	bool m_bigEndian;
+
+	///@brief Number of points sent per command
+	size_t m_chunkPoints;
+
+	/**
+		@brief Command sent before the data block of each chunk
+
+		{ch} is replaced by the 1-based channel number, {offset} by the index of the first point in the chunk,
+		{count} by the number of points in it, and {last} by 1 for the final chunk and 0 otherwise.
+	 */
+	std::string m_command;
+
+	///@brief Command sent once every chunk is done, with the same substitutions (empty to send nothing)
+	std::string m_finishCommand;
+
+	///@brief True to set the channel's amplitude and offset to match the source once the upload is done
+	bool m_matchAmplitude;
+};
+
+/**
+	@brief Converts an analog waveform to a generator's sample format and sends it a chunk at a time
+
+	The source is copied when the upload is created, so the original can change or go away while it's in progress.
+	Resampling and quantization to codes are done by a compute shader, after which each chunk goes out as an IEEE
+	488.2 definite length block following the format's command. Chunks are only sent when Step() is called, so the
+	instrument thread can keep polling (and the GUI can keep sending commands) in between.
+
+	The full span of the source is mapped to the full code range; use the channel's amplitude and offset to set the
+	output in volts.
+ */
+class ArbitraryWaveformUpload
+{
+public:
+	ArbitraryWaveformUpload(
+		size_t channel,
+		const std::string& source,
+		UniformAnalogWaveform* wfm,
+		const ArbitraryWaveformFormat& format);
+
+	enum State
+	{
+		STATE_PENDING,
+		STATE_UPLOADING,
+		STATE_DONE,
+		STATE_FAILED,
+		STATE_CANCELLED
+	};
+
+	bool Step(SCPITransport* transport, FunctionGenerator* gen);
+
+	///@brief Requests that the upload stop before the next chunk
+	void Cancel()
+	{ m_cancel = true; }
+
+	///@brief Gets the current state of the upload
+	State GetState()
+	{ return m_state; }
+
+	///@brief Checks if the upload has finished, successfully or not
+	bool IsFinished()
+	{ return m_state >= STATE_DONE; }
+
+	///@brief Gets the generator channel being uploaded to
+	size_t GetChannel()
+	{ return m_channel; }
+
+	///@brief Gets a description of the source waveform, for display
+	const std::string& GetSource()
+	{ return m_source; }
+
+	///@brief Gets the number of points sent so far
+	size_t GetPointsSent()
+	{ return m_sent; }
+
+	///@brief Gets the number of points being sent (zero until the waveform has been converted)
+	size_t GetPointCount()
+	{ return m_total; }
+
+	///@brief Gets a description of what went wrong, if the upload failed
+	std::string GetError()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_error;
+	}
+
+protected:
+	bool Convert();
+	std::string ExpandCommand(const std::string& command, size_t offset, size_t count, bool last);
+	void Fail(const std::string& err);
+
+	///@brief Generator channel we're uploading to
+	size_t m_channel;
+
+	///@brief Description of the source waveform, for display
+	std::string m_source;
+
+	///@brief What the generator wants
+	ArbitraryWaveformFormat m_format;
+
+	///@brief Current state
+	std::atomic<State> m_state;
+
+	///@brief Set to stop before the next chunk
+	std::atomic<bool> m_cancel;
+
+	///@brief Number of points sent so far
+	std::atomic<size_t> m_sent;
+
+	///@brief Number of points to send
+	std::atomic<size_t> m_total;
+
+	///@brief Guards m_error
+	std::mutex m_mutex;
+
+	///@brief Description of what went wrong
+	std::string m_error;
+
+	///@brief Smallest source sample, in volts
+	float m_vmin;
+
+	///@brief Largest source sample, in volts
+	float m_vmax;
+
+	///@brief Copy of the source samples
+	AcceleratorBuffer<float> m_samples;
+
+	///@brief Minimum and maximum found by each thread of the range pass
+	AcceleratorBuffer<float> m_ranges;
+
+	///@brief Quantized codes, two per word, in the byte order the generator wants
+	AcceleratorBuffer<uint32_t> m_codes;
+
+	///@brief Queue for the conversion
+	std::shared_ptr<QueueHandle> m_queue;
+
+	///@brief Command pool for the conversion
+	vk::raii::CommandPool m_pool;
+
+	///@brief Command buffer for the conversion
+	vk::raii::CommandBuffer m_cmdBuf;
+
+	std::shared_ptr<ComputePipeline> m_quantizePipeline;
+};
+
+#endif
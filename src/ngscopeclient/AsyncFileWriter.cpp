@@ -0,0 +1,597 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of AsyncFileWriter
+ */
+
+#include "ngscopeclient.h"
+#include "AsyncFileWriter.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a writer with no file open
+
+	@param async	True to try the async backend, false to always use stdio
+ */
+AsyncFileWriter::AsyncFileWriter(bool async)
+	: m_open(false)
+	, m_asyncEnabled(async)
+	, m_ok(true)
+	, m_direct(false)
+	, m_fp(nullptr)
+	, m_pos(0)
+	, m_submitOffset(0)
+	, m_current(QUEUE_DEPTH)
+	, m_fill(0)
+	, m_pending(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_iocp(NULL)
+#elif defined(__linux__)
+	, m_fd(-1)
+	, m_ring(-1)
+	, m_ringMem(MAP_FAILED)
+	, m_ringMemSize(0)
+	, m_sqeMem(MAP_FAILED)
+	, m_sqeMemSize(0)
+	, m_sqHead(nullptr)
+	, m_sqTail(nullptr)
+	, m_sqMask(nullptr)
+	, m_sqArray(nullptr)
+	, m_cqHead(nullptr)
+	, m_cqTail(nullptr)
+	, m_cqMask(nullptr)
+	, m_cqes(nullptr)
+#endif
+{
+	for(size_t i=0; i<QUEUE_DEPTH; i++)
+	{
+		m_inFlight[i] = false;
+		m_submitLen[i] = 0;
+		m_submitPos[i] = 0;
+	}
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+	if(m_open)
+		Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public API
+
+/**
+	@brief Creates (or truncates) a file and opens it for writing
+
+	@return True on success
+ */
+bool AsyncFileWriter::Open(const string& path)
+{
+	if(m_open)
+		Close();
+
+	m_ok = true;
+	m_pos = 0;
+	m_submitOffset = 0;
+	m_current = QUEUE_DEPTH;
+	m_fill = 0;
+
+	if(m_asyncEnabled && OpenAsync(path))
+	{
+		m_open = true;
+		return true;
+	}
+
+	m_fp = fopen(path.c_str(), "wb");
+	m_open = (m_fp != nullptr);
+	return m_open;
+}
+
+/**
+	@brief Appends data to the file
+
+	The data is copied, so the caller's buffer can be reused as soon as this returns.
+
+	@return False if this or any previous write failed
+ */
+bool AsyncFileWriter::Write(const void* data, size_t len)
+{
+	if(!m_open)
+		return false;
+	if(len == 0)
+		return m_ok;
+
+	if(m_fp)
+	{
+		if(len != fwrite(data, 1, len, m_fp))
+			m_ok = false;
+		m_pos += len;
+		return m_ok;
+	}
+
+	auto src = static_cast<const uint8_t*>(data);
+	while(len && m_ok)
+	{
+		if(!AcquireBuffer())
+			break;
+
+		size_t chunk = min(len, BUFFER_SIZE - m_fill);
+		memcpy(m_staging.data() + m_current*BUFFER_SIZE + m_fill, src, chunk);
+		m_fill += chunk;
+		m_pos += chunk;
+		src += chunk;
+		len -= chunk;
+
+		if(m_fill == BUFFER_SIZE)
+			Submit(BUFFER_SIZE);
+	}
+
+	return m_ok;
+}
+
+/**
+	@brief Writes out anything still buffered, waits for all writes to complete, and closes the file
+
+	@return True if every write succeeded
+ */
+bool AsyncFileWriter::Close()
+{
+	if(!m_open)
+		return false;
+	m_open = false;
+
+	if(m_fp)
+	{
+		if(0 != fclose(m_fp))
+			m_ok = false;
+		m_fp = nullptr;
+		return m_ok;
+	}
+
+	//Direct I/O can only write whole blocks, so pad the tail with zeroes and truncate afterwards
+	if(m_fill)
+	{
+		size_t len = m_fill;
+		if(m_direct)
+		{
+			len = (m_fill + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+			memset(m_staging.data() + m_current*BUFFER_SIZE + m_fill, 0, len - m_fill);
+		}
+		Submit(len);
+	}
+
+	//If the backend stops delivering completions, waiting again won't help
+	while(m_pending)
+	{
+		if(!WaitForCompletion())
+		{
+			LogError("gave up waiting for %zu async writes to complete\n", m_pending);
+			m_ok = false;
+			break;
+		}
+	}
+
+	CloseAsync();
+	return m_ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Buffer management
+
+/**
+	@brief Makes sure there's a buffer to fill, waiting for a write to complete if all of them are in flight
+
+	@return False if no buffer could be freed up
+ */
+bool AsyncFileWriter::AcquireBuffer()
+{
+	if(m_current < QUEUE_DEPTH)
+		return true;
+
+	while(true)
+	{
+		for(size_t i=0; i<QUEUE_DEPTH; i++)
+		{
+			if(!m_inFlight[i])
+			{
+				m_current = i;
+				m_fill = 0;
+				return true;
+			}
+		}
+
+		if(!WaitForCompletion())
+			return false;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Backends
+
+#ifdef _WIN32
+
+/**
+	@brief Opens the file for unbuffered overlapped I/O, and creates its completion port
+ */
+bool AsyncFileWriter::OpenAsync(const string& path)
+{
+	m_file = CreateFileA(
+		path.c_str(),
+		GENERIC_WRITE,
+		0,
+		NULL,
+		CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING,
+		NULL);
+	if(m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_iocp = CreateIoCompletionPort(m_file, NULL, 0, 1);
+	if(!m_iocp)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	m_staging.resize(BUFFER_SIZE * QUEUE_DEPTH);
+	m_direct = true;
+	return true;
+}
+
+/**
+	@brief Starts writing the current buffer at the next file offset
+ */
+void AsyncFileWriter::Submit(size_t len)
+{
+	size_t i = m_current;
+	m_current = QUEUE_DEPTH;
+	m_fill = 0;
+
+	auto& ov = m_overlapped[i];
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = static_cast<DWORD>(m_submitOffset & 0xffffffff);
+	ov.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(m_submitOffset) >> 32);
+
+	m_submitLen[i] = len;
+	m_submitPos[i] = m_submitOffset;
+	m_submitOffset += len;
+
+	//Completions are posted to the port even if the write finishes immediately
+	if(!WriteFile(m_file, m_staging.data() + i*BUFFER_SIZE, static_cast<DWORD>(len), NULL, &ov) &&
+		(GetLastError() != ERROR_IO_PENDING) )
+	{
+		LogError("WriteFile failed (error %lu)\n", GetLastError());
+		m_ok = false;
+		return;
+	}
+
+	m_inFlight[i] = true;
+	m_pending ++;
+}
+
+/**
+	@brief Blocks until at least one write completes
+
+	@return False if nothing was in flight, or the wait failed
+ */
+bool AsyncFileWriter::WaitForCompletion()
+{
+	if(!m_pending)
+		return false;
+
+	DWORD bytes = 0;
+	ULONG_PTR key = 0;
+	OVERLAPPED* ov = nullptr;
+	BOOL ret = GetQueuedCompletionStatus(m_iocp, &bytes, &key, &ov, INFINITE);
+	if(!ov)
+	{
+		LogError("GetQueuedCompletionStatus failed (error %lu)\n", GetLastError());
+		m_ok = false;
+		return false;
+	}
+
+	size_t i = ov - m_overlapped;
+	m_inFlight[i] = false;
+	m_pending --;
+	if(!ret || (bytes != m_submitLen[i]) )
+	{
+		LogError("async write failed (error %lu)\n", GetLastError());
+		m_ok = false;
+	}
+	return true;
+}
+
+/**
+	@brief Trims off the padding from the last block and closes the file
+ */
+void AsyncFileWriter::CloseAsync()
+{
+	if(m_ok && (m_submitOffset != m_pos))
+	{
+		FILE_END_OF_FILE_INFO info;
+		info.EndOfFile.QuadPart = m_pos;
+		if(!SetFileInformationByHandle(m_file, FileEndOfFileInfo, &info, sizeof(info)))
+		{
+			LogError("couldn't truncate file (error %lu)\n", GetLastError());
+			m_ok = false;
+		}
+	}
+
+	CloseHandle(m_iocp);
+	CloseHandle(m_file);
+	m_iocp = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+#elif defined(__linux__)
+
+/**
+	@brief Opens the file (for direct I/O if the file system supports it) and sets up an io_uring for it
+ */
+bool AsyncFileWriter::OpenAsync(const string& path)
+{
+	//Not every file system supports direct I/O (e.g. tmpfs), but io_uring still beats stdio without it
+	m_direct = true;
+	m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+	if( (m_fd < 0) && (errno == EINVAL) )
+	{
+		m_direct = false;
+		m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+	if(m_fd < 0)
+		return false;
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	m_ring = syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params);
+	if(m_ring < 0)
+	{
+		//Kernel too old, or io_uring disabled by sysctl or seccomp. Fall back to stdio.
+		LogTrace("io_uring_setup failed (%s), using stdio\n", strerror(errno));
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	//Map the rings. Since 5.4 they share one mapping, before that the completion ring is separate, so only
+	//accept kernels which can do it in one (older ones fall back to stdio)
+	size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if(!(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		CloseAsync();
+		return false;
+	}
+	m_ringMemSize = max(sqSize, cqSize);
+	m_ringMem = mmap(nullptr, m_ringMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+		IORING_OFF_SQ_RING);
+	m_sqeMemSize = params.sq_entries * sizeof(io_uring_sqe);
+	m_sqeMem = mmap(nullptr, m_sqeMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+		IORING_OFF_SQES);
+	if( (m_ringMem == MAP_FAILED) || (m_sqeMem == MAP_FAILED) )
+	{
+		LogTrace("couldn't map io_uring (%s), using stdio\n", strerror(errno));
+		CloseAsync();
+		return false;
+	}
+
+	auto base = static_cast<uint8_t*>(m_ringMem);
+	m_sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+	m_sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+	m_sqMask = reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+	m_sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+	m_cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+	m_cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+	m_cqMask = reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+	m_cqes = base + params.cq_off.cqes;
+
+	m_staging.resize(BUFFER_SIZE * QUEUE_DEPTH);
+	return true;
+}
+
+/**
+	@brief Queues a write of the current buffer at the next file offset
+ */
+void AsyncFileWriter::Submit(size_t len)
+{
+	size_t i = m_current;
+	m_current = QUEUE_DEPTH;
+	m_fill = 0;
+
+	m_iovecs[i].iov_base = m_staging.data() + i*BUFFER_SIZE;
+	m_iovecs[i].iov_len = len;
+	m_submitLen[i] = len;
+	m_submitPos[i] = m_submitOffset;
+	m_submitOffset += len;
+
+	//We never have more writes in flight than the ring has entries, so there's always a free slot
+	unsigned tail = *m_sqTail;
+	unsigned index = tail & *m_sqMask;
+	auto sqe = static_cast<io_uring_sqe*>(m_sqeMem) + index;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = m_fd;
+	sqe->addr = reinterpret_cast<uint64_t>(&m_iovecs[i]);
+	sqe->len = 1;
+	sqe->off = m_submitPos[i];
+	sqe->user_data = i;
+	m_sqArray[index] = index;
+	__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	if(syscall(__NR_io_uring_enter, m_ring, 1, 0, 0, nullptr, 0) < 0)
+	{
+		LogError("io_uring_enter failed: %s\n", strerror(errno));
+		m_ok = false;
+		return;
+	}
+
+	m_inFlight[i] = true;
+	m_pending ++;
+}
+
+/**
+	@brief Blocks until at least one write completes, then handles every completion which is ready
+
+	@return False if nothing was in flight, or the wait failed
+ */
+bool AsyncFileWriter::WaitForCompletion()
+{
+	if(!m_pending)
+		return false;
+
+	unsigned head = *m_cqHead;
+	if(head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+	{
+		if(syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+		{
+			if(errno == EINTR)
+				return true;
+			LogError("io_uring_enter failed: %s\n", strerror(errno));
+			m_ok = false;
+			return false;
+		}
+	}
+
+	auto cqes = static_cast<io_uring_cqe*>(m_cqes);
+	while(head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+	{
+		auto& cqe = cqes[head & *m_cqMask];
+		size_t i = cqe.user_data;
+		head ++;
+
+		m_inFlight[i] = false;
+		m_pending --;
+		if(cqe.res < 0)
+		{
+			LogError("async write failed: %s\n", strerror(-cqe.res));
+			m_ok = false;
+			continue;
+		}
+
+		//Regular files don't normally do short writes, but finish the job synchronously if one does.
+		//The rest of the buffer is unlikely to be aligned any more, so stop using direct I/O for it.
+		size_t done = cqe.res;
+		if(m_direct && (done < m_submitLen[i]) )
+		{
+			int flags = fcntl(m_fd, F_GETFL);
+			if( (flags < 0) || (0 != fcntl(m_fd, F_SETFL, flags & ~O_DIRECT)) )
+			{
+				LogError("couldn't turn off direct I/O after a short write: %s\n", strerror(errno));
+				m_ok = false;
+			}
+			else
+				m_direct = false;
+		}
+		while(m_ok && (done < m_submitLen[i]) )
+		{
+			auto ret = pwrite(
+				m_fd,
+				m_staging.data() + i*BUFFER_SIZE + done,
+				m_submitLen[i] - done,
+				m_submitPos[i] + done);
+			if(ret <= 0)
+			{
+				LogError("async write failed: %s\n", strerror(errno));
+				m_ok = false;
+			}
+			else
+				done += ret;
+		}
+	}
+	__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+/**
+	@brief Trims off the padding from the last block, closes the file and tears down the ring
+ */
+void AsyncFileWriter::CloseAsync()
+{
+	if( (m_fd >= 0) && m_ok && (m_submitOffset != m_pos) && (0 != ftruncate(m_fd, m_pos)) )
+	{
+		LogError("couldn't truncate file: %s\n", strerror(errno));
+		m_ok = false;
+	}
+
+	if(m_sqeMem != MAP_FAILED)
+		munmap(m_sqeMem, m_sqeMemSize);
+	if(m_ringMem != MAP_FAILED)
+		munmap(m_ringMem, m_ringMemSize);
+	m_sqeMem = MAP_FAILED;
+	m_ringMem = MAP_FAILED;
+
+	if(m_ring >= 0)
+		close(m_ring);
+	if(m_fd >= 0)
+		close(m_fd);
+	m_ring = -1;
+	m_fd = -1;
+}
+
+#else
+
+//No async backend, always use stdio
+
+bool AsyncFileWriter::OpenAsync(const string& /*path*/)
+{
+	return false;
+}
+
+void AsyncFileWriter::Submit(size_t /*len*/)
+{
+}
+
+bool AsyncFileWriter::WaitForCompletion()
+{
+	return false;
+}
+
+void AsyncFileWriter::CloseAsync()
+{
+}
+
+#endif
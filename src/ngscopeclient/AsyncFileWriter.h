@@ -0,0 +1,180 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of AsyncFileWriter
+ */
+#ifndef AsyncFileWriter_h
+#define AsyncFileWriter_h
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/uio.h>
+#endif
+
+/**
+	@brief Sequential file writer which keeps several writes in flight, bypassing the page cache where possible
+
+	Data passed to Write() is copied into a small set of aligned staging buffers. Each buffer is submitted as soon as
+	it fills, and Write() only blocks when all of them are in flight, so packing the next block of a file overlaps
+	with writing the last one. Files are opened for direct I/O (O_DIRECT / FILE_FLAG_NO_BUFFERING), so multi-GB saves
+	don't evict everything else from the page cache. The last buffer is padded out to the alignment and the file
+	truncated back to its real length on Close().
+
+	Backends are io_uring on Linux and overlapped I/O with a completion port on Windows. If the platform doesn't
+	support either, the file system doesn't support direct I/O and the async backend can't be set up either, or
+	async writes are disabled, this falls back to plain stdio.
+
+	Each writer must only be used from one thread at a time.
+ */
+class AsyncFileWriter
+{
+public:
+	AsyncFileWriter(bool async = true);
+	~AsyncFileWriter();
+
+	AsyncFileWriter(const AsyncFileWriter&) = delete;
+	AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+	bool Open(const std::string& path);
+	bool Write(const void* data, size_t len);
+	bool Close();
+
+	///@brief Returns true if a file is open
+	bool IsOpen() const
+	{ return m_open; }
+
+	///@brief Returns true if writes are going through the async backend rather than stdio
+	bool IsAsync() const
+	{ return m_open && !m_fp; }
+
+	///@brief Gets the number of bytes written (or queued to be written) so far
+	size_t GetPosition() const
+	{ return m_pos; }
+
+	///@brief Size of each staging buffer
+	static const size_t BUFFER_SIZE = 1024 * 1024;
+
+	///@brief Number of staging buffers, and so the maximum number of writes in flight
+	static const size_t QUEUE_DEPTH = 4;
+
+	///@brief Alignment of buffers, lengths and offsets for direct I/O
+	static const size_t ALIGNMENT = 4096;
+
+protected:
+	bool OpenAsync(const std::string& path);
+	bool AcquireBuffer();
+	void Submit(size_t len);
+	bool WaitForCompletion();
+	void CloseAsync();
+
+	///@brief True if a file is open
+	bool m_open;
+
+	///@brief True if we should try the async backend before falling back to stdio
+	bool m_asyncEnabled;
+
+	///@brief True if no write has failed since the file was opened
+	bool m_ok;
+
+	///@brief True if the file was opened for direct I/O, so writes must be aligned
+	bool m_direct;
+
+	///@brief Stdio handle, if we fell back to it
+	FILE* m_fp;
+
+	///@brief Bytes accepted by Write() so far
+	size_t m_pos;
+
+	///@brief File offset the next submitted buffer will be written to
+	size_t m_submitOffset;
+
+	///@brief Staging memory, QUEUE_DEPTH buffers of BUFFER_SIZE bytes each
+	std::vector<uint8_t, AlignedAllocator<uint8_t, ALIGNMENT> > m_staging;
+
+	///@brief Index of the buffer being filled, or QUEUE_DEPTH if we don't have one
+	size_t m_current;
+
+	///@brief Number of bytes in the buffer being filled
+	size_t m_fill;
+
+	///@brief True for each buffer which has been submitted but hasn't completed yet
+	bool m_inFlight[QUEUE_DEPTH];
+
+	///@brief Length of the write submitted for each buffer
+	size_t m_submitLen[QUEUE_DEPTH];
+
+	///@brief File offset of the write submitted for each buffer
+	size_t m_submitPos[QUEUE_DEPTH];
+
+	///@brief Number of writes in flight
+	size_t m_pending;
+
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_iocp;
+	OVERLAPPED m_overlapped[QUEUE_DEPTH];
+#elif defined(__linux__)
+	int m_fd;
+
+	///@brief The io_uring instance, or -1 if not set up
+	int m_ring;
+
+	///@brief Mapping of the submission and completion rings
+	void* m_ringMem;
+	size_t m_ringMemSize;
+
+	///@brief Mapping of the submission queue entries
+	void* m_sqeMem;
+	size_t m_sqeMemSize;
+
+	//Pointers into the rings
+	unsigned* m_sqHead;
+	unsigned* m_sqTail;
+	unsigned* m_sqMask;
+	unsigned* m_sqArray;
+	unsigned* m_cqHead;
+	unsigned* m_cqTail;
+	unsigned* m_cqMask;
+	void* m_cqes;
+
+	///@brief Scatter list for each buffer's write
+	iovec m_iovecs[QUEUE_DEPTH];
+#endif
+};
+
+#endif
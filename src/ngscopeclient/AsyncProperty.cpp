@@ -0,0 +1,123 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of InstrumentReadQueue
+ */
+#include "ngscopeclient.h"
+
+using namespace std;
+
+/**
+	@brief Reads waiting to run on one instrument's polling thread
+ */
+class InstrumentReadQueueEntry
+{
+public:
+	///@brief Signaled to wake the polling thread when a read is queued
+	Event* m_wakeEvent;
+
+	///@brief Queued reads, oldest first
+	deque< function<void()> > m_jobs;
+};
+
+///@brief Mutex controlling access to g_readQueues
+static mutex g_readQueueMutex;
+
+///@brief Queued reads for each instrument which has a polling thread
+static map<Instrument*, InstrumentReadQueueEntry> g_readQueues;
+
+/**
+	@brief Starts accepting reads for an instrument
+
+	Called by the instrument's polling thread when it starts up.
+
+	@param inst			The instrument
+	@param wakeEvent	Event to signal to wake the polling thread early (may be null)
+ */
+void InstrumentReadQueue::Register(Instrument* inst, Event* wakeEvent)
+{
+	lock_guard<mutex> lock(g_readQueueMutex);
+	g_readQueues[inst].m_wakeEvent = wakeEvent;
+}
+
+/**
+	@brief Stops accepting reads for an instrument, discarding anything still queued
+
+	Called by the instrument's polling thread when it shuts down. Reads which were discarded are never completed, so
+	their properties just keep the last known value.
+ */
+void InstrumentReadQueue::Unregister(Instrument* inst)
+{
+	lock_guard<mutex> lock(g_readQueueMutex);
+	g_readQueues.erase(inst);
+}
+
+/**
+	@brief Queues a read to run on an instrument's polling thread
+
+	@return False if the instrument has no polling thread, in which case the caller should run the read itself
+ */
+bool InstrumentReadQueue::Post(Instrument* inst, function<void()> job)
+{
+	lock_guard<mutex> lock(g_readQueueMutex);
+	auto it = g_readQueues.find(inst);
+	if(it == g_readQueues.end())
+		return false;
+
+	it->second.m_jobs.push_back(job);
+	if(it->second.m_wakeEvent)
+		it->second.m_wakeEvent->Signal();
+	return true;
+}
+
+/**
+	@brief Runs all reads queued for an instrument
+
+	Must be called from the instrument's polling thread.
+
+	@return True if any reads were run
+ */
+bool InstrumentReadQueue::RunPending(Instrument* inst)
+{
+	deque< function<void()> > jobs;
+	{
+		lock_guard<mutex> lock(g_readQueueMutex);
+		auto it = g_readQueues.find(inst);
+		if(it == g_readQueues.end())
+			return false;
+		jobs.swap(it->second.m_jobs);
+	}
+
+	for(auto& job : jobs)
+		job();
+	return !jobs.empty();
+}
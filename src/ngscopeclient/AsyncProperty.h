@@ -0,0 +1,171 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of AsyncProperty and InstrumentReadQueue
+ */
+#ifndef AsyncProperty_h
+#define AsyncProperty_h
+
+#include <deque>
+#include <functional>
+
+///@brief Default minimum time between refreshes of an AsyncProperty, in seconds
+#define ASYNC_PROPERTY_DEFAULT_INTERVAL 0.25
+
+class Event;
+
+/**
+	@brief Runs instrument queries queued by the GUI on the instrument's own polling thread
+
+	If a driver's cache misses, reading a setting means a round trip to the instrument, which can take hundreds of ms.
+	Queueing the read here lets the GUI keep rendering with the last known value in the meantime.
+ */
+class InstrumentReadQueue
+{
+public:
+	static void Register(Instrument* inst, Event* wakeEvent);
+	static void Unregister(Instrument* inst);
+
+	static bool Post(Instrument* inst, std::function<void()> job);
+	static bool RunPending(Instrument* inst);
+};
+
+/**
+	@brief State shared between an AsyncProperty and any read of it which is still queued
+ */
+template<class T>
+class AsyncPropertyState
+{
+public:
+	AsyncPropertyState(T value)
+	: m_value(value)
+	, m_pending(false)
+	, m_generation(0)
+	{}
+
+	std::mutex m_mutex;
+
+	///@brief Last value read from the instrument
+	T m_value;
+
+	///@brief True if a read is queued or in progress
+	bool m_pending;
+
+	///@brief Incremented by Set() so reads issued before the change don't overwrite it
+	uint64_t m_generation;
+};
+
+/**
+	@brief An instrument setting displayed by the GUI, which is read in the background
+
+	Get() always returns immediately with the last known value. Call Refresh() every frame the value is displayed
+	to have it re-read on the instrument's thread (rate limited, and at most one read in flight at a time). The GUI is
+	woken up when the read completes.
+ */
+template<class T>
+class AsyncProperty
+{
+public:
+	AsyncProperty(T value = T(), double interval = ASYNC_PROPERTY_DEFAULT_INTERVAL)
+	: m_state(std::make_shared<AsyncPropertyState<T>>(value))
+	, m_interval(interval)
+	, m_lastRequest(0)
+	{}
+
+	/**
+		@brief Gets the last known value
+	 */
+	T Get()
+	{
+		std::lock_guard<std::mutex> lock(m_state->m_mutex);
+		return m_state->m_value;
+	}
+
+	/**
+		@brief Replaces the last known value, e.g. after the GUI has pushed a new setting to the instrument
+
+		Any read which was already in flight when this is called is discarded when it completes.
+	 */
+	void Set(T value)
+	{
+		std::lock_guard<std::mutex> lock(m_state->m_mutex);
+		m_state->m_value = value;
+		m_state->m_generation ++;
+	}
+
+	/**
+		@brief Requests an updated value, if the last one is old enough and no read is already in flight
+
+		@param inst		The instrument to read from. If it has no polling thread (or is null, e.g. for filters),
+						the value is read right away.
+		@param fetch	Function reading the value from the instrument
+	 */
+	void Refresh(Instrument* inst, std::function<T()> fetch)
+	{
+		double now = GetTime();
+		if( (now - m_lastRequest) < m_interval)
+			return;
+		uint64_t generation;
+		{
+			std::lock_guard<std::mutex> lock(m_state->m_mutex);
+			if(m_state->m_pending)
+				return;
+			m_state->m_pending = true;
+			generation = m_state->m_generation;
+		}
+		m_lastRequest = now;
+
+		auto state = m_state;
+		auto job = [state, fetch, generation]()
+		{
+			T value = fetch();
+			std::lock_guard<std::mutex> lock(state->m_mutex);
+			if(state->m_generation == generation)
+				state->m_value = value;
+			state->m_pending = false;
+		};
+		if(!inst || !InstrumentReadQueue::Post(inst, job))
+			job();
+	}
+
+protected:
+	///@brief Value and read status, shared with any queued read so it's safe to destroy us while one is pending
+	std::shared_ptr<AsyncPropertyState<T>> m_state;
+
+	///@brief Minimum time between refreshes, in seconds
+	double m_interval;
+
+	///@brief Time of the last refresh request
+	double m_lastRequest;
+};
+
+#endif
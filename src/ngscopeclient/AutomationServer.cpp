@@ -0,0 +1,730 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of AutomationServer
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "AutomationServer.h"
+#include "MainWindow.h"
+#include "Session.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+
+///@brief Longest line a client may send before we give up on it
+#define AUTOMATION_MAX_LINE (1024 * 1024)
+
+///@brief How long WAIT blocks for if no timeout is given, in seconds
+#define AUTOMATION_DEFAULT_WAIT 10.0
+
+/**
+	@brief Shuts down a socket, waking up anything blocked on it
+ */
+static void ShutdownSocket(ZSOCKET fd)
+{
+	#ifdef _WIN32
+		shutdown(fd, SD_BOTH);
+	#else
+		shutdown(fd, SHUT_RDWR);
+	#endif
+}
+
+/**
+	@brief Formats a timestamp as seconds.femtoseconds
+ */
+static string FormatTimePoint(TimePoint t)
+{
+	char tmp[64];
+	snprintf(tmp, sizeof(tmp), "%lld.%015lld", (long long)t.first, (long long)t.second);
+	return tmp;
+}
+
+/**
+	@brief Removes leading and trailing whitespace, then a pair of surrounding double quotes if there is one
+ */
+static string TrimArgument(const string& str)
+{
+	size_t start = str.find_first_not_of(" \t");
+	if(start == string::npos)
+		return "";
+	size_t end = str.find_last_not_of(" \t");
+	string ret = str.substr(start, end - start + 1);
+
+	if( (ret.length() >= 2) && (ret[0] == '"') && (ret.back() == '"') )
+		ret = ret.substr(1, ret.length() - 2);
+	return ret;
+}
+
+/**
+	@brief Splits a line into commands at semicolons which aren't inside double quotes
+ */
+static vector<AutomationCommand> ParseLine(const string& line)
+{
+	vector<string> pieces;
+	string cur;
+	bool quoted = false;
+	for(auto c : line)
+	{
+		if(c == '"')
+			quoted = !quoted;
+		if( (c == ';') && !quoted)
+		{
+			pieces.push_back(cur);
+			cur.clear();
+		}
+		else
+			cur += c;
+	}
+	pieces.push_back(cur);
+
+	vector<AutomationCommand> ret;
+	for(auto& p : pieces)
+	{
+		string s = TrimArgument(p);
+		if(s.empty())
+			continue;
+
+		AutomationCommand cmd;
+		size_t space = s.find_first_of(" \t");
+		cmd.m_keyword = s.substr(0, space);
+		for(auto& c : cmd.m_keyword)
+			c = toupper(c);
+		if(space != string::npos)
+			cmd.m_arg = TrimArgument(s.substr(space));
+		ret.push_back(cmd);
+	}
+	return ret;
+}
+
+/**
+	@brief Looks up a channel or filter stream by name
+
+	@return False if there's no stream with that name
+ */
+static bool FindStream(Session& session, const string& name, StreamDescriptor& stream)
+{
+	for(auto scope : session.GetScopes())
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan)
+				continue;
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				StreamDescriptor s(chan, j);
+				if(s.GetName() == name)
+				{
+					stream = s;
+					return true;
+				}
+			}
+		}
+	}
+
+	for(auto f : Filter::GetAllInstances())
+	{
+		for(size_t j=0; j<f->GetStreamCount(); j++)
+		{
+			StreamDescriptor s(f, j);
+			if(s.GetName() == name)
+			{
+				stream = s;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts listening for automation clients
+
+	@param port	TCP port to listen on
+ */
+AutomationServer::AutomationServer(uint16_t port)
+	: m_port(port)
+	, m_listener(AF_INET6, SOCK_STREAM, IPPROTO_TCP)
+	, m_acquisitionCount(0)
+	, m_lastAcquisition(0, 0)
+	, m_clientCount(0)
+	, m_shuttingDown(false)
+{
+	if(!m_listener.Bind(port) || !m_listener.Listen())
+	{
+		LogError("Automation server failed to listen on port %u\n", port);
+		return;
+	}
+
+	LogNotice("Automation server listening on port %u\n", port);
+	m_listenThread = make_unique<thread>(&AutomationServer::ListenThreadProc, this);
+	m_eventThread = make_unique<thread>(&AutomationServer::EventThreadProc, this);
+}
+
+/**
+	@brief Disconnects all clients and stops listening
+
+	Must be called from the GUI thread, so no job is being run while we tear down.
+ */
+AutomationServer::~AutomationServer()
+{
+	m_shuttingDown = true;
+
+	//Stop accepting new connections
+	ShutdownSocket((ZSOCKET)m_listener);
+	if(m_listenThread)
+		m_listenThread->join();
+	m_listener.Close();
+
+	//Kick off everyone who's already connected, and wake up anyone waiting on a job or an acquisition
+	{
+		lock_guard<mutex> lock(m_clientMutex);
+		for(auto& c : m_clients)
+			ShutdownSocket(c->m_fd);
+	}
+	{
+		lock_guard<mutex> lock(m_jobMutex);
+		m_jobDoneCond.notify_all();
+	}
+	{
+		lock_guard<mutex> lock(m_acquisitionMutex);
+		m_acquisitionCond.notify_all();
+	}
+
+	for(auto& t : m_clientThreads)
+		t.join();
+	if(m_eventThread)
+		m_eventThread->join();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GUI thread interface
+
+/**
+	@brief Counts a new acquisition, waking up WAIT commands and subscribed clients
+
+	Must be called from the GUI thread.
+ */
+void AutomationServer::OnNewPoint(shared_ptr<HistoryPoint> pt)
+{
+	lock_guard<mutex> lock(m_acquisitionMutex);
+	m_acquisitionCount ++;
+	m_lastAcquisition = pt->m_time;
+	m_acquisitionCond.notify_all();
+}
+
+/**
+	@brief Runs every job the clients have queued up
+
+	Must be called from the GUI thread once per frame.
+ */
+void AutomationServer::RunPendingJobs(Session& session)
+{
+	deque<shared_ptr<AutomationJob> > jobs;
+	{
+		lock_guard<mutex> lock(m_jobMutex);
+		jobs.swap(m_jobs);
+	}
+	if(jobs.empty())
+		return;
+
+	for(auto& job : jobs)
+	{
+		for(auto& cmd : job->m_commands)
+			job->m_replies.push_back(ExecuteOnGuiThread(cmd, session));
+
+		//Acquisitions are only committed on this thread, so nothing can sneak in between the last command and this
+		lock_guard<mutex> lock(m_acquisitionMutex);
+		job->m_acquisitionCount = m_acquisitionCount;
+	}
+
+	lock_guard<mutex> lock(m_jobMutex);
+	for(auto& job : jobs)
+		job->m_done = true;
+	m_jobDoneCond.notify_all();
+}
+
+/**
+	@brief Runs one command which touches the session
+
+	@return The reply to the command
+ */
+string AutomationServer::ExecuteOnGuiThread(const AutomationCommand& cmd, Session& session)
+{
+	auto& kw = cmd.m_keyword;
+
+	if(kw == "ARM")
+	{
+		string mode = cmd.m_arg;
+		for(auto& c : mode)
+			c = toupper(c);
+
+		TriggerGroup::TriggerType type;
+		if( (mode == "") || (mode == "NORMAL") )
+			type = TriggerGroup::TRIGGER_TYPE_NORMAL;
+		else if(mode == "SINGLE")
+			type = TriggerGroup::TRIGGER_TYPE_SINGLE;
+		else if(mode == "AUTO")
+			type = TriggerGroup::TRIGGER_TYPE_AUTO;
+		else if(mode == "FORCE")
+			type = TriggerGroup::TRIGGER_TYPE_FORCED;
+		else
+			return "ERR unknown trigger mode " + cmd.m_arg;
+
+		session.ArmTrigger(type, true);
+		return "OK";
+	}
+
+	else if(kw == "STOP")
+	{
+		session.StopTrigger(true);
+		return "OK";
+	}
+
+	else if(kw == "HIST?")
+		return to_string(session.GetHistory().m_history.size());
+
+	else if(kw == "HIST:LAST?")
+	{
+		auto& history = session.GetHistory();
+		if(history.m_history.empty())
+			return "ERR history is empty";
+		return FormatTimePoint(history.GetMostRecentPoint());
+	}
+
+	else if(kw == "STREAMS?")
+	{
+		string ret;
+		auto add = [&](FlowGraphNode* node, size_t nstreams)
+		{
+			for(size_t j=0; j<nstreams; j++)
+			{
+				if(!ret.empty())
+					ret += ",";
+				ret += StreamDescriptor(node, j).GetName();
+			}
+		};
+
+		for(auto scope : session.GetScopes())
+		{
+			for(size_t i=0; i<scope->GetChannelCount(); i++)
+			{
+				auto chan = scope->GetOscilloscopeChannel(i);
+				if(chan)
+					add(chan, chan->GetStreamCount());
+			}
+		}
+		for(auto f : Filter::GetAllInstances())
+			add(f, f->GetStreamCount());
+		return ret;
+	}
+
+	else if( (kw == "MEAS?") || (kw == "MEAS:STATS?") )
+	{
+		StreamDescriptor stream;
+		if(!FindStream(session, cmd.m_arg, stream))
+			return "ERR no stream named " + cmd.m_arg;
+		if(stream.GetType() != Stream::STREAM_TYPE_ANALOG_SCALAR)
+			return "ERR " + cmd.m_arg + " is not a scalar stream";
+
+		if(kw == "MEAS?")
+		{
+			char tmp[64];
+			snprintf(tmp, sizeof(tmp), "%.9g", stream.GetScalarValue());
+			return tmp;
+		}
+
+		//Start tracking on the first query, so clients don't need to know which streams the GUI is watching
+		MeasurementSummary summary;
+		if(!session.GetMeasurementSummary(stream, summary, 0))
+		{
+			session.TrackMeasurementStatistics(stream);
+			return "0,nan,nan,nan,nan";
+		}
+
+		char tmp[256];
+		snprintf(tmp, sizeof(tmp), "%zu,%.9g,%.9g,%.9g,%.9g",
+			(size_t)summary.m_count, summary.m_mean, summary.m_stdev, summary.m_min, summary.m_max);
+		return tmp;
+	}
+
+	else if(kw == "PACKETS?")
+	{
+		for(auto f : Filter::GetAllInstances())
+		{
+			auto pd = dynamic_cast<PacketDecoder*>(f);
+			if(!pd || (pd->GetDisplayName() != cmd.m_arg) )
+				continue;
+
+			auto mgr = session.GetPacketManager(pd);
+			if(!mgr)
+				return "0";
+
+			lock_guard<recursive_mutex> lock(mgr->GetMutex());
+			size_t count = 0;
+			for(auto& it : mgr->GetPackets())
+				count += it.second.size();
+			return to_string(count);
+		}
+		return "ERR no protocol decoder named " + cmd.m_arg;
+	}
+
+	else if(kw == "SAVE")
+	{
+		auto wnd = session.GetMainWindow();
+		if(!wnd)
+			return "ERR no main window";
+		if(cmd.m_arg.empty())
+			return "ERR no file name given";
+		wnd->DoSaveFile(cmd.m_arg);
+		return "OK";
+	}
+
+	return "ERR unknown command " + kw;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Network threads
+
+/**
+	@brief Checks whether a command has to be run on the GUI thread
+ */
+bool AutomationServer::IsGuiCommand(const string& keyword)
+{
+	static const set<string> guiCommands =
+	{
+		"ARM",
+		"STOP",
+		"HIST?",
+		"HIST:LAST?",
+		"STREAMS?",
+		"MEAS?",
+		"MEAS:STATS?",
+		"PACKETS?",
+		"SAVE"
+	};
+	return guiCommands.find(keyword) != guiCommands.end();
+}
+
+/**
+	@brief Sends one line to a client
+
+	@return False if the client has gone away
+ */
+bool AutomationServer::SendLine(AutomationClient& client, const string& line)
+{
+	lock_guard<mutex> lock(client.m_sendMutex);
+	if(client.m_closed)
+		return false;
+
+	size_t sent = 0;
+	while(sent < line.length())
+	{
+		auto n = send(client.m_fd, line.c_str() + sent, line.length() - sent, MSG_NOSIGNAL);
+		if(n <= 0)
+			return false;
+		sent += n;
+	}
+	return true;
+}
+
+/**
+	@brief Thread function accepting new client connections
+ */
+void AutomationServer::ListenThreadProc()
+{
+	pthread_setname_np_compat("AutomationListen");
+
+	while(!m_shuttingDown)
+	{
+		Socket sock = m_listener.Accept();
+		if(!sock.IsValid() || m_shuttingDown)
+			break;
+		if(!sock.DisableNagle())
+			LogWarning("Failed to disable Nagle on automation socket\n");
+
+		LogNotice("Automation client connected\n");
+
+		auto client = make_shared<AutomationClient>(sock.Detach());
+		{
+			lock_guard<mutex> lock(m_clientMutex);
+			m_clients.emplace(client);
+		}
+		m_clientThreads.push_back(thread(&AutomationServer::ClientThreadProc, this, client));
+	}
+}
+
+/**
+	@brief Thread function running commands from one client until it disconnects
+ */
+void AutomationServer::ClientThreadProc(shared_ptr<AutomationClient> client)
+{
+	pthread_setname_np_compat("AutomationClient");
+	m_clientCount ++;
+
+	{
+		Socket sock(client->m_fd, AF_INET6);
+
+		string pending;
+		char buf[4096];
+		while(!m_shuttingDown)
+		{
+			auto len = recv(client->m_fd, buf, sizeof(buf), 0);
+			if(len <= 0)
+				break;
+			pending.append(buf, len);
+
+			//Run every complete line we have
+			bool ok = true;
+			size_t start = 0;
+			for(size_t nl; ok && ((nl = pending.find('\n', start)) != string::npos); start = nl + 1)
+			{
+				string line = pending.substr(start, nl - start);
+				if(!line.empty() && (line.back() == '\r'))
+					line.pop_back();
+				if(line.find_first_not_of(" \t") == string::npos)
+					continue;
+
+				ok = SendLine(*client, ExecuteLine(line, *client) + "\n");
+			}
+			pending.erase(0, start);
+
+			if(!ok)
+				break;
+			if(pending.length() > AUTOMATION_MAX_LINE)
+			{
+				LogWarning("Automation client sent a line longer than %d bytes, disconnecting\n", AUTOMATION_MAX_LINE);
+				break;
+			}
+		}
+
+		//Once we're out of the list and marked closed, nobody else will touch the socket, so it's safe to close
+		{
+			lock_guard<mutex> lock(m_clientMutex);
+			m_clients.erase(client);
+		}
+		lock_guard<mutex> lock(client->m_sendMutex);
+		client->m_closed = true;
+	}
+
+	m_clientCount --;
+	LogNotice("Automation client disconnected\n");
+}
+
+/**
+	@brief Runs every command on a line, in order
+
+	Runs of commands which need the GUI thread go over as a single job, so they all happen in the same frame.
+
+	@return The reply line, without the trailing newline
+ */
+string AutomationServer::ExecuteLine(const string& line, AutomationClient& client)
+{
+	auto commands = ParseLine(line);
+
+	//WAIT counts acquisitions from the end of whatever ran before it
+	uint64_t baseline;
+	{
+		lock_guard<mutex> lock(m_acquisitionMutex);
+		baseline = m_acquisitionCount;
+	}
+
+	vector<string> replies;
+	size_t i = 0;
+	while(i < commands.size())
+	{
+		if(!IsGuiCommand(commands[i].m_keyword))
+		{
+			replies.push_back(ExecuteLocal(commands[i], client, baseline));
+			i++;
+			continue;
+		}
+
+		auto job = make_shared<AutomationJob>();
+		while( (i < commands.size()) && IsGuiCommand(commands[i].m_keyword) )
+		{
+			job->m_commands.push_back(commands[i]);
+			i++;
+		}
+
+		if(RunJob(job))
+		{
+			replies.insert(replies.end(), job->m_replies.begin(), job->m_replies.end());
+			baseline = job->m_acquisitionCount;
+		}
+		else
+		{
+			for(size_t j=0; j<job->m_commands.size(); j++)
+				replies.push_back("ERR shutting down");
+		}
+	}
+
+	string ret;
+	for(size_t j=0; j<replies.size(); j++)
+	{
+		if(j > 0)
+			ret += ";";
+		ret += replies[j];
+	}
+	return ret;
+}
+
+/**
+	@brief Hands a job to the GUI thread and waits for it to be run
+
+	@return False if we started shutting down before the job ran
+ */
+bool AutomationServer::RunJob(shared_ptr<AutomationJob> job)
+{
+	{
+		lock_guard<mutex> lock(m_jobMutex);
+		m_jobs.push_back(job);
+	}
+
+	//The GUI may be idle waiting for input, so make sure it gets around to running us
+	WakeEventLoop();
+
+	unique_lock<mutex> lock(m_jobMutex);
+	m_jobDoneCond.wait(lock, [&]{ return job->m_done || m_shuttingDown; });
+	return job->m_done;
+}
+
+/**
+	@brief Runs one command which doesn't touch the session, on the client's own thread
+
+	@param cmd		The command
+	@param client	The client which sent it
+	@param baseline	Acquisition count WAIT counts from, updated when a WAIT finishes
+
+	@return The reply to the command
+ */
+string AutomationServer::ExecuteLocal(const AutomationCommand& cmd, AutomationClient& client, uint64_t& baseline)
+{
+	auto& kw = cmd.m_keyword;
+
+	if(kw == "*IDN?")
+		return string("ngscopeclient,") + NGSCOPECLIENT_VERSION;
+
+	else if(kw == "ACQ?")
+	{
+		lock_guard<mutex> lock(m_acquisitionMutex);
+		return to_string(m_acquisitionCount);
+	}
+
+	else if(kw == "WAIT")
+	{
+		char* end;
+		auto count = strtoull(cmd.m_arg.c_str(), &end, 10);
+		double timeout = AUTOMATION_DEFAULT_WAIT;
+		if(*end != '\0')
+			timeout = strtod(end, nullptr);
+
+		uint64_t target = baseline + count;
+		auto deadline = chrono::steady_clock::now() + chrono::duration<double>(timeout);
+
+		unique_lock<mutex> lock(m_acquisitionMutex);
+		bool ok = m_acquisitionCond.wait_until(lock, deadline,
+			[&]{ return (m_acquisitionCount >= target) || m_shuttingDown; });
+		if(m_shuttingDown)
+			return "ERR shutting down";
+		if(!ok)
+			return "ERR timed out after " + to_string(m_acquisitionCount - baseline) + " acquisitions";
+
+		baseline = m_acquisitionCount;
+		return to_string(m_acquisitionCount);
+	}
+
+	else if(kw == "SUBSCRIBE")
+	{
+		client.m_subscribed = true;
+		return "OK";
+	}
+
+	else if(kw == "UNSUBSCRIBE")
+	{
+		client.m_subscribed = false;
+		return "OK";
+	}
+
+	return "ERR unknown command " + kw;
+}
+
+/**
+	@brief Thread function pushing acquisition events to subscribed clients
+
+	Only the newest acquisition is sent each time we wake up, so a client that can't keep up sees gaps in the count
+	rather than an ever growing backlog.
+ */
+void AutomationServer::EventThreadProc()
+{
+	pthread_setname_np_compat("AutomationEvents");
+
+	uint64_t sent = 0;
+	while(true)
+	{
+		TimePoint t;
+		{
+			unique_lock<mutex> lock(m_acquisitionMutex);
+			m_acquisitionCond.wait(lock, [&]{ return m_shuttingDown || (m_acquisitionCount != sent); });
+			if(m_shuttingDown)
+				break;
+			sent = m_acquisitionCount;
+			t = m_lastAcquisition;
+		}
+
+		vector<shared_ptr<AutomationClient> > targets;
+		{
+			lock_guard<mutex> lock(m_clientMutex);
+			for(auto& c : m_clients)
+			{
+				if(c->m_subscribed)
+					targets.push_back(c);
+			}
+		}
+
+		string line = "!ACQ " + to_string(sent) + " " + FormatTimePoint(t) + "\n";
+		for(auto& c : targets)
+			SendLine(*c, line);
+	}
+}
@@ -0,0 +1,217 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of AutomationServer
+ */
+#ifndef AutomationServer_h
+#define AutomationServer_h
+
+#include "../xptools/Socket.h"
+
+class HistoryPoint;
+class Session;
+
+/**
+	@brief One command of a line sent by an automation client
+ */
+class AutomationCommand
+{
+public:
+	///@brief Upper case command keyword, e.g. "MEAS?"
+	std::string m_keyword;
+
+	///@brief Everything after the keyword, with surrounding whitespace and quotes removed
+	std::string m_arg;
+};
+
+/**
+	@brief A run of commands from one client which have to be executed on the GUI thread
+
+	The client thread queues the job and blocks until the GUI thread has filled in the replies.
+ */
+class AutomationJob
+{
+public:
+	AutomationJob()
+	: m_acquisitionCount(0)
+	, m_done(false)
+	{}
+
+	///@brief The commands to run, in order
+	std::vector<AutomationCommand> m_commands;
+
+	///@brief Reply to each command
+	std::vector<std::string> m_replies;
+
+	///@brief Number of acquisitions seen when the last command finished
+	uint64_t m_acquisitionCount;
+
+	///@brief Set by the GUI thread once m_replies is filled in
+	bool m_done;
+};
+
+///@brief State of one connected automation client
+class AutomationClient
+{
+public:
+	AutomationClient(ZSOCKET fd)
+	: m_fd(fd)
+	, m_closed(false)
+	, m_subscribed(false)
+	{}
+
+	///@brief Socket connected to the client
+	ZSOCKET m_fd;
+
+	///@brief Serializes replies and pushed events so lines don't interleave
+	std::mutex m_sendMutex;
+
+	///@brief Set (under m_sendMutex) once the socket is about to be closed, so nothing else sends on it
+	bool m_closed;
+
+	///@brief True if the client asked to be told about new acquisitions
+	std::atomic<bool> m_subscribed;
+};
+
+/**
+	@brief Line based remote control server, so test rigs can drive a running session without going through the GUI
+
+	Each line sent by a client holds one or more commands separated by semicolons, and gets exactly one reply line
+	with the result of each command, also separated by semicolons. A command which fails replies "ERR <reason>" and
+	the rest of the line is still run. Batching several commands into a line costs one round trip, and commands
+	needing the GUI thread which are next to each other are run in the same frame.
+
+	Commands:
+	* *IDN?				Identifies the application
+	* ARM [mode]		Arms the trigger of all groups; mode is NORMAL (default), SINGLE, AUTO or FORCE
+	* STOP				Stops the trigger of all groups
+	* ACQ?				Number of acquisitions seen since the server started
+	* WAIT n [timeout]	Blocks until n more acquisitions have arrived, counting from the end of the previous command
+						on the line, or timeout seconds (default 10) pass. Replies with the acquisition count, or
+						ERR on timeout
+	* HIST?				Number of points in history
+	* HIST:LAST?		Timestamp of the newest point in history, as seconds.femtoseconds
+	* STREAMS?			Comma separated names of every channel and filter stream
+	* MEAS? stream		Current value of a scalar stream
+	* MEAS:STATS? stream	count,mean,stdev,min,max of a scalar stream over every acquisition since the first
+						query. The first query starts tracking the stream, so it replies with zero count
+	* PACKETS? filter	Number of packets in the history of a protocol decoder
+	* SAVE path			Saves the session, as File | Save As would
+	* SUBSCRIBE			Pushes "!ACQ <count> <timestamp>" lines as acquisitions arrive. Events are coalesced if the
+						client falls behind, so only the newest is sent
+	* UNSUBSCRIBE		Stops pushing acquisition events
+
+	Pushed lines always start with '!' and replies never do, so a client can tell them apart.
+ */
+class AutomationServer
+{
+public:
+	AutomationServer(uint16_t port);
+	virtual ~AutomationServer();
+
+	AutomationServer(const AutomationServer&) =delete;
+	AutomationServer& operator=(const AutomationServer&) =delete;
+
+	void OnNewPoint(std::shared_ptr<HistoryPoint> pt);
+	void RunPendingJobs(Session& session);
+
+	///@brief Returns the port we're listening on
+	uint16_t GetPort()
+	{ return m_port; }
+
+	///@brief Returns the number of clients connected
+	size_t GetClientCount()
+	{ return m_clientCount; }
+
+protected:
+	void ListenThreadProc();
+	void ClientThreadProc(std::shared_ptr<AutomationClient> client);
+	void EventThreadProc();
+
+	std::string ExecuteLine(const std::string& line, AutomationClient& client);
+	std::string ExecuteLocal(const AutomationCommand& cmd, AutomationClient& client, uint64_t& baseline);
+	std::string ExecuteOnGuiThread(const AutomationCommand& cmd, Session& session);
+	bool RunJob(std::shared_ptr<AutomationJob> job);
+
+	static bool IsGuiCommand(const std::string& keyword);
+	static bool SendLine(AutomationClient& client, const std::string& line);
+
+	///@brief Port we're listening on
+	uint16_t m_port;
+
+	///@brief Socket waiting for clients to connect
+	Socket m_listener;
+
+	///@brief Mutex controlling access to m_jobs
+	std::mutex m_jobMutex;
+
+	///@brief Signaled when the GUI thread finishes a job, or we're shutting down
+	std::condition_variable m_jobDoneCond;
+
+	///@brief Jobs waiting for the GUI thread
+	std::deque<std::shared_ptr<AutomationJob> > m_jobs;
+
+	///@brief Mutex controlling access to m_acquisitionCount and m_lastAcquisition
+	std::mutex m_acquisitionMutex;
+
+	///@brief Signaled when an acquisition arrives, or we're shutting down
+	std::condition_variable m_acquisitionCond;
+
+	///@brief Number of acquisitions since the server started
+	uint64_t m_acquisitionCount;
+
+	///@brief Timestamp of the newest acquisition
+	TimePoint m_lastAcquisition;
+
+	///@brief Mutex controlling access to m_clients
+	std::mutex m_clientMutex;
+
+	///@brief Connected clients, so they can be sent events and shut down when we exit
+	std::set<std::shared_ptr<AutomationClient> > m_clients;
+
+	///@brief Number of clients connected
+	std::atomic<size_t> m_clientCount;
+
+	///@brief Set to shut down all of our threads
+	std::atomic<bool> m_shuttingDown;
+
+	///@brief Thread accepting new connections
+	std::unique_ptr<std::thread> m_listenThread;
+
+	///@brief Thread pushing acquisition events to subscribed clients
+	std::unique_ptr<std::thread> m_eventThread;
+
+	///@brief Threads serving each client
+	std::vector<std::thread> m_clientThreads;
+};
+
+#endif
@@ -320,8 +320,11 @@ bool BERTInputChannelDialog::DoRender()
 		ImGui::SameLine();
 
 		//Scan progress or estimated run time
+		size_t index = m_channel->GetIndex();
 		if(m_channel->IsHBathtubScanInProgress())
 			ImGui::ProgressBar(m_channel->GetScanProgress(), ImVec2(2*width, 0));
+		else if(state->m_horzBathtubScanPending[index])
+			ImGui::TextUnformatted("Queued");
 		else
 			ImGui::Text("Estimated %s", fs.PrettyPrint(m_channel->GetExpectedBathtubCaptureTime(), 5).c_str());
 
@@ -340,10 +343,23 @@ bool BERTInputChannelDialog::DoRender()
 		//Scan progress or estimated run time
 		if(m_channel->IsEyeScanInProgress())
 			ImGui::ProgressBar(m_channel->GetScanProgress(), ImVec2(2*width, 0));
+		else if(state->m_eyeScanPending[index])
+			ImGui::TextUnformatted("Queued");
 		else
 			ImGui::Text("Estimated %s", fs.PrettyPrint(m_channel->GetExpectedEyeCaptureTime(), 5).c_str());
 		HelpMarker("Acquire a single eye pattern measurement");
 
+		//Let the user back out of scans that haven't started yet
+		bool queued = state->m_horzBathtubScanPending[index] || state->m_eyeScanPending[index];
+		{
+			ImGuiDisabler disabler(!queued);
+			if(ImGui::Button("Cancel queued scans"))
+				state->CancelPendingScans(index);
+		}
+		HelpMarker(
+			"Drop bathtub or eye scans on this channel that are waiting for another scan to finish.\n\n"
+			"A scan that has already started runs to completion.");
+
 		//Input path
 		ImGui::SetNextItemWidth(ImGui::GetFontSize() * 10);
 		if(TextInputWithImplicitApply("###pathmask", m_tempMaskFile, m_committedMaskFile))
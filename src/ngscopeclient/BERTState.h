@@ -47,18 +47,49 @@ public:
 		m_horzBathtubScanPending = std::make_unique<std::atomic<bool>[] >(n);
 		m_eyeScanPending = std::make_unique<std::atomic<bool>[] >(n);
 
+		m_scanInProgress = std::make_unique<std::atomic<bool>[] >(n);
+		m_scanFinished = std::make_unique<std::atomic<bool>[] >(n);
+
 		for(size_t i=0; i<n; i++)
 		{
 			m_horzBathtubScanPending[i] = false;
 			m_eyeScanPending[i] = false;
+			m_scanInProgress[i] = false;
+			m_scanFinished[i] = false;
 		}
 
 		m_firstUpdateDone = false;
 	}
 
+	/**
+		@brief Drops any scans on the given channel that are queued but not yet started
+
+		A scan that is already running is owned by the driver and runs to completion.
+	 */
+	void CancelPendingScans(size_t i)
+	{
+		m_horzBathtubScanPending[i] = false;
+		m_eyeScanPending[i] = false;
+	}
+
+	///@brief Scan requests queued by the UI, picked up by the scan thread
 	std::unique_ptr<std::atomic<bool>[]> m_horzBathtubScanPending;
 	std::unique_ptr<std::atomic<bool>[]> m_eyeScanPending;
 
+	///@brief True while the scan thread is running a scan on this channel
+	std::unique_ptr<std::atomic<bool>[]> m_scanInProgress;
+
+	///@brief Set by the scan thread when a scan completes, so the instrument thread can refresh the channel
+	std::unique_ptr<std::atomic<bool>[]> m_scanFinished;
+
+	/**
+		@brief Serializes driver access between the instrument thread and the scan thread
+
+		Drivers aren't thread safe, so the scan thread holds this for the whole of a scan and the instrument thread
+		skips polling the BERT until it's done.
+	 */
+	std::mutex m_driverMutex;
+
 	std::atomic<bool> m_firstUpdateDone;
 };
 
@@ -42,6 +42,7 @@ using namespace std;
 void BERTThread(BERTThreadArgs args)
 {
 	pthread_setname_np_compat("BERTThread");
+	ThreadRoleScope role(THREAD_ROLE_INSTRUMENT);
 
 	auto bert = args.bert;
 	auto state = args.state;
@@ -86,7 +87,7 @@ void BERTThread(BERTThreadArgs args)
 				LogTrace("Scan actually took %s\n", fs.PrettyPrint(dt).c_str());
 			}
 
-			args.session->MarkChannelDirty(bert->GetChannel(i));
+			args.session->MarkPolledChannelDirty(bert->GetChannel(i));
 		}
 		args.session->RefreshDirtyFiltersNonblocking();
 
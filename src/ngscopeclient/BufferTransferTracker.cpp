@@ -0,0 +1,124 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of BufferTransferTracker
+ */
+
+#include "ngscopeclient.h"
+#include "BufferTransferTracker.h"
+
+using namespace std;
+
+atomic<bool> g_bufferTransferTracking(false);
+
+///@brief Stats for each call site, keyed by the site name pointer
+static map<const char*, BufferTransferStats> g_bufferTransferStats;
+
+///@brief Mutex controlling access to g_bufferTransferStats
+static mutex g_bufferTransferMutex;
+
+/**
+	@brief Records one call at a tracked site
+ */
+void BufferTransferTracker::Record(
+	const char* site,
+	bool toGpu,
+	bool copied,
+	bool allocated,
+	size_t bytes,
+	int64_t start,
+	int64_t end)
+{
+	{
+		lock_guard<mutex> lock(g_bufferTransferMutex);
+		auto& stats = g_bufferTransferStats[site];
+		stats.m_calls ++;
+		if(copied)
+		{
+			if(toGpu)
+				stats.m_toGpu ++;
+			else
+				stats.m_toCpu ++;
+			stats.m_bytes += bytes;
+		}
+		if(allocated)
+			stats.m_allocations ++;
+		if(copied || allocated)
+			stats.m_time += end - start;
+	}
+
+	//Calls which didn't do anything aren't worth cluttering the trace with
+	if(copied || allocated)
+	{
+		char detail[64];
+		snprintf(detail, sizeof(detail), "%s: %zu bytes", site, bytes);
+		const char* name;
+		if(copied)
+			name = toGpu ? "Host to device copy" : "Device to host copy";
+		else
+			name = "Buffer allocation";
+		Tracer::Record(name, start, end, detail);
+	}
+}
+
+/**
+	@brief Gets a copy of the stats for every call site, by site name
+
+	Sites with the same name are combined.
+ */
+map<string, BufferTransferStats> BufferTransferTracker::GetStats()
+{
+	map<string, BufferTransferStats> ret;
+
+	lock_guard<mutex> lock(g_bufferTransferMutex);
+	for(auto& it : g_bufferTransferStats)
+	{
+		auto& dst = ret[it.first];
+		dst.m_calls += it.second.m_calls;
+		dst.m_toGpu += it.second.m_toGpu;
+		dst.m_toCpu += it.second.m_toCpu;
+		dst.m_allocations += it.second.m_allocations;
+		dst.m_bytes += it.second.m_bytes;
+		dst.m_time += it.second.m_time;
+	}
+	return ret;
+}
+
+/**
+	@brief Forgets all recorded stats
+ */
+void BufferTransferTracker::Clear()
+{
+	lock_guard<mutex> lock(g_bufferTransferMutex);
+	g_bufferTransferStats.clear();
+}
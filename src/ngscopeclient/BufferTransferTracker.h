@@ -0,0 +1,186 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of BufferTransferTracker
+ */
+#ifndef BufferTransferTracker_h
+#define BufferTransferTracker_h
+
+#include "Tracer.h"
+
+extern std::atomic<bool> g_bufferTransferTracking;
+
+/**
+	@brief Cumulative host/device transfer activity at one call site
+ */
+class BufferTransferStats
+{
+public:
+	BufferTransferStats()
+	: m_calls(0)
+	, m_toGpu(0)
+	, m_toCpu(0)
+	, m_allocations(0)
+	, m_bytes(0)
+	, m_time(0)
+	{}
+
+	///@brief Number of times the call site asked for a buffer to be made accessible
+	uint64_t m_calls;
+
+	///@brief Number of calls which actually copied data from host to device
+	uint64_t m_toGpu;
+
+	///@brief Number of calls which actually copied data from device to host
+	uint64_t m_toCpu;
+
+	///@brief Number of calls which had to allocate a new buffer on the side being accessed
+	uint64_t m_allocations;
+
+	///@brief Total bytes copied
+	uint64_t m_bytes;
+
+	///@brief Total time spent in calls which copied or allocated, in ns
+	int64_t m_time;
+};
+
+/**
+	@brief Instrumentation for hidden AcceleratorBuffer transfers
+
+	Wraps PrepareForCpuAccess() / PrepareForGpuAccess() at a named call site. When tracking is enabled, the buffer's
+	stale flags are checked before the call to find out whether it will really copy anything, and calls which copy
+	or allocate are timed, counted per call site, and recorded as trace zones so they show up in a Chrome trace.
+
+	When tracking is disabled this costs one relaxed atomic load on top of the normal call.
+ */
+class BufferTransferTracker
+{
+public:
+	static void SetEnabled(bool enabled)
+	{ g_bufferTransferTracking = enabled; }
+
+	///@brief Checks if tracking is enabled
+	static bool IsEnabled()
+	{ return g_bufferTransferTracking.load(std::memory_order_relaxed); }
+
+	static std::map<std::string, BufferTransferStats> GetStats();
+	static void Clear();
+
+	/**
+		@brief Makes a buffer accessible from the CPU, tracking any device-to-host copy
+
+		@param site	Name of the call site (must be a string literal or otherwise live forever)
+		@param buf	The buffer
+	 */
+	template<class T>
+	static void PrepareForCpuAccess(const char* site, AcceleratorBuffer<T>& buf)
+	{
+		if(!IsEnabled())
+		{
+			buf.PrepareForCpuAccess();
+			return;
+		}
+
+		bool copy = buf.HasGpuBuffer() && buf.IsCpuBufferStale();
+		bool hadBuffer = buf.HasCpuBuffer();
+		auto start = Tracer::Now();
+		buf.PrepareForCpuAccess();
+		auto end = Tracer::Now();
+
+		Record(site, false, copy, !hadBuffer && buf.HasCpuBuffer(), copy ? buf.size() * sizeof(T) : 0, start, end);
+	}
+
+	/**
+		@brief Makes a buffer accessible from the GPU, tracking any host-to-device copy
+
+		@param site			Name of the call site (must be a string literal or otherwise live forever)
+		@param buf			The buffer
+		@param outputOnly	True if the GPU will only write to the buffer, so no copy is needed
+	 */
+	template<class T>
+	static void PrepareForGpuAccess(const char* site, AcceleratorBuffer<T>& buf, bool outputOnly = false)
+	{
+		if(!IsEnabled())
+		{
+			buf.PrepareForGpuAccess(outputOnly);
+			return;
+		}
+
+		bool copy = !outputOnly && buf.HasCpuBuffer() && buf.IsGpuBufferStale() && !buf.IsSingleSharedBuffer();
+		bool hadBuffer = buf.HasGpuBuffer();
+		auto start = Tracer::Now();
+		buf.PrepareForGpuAccess(outputOnly);
+		auto end = Tracer::Now();
+
+		Record(site, true, copy, !hadBuffer && buf.HasGpuBuffer(), copy ? buf.size() * sizeof(T) : 0, start, end);
+	}
+
+	/**
+		@brief Makes a sparse waveform accessible from the CPU, tracking any copy of its offsets and durations
+
+		The sample buffer's type isn't known here, so only timestamp bytes are counted.
+	 */
+	static void PrepareForCpuAccess(const char* site, SparseWaveformBase* wfm)
+	{
+		if(!IsEnabled())
+		{
+			wfm->PrepareForCpuAccess();
+			return;
+		}
+
+		bool copyOffsets = wfm->m_offsets.HasGpuBuffer() && wfm->m_offsets.IsCpuBufferStale();
+		bool copyDurations = wfm->m_durations.HasGpuBuffer() && wfm->m_durations.IsCpuBufferStale();
+		auto start = Tracer::Now();
+		wfm->PrepareForCpuAccess();
+		auto end = Tracer::Now();
+
+		size_t bytes = 0;
+		if(copyOffsets)
+			bytes += wfm->m_offsets.size() * sizeof(int64_t);
+		if(copyDurations)
+			bytes += wfm->m_durations.size() * sizeof(int64_t);
+		Record(site, false, copyOffsets || copyDurations, false, bytes, start, end);
+	}
+
+protected:
+	static void Record(
+		const char* site,
+		bool toGpu,
+		bool copied,
+		bool allocated,
+		size_t bytes,
+		int64_t start,
+		int64_t end);
+};
+
+#endif
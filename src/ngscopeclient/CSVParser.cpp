@@ -0,0 +1,440 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of CSVParser
+ */
+#include "ngscopeclient.h"
+#include "CSVParser.h"
+#include <charconv>
+#include <omp.h>
+
+using namespace std;
+
+///@brief Size of each block read from disk
+static const size_t CSV_BLOCK_SIZE = 64 * 1024 * 1024;
+
+///@brief Number of slices per thread each block is split into, for load balancing
+static const size_t CSV_SLICES_PER_THREAD = 4;
+
+///@brief Powers of ten which can be represented exactly as a double
+static const double g_exactPowersOfTen[] =
+{
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+CSVParser::CSVParser()
+	: m_valueColumns(0)
+	, m_badLines(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Number parsing
+
+static bool IsDigit(char c)
+{ return (c >= '0') && (c <= '9'); }
+
+static bool IsBlank(char c)
+{ return (c == ' ') || (c == '\t'); }
+
+/**
+	@brief Parses a decimal number, with optional sign, fraction and exponent, and any whitespace around it
+
+	If the mantissa fits in 53 bits and the power of ten is exactly representable, a single multiply or divide gives
+	the correctly rounded result. Anything else (more digits, huge exponents, inf/nan) goes through std::from_chars().
+
+	@param p	Start of the number, updated to point just past it (and any trailing whitespace)
+	@param end	End of the line
+	@param v	Parsed value
+
+	@return True if a number was found
+ */
+bool CSVParser::ParseNumber(const char*& p, const char* end, double& v)
+{
+	while( (p < end) && IsBlank(*p) )
+		p++;
+	const char* start = p;
+
+	bool negative = false;
+	if( (p < end) && ( (*p == '-') || (*p == '+') ) )
+	{
+		negative = (*p == '-');
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	while( (p < end) && IsDigit(*p) )
+	{
+		mantissa = mantissa*10 + (*p - '0');
+		if(mantissa)
+			digits ++;
+		any = true;
+		p++;
+	}
+	if( (p < end) && (*p == '.') )
+	{
+		p++;
+		while( (p < end) && IsDigit(*p) )
+		{
+			mantissa = mantissa*10 + (*p - '0');
+			if(mantissa)
+				digits ++;
+			exponent --;
+			any = true;
+			p++;
+		}
+	}
+
+	if(any && (p < end) && ( (*p == 'e') || (*p == 'E') ) )
+	{
+		const char* q = p + 1;
+		bool eneg = false;
+		if( (q < end) && ( (*q == '-') || (*q == '+') ) )
+		{
+			eneg = (*q == '-');
+			q++;
+		}
+		if( (q < end) && IsDigit(*q) )
+		{
+			int e = 0;
+			while( (q < end) && IsDigit(*q) )
+			{
+				if(e < 10000)
+					e = e*10 + (*q - '0');
+				q++;
+			}
+			exponent += eneg ? -e : e;
+			p = q;
+		}
+	}
+
+	//Fast path
+	if(any && (digits <= 19) && (mantissa <= (1ULL << 53)) && (exponent >= -22) && (exponent <= 22) )
+	{
+		double d = static_cast<double>(mantissa);
+		if(exponent < 0)
+			d /= g_exactPowersOfTen[-exponent];
+		else
+			d *= g_exactPowersOfTen[exponent];
+		v = negative ? -d : d;
+	}
+
+	//Slow path (from_chars doesn't take a leading +)
+	else
+	{
+		const char* q = start;
+		if( (q < end) && (*q == '+') )
+			q++;
+		auto res = from_chars(q, end, v);
+		if(res.ec != errc())
+			return false;
+		p = res.ptr;
+	}
+
+	while( (p < end) && IsBlank(*p) )
+		p++;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// File parsing
+
+/**
+	@brief Loads a file
+
+	@return True on success, false if the file couldn't be read or has no data in it
+ */
+bool CSVParser::Load(const string& path)
+{
+	m_names.clear();
+	m_timestamps.clear();
+	m_columns.clear();
+	m_valueColumns = 0;
+	m_badLines = 0;
+	m_error = "";
+
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
+	{
+		m_error = string("Could not open ") + path;
+		return false;
+	}
+
+	vector<char> cur(CSV_BLOCK_SIZE);
+	vector<char> next;
+	size_t curLen = fread(cur.data(), 1, CSV_BLOCK_SIZE, fp);
+	bool eof = (curLen < CSV_BLOCK_SIZE);
+	bool headerDone = false;
+
+	size_t nslices = max(1, omp_get_max_threads()) * CSV_SLICES_PER_THREAD;
+	vector<Slice> slices(nslices);
+
+	while(true)
+	{
+		//Only parse complete lines, and carry the rest over to the start of the next block
+		size_t split = curLen;
+		if(!eof)
+		{
+			while( (split > 0) && (cur[split-1] != '\n') )
+				split --;
+		}
+		size_t carry = curLen - split;
+
+		//Start reading the next block while we parse this one
+		size_t nextLen = 0;
+		bool nextEof = true;
+		thread reader;
+		if(!eof)
+		{
+			next.resize(carry + CSV_BLOCK_SIZE);
+			memcpy(next.data(), cur.data() + split, carry);
+			reader = thread([&]()
+				{
+					size_t len = fread(next.data() + carry, 1, CSV_BLOCK_SIZE, fp);
+					nextEof = (len < CSV_BLOCK_SIZE);
+					nextLen = carry + len;
+				});
+		}
+
+		const char* p = cur.data();
+		const char* end = cur.data() + split;
+		if(!headerDone)
+			headerDone = ParseHeader(p, end);
+
+		if(headerDone && (p < end) )
+		{
+			//Split the block at line boundaries
+			size_t len = end - p;
+			const char* sliceStart = p;
+			for(size_t i=0; i<nslices; i++)
+			{
+				const char* sliceEnd = end;
+				if(i+1 < nslices)
+				{
+					sliceEnd = max(sliceStart, p + (len * (i+1)) / nslices);
+					auto eol = static_cast<const char*>(memchr(sliceEnd, '\n', end - sliceEnd));
+					sliceEnd = eol ? (eol + 1) : end;
+				}
+				slices[i].m_start = sliceStart;
+				slices[i].m_end = sliceEnd;
+				sliceStart = sliceEnd;
+			}
+
+			#pragma omp parallel for
+			for(size_t i=0; i<nslices; i++)
+				ParseSlice(slices[i]);
+
+			//Append each column's slices in order
+			#pragma omp parallel for
+			for(size_t c=0; c<=m_valueColumns; c++)
+			{
+				for(auto& s : slices)
+				{
+					if(c == 0)
+						m_timestamps.insert(m_timestamps.end(), s.m_timestamps.begin(), s.m_timestamps.end());
+					else
+					{
+						auto& col = s.m_columns[c-1];
+						m_columns[c-1].insert(m_columns[c-1].end(), col.begin(), col.end());
+					}
+				}
+			}
+			for(auto& s : slices)
+				m_badLines += s.m_badLines;
+		}
+
+		if(eof)
+			break;
+
+		reader.join();
+		cur.swap(next);
+		curLen = nextLen;
+		eof = nextEof;
+	}
+
+	fclose(fp);
+
+	if(m_timestamps.empty())
+	{
+		m_error = path + " has no data in it";
+		return false;
+	}
+
+	if(m_badLines)
+		LogWarning("%s: skipped %zu lines which didn't parse\n", path.c_str(), m_badLines);
+	return true;
+}
+
+/**
+	@brief Looks for the first line with content, to find the number of columns and their names
+
+	@param p	Start of the data, advanced past comments and the header (if there is one)
+	@param end	End of the data
+
+	@return True if the first line was found
+ */
+bool CSVParser::ParseHeader(const char*& p, const char* end)
+{
+	while(p < end)
+	{
+		auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char* next = eol ? (eol + 1) : end;
+		const char* lineEnd = eol ? eol : end;
+		if( (lineEnd > p) && (lineEnd[-1] == '\r') )
+			lineEnd --;
+
+		const char* q = p;
+		while( (q < lineEnd) && IsBlank(*q) )
+			q++;
+		if( (q == lineEnd) || (*q == '#') )
+		{
+			p = next;
+			continue;
+		}
+
+		//Split into fields
+		vector<string> fields;
+		const char* fieldStart = q;
+		for(const char* r = q; r <= lineEnd; r++)
+		{
+			if( (r == lineEnd) || (*r == ',') )
+			{
+				string field(fieldStart, r);
+				size_t first = field.find_first_not_of(" \t\"");
+				size_t last = field.find_last_not_of(" \t\"");
+				fields.push_back( (first == string::npos) ? "" : field.substr(first, last - first + 1));
+				fieldStart = r + 1;
+			}
+		}
+
+		m_valueColumns = (fields.size() > 1) ? fields.size() - 1 : 1;
+		m_columns.resize(m_valueColumns);
+
+		//If every field is a number, there's no header and this line is data
+		bool numeric = true;
+		for(auto& f : fields)
+		{
+			const char* fs = f.c_str();
+			double v;
+			if(!ParseNumber(fs, f.c_str() + f.length(), v) || (fs != f.c_str() + f.length()) )
+				numeric = false;
+		}
+
+		for(size_t i=0; i<m_valueColumns; i++)
+		{
+			if(!numeric && (i+1 < fields.size()) && !fields[i+1].empty() )
+				m_names.push_back(fields[i+1]);
+			else
+				m_names.push_back(string("Column ") + to_string(i+1));
+		}
+
+		if(!numeric)
+			p = next;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+	@brief Parses every line in one slice of a block
+ */
+void CSVParser::ParseSlice(Slice& slice)
+{
+	slice.m_timestamps.clear();
+	slice.m_columns.resize(m_valueColumns);
+	for(auto& c : slice.m_columns)
+		c.clear();
+	slice.m_badLines = 0;
+
+	//Guess at the line count so we don't reallocate much
+	size_t estimate = (slice.m_end - slice.m_start) / (8 * (m_valueColumns + 1));
+	slice.m_timestamps.reserve(estimate);
+	for(auto& c : slice.m_columns)
+		c.reserve(estimate);
+
+	vector<float> row(m_valueColumns);
+	const char* p = slice.m_start;
+	const char* end = slice.m_end;
+	while(p < end)
+	{
+		auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char* next = eol ? (eol + 1) : end;
+		const char* lineEnd = eol ? eol : end;
+		if( (lineEnd > p) && (lineEnd[-1] == '\r') )
+			lineEnd --;
+
+		const char* q = p;
+		p = next;
+		while( (q < lineEnd) && IsBlank(*q) )
+			q++;
+		if( (q == lineEnd) || (*q == '#') )
+			continue;
+
+		double t;
+		bool ok = ParseNumber(q, lineEnd, t);
+		for(size_t i=0; ok && (i<m_valueColumns); i++)
+		{
+			if( (q >= lineEnd) || (*q != ',') )
+			{
+				ok = false;
+				break;
+			}
+			q++;
+
+			double v;
+			ok = ParseNumber(q, lineEnd, v);
+			row[i] = v;
+		}
+
+		//Anything after the last column we care about is ignored, but what we did parse has to be whole fields
+		if(ok && (q < lineEnd) && (*q != ',') )
+			ok = false;
+
+		if(!ok)
+		{
+			slice.m_badLines ++;
+			continue;
+		}
+
+		slice.m_timestamps.push_back(t);
+		for(size_t i=0; i<m_valueColumns; i++)
+			slice.m_columns[i].push_back(row[i]);
+	}
+}
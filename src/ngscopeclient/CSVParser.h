@@ -0,0 +1,106 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of CSVParser
+ */
+#ifndef CSVParser_h
+#define CSVParser_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+	@brief Multithreaded parser for numeric CSV files: one timestamp column followed by any number of value columns
+
+	The file is read in large blocks, the next one being read from disk while the current one is parsed. Each block
+	is split at line boundaries into slices which are parsed in parallel, each into its own column arrays, then
+	appended in order. Lines are found with memchr() (which the C library vectorizes), and numbers are converted with
+	a locale independent fast path which is exact for anything with up to 19 significant digits and a small exponent,
+	falling back to std::from_chars() for the rest.
+
+	The first line which isn't blank or a # comment sets the number of columns. If it doesn't parse as numbers, it's
+	taken as the column names. Lines which don't parse later on are skipped and counted.
+ */
+class CSVParser
+{
+public:
+	CSVParser();
+
+	bool Load(const std::string& path);
+
+	///@brief Gets a description of what went wrong, if Load() failed
+	const std::string& GetError()
+	{ return m_error; }
+
+	///@brief Number of lines which couldn't be parsed and were skipped
+	size_t GetBadLineCount()
+	{ return m_badLines; }
+
+	static bool ParseNumber(const char*& p, const char* end, double& v);
+
+	///@brief Names of the value columns (from the header, or made up if there wasn't one)
+	std::vector<std::string> m_names;
+
+	///@brief Contents of the first column, in seconds
+	std::vector<double> m_timestamps;
+
+	///@brief Contents of each value column
+	std::vector<std::vector<float>> m_columns;
+
+protected:
+
+	///@brief Rows parsed from one slice of a block
+	class Slice
+	{
+	public:
+		const char* m_start;
+		const char* m_end;
+		std::vector<double> m_timestamps;
+		std::vector<std::vector<float>> m_columns;
+		size_t m_badLines;
+	};
+
+	bool ParseHeader(const char*& p, const char* end);
+	void ParseSlice(Slice& slice);
+
+	///@brief Number of value columns (not counting the timestamp)
+	size_t m_valueColumns;
+
+	///@brief Number of lines skipped
+	size_t m_badLines;
+
+	///@brief Error message, if any
+	std::string m_error;
+};
+
+#endif
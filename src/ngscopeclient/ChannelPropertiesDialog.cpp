@@ -66,15 +66,19 @@ ChannelPropertiesDialog::ChannelPropertiesDialog(InstrumentChannel* chan, bool g
 	m_offset.resize(nstreams);
 	m_committedRange.resize(nstreams);
 	m_range.resize(nstreams);
+	m_liveOffset.resize(nstreams);
+	m_liveRange.resize(nstreams);
 	for(size_t i = 0; i<nstreams; i++)
 	{
 		auto unit = m_channel->GetYAxisUnits(i);
 
 		m_committedOffset[i] = ochan->GetOffset(i);
 		m_offset[i] = unit.PrettyPrint(m_committedOffset[i]);
+		m_liveOffset[i].Set(m_committedOffset[i]);
 
 		m_committedRange[i] = ochan->GetVoltageRange(i);
 		m_range[i] = unit.PrettyPrint(m_committedRange[i]);
+		m_liveRange[i].Set(m_committedRange[i]);
 	}
 
 	//Digital channel settings
@@ -390,9 +394,11 @@ bool ChannelPropertiesDialog::DoRender()
 
 						m_committedOffset[i] = ochan->GetOffset(i);
 						m_offset[i] = unit.PrettyPrint(m_committedOffset[i]);
+						m_liveOffset[i].Set(m_committedOffset[i]);
 
 						m_committedRange[i] = ochan->GetVoltageRange(i);
 						m_range[i] = unit.PrettyPrint(m_committedRange[i]);
+						m_liveRange[i].Set(m_committedRange[i]);
 					}
 				}
 				if(m_probe != "")
@@ -516,18 +522,29 @@ bool ChannelPropertiesDialog::DoRender()
 		m_offset.resize(nstreams);
 		m_committedRange.resize(nstreams);
 		m_range.resize(nstreams);
+		m_liveOffset.resize(nstreams);
+		m_liveRange.resize(nstreams);
 		for(size_t i = noldstreams; i<nstreams; i++)
 		{
 			auto unit = m_channel->GetYAxisUnits(i);
 
 			m_committedOffset[i] = ochan->GetOffset(i);
 			m_offset[i] = unit.PrettyPrint(m_committedOffset[i]);
+			m_liveOffset[i].Set(m_committedOffset[i]);
 
 			m_committedRange[i] = ochan->GetVoltageRange(i);
 			m_range[i] = unit.PrettyPrint(m_committedRange[i]);
+			m_liveRange[i].Set(m_committedRange[i]);
 		}
 	}
 
+	//Background reads may still be queued after the dialog or the instrument goes away.
+	//Have them hold a reference to the scope, which owns the channel, so the channel outlives them.
+	auto liveScope = ochan->GetScope();
+	shared_ptr<Instrument> liveOwner;
+	if(liveScope)
+		liveOwner = liveScope->shared_from_this();
+
 	//Vertical settings are per stream
 	for(size_t i = 0; i<nstreams; i++)
 	{
@@ -544,8 +561,10 @@ bool ChannelPropertiesDialog::DoRender()
 
 				auto unit = m_channel->GetYAxisUnits(i);
 
-				//If no change to offset in dialog, update our input value when we change offset outside the dialog
-				auto off = ochan->GetOffset(i);
+				//If no change to offset in dialog, update our input value when we change offset outside the dialog.
+				//Read in the background since a cache miss in the driver means a round trip to the instrument.
+				m_liveOffset[i].Refresh(liveScope, [liveOwner, ochan, i]() { return ochan->GetOffset(i); });
+				auto off = m_liveOffset[i].Get();
 				auto soff = unit.PrettyPrint(m_committedOffset[i]);
 				if( (m_committedOffset[i] != off) && (soff == m_offset[i]) )
 				{
@@ -554,10 +573,14 @@ bool ChannelPropertiesDialog::DoRender()
 				}
 				ImGui::SetNextItemWidth(width);
 				if(UnitInputWithExplicitApply("Offset", m_offset[i], m_committedOffset[i], unit))
+				{
 					ochan->SetOffset(m_committedOffset[i], i);
+					m_liveOffset[i].Set(m_committedOffset[i]);
+				}
 
 				//Same for range
-				auto range = ochan->GetVoltageRange(i);
+				m_liveRange[i].Refresh(liveScope, [liveOwner, ochan, i]() { return ochan->GetVoltageRange(i); });
+				auto range = m_liveRange[i].Get();
 				auto srange = unit.PrettyPrint(m_committedRange[i]);
 				if( (m_committedRange[i] != range) && (srange == m_range[i]) )
 				{
@@ -566,7 +589,10 @@ bool ChannelPropertiesDialog::DoRender()
 				}
 				ImGui::SetNextItemWidth(width);
 				if(UnitInputWithExplicitApply("Range", m_range[i], m_committedRange[i], unit))
+				{
 					ochan->SetVoltageRange(m_committedRange[i], i);
+					m_liveRange[i].Set(m_committedRange[i]);
+				}
 
 				ImGui::PopID();
 			}
@@ -58,6 +58,10 @@ protected:
 	std::vector<std::string> m_range;
 	std::vector<float> m_committedRange;
 
+	///@brief Offset and range as last read from the instrument, to pick up changes made outside the dialog
+	std::vector<AsyncProperty<float>> m_liveOffset;
+	std::vector<AsyncProperty<float>> m_liveRange;
+
 	std::string m_threshold;
 	float m_committedThreshold;
 
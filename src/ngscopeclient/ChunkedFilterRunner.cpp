@@ -0,0 +1,836 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ChunkedFilterRunner
+ */
+
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "ChunkedFilterRunner.h"
+#include "Session.h"
+
+using namespace std;
+
+///@brief Mutex controlling access to the streaming filter registry
+static mutex g_streamingFiltersMutex;
+
+/**
+	@brief Gets the registry of filters which can be run in chunks, by protocol name
+
+	Filters which compute each output sample only from the input samples at the same time need no overlap at all.
+ */
+static map<string, StreamingSpec>& GetStreamingFilters()
+{
+	static map<string, StreamingSpec> filters =
+	{
+		{ "Add",		StreamingSpec() },
+		{ "Subtract",	StreamingSpec() },
+		{ "Multiply",	StreamingSpec() },
+		{ "Divide",		StreamingSpec() },
+		{ "Scale",		StreamingSpec() },
+		{ "Clip",		StreamingSpec() },
+		{ "Threshold",	StreamingSpec() }
+	};
+	return filters;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Slicing helpers
+
+/**
+	@brief Makes an empty waveform of the same type as another, with the same timebase
+ */
+template<class W>
+static W* CloneEmpty(W* wfm)
+{
+	auto ret = new W;
+	ret->m_timescale = wfm->m_timescale;
+	ret->m_startTimestamp = wfm->m_startTimestamp;
+	ret->m_startFemtoseconds = wfm->m_startFemtoseconds;
+	ret->m_triggerPhase = wfm->m_triggerPhase;
+	ret->m_flags = wfm->m_flags;
+	return ret;
+}
+
+/**
+	@brief Gets the time of the first and one past the last sample of a waveform, in fs from the trigger
+ */
+static bool GetWaveformSpan(WaveformBase* wfm, int64_t& tstart, int64_t& tend)
+{
+	size_t len = wfm->size();
+	if(len == 0)
+		return false;
+
+	auto sparse = dynamic_cast<SparseWaveformBase*>(wfm);
+	if(sparse)
+	{
+		tstart = sparse->m_offsets[0] * wfm->m_timescale + wfm->m_triggerPhase;
+		tend = (sparse->m_offsets[len-1] + sparse->m_durations[len-1]) * wfm->m_timescale + wfm->m_triggerPhase;
+	}
+	else
+	{
+		tstart = wfm->m_triggerPhase;
+		tend = len * wfm->m_timescale + wfm->m_triggerPhase;
+	}
+	return true;
+}
+
+/**
+	@brief Gets the index of the first sample in a uniform waveform at or after a given time, clamped to the waveform
+ */
+static size_t UniformIndexAt(WaveformBase* wfm, int64_t t)
+{
+	int64_t rel = t - wfm->m_triggerPhase;
+	if(rel <= 0)
+		return 0;
+	int64_t i = (rel + wfm->m_timescale - 1) / wfm->m_timescale;
+	return min((size_t)i, wfm->size());
+}
+
+/**
+	@brief Copies the samples of a uniform waveform in [tstart, tend) into a new waveform
+ */
+template<class W>
+static W* SliceUniform(W* src, int64_t tstart, int64_t tend)
+{
+	size_t first = UniformIndexAt(src, tstart);
+	size_t last = max(first, UniformIndexAt(src, tend));
+
+	auto ret = CloneEmpty(src);
+	ret->m_triggerPhase = src->m_triggerPhase + first * src->m_timescale;
+	ret->PrepareForCpuAccess();
+	ret->Resize(last - first);
+	for(size_t i=first; i<last; i++)
+		ret->m_samples[i - first] = src->m_samples[i];
+	ret->MarkModifiedFromCpu();
+	return ret;
+}
+
+/**
+	@brief Copies the samples of a sparse waveform overlapping [tstart, tend) into a new waveform
+ */
+template<class W>
+static W* SliceSparse(W* src, int64_t tstart, int64_t tend)
+{
+	int64_t ts = src->m_timescale;
+	int64_t phase = src->m_triggerPhase;
+	size_t len = src->size();
+
+	//First sample which hasn't ended by tstart
+	size_t lo = 0;
+	size_t hi = len;
+	while(lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if( (src->m_offsets[mid] + src->m_durations[mid]) * ts + phase <= tstart)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	size_t first = lo;
+
+	//First sample starting at or after tend
+	hi = len;
+	while(lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if(src->m_offsets[mid] * ts + phase < tend)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	size_t last = lo;
+
+	auto ret = CloneEmpty(src);
+	int64_t base = (first < len) ? src->m_offsets[first] : 0;
+	ret->m_triggerPhase = phase + base * ts;
+	ret->PrepareForCpuAccess();
+	ret->Resize(last - first);
+	for(size_t i=first; i<last; i++)
+	{
+		ret->m_offsets[i - first] = src->m_offsets[i] - base;
+		ret->m_durations[i - first] = src->m_durations[i];
+		ret->m_samples[i - first] = src->m_samples[i];
+	}
+	ret->MarkModifiedFromCpu();
+	return ret;
+}
+
+/**
+	@brief Checks if a waveform is one of the types SliceWaveform() can handle
+ */
+static bool IsSliceable(WaveformBase* wfm)
+{
+	return
+		dynamic_cast<UniformAnalogWaveform*>(wfm) ||
+		dynamic_cast<UniformDigitalWaveform*>(wfm) ||
+		dynamic_cast<SparseAnalogWaveform*>(wfm) ||
+		dynamic_cast<SparseDigitalWaveform*>(wfm);
+}
+
+/**
+	@brief Copies the part of a waveform overlapping [tstart, tend) into a new waveform of the same type
+
+	@return The new waveform, or null if the type isn't supported
+ */
+static WaveformBase* SliceWaveform(WaveformBase* wfm, int64_t tstart, int64_t tend)
+{
+	auto ua = dynamic_cast<UniformAnalogWaveform*>(wfm);
+	auto ud = dynamic_cast<UniformDigitalWaveform*>(wfm);
+	auto sa = dynamic_cast<SparseAnalogWaveform*>(wfm);
+	auto sd = dynamic_cast<SparseDigitalWaveform*>(wfm);
+	if(ua)
+		return SliceUniform(ua, tstart, tend);
+	else if(ud)
+		return SliceUniform(ud, tstart, tend);
+	else if(sa)
+		return SliceSparse(sa, tstart, tend);
+	else if(sd)
+		return SliceSparse(sd, tstart, tend);
+	return nullptr;
+}
+
+/**
+	@brief Appends the samples of a uniform chunk output in [tstart, tend) to the stitched output
+ */
+template<class W>
+static void AppendUniform(W* acc, W* chunk, int64_t tstart, int64_t tend)
+{
+	size_t first = UniformIndexAt(chunk, tstart);
+	size_t last = max(first, UniformIndexAt(chunk, tend));
+
+	size_t base = acc->size();
+	if(base == 0)
+		acc->m_triggerPhase = chunk->m_triggerPhase + first * chunk->m_timescale;
+
+	chunk->PrepareForCpuAccess();
+	acc->Resize(base + last - first);
+	for(size_t i=first; i<last; i++)
+		acc->m_samples[base + i - first] = chunk->m_samples[i];
+}
+
+/**
+	@brief Appends the samples of a sparse chunk output starting in [tstart, tend) to the stitched output
+ */
+template<class W>
+static void AppendSparse(W* acc, W* chunk, int64_t tstart, int64_t tend)
+{
+	int64_t ts = chunk->m_timescale;
+	chunk->PrepareForCpuAccess();
+	for(size_t i=0; i<chunk->size(); i++)
+	{
+		int64_t t = chunk->m_offsets[i] * ts + chunk->m_triggerPhase;
+		if(t < tstart)
+			continue;
+		if(t >= tend)
+			break;
+
+		if(acc->size() == 0)
+			acc->m_triggerPhase = t;
+
+		acc->m_offsets.push_back( (t - acc->m_triggerPhase) / ts );
+		acc->m_durations.push_back(chunk->m_durations[i]);
+		acc->m_samples.push_back(chunk->m_samples[i]);
+	}
+}
+
+/**
+	@brief Appends the part of a chunk output in [tstart, tend) to the stitched output
+
+	@return False if the chunk isn't the same type as the stitched output
+ */
+static bool AppendWaveform(WaveformBase* acc, WaveformBase* chunk, int64_t tstart, int64_t tend)
+{
+	if(acc->m_timescale != chunk->m_timescale)
+		return false;
+
+	auto ua = dynamic_cast<UniformAnalogWaveform*>(acc);
+	auto ud = dynamic_cast<UniformDigitalWaveform*>(acc);
+	auto sa = dynamic_cast<SparseAnalogWaveform*>(acc);
+	auto sd = dynamic_cast<SparseDigitalWaveform*>(acc);
+	if(ua && dynamic_cast<UniformAnalogWaveform*>(chunk))
+		AppendUniform(ua, dynamic_cast<UniformAnalogWaveform*>(chunk), tstart, tend);
+	else if(ud && dynamic_cast<UniformDigitalWaveform*>(chunk))
+		AppendUniform(ud, dynamic_cast<UniformDigitalWaveform*>(chunk), tstart, tend);
+	else if(sa && dynamic_cast<SparseAnalogWaveform*>(chunk))
+		AppendSparse(sa, dynamic_cast<SparseAnalogWaveform*>(chunk), tstart, tend);
+	else if(sd && dynamic_cast<SparseDigitalWaveform*>(chunk))
+		AppendSparse(sd, dynamic_cast<SparseDigitalWaveform*>(chunk), tstart, tend);
+	else
+		return false;
+	return true;
+}
+
+/**
+	@brief Makes an empty stitched output for a chunk output, in host memory
+
+	@return The new waveform, or null if the type can't be stitched
+ */
+static WaveformBase* NewStitchedOutput(WaveformBase* chunk)
+{
+	WaveformBase* ret = nullptr;
+	if(auto ua = dynamic_cast<UniformAnalogWaveform*>(chunk))
+		ret = CloneEmpty(ua);
+	else if(auto ud = dynamic_cast<UniformDigitalWaveform*>(chunk))
+		ret = CloneEmpty(ud);
+	else if(auto sa = dynamic_cast<SparseAnalogWaveform*>(chunk))
+		ret = CloneEmpty(sa);
+	else if(auto sd = dynamic_cast<SparseDigitalWaveform*>(chunk))
+		ret = CloneEmpty(sd);
+
+	//The whole capture doesn't fit on the GPU, so don't try to keep a copy there
+	if(ret)
+		HistoryPoint::SetWaveformTier(ret, HistoryPoint::TIER_HOST);
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts running a filter in chunks in the background
+
+	@param session		The session the filter belongs to
+	@param target		The filter to compute the output of
+	@param chunkSamples	Samples of the first source waveform per window, not counting the overlap
+	@param overlap		Total overlap needed by the chain, or null to use the overlap registered for each filter
+ */
+ChunkedFilterRunner::ChunkedFilterRunner(
+	Session& session,
+	Filter* target,
+	size_t chunkSamples,
+	const StreamingSpec* overlap)
+	: m_session(session)
+	, m_target(target)
+	, m_chunkSamples(max(chunkSamples, (size_t)1))
+	, m_hasOverride(overlap != nullptr)
+	, m_override(overlap ? *overlap : StreamingSpec())
+	, m_tstart(0)
+	, m_tend(0)
+	, m_chunkWidth(0)
+	, m_chunkCount(0)
+	, m_chunksDone(0)
+	, m_cancel(false)
+	, m_done(false)
+{
+	m_thread = thread(&ChunkedFilterRunner::WorkerThread, this);
+}
+
+ChunkedFilterRunner::~ChunkedFilterRunner()
+{
+	m_cancel = true;
+	m_thread.join();
+
+	for(auto& level : m_levels)
+	{
+		for(auto node : level)
+			static_cast<Filter*>(node)->Release();
+	}
+
+	for(auto p : m_packets)
+		delete p;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Streaming filter registry
+
+/**
+	@brief Declares that a filter can be run in chunks
+
+	@param protocol	Protocol name of the filter, as returned by GetProtocolDisplayName()
+	@param spec		Context the filter needs around each output sample
+ */
+void ChunkedFilterRunner::RegisterStreamingFilter(const string& protocol, StreamingSpec spec)
+{
+	lock_guard<mutex> lock(g_streamingFiltersMutex);
+	GetStreamingFilters()[protocol] = spec;
+}
+
+/**
+	@brief Checks if a filter can be run in chunks, and if so how much context it needs
+
+	@return True if the filter is registered as streaming
+ */
+bool ChunkedFilterRunner::GetStreamingSpec(Filter* f, StreamingSpec& spec)
+{
+	lock_guard<mutex> lock(g_streamingFiltersMutex);
+	auto& filters = GetStreamingFilters();
+	auto it = filters.find(f->GetProtocolDisplayName());
+	if(it == filters.end())
+		return false;
+	spec = it->second;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+void ChunkedFilterRunner::SetError(const string& error)
+{
+	LogError("Chunked run of %s failed: %s\n", m_target->GetHwname().c_str(), error.c_str());
+
+	lock_guard<mutex> lock(m_errorMutex);
+	m_error = error;
+}
+
+/**
+	@brief Walks the graph from the target back to the instrument channels feeding it
+
+	Must be called with the waveform writer and data mutexes held.
+ */
+bool ChunkedFilterRunner::FindChain(string& error)
+{
+	map<Filter*, size_t> levels;
+	StreamingSpec total;
+
+	//Level of each filter is one more than the deepest filter feeding it, with filters fed only by instruments at 0
+	function<bool(Filter*, size_t&)> visit = [&](Filter* f, size_t& level) -> bool
+	{
+		auto it = levels.find(f);
+		if(it != levels.end())
+		{
+			level = it->second;
+			return true;
+		}
+
+		if(f->GetInputCount() == 0)
+		{
+			error = f->GetHwname() + " has no inputs, so there's nothing to split into chunks";
+			return false;
+		}
+
+		StreamingSpec spec;
+		if(!m_hasOverride && !GetStreamingSpec(f, spec))
+		{
+			error = f->GetHwname() + " (" + f->GetProtocolDisplayName() + ") isn't known to be able to run in "
+				"chunks. Specify the overlap it needs to run it anyway.";
+			return false;
+		}
+		total.m_history += spec.m_history;
+		total.m_lookahead += spec.m_lookahead;
+
+		level = 0;
+		for(size_t i=0; i<f->GetInputCount(); i++)
+		{
+			auto stream = f->GetInput(i);
+			if(!stream.m_channel)
+			{
+				error = "Input " + f->GetInputName(i) + " of " + f->GetHwname() + " isn't connected";
+				return false;
+			}
+
+			auto upstream = dynamic_cast<Filter*>(stream.m_channel);
+			if(upstream)
+			{
+				size_t upLevel;
+				if(!visit(upstream, upLevel))
+					return false;
+				level = max(level, upLevel + 1);
+				continue;
+			}
+
+			//Scalar inputs are the same for every chunk
+			auto data = stream.GetData();
+			if(!data && (stream.GetType() == Stream::STREAM_TYPE_ANALOG_SCALAR))
+				continue;
+			if(!data)
+			{
+				error = stream.GetName() + " has no data";
+				return false;
+			}
+			if(find(m_sources.begin(), m_sources.end(), stream) == m_sources.end())
+			{
+				if(!IsSliceable(data))
+				{
+					error = stream.GetName() + " isn't an analog or digital waveform";
+					return false;
+				}
+				m_sources.push_back(stream);
+				m_sourceData.push_back(data);
+			}
+		}
+
+		levels[f] = level;
+		return true;
+	};
+
+	size_t targetLevel;
+	if(!visit(m_target, targetLevel))
+		return false;
+	if(m_sources.empty())
+	{
+		error = "No waveforms feed " + m_target->GetHwname();
+		return false;
+	}
+
+	m_levels.resize(targetLevel + 1);
+	for(auto it : levels)
+	{
+		it.first->AddRef();
+		m_levels[it.second].insert(it.first);
+	}
+
+	m_overlap = m_hasOverride ? m_override : total;
+
+	//Windows cover the union of all the sources, and are sized by the first one's sample rate
+	bool first = true;
+	for(auto data : m_sourceData)
+	{
+		data->PrepareForCpuAccess();
+
+		int64_t tstart;
+		int64_t tend;
+		if(!GetWaveformSpan(data, tstart, tend))
+			continue;
+		if(first)
+		{
+			m_tstart = tstart;
+			m_tend = tend;
+			first = false;
+		}
+		m_tstart = min(m_tstart, tstart);
+		m_tend = max(m_tend, tend);
+	}
+	if(first)
+	{
+		error = "The input waveforms are empty";
+		return false;
+	}
+
+	m_chunkWidth = max((int64_t)1, (int64_t)m_chunkSamples * m_sourceData[0]->m_timescale);
+	m_chunkCount = (m_tend - m_tstart + m_chunkWidth - 1) / m_chunkWidth;
+	return true;
+}
+
+void ChunkedFilterRunner::WorkerThread()
+{
+	pthread_setname_np_compat("ChunkedFilter");
+	Tracer::SetThreadName("ChunkedFilter");
+
+	{
+		lock_guard wlock(m_session.GetWaveformWriterMutex());
+		lock_guard lock(m_session.GetWaveformDataMutex());
+		string error;
+		if(!FindChain(error))
+		{
+			SetError(error);
+			m_done = true;
+			return;
+		}
+	}
+
+	LogDebug("Running %s in %zu chunks of %s (history %s, lookahead %s)\n",
+		m_target->GetHwname().c_str(),
+		m_chunkCount,
+		Unit(Unit::UNIT_FS).PrettyPrint(m_chunkWidth).c_str(),
+		Unit(Unit::UNIT_FS).PrettyPrint(m_overlap.m_history).c_str(),
+		Unit(Unit::UNIT_FS).PrettyPrint(m_overlap.m_lookahead).c_str());
+
+	auto& pool = m_session.GetTaskPool();
+	vector<unique_ptr<WaveformBase>> current;
+	vector<unique_ptr<WaveformBase>> next;
+	bool ok = true;
+	for(size_t i=0; (i < m_chunkCount) && !m_cancel; i++)
+	{
+		int64_t tstart = m_tstart + i*m_chunkWidth;
+		int64_t tend = (i+1 == m_chunkCount) ? m_tend : (tstart + m_chunkWidth);
+
+		//Only hold the writer mutex for one window at a time, so new acquisitions aren't held up for the whole run.
+		//If one replaced the capture since the last window, the source waveforms may be gone, so stop.
+		{
+			lock_guard wlock(m_session.GetWaveformWriterMutex());
+			ok = CheckSources();
+			if(!ok)
+				break;
+			if(i == 0)
+				SliceSources(tstart, tend, current);
+
+			//Nothing can replace the source data while we hold the writer mutex, so the next window can be sliced
+			//out of it while this one is running
+			TaskGroup group;
+			if(i+1 < m_chunkCount)
+			{
+				pool.Submit(group, [this, &next, tend]
+					{ SliceSources(tend, min(tend + m_chunkWidth, m_tend), next); });
+			}
+			ok = RunChunk(i, tstart, tend, current);
+			pool.Wait(group);
+		}
+		if(!ok)
+			break;
+
+		m_chunksDone ++;
+		current.swap(next);
+		next.clear();
+
+		//Give anyone waiting for the writer mutex a chance to get it
+		this_thread::yield();
+	}
+
+	if(ok && !m_cancel)
+		Finish();
+	DeleteScratchOutputs();
+	m_done = true;
+}
+
+/**
+	@brief Checks that the source channels still have the waveforms we started with
+
+	Must be called with the waveform writer mutex held.
+
+	@return False (and sets the error) if a new acquisition or history point replaced any of them
+ */
+bool ChunkedFilterRunner::CheckSources()
+{
+	for(size_t i=0; i<m_sources.size(); i++)
+	{
+		if(m_sources[i].GetData() != m_sourceData[i])
+		{
+			SetError(m_sources[i].GetName() + " changed while processing");
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+	@brief Sets aside the real outputs of the chain's filters, and gives them their scratch outputs from the last window
+
+	Must be called with the waveform writer and data mutexes held, and followed by SwapOutScratchOutputs() before they
+	are released.
+ */
+void ChunkedFilterRunner::SwapInScratchOutputs()
+{
+	for(auto& level : m_levels)
+	{
+		for(auto node : level)
+		{
+			auto f = static_cast<Filter*>(node);
+			for(size_t i=0; i<f->GetStreamCount(); i++)
+			{
+				StreamDescriptor stream(f, i);
+				m_savedOutputs[stream] = f->GetData(i);
+				f->Detach(i);
+
+				auto it = m_scratchOutputs.find(stream);
+				if(it != m_scratchOutputs.end())
+				{
+					f->SetData(it->second, i);
+					m_scratchOutputs.erase(it);
+				}
+			}
+		}
+	}
+}
+
+/**
+	@brief Takes the per-window outputs of the chain's filters back, and puts their real outputs back in place
+
+	Must be called with the waveform writer and data mutexes held.
+ */
+void ChunkedFilterRunner::SwapOutScratchOutputs()
+{
+	for(auto& level : m_levels)
+	{
+		for(auto node : level)
+		{
+			auto f = static_cast<Filter*>(node);
+			for(size_t i=0; i<f->GetStreamCount(); i++)
+			{
+				StreamDescriptor stream(f, i);
+				auto temp = f->GetData(i);
+				f->Detach(i);
+				if(temp)
+					m_scratchOutputs[stream] = temp;
+
+				auto it = m_savedOutputs.find(stream);
+				if(it != m_savedOutputs.end())
+				{
+					f->SetData(it->second, i);
+					m_savedOutputs.erase(it);
+				}
+			}
+		}
+	}
+
+	//Anything left over was on a stream the filter no longer has
+	for(auto& it : m_savedOutputs)
+		delete it.second;
+	m_savedOutputs.clear();
+}
+
+/**
+	@brief Deletes the per-window outputs of the chain's filters at the end of the run
+
+	These are never attached to a filter outside of RunChunk(), so no locks are needed.
+ */
+void ChunkedFilterRunner::DeleteScratchOutputs()
+{
+	for(auto& it : m_scratchOutputs)
+		delete it.second;
+	m_scratchOutputs.clear();
+}
+
+/**
+	@brief Copies one window of every source waveform, padded by the overlap the chain needs
+
+	Must be called with the waveform writer mutex held.
+ */
+void ChunkedFilterRunner::SliceSources(int64_t tstart, int64_t tend, vector<unique_ptr<WaveformBase>>& slices)
+{
+	slices.clear();
+	for(auto data : m_sourceData)
+	{
+		slices.push_back(unique_ptr<WaveformBase>(
+			SliceWaveform(data, tstart - m_overlap.m_history, tend + m_overlap.m_lookahead)));
+	}
+}
+
+/**
+	@brief Runs one window through the chain and keeps the target's output within [tstart, tend)
+
+	@param ichunk	Index of the window
+	@param tstart	Start of the window, in fs from the trigger
+	@param tend		End of the window
+	@param slices	Padded source waveforms for the window, in the same order as m_sources
+
+	@return False if the run can't continue
+ */
+bool ChunkedFilterRunner::RunChunk(
+	size_t ichunk,
+	int64_t tstart,
+	int64_t tend,
+	vector<unique_ptr<WaveformBase>>& slices)
+{
+	TRACE_ZONE("ChunkedFilterRunner::RunChunk");
+
+	lock_guard wlock(m_session.GetWaveformWriterMutex());
+	lock_guard lock(m_session.GetWaveformDataMutex());
+
+	//A new acquisition or history point replaced the capture we were working on
+	if(!CheckSources())
+		return false;
+
+	//Swap in the window, run the chain over it, and put the full waveforms back
+	for(size_t i=0; i<m_sources.size(); i++)
+	{
+		m_sources[i].m_channel->Detach(m_sources[i].m_stream);
+		m_sources[i].m_channel->SetData(slices[i].release(), m_sources[i].m_stream);
+	}
+	SwapInScratchOutputs();
+	m_session.RunFilterLevels(m_levels);
+	for(size_t i=0; i<m_sources.size(); i++)
+	{
+		auto chan = m_sources[i].m_channel;
+		auto slice = chan->GetData(m_sources[i].m_stream);
+		chan->Detach(m_sources[i].m_stream);
+		delete slice;
+		chan->SetData(m_sourceData[i], m_sources[i].m_stream);
+	}
+
+	//Keep only the output within the unpadded window
+	if(ichunk == 0)
+		m_outputs.resize(m_target->GetStreamCount());
+	for(size_t i=0; (i < m_outputs.size()) && (i < m_target->GetStreamCount()); i++)
+	{
+		auto data = m_target->GetData(i);
+		if(!data)
+			continue;
+
+		if(ichunk == 0)
+			m_outputs[i].reset(NewStitchedOutput(data));
+		if(m_outputs[i] && !AppendWaveform(m_outputs[i].get(), data, tstart, tend))
+		{
+			LogWarning("Output %zu of %s changed type between chunks, dropping it\n",
+				i, m_target->GetHwname().c_str());
+			m_outputs[i] = nullptr;
+		}
+	}
+
+	auto decoder = dynamic_cast<PacketDecoder*>(m_target);
+	if(decoder)
+	{
+		for(auto p : decoder->GetPackets())
+		{
+			if( (p->m_offset >= tstart) && (p->m_offset < tend) )
+				m_packets.push_back(p);
+			else
+				delete p;
+		}
+		decoder->DetachPackets();
+	}
+
+	//Nothing outside the run may see the per-window outputs once we let go of the mutexes
+	SwapOutScratchOutputs();
+	return true;
+}
+
+/**
+	@brief Replaces the target's output with the stitched one
+ */
+void ChunkedFilterRunner::Finish()
+{
+	lock_guard wlock(m_session.GetWaveformWriterMutex());
+	lock_guard lock(m_session.GetWaveformDataMutex());
+
+	if(!CheckSources())
+		return;
+
+	for(size_t i=0; i<m_target->GetStreamCount(); i++)
+	{
+		if((i >= m_outputs.size()) || !m_outputs[i])
+		{
+			LogNotice("Output %zu of %s can't be stitched from chunks, clearing it\n", i, m_target->GetHwname().c_str());
+			m_target->SetData(nullptr, i);
+		}
+		else
+		{
+			m_outputs[i]->MarkModifiedFromCpu();
+			m_target->SetData(m_outputs[i].release(), i);
+		}
+	}
+
+	auto decoder = dynamic_cast<PacketDecoder*>(m_target);
+	if(decoder)
+	{
+		auto mgr = m_session.GetPacketManager(decoder);
+		if(mgr)
+		{
+			auto data = m_sourceData[0];
+			mgr->ReplacePackets(TimePoint(data->m_startTimestamp, data->m_startFemtoseconds), m_packets);
+			m_packets.clear();
+		}
+	}
+
+	//Don't let saved outputs from a normal run be swapped back in over the stitched ones
+	m_session.InvalidateFilterOutputCache();
+}
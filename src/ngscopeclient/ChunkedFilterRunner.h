@@ -0,0 +1,181 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ChunkedFilterRunner
+ */
+#ifndef ChunkedFilterRunner_h
+#define ChunkedFilterRunner_h
+
+class Session;
+
+/**
+	@brief How much context a filter needs around each output sample to be run in chunks
+ */
+class StreamingSpec
+{
+public:
+	StreamingSpec(int64_t history = 0, int64_t lookahead = 0)
+	: m_history(history)
+	, m_lookahead(lookahead)
+	{}
+
+	///@brief Input needed before the first output sample of a chunk, in fs
+	int64_t m_history;
+
+	///@brief Input needed after the last output sample of a chunk, in fs
+	int64_t m_lookahead;
+};
+
+/**
+	@brief Runs a filter over a capture too big for GPU memory, in overlapping windows of its inputs
+
+	Every filter from the target back to the instrument channels feeding it must be able to stream, either because it's
+	registered with RegisterStreamingFilter() or because the user supplied an overlap for the whole chain. Each window
+	of the source waveforms is padded by the summed history and lookahead of the chain, swapped onto the source channels
+	in place of the full waveform, and run through the graph. Only the part of the target's output within the
+	unpadded window is kept, in host memory, so the GPU never has to hold more than a couple of windows at once. The
+	next window is sliced out on the task pool while the current one runs.
+
+	Each window runs with the filters of the chain (including the target) holding scratch outputs, and their real
+	outputs are put back before the waveform mutexes are released, so the GUI and WaveformThread never see a
+	window-sized output between windows. The scratch outputs are kept from one window to the next so their buffers
+	can be reused, and deleted at the end.
+
+	When every window is done, the stitched output replaces the target's output and, for protocol decoders, the
+	packets replace those in its packet manager. Output streams of the target which can't be stitched (eye patterns,
+	protocol symbols, scalars) are cleared. If the run fails or is cancelled, the target keeps the output it had.
+ */
+class ChunkedFilterRunner
+{
+public:
+	ChunkedFilterRunner(Session& session, Filter* target, size_t chunkSamples, const StreamingSpec* overlap = nullptr);
+	~ChunkedFilterRunner();
+
+	///@brief Checks if the run has finished (or failed, or was cancelled)
+	bool IsDone()
+	{ return m_done; }
+
+	///@brief Gets the fraction of windows processed so far
+	float GetProgress()
+	{
+		if(m_chunkCount == 0)
+			return 1;
+		return m_chunksDone.load() * 1.0f / m_chunkCount;
+	}
+
+	void Cancel()
+	{ m_cancel = true; }
+
+	///@brief Gets the reason the run failed, or an empty string if it didn't
+	std::string GetError()
+	{
+		std::lock_guard<std::mutex> lock(m_errorMutex);
+		return m_error;
+	}
+
+	Filter* GetTarget()
+	{ return m_target; }
+
+	static void RegisterStreamingFilter(const std::string& protocol, StreamingSpec spec);
+	static bool GetStreamingSpec(Filter* f, StreamingSpec& spec);
+
+protected:
+	void WorkerThread();
+	bool FindChain(std::string& error);
+	bool RunChunk(
+		size_t ichunk,
+		int64_t tstart,
+		int64_t tend,
+		std::vector<std::unique_ptr<WaveformBase>>& slices);
+	void SliceSources(int64_t tstart, int64_t tend, std::vector<std::unique_ptr<WaveformBase>>& slices);
+	bool CheckSources();
+	void SwapInScratchOutputs();
+	void SwapOutScratchOutputs();
+	void DeleteScratchOutputs();
+	void Finish();
+	void SetError(const std::string& error);
+
+	Session& m_session;
+
+	///@brief The filter whose output we're computing
+	Filter* m_target;
+
+	///@brief Samples of the first source per window, not counting the overlap
+	size_t m_chunkSamples;
+
+	///@brief Overlap for the whole chain, overriding the registry
+	bool m_hasOverride;
+	StreamingSpec m_override;
+
+	///@brief Context needed by the whole chain
+	StreamingSpec m_overlap;
+
+	///@brief Every filter from the sources to the target, in graph levels
+	std::vector<std::set<FlowGraphNode*>> m_levels;
+
+	///@brief Instrument channels feeding the chain
+	std::vector<StreamDescriptor> m_sources;
+
+	///@brief The full source waveforms, as they were when the run started
+	std::vector<WaveformBase*> m_sourceData;
+
+	///@brief Time of the first and one past the last source sample, in fs from the trigger
+	int64_t m_tstart;
+	int64_t m_tend;
+
+	///@brief Width of a window before padding, in fs
+	int64_t m_chunkWidth;
+
+	///@brief Real outputs of the chain's filters, held while a window is running in their place
+	std::map<StreamDescriptor, WaveformBase*> m_savedOutputs;
+
+	///@brief Outputs of the chain's filters from the last window, kept so the next one can reuse their buffers
+	std::map<StreamDescriptor, WaveformBase*> m_scratchOutputs;
+
+	///@brief Stitched target output for each stream, or null if it can't be stitched
+	std::vector<std::unique_ptr<WaveformBase>> m_outputs;
+
+	///@brief Packets decoded in each window's unpadded range, if the target is a protocol decoder
+	std::vector<Packet*> m_packets;
+
+	size_t m_chunkCount;
+	std::atomic<size_t> m_chunksDone;
+	std::atomic<bool> m_cancel;
+	std::atomic<bool> m_done;
+
+	std::mutex m_errorMutex;
+	std::string m_error;
+
+	std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ComputePipelinePool
+ */
+#include "ngscopeclient.h"
+#include "ComputePipelinePool.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Pool management
+
+/**
+	@brief Gets a pipeline for the specified shader, reusing an idle one if possible
+
+	The arguments are the same as the ComputePipeline constructor.
+ */
+shared_ptr<ComputePipeline> ComputePipelinePool::Get(
+	const string& shaderPath,
+	size_t numSSBOs,
+	size_t pushConstantSize,
+	size_t numStorageImages,
+	size_t numSampledImages)
+{
+	ComputePipelineKey key(shaderPath, numSSBOs, pushConstantSize, numStorageImages, numSampledImages);
+
+	lock_guard<mutex> lock(m_mutex);
+
+	auto it = m_idle.find(key);
+	if( (it != m_idle.end()) && !it->second.empty() )
+	{
+		auto pipe = it->second.back();
+		it->second.pop_back();
+		return pipe;
+	}
+
+	auto pipe = make_shared<ComputePipeline>(
+		shaderPath, numSSBOs, pushConstantSize, numStorageImages, numSampledImages);
+	m_keys.emplace(pipe.get(), key);
+	return pipe;
+}
+
+/**
+	@brief Makes sure at least the specified number of idle, fully compiled pipelines exist for a shader
+
+	This is slow (it's the same shader compilation Get() would otherwise do on first dispatch) and is meant to be run
+	from a background thread. The mutex isn't held while compiling, so Get() can still create its own pipelines in
+	the meantime if it gets there first.
+
+	@param key		Shader and layout of the pipeline
+	@param count	Number of idle pipelines wanted
+ */
+void ComputePipelinePool::Warm(const ComputePipelineKey& key, size_t count)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto it = m_idle.find(key);
+		if(it != m_idle.end())
+		{
+			if(it->second.size() >= count)
+				return;
+			count -= it->second.size();
+		}
+	}
+
+	//ComputePipeline doesn't compile anything until the first buffer is bound, so bind a placeholder.
+	//Everyone using a pooled pipeline binds all of its buffers before dispatching, so it never gets used.
+	AcceleratorBuffer<uint32_t> placeholder("ComputePipelinePool.placeholder");
+	placeholder.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+	placeholder.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	placeholder.resize(1);
+
+	for(size_t i=0; i<count; i++)
+	{
+		auto pipe = make_shared<ComputePipeline>(
+			key.m_shaderPath, key.m_numSSBOs, key.m_pushConstantSize, key.m_numStorageImages, key.m_numSampledImages);
+		{
+			shared_lock vlock(g_vulkanActivityMutex);
+			pipe->BindBuffer(0, placeholder, true);
+		}
+
+		lock_guard<mutex> lock(m_mutex);
+		m_keys.emplace(pipe.get(), key);
+		m_idle[key].push_back(pipe);
+	}
+}
+
+/**
+	@brief Returns a pipeline to the pool and clears the caller's reference to it
+
+	Any commands using the pipeline must have completed, or at least not be re-recorded, before it's released since
+	the next user will rebind its buffers.
+
+	Pipelines which didn't come from the pool are simply dropped.
+ */
+void ComputePipelinePool::Release(shared_ptr<ComputePipeline>& pipe)
+{
+	if(pipe == nullptr)
+		return;
+
+	lock_guard<mutex> lock(m_mutex);
+
+	auto it = m_keys.find(pipe.get());
+	if(it != m_keys.end())
+		m_idle[it->second].push_back(pipe);
+	pipe = nullptr;
+}
+
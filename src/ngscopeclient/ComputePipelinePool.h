@@ -0,0 +1,116 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ComputePipelinePool
+ */
+#ifndef ComputePipelinePool_h
+#define ComputePipelinePool_h
+
+/**
+	@brief Everything a ComputePipeline is constructed from
+ */
+class ComputePipelineKey
+{
+public:
+	ComputePipelineKey(
+		const std::string& shaderPath,
+		size_t numSSBOs,
+		size_t pushConstantSize,
+		size_t numStorageImages = 0,
+		size_t numSampledImages = 0)
+	: m_shaderPath(shaderPath)
+	, m_numSSBOs(numSSBOs)
+	, m_pushConstantSize(pushConstantSize)
+	, m_numStorageImages(numStorageImages)
+	, m_numSampledImages(numSampledImages)
+	{}
+
+	bool operator<(const ComputePipelineKey& rhs) const
+	{
+		return
+			std::tie(m_shaderPath, m_numSSBOs, m_pushConstantSize, m_numStorageImages, m_numSampledImages) <
+			std::tie(
+				rhs.m_shaderPath, rhs.m_numSSBOs, rhs.m_pushConstantSize, rhs.m_numStorageImages, rhs.m_numSampledImages);
+	}
+
+	std::string m_shaderPath;
+	size_t m_numSSBOs;
+	size_t m_pushConstantSize;
+	size_t m_numStorageImages;
+	size_t m_numSampledImages;
+};
+
+/**
+	@brief Pool of idle compute pipelines, so closing and opening views doesn't keep recreating the same pipelines
+
+	A ComputePipeline holds the buffers bound to it until it's dispatched, so it can't be shared between several
+	channels whose commands are recorded at the same time. Instead, each user gets a pipeline of its own from Get(),
+	and hands it back with Release() when it's done. The next request for the same shader reuses it rather than
+	loading the SPIR-V and creating a new pipeline.
+
+	Warm() creates idle pipelines ahead of time, so a background thread can compile everything a session is going to
+	need before the first waveform arrives.
+ */
+class ComputePipelinePool
+{
+public:
+	std::shared_ptr<ComputePipeline> Get(
+		const std::string& shaderPath,
+		size_t numSSBOs,
+		size_t pushConstantSize,
+		size_t numStorageImages = 0,
+		size_t numSampledImages = 0);
+
+	///@brief Gets a pipeline for the specified key, reusing an idle one if possible
+	std::shared_ptr<ComputePipeline> Get(const ComputePipelineKey& key)
+	{
+		return Get(
+			key.m_shaderPath, key.m_numSSBOs, key.m_pushConstantSize, key.m_numStorageImages, key.m_numSampledImages);
+	}
+
+	void Warm(const ComputePipelineKey& key, size_t count);
+
+	void Release(std::shared_ptr<ComputePipeline>& pipe);
+
+protected:
+
+	///@brief Mutex protecting the pool, since pipelines are requested from both the GUI and WaveformThread
+	std::mutex m_mutex;
+
+	///@brief Key of every pipeline created by the pool
+	std::map<ComputePipeline*, ComputePipelineKey> m_keys;
+
+	///@brief Pipelines which aren't currently in use by anything
+	std::map<ComputePipelineKey, std::vector<std::shared_ptr<ComputePipeline> > > m_idle;
+};
+
+#endif
@@ -267,7 +267,8 @@ void CreateFilterBrowser::DrawIconButton(
 		tl.x += extraSpace / 2;
 		br.x -= extraSpace / 2;
 
-		list->AddImage(m_parent->GetTexture(icon), tl, br);
+		auto tex = m_parent->GetTextureRef(icon);
+		list->AddImage(tex.m_id, tl, br, tex.m_uv0, tex.m_uv1);
 	}
 
 	//Draw the text
@@ -0,0 +1,321 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DataLogDialog
+ */
+
+#include "ngscopeclient.h"
+#include "DataLogDialog.h"
+#include "Session.h"
+
+using namespace std;
+
+///@brief How often to reload a log which is still being written, in seconds
+#define DATALOG_RELOAD_INTERVAL 1.0
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+DataLogDialog::DataLogDialog(Session* session)
+	: Dialog("Data Logger", "DataLogger", ImVec2(600, 450))
+	, m_session(session)
+	, m_lastReload(0)
+	, m_rangesStale(true)
+	, m_fetchedWidth(0)
+	, m_fitRequested(true)
+	, m_browsingForNewLog(false)
+{
+	//Show the log in progress, if there is one
+	auto logger = m_session->GetDataLogger();
+	if(logger)
+		OpenLog(logger->GetPath());
+}
+
+DataLogDialog::~DataLogDialog()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rendering
+
+/**
+	@brief Renders the dialog and handles UI events
+
+	@return		True if we should continue showing the dialog
+				False if it's been closed
+ */
+bool DataLogDialog::DoRender()
+{
+	LoggingControls();
+
+	if(m_reader)
+	{
+		//Follow a log that's still being written
+		auto logger = m_session->GetDataLogger();
+		if( logger && (logger->GetPath() == m_reader->GetPath()) &&
+			(GetTime() - m_lastReload > DATALOG_RELOAD_INTERVAL) )
+		{
+			//Plot any columns which have showed up since the last reload
+			size_t oldCount = m_reader->GetColumns().size();
+			m_reader->Load(m_reader->GetPath());
+			for(size_t i=oldCount; i<m_reader->GetColumns().size(); i++)
+				m_plottedColumns.emplace(i);
+
+			m_lastReload = GetTime();
+			m_rangesStale = true;
+		}
+
+		ColumnList();
+		Plot();
+	}
+
+	RunFileDialog();
+	return true;
+}
+
+/**
+	@brief Buttons for starting and stopping logging, and opening logs to view
+ */
+void DataLogDialog::LoggingControls()
+{
+	auto logger = m_session->GetDataLogger();
+	if(logger)
+	{
+		if(ImGui::Button("Stop Logging"))
+		{
+			m_session->StopDataLogging();
+
+			//Pick up the last few readings
+			if(m_reader && (m_reader->GetPath() == logger->GetPath()) )
+			{
+				m_reader->Load(m_reader->GetPath());
+				m_rangesStale = true;
+			}
+		}
+		else
+		{
+			ImGui::SameLine();
+			ImGui::Text(
+				"%zu columns, %zu readings written, %zu dropped",
+				logger->GetColumnCount(),
+				logger->GetWrittenCount(),
+				logger->GetDroppedCount());
+		}
+	}
+	else
+	{
+		if(m_fileDialog)
+			ImGui::BeginDisabled();
+		if(ImGui::Button("Start Logging..."))
+		{
+			m_browsingForNewLog = true;
+			m_fileDialog = MakeFileBrowser(
+				m_session->GetMainWindow(),
+				".",
+				"Start Data Log",
+				"Data logs (*.datalog)",
+				"*.datalog",
+				true);
+		}
+		if(m_fileDialog)
+			ImGui::EndDisabled();
+	}
+
+	HelpMarker(
+		"Records every reading from power supplies, multimeters, and electronic loads to disk, along with the time it "
+		"was taken.\n\n"
+		"Readings are taken at the instrument's polling rate, and logging carries on until stopped or the session is "
+		"closed, regardless of history depth.");
+
+	if(m_fileDialog)
+		ImGui::BeginDisabled();
+	if(ImGui::Button("Open Log..."))
+	{
+		m_browsingForNewLog = false;
+		m_fileDialog = MakeFileBrowser(
+			m_session->GetMainWindow(),
+			".",
+			"Open Data Log",
+			"Data logs (*.datalog)",
+			"*.datalog",
+			false);
+	}
+	if(m_fileDialog)
+		ImGui::EndDisabled();
+
+	if(m_reader)
+	{
+		ImGui::SameLine();
+		ImGui::TextUnformatted(m_reader->GetPath().c_str());
+	}
+}
+
+/**
+	@brief Checkboxes for picking which columns to plot
+ */
+void DataLogDialog::ColumnList()
+{
+	if(!ImGui::CollapsingHeader("Columns", ImGuiTreeNodeFlags_DefaultOpen))
+		return;
+
+	auto& columns = m_reader->GetColumns();
+	if(columns.empty())
+		ImGui::TextDisabled("No readings logged yet");
+
+	for(size_t i=0; i<columns.size(); i++)
+	{
+		bool plotted = (m_plottedColumns.find(i) != m_plottedColumns.end());
+		if(ImGui::Checkbox((columns[i].GetName() + "##" + to_string(i)).c_str(), &plotted))
+		{
+			if(plotted)
+				m_plottedColumns.emplace(i);
+			else
+				m_plottedColumns.erase(i);
+			m_rangesStale = true;
+		}
+		Tooltip(to_string(columns[i].m_count) + " samples");
+	}
+}
+
+/**
+	@brief Plots the selected columns over whatever range is currently in view
+ */
+void DataLogDialog::Plot()
+{
+	if(ImGui::Button("Zoom to Fit"))
+		m_fitRequested = true;
+
+	if(!ImPlot::BeginPlot("##datalog", ImVec2(-1, -1)))
+		return;
+
+	ImPlot::SetupAxes("Time (s)", nullptr, 0, ImPlotAxisFlags_AutoFit);
+	if(m_fitRequested)
+	{
+		ImPlot::SetupAxisLimits(ImAxis_X1, 0, max(m_reader->GetEndTime(), 1.0), ImGuiCond_Always);
+		m_fitRequested = false;
+	}
+
+	//Only go back to the files if the view has actually changed
+	auto limits = ImPlot::GetPlotLimits();
+	size_t width = static_cast<size_t>(max(ImPlot::GetPlotSize().x, 1.0f));
+	if( m_rangesStale ||
+		(limits.X.Min != m_fetchedRange.Min) ||
+		(limits.X.Max != m_fetchedRange.Max) ||
+		(width != m_fetchedWidth) )
+	{
+		m_ranges.clear();
+		for(auto i : m_plottedColumns)
+			m_reader->GetRange(i, limits.X.Min, limits.X.Max, width, m_ranges[i]);
+
+		m_fetchedRange = limits.X;
+		m_fetchedWidth = width;
+		m_rangesStale = false;
+	}
+
+	auto& columns = m_reader->GetColumns();
+	for(auto& it : m_ranges)
+	{
+		auto& range = it.second;
+		if(range.m_times.empty() || (it.first >= columns.size()) )
+			continue;
+
+		string name = columns[it.first].GetName() + "##" + to_string(it.first);
+		if(range.m_decimated)
+		{
+			//Each point is a bucket of many samples, so show the range of values they cover
+			ImPlot::SetNextFillStyle(IMPLOT_AUTO_COL, 0.75f);
+			ImPlot::PlotShaded(
+				name.c_str(),
+				&range.m_times[0],
+				&range.m_min[0],
+				&range.m_max[0],
+				range.m_times.size());
+		}
+		else
+			ImPlot::PlotLine(name.c_str(), &range.m_times[0], &range.m_min[0], range.m_times.size());
+	}
+
+	ImPlot::EndPlot();
+}
+
+/**
+	@brief Opens a log for viewing, plotting every column
+ */
+void DataLogDialog::OpenLog(const string& path)
+{
+	m_reader = make_unique<DataLogReader>();
+	if(!m_reader->Load(path))
+	{
+		ShowErrorPopup("Failed to open data log", string("The data log ") + path + " could not be loaded.");
+		m_reader = nullptr;
+		return;
+	}
+
+	m_lastReload = GetTime();
+	m_plottedColumns.clear();
+	for(size_t i=0; i<m_reader->GetColumns().size(); i++)
+		m_plottedColumns.emplace(i);
+	m_rangesStale = true;
+	m_fitRequested = true;
+}
+
+/**
+	@brief Runs the file browser, if open
+ */
+void DataLogDialog::RunFileDialog()
+{
+	if(!m_fileDialog)
+		return;
+
+	m_fileDialog->Render();
+
+	if(m_fileDialog->IsClosedOK())
+	{
+		auto path = m_fileDialog->GetFileName();
+		if(m_browsingForNewLog)
+		{
+			if(path.find(".datalog") == string::npos)
+				path += ".datalog";
+
+			if(m_session->StartDataLogging(path))
+				OpenLog(path);
+			else
+				ShowErrorPopup("Failed to start logging", string("The data log ") + path + " could not be created.");
+		}
+		else
+			OpenLog(path);
+	}
+
+	if(m_fileDialog->IsClosed())
+		m_fileDialog = nullptr;
+}
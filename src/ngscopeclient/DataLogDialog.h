@@ -0,0 +1,94 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DataLogDialog
+ */
+#ifndef DataLogDialog_h
+#define DataLogDialog_h
+
+#include "Dialog.h"
+#include "FileBrowser.h"
+#include "DataLogger.h"
+
+/**
+	@brief Starts and stops logging of instrument readings, and plots data logs
+ */
+class DataLogDialog : public Dialog
+{
+public:
+	DataLogDialog(Session* session);
+	virtual ~DataLogDialog();
+
+	virtual bool DoRender();
+
+protected:
+	void LoggingControls();
+	void ColumnList();
+	void Plot();
+	void OpenLog(const std::string& path);
+	void RunFileDialog();
+
+	Session* m_session;
+
+	///@brief The log being viewed, if any
+	std::unique_ptr<DataLogReader> m_reader;
+
+	///@brief Time m_reader was last reloaded, for following a log that's still being written
+	double m_lastReload;
+
+	///@brief Columns shown on the plot
+	std::set<size_t> m_plottedColumns;
+
+	///@brief Data for each plotted column over the current plot range
+	std::map<size_t, DataLogRange> m_ranges;
+
+	///@brief Set to refetch m_ranges on the next frame
+	bool m_rangesStale;
+
+	///@brief X axis range m_ranges was fetched for
+	ImPlotRange m_fetchedRange;
+
+	///@brief Plot width m_ranges was fetched for, in pixels
+	size_t m_fetchedWidth;
+
+	///@brief Set to zoom the plot out to the whole log on the next frame
+	bool m_fitRequested;
+
+	///@brief Browser for picking a log to create or open
+	std::shared_ptr<FileBrowser> m_fileDialog;
+
+	///@brief True if m_fileDialog is picking a new log to write, false if it's opening one to view
+	bool m_browsingForNewLog;
+};
+
+#endif
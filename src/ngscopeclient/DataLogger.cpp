@@ -0,0 +1,764 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DataLogger and DataLogReader
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "DataLogger.h"
+
+#include <fstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+///@brief Version of the on-disk data log format
+#define DATALOG_VERSION 1
+
+///@brief Number of readings each instrument thread can queue before new ones are dropped
+#define DATALOG_QUEUE_SIZE 65536
+
+///@brief How often the writer thread drains the queues and writes to disk, in milliseconds
+#define DATALOG_FLUSH_INTERVAL_MS 250
+
+///@brief Number of blocks merged into each block of the next coarser decimation level
+#define DATALOG_LEVEL_FANOUT 8
+
+static_assert(sizeof(DataLogBlock) == 40, "DataLogBlock is written to disk and must not contain padding");
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DataLogProducer
+
+DataLogProducer::DataLogProducer(size_t capacity)
+	: m_ring(capacity)
+	, m_head(0)
+	, m_tail(0)
+	, m_dropped(0)
+{
+}
+
+/**
+	@brief Queues a reading. Must only be called from the producing thread.
+
+	@return False if the queue was full and the reading was dropped
+ */
+bool DataLogProducer::Push(const DataLogSample& sample)
+{
+	size_t head = m_head.load(memory_order_relaxed);
+	if(head - m_tail.load(memory_order_acquire) >= m_ring.size())
+	{
+		m_dropped ++;
+		return false;
+	}
+
+	m_ring[head % m_ring.size()] = sample;
+	m_head.store(head + 1, memory_order_release);
+	return true;
+}
+
+/**
+	@brief Pops the oldest reading. Must only be called from the consuming thread.
+
+	@return False if the queue was empty
+ */
+bool DataLogProducer::Pop(DataLogSample& sample)
+{
+	size_t tail = m_tail.load(memory_order_relaxed);
+	if(tail == m_head.load(memory_order_acquire))
+		return false;
+
+	sample = m_ring[tail % m_ring.size()];
+	m_tail.store(tail + 1, memory_order_release);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DataLogColumnWriter
+
+DataLogColumnWriter::DataLogColumnWriter()
+	: m_count(0)
+	, m_timeFile(nullptr)
+	, m_valueFile(nullptr)
+	, m_indexFile(nullptr)
+{
+	m_block.m_count = 0;
+	m_block.m_reserved = 0;
+}
+
+DataLogColumnWriter::~DataLogColumnWriter()
+{
+	if(m_timeFile)
+		fclose(m_timeFile);
+	if(m_valueFile)
+		fclose(m_valueFile);
+	if(m_indexFile)
+		fclose(m_indexFile);
+}
+
+/**
+	@brief Creates the files for the column
+
+	@param prefix	Path to the column's files, without extension
+ */
+bool DataLogColumnWriter::Open(const string& prefix)
+{
+	m_timeFile = fopen((prefix + ".time").c_str(), "wb");
+	m_valueFile = fopen((prefix + ".value").c_str(), "wb");
+	m_indexFile = fopen((prefix + ".index").c_str(), "wb");
+	return m_timeFile && m_valueFile && m_indexFile;
+}
+
+/**
+	@brief Adds a sample to the column, updating the decimation index
+
+	@param t		Timestamp, in seconds since the start of the log
+	@param value	The reading
+ */
+void DataLogColumnWriter::Append(double t, float value)
+{
+	m_times.push_back(t);
+	m_values.push_back(value);
+
+	if(m_block.m_count == 0)
+	{
+		m_block.m_tstart = t;
+		m_block.m_first = m_count;
+		m_block.m_min = value;
+		m_block.m_max = value;
+	}
+	m_block.m_tend = t;
+	m_block.m_min = min(m_block.m_min, value);
+	m_block.m_max = max(m_block.m_max, value);
+	m_block.m_count ++;
+	m_count ++;
+
+	if(m_block.m_count == DATALOG_BLOCK_SIZE)
+	{
+		m_blocks.push_back(m_block);
+		m_block.m_count = 0;
+	}
+}
+
+/**
+	@brief Writes everything appended since the last flush
+
+	The partially filled index block isn't written; readers summarize trailing samples themselves.
+ */
+bool DataLogColumnWriter::Flush()
+{
+	if(!m_timeFile || !m_valueFile || !m_indexFile)
+		return false;
+
+	bool ok = true;
+	if(!m_times.empty())
+	{
+		ok &= (fwrite(&m_times[0], sizeof(double), m_times.size(), m_timeFile) == m_times.size());
+		ok &= (fwrite(&m_values[0], sizeof(float), m_values.size(), m_valueFile) == m_values.size());
+		m_times.clear();
+		m_values.clear();
+	}
+	if(!m_blocks.empty())
+	{
+		ok &= (fwrite(&m_blocks[0], sizeof(DataLogBlock), m_blocks.size(), m_indexFile) == m_blocks.size());
+		m_blocks.clear();
+	}
+
+	//Readers ignore samples (and index entries) which haven't made it into every file yet, so order doesn't matter
+	ok &= (fflush(m_timeFile) == 0);
+	ok &= (fflush(m_valueFile) == 0);
+	ok &= (fflush(m_indexFile) == 0);
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DataLogger construction / destruction
+
+/**
+	@brief Creates a new data log, overwriting any existing log at the same path
+
+	Check IsOpen() afterwards to see if it worked.
+
+	@param logPath	Path to the .datalog file. Column data goes in a _data directory next to it.
+ */
+DataLogger::DataLogger(const string& logPath)
+	: m_path(logPath)
+	, m_dataDir(GetDataDirectory(logPath))
+	, m_startTime(GetTime())
+	, m_metadataDirty(false)
+	, m_written(0)
+	, m_shuttingDown(false)
+{
+#ifdef _WIN32
+	_mkdir(m_dataDir.c_str());
+#else
+	mkdir(m_dataDir.c_str(), 0755);
+#endif
+
+	if(!WriteMetadata())
+	{
+		LogError("Failed to create data log %s\n", m_path.c_str());
+		return;
+	}
+
+	LogNotice("Logging instrument readings to %s\n", m_path.c_str());
+	m_thread = make_unique<thread>(&DataLogger::ThreadProc, this);
+}
+
+DataLogger::~DataLogger()
+{
+	Stop();
+}
+
+/**
+	@brief Gets the path of the directory column data is stored in, given the path to a .datalog file
+ */
+string DataLogger::GetDataDirectory(const string& logPath)
+{
+	string base = logPath;
+	if( (base.length() > strlen(".datalog")) &&
+		(base.substr(base.length() - strlen(".datalog")) == ".datalog") )
+	{
+		base = base.substr(0, base.length() - strlen(".datalog"));
+	}
+	return base + "_data";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DataLogger producer interface
+
+/**
+	@brief Gets the ID of a column, adding it to the log if it's not already there
+
+	Takes a lock, so instrument threads should only call this the first time they see each channel and quantity.
+ */
+uint32_t DataLogger::AddColumn(const string& instrument, const string& channel, const string& quantity, Unit unit)
+{
+	string key = instrument + "\n" + channel + "\n" + quantity;
+
+	lock_guard<mutex> lock(m_columnMutex);
+	auto it = m_columnIndex.find(key);
+	if(it != m_columnIndex.end())
+		return it->second;
+
+	uint32_t id = m_columns.size();
+	m_columns.push_back(DataLogColumn(instrument, channel, quantity, unit));
+	m_columnIndex[key] = id;
+	m_metadataDirty = true;
+	return id;
+}
+
+/**
+	@brief Creates a queue for a new instrument thread to push readings into
+ */
+shared_ptr<DataLogProducer> DataLogger::CreateProducer()
+{
+	auto producer = make_shared<DataLogProducer>(DATALOG_QUEUE_SIZE);
+	lock_guard<mutex> lock(m_columnMutex);
+	m_producers.push_back(producer);
+	return producer;
+}
+
+/**
+	@brief Returns the total number of readings dropped because the writer couldn't keep up
+ */
+size_t DataLogger::GetDroppedCount()
+{
+	size_t dropped = 0;
+	lock_guard<mutex> lock(m_columnMutex);
+	for(auto& p : m_producers)
+		dropped += p->GetDroppedCount();
+	return dropped;
+}
+
+/**
+	@brief Writes out everything queued so far and closes the log
+ */
+void DataLogger::Stop()
+{
+	if(!m_thread)
+		return;
+
+	m_shuttingDown = true;
+	m_wakeEvent.Signal();
+	m_thread->join();
+	m_thread = nullptr;
+
+	LogNotice("Data log %s closed: %zu readings written, %zu dropped\n",
+		m_path.c_str(),
+		m_written.load(),
+		GetDroppedCount());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DataLogger writer thread
+
+/**
+	@brief Thread function periodically writing queued readings to disk
+ */
+void DataLogger::ThreadProc()
+{
+	pthread_setname_np_compat("DataLogger");
+
+	bool ok = true;
+	while(!m_shuttingDown)
+	{
+		m_wakeEvent.BlockFor(chrono::milliseconds(DATALOG_FLUSH_INTERVAL_MS));
+
+		//Only complain once, but keep draining the queues so the producers don't all start dropping
+		if(!Drain() && ok)
+		{
+			LogError("Failed to write to data log %s\n", m_path.c_str());
+			ok = false;
+		}
+	}
+
+	//Pick up anything pushed while we were shutting down
+	Drain();
+}
+
+/**
+	@brief Moves everything in the producer queues into the column files
+
+	@return False on a write error
+ */
+bool DataLogger::Drain()
+{
+	TRACE_ZONE("DataLogger::Drain");
+
+	vector<shared_ptr<DataLogProducer>> producers;
+	{
+		lock_guard<mutex> lock(m_columnMutex);
+		producers = m_producers;
+	}
+
+	vector<DataLogSample> samples;
+	for(auto& p : producers)
+	{
+		DataLogSample sample;
+		while(p->Pop(sample))
+			samples.push_back(sample);
+	}
+
+	//Columns are always registered before any readings for them are pushed, so this covers every sample we popped
+	bool dirty;
+	{
+		lock_guard<mutex> lock(m_columnMutex);
+		while(m_writers.size() < m_columns.size())
+		{
+			auto writer = make_unique<DataLogColumnWriter>();
+			if(!writer->Open(m_dataDir + "/col" + to_string(m_writers.size())))
+				LogError("Failed to create data log column files in %s\n", m_dataDir.c_str());
+			m_writers.push_back(std::move(writer));
+		}
+		dirty = m_metadataDirty;
+		m_metadataDirty = false;
+	}
+
+	bool ok = true;
+	if(dirty)
+		ok &= WriteMetadata();
+
+	for(auto& s : samples)
+		m_writers[s.m_column]->Append(s.m_time - m_startTime, s.m_value);
+	for(auto& w : m_writers)
+		ok &= w->Flush();
+
+	m_written += samples.size();
+	return ok;
+}
+
+/**
+	@brief Writes the .datalog file describing every column added so far
+ */
+bool DataLogger::WriteMetadata()
+{
+	YAML::Node node;
+	node["version"] = DATALOG_VERSION;
+	node["start"] = m_startTime;
+	node["blocksize"] = DATALOG_BLOCK_SIZE;
+
+	{
+		lock_guard<mutex> lock(m_columnMutex);
+		for(size_t i=0; i<m_columns.size(); i++)
+		{
+			auto& col = m_columns[i];
+			string name = string("col") + to_string(i);
+
+			YAML::Node cnode;
+			cnode["id"] = i;
+			cnode["instrument"] = col.m_instrument;
+			cnode["channel"] = col.m_channel;
+			cnode["quantity"] = col.m_quantity;
+			cnode["unit"] = static_cast<int>(col.m_unit.GetType());
+			cnode["file"] = name;
+			node["columns"][name] = cnode;
+		}
+	}
+
+	ofstream outfs(m_path);
+	if(!outfs)
+		return false;
+	outfs << node;
+	outfs.close();
+	return static_cast<bool>(outfs);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DataLogSource
+
+/**
+	@brief Starts a new poll, using the given log (which may be null if logging is turned off)
+
+	All readings logged until the next call share the same timestamp.
+ */
+void DataLogSource::Begin(shared_ptr<DataLogger> logger)
+{
+	if(logger != m_logger)
+	{
+		m_logger = logger;
+		m_columns.clear();
+		m_producer = nullptr;
+		if(m_logger)
+			m_producer = m_logger->CreateProducer();
+	}
+
+	m_time = GetTime();
+}
+
+/**
+	@brief Logs a reading, if a log is open
+
+	@param inst		The instrument the reading came from
+	@param chan		The channel the reading came from
+	@param quantity	What's being measured
+	@param unit		Unit of the reading
+	@param value	The reading
+ */
+void DataLogSource::Log(Instrument* inst, InstrumentChannel* chan, const string& quantity, Unit unit, float value)
+{
+	if(!m_producer)
+		return;
+
+	auto key = make_pair(chan, quantity);
+	auto it = m_columns.find(key);
+	uint32_t column;
+	if(it != m_columns.end())
+		column = it->second;
+	else
+	{
+		column = m_logger->AddColumn(inst->m_nickname, chan->GetDisplayName(), quantity, unit);
+		m_columns[key] = column;
+	}
+
+	DataLogSample sample;
+	sample.m_time = m_time;
+	sample.m_column = column;
+	sample.m_value = value;
+	m_producer->Push(sample);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DataLogReader
+
+/**
+	@brief Gets the size of a file, or zero if it can't be opened
+ */
+static uint64_t GetDataLogFileSize(const string& path)
+{
+	ifstream in(path, ios::binary | ios::ate);
+	if(!in)
+		return 0;
+	return static_cast<uint64_t>(in.tellg());
+}
+
+DataLogReader::DataLogReader()
+	: m_startTime(0)
+	, m_endTime(0)
+{
+}
+
+/**
+	@brief Loads (or reloads) a data log
+
+	Logs which are still being written can be reloaded at any time to pick up new samples.
+
+	@return True on success
+ */
+bool DataLogReader::Load(const string& logPath)
+{
+	m_path = logPath;
+	m_dataDir = DataLogger::GetDataDirectory(logPath);
+	m_columns.clear();
+	m_prefixes.clear();
+	m_levels.clear();
+	m_endTime = 0;
+
+	YAML::Node node;
+	try
+	{
+		node = YAML::LoadFile(logPath);
+	}
+	catch(const YAML::Exception& ex)
+	{
+		LogError("Failed to load data log %s: %s\n", logPath.c_str(), ex.what());
+		return false;
+	}
+
+	if(!node["version"] || (node["version"].as<int>() != DATALOG_VERSION) )
+	{
+		LogError("Data log %s is not a supported version\n", logPath.c_str());
+		return false;
+	}
+	if(node["blocksize"].as<int>() != DATALOG_BLOCK_SIZE)
+	{
+		LogError("Data log %s has an unsupported block size\n", logPath.c_str());
+		return false;
+	}
+	m_startTime = node["start"].as<double>();
+
+	auto columns = node["columns"];
+	size_t ncols = columns ? columns.size() : 0;
+	m_columns.resize(ncols, DataLogColumn("", "", "", Unit(Unit::UNIT_COUNTS)));
+	m_prefixes.resize(ncols);
+	m_levels.resize(ncols);
+	for(auto it : columns)
+	{
+		auto cnode = it.second;
+		size_t id = cnode["id"].as<size_t>();
+		if(id >= ncols)
+		{
+			LogError("Data log %s has an invalid column ID\n", logPath.c_str());
+			return false;
+		}
+
+		m_columns[id] = DataLogColumn(
+			cnode["instrument"].as<string>(),
+			cnode["channel"].as<string>(),
+			cnode["quantity"].as<string>(),
+			Unit(static_cast<Unit::UnitType>(cnode["unit"].as<int>())));
+		m_prefixes[id] = m_dataDir + "/" + cnode["file"].as<string>();
+	}
+
+	for(size_t i=0; i<ncols; i++)
+	{
+		if(!LoadColumn(i, m_prefixes[i]))
+		{
+			LogError("Failed to load data log column %s\n", m_prefixes[i].c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+	@brief Loads the decimation index of a column, and builds the coarser levels from it
+ */
+bool DataLogReader::LoadColumn(size_t column, const string& prefix)
+{
+	auto& col = m_columns[column];
+	auto& levels = m_levels[column];
+
+	//The writer may be partway through appending, so only trust samples which made it into both files
+	col.m_count = min(
+		GetDataLogFileSize(prefix + ".time") / sizeof(double),
+		GetDataLogFileSize(prefix + ".value") / sizeof(float));
+	if(col.m_count == 0)
+		return true;
+
+	//Read the index for every complete block
+	size_t nblocks = min(
+		GetDataLogFileSize(prefix + ".index") / sizeof(DataLogBlock),
+		col.m_count / DATALOG_BLOCK_SIZE);
+	levels.resize(1);
+	auto& base = levels[0];
+	base.resize(nblocks);
+	if(nblocks)
+	{
+		ifstream in(prefix + ".index", ios::binary);
+		if(!in.read(reinterpret_cast<char*>(&base[0]), nblocks * sizeof(DataLogBlock)))
+			return false;
+	}
+
+	//Summarize any trailing samples the writer hasn't indexed yet
+	uint64_t indexed = nblocks * DATALOG_BLOCK_SIZE;
+	if(indexed < col.m_count)
+	{
+		DataLogRange tail;
+		ReadSamples(column, indexed, col.m_count - indexed, tail);
+		if(tail.m_times.empty())
+			return false;
+
+		DataLogBlock block;
+		block.m_tstart = tail.m_times.front();
+		block.m_tend = tail.m_times.back();
+		block.m_first = indexed;
+		block.m_count = tail.m_times.size();
+		block.m_reserved = 0;
+		block.m_min = *min_element(tail.m_min.begin(), tail.m_min.end());
+		block.m_max = *max_element(tail.m_max.begin(), tail.m_max.end());
+		base.push_back(block);
+	}
+
+	m_endTime = max(m_endTime, base.back().m_tend);
+
+	//Build coarser levels until there's only a handful of blocks left
+	while(levels.back().size() > DATALOG_LEVEL_FANOUT)
+	{
+		auto& prev = levels.back();
+		vector<DataLogBlock> next;
+		for(size_t i=0; i<prev.size(); i += DATALOG_LEVEL_FANOUT)
+		{
+			size_t end = min(prev.size(), i + DATALOG_LEVEL_FANOUT);
+			DataLogBlock block = prev[i];
+			for(size_t j=i+1; j<end; j++)
+			{
+				block.m_tend = prev[j].m_tend;
+				block.m_min = min(block.m_min, prev[j].m_min);
+				block.m_max = max(block.m_max, prev[j].m_max);
+				block.m_count += prev[j].m_count;
+			}
+			next.push_back(block);
+		}
+		levels.push_back(std::move(next));
+	}
+
+	return true;
+}
+
+/**
+	@brief Reads raw samples from a column's files, appending them to a range
+ */
+void DataLogReader::ReadSamples(size_t column, uint64_t first, uint64_t count, DataLogRange& out)
+{
+	if(count == 0)
+		return;
+
+	vector<double> times(count);
+	vector<float> values(count);
+
+	auto& prefix = m_prefixes[column];
+	ifstream tin(prefix + ".time", ios::binary);
+	ifstream vin(prefix + ".value", ios::binary);
+	tin.seekg(first * sizeof(double));
+	vin.seekg(first * sizeof(float));
+	if(!tin.read(reinterpret_cast<char*>(&times[0]), count * sizeof(double)) ||
+		!vin.read(reinterpret_cast<char*>(&values[0]), count * sizeof(float)) )
+	{
+		LogError("Failed to read samples from data log column %s\n", prefix.c_str());
+		return;
+	}
+
+	for(size_t i=0; i<count; i++)
+	{
+		out.m_times.push_back(times[i]);
+		out.m_min.push_back(values[i]);
+		out.m_max.push_back(values[i]);
+	}
+}
+
+/**
+	@brief Gets the samples of a column over a time range, decimated to at most a given number of points
+
+	One point either side of the range is included (if there is one), so lines run off the edges of a plot.
+
+	@param column		Index of the column
+	@param tmin			Start of the range, in seconds since the start of the log
+	@param tmax			End of the range, in seconds since the start of the log
+	@param maxPoints	Maximum number of points to return, typically the width of the plot in pixels
+	@param out			Output samples or min/max buckets
+ */
+void DataLogReader::GetRange(size_t column, double tmin, double tmax, size_t maxPoints, DataLogRange& out)
+{
+	out.m_times.clear();
+	out.m_min.clear();
+	out.m_max.clear();
+	out.m_decimated = false;
+
+	if(column >= m_levels.size())
+		return;
+	auto& levels = m_levels[column];
+	maxPoints = max(maxPoints, (size_t)1);
+
+	for(size_t level=0; level<levels.size(); level++)
+	{
+		auto& blocks = levels[level];
+		if(blocks.empty())
+			return;
+
+		//Find the blocks overlapping the range, plus one either side
+		size_t lo = lower_bound(
+			blocks.begin(),
+			blocks.end(),
+			tmin,
+			[](const DataLogBlock& b, double t) { return b.m_tend < t; }) - blocks.begin();
+		size_t hi = upper_bound(
+			blocks.begin(),
+			blocks.end(),
+			tmax,
+			[](double t, const DataLogBlock& b) { return t < b.m_tstart; }) - blocks.begin();
+		if(lo > 0)
+			lo --;
+		if(hi < blocks.size())
+			hi ++;
+		if(lo >= hi)
+			return;
+
+		//Zoomed in far enough to show the raw samples
+		uint64_t first = blocks[lo].m_first;
+		uint64_t count = blocks[hi-1].m_first + blocks[hi-1].m_count - first;
+		if(count <= maxPoints)
+		{
+			ReadSamples(column, first, count, out);
+			return;
+		}
+
+		//Otherwise use the finest level which fits, or the coarsest we have
+		if( ( (hi - lo) <= maxPoints) || (level + 1 == levels.size()) )
+		{
+			out.m_decimated = true;
+			for(size_t i=lo; i<hi; i++)
+			{
+				out.m_times.push_back( (blocks[i].m_tstart + blocks[i].m_tend) / 2);
+				out.m_min.push_back(blocks[i].m_min);
+				out.m_max.push_back(blocks[i].m_max);
+			}
+			return;
+		}
+	}
+}
@@ -0,0 +1,413 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DataLogger and DataLogReader
+ */
+#ifndef DataLogger_h
+#define DataLogger_h
+
+#include "Event.h"
+
+///@brief Number of samples summarized by each entry of a data log column's decimation index
+#define DATALOG_BLOCK_SIZE 256
+
+/**
+	@brief A single timestamped reading handed from an instrument thread to a DataLogger
+ */
+class DataLogSample
+{
+public:
+	///@brief Time of the reading, in seconds since the epoch
+	double m_time;
+
+	///@brief Column the reading belongs to
+	uint32_t m_column;
+
+	///@brief The reading
+	float m_value;
+};
+
+/**
+	@brief One entry of a data log column's decimation index, summarizing a contiguous run of samples
+
+	Written to disk as-is, so the layout must not change without bumping the log version.
+ */
+class DataLogBlock
+{
+public:
+	///@brief Timestamp of the first sample in the block, in seconds since the start of the log
+	double m_tstart;
+
+	///@brief Timestamp of the last sample in the block, in seconds since the start of the log
+	double m_tend;
+
+	///@brief Index of the first sample in the block
+	uint64_t m_first;
+
+	///@brief Lowest value in the block
+	float m_min;
+
+	///@brief Highest value in the block
+	float m_max;
+
+	///@brief Number of samples in the block
+	uint32_t m_count;
+
+	///@brief Unused, keeps the on-disk layout free of compiler-dependent padding
+	uint32_t m_reserved;
+};
+
+/**
+	@brief Lock-free single producer / single consumer queue of readings from one instrument thread
+
+	The instrument thread pushes readings without ever blocking; if the writer falls so far behind that the queue is
+	full, new readings are dropped and counted rather than stalling the poll loop.
+ */
+class DataLogProducer
+{
+public:
+	DataLogProducer(size_t capacity);
+
+	bool Push(const DataLogSample& sample);
+	bool Pop(DataLogSample& sample);
+
+	///@brief Returns the number of readings dropped because the queue was full
+	size_t GetDroppedCount()
+	{ return m_dropped; }
+
+protected:
+	///@brief Queue storage
+	std::vector<DataLogSample> m_ring;
+
+	///@brief Total number of readings pushed (only written by the producer)
+	std::atomic<size_t> m_head;
+
+	///@brief Total number of readings popped (only written by the consumer)
+	std::atomic<size_t> m_tail;
+
+	///@brief Number of readings dropped because the queue was full
+	std::atomic<size_t> m_dropped;
+};
+
+/**
+	@brief Description of one column (a single quantity from a single channel) in a data log
+ */
+class DataLogColumn
+{
+public:
+	DataLogColumn(
+		const std::string& instrument,
+		const std::string& channel,
+		const std::string& quantity,
+		Unit unit)
+	: m_instrument(instrument)
+	, m_channel(channel)
+	, m_quantity(quantity)
+	, m_unit(unit)
+	, m_count(0)
+	{}
+
+	///@brief Gets a human readable name for the column
+	std::string GetName() const
+	{ return m_instrument + ":" + m_channel + " " + m_quantity; }
+
+	///@brief Nickname of the instrument the readings come from
+	std::string m_instrument;
+
+	///@brief Name of the channel the readings come from
+	std::string m_channel;
+
+	///@brief What's being measured (voltage, current, meter mode, etc)
+	std::string m_quantity;
+
+	///@brief Unit of the readings
+	Unit m_unit;
+
+	///@brief Number of samples in the column
+	uint64_t m_count;
+};
+
+/**
+	@brief Writer-side state of one column of a data log
+ */
+class DataLogColumnWriter
+{
+public:
+	DataLogColumnWriter();
+	~DataLogColumnWriter();
+
+	bool Open(const std::string& prefix);
+	void Append(double t, float value);
+	bool Flush();
+
+	///@brief Sample timestamps waiting to be written
+	std::vector<double> m_times;
+
+	///@brief Sample values waiting to be written
+	std::vector<float> m_values;
+
+	///@brief Completed index blocks waiting to be written
+	std::vector<DataLogBlock> m_blocks;
+
+	///@brief The partially filled index block
+	DataLogBlock m_block;
+
+	///@brief Number of samples appended so far
+	uint64_t m_count;
+
+	///@brief Timestamp file
+	FILE* m_timeFile;
+
+	///@brief Value file
+	FILE* m_valueFile;
+
+	///@brief Decimation index file
+	FILE* m_indexFile;
+};
+
+/**
+	@brief Appends timestamped scalar readings from instrument threads to a columnar log on disk
+
+	Each instrument thread gets its own DataLogProducer and pushes readings into it without locking. A background thread
+	drains all of the producers a few times a second and appends each column's readings to its own set of files in the
+	log's data directory, in large batches:
+
+	* colN.time: sample timestamps, as doubles in seconds since the start of the log
+	* colN.value: sample values, as floats
+	* colN.index: a DataLogBlock for every DATALOG_BLOCK_SIZE samples, giving their time span and value range
+
+	The .datalog file itself is YAML describing the columns. It's rewritten whenever a column is added, and every
+	complete sample is readable as soon as it's flushed, so a log can be viewed while it's still being written and
+	survives a crash.
+ */
+class DataLogger
+{
+public:
+	DataLogger(const std::string& logPath);
+	virtual ~DataLogger();
+
+	DataLogger(const DataLogger&) =delete;
+	DataLogger& operator=(const DataLogger&) =delete;
+
+	static std::string GetDataDirectory(const std::string& logPath);
+
+	///@brief Returns true if the log was created successfully
+	bool IsOpen()
+	{ return m_thread != nullptr; }
+
+	uint32_t AddColumn(
+		const std::string& instrument,
+		const std::string& channel,
+		const std::string& quantity,
+		Unit unit);
+	std::shared_ptr<DataLogProducer> CreateProducer();
+
+	void Stop();
+
+	///@brief Returns the path of the .datalog file
+	const std::string& GetPath()
+	{ return m_path; }
+
+	///@brief Returns the number of columns in the log
+	size_t GetColumnCount()
+	{
+		std::lock_guard<std::mutex> lock(m_columnMutex);
+		return m_columns.size();
+	}
+
+	///@brief Returns the number of readings written so far
+	size_t GetWrittenCount()
+	{ return m_written; }
+
+	size_t GetDroppedCount();
+
+protected:
+	void ThreadProc();
+	bool Drain();
+	bool WriteMetadata();
+
+	///@brief Path to the .datalog file
+	std::string m_path;
+
+	///@brief Path to the data directory
+	std::string m_dataDir;
+
+	///@brief Time the log was started, in seconds since the epoch
+	double m_startTime;
+
+	///@brief Mutex controlling access to m_columns, m_columnIndex, m_producers, and m_metadataDirty
+	std::mutex m_columnMutex;
+
+	///@brief Description of each column
+	std::vector<DataLogColumn> m_columns;
+
+	///@brief Column ID by instrument, channel, and quantity
+	std::map<std::string, uint32_t> m_columnIndex;
+
+	///@brief Set when a column has been added and the metadata needs rewriting
+	bool m_metadataDirty;
+
+	///@brief Queues from each instrument thread
+	std::vector<std::shared_ptr<DataLogProducer>> m_producers;
+
+	///@brief Writer state for each column (writer thread only)
+	std::vector<std::unique_ptr<DataLogColumnWriter>> m_writers;
+
+	///@brief Number of readings written so far
+	std::atomic<size_t> m_written;
+
+	///@brief Signaled to shut down
+	Event m_wakeEvent;
+
+	///@brief Set to shut down the writer thread once the queues are empty
+	std::atomic<bool> m_shuttingDown;
+
+	///@brief Writer thread
+	std::unique_ptr<std::thread> m_thread;
+};
+
+/**
+	@brief Instrument-thread helper for pushing readings into whichever data log the session currently has open
+
+	Keeps the instrument thread's producer and the column IDs it's registered, and starts over if the log changes.
+ */
+class DataLogSource
+{
+public:
+	DataLogSource()
+	: m_time(0)
+	{}
+
+	void Begin(std::shared_ptr<DataLogger> logger);
+	void Log(Instrument* inst, InstrumentChannel* chan, const std::string& quantity, Unit unit, float value);
+
+protected:
+	///@brief The log we're writing to
+	std::shared_ptr<DataLogger> m_logger;
+
+	///@brief Our queue into m_logger
+	std::shared_ptr<DataLogProducer> m_producer;
+
+	///@brief Column IDs we've registered, by channel and quantity
+	std::map<std::pair<InstrumentChannel*, std::string>, uint32_t> m_columns;
+
+	///@brief Timestamp for readings from the current poll
+	double m_time;
+};
+
+/**
+	@brief Decimated or raw samples from one column of a data log, over some time range
+ */
+class DataLogRange
+{
+public:
+	DataLogRange()
+	: m_decimated(false)
+	{}
+
+	///@brief Sample timestamps, or the center of each bucket if decimated
+	std::vector<double> m_times;
+
+	///@brief Lowest value of each bucket (the sample value if not decimated)
+	std::vector<double> m_min;
+
+	///@brief Highest value of each bucket (the sample value if not decimated)
+	std::vector<double> m_max;
+
+	///@brief True if each point summarizes many samples
+	bool m_decimated;
+};
+
+/**
+	@brief Reads a data log written by DataLogger, for plotting
+
+	Only the decimation index is kept in memory, along with coarser levels built from it, so a range of any length can
+	be plotted by reading either a handful of index entries or a few thousand raw samples.
+ */
+class DataLogReader
+{
+public:
+	DataLogReader();
+
+	bool Load(const std::string& logPath);
+
+	///@brief Returns the path of the .datalog file
+	const std::string& GetPath()
+	{ return m_path; }
+
+	///@brief Returns the columns in the log
+	const std::vector<DataLogColumn>& GetColumns()
+	{ return m_columns; }
+
+	///@brief Returns the time the log was started, in seconds since the epoch
+	double GetStartTime()
+	{ return m_startTime; }
+
+	///@brief Returns the time of the last sample in the log, in seconds since the start of the log
+	double GetEndTime()
+	{ return m_endTime; }
+
+	void GetRange(size_t column, double tmin, double tmax, size_t maxPoints, DataLogRange& out);
+
+protected:
+	bool LoadColumn(size_t column, const std::string& prefix);
+	void ReadSamples(size_t column, uint64_t first, uint64_t count, DataLogRange& out);
+
+	///@brief Path to the .datalog file
+	std::string m_path;
+
+	///@brief Path to the data directory
+	std::string m_dataDir;
+
+	///@brief Time the log was started, in seconds since the epoch
+	double m_startTime;
+
+	///@brief Time of the last sample in any column, in seconds since the start of the log
+	double m_endTime;
+
+	///@brief Description of each column
+	std::vector<DataLogColumn> m_columns;
+
+	///@brief File name prefix of each column
+	std::vector<std::string> m_prefixes;
+
+	/**
+		@brief Decimation levels of each column
+
+		Level 0 is the on-disk index (plus a block for any trailing samples not indexed yet). Each level after that
+		merges several blocks of the one before it.
+	 */
+	std::vector<std::vector<std::vector<DataLogBlock>>> m_levels;
+};
+
+#endif
@@ -0,0 +1,414 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DeskewCorrelator
+ */
+
+#include "ngscopeclient.h"
+#include "DeskewCorrelator.h"
+
+#include <cinttypes>
+
+using namespace std;
+
+/**
+	@brief Number of thread blocks to dispatch for an FFT-sized job
+
+	The FFT shaders use grid-stride loops, so cap the dispatch below the maximum work group count.
+ */
+static uint32_t FFTBlockCount(size_t n)
+{
+	uint32_t blocks = GetComputeBlockCount(n, 64);
+	if(blocks > 32768)
+		blocks = 32768;
+	return blocks;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+DeskewCorrelator::DeskewCorrelator(const string& name)
+	: m_bestCorrelation(0)
+	, m_bestOffset(0)
+	, m_bestSkew(0)
+	, m_queue(g_vkQueueManager->GetComputeQueue(name + ".queue"))
+	, m_pool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_pool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+	, m_fftLen(0)
+	, m_priIn(name + ".priIn")
+	, m_secIn(name + ".secIn")
+	, m_priSpectrum(name + ".priSpectrum")
+	, m_secSpectrum(name + ".secSpectrum")
+	, m_product(name + ".product")
+	, m_corr(name + ".corr")
+	, m_corrOut(name + ".corrOut")
+{
+	m_resamplePipeline = make_shared<ComputePipeline>(
+		"shaders/ScopeDeskewFFTResample.spv", 2, sizeof(FFTResampleArgs));
+
+	m_multiplyPipeline = make_shared<ComputePipeline>(
+		"shaders/ScopeDeskewFFTMultiply.spv", 3, sizeof(FFTMultiplyArgs));
+
+	m_normalizePipeline = make_shared<ComputePipeline>(
+		"shaders/ScopeDeskewFFTNormalize.spv", 2, sizeof(FFTNormalizeArgs));
+
+	if(g_hasDebugUtils)
+	{
+		string poolName = name + ".pool";
+		string bufName = name + ".cmdbuf";
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandPool,
+				reinterpret_cast<uint64_t>(static_cast<VkCommandPool>(*m_pool)),
+				poolName.c_str()));
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandBuffer,
+				reinterpret_cast<int64_t>(static_cast<VkCommandBuffer>(*m_cmdBuf)),
+				bufName.c_str()));
+	}
+
+	//Working buffers never need to leave the GPU
+	AcceleratorBuffer<float>* bufs[] = { &m_priIn, &m_secIn, &m_priSpectrum, &m_secSpectrum, &m_product, &m_corr };
+	for(auto buf : bufs)
+	{
+		buf->SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+		buf->SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	}
+
+	m_corrOut.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_corrOut.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_UNLIKELY);
+}
+
+/**
+	@brief Checks if the GPU supports everything the correlation shaders need
+ */
+bool DeskewCorrelator::IsAvailable()
+{
+	return g_hasShaderInt64;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Correlation
+
+/**
+	@brief Cross-correlates two waveforms of the same signal
+
+	Sparse waveforms are sample-and-held onto a uniform grid first, so any combination of waveform types works.
+	The caller must hold a shared lock on the waveform data.
+
+	@param pri				Waveform from the primary instrument
+	@param sec				Waveform from the secondary instrument
+	@param maxSkewSamples	Largest offset to search, in either direction, in samples of the primary
+	@param maxPoints		If nonzero, decimate the primary to at most this many points to bound the cost
+
+	@return True if a correlation peak was found
+ */
+bool DeskewCorrelator::Correlate(WaveformBase* pri, WaveformBase* sec, int64_t maxSkewSamples, size_t maxPoints)
+{
+	m_bestCorrelation = 0;
+	m_bestOffset = 0;
+	m_bestSkew = 0;
+
+	auto upri = dynamic_cast<UniformAnalogWaveform*>(pri);
+	auto usec = dynamic_cast<UniformAnalogWaveform*>(sec);
+
+	unique_ptr<UniformAnalogWaveform> tmppri;
+	unique_ptr<UniformAnalogWaveform> tmpsec;
+	if(!upri)
+	{
+		auto spri = dynamic_cast<SparseAnalogWaveform*>(pri);
+		if(!spri)
+			return false;
+		tmppri = SparseToUniform(spri);
+		upri = tmppri.get();
+	}
+	if(!usec)
+	{
+		auto ssec = dynamic_cast<SparseAnalogWaveform*>(sec);
+		if(!ssec)
+			return false;
+		tmpsec = SparseToUniform(ssec);
+		usec = tmpsec.get();
+	}
+
+	return CorrelateUniform(upri, usec, maxSkewSamples, maxPoints);
+}
+
+/**
+	@brief Calculates the cross-correlation of two uniform waveforms in the frequency domain
+
+	The secondary is resampled onto the primary's timebase (so any ratio of sample rates works), both are zero
+	padded to avoid circular wraparound, and the correlation is calculated as IFFT(conj(P) * S). This is
+	O(N log N) in the waveform length regardless of how many lags we search.
+ */
+bool DeskewCorrelator::CorrelateUniform(
+	UniformAnalogWaveform* ppri,
+	UniformAnalogWaveform* psec,
+	int64_t maxSkewSamples,
+	size_t maxPoints)
+{
+	auto start = GetTime();
+
+	int64_t rawPriLen = ppri->size();
+	int64_t secLen = psec->size();
+	if( (rawPriLen == 0) || (secLen == 0) )
+		return false;
+
+	//Decimate if the caller wants to bound the cost.
+	//The resample shader box filters anything it decimates, so this doesn't alias.
+	int64_t decimation = 1;
+	if( (maxPoints > 0) && ((size_t)rawPriLen > maxPoints) )
+		decimation = (rawPriLen + maxPoints - 1) / maxPoints;
+	int64_t ts = ppri->m_timescale * decimation;
+	int64_t priLen = (rawPriLen - 1) / decimation + 1;
+	int64_t maxSkew = (maxSkewSamples + decimation - 1) / decimation;
+
+	//Sample j of the resampled secondary is at (j * ts + phaseDelta) in the secondary's time frame.
+	//Figure out which j actually land within the secondary's data.
+	int64_t phaseDelta = ppri->m_triggerPhase - psec->m_triggerPhase;
+	int64_t secDuration = (secLen - 1) * psec->m_timescale;
+	auto floordiv = [](int64_t a, int64_t b)
+	{
+		int64_t q = a / b;
+		if( (a % b != 0) && ( (a < 0) != (b < 0) ) )
+			q --;
+		return q;
+	};
+	int64_t secStart = max((int64_t)0, -floordiv(phaseDelta, ts));
+	int64_t secEnd = floordiv(secDuration - phaseDelta, ts) + 1;
+
+	//Anything past the end of the primary plus the largest lag can't line up with anything we care about
+	secEnd = min(secEnd, priLen + maxSkew);
+	if(secEnd <= secStart)
+	{
+		LogError("Secondary waveform does not overlap the primary\n");
+		return false;
+	}
+
+	//Pad to a power of two big enough that no lag wraps around onto another
+	size_t fftLen = 1;
+	while(fftLen < (size_t)(priLen + secEnd))
+		fftLen <<= 1;
+	size_t nouts = fftLen/2 + 1;
+
+	if(fftLen != m_fftLen)
+	{
+		m_fftLen = fftLen;
+		m_forwardPlan = make_unique<VulkanFFTPlan>(fftLen, nouts, VulkanFFTPlan::DIRECTION_FORWARD);
+		m_reversePlan = make_unique<VulkanFFTPlan>(fftLen, nouts, VulkanFFTPlan::DIRECTION_REVERSE);
+
+		m_priIn.resize(fftLen);
+		m_secIn.resize(fftLen);
+		m_priSpectrum.resize(2*nouts);
+		m_secSpectrum.resize(2*nouts);
+		m_product.resize(2*nouts);
+		m_corr.resize(fftLen);
+	}
+	m_corrOut.resize(2*maxSkew);
+
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	ppri->m_samples.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+	psec->m_samples.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+	m_corrOut.PrepareForGpuAccessNonblocking(true, m_cmdBuf);
+
+	//sync in case transfer happened in another thread
+	AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+	//Zero pad (and maybe decimate) the primary, and resample the secondary onto the same grid.
+	//Both go through the same filter so any delay it adds cancels out.
+	AppendResample(ppri, m_priIn, ts, 0, 0, priLen);
+	AppendResample(psec, m_secIn, ts, phaseDelta, secStart, secEnd);
+	m_resamplePipeline->AddComputeMemoryBarrier(m_cmdBuf);
+
+	//Forward FFTs
+	m_forwardPlan->AppendForward(m_priIn, m_priSpectrum, m_cmdBuf);
+	m_forwardPlan->AppendForward(m_secIn, m_secSpectrum, m_cmdBuf);
+	m_multiplyPipeline->AddComputeMemoryBarrier(m_cmdBuf);
+
+	//Cross power spectrum
+	FFTMultiplyArgs margs;
+	margs.numBins = nouts;
+	m_multiplyPipeline->BindBufferNonblocking(0, m_product, m_cmdBuf, true);
+	m_multiplyPipeline->BindBufferNonblocking(1, m_priSpectrum, m_cmdBuf);
+	m_multiplyPipeline->BindBufferNonblocking(2, m_secSpectrum, m_cmdBuf);
+	m_multiplyPipeline->Dispatch(m_cmdBuf, margs, FFTBlockCount(nouts));
+	m_multiplyPipeline->AddComputeMemoryBarrier(m_cmdBuf);
+
+	//Back to the lag domain
+	m_reversePlan->AppendReverse(m_product, m_corr, m_cmdBuf);
+	m_normalizePipeline->AddComputeMemoryBarrier(m_cmdBuf);
+
+	//Pull out the lags we search and normalize the same way the direct correlation does.
+	//The inverse FFT is unnormalized so scale by 1/N too.
+	FFTNormalizeArgs nargs;
+	nargs.startingDelta = -maxSkew;
+	nargs.numDeltas = 2*maxSkew;
+	nargs.fftLen = fftLen;
+	nargs.priLen = priLen;
+	nargs.secStart = secStart;
+	nargs.secEnd = secEnd;
+	nargs.scale = 1.0f / fftLen;
+	m_normalizePipeline->BindBufferNonblocking(0, m_corrOut, m_cmdBuf, true);
+	m_normalizePipeline->BindBufferNonblocking(1, m_corr, m_cmdBuf);
+	m_normalizePipeline->Dispatch(m_cmdBuf, nargs, GetComputeBlockCount(2*maxSkew, 64));
+
+	m_cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "deskew correlation");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+
+	//Find the peak
+	m_corrOut.PrepareForCpuAccess();
+	int64_t index;
+	double fraction;
+	FindPeak(m_corrOut, 2*maxSkew, m_bestCorrelation, index, fraction);
+	m_bestOffset = (index - maxSkew + fraction) * decimation;
+	m_bestSkew = llround(m_bestOffset * ppri->m_timescale);
+
+	auto dt = GetTime() - start;
+	LogTrace("GPU FFT correlation (%zu points, decimation %" PRId64 ") evaluated in %.3f sec\n",
+		fftLen, decimation, dt);
+
+	return (m_bestCorrelation > 0);
+}
+
+/**
+	@brief Appends commands to resample a waveform onto the correlation grid and zero pad to the FFT length
+
+	Inputs sampled faster than the grid are averaged over one grid period, centered on each output sample, rather
+	than point sampled. Slower inputs are linearly interpolated.
+
+	@param pin			Input waveform
+	@param out			Output buffer (already sized to the FFT length)
+	@param timescale	Timescale of the output, in fs
+	@param offset		Time of the first output sample in the input's time frame, in fs
+	@param validStart	First output sample that lies within the input
+	@param validEnd		One past the last output sample that lies within the input
+ */
+void DeskewCorrelator::AppendResample(
+	UniformAnalogWaveform* pin,
+	AcceleratorBuffer<float>& out,
+	int64_t timescale,
+	int64_t offset,
+	int64_t validStart,
+	int64_t validEnd)
+{
+	FFTResampleArgs args;
+	args.srcTimescale = pin->m_timescale;
+	args.dstTimescale = timescale;
+	args.offset = offset;
+	args.srcLen = pin->size();
+	args.outLen = m_fftLen;
+	args.validStart = validStart;
+	args.validEnd = validEnd;
+
+	m_resamplePipeline->BindBufferNonblocking(0, out, m_cmdBuf, true);
+	m_resamplePipeline->BindBufferNonblocking(1, pin->m_samples, m_cmdBuf);
+	m_resamplePipeline->Dispatch(m_cmdBuf, args, FFTBlockCount(m_fftLen));
+}
+
+/**
+	@brief Finds the highest point of a correlation, refined to sub-sample resolution
+
+	A parabola is fit through the peak and its neighbors to estimate where the true peak lies between samples.
+
+	@param corr		Correlation values (must be CPU accessible)
+	@param len		Number of correlation values
+	@param best		Highest correlation found (zero if none was positive)
+	@param index	Index of the highest correlation
+	@param fraction	Estimated offset of the true peak from index, in the range [-0.5, 0.5]
+ */
+void DeskewCorrelator::FindPeak(AcceleratorBuffer<float>& corr, size_t len, float& best, int64_t& index, double& fraction)
+{
+	best = 0;
+	index = 0;
+	fraction = 0;
+	for(size_t i=0; i<len; i++)
+	{
+		auto f = corr[i];
+		if(f > best)
+		{
+			best = f;
+			index = i;
+		}
+	}
+
+	if( (index > 0) && ((size_t)index+1 < len) )
+	{
+		double left = corr[index-1];
+		double right = corr[index+1];
+		double denom = left - 2*best + right;
+		if(denom < 0)
+			fraction = max(-0.5, min(0.5, 0.5 * (left - right) / denom));
+	}
+}
+
+/**
+	@brief Converts a sparse waveform to a uniform one by sample-and-hold at its native timescale
+ */
+unique_ptr<UniformAnalogWaveform> DeskewCorrelator::SparseToUniform(SparseAnalogWaveform* wfm)
+{
+	auto ret = make_unique<UniformAnalogWaveform>();
+	ret->m_timescale = wfm->m_timescale;
+	ret->m_triggerPhase = wfm->m_triggerPhase;
+	ret->m_startTimestamp = wfm->m_startTimestamp;
+	ret->m_startFemtoseconds = wfm->m_startFemtoseconds;
+
+	size_t len = wfm->size();
+	if(len == 0)
+		return ret;
+
+	wfm->PrepareForCpuAccess();
+	ret->PrepareForCpuAccess();
+
+	ret->Resize(wfm->m_offsets[len-1] + wfm->m_durations[len-1]);
+	size_t iout = 0;
+	for(size_t i=0; i<len; i++)
+	{
+		size_t end = wfm->m_offsets[i] + wfm->m_durations[i];
+		for(; iout < end; iout++)
+			ret->m_samples[iout] = wfm->m_samples[i];
+	}
+
+	ret->MarkModifiedFromCpu();
+	return ret;
+}
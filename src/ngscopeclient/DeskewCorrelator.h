@@ -0,0 +1,150 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DeskewCorrelator
+ */
+#ifndef DeskewCorrelator_h
+#define DeskewCorrelator_h
+
+#include "VulkanFFTPlan.h"
+
+class FFTResampleArgs
+{
+public:
+	int64_t srcTimescale;
+	int64_t dstTimescale;
+	int64_t offset;
+
+	uint32_t srcLen;
+	uint32_t outLen;
+
+	uint32_t validStart;
+	uint32_t validEnd;
+};
+
+class FFTMultiplyArgs
+{
+public:
+	uint32_t numBins;
+};
+
+class FFTNormalizeArgs
+{
+public:
+	int32_t startingDelta;
+	int32_t numDeltas;
+
+	int32_t fftLen;
+	int32_t priLen;
+
+	int32_t secStart;
+	int32_t secEnd;
+
+	float scale;
+};
+
+/**
+	@brief GPU cross-correlation between the same signal captured by two instruments, done in the frequency domain
+
+	Used by the deskew wizard for one-shot calibration and by DeskewTracker for continuous background tracking.
+	Each instance has its own compute queue and working buffers, so several can run at once.
+ */
+class DeskewCorrelator
+{
+public:
+	DeskewCorrelator(const std::string& name);
+
+	static bool IsAvailable();
+
+	bool Correlate(WaveformBase* pri, WaveformBase* sec, int64_t maxSkewSamples, size_t maxPoints = 0);
+
+	///@brief Normalized correlation at the best alignment found by the last Correlate() call
+	float GetCorrelation()
+	{ return m_bestCorrelation; }
+
+	///@brief Best alignment found by the last Correlate() call, in (fractional) samples of the primary
+	double GetOffset()
+	{ return m_bestOffset; }
+
+	///@brief Best alignment found by the last Correlate() call, in fs
+	int64_t GetSkew()
+	{ return m_bestSkew; }
+
+	static void FindPeak(AcceleratorBuffer<float>& corr, size_t len, float& best, int64_t& index, double& fraction);
+	static std::unique_ptr<UniformAnalogWaveform> SparseToUniform(SparseAnalogWaveform* wfm);
+
+protected:
+	bool CorrelateUniform(
+		UniformAnalogWaveform* ppri,
+		UniformAnalogWaveform* psec,
+		int64_t maxSkewSamples,
+		size_t maxPoints);
+
+	void AppendResample(
+		UniformAnalogWaveform* pin,
+		AcceleratorBuffer<float>& out,
+		int64_t timescale,
+		int64_t offset,
+		int64_t validStart,
+		int64_t validEnd);
+
+	//Results of the last run
+	float m_bestCorrelation;
+	double m_bestOffset;
+	int64_t m_bestSkew;
+
+	//Vulkan processing queues etc
+	std::shared_ptr<QueueHandle> m_queue;
+	vk::raii::CommandPool m_pool;
+	vk::raii::CommandBuffer m_cmdBuf;
+
+	//Vulkan compute pipelines
+	std::shared_ptr<ComputePipeline> m_resamplePipeline;
+	std::shared_ptr<ComputePipeline> m_multiplyPipeline;
+	std::shared_ptr<ComputePipeline> m_normalizePipeline;
+
+	//FFT plans and working buffers
+	size_t m_fftLen;
+	std::unique_ptr<VulkanFFTPlan> m_forwardPlan;
+	std::unique_ptr<VulkanFFTPlan> m_reversePlan;
+	AcceleratorBuffer<float> m_priIn;
+	AcceleratorBuffer<float> m_secIn;
+	AcceleratorBuffer<float> m_priSpectrum;
+	AcceleratorBuffer<float> m_secSpectrum;
+	AcceleratorBuffer<float> m_product;
+	AcceleratorBuffer<float> m_corr;
+
+	//Output correlation data (one entry per lag searched)
+	AcceleratorBuffer<float> m_corrOut;
+};
+
+#endif
@@ -0,0 +1,239 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DeskewTracker
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "DeskewTracker.h"
+#include "Session.h"
+
+using namespace std;
+
+///@brief Largest share of wall clock time the tracker may spend correlating
+#define DESKEW_TRACKER_DUTY_CYCLE	0.05
+
+///@brief Maximum number of primary samples to correlate (deeper captures are decimated)
+#define DESKEW_TRACKER_MAX_POINTS	(1024 * 1024)
+
+///@brief Largest residual skew to search for, in either direction, in fs
+#define DESKEW_TRACKER_SEARCH_WINDOW	(10LL * 1000 * 1000)
+
+///@brief Number of measurements to keep in the drift history
+#define DESKEW_TRACKER_HISTORY_DEPTH	4096
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts tracking the skew of a secondary instrument
+
+	@param session			The session to update the calibration of
+	@param secondary		The secondary instrument
+	@param primaryStream	Reference channel on the primary instrument
+	@param secondaryStream	Same signal as seen by the secondary instrument
+	@param interval			Minimum time between measurements, in seconds
+	@param smoothing		Weight given to each new measurement, in the range (0, 1]
+	@param minCorrelation	Measurements with a correlation below this are discarded
+ */
+DeskewTracker::DeskewTracker(
+	Session* session,
+	shared_ptr<Oscilloscope> secondary,
+	StreamDescriptor primaryStream,
+	StreamDescriptor secondaryStream,
+	double interval,
+	float smoothing,
+	float minCorrelation)
+	: m_session(session)
+	, m_secondary(secondary)
+	, m_primaryStream(primaryStream)
+	, m_secondaryStream(secondaryStream)
+	, m_interval(interval)
+	, m_smoothing(max(0.01f, min(1.0f, smoothing)))
+	, m_minCorrelation(minCorrelation)
+	, m_initialSkew(session->GetDeskew(secondary))
+	, m_startTime(GetTime())
+	, m_nextRunTime(0)
+	, m_lastTriggerTimestamp(0)
+	, m_lastTriggerFs(0)
+	, m_rejected(0)
+	, m_correlator("DeskewTracker." + secondary->m_nickname)
+	, m_shuttingDown(false)
+{
+	LogNotice("Tracking skew of %s (%s) against %s\n",
+		secondary->m_nickname.c_str(),
+		secondaryStream.GetName().c_str(),
+		primaryStream.GetName().c_str());
+
+	m_thread = make_unique<thread>(&DeskewTracker::ThreadProc, this);
+}
+
+/**
+	@brief Stops the tracking thread, leaving the last calibration in place
+ */
+DeskewTracker::~DeskewTracker()
+{
+	if(m_thread)
+	{
+		m_shuttingDown = true;
+		m_wakeEvent.Signal();
+		m_thread->join();
+		m_thread = nullptr;
+	}
+
+	Unit fs(Unit::UNIT_FS);
+	LogNotice("Stopped tracking skew of %s (total drift %s)\n",
+		m_secondary->m_nickname.c_str(),
+		fs.PrettyPrint(m_session->GetDeskew(m_secondary) - m_initialSkew).c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Returns a copy of the recent measurements, oldest first
+ */
+vector<DeskewTrackerSample> DeskewTracker::GetHistory()
+{
+	lock_guard<mutex> lock(m_historyMutex);
+	return vector<DeskewTrackerSample>(m_history.begin(), m_history.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Measurement
+
+/**
+	@brief Notifies the tracker that new waveforms have been added to history
+
+	Called from the GUI thread. This only wakes the tracking thread if it's idle and enough time has elapsed since
+	the last measurement, so it's cheap to call on every acquisition.
+ */
+void DeskewTracker::OnNewWaveforms()
+{
+	if(GetTime() >= m_nextRunTime)
+		m_wakeEvent.SignalIfNotAlreadySignaled();
+}
+
+/**
+	@brief Thread function making measurements when woken up
+ */
+void DeskewTracker::ThreadProc()
+{
+	pthread_setname_np_compat("DeskewTracker");
+	Tracer::SetThreadName("DeskewTracker");
+
+	while(true)
+	{
+		m_wakeEvent.Block();
+		if(m_shuttingDown)
+			break;
+
+		//Don't push the next run out until we're done, so there's never more than one measurement in flight
+		m_nextRunTime = numeric_limits<double>::max();
+
+		double start = GetTime();
+		Update();
+		double dt = GetTime() - start;
+
+		//Back off if a measurement took long enough to blow our budget
+		m_nextRunTime = start + max(m_interval, dt / DESKEW_TRACKER_DUTY_CYCLE);
+	}
+}
+
+/**
+	@brief Measures the residual skew on the current acquisition and updates the calibration
+ */
+void DeskewTracker::Update()
+{
+	TRACE_ZONE("DeskewTracker::Update", m_secondary->m_nickname.c_str());
+
+	//Waveforms were patched with the calibration in effect when they were downloaded.
+	//We're the only writer during normal operation, so the current value is what they used.
+	int64_t skew = m_session->GetDeskew(m_secondary);
+
+	int64_t residual;
+	float correlation;
+	{
+		//The correlator moves the waveforms to the GPU, which changes their buffers' state, so this counts as
+		//modifying them
+		lock_guard wlock(m_session->GetWaveformWriterMutex());
+		lock_guard lock(m_session->GetWaveformDataMutex());
+
+		auto pri = m_primaryStream.GetData();
+		auto sec = m_secondaryStream.GetData();
+		if(!pri || !sec || (pri->m_timescale <= 0) )
+			return;
+
+		//Don't measure the same acquisition twice
+		if( (m_lastTriggerTimestamp == pri->m_startTimestamp) && (m_lastTriggerFs == pri->m_startFemtoseconds) )
+			return;
+		m_lastTriggerTimestamp = pri->m_startTimestamp;
+		m_lastTriggerFs = pri->m_startFemtoseconds;
+
+		//Drift is slow, so only search a small window around the current alignment
+		int64_t maxSkewSamples = max((int64_t)1, DESKEW_TRACKER_SEARCH_WINDOW / pri->m_timescale);
+		if(!m_correlator.Correlate(pri, sec, maxSkewSamples, DESKEW_TRACKER_MAX_POINTS))
+		{
+			m_rejected ++;
+			return;
+		}
+
+		residual = m_correlator.GetSkew();
+		correlation = m_correlator.GetCorrelation();
+	}
+
+	Unit fs(Unit::UNIT_FS);
+	if(correlation < m_minCorrelation)
+	{
+		LogTrace("Deskew tracker: rejecting measurement on %s (correlation %f below %f)\n",
+			m_secondary->m_nickname.c_str(), correlation, m_minCorrelation);
+		m_rejected ++;
+		return;
+	}
+
+	//Smooth so a single noisy measurement doesn't make the waveforms jump around
+	skew += llround(m_smoothing * residual);
+	m_session->SetDeskew(m_secondary, skew);
+
+	double now = GetTime();
+	LogVerbose("Deskew tracker: %s residual %s, skew now %s (drift %s over %.0f sec)\n",
+		m_secondary->m_nickname.c_str(),
+		fs.PrettyPrint(residual).c_str(),
+		fs.PrettyPrint(skew).c_str(),
+		fs.PrettyPrint(skew - m_initialSkew).c_str(),
+		now - m_startTime);
+
+	lock_guard<mutex> lock(m_historyMutex);
+	m_history.push_back({now, skew, residual, correlation});
+	while(m_history.size() > DESKEW_TRACKER_HISTORY_DEPTH)
+		m_history.pop_front();
+}
@@ -0,0 +1,166 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DeskewTracker
+ */
+#ifndef DeskewTracker_h
+#define DeskewTracker_h
+
+#include "Event.h"
+#include "DeskewCorrelator.h"
+
+class Session;
+
+/**
+	@brief A single measurement made by a DeskewTracker
+ */
+class DeskewTrackerSample
+{
+public:
+	///@brief Time the measurement was made, as returned by GetTime()
+	double m_time;
+
+	///@brief Skew calibration in effect after the measurement was applied, in fs
+	int64_t m_skew;
+
+	///@brief Residual skew measured on the acquisition, in fs
+	int64_t m_residual;
+
+	///@brief Normalized correlation at the measured alignment
+	float m_correlation;
+};
+
+/**
+	@brief Tracks drift of the trigger skew between two instruments of a trigger group on live acquisitions
+
+	Every so often the reference channel pair chosen in the deskew wizard is cross-correlated on a background thread,
+	and the residual skew is folded into the session's deskew calibration for the secondary through a first order
+	low pass filter. The primary is decimated and the update rate limited so the tracker stays within a fixed share
+	of CPU/GPU time no matter how deep the captures are.
+ */
+class DeskewTracker
+{
+public:
+	DeskewTracker(
+		Session* session,
+		std::shared_ptr<Oscilloscope> secondary,
+		StreamDescriptor primaryStream,
+		StreamDescriptor secondaryStream,
+		double interval,
+		float smoothing,
+		float minCorrelation);
+	virtual ~DeskewTracker();
+
+	DeskewTracker(const DeskewTracker&) =delete;
+	DeskewTracker& operator=(const DeskewTracker&) =delete;
+
+	void OnNewWaveforms();
+
+	///@brief Returns the secondary instrument being tracked
+	std::shared_ptr<Oscilloscope> GetSecondary()
+	{ return m_secondary; }
+
+	///@brief Returns the skew calibration in effect when tracking started, in fs
+	int64_t GetInitialSkew()
+	{ return m_initialSkew; }
+
+	///@brief Returns the time tracking started, as returned by GetTime()
+	double GetStartTime()
+	{ return m_startTime; }
+
+	///@brief Returns the number of acquisitions rejected due to weak correlation
+	size_t GetRejectedCount()
+	{ return m_rejected; }
+
+	std::vector<DeskewTrackerSample> GetHistory();
+
+protected:
+	void ThreadProc();
+	void Update();
+
+	///@brief The session we're updating the calibration of
+	Session* m_session;
+
+	///@brief The secondary instrument whose deskew we're tracking
+	std::shared_ptr<Oscilloscope> m_secondary;
+
+	///@brief Reference channel on the primary instrument
+	StreamDescriptor m_primaryStream;
+
+	///@brief Reference channel on the secondary instrument
+	StreamDescriptor m_secondaryStream;
+
+	///@brief Minimum time between measurements, in seconds
+	double m_interval;
+
+	///@brief Weight given to each new measurement (1 = no smoothing)
+	float m_smoothing;
+
+	///@brief Correlations below this are assumed to be a false alignment and ignored
+	float m_minCorrelation;
+
+	///@brief Skew calibration in effect when tracking started, in fs
+	int64_t m_initialSkew;
+
+	///@brief Time tracking started
+	double m_startTime;
+
+	///@brief Earliest time the next measurement may start
+	std::atomic<double> m_nextRunTime;
+
+	///@brief Timestamp of the last acquisition measured, so we never measure the same one twice
+	time_t m_lastTriggerTimestamp;
+	int64_t m_lastTriggerFs;
+
+	///@brief Number of acquisitions rejected due to weak correlation
+	std::atomic<size_t> m_rejected;
+
+	///@brief Frequency domain correlator (with its own compute queue)
+	DeskewCorrelator m_correlator;
+
+	///@brief Mutex controlling access to m_history
+	std::mutex m_historyMutex;
+
+	///@brief Recent measurements, oldest first
+	std::deque<DeskewTrackerSample> m_history;
+
+	///@brief Signaled when it's time to make a measurement, or to shut down
+	Event m_wakeEvent;
+
+	///@brief Set to shut down the tracking thread
+	std::atomic<bool> m_shuttingDown;
+
+	///@brief Tracking thread
+	std::unique_ptr<std::thread> m_thread;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DeviceMemoryPool
+ */
+#include "ngscopeclient.h"
+#include "DeviceMemoryPool.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DeviceMemoryAllocation
+
+DeviceMemoryAllocation::DeviceMemoryAllocation(
+	shared_ptr<DeviceMemoryPool> pool,
+	vk::DeviceMemory memory,
+	vk::DeviceSize offset,
+	vk::DeviceSize size,
+	size_t block,
+	uint32_t memType,
+	unique_ptr<vk::raii::DeviceMemory> dedicated)
+	: m_pool(pool)
+	, m_memory(memory)
+	, m_offset(offset)
+	, m_size(size)
+	, m_block(block)
+	, m_memType(memType)
+	, m_dedicated(std::move(dedicated))
+{
+}
+
+DeviceMemoryAllocation::~DeviceMemoryAllocation()
+{
+	m_pool->Free(*this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates an empty pool. Blocks are allocated as they're needed.
+
+	@param name			Debug name for the blocks
+	@param blockSize	Size of each block, in bytes
+ */
+DeviceMemoryPool::DeviceMemoryPool(const string& name, vk::DeviceSize blockSize)
+	: m_name(name)
+	, m_blockSize(blockSize)
+	, m_dedicatedAllocations(0)
+	, m_dedicatedBytes(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation
+
+/**
+	@brief Allocates memory for a resource
+
+	@param req		Memory requirements of the resource
+	@param memType	Memory type index to allocate from (must be allowed by req)
+
+	@return The allocation, which frees itself when destroyed
+ */
+unique_ptr<DeviceMemoryAllocation> DeviceMemoryPool::Allocate(const vk::MemoryRequirements& req, uint32_t memType)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	//Big allocations get a memory object of their own, they'd waste too much of a block
+	if(req.size > m_blockSize / 4)
+	{
+		vk::MemoryAllocateInfo info(req.size, memType);
+		auto mem = make_unique<vk::raii::DeviceMemory>(*g_vkComputeDevice, info);
+		m_dedicatedAllocations ++;
+		m_dedicatedBytes += req.size;
+		vk::DeviceMemory handle = **mem;
+		return make_unique<DeviceMemoryAllocation>(
+			shared_from_this(), handle, 0, req.size, 0, memType, std::move(mem));
+	}
+
+	//Find the first free range in any block big enough once aligned
+	VkDeviceSize align = max((VkDeviceSize)1, req.alignment);
+	auto& blocks = m_blocks[memType];
+	for(size_t i=0; i<=blocks.size(); i++)
+	{
+		//Nothing fits, make a new block (or bring back a released one)
+		if(i == blocks.size())
+		{
+			for(i=0; i<blocks.size(); i++)
+			{
+				if(!blocks[i].m_memory)
+					break;
+			}
+			if(i == blocks.size())
+				blocks.push_back(Block());
+
+			LogTrace("Allocating %s block %zu for memory type %u\n", m_name.c_str(), i, memType);
+			vk::MemoryAllocateInfo info(m_blockSize, memType);
+			auto& block = blocks[i];
+			block.m_memory = make_unique<vk::raii::DeviceMemory>(*g_vkComputeDevice, info);
+			block.m_free.clear();
+			block.m_free[0] = m_blockSize;
+			block.m_allocations = 0;
+
+			if(g_hasDebugUtils)
+			{
+				string blockName = m_name + ".block" + to_string(i);
+				g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+					vk::DebugUtilsObjectNameInfoEXT(
+						vk::ObjectType::eDeviceMemory,
+						reinterpret_cast<uint64_t>(static_cast<VkDeviceMemory>(**block.m_memory)),
+						blockName.c_str()));
+			}
+		}
+
+		auto& block = blocks[i];
+		if(!block.m_memory)
+			continue;
+
+		for(auto it = block.m_free.begin(); it != block.m_free.end(); it++)
+		{
+			VkDeviceSize start = (it->first + align - 1) / align * align;
+			VkDeviceSize end = it->first + it->second;
+			if(start + req.size > end)
+				continue;
+
+			//Split the free range around the allocation
+			VkDeviceSize freeStart = it->first;
+			block.m_free.erase(it);
+			if(start > freeStart)
+				block.m_free[freeStart] = start - freeStart;
+			if(end > start + req.size)
+				block.m_free[start + req.size] = end - (start + req.size);
+
+			block.m_allocations ++;
+			return make_unique<DeviceMemoryAllocation>(
+				shared_from_this(), **block.m_memory, start, req.size, i, memType);
+		}
+	}
+
+	//not reachable, we always find space in a new block
+	return nullptr;
+}
+
+/**
+	@brief Returns an allocation's memory to its block, merging it with any free neighbors
+ */
+void DeviceMemoryPool::Free(DeviceMemoryAllocation& alloc)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if(alloc.m_dedicated)
+	{
+		m_dedicatedAllocations --;
+		m_dedicatedBytes -= alloc.m_size;
+		return;
+	}
+
+	auto& blocks = m_blocks[alloc.m_memType];
+	auto& block = blocks[alloc.m_block];
+	VkDeviceSize start = alloc.m_offset;
+	VkDeviceSize size = alloc.m_size;
+
+	//Merge with the free range after us, if it's adjacent
+	auto next = block.m_free.lower_bound(start);
+	if( (next != block.m_free.end()) && (next->first == start + size) )
+	{
+		size += next->second;
+		next = block.m_free.erase(next);
+	}
+
+	//and the one before
+	if(next != block.m_free.begin())
+	{
+		auto prev = std::prev(next);
+		if(prev->first + prev->second == start)
+		{
+			start = prev->first;
+			size += prev->second;
+			block.m_free.erase(prev);
+		}
+	}
+	block.m_free[start] = size;
+
+	//Give empty blocks back to the driver, but keep one of each type around so we don't thrash
+	block.m_allocations --;
+	if(block.m_allocations == 0)
+	{
+		size_t live = 0;
+		for(auto& b : blocks)
+		{
+			if(b.m_memory)
+				live ++;
+		}
+		if(live > 1)
+		{
+			LogTrace("Releasing empty %s block %zu for memory type %u\n", m_name.c_str(), alloc.m_block, alloc.m_memType);
+			block.m_memory = nullptr;
+			block.m_free.clear();
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+/**
+	@brief Gets a snapshot of how much of the pool is in use
+ */
+DeviceMemoryPoolStats DeviceMemoryPool::GetStats()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	DeviceMemoryPoolStats stats;
+	stats.m_dedicatedAllocations = m_dedicatedAllocations;
+	stats.m_dedicatedBytes = m_dedicatedBytes;
+	for(auto& it : m_blocks)
+	{
+		for(auto& block : it.second)
+		{
+			if(!block.m_memory)
+				continue;
+
+			stats.m_blocks ++;
+			stats.m_blockBytes += m_blockSize;
+			stats.m_allocations += block.m_allocations;
+
+			size_t free = 0;
+			for(auto& range : block.m_free)
+			{
+				free += range.second;
+				stats.m_largestFree = max(stats.m_largestFree, (size_t)range.second);
+			}
+			stats.m_usedBytes += m_blockSize - free;
+		}
+	}
+	return stats;
+}
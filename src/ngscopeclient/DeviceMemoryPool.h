@@ -0,0 +1,202 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DeviceMemoryPool
+ */
+#ifndef DeviceMemoryPool_h
+#define DeviceMemoryPool_h
+
+class DeviceMemoryPool;
+
+/**
+	@brief A range of device memory handed out by a DeviceMemoryPool, returned to the pool when destroyed
+ */
+class DeviceMemoryAllocation
+{
+public:
+	DeviceMemoryAllocation(
+		std::shared_ptr<DeviceMemoryPool> pool,
+		vk::DeviceMemory memory,
+		vk::DeviceSize offset,
+		vk::DeviceSize size,
+		size_t block,
+		uint32_t memType,
+		std::unique_ptr<vk::raii::DeviceMemory> dedicated = nullptr);
+	~DeviceMemoryAllocation();
+
+	///@brief Gets the memory object to bind to
+	vk::DeviceMemory GetMemory()
+	{ return m_memory; }
+
+	///@brief Gets the offset to bind at
+	vk::DeviceSize GetOffset()
+	{ return m_offset; }
+
+	///@brief Returns true if this allocation has a memory object of its own rather than part of a block
+	bool IsDedicated()
+	{ return m_dedicated != nullptr; }
+
+protected:
+	friend class DeviceMemoryPool;
+
+	///@brief The pool we came from
+	std::shared_ptr<DeviceMemoryPool> m_pool;
+
+	///@brief Memory object (either a block of the pool, or m_dedicated)
+	vk::DeviceMemory m_memory;
+
+	///@brief Offset of the allocation within m_memory
+	vk::DeviceSize m_offset;
+
+	///@brief Size of the allocation, in bytes
+	vk::DeviceSize m_size;
+
+	///@brief Index of the block within the pool's blocks for this memory type (ignored if dedicated)
+	size_t m_block;
+
+	///@brief Memory type index
+	uint32_t m_memType;
+
+	///@brief Memory object of our own, for allocations too big to share a block
+	std::unique_ptr<vk::raii::DeviceMemory> m_dedicated;
+};
+
+/**
+	@brief Usage statistics for a DeviceMemoryPool
+ */
+class DeviceMemoryPoolStats
+{
+public:
+	DeviceMemoryPoolStats()
+	: m_blocks(0)
+	, m_blockBytes(0)
+	, m_usedBytes(0)
+	, m_allocations(0)
+	, m_largestFree(0)
+	, m_dedicatedAllocations(0)
+	, m_dedicatedBytes(0)
+	{}
+
+	///@brief Number of shared blocks
+	size_t m_blocks;
+
+	///@brief Total size of all shared blocks
+	size_t m_blockBytes;
+
+	///@brief Bytes of the shared blocks handed out
+	size_t m_usedBytes;
+
+	///@brief Number of allocations placed in shared blocks
+	size_t m_allocations;
+
+	///@brief Size of the largest free range in any block
+	size_t m_largestFree;
+
+	///@brief Number of dedicated allocations
+	size_t m_dedicatedAllocations;
+
+	///@brief Total size of dedicated allocations
+	size_t m_dedicatedBytes;
+
+	/**
+		@brief Gets the fraction of free block memory which can't be used for an allocation as big as the largest free
+		range (zero if there's no free space, or it's all in one piece)
+	 */
+	float GetFragmentation()
+	{
+		size_t free = m_blockBytes - m_usedBytes;
+		if(free == 0)
+			return 0;
+		return 1 - (m_largestFree * 1.0f / free);
+	}
+};
+
+/**
+	@brief Places many small device memory allocations in a few large blocks
+
+	Drivers limit the total number of allocations and have a fair bit of overhead per allocation, so small images
+	share large blocks of each memory type rather than getting a memory object each. Allocations bigger than a quarter
+	of a block still get a memory object of their own.
+
+	Free space in each block is kept as a map of free ranges (first fit, coalesced on free). Only optimally tiled
+	images are placed in the pool, so bufferImageGranularity doesn't have to be considered.
+
+	Thread safe.
+ */
+class DeviceMemoryPool : public std::enable_shared_from_this<DeviceMemoryPool>
+{
+public:
+	DeviceMemoryPool(const std::string& name, vk::DeviceSize blockSize = 32 * 1024 * 1024);
+
+	std::unique_ptr<DeviceMemoryAllocation> Allocate(const vk::MemoryRequirements& req, uint32_t memType);
+	DeviceMemoryPoolStats GetStats();
+
+protected:
+	friend class DeviceMemoryAllocation;
+	void Free(DeviceMemoryAllocation& alloc);
+
+	/**
+		@brief One large memory object, divided up between many allocations
+	 */
+	class Block
+	{
+	public:
+		///@brief The memory object (null if the block has been released)
+		std::unique_ptr<vk::raii::DeviceMemory> m_memory;
+
+		///@brief Free ranges, by offset
+		std::map<vk::DeviceSize, vk::DeviceSize> m_free;
+
+		///@brief Number of allocations in the block
+		size_t m_allocations;
+	};
+
+	///@brief Debug name for the blocks
+	std::string m_name;
+
+	///@brief Size of each block
+	vk::DeviceSize m_blockSize;
+
+	///@brief Mutex protecting all of our state
+	std::mutex m_mutex;
+
+	///@brief Blocks of each memory type. Released blocks stay in the list so allocation indexes don't change.
+	std::map<uint32_t, std::vector<Block> > m_blocks;
+
+	///@brief Number of dedicated allocations live
+	size_t m_dedicatedAllocations;
+
+	///@brief Total size of dedicated allocations live
+	size_t m_dedicatedBytes;
+};
+
+#endif
@@ -42,11 +42,18 @@
 #include "DigitalOutputChannelDialog.h"
 #include "ChannelPropertiesDialog.h"
 #include "FilterPropertiesDialog.h"
+#include "FilterTemplateDialog.h"
 #include "EmbeddedTriggerPropertiesDialog.h"
 #include "MeasurementsDialog.h"
 
 using namespace std;
 
+///@brief Color used to highlight nodes and links on the critical path of the filter graph
+#define CRITICAL_PATH_COLOR 0xff4040ff
+
+///@brief Distance (in screen pixels) outside the visible area within which nodes are still fully drawn
+#define NODE_CULL_MARGIN 64
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // FilterGraphGroup
 
@@ -199,6 +206,11 @@ FilterGraphEditor::FilterGraphEditor(Session& session, MainWindow* parent)
 	, m_session(session)
 	, m_parent(parent)
 	, m_nextID(1)
+	, m_totalRuntime(0)
+	, m_maxRuntime(0)
+	, m_criticalPathTime(0)
+	, m_layoutConverged(false)
+	, m_groupPortSettleFrames(0)
 {
 	m_config.SaveSettings = &FilterGraphEditor::SaveSettingsCallback;
 	m_config.LoadSettings = &FilterGraphEditor::LoadSettingsCallback;
@@ -253,7 +265,8 @@ map<shared_ptr<Instrument>, vector<InstrumentChannel*> > FilterGraphEditor::GetA
 {
 	map<shared_ptr<Instrument>, vector<InstrumentChannel*> > ret;
 
-	auto insts = m_session.GetInstruments();
+	auto snapshot = m_session.GetInstrumentSnapshot();
+	auto& insts = snapshot->m_instruments;
 	for(auto inst : insts)
 	{
 		vector<InstrumentChannel*> chans;
@@ -343,7 +356,8 @@ vector<FlowGraphNode*> FilterGraphEditor::GetAllNodes()
 	}
 
 	//Triggers
-	auto insts = m_session.GetInstruments();
+	auto snapshot = m_session.GetInstrumentSnapshot();
+	auto& insts = snapshot->m_instruments;
 	for(auto inst : insts)
 	{
 		auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
@@ -429,9 +443,21 @@ bool FilterGraphEditor::DoRender()
 {
 	bool windowHovered = ImGui::IsWindowHovered();
 
+	//Look at the last filter graph execution first, so nodes and links on the critical path can be highlighted
+	auto filterperf = m_session.GetFilterGraphRuntime();
+	AnalyzeRuntimes(filterperf);
+	RuntimeSummary();
+
 	ax::NodeEditor::SetCurrentEditor(m_context);
+	ImVec2 screenMin = ImGui::GetCursorScreenPos();
+	ImVec2 screenMax = screenMin + ImGui::GetContentRegionAvail();
 	ax::NodeEditor::Begin("Filter Graph", ImVec2(0, 0));
 
+	//Figure out what part of the canvas is on screen, with some slop so nodes are fully built before they scroll in
+	ImVec2 margin(NODE_CULL_MARGIN, NODE_CULL_MARGIN);
+	m_visibleCanvasMin = ax::NodeEditor::ScreenToCanvas(screenMin - margin);
+	m_visibleCanvasMax = ax::NodeEditor::ScreenToCanvas(screenMax + margin);
+
 	//Handle dropping a stream or channel from the browser
 	ax::NodeEditor::NodeId newNode;
 	bool nodeAdded = false;
@@ -484,7 +510,13 @@ bool FilterGraphEditor::DoRender()
 	}
 
 	//Make nodes for all groups
-	RefreshGroupPorts();
+	if(HasGraphChanged())
+		m_groupPortSettleFrames = 2;
+	if(m_groupPortSettleFrames > 0)
+	{
+		RefreshGroupPorts();
+		m_groupPortSettleFrames --;
+	}
 	for(auto it : m_groups)
 		DoNodeForGroup(it.first);
 
@@ -502,7 +534,8 @@ bool FilterGraphEditor::DoRender()
 		ax::NodeEditor::SetNodePosition(newNode, ImGui::GetMousePos());
 
 	//Make nodes for all triggers
-	auto insts = m_session.GetInstruments();
+	auto snapshot = m_session.GetInstrumentSnapshot();
+	auto& insts = snapshot->m_instruments;
 	for(auto inst : insts)
 	{
 		auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
@@ -518,7 +551,6 @@ bool FilterGraphEditor::DoRender()
 
 	//Filters
 	auto filters = Filter::GetAllInstances();
-	auto filterperf = m_session.GetFilterGraphRuntime();
 	for(auto f : filters)
 	{
 		DoNodeForChannel(f, nullptr, false, filterperf[f]);
@@ -548,7 +580,13 @@ bool FilterGraphEditor::DoRender()
 				auto dstid = GetSinkPinForLink(stream, pair<FlowGraphNode*, size_t>(f, i));
 				auto linkid = GetID(pair<ax::NodeEditor::PinId, ax::NodeEditor::PinId>(srcid, dstid));
 				freshLinks.emplace(linkid);
-				ax::NodeEditor::Link(linkid, srcid, dstid);
+
+				//Highlight links along the critical path
+				auto it = m_criticalPred.find(f);
+				if( (it != m_criticalPred.end()) && (it->second == stream.m_channel) && (stream.m_channel != nullptr) )
+					ax::NodeEditor::Link(linkid, srcid, dstid, ImColor(CRITICAL_PATH_COLOR), 3);
+				else
+					ax::NodeEditor::Link(linkid, srcid, dstid);
 			}
 		}
 	}
@@ -659,6 +697,7 @@ void FilterGraphEditor::RefreshGroupPorts()
 {
 	m_nodeGroupMap.clear();
 
+	auto nodes = GetAllNodes();
 	for(auto it : m_groups)
 	{
 		auto group = it.first;
@@ -666,7 +705,6 @@ void FilterGraphEditor::RefreshGroupPorts()
 		group->m_childSourcePins.clear();
 		group->m_childSinkPins.clear();
 
-		auto nodes = GetAllNodes();
 		for(auto node : nodes)
 		{
 			auto id = GetID(node);
@@ -695,7 +733,50 @@ void FilterGraphEditor::RefreshGroupPorts()
 				group->m_childSinkPins.emplace(GetID(indesc));
 			}
 		}
+
+		//Find which of our source pins have edges to other groups
+		group->RefreshLinks();
+	}
+}
+
+/**
+	@brief Checks whether group membership or any connection has changed since the last call
+
+	Group ports only depend on which nodes are in each group and how they're wired up, so there's no need to walk
+	every link of every group each frame. This is a single pass over the nodes and their inputs.
+ */
+bool FilterGraphEditor::HasGraphChanged()
+{
+	vector<uintptr_t> sig;
+	for(auto it : m_groups)
+	{
+		sig.push_back(reinterpret_cast<uintptr_t>(it.first.get()));
+		for(auto nid : it.first->m_children)
+			sig.push_back(reinterpret_cast<uintptr_t>(nid.AsPointer()));
+		sig.push_back(0);
+	}
+
+	auto nodes = GetAllNodes();
+	for(auto node : nodes)
+	{
+		sig.push_back(reinterpret_cast<uintptr_t>(node));
+
+		auto chan = dynamic_cast<InstrumentChannel*>(node);
+		sig.push_back(chan ? chan->GetStreamCount() : 0);
+
+		sig.push_back(node->GetInputCount());
+		for(size_t i=0; i<node->GetInputCount(); i++)
+		{
+			auto stream = node->GetInput(i);
+			sig.push_back(reinterpret_cast<uintptr_t>(stream.m_channel));
+			sig.push_back(stream.m_stream);
+		}
 	}
+
+	if(sig == m_lastGraphSignature)
+		return false;
+	m_lastGraphSignature = std::move(sig);
+	return true;
 }
 
 void FilterGraphEditor::DoNodeForGroup(std::shared_ptr<FilterGraphGroup> group)
@@ -714,9 +795,6 @@ void FilterGraphEditor::DoNodeForGroup(std::shared_ptr<FilterGraphGroup> group)
 	ax::NodeEditor::EndNode();
 	ax::NodeEditor::PopStyleColor();
 
-	//Find which of our source pins have edges to other groups
-	group->RefreshLinks();
-
 	//Groups cannot directly have ports, so make a dummy child node for the hierarchical ports
 	DoNodeForGroupOutputs(group);
 	DoNodeForGroupInputs(group);
@@ -1069,6 +1147,10 @@ void FilterGraphEditor::OutputPortTooltip(StreamDescriptor stream)
 
 /**
 	@brief Calculates the forces applied to each node in the graph based on interaction physics
+
+	Uses sweep-and-prune on the X axis as a broadphase: nodes are sorted by left edge, and each node is only tested
+	against those whose left edge lies before its own right edge. For the usual graph layout (a few columns of nodes)
+	this is close to linear rather than testing every pair.
  */
 void FilterGraphEditor::CalculateNodeForces(
 	const vector<ax::NodeEditor::NodeId>& nodes,
@@ -1079,24 +1161,35 @@ void FilterGraphEditor::CalculateNodeForces(
 	const vector<ImVec2>& sizes,
 	vector<ImVec2>& forces)
 {
-	//Loop over all nodes and find potential collisions
+	//Sort collidable nodes by left edge
+	vector<size_t> order;
+	order.reserve(nodes.size());
 	for(size_t i=0; i<nodes.size(); i++)
 	{
-		if(nocollide[i])
-			continue;
+		if(!nocollide[i])
+			order.push_back(i);
+	}
+	sort(order.begin(), order.end(),
+		[&](size_t a, size_t b) { return positions[a].x < positions[b].x; });
 
-		auto nodeA = nodes[i];
+	//Loop over all nodes and find potential collisions
+	for(size_t ia=0; ia<order.size(); ia++)
+	{
+		size_t i = order[ia];
 		auto posA = positions[i];
 		auto sizeA = sizes[i];
 		bool groupA = isgroup[i];
 
-		for(size_t j=i+1; j<nodes.size(); j++)
-		{
-			if(nocollide[j])
-				continue;
+		//Anything starting past our right edge (plus the hitbox margins) can't overlap us, or anything after it
+		float right = posA.x + sizeA.x + 2*RECT_INTERSECT_MARGIN;
 
-			auto nodeB = nodes[j];
+		for(size_t ib=ia+1; ib<order.size(); ib++)
+		{
+			size_t j = order[ib];
 			auto posB = positions[j];
+			if(posB.x > right)
+				break;
+
 			auto sizeB = sizes[j];
 			bool groupB = isgroup[j];
 
@@ -1104,14 +1197,11 @@ void FilterGraphEditor::CalculateNodeForces(
 			//Node-node is normal code path, group-group also repels
 			if( (groupA && !groupB) || (!groupA && groupB) )
 			{
-				auto nid = groupA ? nodeB : nodeA;
-				auto gid = groupA ? nodeA : nodeB;
-
-				auto posNode = ax::NodeEditor::GetNodePosition(nid);
-				auto sizeNode = ax::NodeEditor::GetNodeSize(nid);
+				auto posNode = groupA ? posB : posA;
+				auto sizeNode = groupA ? sizeB : sizeA;
 
-				auto posGroup = ax::NodeEditor::GetNodePosition(gid);
-				auto sizeGroup = ax::NodeEditor::GetNodeSize(gid);
+				auto posGroup = groupA ? posA : posB;
+				auto sizeGroup = groupA ? sizeA : sizeB;
 
 				//If node is completely INSIDE the group, don't repel
 				if(RectContains(posGroup, sizeGroup, posNode, sizeNode))
@@ -1317,13 +1407,38 @@ void FilterGraphEditor::HandleOverlaps()
 		}
 	}
 
+	//If nothing overlapped last frame and nothing has moved or resized since, the layout is still converged
+	//and there's no need to redo the physics. Dragging always counts as a change.
+	bool anyDragging = false;
+	for(int i=0; i<nnodes; i++)
+		anyDragging |= dragging[i];
+	bool unchanged = !anyDragging && (nodes == m_lastLayoutNodes);
+	for(int i=0; unchanged && (i<nnodes); i++)
+	{
+		if( (positions[i].x != m_lastLayoutPositions[i].x) || (positions[i].y != m_lastLayoutPositions[i].y) ||
+			(sizes[i].x != m_lastLayoutSizes[i].x) || (sizes[i].y != m_lastLayoutSizes[i].y) )
+		{
+			unchanged = false;
+		}
+	}
+	if(unchanged && m_layoutConverged)
+		return;
+	m_lastLayoutNodes = nodes;
+	m_lastLayoutPositions = positions;
+	m_lastLayoutSizes = sizes;
+
 	//Calculate forces from interaction physics
 	CalculateNodeForces(nodes, isgroup, dragging, nocollide, positions, sizes, forces);
 
 	//DEBUG: save the forces
 	m_nodeForces.clear();
+	m_layoutConverged = true;
 	for(int i=0; i<nnodes; i++)
+	{
 		m_nodeForces[nodes[i]] = forces[i];
+		if( (fabs(forces[i].x) > 1e-2) || (fabs(forces[i].y) > 1e-2) )
+			m_layoutConverged = false;
+	}
 
 	//Apply the forces to move the nodes
 	//For now, no persistent velocities
@@ -1863,6 +1978,12 @@ void FilterGraphEditor::DoNodeForTrigger(Trigger* trig)
 	auto tsize = ImGui::GetFontSize();
 	auto color = ColorFromString("#808080");
 	auto id = GetID(trig);
+	if(!IsNodeVisible(id))
+	{
+		DoPlaceholderNode(id, trig, nullptr);
+		return;
+	}
+
 	auto headercolor = prefs.GetColor("Appearance.Filter Graph.header_text_color");
 	auto headerfont = m_parent->GetFontPref("Appearance.Filter Graph.header_font");
 	auto headerfontsize = headerfont->FontSize * ImGui::GetIO().FontGlobalScale;
@@ -1940,6 +2061,164 @@ void FilterGraphEditor::DoNodeForTrigger(Trigger* trig)
 		headerText.c_str());
 }
 
+/**
+	@brief Finds the critical path of the last filter graph execution
+
+	Each filter can't start until everything upstream of it has finished, so the longest chain of runtimes through
+	the graph is a lower bound on the execution time no matter how many threads run it.
+
+	@param runtimes	Runtime of each node in the last execution
+ */
+void FilterGraphEditor::AnalyzeRuntimes(const map<FlowGraphNode*, int64_t>& runtimes)
+{
+	m_totalRuntime = 0;
+	m_maxRuntime = 0;
+	m_criticalPathTime = 0;
+	m_criticalPath.clear();
+	m_criticalPred.clear();
+
+	//Only look at filters which still exist, the runtime stats may refer to ones deleted since the last run
+	map<FlowGraphNode*, int64_t> live;
+	auto filters = Filter::GetAllInstances();
+	for(auto f : filters)
+	{
+		auto it = runtimes.find(f);
+		if(it == runtimes.end())
+			continue;
+		live[f] = it->second;
+		m_totalRuntime += it->second;
+		m_maxRuntime = max(m_maxRuntime, it->second);
+	}
+	if(live.empty())
+		return;
+
+	//Find the latest finishing node, assuming every filter starts as soon as its inputs are ready
+	map<FlowGraphNode*, int64_t> finish;
+	map<FlowGraphNode*, FlowGraphNode*> pred;
+	FlowGraphNode* last = nullptr;
+	for(auto it : live)
+	{
+		auto t = GetPathFinishTime(it.first, live, finish, pred);
+		if(t > m_criticalPathTime)
+		{
+			m_criticalPathTime = t;
+			last = it.first;
+		}
+	}
+
+	//Walk back up the path
+	for(auto node = last; node != nullptr; node = pred[node])
+	{
+		m_criticalPath.push_back(node);
+		m_criticalPred[node] = pred[node];
+	}
+	reverse(m_criticalPath.begin(), m_criticalPath.end());
+}
+
+/**
+	@brief Calculates the earliest time a node can finish, if it starts as soon as all of its inputs are ready
+
+	@param node		The node to look at
+	@param runtimes	Runtime of each live filter
+	@param finish	Memoized finish times
+	@param pred		Filled out with the input each node was waiting on last (null if none)
+
+	@return Finish time, relative to the start of execution
+ */
+int64_t FilterGraphEditor::GetPathFinishTime(
+	FlowGraphNode* node,
+	const map<FlowGraphNode*, int64_t>& runtimes,
+	map<FlowGraphNode*, int64_t>& finish,
+	map<FlowGraphNode*, FlowGraphNode*>& pred)
+{
+	auto it = finish.find(node);
+	if(it != finish.end())
+		return it->second;
+
+	//Mark as visited before recursing, so a malformed graph with a loop can't recurse forever
+	finish[node] = 0;
+	pred[node] = nullptr;
+
+	int64_t start = 0;
+	for(size_t i=0; i<node->GetInputCount(); i++)
+	{
+		FlowGraphNode* src = node->GetInput(i).m_channel;
+		if( (src == nullptr) || (runtimes.find(src) == runtimes.end()) )
+			continue;
+
+		auto t = GetPathFinishTime(src, runtimes, finish, pred);
+		if(t > start)
+		{
+			start = t;
+			pred[node] = src;
+		}
+	}
+
+	auto t = start + runtimes.at(node);
+	finish[node] = t;
+	return t;
+}
+
+/**
+	@brief Shows a one line summary of the last filter graph execution above the graph
+ */
+void FilterGraphEditor::RuntimeSummary()
+{
+	if(m_totalRuntime <= 0)
+		return;
+
+	Unit fs(Unit::UNIT_FS);
+	auto wall = m_session.GetFilterGraphExecTime();
+
+	string str = "Last run: " + fs.PrettyPrint(wall, 3) + " elapsed, " + fs.PrettyPrint(m_totalRuntime, 3) +
+		" in filters";
+	if(wall > 0)
+	{
+		char tmp[32];
+		snprintf(tmp, sizeof(tmp), " (%.2fx parallel)", m_totalRuntime * 1.0 / wall);
+		str += tmp;
+	}
+	str += ", critical path " + fs.PrettyPrint(m_criticalPathTime, 3);
+	ImGui::TextUnformatted(str.c_str());
+
+	string path;
+	for(auto node : m_criticalPath)
+	{
+		auto f = dynamic_cast<Filter*>(node);
+		if(!f)
+			continue;
+		if(!path.empty())
+			path += " → ";
+		path += f->GetDisplayName();
+	}
+
+	HelpMarker(
+		"Performance of the most recent filter graph execution.\n\n"
+		"Parallelism is the total time spent in filters divided by the elapsed time, i.e. the average number of "
+		"filters running at once.\n"
+		"The critical path is the slowest chain of dependent filters (outlined in red). The graph can never run "
+		"faster than this, so speeding up or splitting filters on it is the way to improve the refresh rate.\n\n"
+		"Critical path: " + path);
+}
+
+/**
+	@brief Gets the background color for a filter's runtime bubble
+
+	Ranges from green for the fastest filters to red for the slowest one in the last execution.
+ */
+ImU32 FilterGraphEditor::GetRuntimeHeatColor(int64_t runtime)
+{
+	float frac = 0;
+	if(m_maxRuntime > 0)
+		frac = min(1.0f, runtime * 1.0f / m_maxRuntime);
+
+	float r;
+	float g;
+	float b;
+	ImGui::ColorConvertHSVtoRGB(0.33f * (1 - frac), 0.8f, 0.5f, r, g, b);
+	return ImGui::ColorConvertFloat4ToU32(ImVec4(r, g, b, 1));
+}
+
 /**
 	@brief Make a node for a single channel, of any type
 
@@ -1951,6 +2230,14 @@ void FilterGraphEditor::DoNodeForChannel(
 	bool multiInst,
 	int64_t runtime)
 {
+	//Don't bother laying out nodes nobody can see
+	auto id = GetID(channel);
+	if(!IsNodeVisible(id))
+	{
+		DoPlaceholderNode(id, channel, channel);
+		return;
+	}
+
 	Unit fs(Unit::UNIT_FS);
 
 	//If the channel has no color, make it neutral gray
@@ -1971,7 +2258,14 @@ void FilterGraphEditor::DoNodeForChannel(
 	float headerheight = headerfontsize * 1.5;
 	float rounding = ax::NodeEditor::GetStyle().NodeRounding;
 
-	auto id = GetID(channel);
+	//Outline nodes on the critical path of the last filter graph execution
+	bool critical = (m_criticalPred.find(channel) != m_criticalPred.end());
+	if(critical)
+	{
+		ax::NodeEditor::PushStyleColor(ax::NodeEditor::StyleColor_NodeBorder, ImColor(CRITICAL_PATH_COLOR));
+		ax::NodeEditor::PushStyleVar(ax::NodeEditor::StyleVar_NodeBorderWidth, 3);
+	}
+
 	ax::NodeEditor::BeginNode(id);
 	ImGui::PushID(id.AsPointer());
 
@@ -2130,6 +2424,12 @@ void FilterGraphEditor::DoNodeForChannel(
 	ImGui::PopID();
 	ax::NodeEditor::EndNode();
 
+	if(critical)
+	{
+		ax::NodeEditor::PopStyleVar();
+		ax::NodeEditor::PopStyleColor();
+	}
+
 	//Draw header after the node is done
 	auto bgList = ax::NodeEditor::GetNodeBackgroundDrawList(id);
 	bgList->AddRectFilled(
@@ -2147,13 +2447,21 @@ void FilterGraphEditor::DoNodeForChannel(
 
 	//TODO: add an option for toggling this
 	//TODO: add preference for colors
-	//Draw a bubble above the text with the runtime stats
-	if(runtime > 0)
-	{
-		auto runtimeText = fs.PrettyPrint(runtime, 3);
+	//Draw a bubble above the text with the runtime stats, colored by how slow it is relative to the slowest filter.
+	//Filters which don't run on every acquisition say how often they do.
+	string policyText;
+	if(f)
+		policyText = m_session.GetFilterRefreshPolicy(f).GetSummary();
+	if( (runtime > 0) || !policyText.empty() )
+	{
+		string runtimeText;
+		if(runtime > 0)
+			runtimeText = fs.PrettyPrint(runtime, 3);
+		if(!policyText.empty())
+			runtimeText += (runtimeText.empty() ? "" : ", ") + policyText;
 		auto runtimeSize = headerfont->CalcTextSizeA(headerfontsize, FLT_MAX, 0, runtimeText.c_str());
 
-		auto timebgColor = ColorFromString("#404040");
+		auto timebgColor = GetRuntimeHeatColor(runtime);
 		auto timeTextColor = ColorFromString("#ffffff");
 		float timespacing = 0.1 * headerheight;
 		float runtimeBot = pos.y - timespacing;
@@ -2175,10 +2483,13 @@ void FilterGraphEditor::DoNodeForChannel(
 			rounding,
 			ImDrawFlags_RoundCornersAll);
 
+		auto clockicon = m_parent->GetTextureRef("time");
 		bgList->AddImage(
-			m_parent->GetTextureManager()->GetTexture("time"),
+			clockicon.m_id,
 			clockiconpos,
-			clockiconpos + clockiconsize );
+			clockiconpos + clockiconsize,
+			clockicon.m_uv0,
+			clockicon.m_uv1);
 
 		bgList->AddText(
 			headerfont,
@@ -2210,6 +2521,74 @@ void FilterGraphEditor::DoNodeForChannel(
 		blocktype.c_str());
 }
 
+/**
+	@brief Checks if a node was within the visible part of the canvas last frame
+
+	Nodes which have never been drawn have no size yet, and are always considered visible so they get laid out once.
+ */
+bool FilterGraphEditor::IsNodeVisible(ax::NodeEditor::NodeId id)
+{
+	auto size = ax::NodeEditor::GetNodeSize(id);
+	if( (size.x <= 0) || (size.y <= 0) )
+		return true;
+
+	auto pos = ax::NodeEditor::GetNodePosition(id);
+	return
+		(pos.x < m_visibleCanvasMax.x) && (pos.x + size.x > m_visibleCanvasMin.x) &&
+		(pos.y < m_visibleCanvasMax.y) && (pos.y + size.y > m_visibleCanvasMin.y);
+}
+
+/**
+	@brief Makes a blank stand-in for an off-screen node
+
+	The placeholder keeps the node's size from last frame, so group membership and overlap avoidance don't change.
+	Pins are still emitted (as empty items down each side) so links to on-screen nodes have somewhere to attach.
+
+	@param id		Node ID
+	@param node		The node, for enumerating inputs
+	@param chan		The node as a channel, for enumerating outputs (null if it has none)
+ */
+void FilterGraphEditor::DoPlaceholderNode(ax::NodeEditor::NodeId id, FlowGraphNode* node, InstrumentChannel* chan)
+{
+	auto& style = ax::NodeEditor::GetStyle();
+	auto size = ax::NodeEditor::GetNodeSize(id);
+	ImVec2 content(
+		max(1.0f, size.x - style.NodePadding.x - style.NodePadding.z),
+		max(1.0f, size.y - style.NodePadding.y - style.NodePadding.w));
+
+	size_t nin = node->GetInputCount();
+	size_t nout = chan ? chan->GetStreamCount() : 0;
+	float rowheight = content.y / max(max(nin, nout), (size_t)1);
+
+	ax::NodeEditor::BeginNode(id);
+	ImGui::PushID(id.AsPointer());
+
+	auto start = ImGui::GetCursorPos();
+	for(size_t i=0; i<nin; i++)
+	{
+		ImGui::SetCursorPos(start + ImVec2(0, rowheight*i));
+		ax::NodeEditor::BeginPin(GetID(pair<FlowGraphNode*, size_t>(node, i)), ax::NodeEditor::PinKind::Input);
+			ax::NodeEditor::PinPivotAlignment(ImVec2(0, 0.5));
+			ImGui::Dummy(ImVec2(1, rowheight));
+		ax::NodeEditor::EndPin();
+	}
+	for(size_t i=0; i<nout; i++)
+	{
+		ImGui::SetCursorPos(start + ImVec2(content.x - 1, rowheight*i));
+		ax::NodeEditor::BeginPin(GetID(StreamDescriptor(chan, i)), ax::NodeEditor::PinKind::Output);
+			ax::NodeEditor::PinPivotAlignment(ImVec2(1, 0.5));
+			ImGui::Dummy(ImVec2(1, rowheight));
+		ax::NodeEditor::EndPin();
+	}
+
+	//Reserve the full size last, so the node ends up exactly as big as it was
+	ImGui::SetCursorPos(start);
+	ImGui::Dummy(content);
+
+	ImGui::PopID();
+	ax::NodeEditor::EndNode();
+}
+
 void FilterGraphEditor::RenderForceVector(ImDrawList* list, ImVec2 pos, ImVec2 size, ImVec2 vec)
 {
 	//uncomment to enable this for debugging
@@ -2279,10 +2658,13 @@ void FilterGraphEditor::NodeIcon(InstrumentChannel* chan, ImVec2 pos, ImVec2 ico
 
 	if(iconname != "")
 	{
+		auto icon = m_parent->GetTextureRef(iconname);
 		list->AddImage(
-			m_parent->GetTextureManager()->GetTexture(iconname),
+			icon.m_id,
 			pos,
-			pos + iconsize );
+			pos + iconsize,
+			icon.m_uv0,
+			icon.m_uv1);
 		return;
 	}
 
@@ -2430,6 +2812,30 @@ bool FilterGraphEditor::HandleNodeProperties()
 		{
 			auto group = m_groups[m_selectedProperties];
 			ImGui::InputText("Name", &group->m_name);
+
+			//Save the filters in the group so the same chain can be made for other channels
+			if(ImGui::Button("Save as Template"))
+			{
+				set<Filter*> filters;
+				for(auto f : Filter::GetAllInstances())
+				{
+					if(m_nodeGroupMap.HasEntry(f) && (m_nodeGroupMap[f] == group))
+						filters.emplace(f);
+				}
+
+				auto tmpl = make_shared<FilterGraphTemplate>(group->m_name, filters, m_session.m_idtable);
+				if(tmpl->IsValid())
+				{
+					m_session.AddFilterTemplate(tmpl);
+					ImGui::CloseCurrentPopup();
+				}
+				else
+					LogWarning("Group \"%s\" has no filters fed from outside the group, not saving as template\n",
+						group->m_name.c_str());
+			}
+			HelpMarker(
+				"Saves the filters in this group as a template, which can then be created for any number of "
+				"other streams at once from the Templates menu.");
 		}
 		ImGui::EndPopup();
 	}
@@ -2516,6 +2922,17 @@ void FilterGraphEditor::DoAddMenu()
 		ImGui::EndMenu();
 	}
 
+	auto& templates = m_session.GetFilterTemplates();
+	if(!templates.empty() && ImGui::BeginMenu("Templates"))
+	{
+		for(auto tmpl : templates)
+		{
+			if(ImGui::MenuItem(tmpl->m_name.c_str()))
+				m_parent->AddDialog(make_shared<FilterTemplateDialog>(m_parent, tmpl));
+		}
+		ImGui::EndMenu();
+	}
+
 	ImGui::Separator();
 
 	if(ImGui::MenuItem("New Group"))
@@ -169,6 +169,7 @@ protected:
 	std::vector<FlowGraphNode*> GetAllNodes();
 
 	void RefreshGroupPorts();
+	bool HasGraphChanged();
 
 	ax::NodeEditor::PinId CanonicalizePin(ax::NodeEditor::PinId port);
 
@@ -183,6 +184,8 @@ protected:
 		bool multiInst,
 		int64_t runtime);
 	void DoNodeForTrigger(Trigger* trig);
+	bool IsNodeVisible(ax::NodeEditor::NodeId id);
+	void DoPlaceholderNode(ax::NodeEditor::NodeId id, FlowGraphNode* node, InstrumentChannel* chan);
 	bool HandleNodeProperties();
 	void HandleDoubleClicks();
 	void HandleLinkCreationRequests(Filter*& fReconfigure);
@@ -209,6 +212,15 @@ protected:
 
 	void ClearOldPropertiesDialogs();
 
+	void AnalyzeRuntimes(const std::map<FlowGraphNode*, int64_t>& runtimes);
+	int64_t GetPathFinishTime(
+		FlowGraphNode* node,
+		const std::map<FlowGraphNode*, int64_t>& runtimes,
+		std::map<FlowGraphNode*, int64_t>& finish,
+		std::map<FlowGraphNode*, FlowGraphNode*>& pred);
+	void RuntimeSummary();
+	ImU32 GetRuntimeHeatColor(int64_t runtime);
+
 	void NodeIcon(InstrumentChannel* chan, ImVec2 iconpos, ImVec2 iconsize, ImDrawList* list);
 
 	void FilterMenu(StreamDescriptor src);
@@ -298,6 +310,45 @@ protected:
 		lessID<ax::NodeEditor::NodeId>
 		 > m_groups;
 
+	///@brief Sum of every filter's runtime in the last filter graph execution
+	int64_t m_totalRuntime;
+
+	///@brief Longest runtime of a single filter in the last filter graph execution
+	int64_t m_maxRuntime;
+
+	///@brief Total runtime of the filters on the critical path
+	int64_t m_criticalPathTime;
+
+	///@brief Filters on the critical path of the last execution, in dependency order
+	std::vector<FlowGraphNode*> m_criticalPath;
+
+	///@brief Map of each filter on the critical path to the one before it (null for the first)
+	std::map<FlowGraphNode*, FlowGraphNode*> m_criticalPred;
+
+	///@brief True if no nodes overlapped the last time forces were calculated
+	bool m_layoutConverged;
+
+	///@brief Node IDs the last time forces were calculated
+	std::vector<ax::NodeEditor::NodeId> m_lastLayoutNodes;
+
+	///@brief Node positions the last time forces were calculated
+	std::vector<ImVec2> m_lastLayoutPositions;
+
+	///@brief Node sizes the last time forces were calculated
+	std::vector<ImVec2> m_lastLayoutSizes;
+
+	///@brief Top left corner of the visible part of the canvas, in canvas coordinates
+	ImVec2 m_visibleCanvasMin;
+
+	///@brief Bottom right corner of the visible part of the canvas, in canvas coordinates
+	ImVec2 m_visibleCanvasMax;
+
+	///@brief Group membership and node inputs the last time group ports were refreshed
+	std::vector<uintptr_t> m_lastGraphSignature;
+
+	///@brief Frames left to keep refreshing group ports after a change, while link and pin IDs catch up
+	int m_groupPortSettleFrames;
+
 	//DEBUG: forces for display
 	std::map<
 		ax::NodeEditor::NodeId,
@@ -0,0 +1,251 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FilterGraphIndex
+ */
+#include "ngscopeclient.h"
+#include "FilterGraphIndex.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterGraphIndex::FilterGraphIndex()
+	: m_words(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Indexing
+
+/**
+	@brief Makes sure the index matches the current graph, rebuilding it if needed
+
+	@param nodes	Every node currently in the graph
+
+	@return True if the index was rebuilt
+ */
+bool FilterGraphIndex::Update(const set<FlowGraphNode*>& nodes)
+{
+	//Snapshot the current edges and see if anything changed
+	vector<pair<FlowGraphNode*, vector<FlowGraphNode*> > > edges;
+	edges.reserve(nodes.size());
+	for(auto node : nodes)
+	{
+		vector<FlowGraphNode*> inputs;
+		for(size_t i=0; i<node->GetInputCount(); i++)
+			inputs.push_back(node->GetInput(i).m_channel);
+		edges.push_back(pair(node, std::move(inputs)));
+	}
+
+	if(edges == m_edges)
+		return false;
+
+	m_edges = std::move(edges);
+	Rebuild();
+	return true;
+}
+
+/**
+	@brief Recomputes the topological order and downstream bitsets from m_edges
+ */
+void FilterGraphIndex::Rebuild()
+{
+	size_t n = m_edges.size();
+
+	//Find the consumers of each node, and how many (indexed) inputs each node has
+	map<FlowGraphNode*, size_t> edgeIndex;
+	for(size_t i=0; i<n; i++)
+		edgeIndex[m_edges[i].first] = i;
+
+	vector<vector<size_t> > consumers(n);
+	vector<size_t> pendingInputs(n, 0);
+	for(size_t i=0; i<n; i++)
+	{
+		//Count each source once, even if it feeds several inputs of the same node
+		set<size_t> sources;
+		for(auto src : m_edges[i].second)
+		{
+			auto it = edgeIndex.find(src);
+			if(it != edgeIndex.end())
+				sources.emplace(it->second);
+		}
+		for(auto s : sources)
+			consumers[s].push_back(i);
+		pendingInputs[i] = sources.size();
+	}
+
+	//Kahn's algorithm for the topological order
+	vector<size_t> order;
+	order.reserve(n);
+	for(size_t i=0; i<n; i++)
+	{
+		if(pendingInputs[i] == 0)
+			order.push_back(i);
+	}
+	for(size_t i=0; i<order.size(); i++)
+	{
+		for(auto c : consumers[order[i]])
+		{
+			if(--pendingInputs[c] == 0)
+				order.push_back(c);
+		}
+	}
+
+	//The graph editor doesn't allow cycles, but don't lose nodes if one sneaks in somehow
+	if(order.size() != n)
+	{
+		LogWarning("FilterGraphIndex: filter graph contains a cycle\n");
+		vector<bool> placed(n, false);
+		for(auto i : order)
+			placed[i] = true;
+		for(size_t i=0; i<n; i++)
+		{
+			if(!placed[i])
+				order.push_back(i);
+		}
+	}
+
+	m_order.resize(n);
+	m_index.clear();
+	vector<size_t> position(n);
+	for(size_t i=0; i<n; i++)
+	{
+		m_order[i] = m_edges[order[i]].first;
+		m_index[m_order[i]] = i;
+		position[order[i]] = i;
+	}
+
+	m_inputPositions.assign(n, vector<size_t>());
+	for(size_t i=0; i<n; i++)
+	{
+		for(auto c : consumers[i])
+			m_inputPositions[position[c]].push_back(position[i]);
+	}
+
+	//Downstream sets, working backwards from the sinks so each consumer's row is complete before we use it
+	m_words = (n + 63) / 64;
+	m_downstream.assign(n * m_words, 0);
+	for(size_t i=n; i>0; i--)
+	{
+		size_t pos = i-1;
+		auto row = &m_downstream[pos * m_words];
+		for(auto c : consumers[order[pos]])
+		{
+			size_t cpos = position[c];
+			row[cpos / 64] |= (1ULL << (cpos % 64));
+
+			auto crow = &m_downstream[cpos * m_words];
+			for(size_t w=0; w<m_words; w++)
+				row[w] |= crow[w];
+		}
+	}
+}
+
+/**
+	@brief Finds every node downstream of any of the given roots
+
+	The roots themselves are not included unless they are downstream of another root.
+
+	@param roots		Nodes to search from. Nodes not in the index are ignored.
+	@param downstream	Set to add the downstream nodes to
+ */
+void FilterGraphIndex::GetDownstream(const set<FlowGraphNode*>& roots, set<FlowGraphNode*>& downstream) const
+{
+	vector<uint64_t> mask(m_words, 0);
+	for(auto r : roots)
+	{
+		auto it = m_index.find(r);
+		if(it == m_index.end())
+			continue;
+
+		auto row = &m_downstream[it->second * m_words];
+		for(size_t w=0; w<m_words; w++)
+			mask[w] |= row[w];
+	}
+
+	for(size_t i=0; i<m_order.size(); i++)
+	{
+		if(mask[i / 64] & (1ULL << (i % 64)))
+			downstream.emplace(m_order[i]);
+	}
+}
+
+/**
+	@brief Splits a set of nodes into batches which can be run one after another
+
+	Every node in a batch only depends on nodes in earlier batches (or on nodes not in the set at all), so each batch
+	can be run once everything before it has finished.
+
+	@param nodes	Nodes to split. Nodes not in the index are put in the first batch.
+	@param levels	Filled out with the batches, in the order they need to run
+ */
+void FilterGraphIndex::GetLevels(const set<FlowGraphNode*>& nodes, vector<set<FlowGraphNode*> >& levels) const
+{
+	levels.clear();
+
+	//Index of the first batch which can run once each node's output is ready
+	vector<size_t> ready(m_order.size(), 0);
+	size_t found = 0;
+	for(size_t i=0; i<m_order.size(); i++)
+	{
+		size_t level = 0;
+		for(auto src : m_inputPositions[i])
+			level = max(level, ready[src]);
+
+		//Nodes that aren't being run don't add a batch, but still pass on the dependency
+		if(nodes.find(m_order[i]) == nodes.end())
+		{
+			ready[i] = level;
+			continue;
+		}
+
+		if(levels.size() <= level)
+			levels.resize(level + 1);
+		levels[level].emplace(m_order[i]);
+		ready[i] = level + 1;
+		found ++;
+	}
+
+	if(found == nodes.size())
+		return;
+
+	if(levels.empty())
+		levels.resize(1);
+	for(auto node : nodes)
+	{
+		if(m_index.find(node) == m_index.end())
+			levels[0].emplace(node);
+	}
+}
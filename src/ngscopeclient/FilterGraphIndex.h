@@ -0,0 +1,87 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FilterGraphIndex
+ */
+#ifndef FilterGraphIndex_h
+#define FilterGraphIndex_h
+
+/**
+	@brief Cached topological order and downstream dependency sets of the filter graph
+
+	Finding what has to be refreshed when a channel changes used to mean calling IsDownstreamOf() on every node, each
+	of which walks its inputs recursively. Instead, the graph is indexed once: nodes are put in topological order and
+	each gets a bitset of every node downstream of it, so the downstream cone of a set of channels is just an OR of
+	their rows.
+
+	Update() compares the current graph edges against the ones the index was built from, and rebuilds only if
+	something was added, removed, or rewired. That check is a single pass over each node's inputs.
+ */
+class FilterGraphIndex
+{
+public:
+	FilterGraphIndex();
+
+	bool Update(const std::set<FlowGraphNode*>& nodes);
+	void GetDownstream(const std::set<FlowGraphNode*>& roots, std::set<FlowGraphNode*>& downstream) const;
+	void GetLevels(
+		const std::set<FlowGraphNode*>& nodes,
+		std::vector<std::set<FlowGraphNode*> >& levels) const;
+
+	///@brief Gets every indexed node, in topological order (inputs before the nodes that consume them)
+	const std::vector<FlowGraphNode*>& GetTopologicalOrder() const
+	{ return m_order; }
+
+protected:
+	void Rebuild();
+
+	///@brief Every node and the sources of each of its inputs, as of the last Update()
+	std::vector<std::pair<FlowGraphNode*, std::vector<FlowGraphNode*> > > m_edges;
+
+	///@brief Nodes in topological order
+	std::vector<FlowGraphNode*> m_order;
+
+	///@brief Map of nodes to their position in m_order
+	std::map<FlowGraphNode*, size_t> m_index;
+
+	///@brief Positions in m_order of the indexed sources of each node (in m_order order)
+	std::vector<std::vector<size_t> > m_inputPositions;
+
+	///@brief Number of 64-bit words in each downstream bitset
+	size_t m_words;
+
+	///@brief Bitsets (m_words words per node, in m_order order) of the nodes downstream of each node
+	std::vector<uint64_t> m_downstream;
+};
+
+#endif
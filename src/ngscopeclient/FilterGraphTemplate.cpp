@@ -0,0 +1,214 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FilterGraphTemplate
+ */
+#include "ngscopeclient.h"
+#include "FilterGraphTemplate.h"
+#include "MainWindow.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Captures a set of filters and the links between them
+
+	@param name		Display name of the template
+	@param filters	The filters making up the subgraph
+	@param table	Session ID table, for serializing filter configuration
+ */
+FilterGraphTemplate::FilterGraphTemplate(const string& name, const set<Filter*>& filters, IDTable& table)
+	: m_name(name)
+	, m_hasInput(false)
+	, m_inputType(Stream::STREAM_TYPE_ANALOG)
+{
+	//Put every filter after the filters in the subgraph feeding it, so instances can be created in one pass
+	vector<Filter*> order;
+	set<Filter*> placed;
+	bool progress = true;
+	while( (order.size() < filters.size()) && progress)
+	{
+		progress = false;
+		for(auto f : filters)
+		{
+			if(placed.find(f) != placed.end())
+				continue;
+
+			bool ready = true;
+			for(size_t i=0; i<f->GetInputCount(); i++)
+			{
+				auto src = dynamic_cast<Filter*>(f->GetInput(i).m_channel);
+				if(src && (filters.find(src) != filters.end()) && (placed.find(src) == placed.end()) )
+					ready = false;
+			}
+
+			if(ready)
+			{
+				order.push_back(f);
+				placed.emplace(f);
+				progress = true;
+			}
+		}
+	}
+
+	map<Filter*, size_t> indexes;
+	for(size_t i=0; i<order.size(); i++)
+		indexes[order[i]] = i;
+
+	StreamDescriptor input;
+	for(auto f : order)
+	{
+		FilterGraphTemplateNode node;
+		node.m_config = f->SerializeConfiguration(table);
+		node.m_protocol = node.m_config["protocol"].as<string>();
+		node.m_addToArea = (f->GetCategory() != Filter::CAT_MEASUREMENT);
+
+		for(size_t i=0; i<f->GetInputCount(); i++)
+		{
+			FilterGraphTemplateInput in;
+			auto stream = f->GetInput(i);
+			auto src = dynamic_cast<Filter*>(stream.m_channel);
+
+			if(stream.m_channel == nullptr)
+				in.m_type = FilterGraphTemplateInput::INPUT_NONE;
+
+			else if(src && (indexes.find(src) != indexes.end()) )
+			{
+				in.m_type = FilterGraphTemplateInput::INPUT_INTERNAL;
+				in.m_node = indexes[src];
+				in.m_stream = stream.m_stream;
+			}
+
+			//The first external stream we come across is the one each instance gets its own copy of
+			else if(!m_hasInput || ( (stream.m_channel == input.m_channel) && (stream.m_stream == input.m_stream) ) )
+			{
+				if(!m_hasInput)
+				{
+					input = stream;
+					m_hasInput = true;
+					m_inputName = stream.GetName();
+					m_inputType = stream.GetType();
+				}
+				in.m_type = FilterGraphTemplateInput::INPUT_TEMPLATE;
+			}
+
+			else
+			{
+				in.m_type = FilterGraphTemplateInput::INPUT_FIXED;
+				in.m_fixed = stream;
+				if(src && (m_fixedFilters.find(src) == m_fixedFilters.end()) )
+				{
+					src->AddRef();
+					m_fixedFilters.emplace(src);
+				}
+			}
+
+			node.m_inputs.push_back(in);
+		}
+
+		m_nodes.push_back(node);
+	}
+}
+
+FilterGraphTemplate::~FilterGraphTemplate()
+{
+	for(auto f : m_fixedFilters)
+		f->Release();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instantiation
+
+/**
+	@brief Returns true if the template can be instantiated for the specified stream
+ */
+bool FilterGraphTemplate::CanInstantiate(StreamDescriptor input)
+{
+	return m_hasInput && (input.m_channel != nullptr) && (input.GetType() == m_inputType);
+}
+
+/**
+	@brief Creates a copy of every filter in the template, with the template input connected to the specified stream
+
+	The new filters aren't refreshed here. The caller is expected to refresh everything it instantiated at once.
+
+	@param parent	Main window, for creating the filters
+	@param input	Stream to connect to the template input
+	@param table	Session ID table, for loading filter configuration
+
+	@return The new filters, in template order
+ */
+vector<Filter*> FilterGraphTemplate::Instantiate(MainWindow* parent, StreamDescriptor input, IDTable& table)
+{
+	//Load parameters before hooking anything up, since they can change the number of inputs
+	vector<Filter*> created;
+	for(auto& node : m_nodes)
+	{
+		auto f = parent->CreateFilter(node.m_protocol, nullptr, StreamDescriptor(nullptr, 0), false, node.m_addToArea);
+		f->LoadParameters(node.m_config, table);
+		created.push_back(f);
+	}
+
+	for(size_t i=0; i<m_nodes.size(); i++)
+	{
+		auto f = created[i];
+		auto& inputs = m_nodes[i].m_inputs;
+		for(size_t j=0; (j < inputs.size()) && (j < f->GetInputCount()); j++)
+		{
+			auto& in = inputs[j];
+			switch(in.m_type)
+			{
+				case FilterGraphTemplateInput::INPUT_INTERNAL:
+					f->SetInput(j, StreamDescriptor(created[in.m_node], in.m_stream));
+					break;
+
+				case FilterGraphTemplateInput::INPUT_TEMPLATE:
+					f->SetInput(j, input);
+					break;
+
+				case FilterGraphTemplateInput::INPUT_FIXED:
+					f->SetInput(j, in.m_fixed);
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		//Name after the new inputs, not whatever the original was called
+		f->SetDefaultName();
+	}
+
+	return created;
+}
@@ -0,0 +1,150 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FilterGraphTemplate
+ */
+#ifndef FilterGraphTemplate_h
+#define FilterGraphTemplate_h
+
+class MainWindow;
+
+/**
+	@brief Where one input of a templated filter comes from
+ */
+class FilterGraphTemplateInput
+{
+public:
+	enum InputType
+	{
+		///@brief Not connected
+		INPUT_NONE,
+
+		///@brief Output of another filter in the template
+		INPUT_INTERNAL,
+
+		///@brief The stream the template is being instantiated for
+		INPUT_TEMPLATE,
+
+		///@brief The same stream as in the original subgraph (e.g. a clock shared by every lane)
+		INPUT_FIXED
+	};
+
+	FilterGraphTemplateInput()
+	: m_type(INPUT_NONE)
+	, m_node(0)
+	, m_stream(0)
+	{}
+
+	///@brief Kind of connection
+	InputType m_type;
+
+	///@brief Index of the source node within the template, for INPUT_INTERNAL
+	size_t m_node;
+
+	///@brief Stream index of the source node, for INPUT_INTERNAL
+	size_t m_stream;
+
+	///@brief Source stream, for INPUT_FIXED
+	StreamDescriptor m_fixed;
+};
+
+/**
+	@brief One filter of a template
+ */
+class FilterGraphTemplateNode
+{
+public:
+	///@brief Protocol name to create the filter with
+	std::string m_protocol;
+
+	///@brief Serialized configuration of the original filter, for its parameters
+	YAML::Node m_config;
+
+	///@brief Where each input comes from
+	std::vector<FilterGraphTemplateInput> m_inputs;
+
+	///@brief True if the filter's outputs should be put in waveform areas
+	bool m_addToArea;
+};
+
+/**
+	@brief A saved subgraph of filters which can be re-created for other input streams
+
+	The template has one input: the external stream feeding the first input of the first filter. Every link from that
+	stream into the subgraph is rebound to the new stream on instantiation. Any other external stream the subgraph
+	uses (a reference clock, say) stays connected to the same source in every copy.
+ */
+class FilterGraphTemplate
+{
+public:
+	FilterGraphTemplate(const std::string& name, const std::set<Filter*>& filters, IDTable& table);
+	virtual ~FilterGraphTemplate();
+
+	FilterGraphTemplate(const FilterGraphTemplate&) =delete;
+	FilterGraphTemplate& operator=(const FilterGraphTemplate&) =delete;
+
+	///@brief Returns true if the template has at least one filter, and an input to instantiate it for
+	bool IsValid()
+	{ return !m_nodes.empty() && m_hasInput; }
+
+	///@brief Gets the name of the stream the original subgraph was fed from
+	const std::string& GetOriginalInputName()
+	{ return m_inputName; }
+
+	///@brief Gets the number of filters in the template
+	size_t GetNodeCount()
+	{ return m_nodes.size(); }
+
+	bool CanInstantiate(StreamDescriptor input);
+	std::vector<Filter*> Instantiate(MainWindow* parent, StreamDescriptor input, IDTable& table);
+
+	///@brief Display name of the template
+	std::string m_name;
+
+protected:
+	///@brief The filters, in an order where every filter comes after the filters it takes input from
+	std::vector<FilterGraphTemplateNode> m_nodes;
+
+	///@brief True if the subgraph had an external input
+	bool m_hasInput;
+
+	///@brief Name of the external stream the template was made from
+	std::string m_inputName;
+
+	///@brief Type of the external stream the template was made from
+	Stream::StreamType m_inputType;
+
+	///@brief Filters used as INPUT_FIXED sources, which we hold a reference to so they stay valid
+	std::set<Filter*> m_fixedFilters;
+};
+
+#endif
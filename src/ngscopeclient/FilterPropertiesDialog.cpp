@@ -50,8 +50,15 @@ using namespace std;
 FilterPropertiesDialog::FilterPropertiesDialog(Filter* f, MainWindow* parent, bool graphEditorMode)
 	: ChannelPropertiesDialog(f, graphEditorMode)
 	, m_parent(parent)
+	, m_chunkedOverride(false)
 {
+	Unit fs(Unit::UNIT_FS);
+	m_chunkedHistoryText = fs.PrettyPrint(m_chunkedOverlap.m_history);
+	m_chunkedLookaheadText = fs.PrettyPrint(m_chunkedOverlap.m_lookahead);
 
+	auto policy = parent->GetSession().GetFilterRefreshPolicy(f);
+	m_refreshRateText = Unit(Unit::UNIT_HZ).PrettyPrint(policy.m_maxRate);
+	m_refreshIntervalText = Unit(Unit::UNIT_COUNTS).PrettyPrintInt64(policy.m_interval);
 }
 
 FilterPropertiesDialog::~FilterPropertiesDialog()
@@ -270,12 +277,147 @@ bool FilterPropertiesDialog::DoRender()
 		}
 	}
 
+	//Scheduling overrides
+	if(ImGui::CollapsingHeader("Scheduling", defaultOpenFlags))
+	{
+		auto& session = m_parent->GetSession();
+		bool alwaysRun = session.IsFilterAlwaysRun(f);
+		if(ImGui::Checkbox("Always run", &alwaysRun))
+			session.SetFilterAlwaysRun(f, alwaysRun);
+		HelpMarker(
+			"Run this filter on every acquisition even if its output isn't displayed anywhere.\n\n"
+			"Only needed when demand-driven scheduling is enabled (Preferences | Performance | Waveform Processing)\n"
+			"and the filter has side effects, such as being used for logging or by a trigger.");
+
+		static const vector<string> refreshModes =
+		{
+			"Every acquisition",
+			"Rate limited",
+			"Every Nth acquisition",
+			"Skip if busy"
+		};
+		auto policy = session.GetFilterRefreshPolicy(f);
+		int mode = policy.m_mode;
+		ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12);
+		bool policyChanged = Combo("Refresh", refreshModes, mode);
+		policy.m_mode = static_cast<FilterRefreshPolicy::Mode>(mode);
+		HelpMarker(
+			"How often to run this filter when new data arrives. Use this to keep an expensive filter\n"
+			"(and anything fed only by it) from holding back the refresh rate of the rest of the graph.",
+			{
+				"Rate limited: run at most this many times per second",
+				"Every Nth acquisition: run on one acquisition out of every N",
+				"Skip if busy: run only once as much time has passed since the last run as it took",
+				"Filters which are held back keep showing their last output",
+				"Reconfiguring the filter or selecting a history point always runs it"
+			});
+
+		if(policy.m_mode == FilterRefreshPolicy::MODE_MAX_RATE)
+		{
+			ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12);
+			if(UnitInputWithImplicitApply("Max rate", m_refreshRateText, policy.m_maxRate, Unit(Unit::UNIT_HZ)))
+			{
+				policy.m_maxRate = max(1e-3, policy.m_maxRate);
+				policyChanged = true;
+			}
+		}
+		else if(policy.m_mode == FilterRefreshPolicy::MODE_INTERVAL)
+		{
+			ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12);
+			if(UnitInputWithImplicitApply("Run every", m_refreshIntervalText, policy.m_interval, Unit(Unit::UNIT_COUNTS)))
+			{
+				policy.m_interval = max((int64_t)1, policy.m_interval);
+				policyChanged = true;
+			}
+		}
+
+		if(policyChanged)
+			session.SetFilterRefreshPolicy(f, policy);
+	}
+
+	if(!m_graphEditorMode)
+		ChunkedRunSection(f);
+
 	if(reconfigured)
 		OnReconfigured(f, oldStreamCount);
 
 	return true;
 }
 
+/**
+	@brief Run the filter in chunks, for captures too big to process in GPU memory all at once
+ */
+void FilterPropertiesDialog::ChunkedRunSection(Filter* f)
+{
+	if(!ImGui::CollapsingHeader("Chunked Run"))
+		return;
+
+	auto& session = m_parent->GetSession();
+
+	//Pick up the results of a finished run
+	if(m_chunkedRun && m_chunkedRun->IsDone())
+	{
+		auto err = m_chunkedRun->GetError();
+		if(!err.empty())
+			m_chunkedRunStatus = err;
+		else if(m_chunkedRun->GetProgress() < 1)
+			m_chunkedRunStatus = "Cancelled";
+		else
+		{
+			m_chunkedRunStatus = "Done";
+			m_parent->ClearPersistence();
+		}
+		m_chunkedRun = nullptr;
+	}
+
+	if(m_chunkedRun)
+	{
+		ImGui::ProgressBar(m_chunkedRun->GetProgress(), ImVec2(ImGui::GetFontSize() * 15, 0));
+		ImGui::SameLine();
+		if(ImGui::Button("Cancel"))
+			m_chunkedRun->Cancel();
+		return;
+	}
+
+	StreamingSpec registered;
+	bool streaming = ChunkedFilterRunner::GetStreamingSpec(f, registered);
+
+	ImGui::Checkbox("Specify overlap", &m_chunkedOverride);
+	HelpMarker(
+		"Run the filter and everything feeding it in windows padded by this much input on each side,\n"
+		"rather than by the overlap registered for each filter. Needed for filters which aren't known\n"
+		"to be able to run in chunks.\n\n"
+		"Set the history to at least the length of input the filter looks back over, such as the length of\n"
+		"an FIR filter or the longest packet of a protocol, and the lookahead likewise.");
+	if(m_chunkedOverride)
+	{
+		Unit fs(Unit::UNIT_FS);
+		ImGui::SetNextItemWidth(ImGui::GetFontSize() * 10);
+		UnitInputWithImplicitApply("History", m_chunkedHistoryText, m_chunkedOverlap.m_history, fs);
+		ImGui::SetNextItemWidth(ImGui::GetFontSize() * 10);
+		UnitInputWithImplicitApply("Lookahead", m_chunkedLookaheadText, m_chunkedOverlap.m_lookahead, fs);
+	}
+	else if(!streaming)
+		ImGui::TextUnformatted("This filter isn't known to be able to run in chunks");
+
+	if(ImGui::Button("Run in chunks"))
+	{
+		session.StopTrigger();
+		m_chunkedRunStatus = "";
+		m_chunkedRun = make_unique<ChunkedFilterRunner>(
+			session,
+			f,
+			max((int64_t)1, session.GetPreferences().GetInt("Performance.Waveform Processing.chunk_samples")),
+			m_chunkedOverride ? &m_chunkedOverlap : nullptr);
+	}
+	HelpMarker(
+		"Stop the trigger and recompute this filter's output for the current waveform a window at a time.\n\n"
+		"The window size is set in Preferences | Performance | Waveform Processing.");
+
+	if(!m_chunkedRunStatus.empty())
+		ImGui::TextWrapped("%s", m_chunkedRunStatus.c_str());
+}
+
 /**
 	@brief Handle a single parameter row in the filter (or trigger) properties dialog
 
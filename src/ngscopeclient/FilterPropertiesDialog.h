@@ -36,6 +36,7 @@
 #define FilterPropertiesDialog_h
 
 #include "FileBrowser.h"
+#include "ChunkedFilterRunner.h"
 
 class MainWindow;
 
@@ -58,6 +59,7 @@ protected:
 
 	void FindAllStreams(std::vector<StreamDescriptor>& streams);
 	void OnReconfigured(Filter* f, size_t oldStreamCount);
+	void ChunkedRunSection(Filter* f);
 
 	MainWindow* m_parent;
 
@@ -65,6 +67,24 @@ protected:
 	std::shared_ptr<FileBrowser> m_fileDialog;
 
 	std::string m_fileParamName;
+
+	///@brief Chunked run of the filter in progress, if any
+	std::unique_ptr<ChunkedFilterRunner> m_chunkedRun;
+
+	///@brief Message from the last chunked run
+	std::string m_chunkedRunStatus;
+
+	///@brief True to use m_chunkedOverlap for the whole chain rather than the registered overlap of each filter
+	bool m_chunkedOverride;
+	StreamingSpec m_chunkedOverlap;
+	std::string m_chunkedHistoryText;
+	std::string m_chunkedLookaheadText;
+
+	///@brief Text being edited for the maximum refresh rate
+	std::string m_refreshRateText;
+
+	///@brief Text being edited for the number of acquisitions per refresh
+	std::string m_refreshIntervalText;
 };
 
 #endif
@@ -0,0 +1,188 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FilterRefreshPolicy
+ */
+#include "ngscopeclient.h"
+#include "FilterRefreshPolicy.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterRefreshPolicy::FilterRefreshPolicy()
+	: m_mode(MODE_ALWAYS)
+	, m_maxRate(1)
+	, m_interval(10)
+	, m_lastRunStart(0)
+	, m_lastRuntime(0)
+	, m_heldCount(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+
+/**
+	@brief Decides whether the filter should run on the acquisition being processed
+
+	Called once per refresh triggered by new data. If this returns true, the run is expected to be reported by OnRun().
+
+	@param now	Current time, as returned by GetTime()
+ */
+bool FilterRefreshPolicy::ShouldRun(double now)
+{
+	bool run = true;
+	switch(m_mode)
+	{
+		case MODE_MAX_RATE:
+			if(m_maxRate > 0)
+				run = (now - m_lastRunStart) >= (1.0 / m_maxRate);
+			break;
+
+		case MODE_INTERVAL:
+			run = (m_heldCount + 1) >= m_interval;
+			break;
+
+		case MODE_SKIP_IF_BUSY:
+			run = (now - (m_lastRunStart + m_lastRuntime)) >= m_lastRuntime;
+			break;
+
+		default:
+			break;
+	}
+
+	if(!run)
+		m_heldCount ++;
+	return run;
+}
+
+/**
+	@brief Records that the filter ran, whether because of new data or because something else asked for it
+
+	@param now		Time the run finished, as returned by GetTime()
+	@param runtime	How long the run took, in seconds
+ */
+void FilterRefreshPolicy::OnRun(double now, double runtime)
+{
+	m_lastRunStart = now - runtime;
+	m_lastRuntime = runtime;
+	m_heldCount = 0;
+}
+
+/**
+	@brief Copies the settings of another policy, keeping our record of when the filter last ran
+ */
+void FilterRefreshPolicy::SetConfig(const FilterRefreshPolicy& rhs)
+{
+	m_mode = rhs.m_mode;
+	m_maxRate = rhs.m_maxRate;
+	m_interval = rhs.m_interval;
+}
+
+/**
+	@brief Gets a short description of the policy for display in the filter graph editor
+
+	@return The description, or an empty string for MODE_ALWAYS
+ */
+string FilterRefreshPolicy::GetSummary() const
+{
+	switch(m_mode)
+	{
+		case MODE_MAX_RATE:
+			return "max " + Unit(Unit::UNIT_HZ).PrettyPrint(m_maxRate);
+
+		case MODE_INTERVAL:
+			return "1/" + to_string(m_interval) + " acqs";
+
+		case MODE_SKIP_IF_BUSY:
+			return "skip if busy";
+
+		default:
+			return "";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Serialization
+
+/**
+	@brief Saves the settings (but not the state) of the policy to a session file
+ */
+YAML::Node FilterRefreshPolicy::Serialize() const
+{
+	YAML::Node node;
+	switch(m_mode)
+	{
+		case MODE_MAX_RATE:
+			node["mode"] = "max_rate";
+			break;
+
+		case MODE_INTERVAL:
+			node["mode"] = "interval";
+			break;
+
+		case MODE_SKIP_IF_BUSY:
+			node["mode"] = "skip_if_busy";
+			break;
+
+		default:
+			node["mode"] = "always";
+			break;
+	}
+	node["max_rate"] = m_maxRate;
+	node["interval"] = m_interval;
+	return node;
+}
+
+/**
+	@brief Loads settings saved by Serialize()
+ */
+void FilterRefreshPolicy::Load(const YAML::Node& node)
+{
+	string mode = node["mode"] ? node["mode"].as<string>() : "always";
+	if(mode == "max_rate")
+		m_mode = MODE_MAX_RATE;
+	else if(mode == "interval")
+		m_mode = MODE_INTERVAL;
+	else if(mode == "skip_if_busy")
+		m_mode = MODE_SKIP_IF_BUSY;
+	else
+		m_mode = MODE_ALWAYS;
+
+	if(node["max_rate"])
+		m_maxRate = node["max_rate"].as<double>();
+	if(node["interval"])
+		m_interval = max((int64_t)1, node["interval"].as<int64_t>());
+}
@@ -0,0 +1,107 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FilterRefreshPolicy
+ */
+#ifndef FilterRefreshPolicy_h
+#define FilterRefreshPolicy_h
+
+/**
+	@brief How often a filter is run when new data arrives
+
+	Expensive filters (big FFTs, eye integration, de-embedding...) can be throttled so they don't cap the refresh rate
+	of everything else. A filter which is held back keeps its last output until it runs again.
+
+	Only refreshes triggered by new data are throttled. Reconfiguring a filter or moving around in history always runs
+	it, since its output would otherwise be wrong rather than just old.
+ */
+class FilterRefreshPolicy
+{
+public:
+	FilterRefreshPolicy();
+
+	enum Mode
+	{
+		///@brief Run on every acquisition
+		MODE_ALWAYS,
+
+		///@brief Run at most m_maxRate times per second
+		MODE_MAX_RATE,
+
+		///@brief Run on every m_interval'th acquisition
+		MODE_INTERVAL,
+
+		/**
+			@brief Don't run until as much time has passed since the last run as that run took
+
+			The graph is run synchronously, so this is what holding the output while the filter is still busy
+			amounts to: the filter never takes more than half the time.
+		 */
+		MODE_SKIP_IF_BUSY
+	};
+
+	///@brief True if the filter is run on every acquisition
+	bool IsDefault() const
+	{ return m_mode == MODE_ALWAYS; }
+
+	bool ShouldRun(double now);
+	void OnRun(double now, double runtime);
+	void SetConfig(const FilterRefreshPolicy& rhs);
+
+	std::string GetSummary() const;
+
+	YAML::Node Serialize() const;
+	void Load(const YAML::Node& node);
+
+	///@brief The policy
+	Mode m_mode;
+
+	///@brief Maximum number of runs per second, for MODE_MAX_RATE
+	double m_maxRate;
+
+	///@brief Number of acquisitions per run, for MODE_INTERVAL
+	int64_t m_interval;
+
+protected:
+
+	///@brief Time the last run started, as returned by GetTime()
+	double m_lastRunStart;
+
+	///@brief Duration of the last run, in seconds
+	double m_lastRuntime;
+
+	///@brief Number of acquisitions the filter was held for since it last ran
+	int64_t m_heldCount;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FilterTemplateDialog
+ */
+
+#include "ngscopeclient.h"
+#include "FilterTemplateDialog.h"
+#include "MainWindow.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterTemplateDialog::FilterTemplateDialog(MainWindow* parent, shared_ptr<FilterGraphTemplate> tmpl)
+	: Dialog(
+		string("Template: ") + tmpl->m_name,
+		string("Template: ") + tmpl->m_name + "##" + to_string(reinterpret_cast<uintptr_t>(tmpl.get())),
+		ImVec2(400, 350))
+	, m_parent(parent)
+	, m_template(tmpl)
+{
+}
+
+FilterTemplateDialog::~FilterTemplateDialog()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rendering
+
+/**
+	@brief Renders the dialog and handles UI events
+
+	@return		True if we should continue showing the dialog
+				False if it's been closed
+ */
+bool FilterTemplateDialog::DoRender()
+{
+	ImGui::Text("%zu filters, originally fed from %s",
+		m_template->GetNodeCount(), m_template->GetOriginalInputName().c_str());
+	HelpMarker(
+		"Select the streams to create a copy of the template for.\n\n"
+		"Any other inputs the original filters had stay connected to the same source in every copy.");
+
+	//Re-enumerate every frame since filters may have been created or deleted since last time
+	vector<StreamDescriptor> streams;
+	GetCandidateStreams(streams);
+
+	if(ImGui::Button("Select All"))
+	{
+		for(auto s : streams)
+			m_selected.emplace(s);
+	}
+	ImGui::SameLine();
+	if(ImGui::Button("Select None"))
+		m_selected.clear();
+
+	vector<StreamDescriptor> checked;
+	float height = ImGui::GetContentRegionAvail().y - ImGui::GetFrameHeightWithSpacing();
+	if(ImGui::BeginChild("Streams", ImVec2(0, height), true))
+	{
+		for(auto s : streams)
+		{
+			bool selected = (m_selected.find(s) != m_selected.end());
+			if(ImGui::Checkbox(s.GetName().c_str(), &selected))
+			{
+				if(selected)
+					m_selected.emplace(s);
+				else
+					m_selected.erase(s);
+			}
+
+			if(selected)
+				checked.push_back(s);
+		}
+	}
+	ImGui::EndChild();
+
+	ImGui::BeginDisabled(checked.empty());
+	bool create = ImGui::Button("Create");
+	ImGui::EndDisabled();
+	if(create)
+	{
+		m_parent->InstantiateFilterTemplate(m_template, checked);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+	@brief Finds every stream the template could be instantiated for
+ */
+void FilterTemplateDialog::GetCandidateStreams(vector<StreamDescriptor>& streams)
+{
+	auto& scopes = m_parent->GetSession().GetScopes();
+	for(auto scope : scopes)
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			if(!scope->CanEnableChannel(i))
+				continue;
+
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan)
+				continue;
+
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				StreamDescriptor s(chan, j);
+				if(m_template->CanInstantiate(s))
+					streams.push_back(s);
+			}
+		}
+	}
+
+	auto filters = Filter::GetAllInstances();
+	for(auto f : filters)
+	{
+		for(size_t j=0; j<f->GetStreamCount(); j++)
+		{
+			StreamDescriptor s(f, j);
+			if(m_template->CanInstantiate(s))
+				streams.push_back(s);
+		}
+	}
+}
@@ -30,9 +30,23 @@
 #include "ngscopeclient.h"
 #include "FontManager.h"
 #include "PreferenceManager.h"
+#include <fstream>
+#include <sys/stat.h>
 
 using namespace std;
 
+//The atlas cache pokes at ImFontAtlas / ImFont internals, which were reworked in imgui 1.92
+#if (IMGUI_VERSION_NUM >= 18900) && (IMGUI_VERSION_NUM < 19200)
+#define FONT_CACHE_SUPPORTED
+#endif
+
+//Bump if the layout of the cache file changes
+#define FONT_CACHE_VERSION 1
+
+//Oversampling settings used when rasterizing
+#define FONT_OVERSAMPLE_H 5
+#define FONT_OVERSAMPLE_V 5
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -50,9 +64,17 @@ FontManager::~FontManager()
 /**
 	@brief Check for changes to our fonts and, if any are found, reload
 
+	Rasterizing every font at every size is slow, so each atlas we build is also saved (in memory, and in cacheDir if
+	not empty) keyed by everything that went into it. If the same set of fonts is requested again, either later in this
+	run or on the next startup, the saved atlas is reused instead of being rebuilt.
+
+	@param root			Root of the preferences tree
+	@param contentScale	Display scaling factor
+	@param cacheDir		Directory to cache the atlas in, or empty to not cache on disk
+
 	@return True if changes were made to the font atlas
  */
-bool FontManager::UpdateFonts(PreferenceCategory& root, float contentScale)
+bool FontManager::UpdateFonts(PreferenceCategory& root, float contentScale, const string& cacheDir)
 {
 	//Make a list of fonts we want to have
 	set<FontDescription> fonts;
@@ -97,16 +119,11 @@ bool FontManager::UpdateFonts(PreferenceCategory& root, float contentScale)
 	ImVector<ImWchar> ranges;
 	builder.BuildRanges(&ranges);
 
-	//Load the fonts
-	ImFontConfig config;
-	config.PixelSnapH = true;
-	config.OversampleH = 5;
-	config.OversampleV = 5;
+	//Figure out which file each font actually comes from
 	string defaultFontPath = FindDataFile("fonts/DejaVuSans.ttf");
+	vector<pair<FontDescription, string>> files;
 	for(auto f : fonts)
 	{
-		float scaledsize = round(max(1.0f, f.second) * contentScale);
-
 		//See if the file exists, if it doesn't exist use the default font
 		//(note, things will go bad if you pass a file that's not a valid TTF)
 		string fname = f.first;
@@ -123,16 +140,363 @@ bool FontManager::UpdateFonts(PreferenceCategory& root, float contentScale)
 			fname = defaultFontPath;
 		}
 
-		m_fonts[f] = atlas->AddFontFromFileTTF(fname.c_str(), scaledsize, &config, ranges.Data);
+		files.push_back(pair<FontDescription, string>(f, fname));
+	}
+
+#ifdef FONT_CACHE_SUPPORTED
+
+	//See if we've built this exact atlas before
+	double start = GetTime();
+	string key = GetCacheKey(files, contentScale, ranges);
+	string cachePath;
+	if(!cacheDir.empty())
+		cachePath = cacheDir + "/fontcache.bin";
+
+	shared_ptr<vector<uint8_t>> blob;
+	auto it = m_memoryCache.find(key);
+	if(it != m_memoryCache.end())
+		blob = it->second;
+	else if(!cachePath.empty())
+	{
+		ifstream ifs(cachePath, ios::binary | ios::ate);
+		if(ifs)
+		{
+			size_t len = ifs.tellg();
+			ifs.seekg(0);
+			blob = make_shared<vector<uint8_t>>(len);
+			if(!ifs.read(reinterpret_cast<char*>(blob->data()), len))
+				blob = nullptr;
+		}
+	}
+
+	if(blob)
+	{
+		if(DeserializeAtlas(key, *blob, files))
+		{
+			m_memoryCache[key] = blob;
+			LogTrace("Loaded cached font atlas in %.2f ms\n", (GetTime() - start) * 1000);
+			return true;
+		}
+
+		//Stale or damaged, start over
+		atlas->Clear();
+		m_fonts.clear();
+	}
+
+#endif
+
+	//Load the fonts
+	ImFontConfig config;
+	config.PixelSnapH = true;
+	config.OversampleH = FONT_OVERSAMPLE_H;
+	config.OversampleV = FONT_OVERSAMPLE_V;
+	for(auto& f : files)
+	{
+		float scaledsize = round(max(1.0f, f.first.second) * contentScale);
+		m_fonts[f.first] = atlas->AddFontFromFileTTF(f.second.c_str(), scaledsize, &config, ranges.Data);
 	}
 
 	//Done loading fonts, build the texture
 	atlas->Flags = ImFontAtlasFlags_NoMouseCursors;
 	atlas->Build();
 
+#ifdef FONT_CACHE_SUPPORTED
+
+	//Save it for next time
+	blob = SerializeAtlas(key, files);
+	m_memoryCache[key] = blob;
+	if(!cachePath.empty())
+	{
+		ofstream ofs(cachePath, ios::binary | ios::trunc);
+		if(!ofs || !ofs.write(reinterpret_cast<const char*>(blob->data()), blob->size()))
+			LogWarning("Failed to write font cache \"%s\"\n", cachePath.c_str());
+	}
+	LogTrace("Built font atlas in %.2f ms\n", (GetTime() - start) * 1000);
+
+#endif
+
 	return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Atlas caching
+
+/**
+	@brief Generates a string uniquely identifying everything that affects the contents of the font atlas
+
+	Includes the size and modification time of each font file, so editing or replacing a font invalidates the cache.
+ */
+string FontManager::GetCacheKey(
+	const vector<pair<FontDescription, string>>& files,
+	float contentScale,
+	const ImVector<ImWchar>& ranges)
+{
+	char tmp[256];
+	snprintf(tmp, sizeof(tmp), "imgui %d, format %d, scale %a, oversample %d/%d\n",
+		IMGUI_VERSION_NUM, FONT_CACHE_VERSION, contentScale, FONT_OVERSAMPLE_H, FONT_OVERSAMPLE_V);
+	string key = tmp;
+
+	key += "ranges";
+	for(auto r : ranges)
+		key += " " + to_string(r);
+	key += "\n";
+
+	for(auto& f : files)
+	{
+		struct stat st;
+		memset(&st, 0, sizeof(st));
+		stat(f.second.c_str(), &st);
+
+		snprintf(tmp, sizeof(tmp), " %a %lld %lld\n",
+			f.first.second, (long long)st.st_size, (long long)st.st_mtime);
+		key += f.first.first + " -> " + f.second + tmp;
+	}
+
+	return key;
+}
+
+#ifdef FONT_CACHE_SUPPORTED
+
+/**
+	@brief Appends a plain-old-data value to a byte buffer
+ */
+template<class T>
+static void AppendToBlob(vector<uint8_t>& blob, const T& value)
+{
+	auto p = reinterpret_cast<const uint8_t*>(&value);
+	blob.insert(blob.end(), p, p + sizeof(T));
+}
+
+/**
+	@brief Bounds-checked sequential reader for a cache blob
+ */
+class FontCacheReader
+{
+public:
+	FontCacheReader(const vector<uint8_t>& blob)
+	: m_blob(blob)
+	, m_offset(0)
+	, m_ok(true)
+	{}
+
+	template<class T>
+	T Read()
+	{
+		T ret;
+		memset(&ret, 0, sizeof(ret));
+		ReadBytes(&ret, sizeof(ret));
+		return ret;
+	}
+
+	void ReadBytes(void* dst, size_t len)
+	{
+		if(!m_ok || (len > m_blob.size() - m_offset) )
+		{
+			m_ok = false;
+			return;
+		}
+		memcpy(dst, &m_blob[m_offset], len);
+		m_offset += len;
+	}
+
+	bool IsOK()
+	{ return m_ok; }
+
+protected:
+	const vector<uint8_t>& m_blob;
+	size_t m_offset;
+	bool m_ok;
+};
+
+/**
+	@brief Glyph data for one font read back from the cache
+ */
+class CachedFont
+{
+public:
+	float m_fontSize;
+	float m_ascent;
+	float m_descent;
+	vector<ImFontGlyph> m_glyphs;
+};
+
+/**
+	@brief Saves the current imgui font atlas (which must have just been built from files) to a byte buffer
+ */
+shared_ptr<vector<uint8_t>> FontManager::SerializeAtlas(
+	const string& key,
+	const vector<pair<FontDescription, string>>& files)
+{
+	auto ret = make_shared<vector<uint8_t>>();
+	auto& blob = *ret;
+	auto atlas = ImGui::GetIO().Fonts;
+
+	//Header
+	AppendToBlob(blob, (uint32_t)FONT_CACHE_VERSION);
+	AppendToBlob(blob, (uint32_t)key.length());
+	blob.insert(blob.end(), key.begin(), key.end());
+
+	//Texture
+	unsigned char* pixels;
+	int width;
+	int height;
+	atlas->GetTexDataAsAlpha8(&pixels, &width, &height);
+	AppendToBlob(blob, (int32_t)width);
+	AppendToBlob(blob, (int32_t)height);
+	AppendToBlob(blob, atlas->TexUvScale);
+	AppendToBlob(blob, atlas->TexUvWhitePixel);
+	AppendToBlob(blob, (uint32_t)IM_ARRAYSIZE(atlas->TexUvLines));
+	for(auto& l : atlas->TexUvLines)
+		AppendToBlob(blob, l);
+	blob.insert(blob.end(), pixels, pixels + (size_t)width*height);
+
+	//Glyphs for each font, in the same order as files
+	AppendToBlob(blob, (uint32_t)files.size());
+	for(auto& f : files)
+	{
+		auto font = m_fonts[f.first];
+		AppendToBlob(blob, font->FontSize);
+		AppendToBlob(blob, font->Ascent);
+		AppendToBlob(blob, font->Descent);
+		AppendToBlob(blob, (uint32_t)font->Glyphs.Size);
+		for(auto& g : font->Glyphs)
+		{
+			AppendToBlob(blob, (uint32_t)g.Codepoint);
+			AppendToBlob(blob, g.AdvanceX);
+			AppendToBlob(blob, g.X0);
+			AppendToBlob(blob, g.Y0);
+			AppendToBlob(blob, g.X1);
+			AppendToBlob(blob, g.Y1);
+			AppendToBlob(blob, g.U0);
+			AppendToBlob(blob, g.V0);
+			AppendToBlob(blob, g.U1);
+			AppendToBlob(blob, g.V1);
+		}
+	}
+
+	return ret;
+}
+
+/**
+	@brief Replaces the imgui font atlas with one saved by SerializeAtlas()
+
+	@return True on success, false if the blob is for a different key or is damaged (the atlas is left untouched)
+ */
+bool FontManager::DeserializeAtlas(
+	const string& key,
+	const vector<uint8_t>& blob,
+	const vector<pair<FontDescription, string>>& files)
+{
+	FontCacheReader reader(blob);
+
+	//Check the header
+	if(reader.Read<uint32_t>() != FONT_CACHE_VERSION)
+		return false;
+	uint32_t keylen = reader.Read<uint32_t>();
+	if(!reader.IsOK() || (keylen != key.length()) )
+		return false;
+	string filekey(keylen, '\0');
+	reader.ReadBytes(&filekey[0], keylen);
+	if(!reader.IsOK() || (filekey != key) )
+		return false;
+
+	//Read the texture
+	auto atlas = ImGui::GetIO().Fonts;
+	int32_t width = reader.Read<int32_t>();
+	int32_t height = reader.Read<int32_t>();
+	auto uvScale = reader.Read<ImVec2>();
+	auto uvWhite = reader.Read<ImVec2>();
+	if(reader.Read<uint32_t>() != IM_ARRAYSIZE(atlas->TexUvLines))
+		return false;
+	ImVec4 uvLines[IM_ARRAYSIZE(atlas->TexUvLines)];
+	for(auto& l : uvLines)
+		l = reader.Read<ImVec4>();
+	if(!reader.IsOK() || (width <= 0) || (height <= 0) )
+		return false;
+	vector<uint8_t> pixels((size_t)width * height);
+	reader.ReadBytes(pixels.data(), pixels.size());
+
+	//Read the glyphs
+	if(reader.Read<uint32_t>() != files.size())
+		return false;
+	vector<CachedFont> cfonts(files.size());
+	for(auto& cf : cfonts)
+	{
+		cf.m_fontSize = reader.Read<float>();
+		cf.m_ascent = reader.Read<float>();
+		cf.m_descent = reader.Read<float>();
+		uint32_t nglyphs = reader.Read<uint32_t>();
+		if(!reader.IsOK() || (nglyphs > blob.size()) )
+			return false;
+
+		cf.m_glyphs.resize(nglyphs);
+		for(auto& g : cf.m_glyphs)
+		{
+			g.Codepoint = reader.Read<uint32_t>();
+			g.AdvanceX = reader.Read<float>();
+			g.X0 = reader.Read<float>();
+			g.Y0 = reader.Read<float>();
+			g.X1 = reader.Read<float>();
+			g.Y1 = reader.Read<float>();
+			g.U0 = reader.Read<float>();
+			g.V0 = reader.Read<float>();
+			g.U1 = reader.Read<float>();
+			g.V1 = reader.Read<float>();
+		}
+	}
+	if(!reader.IsOK())
+		return false;
+
+	//Everything checks out, replace the atlas contents.
+	//Each font gets a config with no font data, so imgui has something to look at but can't try to rebuild from it.
+	atlas->Clear();
+	atlas->Flags = ImFontAtlasFlags_NoMouseCursors;
+
+	ImFontConfig config;
+	config.FontData = nullptr;
+	config.FontDataOwnedByAtlas = false;
+	atlas->ConfigData.resize(cfonts.size(), config);
+	for(size_t i=0; i<cfonts.size(); i++)
+	{
+		auto& cf = cfonts[i];
+		auto& cfg = atlas->ConfigData[i];
+		cfg.SizePixels = cf.m_fontSize;
+		snprintf(cfg.Name, sizeof(cfg.Name), "%s, %.0fpx (cached)", files[i].second.c_str(), cf.m_fontSize);
+
+		ImFont* font = IM_NEW(ImFont)();
+		atlas->Fonts.push_back(font);
+		cfg.DstFont = font;
+
+		font->ContainerAtlas = atlas;
+		font->ConfigData = &cfg;
+		font->ConfigDataCount = 1;
+		font->FontSize = cf.m_fontSize;
+		font->Ascent = cf.m_ascent;
+		font->Descent = cf.m_descent;
+
+		//Glyph metrics were already adjusted by the original build, so don't pass a config to apply them again
+		for(auto& g : cf.m_glyphs)
+			font->AddGlyph(nullptr, (ImWchar)g.Codepoint, g.X0, g.Y0, g.X1, g.Y1, g.U0, g.V0, g.U1, g.V1, g.AdvanceX);
+		font->BuildLookupTable();
+
+		m_fonts[files[i].first] = font;
+	}
+
+	atlas->TexWidth = width;
+	atlas->TexHeight = height;
+	atlas->TexUvScale = uvScale;
+	atlas->TexUvWhitePixel = uvWhite;
+	for(size_t i=0; i<IM_ARRAYSIZE(atlas->TexUvLines); i++)
+		atlas->TexUvLines[i] = uvLines[i];
+	atlas->TexPixelsAlpha8 = reinterpret_cast<unsigned char*>(IM_ALLOC(pixels.size()));
+	memcpy(atlas->TexPixelsAlpha8, pixels.data(), pixels.size());
+	atlas->TexReady = true;
+
+	return true;
+}
+
+#endif
+
 /**
 	@brief Get the font descriptions for each preference category
  */
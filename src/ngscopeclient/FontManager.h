@@ -36,6 +36,8 @@
 #define FontManager_h
 
 #include <map>
+#include <memory>
+#include <vector>
 
 class PreferenceCategory;
 
@@ -48,7 +50,7 @@ public:
 	FontManager();
 	~FontManager();
 
-	bool UpdateFonts(PreferenceCategory& root, float contentScale);
+	bool UpdateFonts(PreferenceCategory& root, float contentScale, const std::string& cacheDir = "");
 
 	/**
 		@brief Gets the font, if any, for the provided description
@@ -59,8 +61,23 @@ public:
 protected:
 	void AddFontDescriptions(PreferenceCategory& cat, std::set<FontDescription>& fonts);
 
+	std::string GetCacheKey(
+		const std::vector<std::pair<FontDescription, std::string>>& files,
+		float contentScale,
+		const ImVector<ImWchar>& ranges);
+	std::shared_ptr<std::vector<uint8_t>> SerializeAtlas(
+		const std::string& key,
+		const std::vector<std::pair<FontDescription, std::string>>& files);
+	bool DeserializeAtlas(
+		const std::string& key,
+		const std::vector<uint8_t>& blob,
+		const std::vector<std::pair<FontDescription, std::string>>& files);
+
 	//Map of font descriptions to fonts
 	std::map<FontDescription, ImFont*> m_fonts;
+
+	///@brief Atlases built (or loaded) so far this run, by cache key, so switching back to old settings is instant
+	std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> m_memoryCache;
 };
 
 #endif
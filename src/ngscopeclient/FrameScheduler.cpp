@@ -0,0 +1,121 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FrameScheduler
+ */
+#include "ngscopeclient.h"
+#include "FrameScheduler.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queueing
+
+/**
+	@brief Adds a task to the end of the queue, or replaces the pending task with the same owner and name
+
+	A replaced task keeps its place in the queue, so a stream of repeated requests can't starve it.
+
+	@param owner	Object the task belongs to (it must call Cancel() before it's destroyed)
+	@param name		Name of the task
+	@param task		The work to do
+ */
+void FrameScheduler::Post(const void* owner, const string& name, Task task)
+{
+	for(auto& t : m_tasks)
+	{
+		if( (t.m_owner == owner) && (t.m_name == name) )
+		{
+			t.m_task = task;
+			return;
+		}
+	}
+
+	m_tasks.push_back({owner, name, task});
+}
+
+/**
+	@brief Drops every pending task belonging to an object, without running them
+ */
+void FrameScheduler::Cancel(const void* owner)
+{
+	m_tasks.remove_if([owner](const PendingTask& t) { return t.m_owner == owner; });
+
+	if(m_running && (m_running->m_owner == owner) )
+		m_runningCancelled = true;
+}
+
+/**
+	@brief Checks if a task with the given owner and name is waiting to run
+ */
+bool FrameScheduler::IsPending(const void* owner, const string& name)
+{
+	for(auto& t : m_tasks)
+	{
+		if( (t.m_owner == owner) && (t.m_name == name) )
+			return true;
+	}
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+/**
+	@brief Gives pending tasks slices of time, round robin, until the deadline
+
+	The first task always gets one slice even if we're already past the deadline, so everything is finished
+	eventually no matter how busy the frames are. Tasks which aren't finished go to the back of the queue.
+
+	@param deadline	Time (as returned by GetTime()) to stop at
+ */
+void FrameScheduler::Run(double deadline)
+{
+	bool first = true;
+	while(!m_tasks.empty() && (first || (GetTime() < deadline)) )
+	{
+		first = false;
+
+		//Take the task off the queue while it runs, so it can post or cancel tasks itself
+		auto t = m_tasks.front();
+		m_tasks.pop_front();
+		m_running = &t;
+		m_runningCancelled = false;
+		bool done = t.m_task(deadline);
+		m_running = nullptr;
+
+		//If the task was cancelled, or posted a replacement for itself, this copy is stale
+		if(done || m_runningCancelled || IsPending(t.m_owner, t.m_name))
+			continue;
+		m_tasks.push_back(t);
+	}
+}
@@ -0,0 +1,108 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FrameScheduler
+ */
+#ifndef FrameScheduler_h
+#define FrameScheduler_h
+
+#include <functional>
+
+/**
+	@brief Runs deferrable GUI thread work in slices, within whatever time is left in each frame
+
+	Work which doesn't have to be finished before the frame it was requested in (rebuilding table rows, warming
+	caches, and so on) is posted here rather than done all at once, so large jobs don't cause frame time spikes.
+	Tasks are identified by an owner and a name; posting a task which is already pending replaces it, so repeated
+	requests coalesce into one.
+
+	Only touched from the GUI thread.
+ */
+class FrameScheduler
+{
+public:
+
+	/**
+		@brief Does one slice of a task
+
+		Each call must make some progress, even if the deadline has already passed, and should return as soon as
+		practical once it has.
+
+		@param deadline	Time (as returned by GetTime()) to stop at
+
+		@return True if the task is finished, false if it needs to be called again
+	 */
+	typedef std::function<bool(double deadline)> Task;
+
+	FrameScheduler()
+	: m_running(nullptr)
+	, m_runningCancelled(false)
+	{}
+
+	void Post(const void* owner, const std::string& name, Task task);
+	void Cancel(const void* owner);
+	bool IsPending(const void* owner, const std::string& name);
+	void Run(double deadline);
+
+	///@brief Gets the number of tasks waiting to run
+	size_t GetPendingCount()
+	{ return m_tasks.size(); }
+
+protected:
+
+	/**
+		@brief A single pending task
+	 */
+	class PendingTask
+	{
+	public:
+		///@brief Object the task belongs to
+		const void* m_owner;
+
+		///@brief Name of the task, unique per owner
+		std::string m_name;
+
+		///@brief The work to do
+		Task m_task;
+	};
+
+	///@brief Pending tasks, in the order they'll next get a slice
+	std::list<PendingTask> m_tasks;
+
+	///@brief The task currently running, if any (it's not in m_tasks while it runs)
+	PendingTask* m_running;
+
+	///@brief Set if the running task's owner was cancelled while it ran
+	bool m_runningCancelled;
+};
+
+#endif
@@ -290,6 +290,8 @@ void FunctionGeneratorDialog::DoChannel(size_t i)
 				m_generator->SetFunctionChannelFallTime(i, m_uiState[i].m_committedFallTime);
 		}
 
+		DoArbitraryWaveform(i);
+
 		ImGui::PopID();
 	}
 
@@ -297,3 +299,175 @@ void FunctionGeneratorDialog::DoChannel(size_t i)
 	if(dynamic_pointer_cast<Oscilloscope>(m_generator) == nullptr)
 		m_generator->GetTransport()->FlushCommandQueue();
 }
+
+/**
+	@brief Run the UI for uploading a captured or generated waveform to a single channel
+ */
+void FunctionGeneratorDialog::DoArbitraryWaveform(size_t i)
+{
+	auto& state = m_uiState[i];
+	float valueWidth = 200;
+	Unit volts(Unit::UNIT_VOLTS);
+
+	//Pick up the new amplitude and offset once an upload which changed them is done
+	if(state.m_arbUpload && state.m_arbUpload->IsFinished() && !state.m_arbUploadSeen)
+	{
+		state.m_arbUploadSeen = true;
+		state.m_committedAmplitude = m_generator->GetFunctionChannelAmplitude(i);
+		state.m_amplitude = volts.PrettyPrint(state.m_committedAmplitude);
+		state.m_committedOffset = m_generator->GetFunctionChannelOffset(i);
+		state.m_offset = volts.PrettyPrint(state.m_committedOffset);
+	}
+
+	if(!ImGui::TreeNode("Arbitrary Waveform"))
+		return;
+
+	//Any uniformly sampled analog stream can be played back
+	vector<StreamDescriptor> streams;
+	for(auto scope : m_session->GetScopes())
+	{
+		for(size_t j=0; j<scope->GetChannelCount(); j++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(j);
+			if(!chan)
+				continue;
+			for(size_t k=0; k<chan->GetStreamCount(); k++)
+			{
+				if(chan->GetType(k) == Stream::STREAM_TYPE_ANALOG)
+					streams.push_back(StreamDescriptor(chan, k));
+			}
+		}
+	}
+	for(auto f : Filter::GetAllInstances())
+	{
+		for(size_t k=0; k<f->GetStreamCount(); k++)
+		{
+			if(f->GetType(k) == Stream::STREAM_TYPE_ANALOG)
+				streams.push_back(StreamDescriptor(f, k));
+		}
+	}
+	vector<string> names;
+	int sel = -1;
+	for(auto& stream : streams)
+	{
+		if(stream == state.m_arbStream)
+			sel = names.size();
+		names.push_back(stream.GetName());
+	}
+	ImGui::SetNextItemWidth(valueWidth);
+	if(Combo("Source", names, sel) && (sel >= 0) )
+		state.m_arbStream = streams[sel];
+	if(sel < 0)
+		state.m_arbStream = StreamDescriptor(nullptr, 0);
+	HelpMarker("Waveform to play back. The current acquisition is copied when the upload starts.");
+
+	auto& format = state.m_arbFormat;
+	ImGui::SetNextItemWidth(valueWidth);
+	if(ImGui::InputInt("Points", &state.m_arbPoints))
+		state.m_arbPoints = max(state.m_arbPoints, 0);
+	HelpMarker("Number of points to resample the waveform to, or zero to send every sample.");
+
+	ImGui::SetNextItemWidth(valueWidth);
+	if(ImGui::InputInt("DAC Bits", &format.m_bits))
+		format.m_bits = min(max(format.m_bits, 2), 16);
+	ImGui::Checkbox("Signed Codes", &format.m_signed);
+	HelpMarker("Two's complement codes centered on zero if checked, offset binary if not.");
+	ImGui::Checkbox("Big Endian", &format.m_bigEndian);
+	HelpMarker("Send the most significant byte of each 16-bit code first.");
+
+	ImGui::SetNextItemWidth(valueWidth);
+	if(ImGui::InputInt("Chunk Points", &state.m_arbChunkPoints, 1024, 65536))
+		state.m_arbChunkPoints = max(state.m_arbChunkPoints, 1);
+	HelpMarker("Number of points sent in each block. Smaller chunks let other commands through more often.");
+
+	ImGui::SetNextItemWidth(valueWidth);
+	ImGui::InputText("Chunk Command", &format.m_command);
+	HelpMarker(
+		"Command sent before the binary block of each chunk.\n\n"
+		"{ch} is the 1-based channel number, {offset} the index of the first point in the chunk, "
+		"{count} the number of points in it, and {last} is 1 for the final chunk and 0 otherwise.");
+	ImGui::SetNextItemWidth(valueWidth);
+	ImGui::InputText("Finish Command", &format.m_finishCommand);
+	HelpMarker("Optional command sent once every chunk has been sent, for example to select the new waveform.");
+
+	ImGui::Checkbox("Match Amplitude", &format.m_matchAmplitude);
+	HelpMarker(
+		"Set the channel amplitude and offset to the span of the source once the upload is done.\n\n"
+		"Otherwise the full span of the source is mapped to the current amplitude.");
+
+	//Progress of the most recent upload
+	auto upload = state.m_arbUpload;
+	bool busy = upload && !upload->IsFinished();
+	if(busy)
+	{
+		size_t total = upload->GetPointCount();
+		float frac = total ? (upload->GetPointsSent() * 1.0f / total) : 0;
+		string label = total ?
+			(to_string(upload->GetPointsSent()) + " / " + to_string(total)) :
+			string("Converting...");
+		ImGui::ProgressBar(frac, ImVec2(valueWidth, 0), label.c_str());
+		ImGui::SameLine();
+		if(ImGui::Button("Cancel"))
+			upload->Cancel();
+	}
+	else
+	{
+		ImGui::BeginDisabled(state.m_arbStream.m_channel == nullptr);
+		if(ImGui::Button("Upload"))
+			StartArbitraryWaveformUpload(i);
+		ImGui::EndDisabled();
+
+		if(upload)
+		{
+			ImGui::SameLine();
+			switch(upload->GetState())
+			{
+				case ArbitraryWaveformUpload::STATE_DONE:
+					ImGui::Text("Uploaded %zu points of %s", upload->GetPointCount(), upload->GetSource().c_str());
+					break;
+
+				case ArbitraryWaveformUpload::STATE_CANCELLED:
+					ImGui::TextUnformatted("Cancelled");
+					break;
+
+				case ArbitraryWaveformUpload::STATE_FAILED:
+					ImGui::TextColored(ImVec4(1, 0.25, 0.25, 1), "%s", upload->GetError().c_str());
+					break;
+
+				default:
+					break;
+			}
+		}
+	}
+
+	ImGui::TreePop();
+}
+
+/**
+	@brief Copies the selected stream and hands it to the instrument thread to upload
+ */
+void FunctionGeneratorDialog::StartArbitraryWaveformUpload(size_t i)
+{
+	auto& state = m_uiState[i];
+	state.m_arbFormat.m_points = state.m_arbPoints;
+	state.m_arbFormat.m_chunkPoints = state.m_arbChunkPoints;
+
+	{
+		shared_lock lock(m_session->GetWaveformDataMutex());
+		auto wfm = dynamic_cast<UniformAnalogWaveform*>(state.m_arbStream.GetData());
+		if(!wfm || (wfm->size() == 0) )
+		{
+			LogError("%s has no uniformly sampled analog data to upload\n", state.m_arbStream.GetName().c_str());
+			return;
+		}
+		state.m_arbUpload = make_shared<ArbitraryWaveformUpload>(
+			i, state.m_arbStream.GetName(), wfm, state.m_arbFormat);
+	}
+	state.m_arbUploadSeen = !state.m_arbFormat.m_matchAmplitude;
+
+	{
+		lock_guard<mutex> lock(m_state->m_arbMutex);
+		m_state->m_arbUploads.push_back(state.m_arbUpload);
+	}
+	m_session->WakeInstrumentThreads();
+}
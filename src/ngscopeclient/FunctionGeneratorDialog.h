@@ -38,6 +38,7 @@
 #include "Dialog.h"
 #include "RollingBuffer.h"
 #include "Session.h"
+#include "ArbitraryWaveformUpload.h"
 
 class FunctionGeneratorChannelUIState
 {
@@ -67,6 +68,24 @@ public:
 	int m_shapeIndex;
 	std::vector<FunctionGenerator::WaveShape> m_waveShapes;
 	std::vector<std::string> m_waveShapeNames;
+
+	///@brief Stream to upload as an arbitrary waveform
+	StreamDescriptor m_arbStream;
+
+	///@brief Sample format for arbitrary waveform uploads
+	ArbitraryWaveformFormat m_arbFormat;
+
+	///@brief Number of points to resample to, as edited (zero to keep the source length)
+	int m_arbPoints = 0;
+
+	///@brief Points per chunk, as edited
+	int m_arbChunkPoints = 65536;
+
+	///@brief Most recent arbitrary waveform upload (may still be in progress)
+	std::shared_ptr<ArbitraryWaveformUpload> m_arbUpload;
+
+	///@brief True once the settings have been read back after m_arbUpload finished
+	bool m_arbUploadSeen = true;
 };
 
 class FunctionGeneratorDialog : public Dialog
@@ -82,6 +101,8 @@ public:
 
 protected:
 	void DoChannel(size_t i);
+	void DoArbitraryWaveform(size_t i);
+	void StartArbitraryWaveformUpload(size_t i);
 
 	///@brief Session handle so we can remove the PSU when closed
 	Session* m_session;
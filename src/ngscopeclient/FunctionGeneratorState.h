@@ -35,6 +35,8 @@
 #ifndef FunctionGeneratorState_h
 #define FunctionGeneratorState_h
 
+class ArbitraryWaveformUpload;
+
 /**
 	@brief Current status of a Function Generator
  */
@@ -110,6 +112,12 @@ public:
 
 	std::unique_ptr<float[]> m_committedFrequency;
 	std::unique_ptr<std::string[]> m_strFrequency;
+
+	///@brief Guards m_arbUploads
+	std::mutex m_arbMutex;
+
+	///@brief Arbitrary waveform uploads, oldest first (the instrument thread works on the front one)
+	std::deque<std::shared_ptr<ArbitraryWaveformUpload>> m_arbUploads;
 };
 
 #endif
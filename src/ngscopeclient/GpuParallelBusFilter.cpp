@@ -0,0 +1,278 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of GpuParallelBusFilter
+ */
+
+#include "ngscopeclient.h"
+#include "GpuParallelBusFilter.h"
+
+using namespace std;
+
+///@brief Most thread blocks dispatched in X before wrapping into Y
+static const size_t PARALLEL_BUS_MAX_X_BLOCKS = 32768;
+
+///@brief Most threads the counting and compaction passes are split across (bounds the CPU side prefix sum)
+static const size_t PARALLEL_BUS_MAX_THREADS = 16384;
+
+///@brief Fewest samples given to one thread of the counting and compaction passes
+static const size_t PARALLEL_BUS_MIN_SAMPLES_PER_THREAD = 256;
+
+///@brief Widest bus we can pack into one word per sample
+static const int64_t PARALLEL_BUS_MAX_WIDTH = 32;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GpuParallelBusWaveform
+
+string GpuParallelBusWaveform::GetText(size_t i)
+{
+	char tmp[16];
+	snprintf(tmp, sizeof(tmp), "%0*x", (int)((m_width + 3) / 4), m_samples[i]);
+	return tmp;
+}
+
+string GpuParallelBusWaveform::GetColor(size_t /*i*/)
+{
+	return StandardColors::colors[StandardColors::COLOR_DATA];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+GpuParallelBusFilter::GpuParallelBusFilter(const string& color)
+	: Filter(color, CAT_BUS)
+	, m_widthName("Width")
+	, m_packed("GpuParallelBusFilter.packed")
+	, m_counts("GpuParallelBusFilter.counts")
+{
+	AddStream(Unit(Unit::UNIT_COUNTS), "data", Stream::STREAM_TYPE_PROTOCOL);
+
+	m_parameters[m_widthName] = FilterParameter(FilterParameter::TYPE_INT, Unit(Unit::UNIT_COUNTS));
+	m_parameters[m_widthName].signal_changed().connect(
+		sigc::mem_fun(*this, &GpuParallelBusFilter::OnWidthChanged));
+	m_parameters[m_widthName].SetIntVal(8);
+
+	//The packed samples are only ever used by the shaders, but the counts come back for the prefix sum
+	m_packed.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+	m_packed.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_counts.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_counts.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	m_scanPipeline = make_shared<ComputePipeline>(
+		"shaders/GpuParallelBusScan.spv", 3, sizeof(GpuParallelBusArgs));
+	m_compactPipeline = make_shared<ComputePipeline>(
+		"shaders/GpuParallelBusCompact.spv", 5, sizeof(GpuParallelBusArgs));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Factory methods
+
+bool GpuParallelBusFilter::ValidateChannel(size_t i, StreamDescriptor stream)
+{
+	if(stream.m_channel == nullptr)
+		return false;
+
+	return (i < m_inputs.size()) && (stream.GetType() == Stream::STREAM_TYPE_DIGITAL);
+}
+
+string GpuParallelBusFilter::GetProtocolName()
+{
+	return "Parallel Bus (GPU)";
+}
+
+Filter::DataLocation GpuParallelBusFilter::GetInputLocation()
+{
+	return LOC_GPU;
+}
+
+/**
+	@brief Adds or removes inputs to match the bus width
+ */
+void GpuParallelBusFilter::OnWidthChanged()
+{
+	size_t width = min(max(m_parameters[m_widthName].GetIntVal(), (int64_t)1), PARALLEL_BUS_MAX_WIDTH);
+
+	//Let go of anything connected to the lanes we're dropping
+	for(size_t i=width; i<m_inputs.size(); i++)
+		SetInput(i, StreamDescriptor(nullptr, 0), true);
+	if(m_inputs.size() > width)
+	{
+		m_inputs.erase(m_inputs.begin() + width, m_inputs.end());
+		m_signalNames.erase(m_signalNames.begin() + width, m_signalNames.end());
+	}
+
+	while(m_inputs.size() < width)
+		CreateInput(string("din") + to_string(m_inputs.size()));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Actual decoder logic
+
+void GpuParallelBusFilter::Refresh(vk::raii::CommandBuffer& cmdBuf, shared_ptr<QueueHandle> queue)
+{
+	if(!VerifyAllInputsOK())
+	{
+		SetData(nullptr, 0);
+		return;
+	}
+
+	//Every lane has to be sampled on the same clock for the samples to line up
+	vector<UniformDigitalWaveform*> lanes;
+	size_t len = UINT32_MAX;
+	for(size_t i=0; i<m_inputs.size(); i++)
+	{
+		auto wfm = dynamic_cast<UniformDigitalWaveform*>(GetInputWaveform(i));
+		if( (wfm == nullptr) ||
+			( !lanes.empty() &&
+			  ( (wfm->m_timescale != lanes[0]->m_timescale) || (wfm->m_triggerPhase != lanes[0]->m_triggerPhase) ) ) )
+		{
+			SetData(nullptr, 0);
+			return;
+		}
+		lanes.push_back(wfm);
+		len = min(len, wfm->size());
+	}
+	if(lanes.empty() || (len == 0) )
+	{
+		SetData(nullptr, 0);
+		return;
+	}
+
+	//Reuse the output if we can
+	size_t width = lanes.size();
+	auto cap = dynamic_cast<GpuParallelBusWaveform*>(GetData(0));
+	if( (cap == nullptr) || (cap->m_width != width) )
+	{
+		cap = new GpuParallelBusWaveform(width);
+		SetData(cap, 0);
+	}
+	cap->m_timescale = lanes[0]->m_timescale;
+	cap->m_triggerPhase = lanes[0]->m_triggerPhase;
+	cap->m_startTimestamp = lanes[0]->m_startTimestamp;
+	cap->m_startFemtoseconds = lanes[0]->m_startFemtoseconds;
+	cap->m_revision ++;
+
+	size_t samplesPerThread = max<size_t>(
+		PARALLEL_BUS_MIN_SAMPLES_PER_THREAD,
+		GetComputeBlockCount(len, PARALLEL_BUS_MAX_THREADS));
+	size_t numThreads = GetComputeBlockCount(len, samplesPerThread);
+
+	GpuParallelBusArgs args;
+	args.numSamples = len;
+	args.samplesPerThread = samplesPerThread;
+	args.numThreads = numThreads;
+	args.numCells = 0;
+	args.lane = 0;
+
+	//Pack the lanes and count the value changes seen by each thread
+	m_packed.resize(len);
+	m_counts.resize(numThreads);
+
+	cmdBuf.begin({});
+
+	for(auto w : lanes)
+		w->m_samples.PrepareForGpuAccessNonblocking(false, cmdBuf);
+	AcceleratorBuffer<uint32_t>::HostToDeviceTransferMemoryBarrier(cmdBuf);
+
+	size_t xblocks = min<size_t>(GetComputeBlockCount(len, 64), PARALLEL_BUS_MAX_X_BLOCKS);
+	size_t yblocks = GetComputeBlockCount(len, xblocks*64);
+	args.stride = xblocks*64;
+
+	m_scanPipeline->BindBufferNonblocking(0, m_packed, cmdBuf, true);
+	m_scanPipeline->BindBufferNonblocking(2, m_counts, cmdBuf, true);
+	args.mode = GpuParallelBusArgs::MODE_PACK;
+	for(size_t i=0; i<width; i++)
+	{
+		args.lane = i;
+		m_scanPipeline->BindBufferNonblocking(1, lanes[i]->m_samples, cmdBuf);
+		m_scanPipeline->Dispatch(cmdBuf, args, xblocks, yblocks);
+		m_scanPipeline->AddComputeMemoryBarrier(cmdBuf);
+	}
+
+	args.mode = GpuParallelBusArgs::MODE_COUNT;
+	m_scanPipeline->Dispatch(cmdBuf, args, GetComputeBlockCount(numThreads, 64));
+
+	m_packed.MarkModifiedFromGpu();
+	m_counts.MarkModifiedFromGpu();
+
+	cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "parallel bus scan");
+		queue->SubmitAndBlock(cmdBuf);
+	}
+
+	//Turn the counts into the index of each thread's first cell
+	m_counts.PrepareForCpuAccess();
+	uint32_t numCells = 0;
+	for(size_t i=0; i<numThreads; i++)
+	{
+		uint32_t n = m_counts[i];
+		m_counts[i] = numCells;
+		numCells += n;
+	}
+	m_counts.MarkModifiedFromCpu();
+	cap->Resize(numCells);
+	args.numCells = numCells;
+
+	//Write out the cells
+	cmdBuf.begin({});
+
+	m_counts.PrepareForGpuAccessNonblocking(false, cmdBuf);
+	AcceleratorBuffer<uint32_t>::HostToDeviceTransferMemoryBarrier(cmdBuf);
+
+	m_compactPipeline->BindBufferNonblocking(0, m_packed, cmdBuf);
+	m_compactPipeline->BindBufferNonblocking(1, m_counts, cmdBuf);
+	m_compactPipeline->BindBufferNonblocking(2, cap->m_offsets, cmdBuf, true);
+	m_compactPipeline->BindBufferNonblocking(3, cap->m_durations, cmdBuf, true);
+	m_compactPipeline->BindBufferNonblocking(4, cap->m_samples, cmdBuf, true);
+
+	args.mode = GpuParallelBusArgs::MODE_COMPACT;
+	m_compactPipeline->Dispatch(cmdBuf, args, GetComputeBlockCount(numThreads, 64));
+	m_compactPipeline->AddComputeMemoryBarrier(cmdBuf);
+
+	xblocks = min<size_t>(GetComputeBlockCount(numCells, 64), PARALLEL_BUS_MAX_X_BLOCKS);
+	yblocks = GetComputeBlockCount(numCells, xblocks*64);
+	args.stride = xblocks*64;
+	args.mode = GpuParallelBusArgs::MODE_DURATION;
+	m_compactPipeline->Dispatch(cmdBuf, args, xblocks, yblocks);
+
+	cap->m_offsets.MarkModifiedFromGpu();
+	cap->m_durations.MarkModifiedFromGpu();
+	cap->m_samples.MarkModifiedFromGpu();
+
+	cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "parallel bus compact");
+		queue->SubmitAndBlock(cmdBuf);
+	}
+}
@@ -0,0 +1,127 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of GpuParallelBusFilter
+ */
+#ifndef GpuParallelBusFilter_h
+#define GpuParallelBusFilter_h
+
+///@brief Push constants for GpuParallelBusScan.glsl and GpuParallelBusCompact.glsl
+class GpuParallelBusArgs
+{
+public:
+	enum Mode
+	{
+		///@brief Set one bit of the packed bus value from an input lane
+		MODE_PACK,
+
+		///@brief Count value changes in each thread's range of samples
+		MODE_COUNT,
+
+		///@brief Write the start and value of each cell
+		MODE_COMPACT,
+
+		///@brief Fill in the duration of each cell from the start of the next
+		MODE_DURATION
+	};
+
+	uint32_t numSamples;
+	uint32_t stride;
+	uint32_t samplesPerThread;
+	uint32_t numThreads;
+	uint32_t numCells;
+	uint32_t mode;
+	uint32_t lane;
+};
+
+/**
+	@brief Parallel bus values, with text formatted on demand
+
+	Only the cells wide enough for a label ever have GetText() called on them, so decoding hundreds of millions of
+	samples doesn't mean formatting hundreds of millions of strings.
+ */
+class GpuParallelBusWaveform : public SparseWaveform<uint32_t>
+{
+public:
+	GpuParallelBusWaveform(size_t width)
+	: m_width(width)
+	{}
+
+	virtual std::string GetText(size_t i) override;
+	virtual std::string GetColor(size_t i) override;
+
+	///@brief Number of bits in the bus
+	size_t m_width;
+};
+
+/**
+	@brief Decodes a parallel bus from a set of logic analyzer channels, entirely on the GPU
+
+	The inputs are packed into one word per sample, one bit per lane (din0 is the LSB). Each thread then counts the
+	value changes in its range of samples, and after a prefix sum over the counts a second pass writes the start,
+	duration, and value of each cell to the output. The samples themselves never come back to the CPU.
+
+	The output is a protocol stream, so the narrow cells are drawn by the GPU protocol rasterizer and only the ones
+	wide enough to read get hex labels.
+ */
+class GpuParallelBusFilter : public Filter
+{
+public:
+	GpuParallelBusFilter(const std::string& color);
+
+	virtual void Refresh(vk::raii::CommandBuffer& cmdBuf, std::shared_ptr<QueueHandle> queue) override;
+	virtual DataLocation GetInputLocation() override;
+
+	static std::string GetProtocolName();
+
+	virtual bool ValidateChannel(size_t i, StreamDescriptor stream) override;
+
+	PROTOCOL_DECODER_INITPROC(GpuParallelBusFilter)
+
+protected:
+	void OnWidthChanged();
+
+	///@brief Name of the width parameter
+	std::string m_widthName;
+
+	///@brief One word per sample with every lane packed into it
+	AcceleratorBuffer<uint32_t> m_packed;
+
+	///@brief Number of cells found by each thread, then replaced by the index of its first cell
+	AcceleratorBuffer<uint32_t> m_counts;
+
+	std::shared_ptr<ComputePipeline> m_scanPipeline;
+	std::shared_ptr<ComputePipeline> m_compactPipeline;
+};
+
+#endif
@@ -0,0 +1,350 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of GpuReadback
+ */
+
+#include "ngscopeclient.h"
+#include "GpuReadback.h"
+#include "Session.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+GpuReadback::GpuReadback(Session& session)
+	: m_session(session)
+	, m_terminating(false)
+	, m_queue(g_vkQueueManager->GetComputeQueue("GpuReadback.queue"))
+	, m_pool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_pool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+	, m_indexes("GpuReadback.indexes")
+	, m_gathered("GpuReadback.gathered")
+{
+	m_gatherPipeline = make_shared<ComputePipeline>(
+		"shaders/GpuReadback.spv", 3, sizeof(GpuReadbackArgs));
+
+	m_indexes.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_indexes.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_gathered.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_gathered.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	m_thread = thread(&GpuReadback::WorkerThread, this);
+}
+
+GpuReadback::~GpuReadback()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_terminating = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	for(auto& it : m_slots)
+	{
+		if(it.second.m_pending && it.second.m_job.m_ref)
+			it.second.m_job.m_ref->Release();
+	}
+	ReleaseFinishedRefs();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GUI thread API
+
+/**
+	@brief Asks for some elements of the waveform currently in a stream
+
+	Replaces any request from the same owner which hasn't started yet.
+
+	@param owner	Identifies the caller, for GetResult() and Cancel()
+	@param stream	Stream to read from
+	@param source	Which buffer of the waveform to read
+	@param indexes	Elements to read
+	@param tag		Caller defined value returned with the result, e.g. describing what was asked for
+ */
+void GpuReadback::Request(
+	void* owner,
+	StreamDescriptor stream,
+	Source source,
+	const vector<uint32_t>& indexes,
+	uint64_t tag)
+{
+	auto data = stream.GetData();
+	if(!data || indexes.empty())
+		return;
+
+	//Hold filters so they can't be deleted until the job has checked the stream
+	auto f = dynamic_cast<Filter*>(stream.m_channel);
+	if(f)
+		f->AddRef();
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto& slot = m_slots[owner];
+		if(slot.m_pending && slot.m_job.m_ref)
+			m_finishedRefs.push_back(slot.m_job.m_ref);
+
+		slot.m_job.m_stream = stream;
+		slot.m_job.m_source = source;
+		slot.m_job.m_indexes = indexes;
+		slot.m_job.m_data = data;
+		slot.m_job.m_revision = data->m_revision;
+		slot.m_job.m_tag = tag;
+		slot.m_job.m_ref = f;
+		slot.m_pending = true;
+		slot.m_cancelled = false;
+	}
+	m_wake.notify_one();
+
+	ReleaseFinishedRefs();
+}
+
+/**
+	@brief Gets the result of the last completed request from an owner
+
+	@return True if a new result was available (each result is only returned once)
+ */
+bool GpuReadback::GetResult(void* owner, GpuReadbackResult& result)
+{
+	bool ret = false;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto it = m_slots.find(owner);
+		if( (it != m_slots.end()) && it->second.m_ready)
+		{
+			result = std::move(it->second.m_result);
+			it->second.m_ready = false;
+			ret = true;
+		}
+	}
+
+	ReleaseFinishedRefs();
+	return ret;
+}
+
+/**
+	@brief Discards any request or result from an owner, waiting for a job in progress to finish
+
+	Must be called before the owner is destroyed.
+ */
+void GpuReadback::Cancel(void* owner)
+{
+	{
+		unique_lock<mutex> lock(m_mutex);
+		auto it = m_slots.find(owner);
+		if(it != m_slots.end())
+		{
+			it->second.m_cancelled = true;
+			m_jobDone.wait(lock, [&]{ return !it->second.m_busy; });
+
+			if(it->second.m_pending && it->second.m_job.m_ref)
+				m_finishedRefs.push_back(it->second.m_job.m_ref);
+			m_slots.erase(it);
+		}
+	}
+
+	ReleaseFinishedRefs();
+}
+
+/**
+	@brief Drops references held by completed jobs
+
+	Releasing the last reference deletes a filter, which has to happen on the GUI thread.
+ */
+void GpuReadback::ReleaseFinishedRefs()
+{
+	vector<Filter*> refs;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		refs.swap(m_finishedRefs);
+	}
+	for(auto f : refs)
+		f->Release();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Worker thread
+
+void GpuReadback::WorkerThread()
+{
+	pthread_setname_np_compat("GpuReadback");
+
+	unique_lock<mutex> lock(m_mutex);
+	while(true)
+	{
+		//Find something to do
+		Slot* slot = nullptr;
+		for(auto& it : m_slots)
+		{
+			if(it.second.m_pending && !it.second.m_cancelled)
+			{
+				slot = &it.second;
+				break;
+			}
+		}
+		if(!slot)
+		{
+			if(m_terminating)
+				break;
+			m_wake.wait(lock);
+			continue;
+		}
+
+		Job job = std::move(slot->m_job);
+		slot->m_pending = false;
+		slot->m_busy = true;
+
+		//Don't hold our mutex while waiting on the GPU, the GUI thread may want to post more requests
+		lock.unlock();
+		GpuReadbackResult result;
+		bool ok = Gather(job, result);
+		lock.lock();
+
+		if(job.m_ref)
+			m_finishedRefs.push_back(job.m_ref);
+		slot->m_busy = false;
+		if(ok && !slot->m_cancelled)
+		{
+			slot->m_result = std::move(result);
+			slot->m_ready = true;
+		}
+		m_jobDone.notify_all();
+	}
+}
+
+/**
+	@brief Reads the elements for one job
+
+	@return False if the stream no longer has the waveform the request was made for, or an index is out of range
+ */
+bool GpuReadback::Gather(Job& job, GpuReadbackResult& result)
+{
+	//Hold off filter refreshes and history changes while we look at the waveform
+	shared_lock lock(m_session.GetWaveformDataMutex());
+
+	auto data = job.m_stream.GetData();
+	if( (data != job.m_data) || (data->m_revision != job.m_revision) )
+		return false;
+
+	result.m_data = data;
+	result.m_revision = job.m_revision;
+	result.m_tag = job.m_tag;
+
+	if(job.m_source == SOURCE_EYE_ACCUM)
+	{
+		auto eye = dynamic_cast<EyeWaveform*>(data);
+		if(eye)
+			return GatherFrom(eye->GetAccumBuffer(), job, result);
+	}
+	else
+	{
+		auto swfm = dynamic_cast<SparseAnalogWaveform*>(data);
+		auto uwfm = dynamic_cast<UniformAnalogWaveform*>(data);
+		if(swfm)
+			return GatherFrom(swfm->m_samples, job, result);
+		else if(uwfm)
+			return GatherFrom(uwfm->m_samples, job, result);
+	}
+
+	return false;
+}
+
+/**
+	@brief Reads the requested elements of one buffer
+
+	Called with the waveform data mutex held.
+ */
+template<class T>
+bool GpuReadback::GatherFrom(AcceleratorBuffer<T>& buf, Job& job, GpuReadbackResult& result)
+{
+	static_assert(sizeof(T) % sizeof(uint32_t) == 0, "elements must be a whole number of words");
+	const size_t wordsPerElement = sizeof(T) / sizeof(uint32_t);
+
+	size_t count = job.m_indexes.size();
+	for(auto i : job.m_indexes)
+	{
+		if(i >= buf.size())
+			return false;
+	}
+	result.m_words.resize(count * wordsPerElement);
+
+	//If the CPU copy is current, just copy out of it
+	if(buf.HasCpuBuffer() && !buf.IsCpuBufferStale())
+	{
+		auto p = buf.GetCpuPointer();
+		for(size_t i=0; i<count; i++)
+			memcpy(&result.m_words[i*wordsPerElement], &p[job.m_indexes[i]], sizeof(T));
+		return true;
+	}
+
+	//Otherwise gather on the GPU, so only the elements we want get copied back
+	GpuReadbackArgs args;
+	args.count = count;
+	args.wordsPerElement = wordsPerElement;
+
+	m_indexes.resize(count);
+	memcpy(m_indexes.GetCpuPointer(), job.m_indexes.data(), count * sizeof(uint32_t));
+	m_indexes.MarkModifiedFromCpu();
+	m_gathered.resize(count * wordsPerElement);
+
+	{
+		shared_lock lock(g_vulkanActivityMutex);
+
+		m_cmdBuf.reset();
+		m_cmdBuf.begin({});
+
+		m_indexes.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+		AcceleratorBuffer<uint32_t>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+		m_gatherPipeline->BindBufferNonblocking(0, m_gathered, m_cmdBuf, true);
+		m_gatherPipeline->BindBufferNonblocking(1, buf, m_cmdBuf);
+		m_gatherPipeline->BindBufferNonblocking(2, m_indexes, m_cmdBuf);
+		m_gatherPipeline->Dispatch(m_cmdBuf, args, GetComputeBlockCount(count, 64));
+		m_gathered.MarkModifiedFromGpu();
+
+		m_cmdBuf.end();
+		{
+			TRACE_ZONE("Vulkan submit", "readback");
+			m_queue->SubmitAndBlock(m_cmdBuf);
+		}
+	}
+
+	m_gathered.PrepareForCpuAccess();
+	memcpy(result.m_words.data(), m_gathered.GetCpuPointer(), result.m_words.size() * sizeof(uint32_t));
+	return true;
+}
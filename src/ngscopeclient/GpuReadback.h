@@ -0,0 +1,194 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of GpuReadback
+ */
+#ifndef GpuReadback_h
+#define GpuReadback_h
+
+#include <condition_variable>
+
+class Session;
+
+///@brief Push constants for GpuReadback.glsl
+class GpuReadbackArgs
+{
+public:
+	uint32_t count;
+	uint32_t wordsPerElement;
+};
+
+///@brief Values read back for one request
+class GpuReadbackResult
+{
+public:
+	GpuReadbackResult()
+		: m_data(nullptr)
+		, m_revision(0)
+		, m_tag(0)
+	{}
+
+	///@brief Waveform the values were read from
+	WaveformBase* m_data;
+
+	///@brief Revision of m_data the values were read from
+	uint64_t m_revision;
+
+	///@brief Caller defined tag passed to GpuReadback::Request()
+	uint64_t m_tag;
+
+	///@brief The requested elements, in the order they were asked for (each one wordsPerElement 32-bit words)
+	std::vector<uint32_t> m_words;
+};
+
+/**
+	@brief Reads a few elements out of a waveform without downloading the whole thing
+
+	Hover tooltips and similar displays often need a handful of values out of a buffer which lives on the GPU. Calling
+	PrepareForCpuAccess() on it from the GUI thread stalls the frame while the entire buffer is copied back, just to
+	look at a row of it.
+
+	Instead, the GUI thread posts a request naming the stream and the element indexes it wants, and carries on. A
+	worker thread checks the stream still has the same waveform, then either copies the elements directly (if the
+	CPU copy is current) or dispatches a tiny gather shader into a small buffer and reads that back. The caller polls
+	with GetResult() on later frames.
+
+	Each owner (typically a view) has a single slot: a new request replaces one which hasn't started yet, so a mouse
+	moving across a plot only ever has the latest position queued.
+ */
+class GpuReadback
+{
+public:
+	GpuReadback(Session& session);
+	~GpuReadback();
+
+	///@brief Which buffer of a waveform to read from
+	enum Source
+	{
+		///@brief m_samples of an analog waveform (float)
+		SOURCE_ANALOG_SAMPLES,
+
+		///@brief Integration buffer of an eye pattern (int64_t)
+		SOURCE_EYE_ACCUM
+	};
+
+	void Request(
+		void* owner,
+		StreamDescriptor stream,
+		Source source,
+		const std::vector<uint32_t>& indexes,
+		uint64_t tag);
+
+	bool GetResult(void* owner, GpuReadbackResult& result);
+	void Cancel(void* owner);
+
+protected:
+	void WorkerThread();
+	void ReleaseFinishedRefs();
+
+	///@brief A pending request
+	class Job
+	{
+	public:
+		StreamDescriptor m_stream;
+		Source m_source;
+		std::vector<uint32_t> m_indexes;
+
+		///@brief Waveform which was in the stream when the request was made
+		WaveformBase* m_data;
+		uint64_t m_revision;
+		uint64_t m_tag;
+
+		///@brief Reference held on m_stream's filter (if any) until the job is done
+		Filter* m_ref;
+	};
+
+	///@brief State for one owner
+	class Slot
+	{
+	public:
+		Slot()
+			: m_pending(false)
+			, m_busy(false)
+			, m_ready(false)
+			, m_cancelled(false)
+		{}
+
+		Job m_job;
+		bool m_pending;
+		bool m_busy;
+		bool m_ready;
+		bool m_cancelled;
+		GpuReadbackResult m_result;
+	};
+
+	bool Gather(Job& job, GpuReadbackResult& result);
+
+	template<class T>
+	bool GatherFrom(AcceleratorBuffer<T>& buf, Job& job, GpuReadbackResult& result);
+
+	///@brief The session we're reading waveforms from
+	Session& m_session;
+
+	///@brief Guards m_slots and m_finishedRefs
+	std::mutex m_mutex;
+
+	///@brief Signalled when there's new work, or we're shutting down
+	std::condition_variable m_wake;
+
+	///@brief Signalled when a job completes
+	std::condition_variable m_jobDone;
+
+	///@brief Per owner state
+	std::map<void*, Slot> m_slots;
+
+	///@brief Filter references from completed jobs, to be released on the GUI thread
+	std::vector<Filter*> m_finishedRefs;
+
+	///@brief Set to stop the worker thread
+	bool m_terminating;
+
+	std::shared_ptr<QueueHandle> m_queue;
+	vk::raii::CommandPool m_pool;
+	vk::raii::CommandBuffer m_cmdBuf;
+	std::shared_ptr<ComputePipeline> m_gatherPipeline;
+
+	///@brief Indexes of the elements being gathered
+	AcceleratorBuffer<uint32_t> m_indexes;
+
+	///@brief Gathered elements
+	AcceleratorBuffer<uint32_t> m_gathered;
+
+	std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of GpuTimer
+ */
+#include "ngscopeclient.h"
+#include "GpuTimer.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a timer for command buffers submitted to a given queue family
+
+	@param queueFamily	Queue family the timed command buffers will run on
+	@param name			Name for debug tools
+	@param maxSpans		Maximum number of spans timed per command buffer (any beyond this are ignored)
+ */
+GpuTimer::GpuTimer(uint32_t queueFamily, const string& name, size_t maxSpans)
+	: m_maxSpans(maxSpans)
+	, m_period(1)
+	, m_validMask(0)
+{
+	auto families = g_vkComputePhysicalDevice->getQueueFamilyProperties();
+	if(queueFamily >= families.size())
+		return;
+	uint32_t validBits = families[queueFamily].timestampValidBits;
+	if(validBits == 0)
+	{
+		LogDebug("Queue family %u does not support timestamps, GPU timing unavailable\n", queueFamily);
+		return;
+	}
+	m_validMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+	m_period = g_vkComputePhysicalDevice->getProperties().limits.timestampPeriod;
+
+	vk::QueryPoolCreateInfo info({}, vk::QueryType::eTimestamp, 2*m_maxSpans);
+	m_pool = make_unique<vk::raii::QueryPool>(*g_vkComputeDevice, info);
+
+	if(g_hasDebugUtils)
+	{
+		string poolName = name + ".queryPool";
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eQueryPool,
+				reinterpret_cast<uint64_t>(static_cast<VkQueryPool>(**m_pool)),
+				poolName.c_str()));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Recording
+
+/**
+	@brief Records a reset of all queries and forgets previous spans. Must be called before Begin().
+ */
+void GpuTimer::Reset(vk::raii::CommandBuffer& cmdbuf)
+{
+	m_labels.clear();
+	if(m_pool)
+		cmdbuf.resetQueryPool(**m_pool, 0, 2*m_maxSpans);
+}
+
+/**
+	@brief Records a timestamp at the start of a span
+
+	An execution barrier is recorded first, so the span doesn't overlap with (and get billed for) any work still
+	running from before it. This changes scheduling, so timers should only be used while profiling.
+
+	@return Span index to pass to End()
+ */
+size_t GpuTimer::Begin(vk::raii::CommandBuffer& cmdbuf, const string& channel, const string& shader)
+{
+	size_t span = m_labels.size();
+	if(!m_pool || (span >= m_maxSpans) )
+		return SIZE_MAX;
+
+	m_labels.push_back(pair<string, string>(channel, shader));
+	cmdbuf.pipelineBarrier(
+		vk::PipelineStageFlagBits::eAllCommands,
+		vk::PipelineStageFlagBits::eAllCommands,
+		{},
+		{},
+		{},
+		{});
+	cmdbuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, **m_pool, 2*span);
+	return span;
+}
+
+/**
+	@brief Records a timestamp at the end of a span
+ */
+void GpuTimer::End(vk::raii::CommandBuffer& cmdbuf, size_t span)
+{
+	if(!m_pool || (span >= m_labels.size()) )
+		return;
+	cmdbuf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, **m_pool, 2*span + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Readout
+
+/**
+	@brief Reads back the timestamps of the last recorded command buffer
+
+	The command buffer must have finished executing.
+
+	@param timings	Output list of spans, in the order they were recorded
+
+	@return True if any spans were read
+ */
+bool GpuTimer::Resolve(vector<GpuTiming>& timings)
+{
+	timings.clear();
+	if(!m_pool || m_labels.empty())
+		return false;
+
+	size_t nqueries = 2*m_labels.size();
+	auto result = m_pool->getResults<uint64_t>(
+		0,
+		nqueries,
+		nqueries * sizeof(uint64_t),
+		sizeof(uint64_t),
+		vk::QueryResultFlagBits::e64);
+	if(result.first != vk::Result::eSuccess)
+		return false;
+
+	auto& stamps = result.second;
+	for(size_t i=0; i<m_labels.size(); i++)
+	{
+		uint64_t ticks = (stamps[2*i + 1] - stamps[2*i]) & m_validMask;
+
+		GpuTiming t;
+		t.m_channel = m_labels[i].first;
+		t.m_shader = m_labels[i].second;
+		t.m_time = llround(ticks * m_period * 1e6);
+		timings.push_back(t);
+	}
+	return true;
+}
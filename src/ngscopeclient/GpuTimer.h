@@ -0,0 +1,98 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of GpuTimer
+ */
+#ifndef GpuTimer_h
+#define GpuTimer_h
+
+/**
+	@brief GPU execution time of one labeled span of a command buffer
+ */
+class GpuTiming
+{
+public:
+	///@brief Name of the channel the work was for
+	std::string m_channel;
+
+	///@brief Name of the shader (or other operation) being timed
+	std::string m_shader;
+
+	///@brief Execution time, in fs
+	int64_t m_time;
+};
+
+/**
+	@brief Measures how long labeled spans of a command buffer take to execute on the GPU
+
+	Timestamp queries are written before and after each span. Once the command buffer has completed, Resolve()
+	turns them into a list of per-span execution times.
+
+	Each span is serialized against the work recorded before it, so the measured times add up rather than
+	overlapping.
+ */
+class GpuTimer
+{
+public:
+	GpuTimer(uint32_t queueFamily, const std::string& name, size_t maxSpans = 256);
+
+	GpuTimer(const GpuTimer&) =delete;
+	GpuTimer& operator=(const GpuTimer&) =delete;
+
+	///@brief Checks if the queue family supports timestamps at all
+	bool IsAvailable()
+	{ return m_pool != nullptr; }
+
+	void Reset(vk::raii::CommandBuffer& cmdbuf);
+	size_t Begin(vk::raii::CommandBuffer& cmdbuf, const std::string& channel, const std::string& shader);
+	void End(vk::raii::CommandBuffer& cmdbuf, size_t span);
+
+	bool Resolve(std::vector<GpuTiming>& timings);
+
+protected:
+	///@brief Query pool holding two timestamps per span
+	std::unique_ptr<vk::raii::QueryPool> m_pool;
+
+	///@brief Maximum number of spans per command buffer
+	size_t m_maxSpans;
+
+	///@brief Labels of the spans recorded since the last Reset()
+	std::vector< std::pair<std::string, std::string> > m_labels;
+
+	///@brief Nanoseconds per timestamp tick
+	double m_period;
+
+	///@brief Mask of valid timestamp bits
+	uint64_t m_validMask;
+};
+
+#endif
@@ -37,11 +37,40 @@
 
 using namespace std;
 
+///@brief Text of a line which hasn't had its newline logged yet (per thread, so threads don't mix their output)
+static thread_local string g_unbufferedLine;
+
+///@brief Scratch buffer for formatting messages without a heap allocation per call
+static thread_local vector<char> g_formatBuffer;
+
+/**
+	@brief Rounds up to the next power of two
+ */
+static size_t RoundUpToPowerOfTwo(size_t n)
+{
+	size_t ret = 1;
+	while(ret < n)
+		ret <<= 1;
+	return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
-GuiLogSink::GuiLogSink(Severity min_severity)
+/**
+	@brief Creates the sink
+
+	@param min_severity		Least important severity to keep
+	@param lineCapacity		Number of lines to keep before the oldest are overwritten (rounded up to a power of two)
+	@param arenaSize		Bytes of message text to keep (rounded up to a power of two)
+ */
+GuiLogSink::GuiLogSink(Severity min_severity, size_t lineCapacity, size_t arenaSize)
 	: LogSink(min_severity)
+	, m_slots(RoundUpToPowerOfTwo(lineCapacity))
+	, m_head(0)
+	, m_clearSeq(0)
+	, m_arena(RoundUpToPowerOfTwo(arenaSize))
+	, m_arenaHead(0)
 {
 
 }
@@ -50,12 +79,123 @@ GuiLogSink::~GuiLogSink()
 {
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Readout
+
+/**
+	@brief Gets the sequence number of the oldest line still available
+ */
+uint64_t GuiLogSink::GetTailSequence()
+{
+	uint64_t head = GetHeadSequence();
+	uint64_t tail = (head > m_slots.size()) ? (head - m_slots.size()) : 0;
+	return max(tail, m_clearSeq.load(memory_order_acquire));
+}
+
+/**
+	@brief Copies a line out of the ring buffer
+
+	@param seq		Sequence number of the line
+	@param line		Output line
+
+	@return	True on success, false if the line has been overwritten or cleared, or hasn't been fully written yet
+ */
+bool GuiLogSink::GetLine(uint64_t seq, LogLine& line)
+{
+	if(seq < m_clearSeq.load(memory_order_acquire))
+		return false;
+
+	auto& slot = m_slots[seq & (m_slots.size() - 1)];
+	if(slot.m_seq.load(memory_order_acquire) != seq+1)
+		return false;
+
+	line.m_sev = slot.m_sev;
+	line.m_timestamp = slot.m_timestamp;
+	uint64_t off = slot.m_arenaOffset;
+	size_t len = slot.m_len;
+
+	size_t mask = m_arena.size() - 1;
+	size_t start = off & mask;
+	size_t first = min(len, m_arena.size() - start);
+	line.m_msg.assign(&m_arena[start], first);
+	if(first < len)
+		line.m_msg.append(&m_arena[0], len - first);
+
+	//Make sure nobody started overwriting the slot or the text while we were copying
+	atomic_thread_fence(memory_order_acquire);
+	if(slot.m_seq.load(memory_order_relaxed) != seq+1)
+		return false;
+	if(m_arenaHead.load(memory_order_relaxed) - off > m_arena.size())
+		return false;
+
+	return true;
+}
+
+/**
+	@brief Checks if a line has been reserved by a writer which hasn't finished writing it yet
+
+	GetLine() fails for both pending lines and lines which have been lost, this tells the two apart.
+ */
+bool GuiLogSink::IsLinePending(uint64_t seq)
+{
+	if(seq < GetTailSequence())
+		return false;
+
+	//Slot is still empty, mid-write, or holds the line from a lap ago
+	auto& slot = m_slots[seq & (m_slots.size() - 1)];
+	return slot.m_seq.load(memory_order_acquire) < seq+1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Logging
 
+/**
+	@brief Discards all lines logged so far
+ */
 void GuiLogSink::Clear()
 {
-	m_lines.clear();
+	m_clearSeq = GetHeadSequence();
+}
+
+/**
+	@brief Appends one line to the ring buffer
+
+	@param severity		Severity of the line
+	@param parts		Pieces of text to concatenate into the line
+ */
+void GuiLogSink::LogLineInternal(Severity severity, initializer_list<string_view> parts)
+{
+	//Truncate anything absurdly long so one line can't wipe out the whole arena
+	size_t maxLen = m_arena.size() / 16;
+	size_t len = 0;
+	for(auto& p : parts)
+		len += p.size();
+	len = min(len, maxLen);
+
+	//Reserve space for the line and its text
+	uint64_t seq = m_head.fetch_add(1, memory_order_acq_rel);
+	uint64_t off = m_arenaHead.fetch_add(len, memory_order_acq_rel);
+
+	//Invalidate the slot before we start touching it, so readers don't see a half updated line
+	auto& slot = m_slots[seq & (m_slots.size() - 1)];
+	slot.m_seq.store(0, memory_order_release);
+	atomic_thread_fence(memory_order_release);
+
+	size_t mask = m_arena.size() - 1;
+	size_t done = 0;
+	for(auto& p : parts)
+	{
+		for(size_t i=0; (i < p.size()) && (done < len); i++, done++)
+			m_arena[(off + done) & mask] = p[i];
+	}
+
+	slot.m_sev = severity;
+	slot.m_timestamp = TimePoint(GetTime());
+	slot.m_arenaOffset = off;
+	slot.m_len = len;
+
+	//Publish
+	slot.m_seq.store(seq+1, memory_order_release);
 }
 
 void GuiLogSink::Log(Severity severity, const string &msg)
@@ -63,51 +203,65 @@ void GuiLogSink::Log(Severity severity, const string &msg)
 	if(severity > m_min_severity)
 		return;
 
+	LogText(severity, msg);
+}
+
+/**
+	@brief Splits a message into lines and appends them to the ring buffer
+ */
+void GuiLogSink::LogText(Severity severity, string_view msg)
+{
 	//Blank lines get special handling
 	if(msg == "\n")
 	{
-		m_lines.push_back(LogLine(severity, ""));
+		LogLineInternal(severity, {});
 		return;
 	}
 
 	auto indent = GetIndentString();
 
 	//No newline? Append to existing buffer
-	if(msg.find('\n') == string::npos)
+	if(msg.find('\n') == string_view::npos)
 	{
-		if(m_unbufferedLine.empty())
-			m_unbufferedLine += indent;
-		m_unbufferedLine += msg;
+		if(g_unbufferedLine.empty())
+			g_unbufferedLine += indent;
+		g_unbufferedLine += msg;
 		return;
 	}
 
-	//One or more newlines? Split and process it
-	auto vec = explode(msg, '\n');
-	auto len = vec.size();
-	for(size_t i=0; i<len; i++)
+	//One or more newlines? Split and process it in place
+	string_view remaining = msg;
+	while(true)
 	{
+		auto pos = remaining.find('\n');
+		bool last = (pos == string_view::npos);
+		string_view line = remaining.substr(0, pos);
+
+		//Blank line at end of buffer? Special handling
+		if(last && line.empty())
+			break;
+
 		//Remove the ERROR or Warning text inserted by logtools
 		//TODO: we should change logtools to make this message be inserted by the sink to avoid this!
-		string line = vec[i];
 		if(severity == Severity::ERROR)
-			line = line.substr(7);
+			line.remove_prefix(min(line.size(), (size_t)7));
 		else if(severity == Severity::WARNING)
-			line = line.substr(9);
-
-		//Blank line at end of buffer? Special handling
-		if( (i+1 == len) && line.empty())
-			break;
+			line.remove_prefix(min(line.size(), (size_t)9));
 
 		//If unbuffered line is present, append to it
-		if(!m_unbufferedLine.empty())
+		if(!g_unbufferedLine.empty())
 		{
-			m_lines.push_back(LogLine(severity, m_unbufferedLine + line));
-			m_unbufferedLine = "";
+			LogLineInternal(severity, {g_unbufferedLine, line});
+			g_unbufferedLine.clear();
 		}
 
 		//Otherwise append it
 		else
-			m_lines.push_back(LogLine(severity, indent + line));
+			LogLineInternal(severity, {indent, line});
+
+		if(last)
+			break;
+		remaining.remove_prefix(pos + 1);
 	}
 }
 
@@ -116,5 +270,24 @@ void GuiLogSink::Log(Severity severity, const char *format, va_list va)
 	if(severity > m_min_severity)
 		return;
 
-	Log(severity, vstrprintf(format, va));
+	if(g_formatBuffer.empty())
+		g_formatBuffer.resize(1024);
+
+	//Try formatting into the scratch buffer, and grow it if the message didn't fit
+	va_list va2;
+	va_copy(va2, va);
+	int len = vsnprintf(&g_formatBuffer[0], g_formatBuffer.size(), format, va);
+	if(len < 0)
+	{
+		va_end(va2);
+		return;
+	}
+	if((size_t)len >= g_formatBuffer.size())
+	{
+		g_formatBuffer.resize(len + 1);
+		vsnprintf(&g_formatBuffer[0], g_formatBuffer.size(), format, va2);
+	}
+	va_end(va2);
+
+	LogText(severity, string_view(&g_formatBuffer[0], len));
 }
@@ -38,15 +38,13 @@
 #include "Marker.h"
 
 /**
-	@brief A single line of the log
+	@brief A single line of the log, as copied out of the GuiLogSink
  */
 class LogLine
 {
 public:
-	LogLine(Severity sev, const std::string& str)
-		: m_sev(sev)
-		, m_msg(str)
-		, m_timestamp(GetTime())
+	LogLine()
+		: m_sev(Severity::DEBUG)
 	{
 	}
 
@@ -55,27 +53,85 @@ public:
 	TimePoint m_timestamp;
 };
 
+/**
+	@brief Slot in the GuiLogSink ring buffer
+
+	The message text lives in the sink's string arena, only its position is stored here.
+ */
+class LogSlot
+{
+public:
+	LogSlot()
+		: m_seq(0)
+		, m_sev(Severity::DEBUG)
+		, m_arenaOffset(0)
+		, m_len(0)
+	{
+	}
+
+	///@brief One plus the sequence number of the line in this slot (0 if empty or being written)
+	std::atomic<uint64_t> m_seq;
+
+	Severity m_sev;
+	TimePoint m_timestamp;
+
+	///@brief Position of the message in the arena (not wrapped to the arena size)
+	uint64_t m_arenaOffset;
+
+	///@brief Length of the message in bytes
+	uint32_t m_len;
+};
+
 /**
 	@brief Log sink for displaying logs in the GUI
+
+	Lines are kept in a fixed-capacity ring buffer with a separate ring of character storage, so memory use is bounded
+	no matter how much gets logged. Any thread may log without taking a lock: writers reserve a slot and arena space
+	with atomic increments, and readers validate each line after copying it out in case it was overwritten meanwhile.
+
+	Lines are identified by a sequence number which increases by one per line for the life of the sink.
  */
 class GuiLogSink : public LogSink
 {
 public:
-	GuiLogSink(Severity min_severity = Severity::DEBUG);
+	GuiLogSink(Severity min_severity = Severity::DEBUG, size_t lineCapacity = 65536, size_t arenaSize = 16*1024*1024);
 	virtual ~GuiLogSink() override;
 
+	GuiLogSink(const GuiLogSink&) =delete;
+	GuiLogSink& operator=(const GuiLogSink&) =delete;
+
 	void Clear();
 
 	void Log(Severity severity, const std::string &msg) override;
 	void Log(Severity severity, const char *format, va_list va) override;
 
-	const std::vector<LogLine>& GetLines()
-	{ return m_lines; }
+	///@brief Gets one past the sequence number of the most recently started line
+	uint64_t GetHeadSequence()
+	{ return m_head.load(std::memory_order_acquire); }
+
+	uint64_t GetTailSequence();
+
+	bool GetLine(uint64_t seq, LogLine& line);
+	bool IsLinePending(uint64_t seq);
 
 protected:
-	std::vector<LogLine> m_lines;
+	void LogText(Severity severity, std::string_view msg);
+	void LogLineInternal(Severity severity, std::initializer_list<std::string_view> parts);
+
+	///@brief Ring of line slots (size is a power of two)
+	std::vector<LogSlot> m_slots;
+
+	///@brief Sequence number of the next line to be written
+	std::atomic<uint64_t> m_head;
+
+	///@brief Lines before this were removed by Clear()
+	std::atomic<uint64_t> m_clearSeq;
+
+	///@brief Ring of message text (size is a power of two)
+	std::vector<char> m_arena;
 
-	std::string m_unbufferedLine;
+	///@brief Total number of bytes ever reserved in the arena
+	std::atomic<uint64_t> m_arenaHead;
 };
 
 #endif
@@ -0,0 +1,343 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HistoryCompactor
+ */
+
+#include "ngscopeclient.h"
+#include "HistoryCompactor.h"
+#include "TaskPool.h"
+
+using namespace std;
+
+///@brief Samples handled by one task when scanning or converting on the CPU
+#define COMPACT_BLOCK_SIZE (1024 * 1024)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistoryCompactor::HistoryCompactor(TaskPool& pool)
+	: m_pool(pool)
+	, m_queue(g_vkQueueManager->GetComputeQueue("HistoryCompactor.queue"))
+	, m_cmdPool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_cmdPool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+{
+	if(g_hasShaderInt8)
+	{
+		m_convert8Pipeline = make_unique<ComputePipeline>(
+			"shaders/Convert8BitSamples.spv", 2, sizeof(ConvertRawSamplesShaderArgs));
+	}
+	if(g_hasShaderInt16)
+	{
+		m_convert16Pipeline = make_unique<ComputePipeline>(
+			"shaders/Convert16BitSamples.spv", 2, sizeof(ConvertRawSamplesShaderArgs));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compaction
+
+/**
+	@brief Finds the grid of ADC levels a waveform's samples lie on
+
+	This only estimates the grid; it doesn't check that every sample is actually on it.
+
+	@param pool		Thread pool to scan the waveform with
+	@param wfm		The waveform
+	@param vmin		Set to the lowest sample value
+	@param step		Set to the spacing between levels
+	@param levels	Set to the number of levels from vmin to the highest sample value
+
+	@return False if the samples span too many levels to fit in 16 bit codes
+ */
+bool HistoryCompactor::FindGrid(TaskPool& pool, UniformAnalogWaveform* wfm, float& vmin, float& step, size_t& levels)
+{
+	size_t len = wfm->size();
+	size_t nblocks = (len + COMPACT_BLOCK_SIZE - 1) / COMPACT_BLOCK_SIZE;
+	vector<float> mins(nblocks, FLT_MAX);
+	vector<float> maxes(nblocks, -FLT_MAX);
+	vector<float> steps(nblocks, FLT_MAX);
+
+	//Blocks overlap by one sample so the step across each boundary is counted too
+	float* samples = wfm->m_samples.GetCpuPointer();
+	pool.ParallelFor(0, nblocks, 1, [&](int64_t i)
+		{
+			size_t start = i * COMPACT_BLOCK_SIZE;
+			size_t end = min(len, start + COMPACT_BLOCK_SIZE + 1);
+			float lo = samples[start];
+			float hi = samples[start];
+			float minStep = FLT_MAX;
+			for(size_t j=start+1; j<end; j++)
+			{
+				float v = samples[j];
+				lo = min(lo, v);
+				hi = max(hi, v);
+				float delta = fabs(v - samples[j-1]);
+				if(delta > 0)
+					minStep = min(minStep, delta);
+			}
+			mins[i] = lo;
+			maxes[i] = hi;
+			steps[i] = minStep;
+		});
+
+	vmin = *min_element(mins.begin(), mins.end());
+	float vmax = *max_element(maxes.begin(), maxes.end());
+	float roughStep = *min_element(steps.begin(), steps.end());
+
+	//Flat line
+	if(roughStep == FLT_MAX)
+	{
+		step = 1;
+		levels = 1;
+		return true;
+	}
+
+	//The smallest step is off by the rounding of the two samples it came from, which adds up over thousands of
+	//levels. Steps between samples closest to zero are rounded the least, so measure the LSB there instead.
+	vector<float> bestMagnitudes(nblocks, FLT_MAX);
+	vector<float> bestSteps(nblocks, roughStep);
+	pool.ParallelFor(0, nblocks, 1, [&](int64_t i)
+		{
+			size_t start = i * COMPACT_BLOCK_SIZE;
+			size_t end = min(len, start + COMPACT_BLOCK_SIZE + 1);
+			for(size_t j=start+1; j<end; j++)
+			{
+				float delta = fabs(samples[j] - samples[j-1]);
+				if( (delta < 0.5f * roughStep) || (delta > 1.5f * roughStep) )
+					continue;
+				float magnitude = max(fabs(samples[j]), fabs(samples[j-1]));
+				if(magnitude < bestMagnitudes[i])
+				{
+					bestMagnitudes[i] = magnitude;
+					bestSteps[i] = delta;
+				}
+			}
+		});
+	step = bestSteps[min_element(bestMagnitudes.begin(), bestMagnitudes.end()) - bestMagnitudes.begin()];
+
+	double span = (double(vmax) - vmin) / step;
+	if(span >= 65536)
+		return false;
+	levels = llround(span) + 1;
+	if(levels > 65536)
+		return false;
+
+	//Both extremes are on the grid, so they give the most precise spacing of all
+	if(levels > 1)
+		step = (double(vmax) - vmin) / (levels - 1);
+	return true;
+}
+
+/**
+	@brief Converts a waveform's samples to integer codes, if they're all on a grid of ADC levels
+
+	On success, the waveform's float samples are freed. The caller must set the memory tier of the code buffers first.
+
+	@param wfm		The waveform
+	@param compact	Set to the codes
+
+	@return True if the waveform was compacted
+ */
+bool HistoryCompactor::Compact(UniformAnalogWaveform* wfm, CompactSamples& compact)
+{
+	size_t len = wfm->size();
+	if(len == 0)
+		return false;
+
+	wfm->PrepareForCpuAccess();
+
+	float vmin;
+	float step;
+	size_t levels;
+	if(!FindGrid(m_pool, wfm, vmin, step, levels))
+		return false;
+
+	//Center the codes on zero like a bipolar ADC, so code * gain - offset lands back on the sample
+	compact.m_size = len;
+	compact.m_wide = (levels > 256);
+	int32_t base = compact.m_wide ? -32768 : -128;
+	int32_t top = base + levels - 1;
+	compact.m_gain = step;
+	compact.m_offset = base * step - vmin;
+
+	if(compact.m_wide)
+		compact.m_codes16.resize(len);
+	else
+		compact.m_codes8.resize(len);
+	compact.m_codes8.PrepareForCpuAccess();
+	compact.m_codes16.PrepareForCpuAccess();
+
+	//Anything further from its level than this isn't ADC data
+	float tolerance = step * 0.01f;
+
+	float* samples = wfm->m_samples.GetCpuPointer();
+	int8_t* codes8 = compact.m_codes8.GetCpuPointer();
+	int16_t* codes16 = compact.m_codes16.GetCpuPointer();
+	size_t nblocks = (len + COMPACT_BLOCK_SIZE - 1) / COMPACT_BLOCK_SIZE;
+	atomic<bool> ok(true);
+	m_pool.ParallelFor(0, nblocks, 1, [&](int64_t i)
+		{
+			size_t start = i * COMPACT_BLOCK_SIZE;
+			size_t end = min(len, start + COMPACT_BLOCK_SIZE);
+			for(size_t j=start; (j<end) && ok; j++)
+			{
+				int32_t code = lrintf((samples[j] - vmin) / step) + base;
+				if( (code > top) || (fabs(code * compact.m_gain - compact.m_offset - samples[j]) > tolerance) )
+				{
+					ok = false;
+					break;
+				}
+
+				if(compact.m_wide)
+					codes16[j] = code;
+				else
+					codes8[j] = code;
+			}
+		});
+
+	if(!ok)
+	{
+		compact.m_codes8.clear();
+		compact.m_codes16.clear();
+		compact.m_codes8.shrink_to_fit();
+		compact.m_codes16.shrink_to_fit();
+		return false;
+	}
+
+	compact.m_codes8.MarkModifiedFromCpu();
+	compact.m_codes16.MarkModifiedFromCpu();
+
+	wfm->m_samples.clear();
+	wfm->m_samples.shrink_to_fit();
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Expansion
+
+/**
+	@brief Converts a compacted waveform back to float samples, and frees the codes
+
+	@param wfm		The waveform the codes were made from
+	@param compact	The codes
+	@param gpu		True if the waveform is in GPU-accessible memory, so the conversion can be done by a shader
+ */
+void HistoryCompactor::Expand(UniformAnalogWaveform* wfm, CompactSamples& compact, bool gpu)
+{
+	wfm->Resize(compact.m_size);
+
+	if(!gpu || !ExpandGpu(wfm, compact))
+	{
+		compact.m_codes8.PrepareForCpuAccess();
+		compact.m_codes16.PrepareForCpuAccess();
+		wfm->PrepareForCpuAccess();
+
+		float* samples = wfm->m_samples.GetCpuPointer();
+		int8_t* codes8 = compact.m_codes8.GetCpuPointer();
+		int16_t* codes16 = compact.m_codes16.GetCpuPointer();
+		size_t nblocks = (compact.m_size + COMPACT_BLOCK_SIZE - 1) / COMPACT_BLOCK_SIZE;
+		m_pool.ParallelFor(0, nblocks, 1, [&](int64_t i)
+			{
+				size_t start = i * COMPACT_BLOCK_SIZE;
+				size_t count = min(compact.m_size - start, (size_t)COMPACT_BLOCK_SIZE);
+				if(compact.m_wide)
+				{
+					Oscilloscope::Convert16BitSamples(
+						samples + start, codes16 + start, compact.m_gain, compact.m_offset, count);
+				}
+				else
+				{
+					Oscilloscope::Convert8BitSamples(
+						samples + start, codes8 + start, compact.m_gain, compact.m_offset, count);
+				}
+			});
+		wfm->MarkModifiedFromCpu();
+	}
+
+	compact.m_codes8.clear();
+	compact.m_codes16.clear();
+	compact.m_codes8.shrink_to_fit();
+	compact.m_codes16.shrink_to_fit();
+}
+
+/**
+	@brief Converts codes back to float samples with the raw sample conversion shaders
+
+	@return False if the GPU can't do the conversion, in which case nothing was changed
+ */
+bool HistoryCompactor::ExpandGpu(UniformAnalogWaveform* wfm, CompactSamples& compact)
+{
+	//The shaders are dispatched as a 1D grid, so very deep waveforms may exceed the device limits
+	auto& pipe = compact.m_wide ? m_convert16Pipeline : m_convert8Pipeline;
+	auto maxBlocks = g_vkComputePhysicalDevice->getProperties().limits.maxComputeWorkGroupCount[0];
+	if(!pipe || (GetComputeBlockCount(compact.m_size, 64) > maxBlocks))
+		return false;
+
+	ConvertRawSamplesShaderArgs args;
+	args.size = compact.m_size;
+	args.gain = compact.m_gain;
+	args.offset = compact.m_offset;
+
+	shared_lock lock(g_vulkanActivityMutex);
+
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	if(compact.m_wide)
+	{
+		compact.m_codes16.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+		AcceleratorBuffer<int16_t>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+		pipe->BindBufferNonblocking(0, wfm->m_samples, m_cmdBuf, true);
+		pipe->BindBufferNonblocking(1, compact.m_codes16, m_cmdBuf);
+	}
+	else
+	{
+		compact.m_codes8.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+		AcceleratorBuffer<int8_t>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+		pipe->BindBufferNonblocking(0, wfm->m_samples, m_cmdBuf, true);
+		pipe->BindBufferNonblocking(1, compact.m_codes8, m_cmdBuf);
+	}
+	pipe->Dispatch(m_cmdBuf, args, GetComputeBlockCount(compact.m_size, 64));
+	wfm->m_samples.MarkModifiedFromGpu();
+
+	m_cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "history expand");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+	return true;
+}
@@ -0,0 +1,108 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HistoryCompactor
+ */
+#ifndef HistoryCompactor_h
+#define HistoryCompactor_h
+
+class TaskPool;
+
+/**
+	@brief Samples of an analog waveform stored as ADC codes plus a gain and offset
+
+	Each sample expands to code * m_gain - m_offset, the same as the raw sample conversion primitives.
+ */
+class CompactSamples
+{
+public:
+	CompactSamples()
+	: m_size(0)
+	, m_wide(false)
+	, m_gain(1)
+	, m_offset(0)
+	, m_codes8("CompactSamples.codes8")
+	, m_codes16("CompactSamples.codes16")
+	{}
+
+	///@brief Gets the number of bytes of codes stored
+	size_t GetMemoryUsage()
+	{ return m_wide ? (m_size * sizeof(int16_t)) : (m_size * sizeof(int8_t)); }
+
+	///@brief Number of samples
+	size_t m_size;
+
+	///@brief True if the codes are in m_codes16, false if they're in m_codes8
+	bool m_wide;
+
+	float m_gain;
+	float m_offset;
+
+	AcceleratorBuffer<int8_t> m_codes8;
+	AcceleratorBuffer<int16_t> m_codes16;
+};
+
+/**
+	@brief Converts history waveforms between float samples and their native integer width
+
+	Drivers convert ADC codes to float as soon as they're downloaded, so the codes have to be recovered from the
+	float samples. A waveform is only compacted if every sample lies exactly (to within float rounding) on a grid of at
+	most 65536 levels. The grid spacing is taken from the smallest step between adjacent samples, which for real ADC
+	data is one LSB. Anything else (e.g. averaged or interpolated data) is left as float.
+
+	Expansion goes through the Convert8BitSamples / Convert16BitSamples shaders once the waveform is back in GPU
+	memory, or the equivalent CPU conversion otherwise.
+ */
+class HistoryCompactor
+{
+public:
+	HistoryCompactor(TaskPool& pool);
+
+	bool Compact(UniformAnalogWaveform* wfm, CompactSamples& compact);
+	void Expand(UniformAnalogWaveform* wfm, CompactSamples& compact, bool gpu);
+
+	static bool FindGrid(TaskPool& pool, UniformAnalogWaveform* wfm, float& vmin, float& step, size_t& levels);
+
+protected:
+	bool ExpandGpu(UniformAnalogWaveform* wfm, CompactSamples& compact);
+
+	TaskPool& m_pool;
+
+	//Vulkan processing queues etc
+	std::shared_ptr<QueueHandle> m_queue;
+	vk::raii::CommandPool m_cmdPool;
+	vk::raii::CommandBuffer m_cmdBuf;
+	std::unique_ptr<ComputePipeline> m_convert8Pipeline;
+	std::unique_ptr<ComputePipeline> m_convert16Pipeline;
+};
+
+#endif
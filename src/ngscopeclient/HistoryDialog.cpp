@@ -36,6 +36,10 @@
 #include "ngscopeclient.h"
 #include "HistoryDialog.h"
 #include "MainWindow.h"
+#include "FileBrowser.h"
+#include "ReferenceComparer.h"
+
+#include <cinttypes>
 
 using namespace std;
 
@@ -83,7 +87,14 @@ HistoryDialog::HistoryDialog(HistoryManager& mgr, Session& session, MainWindow&
 	, m_parent(wnd)
 	, m_rowHeight(0)
 	, m_selectionChanged(false)
+	, m_waitingForLoad(false)
 	, m_selectedMarker(nullptr)
+	, m_rowsHistoryRevision(0)
+	, m_rowsMarkerRevision(0)
+	, m_rowsDirty(true)
+	, m_replayRate(0)
+	, m_replayLoop(false)
+	, m_referenceTolerance(0)
 {
 }
 
@@ -110,178 +121,114 @@ bool HistoryDialog::DoRender()
 
 	float width = ImGui::GetFontSize();
 
+	//If the point we're waiting on just finished loading in the background, apply it now
+	if(m_mgr.PollLoads() && m_waitingForLoad && m_selectedPoint && m_selectedPoint->IsResident())
+	{
+		m_selectionChanged = true;
+		m_waitingForLoad = false;
+	}
+
 	ImGui::InputInt("History Depth", &m_mgr.m_maxDepth, 1, 10);
 	HelpMarker(
 		"Adjust the cap on total history depth, in waveforms.\n"
 		"Large history depths can use significant amounts of RAM with deep memory.");
 
-	if(ImGui::BeginTable("history", 3, flags))
+	Unit bytes(Unit::UNIT_BYTES);
+	string footprint =
+		bytes.PrettyPrint(m_mgr.GetMemoryUsage(), 4) + " / " + bytes.PrettyPrint(m_mgr.GetMemoryBudget(), 4);
+	ImGui::BeginDisabled();
+		ImGui::SetNextItemWidth(10 * width);
+		ImGui::InputText("History Size", &footprint);
+	ImGui::EndDisabled();
+	MemoryUsageHelpMarker();
+
+	RetentionPolicySection();
+	ReferenceCompareSection();
+	ReplaySection();
+
+	if(m_referenceBrowser)
 	{
-		ImGui::TableSetupScrollFreeze(0, 1); //Header row does not scroll
-		ImGui::TableSetupColumn("Timestamp", ImGuiTableColumnFlags_WidthFixed, 12*width);
-		ImGui::TableSetupColumn("Pin", ImGuiTableColumnFlags_WidthFixed, 0.0f);
-		ImGui::TableSetupColumn("Label");
-		ImGui::TableHeadersRow();
+		m_referenceBrowser->Render();
 
-		list<shared_ptr<HistoryPoint> >::iterator itDelete;
-		bool deleting = false;
-		for(auto it = m_mgr.m_history.begin(); it != m_mgr.m_history.end(); it++)
+		if(m_referenceBrowser->IsClosedOK())
 		{
-			auto point = *it;
-			ImGui::PushID(point.get());
-
-			ImGui::TableNextRow(ImGuiTableRowFlags_None, m_rowHeight);
-
-			//Timestamp (and row selection logic)
-			bool rowIsSelected = (m_selectedPoint == point);
-			ImGui::TableSetColumnIndex(0);
-			auto open = ImGui::TreeNodeEx("##tree", ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_DefaultOpen);
-			ImGui::SameLine();
-			if(ImGui::Selectable(
-				point->m_time.PrettyPrint().c_str(),
-				rowIsSelected && !m_selectedMarker,
-				ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap,
-				ImVec2(0, m_rowHeight)))
+			m_referenceError = "";
+			if(!m_session.SetReferenceFromFile(
+				m_referenceStream, m_referenceBrowser->GetFileName(), m_referenceTolerance, m_referenceError))
 			{
-				m_selectedPoint = point;
-				rowIsSelected = true;
-				m_selectionChanged = true;
-				m_selectedMarker = nullptr;
+				LogError("Couldn't load reference: %s\n", m_referenceError.c_str());
 			}
+			m_referenceTolerances.erase(m_referenceStream);
+		}
 
-			if(ImGui::BeginPopupContextItem())
-			{
-				if(ImGui::MenuItem("Delete"))
-				{
-					itDelete = it;
-					deleting = true;
-				}
-				ImGui::EndPopup();
-			}
+		if(m_referenceBrowser->IsClosed())
+			m_referenceBrowser = nullptr;
+	}
 
-			//Force pin if we have a nickname or markers
-			auto& markers = m_session.GetMarkers(point->m_time);
-			bool forcePin = false;
-			if(!point->m_nickname.empty() || !markers.empty())
-			{
-				forcePin = true;
-				point->m_pinned = true;
-			}
+	if( m_rowsDirty ||
+		(m_rowsHistoryRevision != m_mgr.GetRevision()) ||
+		(m_rowsMarkerRevision != m_session.GetMarkerRevision()) )
+	{
+		RefreshRows();
+	}
 
-			//Pin box
-			ImGui::TableSetColumnIndex(1);
-			if(forcePin)
-				ImGui::BeginDisabled();
-			ImGui::Checkbox("###pin", &point->m_pinned);
-			m_rowHeight = ImGui::GetItemRectSize().y;
-			if(forcePin)
-				ImGui::EndDisabled();
-			Dialog::Tooltip(
-				"Check to \"pin\" this waveform and keep it in history rather\n"
-				"than rolling off the end of the buffer as new data comes in.\n\n"
-				"Waveforms with a nickname, or containing any labeled timestamps,\n"
-				"are automatically pinned.", true);
-
-			//Editable nickname box
-			ImGui::TableSetColumnIndex(2);
-			if(rowIsSelected)
-			{
-				if(m_selectionChanged)
-					ImGui::SetKeyboardFocusHere();
-				ImGui::SetNextItemWidth(ImGui::GetColumnWidth() - 4);
-				ImGui::InputText("###nick", &point->m_nickname);
-			}
-			else
-				ImGui::TextUnformatted(point->m_nickname.c_str());
+	if(ImGui::BeginTable("history", 4, flags))
+	{
+		ImGui::TableSetupScrollFreeze(0, 1); //Header row does not scroll
+		ImGui::TableSetupColumn("Timestamp", ImGuiTableColumnFlags_WidthFixed, 12*width);
+		ImGui::TableSetupColumn("Pin", ImGuiTableColumnFlags_WidthFixed, 0.0f);
+		ImGui::TableSetupColumn("Preview", ImGuiTableColumnFlags_WidthFixed, 6*width);
+		ImGui::TableSetupColumn("Label");
+		ImGui::TableHeadersRow();
 
-			//Child nodes for markers
-			if(open)
+		//Only draw the rows actually on screen, there may be thousands of points in history
+		shared_ptr<HistoryPoint> deletePoint;
+		size_t markerToDelete = 0;
+		bool deletingMarker = false;
+		ImGuiListClipper clipper;
+		clipper.Begin(m_rows.size());
+		while(clipper.Step())
+		{
+			for(int i=clipper.DisplayStart; i<clipper.DisplayEnd; i++)
 			{
-				size_t markerToDelete = 0;
-				bool deletingMarker = false;
-
-				for(size_t i=0; i<markers.size(); i++)
-				{
-					auto& m = markers[i];
-
-					ImGui::PushID(i);
-					ImGui::TableNextRow();
-
-					//Timestamp
-					bool markerIsSelected = (m_selectedMarker == &m);
-					ImGui::TableSetColumnIndex(0);
-					if(ImGui::Selectable(
-						m.GetMarkerTime().PrettyPrint().c_str(),
-						markerIsSelected,
-						ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap,
-						ImVec2(0, m_rowHeight)))
-					{
-						//Select the marker
-						m_selectedMarker = &m;
-						markerIsSelected = true;
-
-						//Navigate to the selected waveform
-						if(!rowIsSelected)
-						{
-							rowIsSelected = true;
-							m_selectedPoint = point;
-							m_selectionChanged = true;
-						}
-
-						m_parent.NavigateToTimestamp(m.m_offset);
-					}
-
-					if(ImGui::BeginPopupContextItem())
-					{
-						if(ImGui::MenuItem("Delete"))
-						{
-							deletingMarker = true;
-							markerToDelete = i;
-						}
-						ImGui::EndPopup();
-					}
-
-					//Nothing in pin box
-					ImGui::TableSetColumnIndex(1);
-
-					//Nickname box
-					ImGui::TableSetColumnIndex(2);
-					if(ImGui::InputText("###nick", &m.m_name))
-						m_parent.GetSession().OnMarkerChanged();
-
-					ImGui::PopID();
-				}
-
-				//Execute deletion after drawing the rest of the list
-				if(deletingMarker)
-				{
-					markers.erase(markers.begin() + markerToDelete);
-					m_parent.GetSession().OnMarkerChanged();
-				}
-
-				ImGui::TreePop();
+				if(m_rows[i].m_marker < 0)
+					PointRow(i, deletePoint);
+				else
+					MarkerRow(i, deletingMarker, markerToDelete);
 			}
+		}
 
-			ImGui::PopID();
+		//Execute deletion after drawing the rest of the list
+		if(deletingMarker)
+		{
+			auto& markers = m_session.GetMarkers(m_rows[markerToDelete].m_point->m_time);
+			markers.erase(markers.begin() + m_rows[markerToDelete].m_marker);
+			m_selectedMarker = nullptr;
+			m_parent.GetSession().OnMarkerChanged();
 		}
 
 		//Deleting a row?
-		if(deleting)
+		if(deletePoint)
 		{
 			//Deleting selected row? Select the last row (if we have one)
 			bool deletedSelection = false;
-			if(*itDelete == m_selectedPoint)
+			if(deletePoint == m_selectedPoint)
 				deletedSelection = true;
 
 			//Delete the selected row
 			//(manual delete applies even if we have markers or a pin)
-			m_session.RemoveMarkers((*itDelete)->m_time);
-			m_session.RemovePackets((*itDelete)->m_time);
-			m_mgr.m_history.erase(itDelete);
+			auto it = m_mgr.find(deletePoint->m_time);
+			if(it != m_mgr.m_history.end())
+			{
+				m_session.RemoveMarkers(deletePoint->m_time);
+				m_session.RemovePackets(deletePoint->m_time);
+				m_mgr.erase(it);
+			}
 
 			if(deletedSelection)
 			{
 				m_selectionChanged = true;
+				m_selectedMarker = nullptr;
 				if(m_mgr.m_history.empty())
 					m_selectedPoint = nullptr;
 				else
@@ -295,6 +242,712 @@ bool HistoryDialog::DoRender()
 	return true;
 }
 
+/**
+	@brief Shows the help marker next to the history size, with a breakdown of memory usage by tier
+
+	Adding up the tiers means walking the whole history, so it's only done while the tooltip is open.
+ */
+void HistoryDialog::MemoryUsageHelpMarker()
+{
+	ImGui::SameLine();
+	ImGui::TextDisabled("(?)");
+	if(!ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort))
+		return;
+
+	size_t tierBytes[3] = {0, 0, 0};
+	for(auto& point : m_mgr.m_history)
+		tierBytes[point->m_tier] += point->m_memoryUsage;
+
+	Unit bytes(Unit::UNIT_BYTES);
+	string str =
+		"Total size of waveform data in history, and the size at which old waveforms are deleted.\n\n"
+		"GPU memory: " + bytes.PrettyPrint(tierBytes[HistoryPoint::TIER_GPU], 4) + "\n"
+		"Host memory: " + bytes.PrettyPrint(tierBytes[HistoryPoint::TIER_HOST], 4) + "\n"
+		"Disk: " + bytes.PrettyPrint(tierBytes[HistoryPoint::TIER_DISK], 4) + "\n\n"
+		"Budgets can be changed under Preferences | Performance | History.";
+
+	ImGui::BeginTooltip();
+	ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50);
+	ImGui::TextUnformatted(str.c_str());
+	ImGui::PopTextWrapPos();
+	ImGui::EndTooltip();
+}
+
+/**
+	@brief Shows the controls for the rules deciding which live acquisitions are kept
+ */
+void HistoryDialog::RetentionPolicySection()
+{
+	if(!ImGui::CollapsingHeader("Retention Policy"))
+		return;
+
+	auto& policy = m_mgr.m_retention;
+	lock_guard<mutex> lock(policy.GetMutex());
+
+	ImGui::Checkbox("Only keep interesting acquisitions", &policy.m_enabled);
+	HelpMarker(
+		"Check each new acquisition against the rules below once the filter graph has run on it.\n\n"
+		"Acquisitions matching a rule are kept (or pinned). Of the rest, only one in every N is kept, and the\n"
+		"others are dropped from history as soon as a newer acquisition arrives. This lets long soak tests spend\n"
+		"history capacity on the rare events rather than routine captures.");
+
+	float width = ImGui::GetFontSize();
+	ImGui::SetNextItemWidth(6 * width);
+	if(ImGui::InputInt("Keep 1 in N others", &policy.m_keepEvery))
+		policy.m_keepEvery = max(0, policy.m_keepEvery);
+	HelpMarker("Keep one in this many acquisitions which don't match any rule.\nSet to 0 to drop all of them.");
+
+	ImGui::Text("%" PRIu64 " matched, %" PRIu64 " unmatched", policy.m_matched, policy.m_unmatched);
+
+	//Only filter outputs can be checked
+	vector<Filter*> filters;
+	for(auto f : Filter::GetAllInstances())
+		filters.push_back(f);
+	sort(filters.begin(), filters.end(),
+		[](Filter* a, Filter* b) { return a->GetDisplayName() < b->GetDisplayName(); });
+
+	auto& rules = policy.m_rules;
+	m_ruleThresholds.resize(rules.size());
+	m_rulePacketFilters.resize(rules.size(), "");
+
+	size_t deleteRule = rules.size();
+	for(size_t i=0; i<rules.size(); i++)
+	{
+		if(RetentionRuleRow(i, rules[i], filters))
+			deleteRule = i;
+	}
+	if(deleteRule < rules.size())
+	{
+		rules.erase(rules.begin() + deleteRule);
+		m_ruleThresholds.erase(m_ruleThresholds.begin() + deleteRule);
+		m_rulePacketFilters.erase(m_rulePacketFilters.begin() + deleteRule);
+	}
+
+	if(ImGui::Button("Add Rule"))
+	{
+		rules.push_back(RetentionRule());
+		m_ruleThresholds.push_back("");
+		m_rulePacketFilters.push_back("");
+	}
+	ImGui::Separator();
+}
+
+/**
+	@brief Shows the controls for comparing live acquisitions against golden reference waveforms
+ */
+void HistoryDialog::ReferenceCompareSection()
+{
+	if(!ImGui::CollapsingHeader("Reference Compare"))
+		return;
+
+	float width = ImGui::GetFontSize();
+
+	//Existing references
+	auto comparers = m_session.GetReferenceComparers();
+	for(auto& it : comparers)
+	{
+		bool remove = false;
+		ReferenceRow(it.first, it.second, remove);
+		if(remove)
+		{
+			m_session.RemoveReference(it.first);
+			m_referenceTolerances.erase(it.first);
+		}
+	}
+	if(!comparers.empty())
+		ImGui::Separator();
+
+	//Any uniformly sampled analog stream can have a reference
+	vector<StreamDescriptor> streams;
+	for(auto scope : m_session.GetScopes())
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan)
+				continue;
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				if(chan->GetType(j) == Stream::STREAM_TYPE_ANALOG)
+					streams.push_back(StreamDescriptor(chan, j));
+			}
+		}
+	}
+	for(auto f : Filter::GetAllInstances())
+	{
+		for(size_t j=0; j<f->GetStreamCount(); j++)
+		{
+			if(f->GetType(j) == Stream::STREAM_TYPE_ANALOG)
+				streams.push_back(StreamDescriptor(f, j));
+		}
+	}
+
+	vector<string> names;
+	int sel = -1;
+	for(auto& stream : streams)
+	{
+		if(stream == m_referenceStream)
+			sel = names.size();
+		names.push_back(stream.GetName());
+	}
+	ImGui::SetNextItemWidth(10 * width);
+	if(Combo("Stream", names, sel) && (sel >= 0) )
+	{
+		m_referenceStream = streams[sel];
+		m_referenceToleranceText = "";
+	}
+	if(sel < 0)
+	{
+		m_referenceStream = StreamDescriptor(nullptr, 0);
+		return;
+	}
+
+	auto unit = m_referenceStream.GetYAxisUnits();
+	if(m_referenceToleranceText.empty())
+		m_referenceToleranceText = unit.PrettyPrint(m_referenceTolerance);
+	ImGui::SetNextItemWidth(6 * width);
+	UnitInputWithImplicitApply("Tolerance", m_referenceToleranceText, m_referenceTolerance, unit);
+	HelpMarker("Samples further than this from the reference are counted as out of band.");
+
+	if(ImGui::Button("Use Current Waveform"))
+	{
+		m_referenceError = "";
+		if(!m_session.SetReferenceFromCurrent(m_referenceStream, m_referenceTolerance))
+			m_referenceError = "Stream has no uniformly sampled analog data";
+		m_referenceTolerances.erase(m_referenceStream);
+	}
+	HelpMarker(
+		"Use the waveform currently shown on the stream as its reference.
+"
+		"Select a point in history first to use a stored acquisition.");
+	ImGui::SameLine();
+	if(ImGui::Button("Load from File...") && !m_referenceBrowser)
+	{
+		m_referenceBrowser = MakeFileBrowser(
+			&m_parent,
+			".",
+			"Load Reference Waveform",
+			"CSV files (*.csv)",
+			"*.csv",
+			false);
+	}
+	HelpMarker(
+		"Load the reference from a CSV file, such as one written by the waveform exporter.
+"
+		"The file must have the same sample rate as the live data.");
+
+	if(!m_referenceError.empty())
+		ImGui::TextColored(ImVec4(1, 0.25, 0.25, 1), "%s", m_referenceError.c_str());
+	ImGui::Separator();
+}
+
+/**
+	@brief Shows the settings and results for a single golden reference
+
+	@param stream	The stream being compared
+	@param comparer	The comparer holding its reference
+	@param remove	Set true if the reference should be removed
+ */
+void HistoryDialog::ReferenceRow(StreamDescriptor stream, shared_ptr<ReferenceComparer> comparer, bool& remove)
+{
+	float width = ImGui::GetFontSize();
+	ImGui::PushID(stream.GetName().c_str());
+
+	ImGui::TextUnformatted(stream.GetName().c_str());
+	Tooltip(comparer->GetSource() + " (" + to_string(comparer->GetReferenceLength()) + " samples)");
+
+	auto unit = stream.GetYAxisUnits();
+	auto& text = m_referenceTolerances[stream];
+	float tolerance = comparer->GetTolerance();
+	if(text.empty())
+		text = unit.PrettyPrint(tolerance);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(6 * width);
+	if(UnitInputWithImplicitApply("###tolerance", text, tolerance, unit))
+		comparer->SetTolerance(tolerance);
+	Tooltip("Tolerance");
+
+	int allowed = comparer->GetAllowedFailures();
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(6 * width);
+	if(ImGui::InputInt("Allowed", &allowed))
+		comparer->SetAllowedFailures(max(0, allowed));
+	Tooltip("Number of out-of-band samples an acquisition may have and still pass");
+
+	ImGui::SameLine();
+	if(ImGui::Button("Reset"))
+		comparer->ResetStats();
+	ImGui::SameLine();
+	if(ImGui::Button("Remove"))
+		remove = true;
+
+	auto stats = comparer->GetStats();
+	if(stats.m_acquisitions)
+	{
+		ImGui::Text("%" PRIu64 " / %" PRIu64 " acquisitions failed", stats.m_failedAcquisitions, stats.m_acquisitions);
+		if(stats.m_lastFailures)
+		{
+			Unit fs(Unit::UNIT_FS);
+			ImGui::Text("Last: %s, %" PRIu64 " samples out of band, first at %s",
+				stats.m_lastFailed ? "fail" : "pass",
+				stats.m_lastFailures,
+				fs.PrettyPrint(stats.m_lastFirstFailure).c_str());
+		}
+		else
+			ImGui::TextUnformatted("Last: pass");
+	}
+
+	ImGui::PopID();
+}
+
+/**
+	@brief Shows the controls for replaying history through the filter graph as if it were live
+ */
+void HistoryDialog::ReplaySection()
+{
+	if(!ImGui::CollapsingHeader("Replay"))
+		return;
+
+	auto& replay = m_session.GetReplay();
+	bool running = replay.IsRunning();
+
+	float width = ImGui::GetFontSize();
+	ImGui::BeginDisabled(running);
+		ImGui::SetNextItemWidth(6 * width);
+		if(ImGui::InputFloat("Rate (points/sec)", &m_replayRate, 1, 10, "%.1f"))
+			m_replayRate = max(0.0f, m_replayRate);
+		HelpMarker("Number of history points to replay per second.\nSet to 0 to replay as fast as the pipeline allows.");
+		ImGui::Checkbox("Loop", &m_replayLoop);
+	ImGui::EndDisabled();
+
+	if(running)
+	{
+		if(ImGui::Button("Stop Replay"))
+			replay.Stop();
+	}
+	else if(ImGui::Button("Start Replay"))
+		replay.Start(m_replayRate, m_replayLoop);
+	HelpMarker(
+		"Feed every point in history, oldest first, through the filter graph and renderer as if it had just been\n"
+		"acquired. Nothing new is added to history.\n\n"
+		"Use this to measure filter graph throughput without any instruments connected. Per-stage timings are in\n"
+		"the Metrics dialog.");
+
+	auto stats = replay.GetStats();
+	if(stats.m_elapsed > 0)
+	{
+		Unit sps(Unit::UNIT_SAMPLERATE);
+		ImGui::Text("%" PRIu64 " points in %.2f s (%" PRIu64 " skipped)", stats.m_points, stats.m_elapsed, stats.m_skipped);
+		ImGui::Text("%.2f points/sec, %s",
+			stats.m_points / stats.m_elapsed,
+			sps.PrettyPrint(stats.m_samples / stats.m_elapsed).c_str());
+	}
+	ImGui::Separator();
+}
+
+/**
+	@brief Shows the controls for a single retention rule
+
+	@return True if the rule should be deleted
+ */
+bool HistoryDialog::RetentionRuleRow(size_t i, RetentionRule& rule, const vector<Filter*>& filters)
+{
+	float width = ImGui::GetFontSize();
+	ImGui::PushID(i);
+
+	int type = rule.m_type;
+	ImGui::SetNextItemWidth(8 * width);
+	if(Combo("###type", {"Above", "Below", "Packet", "Reference fail"}, type))
+	{
+		rule.m_type = static_cast<RetentionRule::RuleType>(type);
+		rule.m_filter = nullptr;
+		rule.m_stream = 0;
+	}
+	bool packet = (rule.m_type == RetentionRule::RULE_PACKET);
+
+	//Reference rules check every stream set up under Reference Compare, so there's nothing else to choose
+	if(rule.m_type == RetentionRule::RULE_REFERENCE)
+	{
+		int action = rule.m_action;
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(6 * width);
+		if(Combo("###action", {"Retain", "Pin"}, action))
+			rule.m_action = static_cast<RetentionRule::Action>(action);
+
+		ImGui::SameLine();
+		bool ret = ImGui::Button("Delete");
+
+		ImGui::PopID();
+		return ret;
+	}
+
+	//Pick the filter to check (only protocol decoders can be used for packet rules)
+	vector<string> names;
+	vector<Filter*> choices;
+	int sel = -1;
+	for(auto f : filters)
+	{
+		if(packet && !dynamic_cast<PacketDecoder*>(f))
+			continue;
+		if(f == rule.m_filter)
+			sel = choices.size();
+		choices.push_back(f);
+		names.push_back(f->GetDisplayName());
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(10 * width);
+	if(Combo("###filter", names, sel) && (sel >= 0) )
+	{
+		rule.m_filter = choices[sel];
+		rule.m_stream = 0;
+		m_ruleThresholds[i] = "";
+	}
+	if(sel < 0)
+		rule.m_filter = nullptr;
+
+	ImGui::SameLine();
+	if(packet)
+	{
+		ImGui::SetNextItemWidth(12 * width);
+		TextInputWithImplicitApply("###expr", m_rulePacketFilters[i], rule.m_packetFilter);
+		Tooltip(
+			"Display filter expression (as in the protocol analyzer) packets are matched against.\n"
+			"Leave blank to match any packet.");
+	}
+	else if(rule.m_filter)
+	{
+		//Output stream of the filter
+		vector<string> streams;
+		for(size_t j=0; j<rule.m_filter->GetStreamCount(); j++)
+			streams.push_back(rule.m_filter->GetStreamName(j));
+		int stream = rule.m_stream;
+		ImGui::SetNextItemWidth(6 * width);
+		if(Combo("###stream", streams, stream))
+		{
+			rule.m_stream = stream;
+			m_ruleThresholds[i] = "";
+		}
+
+		//Threshold, in the stream's units
+		auto unit = rule.m_filter->GetYAxisUnits(rule.m_stream);
+		if(m_ruleThresholds[i].empty())
+			m_ruleThresholds[i] = unit.PrettyPrint(rule.m_threshold);
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(6 * width);
+		UnitInputWithImplicitApply("###threshold", m_ruleThresholds[i], rule.m_threshold, unit);
+	}
+
+	int action = rule.m_action;
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(6 * width);
+	if(Combo("###action", {"Retain", "Pin"}, action))
+		rule.m_action = static_cast<RetentionRule::Action>(action);
+
+	ImGui::SameLine();
+	bool ret = ImGui::Button("Delete");
+
+	ImGui::PopID();
+	return ret;
+}
+
+/**
+	@brief Check if a point is a segment shown as a child of the first segment of its acquisition
+
+	If the first segment has been deleted, the rest are shown as normal points.
+ */
+bool HistoryDialog::IsSegmentChild(shared_ptr<HistoryPoint>& point)
+{
+	return (point->m_segmentIndex > 0) && m_mgr.HasHistory(point->m_segmentGroup);
+}
+
+/**
+	@brief Check if a point's child rows (markers, plus the remaining segments of a segmented acquisition) are shown
+ */
+bool HistoryDialog::IsExpanded(shared_ptr<HistoryPoint>& point)
+{
+	if(IsSegmentParent(point))
+		return (m_expandedSegments.find(point->m_time) != m_expandedSegments.end());
+	return (m_collapsedPoints.find(point->m_time) == m_collapsedPoints.end());
+}
+
+/**
+	@brief Shows or hides a point's child rows
+ */
+void HistoryDialog::SetExpanded(shared_ptr<HistoryPoint>& point, bool expanded)
+{
+	if(IsSegmentParent(point))
+	{
+		if(expanded)
+			m_expandedSegments.emplace(point->m_time);
+		else
+			m_expandedSegments.erase(point->m_time);
+	}
+	else
+	{
+		if(expanded)
+			m_collapsedPoints.erase(point->m_time);
+		else
+			m_collapsedPoints.emplace(point->m_time);
+	}
+	m_rowsDirty = true;
+}
+
+/**
+	@brief Rebuilds the flattened list of table rows from the history and markers
+ */
+void HistoryDialog::RefreshRows()
+{
+	m_rows.clear();
+	m_rows.reserve(m_mgr.m_history.size());
+	for(auto& point : m_mgr.m_history)
+	{
+		//Segments are hidden under the first one of their acquisition until it's expanded
+		if(IsSegmentChild(point) && (m_expandedSegments.find(point->m_segmentGroup) == m_expandedSegments.end()) )
+			continue;
+
+		m_rows.push_back(HistoryRow(point));
+		if(!IsExpanded(point))
+			continue;
+
+		auto& markers = m_session.GetMarkers(point->m_time);
+		for(size_t i=0; i<markers.size(); i++)
+			m_rows.push_back(HistoryRow(point, i));
+	}
+
+	m_rowsHistoryRevision = m_mgr.GetRevision();
+	m_rowsMarkerRevision = m_session.GetMarkerRevision();
+	m_rowsDirty = false;
+}
+
+/**
+	@brief Draws the table row for a history point
+
+	@param nrow			Index of the row in m_rows
+	@param deletePoint	Set to the point if the user asked to delete it
+ */
+void HistoryDialog::PointRow(size_t nrow, shared_ptr<HistoryPoint>& deletePoint)
+{
+	auto point = m_rows[nrow].m_point;
+	ImGui::PushID(point.get());
+
+	ImGui::TableNextRow(ImGuiTableRowFlags_None, m_rowHeight);
+
+	//Timestamp (and row selection logic)
+	//We track expanded state ourselves since rows which are scrolled out of view don't get a tree node.
+	//A collapsed segmented acquisition is highlighted if any of its segments is selected.
+	bool rowIsSelected = (m_selectedPoint == point);
+	bool expanded = IsExpanded(point);
+	bool segmentSelected =
+		IsSegmentParent(point) && !expanded && m_selectedPoint && (m_selectedPoint->m_segmentIndex > 0) &&
+		(m_selectedPoint->m_segmentGroup == point->m_time);
+	ImGui::TableSetColumnIndex(0);
+	bool child = IsSegmentChild(point);
+	if(child)
+		ImGui::Indent();
+	ImGui::SetNextItemOpen(expanded);
+	auto open = ImGui::TreeNodeEx("##tree", ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_NoTreePushOnOpen);
+	if(open != expanded)
+		SetExpanded(point, open);
+	ImGui::SameLine();
+	if(ImGui::Selectable(
+		point->m_time.PrettyPrint().c_str(),
+		(rowIsSelected || segmentSelected) && !m_selectedMarker,
+		ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap,
+		ImVec2(0, m_rowHeight)))
+	{
+		m_selectedPoint = point;
+		rowIsSelected = true;
+		m_selectionChanged = true;
+		m_selectedMarker = nullptr;
+	}
+
+	if(ImGui::BeginPopupContextItem())
+	{
+		if(ImGui::MenuItem("Delete"))
+			deletePoint = point;
+		ImGui::EndPopup();
+	}
+	if(child)
+		ImGui::Unindent();
+
+	//Force pin if we have a nickname or markers
+	//(points scrolled out of view don't need this, since eviction checks for markers itself
+	//and the nickname can only be edited while the row is visible)
+	bool forcePin = false;
+	if(!point->m_nickname.empty() || m_session.HasMarkers(point->m_time))
+	{
+		forcePin = true;
+		point->m_pinned = true;
+	}
+
+	//Pin box
+	ImGui::TableSetColumnIndex(1);
+	if(forcePin)
+		ImGui::BeginDisabled();
+	if(ImGui::Checkbox("###pin", &point->m_pinned) && !point->m_pinned)
+		m_mgr.Reconsider(point.get());
+	m_rowHeight = ImGui::GetItemRectSize().y;
+	if(forcePin)
+		ImGui::EndDisabled();
+	Dialog::Tooltip(
+		"Check to \"pin\" this waveform and keep it in history rather\n"
+		"than rolling off the end of the buffer as new data comes in.\n\n"
+		"Waveforms with a nickname, or containing any labeled timestamps,\n"
+		"are automatically pinned.", true);
+
+	//Thumbnail
+	ImGui::TableSetColumnIndex(2);
+	ThumbnailCell(point);
+
+	//Editable nickname box
+	ImGui::TableSetColumnIndex(3);
+	if(point->IsLoading())
+		ImGui::ProgressBar(point->GetLoadProgress(), ImVec2(-1, 0), "Loading...");
+	else if(rowIsSelected)
+	{
+		if(m_selectionChanged)
+			ImGui::SetKeyboardFocusHere();
+		ImGui::SetNextItemWidth(ImGui::GetColumnWidth() - 4);
+		if(ImGui::InputText("###nick", &point->m_nickname) && !point->m_nickname.empty())
+			point->m_pinned = true;
+	}
+	else if(!point->m_nickname.empty() || (point->m_segmentCount <= 1) )
+		ImGui::TextUnformatted(point->m_nickname.c_str());
+	else if(IsSegmentParent(point) && !expanded)
+		ImGui::TextDisabled("%zu segments", point->m_segmentCount);
+	else
+		ImGui::TextDisabled("Segment %zu of %zu", point->m_segmentIndex + 1, point->m_segmentCount);
+
+	ImGui::PopID();
+}
+
+/**
+	@brief Draws the thumbnail of a history point's waveforms into the current table cell
+
+	Each trigger group gets an equal slice of the cell, with its channels overlaid. Every bin is drawn as a vertical
+	line spanning its min and max, which for a row only a few pixels tall is as much detail as there's room for.
+ */
+void HistoryDialog::ThumbnailCell(shared_ptr<HistoryPoint>& point)
+{
+	if(!point->m_thumbnailsReady || point->m_thumbnails.empty())
+		return;
+
+	auto pos = ImGui::GetCursorScreenPos();
+	float w = ImGui::GetColumnWidth();
+	float h = m_rowHeight;
+	ImGui::Dummy(ImVec2(w, h));
+
+	auto list = ImGui::GetWindowDrawList();
+	float slice = w / point->m_thumbnails.size();
+	for(size_t i=0; i<point->m_thumbnails.size(); i++)
+	{
+		float left = pos.x + slice*i;
+		for(auto& trace : point->m_thumbnails[i].m_traces)
+		{
+			size_t nbins = trace.m_bins.size() / 2;
+			if(nbins == 0)
+				continue;
+
+			auto color = ColorFromString(trace.m_color);
+			float binWidth = slice / nbins;
+			for(size_t j=0; j<nbins; j++)
+			{
+				float x = left + (j + 0.5f) * binWidth;
+				float ylo = pos.y + (1 - trace.m_bins[j*2]) * (h - 1);
+				float yhi = pos.y + (1 - trace.m_bins[j*2 + 1]) * (h - 1);
+				list->AddLine(ImVec2(x, ylo + 0.5f), ImVec2(x, yhi - 0.5f), color);
+			}
+		}
+
+		//Separate groups from each other
+		if(i > 0)
+			list->AddLine(ImVec2(left, pos.y), ImVec2(left, pos.y + h), ImGui::GetColorU32(ImGuiCol_Border));
+	}
+
+	string groups;
+	for(auto& thumb : point->m_thumbnails)
+	{
+		if(!groups.empty())
+			groups += ", ";
+		groups += thumb.m_group;
+	}
+	Tooltip(groups);
+}
+
+/**
+	@brief Draws the table row for a marker within a history point
+
+	@param nrow				Index of the row in m_rows
+	@param deletingMarker	Set true if the user asked to delete the marker
+	@param markerToDelete	Set to nrow if the user asked to delete the marker
+ */
+void HistoryDialog::MarkerRow(size_t nrow, bool& deletingMarker, size_t& markerToDelete)
+{
+	auto& row = m_rows[nrow];
+	auto point = row.m_point;
+	auto& markers = m_session.GetMarkers(point->m_time);
+
+	//Markers changed since we made the row list, skip it until the list is rebuilt next frame
+	ImGui::TableNextRow();
+	if(static_cast<size_t>(row.m_marker) >= markers.size())
+		return;
+	auto& m = markers[row.m_marker];
+
+	ImGui::PushID(point.get());
+	ImGui::PushID(row.m_marker);
+
+	//Timestamp (indented as if it was a child of the point's tree node)
+	bool markerIsSelected = (m_selectedMarker == &m);
+	ImGui::TableSetColumnIndex(0);
+	bool child = IsSegmentChild(point);
+	if(child)
+		ImGui::Indent();
+	ImGui::Indent();
+	if(ImGui::Selectable(
+		m.GetMarkerTime().PrettyPrint().c_str(),
+		markerIsSelected,
+		ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap,
+		ImVec2(0, m_rowHeight)))
+	{
+		//Select the marker
+		m_selectedMarker = &m;
+		markerIsSelected = true;
+
+		//Navigate to the selected waveform
+		if(m_selectedPoint != point)
+		{
+			m_selectedPoint = point;
+			m_selectionChanged = true;
+		}
+
+		m_parent.NavigateToTimestamp(m.m_offset);
+	}
+
+	if(ImGui::BeginPopupContextItem())
+	{
+		if(ImGui::MenuItem("Delete"))
+		{
+			deletingMarker = true;
+			markerToDelete = nrow;
+		}
+		ImGui::EndPopup();
+	}
+	ImGui::Unindent();
+	if(child)
+		ImGui::Unindent();
+
+	//Nothing in pin or thumbnail boxes
+	ImGui::TableSetColumnIndex(1);
+
+	//Nickname box
+	ImGui::TableSetColumnIndex(3);
+	if(ImGui::InputText("###nick", &m.m_name))
+		m_parent.GetSession().OnMarkerChanged();
+
+	ImGui::PopID();
+	ImGui::PopID();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // UI event handlers
 
@@ -308,13 +961,28 @@ void HistoryDialog::LoadHistoryFromSelection(Session& session)
 {
 	if(m_selectedPoint)
 	{
+		//Get the points on either side ready, in case the user is stepping through history
+		m_mgr.PrefetchNeighbors(m_selectedPoint);
+
+		//Lazily loaded point that isn't in memory yet? Load it in the background and apply it once it's ready
+		if(!m_selectedPoint->IsResident())
+		{
+			LogTrace("Selected point is not loaded yet\n");
+			m_mgr.StartLoading(m_selectedPoint);
+			m_waitingForLoad = true;
+			return;
+		}
+
 		LogTrace("Valid point selected\n");
+		m_waitingForLoad = false;
 		m_selectedPoint->LoadHistoryToSession(session);
+		session.SetFilterHistoryPoint(m_selectedPoint);
 	}
 	else
 	{
 		LogTrace("Empty point selected\n");
 		m_mgr.LoadEmptyHistoryToSession(session);
+		session.SetFilterHistoryPoint(nullptr);
 	}
 }
 
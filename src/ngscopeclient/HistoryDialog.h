@@ -39,6 +39,7 @@
 #include "Session.h"
 
 class MainWindow;
+class FileBrowser;
 
 /**
 	@brief UI for the history system
@@ -65,6 +66,46 @@ public:
 	TimePoint GetSelectedPoint();
 
 protected:
+	void RefreshRows();
+	void PointRow(size_t nrow, std::shared_ptr<HistoryPoint>& deletePoint);
+	void MarkerRow(size_t nrow, bool& deletingMarker, size_t& markerToDelete);
+	void ThumbnailCell(std::shared_ptr<HistoryPoint>& point);
+	void MemoryUsageHelpMarker();
+	void RetentionPolicySection();
+	void ReplaySection();
+	void ReferenceCompareSection();
+	void ReferenceRow(StreamDescriptor stream, std::shared_ptr<ReferenceComparer> comparer, bool& remove);
+	bool RetentionRuleRow(size_t i, RetentionRule& rule, const std::vector<Filter*>& filters);
+
+	bool IsSegmentChild(std::shared_ptr<HistoryPoint>& point);
+	bool IsExpanded(std::shared_ptr<HistoryPoint>& point);
+	void SetExpanded(std::shared_ptr<HistoryPoint>& point, bool expanded);
+
+	/**
+		@brief Check if a point is the first of several segments of a segmented acquisition
+	 */
+	bool IsSegmentParent(std::shared_ptr<HistoryPoint>& point)
+	{ return (point->m_segmentIndex == 0) && (point->m_segmentCount > 1); }
+
+	/**
+		@brief A single row of the history table
+	 */
+	class HistoryRow
+	{
+	public:
+		HistoryRow(std::shared_ptr<HistoryPoint> point, ssize_t marker = -1)
+		: m_point(point)
+		, m_marker(marker)
+		{}
+
+		///@brief The history point this row belongs to
+		std::shared_ptr<HistoryPoint> m_point;
+
+		///@brief Index of the marker this row shows within the point's markers, or -1 for the point itself
+		ssize_t m_marker;
+	};
+
+
 	HistoryManager& m_mgr;
 	Session& m_session;
 	MainWindow& m_parent;
@@ -75,11 +116,67 @@ protected:
 	///@brief True if a new row in the dialog was selected this frame
 	bool m_selectionChanged;
 
+	///@brief True if the selected point is being loaded in the background and should be applied when done
+	bool m_waitingForLoad;
+
 	///@brief The currently selected point of history
 	std::shared_ptr<HistoryPoint> m_selectedPoint;
 
 	///@brief The currently selected marker
 	Marker* m_selectedMarker;
+
+	/**
+		@brief Flattened list of table rows (points, and the markers of expanded points)
+
+		Rebuilt only when history, markers, or expanded state change, so the table can be clipped to the rows that
+		are actually visible.
+	 */
+	std::vector<HistoryRow> m_rows;
+
+	///@brief History revision m_rows was built from
+	uint64_t m_rowsHistoryRevision;
+
+	///@brief Marker revision m_rows was built from
+	uint64_t m_rowsMarkerRevision;
+
+	///@brief Set to force m_rows to be rebuilt next frame
+	bool m_rowsDirty;
+
+	///@brief Timestamps of points whose marker rows are collapsed
+	std::set<TimePoint> m_collapsedPoints;
+
+	///@brief Timestamps of segmented acquisitions whose segments are shown (they're collapsed by default)
+	std::set<TimePoint> m_expandedSegments;
+
+	///@brief Threshold text being edited for each retention rule
+	std::vector<std::string> m_ruleThresholds;
+
+	///@brief Packet filter expression being edited for each retention rule
+	std::vector<std::string> m_rulePacketFilters;
+
+	///@brief Points per second to replay history at, or zero for as fast as possible
+	float m_replayRate;
+
+	///@brief True to keep replaying history from the start until stopped
+	bool m_replayLoop;
+
+	///@brief Stream to add a golden reference for
+	StreamDescriptor m_referenceStream;
+
+	///@brief Tolerance text being edited for a new reference
+	std::string m_referenceToleranceText;
+
+	///@brief Tolerance for a new reference
+	float m_referenceTolerance;
+
+	///@brief Tolerance text being edited for each existing reference
+	std::map<StreamDescriptor, std::string> m_referenceTolerances;
+
+	///@brief Browser for choosing a reference file, if open
+	std::shared_ptr<FileBrowser> m_referenceBrowser;
+
+	///@brief Why the last reference couldn't be added, if it couldn't
+	std::string m_referenceError;
 };
 
 #endif
@@ -33,8 +33,12 @@
 	@brief Implementation of HistoryManager
  */
 #include "ngscopeclient.h"
+#include "pthread_compat.h"
 #include "HistoryManager.h"
 #include "Session.h"
+#include "HostMemoryPolicy.h"
+#include "WaveformKind.h"
+#include "../scopeprotocols/CANDecoder.h"
 
 using namespace std;
 
@@ -43,40 +47,116 @@ using namespace std;
 
 HistoryPoint::HistoryPoint()
 	: m_time(0, 0)
+	, m_id(0)
 	, m_pinned(false)
 	, m_nickname("")
+	, m_segmentGroup(0, 0)
+	, m_segmentIndex(0)
+	, m_segmentCount(1)
+	, m_tier(TIER_GPU)
+	, m_memoryUsage(0)
+	, m_lazyResident(false)
+	, m_evictionHeld(false)
+	, m_loadProgress(0)
+	, m_loadDone(false)
+	, m_cancelLoad(false)
+	, m_compactChecked(false)
+	, m_filterOutputRevision(0)
+	, m_readerRefs(0)
+	, m_maskTestResult(MASK_UNTESTED)
+	, m_maskHits(0)
+	, m_referenceResult(REFERENCE_NOT_TESTED)
+	, m_referenceFailures(0)
+	, m_referenceFirstFailure(0)
+	, m_retentionDecision(RetentionPolicy::DECISION_UNDECIDED)
+	, m_measurementsRecorded(false)
+	, m_thumbnailsReady(false)
+	, m_waveformPool(nullptr)
 {
 }
 
 HistoryPoint::~HistoryPoint()
 {
+	//Stop any background load before we free the waveforms it's writing to
+	if(m_loadThread)
+	{
+		m_cancelLoad = true;
+		while(!FinishLoading())
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	ClearFilterOutputs();
+
 	for(auto it : m_history)
 	{
 		auto scope = it.first;
 		auto hist = it.second;
 		for(auto jt : hist)
 		{
+			//Shared waveforms are freed by whichever point references them last
 			auto wfm = jt.second;
+			if(!wfm || (m_borrowedWaveforms.find(wfm) != m_borrowedWaveforms.end()) )
+				continue;
 
-			//Add known waveform types to pool for reuse
-			//Delete anything else
-			//TODO: this assumes the waveforms are currently configured for GPU-local or mirrored memory.
-			//This will have to change when we start paging old waveforms out to disk.
-			if(dynamic_cast<UniformAnalogWaveform*>(wfm) != nullptr)
+			//Add types the scope can reuse to its pool, and anything else to ours
+			auto kind = (m_tier == TIER_GPU) ? GetWaveformKind(wfm) : WAVEFORM_KIND_OTHER;
+			if(kind == WAVEFORM_KIND_UNIFORM_ANALOG)
 				scope->AddWaveformToAnalogPool(wfm);
-			else if(dynamic_cast<SparseDigitalWaveform*>(wfm) != nullptr)
+			else if(kind == WAVEFORM_KIND_SPARSE_DIGITAL)
 				scope->AddWaveformToDigitalPool(wfm);
 			else
-				delete wfm;
+				ReleaseWaveform(wfm);
 		}
 	}
 }
 
 /**
-	@brief Returns true if at least one waveform in this history point is currently loaded into a scope
+	@brief Deletes any filter outputs saved for this point
+
+	Filter outputs are never demoted along with the point's own waveforms, so they always go back to the pool for
+	the next filter graph refresh to reuse, regardless of what tier the point is in.
+ */
+void HistoryPoint::ClearFilterOutputs()
+{
+	for(auto it : m_filterOutputs)
+	{
+		if(!it.second)
+			continue;
+		if(m_waveformPool)
+			m_waveformPool->Add(it.second);
+		else
+			delete it.second;
+	}
+	m_filterOutputs.clear();
+	m_filterOutputFilters.clear();
+}
+
+/**
+	@brief Hands a waveform we no longer need to the session's waveform pool, or deletes it if we can't
+
+	Waveforms which were demoted to a slower memory tier are always deleted, since we don't want anyone reusing a
+	file-backed buffer for new data.
+ */
+void HistoryPoint::ReleaseWaveform(WaveformBase* wfm)
+{
+	if(m_waveformPool && (m_tier == TIER_GPU) )
+		m_waveformPool->Add(wfm);
+	else
+		delete wfm;
+}
+
+/**
+	@brief Returns true if at least one waveform owned by this history point is currently loaded into a scope,
+	or a background reader (see m_readerRefs) is holding the point
+
+	Borrowed waveforms don't count, since the newer point which owns them keeps them alive.
  */
 bool HistoryPoint::IsInUse()
 {
+	//Something in the background is reading our sample data
+	if(m_readerRefs > 0)
+		return true;
+
 	for(auto it : m_history)
 	{
 		auto hist = it.second;
@@ -85,14 +165,300 @@ bool HistoryPoint::IsInUse()
 			auto wfm = jt.second;
 
 			//Check if this waveform is currently attached to the scope
-			if( (jt.first.GetData() == wfm) && (wfm != nullptr ) )
+			if( (jt.first.GetData() == wfm) && (wfm != nullptr ) &&
+				(m_borrowedWaveforms.find(wfm) == m_borrowedWaveforms.end()) )
+			{
 				return true;
+			}
 		}
 	}
 
 	return false;
 }
 
+/**
+	@brief Drops one reader reference (see m_readerRefs)
+
+	Safe to call from any thread. When the last reader lets go, the HistoryManager is told so it can evict or demote
+	the point if it had to hold off earlier.
+ */
+void HistoryPoint::ReleaseReader()
+{
+	if(--m_readerRefs != 0)
+		return;
+
+	auto queue = atomic_load(&m_releaseQueue);
+	if(queue)
+		queue->Post(m_id);
+}
+
+/**
+	@brief Gets the approximate number of bytes of sample data owned by this history point
+ */
+size_t HistoryPoint::GetMemoryUsage()
+{
+	size_t bytes = 0;
+	for(auto it : m_history)
+	{
+		for(auto jt : it.second)
+		{
+			if(jt.second && (m_borrowedWaveforms.find(jt.second) == m_borrowedWaveforms.end()) )
+				bytes += WaveformPool::GetWaveformMemoryUsage(jt.second);
+		}
+	}
+	for(auto& it : m_compactSamples)
+		bytes += it.second->GetMemoryUsage();
+	return bytes;
+}
+
+/**
+	@brief Moves a single buffer to the memory type used for a given tier
+ */
+template<class T>
+static void SetBufferTier(AcceleratorBuffer<T>& buf, HistoryPoint::Tier tier)
+{
+	switch(tier)
+	{
+		case HistoryPoint::TIER_GPU:
+			buf.SetGpuAccessHint(AcceleratorBuffer<T>::HINT_LIKELY);
+			buf.SetCpuAccessHint(AcceleratorBuffer<T>::HINT_LIKELY, true);
+			break;
+
+		case HistoryPoint::TIER_HOST:
+			buf.SetGpuAccessHint(AcceleratorBuffer<T>::HINT_UNLIKELY);
+			buf.SetCpuAccessHint(AcceleratorBuffer<T>::HINT_LIKELY, true);
+			HostMemoryPolicy::Apply(buf);
+			break;
+
+		case HistoryPoint::TIER_DISK:
+			buf.SetGpuAccessHint(AcceleratorBuffer<T>::HINT_NEVER);
+			buf.SetCpuAccessHint(AcceleratorBuffer<T>::HINT_UNLIKELY, true);
+			break;
+	}
+}
+
+/**
+	@brief Moves a single waveform's buffers to the memory type used for a given tier
+
+	This can also be called on a newly created, empty waveform so that sample data is loaded directly into the
+	desired type of memory.
+ */
+void HistoryPoint::SetWaveformTier(WaveformBase* wfm, Tier tier)
+{
+	//Make sure the CPU-side copy is current before we potentially throw away the GPU side
+	wfm->PrepareForCpuAccess();
+
+	auto sparse = GetSparseBase(wfm, GetWaveformKind(wfm));
+	if(sparse)
+	{
+		SetBufferTier(sparse->m_offsets, tier);
+		SetBufferTier(sparse->m_durations, tier);
+	}
+
+	DispatchWaveform(wfm, [tier](auto typed)
+		{ SetBufferTier(typed->m_samples, tier); });
+
+	if( (tier != TIER_GPU) && wfm->HasGpuBuffer() )
+		wfm->FreeGpuMemory();
+}
+
+/**
+	@brief Moves all of our waveform data to a different memory tier
+
+	Demotion frees GPU memory (and, for the disk tier, lets the OS page the samples out to the backing file).
+	Promotion copies the samples back into normal memory so they can be displayed and processed at full speed.
+
+	Waveforms of types we don't know the sample layout of have only their timestamps moved. Borrowed waveforms stay
+	in the tier of the point which owns them.
+ */
+void HistoryPoint::SetTier(Tier tier)
+{
+	if(tier == m_tier)
+		return;
+
+	LogTrace("Moving history point %s from tier %d to %d\n", m_time.PrettyPrint().c_str(), m_tier, tier);
+
+	for(auto it : m_history)
+	{
+		for(auto jt : it.second)
+		{
+			if(jt.second && (m_borrowedWaveforms.find(jt.second) == m_borrowedWaveforms.end()) )
+				SetWaveformTier(jt.second, tier);
+		}
+	}
+	for(auto& it : m_compactSamples)
+	{
+		SetBufferTier(it.second->m_codes8, tier);
+		SetBufferTier(it.second->m_codes16, tier);
+	}
+
+	m_tier = tier;
+}
+
+/**
+	@brief Creates an empty waveform with the same metadata as an existing one
+
+	@param wfm		The waveform to copy metadata from
+	@param format	File format the sample data will be loaded from (determines dense vs sparse)
+ */
+static WaveformBase* CreateEmptyWaveformLike(WaveformBase* wfm, const string& format)
+{
+	bool dense = (format == "densev1") || (format == "densev2") || (format == "densebits");
+	bool analog =
+		(dynamic_cast<UniformAnalogWaveform*>(wfm) != nullptr) ||
+		(dynamic_cast<SparseAnalogWaveform*>(wfm) != nullptr);
+
+	WaveformBase* ret;
+	if(dynamic_cast<CANWaveform*>(wfm) != nullptr)
+		ret = new CANWaveform;
+	else if(analog)
+	{
+		if(dense)
+			ret = new UniformAnalogWaveform;
+		else
+			ret = new SparseAnalogWaveform;
+	}
+	else
+	{
+		if(dense)
+			ret = new UniformDigitalWaveform;
+		else
+			ret = new SparseDigitalWaveform;
+	}
+
+	ret->m_timescale = wfm->m_timescale;
+	ret->m_startTimestamp = wfm->m_startTimestamp;
+	ret->m_startFemtoseconds = wfm->m_startFemtoseconds;
+	ret->m_triggerPhase = wfm->m_triggerPhase;
+	ret->m_flags = wfm->m_flags;
+	return ret;
+}
+
+/**
+	@brief Starts loading our sample data from m_lazySources in a background thread
+
+	Call FinishLoading() from the GUI thread to check if it's done.
+
+	@param pool	Pool to decode the files on. Must outlive the load.
+ */
+void HistoryPoint::StartLoading(TaskPool& pool)
+{
+	if(IsResident() || IsLoading())
+		return;
+
+	LogTrace("Loading sample data for history point %s in the background\n", m_time.PrettyPrint().c_str());
+
+	//Grab the waveforms to load into now, so the thread doesn't have to touch m_history.
+	//If we were loaded before, we know how big the data is, so load into a pooled buffer if there's one that fits
+	//(the stub is swapped out in FinishLoading).
+	m_loadResults.clear();
+	for(auto& src : m_lazySources)
+	{
+		auto stub = m_history[src.m_scope][src.m_stream];
+		WaveformBase* wfm = nullptr;
+		if(stub && m_waveformPool && (src.m_size > 0) )
+			wfm = m_waveformPool->GetLike(stub, src.m_size);
+
+		if(wfm)
+		{
+			wfm->m_timescale = stub->m_timescale;
+			wfm->m_startTimestamp = stub->m_startTimestamp;
+			wfm->m_startFemtoseconds = stub->m_startFemtoseconds;
+			wfm->m_triggerPhase = stub->m_triggerPhase;
+			wfm->m_flags = stub->m_flags;
+			m_loadResults.push_back(wfm);
+		}
+		else
+			m_loadResults.push_back(stub);
+	}
+
+	m_loadProgress = 0;
+	m_loadDone = false;
+	m_cancelLoad = false;
+	m_loadThread = make_unique<thread>(&HistoryPoint::LoadThread, this, &pool);
+}
+
+/**
+	@brief Thread function for loading sample data
+ */
+void HistoryPoint::LoadThread(TaskPool* pool)
+{
+	pthread_setname_np_compat("HistoryLoad");
+
+	for(size_t i=0; i<m_lazySources.size(); i++)
+	{
+		if(m_cancelLoad)
+			break;
+
+		auto& src = m_lazySources[i];
+		if(m_loadResults[i])
+			m_loadResults[i] = Session::LoadWaveformFile(*pool, m_loadResults[i], src.m_format, src.m_path);
+		m_loadProgress ++;
+	}
+
+	m_loadDone = true;
+}
+
+/**
+	@brief Completes a load started by StartLoading(), if the background thread is done
+
+	Must be called from the GUI thread.
+
+	@return True if a load was completed by this call
+ */
+bool HistoryPoint::FinishLoading()
+{
+	if(!m_loadThread || !m_loadDone)
+		return false;
+
+	m_loadThread->join();
+	m_loadThread = nullptr;
+
+	//Swap in any waveforms which were replaced during loading (e.g. sparse data which turned out to be uniform)
+	for(size_t i=0; i<m_lazySources.size(); i++)
+	{
+		auto& src = m_lazySources[i];
+		auto& slot = m_history[src.m_scope][src.m_stream];
+		if(slot != m_loadResults[i])
+		{
+			delete slot;
+			slot = m_loadResults[i];
+		}
+	}
+	m_loadResults.clear();
+
+	m_lazyResident = !m_cancelLoad;
+	return true;
+}
+
+/**
+	@brief Frees the sample data of a lazily loaded point, so it's reloaded from the file the next time it's needed
+
+	Must not be called while the point is in use.
+ */
+void HistoryPoint::Unload()
+{
+	if(m_lazySources.empty() || IsLoading() || !m_lazyResident)
+		return;
+
+	LogTrace("Unloading sample data for history point %s\n", m_time.PrettyPrint().c_str());
+
+	for(auto& src : m_lazySources)
+	{
+		auto& slot = m_history[src.m_scope][src.m_stream];
+		if(!slot)
+			continue;
+
+		auto stub = CreateEmptyWaveformLike(slot, src.m_format);
+		src.m_size = slot->size();
+		ReleaseWaveform(slot);
+		slot = stub;
+	}
+
+	m_lazyResident = false;
+	m_tier = TIER_GPU;
+}
+
 /**
 	@brief Update all instruments in the specified session with our saved historical data
  */
@@ -101,12 +467,28 @@ void HistoryPoint::LoadHistoryToSession(Session& session)
 	LogTrace("Loading history from time %s to session\n", m_time.PrettyPrint().c_str());
 	LogIndenter li;
 
+	//If we were lazily loaded and the data isn't in memory yet, we need it now
+	session.GetHistory().EnsureLoaded(this);
+
 	//We don't want to keep capturing if we're trying to look at a historical waveform. That would be a bit silly.
 	session.StopTrigger();
 
+	//If we were paged out to disk or host memory, bring everything back before displaying it
+	SetTier(TIER_GPU);
+	session.GetHistory().Expand(this);
+
+	AttachToScopes(session.GetScopes());
+}
+
+/**
+	@brief Sets the data of every channel in the specified scopes to our saved waveforms
+
+	Channels we have no data for are set to null. Our sample data must already be resident.
+ */
+void HistoryPoint::AttachToScopes(const vector<shared_ptr<Oscilloscope>>& scopes)
+{
 	//Go over each scope in the session and load the relevant history
 	//We do this rather than just looping over the scopes in the history so that we can handle missing data.
-	auto scopes = session.GetScopes();
 	LogTrace("We have %zu scopes, this point has data for %zu of them\n", scopes.size(), m_history.size());
 	for(auto scope : scopes)
 	{
@@ -157,6 +539,16 @@ void HistoryPoint::LoadHistoryToSession(Session& session)
 HistoryManager::HistoryManager(Session& session)
 	: m_maxDepth(10)
 	, m_session(session)
+	, m_memoryUsage(0)
+	, m_idBase(1)
+	, m_nextID(1)
+	, m_revision(0)
+	, m_releaseQueue(make_shared<HistoryReleaseQueue>())
+	, m_gpuTierStart(m_history.end())
+	, m_gpuTierBytes(0)
+	, m_hostTierStart(m_history.end())
+	, m_hostTierBytes(0)
+	, m_tierSpill(false)
 {
 }
 
@@ -229,6 +621,25 @@ void HistoryManager::AddHistory(
 	bool pin,
 	string nick,
 	TimePoint refTimeIfNoWaveforms)
+{
+	AddHistoryPoint(CreateHistoryPoint(scopes, pin, nick, refTimeIfNoWaveforms), deleteOld);
+}
+
+/**
+	@brief Creates a new history point from the current waveforms of a set of instruments, without adding it to history
+
+	This does not touch the history list, so it is safe to call from the WaveformThread (with the waveform data mutex
+	held) in order to snapshot an acquisition before the next one replaces it.
+
+	@param scopes		The instruments to add
+	@param pin			True to pin into history
+	@param nick			Nickname
+ */
+shared_ptr<HistoryPoint> HistoryManager::CreateHistoryPoint(
+	const vector<shared_ptr<Oscilloscope>>& scopes,
+	bool pin,
+	string nick,
+	TimePoint refTimeIfNoWaveforms)
 {
 	bool foundTimestamp = false;
 	TimePoint tp(0,0);
@@ -260,14 +671,8 @@ void HistoryManager::AddHistory(
 	if(!foundTimestamp)
 		tp = refTimeIfNoWaveforms;
 
-	//If we already have a history point for the same exact timestamp, do nothing
-	//Either a bug or we're in append mode
-	if(HasHistory(tp))
-		return;
-
-	//All good. Generate a new history point and add it
+	//Generate the new history point
 	auto pt = make_shared<HistoryPoint>();
-	m_history.push_back(pt);
 	pt->m_time = tp;
 	pt->m_pinned = pin;
 	pt->m_nickname = nick;
@@ -289,139 +694,1029 @@ void HistoryManager::AddHistory(
 		pt->m_history[scope] = hist;
 	}
 
-	//TODO: check history size in MB/GB etc
-	//TODO: convert older stuff to disk, free GPU memory, etc?
-	if(deleteOld)
+	return pt;
+}
+
+/**
+	@brief Adds a previously created history point to the history
+
+	@param pt				The point to add
+	@param deleteOld		True to delete old data that rolled off the end of the history buffer
+							Set false when loading waveforms from a session
+	@param applyPolicies	True if this is a live acquisition, which ApplyPolicies() should pin or drop once its
+							mask test and retention results are in
+ */
+void HistoryManager::AddHistoryPoint(shared_ptr<HistoryPoint> pt, bool deleteOld, bool applyPolicies)
+{
+	//If we already have a history point for the same exact timestamp, do nothing
+	//Either a bug or we're in append mode
+	if(HasHistory(pt->m_time))
 	{
-		while(m_history.size() > (size_t) m_maxDepth)
-		{
-			bool deletedSomething = false;
+		//The waveforms are owned by the existing point (or still attached to the scope), not this one.
+		//Forget about them before the point is destroyed so they don't get returned to the pool.
+		pt->m_history.clear();
+		return;
+	}
 
-			//Delete first un-pinned entry
-			for(auto it = m_history.begin(); it != m_history.end(); it++)
-			{
-				auto& point = (*it);
-				if(point->m_pinned)
-					continue;
-				if(!m_session.GetMarkers(point->m_time).empty())
-					continue;
+	//All good, add it
+	//(and pick up any change to the pool size while we're at it)
+	auto& pool = m_session.GetWaveformPool();
+	pool.SetMaxSize(m_session.GetPreferences().GetReal("Performance.History.waveform_pool_size"));
+	pt->m_waveformPool = &pool;
+	TrackWaveforms(pt.get());
+	m_history.push_back(pt);
+	m_index[pt->m_time] = prev(m_history.end());
+	pt->m_id = m_nextID ++;
+	m_idIndex.push_back(prev(m_history.end()));
+	m_revision ++;
+	m_evictionQueue.push_back(prev(m_history.end()));
+	pt->m_evictionIt = prev(m_evictionQueue.end());
+	pt->m_evictionHeld = false;
+	atomic_store(&pt->m_releaseQueue, m_releaseQueue);
+	if(applyPolicies)
+		m_policyPending.push_back(pt);
 
-				//With multiple trigger groups at different rates, we might have the most recent trigger for a scope
-				//roll to the start of the history queue. Don't delete that!!
-				if(point->IsInUse())
-					continue;
+	//The newest point always starts out in both tiers (UpdateTiers() pushes it out if it alone is over budget)
+	pt->m_memoryUsage = 0;
+	if(m_gpuTierStart == m_history.end())
+		m_gpuTierStart = prev(m_history.end());
+	if(m_hostTierStart == m_history.end())
+		m_hostTierStart = prev(m_history.end());
+	SetPointMemoryUsage(pt.get(), pt->GetMemoryUsage());
 
-				m_session.RemoveMarkers(point->m_time);
-				m_session.RemovePackets(point->m_time);
-				m_history.erase(it);
-				deletedSomething = true;
-				break;
-			}
+	//Pick up any points which readers let go of since last time
+	ProcessReleases();
 
-			//If nothing deleted, all remaining items are pinned. Stop.
-			if(!deletedSomething)
+	//Shrink what's no longer current before deciding how much history fits
+	CompactHistory();
+
+	if(deleteOld)
+	{
+		double budget = GetMemoryBudget();
+		while( (m_history.size() > (size_t) m_maxDepth) || (m_memoryUsage > budget) )
+		{
+			//If nothing can be deleted, all remaining items are pinned or in use. Stop.
+			auto it = FindPointToEvict();
+			if(it == m_history.end())
 				break;
+
+			m_session.RemoveMarkers((*it)->m_time);
+			m_session.RemovePackets((*it)->m_time);
+			erase(it);
 		}
+
+		//Move older points to slower memory to make room for new ones
+		UpdateTiers();
 	}
 }
 
 /**
-	@brief Gets the timestamp of the most recent waveform
- */
-TimePoint HistoryManager::GetMostRecentPoint()
-{
-	if(m_history.empty())
-		return TimePoint(0, 0);
-	else
-		return (*m_history.rbegin())->m_time;
-}
+	@brief Sets up a point added from a saved session to be lazily loaded
 
-/**
-	@brief Gets the history point for a specific timestamp
+	Streams of the scope which have no data in the file would otherwise still reference the last waveform loaded
+	for them, which is another point's placeholder, so they're cleared.
+
+	@param pt		The point, which must already be in history
+	@param scope	Instrument the sources belong to
+	@param sources	Sample data files for each stream of the instrument that has data at this point
  */
-shared_ptr<HistoryPoint> HistoryManager::GetHistory(TimePoint t)
+void HistoryManager::AddLazySources(
+	shared_ptr<HistoryPoint> pt,
+	shared_ptr<Oscilloscope> scope,
+	const vector<LazyWaveformSource>& sources)
 {
-	for(auto it : m_history)
+	auto hit = pt->m_history.find(scope);
+	if(hit == pt->m_history.end())
+		return;
+	auto& hist = hit->second;
+
+	set<StreamDescriptor> streams;
+	for(auto& src : sources)
+		streams.emplace(src.m_stream);
+
+	for(auto& it : hist)
 	{
-		if(it->m_time == t)
-			return it;
+		auto wfm = it.second;
+		if(!wfm)
+			continue;
+
+		//Placeholders are swapped out on every load, so stop tracking ours
+		if(streams.find(it.first) != streams.end())
+			m_trackedWaveforms.erase(wfm);
+
+		//Clear stale references to anyone else's.
+		//If nobody else is tracking it, it's an earlier point's placeholder.
+		else
+		{
+			if(!UntrackWaveform(pt.get(), wfm))
+				m_trackedWaveforms.erase(wfm);
+			pt->m_borrowedWaveforms.erase(wfm);
+			it.second = nullptr;
+		}
 	}
 
-	return nullptr;
+	pt->m_lazySources.insert(pt->m_lazySources.end(), sources.begin(), sources.end());
 }
 
 /**
-	@brief Checks if we have a history point for a specific timestamp
+	@brief Starts tracking the waveforms of a newly added point, sharing any which are already in history
+
+	If a scope didn't trigger again (e.g. a secondary in a group where only the primary re-armed), or a channel is
+	only updated occasionally, its streams still hold the waveform from an earlier acquisition. Rather than managing
+	the same buffer once per point, the newest point referencing it owns it and older ones borrow it.
  */
-bool HistoryManager::HasHistory(TimePoint t)
+void HistoryManager::TrackWaveforms(HistoryPoint* pt)
 {
-	for(auto it : m_history)
+	for(auto& it : pt->m_history)
 	{
-		if(it->m_time == t)
-			return true;
-	}
+		for(auto& jt : it.second)
+		{
+			auto wfm = jt.second;
+			if(!wfm)
+				continue;
 
-	return false;
+			auto& tracked = m_trackedWaveforms[wfm];
+			if(tracked.m_holders.empty())
+				tracked.m_bytes = WaveformPool::GetWaveformMemoryUsage(wfm);
+
+			//Already in history: take it over from the previous owner and keep it in our tier
+			else
+			{
+				auto prevOwner = tracked.m_holders.back();
+				if(prevOwner == pt)
+					continue;
+
+				prevOwner->m_borrowedWaveforms.emplace(wfm);
+				SetPointMemoryUsage(prevOwner, prevOwner->m_memoryUsage - tracked.m_bytes);
+				if(prevOwner->m_tier != pt->m_tier)
+					HistoryPoint::SetWaveformTier(wfm, pt->m_tier);
+			}
+
+			tracked.m_holders.push_back(pt);
+		}
+	}
 }
 
 /**
-	@brief Called when we run out of memory
+	@brief Removes one point's reference to a tracked waveform
+
+	If the point owned the waveform, ownership passes to the next newest point referencing it.
+
+	@return True if other points still reference the waveform, in which case it's marked as borrowed so the point
+			doesn't free it
  */
-bool HistoryManager::OnMemoryPressure(
-	[[maybe_unused]] MemoryPressureLevel level,
-	MemoryPressureType type,
-	[[maybe_unused]] size_t requestedSize)
+bool HistoryManager::UntrackWaveform(HistoryPoint* pt, WaveformBase* wfm)
 {
-	LogDebug("HistoryManager::OnMemoryPressure\n");
-	LogIndenter li;
+	auto it = m_trackedWaveforms.find(wfm);
+	if(it == m_trackedWaveforms.end())
+		return false;
+
+	auto& tracked = it->second;
+	auto& holders = tracked.m_holders;
+	auto jt = std::find(holders.begin(), holders.end(), pt);
+	if(jt == holders.end())
+		return false;
+	bool owner = (jt == prev(holders.end()));
+	holders.erase(jt);
 
-	//For now, only free GPU memory in case of pressure here
-	if(type != MemoryPressureType::Device)
+	if(holders.empty())
+	{
+		m_trackedWaveforms.erase(it);
 		return false;
+	}
+
+	pt->m_borrowedWaveforms.emplace(wfm);
+	if(owner)
+	{
+		auto next = holders.back();
+		next->m_borrowedWaveforms.erase(wfm);
+		SetPointMemoryUsage(pt, pt->m_memoryUsage - tracked.m_bytes);
+		SetPointMemoryUsage(next, next->m_memoryUsage + tracked.m_bytes);
+		if(next->m_tier != pt->m_tier)
+			HistoryPoint::SetWaveformTier(wfm, next->m_tier);
+	}
+	return true;
+}
+
+/**
+	@brief Removes a point from history, regardless of whether it's pinned
 
-	//Try to lock the waveform data mutex for up to 250ms
-	auto& mutex = m_session.GetWaveformDataMutex();
-	double end = GetTime() + 0.25;
-	bool gotMutex = false;
-	while(GetTime() < end)
+	Markers and packets for the point are not removed, the caller is responsible for this if needed.
+ */
+void HistoryManager::erase(HistoryIterator it)
+{
+	auto& pt = *it;
+	for(auto& hit : pt->m_history)
 	{
-		if(mutex.try_lock())
+		for(auto& jt : hit.second)
 		{
-			gotMutex = true;
-			break;
+			if(jt.second)
+				UntrackWaveform(pt.get(), jt.second);
 		}
 	}
-	if(!gotMutex)
+
+	SetPointMemoryUsage(pt.get(), 0);
+	if(m_gpuTierStart == it)
+		m_gpuTierStart = next(it);
+	if(m_hostTierStart == it)
+		m_hostTierStart = next(it);
+	m_tierDeferred.erase(pt->m_id);
+	m_lazyLRU.remove(pt.get());
+	if(pt->m_evictionHeld)
+		m_evictionHeld.erase(pt->m_evictionIt);
+	else
+		m_evictionQueue.erase(pt->m_evictionIt);
+	m_index.erase(pt->m_time);
+	m_idIndex[pt->m_id - m_idBase] = m_history.end();
+	while(!m_idIndex.empty() && (m_idIndex.front() == m_history.end()) )
 	{
-		LogDebug("Failed to lock waveform data mutex\n");
-		return false;
+		m_idIndex.pop_front();
+		m_idBase ++;
 	}
-	LogDebug("Got waveform data mutex, freeing GPU memory of all old points\n");
+	m_history.erase(it);
+	m_revision ++;
+}
 
-	auto mostRecent = GetMostRecentPoint();
+/**
+	@brief Pins or drops live points according to their mask test and retention policy results
 
-	//Go through historical waveforms and free memory
-	bool memFreed = false;
-	for(auto& pt : m_history)
+	Results are filled in by the WaveformThread once the filter graph has run on a point, which in pipelined mode may
+	be after the point was added to history, so this is re-checked every time new waveforms come in. Points are only
+	dropped once something newer has been added, so the acquisition on screen always stays put.
+
+	A point is kept if anything asks to keep it, even if something else would drop it.
+ */
+void HistoryManager::ApplyPolicies()
+{
+	auto& prefs = m_session.GetPreferences();
+	auto maskPolicy = static_cast<MaskFailPolicy>(prefs.GetEnumRaw("Miscellaneous.Mask Testing.history_policy"));
+	auto newest = GetMostRecentPoint();
+
+	deque<shared_ptr<HistoryPoint>> pending;
+	for(auto& pt : m_policyPending)
 	{
-		if(pt->m_time == mostRecent)
+		int mask = pt->m_maskTestResult;
+		int retention = pt->m_retentionDecision;
+		if( (mask == HistoryPoint::MASK_UNTESTED) || (retention == RetentionPolicy::DECISION_UNDECIDED) )
+		{
+			pending.push_back(pt);
 			continue;
+		}
 
-		for(auto& it : pt->m_history)
+		bool maskPin = (mask == HistoryPoint::MASK_FAIL) && (maskPolicy != MASK_FAIL_KEEP_ALL);
+		bool retentionPin = (retention == RetentionPolicy::DECISION_PIN);
+		if(maskPin || retentionPin)
 		{
-			auto& hist = it.second;
-			for(auto jt : hist)
+			pt->m_pinned = true;
+			if(pt->m_nickname.empty())
 			{
-				if(jt.second->HasGpuBuffer())
-				{
-					memFreed = true;
-					jt.second->FreeGpuMemory();
-				}
+				if(maskPin)
+					pt->m_nickname = string("Mask fail (") + to_string(pt->m_maskHits) + " hits)";
+				else
+					pt->m_nickname = pt->m_retentionReason;
 			}
+			continue;
+		}
+
+		bool keep =
+			(mask == HistoryPoint::MASK_FAIL) ||
+			(retention == RetentionPolicy::DECISION_KEEP);
+		bool drop =
+			( (mask == HistoryPoint::MASK_PASS) && (maskPolicy == MASK_FAIL_ONLY) ) ||
+			(retention == RetentionPolicy::DECISION_DROP);
+		if(keep || !drop)
+			continue;
+
+		if(pt->m_time == newest)
+			pending.push_back(pt);
+		else
+			DiscardPoint(pt);
+	}
+	m_policyPending.swap(pending);
+}
+
+/**
+	@brief Deletes a single point right away, if it's one we would be allowed to evict
+
+	@return True if the point was deleted
+ */
+bool HistoryManager::DiscardPoint(shared_ptr<HistoryPoint> pt)
+{
+	if(!CanEvict(pt))
+		return false;
+
+	auto it = find(pt->m_time);
+	if( (it == m_history.end()) || (*it != pt) )
+		return false;
+
+	m_session.RemovePackets(pt->m_time);
+	erase(it);
+	return true;
+}
+
+/**
+	@brief Returns true if a point may be automatically deleted to make room for new data
+ */
+bool HistoryManager::CanEvict(shared_ptr<HistoryPoint> point)
+{
+	if(point->m_pinned)
+		return false;
+	if(point->IsLoading())
+		return false;
+	if(m_session.HasMarkers(point->m_time))
+		return false;
+
+	//With multiple trigger groups at different rates, we might have the most recent trigger for a scope
+	//roll to the start of the history queue. Don't delete that!!
+	if(point->IsInUse())
+		return false;
+
+	return true;
+}
+
+/**
+	@brief Finds the oldest point which can be automatically deleted
+
+	Points which are found to be ineligible when they reach the front of the eviction queue are moved to the held
+	list, so each point is only skipped over once rather than on every new acquisition. Reconsider() moves them back
+	once they're unpinned or their last reader lets go.
+
+	@return Iterator to the point, or m_history.end() if there's nothing we can delete
+ */
+HistoryIterator HistoryManager::FindPointToEvict()
+{
+	//Holds that go away without telling us (e.g. markers being deleted) are only noticed at the front of the list
+	if(!m_evictionHeld.empty() && CanEvict(*m_evictionHeld.front()))
+	{
+		if(m_evictionQueue.empty() || ((*m_evictionHeld.front())->m_id < (*m_evictionQueue.front())->m_id) )
+			return m_evictionHeld.front();
+	}
+
+	while(!m_evictionQueue.empty())
+	{
+		auto it = m_evictionQueue.front();
+		if(CanEvict(*it))
+			return it;
+
+		//Not eligible, move it to the held list. Keep that in age order, since Reconsider() may have taken points
+		//out of it which are older than this one.
+		auto pos = m_evictionHeld.end();
+		while( (pos != m_evictionHeld.begin()) && ((**prev(pos))->m_id > (*it)->m_id) )
+			pos --;
+		m_evictionHeld.splice(pos, m_evictionQueue, m_evictionQueue.begin());
+		(*it)->m_evictionHeld = true;
+	}
+
+	//Queue is empty, so the only candidates left are held points other than the oldest.
+	//This is a linear search, but we only get here if the entire history is pinned or in use.
+	for(auto it : m_evictionHeld)
+	{
+		if(CanEvict(*it))
+			return it;
+	}
+
+	return m_history.end();
+}
+
+/**
+	@brief Reconsiders every point whose last reader let go since the last call
+ */
+void HistoryManager::ProcessReleases()
+{
+	for(auto id : m_releaseQueue->Take())
+	{
+		auto pt = GetHistoryByID(id);
+		if(pt)
+			Reconsider(pt.get());
+	}
+}
+
+/**
+	@brief Evicts or demotes a point later, if that had been held off by something which no longer applies
+
+	Call when a point is unpinned. Points whose last reader lets go are picked up automatically.
+ */
+void HistoryManager::Reconsider(HistoryPoint* pt)
+{
+	if(pt->m_id == 0)
+		return;
+
+	//Back into the eviction queue, in age order. Everything still in the queue is usually newer, so this is quick.
+	if(pt->m_evictionHeld && CanEvict(*(*pt->m_evictionIt)))
+	{
+		auto pos = m_evictionQueue.begin();
+		while( (pos != m_evictionQueue.end()) && ((**pos)->m_id < pt->m_id) )
+			pos ++;
+		m_evictionQueue.splice(pos, m_evictionHeld, pt->m_evictionIt);
+		pt->m_evictionHeld = false;
+	}
+
+	//Catch up on any demotion we had to skip
+	Demote(pt, GetTargetTier(pt));
+}
+
+/**
+	@brief Starts loading a lazily loaded point's sample data in the background
+
+	Call PollLoads() every frame to complete the load once the data is ready.
+ */
+void HistoryManager::StartLoading(shared_ptr<HistoryPoint> pt)
+{
+	if(pt->IsResident() || pt->IsLoading())
+		return;
+
+	pt->StartLoading(m_session.GetTaskPool());
+	m_lazyLRU.remove(pt.get());
+	m_lazyLRU.push_front(pt.get());
+}
+
+/**
+	@brief Starts loading the lazily loaded points on either side of a point, so stepping through history doesn't
+	have to wait for the disk
+
+	Nearest points are loaded first. Nothing is prefetched once history is over its memory budget, and the number of
+	points is limited so prefetched points don't push each other (or the selected point) out of the resident cache.
+ */
+void HistoryManager::PrefetchNeighbors(shared_ptr<HistoryPoint> pt)
+{
+	auto& prefs = m_session.GetPreferences();
+	int64_t cap = max((int64_t)1, prefs.GetInt("Files.lazy_resident_points"));
+	int64_t depth = min(prefs.GetInt("Files.lazy_prefetch_points"), (cap - 1) / 2);
+	if(depth <= 0)
+		return;
+
+	auto found = m_index.find(pt->m_time);
+	if( (found == m_index.end()) || (*found->second != pt) )
+		return;
+	auto center = found->second;
+
+	double budget = GetMemoryBudget();
+	auto before = center;
+	auto after = center;
+	for(int64_t i=0; i<depth; i++)
+	{
+		if(after != m_history.end())
+			after ++;
+		if( (after != m_history.end()) && (m_memoryUsage < budget) )
+			StartLoading(*after);
+
+		if(before != m_history.begin())
+		{
+			before --;
+			if(m_memoryUsage < budget)
+				StartLoading(*before);
+		}
+	}
+}
+
+/**
+	@brief Makes sure a point's sample data is in memory, loading it (and blocking until done) if needed
+
+	@param pt			The point to load
+	@param enforceCap	True to unload other points if we're over the resident point limit.
+						Set false if the caller is still using waveforms from other points.
+ */
+void HistoryManager::EnsureLoaded(HistoryPoint* pt, bool enforceCap)
+{
+	//Nothing to do for points that were never lazily loaded
+	if(pt->m_lazySources.empty())
+		return;
+
+	if(!pt->IsResident())
+	{
+		pt->StartLoading(m_session.GetTaskPool());
+		while(!pt->FinishLoading())
+			this_thread::sleep_for(chrono::milliseconds(1));
+		OnPointLoaded(pt);
+	}
+
+	//Mark as most recently used
+	m_lazyLRU.remove(pt);
+	m_lazyLRU.push_front(pt);
+
+	if(enforceCap)
+		EnforceResidentCap();
+}
+
+/**
+	@brief Completes any background loads which have finished
+
+	@return True if at least one load completed
+ */
+bool HistoryManager::PollLoads()
+{
+	bool done = false;
+	for(auto pt : m_lazyLRU)
+	{
+		if(pt->FinishLoading())
+		{
+			OnPointLoaded(pt);
+			done = true;
+		}
+	}
+
+	if(done)
+		EnforceResidentCap();
+	return done;
+}
+
+/**
+	@brief Updates memory accounting after a point's sample data was loaded
+ */
+void HistoryManager::OnPointLoaded(HistoryPoint* pt)
+{
+	UpdatePointMemoryUsage(pt);
+}
+
+/**
+	@brief Recomputes the memory usage of a point after the amount of sample data it holds changed
+ */
+void HistoryManager::UpdatePointMemoryUsage(HistoryPoint* pt)
+{
+	SetPointMemoryUsage(pt, pt->GetMemoryUsage());
+}
+
+/**
+	@brief Changes the memory usage of a point in history, keeping the totals for history and each tier in sync
+ */
+void HistoryManager::SetPointMemoryUsage(HistoryPoint* pt, size_t bytes)
+{
+	double delta = (double)bytes - (double)pt->m_memoryUsage;
+	m_memoryUsage = m_memoryUsage - pt->m_memoryUsage + bytes;
+	if(InTier(pt, m_gpuTierStart))
+		m_gpuTierBytes += delta;
+	if(InTier(pt, m_hostTierStart))
+		m_hostTierBytes += delta;
+	pt->m_memoryUsage = bytes;
+}
+
+/**
+	@brief Unloads the least recently used lazily loaded points until we're within the configured limit
+
+	Points which are loading or currently displayed are never unloaded.
+ */
+void HistoryManager::EnforceResidentCap()
+{
+	size_t cap = max((int64_t)1, m_session.GetPreferences().GetInt("Files.lazy_resident_points"));
+
+	size_t count = 0;
+	for(auto it = m_lazyLRU.begin(); it != m_lazyLRU.end(); )
+	{
+		auto pt = *it;
+		count ++;
+
+		if( (count > cap) && !pt->IsLoading() && !pt->IsInUse() )
+		{
+			pt->Unload();
+			SetPointMemoryUsage(pt, 0);
+			it = m_lazyLRU.erase(it);
+		}
+		else
+			it ++;
+	}
+}
+
+/**
+	@brief Gets the amount of sample data history may contain before old points are deleted
+
+	If spilling to disk is disabled, this is the sum of the GPU and host tier budgets.
+ */
+double HistoryManager::GetMemoryBudget()
+{
+	auto& prefs = m_session.GetPreferences();
+	if(prefs.GetBool("Performance.History.spill_to_disk"))
+		return prefs.GetReal("Performance.History.max_size");
+
+	double gpuBudget;
+	double hostBudget;
+	GetTierBudgets(gpuBudget, hostBudget);
+	return gpuBudget + hostBudget;
+}
+
+/**
+	@brief Gets the GPU and host tier budgets, clamped to what the Vulkan driver reports is available on each heap
+ */
+void HistoryManager::GetTierBudgets(double& gpuBudget, double& hostBudget)
+{
+	auto& prefs = m_session.GetPreferences();
+	gpuBudget = prefs.GetReal("Performance.History.gpu_budget");
+	hostBudget = prefs.GetReal("Performance.History.host_budget");
+
+	if(!g_hasMemoryBudget)
+		return;
+
+	auto properties = g_vkComputePhysicalDevice->getMemoryProperties2<
+		vk::PhysicalDeviceMemoryProperties2,
+		vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+	auto membudget = std::get<1>(properties);
+	double frac = prefs.GetReal("Performance.History.heap_fraction");
+
+	//GPU tier lives in device local memory, if we have any separate from host memory
+	if(!g_vulkanDeviceHasUnifiedMemory)
+		gpuBudget = min(gpuBudget, membudget.heapBudget[g_vkLocalMemoryHeap] * frac);
+
+	//Both tiers need space in pinned memory (the GPU tier for the CPU-side copy of mirrored buffers)
+	double pinnedBudget = membudget.heapBudget[g_vkPinnedMemoryHeap] * frac;
+	gpuBudget = min(gpuBudget, pinnedBudget);
+	hostBudget = min(hostBudget, pinnedBudget - gpuBudget);
+}
+
+/**
+	@brief Moves older history points to slower memory tiers according to the configured budgets
+
+	Walking from the newest point to the oldest, points are kept in GPU-accessible memory until the GPU budget is
+	used up, then in pinned host memory until the host budget is used up. Anything older than that is moved to
+	file-backed memory, if enabled.
+
+	Rather than walking the history every time, we keep track of where each budget runs out (m_gpuTierStart and
+	m_hostTierStart) and only move those boundaries, so the cost is proportional to the number of points changing
+	tiers.
+
+	Points are only ever demoted here. A point is promoted back to the GPU tier when it's loaded to the session.
+ */
+void HistoryManager::UpdateTiers()
+{
+	double gpuBudget;
+	double hostBudget;
+	GetTierBudgets(gpuBudget, hostBudget);
+	hostBudget += gpuBudget;
+	bool spill = m_session.GetPreferences().GetBool("Performance.History.spill_to_disk");
+
+	//Turning spilling on moves everything past the host budget, so start over
+	if(spill != m_tierSpill)
+	{
+		m_tierSpill = spill;
+		RebuildTiers(gpuBudget, hostBudget);
+		return;
+	}
+
+	MoveTierBoundary(m_gpuTierStart, m_gpuTierBytes, gpuBudget, HistoryPoint::TIER_HOST);
+	MoveTierBoundary(m_hostTierStart, m_hostTierBytes, hostBudget,
+		spill ? HistoryPoint::TIER_DISK : HistoryPoint::TIER_HOST);
+
+	//Retry anything which was being displayed last time. There are only ever a handful of these.
+	set<uint64_t> deferred;
+	deferred.swap(m_tierDeferred);
+	for(auto id : deferred)
+	{
+		auto pt = GetHistoryByID(id);
+		if(pt)
+			Demote(pt.get(), GetTargetTier(pt.get()));
+	}
+}
+
+/**
+	@brief Gets the tier a point belongs in, given where the tier boundaries currently are
+ */
+HistoryPoint::Tier HistoryManager::GetTargetTier(HistoryPoint* pt)
+{
+	if(!InTier(pt, m_hostTierStart))
+		return m_tierSpill ? HistoryPoint::TIER_DISK : HistoryPoint::TIER_HOST;
+	if(!InTier(pt, m_gpuTierStart))
+		return HistoryPoint::TIER_HOST;
+	return HistoryPoint::TIER_GPU;
+}
+
+/**
+	@brief Moves a point to a slower tier, unless it's already there or in use
+
+	Points held by readers are picked up again by Reconsider() when the last one lets go. Points which are attached
+	to a scope are retried on every UpdateTiers() until they aren't.
+ */
+void HistoryManager::Demote(HistoryPoint* pt, HistoryPoint::Tier tier)
+{
+	if(tier <= pt->m_tier)
+		return;
+
+	//Don't move anything that's currently being displayed
+	if(pt->IsInUse())
+	{
+		if(pt->m_readerRefs == 0)
+			m_tierDeferred.emplace(pt->m_id);
+		return;
+	}
+
+	pt->SetTier(tier);
+}
+
+/**
+	@brief Moves a tier boundary so the points from it to the newest fit in the budget, demoting what falls off
+
+	@param start	Oldest point in the tier
+	@param bytes	Total memory usage of start and every newer point
+	@param budget	Size of the tier
+	@param demoteTo	Tier to move points which no longer fit to
+ */
+void HistoryManager::MoveTierBoundary(
+	HistoryIterator& start,
+	double& bytes,
+	double budget,
+	HistoryPoint::Tier demoteTo)
+{
+	//If the budget grew, take back older points which fit again. They keep whatever tier they're in already.
+	while(start != m_history.begin())
+	{
+		auto p = prev(start);
+		if(bytes + (*p)->m_memoryUsage > budget)
+			break;
+		start = p;
+		bytes += (*p)->m_memoryUsage;
+	}
+
+	//Push out the oldest points until the rest fit
+	while( (start != m_history.end()) && (bytes > budget) )
+	{
+		Demote(start->get(), demoteTo);
+		bytes -= (*start)->m_memoryUsage;
+		start ++;
+	}
+}
+
+/**
+	@brief Recomputes both tier boundaries from scratch, demoting every point past them
+
+	This walks the entire history, so it's only done when the spill_to_disk preference changes.
+ */
+void HistoryManager::RebuildTiers(double gpuBudget, double hostBudget)
+{
+	m_gpuTierStart = m_history.end();
+	m_hostTierStart = m_history.end();
+	m_gpuTierBytes = 0;
+	m_hostTierBytes = 0;
+	m_tierDeferred.clear();
+
+	double total = 0;
+	for(auto it = m_history.begin(); it != m_history.end(); it++)
+		total += (*it)->m_memoryUsage;
+
+	//Oldest points first, so the boundaries end up on the oldest point which fits
+	for(auto it = m_history.begin(); it != m_history.end(); it++)
+	{
+		auto pt = it->get();
+		if( (m_hostTierStart == m_history.end()) && (total <= hostBudget) )
+		{
+			m_hostTierStart = it;
+			m_hostTierBytes = total;
+		}
+		if( (m_gpuTierStart == m_history.end()) && (total <= gpuBudget) )
+		{
+			m_gpuTierStart = it;
+			m_gpuTierBytes = total;
+		}
+		Demote(pt, GetTargetTier(pt));
+		total -= pt->m_memoryUsage;
+	}
+}
+
+/**
+	@brief Stores the analog waveforms of every point except the newest as integer codes, if enabled
+
+	Only points that aren't displayed or in use are compacted, and each is only checked once until it's expanded
+	again. Lazily loaded points are skipped since they can be reloaded from the file instead.
+ */
+void HistoryManager::CompactHistory()
+{
+	if(!m_session.GetPreferences().GetBool("Performance.History.compact_samples"))
+		return;
+	if(m_history.size() < 2)
+		return;
+
+	for(auto it = m_history.begin(); it != prev(m_history.end()); it++)
+	{
+		auto pt = it->get();
+		if(pt->m_compactChecked || !pt->m_lazySources.empty() || pt->IsInUse())
+			continue;
+		CompactPoint(pt);
+	}
+}
+
+/**
+	@brief Stores the analog waveforms of one point as integer codes, where they're exactly representable
+ */
+void HistoryManager::CompactPoint(HistoryPoint* pt)
+{
+	pt->m_compactChecked = true;
+
+	if(!m_compactor)
+		m_compactor = make_unique<HistoryCompactor>(m_session.GetTaskPool());
+
+	for(auto& it : pt->m_history)
+	{
+		for(auto& jt : it.second)
+		{
+			auto wfm = dynamic_cast<UniformAnalogWaveform*>(jt.second);
+			if(!wfm || (pt->m_borrowedWaveforms.find(wfm) != pt->m_borrowedWaveforms.end()) )
+				continue;
+
+			//Waveforms shared with other points could be displayed through them, so leave those alone
+			auto tit = m_trackedWaveforms.find(wfm);
+			if( (tit != m_trackedWaveforms.end()) && (tit->second.m_holders.size() > 1) )
+				continue;
+
+			auto compact = make_unique<CompactSamples>();
+			SetBufferTier(compact->m_codes8, pt->m_tier);
+			SetBufferTier(compact->m_codes16, pt->m_tier);
+			if(!m_compactor->Compact(wfm, *compact))
+				continue;
+
+			if(tit != m_trackedWaveforms.end())
+				tit->second.m_bytes = compact->GetMemoryUsage();
+			pt->m_compactSamples[wfm] = std::move(compact);
 		}
 	}
 
-	//Done
-	mutex.unlock();
-	return memFreed;
+	if(pt->IsCompacted())
+	{
+		size_t before = pt->m_memoryUsage;
+		UpdatePointMemoryUsage(pt);
+		LogTrace("Compacted history point %s from %zu to %zu bytes\n",
+			pt->m_time.PrettyPrint().c_str(), before, pt->m_memoryUsage);
+	}
+}
+
+/**
+	@brief Converts any compacted waveforms of a point back to float samples
+
+	Conversion is done on the GPU if the point is in the GPU tier, so call this after promoting the point if it's
+	about to be displayed.
+ */
+void HistoryManager::Expand(HistoryPoint* pt)
+{
+	if(!pt->IsCompacted())
+		return;
+
+	bool gpu = (pt->m_tier == HistoryPoint::TIER_GPU);
+	for(auto& it : pt->m_compactSamples)
+	{
+		auto wfm = static_cast<UniformAnalogWaveform*>(it.first);
+		m_compactor->Expand(wfm, *it.second, gpu);
+
+		auto tit = m_trackedWaveforms.find(wfm);
+		if(tit != m_trackedWaveforms.end())
+			tit->second.m_bytes = WaveformPool::GetWaveformMemoryUsage(wfm);
+	}
+	pt->m_compactSamples.clear();
+	pt->m_compactChecked = false;
+
+	UpdatePointMemoryUsage(pt);
+}
+
+/**
+	@brief Gets the timestamp of the most recent waveform
+ */
+TimePoint HistoryManager::GetMostRecentPoint()
+{
+	if(m_history.empty())
+		return TimePoint(0, 0);
+	else
+		return (*m_history.rbegin())->m_time;
+}
+
+/**
+	@brief Gets the history point for a specific timestamp
+ */
+shared_ptr<HistoryPoint> HistoryManager::GetHistory(TimePoint t)
+{
+	auto it = m_index.find(t);
+	if(it == m_index.end())
+		return nullptr;
+	return *it->second;
+}
+
+/**
+	@brief Gets the position of the history point for a specific timestamp
+
+	@return Iterator to the point, or m_history.end() if there's no point at that time
+ */
+HistoryIterator HistoryManager::find(TimePoint t)
+{
+	auto it = m_index.find(t);
+	if(it == m_index.end())
+		return m_history.end();
+	return it->second;
+}
+
+/**
+	@brief Checks if we have a history point for a specific timestamp
+ */
+bool HistoryManager::HasHistory(TimePoint t)
+{
+	return (m_index.find(t) != m_index.end());
+}
+
+/**
+	@brief Gets the history point with a given ID
+
+	@return The point, or null if it's no longer in history
+ */
+shared_ptr<HistoryPoint> HistoryManager::GetHistoryByID(uint64_t id)
+{
+	if( (id < m_idBase) || (id - m_idBase >= m_idIndex.size()) )
+		return nullptr;
+
+	auto it = m_idIndex[id - m_idBase];
+	if(it == m_history.end())
+		return nullptr;
+	return *it;
+}
+
+/**
+	@brief Gets the ID of the history point for a specific timestamp
+
+	@return The ID, or zero if there's no point at that time
+ */
+uint64_t HistoryManager::GetHistoryID(TimePoint t)
+{
+	auto it = m_index.find(t);
+	if(it == m_index.end())
+		return 0;
+	return (*it->second)->m_id;
+}
+
+/**
+	@brief Gets the tier old points get demoted to, to relieve a given type of memory pressure
+
+	@return True if demoting points can do anything about it
+ */
+bool HistoryManager::GetDemotionTier(MemoryPressureType type, HistoryPoint::Tier& target)
+{
+	//Host memory pressure can only be relieved by moving old waveforms to file-backed memory
+	bool spill = m_session.GetPreferences().GetBool("Performance.History.spill_to_disk");
+	if( (type == MemoryPressureType::Host) && !spill)
+		return false;
+
+	target = (type == MemoryPressureType::Host) ? HistoryPoint::TIER_DISK : HistoryPoint::TIER_HOST;
+	return true;
+}
+
+/**
+	@brief Checks if a point can be demoted to relieve memory pressure
+ */
+bool HistoryManager::CanDemote(shared_ptr<HistoryPoint> pt, HistoryPoint::Tier target, TimePoint mostRecent)
+{
+	if(pt->m_time == mostRecent)
+		return false;
+
+	//Background readers use the sample data without any lock that would stop us moving it
+	if(pt->m_readerRefs > 0)
+		return false;
+
+	//Points still attached to a scope can give up their GPU memory, but shouldn't be paged out
+	if( (target == HistoryPoint::TIER_DISK) && pt->IsInUse() )
+		return false;
+
+	return (pt->m_tier < target);
+}
+
+/**
+	@brief Gets the amount of memory of a given type which could be freed by demoting old points
+ */
+size_t HistoryManager::GetReclaimableMemory(MemoryPressureType type)
+{
+	HistoryPoint::Tier target;
+	if(!GetDemotionTier(type, target))
+		return 0;
+
+	auto mostRecent = GetMostRecentPoint();
+	size_t bytes = 0;
+	for(auto& pt : m_history)
+	{
+		if(CanDemote(pt, target, mostRecent))
+			bytes += pt->m_memoryUsage;
+	}
+	return bytes;
+}
+
+/**
+	@brief Moves old points to slower memory, oldest first, until at least the requested amount has been freed
+
+	The caller must hold the waveform data mutex.
+
+	@param type		Type of memory to free
+	@param bytes	Number of bytes to free
+	@param freed	Set to the number of bytes of sample data which were demoted
+
+	@return True if any points were demoted
+ */
+bool HistoryManager::ReclaimMemory(MemoryPressureType type, size_t bytes, size_t& freed)
+{
+	freed = 0;
+
+	HistoryPoint::Tier target;
+	if(!GetDemotionTier(type, target))
+		return false;
+
+	auto mostRecent = GetMostRecentPoint();
+	for(auto& pt : m_history)
+	{
+		if(freed >= bytes)
+			break;
+		if(!CanDemote(pt, target, mostRecent))
+			continue;
+
+		freed += pt->m_memoryUsage;
+		pt->SetTier(target);
+	}
+
+	return (freed > 0);
 }
@@ -35,11 +35,131 @@
 #ifndef HistoryManager_h
 #define HistoryManager_h
 
+#include "HistoryCompactor.h"
+#include "HistoryRetention.h"
 #include "Marker.h"
+#include "WaveformPool.h"
+
+#include <unordered_map>
 
 //Waveform history for a single instrument
 typedef std::map<StreamDescriptor, WaveformBase*> WaveformHistory;
 
+class HistoryPoint;
+class TaskPool;
+
+//Position of a point in the history list
+typedef std::list<std::shared_ptr<HistoryPoint>>::iterator HistoryIterator;
+
+/**
+	@brief IDs of history points whose last reader (see HistoryPoint::m_readerRefs) let go
+
+	Readers run on all sorts of threads, so they post here and the HistoryManager picks the IDs up on its own
+	thread. Shared with the points so it stays valid if a reader outlives the manager.
+ */
+class HistoryReleaseQueue
+{
+public:
+	void Post(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_ids.push_back(id);
+	}
+
+	std::vector<uint64_t> Take()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<uint64_t> ret;
+		ret.swap(m_ids);
+		return ret;
+	}
+
+protected:
+	std::mutex m_mutex;
+	std::vector<uint64_t> m_ids;
+};
+
+/**
+	@brief Location of sample data for a waveform in a saved session which hasn't been loaded yet
+ */
+class LazyWaveformSource
+{
+public:
+	LazyWaveformSource(
+		std::shared_ptr<Oscilloscope> scope,
+		StreamDescriptor stream,
+		const std::string& format,
+		const std::string& path)
+	: m_scope(scope)
+	, m_stream(stream)
+	, m_format(format)
+	, m_path(path)
+	, m_size(0)
+	{}
+
+	///@brief The instrument the waveform came from
+	std::shared_ptr<Oscilloscope> m_scope;
+
+	///@brief The stream the waveform came from
+	StreamDescriptor m_stream;
+
+	///@brief File format of the sample data
+	std::string m_format;
+
+	///@brief Path to the sample data file
+	std::string m_path;
+
+	///@brief Number of samples the last time the waveform was unloaded (zero if it was never loaded)
+	size_t m_size;
+};
+
+/**
+	@brief Bookkeeping for a waveform referenced by one or more history points
+ */
+class TrackedWaveform
+{
+public:
+	TrackedWaveform()
+	: m_bytes(0)
+	{}
+
+	///@brief Points referencing the waveform, oldest first. The last one owns it.
+	std::vector<HistoryPoint*> m_holders;
+
+	///@brief Size of the waveform's sample data
+	size_t m_bytes;
+};
+
+/**
+	@brief One channel's trace in a history thumbnail
+ */
+class HistoryThumbnailTrace
+{
+public:
+	///@brief Display color of the channel, as a #RRGGBB string
+	std::string m_color;
+
+	/**
+		@brief Interleaved min/max of each bin, scaled so 0 is the bottom of the channel's vertical range and 1 the top
+
+		Values outside the displayed range are clamped.
+	 */
+	std::vector<float> m_bins;
+};
+
+/**
+	@brief Tiny preview of the waveforms one trigger group contributed to a history point
+ */
+class HistoryThumbnail
+{
+public:
+	///@brief Description of the trigger group
+	std::string m_group;
+
+	///@brief Analog traces, in channel order
+	std::vector<HistoryThumbnailTrace> m_traces;
+};
+
 /**
 	@brief A single point of waveform history
  */
@@ -49,21 +169,273 @@ public:
 	HistoryPoint();
 	~HistoryPoint();
 
+	/**
+		@brief Type of memory the waveform data of a history point is stored in
+
+		Tiers are ordered from fastest to slowest, so a larger value means the point has been demoted further.
+	 */
+	enum Tier
+	{
+		///@brief Default memory for new waveforms, mirrored to the GPU as needed
+		TIER_GPU,
+
+		///@brief Pinned host memory only, no GPU-side buffer
+		TIER_HOST,
+
+		///@brief File-backed memory which the OS can page out to disk
+		TIER_DISK
+	};
+
 	bool IsInUse();
 
+	size_t GetMemoryUsage();
+
+	void SetTier(Tier tier);
+	static void SetWaveformTier(WaveformBase* wfm, Tier tier);
+
+	///@brief Memory tier our waveform data is currently stored in
+	Tier m_tier;
+
+	///@brief Cached result of GetMemoryUsage(), computed when the point is added to history
+	size_t m_memoryUsage;
+
+	/**
+		@brief Check if our sample data is in memory
+
+		Points which were captured live, or loaded eagerly from a session, are always resident.
+	 */
+	bool IsResident()
+	{ return m_lazySources.empty() || m_lazyResident; }
+
+	/**
+		@brief Check if our sample data is currently being loaded by a background thread
+	 */
+	bool IsLoading()
+	{ return m_loadThread != nullptr; }
+
+	/**
+		@brief Gets the fraction of our sample data which has been loaded so far
+	 */
+	float GetLoadProgress()
+	{
+		if(m_lazySources.empty())
+			return 1;
+		return m_loadProgress.load() * 1.0f / m_lazySources.size();
+	}
+
+	void StartLoading(TaskPool& pool);
+	bool FinishLoading();
+	void Unload();
+
+	///@brief Files to load sample data from, if this point was lazily loaded from a session
+	std::vector<LazyWaveformSource> m_lazySources;
+
+	///@brief True if m_lazySources have been loaded
+	bool m_lazyResident;
+
+	///@brief Our position in the HistoryManager's eviction index
+	std::list<HistoryIterator>::iterator m_evictionIt;
+
+	///@brief True if m_evictionIt points into the held list rather than the eviction queue
+	bool m_evictionHeld;
+
 	///@brief Timestamp of the point
 	TimePoint m_time;
 
+	/**
+		@brief Dense per-session ID of the point, assigned in order as points are added to history
+
+		Zero if the point hasn't been added to history (yet).
+	 */
+	uint64_t m_id;
+
 	///@brief Set true to "pin" this waveform so it won't be purged from history regardless of age
 	bool m_pinned;
 
 	///@brief Free-form text nickname for this acquisition (may be blank)
 	std::string m_nickname;
 
+	///@brief Timestamp of the first segment, if this point is one segment of a segmented (fast frame) acquisition
+	TimePoint m_segmentGroup;
+
+	///@brief Index of this point within its segmented acquisition
+	size_t m_segmentIndex;
+
+	///@brief Number of segments in the acquisition this point is part of (1 if not segmented)
+	size_t m_segmentCount;
+
 	///@brief Waveform data
 	std::map<std::shared_ptr<Oscilloscope>, WaveformHistory> m_history;
 
+	/**
+		@brief Check if any of our waveforms are stored as integer codes rather than float samples
+
+		Compacted waveforms have no samples until HistoryManager::Expand() is called on the point.
+	 */
+	bool IsCompacted()
+	{ return !m_compactSamples.empty(); }
+
+	///@brief Codes for each compacted waveform in m_history
+	std::map<WaveformBase*, std::unique_ptr<CompactSamples>> m_compactSamples;
+
+	///@brief True if we've already tried to compact the point since it was last expanded
+	bool m_compactChecked;
+
+	/**
+		@brief Waveforms in m_history which are owned by a newer point
+
+		These are streams which didn't change since an earlier acquisition, so several points reference the same
+		buffer. We don't free them, move them to another tier, or count them in our memory usage.
+	 */
+	std::set<WaveformBase*> m_borrowedWaveforms;
+
 	void LoadHistoryToSession(Session& session);
+	void AttachToScopes(const std::vector<std::shared_ptr<Oscilloscope>>& scopes);
+
+	void ClearFilterOutputs();
+
+	/**
+		@brief Filter outputs computed from our waveform data, saved when another point was displayed
+
+		We own these until they're handed back to the filters by Session::RefreshAllFilters().
+	 */
+	std::map<StreamDescriptor, WaveformBase*> m_filterOutputs;
+
+	///@brief Filters which existed when m_filterOutputs was saved (empty if nothing is saved)
+	std::set<Filter*> m_filterOutputFilters;
+
+	///@brief Session filter configuration revision m_filterOutputs was computed with
+	uint64_t m_filterOutputRevision;
+
+	/**
+		@brief Number of readers holding the point's sample data: saves, exports, recording, replay, search,
+		remote viewers and accumulation windows
+
+		While this is nonzero the point is pinned in place, and won't be evicted, demoted or compacted. Increment it
+		directly, but call ReleaseReader() to drop it so the HistoryManager hears about it.
+	 */
+	std::atomic<int> m_readerRefs;
+
+	void ReleaseReader();
+
+	/**
+		@brief Where to post our ID when the last reader lets go
+
+		Set when the point is added to history, which may race with a reader letting go, so only access it with
+		std::atomic_load() / std::atomic_store().
+	 */
+	std::shared_ptr<HistoryReleaseQueue> m_releaseQueue;
+
+	///@brief Outcome of testing the point's waveforms against eye pattern masks
+	enum MaskTestResult
+	{
+		///@brief Not tested yet
+		MASK_UNTESTED,
+
+		///@brief Nothing to test against (no eye pattern with a mask, or testing disabled)
+		MASK_NOT_TESTED,
+
+		///@brief Every mask tested was within its allowed hit rate
+		MASK_PASS,
+
+		///@brief At least one mask exceeded its allowed hit rate
+		MASK_FAIL
+	};
+
+	/**
+		@brief Result of the mask test, as a MaskTestResult
+
+		Set by the WaveformThread once the filter graph has run on the point's waveforms, which in pipelined mode
+		may be after the GUI thread has already added the point to history.
+	 */
+	std::atomic<int> m_maskTestResult;
+
+	///@brief Total number of mask hits in the point's waveforms
+	std::atomic<uint64_t> m_maskHits;
+
+	///@brief Outcome of comparing the point's waveforms against their golden references
+	enum ReferenceResult
+	{
+		///@brief No stream has a reference, or none of them could be compared
+		REFERENCE_NOT_TESTED,
+
+		///@brief Every stream compared was within its tolerance band
+		REFERENCE_PASS,
+
+		///@brief At least one stream had more out-of-band samples than allowed
+		REFERENCE_FAIL
+	};
+
+	/**
+		@brief Result of the reference comparison, as a ReferenceResult
+
+		Set by the WaveformThread before m_retentionDecision, so it's valid whenever the retention decision is.
+	 */
+	std::atomic<int> m_referenceResult;
+
+	///@brief Total number of out-of-band samples across all streams compared
+	std::atomic<uint64_t> m_referenceFailures;
+
+	///@brief Time of the earliest out-of-band sample in any stream, in fs from the trigger
+	std::atomic<int64_t> m_referenceFirstFailure;
+
+	/**
+		@brief Retention policy decision for the point, as a RetentionPolicy::Decision
+
+		Set by the WaveformThread at the same time as m_maskTestResult, after m_retentionReason.
+	 */
+	std::atomic<int> m_retentionDecision;
+
+	///@brief Description of the retention rule which matched, if any
+	std::string m_retentionReason;
+
+	/**
+		@brief Value of every scalar filter output for the point, so measurement statistics can be recomputed
+		across history without rerunning filters
+
+		Filled in by the WaveformThread once the filter graph has run on the point, then never changed again.
+		Only valid once m_measurementsRecorded is set.
+	 */
+	std::map<StreamDescriptor, float> m_measurements;
+
+	///@brief Set by the WaveformThread once m_measurements has been filled in
+	std::atomic<bool> m_measurementsRecorded;
+
+	/**
+		@brief Thumbnail of each trigger group's waveforms, so the history dialog can show them without loading the point
+
+		Filled in by the WaveformThread shortly after the point is created, then never changed again. Only valid once
+		m_thumbnailsReady is set.
+	 */
+	std::vector<HistoryThumbnail> m_thumbnails;
+
+	///@brief Set by the WaveformThread once m_thumbnails has been filled in
+	std::atomic<bool> m_thumbnailsReady;
+
+protected:
+	void LoadThread(TaskPool* pool);
+
+	///@brief Background thread loading sample data
+	std::unique_ptr<std::thread> m_loadThread;
+
+	///@brief Number of m_lazySources loaded so far by the background thread
+	std::atomic<size_t> m_loadProgress;
+
+	///@brief Set by the background thread when it's finished
+	std::atomic<bool> m_loadDone;
+
+	///@brief Set to abort a load in progress
+	std::atomic<bool> m_cancelLoad;
+
+	///@brief Waveforms being loaded, in the same order as m_lazySources
+	std::vector<WaveformBase*> m_loadResults;
+
+public:
+	///@brief Pool to return waveforms to when we're done with them (set when the point is added to history)
+	WaveformPool* m_waveformPool;
+
+protected:
+	void ReleaseWaveform(WaveformBase* wfm);
 };
 
 /**
@@ -75,7 +447,8 @@ public:
 	HistoryManager(Session& session);
 	~HistoryManager();
 
-	bool OnMemoryPressure(MemoryPressureLevel level, MemoryPressureType type, size_t requestedSize);
+	size_t GetReclaimableMemory(MemoryPressureType type);
+	bool ReclaimMemory(MemoryPressureType type, size_t bytes, size_t& freed);
 
 	void AddHistory(
 		const std::vector<std::shared_ptr<Oscilloscope>>& scopes,
@@ -84,6 +457,20 @@ public:
 		std::string nick = "",
 		TimePoint refTimeIfNoWaveforms = TimePoint(0, 0));
 
+	static std::shared_ptr<HistoryPoint> CreateHistoryPoint(
+		const std::vector<std::shared_ptr<Oscilloscope>>& scopes,
+		bool pin = false,
+		std::string nick = "",
+		TimePoint refTimeIfNoWaveforms = TimePoint(0, 0));
+
+	void AddHistoryPoint(std::shared_ptr<HistoryPoint> pt, bool deleteOld = true, bool applyPolicies = false);
+	void ApplyPolicies();
+
+	void AddLazySources(
+		std::shared_ptr<HistoryPoint> pt,
+		std::shared_ptr<Oscilloscope> scope,
+		const std::vector<LazyWaveformSource>& sources);
+
 	void LoadEmptyHistoryToSession(Session& session);
 
 	bool empty();
@@ -95,18 +482,186 @@ public:
 
 	bool HasHistory(TimePoint t);
 
+	std::shared_ptr<HistoryPoint> GetHistoryByID(uint64_t id);
+
+	uint64_t GetHistoryID(TimePoint t);
+
 	TimePoint GetMostRecentPoint();
 
 	void clear()
-	{ m_history.clear(); }
+	{
+		m_lazyLRU.clear();
+		m_evictionQueue.clear();
+		m_evictionHeld.clear();
+		m_index.clear();
+		m_idIndex.clear();
+		m_idBase = m_nextID;
+		m_history.clear();
+		m_trackedWaveforms.clear();
+		m_policyPending.clear();
+		m_memoryUsage = 0;
+		m_gpuTierStart = m_history.end();
+		m_hostTierStart = m_history.end();
+		m_gpuTierBytes = 0;
+		m_hostTierBytes = 0;
+		m_tierDeferred.clear();
+		m_revision ++;
+	}
+
+	void erase(HistoryIterator it);
+	bool DiscardPoint(std::shared_ptr<HistoryPoint> pt);
+
+	HistoryIterator find(TimePoint t);
+
+	void StartLoading(std::shared_ptr<HistoryPoint> pt);
+	void PrefetchNeighbors(std::shared_ptr<HistoryPoint> pt);
+	void EnsureLoaded(HistoryPoint* pt, bool enforceCap = true);
+	bool PollLoads();
+	void EnforceResidentCap();
+
+	void UpdateTiers();
+	void Reconsider(HistoryPoint* pt);
+	void CompactHistory();
+	void Expand(HistoryPoint* pt);
+
+	/**
+		@brief Gets the total amount of sample data in history, across all tiers
+	 */
+	size_t GetMemoryUsage()
+	{ return m_memoryUsage; }
+
+	/**
+		@brief Gets the number of points currently in history
+	 */
+	size_t GetPointCount()
+	{ return m_history.size(); }
+
+	double GetMemoryBudget();
+
+	/**
+		@brief Gets a counter which changes every time a point is added to or removed from history
+
+		Lets the UI cache anything derived from the list of points, rather than walking it every frame.
+	 */
+	uint64_t GetRevision()
+	{ return m_revision; }
 
+	///@brief All points in history, oldest first. Use AddHistoryPoint() / erase() rather than modifying directly.
 	std::list<std::shared_ptr<HistoryPoint>> m_history;
 
 	///@brief has to be an int for imgui compatibility
 	int m_maxDepth;
 
+	///@brief Rules deciding which live acquisitions are kept
+	RetentionPolicy m_retention;
+
 protected:
+	void GetTierBudgets(double& gpuBudget, double& hostBudget);
+	bool CanEvict(std::shared_ptr<HistoryPoint> point);
+	bool GetDemotionTier(MemoryPressureType type, HistoryPoint::Tier& target);
+	bool CanDemote(std::shared_ptr<HistoryPoint> pt, HistoryPoint::Tier target, TimePoint mostRecent);
+	HistoryIterator FindPointToEvict();
+	void ProcessReleases();
+
+	bool InTier(HistoryPoint* pt, HistoryIterator start)
+	{ return (start != m_history.end()) && (pt->m_id >= (*start)->m_id); }
+
+	HistoryPoint::Tier GetTargetTier(HistoryPoint* pt);
+	void Demote(HistoryPoint* pt, HistoryPoint::Tier tier);
+	void MoveTierBoundary(HistoryIterator& start, double& bytes, double budget, HistoryPoint::Tier demoteTo);
+	void RebuildTiers(double gpuBudget, double hostBudget);
+
 	Session& m_session;
+
+	///@brief Total of m_memoryUsage across all points in m_history
+	size_t m_memoryUsage;
+
+	///@brief Index of m_history by timestamp, for fast lookups
+	std::unordered_map<TimePoint, HistoryIterator, TimePointHash> m_index;
+
+	/**
+		@brief Index of m_history by ID, starting from m_idBase
+
+		Erased points leave m_history.end() behind until everything older than them is gone too. Since history
+		is mostly trimmed from the oldest end, there are rarely many holes.
+	 */
+	std::deque<HistoryIterator> m_idIndex;
+
+	///@brief ID of the point at the front of m_idIndex
+	uint64_t m_idBase;
+
+	///@brief ID to give the next point added to history
+	uint64_t m_nextID;
+
+	///@brief Incremented every time m_history changes
+	uint64_t m_revision;
+
+	/**
+		@brief Points which may be evicted, oldest first
+
+		Points are checked for pins, markers, and being in use lazily when they reach the front, so that eviction
+		doesn't have to walk over every pinned point each time.
+	 */
+	std::list<HistoryIterator> m_evictionQueue;
+
+	/**
+		@brief Points which had a pin, markers, or were in use when they reached the front of m_evictionQueue,
+		oldest first
+
+		Reconsider() moves them back into the queue once whatever held them goes away.
+	 */
+	std::list<HistoryIterator> m_evictionHeld;
+
+	///@brief Points whose last reader let go since we last looked, shared with every point in history
+	std::shared_ptr<HistoryReleaseQueue> m_releaseQueue;
+
+	/**
+		@brief Oldest point of the newest run of points which fits in the GPU tier budget
+
+		This and every newer point stay in the GPU tier, anything older is demoted. m_history.end() if even the
+		newest point doesn't fit. The boundary only moves as points are added or removed or the budget changes,
+		so keeping tiers up to date doesn't mean walking the whole history.
+	 */
+	HistoryIterator m_gpuTierStart;
+
+	///@brief Total memory usage of m_gpuTierStart and every newer point
+	double m_gpuTierBytes;
+
+	///@brief Same as m_gpuTierStart, for the GPU and host tier budgets combined (anything older goes to disk)
+	HistoryIterator m_hostTierStart;
+
+	///@brief Total memory usage of m_hostTierStart and every newer point
+	double m_hostTierBytes;
+
+	///@brief Value of the spill_to_disk preference when the tier boundaries were last updated
+	bool m_tierSpill;
+
+	///@brief IDs of points which should have been demoted, but were attached to a scope at the time
+	std::set<uint64_t> m_tierDeferred;
+
+	void OnPointLoaded(HistoryPoint* pt);
+	void UpdatePointMemoryUsage(HistoryPoint* pt);
+	void SetPointMemoryUsage(HistoryPoint* pt, size_t bytes);
+	void CompactPoint(HistoryPoint* pt);
+
+	void TrackWaveforms(HistoryPoint* pt);
+	bool UntrackWaveform(HistoryPoint* pt, WaveformBase* wfm);
+
+	/**
+		@brief Every waveform referenced by a point in history, and which points reference it
+
+		Lazily loaded waveforms are not tracked, since they're swapped out for a different object on every load.
+	 */
+	std::map<WaveformBase*, TrackedWaveform> m_trackedWaveforms;
+
+	///@brief Lazily loaded points which are currently loading or resident, most recently used first
+	std::list<HistoryPoint*> m_lazyLRU;
+
+	///@brief Live points whose mask test or retention results haven't been acted on yet
+	std::deque<std::shared_ptr<HistoryPoint>> m_policyPending;
+
+	///@brief Converts waveforms to and from integer codes (created the first time it's needed)
+	std::unique_ptr<HistoryCompactor> m_compactor;
 };
 
 #endif
@@ -0,0 +1,346 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HistoryReplay
+ */
+#include "ngscopeclient.h"
+#include "HistoryReplay.h"
+#include "Session.h"
+
+using namespace std;
+
+extern Event g_waveformThreadWakeEvent;
+
+///@brief Number of points to keep loaded ahead of the one being processed
+static const size_t REPLAY_LOOKAHEAD = 2;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistoryReplay::HistoryReplay(Session& session)
+	: m_session(session)
+	, m_running(false)
+	, m_next(0)
+	, m_loop(false)
+	, m_rate(0)
+	, m_nextDue(0)
+	, m_ready(0)
+	, m_displayedPending(false)
+	, m_tstart(0)
+{
+}
+
+HistoryReplay::~HistoryReplay()
+{
+	Stop();
+
+	lock_guard<mutex> lock(m_mutex);
+	for(auto& pt : m_inFlight)
+		Release(pt);
+	m_inFlight.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control
+
+/**
+	@brief Starts replaying everything currently in history, oldest first
+
+	Stops the trigger first, since live acquisitions and replayed ones can't be mixed.
+
+	@param rate		Points per second to replay at, or zero to go as fast as the pipeline allows
+	@param loop		True to start over from the oldest point when we get to the end, until stopped
+
+	@return False if there's nothing in history to replay
+ */
+bool HistoryReplay::Start(double rate, bool loop)
+{
+	m_session.StopTrigger();
+
+	lock_guard<mutex> lock(m_mutex);
+
+	m_points.clear();
+	for(auto& pt : m_session.GetHistory().m_history)
+	{
+		if(!pt->m_history.empty())
+			m_points.push_back(pt);
+	}
+	if(m_points.empty())
+		return false;
+
+	LogNotice("Replaying %zu history points\n", m_points.size());
+
+	m_next = 0;
+	m_loop = loop;
+	m_rate = max(0.0, rate);
+	m_tstart = GetTime();
+	m_nextDue = m_tstart;
+	m_stats = Stats();
+	m_running = true;
+
+	Fill();
+	return true;
+}
+
+/**
+	@brief Stops the replay in progress, if any
+
+	Points already handed to the WaveformThread still finish going through the pipeline.
+ */
+void HistoryReplay::Stop()
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(!m_running)
+		return;
+
+	for(auto& pt : m_queue)
+		Release(pt);
+	m_queue.clear();
+	m_ready = 0;
+	m_points.clear();
+
+	m_stats.m_elapsed = GetTime() - m_tstart;
+	m_running = false;
+
+	double rate = (m_stats.m_elapsed > 0) ? (m_stats.m_points / m_stats.m_elapsed) : 0;
+	LogNotice("Replay stopped: %" PRIu64 " points (%" PRIu64 " skipped) in %.3f s, %.2f points/sec\n",
+		m_stats.m_points, m_stats.m_skipped, m_stats.m_elapsed, rate);
+}
+
+/**
+	@brief Keeps the queue of upcoming points loaded, called once per frame from the GUI thread
+ */
+void HistoryReplay::Poll()
+{
+	if(!m_running)
+		return;
+
+	m_session.GetHistory().PollLoads();
+
+	bool done = false;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		Fill();
+
+		//Everything has been queued and made it through the pipeline
+		done = m_queue.empty() && m_inFlight.empty() && (m_next >= m_points.size());
+	}
+
+	if(done)
+		Stop();
+	else
+		g_waveformThreadWakeEvent.Signal();
+}
+
+/**
+	@brief Queues up the next few points and starts loading any that aren't in memory
+
+	Must be called from the GUI thread with m_mutex held.
+ */
+void HistoryReplay::Fill()
+{
+	auto& history = m_session.GetHistory();
+
+	//Skip anything deleted from history since we started, but don't spin forever if everything was
+	size_t tries = 0;
+	while( (m_queue.size() < REPLAY_LOOKAHEAD) && (tries < m_points.size()) )
+	{
+		if(m_next >= m_points.size())
+		{
+			if(!m_loop)
+				break;
+			m_next = 0;
+		}
+
+		tries ++;
+		auto pt = m_points[m_next].lock();
+		m_next ++;
+		if(!pt)
+		{
+			m_stats.m_skipped ++;
+			continue;
+		}
+
+		pt->m_readerRefs ++;
+		history.StartLoading(pt);
+		m_queue.push_back(pt);
+	}
+
+	//A point which isn't loading and still isn't in memory failed to load, don't wait for it
+	for(auto it = m_queue.begin(); it != m_queue.end(); )
+	{
+		auto pt = *it;
+		if(!pt->IsResident() && !pt->IsLoading())
+		{
+			LogWarning("Skipping history point %s, sample data could not be loaded\n", pt->m_time.PrettyPrint().c_str());
+			m_stats.m_skipped ++;
+			Release(pt);
+			it = m_queue.erase(it);
+		}
+		else
+			it ++;
+	}
+
+	//Bring anything paged out back to the GPU tier before the filter graph needs it.
+	//Points are replayed in order, so only the ones up to the first that's still loading are ready.
+	m_ready = 0;
+	for(auto& pt : m_queue)
+	{
+		if(!pt->IsResident())
+			break;
+		if(pt->m_tier != HistoryPoint::TIER_GPU)
+			pt->SetTier(HistoryPoint::TIER_GPU);
+		history.Expand(pt.get());
+		m_ready ++;
+	}
+}
+
+/**
+	@brief Drops the reference keeping a point's sample data in memory
+ */
+void HistoryReplay::Release(shared_ptr<HistoryPoint> pt)
+{
+	pt->ReleaseReader();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WaveformThread interface
+
+/**
+	@brief Check if the next point is loaded and due to be replayed
+ */
+bool HistoryReplay::IsReady()
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(!m_running || (m_ready == 0) )
+		return false;
+
+	return (m_rate <= 0) || (GetTime() >= m_nextDue);
+}
+
+/**
+	@brief Takes the next point to replay off the queue
+
+	The caller must load it into the scopes before the next GUI frame, and hand it back to OnDisplayed() once it's
+	been displayed.
+
+	@return The point, or null if the replay was stopped since IsReady() was called
+ */
+shared_ptr<HistoryPoint> HistoryReplay::Pop()
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(!m_running || (m_ready == 0) )
+		return nullptr;
+
+	auto pt = m_queue.front();
+	m_queue.pop_front();
+	m_ready --;
+	m_inFlight.push_back(pt);
+
+	//Schedule the next point. If we've fallen behind, don't try to catch up with a burst.
+	if(m_rate > 0)
+	{
+		double now = GetTime();
+		m_nextDue += 1.0 / m_rate;
+		if(m_nextDue < now)
+			m_nextDue = now;
+	}
+
+	return pt;
+}
+
+/**
+	@brief Records that a replayed point has made it to the screen, called from the GUI thread
+
+	The point's sample data may be unloaded again from here on.
+ */
+void HistoryReplay::OnDisplayed(shared_ptr<HistoryPoint> pt)
+{
+	uint64_t samples = GetSampleCount(pt);
+
+	lock_guard<mutex> lock(m_mutex);
+	auto it = find(m_inFlight.begin(), m_inFlight.end(), pt);
+	if(it == m_inFlight.end())
+		return;
+	m_inFlight.erase(it);
+	Release(pt);
+
+	m_stats.m_points ++;
+	m_stats.m_samples += samples;
+	m_lastDisplayed = pt->m_time;
+	m_displayedPending = true;
+}
+
+/**
+	@brief Gets the timestamp of the most recently displayed point, if one was displayed since the last call
+
+	@return True if a point was displayed
+ */
+bool HistoryReplay::PopDisplayedPoint(TimePoint& t)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(!m_displayedPending)
+		return false;
+
+	t = m_lastDisplayed;
+	m_displayedPending = false;
+	return true;
+}
+
+/**
+	@brief Gets the throughput of the current replay, or the last one if none is running
+ */
+HistoryReplay::Stats HistoryReplay::GetStats()
+{
+	lock_guard<mutex> lock(m_mutex);
+	Stats ret = m_stats;
+	if(m_running)
+		ret.m_elapsed = GetTime() - m_tstart;
+	return ret;
+}
+
+/**
+	@brief Gets the total number of samples in a point, across all streams
+ */
+uint64_t HistoryReplay::GetSampleCount(shared_ptr<HistoryPoint> pt)
+{
+	uint64_t samples = 0;
+	for(auto& it : pt->m_history)
+	{
+		for(auto& jt : it.second)
+		{
+			if(jt.second)
+				samples += jt.second->size();
+		}
+	}
+	return samples;
+}
@@ -0,0 +1,158 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HistoryReplay
+ */
+#ifndef HistoryReplay_h
+#define HistoryReplay_h
+
+#include "HistoryManager.h"
+
+class Session;
+
+/**
+	@brief Feeds points from history back through the acquisition pipeline as if they were live acquisitions
+
+	Each replayed point is loaded into the scopes by the WaveformThread in place of a download, then goes through the
+	full filter graph and render path, so filter graphs can be benchmarked and tuned against recorded data without
+	any hardware connected. Replayed points are not added to history again.
+
+	Start() and Poll() must be called from the GUI thread, since they touch the history list. Everything else
+	is safe to call from the WaveformThread.
+ */
+class HistoryReplay
+{
+public:
+	HistoryReplay(Session& session);
+	~HistoryReplay();
+
+	bool Start(double rate, bool loop);
+	void Stop();
+	void Poll();
+
+	///@brief Check if a replay is in progress
+	bool IsRunning()
+	{ return m_running; }
+
+	bool IsReady();
+	std::shared_ptr<HistoryPoint> Pop();
+	void OnDisplayed(std::shared_ptr<HistoryPoint> pt);
+	bool PopDisplayedPoint(TimePoint& t);
+
+	/**
+		@brief Throughput of the current (or most recent) replay
+	 */
+	class Stats
+	{
+	public:
+		Stats()
+		: m_points(0)
+		, m_samples(0)
+		, m_skipped(0)
+		, m_elapsed(0)
+		{}
+
+		///@brief Number of points which made it to the screen
+		uint64_t m_points;
+
+		///@brief Total number of samples in the displayed points, across all channels
+		uint64_t m_samples;
+
+		///@brief Number of points which weren't loaded in time and were skipped
+		uint64_t m_skipped;
+
+		///@brief Time since the replay started, or its total duration once it's stopped
+		double m_elapsed;
+	};
+
+	Stats GetStats();
+
+protected:
+	void Fill();
+	void Release(std::shared_ptr<HistoryPoint> pt);
+	static uint64_t GetSampleCount(std::shared_ptr<HistoryPoint> pt);
+
+	///@brief The session we're replaying into
+	Session& m_session;
+
+	///@brief Mutex protecting everything below
+	std::mutex m_mutex;
+
+	///@brief True if a replay is in progress
+	std::atomic<bool> m_running;
+
+	///@brief Points to replay, oldest first. Weak so deleting a point from history mid-replay just skips it.
+	std::vector<std::weak_ptr<HistoryPoint>> m_points;
+
+	///@brief Index in m_points of the next point to queue
+	size_t m_next;
+
+	///@brief True to start over from the oldest point once we reach the end
+	bool m_loop;
+
+	///@brief Points per second to replay at, or zero to go as fast as the pipeline allows
+	double m_rate;
+
+	///@brief Time the next point may be handed to the WaveformThread
+	double m_nextDue;
+
+	/**
+		@brief Points which are loaded (or being loaded) and waiting for the WaveformThread, oldest first
+
+		Each one holds a reader reference so the history manager won't unload it before it's attached to the scopes.
+	 */
+	std::deque<std::shared_ptr<HistoryPoint>> m_queue;
+
+	/**
+		@brief Number of points at the front of m_queue which are in memory and on the GPU tier
+
+		Worked out by Fill() on the GUI thread, since that's where loads complete.
+	 */
+	size_t m_ready;
+
+	///@brief Points which have been handed to the WaveformThread but not displayed yet, oldest first
+	std::deque<std::shared_ptr<HistoryPoint>> m_inFlight;
+
+	///@brief Timestamp of the most recently displayed point
+	TimePoint m_lastDisplayed;
+
+	///@brief True if a point was displayed since the last call to PopDisplayedPoint()
+	bool m_displayedPending;
+
+	///@brief Time the replay started
+	double m_tstart;
+
+	///@brief Throughput so far
+	Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,227 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of RetentionRule and RetentionPolicy
+ */
+
+#include "ngscopeclient.h"
+#include "HistoryRetention.h"
+#include "PacketManager.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RetentionRule
+
+RetentionRule::RetentionRule()
+	: m_type(RULE_ABOVE)
+	, m_action(ACTION_RETAIN)
+	, m_filter(nullptr)
+	, m_stream(0)
+	, m_threshold(0)
+	, m_parsed(false)
+{
+}
+
+/**
+	@brief Checks the rule against the outputs of the filter graph for the acquisition just processed
+
+	@param filters			All filters which currently exist, since m_filter may have been deleted since the rule was
+							set up
+	@param referenceFailed	True if any golden reference comparison failed for the acquisition
+ */
+bool RetentionRule::Matches(const set<Filter*>& filters, bool referenceFailed)
+{
+	if(m_type == RULE_REFERENCE)
+		return referenceFailed;
+
+	if(!m_filter || (filters.find(m_filter) == filters.end()) )
+		return false;
+
+	if(m_type == RULE_PACKET)
+	{
+		auto decoder = dynamic_cast<PacketDecoder*>(m_filter);
+		if(!decoder)
+			return false;
+		return MatchesPackets(decoder);
+	}
+
+	if(m_stream >= m_filter->GetStreamCount())
+		return false;
+	return MatchesThreshold(StreamDescriptor(m_filter, m_stream));
+}
+
+/**
+	@brief Compares a scalar measurement, or the extremes of an analog waveform, against the threshold
+ */
+bool RetentionRule::MatchesThreshold(StreamDescriptor stream)
+{
+	bool above = (m_type == RULE_ABOVE);
+
+	if(stream.GetType() == Stream::STREAM_TYPE_ANALOG_SCALAR)
+	{
+		float v = stream.GetScalarValue();
+		return above ? (v > m_threshold) : (v < m_threshold);
+	}
+
+	//Waveform measurements (e.g. per-cycle period) match if any value crosses the threshold
+	auto data = stream.GetData();
+	AcceleratorBuffer<float>* samples = nullptr;
+	auto udata = dynamic_cast<UniformAnalogWaveform*>(data);
+	auto sdata = dynamic_cast<SparseAnalogWaveform*>(data);
+	if(udata)
+		samples = &udata->m_samples;
+	else if(sdata)
+		samples = &sdata->m_samples;
+	else
+		return false;
+
+	data->PrepareForCpuAccess();
+	for(size_t i=0; i<samples->size(); i++)
+	{
+		float v = (*samples)[i];
+		if(above ? (v > m_threshold) : (v < m_threshold))
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Checks if a protocol decoder produced any packet matching our display filter expression
+ */
+bool RetentionRule::MatchesPackets(PacketDecoder* decoder)
+{
+	if(!m_parsed || (m_parsedText != m_packetFilter) )
+	{
+		m_parsedText = m_packetFilter;
+		m_parsed = true;
+		m_parsedFilter = nullptr;
+
+		size_t i = 0;
+		auto filter = make_shared<ProtocolDisplayFilter>(m_packetFilter, i);
+		if(filter->Validate(decoder->GetHeaders()))
+			m_parsedFilter = filter;
+		else
+			LogWarning("Retention rule filter expression \"%s\" is not valid\n", m_packetFilter.c_str());
+	}
+	if(!m_parsedFilter)
+		return false;
+
+	for(auto p : decoder->GetPackets())
+	{
+		if(m_parsedFilter->Match(p))
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Describes the rule, for nicknaming acquisitions it pinned
+ */
+string RetentionRule::GetDescription()
+{
+	if(m_type == RULE_REFERENCE)
+		return "Reference compare fail";
+
+	if(!m_filter)
+		return "(no filter)";
+
+	if(m_type == RULE_PACKET)
+	{
+		if(m_packetFilter.empty())
+			return m_filter->GetDisplayName() + " packet";
+		return m_filter->GetDisplayName() + ": " + m_packetFilter;
+	}
+
+	StreamDescriptor stream(m_filter, m_stream);
+	return stream.GetName() + ((m_type == RULE_ABOVE) ? " > " : " < ") +
+		stream.GetYAxisUnits().PrettyPrint(m_threshold);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RetentionPolicy
+
+RetentionPolicy::RetentionPolicy()
+	: m_enabled(false)
+	, m_keepEvery(100)
+	, m_matched(0)
+	, m_unmatched(0)
+{
+}
+
+/**
+	@brief Decides whether the acquisition the filter graph was just run on should stay in history
+
+	The caller must hold the policy mutex and a shared lock on the waveform data.
+
+	@param filters			All filters which currently exist
+	@param referenceFailed	True if any golden reference comparison failed for the acquisition
+	@param reason			Description of the first rule which matched, if any
+ */
+RetentionPolicy::Decision RetentionPolicy::Evaluate(const set<Filter*>& filters, bool referenceFailed, string& reason)
+{
+	if(!m_enabled)
+		return DECISION_NONE;
+
+	//A pin anywhere in the list beats an earlier rule which only wants to retain
+	Decision ret = DECISION_UNDECIDED;
+	for(auto& rule : m_rules)
+	{
+		if(!rule.Matches(filters, referenceFailed))
+			continue;
+
+		if(rule.m_action == RetentionRule::ACTION_PIN)
+		{
+			reason = rule.GetDescription();
+			ret = DECISION_PIN;
+			break;
+		}
+		if(ret == DECISION_UNDECIDED)
+		{
+			reason = rule.GetDescription();
+			ret = DECISION_KEEP;
+		}
+	}
+
+	if(ret != DECISION_UNDECIDED)
+	{
+		m_matched ++;
+		return ret;
+	}
+
+	//Keep a sample of routine acquisitions too, so there's something to compare the anomalies against
+	m_unmatched ++;
+	if( (m_keepEvery > 0) && ( ((m_unmatched - 1) % m_keepEvery) == 0) )
+		return DECISION_KEEP;
+	return DECISION_DROP;
+}
@@ -0,0 +1,165 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of RetentionRule and RetentionPolicy
+ */
+#ifndef HistoryRetention_h
+#define HistoryRetention_h
+
+class PacketDecoder;
+class ProtocolDisplayFilter;
+
+/**
+	@brief A condition which makes a new acquisition worth keeping in history
+ */
+class RetentionRule
+{
+public:
+	RetentionRule();
+
+	enum RuleType
+	{
+		///@brief A measurement is above the threshold
+		RULE_ABOVE,
+
+		///@brief A measurement is below the threshold
+		RULE_BELOW,
+
+		///@brief A protocol decoder emitted a packet matching a display filter expression
+		RULE_PACKET,
+
+		///@brief A stream with a golden reference had more out-of-band samples than allowed
+		RULE_REFERENCE
+	};
+
+	enum Action
+	{
+		///@brief Keep the acquisition in history (it can still be purged when history is full)
+		ACTION_RETAIN,
+
+		///@brief Pin the acquisition so it's never purged
+		ACTION_PIN
+	};
+
+	bool Matches(const std::set<Filter*>& filters, bool referenceFailed);
+	std::string GetDescription();
+
+	///@brief What to check
+	RuleType m_type;
+
+	///@brief What to do if the rule matches
+	Action m_action;
+
+	///@brief Filter whose output is checked (a protocol decoder, for RULE_PACKET; unused for RULE_REFERENCE)
+	Filter* m_filter;
+
+	///@brief Output stream of m_filter to compare against the threshold
+	size_t m_stream;
+
+	///@brief Threshold for RULE_ABOVE and RULE_BELOW
+	double m_threshold;
+
+	///@brief Display filter expression packets are matched against. Empty matches any packet
+	std::string m_packetFilter;
+
+protected:
+	bool MatchesThreshold(StreamDescriptor stream);
+	bool MatchesPackets(PacketDecoder* decoder);
+
+	///@brief Parsed form of m_packetFilter, or null if it doesn't validate
+	std::shared_ptr<ProtocolDisplayFilter> m_parsedFilter;
+
+	///@brief The m_packetFilter text m_parsedFilter was parsed from
+	std::string m_parsedText;
+
+	///@brief True if m_parsedFilter is up to date
+	bool m_parsed;
+};
+
+/**
+	@brief Decides which live acquisitions are worth spending history capacity on
+
+	Each new acquisition is evaluated by the WaveformThread once the filter graph has run on it. If any rule matches,
+	the acquisition is kept (or pinned). Otherwise only one in every m_keepEvery acquisitions is kept, and the rest
+	are dropped from history once something newer has arrived.
+ */
+class RetentionPolicy
+{
+public:
+	RetentionPolicy();
+
+	///@brief Outcome of evaluating the policy for a new acquisition
+	enum Decision
+	{
+		///@brief Not evaluated yet
+		DECISION_UNDECIDED,
+
+		///@brief Policy disabled or not applicable, keep as usual
+		DECISION_NONE,
+
+		///@brief A rule asked to keep the acquisition
+		DECISION_KEEP,
+
+		///@brief A rule asked to pin the acquisition
+		DECISION_PIN,
+
+		///@brief No rule matched, and it wasn't one of the 1 in N routine acquisitions we keep
+		DECISION_DROP
+	};
+
+	Decision Evaluate(const std::set<Filter*>& filters, bool referenceFailed, std::string& reason);
+
+	///@brief Gets the mutex which must be held while rules are being edited or evaluated
+	std::mutex& GetMutex()
+	{ return m_mutex; }
+
+	///@brief True if the policy should be applied to new acquisitions
+	bool m_enabled;
+
+	///@brief Rules to check, in order
+	std::vector<RetentionRule> m_rules;
+
+	///@brief Keep one in this many acquisitions which don't match any rule (zero to drop all of them)
+	int m_keepEvery;
+
+	///@brief Number of acquisitions which matched a rule
+	uint64_t m_matched;
+
+	///@brief Number of acquisitions which matched no rule
+	uint64_t m_unmatched;
+
+protected:
+	std::mutex m_mutex;
+};
+
+#endif
@@ -0,0 +1,365 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HistorySearch
+ */
+
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "HistorySearch.h"
+#include "Session.h"
+
+using namespace std;
+
+///@brief Value of the first match index written by the shader when nothing matched
+#define NO_MATCH 0xffffffff
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts searching every point currently in history
+
+	Must be called from the GUI thread, since it walks the history list.
+ */
+HistorySearch::HistorySearch(Session& session, HistoryManager& mgr, const HistorySearchQuery& query)
+	: m_session(session)
+	, m_query(query)
+	, m_next(0)
+	, m_searched(0)
+	, m_skipped(0)
+	, m_running(0)
+	, m_cancel(false)
+	, m_queue(g_vkQueueManager->GetComputeQueue("HistorySearch.queue"))
+	, m_pool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_pool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+	, m_gpuResults("HistorySearch.results")
+{
+	m_searchPipeline = make_shared<ComputePipeline>(
+		"shaders/HistorySearch.spv", 2, sizeof(HistorySearchArgs));
+
+	m_gpuResults.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_gpuResults.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	//Hold every point so it isn't evicted or moved to another tier while we're reading it
+	for(auto& pt : mgr.m_history)
+	{
+		pt->m_readerRefs ++;
+		m_points.push_back(pt);
+	}
+
+	size_t nthreads = max(1u, min(thread::hardware_concurrency(), 8u));
+	nthreads = min(nthreads, max((size_t)1, m_points.size()));
+	m_running = nthreads;
+	for(size_t i=0; i<nthreads; i++)
+		m_workers.push_back(thread(&HistorySearch::WorkerThread, this));
+}
+
+HistorySearch::~HistorySearch()
+{
+	m_cancel = true;
+	for(auto& t : m_workers)
+		t.join();
+
+	//Release anything the workers didn't get to
+	for(size_t i=m_next; i<m_points.size(); i++)
+		m_points[i]->ReleaseReader();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Gets the points which have matched so far, oldest first
+ */
+vector<HistorySearchResult> HistorySearch::GetResults()
+{
+	vector<HistorySearchResult> ret;
+	{
+		lock_guard<mutex> lock(m_resultMutex);
+		ret = m_results;
+	}
+	sort(ret.begin(), ret.end(),
+		[](const HistorySearchResult& a, const HistorySearchResult& b) { return a.m_point < b.m_point; });
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Searching
+
+void HistorySearch::WorkerThread()
+{
+	pthread_setname_np_compat("HistorySearch");
+	Tracer::SetThreadName("HistorySearch");
+
+	while(!m_cancel)
+	{
+		size_t i = m_next ++;
+		if(i >= m_points.size())
+			break;
+
+		auto pt = m_points[i];
+		HistorySearchResult result;
+		result.m_point = pt->m_time;
+		if(SearchPoint(pt.get(), result))
+		{
+			lock_guard<mutex> lock(m_resultMutex);
+			m_results.push_back(result);
+		}
+
+		pt->ReleaseReader();
+		m_searched ++;
+	}
+
+	m_running --;
+}
+
+/**
+	@brief Sample time helpers so the CPU search can be shared between uniform and sparse waveforms
+ */
+static int64_t SampleTime(UniformAnalogWaveform* wfm, size_t i)
+{ return i * wfm->m_timescale + wfm->m_triggerPhase; }
+
+static int64_t SampleTime(SparseAnalogWaveform* wfm, size_t i)
+{ return wfm->m_offsets[i] * wfm->m_timescale + wfm->m_triggerPhase; }
+
+/**
+	@brief Searches a waveform on the CPU
+
+	Works the same way as the compute shader, so results don't depend on which memory tier a point is in.
+ */
+template<class T>
+static bool SearchCpu(T* wfm, const HistorySearchQuery& query, HistorySearchResult& result)
+{
+	wfm->PrepareForCpuAccess();
+
+	size_t len = wfm->size();
+	float thresh = query.m_threshold;
+	bool found = false;
+	result.m_matches = 0;
+	for(size_t i=0; i<len; i++)
+	{
+		float v = wfm->m_samples[i];
+
+		bool match = false;
+		int64_t width = 0;
+		switch(query.m_type)
+		{
+			case HistorySearchQuery::QUERY_BELOW:
+				match = (v < thresh);
+				break;
+
+			case HistorySearchQuery::QUERY_ABOVE:
+				match = (v > thresh);
+				break;
+
+			default:
+				{
+					if(i == 0)
+						break;
+
+					float prev = wfm->m_samples[i-1];
+					bool rising = (prev < thresh) && (v >= thresh);
+					bool falling = (prev >= thresh) && (v < thresh);
+					if(query.m_type == HistorySearchQuery::QUERY_RISING_EDGE)
+						match = rising;
+					else if(query.m_type == HistorySearchQuery::QUERY_FALLING_EDGE)
+						match = falling;
+					else if(rising || falling)
+					{
+						//Look for the signal crossing back again before the pulse is too wide to be a glitch
+						int64_t tstart = SampleTime(wfm, i);
+						for(size_t j=i+1; j<len; j++)
+						{
+							width = SampleTime(wfm, j) - tstart;
+							if(width >= query.m_maxWidth)
+								break;
+							if(rising ? (wfm->m_samples[j] < thresh) : (wfm->m_samples[j] >= thresh))
+							{
+								match = true;
+								break;
+							}
+						}
+					}
+				}
+				break;
+		}
+
+		if(!match)
+			continue;
+
+		if(!found)
+		{
+			result.m_offset = SampleTime(wfm, i);
+			result.m_duration = (query.m_type == HistorySearchQuery::QUERY_GLITCH) ? width : 0;
+			found = true;
+		}
+		result.m_matches ++;
+	}
+
+	return found;
+}
+
+/**
+	@brief Searches a single point
+
+	@return True if the point matched
+ */
+bool HistorySearch::SearchPoint(HistoryPoint* pt, HistorySearchResult& result)
+{
+	if(!pt->IsResident() || pt->IsLoading())
+	{
+		m_skipped ++;
+		return false;
+	}
+
+	auto chan = dynamic_cast<OscilloscopeChannel*>(m_query.m_stream.m_channel);
+	if(!chan)
+	{
+		m_skipped ++;
+		return false;
+	}
+
+	WaveformBase* wfm = nullptr;
+	for(auto& it : pt->m_history)
+	{
+		if(it.first.get() != chan->GetScope())
+			continue;
+		auto wit = it.second.find(m_query.m_stream);
+		if(wit != it.second.end())
+			wfm = wit->second;
+	}
+	if(!wfm)
+	{
+		m_skipped ++;
+		return false;
+	}
+
+	//Don't let the WaveformThread touch the buffers while we're reading them
+	shared_lock lock(m_session.GetWaveformDataMutex());
+
+	//Compacted waveforms have no float samples to scan until they're expanded
+	if(pt->m_compactSamples.find(wfm) != pt->m_compactSamples.end())
+	{
+		m_skipped ++;
+		return false;
+	}
+
+	auto uwfm = dynamic_cast<UniformAnalogWaveform*>(wfm);
+	auto swfm = dynamic_cast<SparseAnalogWaveform*>(wfm);
+	if(uwfm)
+	{
+		//Waveforms which are already on the GPU are much faster to scan there
+		if( (pt->m_tier == HistoryPoint::TIER_GPU) && (uwfm->size() > 1) && (uwfm->size() < 0x80000000) )
+			return SearchGpu(uwfm, result);
+		return SearchCpu(uwfm, m_query, result);
+	}
+	else if(swfm)
+		return SearchCpu(swfm, m_query, result);
+
+	m_skipped ++;
+	return false;
+}
+
+/**
+	@brief Searches a uniform waveform with a compute shader
+
+	Each thread scans a block of samples and reports the first match in it and the number of matches, which we
+	combine on the CPU.
+ */
+bool HistorySearch::SearchGpu(UniformAnalogWaveform* wfm, HistorySearchResult& result)
+{
+	lock_guard<mutex> lock(m_gpuMutex);
+
+	//Keep the dispatch below the maximum work group count
+	size_t len = wfm->size();
+	const size_t maxThreads = 32768 * 64;
+	size_t samplesPerThread = max((size_t)256, (len + maxThreads - 1) / maxThreads);
+	size_t nthreads = (len + samplesPerThread - 1) / samplesPerThread;
+
+	HistorySearchArgs args;
+	args.numSamples = len;
+	args.samplesPerThread = samplesPerThread;
+	args.numThreads = nthreads;
+	args.type = m_query.m_type;
+	args.maxWidth = min((int64_t)len, (m_query.m_maxWidth + wfm->m_timescale - 1) / wfm->m_timescale);
+	args.threshold = m_query.m_threshold;
+
+	m_gpuResults.resize(3 * nthreads);
+
+	{
+		shared_lock lock2(g_vulkanActivityMutex);
+
+		m_cmdBuf.reset();
+		m_cmdBuf.begin({});
+
+		wfm->m_samples.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+		AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+		m_searchPipeline->BindBufferNonblocking(0, m_gpuResults, m_cmdBuf, true);
+		m_searchPipeline->BindBufferNonblocking(1, wfm->m_samples, m_cmdBuf);
+		m_searchPipeline->Dispatch(m_cmdBuf, args, GetComputeBlockCount(nthreads, 64));
+		m_gpuResults.MarkModifiedFromGpu();
+
+		m_cmdBuf.end();
+		{
+			TRACE_ZONE("Vulkan submit", "history search");
+			m_queue->SubmitAndBlock(m_cmdBuf);
+		}
+	}
+
+	//Blocks are in order, so the first one with a match has the first match overall
+	m_gpuResults.PrepareForCpuAccess();
+	bool found = false;
+	result.m_matches = 0;
+	for(size_t i=0; i<nthreads; i++)
+	{
+		uint32_t first = m_gpuResults[i*3];
+		if(first == NO_MATCH)
+			continue;
+
+		if(!found)
+		{
+			result.m_offset = first * wfm->m_timescale + wfm->m_triggerPhase;
+			result.m_duration = m_gpuResults[i*3 + 2] * wfm->m_timescale;
+			found = true;
+		}
+		result.m_matches += m_gpuResults[i*3 + 1];
+	}
+
+	return found;
+}
@@ -0,0 +1,198 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HistorySearch
+ */
+#ifndef HistorySearch_h
+#define HistorySearch_h
+
+class Session;
+class HistoryManager;
+class HistoryPoint;
+
+/**
+	@brief What to look for in a HistorySearch
+ */
+class HistorySearchQuery
+{
+public:
+	HistorySearchQuery()
+	: m_type(QUERY_BELOW)
+	, m_threshold(0)
+	, m_maxWidth(0)
+	{}
+
+	enum QueryType
+	{
+		///@brief Any sample below the threshold
+		QUERY_BELOW,
+
+		///@brief Any sample above the threshold
+		QUERY_ABOVE,
+
+		///@brief The signal crosses the threshold going up
+		QUERY_RISING_EDGE,
+
+		///@brief The signal crosses the threshold going down
+		QUERY_FALLING_EDGE,
+
+		///@brief The signal crosses the threshold and back again within m_maxWidth
+		QUERY_GLITCH
+	};
+
+	QueryType m_type;
+
+	///@brief Stream of an instrument to search
+	StreamDescriptor m_stream;
+
+	///@brief Threshold, in the stream's Y axis units
+	float m_threshold;
+
+	///@brief Longest pulse which counts as a glitch, in fs
+	int64_t m_maxWidth;
+};
+
+/**
+	@brief A history point which matched a HistorySearchQuery
+ */
+class HistorySearchResult
+{
+public:
+	///@brief Timestamp of the point
+	TimePoint m_point;
+
+	///@brief Time of the first match, in fs from the trigger
+	int64_t m_offset;
+
+	///@brief Width of the first glitch, in fs (zero for other queries)
+	int64_t m_duration;
+
+	///@brief Number of matches in the point (samples for level queries, events for edges and glitches)
+	size_t m_matches;
+};
+
+class HistorySearchArgs
+{
+public:
+	uint32_t numSamples;
+	uint32_t samplesPerThread;
+	uint32_t numThreads;
+	uint32_t type;
+	uint32_t maxWidth;
+	float threshold;
+};
+
+/**
+	@brief Background search of every point in history for an event on one stream
+
+	Points are read in place, without loading them into the session or re-running the filter graph, so only
+	instrument waveforms can be searched. Each point is held (so it isn't evicted or moved between memory tiers) until
+	it's been searched. Waveforms still in GPU memory are scanned by a compute shader, and the rest on the CPU by
+	several threads in parallel. Lazily loaded points which aren't resident are skipped rather than loaded, as are
+	waveforms stored as integer codes.
+ */
+class HistorySearch
+{
+public:
+	HistorySearch(Session& session, HistoryManager& mgr, const HistorySearchQuery& query);
+	~HistorySearch();
+
+	///@brief Checks if every point has been searched (or the search was cancelled)
+	bool IsDone()
+	{ return m_running == 0; }
+
+	///@brief Gets the fraction of points searched so far
+	float GetProgress()
+	{
+		if(m_points.empty())
+			return 1;
+		return m_searched.load() * 1.0f / m_points.size();
+	}
+
+	///@brief Number of points which couldn't be searched (not loaded, or no data for the stream)
+	size_t GetSkippedCount()
+	{ return m_skipped; }
+
+	std::vector<HistorySearchResult> GetResults();
+
+	void Cancel()
+	{ m_cancel = true; }
+
+protected:
+	void WorkerThread();
+	bool SearchPoint(HistoryPoint* pt, HistorySearchResult& result);
+	bool SearchGpu(UniformAnalogWaveform* wfm, HistorySearchResult& result);
+
+	Session& m_session;
+	HistorySearchQuery m_query;
+
+	///@brief Points to search, each holding a reader reference until it's been searched
+	std::vector<std::shared_ptr<HistoryPoint>> m_points;
+
+	///@brief Index of the next point for a worker to pick up
+	std::atomic<size_t> m_next;
+
+	///@brief Number of points searched so far
+	std::atomic<size_t> m_searched;
+
+	///@brief Number of points skipped
+	std::atomic<size_t> m_skipped;
+
+	///@brief Number of worker threads still running
+	std::atomic<size_t> m_running;
+
+	///@brief Set to stop the workers early
+	std::atomic<bool> m_cancel;
+
+	std::vector<std::thread> m_workers;
+
+	///@brief Mutex controlling access to m_results
+	std::mutex m_resultMutex;
+
+	///@brief Points which matched, in no particular order
+	std::vector<HistorySearchResult> m_results;
+
+	///@brief Mutex serializing use of the GPU resources between workers
+	std::mutex m_gpuMutex;
+
+	//Vulkan processing queues etc
+	std::shared_ptr<QueueHandle> m_queue;
+	vk::raii::CommandPool m_pool;
+	vk::raii::CommandBuffer m_cmdBuf;
+	std::shared_ptr<ComputePipeline> m_searchPipeline;
+
+	///@brief Per thread (first match, match count, first glitch width) from the shader
+	AcceleratorBuffer<uint32_t> m_gpuResults;
+};
+
+#endif
@@ -0,0 +1,239 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HistorySearchDialog
+ */
+
+#include "ngscopeclient.h"
+#include "HistorySearchDialog.h"
+#include "MainWindow.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistorySearchDialog::HistorySearchDialog(Session& session, MainWindow& parent)
+	: Dialog("History Search", "HistorySearch", ImVec2(500, 350))
+	, m_session(session)
+	, m_parent(parent)
+	, m_selectedResult(-1)
+{
+	m_query.m_maxWidth = 10 * FS_PER_NANOSECOND;
+}
+
+HistorySearchDialog::~HistorySearchDialog()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rendering
+
+/**
+	@brief Renders the dialog and handles UI events
+
+	@return		True if we should continue showing the dialog
+				False if it's been closed
+ */
+bool HistorySearchDialog::DoRender()
+{
+	QueryControls();
+
+	if(m_search)
+	{
+		bool done = m_search->IsDone();
+		m_results = m_search->GetResults();
+
+		if(!done)
+		{
+			ImGui::ProgressBar(m_search->GetProgress(), ImVec2(-1, 0), "Searching...");
+			if(ImGui::Button("Cancel"))
+				m_search->Cancel();
+		}
+		else
+		{
+			ImGui::Text("%zu matching acquisitions", m_results.size());
+			auto skipped = m_search->GetSkippedCount();
+			if(skipped)
+			{
+				ImGui::SameLine();
+				ImGui::TextDisabled("(%zu skipped)", skipped);
+				Tooltip(
+					"Acquisitions with no data for this channel, or which were loaded lazily from a session\n"
+					"and haven't been viewed yet, can't be searched.");
+			}
+		}
+
+		ResultTable();
+	}
+
+	return true;
+}
+
+/**
+	@brief Shows the controls for choosing what to search for
+ */
+void HistorySearchDialog::QueryControls()
+{
+	float width = ImGui::GetFontSize();
+	bool busy = m_search && !m_search->IsDone();
+	if(busy)
+		ImGui::BeginDisabled();
+
+	//Only instrument waveforms are stored in history, so we can't search filter outputs
+	vector<StreamDescriptor> streams;
+	vector<string> names;
+	int sel = -1;
+	for(auto scope : m_session.GetScopes())
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan)
+				continue;
+
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				if(chan->GetType(j) != Stream::STREAM_TYPE_ANALOG)
+					continue;
+
+				StreamDescriptor stream(chan, j);
+				if(stream == m_query.m_stream)
+					sel = streams.size();
+				streams.push_back(stream);
+				names.push_back(stream.GetName());
+			}
+		}
+	}
+	ImGui::SetNextItemWidth(10 * width);
+	if(Combo("Channel", names, sel))
+		m_thresholdText = "";
+	if(sel >= 0)
+		m_query.m_stream = streams[sel];
+	else
+		m_query.m_stream = StreamDescriptor(nullptr, 0);
+
+	int type = m_query.m_type;
+	ImGui::SetNextItemWidth(10 * width);
+	if(Combo("Find", {"Below threshold", "Above threshold", "Rising edge", "Falling edge", "Glitch"}, type))
+		m_query.m_type = static_cast<HistorySearchQuery::QueryType>(type);
+
+	Unit yunit(Unit::UNIT_VOLTS);
+	if(m_query.m_stream.m_channel)
+		yunit = m_query.m_stream.GetYAxisUnits();
+	if(m_thresholdText.empty())
+		m_thresholdText = yunit.PrettyPrint(m_query.m_threshold);
+	ImGui::SetNextItemWidth(10 * width);
+	UnitInputWithImplicitApply("Threshold", m_thresholdText, m_query.m_threshold, yunit);
+
+	if(m_query.m_type == HistorySearchQuery::QUERY_GLITCH)
+	{
+		Unit fs(Unit::UNIT_FS);
+		if(m_widthText.empty())
+			m_widthText = fs.PrettyPrint(m_query.m_maxWidth);
+		ImGui::SetNextItemWidth(10 * width);
+		UnitInputWithImplicitApply("Max width", m_widthText, m_query.m_maxWidth, fs);
+		HelpMarker("Pulses across the threshold narrower than this are reported as glitches");
+	}
+
+	if(!m_query.m_stream.m_channel)
+		ImGui::BeginDisabled();
+	if(ImGui::Button("Search"))
+	{
+		m_search = nullptr;
+		m_results.clear();
+		m_selectedResult = -1;
+		m_search = make_unique<HistorySearch>(m_session, m_session.GetHistory(), m_query);
+	}
+	if(!m_query.m_stream.m_channel)
+		ImGui::EndDisabled();
+
+	if(busy)
+		ImGui::EndDisabled();
+}
+
+/**
+	@brief Shows the matching points, and navigates to one when it's clicked
+ */
+void HistorySearchDialog::ResultTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_ScrollY;
+
+	if(!ImGui::BeginTable("results", 3, flags))
+		return;
+
+	float width = ImGui::GetFontSize();
+	ImGui::TableSetupScrollFreeze(0, 1); //Header row does not scroll
+	ImGui::TableSetupColumn("Timestamp", ImGuiTableColumnFlags_WidthFixed, 12*width);
+	ImGui::TableSetupColumn("Offset", ImGuiTableColumnFlags_WidthFixed, 8*width);
+	ImGui::TableSetupColumn("Matches");
+	ImGui::TableHeadersRow();
+
+	Unit fs(Unit::UNIT_FS);
+	ImGuiListClipper clipper;
+	clipper.Begin(m_results.size());
+	while(clipper.Step())
+	{
+		for(int i=clipper.DisplayStart; i<clipper.DisplayEnd; i++)
+		{
+			auto& result = m_results[i];
+			ImGui::PushID(i);
+			ImGui::TableNextRow();
+
+			ImGui::TableSetColumnIndex(0);
+			if(ImGui::Selectable(
+				result.m_point.PrettyPrint().c_str(),
+				(m_selectedResult == i),
+				ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap))
+			{
+				m_selectedResult = i;
+				if(m_parent.NavigateToHistoryPoint(result.m_point))
+					m_parent.NavigateToTimestamp(result.m_offset, result.m_duration, m_query.m_stream);
+			}
+
+			ImGui::TableSetColumnIndex(1);
+			ImGui::TextUnformatted(fs.PrettyPrint(result.m_offset).c_str());
+
+			ImGui::TableSetColumnIndex(2);
+			ImGui::Text("%zu", result.m_matches);
+
+			ImGui::PopID();
+		}
+	}
+
+	ImGui::EndTable();
+}
@@ -0,0 +1,81 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HistorySearchDialog
+ */
+#ifndef HistorySearchDialog_h
+#define HistorySearchDialog_h
+
+#include "Dialog.h"
+#include "HistorySearch.h"
+
+class MainWindow;
+
+/**
+	@brief Searches every point in history for an event, and navigates to the matches
+ */
+class HistorySearchDialog : public Dialog
+{
+public:
+	HistorySearchDialog(Session& session, MainWindow& parent);
+	virtual ~HistorySearchDialog();
+
+	virtual bool DoRender();
+
+protected:
+	void QueryControls();
+	void ResultTable();
+
+	Session& m_session;
+	MainWindow& m_parent;
+
+	///@brief The query being edited
+	HistorySearchQuery m_query;
+
+	///@brief Text of the threshold box
+	std::string m_thresholdText;
+
+	///@brief Text of the glitch width box
+	std::string m_widthText;
+
+	///@brief The search in progress, or the last one run
+	std::unique_ptr<HistorySearch> m_search;
+
+	///@brief Results of m_search, refreshed while it's running
+	std::vector<HistorySearchResult> m_results;
+
+	///@brief Index of the selected result, or -1 if none
+	int m_selectedResult;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HistoryThumbnailer
+ */
+
+#include "ngscopeclient.h"
+#include "HistoryThumbnailer.h"
+#include "WaveformArea.h"
+
+using namespace std;
+
+//Largest number of bins (or samples) merged by one thread in a single pass
+static const size_t THUMBNAIL_MAX_FACTOR = 256;
+
+//Largest number of thread blocks to dispatch in the X axis, taller reductions wrap into Y
+static const size_t THUMBNAIL_MAX_X_BLOCKS = 32768;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistoryThumbnailer::HistoryThumbnailer(const string& name)
+	: m_queue(g_vkQueueManager->GetComputeQueue(name + ".queue"))
+	, m_pool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_pool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+{
+	m_pyramidPipeline = make_shared<ComputePipeline>(
+		"shaders/WaveformPyramid.spv", 2, sizeof(WaveformPyramidArgs));
+
+	if(g_hasDebugUtils)
+	{
+		string poolName = name + ".pool";
+		string bufName = name + ".cmdbuf";
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandPool,
+				reinterpret_cast<uint64_t>(static_cast<VkCommandPool>(*m_pool)),
+				poolName.c_str()));
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandBuffer,
+				reinterpret_cast<int64_t>(static_cast<VkCommandBuffer>(*m_cmdBuf)),
+				bufName.c_str()));
+	}
+
+	for(auto& buf : m_scratch)
+	{
+		buf.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+		buf.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reduction
+
+/**
+	@brief Reduces a batch of waveforms to min/max bins in a single submission
+
+	The caller must hold a shared lock on the waveform data and on g_vulkanActivityMutex.
+
+	@param waveforms	Waveforms to reduce
+	@param bins			Maximum number of bins per waveform
+	@param out			Set to the interleaved min/max bins of each waveform, in the same order (empty for waveforms
+						with no samples)
+ */
+void HistoryThumbnailer::Reduce(
+	const vector<UniformAnalogWaveform*>& waveforms,
+	size_t bins,
+	vector<vector<float>>& out)
+{
+	out.clear();
+	out.resize(waveforms.size());
+	if(waveforms.empty() || (bins == 0) )
+		return;
+
+	while(m_outputs.size() < waveforms.size())
+	{
+		auto buf = make_unique<AcceleratorBuffer<float>>("HistoryThumbnailer.output");
+		buf->SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+		buf->SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+		m_outputs.push_back(std::move(buf));
+	}
+
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	for(auto w : waveforms)
+		w->m_samples.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+	AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+	//The scratch buffers are shared by every waveform in the batch, the barrier after each pass keeps them in order
+	bool any = false;
+	for(size_t i=0; i<waveforms.size(); i++)
+	{
+		auto& output = *m_outputs[i];
+		size_t inputLen = waveforms[i]->size();
+		if(inputLen == 0)
+		{
+			output.clear();
+			continue;
+		}
+
+		AcceleratorBuffer<float>* input = &waveforms[i]->m_samples;
+		bool interleaved = false;
+		for(size_t pass = 0; ; pass ++)
+		{
+			size_t factor = min(THUMBNAIL_MAX_FACTOR, max((size_t)1, (inputLen + bins - 1) / bins));
+			size_t outputLen = (inputLen + factor - 1) / factor;
+			bool last = (outputLen <= bins);
+			auto& dest = last ? output : m_scratch[pass % 2];
+			dest.resize(2 * outputLen);
+
+			size_t xblocks = min<size_t>(GetComputeBlockCount(outputLen, 64), THUMBNAIL_MAX_X_BLOCKS);
+			size_t yblocks = GetComputeBlockCount(outputLen, xblocks*64);
+
+			WaveformPyramidArgs args(inputLen, outputLen, factor, interleaved, xblocks*64);
+			m_pyramidPipeline->BindBufferNonblocking(0, *input, m_cmdBuf);
+			m_pyramidPipeline->BindBufferNonblocking(1, dest, m_cmdBuf, true);
+			m_pyramidPipeline->Dispatch(m_cmdBuf, args, xblocks, yblocks);
+			m_pyramidPipeline->AddComputeMemoryBarrier(m_cmdBuf);
+			dest.MarkModifiedFromGpu();
+
+			input = &dest;
+			inputLen = outputLen;
+			interleaved = true;
+			if(last)
+				break;
+		}
+		any = true;
+	}
+
+	m_cmdBuf.end();
+	if(!any)
+		return;
+	{
+		TRACE_ZONE("Vulkan submit", "history thumbnails");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+
+	for(size_t i=0; i<waveforms.size(); i++)
+	{
+		auto& output = *m_outputs[i];
+		if(output.size() == 0)
+			continue;
+		output.PrepareForCpuAccess();
+		out[i].assign(output.GetCpuPointer(), output.GetCpuPointer() + output.size());
+	}
+}
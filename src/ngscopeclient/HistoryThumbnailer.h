@@ -0,0 +1,71 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HistoryThumbnailer
+ */
+#ifndef HistoryThumbnailer_h
+#define HistoryThumbnailer_h
+
+/**
+	@brief Reduces waveforms to a handful of min/max bins on the GPU, for the history dialog's thumbnails
+
+	Each waveform is decimated by repeated passes of the same min/max shader used for the waveform area pyramid, so
+	only the final few dozen bins ever come back to the CPU no matter how deep the acquisition was.
+ */
+class HistoryThumbnailer
+{
+public:
+	HistoryThumbnailer(const std::string& name);
+
+	void Reduce(
+		const std::vector<UniformAnalogWaveform*>& waveforms,
+		size_t bins,
+		std::vector<std::vector<float>>& out);
+
+protected:
+
+	//Vulkan processing queues etc
+	std::shared_ptr<QueueHandle> m_queue;
+	vk::raii::CommandPool m_pool;
+	vk::raii::CommandBuffer m_cmdBuf;
+
+	std::shared_ptr<ComputePipeline> m_pyramidPipeline;
+
+	///@brief Intermediate min/max levels, reused for every waveform
+	AcceleratorBuffer<float> m_scratch[2];
+
+	///@brief Final bins of each waveform, read back once the whole batch has run
+	std::vector<std::unique_ptr<AcceleratorBuffer<float>>> m_outputs;
+};
+
+#endif
@@ -0,0 +1,179 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HostMemoryPolicy
+ */
+
+#include "ngscopeclient.h"
+#include "HostMemoryPolicy.h"
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+///@brief True if large buffers should be advised to use huge pages
+static atomic<bool> g_hugePagesEnabled(false);
+
+///@brief True if large buffers should be placed on their consumer's NUMA node
+static atomic<bool> g_numaEnabled(false);
+
+static atomic<uint64_t> g_hugePageBytes(0);
+static atomic<uint64_t> g_hugePageFailures(0);
+static atomic<uint64_t> g_numaBytes(0);
+static atomic<uint64_t> g_numaFailures(0);
+
+/**
+	@brief Turns the two halves of the policy on or off
+
+	Only affects buffers the policy is applied to from now on.
+ */
+void HostMemoryPolicy::Configure(bool hugePages, bool numa)
+{
+	g_hugePagesEnabled = hugePages;
+	g_numaEnabled = numa;
+}
+
+///@brief Returns true if there's anything for Apply() to do
+bool HostMemoryPolicy::IsEnabled()
+{
+	return g_hugePagesEnabled || g_numaEnabled;
+}
+
+/**
+	@brief Applies the policy to a range of CPU memory
+
+	Only whole pages inside the range are touched, so memory shared with neighbouring allocations is left alone.
+
+	@param ptr		Start of the buffer
+	@param bytes	Size of the buffer
+	@param consumer	Role of the threads which will do most of the work on the buffer
+ */
+void HostMemoryPolicy::Apply(void* ptr, size_t bytes, ThreadRole consumer)
+{
+	if(!ptr || (bytes < MIN_BUFFER_SIZE) || !IsEnabled())
+		return;
+
+#ifdef __linux__
+	uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+	uintptr_t end = start + bytes;
+
+	#ifdef MADV_HUGEPAGE
+	if(g_hugePagesEnabled)
+	{
+		uintptr_t hstart = (start + MIN_BUFFER_SIZE - 1) & ~(MIN_BUFFER_SIZE - 1);
+		uintptr_t hend = end & ~(MIN_BUFFER_SIZE - 1);
+		if(hend > hstart)
+		{
+			if(0 == madvise(reinterpret_cast<void*>(hstart), hend - hstart, MADV_HUGEPAGE))
+				g_hugePageBytes += hend - hstart;
+			else if(g_hugePageFailures++ == 0)
+				LogDebug("madvise(MADV_HUGEPAGE) failed: %s\n", strerror(errno));
+		}
+	}
+	#endif
+
+	int node = g_numaEnabled ? ThreadRoles::GetNumaNode(consumer) : -1;
+	if(node >= 0)
+	{
+		uintptr_t pagesize = sysconf(_SC_PAGESIZE);
+		uintptr_t pstart = (start + pagesize - 1) & ~(pagesize - 1);
+		uintptr_t pend = end & ~(pagesize - 1);
+
+		const size_t bitsPerWord = 8 * sizeof(unsigned long);
+		vector<unsigned long> mask(node / bitsPerWord + 1, 0);
+		mask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+
+		//Preferred rather than bound, so we still get memory if the node is full.
+		//MPOL_MF_MOVE migrates any pages which have already been touched.
+		long ret = syscall(
+			SYS_mbind,
+			pstart,
+			pend - pstart,
+			MPOL_PREFERRED,
+			mask.data(),
+			mask.size() * bitsPerWord + 1,
+			MPOL_MF_MOVE);
+		if(ret == 0)
+			g_numaBytes += pend - pstart;
+		else if(g_numaFailures++ == 0)
+			LogDebug("mbind to node %d failed: %s\n", node, strerror(errno));
+	}
+#else
+	(void)consumer;
+#endif
+}
+
+/**
+	@brief Applies the policy to every sample buffer of a waveform
+
+	Waveforms of types we don't know the sample layout of have only their timestamps adjusted.
+ */
+void HostMemoryPolicy::ApplyToWaveform(WaveformBase* wfm, ThreadRole consumer)
+{
+	if(!wfm || !IsEnabled())
+		return;
+
+	auto sparse = dynamic_cast<SparseWaveformBase*>(wfm);
+	if(sparse)
+	{
+		Apply(sparse->m_offsets, consumer);
+		Apply(sparse->m_durations, consumer);
+	}
+
+	auto ua = dynamic_cast<UniformAnalogWaveform*>(wfm);
+	auto sa = dynamic_cast<SparseAnalogWaveform*>(wfm);
+	auto ud = dynamic_cast<UniformDigitalWaveform*>(wfm);
+	auto sd = dynamic_cast<SparseDigitalWaveform*>(wfm);
+	if(ua)
+		Apply(ua->m_samples, consumer);
+	else if(sa)
+		Apply(sa->m_samples, consumer);
+	else if(ud)
+		Apply(ud->m_samples, consumer);
+	else if(sd)
+		Apply(sd->m_samples, consumer);
+}
+
+HostMemoryPolicyStats HostMemoryPolicy::GetStats()
+{
+	HostMemoryPolicyStats stats;
+	stats.m_hugePageBytes = g_hugePageBytes;
+	stats.m_hugePageFailures = g_hugePageFailures;
+	stats.m_numaBytes = g_numaBytes;
+	stats.m_numaFailures = g_numaFailures;
+	return stats;
+}
@@ -0,0 +1,99 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HostMemoryPolicy
+ */
+#ifndef HostMemoryPolicy_h
+#define HostMemoryPolicy_h
+
+#include "ThreadRoles.h"
+
+class WaveformBase;
+
+/**
+	@brief Counters for what HostMemoryPolicy has done since startup
+ */
+class HostMemoryPolicyStats
+{
+public:
+	///@brief Bytes of buffer the kernel agreed to back with huge pages
+	uint64_t m_hugePageBytes;
+
+	///@brief Number of buffers the huge page advice was rejected for
+	uint64_t m_hugePageFailures;
+
+	///@brief Bytes of buffer placed on (or moved to) a specific NUMA node
+	uint64_t m_numaBytes;
+
+	///@brief Number of buffers which couldn't be placed
+	uint64_t m_numaFailures;
+};
+
+/**
+	@brief Placement policy for large CPU-side buffers (waveforms in history, load / save staging)
+
+	Buffers are allocated by libscopehal, so rather than allocating memory ourselves we adjust it after the fact:
+	large buffers are advised to use transparent huge pages, and placed on the NUMA node of the thread role which will
+	process them (if that role is pinned to CPUs on a single node, see ThreadRoles). Applying the policy before a
+	buffer is first written is cheapest, but it also works on a populated buffer (pages are migrated).
+
+	Only anonymous memory can be adjusted. Pinned memory mapped by the Vulkan driver generally can't, and shows up as
+	failures in the stats. Currently Linux only; everywhere else this does nothing.
+
+	Safe to call from any thread.
+ */
+class HostMemoryPolicy
+{
+public:
+	static void Configure(bool hugePages, bool numa);
+	static bool IsEnabled();
+
+	static void Apply(void* ptr, size_t bytes, ThreadRole consumer = THREAD_ROLE_WAVEFORM);
+	static void ApplyToWaveform(WaveformBase* wfm, ThreadRole consumer = THREAD_ROLE_WAVEFORM);
+
+	/**
+		@brief Applies the policy to the CPU side of a buffer, if it has one
+	 */
+	template<class T>
+	static void Apply(AcceleratorBuffer<T>& buf, ThreadRole consumer = THREAD_ROLE_WAVEFORM)
+	{
+		if(IsEnabled() && buf.HasCpuBuffer())
+			Apply(buf.GetCpuPointer(), buf.size() * sizeof(T), consumer);
+	}
+
+	static HostMemoryPolicyStats GetStats();
+
+	///@brief Buffers smaller than this are left alone, since they can't use a huge page anyway
+	static const size_t MIN_BUFFER_SIZE = 2 * 1024 * 1024;
+};
+
+#endif
@@ -0,0 +1,109 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of InstrumentPoller
+ */
+#ifndef InstrumentPoller_h
+#define InstrumentPoller_h
+
+#include "DataLogger.h"
+
+/**
+	@brief Polls one instrument, one pass at a time
+
+	Holds everything an instrument's polling loop keeps between passes, so the same code can be driven either by a
+	dedicated InstrumentThread or by a shared PollingScheduler.
+ */
+class InstrumentPoller
+{
+public:
+	InstrumentPoller(InstrumentThreadArgs args);
+	~InstrumentPoller();
+
+	double Poll();
+
+	///@brief Gets the instrument being polled
+	std::shared_ptr<SCPIInstrument> GetInstrument()
+	{ return m_args.inst; }
+
+protected:
+	void PollScope(double& waitTime, bool& newData);
+	void PollPowerSupply(bool& newData);
+	void PollLoad(bool& newData);
+	void PollMultimeter(bool& newData);
+	void PollFunctionGenerator(double& waitTime, bool& newData);
+
+	///@brief Instrument, session and shared state we were created with
+	InstrumentThreadArgs m_args;
+
+	std::shared_ptr<Load> m_load;
+	std::shared_ptr<Oscilloscope> m_scope;
+	std::shared_ptr<SCPIBERT> m_bert;
+	std::shared_ptr<SCPIMultimeter> m_meter;
+	std::shared_ptr<SCPIRFSignalGenerator> m_rfgen;
+	std::shared_ptr<SCPIMiscInstrument> m_misc;
+	std::shared_ptr<SCPIPowerSupply> m_psu;
+	std::shared_ptr<FunctionGenerator> m_awg;
+
+	///@brief True once the trigger state of a stopped scope has settled
+	bool m_triggerUpToDate;
+
+	///@brief Time of the most recent trigger, for picking the poll interval
+	double m_lastTriggerTime;
+
+	///@brief Smoothed time between triggers
+	double m_triggerPeriod;
+
+	///@brief Start of the current poll rate measurement window
+	double m_rateWindowStart;
+
+	///@brief Number of trigger polls in the current measurement window
+	size_t m_pollCount;
+
+	///@brief Used to count queue stalls once each rather than once per poll
+	bool m_queueFull;
+
+	///@brief Last time we read slow-changing PSU status flags
+	double m_lastPsuStatusPoll;
+
+	///@brief Worker for long-running BERT scans, started the first time we poll a BERT
+	std::unique_ptr<std::thread> m_bertScanThread;
+
+	///@brief Tells the BERT scan thread to stop before starting another scan
+	std::shared_ptr<std::atomic<bool>> m_bertScanExit;
+
+	///@brief Our connection to the session's data log, if it has one open
+	DataLogSource m_datalog;
+};
+
+#endif
@@ -30,227 +30,619 @@
 /**
 	@file
 	@author Andrew D. Zonenberg
-	@brief Implementation of ScopeThread
+	@brief Implementation of InstrumentThread and InstrumentPoller
  */
 #include "ngscopeclient.h"
 #include "pthread_compat.h"
 #include "Session.h"
+#include "InstrumentPoller.h"
 #include "LoadChannel.h"
+#include "DataLogger.h"
+#include "ArbitraryWaveformUpload.h"
 
 using namespace std;
 
-void InstrumentThread(InstrumentThreadArgs args)
-{
-	pthread_setname_np_compat("InstrumentThread");
+extern Event g_waveformThreadWakeEvent;
 
-	auto inst = args.inst;
-	if(!inst)
-	{
-		LogError("InstrumentThread called with null instrument (bug)\n");
-		return;
-	}
+//Limits on how often to poll an armed scope for a trigger, in seconds
+#define MIN_TRIGGER_POLL_INTERVAL 0.0005
+#define MAX_TRIGGER_POLL_INTERVAL 0.01
+
+//How long to wait when there's nothing to poll for. We get woken early by whatever changes that.
+#define IDLE_POLL_INTERVAL 0.05
+
+/**
+	@brief Figures out how many waveforms a scope may have pending before we stop grabbing data from it
+
+	In memory mode the per-waveform size is estimated as sample depth times the number of enabled streams, so the
+	limit follows the current acquisition settings.
+ */
+static size_t GetWaveformQueueLimit(shared_ptr<Oscilloscope> scope, shared_ptr<InstrumentConnectionState> state)
+{
+	if(!state->m_queueLimitByMemory)
+		return max((size_t)1, state->m_queueLimitCount.load());
 
-	auto session = args.session;
-
-	//Extract type-specified fields
-	auto load = dynamic_pointer_cast<Load>(inst);
-	auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
-	auto bert = dynamic_pointer_cast<SCPIBERT>(inst);
-	auto meter = dynamic_pointer_cast<SCPIMultimeter>(inst);
-	auto rfgen = dynamic_pointer_cast<SCPIRFSignalGenerator>(inst);
-	auto misc = dynamic_pointer_cast<SCPIMiscInstrument>(inst);
-	auto psu = dynamic_pointer_cast<SCPIPowerSupply>(inst);
-	auto awg = dynamic_pointer_cast<FunctionGenerator>(inst);
-	auto loadstate = args.loadstate;
-	auto meterstate = args.meterstate;
-	auto bertstate = args.bertstate;
-	auto psustate = args.psustate;
-	auto awgstate = args.awgstate;
-
-	bool triggerUpToDate = false;
-
-	while(!*args.shuttingDown)
+	size_t bytesPerSample = 0;
+	for(size_t i=0; i<scope->GetChannelCount(); i++)
 	{
-		//Flush any pending commands
-		inst->GetTransport()->FlushCommandQueue();
+		if(!scope->IsChannelEnabled(i))
+			continue;
+		auto chan = scope->GetOscilloscopeChannel(i);
+		if(!chan)
+			continue;
 
-		//Scope processing
-		if(scope)
+		for(size_t j=0; j<chan->GetStreamCount(); j++)
 		{
-			//If the queue is too big, stop grabbing data
-			size_t npending = scope->GetPendingWaveformCount();
-			if(npending > 5)
+			switch(chan->GetType(j))
 			{
-				LogTrace("Queue is too big, sleeping\n");
-				this_thread::sleep_for(chrono::milliseconds(5));
-			}
+				case Stream::STREAM_TYPE_ANALOG:
+					bytesPerSample += sizeof(float);
+					break;
 
-			//If trigger isn't armed, don't even bother polling for a while.
-			else if(!scope->IsTriggerArmed())
-			{
-				//LogTrace("Scope isn't armed, sleeping\n");
-				this_thread::sleep_for(chrono::milliseconds(5));
-				if(!triggerUpToDate)
-				{	// Check for trigger state change
-					auto stat = scope->PollTrigger();
-					session->GetInstrumentConnectionState(inst)->m_lastTriggerState = stat;
-					if(stat == Oscilloscope::TRIGGER_MODE_STOP || stat == Oscilloscope::TRIGGER_MODE_RUN || stat == Oscilloscope::TRIGGER_MODE_TRIGGERED)
-					{	// Final state
-						triggerUpToDate = true;
-					}
-				}
-			}
+				case Stream::STREAM_TYPE_DIGITAL:
+					bytesPerSample += sizeof(bool);
+					break;
 
-			//Grab data if it's ready
-			//TODO: how is this going to play with reading realtime BER from BERT+scope deviecs?
-			else
-			{
-				auto stat = scope->PollTrigger();
-				session->GetInstrumentConnectionState(inst)->m_lastTriggerState = stat;
-				if(stat == Oscilloscope::TRIGGER_MODE_TRIGGERED)
-				{
-					//Hold this lock because some scopes use vulkan for sample processing internally
-					//and we need to block in case a swapchain recreation comes in
-					shared_lock<shared_mutex> vlock(g_vulkanActivityMutex);
-
-					scope->AcquireData();
-				}
-				triggerUpToDate = false;
+				default:
+					break;
 			}
 		}
+	}
 
-		//Always acquire data from non-scope instruments
-		else
-			inst->AcquireData();
+	int64_t bytesPerWaveform = bytesPerSample * scope->GetSampleDepth();
+	if(bytesPerWaveform <= 0)
+		return 1;
+	return max((int64_t)1, state->m_queueLimitBytes / bytesPerWaveform);
+}
+
+/**
+	@brief Stores a new reading, and reports whether it differs from the previous one
+
+	Used to decide whether the GUI needs to be woken up to redraw.
+ */
+static bool UpdateReading(atomic<float>& reading, float value)
+{
+	return (reading.exchange(value) != value);
+}
+
+/**
+	@brief Runs bathtub and eye scans queued from the UI for one BERT
+
+	Scans can take minutes, so they're kept off the instrument thread to keep it (and shutdown) responsive.
+	Requests are served one at a time in channel order, holding the BERT's driver mutex for each one. The exit flag
+	is checked before every scan, since a scan already handed to the driver can't be interrupted.
 
-		//Populate scalar channel and do other instrument-specific processing
-		if(psu && psustate)
+	Only shared state is touched here, so the thread can be left to finish a scan after its poller has gone.
+ */
+static void BERTScanThread(
+	shared_ptr<SCPIBERT> bert,
+	shared_ptr<BERTState> state,
+	shared_ptr<atomic<bool>> exit)
+{
+	pthread_setname_np_compat("BERTScanThread");
+	Tracer::SetThreadName("BERTScanThread");
+	ThreadRoleScope role(THREAD_ROLE_INSTRUMENT);
+
+	Unit fs(Unit::UNIT_FS);
+	while(!*exit)
+	{
+		bool ranScan = false;
+		for(size_t i=0; (i<bert->GetChannelCount()) && !*exit; i++)
 		{
-			//Poll status
-			for(size_t i=0; i<psu->GetChannelCount(); i++)
+			if(state->m_horzBathtubScanPending[i])
 			{
-				//Skip non-power channels
-				auto pchan = dynamic_cast<PowerSupplyChannel*>(psu->GetChannel(i));
-				if(!pchan)
+				lock_guard<mutex> lock(state->m_driverMutex);
+				if(*exit || !state->m_horzBathtubScanPending[i].exchange(false))
 					continue;
 
-				psustate->m_channelVoltage[i] = pchan->GetVoltageMeasured();
-				psustate->m_channelCurrent[i] = pchan->GetCurrentMeasured();
-				psustate->m_channelConstantCurrent[i] = psu->IsPowerConstantCurrent(i);
-				psustate->m_channelFuseTripped[i] = psu->GetPowerOvercurrentShutdownTripped(i);
-				psustate->m_channelOn[i] = psu->GetPowerChannelActive(i);
+				TRACE_ZONE("HBathtub", bert->m_nickname.c_str());
+				auto expected = bert->GetExpectedBathtubCaptureTime(i);
+				LogTrace("Starting bathtub scan, expecting to take %s\n", fs.PrettyPrint(expected).c_str());
+
+				state->m_scanInProgress[i] = true;
+				double start = GetTime();
+				bert->MeasureHBathtub(i);
+				double dt = (GetTime() - start) * FS_PER_SECOND;
+				state->m_scanInProgress[i] = false;
 
-				session->MarkChannelDirty(pchan);
+				LogTrace("Scan actually took %s\n", fs.PrettyPrint(dt).c_str());
+				state->m_scanFinished[i] = true;
+				ranScan = true;
 			}
 
-			if(psu->SupportsMasterOutputSwitching())
-				psustate->m_masterEnable = psu->GetMasterPowerEnable();
+			if(state->m_eyeScanPending[i] && !*exit)
+			{
+				lock_guard<mutex> lock(state->m_driverMutex);
+				if(*exit || !state->m_eyeScanPending[i].exchange(false))
+					continue;
+
+				TRACE_ZONE("Eye", bert->m_nickname.c_str());
+				auto expected = bert->GetExpectedEyeCaptureTime(i);
+				LogTrace("Starting eye scan, expecting to take %s\n", fs.PrettyPrint(expected).c_str());
+
+				state->m_scanInProgress[i] = true;
+				double start = GetTime();
+				bert->MeasureEye(i);
+				double dt = (GetTime() - start) * FS_PER_SECOND;
+				state->m_scanInProgress[i] = false;
 
-			psustate->m_firstUpdateDone = true;
+				LogTrace("Scan actually took %s\n", fs.PrettyPrint(dt).c_str());
+				state->m_scanFinished[i] = true;
+				ranScan = true;
+			}
 		}
-		if(load && loadstate)
+
+		//The instrument thread picks up the results on its next poll
+		if(!ranScan)
+			this_thread::sleep_for(chrono::milliseconds(50));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Dedicated polling thread
+
+void InstrumentThread(InstrumentThreadArgs args)
+{
+	pthread_setname_np_compat("InstrumentThread");
+	Tracer::SetThreadName("InstrumentThread");
+	ThreadRoleScope role(THREAD_ROLE_INSTRUMENT);
+
+	if(!args.inst)
+	{
+		LogError("InstrumentThread called with null instrument (bug)\n");
+		return;
+	}
+
+	{
+		InstrumentPoller poller(args);
+		while(!*args.shuttingDown)
 		{
-			for(size_t i=0; i<load->GetChannelCount(); i++)
-			{
-				auto lchan = dynamic_cast<LoadChannel*>(load->GetChannel(i));
+			double waitTime = poller.Poll();
 
-				loadstate->m_channelVoltage[i] = lchan->GetScalarValue(LoadChannel::STREAM_VOLTAGE_MEASURED);
-				loadstate->m_channelCurrent[i] = lchan->GetScalarValue(LoadChannel::STREAM_CURRENT_MEASURED);
+			//Wait until the next poll is due, or something wakes us up early
+			if(args.wakeEvent)
+				args.wakeEvent->BlockFor(chrono::duration<double>(waitTime));
+			else
+				this_thread::sleep_for(chrono::duration<double>(waitTime));
+		}
+	}
 
-				session->MarkChannelDirty(lchan);
-			}
-			loadstate->m_firstUpdateDone = true;
+	LogTrace("Shutting down instrument thread\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+InstrumentPoller::InstrumentPoller(InstrumentThreadArgs args)
+	: m_args(args)
+	, m_load(dynamic_pointer_cast<Load>(args.inst))
+	, m_scope(dynamic_pointer_cast<Oscilloscope>(args.inst))
+	, m_bert(dynamic_pointer_cast<SCPIBERT>(args.inst))
+	, m_meter(dynamic_pointer_cast<SCPIMultimeter>(args.inst))
+	, m_rfgen(dynamic_pointer_cast<SCPIRFSignalGenerator>(args.inst))
+	, m_misc(dynamic_pointer_cast<SCPIMiscInstrument>(args.inst))
+	, m_psu(dynamic_pointer_cast<SCPIPowerSupply>(args.inst))
+	, m_awg(dynamic_pointer_cast<FunctionGenerator>(args.inst))
+	, m_triggerUpToDate(false)
+	, m_lastTriggerTime(0)
+	, m_triggerPeriod(0)
+	, m_rateWindowStart(GetTime())
+	, m_pollCount(0)
+	, m_queueFull(false)
+	, m_lastPsuStatusPoll(0)
+{
+	//Accept reads from the GUI so dialogs don't block rendering on a round trip to the instrument
+	InstrumentReadQueue::Register(m_args.inst.get(), m_args.wakeEvent);
+}
+
+/**
+	@brief Stops accepting GUI reads and shuts down the BERT scan thread
+
+	If a scan is in progress we don't wait minutes for it: the thread is detached, and exits on its own once the
+	driver returns.
+ */
+InstrumentPoller::~InstrumentPoller()
+{
+	InstrumentReadQueue::Unregister(m_args.inst.get());
+
+	if(m_bertScanThread)
+	{
+		*m_bertScanExit = true;
+
+		//If we can get the driver mutex no scan is running, and the thread sees the exit flag before starting one
+		unique_lock<mutex> lock(m_args.bertstate->m_driverMutex, try_to_lock);
+		if(lock.owns_lock())
+		{
+			lock.unlock();
+			m_bertScanThread->join();
 		}
-		if(meter && meterstate)
+		else
 		{
-			auto chan = dynamic_cast<MultimeterChannel*>(meter->GetChannel(meter->GetCurrentMeterChannel()));
+			LogTrace("Leaving BERT scan to finish in the background\n");
+			m_bertScanThread->detach();
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Polling
+
+/**
+	@brief Runs one pass of polling: flushes queued commands, reads the instrument, and publishes the results
+
+	@return Time (in seconds) until the instrument wants to be polled again. Zero means as soon as possible.
+ */
+double InstrumentPoller::Poll()
+{
+	auto inst = m_args.inst;
+	auto session = m_args.session;
+
+	//Non-scope instruments are rate limited to 100 Hz to avoid saturating CPU with polls
+	//(this also provides a yield point for the gui thread to get mutex ownership etc)
+	double waitTime = 0.01;
+
+	//Set if anything the GUI shows changed this time around, so it can redraw without waiting for a timeout
+	bool newData = false;
+
+	//While a BERT scan has the driver, leave the instrument alone (drivers aren't thread safe)
+	unique_lock<mutex> bertLock;
+	if(m_bert && m_args.bertstate)
+	{
+		bertLock = unique_lock<mutex>(m_args.bertstate->m_driverMutex, try_to_lock);
+		if(!bertLock.owns_lock())
+			return IDLE_POLL_INTERVAL;
+	}
+
+	//Flush any pending commands
+	inst->GetTransport()->FlushCommandQueue();
+
+	//Run any reads the GUI queued since last time
+	newData |= InstrumentReadQueue::RunPending(inst.get());
+
+	//Scope processing
+	if(m_scope)
+		PollScope(waitTime, newData);
+
+	//Always acquire data from non-scope instruments
+	else
+	{
+		TRACE_ZONE("AcquireData", inst->m_nickname.c_str());
+		inst->AcquireData();
+	}
+
+	//Populate scalar channel and do other instrument-specific processing
+	m_datalog.Begin(session->GetDataLogger());
+	if(m_psu && m_args.psustate)
+		PollPowerSupply(newData);
+	if(m_load && m_args.loadstate)
+		PollLoad(newData);
+	if(m_meter && m_args.meterstate)
+		PollMultimeter(newData);
+	if(m_misc || m_rfgen || m_bert)
+	{
+		for(size_t i=0; i<inst->GetChannelCount(); i++)
+		{
+			auto chan = inst->GetChannel(i);
 			if(chan)
+				session->MarkPolledChannelDirty(chan);
+		}
+	}
+	if(m_bert && m_args.bertstate)
+	{
+		//Long scans run on their own thread so they don't hold up the instrument thread
+		if(!m_bertScanThread)
+		{
+			m_bertScanExit = make_shared<atomic<bool>>(false);
+			m_bertScanThread = make_unique<thread>(BERTScanThread, m_bert, m_args.bertstate, m_bertScanExit);
+		}
+
+		//Refresh anything downstream of scans that just finished
+		for(size_t i=0; i<m_bert->GetChannelCount(); i++)
+		{
+			if(m_args.bertstate->m_scanFinished[i].exchange(false))
 			{
-				meterstate->m_primaryMeasurement = chan->GetPrimaryValue();
-				meterstate->m_secondaryMeasurement = chan->GetSecondaryValue();
-				meterstate->m_firstUpdateDone = true;
+				session->MarkChannelDirty(m_bert->GetChannel(i));
+				newData = true;
+			}
+		}
+
+		m_args.bertstate->m_firstUpdateDone = true;
+	}
+	if(m_awg && m_args.awgstate)
+		PollFunctionGenerator(waitTime, newData);
+
+	//TODO: does this make sense to do in the instrument thread?
+	session->RefreshDirtyFiltersNonblocking();
+
+	//Let the GUI redraw right away if it's sleeping in power-saving mode
+	if(newData)
+		WakeEventLoop();
+
+	return waitTime;
+}
+
+/**
+	@brief Checks an oscilloscope's trigger, downloads data if it triggered, and picks the next poll interval
+ */
+void InstrumentPoller::PollScope(double& waitTime, bool& newData)
+{
+	auto inst = m_args.inst;
+	auto session = m_args.session;
+	auto scope = m_scope;
+
+	//If the queue is too big, stop grabbing data
+	//(the session wakes us when it pops a waveform off the queue).
+	//Don't bother working out the limit if nothing is queued, it might mean talking to the instrument.
+	auto state = session->GetInstrumentConnectionState(inst);
+	size_t npending = scope->GetPendingWaveformCount();
+	bool full = false;
+	if(state && (npending > 0) )
+	{
+		size_t limit = GetWaveformQueueLimit(scope, state);
+		state->m_queueLimit = limit;
+		full = (npending > limit);
+	}
+	if(full && !m_queueFull)
+		state->m_queueStalls ++;
+	m_queueFull = full;
+
+	if(full)
+	{
+		LogTrace("Queue is too big, waiting for it to drain\n");
+		waitTime = IDLE_POLL_INTERVAL;
+	}
 
-				session->MarkChannelDirty(chan);
+	//If trigger isn't armed, don't even bother polling until it is
+	//(but keep an eye on the trigger state until it settles)
+	else if(!scope->IsTriggerArmed())
+	{
+		waitTime = m_triggerUpToDate ? IDLE_POLL_INTERVAL : 0.005;
+		if(!m_triggerUpToDate)
+		{	// Check for trigger state change
+			auto stat = scope->PollTrigger();
+			auto cstate = session->GetInstrumentConnectionState(inst);
+			if(cstate->m_lastTriggerState != stat)
+				newData = true;
+			cstate->m_lastTriggerState = stat;
+			if(stat == Oscilloscope::TRIGGER_MODE_STOP || stat == Oscilloscope::TRIGGER_MODE_RUN || stat == Oscilloscope::TRIGGER_MODE_TRIGGERED)
+			{	// Final state
+				m_triggerUpToDate = true;
 			}
 		}
-		if(misc || rfgen || bert)
+	}
+
+	//Grab data if it's ready
+	//TODO: how is this going to play with reading realtime BER from BERT+scope deviecs?
+	else
+	{
+		m_pollCount ++;
+
+		Oscilloscope::TriggerMode stat;
 		{
-			for(size_t i=0; i<inst->GetChannelCount(); i++)
-			{
-				auto chan = inst->GetChannel(i);
-				if(chan)
-					session->MarkChannelDirty(chan);
-			}
+			TRACE_ZONE("PollTrigger", inst->m_nickname.c_str());
+			stat = scope->PollTrigger();
 		}
-		if(bert && bertstate)
+		auto cstate = session->GetInstrumentConnectionState(inst);
+		if(cstate->m_lastTriggerState != stat)
+			newData = true;
+		cstate->m_lastTriggerState = stat;
+		double now = GetTime();
+		if(stat == Oscilloscope::TRIGGER_MODE_TRIGGERED)
 		{
-			//Check if we have any pending acquisition requests
-			for(size_t i=0; i<bert->GetChannelCount(); i++)
 			{
-				if(bertstate->m_horzBathtubScanPending[i].exchange(false))
-				{
-					Unit fs(Unit::UNIT_FS);
-					auto expected = bert->GetExpectedBathtubCaptureTime(i);
-					LogTrace("Starting bathtub scan, expecting to take %s\n", fs.PrettyPrint(expected).c_str());
-
-					double start = GetTime();
-					bert->MeasureHBathtub(i);
-					double dt = (GetTime() - start) * FS_PER_SECOND;
-
-					LogTrace("Scan actually took %s\n", fs.PrettyPrint(dt).c_str());
-				}
-
-				if(bertstate->m_eyeScanPending[i].exchange(false))
-				{
-					Unit fs(Unit::UNIT_FS);
-					auto expected = bert->GetExpectedEyeCaptureTime(i);
-					LogTrace("Starting eye scan, expecting to take %s\n", fs.PrettyPrint(expected).c_str());
-
-					double start = GetTime();
-					bert->MeasureEye(i);
-					double dt = (GetTime() - start) * FS_PER_SECOND;
-
-					LogTrace("Scan actually took %s\n", fs.PrettyPrint(dt).c_str());
-				}
+				//Hold this lock because some scopes use vulkan for sample processing internally
+				//and we need to block in case a swapchain recreation comes in
+				shared_lock vlock(g_vulkanActivityMutex);
+
+				TRACE_ZONE("AcquireData", inst->m_nickname.c_str());
+				scope->AcquireData();
 			}
+			session->GetMetricHistory().Record("Acquire time", (GetTime() - now) * FS_PER_SECOND);
+
+			//Let the waveform thread know there's new data rather than having it poll
+			g_waveformThreadWakeEvent.Signal();
 
-			bertstate->m_firstUpdateDone = true;
+			//Smooth the trigger period a bit to ride out jitter
+			if(m_lastTriggerTime > 0)
+			{
+				double dt = now - m_lastTriggerTime;
+				if(m_triggerPeriod <= 0)
+					m_triggerPeriod = dt;
+				else
+					m_triggerPeriod = 0.75*m_triggerPeriod + 0.25*dt;
+			}
+			m_lastTriggerTime = now;
 		}
-		// Read and cache FunctionGenerator settings
-		if(awg && awgstate)
+		m_triggerUpToDate = false;
+
+		//Poll a few times per expected trigger. If it's been a lot longer than that since the last trigger,
+		//the rate has dropped, so back off accordingly.
+		double expected = m_triggerPeriod;
+		if(m_lastTriggerTime > 0)
+			expected = max(expected, now - m_lastTriggerTime);
+		if(expected <= 0)
+			waitTime = MIN_TRIGGER_POLL_INTERVAL;
+		else
+			waitTime = min(max(expected / 4, MIN_TRIGGER_POLL_INTERVAL), MAX_TRIGGER_POLL_INTERVAL);
+	}
+
+	//Update rate metrics about once a second
+	double now = GetTime();
+	double dt = now - m_rateWindowStart;
+	if(dt >= 1)
+	{
+		if(m_args.pollRate)
+			*m_args.pollRate = m_pollCount / dt;
+		if(m_args.triggerRate)
 		{
-			//Read status for channels that need it
-			for(size_t i=0; i<awg->GetChannelCount(); i++)
-			{
-				if(awgstate->m_needsUpdate[i])
-				{
-					Unit volts(Unit::UNIT_VOLTS);
-
-					//Skip non-awg channels
-					auto awgchan = dynamic_cast<FunctionGeneratorChannel*>(awg->GetChannel(i));
-					if(!awgchan)
-						continue;
-					awgstate->m_channelActive[i] = awg->GetFunctionChannelActive(i);
-					awgstate->m_channelAmplitude[i] = awg->GetFunctionChannelAmplitude(i);
-					awgstate->m_channelOffset[i] = awg->GetFunctionChannelOffset(i);
-					awgstate->m_channelFrequency[i] = awg->GetFunctionChannelFrequency(i);
-					awgstate->m_channelShape[i] = awg->GetFunctionChannelShape(i);
-					awgstate->m_channelOutputImpedance[i] = awg->GetFunctionChannelOutputImpedance(i);
-					session->MarkChannelDirty(awgchan);
-
-					awgstate->m_needsUpdate[i] = false;
-				}
+			bool stale = (m_lastTriggerTime <= 0) || ( (now - m_lastTriggerTime) > 2 );
+			*m_args.triggerRate = ( (m_triggerPeriod > 0) && !stale ) ? (1 / m_triggerPeriod) : 0;
+		}
+		m_pollCount = 0;
+		m_rateWindowStart = now;
+	}
+}
 
-			}
+/**
+	@brief Reads back a power supply's measurements, and its status flags when they're due
+ */
+void InstrumentPoller::PollPowerSupply(bool& newData)
+{
+	auto session = m_args.session;
+
+	//Measured values are polled every time around, but mode / protection / enable flags rarely change
+	//so only read them at the (slower) status rate, or when the UI just changed something.
+	//Every query is a full round trip to the instrument, so this cuts the per-poll latency roughly in half.
+	double now = GetTime();
+	double statusInterval =
+		session->GetPreferences().GetReal("Drivers.General.psu_status_interval") / FS_PER_SECOND;
+	bool pollStatus =
+		!m_args.psustate->m_firstUpdateDone ||
+		m_args.psustate->m_statusUpdateRequested.exchange(false) ||
+		( (now - m_lastPsuStatusPoll) >= statusInterval );
+	if(pollStatus)
+	{
+		m_lastPsuStatusPoll = now;
+		newData = true;
+	}
+
+	//Poll status
+	for(size_t i=0; i<m_psu->GetChannelCount(); i++)
+	{
+		//Skip non-power channels
+		auto pchan = dynamic_cast<PowerSupplyChannel*>(m_psu->GetChannel(i));
+		if(!pchan)
+			continue;
+
+		newData |= UpdateReading(m_args.psustate->m_channelVoltage[i], pchan->GetVoltageMeasured());
+		newData |= UpdateReading(m_args.psustate->m_channelCurrent[i], pchan->GetCurrentMeasured());
+		m_datalog.Log(m_psu.get(), pchan, "Voltage", Unit(Unit::UNIT_VOLTS), m_args.psustate->m_channelVoltage[i]);
+		m_datalog.Log(m_psu.get(), pchan, "Current", Unit(Unit::UNIT_AMPS), m_args.psustate->m_channelCurrent[i]);
+		if(pollStatus)
+		{
+			m_args.psustate->m_channelConstantCurrent[i] = m_psu->IsPowerConstantCurrent(i);
+			m_args.psustate->m_channelFuseTripped[i] = m_psu->GetPowerOvercurrentShutdownTripped(i);
+			m_args.psustate->m_channelOn[i] = m_psu->GetPowerChannelActive(i);
 		}
 
-		//TODO: does this make sense to do in the instrument thread?
-		session->RefreshDirtyFiltersNonblocking();
+		session->MarkPolledChannelDirty(pchan);
+	}
+
+	if(pollStatus && m_psu->SupportsMasterOutputSwitching())
+		m_args.psustate->m_masterEnable = m_psu->GetMasterPowerEnable();
+
+	m_args.psustate->m_firstUpdateDone = true;
+}
+
+/**
+	@brief Reads back an electronic load's measurements
+ */
+void InstrumentPoller::PollLoad(bool& newData)
+{
+	auto session = m_args.session;
+
+	for(size_t i=0; i<m_load->GetChannelCount(); i++)
+	{
+		auto lchan = dynamic_cast<LoadChannel*>(m_load->GetChannel(i));
+
+		newData |= UpdateReading(
+			m_args.loadstate->m_channelVoltage[i], lchan->GetScalarValue(LoadChannel::STREAM_VOLTAGE_MEASURED));
+		newData |= UpdateReading(
+			m_args.loadstate->m_channelCurrent[i], lchan->GetScalarValue(LoadChannel::STREAM_CURRENT_MEASURED));
+		m_datalog.Log(m_load.get(), lchan, "Voltage", Unit(Unit::UNIT_VOLTS), m_args.loadstate->m_channelVoltage[i]);
+		m_datalog.Log(m_load.get(), lchan, "Current", Unit(Unit::UNIT_AMPS), m_args.loadstate->m_channelCurrent[i]);
 
-		//Rate limit to 100 Hz to avoid saturating CPU with polls
-		//(this also provides a yield point for the gui thread to get mutex ownership etc)
-		this_thread::sleep_for(chrono::milliseconds(10));
+		session->MarkPolledChannelDirty(lchan);
 	}
+	m_args.loadstate->m_firstUpdateDone = true;
+}
 
-	LogTrace("Shutting down instrument thread\n");
+/**
+	@brief Reads back a multimeter's measurements
+ */
+void InstrumentPoller::PollMultimeter(bool& newData)
+{
+	auto session = m_args.session;
+
+	auto chan = dynamic_cast<MultimeterChannel*>(m_meter->GetChannel(m_meter->GetCurrentMeterChannel()));
+	if(chan)
+	{
+		newData |= UpdateReading(m_args.meterstate->m_primaryMeasurement, chan->GetPrimaryValue());
+		newData |= UpdateReading(m_args.meterstate->m_secondaryMeasurement, chan->GetSecondaryValue());
+		m_args.meterstate->m_firstUpdateDone = true;
+
+		//Each meter mode gets its own column, since the unit changes with it
+		m_datalog.Log(
+			m_meter.get(),
+			chan,
+			m_meter->ModeToText(m_meter->GetMeterMode()),
+			m_meter->GetMeterUnit(),
+			m_args.meterstate->m_primaryMeasurement);
+		if(m_meter->GetSecondaryMeterMode() != Multimeter::NONE)
+		{
+			m_datalog.Log(
+				m_meter.get(),
+				chan,
+				m_meter->ModeToText(m_meter->GetSecondaryMeterMode()) + " (secondary)",
+				m_meter->GetSecondaryMeterUnit(),
+				m_args.meterstate->m_secondaryMeasurement);
+		}
+
+		session->MarkPolledChannelDirty(chan);
+	}
+}
+
+/**
+	@brief Refreshes cached function generator settings, and sends the next chunk of any arbitrary waveform upload
+ */
+void InstrumentPoller::PollFunctionGenerator(double& waitTime, bool& newData)
+{
+	auto inst = m_args.inst;
+	auto session = m_args.session;
+
+	//Read status for channels that need it
+	for(size_t i=0; i<m_awg->GetChannelCount(); i++)
+	{
+		if(m_args.awgstate->m_needsUpdate[i])
+		{
+			Unit volts(Unit::UNIT_VOLTS);
+
+			//Skip non-awg channels
+			auto awgchan = dynamic_cast<FunctionGeneratorChannel*>(m_awg->GetChannel(i));
+			if(!awgchan)
+				continue;
+			m_args.awgstate->m_channelActive[i] = m_awg->GetFunctionChannelActive(i);
+			m_args.awgstate->m_channelAmplitude[i] = m_awg->GetFunctionChannelAmplitude(i);
+			m_args.awgstate->m_channelOffset[i] = m_awg->GetFunctionChannelOffset(i);
+			m_args.awgstate->m_channelFrequency[i] = m_awg->GetFunctionChannelFrequency(i);
+			m_args.awgstate->m_channelShape[i] = m_awg->GetFunctionChannelShape(i);
+			m_args.awgstate->m_channelOutputImpedance[i] = m_awg->GetFunctionChannelOutputImpedance(i);
+			session->MarkChannelDirty(awgchan);
+
+			m_args.awgstate->m_needsUpdate[i] = false;
+			newData = true;
+		}
+
+	}
+
+	//Arbitrary waveforms go out a chunk per poll, so status reads and GUI commands can get in between
+	shared_ptr<ArbitraryWaveformUpload> upload;
+	{
+		lock_guard<mutex> lock(m_args.awgstate->m_arbMutex);
+		if(!m_args.awgstate->m_arbUploads.empty())
+			upload = m_args.awgstate->m_arbUploads.front();
+	}
+	if(upload)
+	{
+		upload->Step(inst->GetTransport(), m_awg.get());
+		if(upload->IsFinished())
+		{
+			lock_guard<mutex> lock(m_args.awgstate->m_arbMutex);
+			m_args.awgstate->m_arbUploads.pop_front();
+			m_args.awgstate->m_needsUpdate[upload->GetChannel()] = true;
+		}
+		else
+			waitTime = 0;
+		newData = true;
+	}
 }
@@ -47,6 +47,8 @@ extern GuiLogSink* g_guiLog;
 LogViewerDialog::LogViewerDialog(MainWindow* parent)
 	: Dialog("Log Viewer", "Log Viewer", ImVec2(500, 300))
 	, m_parent(parent)
+	, m_minSeverity(Severity::DEBUG)
+	, m_nextSeq(0)
 {
 }
 
@@ -57,18 +59,92 @@ LogViewerDialog::~LogViewerDialog()
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Rendering
 
+/**
+	@brief Checks if a line passes the current filter
+ */
+bool LogViewerDialog::MatchesFilter(const LogLine& line)
+{
+	if(line.m_sev > m_minSeverity)
+		return false;
+	if(!m_search.empty() && (line.m_msg.find(m_search) == string::npos))
+		return false;
+	return true;
+}
+
+/**
+	@brief Checks lines logged since last frame against the filter, and forgets lines which have been overwritten
+
+	Only new lines are looked at, so the cost per frame depends on the logging rate rather than the log size.
+ */
+void LogViewerDialog::UpdateFilter()
+{
+	auto tail = g_guiLog->GetTailSequence();
+	auto head = g_guiLog->GetHeadSequence();
+
+	while(!m_visibleLines.empty() && (m_visibleLines.front() < tail))
+		m_visibleLines.pop_front();
+
+	m_nextSeq = max(m_nextSeq, tail);
+	for(; m_nextSeq < head; m_nextSeq ++)
+	{
+		//Stop at the first line still being written, we'll pick it up next frame.
+		//Lines lost to wraparound in the meantime are just skipped.
+		if(!g_guiLog->GetLine(m_nextSeq, m_line))
+		{
+			if(g_guiLog->IsLinePending(m_nextSeq))
+				break;
+			continue;
+		}
+
+		if(MatchesFilter(m_line))
+			m_visibleLines.push_back(m_nextSeq);
+	}
+}
+
 bool LogViewerDialog::DoRender()
 {
 	auto errColor = m_parent->GetColorPref("Appearance.Log Viewer.error_color");
 	auto warningColor = m_parent->GetColorPref("Appearance.Log Viewer.warning_color");
 	auto baseColor = m_parent->GetColorPref("Appearance.Graphs.bottom_color");
 
+	float width = ImGui::GetFontSize();
+
+	//Filter controls. Rescan everything still in the buffer if the filter changed.
+	static const char* severityNames[] = { "Error", "Warning", "Notice", "Verbose", "Debug" };
+	static const Severity severities[] =
+		{ Severity::ERROR, Severity::WARNING, Severity::NOTICE, Severity::VERBOSE, Severity::DEBUG };
+	int sel = 0;
+	for(int i=0; i<5; i++)
+	{
+		if(severities[i] == m_minSeverity)
+			sel = i;
+	}
+	bool filterChanged = false;
+	ImGui::SetNextItemWidth(8*width);
+	if(ImGui::Combo("Severity", &sel, severityNames, 5))
+	{
+		m_minSeverity = severities[sel];
+		filterChanged = true;
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(20*width);
+	if(ImGui::InputText("Search", &m_search))
+		filterChanged = true;
+	ImGui::SameLine();
+	if(ImGui::Button("Clear"))
+		g_guiLog->Clear();
+
+	if(filterChanged)
+	{
+		m_visibleLines.clear();
+		m_nextSeq = 0;
+	}
+	UpdateFilter();
+
 	ImGui::BeginChild("scrollview", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
 
 	ImGui::PushFont(m_parent->GetFontPref("Appearance.General.console_font"));
-	auto& lines = g_guiLog->GetLines();
 
-	float width = ImGui::GetFontSize();
 	static ImGuiTableFlags flags =
 		ImGuiTableFlags_Resizable |
 		ImGuiTableFlags_BordersOuter |
@@ -78,75 +154,85 @@ bool LogViewerDialog::DoRender()
 		ImGuiTableFlags_SizingFixedFit;
 	if(ImGui::BeginTable("table", 3, flags))
 	{
-		//TODO: use ImGuiListClipper
-
 		ImGui::TableSetupScrollFreeze(0, 1); //Header row does not scroll
 		ImGui::TableSetupColumn("Timestamp", ImGuiTableColumnFlags_WidthFixed, 10*width);
 		ImGui::TableSetupColumn("Severity", ImGuiTableColumnFlags_WidthFixed, 0.0f);
 		ImGui::TableSetupColumn("Message", ImGuiTableColumnFlags_WidthStretch, 0.0f);
 		ImGui::TableHeadersRow();
 
-		for(auto& line : lines)
+		//Only the rows actually on screen get copied out of the log
+		ImGuiListClipper clipper;
+		clipper.Begin(m_visibleLines.size());
+		while(clipper.Step())
 		{
-			ImGui::TableNextRow(ImGuiTableRowFlags_None);
-
-			switch(line.m_sev)
-			{
-				case Severity::ERROR:
-					ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, errColor);
-					break;
-
-				case Severity::WARNING:
-					ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, warningColor);
-					break;
-
-				default:
-					ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, baseColor);
-					break;
-			}
-
-			ImGui::TableSetColumnIndex(0);
-			ImGui::TextUnformatted(line.m_timestamp.PrettyPrint().c_str());
-
-			ImGui::TableSetColumnIndex(1);
-			switch(line.m_sev)
+			for(int i=clipper.DisplayStart; i<clipper.DisplayEnd; i++)
 			{
-				//no need for fatal, we abort before we can see it
-
-				case Severity::ERROR:
-					ImGui::TextUnformatted("Error");
-					break;
-
-				case Severity::WARNING:
-					ImGui::TextUnformatted("Warning");
-					break;
-
-				case Severity::NOTICE:
-					ImGui::TextUnformatted("Notice");
-					break;
-
-				case Severity::VERBOSE:
-					ImGui::TextUnformatted("Verbose");
-					break;
-
-				case Severity::DEBUG:
-				default:
-					ImGui::TextUnformatted("Debug");
-					break;
+				ImGui::TableNextRow(ImGuiTableRowFlags_None);
+
+				//If the line was overwritten since we filtered it, leave a blank row until the next frame trims it
+				if(!g_guiLog->GetLine(m_visibleLines[i], m_line))
+					continue;
+				auto& line = m_line;
+
+				switch(line.m_sev)
+				{
+					case Severity::ERROR:
+						ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, errColor);
+						break;
+
+					case Severity::WARNING:
+						ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, warningColor);
+						break;
+
+					default:
+						ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, baseColor);
+						break;
+				}
+
+				ImGui::TableSetColumnIndex(0);
+				ImGui::TextUnformatted(line.m_timestamp.PrettyPrint().c_str());
+
+				ImGui::TableSetColumnIndex(1);
+				switch(line.m_sev)
+				{
+					//no need for fatal, we abort before we can see it
+
+					case Severity::ERROR:
+						ImGui::TextUnformatted("Error");
+						break;
+
+					case Severity::WARNING:
+						ImGui::TextUnformatted("Warning");
+						break;
+
+					case Severity::NOTICE:
+						ImGui::TextUnformatted("Notice");
+						break;
+
+					case Severity::VERBOSE:
+						ImGui::TextUnformatted("Verbose");
+						break;
+
+					case Severity::DEBUG:
+					default:
+						ImGui::TextUnformatted("Debug");
+						break;
+				}
+
+				ImGui::TableSetColumnIndex(2);
+				ImGui::TextUnformatted(line.m_msg.c_str());
 			}
-
-			ImGui::TableSetColumnIndex(2);
-			ImGui::TextUnformatted(line.m_msg.c_str());
 		}
 
+		//Follow new output if we're scrolled to the bottom
+		if(ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
+			ImGui::SetScrollHereY(1.0f);
+
 		ImGui::EndTable();
 	}
 
 	ImGui::PopFont();
 
-	if(ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
-		ImGui::SetScrollHereY(1.0f);
-
 	ImGui::EndChild();
 
 	return true;
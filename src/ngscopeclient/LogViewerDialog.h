@@ -48,7 +48,25 @@ public:
 	virtual bool DoRender();
 
 protected:
+	void UpdateFilter();
+	bool MatchesFilter(const LogLine& line);
+
 	MainWindow* m_parent;
+
+	///@brief Least important severity to show
+	Severity m_minSeverity;
+
+	///@brief Only show lines containing this text (if not empty)
+	std::string m_search;
+
+	///@brief Sequence number of the next log line to check against the filter
+	uint64_t m_nextSeq;
+
+	///@brief Sequence numbers of the lines which passed the filter, oldest first
+	std::deque<uint64_t> m_visibleLines;
+
+	///@brief Scratch line, reused to avoid an allocation per row rendered
+	LogLine m_line;
 };
 
 #endif
@@ -52,11 +52,13 @@
 #include "BERTInputChannelDialog.h"
 #include "ChannelPropertiesDialog.h"
 #include "CreateFilterBrowser.h"
+#include "DataLogDialog.h"
 #include "FileBrowser.h"
 #include "FilterGraphWorkspace.h"
 #include "FilterPropertiesDialog.h"
 #include "FunctionGeneratorDialog.h"
 #include "HistoryDialog.h"
+#include "HistorySearchDialog.h"
 #include "LoadDialog.h"
 #include "LogViewerDialog.h"
 #include "ManageInstrumentsDialog.h"
@@ -73,6 +75,7 @@
 #include "ScopeDeskewWizard.h"
 #include "TimebasePropertiesDialog.h"
 #include "TriggerPropertiesDialog.h"
+#include "WaveformRecorder.h"
 
 #include <imgui_markdown.h>
 
@@ -91,6 +94,7 @@
 using namespace std;
 
 extern Event g_rerenderRequestedEvent;
+extern Event g_waveformThreadWakeEvent;
 extern unique_ptr<MainWindow> g_mainWindow;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -117,8 +121,11 @@ MainWindow::MainWindow(shared_ptr<QueueHandle> queue)
 	, m_persistenceDecay(0.8)
 	, m_session(this)
 	, m_sessionClosing(true)	//reset a default session on the first frame after we start up
+	, m_memoryBudget(*this)
 	, m_fileLoadInProgress(false)
+	, m_lastSaveTime(GetTime())
 	, m_openOnline(false)
+	, m_traceExportSeconds(10)
 	, m_showingLoadWarnings(false)
 	, m_loadConfirmationChecked(false)
 	, m_texmgr(queue)
@@ -140,6 +147,9 @@ MainWindow::MainWindow(shared_ptr<QueueHandle> queue)
 	vk::CommandBufferAllocateInfo bufinfo(**m_cmdPool, vk::CommandBufferLevel::ePrimary, 1);
 	m_cmdBuffer = make_unique<vk::raii::CommandBuffer>(
 		std::move(vk::raii::CommandBuffers(*g_vkComputeDevice, bufinfo).front()));
+	m_toneMapCmdBuffer = make_unique<vk::raii::CommandBuffer>(
+		std::move(vk::raii::CommandBuffers(*g_vkComputeDevice, bufinfo).front()));
+	m_toneMapTimer = make_unique<GpuTimer>(queue->m_family, "MainWindow.m_toneMapTimer");
 
 	if(g_hasDebugUtils)
 	{
@@ -154,21 +164,36 @@ MainWindow::MainWindow(shared_ptr<QueueHandle> queue)
 				vk::ObjectType::eCommandBuffer,
 				reinterpret_cast<int64_t>(static_cast<VkCommandBuffer>(**m_cmdBuffer)),
 				"MainWindow.m_cmdBuffer"));
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandBuffer,
+				reinterpret_cast<int64_t>(static_cast<VkCommandBuffer>(**m_toneMapCmdBuffer)),
+				"MainWindow.m_toneMapCmdBuffer"));
 	}
 
 	UpdateFonts();
 
 	//Load some textures
-	m_toolbarIconSize = 0;
-	LoadToolbarIcons();
+	//(batched so they're all decoded in parallel and uploaded to the GPU at once)
+	m_texmgr.BeginBatch();
+
+	//Gradients are sampled by shaders and stretched across the whole image, so they need textures of their own
 	LoadGradients();
-	m_texmgr.LoadTexture("warning", FindDataFile("icons/48x48/dialog-warning-2.png"));
 	m_texmgr.LoadTexture("visible-spectrum-380nm-750nm",
 		FindDataFile("icons/gradients/visible-spectrum-380nm-750nm.png"));
+
+	//Icons all go in the atlas
+	m_texmgr.BeginBatch(true);
+	m_toolbarIconSize = 0;
+	LoadToolbarIcons();
+	m_texmgr.LoadTexture("warning", FindDataFile("icons/48x48/dialog-warning-2.png"));
 	LoadFilterIcons();
 	LoadStatusBarIcons();
 	LoadWaveformShapeIcons();
+	m_texmgr.EndBatch();
 
+	m_texmgr.EndBatch();
 
 	//Don't move windows when dragging in the body, only the title bar
 	ImGui::GetIO().ConfigWindowsMoveFromTitleBarOnly = true;
@@ -185,9 +210,12 @@ MainWindow::~MainWindow()
 {
 	LogTrace("Application exiting\n");
 
+	//The render thread calls back into us, so it has to go before anything else does
+	StopRenderThread();
 	g_vkComputeDevice->waitIdle();
 	m_texmgr.clear();
 
+	m_toneMapCmdBuffer = nullptr;
 	m_cmdBuffer = nullptr;
 	m_cmdPool = nullptr;
 
@@ -251,6 +279,9 @@ void MainWindow::CloseSession()
 	//This ensures that we have a nice well defined shutdown order.
 	LogTrace("Clearing dialogs\n");
 	m_logViewerDialog = nullptr;
+	m_dataLogDialog = nullptr;
+	m_historySearchDialog = nullptr;
+	m_waveformExportDialog = nullptr;
 	m_metricsDialog = nullptr;
 	m_timebaseDialog = nullptr;
 	m_triggerDialog = nullptr;
@@ -511,6 +542,34 @@ void MainWindow::OnScopeAdded(shared_ptr<Oscilloscope> scope, bool createViews)
 	//Refresh any dialogs that depend on it
 	RefreshTimebasePropertiesDialog();
 	RefreshTriggerPropertiesDialog();
+
+	if(createViews)
+		WarmPipelines();
+}
+
+/**
+	@brief Compiles the pipelines needed to draw every channel currently in a view, on a background thread
+
+	Without this, they're compiled when the first waveform is rendered, which can take seconds with a lot of channels.
+ */
+void MainWindow::WarmPipelines()
+{
+	bool half = m_session.GetPreferences().GetBool("Performance.Rendering.half_precision_raster");
+
+	vector<ComputePipelineKey> keys;
+	{
+		lock_guard<recursive_mutex> lock(m_waveformGroupsMutex);
+		for(auto group : m_waveformGroups)
+		{
+			for(auto area : group->GetWaveformAreas())
+			{
+				for(size_t i=0; i<area->GetStreamCount(); i++)
+					area->GetDisplayedChannel(i)->GetWarmupPipelineKeys(keys, half);
+			}
+		}
+	}
+
+	m_session.WarmPipelines(keys);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -536,11 +595,87 @@ void MainWindow::Render()
 	VulkanWindow::Render();
 }
 
+/**
+	@brief Tells the session which filters have their output visible somewhere in the GUI
+
+	This is what demand-driven filter scheduling works backwards from.
+ */
+void MainWindow::UpdateDisplayedFilters()
+{
+	set<Filter*> filters;
+
+	//Anything in a waveform view
+	{
+		lock_guard<recursive_mutex> lock(m_waveformGroupsMutex);
+		for(auto& group : m_waveformGroups)
+		{
+			for(auto& area : group->GetWaveformAreas())
+			{
+				for(size_t i=0; i<area->GetStreamCount(); i++)
+				{
+					auto f = dynamic_cast<Filter*>(area->GetStream(i).m_channel);
+					if(f)
+						filters.emplace(f);
+				}
+			}
+		}
+	}
+
+	//Protocol analyzers
+	for(auto& it : m_protocolAnalyzerDialogs)
+		filters.emplace(it.first);
+
+	//Measurements
+	if(m_measurementsDialog)
+	{
+		for(auto& stream : m_measurementsDialog->GetStreams())
+		{
+			auto f = dynamic_cast<Filter*>(stream.m_channel);
+			if(f)
+				filters.emplace(f);
+		}
+	}
+
+	m_session.SetDisplayedFilters(filters);
+}
+
+/**
+	@brief Starts a synthetic pipeline benchmark, which drives a demo oscilloscope and exits when done
+ */
+void MainWindow::StartBenchmark(const PipelineBenchmarkConfig& config)
+{
+	m_benchmark = make_unique<PipelineBenchmark>(m_session, this, config);
+}
+
 void MainWindow::DoRender(vk::raii::CommandBuffer& /*cmdBuf*/)
 {
 
 }
 
+void MainWindow::OnFramePresented(double presentTime)
+{
+	//Anything tone mapped this frame is now on its way to the screen
+	m_session.OnFramePresented(presentTime);
+}
+
+/**
+	@brief Makes every tone mapped texture visible to the fragment shader drawing the frame
+
+	The tone mapping dispatches for individual channels don't have barriers of their own, so they can overlap on the
+	GPU. Textures stay in the general layout, so one global memory barrier covers all of them.
+ */
+static void RecordToneMapBarrier(vk::raii::CommandBuffer& cmdbuf)
+{
+	vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+	cmdbuf.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eFragmentShader,
+		{},
+		barrier,
+		{},
+		{});
+}
+
 /**
 	@brief Run the tone-mapping shader on all of our waveforms
 
@@ -548,11 +683,13 @@ void MainWindow::DoRender(vk::raii::CommandBuffer& /*cmdBuf*/)
  */
 void MainWindow::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
 {
-	double start = GetTime();
+	TRACE_ZONE("ToneMapAllWaveforms");
 
-	lock_guard<mutex> lock(m_session.GetRasterizedWaveformMutex());
+	//Textures are written in place, so the frame on its way to the screen has to be done with them
+	WaitForPreviousFrame();
+	double start = GetTime();
 
-	m_cmdBuffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	lock_guard lock(m_session.GetRasterizedWaveformMutex());
 
 	//Tone map the waveforms, holding the group mutex for as short a time as possible
 	vector<shared_ptr<WaveformGroup>> groups;
@@ -560,32 +697,110 @@ void MainWindow::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
 		lock_guard<recursive_mutex> lock2(m_waveformGroupsMutex);
 		groups = m_waveformGroups;
 	}
+
+	//Tone mapping analog and digital channels always reads from the same rasterized buffers and writes to the same
+	//textures, so if the set of channels hasn't changed we can just submit the same command buffer as last time
+	vector<uintptr_t> layout;
+	bool cacheable = m_session.GetPreferences().GetBool("Performance.Rendering.cache_tone_map");
+	for(auto group : groups)
+		cacheable = group->GetToneMapLayout(layout) && cacheable;
+
+	//Timestamps are part of the recorded commands, so toggling profiling invalidates the cached command buffer
+	GpuTimer* timer = m_session.IsGpuProfilingEnabled() ? m_toneMapTimer.get() : nullptr;
+	layout.push_back(timer != nullptr);
+
+	if(cacheable && !m_toneMapLayout.empty() && (layout == m_toneMapLayout))
+	{
+		TRACE_ZONE("Vulkan submit", "tone map (replay)");
+		m_renderQueue->SubmitAndBlock(*m_toneMapCmdBuffer);
+	}
+
+	//Layout changed, record it again so we can replay it next time
+	else if(cacheable)
+	{
+		m_toneMapCmdBuffer->begin(vk::CommandBufferBeginInfo());
+		if(timer)
+			timer->Reset(*m_toneMapCmdBuffer);
+		for(auto group : groups)
+			group->ToneMapAllWaveforms(*m_toneMapCmdBuffer, timer);
+		RecordToneMapBarrier(*m_toneMapCmdBuffer);
+		m_toneMapCmdBuffer->end();
+		{
+			TRACE_ZONE("Vulkan submit", "tone map");
+			m_renderQueue->SubmitAndBlock(*m_toneMapCmdBuffer);
+		}
+
+		m_toneMapLayout = layout;
+	}
+
+	//Something needs per-frame state (e.g. density plots reading waveform data), record from scratch
+	else
+	{
+		m_toneMapLayout.clear();
+
+		m_cmdBuffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+		if(timer)
+			timer->Reset(cmdbuf);
+		for(auto group : groups)
+			group->ToneMapAllWaveforms(cmdbuf, timer);
+		RecordToneMapBarrier(cmdbuf);
+		m_cmdBuffer->end();
+		{
+			TRACE_ZONE("Vulkan submit", "tone map (uncached)");
+			m_renderQueue->SubmitAndBlock(*m_cmdBuffer);
+		}
+	}
+
+	//Textures now show the latest rasterized images, note what view they were drawn with
 	for(auto group : groups)
-		group->ToneMapAllWaveforms(cmdbuf);
+		group->LatchTextureViews();
 
-	m_cmdBuffer->end();
-	m_renderQueue->SubmitAndBlock(*m_cmdBuffer);
+	if(timer)
+	{
+		vector<GpuTiming> timings;
+		if(timer->Resolve(timings))
+			m_session.SetToneMapGpuTimings(timings);
+	}
 
 	double dt = GetTime() - start;
 	m_toneMapTime = dt * FS_PER_SECOND;
+	m_session.GetMetricHistory().Record("Tone map time", m_toneMapTime);
 }
 
-void MainWindow::RenderWaveformTextures(
+bool MainWindow::RenderWaveformTextures(
 	vk::raii::CommandBuffer& cmdbuf,
-	vector<shared_ptr<DisplayedChannel> >& channels)
+	vector<shared_ptr<DisplayedChannel> >& channels,
+	GpuTimer* timer,
+	bool interruptible,
+	bool previewOnly)
 {
-	bool clear = m_clearPersistence.exchange(false);
+	//Previews don't draw persistent channels, so leave any clear request for the full render
+	bool clear = previewOnly ? false : m_clearPersistence.exchange(false);
 	vector<shared_ptr<WaveformGroup>> groups;
 	{
 		lock_guard<recursive_mutex> lock2(m_waveformGroupsMutex);
 		groups = m_waveformGroups;
 	}
+
+	//The same stream can be on screen in several groups at once, so identical images are shared across all of them
+	RasterShareCache shares;
 	for(auto group : groups)
-		group->RenderWaveformTextures(cmdbuf, channels, clear);
+	{
+		//Superseded by a newer view. Whatever we didn't get to still needs its persistence cleared next pass.
+		if(!group->RenderWaveformTextures(cmdbuf, channels, shares, clear, timer, interruptible, previewOnly))
+		{
+			if(clear)
+				m_clearPersistence = true;
+			return false;
+		}
+	}
+	return true;
 }
 
 void MainWindow::RenderUI()
 {
+	double frameStart = GetTime();
+
 	//Set up colors
 	switch(m_session.GetPreferences().GetEnumRaw("Appearance.General.theme"))
 	{
@@ -602,6 +817,24 @@ void MainWindow::RenderUI()
 			break;
 	}
 
+	//Pick up present mode changes (the swapchain is only recreated if it actually changed)
+	switch(m_session.GetPreferences().GetEnumRaw("Performance.Rendering.present_mode"))
+	{
+		case PRESENT_MAILBOX:
+			SetPresentMode(vk::PresentModeKHR::eMailbox);
+			break;
+
+		case PRESENT_IMMEDIATE:
+			SetPresentMode(vk::PresentModeKHR::eImmediate);
+			break;
+
+		case PRESENT_FIFO:
+		default:
+			SetPresentMode(vk::PresentModeKHR::eFifo);
+			break;
+	}
+	SetRenderThreadEnabled(m_session.GetPreferences().GetBool("Performance.Rendering.render_thread"));
+
 	m_needRender = false;
 
 	//Keep references to all of our waveform textures until next frame
@@ -616,26 +849,78 @@ void MainWindow::RenderUI()
 	//Block until all background processing completes to ensure no command buffers are still pending
 	if(!m_groupsToClose.empty())
 	{
+		WaitForRenderThreadIdle();
 		g_vkComputeDevice->waitIdle();
 		m_groupsToClose.clear();
 	}
 
+	m_session.GetMetricHistory().Record("Frame time", ImGui::GetIO().DeltaTime * FS_PER_SECOND);
+	m_session.GetMetricHistory().Record("Frame latency", GetLastFrameLatency());
+
+	//Keep an eye on memory usage, and free some before we actually run out
+	m_memoryBudget.Update();
+
+	//Drive the benchmark, if any, and quit when it's done
+	if(m_benchmark && !m_benchmark->Poll())
+		glfwSetWindowShouldClose(m_window, true);
+
+	//Tell the session what's on screen so it knows which filters need to run
+	UpdateDisplayedFilters();
+
 	//Request a refresh of any dirty filters next frame
 	m_session.RefreshDirtyFiltersNonblocking();
 
+	//Keep the next few points loaded if we're replaying history
+	auto& replay = m_session.GetReplay();
+	replay.Poll();
+
 	//See if we have new waveform data to look at.
-	//If we got one, highlight the new waveform in history
+	//If we got one, highlight the new waveform in history (or the point being replayed)
 	if(m_session.CheckForWaveforms(*m_cmdBuffer))
 	{
+		TimePoint t;
+		bool replayed = replay.PopDisplayedPoint(t);
+		if(!replayed)
+			t = m_session.GetHistory().GetMostRecentPoint();
+
 		if(m_historyDialog != nullptr)
-			m_historyDialog->UpdateSelectionToLatest();
+		{
+			if(replayed)
+				m_historyDialog->SelectTimestamp(t);
+			else
+				m_historyDialog->UpdateSelectionToLatest();
+		}
 
 		//Tell protocol analyzer dialogs a new waveform arrived
-		auto t = m_session.GetHistory().GetMostRecentPoint();
 		for(auto it : m_protocolAnalyzerDialogs)
 			it.second->OnWaveformLoaded(t);
 	}
 
+	//Start or stop serving remote viewers and automation clients if the preferences changed
+	m_session.UpdateViewerServer();
+	m_session.UpdateAutomationServer();
+
+	//Turn instrument channels off and on to match what's using them, if enabled
+	m_session.UpdateConsumedChannels();
+
+	//Apply any changes to thread priority, affinity and memory placement preferences
+	m_session.UpdateThreadRoles();
+	m_session.UpdateHostMemoryPolicy();
+
+	//Clean up after a background save, and start an autosave if one is due
+	m_session.PollBackgroundSave();
+	auto autosaveInterval = m_session.GetPreferences().GetInt("Files.autosave_interval");
+	if( (autosaveInterval > 0) &&
+		!m_sessionFileName.empty() &&
+		!m_fileLoadInProgress &&
+		!m_session.IsBackgroundSaveInProgress() &&
+		m_session.GetPreferences().GetBool("Files.incremental_save") &&
+		(GetTime() - m_lastSaveTime) > (autosaveInterval * 60) )
+	{
+		LogTrace("Autosaving session\n");
+		DoSaveFile(m_sessionFileName);
+	}
+
 	//Menu for main window
 	MainMenu();
 	Toolbar();
@@ -645,7 +930,7 @@ void MainWindow::RenderUI()
 
 	//Waveform groups
 	{
-		shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+		shared_lock lock(m_session.GetWaveformDataMutex());
 		lock_guard<recursive_mutex> lock2(m_waveformGroupsMutex);
 
 		for(size_t i=0; i<m_waveformGroups.size(); i++)
@@ -705,7 +990,7 @@ void MainWindow::RenderUI()
 				it.second->OnWaveformLoaded(t);
 		}
 
-		m_session.RefreshAllFiltersNonblocking();
+		m_session.RefreshScopeFiltersNonblocking();
 		m_needRender = true;
 	}
 
@@ -718,18 +1003,8 @@ void MainWindow::RenderUI()
 	{
 		if(it.second->PollForSelectionChanges())
 		{
-			auto tstamp = it.second->GetSelectedWaveformTimestamp();
-			auto& hist = m_session.GetHistory();
-			if(m_historyDialog)
-				m_historyDialog->SelectTimestamp(tstamp);
-
-			auto hpt = hist.GetHistory(tstamp);
-			if(hpt)
-			{
-				hpt->LoadHistoryToSession(m_session);
-				m_needRender = true;
-			}
-			m_session.RefreshAllFiltersNonblocking();
+			if(!NavigateToHistoryPoint(it.second->GetSelectedWaveformTimestamp()))
+				m_session.RefreshAllFiltersNonblocking();
 		}
 	}
 
@@ -738,13 +1013,44 @@ void MainWindow::RenderUI()
 	RenderLoadWarningPopup();
 
 	if(m_needRender)
+	{
 		g_rerenderRequestedEvent.Signal();
+		g_waveformThreadWakeEvent.Signal();
+	}
+
+	RunDeferredWork(frameStart);
 
 	//DEBUG: draw the demo windows
 	if(m_showDemo)
 		ImGui::ShowDemoWindow(&m_showDemo);
 }
 
+/**
+	@brief Spends whatever is left of this frame's time budget on deferred GUI thread work
+
+	@param frameStart	Time this frame's RenderUI() call started
+ */
+void MainWindow::RunDeferredWork(double frameStart)
+{
+	if(m_frameScheduler.GetPendingCount() == 0)
+		return;
+
+	//Assume 60 Hz if we can't tell what the display is doing
+	double period = 1.0 / 60;
+	auto mon = glfwGetPrimaryMonitor();
+	if(mon)
+	{
+		auto mode = glfwGetVideoMode(mon);
+		if(mode && (mode->refreshRate > 0) )
+			period = 1.0 / mode->refreshRate;
+	}
+
+	double tstart = GetTime();
+	double budget = m_session.GetPreferences().GetReal("Performance.Rendering.deferred_work_budget");
+	m_frameScheduler.Run(frameStart + period*budget);
+	m_session.GetMetricHistory().Record("Deferred work time", (GetTime() - tstart) * FS_PER_SECOND);
+}
+
 void MainWindow::Toolbar()
 {
 	//Update icons, if needed
@@ -794,34 +1100,51 @@ void MainWindow::Toolbar()
 
 /**
 	@brief Load gradient images
+
+	All of the gradients go in one texture strip, so every tone mapping shader binds the same texture and selects its
+	ramp with a push constant.
  */
 void MainWindow::LoadGradients()
 {
 	LogTrace("Loading eye pattern gradients...\n");
 	LogIndenter li;
 
-	LoadGradient("CRT", "eye-gradient-crt");
-	LoadGradient("Grayscale", "eye-gradient-grayscale");
-	LoadGradient("Ironbow", "eye-gradient-ironbow");
-	LoadGradient("KRain", "eye-gradient-krain");
-	LoadGradient("Rainbow", "eye-gradient-rainbow");
-	LoadGradient("Reverse Grayscale", "eye-gradient-reverse-grayscale");
-	LoadGradient("Reverse Rainbow", "eye-gradient-reverse-rainbow");
-	LoadGradient("Reverse Viridis", "eye-gradient-reverse-viridis");
-	LoadGradient("Viridis", "eye-gradient-viridis");
+	vector<pair<string, string> > files;
+	LoadGradient("CRT", "eye-gradient-crt", files);
+	LoadGradient("Grayscale", "eye-gradient-grayscale", files);
+	LoadGradient("Ironbow", "eye-gradient-ironbow", files);
+	LoadGradient("KRain", "eye-gradient-krain", files);
+	LoadGradient("Rainbow", "eye-gradient-rainbow", files);
+	LoadGradient("Reverse Grayscale", "eye-gradient-reverse-grayscale", files);
+	LoadGradient("Reverse Rainbow", "eye-gradient-reverse-rainbow", files);
+	LoadGradient("Reverse Viridis", "eye-gradient-reverse-viridis", files);
+	LoadGradient("Viridis", "eye-gradient-viridis", files);
+	m_texmgr.LoadTextureStrip("eye-gradients", files);
 }
 
 /**
-	@brief Load a single gradient
+	@brief Registers a single gradient, and adds its image to the list of files to load
  */
-void MainWindow::LoadGradient(const string& friendlyName, const string& internalName)
+void MainWindow::LoadGradient(
+	const string& friendlyName,
+	const string& internalName,
+	vector<pair<string, string> >& files)
 {
 	string prefix = string("icons/gradients/");
-	m_texmgr.LoadTexture(internalName, FindDataFile(prefix + internalName + ".png"));
+	files.push_back(pair(internalName, FindDataFile(prefix + internalName + ".png")));
 	m_eyeGradientFriendlyNames[internalName] = friendlyName;
 	m_eyeGradients.push_back(internalName);
 }
 
+/**
+	@brief Draws an image button using an icon (which may be in an atlas), using the icon name as the ID
+ */
+bool MainWindow::IconButton(const char* name, ImVec2 size)
+{
+	auto tex = GetTextureRef(name);
+	return ImGui::ImageButton(name, tex.m_id, size, tex.m_uv0, tex.m_uv1);
+}
+
 bool MainWindow::DropdownButton(const char* id, float height)
 {
 	auto pos = ImGui::GetCursorPos();
@@ -980,7 +1303,7 @@ void MainWindow::ToolbarButtons()
 	bool multigroup = (m_session.GetTriggerGroups().size() > 1);
 
 	//Trigger button group
-	if(ImGui::ImageButton("trigger-start", GetTexture("trigger-start"), buttonsize))
+	if(IconButton("trigger-start", buttonsize))
 		m_session.ArmTrigger(TriggerGroup::TRIGGER_TYPE_NORMAL);
 	Dialog::Tooltip("Arm the trigger in normal mode");
 	if(multigroup)
@@ -990,7 +1313,7 @@ void MainWindow::ToolbarButtons()
 	}
 
 	ImGui::SameLine(0.0, 0.0);
-	if(ImGui::ImageButton("trigger-single", GetTexture("trigger-single"), buttonsize))
+	if(IconButton("trigger-single", buttonsize))
 		m_session.ArmTrigger(TriggerGroup::TRIGGER_TYPE_SINGLE);
 	Dialog::Tooltip("Arm the trigger in one-shot mode");
 	if(multigroup)
@@ -1000,7 +1323,7 @@ void MainWindow::ToolbarButtons()
 	}
 
 	ImGui::SameLine(0.0, 0.0);
-	if(ImGui::ImageButton("trigger-force", GetTexture("trigger-force"), buttonsize))
+	if(IconButton("trigger-force", buttonsize))
 		m_session.ArmTrigger(TriggerGroup::TRIGGER_TYPE_FORCED);
 	Dialog::Tooltip("Acquire a waveform immediately, ignoring the trigger condition");
 	if(multigroup)
@@ -1010,7 +1333,7 @@ void MainWindow::ToolbarButtons()
 	}
 
 	ImGui::SameLine(0.0, 0.0);
-	if(ImGui::ImageButton("trigger-stop", GetTexture("trigger-stop"), buttonsize))
+	if(IconButton("trigger-stop", buttonsize))
 		m_session.StopTrigger();
 	Dialog::Tooltip("Stop acquiring waveforms");
 	if(multigroup)
@@ -1024,7 +1347,7 @@ void MainWindow::ToolbarButtons()
 	ImGui::SameLine();
 	if(hasHist)
 		ImGui::BeginDisabled();
-	if(ImGui::ImageButton("history", GetTexture("history"), buttonsize))
+	if(IconButton("history", buttonsize))
 	{
 		m_historyDialog = make_shared<HistoryDialog>(m_session.GetHistory(), m_session, *this);
 		AddDialog(m_historyDialog);
@@ -1035,7 +1358,7 @@ void MainWindow::ToolbarButtons()
 
 	//Refresh scope settings
 	ImGui::SameLine();
-	if(ImGui::ImageButton("refresh-settings", GetTexture("refresh-settings"), buttonsize))
+	if(IconButton("refresh-settings", buttonsize))
 	{
 		m_session.FlushConfigCache();
 		ClearPersistence();
@@ -1048,7 +1371,7 @@ void MainWindow::ToolbarButtons()
 
 	//View settings
 	ImGui::SameLine();
-	if(ImGui::ImageButton("clear-sweeps", GetTexture("clear-sweeps"), buttonsize))
+	if(IconButton("clear-sweeps", buttonsize))
 	{
 		ClearPersistence();
 		m_session.ClearSweeps();
@@ -1059,13 +1382,13 @@ void MainWindow::ToolbarButtons()
 	ImGui::SameLine(0.0, 0.0);
 	if(m_fullscreen)
 	{
-		if(ImGui::ImageButton("fullscreen-exit", GetTexture("fullscreen-exit"), buttonsize))
+		if(IconButton("fullscreen-exit", buttonsize))
 			SetFullscreen(false);
 		Dialog::Tooltip("Leave fullscreen mode");
 	}
 	else
 	{
-		if(ImGui::ImageButton("fullscreen-enter", GetTexture("fullscreen-enter"), buttonsize))
+		if(IconButton("fullscreen-enter", buttonsize))
 			SetFullscreen(true);
 		Dialog::Tooltip("Enter fullscreen mode");
 	}
@@ -1115,6 +1438,12 @@ void MainWindow::OnDialogClosed(const std::shared_ptr<Dialog>& dlg)
 		m_filterPalette = nullptr;
 	if(m_logViewerDialog == dlg)
 		m_logViewerDialog = nullptr;
+	if(m_dataLogDialog == dlg)
+		m_dataLogDialog = nullptr;
+	if(m_historySearchDialog == dlg)
+		m_historySearchDialog = nullptr;
+	if(m_waveformExportDialog == dlg)
+		m_waveformExportDialog = nullptr;
 	if(m_streamBrowser == dlg)
 		m_streamBrowser = nullptr;
 	if(m_metricsDialog == dlg)
@@ -1354,7 +1683,8 @@ void MainWindow::StatusBar(float height)
 		if(it.second.empty())
 			continue;
 
-		ImGui::Image(GetTexture(it.first), iconSize);
+		auto tex = GetTextureRef(it.first);
+		ImGui::Image(tex.m_id, iconSize, tex.m_uv0, tex.m_uv1);
 		ImGui::SameLine();
 		ImGui::TextUnformatted(it.second.c_str());
 		ImGui::SameLine();
@@ -1364,6 +1694,27 @@ void MainWindow::StatusBar(float height)
 	m_statusHelp.clear();
 }
 
+/**
+	@brief Loads the specified point in history to the session, as if it had been selected in the history dialog
+
+	@return True if the point was found and loaded, false if it's no longer in history
+ */
+bool MainWindow::NavigateToHistoryPoint(TimePoint t)
+{
+	if(m_historyDialog)
+		m_historyDialog->SelectTimestamp(t);
+
+	auto hpt = m_session.GetHistory().GetHistory(t);
+	if(!hpt)
+		return false;
+
+	hpt->LoadHistoryToSession(m_session);
+	m_session.SetFilterHistoryPoint(hpt);
+	m_session.RefreshScopeFiltersNonblocking();
+	m_needRender = true;
+	return true;
+}
+
 /**
 	@brief Scrolls all waveform groups so that the specified timestamp is visible
  */
@@ -1743,9 +2094,12 @@ void MainWindow::RenderLoadWarningPopup()
 		auto& warnings = m_session.GetWarnings();
 		if(!warnings.m_warnings.empty())
 		{
+			auto warning = GetTextureRef("warning");
 			ImGui::Image(
-				GetTextureManager()->GetTexture("warning"),
-				ImVec2(warningSize, warningSize));
+				warning.m_id,
+				ImVec2(warningSize, warningSize),
+				warning.m_uv0,
+				warning.m_uv1);
 			ImGui::SameLine();
 			ImGui::TextUnformatted(
 				"Some of the instrument settings in the session you are loading do not match "
@@ -1869,7 +2223,10 @@ void MainWindow::UpdateFonts()
 	//Check for any changes to font preferences and rebuild the atlas if so
 	//Skip rebuilding atlas if nothing changed
 	auto& prefs = GetSession().GetPreferences();
-	if(m_fontmgr.UpdateFonts(prefs.AllPreferences(), GetContentScale()))
+	string cacheDir;
+	if(prefs.GetBool("Performance.Rendering.cache_fonts"))
+		cacheDir = prefs.GetConfigDirectory();
+	if(m_fontmgr.UpdateFonts(prefs.AllPreferences(), GetContentScale(), cacheDir))
 	{
 		//Download imgui fonts
 		ImGui_ImplVulkan_CreateFontsTexture();
@@ -2128,6 +2485,38 @@ void MainWindow::FindAreaForStream(WaveformArea* area, StreamDescriptor stream)
 	group->AddArea(a);
 }
 
+/**
+	@brief Creates a copy of a filter graph template for each of the specified streams
+
+	Every new filter is marked dirty rather than refreshed as it's made, so the whole batch is evaluated in a single
+	refresh next frame no matter how many streams were selected.
+
+	@return Number of filters created
+ */
+size_t MainWindow::InstantiateFilterTemplate(
+	shared_ptr<FilterGraphTemplate> tmpl,
+	const vector<StreamDescriptor>& inputs)
+{
+	size_t count = 0;
+	for(auto stream : inputs)
+	{
+		if(!tmpl->CanInstantiate(stream))
+		{
+			LogWarning("Template \"%s\" can't be instantiated for %s\n", tmpl->m_name.c_str(), stream.GetName().c_str());
+			continue;
+		}
+
+		auto filters = tmpl->Instantiate(this, stream, m_session.m_idtable);
+		for(auto f : filters)
+			m_session.MarkChannelDirty(f);
+		count += filters.size();
+	}
+
+	LogTrace("Instantiated template \"%s\" for %zu streams (%zu filters)\n",
+		tmpl->m_name.c_str(), inputs.size(), count);
+	return count;
+}
+
 /**
 	@brief Handle a filter being reconfigured
 
@@ -2137,12 +2526,14 @@ void MainWindow::OnFilterReconfigured(Filter* f)
 {
 	//Remove any saved configuration, eye patterns, etc
 	{
+		lock_guard wlock(m_session.GetWaveformWriterMutex());
 		lock_guard lock(m_session.GetWaveformDataMutex());
 		f->ClearSweeps();
 	}
 
-	//Re-run the filter
-	m_session.RefreshAllFiltersNonblocking();
+	//Re-run the filter and everything downstream of it, and forget any outputs saved with other history points
+	m_session.InvalidateFilterOutputCache();
+	m_session.RefreshFiltersNonblocking({f});
 
 	//Clear persistence of any waveform areas showing this waveform
 	lock_guard<recursive_mutex> lock(m_waveformGroupsMutex);
@@ -2193,6 +2584,54 @@ void MainWindow::OnSaveAs()
 		true);
 }
 
+/**
+	@brief Handler for file | start recording menu. Spawns the browser dialog
+ */
+void MainWindow::OnStartRecording()
+{
+	m_fileBrowserMode = BROWSE_RECORD_SESSION;
+	m_fileBrowser = MakeFileBrowser(
+		this,
+		".",
+		"Record Session",
+		"Session files (*.scopesession)",
+		"*.scopesession",
+		true);
+}
+
+/**
+	@brief Handler for view | record video menu. Spawns the browser dialog
+ */
+void MainWindow::OnStartVideoCapture()
+{
+	m_fileBrowserMode = BROWSE_RECORD_VIDEO;
+	m_fileBrowser = MakeFileBrowser(
+		this,
+		".",
+		"Record Video",
+		"MP4 video (*.mp4)",
+		"*.mp4",
+		true);
+}
+
+/**
+	@brief Starts recording the window to a video file, using the encoder from preferences
+ */
+void MainWindow::DoStartVideoCapture(const string& path)
+{
+	auto& prefs = m_session.GetPreferences();
+	if(!StartVideoCapture(
+		prefs.GetString("Miscellaneous.Video Capture.encoder_command"),
+		path,
+		prefs.GetInt("Miscellaneous.Video Capture.frame_rate")))
+	{
+		ShowErrorPopup(
+			"Video capture error",
+			"Could not start recording to \"" + path + "\".\n\n"
+			"Check the encoder command in Preferences | Miscellaneous | Video Capture, and the log for details.");
+	}
+}
+
 /**
 	@brief Runs the file browser dialog
  */
@@ -2214,6 +2653,18 @@ void MainWindow::RenderFileBrowser()
 				case BROWSE_SAVE_SESSION:
 					DoSaveFile(m_fileBrowser->GetFileName());
 					break;
+
+				case BROWSE_RECORD_SESSION:
+					DoStartRecording(m_fileBrowser->GetFileName());
+					break;
+
+				case BROWSE_RECORD_VIDEO:
+					DoStartVideoCapture(m_fileBrowser->GetFileName());
+					break;
+
+				case BROWSE_SAVE_TRACE:
+					Tracer::WriteChromeTrace(m_fileBrowser->GetFileName(), m_traceExportSeconds);
+					break;
 			}
 		}
 
@@ -2252,6 +2703,7 @@ void MainWindow::DoOpenFile(const string& sessionPath, bool online)
 		//Save file path immediately
 		m_sessionFileName = sessionPath;
 		m_sessionDataDir = datadir;
+		m_lastSaveTime = GetTime();
 
 		//Run preload first, error out if this fails
 		if(!PreLoadSessionFromYaml(m_fileBeingLoaded[0], m_sessionDataDir, online))
@@ -2351,8 +2803,12 @@ bool MainWindow::PreLoadSessionFromYaml(const YAML::Node& node, const string& da
  */
 bool MainWindow::LoadSessionFromYaml(const YAML::Node& node, const string& dataDir, bool online)
 {
+	//Build everything before running the filter graph, rather than refreshing as each piece is added
+	m_session.BeginLoadBatch();
 	if(!m_session.LoadFromYaml(node, dataDir, online))
 	{
+		m_session.EndLoadBatch(false);
+
 		//If loading fails, clean up any incomplete half-loaded stuff that might be in a bad state
 		CloseSession();
 		return false;
@@ -2389,6 +2845,10 @@ bool MainWindow::LoadSessionFromYaml(const YAML::Node& node, const string& dataD
 	string ipath = dataDir + "/imgui.ini";
 	ImGui::LoadIniSettingsFromDisk(ipath.c_str());
 
+	//Start compiling pipelines for the views before the first refresh gets to rendering them
+	WarmPipelines();
+	m_session.EndLoadBatch(true);
+
 	LogTrace("Load completed successfully\n");
 	return true;
 }
@@ -2779,6 +3239,20 @@ bool MainWindow::LoadDialogs(const YAML::Node& node)
 		AddDialog(m_metricsDialog);
 	}
 
+	auto datalog = node["datalogger"];
+	if(datalog && datalog.as<bool>())
+	{
+		m_dataLogDialog = make_shared<DataLogDialog>(&m_session);
+		AddDialog(m_dataLogDialog);
+	}
+
+	auto histsearch = node["historysearch"];
+	if(histsearch && histsearch.as<bool>())
+	{
+		m_historySearchDialog = make_shared<HistorySearchDialog>(m_session, *this);
+		AddDialog(m_historySearchDialog);
+	}
+
 	auto sb = node["streambrowser"];
 	if(sb && sb.as<bool>())
 	{
@@ -2852,12 +3326,61 @@ bool MainWindow::LoadDialogs(const YAML::Node& node)
  */
 void MainWindow::DoSaveFile(string sessionPath)
 {
-	//Stop the trigger so we don't have data races if a waveform comes in mid-save
-	m_session.StopTrigger();
+	//If the filename does not end in .scopesession, add it
+	if(sessionPath.find(".scopesession") == string::npos)
+		sessionPath += ".scopesession";
+
+	//Get the data directory for the session
+	string base = sessionPath.substr(0, sessionPath.length() - strlen(".scopesession"));
+	string datadir = base + "_data";
+	LogDebug("Saving session file \"%s\" (data directory %s)\n", sessionPath.c_str(), datadir.c_str());
+	m_lastSaveTime = GetTime();
+
+	//Don't clobber a recording in progress with our history
+	auto recorder = m_session.GetRecorder();
+	if(recorder && (recorder->GetDataDir() == datadir) )
+	{
+		ShowErrorPopup(
+			"Cannot save session",
+			string("The session \"") + sessionPath + "\" is being recorded to. Stop recording before saving over it.");
+		return;
+	}
+
+	//Saving back to where our history already is only has to write new waveforms, and can do so in the background.
+	//Otherwise stop the trigger so we don't have data races if a waveform comes in mid-save
+	bool incremental =
+		m_session.GetPreferences().GetBool("Files.incremental_save") && (datadir == m_session.GetSavedDataDir());
+	if(!incremental)
+		m_session.StopTrigger();
 
 	//Saving the file conflicts with all other waveform data operations
-	lock_guard<shared_mutex> lock(m_session.GetWaveformDataMutex());
+	lock_guard wlock(m_session.GetWaveformWriterMutex());
+	lock_guard lock(m_session.GetWaveformDataMutex());
+
+	//Serialize the session
+	YAML::Node node{};
+	if(!SaveSessionToYaml(node, datadir, incremental ? SAVE_WAVEFORMS_INCREMENTAL : SAVE_WAVEFORMS_FULL))
+		return;
+	WriteSessionFile(sessionPath, node);
 
+	//Save the lab notes
+	SaveLabNotes(datadir);
+
+	//Add to recent files list
+	m_sessionFileName = sessionPath;
+	m_sessionDataDir = datadir;
+	m_recentFiles[sessionPath] = time(nullptr);
+	SaveRecentFileList();
+}
+
+/**
+	@brief Starts recording every new acquisition to a session file (may be triggered by file|start recording)
+
+	The session configuration is saved right away, without any of the current history. Waveforms are then appended to
+	the data directory as they arrive, until recording is stopped.
+ */
+void MainWindow::DoStartRecording(string sessionPath)
+{
 	//If the filename does not end in .scopesession, add it
 	if(sessionPath.find(".scopesession") == string::npos)
 		sessionPath += ".scopesession";
@@ -2865,21 +3388,49 @@ void MainWindow::DoSaveFile(string sessionPath)
 	//Get the data directory for the session
 	string base = sessionPath.substr(0, sessionPath.length() - strlen(".scopesession"));
 	string datadir = base + "_data";
-	LogDebug("Saving session file \"%s\" (data directory %s)\n", sessionPath.c_str(), datadir.c_str());
+	LogDebug("Recording to session file \"%s\" (data directory %s)\n", sessionPath.c_str(), datadir.c_str());
+
+	//Recording over the session we're working on would delete its history
+	if(datadir == m_session.GetSavedDataDir())
+	{
+		ShowErrorPopup(
+			"Cannot start recording",
+			string("The session \"") + sessionPath + "\" is the current session. Record to a new file instead.");
+		return;
+	}
+
+	m_session.StopRecording();
+
+	lock_guard wlock(m_session.GetWaveformWriterMutex());
+	lock_guard lock(m_session.GetWaveformDataMutex());
 
-	//Serialize the session
 	YAML::Node node{};
-	if(!SaveSessionToYaml(node, datadir))
+	if(!SaveSessionToYaml(node, datadir, SAVE_WAVEFORMS_NONE))
+		return;
+	if(!WriteSessionFile(sessionPath, node))
 		return;
+	SaveLabNotes(datadir);
+
+	m_session.StartRecording(datadir);
+
+	m_recentFiles[sessionPath] = time(nullptr);
+	SaveRecentFileList();
+}
+
+/**
+	@brief Writes the main .scopesession file
 
-	//Write the generated YAML to disk
+	@return	True if successful, false on error
+ */
+bool MainWindow::WriteSessionFile(const string& sessionPath, const YAML::Node& node)
+{
 	ofstream outfs(sessionPath);
 	if(!outfs)
 	{
 		ShowErrorPopup(
 			"Cannot open file",
 			string("Failed to open output session file \"") + sessionPath + "\" for writing");
-		return;
+		return false;
 	}
 
 	outfs << node;
@@ -2890,16 +3441,10 @@ void MainWindow::DoSaveFile(string sessionPath)
 		ShowErrorPopup(
 			"Write failed",
 			string("Failed to write session file \"") + sessionPath + "\"");
+		return false;
 	}
 
-	//Save the lab notes
-	SaveLabNotes(datadir);
-
-	//Add to recent files list
-	m_sessionFileName = sessionPath;
-	m_sessionDataDir = datadir;
-	m_recentFiles[sessionPath] = time(nullptr);
-	SaveRecentFileList();
+	return true;
 }
 
 /**
@@ -3000,12 +3545,18 @@ void MainWindow::LoadLabNotes(const string& dataDir)
 
 	@param node		Node for the main .scopesession
 	@param dataDir	Path to the _data directory (may not have been created yet)
+	@param mode		How to save waveform data. In incremental mode only new history is written, leaving the rest of
+					the data directory alone, and the waveform data is written by a background thread so it may not
+					be on disk yet when this function returns.
 
 	@return			True if successful, false on error
  */
-bool MainWindow::SaveSessionToYaml(YAML::Node& node, const string& dataDir)
+bool MainWindow::SaveSessionToYaml(YAML::Node& node, const string& dataDir, WaveformSaveMode mode)
 {
-	if(!SetupDataDirectory(dataDir))
+	//Don't touch the data directory while a previous save is still writing to it
+	m_session.WaitForBackgroundSave();
+
+	if(!SetupDataDirectory(dataDir, mode != SAVE_WAVEFORMS_INCREMENTAL))
 		return false;
 
 	/*
@@ -3025,9 +3576,23 @@ bool MainWindow::SaveSessionToYaml(YAML::Node& node, const string& dataDir)
 	//Save UI widgets
 	node["ui_config"] = SerializeUIConfiguration();
 
-	//TODO: waveform data
-	if(!m_session.SerializeWaveforms(dataDir))
-		return false;
+	//Save waveform data
+	switch(mode)
+	{
+		case SAVE_WAVEFORMS_FULL:
+			if(!m_session.SerializeWaveforms(dataDir))
+				return false;
+			break;
+
+		case SAVE_WAVEFORMS_INCREMENTAL:
+			if(!m_session.StartBackgroundWaveformSave(dataDir))
+				return false;
+			break;
+
+		case SAVE_WAVEFORMS_NONE:
+		default:
+			break;
+	}
 
 	//Save ImGui configuration
 	string ipath = dataDir + "/imgui.ini";
@@ -3050,8 +3615,11 @@ bool MainWindow::SaveSessionToYaml(YAML::Node& node, const string& dataDir)
 
 /**
 	@brief Make sure the data directory exists
+
+	@param dataDir			Path to the data directory
+	@param clearWaveforms	True to remove any waveform data already in the directory
  */
-bool MainWindow::SetupDataDirectory(const string& dataDir)
+bool MainWindow::SetupDataDirectory(const string& dataDir, bool clearWaveforms)
 {
 	//See if the directory exists
 	bool dir_exists = false;
@@ -3121,6 +3689,8 @@ bool MainWindow::SetupDataDirectory(const string& dataDir)
 	}
 
 	//Remove any existing waveform data
+	if(!clearWaveforms)
+		return true;
 	char cwd[PATH_MAX];
 	getcwd(cwd, PATH_MAX);
 
@@ -3346,6 +3916,14 @@ YAML::Node MainWindow::SerializeDialogs()
 	if(m_metricsDialog)
 		node["metrics"] = true;
 
+	//Data logger has no separate settings
+	if(m_dataLogDialog)
+		node["datalogger"] = true;
+
+	//History search doesn't persist its query
+	if(m_historySearchDialog)
+		node["historysearch"] = true;
+
 	//Preferences dialog has no separate settings
 	if(m_preferenceDialog)
 		node["preferences"] = true;
@@ -38,6 +38,9 @@
 #include "Dialog.h"
 #include "Session.h"
 #include "FontManager.h"
+#include "FrameScheduler.h"
+#include "MemoryBudget.h"
+#include "PipelineBenchmark.h"
 #include "TextureManager.h"
 #include "VulkanWindow.h"
 #include "WaveformGroup.h"
@@ -125,6 +128,7 @@ public:
 	void RemoveFunctionGenerator(std::shared_ptr<SCPIFunctionGenerator> gen);
 
 	void OnScopeAdded(std::shared_ptr<Oscilloscope> scope, bool createViews);
+	void WarmPipelines();
 
 	void QueueSplitGroup(std::shared_ptr<WaveformGroup> group, ImGuiDir direction, StreamDescriptor stream)
 	{ m_splitRequests.push_back(SplitGroupRequest(group, direction, stream)); }
@@ -138,6 +142,8 @@ public:
 
 	void OnCursorMoved(int64_t offset);
 
+	bool NavigateToHistoryPoint(TimePoint t);
+
 	void NavigateToTimestamp(
 		int64_t stamp,
 		int64_t duration = 0,
@@ -163,9 +169,26 @@ public:
 
 	void ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf);
 
-	void RenderWaveformTextures(
+	std::vector<std::shared_ptr<WaveformGroup> > GetWaveformGroups()
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_waveformGroupsMutex);
+		return m_waveformGroups;
+	}
+
+	///@brief Gets the memory usage tracker
+	MemoryBudget& GetMemoryBudget()
+	{ return m_memoryBudget; }
+
+	///@brief Gets the scheduler for GUI thread work which can be spread over several frames
+	FrameScheduler& GetFrameScheduler()
+	{ return m_frameScheduler; }
+
+	bool RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
-		std::vector<std::shared_ptr<DisplayedChannel> >& channels);
+		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
+		GpuTimer* timer,
+		bool interruptible,
+		bool previewOnly);
 
 	void SetNeedRender()
 	{ m_needRender = true; }
@@ -178,6 +201,13 @@ public:
 
 	virtual void Render();
 
+	void StartBenchmark(const PipelineBenchmarkConfig& config);
+	void UpdateDisplayedFilters();
+
+	///@brief Returns true if a benchmark is running
+	bool IsBenchmarking()
+	{ return m_benchmark != nullptr; }
+
 	void QueueCloseSession()
 	{ m_sessionClosing = true; }
 
@@ -203,6 +233,10 @@ public:
 
 	void OnFilterReconfigured(Filter* f);
 
+	size_t InstantiateFilterTemplate(
+		std::shared_ptr<FilterGraphTemplate> tmpl,
+		const std::vector<StreamDescriptor>& inputs);
+
 	const std::vector<std::string>& GetEyeGradients()
 	{ return m_eyeGradients; }
 
@@ -224,6 +258,7 @@ public:
 
 protected:
 	virtual void DoRender(vk::raii::CommandBuffer& cmdBuf);
+	virtual void OnFramePresented(double presentTime);
 
 	void CloseSession();
 	void InitializeDefaultSession();
@@ -255,7 +290,9 @@ protected:
 				void WindowMultimeterMenu();
 			void DebugMenu();
 				void DebugSCPIConsoleMenu();
+				void DebugTracingMenu();
 			void HelpMenu();
+		void RunDeferredWork(double frameStart);
 		void Toolbar();
 			void LoadToolbarIcons();
 			void ToolbarButtons();
@@ -268,7 +305,10 @@ protected:
 			void StatusBar(float height);
 
 	void LoadGradients();
-	void LoadGradient(const std::string& friendlyName, const std::string& internalName);
+	void LoadGradient(
+		const std::string& friendlyName,
+		const std::string& internalName,
+		std::vector<std::pair<std::string, std::string> >& files);
 	std::map<std::string, std::string> m_eyeGradientFriendlyNames;
 	std::vector<std::string> m_eyeGradients;
 
@@ -335,6 +375,9 @@ protected:
 	///@brief Logfile viewer
 	std::shared_ptr<Dialog> m_logViewerDialog;
 
+	///@brief Instrument data logger
+	std::shared_ptr<Dialog> m_dataLogDialog;
+
 	///@brief Performance metrics
 	std::shared_ptr<Dialog> m_metricsDialog;
 
@@ -344,6 +387,12 @@ protected:
 	///@brief History
 	std::shared_ptr<HistoryDialog> m_historyDialog;
 
+	///@brief Search across history
+	std::shared_ptr<Dialog> m_historySearchDialog;
+
+	///@brief Export of sample data across history
+	std::shared_ptr<Dialog> m_waveformExportDialog;
+
 	///@brief Timebase properties
 	std::shared_ptr<TimebasePropertiesDialog> m_timebaseDialog;
 
@@ -405,12 +454,18 @@ protected:
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Session state
 
+	///@brief Deferred GUI thread work (declared before the session, since session objects may post to it)
+	FrameScheduler m_frameScheduler;
+
 	///@brief Our session object
 	Session m_session;
 
 	///@brief True if a close-session request came in this frame
 	bool m_sessionClosing;
 
+	///@brief Memory usage tracking
+	MemoryBudget m_memoryBudget;
+
 	SCPITransport* MakeTransport(const std::string& trans, const std::string& args);
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -429,13 +484,32 @@ public:
 	const std::string& GetGraphEditorConfigBlob()
 	{ return m_graphEditorConfigBlob; }
 
+	void DoSaveFile(std::string sessionPath);
+
 protected:
+	///@brief How SaveSessionToYaml() saves waveform data
+	enum WaveformSaveMode
+	{
+		///@brief Rewrite all history and filter waveforms
+		SAVE_WAVEFORMS_FULL,
+
+		///@brief Only write history which isn't already in the data directory, in the background
+		SAVE_WAVEFORMS_INCREMENTAL,
+
+		///@brief Don't save any waveform data, just the session configuration
+		SAVE_WAVEFORMS_NONE
+	};
+
 	void OnSaveAs();
-	void DoSaveFile(std::string sessionPath);
-	bool SaveSessionToYaml(YAML::Node& node, const std::string& dataDir);
+	void OnStartRecording();
+	void DoStartRecording(std::string sessionPath);
+	void OnStartVideoCapture();
+	void DoStartVideoCapture(const std::string& path);
+	bool WriteSessionFile(const std::string& sessionPath, const YAML::Node& node);
+	bool SaveSessionToYaml(YAML::Node& node, const std::string& dataDir, WaveformSaveMode mode);
 	void SaveLabNotes(const std::string& dataDir);
 	void LoadLabNotes(const std::string& dataDir);
-	bool SetupDataDirectory(const std::string& dataDir);
+	bool SetupDataDirectory(const std::string& dataDir, bool clearWaveforms);
 	YAML::Node SerializeUIConfiguration();
 	YAML::Node SerializeDialogs();
 	bool LoadDialogs(const YAML::Node& node);
@@ -445,7 +519,10 @@ protected:
 	enum
 	{
 		BROWSE_OPEN_SESSION,
-		BROWSE_SAVE_SESSION
+		BROWSE_SAVE_SESSION,
+		BROWSE_RECORD_SESSION,
+		BROWSE_RECORD_VIDEO,
+		BROWSE_SAVE_TRACE
 	} m_fileBrowserMode;
 
 	///@brief Browser for pending file loads
@@ -457,6 +534,9 @@ protected:
 	///@brief True if we're actively loading a file
 	bool m_fileLoadInProgress;
 
+	///@brief Time the session was last saved (or the app started), for autosave
+	double m_lastSaveTime;
+
 	///@brief Current session file path
 	std::string m_sessionFileName;
 
@@ -472,6 +552,9 @@ protected:
 	///@brief True if the pending file is to be opened online
 	bool m_openOnline;
 
+	///@brief How far back in time to include events when saving a trace, in seconds
+	int m_traceExportSeconds;
+
 protected:
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -536,7 +619,20 @@ protected:
 	///@brief Command buffer used during rendering operations
 	std::unique_ptr<vk::raii::CommandBuffer> m_cmdBuffer;
 
+	///@brief Command buffer containing the last tone mapping pass, for replaying if nothing has changed
+	std::unique_ptr<vk::raii::CommandBuffer> m_toneMapCmdBuffer;
+
+	///@brief Layout of displayed channels that m_toneMapCmdBuffer was recorded for (empty if not valid)
+	std::vector<uintptr_t> m_toneMapLayout;
+
+	///@brief Timestamps for per-shader profiling of tone mapping
+	std::unique_ptr<GpuTimer> m_toneMapTimer;
+
+	///@brief Synthetic pipeline benchmark, if one was requested on the command line
+	std::unique_ptr<PipelineBenchmark> m_benchmark;
+
 	bool DropdownButton(const char* id, float height);
+	bool IconButton(const char* name, ImVec2 size);
 
 public:
 
@@ -552,6 +648,9 @@ public:
 	ImTextureID GetTexture(const std::string& name)
 	{ return m_texmgr.GetTexture(name); }
 
+	TextureRef GetTextureRef(const std::string& name)
+	{ return m_texmgr.GetTextureRef(name); }
+
 	TextureManager* GetTextureManager()
 	{ return &m_texmgr; }
 
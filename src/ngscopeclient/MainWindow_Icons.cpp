@@ -779,6 +779,7 @@ void MainWindow::LoadToolbarIcons()
 	string prefix = string("icons/") + to_string(iconSize) + "x" + to_string(iconSize) + "/";
 
 	//Load the icons
+	m_texmgr.BeginBatch(true);
 	m_texmgr.LoadTexture("clear-sweeps", FindDataFile(prefix + "clear-sweeps.png"));
 	m_texmgr.LoadTexture("fullscreen-enter", FindDataFile(prefix + "fullscreen-enter.png"));
 	m_texmgr.LoadTexture("fullscreen-exit", FindDataFile(prefix + "fullscreen-exit.png"));
@@ -788,4 +789,5 @@ void MainWindow::LoadToolbarIcons()
 	m_texmgr.LoadTexture("trigger-force", FindDataFile(prefix + "trigger-single.png"));	//no dedicated icon yet
 	m_texmgr.LoadTexture("trigger-start", FindDataFile(prefix + "trigger-start.png"));
 	m_texmgr.LoadTexture("trigger-stop", FindDataFile(prefix + "trigger-stop.png"));
+	m_texmgr.EndBatch();
 }
@@ -36,6 +36,7 @@
 #include "MainWindow.h"
 
 #include "RemoteBridgeOscilloscope.h"
+#include "VideoRecorder.h"
 
 //Dock builder API is not yet public, so might change...
 #include "imgui_internal.h"
@@ -45,9 +46,11 @@
 #include "AddInstrumentDialog.h"
 #include "BERTDialog.h"
 #include "CreateFilterBrowser.h"
+#include "DataLogDialog.h"
 #include "FilterGraphEditor.h"
 #include "FunctionGeneratorDialog.h"
 #include "HistoryDialog.h"
+#include "HistorySearchDialog.h"
 #include "LoadDialog.h"
 #include "LogViewerDialog.h"
 #include "MeasurementsDialog.h"
@@ -61,6 +64,8 @@
 #include "ProtocolAnalyzerDialog.h"
 #include "RFGeneratorDialog.h"
 #include "SCPIConsoleDialog.h"
+#include "WaveformExportDialog.h"
+#include "WaveformRecorder.h"
 #include "Workspace.h"
 
 using namespace std;
@@ -156,6 +161,28 @@ void MainWindow::FileMenu()
 
 		ImGui::Separator();
 
+		//Stream new waveforms straight to disk
+		auto recorder = m_session.GetRecorder();
+		if(recorder)
+		{
+			string stats =
+				to_string(recorder->GetWrittenCount()) + " written, " +
+				to_string(recorder->GetDroppedCount()) + " dropped";
+			if(ImGui::MenuItem("Stop Recording", stats.c_str()))
+				m_session.StopRecording();
+		}
+		else
+		{
+			if(hasFileBrowser)
+				ImGui::BeginDisabled();
+			if(ImGui::MenuItem("Start Recording..."))
+				OnStartRecording();
+			if(hasFileBrowser)
+				ImGui::EndDisabled();
+		}
+
+		ImGui::Separator();
+
 		if(ImGui::MenuItem("Close"))
 			QueueCloseSession();
 
@@ -229,6 +256,27 @@ void MainWindow::ViewMenu()
 		if(ImGui::MenuItem("Fullscreen"))
 			SetFullscreen(!m_fullscreen);
 
+		//Record the window contents straight from the swapchain
+		auto video = GetVideoRecorder();
+		if(video)
+		{
+			string stats =
+				to_string(video->GetFramesWritten()) + " written, " +
+				to_string(GetCaptureDroppedCount()) + " dropped";
+			if(ImGui::MenuItem("Stop Recording Video", stats.c_str()))
+				StopVideoCapture();
+		}
+		else
+		{
+			bool disabled = (m_fileBrowser != nullptr) || !IsVideoCaptureSupported();
+			if(disabled)
+				ImGui::BeginDisabled();
+			if(ImGui::MenuItem("Record Video..."))
+				OnStartVideoCapture();
+			if(disabled)
+				ImGui::EndDisabled();
+		}
+
 		ImGui::Separator();
 
 		if(ImGui::MenuItem("Persistence Setup"))
@@ -369,7 +417,8 @@ void MainWindow::AddChannelsMenu()
 {
 	if(ImGui::BeginMenu("Channels"))
 	{
-		auto insts = m_session.GetInstruments();
+		auto snapshot = m_session.GetInstrumentSnapshot();
+		auto& insts = snapshot->m_instruments;
 		for(auto inst : insts)
 		{
 			if(ImGui::BeginMenu(inst->m_nickname.c_str()))
@@ -547,6 +596,19 @@ void MainWindow::WindowMenu()
 		WindowMultimeterMenu();
 		WindowPSUMenu();
 
+		bool hasDataLog = m_dataLogDialog != nullptr;
+		if(hasDataLog)
+			ImGui::BeginDisabled();
+
+		if(ImGui::MenuItem("Data Logger"))
+		{
+			m_dataLogDialog = make_shared<DataLogDialog>(&m_session);
+			AddDialog(m_dataLogDialog);
+		}
+
+		if(hasDataLog)
+			ImGui::EndDisabled();
+
 		bool hasLabNotes = m_notesDialog != nullptr;
 		if(hasLabNotes)
 			ImGui::BeginDisabled();
@@ -610,6 +672,28 @@ void MainWindow::WindowMenu()
 		if(hasHistory)
 			ImGui::EndDisabled();
 
+		bool hasHistorySearch = m_historySearchDialog != nullptr;
+		if(hasHistorySearch)
+			ImGui::BeginDisabled();
+		if(ImGui::MenuItem("History Search"))
+		{
+			m_historySearchDialog = make_shared<HistorySearchDialog>(m_session, *this);
+			AddDialog(m_historySearchDialog);
+		}
+		if(hasHistorySearch)
+			ImGui::EndDisabled();
+
+		bool hasWaveformExport = m_waveformExportDialog != nullptr;
+		if(hasWaveformExport)
+			ImGui::BeginDisabled();
+		if(ImGui::MenuItem("Waveform Export"))
+		{
+			m_waveformExportDialog = make_shared<WaveformExportDialog>(m_session, *this);
+			AddDialog(m_waveformExportDialog);
+		}
+		if(hasWaveformExport)
+			ImGui::EndDisabled();
+
 		bool hasGraphEditor = m_graphEditor != nullptr;
 		if(hasGraphEditor)
 			ImGui::BeginDisabled();
@@ -706,7 +790,8 @@ void MainWindow::WindowGeneratorMenu()
 {
 	if(ImGui::BeginMenu("Generator"))
 	{
-		auto insts = m_session.GetSCPIInstruments();
+		auto snapshot = m_session.GetInstrumentSnapshot();
+		auto& insts = snapshot->m_scpiInstruments;
 		for(auto inst : insts)
 		{
 			//Skip anything that's not a function generator
@@ -741,7 +826,8 @@ void MainWindow::WindowPSUMenu()
 {
 	if(ImGui::BeginMenu("Power Supply"))
 	{
-		auto insts = m_session.GetSCPIInstruments();
+		auto snapshot = m_session.GetInstrumentSnapshot();
+		auto& insts = snapshot->m_scpiInstruments;
 		for(auto inst : insts)
 		{
 			//Skip anything that's not a PSU
@@ -797,7 +883,8 @@ void MainWindow::DebugSCPIConsoleMenu()
 {
 	if(ImGui::BeginMenu("SCPI Console"))
 	{
-		auto insts = m_session.GetSCPIInstruments();
+		auto snapshot = m_session.GetInstrumentSnapshot();
+		auto& insts = snapshot->m_scpiInstruments;
 		for(auto inst : insts)
 		{
 			//If we already have a dialog, don't show the menu
@@ -816,6 +903,37 @@ void MainWindow::DebugSCPIConsoleMenu()
 	}
 }
 
+/**
+	@brief Runs the Debug | Tracing menu
+ */
+void MainWindow::DebugTracingMenu()
+{
+	if(ImGui::BeginMenu("Tracing"))
+	{
+		bool enabled = Tracer::IsEnabled();
+		if(ImGui::MenuItem("Enable", nullptr, &enabled))
+			Tracer::SetEnabled(enabled);
+
+		ImGui::SetNextItemWidth(5*ImGui::GetFontSize());
+		if(ImGui::InputInt("Seconds to save", &m_traceExportSeconds))
+			m_traceExportSeconds = max(m_traceExportSeconds, 1);
+
+		if(ImGui::MenuItem("Save Trace..."))
+		{
+			m_fileBrowserMode = BROWSE_SAVE_TRACE;
+			m_fileBrowser = MakeFileBrowser(
+				this,
+				".",
+				"Save Trace",
+				"Chrome/Perfetto trace (*.json)",
+				"*.json",
+				true);
+		}
+
+		ImGui::EndMenu();
+	}
+}
+
 /**
 	@brief Run the Debug menu
  */
@@ -824,6 +942,7 @@ void MainWindow::DebugMenu()
 	if(ImGui::BeginMenu("Debug"))
 	{
 		DebugSCPIConsoleMenu();
+		DebugTracingMenu();
 
 		bool showDemo = m_showDemo;
 		if(showDemo)
@@ -36,6 +36,7 @@
 #include "ngscopeclient.h"
 #include "../scopehal/MockOscilloscope.h"
 #include "ManageInstrumentsDialog.h"
+#include "DeskewTracker.h"
 #include "MainWindow.h"
 
 using namespace std;
@@ -85,7 +86,7 @@ bool ManageInstrumentsDialog::DoRender()
 			"The root instrument of a trigger group must have a trigger-out port.\n"
 			"All instruments in a trigger group should be connected to a common reference clock to avoid skew.");
 
-		if(ImGui::BeginTable("groups", 6, flags))
+		if(ImGui::BeginTable("groups", 7, flags))
 		{
 			TriggerGroupsTable();
 			ImGui::EndTable();
@@ -116,6 +117,7 @@ void ManageInstrumentsDialog::TriggerGroupsTable()
 	ImGui::TableSetupColumn("Model", ImGuiTableColumnFlags_WidthFixed, 15*width);
 	ImGui::TableSetupColumn("Serial", ImGuiTableColumnFlags_WidthFixed, 8*width);
 	ImGui::TableSetupColumn("Skew", ImGuiTableColumnFlags_WidthFixed, 8*width);
+	ImGui::TableSetupColumn("Lag", ImGuiTableColumnFlags_WidthFixed, 8*width);
 	ImGui::TableSetupColumn("Actions", ImGuiTableColumnFlags_WidthFixed, 8*width);
 	ImGui::TableHeadersRow();
 
@@ -305,8 +307,38 @@ void ManageInstrumentsDialog::TriggerGroupsTable()
 				if(ImGui::TableSetColumnIndex(3))
 					ImGui::TextUnformatted(scope->GetSerial().c_str());
 				if(ImGui::TableSetColumnIndex(4))
+				{
 					ImGui::TextUnformatted(fs.PrettyPrint(m_session.GetDeskew(scope)).c_str());
+
+					auto tracker = m_session.GetDeskewTracker(scope);
+					if(tracker)
+					{
+						auto history = tracker->GetHistory();
+						double elapsed = GetTime() - tracker->GetStartTime();
+						string tip = "Tracking drift in the background.\n\n";
+						tip += string("Drift: ") +
+							fs.PrettyPrint(m_session.GetDeskew(scope) - tracker->GetInitialSkew()) +
+							" over " + to_string(llround(elapsed / 60)) + " min\n";
+						if(!history.empty())
+						{
+							tip += string("Last residual: ") + fs.PrettyPrint(history.back().m_residual) + "\n";
+							tip += string("Last correlation: ") + to_string_sci(history.back().m_correlation) + "\n";
+						}
+						tip += string("Measurements: ") + to_string(history.size()) +
+							" (" + to_string(tracker->GetRejectedCount()) + " rejected)";
+						Tooltip(tip);
+					}
+				}
 				if(ImGui::TableSetColumnIndex(5))
+				{
+					ImGui::TextUnformatted(fs.PrettyPrint(group->GetLag(scope) * FS_PER_SECOND).c_str());
+					Tooltip(
+						"How long after the primary this instrument had its waveform ready, for the most recent "
+						"acquisition.\n\n"
+						"The group can't be processed until every instrument is ready, so a large lag here means "
+						"this instrument is limiting the group's trigger rate.");
+				}
+				if(ImGui::TableSetColumnIndex(6))
 				{
 					if(ImGui::Button("Deskew"))
 						m_parent->ShowSyncWizard(group, scope);
@@ -393,7 +425,8 @@ void ManageInstrumentsDialog::RowForNewGroup()
 
 void ManageInstrumentsDialog::AllInstrumentsTable()
 {
-	auto insts = m_session.GetInstruments();
+	auto snapshot = m_session.GetInstrumentSnapshot();
+	auto& insts = snapshot->m_instruments;
 	float width = ImGui::GetFontSize();
 	ImGui::TableSetupScrollFreeze(0, 1); //Header row does not scroll
 	ImGui::TableSetupColumn("Nickname", ImGuiTableColumnFlags_WidthFixed, 6*width);
@@ -74,6 +74,19 @@ public:
 	}
 };
 
+/**
+	@brief Hash of a TimePoint, for when it's used as a key but ordering isn't needed
+ */
+class TimePointHash
+{
+public:
+	size_t operator()(const TimePoint& t) const
+	{
+		//Acquisitions mostly differ in the femtoseconds, so mix the seconds in rather than just XORing them
+		return std::hash<int64_t>()(t.second) ^ (std::hash<int64_t>()(t.first) * 0x9e3779b97f4a7c15ULL);
+	}
+};
+
 /**
 	@brief Data for a marker
 
@@ -117,4 +130,74 @@ public:
 	}
 };
 
+/**
+	@brief The markers within a single waveform, kept sorted by offset
+
+	Markers are stored contiguously so they can be indexed like a vector, and always kept in offset order so the
+	ones within a given range of the waveform can be found by binary search rather than walking the whole list.
+ */
+class MarkerList
+{
+public:
+	typedef std::vector<Marker>::iterator iterator;
+	typedef std::pair<iterator, iterator> range;
+
+	size_t size() const
+	{ return m_markers.size(); }
+
+	bool empty() const
+	{ return m_markers.empty(); }
+
+	Marker& operator[](size_t i)
+	{ return m_markers[i]; }
+
+	iterator begin()
+	{ return m_markers.begin(); }
+
+	iterator end()
+	{ return m_markers.end(); }
+
+	iterator erase(iterator it)
+	{ return m_markers.erase(it); }
+
+	/**
+		@brief Adds a marker, after any existing markers at the same offset
+	 */
+	iterator Insert(const Marker& m)
+	{
+		auto it = std::upper_bound(m_markers.begin(), m_markers.end(), m.m_offset,
+			[](int64_t off, const Marker& rhs) { return off < rhs.m_offset; });
+		return m_markers.insert(it, m);
+	}
+
+	/**
+		@brief Gets the markers with offsets in the range [start, end]
+	 */
+	range GetRange(int64_t start, int64_t end)
+	{
+		auto lo = std::lower_bound(m_markers.begin(), m_markers.end(), start,
+			[](const Marker& lhs, int64_t off) { return lhs.m_offset < off; });
+		auto hi = std::upper_bound(lo, m_markers.end(), end,
+			[](int64_t off, const Marker& rhs) { return off < rhs.m_offset; });
+		return range(lo, hi);
+	}
+
+	/**
+		@brief Restores offset order after markers have been moved in place (e.g. by dragging)
+
+		@return True if anything had to be moved
+	 */
+	bool Sort()
+	{
+		auto cmp = [](const Marker& lhs, const Marker& rhs) { return lhs.m_offset < rhs.m_offset; };
+		if(std::is_sorted(m_markers.begin(), m_markers.end(), cmp))
+			return false;
+		std::stable_sort(m_markers.begin(), m_markers.end(), cmp);
+		return true;
+	}
+
+protected:
+	std::vector<Marker> m_markers;
+};
+
 #endif
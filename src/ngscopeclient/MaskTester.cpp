@@ -0,0 +1,475 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of MaskTester
+ */
+
+#include "ngscopeclient.h"
+#include "MaskTester.h"
+#include "../scopeprotocols/EyePattern.h"
+
+using namespace std;
+
+///@brief Margin of the last step of the integrated eye margin search (1 = every mask region doubled in size)
+static const float MASK_MARGIN_MAX = 1;
+
+//Layout of m_eyeCounters, must match EyeMaskCount.glsl
+static const size_t EYE_COUNTER_TOTAL = 0;
+static const size_t EYE_COUNTER_REGIONS = 1;
+static const size_t EYE_COUNTER_STEPS = EYE_COUNTER_REGIONS + MASK_TEST_MAX_POLYGONS;
+static const size_t EYE_NUM_COUNTERS = EYE_COUNTER_STEPS + MASK_MARGIN_STEPS;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+MaskTester::MaskTester(const string& name)
+	: m_queue(g_vkQueueManager->GetComputeQueue(name + ".queue"))
+	, m_pool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_pool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+	, m_uiStart(name + ".uiStart")
+	, m_uiOffset(name + ".uiOffset")
+	, m_uiLength(name + ".uiLength")
+	, m_polyStart(name + ".polyStart")
+	, m_polyX(name + ".polyX")
+	, m_polyY(name + ".polyY")
+	, m_hits(name + ".hits")
+	, m_coverage(name + ".coverage")
+	, m_eyeCounters(name + ".eyeCounters")
+{
+	m_testPipeline = make_shared<ComputePipeline>(
+		"shaders/MaskTest.spv", 8, sizeof(MaskTestArgs));
+	m_coveragePipeline = make_shared<ComputePipeline>(
+		"shaders/EyeMaskCoverage.spv", 4, sizeof(EyeMaskCoverageArgs));
+	m_countPipeline = make_shared<ComputePipeline>(
+		"shaders/EyeMaskCount.spv", 3, sizeof(EyeMaskCountArgs));
+
+	if(g_hasDebugUtils)
+	{
+		string poolName = name + ".pool";
+		string bufName = name + ".cmdbuf";
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandPool,
+				reinterpret_cast<uint64_t>(static_cast<VkCommandPool>(*m_pool)),
+				poolName.c_str()));
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandBuffer,
+				reinterpret_cast<int64_t>(static_cast<VkCommandBuffer>(*m_cmdBuf)),
+				bufName.c_str()));
+	}
+
+	//Everything is generated on the CPU and only read by the shader, except the hit counters which come back
+	m_uiStart.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_uiStart.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_polyStart.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_polyStart.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_hits.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_hits.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_eyeCounters.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_eyeCounters.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	//Coverage is built and used entirely on the GPU
+	m_coverage.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+	m_coverage.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	AcceleratorBuffer<float>* bufs[] = { &m_uiOffset, &m_uiLength, &m_polyX, &m_polyY };
+	for(auto buf : bufs)
+	{
+		buf->SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+		buf->SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Testing
+
+/**
+	@brief Tests the current input of an eye pattern against its mask
+
+	Only uniformly sampled analog data with a digital clock (e.g. from a CDR filter) can be tested, which covers
+	the usual eye pattern setup. The caller must hold a shared lock on the waveform data, and the filter graph must
+	have been run on the waveforms being tested.
+
+	@param eye		The eye pattern to test
+	@param failed	Set true if the acquisition exceeded the mask's allowed hit rate
+	@param hits		Total number of mask hits in the acquisition
+
+	@return True if a test was run, false if there's no mask or the inputs can't be tested
+ */
+bool MaskTester::Test(EyePattern* eye, bool& failed, uint64_t& hits)
+{
+	failed = false;
+	hits = 0;
+
+	auto& mask = eye->GetMask();
+	if(mask.empty())
+		return false;
+
+	auto din = dynamic_cast<UniformAnalogWaveform*>(eye->GetInput(0).GetData());
+	auto clk = dynamic_cast<SparseDigitalWaveform*>(eye->GetInput(1).GetData());
+	if(!din || !clk || (din->size() == 0) )
+		return false;
+
+	//Figure out where each UI starts
+	uint64_t samples = 0;
+	size_t nuis = FoldAgainstClock(din, clk, samples);
+	if(nuis == 0)
+		return false;
+
+	//Relative masks are scaled by the UI width the eye measured, or our own average if it hasn't got one yet
+	double uiWidth = 0;
+	auto edata = dynamic_cast<EyeWaveform*>(eye->GetData(0));
+	if(edata)
+		uiWidth = edata->GetUIWidth();
+	if(uiWidth <= 0)
+	{
+		for(size_t i=0; i<nuis; i++)
+			uiWidth += m_uiLength[i];
+		uiWidth /= nuis;
+	}
+	size_t npolys = LoadPolygons(eye, uiWidth);
+	if(npolys == 0)
+		return false;
+
+	m_hits.resize(npolys);
+	for(size_t i=0; i<npolys; i++)
+		m_hits[i] = 0;
+	m_hits.MarkModifiedFromCpu();
+
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	din->m_samples.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+
+	//sync in case transfer happened in another thread
+	AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+	MaskTestArgs args;
+	args.numUIs = nuis;
+	args.numSamples = din->size();
+	args.numPolygons = npolys;
+	args.timescale = din->m_timescale;
+	m_testPipeline->BindBufferNonblocking(0, m_hits, m_cmdBuf);
+	m_testPipeline->BindBufferNonblocking(1, din->m_samples, m_cmdBuf);
+	m_testPipeline->BindBufferNonblocking(2, m_uiStart, m_cmdBuf);
+	m_testPipeline->BindBufferNonblocking(3, m_uiOffset, m_cmdBuf);
+	m_testPipeline->BindBufferNonblocking(4, m_uiLength, m_cmdBuf);
+	m_testPipeline->BindBufferNonblocking(5, m_polyStart, m_cmdBuf);
+	m_testPipeline->BindBufferNonblocking(6, m_polyX, m_cmdBuf);
+	m_testPipeline->BindBufferNonblocking(7, m_polyY, m_cmdBuf);
+	uint32_t blocks = GetComputeBlockCount(nuis, 64);
+	if(blocks > 32768)
+		blocks = 32768;
+	m_testPipeline->Dispatch(m_cmdBuf, args, blocks);
+	m_hits.MarkModifiedFromGpu();
+
+	m_cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "mask test");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+
+	m_hits.PrepareForCpuAccess();
+	for(size_t i=0; i<npolys; i++)
+		hits += m_hits[i];
+
+	//Each sample is tested at both of the positions it's drawn at in the eye
+	double rate = hits * 1.0 / (2 * samples);
+	failed = (hits > 0) && (rate > mask.GetAllowedHitRate());
+
+	lock_guard<mutex> lock(m_statsMutex);
+	if(m_stats.m_regionHits.size() != npolys)
+		m_stats.m_regionHits.resize(npolys, 0);
+	for(size_t i=0; i<npolys; i++)
+		m_stats.m_regionHits[i] += m_hits[i];
+	m_stats.m_acquisitions ++;
+	if(failed)
+		m_stats.m_failedAcquisitions ++;
+	m_stats.m_uis += nuis;
+	m_stats.m_samples += samples;
+	m_stats.m_lastHits = hits;
+	m_stats.m_lastFailed = failed;
+
+	return true;
+}
+
+/**
+	@brief Measures an eye pattern's integrated data against its mask, without reading the eye back from the GPU
+
+	The mask regions are rasterized into a coverage map matching the eye's integration buffer, at zero margin and at
+	each of MASK_MARGIN_STEPS margins up to MASK_MARGIN_MAX. That only has to be redone when the eye's size or scale
+	or the mask changes. Each call then just totals the eye's bins under each region and each margin step, and only
+	the totals come back to the CPU.
+
+	The caller must hold a shared lock on the waveform data.
+
+	@param eye		The eye pattern to measure
+
+	@return True if the results in the stats were updated
+ */
+bool MaskTester::AnalyzeEye(EyePattern* eye)
+{
+	auto& mask = eye->GetMask();
+	if(mask.empty())
+		return false;
+
+	auto edata = dynamic_cast<EyeWaveform*>(eye->GetData(0));
+	if(!edata)
+		return false;
+	size_t width = edata->GetWidth();
+	size_t height = edata->GetHeight();
+	double uiWidth = edata->GetUIWidth();
+	if( (width == 0) || (height == 0) || (uiWidth <= 0) )
+		return false;
+
+	size_t npolys = LoadPolygons(eye, uiWidth);
+	if(npolys == 0)
+		return false;
+
+	//The integration buffer spans two UIs centered on the clock edge horizontally, and the eye's full scale range
+	//vertically (the same way it's drawn)
+	float range = eye->GetVoltageRange(0);
+	float offset = eye->GetOffset(0);
+	EyeMaskCoverageArgs cargs;
+	cargs.width = width;
+	cargs.height = height;
+	cargs.numPolygons = npolys;
+	cargs.numSteps = MASK_MARGIN_STEPS;
+	cargs.xscale = 2 * uiWidth / width;
+	cargs.xoff = cargs.xscale/2 - uiWidth;
+	cargs.yscale = range / height;
+	cargs.yoff = cargs.yscale/2 - range/2 - offset;
+	cargs.maxMargin = MASK_MARGIN_MAX;
+
+	vector<float> key = { (float)width, (float)height, cargs.xscale, cargs.yscale, cargs.yoff };
+	for(size_t i=0; i<m_polyStart.size(); i++)
+		key.push_back(m_polyStart[i]);
+	for(size_t i=0; i<m_polyX.size(); i++)
+	{
+		key.push_back(m_polyX[i]);
+		key.push_back(m_polyY[i]);
+	}
+	bool rasterize = (key != m_coverageKey);
+
+	m_eyeCounters.resize(2 * EYE_NUM_COUNTERS);
+	for(size_t i=0; i<m_eyeCounters.size(); i++)
+		m_eyeCounters[i] = 0;
+	m_eyeCounters.MarkModifiedFromCpu();
+
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	auto& accum = edata->GetAccumBuffer();
+	accum.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+
+	//sync in case transfer happened in another thread
+	AcceleratorBuffer<int64_t>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+	uint32_t xblocks = GetComputeBlockCount(width, 64);
+	if(rasterize)
+	{
+		m_coverage.resize(3 * width * height);
+		m_coveragePipeline->BindBufferNonblocking(0, m_coverage, m_cmdBuf, true);
+		m_coveragePipeline->BindBufferNonblocking(1, m_polyStart, m_cmdBuf);
+		m_coveragePipeline->BindBufferNonblocking(2, m_polyX, m_cmdBuf);
+		m_coveragePipeline->BindBufferNonblocking(3, m_polyY, m_cmdBuf);
+		m_coveragePipeline->Dispatch(m_cmdBuf, cargs, xblocks, height);
+		m_coveragePipeline->AddComputeMemoryBarrier(m_cmdBuf);
+		m_coverage.MarkModifiedFromGpu();
+	}
+
+	EyeMaskCountArgs nargs;
+	nargs.width = width;
+	nargs.height = height;
+	nargs.numPolygons = npolys;
+	nargs.numSteps = MASK_MARGIN_STEPS;
+	m_countPipeline->BindBufferNonblocking(0, accum, m_cmdBuf);
+	m_countPipeline->BindBufferNonblocking(1, m_coverage, m_cmdBuf);
+	m_countPipeline->BindBufferNonblocking(2, m_eyeCounters, m_cmdBuf);
+	m_countPipeline->Dispatch(m_cmdBuf, nargs, xblocks, height);
+	m_eyeCounters.MarkModifiedFromGpu();
+
+	m_cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "eye mask margin");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+	if(rasterize)
+		m_coverageKey = key;
+
+	m_eyeCounters.PrepareForCpuAccess();
+	auto counter = [&](size_t i)
+	{ return (static_cast<uint64_t>(m_eyeCounters[i*2 + 1]) << 32) | m_eyeCounters[i*2]; };
+
+	//The margin is the last step before the first one which exceeds the allowed hit rate
+	uint64_t total = counter(EYE_COUNTER_TOTAL);
+	double allowed = mask.GetAllowedHitRate();
+	int passed = -1;
+	for(size_t k=0; k<MASK_MARGIN_STEPS; k++)
+	{
+		uint64_t hits = counter(EYE_COUNTER_STEPS + k);
+		if( (hits > 0) && ( (total == 0) || (hits * 1.0 / total > allowed) ) )
+			break;
+		passed = static_cast<int>(k);
+	}
+
+	lock_guard<mutex> lock(m_statsMutex);
+	m_stats.m_eyeValid = true;
+	m_stats.m_eyeTotal = total;
+	m_stats.m_eyeRegionHits.resize(npolys);
+	for(size_t i=0; i<npolys; i++)
+		m_stats.m_eyeRegionHits[i] = counter(EYE_COUNTER_REGIONS + i);
+	if(passed < 0)
+		m_stats.m_eyeMargin = -1;
+	else
+		m_stats.m_eyeMargin = MASK_MARGIN_MAX * passed / (MASK_MARGIN_STEPS - 1);
+	m_stats.m_eyeMarginUnbounded = (passed == (MASK_MARGIN_STEPS - 1));
+
+	return true;
+}
+
+/**
+	@brief Splits the data waveform into unit intervals at each clock edge
+
+	UI k starts at sample m_uiStart[k], which is m_uiOffset[k] fs after the clock edge, and is m_uiLength[k] fs long.
+	Both edges of the clock count, the same as a CDR output toggling once per UI.
+
+	@param din		Sampled data
+	@param clk		Recovered clock
+	@param samples	Number of data samples within a UI
+
+	@return Number of UIs
+ */
+size_t MaskTester::FoldAgainstClock(UniformAnalogWaveform* din, SparseDigitalWaveform* clk, uint64_t& samples)
+{
+	samples = 0;
+	clk->PrepareForCpuAccess();
+
+	int64_t len = din->size();
+	int64_t ts = din->m_timescale;
+	int64_t phase = din->m_triggerPhase;
+	size_t nclk = clk->size();
+
+	m_uiStart.resize(nclk);
+	m_uiOffset.resize(nclk);
+	m_uiLength.resize(nclk);
+
+	size_t nuis = 0;
+	bool haveEdge = false;
+	int64_t lastEdge = 0;
+	for(size_t i=0; i<nclk; i++)
+	{
+		if( (i > 0) && (clk->m_samples[i] == clk->m_samples[i-1]) )
+			continue;
+
+		int64_t edge = clk->m_offsets[i] * clk->m_timescale + clk->m_triggerPhase;
+		if(haveEdge)
+		{
+			//First and one past the last sample within the UI
+			int64_t first = max((int64_t)0, (lastEdge - phase + ts - 1) / ts);
+			int64_t end = min(len, (edge - phase + ts - 1) / ts);
+			if(first >= len)
+				break;
+
+			if(end > first)
+			{
+				m_uiStart[nuis] = first;
+				m_uiOffset[nuis] = first*ts + phase - lastEdge;
+				m_uiLength[nuis] = edge - lastEdge;
+				samples += end - first;
+				nuis ++;
+			}
+		}
+
+		lastEdge = edge;
+		haveEdge = true;
+	}
+
+	m_uiStart.resize(nuis);
+	m_uiOffset.resize(nuis);
+	m_uiLength.resize(nuis);
+	m_uiStart.MarkModifiedFromCpu();
+	m_uiOffset.MarkModifiedFromCpu();
+	m_uiLength.MarkModifiedFromCpu();
+
+	return nuis;
+}
+
+/**
+	@brief Converts the eye's mask polygons to absolute time (fs relative to the clock edge) and voltage
+
+	@return Number of polygons
+ */
+size_t MaskTester::LoadPolygons(EyePattern* eye, double uiWidth)
+{
+	auto& mask = eye->GetMask();
+	auto polygons = mask.GetPolygons();
+	bool relative = mask.IsTimebaseRelative();
+
+	if(polygons.size() > MASK_TEST_MAX_POLYGONS)
+	{
+		LogTrace("Mask for %s has %zu regions, only the first %d are tested\n",
+			eye->GetDisplayName().c_str(), polygons.size(), MASK_TEST_MAX_POLYGONS);
+		polygons.resize(MASK_TEST_MAX_POLYGONS);
+	}
+
+	m_polyStart.clear();
+	m_polyX.clear();
+	m_polyY.clear();
+	for(auto& poly : polygons)
+	{
+		m_polyStart.push_back(m_polyX.size());
+		for(auto& point : poly.m_points)
+		{
+			if(relative)
+				m_polyX.push_back(point.m_time * uiWidth);
+			else
+				m_polyX.push_back(point.m_time);
+			m_polyY.push_back(point.m_voltage);
+		}
+	}
+	m_polyStart.push_back(m_polyX.size());
+
+	m_polyStart.MarkModifiedFromCpu();
+	m_polyX.MarkModifiedFromCpu();
+	m_polyY.MarkModifiedFromCpu();
+
+	return polygons.size();
+}
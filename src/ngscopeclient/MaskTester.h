@@ -0,0 +1,213 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of MaskTester
+ */
+#ifndef MaskTester_h
+#define MaskTester_h
+
+class EyePattern;
+
+///@brief Maximum number of mask regions tested on the GPU (any more are ignored)
+#define MASK_TEST_MAX_POLYGONS 16
+
+///@brief Number of margins tried by the integrated eye margin search, from zero to MASK_MARGIN_MAX
+#define MASK_MARGIN_STEPS 64
+
+class MaskTestArgs
+{
+public:
+	uint32_t numUIs;
+	uint32_t numSamples;
+	uint32_t numPolygons;
+	float timescale;
+};
+
+class EyeMaskCoverageArgs
+{
+public:
+	uint32_t width;
+	uint32_t height;
+	uint32_t numPolygons;
+	uint32_t numSteps;
+	float xoff;
+	float xscale;
+	float yoff;
+	float yscale;
+	float maxMargin;
+};
+
+class EyeMaskCountArgs
+{
+public:
+	uint32_t width;
+	uint32_t height;
+	uint32_t numPolygons;
+	uint32_t numSteps;
+};
+
+/**
+	@brief Cumulative results of testing live acquisitions against one eye pattern's mask
+ */
+class MaskTestStats
+{
+public:
+	MaskTestStats()
+	: m_acquisitions(0)
+	, m_failedAcquisitions(0)
+	, m_uis(0)
+	, m_samples(0)
+	, m_lastHits(0)
+	, m_lastFailed(false)
+	, m_eyeValid(false)
+	, m_eyeTotal(0)
+	, m_eyeMargin(0)
+	, m_eyeMarginUnbounded(false)
+	{}
+
+	///@brief Total number of hits in each region of the mask
+	std::vector<uint64_t> m_regionHits;
+
+	///@brief Number of acquisitions tested
+	uint64_t m_acquisitions;
+
+	///@brief Number of acquisitions which exceeded the mask's allowed hit rate
+	uint64_t m_failedAcquisitions;
+
+	///@brief Number of unit intervals tested
+	uint64_t m_uis;
+
+	///@brief Number of samples tested
+	uint64_t m_samples;
+
+	///@brief Number of hits in the most recent acquisition
+	uint64_t m_lastHits;
+
+	///@brief True if the most recent acquisition failed
+	bool m_lastFailed;
+
+	///@brief True if the m_eye* fields have been filled in from the integrated eye
+	bool m_eyeValid;
+
+	///@brief Total number of samples integrated into the eye
+	uint64_t m_eyeTotal;
+
+	///@brief Number of integrated samples within each region of the mask
+	std::vector<uint64_t> m_eyeRegionHits;
+
+	/**
+		@brief Largest margin the mask can be grown by while staying within its allowed hit rate
+
+		As a fraction of the size of each region (0.1 = every region grown by 10% about its centroid), or negative if
+		the eye fails the mask as is.
+	 */
+	double m_eyeMargin;
+
+	///@brief True if the eye passed at every margin tried, so the real margin is at least m_eyeMargin
+	bool m_eyeMarginUnbounded;
+};
+
+/**
+	@brief Tests every sample of a live acquisition against an eye pattern's mask on the GPU
+
+	The eye pattern itself only keeps an integrated 2D histogram, so it can tell that the mask was hit but not by
+	which acquisition. This folds the eye's raw data input against its clock input the same way the eye does, and
+	checks each (time, voltage) sample against the mask polygons, so individual failing acquisitions can be
+	flagged in history as they arrive.
+
+	It can also measure the integrated eye against the mask directly on the GPU (per-region hit counts, and how far
+	the mask can grow before failing) without reading the eye back.
+ */
+class MaskTester
+{
+public:
+	MaskTester(const std::string& name);
+
+	bool Test(EyePattern* eye, bool& failed, uint64_t& hits);
+	bool AnalyzeEye(EyePattern* eye);
+
+	///@brief Gets a copy of the cumulative results
+	MaskTestStats GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		return m_stats;
+	}
+
+	///@brief Clears the cumulative results
+	void ResetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_stats = MaskTestStats();
+	}
+
+protected:
+	size_t FoldAgainstClock(UniformAnalogWaveform* din, SparseDigitalWaveform* clk, uint64_t& samples);
+	size_t LoadPolygons(EyePattern* eye, double uiWidth);
+
+	//Vulkan processing queues etc
+	std::shared_ptr<QueueHandle> m_queue;
+	vk::raii::CommandPool m_pool;
+	vk::raii::CommandBuffer m_cmdBuf;
+
+	std::shared_ptr<ComputePipeline> m_testPipeline;
+
+	//Per UI: first sample, offset of that sample from the clock edge (fs), and UI length (fs)
+	AcceleratorBuffer<uint32_t> m_uiStart;
+	AcceleratorBuffer<float> m_uiOffset;
+	AcceleratorBuffer<float> m_uiLength;
+
+	//Mask polygons: index of each polygon's first vertex (plus one past the end), and vertex coordinates
+	AcceleratorBuffer<uint32_t> m_polyStart;
+	AcceleratorBuffer<float> m_polyX;
+	AcceleratorBuffer<float> m_polyY;
+
+	//Hit count for each polygon
+	AcceleratorBuffer<uint32_t> m_hits;
+
+	std::shared_ptr<ComputePipeline> m_coveragePipeline;
+	std::shared_ptr<ComputePipeline> m_countPipeline;
+
+	//Per pixel of the integrated eye: regions covering it, and margin steps at which it's covered
+	AcceleratorBuffer<uint32_t> m_coverage;
+
+	//Eye size, scale and mask polygons m_coverage was rasterized for, so it's only redone when one changes
+	std::vector<float> m_coverageKey;
+
+	//64-bit (low, high) hit counters for the integrated eye: total, per region, per margin step
+	AcceleratorBuffer<uint32_t> m_eyeCounters;
+
+	std::mutex m_statsMutex;
+	MaskTestStats m_stats;
+};
+
+#endif
@@ -0,0 +1,308 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of MeasurementStatistics
+ */
+
+#include "ngscopeclient.h"
+#include "MeasurementStatistics.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TDigest
+
+TDigest::TDigest(double compression)
+	: m_compression(compression)
+	, m_count(0)
+	, m_min(0)
+	, m_max(0)
+{
+}
+
+/**
+	@brief Adds a value to the digest
+ */
+void TDigest::Add(double value)
+{
+	if(m_count == 0)
+	{
+		m_min = value;
+		m_max = value;
+	}
+	else
+	{
+		m_min = min(m_min, value);
+		m_max = max(m_max, value);
+	}
+	m_count ++;
+
+	//Batch up new values so we only have to sort and merge once in a while
+	m_buffer.push_back(value);
+	if(m_buffer.size() >= 5*m_compression)
+		Flush();
+}
+
+/**
+	@brief Removes all values from the digest
+ */
+void TDigest::Clear()
+{
+	m_centroids.clear();
+	m_buffer.clear();
+	m_count = 0;
+	m_min = 0;
+	m_max = 0;
+}
+
+/**
+	@brief Merges buffered values into the centroids
+ */
+void TDigest::Flush()
+{
+	if(m_buffer.empty())
+		return;
+
+	vector<Centroid> points = m_centroids;
+	for(auto v : m_buffer)
+		points.push_back({v, 1});
+	m_buffer.clear();
+	sort(points.begin(), points.end(),
+		[](const Centroid& a, const Centroid& b) { return a.m_mean < b.m_mean; });
+
+	//k1 scale function: maps a quantile to a centroid index, so centroids near the tails cover fewer values
+	double total = m_count;
+	double scale = m_compression / (2 * M_PI);
+	auto k = [&](double q) { return scale * asin(2*q - 1); };
+	auto kinv = [&](double kv) { return (sin(kv / scale) + 1) / 2; };
+
+	m_centroids.clear();
+	Centroid cur = points[0];
+	double weightSoFar = 0;
+	double qlimit = kinv(k(0) + 1);
+	for(size_t i=1; i<points.size(); i++)
+	{
+		auto& next = points[i];
+		double q = (weightSoFar + cur.m_weight + next.m_weight) / total;
+
+		//Merge into the current centroid if it doesn't grow past the size allowed at this quantile
+		if(q <= qlimit)
+		{
+			cur.m_weight += next.m_weight;
+			cur.m_mean += (next.m_mean - cur.m_mean) * next.m_weight / cur.m_weight;
+		}
+		else
+		{
+			weightSoFar += cur.m_weight;
+			m_centroids.push_back(cur);
+			qlimit = kinv(k(weightSoFar / total) + 1);
+			cur = next;
+		}
+	}
+	m_centroids.push_back(cur);
+}
+
+/**
+	@brief Gets the piecewise linear approximation of the CDF: cumulative weight at the center of each centroid,
+	plus the minimum and maximum at either end
+ */
+void TDigest::GetKnots(vector<double>& positions, vector<double>& means)
+{
+	Flush();
+
+	positions.push_back(0);
+	means.push_back(m_min);
+
+	double cum = 0;
+	for(auto& c : m_centroids)
+	{
+		positions.push_back(cum + c.m_weight/2);
+		means.push_back(c.m_mean);
+		cum += c.m_weight;
+	}
+
+	positions.push_back(cum);
+	means.push_back(m_max);
+}
+
+/**
+	@brief Estimates the value below which a fraction q of the values lie
+ */
+double TDigest::Quantile(double q)
+{
+	if(m_count == 0)
+		return 0;
+
+	vector<double> positions;
+	vector<double> means;
+	GetKnots(positions, means);
+
+	double index = min(max(q, 0.0), 1.0) * m_count;
+	for(size_t i=1; i<positions.size(); i++)
+	{
+		if(index > positions[i])
+			continue;
+
+		double span = positions[i] - positions[i-1];
+		if(span <= 0)
+			return means[i];
+		return means[i-1] + (means[i] - means[i-1]) * (index - positions[i-1]) / span;
+	}
+	return m_max;
+}
+
+/**
+	@brief Estimates the fraction of values less than or equal to the given value
+ */
+double TDigest::Cdf(double value)
+{
+	if(m_count == 0)
+		return 0;
+	if(value < m_min)
+		return 0;
+	if(value >= m_max)
+		return 1;
+
+	vector<double> positions;
+	vector<double> means;
+	GetKnots(positions, means);
+
+	for(size_t i=1; i<means.size(); i++)
+	{
+		if(value > means[i])
+			continue;
+
+		double span = means[i] - means[i-1];
+		if(span <= 0)
+			return positions[i] / m_count;
+		return (positions[i-1] + (positions[i] - positions[i-1]) * (value - means[i-1]) / span) / m_count;
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MeasurementStatistics
+
+MeasurementStatistics::MeasurementStatistics()
+	: m_count(0)
+	, m_mean(0)
+	, m_m2(0)
+	, m_min(0)
+	, m_max(0)
+{
+}
+
+/**
+	@brief Adds one acquisition's value of the measurement
+ */
+void MeasurementStatistics::Add(double value)
+{
+	//Ignore measurements which didn't produce a result
+	if(!isfinite(value))
+		return;
+
+	if(m_count == 0)
+	{
+		m_min = value;
+		m_max = value;
+	}
+	else
+	{
+		m_min = min(m_min, value);
+		m_max = max(m_max, value);
+	}
+
+	//Welford's algorithm, to avoid the loss of precision of accumulating sum and sum of squares
+	m_count ++;
+	double delta = value - m_mean;
+	m_mean += delta / m_count;
+	m_m2 += delta * (value - m_mean);
+
+	m_digest.Add(value);
+}
+
+/**
+	@brief Forgets all values
+ */
+void MeasurementStatistics::Clear()
+{
+	m_count = 0;
+	m_mean = 0;
+	m_m2 = 0;
+	m_min = 0;
+	m_max = 0;
+	m_digest.Clear();
+}
+
+/**
+	@brief Gets the current statistics
+
+	@param bins		Number of histogram bins to generate
+ */
+MeasurementSummary MeasurementStatistics::GetSummary(size_t bins)
+{
+	MeasurementSummary ret;
+	ret.m_count = m_count;
+	if(m_count == 0)
+		return ret;
+
+	ret.m_mean = m_mean;
+	if(m_count > 1)
+		ret.m_stdev = sqrt(m_m2 / (m_count - 1));
+	ret.m_min = m_min;
+	ret.m_max = m_max;
+	ret.m_median = m_digest.Quantile(0.5);
+	ret.m_p5 = m_digest.Quantile(0.05);
+	ret.m_p95 = m_digest.Quantile(0.95);
+
+	if(bins == 0)
+		return ret;
+
+	//If every value is the same, put them all in one bin
+	ret.m_histogram.resize(bins, 0);
+	double range = m_max - m_min;
+	if(range <= 0)
+	{
+		ret.m_histogram[bins/2] = m_count;
+		return ret;
+	}
+
+	double prev = 0;
+	for(size_t i=0; i<bins; i++)
+	{
+		double cdf = (i == bins-1) ? 1 : m_digest.Cdf(m_min + range * (i+1) / bins);
+		ret.m_histogram[i] = (cdf - prev) * m_count;
+		prev = cdf;
+	}
+	return ret;
+}
@@ -0,0 +1,157 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of MeasurementStatistics
+ */
+#ifndef MeasurementStatistics_h
+#define MeasurementStatistics_h
+
+/**
+	@brief Streaming approximation of a distribution, for estimating percentiles of an unbounded series of values
+
+	This is a merging t-digest (Dunning & Ertl): values are clustered into a bounded number of weighted centroids,
+	which are kept small at the tails of the distribution and allowed to grow in the middle. Memory use and the
+	cost of adding a value are constant regardless of how many values have been seen.
+ */
+class TDigest
+{
+public:
+	TDigest(double compression = 100);
+
+	void Add(double value);
+	void Clear();
+
+	double Quantile(double q);
+	double Cdf(double value);
+
+	///@brief Gets the number of values added
+	size_t GetCount()
+	{ return m_count; }
+
+protected:
+	void Flush();
+	void GetKnots(std::vector<double>& positions, std::vector<double>& means);
+
+	class Centroid
+	{
+	public:
+		double m_mean;
+		double m_weight;
+	};
+
+	///@brief Compression factor (larger is more accurate but uses more centroids)
+	double m_compression;
+
+	///@brief Merged centroids, sorted by mean
+	std::vector<Centroid> m_centroids;
+
+	///@brief Values added since the last merge
+	std::vector<double> m_buffer;
+
+	///@brief Number of values added
+	size_t m_count;
+
+	///@brief Smallest value added
+	double m_min;
+
+	///@brief Largest value added
+	double m_max;
+};
+
+/**
+	@brief Summary of a MeasurementStatistics, cheap enough to fetch every frame
+ */
+class MeasurementSummary
+{
+public:
+	MeasurementSummary()
+	: m_count(0)
+	, m_mean(0)
+	, m_stdev(0)
+	, m_min(0)
+	, m_max(0)
+	, m_median(0)
+	, m_p5(0)
+	, m_p95(0)
+	{}
+
+	size_t m_count;
+	double m_mean;
+	double m_stdev;
+	double m_min;
+	double m_max;
+	double m_median;
+	double m_p5;
+	double m_p95;
+
+	///@brief Number of values in each of a set of equal width bins from m_min to m_max
+	std::vector<float> m_histogram;
+};
+
+/**
+	@brief Running statistics of one scalar measurement across many acquisitions
+
+	Mean and standard deviation are computed exactly with Welford's algorithm, percentiles and the histogram are
+	estimated from a t-digest.
+ */
+class MeasurementStatistics
+{
+public:
+	MeasurementStatistics();
+
+	void Add(double value);
+	void Clear();
+
+	MeasurementSummary GetSummary(size_t bins);
+
+protected:
+	///@brief Number of values added
+	size_t m_count;
+
+	///@brief Running mean
+	double m_mean;
+
+	///@brief Running sum of squared differences from the mean
+	double m_m2;
+
+	///@brief Smallest value added
+	double m_min;
+
+	///@brief Largest value added
+	double m_max;
+
+	///@brief Distribution of the values
+	TDigest m_digest;
+};
+
+#endif
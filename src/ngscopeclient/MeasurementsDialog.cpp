@@ -42,7 +42,7 @@ using namespace std;
 // Construction / destruction
 
 MeasurementsDialog::MeasurementsDialog(Session& session)
-	: Dialog("Measurements", "Measurements", ImVec2(300, 400))
+	: Dialog("Measurements", "Measurements", ImVec2(600, 400))
 	, m_session(session)
 {
 
@@ -52,6 +52,7 @@ MeasurementsDialog::~MeasurementsDialog()
 {
 	for(auto s : m_streams)
 	{
+		m_session.UntrackMeasurementStatistics(s);
 		auto ochan = dynamic_cast<OscilloscopeChannel*>(s.m_channel);
 		if(ochan)
 			ochan->Release();
@@ -80,7 +81,25 @@ bool MeasurementsDialog::DoRender()
 
 	float width = ImGui::GetFontSize();
 
-	int ncols = 2;
+	//Statistics are accumulated by the WaveformThread, we only display them here
+	if(m_session.IsRecomputingMeasurementStatistics())
+	{
+		ImGui::ProgressBar(m_session.GetMeasurementRecomputeProgress(), ImVec2(15*width, 0), "Recomputing...");
+		ImGui::SameLine();
+	}
+	else
+	{
+		if(ImGui::Button("Recompute from History"))
+			m_session.RecomputeMeasurementStatistics();
+		HelpMarker(
+			"Rebuilds the statistics from every acquisition in history, using the measurement values recorded\n"
+			"when each one was acquired. Acquisitions loaded from a saved session don't have recorded values.");
+		ImGui::SameLine();
+	}
+	if(ImGui::Button("Reset Statistics"))
+		m_session.ResetMeasurementStatistics();
+
+	int ncols = 7;
 	bool deleteRow = false;
 	size_t rowToDelete = 0;
 	if(ImGui::BeginTable("table", ncols, flags))
@@ -88,6 +107,11 @@ bool MeasurementsDialog::DoRender()
 		ImGui::TableSetupScrollFreeze(0, 1); //Header row does not scroll
 		ImGui::TableSetupColumn("Channel", ImGuiTableColumnFlags_WidthFixed, 15*width);
 		ImGui::TableSetupColumn("Value", ImGuiTableColumnFlags_WidthFixed, 10*width);
+		ImGui::TableSetupColumn("Mean", ImGuiTableColumnFlags_WidthFixed, 7*width);
+		ImGui::TableSetupColumn("Std dev", ImGuiTableColumnFlags_WidthFixed, 7*width);
+		ImGui::TableSetupColumn("Min", ImGuiTableColumnFlags_WidthFixed, 7*width);
+		ImGui::TableSetupColumn("Max", ImGuiTableColumnFlags_WidthFixed, 7*width);
+		ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthFixed, 5*width);
 		ImGui::TableHeadersRow();
 
 		//TODO: double click value opens properties dialog
@@ -137,9 +161,28 @@ bool MeasurementsDialog::DoRender()
 			}
 
 			ImGui::TableSetColumnIndex(1);
-			auto value = s.GetYAxisUnits().PrettyPrint(s.GetScalarValue());
+			auto unit = s.GetYAxisUnits();
+			auto value = unit.PrettyPrint(s.GetScalarValue());
 			ImGui::TextUnformatted(value.c_str());
 
+			MeasurementSummary stats;
+			if(m_session.GetMeasurementSummary(s, stats, 32))
+			{
+				if(ImGui::IsItemHovered())
+					StatisticsTooltip(stats, unit);
+
+				ImGui::TableSetColumnIndex(2);
+				ImGui::TextUnformatted(unit.PrettyPrint(stats.m_mean).c_str());
+				ImGui::TableSetColumnIndex(3);
+				ImGui::TextUnformatted(unit.PrettyPrint(stats.m_stdev).c_str());
+				ImGui::TableSetColumnIndex(4);
+				ImGui::TextUnformatted(unit.PrettyPrint(stats.m_min).c_str());
+				ImGui::TableSetColumnIndex(5);
+				ImGui::TextUnformatted(unit.PrettyPrint(stats.m_max).c_str());
+				ImGui::TableSetColumnIndex(6);
+				ImGui::Text("%zu", stats.m_count);
+			}
+
 			ImGui::PopID();
 		}
 
@@ -190,8 +233,40 @@ bool MeasurementsDialog::DoRender()
 	return true;
 }
 
+/**
+	@brief Shows percentiles and a histogram of a measurement across acquisitions
+ */
+void MeasurementsDialog::StatisticsTooltip(const MeasurementSummary& stats, Unit unit)
+{
+	ImGui::BeginTooltip();
+
+	ImGui::Text("5th percentile:  %s", unit.PrettyPrint(stats.m_p5).c_str());
+	ImGui::Text("Median:          %s", unit.PrettyPrint(stats.m_median).c_str());
+	ImGui::Text("95th percentile: %s", unit.PrettyPrint(stats.m_p95).c_str());
+
+	if(!stats.m_histogram.empty())
+	{
+		float width = ImGui::GetFontSize();
+		ImGui::PlotHistogram(
+			"##histogram",
+			&stats.m_histogram[0],
+			stats.m_histogram.size(),
+			0,
+			nullptr,
+			0,
+			FLT_MAX,
+			ImVec2(20*width, 5*width));
+		ImGui::Text("%s", unit.PrettyPrint(stats.m_min).c_str());
+		ImGui::SameLine(20*width - ImGui::CalcTextSize(unit.PrettyPrint(stats.m_max).c_str()).x);
+		ImGui::Text("%s", unit.PrettyPrint(stats.m_max).c_str());
+	}
+
+	ImGui::EndTooltip();
+}
+
 void MeasurementsDialog::RemoveStream(size_t i)
 {
+	m_session.UntrackMeasurementStatistics(m_streams[i]);
 	auto ochan = dynamic_cast<OscilloscopeChannel*>(m_streams[i].m_channel);
 	m_streamset.erase(ochan);
 	if(ochan)
@@ -210,6 +285,7 @@ void MeasurementsDialog::AddStream(StreamDescriptor stream)
 
 	m_streams.push_back(stream);
 	m_streamset.emplace(stream);
+	m_session.TrackMeasurementStatistics(stream);
 
 	auto ochan = dynamic_cast<OscilloscopeChannel*>(stream.m_channel);
 	if(ochan)
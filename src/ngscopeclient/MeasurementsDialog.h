@@ -58,6 +58,7 @@ protected:
 	Session& m_session;
 
 	void RemoveStream(size_t i);
+	void StatisticsTooltip(const MeasurementSummary& stats, Unit unit);
 
 	/**
 		@brief Ordered list of streams being displayed, in the order they should be drawn in the table
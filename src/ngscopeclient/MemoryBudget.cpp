@@ -0,0 +1,215 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of MemoryBudget
+ */
+#include "ngscopeclient.h"
+#include "MemoryBudget.h"
+#include "MainWindow.h"
+
+using namespace std;
+
+//How often to recompute usage, in seconds
+#define MEMORY_BUDGET_UPDATE_INTERVAL 0.25
+
+//Minimum time between proactive reclaims, in seconds, so we don't thrash if nothing more can be freed
+#define MEMORY_BUDGET_RECLAIM_INTERVAL 2
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+MemoryBudget::MemoryBudget(MainWindow& wnd)
+	: m_parent(wnd)
+	, m_lastUpdate(0)
+	, m_lastReclaim(0)
+	, m_reclaimCount(0)
+	, m_pinnedUsage(0)
+	, m_pinnedBudget(0)
+	, m_localUsage(0)
+	, m_localBudget(0)
+{
+	for(size_t i=0; i<CATEGORY_COUNT; i++)
+		m_usage[i] = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Gets the display name of a category
+ */
+const char* MemoryBudget::GetCategoryName(Category category)
+{
+	switch(category)
+	{
+		case CATEGORY_INSTRUMENTS:
+			return "Instrument waveforms";
+
+		case CATEGORY_HISTORY:
+			return "History";
+
+		case CATEGORY_FILTERS:
+			return "Filter outputs";
+
+		case CATEGORY_POOL:
+			return "Waveform pool";
+
+		case CATEGORY_RASTER:
+			return "Raster buffers";
+
+		case CATEGORY_TEXTURES:
+			return "Textures";
+
+		default:
+			return "Unknown";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Tracking
+
+/**
+	@brief Refreshes usage numbers and checks the high-water mark, if it's been long enough since the last time
+
+	Call once per frame.
+ */
+void MemoryBudget::Update()
+{
+	double now = GetTime();
+	if( (now - m_lastUpdate) < MEMORY_BUDGET_UPDATE_INTERVAL)
+		return;
+	m_lastUpdate = now;
+
+	UpdateCategories();
+	UpdateHeaps();
+	CheckHighWaterMark();
+}
+
+/**
+	@brief Recomputes the usage of each category
+ */
+void MemoryBudget::UpdateCategories()
+{
+	auto& session = m_parent.GetSession();
+
+	//Sample data (keep the old numbers if the filter graph is busy with it)
+	size_t instruments;
+	size_t history;
+	size_t filters;
+	if(session.GetSampleMemoryUsage(instruments, history, filters))
+	{
+		m_usage[CATEGORY_INSTRUMENTS] = instruments;
+		m_usage[CATEGORY_HISTORY] = history;
+		m_usage[CATEGORY_FILTERS] = filters;
+	}
+	m_usage[CATEGORY_POOL] = session.GetWaveformPool().GetMemoryUsage();
+
+	//Rendering buffers
+	size_t raster = 0;
+	size_t textures = 0;
+	{
+		lock_guard lock(session.GetRasterizedWaveformMutex());
+		for(auto group : m_parent.GetWaveformGroups())
+		{
+			for(auto area : group->GetWaveformAreas())
+			{
+				for(size_t i=0; i<area->GetStreamCount(); i++)
+				{
+					auto chan = area->GetDisplayedChannel(i);
+					raster += chan->GetRasterMemoryUsage();
+					textures += chan->GetTextureMemoryUsage();
+				}
+			}
+		}
+	}
+	m_usage[CATEGORY_RASTER] = raster;
+	m_usage[CATEGORY_TEXTURES] = textures;
+}
+
+/**
+	@brief Reads the current usage and budget of each heap from the driver
+ */
+void MemoryBudget::UpdateHeaps()
+{
+	if(!g_hasMemoryBudget)
+		return;
+
+	auto properties = g_vkComputePhysicalDevice->getMemoryProperties2<
+		vk::PhysicalDeviceMemoryProperties2,
+		vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+	auto membudget = std::get<1>(properties);
+
+	m_pinnedUsage = membudget.heapUsage[g_vkPinnedMemoryHeap];
+	m_pinnedBudget = membudget.heapBudget[g_vkPinnedMemoryHeap];
+	if(!g_vulkanDeviceHasUnifiedMemory)
+	{
+		m_localUsage = membudget.heapUsage[g_vkLocalMemoryHeap];
+		m_localBudget = membudget.heapBudget[g_vkLocalMemoryHeap];
+	}
+}
+
+/**
+	@brief Frees memory if any heap is over the high-water mark
+ */
+void MemoryBudget::CheckHighWaterMark()
+{
+	if(!g_hasMemoryBudget)
+		return;
+
+	double now = GetTime();
+	if( (now - m_lastReclaim) < MEMORY_BUDGET_RECLAIM_INTERVAL)
+		return;
+
+	//100% means only free memory once an allocation actually fails
+	double mark = m_parent.GetSession().GetPreferences().GetReal("Performance.Memory.high_water_mark");
+	if(mark >= 1)
+		return;
+
+	//Free enough to get back under the mark
+	size_t pinnedLimit = m_pinnedBudget * mark;
+	if(m_pinnedUsage > pinnedLimit)
+	{
+		LogDebug("Pinned memory usage is over the high-water mark, reclaiming\n");
+		m_parent.OnMemoryPressure(MemoryPressureLevel::Soft, MemoryPressureType::Host, m_pinnedUsage - pinnedLimit);
+		m_lastReclaim = now;
+		m_reclaimCount ++;
+	}
+
+	size_t localLimit = m_localBudget * mark;
+	if(!g_vulkanDeviceHasUnifiedMemory && (m_localUsage > localLimit) )
+	{
+		LogDebug("Local memory usage is over the high-water mark, reclaiming\n");
+		m_parent.OnMemoryPressure(MemoryPressureLevel::Soft, MemoryPressureType::Device, m_localUsage - localLimit);
+		m_lastReclaim = now;
+		m_reclaimCount ++;
+	}
+}
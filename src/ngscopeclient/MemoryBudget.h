@@ -0,0 +1,145 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of MemoryBudget
+ */
+#ifndef MemoryBudget_h
+#define MemoryBudget_h
+
+class MainWindow;
+
+/**
+	@brief Keeps track of what's using memory, and how close we are to the Vulkan heap budgets
+
+	Usage is broken down by category from our own bookkeeping, and the heap totals come from VK_EXT_memory_budget
+	(if the driver supports it). When a heap goes over the configured high-water mark, the memory pressure handler
+	is called to free some memory before an allocation actually fails.
+
+	Must only be used from the GUI thread.
+ */
+class MemoryBudget
+{
+public:
+	MemoryBudget(MainWindow& wnd);
+
+	/**
+		@brief Things memory is used for
+	 */
+	enum Category
+	{
+		///@brief Waveforms currently attached to instrument channels, which aren't in history
+		CATEGORY_INSTRUMENTS,
+
+		///@brief Waveforms in history (other than the ones counted as instrument waveforms)
+		CATEGORY_HISTORY,
+
+		///@brief Current filter outputs, and outputs saved to history points
+		CATEGORY_FILTERS,
+
+		///@brief Idle waveforms in the session's waveform pool
+		CATEGORY_POOL,
+
+		///@brief Rasterization buffers of displayed channels
+		CATEGORY_RASTER,
+
+		///@brief Tone mapped textures of displayed channels
+		CATEGORY_TEXTURES,
+
+		CATEGORY_COUNT
+	};
+
+	static const char* GetCategoryName(Category category);
+
+	void Update();
+
+	///@brief Gets the last measured memory usage of a category, in bytes
+	size_t GetUsage(Category category)
+	{ return m_usage[category]; }
+
+	///@brief Checks if heap usage and budgets are available
+	bool HasHeapInfo()
+	{ return g_hasMemoryBudget; }
+
+	///@brief Gets the last measured usage of the pinned (or unified) memory heap
+	size_t GetPinnedUsage()
+	{ return m_pinnedUsage; }
+
+	///@brief Gets the last measured budget of the pinned (or unified) memory heap
+	size_t GetPinnedBudget()
+	{ return m_pinnedBudget; }
+
+	///@brief Gets the last measured usage of the device local memory heap
+	size_t GetLocalUsage()
+	{ return m_localUsage; }
+
+	///@brief Gets the last measured budget of the device local memory heap
+	size_t GetLocalBudget()
+	{ return m_localBudget; }
+
+	///@brief Gets the number of times memory was reclaimed because a heap went over the high-water mark
+	uint64_t GetReclaimCount()
+	{ return m_reclaimCount; }
+
+protected:
+	void UpdateCategories();
+	void UpdateHeaps();
+	void CheckHighWaterMark();
+
+	///@brief The window we belong to
+	MainWindow& m_parent;
+
+	///@brief Time of the last update
+	double m_lastUpdate;
+
+	///@brief Time of the last proactive reclaim
+	double m_lastReclaim;
+
+	///@brief Number of proactive reclaims
+	uint64_t m_reclaimCount;
+
+	///@brief Memory usage of each category
+	size_t m_usage[CATEGORY_COUNT];
+
+	///@brief Usage of the pinned memory heap
+	size_t m_pinnedUsage;
+
+	///@brief Budget of the pinned memory heap
+	size_t m_pinnedBudget;
+
+	///@brief Usage of the device local memory heap
+	size_t m_localUsage;
+
+	///@brief Budget of the device local memory heap
+	size_t m_localBudget;
+};
+
+#endif
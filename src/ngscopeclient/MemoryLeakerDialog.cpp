@@ -53,6 +53,18 @@ MemoryLeakerDialog::MemoryLeakerDialog(MainWindow* parent)
 	, m_deviceMemoryUsage(0)
 	, m_hostMemoryString("0 kB")
 	, m_hostMemoryUsage(0)
+	, m_rampType(0)
+	, m_rampStepString("64 MB")
+	, m_rampStep(64 * 1024 * 1024)
+	, m_rampMaxString("4 GB")
+	, m_rampMax(4LL * 1024 * 1024 * 1024)
+	, m_rampIntervalString("500 ms")
+	, m_rampInterval(0.5 * FS_PER_SECOND)
+	, m_rampRunning(false)
+	, m_tlastStep(0)
+	, m_rampStartEvents(0)
+	, m_rampStartFreed(0)
+	, m_rampStartHistory(0)
 {
 	m_deviceMemoryBuffer.SetGpuAccessHint(AcceleratorBuffer<uint8_t>::HINT_LIKELY);
 	m_deviceMemoryBuffer.SetCpuAccessHint(AcceleratorBuffer<uint8_t>::HINT_NEVER);
@@ -94,5 +106,86 @@ bool MemoryLeakerDialog::DoRender()
 		m_hostMemoryBuffer.resize(m_hostMemoryUsage);
 	}
 
+	RenderRamp();
+
 	return true;
 }
+
+/**
+	@brief Runs the automatic ramp, which keeps allocating until memory runs out or the limit is reached
+
+	Meant to be left running alongside a free-running acquisition, to check that history and pools get
+	reclaimed instead of the application crashing.
+ */
+void MemoryLeakerDialog::RenderRamp()
+{
+	if(!ImGui::CollapsingHeader("Ramp"))
+		return;
+
+	ImGui::BeginDisabled(m_rampRunning);
+		Combo("Type", {"Host", "Device"}, m_rampType);
+		UnitInputWithImplicitApply("Step", m_rampStepString, m_rampStep, Unit(Unit::UNIT_BYTES));
+		UnitInputWithImplicitApply("Limit", m_rampMaxString, m_rampMax, Unit(Unit::UNIT_BYTES));
+		UnitInputWithImplicitApply("Interval", m_rampIntervalString, m_rampInterval, Unit(Unit::UNIT_FS));
+	ImGui::EndDisabled();
+
+	if(m_rampRunning)
+	{
+		if(ImGui::Button("Stop"))
+			m_rampRunning = false;
+	}
+	else if(ImGui::Button("Start"))
+		StartRamp();
+	ImGui::SameLine();
+	ImGui::BeginDisabled(m_rampRunning || !m_ramp);
+		if(ImGui::Button("Free"))
+			m_ramp = nullptr;
+	ImGui::EndDisabled();
+
+	if(!m_ramp)
+		return;
+
+	//Take the next step if it's time
+	double now = GetTime();
+	if(m_rampRunning && ( (now - m_tlastStep) * FS_PER_SECOND >= m_rampInterval) )
+	{
+		m_tlastStep = now;
+		m_ramp->Step();
+		if(m_ramp->IsDone())
+			m_rampRunning = false;
+	}
+
+	//Show what the rest of the application gave up
+	auto& session = m_parent->GetSession();
+	auto& pressure = session.GetMemoryPressureRegistry();
+	auto& history = session.GetHistory();
+
+	Unit bytes(Unit::UNIT_BYTES);
+	ImGui::Text("Allocated: %s%s", bytes.PrettyPrint(m_ramp->GetAllocated()).c_str(),
+		m_ramp->HasFailed() ? " (allocation failed)" : "");
+	ImGui::Text("Pressure events: %" PRIu64, pressure.GetEventCount() - m_rampStartEvents);
+	ImGui::Text("Reclaimed: %s", bytes.PrettyPrint(pressure.GetBytesFreed() - m_rampStartFreed).c_str());
+	ImGui::Text("History: %zu points (%zu at start), %s",
+		history.GetPointCount(),
+		m_rampStartHistory,
+		bytes.PrettyPrint(history.GetMemoryUsage()).c_str());
+}
+
+/**
+	@brief Throws away any previous ramp and starts a new one
+ */
+void MemoryLeakerDialog::StartRamp()
+{
+	m_ramp = nullptr;
+	m_ramp = make_unique<MemoryStressRamp>(
+		(m_rampType == 0) ? MemoryPressureType::Host : MemoryPressureType::Device,
+		max<int64_t>(1, m_rampStep),
+		max<int64_t>(0, m_rampMax));
+	m_rampRunning = true;
+	m_tlastStep = 0;
+
+	auto& session = m_parent->GetSession();
+	m_rampStartEvents = session.GetMemoryPressureRegistry().GetEventCount();
+	m_rampStartFreed = session.GetMemoryPressureRegistry().GetBytesFreed();
+	m_rampStartHistory = session.GetHistory().GetPointCount();
+}
@@ -36,6 +36,7 @@
 #define MemoryLeakerDialog_h
 
 #include "Dialog.h"
+#include "MemoryStressRamp.h"
 #include <future>
 
 class MainWindow;
@@ -52,6 +53,9 @@ public:
 	virtual bool DoRender();
 
 protected:
+	void RenderRamp();
+	void StartRamp();
+
 	MainWindow* m_parent;
 
 	std::string m_deviceMemoryString;
@@ -62,6 +66,36 @@ protected:
 
 	AcceleratorBuffer<uint8_t> m_deviceMemoryBuffer;
 	AcceleratorBuffer<uint8_t> m_hostMemoryBuffer;
+
+	///@brief Index of the type of memory to ramp (0 = host, 1 = device)
+	int m_rampType;
+
+	std::string m_rampStepString;
+	int64_t m_rampStep;
+
+	std::string m_rampMaxString;
+	int64_t m_rampMax;
+
+	std::string m_rampIntervalString;
+	double m_rampInterval;
+
+	///@brief The running ramp, if any
+	std::unique_ptr<MemoryStressRamp> m_ramp;
+
+	///@brief True while the ramp is still allocating
+	bool m_rampRunning;
+
+	///@brief Time of the last ramp step
+	double m_tlastStep;
+
+	///@brief Memory pressure event count when the ramp was started
+	uint64_t m_rampStartEvents;
+
+	///@brief Bytes reclaimed by pressure handlers when the ramp was started
+	uint64_t m_rampStartFreed;
+
+	///@brief History size when the ramp was started
+	size_t m_rampStartHistory;
 };
 
 #endif
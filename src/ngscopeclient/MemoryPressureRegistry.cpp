@@ -0,0 +1,145 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of MemoryPressureRegistry
+ */
+#include "ngscopeclient.h"
+#include "MemoryPressureRegistry.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Registration
+
+/**
+	@brief Adds a reclaimer to the registry
+
+	@param name				Display name, for logging
+	@param priority			When to call this reclaimer relative to the others
+	@param needsDataLock	True if the reclaimer may only run while the caller holds the waveform data mutex
+	@param reclaimable		Function reporting how much memory could be freed
+	@param reclaim			Function freeing memory
+ */
+void MemoryPressureRegistry::Register(
+	const string& name,
+	MemoryReclaimPriority priority,
+	bool needsDataLock,
+	ReclaimableFunction reclaimable,
+	ReclaimFunction reclaim)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_reclaimers.push_back({name, priority, needsDataLock, reclaimable, reclaim});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reclaiming
+
+/**
+	@brief Frees memory, in priority order, until the requested amount has been freed
+
+	A hard pressure event means an allocation already failed. Since freed memory isn't necessarily contiguous or in
+	the same heap the allocation needs, we aim to free twice the requested size in that case.
+
+	If the requested size is unknown (zero), everything which can be freed is.
+
+	@param level		How urgent the request is
+	@param type			Type of memory to free
+	@param requestedSize	Size of the allocation we're trying to make room for
+	@param dataLocked	True if the caller holds the waveform data mutex
+
+	@return True if anything was freed
+ */
+bool MemoryPressureRegistry::OnMemoryPressure(
+	MemoryPressureLevel level,
+	MemoryPressureType type,
+	size_t requestedSize,
+	bool dataLocked)
+{
+	//Work on a copy, so a reclaimer which allocates (and signals pressure again) can't deadlock us
+	vector<Reclaimer> order;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		order = m_reclaimers;
+	}
+
+	//Sort by priority, keeping registration order within a priority
+	stable_sort(order.begin(), order.end(),
+		[](const Reclaimer& a, const Reclaimer& b) { return a.m_priority < b.m_priority; });
+
+	size_t target = requestedSize;
+	if(level == MemoryPressureLevel::Hard)
+		target *= 2;
+	if(target == 0)
+		target = SIZE_MAX;
+
+	Unit bytes(Unit::UNIT_BYTES);
+	LogDebug("Trying to reclaim %s of %s memory\n",
+		(target == SIZE_MAX) ? "all" : bytes.PrettyPrint(target, 4).c_str(),
+		(type == MemoryPressureType::Host) ? "host" : "device");
+	LogIndenter li;
+
+	size_t total = 0;
+	bool anyFreed = false;
+	for(auto& r : order)
+	{
+		if(total >= target)
+			break;
+
+		if(r.m_needsDataLock && !dataLocked)
+		{
+			LogDebug("%s: skipped, couldn't lock waveform data\n", r.m_name.c_str());
+			continue;
+		}
+
+		//Skip anything with nothing to give, unless it can't tell us how much it has
+		size_t available = r.m_reclaimable(type);
+		if( (available == 0) && (r.m_priority != RECLAIM_LAST_RESORT) )
+			continue;
+
+		size_t freed = 0;
+		if(r.m_reclaim(type, target - total, freed))
+		{
+			anyFreed = true;
+			total += freed;
+			LogDebug("%s: freed %s (of %s reclaimable)\n",
+				r.m_name.c_str(),
+				bytes.PrettyPrint(freed, 4).c_str(),
+				bytes.PrettyPrint(available, 4).c_str());
+		}
+	}
+
+	m_eventCount ++;
+	m_bytesFreed += total;
+
+	LogDebug("Reclaimed %s total\n", bytes.PrettyPrint(total, 4).c_str());
+	return anyFreed;
+}
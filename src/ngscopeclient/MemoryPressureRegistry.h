@@ -0,0 +1,144 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of MemoryPressureRegistry
+ */
+#ifndef MemoryPressureRegistry_h
+#define MemoryPressureRegistry_h
+
+#include <atomic>
+#include <functional>
+
+/**
+	@brief Order in which memory is reclaimed, cheapest to give up first
+ */
+enum MemoryReclaimPriority
+{
+	///@brief Idle buffers which are only kept around to avoid reallocating them
+	RECLAIM_IDLE,
+
+	///@brief Data which can be recomputed if it's needed again
+	RECLAIM_DERIVED,
+
+	///@brief Acquired data, which is moved to slower memory rather than lost
+	RECLAIM_WAVEFORMS,
+
+	///@brief Caches we can't size, only freed if nothing else was enough
+	RECLAIM_LAST_RESORT
+};
+
+/**
+	@brief Keeps track of everything which can give up memory when an allocation fails or memory runs low
+
+	Each subsystem registers a reclaimer, which reports how much memory it could give up and frees some on request.
+	When memory pressure is signaled, reclaimers are asked to free memory in priority order until the requested
+	amount has been freed, so a small allocation failure doesn't throw away every cache at once.
+ */
+class MemoryPressureRegistry
+{
+public:
+
+	/**
+		@brief Reports how many bytes of the given type of memory a reclaimer could free
+	 */
+	typedef std::function<size_t(MemoryPressureType type)> ReclaimableFunction;
+
+	/**
+		@brief Frees at least the requested number of bytes of memory if possible
+
+		@param type		Type of memory to free
+		@param bytes	Number of bytes to free
+		@param freed	Set to the (approximate) number of bytes actually freed, or zero if unknown
+
+		@return True if anything was freed
+	 */
+	typedef std::function<bool(MemoryPressureType type, size_t bytes, size_t& freed)> ReclaimFunction;
+
+	void Register(
+		const std::string& name,
+		MemoryReclaimPriority priority,
+		bool needsDataLock,
+		ReclaimableFunction reclaimable,
+		ReclaimFunction reclaim);
+
+	bool OnMemoryPressure(MemoryPressureLevel level, MemoryPressureType type, size_t requestedSize, bool dataLocked);
+
+	/**
+		@brief Gets the number of memory pressure events handled since startup
+	 */
+	uint64_t GetEventCount()
+	{ return m_eventCount; }
+
+	/**
+		@brief Gets the (approximate) total number of bytes reclaimed since startup
+	 */
+	uint64_t GetBytesFreed()
+	{ return m_bytesFreed; }
+
+protected:
+
+	/**
+		@brief A single registered reclaimer
+	 */
+	class Reclaimer
+	{
+	public:
+		///@brief Display name, for logging
+		std::string m_name;
+
+		///@brief When to call this reclaimer relative to the others
+		MemoryReclaimPriority m_priority;
+
+		///@brief True if the reclaimer touches waveform data, and may only run with the waveform data mutex held
+		bool m_needsDataLock;
+
+		///@brief Reports how much could be freed
+		ReclaimableFunction m_reclaimable;
+
+		///@brief Frees memory
+		ReclaimFunction m_reclaim;
+	};
+
+	///@brief Mutex protecting m_reclaimers (memory pressure can be signaled from any thread)
+	std::mutex m_mutex;
+
+	///@brief All registered reclaimers, in registration order
+	std::vector<Reclaimer> m_reclaimers;
+
+	///@brief Number of memory pressure events handled
+	std::atomic<uint64_t> m_eventCount {0};
+
+	///@brief Total bytes reported freed by reclaimers
+	std::atomic<uint64_t> m_bytesFreed {0};
+};
+
+#endif
@@ -0,0 +1,123 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of MemoryStressRamp
+ */
+#include "ngscopeclient.h"
+#include "MemoryStressRamp.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a ramp with nothing allocated yet
+
+	@param type		Type of memory to allocate
+	@param stepSize	Number of bytes to allocate per step
+	@param maxSize	Maximum total number of bytes to allocate
+ */
+MemoryStressRamp::MemoryStressRamp(MemoryPressureType type, size_t stepSize, size_t maxSize)
+	: m_type(type)
+	, m_stepSize(max<size_t>(1, stepSize))
+	, m_maxSize(maxSize)
+	, m_allocated(0)
+	, m_failed(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation
+
+/**
+	@brief Allocates one more step
+
+	The buffer is allocated through AcceleratorBuffer, so running short of memory triggers the normal memory pressure
+	handlers (history demotion, pool trimming, etc.) before the allocation is allowed to fail.
+
+	@return True if the step was allocated
+ */
+bool MemoryStressRamp::Step()
+{
+	if(IsDone())
+		return false;
+
+	auto buf = make_unique< AcceleratorBuffer<uint8_t> >();
+	if(m_type == MemoryPressureType::Host)
+	{
+		buf->SetCpuAccessHint(AcceleratorBuffer<uint8_t>::HINT_LIKELY);
+		buf->SetGpuAccessHint(AcceleratorBuffer<uint8_t>::HINT_UNLIKELY);
+	}
+	else
+	{
+		buf->SetCpuAccessHint(AcceleratorBuffer<uint8_t>::HINT_NEVER);
+		buf->SetGpuAccessHint(AcceleratorBuffer<uint8_t>::HINT_LIKELY);
+	}
+
+	try
+	{
+		buf->resize(m_stepSize);
+	}
+	catch(const exception& e)
+	{
+		LogWarning("Memory stress step of %zu bytes failed: %s\n", m_stepSize, e.what());
+		m_failed = true;
+		return false;
+	}
+
+	if(buf->size() != m_stepSize)
+	{
+		LogWarning("Memory stress step of %zu bytes failed\n", m_stepSize);
+		m_failed = true;
+		return false;
+	}
+
+	//Touch host memory so the OS actually has to find pages for it
+	if(m_type == MemoryPressureType::Host)
+		memset(buf->GetCpuPointer(), 0x55, m_stepSize);
+
+	m_allocated += m_stepSize;
+	m_steps.push_back(move(buf));
+	return true;
+}
+
+/**
+	@brief Frees everything the ramp has allocated, and allows it to start over
+ */
+void MemoryStressRamp::Clear()
+{
+	m_steps.clear();
+	m_allocated = 0;
+	m_failed = false;
+}
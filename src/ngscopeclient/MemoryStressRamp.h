@@ -0,0 +1,98 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of MemoryStressRamp
+ */
+#ifndef MemoryStressRamp_h
+#define MemoryStressRamp_h
+
+/**
+	@brief Allocates host or device memory in fixed size steps, to push the application into memory pressure
+
+	Used by the memory leaker dialog and the pipeline benchmark. Each step is a separate buffer, so a failed step
+	doesn't throw away what was already allocated and the ramp stops at roughly the amount of memory we could get.
+ */
+class MemoryStressRamp
+{
+public:
+	MemoryStressRamp(MemoryPressureType type, size_t stepSize, size_t maxSize);
+
+	bool Step();
+	void Clear();
+
+	/**
+		@brief Gets the number of bytes currently allocated by the ramp
+	 */
+	size_t GetAllocated()
+	{ return m_allocated; }
+
+	/**
+		@brief Returns true if the ramp can't allocate any more, either because it hit the limit or a step failed
+	 */
+	bool IsDone()
+	{ return m_failed || (m_allocated + m_stepSize > m_maxSize); }
+
+	/**
+		@brief Returns true if the last step couldn't be allocated
+	 */
+	bool HasFailed()
+	{ return m_failed; }
+
+	/**
+		@brief Gets the type of memory being allocated
+	 */
+	MemoryPressureType GetType()
+	{ return m_type; }
+
+protected:
+
+	///@brief Type of memory to allocate
+	MemoryPressureType m_type;
+
+	///@brief Size of each step, in bytes
+	size_t m_stepSize;
+
+	///@brief Maximum total size, in bytes
+	size_t m_maxSize;
+
+	///@brief Total size of all steps allocated so far
+	size_t m_allocated;
+
+	///@brief True if a step failed to allocate
+	bool m_failed;
+
+	///@brief One buffer per step
+	std::vector< std::unique_ptr< AcceleratorBuffer<uint8_t> > > m_steps;
+};
+
+#endif
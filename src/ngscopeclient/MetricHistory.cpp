@@ -0,0 +1,203 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of MetricHistory
+ */
+#include "ngscopeclient.h"
+#include "MetricHistory.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MetricSeries
+
+MetricSeries::MetricSeries(size_t depth)
+	: m_times(depth, 0)
+	, m_values(depth, 0)
+	, m_head(0)
+	, m_count(0)
+	, m_statsDirty(false)
+{
+}
+
+/**
+	@brief Adds a sample, overwriting the oldest one if the buffer is full
+ */
+void MetricSeries::Add(double t, double value)
+{
+	m_times[m_head] = t;
+	m_values[m_head] = value;
+	m_head = (m_head + 1) % m_times.size();
+	if(m_count < m_times.size())
+		m_count ++;
+
+	m_stats.m_last = value;
+	m_statsDirty = true;
+}
+
+/**
+	@brief Discards all samples
+ */
+void MetricSeries::Clear()
+{
+	m_head = 0;
+	m_count = 0;
+	m_stats = MetricStats();
+	m_statsDirty = false;
+}
+
+/**
+	@brief Gets percentile statistics over every sample in the buffer
+
+	Statistics are only recomputed if samples were added since the last call.
+ */
+const MetricStats& MetricSeries::GetStats()
+{
+	if(!m_statsDirty)
+		return m_stats;
+	m_statsDirty = false;
+
+	//Nearest rank percentiles. This runs every frame while the dialog is open, so use partial sorts
+	//rather than sorting the whole buffer.
+	vector<double> values(m_values.begin(), m_values.begin() + m_count);
+	auto rank = [&](double p)
+	{
+		size_t i = min(values.size() - 1, static_cast<size_t>(ceil(p * values.size())) - 1);
+		nth_element(values.begin(), values.begin() + i, values.end());
+		return values[i];
+	};
+
+	m_stats.m_p50 = rank(0.50);
+	m_stats.m_p95 = rank(0.95);
+	m_stats.m_p99 = rank(0.99);
+	m_stats.m_max = *max_element(values.begin(), values.end());
+	return m_stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MetricHistory
+
+MetricHistory::MetricHistory()
+	: m_tstart(GetTime())
+{
+}
+
+/**
+	@brief Adds a sample of a session-wide metric, timestamped with the current time
+
+	@param name		Name of the metric
+	@param value	Duration, in fs
+ */
+void MetricHistory::Record(const string& name, int64_t value)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_series[name].Add(GetTime() - m_tstart, value);
+}
+
+/**
+	@brief Adds a sample for every node of a filter graph run, all sharing the current time
+
+	@param values	Runtime of each node, in fs
+ */
+void MetricHistory::RecordNodes(const map<FlowGraphNode*, int64_t>& values)
+{
+	lock_guard<mutex> lock(m_mutex);
+	double t = GetTime() - m_tstart;
+	for(auto it : values)
+		m_nodeSeries[it.first].Add(t, it.second);
+}
+
+/**
+	@brief Discards all series and restarts the time axis
+ */
+void MetricHistory::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_series.clear();
+	m_nodeSeries.clear();
+	m_tstart = GetTime();
+}
+
+/**
+	@brief Writes every sample of every series to a CSV file
+
+	One row is written per sample, with columns for the metric name, the time in seconds since the history was
+	started, and the value in seconds.
+
+	@param path			Path of the file to write
+	@param nodeNames	Display name to use for each filter graph node. Nodes not listed are skipped.
+
+	@return True on success, false if the file couldn't be written
+ */
+bool MetricHistory::ExportCSV(const string& path, const map<FlowGraphNode*, string>& nodeNames)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Failed to open metrics export file \"%s\"\n", path.c_str());
+		return false;
+	}
+
+	lock_guard<mutex> lock(m_mutex);
+	fprintf(fp, "metric,time,value\n");
+	for(auto& it : m_series)
+	{
+		auto& s = it.second;
+		for(size_t i=0; i<s.GetCount(); i++)
+			fprintf(fp, "%s,%.6f,%.9e\n", it.first.c_str(), s.GetTime(i), s.GetValue(i) / FS_PER_SECOND);
+	}
+	for(auto& it : m_nodeSeries)
+	{
+		auto nit = nodeNames.find(it.first);
+		if(nit == nodeNames.end())
+			continue;
+
+		//Quote node names since they're user controlled
+		string name = "\"";
+		for(auto c : nit->second)
+		{
+			if(c == '\"')
+				name += "\"\"";
+			else
+				name += c;
+		}
+		name += "\"";
+
+		auto& s = it.second;
+		for(size_t i=0; i<s.GetCount(); i++)
+			fprintf(fp, "%s,%.6f,%.9e\n", name.c_str(), s.GetTime(i), s.GetValue(i) / FS_PER_SECOND);
+	}
+
+	bool ok = (ferror(fp) == 0);
+	fclose(fp);
+	return ok;
+}
@@ -0,0 +1,168 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of MetricHistory
+ */
+#ifndef MetricHistory_h
+#define MetricHistory_h
+
+///@brief Number of samples kept for each performance metric
+#define METRIC_HISTORY_DEPTH 16384
+
+/**
+	@brief Summary statistics of a MetricSeries
+ */
+class MetricStats
+{
+public:
+	MetricStats()
+	: m_last(0)
+	, m_p50(0)
+	, m_p95(0)
+	, m_p99(0)
+	, m_max(0)
+	{}
+
+	double m_last;
+	double m_p50;
+	double m_p95;
+	double m_p99;
+	double m_max;
+};
+
+/**
+	@brief Fixed size ring buffer of (time, value) samples of one performance metric
+
+	Once full, each new sample overwrites the oldest one. Timestamps and values are kept in separate arrays so they
+	can be handed straight to ImPlot, using GetOffset() as the index of the oldest sample.
+ */
+class MetricSeries
+{
+public:
+	MetricSeries(size_t depth = METRIC_HISTORY_DEPTH);
+
+	void Add(double t, double value);
+	void Clear();
+
+	///@brief Number of valid samples
+	size_t GetCount() const
+	{ return m_count; }
+
+	///@brief Index of the oldest sample in the arrays
+	size_t GetOffset() const
+	{ return (m_count < m_times.size()) ? 0 : m_head; }
+
+	///@brief Returns the i'th sample's timestamp, counting from the oldest
+	double GetTime(size_t i) const
+	{ return m_times[(GetOffset() + i) % m_times.size()]; }
+
+	///@brief Returns the i'th sample's value, counting from the oldest
+	double GetValue(size_t i) const
+	{ return m_values[(GetOffset() + i) % m_values.size()]; }
+
+	///@brief Raw timestamp array (see GetOffset())
+	const double* GetTimes() const
+	{ return m_times.data(); }
+
+	///@brief Raw value array (see GetOffset())
+	const double* GetValues() const
+	{ return m_values.data(); }
+
+	const MetricStats& GetStats();
+
+protected:
+	///@brief Sample timestamps, in seconds since the start of the history
+	std::vector<double> m_times;
+
+	///@brief Sample values
+	std::vector<double> m_values;
+
+	///@brief Index the next sample will be written to
+	size_t m_head;
+
+	///@brief Number of valid samples
+	size_t m_count;
+
+	///@brief Cached statistics
+	MetricStats m_stats;
+
+	///@brief True if m_stats is out of date
+	bool m_statsDirty;
+};
+
+/**
+	@brief Time series of performance metrics for the whole session
+
+	Metrics are all durations, in fs. Named series cover session-wide metrics (frame time, download time, etc).
+	Filter graph nodes each have their own series keyed by node, which is only used as a lookup key and never
+	dereferenced, so series of deleted nodes linger harmlessly until the history is cleared.
+
+	Samples are recorded from both the GUI and waveform threads. Hold the lock from GetMutex() while reading.
+ */
+class MetricHistory
+{
+public:
+	MetricHistory();
+
+	void Record(const std::string& name, int64_t value);
+	void RecordNodes(const std::map<FlowGraphNode*, int64_t>& values);
+	void Clear();
+
+	///@brief Mutex which must be held while accessing series
+	std::mutex& GetMutex()
+	{ return m_mutex; }
+
+	///@brief Gets the session-wide series, sorted by name
+	std::map<std::string, MetricSeries>& GetSeries()
+	{ return m_series; }
+
+	///@brief Gets the per filter graph node series
+	std::map<FlowGraphNode*, MetricSeries>& GetNodeSeries()
+	{ return m_nodeSeries; }
+
+	bool ExportCSV(const std::string& path, const std::map<FlowGraphNode*, std::string>& nodeNames);
+
+protected:
+	///@brief Mutex controlling access to all of the series
+	std::mutex m_mutex;
+
+	///@brief Time the history was started (or last cleared)
+	double m_tstart;
+
+	///@brief Session-wide series
+	std::map<std::string, MetricSeries> m_series;
+
+	///@brief Per filter graph node series
+	std::map<FlowGraphNode*, MetricSeries> m_nodeSeries;
+};
+
+#endif
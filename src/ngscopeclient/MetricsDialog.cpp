@@ -36,6 +36,9 @@
 #include "ngscopeclient.h"
 #include "MetricsDialog.h"
 #include "Session.h"
+#include "MainWindow.h"
+#include "BufferTransferTracker.h"
+#include "HostMemoryPolicy.h"
 
 using namespace std;
 
@@ -45,8 +48,10 @@ using namespace std;
 MetricsDialog::MetricsDialog(Session* session)
 	: Dialog("Performance Metrics", "Metrics", ImVec2(300, 400))
 	, m_session(session)
+	, m_plotSpan(60)
 {
 	m_displayRefreshRate = 0;
+	m_plottedSeries.emplace("Frame time");
 
 	auto mon = glfwGetPrimaryMonitor();
 	if(mon)
@@ -102,6 +107,18 @@ bool MetricsDialog::DoRender()
 		HelpMarker(
 			"Refresh rate for your monitor. Framerate should ideally be very close to this.");
 
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetMainWindow()->GetLastFrameLatency());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Frame latency", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time from the start of the last completed frame (when input is read) until the GPU finished drawing it.\n\n"
+			"Waiting for the display to scan the frame out comes on top of this.\n\n"
+			"Present mode in use: " + vk::to_string(m_session->GetMainWindow()->GetPresentMode()) +
+			" (see Preferences | Performance | Rendering)");
+
 		ImGui::BeginDisabled();
 			str = fs.PrettyPrint(m_session->GetLastWaveformRenderTime());
 			ImGui::SetNextItemWidth(width);
@@ -114,6 +131,57 @@ bool MetricsDialog::DoRender()
 			"necessarily execute every frame. It runs asynchronously and is not locked to the display framerate."
 			);
 
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(g_channelRasterizations.load());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Channels rasterized", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Total number of times a displayed channel has been rasterized since startup.");
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(g_skippedChannelRasterizations.load());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Channels skipped", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Total number of times rasterizing a displayed channel was skipped since startup,\n"
+			"because neither its waveform nor its view had changed since the last time it was drawn.");
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(g_sharedIndexSearches.load());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Index searches shared", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Total number of per-column sample index searches skipped since startup, because another area in the\n"
+			"same group had already searched the same waveform at the same zoom and pan position.");
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(g_sharedChannelRasterizations.load());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Rasterizations shared", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Total number of times a displayed channel was not rasterized since startup, because another view\n"
+			"of the same stream had already drawn an identical image (same size, zoom, pan, and Y scale) in the\n"
+			"same pass. The channel is tone mapped straight from the other view's image.");
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(g_interruptedRerenders.load());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Rerenders interrupted", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Total number of re-render passes (e.g. while panning or zooming) which were cut short since startup,\n"
+			"because the view changed again before they had finished. The rest of the pass is left to the next one,\n"
+			"which is drawn for the newest view.");
+
 		ImGui::BeginDisabled();
 			str = fs.PrettyPrint(m_session->GetToneMapTime());
 			ImGui::SetNextItemWidth(width);
@@ -146,6 +214,40 @@ bool MetricsDialog::DoRender()
 		HelpMarker(
 			"Total number of index buffer entries in the last frame\n\n"
 			"Waveform samples are drawn by a compute shader and not included in this total");
+
+		if(ImGui::TreeNode("Raster memory"))
+		{
+			RasterMemoryTable();
+			ImGui::TreePop();
+		}
+	}
+
+	if(ImGui::CollapsingHeader("GPU shaders"))
+	{
+		bool profiling = m_session->IsGpuProfilingEnabled();
+		if(ImGui::Checkbox("Profile GPU shaders", &profiling))
+			m_session->SetGpuProfilingEnabled(profiling);
+
+		HelpMarker(
+			"Record GPU timestamps around every rasterization and tone mapping dispatch.\n\n"
+			"Dispatches are serialized while profiling so each one can be measured on its own, which makes "
+			"rendering somewhat slower. Leave this off unless you're looking for a slow shader.\n\n"
+			"Filter graph GPU work is not included.");
+
+		if(profiling)
+		{
+			if(ImGui::TreeNodeEx("Rasterization", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				GpuTimingTable("rasterize", m_session->GetRasterizeGpuTimings());
+				ImGui::TreePop();
+			}
+
+			if(ImGui::TreeNodeEx("Tone mapping", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				GpuTimingTable("tonemap", m_session->GetToneMapGpuTimings());
+				ImGui::TreePop();
+			}
+		}
 	}
 
 	if(ImGui::CollapsingHeader("Filter graph"))
@@ -165,6 +267,32 @@ bool MetricsDialog::DoRender()
 		ImGui::EndDisabled();
 
 		HelpMarker("Update time for the last evaluation of the filter graph");
+
+		ImGui::BeginDisabled();
+			uint64_t hits = m_session->GetFilterOutputRecycleHits();
+			uint64_t misses = m_session->GetFilterOutputRecycleMisses();
+			str = to_string(hits) + " / " + to_string(misses);
+			if(hits + misses)
+				str += " (" + Unit(Unit::UNIT_PERCENT).PrettyPrint(hits * 1.0 / (hits + misses), 4) + ")";
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Output reuse", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number of filter outputs which were given a recycled buffer from the waveform pool when the filter\n"
+			"graph ran on a different history point, versus ones which had to allocate new memory.\n\n"
+			"Buffers come back to the pool when saved filter outputs are evicted from history.");
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(g_cancelledRefilters.load());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Refreshes cancelled", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Total number of filter graph refreshes (e.g. after changing a filter parameter or selecting a history\n"
+			"point) which were abandoned since startup, because another refresh was requested before they finished.\n"
+			"Filters which hadn't run yet are left to the newer refresh.");
 	}
 
 	if(ImGui::CollapsingHeader("Acquisition"))
@@ -182,6 +310,78 @@ bool MetricsDialog::DoRender()
 			"are likely the bottleneck."
 			);
 
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetLastWaveformDownloadTime());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Download time", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker("Time spent downloading the last set of waveforms from all triggered instruments");
+
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetLastWaveformUploadTime());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Upload time", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time spent copying the last set of downloaded waveforms to the GPU in one batch.\n\n"
+			"Only measured if \"Upload new waveforms in one batch\" is enabled "
+			"(Preferences | Performance | Waveform Processing).");
+
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetLastWaveformProcessTime());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Process time", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time spent running the filter graph, history retention rules and thumbnail generation on the last "
+			"acquisition.");
+
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetLastWaveformRasterizeWaitTime());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Rasterize wait", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time the waveform processing thread last spent waiting for the GPU to finish rasterizing.\n\n"
+			"In pipelined mode rasterization overlaps with downloading the next acquisition, so this is only the "
+			"part that didn't fit in the overlap.");
+
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetLastWaveformPipelineStallTime());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Pipeline stall", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time the waveform processing thread last spent waiting for the GUI to consume an acquisition.\n\n"
+			"If this is large, the GUI is the bottleneck and increasing the pipeline depth may help."
+			);
+
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetLastAcquisitionCommitTime());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Commit time", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time the GUI last spent adding newly displayed acquisitions to history and applying history limits.");
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(m_session->GetPendingAcquisitionCount()) + " / " +
+				counts.PrettyPrint(m_session->GetWaveformPipelineDepth());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Pipelined acquisitions", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number of acquisitions which have been processed but not yet consumed by the GUI, out of the "
+			"configured pipeline depth (Preferences | Performance | Waveform Processing)."
+			);
+
 		//Category for each scope
 		auto scopes = m_session->GetScopes();
 		for(auto s : scopes)
@@ -196,14 +396,112 @@ bool MetricsDialog::DoRender()
 
 				HelpMarker(
 					"Number of waveforms queued for processing.\n\n"
-					"This value should normally be 0 or 1, and is capped at 5.\n"
-					"If it is consistently at or near 5, waveform processing and/or rendering is unable to keep "
-					"up with the instrument."
+					"This value should normally be 0 or 1, and is capped at the queue limit configured in the "
+					"stream browser (5 waveforms by default).\n"
+					"If it is consistently at or near the limit, waveform processing and/or rendering is unable to "
+					"keep up with the instrument."
 					);
 
+				auto state = m_session->GetInstrumentConnectionState(s);
+				if(state)
+				{
+					ImGui::BeginDisabled();
+						str = hz.PrettyPrint(state->m_pollRate);
+						ImGui::SetNextItemWidth(width);
+						ImGui::InputText("Poll rate", &str);
+					ImGui::EndDisabled();
+
+					HelpMarker(
+						"Number of times per second the instrument is being polled for a trigger.\n\n"
+						"The poll interval adapts to the measured trigger rate, so this value is normally a few "
+						"times the trigger rate and drops to zero while the trigger is stopped."
+						);
+
+					ImGui::BeginDisabled();
+						str = hz.PrettyPrint(state->m_triggerRate);
+						ImGui::SetNextItemWidth(width);
+						ImGui::InputText("Trigger rate", &str);
+					ImGui::EndDisabled();
+
+					HelpMarker("Smoothed rate at which the instrument is triggering");
+				}
+
 				ImGui::TreePop();
 			}
 		}
+
+		//Instruments on the shared polling threads
+		//(rebuild the text box map each time so instruments that went away don't leave stale entries)
+		map<Instrument*, string> rateText;
+		auto snapshot = m_session->GetInstrumentSnapshot();
+		for(auto inst : snapshot->m_scpiInstruments)
+		{
+			auto state = m_session->GetInstrumentConnectionState(inst);
+			if(!state || !state->IsSharedPolling())
+				continue;
+
+			auto it = m_targetPollRateText.find(inst.get());
+			auto& text = rateText[inst.get()];
+			float target = state->m_targetPollRate;
+			text = (it != m_targetPollRateText.end()) ? it->second : hz.PrettyPrint(target);
+
+			if(ImGui::TreeNode(inst->m_nickname.c_str()))
+			{
+				ImGui::BeginDisabled();
+					str = hz.PrettyPrint(state->m_pollRate);
+					ImGui::SetNextItemWidth(width);
+					ImGui::InputText("Poll rate", &str);
+				ImGui::EndDisabled();
+
+				HelpMarker(
+					"Number of times per second the instrument is actually being polled by the shared polling "
+					"threads.\n\n"
+					"If this is well below the target rate, the instrument is slow to respond or every polling "
+					"thread is busy (Preferences | Drivers | General)."
+					);
+
+				ImGui::SetNextItemWidth(width);
+				if(UnitInputWithImplicitApply("Target poll rate", text, target, hz))
+					state->m_targetPollRate = max(target, 0.0f);
+
+				HelpMarker(
+					"Rate the shared polling threads try to poll this instrument at.\n\n"
+					"Zero polls as fast as the instrument allows.");
+
+				ImGui::TreePop();
+			}
+		}
+		m_targetPollRateText = rateText;
+	}
+
+	if(ImGui::CollapsingHeader("Latency"))
+	{
+		auto& tracker = m_session->GetLatencyTracker();
+		if(ImGui::Button("Reset"))
+			tracker.Clear();
+		HelpMarker(
+			"Time from the trigger of each displayed acquisition being seen to the first frame showing it being\n"
+			"presented, for each trigger group. Segments of a segmented capture which aren't displayed aren't counted.\n\n"
+			"The trigger is seen when the instrument is polled and already has the waveform ready, so time spent\n"
+			"by the instrument driver downloading it isn't included.");
+
+		bool any = false;
+		for(auto group : m_session->GetTriggerGroups())
+		{
+			AcquisitionLatencyStats stats;
+			if(!tracker.GetStats(group.get(), stats))
+				continue;
+			any = true;
+
+			auto label = group->GetDescription() + "##" + to_string(reinterpret_cast<uintptr_t>(group.get()));
+			if(ImGui::TreeNodeEx(label.c_str(), ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				LatencyTable(stats);
+				ImGui::TreePop();
+			}
+		}
+		if(!any)
+			ImGui::TextUnformatted("No acquisitions displayed yet");
 	}
 
 	//Only show this tab if available
@@ -289,11 +587,892 @@ bool MetricsDialog::DoRender()
 				ImGui::TreePop();
 			}
 
+			if(ImGui::TreeNodeEx("Usage by category", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				MemoryCategoryTable();
+				ImGui::TreePop();
+			}
 		}
 	}
 
+	//No driver support for heap budgets, but we can still show our own bookkeeping
+	else if(ImGui::CollapsingHeader("Memory"))
+		MemoryCategoryTable();
+
+	if(ImGui::CollapsingHeader("Buffer transfers"))
+	{
+		bool tracking = BufferTransferTracker::IsEnabled();
+		if(ImGui::Checkbox("Track transfers", &tracking))
+			BufferTransferTracker::SetEnabled(tracking);
+
+		HelpMarker(
+			"Count and time host/device copies and allocations made when the GUI prepares a buffer for CPU or GPU\n"
+			"access, by call site.\n\n"
+			"If tracing is enabled (Debug | Tracing), each copy is also recorded in the trace.\n\n"
+			"Only call sites in the GUI are instrumented. Filter graph execution is not included.");
+
+		ImGui::SameLine();
+		if(ImGui::Button("Clear##transfers"))
+			BufferTransferTracker::Clear();
+
+		BufferTransferTable();
+	}
+
+	if(ImGui::CollapsingHeader("Locks"))
+	{
+		if(!LockProfiler::IsCompiledIn())
+		{
+			ImGui::TextUnformatted("Lock profiling is not enabled in this build");
+			HelpMarker("Configure with -DNGSCOPECLIENT_PROFILE_LOCKS=ON to record contention on the Session mutexes.");
+		}
+		else
+		{
+			if(ImGui::Button("Clear##locks"))
+				LockProfiler::Clear();
+			HelpMarker(
+				"Wait and hold times for the mutexes the session uses to coordinate the GUI, waveform and instrument\n"
+				"threads. Hold times only count exclusive locks.\n\n"
+				"If tracing is enabled (Debug | Tracing), waits and long holds are also recorded in the trace.\n\n"
+				"Debug builds also count locks taken out of the documented order (the first of each pair is logged).");
+
+			LockTable();
+		}
+	}
+
+	if(ImGui::CollapsingHeader("CPU/GPU autotuning"))
+	{
+		auto& tuner = m_session->GetAutotuner();
+		ImGui::Text("Device: %s", tuner.GetDeviceName().c_str());
+		HelpMarker(
+			"Operations that have both a CPU and a GPU implementation are timed on both the first time they run at\n"
+			"a new size. The crossover is remembered for this GPU and driver so later runs pick the faster path.\n\n"
+			"Sizes are rounded to powers of two.");
+
+		ImGui::SameLine();
+		if(ImGui::Button("Reset##autotune"))
+			tuner.Reset();
+
+		AutotuneTable();
+	}
+
+	if(ImGui::CollapsingHeader("Waveform pool"))
+	{
+		auto& pool = m_session->GetWaveformPool();
+		Unit bytes(Unit::UNIT_BYTES);
+		Unit pct(Unit::UNIT_PERCENT);
+
+		uint64_t hits = pool.GetHitCount();
+		uint64_t misses = pool.GetMissCount();
+
+		ImGui::BeginDisabled();
+			str = to_string(pool.GetWaveformCount()) + " (" + bytes.PrettyPrint(pool.GetMemoryUsage(), 4) + ")";
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Pooled", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number and total size of waveforms waiting in the pool to be reused.\n\n"
+			"The size limit can be changed under Preferences | Performance | History.");
+
+		ImGui::BeginDisabled();
+			str = to_string(hits) + " / " + to_string(misses);
+			if(hits + misses)
+				str += " (" + pct.PrettyPrint(hits * 1.0 / (hits + misses), 4) + ")";
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Hits / misses", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number of requests for a waveform which were served from the pool, versus ones which found nothing\n"
+			"suitable and had to allocate new memory.");
+
+		ImGui::BeginDisabled();
+			str = to_string(pool.GetDropCount());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Dropped", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker("Number of waveforms which were freed rather than pooled, because the pool was full.");
+	}
+
+	if(ImGui::CollapsingHeader("History"))
+	{
+		auto& history = m_session->GetMetricHistory();
+		auto nodeNames = GetNodeNames();
+
+		if(ImGui::Button("Clear"))
+			history.Clear();
+		ImGui::SameLine();
+		if(ImGui::Button("Export CSV...") && !m_fileDialog)
+		{
+			m_fileDialog = MakeFileBrowser(
+				m_session->GetMainWindow(),
+				".",
+				"Export Metrics",
+				"CSV files (*.csv)",
+				"*.csv",
+				true);
+		}
+
+		HelpMarker(
+			"Recent samples of each metric, recorded every time it's updated.\n\n"
+			"Percentiles and max are over every sample still in the history (the last "
+			+ to_string(METRIC_HISTORY_DEPTH) + " of each metric).\n"
+			"Click a metric to add or remove it from the plot.");
+
+		HistoryTable(history, nodeNames);
+		HistoryPlot(history, nodeNames);
+	}
+
+	RunFileDialog();
+
 	return true;
 }
 
+/**
+	@brief Gets the display name of every filter graph node that still exists
+ */
+map<FlowGraphNode*, string> MetricsDialog::GetNodeNames()
+{
+	map<FlowGraphNode*, string> names;
+	auto filters = Filter::GetAllInstances();
+	for(auto f : filters)
+		names[static_cast<FlowGraphNode*>(f)] = f->GetDisplayName();
+	return names;
+}
+
+/**
+	@brief Shows summary statistics of every metric in the history
+ */
+void MetricsDialog::HistoryTable(MetricHistory& history, const map<FlowGraphNode*, string>& nodeNames)
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	if(!ImGui::BeginTable("history", 6, flags))
+		return;
+
+	float width = ImGui::GetFontSize();
+	ImGui::TableSetupColumn("Metric", ImGuiTableColumnFlags_WidthFixed, 10*width);
+	ImGui::TableSetupColumn("Last", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("p50", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("p95", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("p99", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("Max", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableHeadersRow();
+
+	Unit fs(Unit::UNIT_FS);
+	auto row = [&](const string& name, MetricSeries& series, bool plotted) -> bool
+	{
+		auto& stats = series.GetStats();
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::PushID(&series);
+		bool clicked = ImGui::Selectable(name.c_str(), plotted, ImGuiSelectableFlags_SpanAllColumns);
+		ImGui::PopID();
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_last).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_p50).c_str());
+		ImGui::TableSetColumnIndex(3);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_p95).c_str());
+		ImGui::TableSetColumnIndex(4);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_p99).c_str());
+		ImGui::TableSetColumnIndex(5);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_max).c_str());
+		return clicked;
+	};
+
+	lock_guard<mutex> lock(history.GetMutex());
+	for(auto& it : history.GetSeries())
+	{
+		bool plotted = (m_plottedSeries.find(it.first) != m_plottedSeries.end());
+		if(row(it.first, it.second, plotted))
+		{
+			if(plotted)
+				m_plottedSeries.erase(it.first);
+			else
+				m_plottedSeries.emplace(it.first);
+		}
+	}
+	for(auto& it : history.GetNodeSeries())
+	{
+		auto nit = nodeNames.find(it.first);
+		if(nit == nodeNames.end())
+			continue;
+
+		bool plotted = (m_plottedNodes.find(it.first) != m_plottedNodes.end());
+		if(row(nit->second, it.second, plotted))
+		{
+			if(plotted)
+				m_plottedNodes.erase(it.first);
+			else
+				m_plottedNodes.emplace(it.first);
+		}
+	}
+
+	ImGui::EndTable();
+}
+
+/**
+	@brief Formats plot axis ticks as durations
+ */
+static int FormatDurationTick(double value, char* buf, int size, void* /*data*/)
+{
+	Unit fs(Unit::UNIT_FS);
+	return snprintf(buf, size, "%s", fs.PrettyPrint(value).c_str());
+}
+
+/**
+	@brief Plots the selected metrics against time
+ */
+void MetricsDialog::HistoryPlot(MetricHistory& history, const map<FlowGraphNode*, string>& nodeNames)
+{
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 7);
+	ImGui::InputFloat("Span (s)", &m_plotSpan);
+	if(m_plotSpan < 0)
+		m_plotSpan = 0;
+	HelpMarker("Width of the time axis, following the most recent samples. Set to zero to show the whole history.");
+
+	if(!ImPlot::BeginPlot("##metrics", ImVec2(-1, ImGui::GetFontSize() * 15)))
+		return;
+
+	ImPlot::SetupAxes("Time (s)", nullptr, 0, ImPlotAxisFlags_AutoFit);
+	ImPlot::SetupAxisFormat(ImAxis_Y1, FormatDurationTick);
+
+	lock_guard<mutex> lock(history.GetMutex());
+
+	//Find where the time axis should end
+	double tmax = 0;
+	double tmin = DBL_MAX;
+	vector< pair<string, MetricSeries*> > plotted;
+	for(auto name : m_plottedSeries)
+	{
+		auto& all = history.GetSeries();
+		auto it = all.find(name);
+		if(it != all.end())
+			plotted.push_back(pair<string, MetricSeries*>(name, &it->second));
+	}
+	for(auto node : m_plottedNodes)
+	{
+		auto& all = history.GetNodeSeries();
+		auto it = all.find(node);
+		auto nit = nodeNames.find(node);
+		if( (it != all.end()) && (nit != nodeNames.end()) )
+			plotted.push_back(pair<string, MetricSeries*>(nit->second, &it->second));
+	}
+	for(auto& p : plotted)
+	{
+		auto s = p.second;
+		if(s->GetCount() == 0)
+			continue;
+		tmin = min(tmin, s->GetTime(0));
+		tmax = max(tmax, s->GetTime(s->GetCount() - 1));
+	}
+
+	if(tmin <= tmax)
+	{
+		if(m_plotSpan > 0)
+			ImPlot::SetupAxisLimits(ImAxis_X1, tmax - m_plotSpan, tmax, ImGuiCond_Always);
+		else
+			ImPlot::SetupAxisLimits(ImAxis_X1, tmin, tmax, ImGuiCond_Always);
+	}
+
+	for(auto& p : plotted)
+	{
+		auto s = p.second;
+		ImPlot::PlotLine(
+			p.first.c_str(),
+			s->GetTimes(),
+			s->GetValues(),
+			s->GetCount(),
+			0,
+			s->GetOffset());
+	}
+
+	ImPlot::EndPlot();
+}
+
+/**
+	@brief Runs the CSV export file browser, if open
+ */
+void MetricsDialog::RunFileDialog()
+{
+	if(!m_fileDialog)
+		return;
+
+	m_fileDialog->Render();
+
+	if(m_fileDialog->IsClosedOK())
+	{
+		auto path = m_fileDialog->GetFileName();
+		if(m_session->GetMetricHistory().ExportCSV(path, GetNodeNames()))
+			LogNotice("Exported performance metrics to %s\n", path.c_str());
+	}
+
+	if(m_fileDialog->IsClosed())
+		m_fileDialog = nullptr;
+}
+
+/**
+	@brief Shows host/device transfer activity at each instrumented call site
+ */
+void MetricsDialog::BufferTransferTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	if(!ImGui::BeginTable("transfers", 7, flags))
+		return;
+
+	float width = ImGui::GetFontSize();
+	ImGui::TableSetupColumn("Call site", ImGuiTableColumnFlags_WidthFixed, 18*width);
+	ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("To GPU", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("To CPU", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("Allocs", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("Bytes", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Time", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableHeadersRow();
+
+	Unit counts(Unit::UNIT_COUNTS);
+	Unit bytes(Unit::UNIT_BYTES);
+	Unit fs(Unit::UNIT_FS);
+	for(auto& it : BufferTransferTracker::GetStats())
+	{
+		auto& stats = it.second;
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted(it.first.c_str());
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(counts.PrettyPrint(stats.m_calls).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(counts.PrettyPrint(stats.m_toGpu).c_str());
+		ImGui::TableSetColumnIndex(3);
+		ImGui::TextUnformatted(counts.PrettyPrint(stats.m_toCpu).c_str());
+		ImGui::TableSetColumnIndex(4);
+		ImGui::TextUnformatted(counts.PrettyPrint(stats.m_allocations).c_str());
+		ImGui::TableSetColumnIndex(5);
+		ImGui::TextUnformatted(bytes.PrettyPrint(stats.m_bytes, 4).c_str());
+		ImGui::TableSetColumnIndex(6);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_time * 1e6).c_str());
+	}
+
+	ImGui::EndTable();
+}
+
+/**
+	@brief Shows the latency histogram and the per-stage breakdown of one trigger group
+ */
+void MetricsDialog::LatencyTable(const AcquisitionLatencyStats& stats)
+{
+	Unit fs(Unit::UNIT_FS);
+	Unit counts(Unit::UNIT_COUNTS);
+
+	ImGui::Text("%s acquisitions, median %s, 95th percentile %s, 99th percentile %s",
+		counts.PrettyPrint(stats.m_count).c_str(),
+		fs.PrettyPrint(stats.GetPercentile(0.5) * FS_PER_SECOND).c_str(),
+		fs.PrettyPrint(stats.GetPercentile(0.95) * FS_PER_SECOND).c_str(),
+		fs.PrettyPrint(stats.GetPercentile(0.99) * FS_PER_SECOND).c_str());
+
+	//Only show the part of the histogram that has anything in it
+	size_t first = AcquisitionLatencyStats::NUM_BINS;
+	size_t last = 0;
+	for(size_t i=0; i<AcquisitionLatencyStats::NUM_BINS; i++)
+	{
+		if(stats.m_bins[i] == 0)
+			continue;
+		first = min(first, i);
+		last = i;
+	}
+	if(first <= last)
+	{
+		vector<float> bins;
+		for(size_t i=first; i<=last; i++)
+			bins.push_back(stats.m_bins[i]);
+
+		float width = ImGui::GetFontSize();
+		ImGui::PlotHistogram("##latency", &bins[0], bins.size(), 0, nullptr, 0, FLT_MAX, ImVec2(30*width, 5*width));
+
+		auto lo = fs.PrettyPrint((first ? AcquisitionLatencyStats::GetBinUpperEdge(first-1) : 0) * FS_PER_SECOND);
+		auto hi = fs.PrettyPrint(AcquisitionLatencyStats::GetBinUpperEdge(last) * FS_PER_SECOND);
+		ImGui::TextUnformatted(lo.c_str());
+		ImGui::SameLine(30*width - ImGui::CalcTextSize(hi.c_str()).x);
+		ImGui::TextUnformatted(hi.c_str());
+	}
+
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	if(!ImGui::BeginTable("latency", 3, flags))
+		return;
+
+	float width = ImGui::GetFontSize();
+	ImGui::TableSetupColumn("Stage", ImGuiTableColumnFlags_WidthFixed, 10*width);
+	ImGui::TableSetupColumn("Last", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Mean", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableHeadersRow();
+
+	//Each stage is the time taken since the one before it
+	for(size_t i=AcquisitionLatency::STAGE_DOWNLOADED; i<AcquisitionLatency::STAGE_COUNT; i++)
+	{
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted(AcquisitionLatency::GetStageName(static_cast<AcquisitionLatency::Stage>(i)));
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_stageLast[i] * FS_PER_SECOND).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_stageSums[i] / stats.m_count * FS_PER_SECOND).c_str());
+	}
+
+	ImGui::TableNextRow(ImGuiTableRowFlags_None);
+	ImGui::TableSetColumnIndex(0);
+	ImGui::TextUnformatted("Total");
+	ImGui::TableSetColumnIndex(1);
+	ImGui::TextUnformatted(fs.PrettyPrint(stats.m_last * FS_PER_SECOND).c_str());
+	ImGui::TableSetColumnIndex(2);
+	ImGui::TextUnformatted(fs.PrettyPrint(stats.m_sum / stats.m_count * FS_PER_SECOND).c_str());
+
+	ImGui::EndTable();
+
+	ImGui::Text("Fastest %s, slowest %s",
+		fs.PrettyPrint(stats.m_min * FS_PER_SECOND).c_str(),
+		fs.PrettyPrint(stats.m_max * FS_PER_SECOND).c_str());
+}
+
+/**
+	@brief Shows contention statistics for each profiled lock
+ */
+void MetricsDialog::LockTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	if(!ImGui::BeginTable("locks", 9, flags))
+		return;
+
+	float width = ImGui::GetFontSize();
+	ImGui::TableSetupColumn("Lock", ImGuiTableColumnFlags_WidthFixed, 16*width);
+	ImGui::TableSetupColumn("Locked", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("Waited", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("Wait time", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Max wait", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Hold time", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Max hold", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Order errors", ImGuiTableColumnFlags_WidthFixed, 5*width);
+	ImGui::TableSetupColumn("Waiting threads", ImGuiTableColumnFlags_WidthStretch, 0);
+	ImGui::TableHeadersRow();
+
+	Unit counts(Unit::UNIT_COUNTS);
+	Unit fs(Unit::UNIT_FS);
+	for(auto& it : LockProfiler::GetStats())
+	{
+		auto& stats = it.second;
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted(it.first.c_str());
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(counts.PrettyPrint(stats.m_acquisitions).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(counts.PrettyPrint(stats.m_contended).c_str());
+		ImGui::TableSetColumnIndex(3);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_waitTime * 1e6).c_str());
+		ImGui::TableSetColumnIndex(4);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_maxWait * 1e6).c_str());
+		ImGui::TableSetColumnIndex(5);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_holdTime * 1e6).c_str());
+		ImGui::TableSetColumnIndex(6);
+		ImGui::TextUnformatted(fs.PrettyPrint(stats.m_maxHold * 1e6).c_str());
+		ImGui::TableSetColumnIndex(7);
+		ImGui::TextUnformatted(to_string(stats.m_orderViolations).c_str());
+
+		ImGui::TableSetColumnIndex(8);
+		string threads;
+		for(auto& jt : stats.m_contenders)
+		{
+			if(!threads.empty())
+				threads += ", ";
+			threads += jt.first + " (" + to_string(jt.second) + ")";
+		}
+		ImGui::TextUnformatted(threads.c_str());
+	}
+
+	ImGui::EndTable();
+}
+
+/**
+	@brief Shows the measured CPU/GPU crossover of each autotuned operation on the current device
+ */
+void MetricsDialog::AutotuneTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	if(!ImGui::BeginTable("autotune", 3, flags))
+		return;
+
+	float width = ImGui::GetFontSize();
+	ImGui::TableSetupColumn("Operation", ImGuiTableColumnFlags_WidthFixed, 18*width);
+	ImGui::TableSetupColumn("CPU faster up to", ImGuiTableColumnFlags_WidthFixed, 8*width);
+	ImGui::TableSetupColumn("GPU faster from", ImGuiTableColumnFlags_WidthFixed, 8*width);
+	ImGui::TableHeadersRow();
+
+	for(auto& it : m_session->GetAutotuner().GetCrossovers())
+	{
+		auto& c = it.second;
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted(it.first.c_str());
+		ImGui::TableSetColumnIndex(1);
+		if(c.m_lastCpuWin >= 0)
+			ImGui::Text("2^%d", c.m_lastCpuWin);
+		else
+			ImGui::TextUnformatted("-");
+		ImGui::TableSetColumnIndex(2);
+		if(c.m_firstGpuWin != INT_MAX)
+			ImGui::Text("2^%d", c.m_firstGpuWin);
+		else
+			ImGui::TextUnformatted("-");
+	}
+
+	ImGui::EndTable();
+}
+
+/**
+	@brief Shows the GPU memory used by the rasterized image and texture of each displayed channel
+ */
+void MetricsDialog::RasterMemoryTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	if(!ImGui::BeginTable("rastermem", 4, flags))
+		return;
+
+	float width = ImGui::GetFontSize();
+	ImGui::TableSetupColumn("Channel", ImGuiTableColumnFlags_WidthFixed, 10*width);
+	ImGui::TableSetupColumn("Format", ImGuiTableColumnFlags_WidthFixed, 4*width);
+	ImGui::TableSetupColumn("Raster", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Texture", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableHeadersRow();
+
+	Unit bytes(Unit::UNIT_BYTES);
+	size_t totalRaster = 0;
+	size_t totalTexture = 0;
+
+	lock_guard lock(m_session->GetRasterizedWaveformMutex());
+	for(auto group : m_session->GetMainWindow()->GetWaveformGroups())
+	{
+		for(auto area : group->GetWaveformAreas())
+		{
+			for(size_t i=0; i<area->GetStreamCount(); i++)
+			{
+				auto chan = area->GetDisplayedChannel(i);
+				size_t raster = chan->GetRasterMemoryUsage();
+				size_t texture = chan->GetTextureMemoryUsage();
+				totalRaster += raster;
+				totalTexture += texture;
+
+				ImGui::TableNextRow(ImGuiTableRowFlags_None);
+				ImGui::TableSetColumnIndex(0);
+				ImGui::TextUnformatted(chan->GetName().c_str());
+				ImGui::TableSetColumnIndex(1);
+				if(raster > 0)
+					ImGui::TextUnformatted(chan->IsRasterizedHalfPrecision() ? "fp16" : "fp32");
+				ImGui::TableSetColumnIndex(2);
+				ImGui::TextUnformatted(bytes.PrettyPrint(raster, 4).c_str());
+				ImGui::TableSetColumnIndex(3);
+				ImGui::TextUnformatted(bytes.PrettyPrint(texture, 4).c_str());
+			}
+		}
+	}
+
+	ImGui::TableNextRow(ImGuiTableRowFlags_None);
+	ImGui::TableSetColumnIndex(0);
+	ImGui::TextUnformatted("Total");
+	ImGui::TableSetColumnIndex(2);
+	ImGui::TextUnformatted(bytes.PrettyPrint(totalRaster, 4).c_str());
+	ImGui::TableSetColumnIndex(3);
+	ImGui::TextUnformatted(bytes.PrettyPrint(totalTexture, 4).c_str());
+
+	ImGui::EndTable();
+}
+
+/**
+	@brief Shows what our memory is being used for
+ */
+void MetricsDialog::MemoryCategoryTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	auto& budget = m_session->GetMainWindow()->GetMemoryBudget();
+	Unit bytes(Unit::UNIT_BYTES);
+
+	if(ImGui::BeginTable("memcategories", 2, flags))
+	{
+		float width = ImGui::GetFontSize();
+		ImGui::TableSetupColumn("Category", ImGuiTableColumnFlags_WidthFixed, 10*width);
+		ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed, 6*width);
+		ImGui::TableHeadersRow();
+
+		size_t total = 0;
+		for(int i=0; i<MemoryBudget::CATEGORY_COUNT; i++)
+		{
+			auto category = static_cast<MemoryBudget::Category>(i);
+			size_t usage = budget.GetUsage(category);
+			total += usage;
+
+			ImGui::TableNextRow(ImGuiTableRowFlags_None);
+			ImGui::TableSetColumnIndex(0);
+			ImGui::TextUnformatted(MemoryBudget::GetCategoryName(category));
+			ImGui::TableSetColumnIndex(1);
+			ImGui::TextUnformatted(bytes.PrettyPrint(usage, 4).c_str());
+		}
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted("Total");
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(bytes.PrettyPrint(total, 4).c_str());
+
+		ImGui::EndTable();
+	}
+
+	HelpMarker(
+		"Sample data and rendering buffers, from ngscopeclient's own bookkeeping.\n\n"
+		"Waveform data is stored in pinned memory, and also in GPU memory if the GPU has its own, so these\n"
+		"don't necessarily add up to the heap usage above. Driver overhead, shaders etc. aren't included.");
+
+	TexturePoolTable();
+
+	if(HostMemoryPolicy::IsEnabled())
+		HostMemoryPolicyTable();
+
+	if(budget.HasHeapInfo())
+	{
+		string str = to_string(budget.GetReclaimCount());
+		ImGui::BeginDisabled();
+			ImGui::SetNextItemWidth(6 * ImGui::GetFontSize());
+			ImGui::InputText("Proactive reclaims", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number of times memory was freed because a heap went over the high-water mark.\n\n"
+			"The mark can be changed under Preferences | Performance | Memory.");
+	}
+}
+
+/**
+	@brief Shows how texture memory is divided between shared blocks and dedicated allocations
+ */
+void MetricsDialog::TexturePoolTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	auto stats = m_session->GetMainWindow()->GetTextureManager()->GetMemoryPool()->GetStats();
+	Unit bytes(Unit::UNIT_BYTES);
+	Unit pct(Unit::UNIT_PERCENT);
+
+	if(ImGui::BeginTable("texturepool", 3, flags))
+	{
+		float width = ImGui::GetFontSize();
+		ImGui::TableSetupColumn("Texture memory", ImGuiTableColumnFlags_WidthFixed, 10*width);
+		ImGui::TableSetupColumn("Allocations", ImGuiTableColumnFlags_WidthFixed, 6*width);
+		ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed, 6*width);
+		ImGui::TableHeadersRow();
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted("Shared blocks");
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(to_string(stats.m_blocks).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(bytes.PrettyPrint(stats.m_blockBytes, 4).c_str());
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted("Used in blocks");
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(to_string(stats.m_allocations).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(bytes.PrettyPrint(stats.m_usedBytes, 4).c_str());
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted("Dedicated");
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(to_string(stats.m_dedicatedAllocations).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(bytes.PrettyPrint(stats.m_dedicatedBytes, 4).c_str());
+
+		ImGui::EndTable();
+	}
+
+	string str = pct.PrettyPrint(stats.GetFragmentation());
+	ImGui::BeginDisabled();
+		ImGui::SetNextItemWidth(6 * ImGui::GetFontSize());
+		ImGui::InputText("Fragmentation", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker(
+		"Small textures share large blocks of GPU memory rather than each getting an allocation from the driver.\n"
+		"Textures too big to share a block get a dedicated allocation.\n\n"
+		"Fragmentation is the fraction of free block memory which isn't part of the largest free range.");
+}
+
+/**
+	@brief Shows how much large buffer memory the huge page and NUMA placement policy has been applied to
+ */
+void MetricsDialog::HostMemoryPolicyTable()
+{
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	auto stats = HostMemoryPolicy::GetStats();
+	Unit bytes(Unit::UNIT_BYTES);
+
+	if(ImGui::BeginTable("hostmempolicy", 3, flags))
+	{
+		float width = ImGui::GetFontSize();
+		ImGui::TableSetupColumn("Large buffers", ImGuiTableColumnFlags_WidthFixed, 10*width);
+		ImGui::TableSetupColumn("Applied", ImGuiTableColumnFlags_WidthFixed, 6*width);
+		ImGui::TableSetupColumn("Failed", ImGuiTableColumnFlags_WidthFixed, 6*width);
+		ImGui::TableHeadersRow();
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted("Huge pages");
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(bytes.PrettyPrint(stats.m_hugePageBytes, 4).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(to_string(stats.m_hugePageFailures).c_str());
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted("NUMA placement");
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(bytes.PrettyPrint(stats.m_numaBytes, 4).c_str());
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(to_string(stats.m_numaFailures).c_str());
+
+		ImGui::EndTable();
+	}
+
+	HelpMarker(
+		"Total size of buffers the huge page and NUMA placement preferences have been applied to since startup,\n"
+		"and the number of buffers the OS refused.\n\n"
+		"Pinned memory allocated by the Vulkan driver usually can't be adjusted, so failures are expected\n"
+		"for waveforms which are shared with the GPU.");
+}
+
+/**
+	@brief Shows GPU execution time for each channel and shader from one pass, slowest first
+ */
+void MetricsDialog::GpuTimingTable(const char* id, const vector<GpuTiming>& timings)
+{
+	if(timings.empty())
+	{
+		ImGui::TextDisabled("No data yet");
+		return;
+	}
+
+	//Merge repeated dispatches of the same shader for the same channel (e.g. several index searches)
+	map<pair<string, string>, int64_t> merged;
+	int64_t total = 0;
+	for(auto& t : timings)
+	{
+		merged[pair<string, string>(t.m_channel, t.m_shader)] += t.m_time;
+		total += t.m_time;
+	}
+
+	vector<pair<pair<string, string>, int64_t> > rows(merged.begin(), merged.end());
+	sort(rows.begin(), rows.end(),
+		[](const pair<pair<string, string>, int64_t>& a, const pair<pair<string, string>, int64_t>& b)
+		{ return a.second > b.second; });
+
+	Unit fs(Unit::UNIT_FS);
+	Unit pct(Unit::UNIT_PERCENT);
+	float width = ImGui::GetFontSize();
+
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	if(ImGui::BeginTable(id, 4, flags))
+	{
+		ImGui::TableSetupColumn("Channel", ImGuiTableColumnFlags_WidthFixed, 10*width);
+		ImGui::TableSetupColumn("Shader", ImGuiTableColumnFlags_WidthFixed, 14*width);
+		ImGui::TableSetupColumn("Time", ImGuiTableColumnFlags_WidthFixed, 6*width);
+		ImGui::TableSetupColumn("Share", ImGuiTableColumnFlags_WidthFixed, 5*width);
+		ImGui::TableHeadersRow();
+
+		for(auto& row : rows)
+		{
+			ImGui::TableNextRow(ImGuiTableRowFlags_None);
+
+			ImGui::TableSetColumnIndex(0);
+			ImGui::TextUnformatted(row.first.first.c_str());
+			ImGui::TableSetColumnIndex(1);
+			ImGui::TextUnformatted(row.first.second.c_str());
+			ImGui::TableSetColumnIndex(2);
+			ImGui::TextUnformatted(fs.PrettyPrint(row.second).c_str());
+			ImGui::TableSetColumnIndex(3);
+			if(total > 0)
+				ImGui::TextUnformatted(pct.PrettyPrint(row.second * 1.0 / total).c_str());
+		}
+
+		ImGui::TableNextRow(ImGuiTableRowFlags_None);
+		ImGui::TableSetColumnIndex(0);
+		ImGui::TextUnformatted("Total");
+		ImGui::TableSetColumnIndex(2);
+		ImGui::TextUnformatted(fs.PrettyPrint(total).c_str());
+
+		ImGui::EndTable();
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // UI event handlers
+
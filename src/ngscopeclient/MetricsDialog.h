@@ -36,6 +36,7 @@
 #define MetricsDialog_h
 
 #include "Dialog.h"
+#include "FileBrowser.h"
 
 class MetricsDialog : public Dialog
 {
@@ -46,9 +47,39 @@ public:
 	virtual bool DoRender();
 
 protected:
+	void GpuTimingTable(const char* id, const std::vector<GpuTiming>& timings);
+	void RasterMemoryTable();
+	void BufferTransferTable();
+	void LockTable();
+	void LatencyTable(const AcquisitionLatencyStats& stats);
+	void AutotuneTable();
+	void MemoryCategoryTable();
+	void TexturePoolTable();
+	void HostMemoryPolicyTable();
+	void HistoryTable(MetricHistory& history, const std::map<FlowGraphNode*, std::string>& nodeNames);
+	void HistoryPlot(MetricHistory& history, const std::map<FlowGraphNode*, std::string>& nodeNames);
+	void RunFileDialog();
+
+	std::map<FlowGraphNode*, std::string> GetNodeNames();
+
 	Session* m_session;
 
 	int m_displayRefreshRate;
+
+	///@brief Session-wide metrics shown on the history plot
+	std::set<std::string> m_plottedSeries;
+
+	///@brief Filter graph nodes shown on the history plot
+	std::set<FlowGraphNode*> m_plottedNodes;
+
+	///@brief Width of the history plot's time axis, in seconds (or zero to show everything)
+	float m_plotSpan;
+
+	///@brief Browser for picking the CSV export path
+	std::shared_ptr<FileBrowser> m_fileDialog;
+
+	///@brief Text of the target poll rate box for each instrument using shared polling
+	std::map<Instrument*, std::string> m_targetPollRateText;
 };
 
 #endif
@@ -0,0 +1,326 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PacketExporter
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "PacketExporter.h"
+
+using namespace std;
+
+//pcap file format constants (nanosecond timestamp variant)
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define PCAP_LINKTYPE_USER0	147
+#define PCAP_SNAPLEN		65535
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Opens the output file and starts the writer thread
+
+	@param path		Path to the output file
+	@param format	File format to write
+	@param headers	Names of the decoder's header columns
+ */
+PacketExporter::PacketExporter(const string& path, Format format, const vector<string>& headers)
+	: m_path(path)
+	, m_format(format)
+	, m_headerNames(headers)
+	, m_shuttingDown(false)
+	, m_packetCount(0)
+	, m_anyQueued(false)
+{
+	m_fp = fopen(path.c_str(), (format == FORMAT_PCAP) ? "wb" : "w");
+	if(!m_fp)
+	{
+		LogError("Failed to open packet export file %s\n", path.c_str());
+		return;
+	}
+
+	WriteHeader();
+	m_thread = make_unique<thread>(&PacketExporter::ThreadProc, this);
+}
+
+/**
+	@brief Writes out anything still queued, then closes the file
+ */
+PacketExporter::~PacketExporter()
+{
+	if(m_thread)
+	{
+		m_shuttingDown = true;
+		m_queueEvent.Signal();
+		m_thread->join();
+		m_thread = nullptr;
+	}
+
+	if(m_fp)
+		fclose(m_fp);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Returns the file browser mask for a format
+ */
+string PacketExporter::GetFileMask(Format format)
+{
+	switch(format)
+	{
+		case FORMAT_JSON_LINES:
+			return "*.jsonl";
+
+		case FORMAT_PCAP:
+			return "*.pcap";
+
+		case FORMAT_CSV:
+		default:
+			return "*.csv";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Packet processing
+
+/**
+	@brief Queues packets from a newly decoded waveform for writing
+
+	This is called from the thread updating the PacketManager, so it only copies the packets and leaves formatting
+	and file I/O to the writer thread.
+
+	The export is a log of new data, so only waveforms newer than any already queued are written. Re-decoding the
+	current waveform (e.g. after changing a setting) or one from history doesn't write its packets again.
+
+	@param stamp	Timestamp of the waveform the packets came from
+	@param packets	The decoded packets
+ */
+void PacketExporter::Enqueue(TimePoint stamp, const vector<Packet*>& packets)
+{
+	if(!m_thread)
+		return;
+
+	if(m_anyQueued && !(m_lastStamp < stamp))
+		return;
+	m_anyQueued = true;
+	m_lastStamp = stamp;
+
+	if(packets.empty())
+		return;
+
+	const int64_t fsPerSecond = FS_PER_SECOND;
+
+	vector<ExportedPacket> chunk;
+	chunk.resize(packets.size());
+	for(size_t i=0; i<packets.size(); i++)
+	{
+		auto p = packets[i];
+		auto& out = chunk[i];
+
+		int64_t fs = stamp.GetFs() + p->m_offset;
+		out.m_stamp = TimePoint(stamp.GetSec() + fs / fsPerSecond, fs % fsPerSecond);
+
+		out.m_headers.reserve(m_headerNames.size());
+		for(auto& name : m_headerNames)
+		{
+			auto it = p->m_headers.find(name);
+			if(it != p->m_headers.end())
+				out.m_headers.push_back(it->second);
+			else
+				out.m_headers.push_back("");
+		}
+
+		out.m_data = p->m_data;
+	}
+
+	{
+		lock_guard<mutex> lock(m_queueMutex);
+		m_queue.push_back(std::move(chunk));
+	}
+	m_queueEvent.Signal();
+}
+
+/**
+	@brief Thread function writing queued packets to the file
+ */
+void PacketExporter::ThreadProc()
+{
+	pthread_setname_np_compat("PacketExport");
+
+	while(true)
+	{
+		m_queueEvent.Block();
+
+		//Grab everything queued so far and write it without holding the lock
+		deque< vector<ExportedPacket> > chunks;
+		{
+			lock_guard<mutex> lock(m_queueMutex);
+			chunks.swap(m_queue);
+		}
+
+		for(auto& chunk : chunks)
+		{
+			for(auto& pack : chunk)
+				WritePacket(pack);
+			m_packetCount += chunk.size();
+		}
+		fflush(m_fp);
+
+		if(m_shuttingDown)
+		{
+			lock_guard<mutex> lock(m_queueMutex);
+			if(m_queue.empty())
+				break;
+		}
+	}
+}
+
+/**
+	@brief Writes the file header (column names or pcap global header)
+ */
+void PacketExporter::WriteHeader()
+{
+	switch(m_format)
+	{
+		case FORMAT_CSV:
+			fprintf(m_fp, "Timestamp");
+			for(auto& name : m_headerNames)
+				fprintf(m_fp, ",%s", Quote(name, false).c_str());
+			fprintf(m_fp, ",Data\n");
+			break;
+
+		//Packet data goes out as a user-defined link type since decoders don't tell us what it actually is
+		case FORMAT_PCAP:
+			{
+				uint32_t magic = PCAP_MAGIC_NSEC;
+				uint16_t versionMajor = 2;
+				uint16_t versionMinor = 4;
+				int32_t thiszone = 0;
+				uint32_t sigfigs = 0;
+				uint32_t snaplen = PCAP_SNAPLEN;
+				uint32_t linktype = PCAP_LINKTYPE_USER0;
+				fwrite(&magic, sizeof(magic), 1, m_fp);
+				fwrite(&versionMajor, sizeof(versionMajor), 1, m_fp);
+				fwrite(&versionMinor, sizeof(versionMinor), 1, m_fp);
+				fwrite(&thiszone, sizeof(thiszone), 1, m_fp);
+				fwrite(&sigfigs, sizeof(sigfigs), 1, m_fp);
+				fwrite(&snaplen, sizeof(snaplen), 1, m_fp);
+				fwrite(&linktype, sizeof(linktype), 1, m_fp);
+			}
+			break;
+
+		//JSON lines has no header
+		default:
+			break;
+	}
+}
+
+/**
+	@brief Writes a single packet in the current format
+ */
+void PacketExporter::WritePacket(const ExportedPacket& pack)
+{
+	TimePoint stamp = pack.m_stamp;
+
+	switch(m_format)
+	{
+		case FORMAT_CSV:
+			{
+				fprintf(m_fp, "%s", Quote(stamp.PrettyPrint(), false).c_str());
+				for(auto& h : pack.m_headers)
+					fprintf(m_fp, ",%s", Quote(h, false).c_str());
+				fputc(',', m_fp);
+				for(auto b : pack.m_data)
+					fprintf(m_fp, "%02x", b);
+				fputc('\n', m_fp);
+			}
+			break;
+
+		case FORMAT_JSON_LINES:
+			{
+				fprintf(m_fp, "{\"timestamp\":%s,\"headers\":{", Quote(stamp.PrettyPrint(), true).c_str());
+				for(size_t i=0; i<pack.m_headers.size(); i++)
+				{
+					fprintf(m_fp, "%s%s:%s",
+						(i > 0) ? "," : "",
+						Quote(m_headerNames[i], true).c_str(),
+						Quote(pack.m_headers[i], true).c_str());
+				}
+				fprintf(m_fp, "},\"data\":\"");
+				for(auto b : pack.m_data)
+					fprintf(m_fp, "%02x", b);
+				fprintf(m_fp, "\"}\n");
+			}
+			break;
+
+		case FORMAT_PCAP:
+			{
+				uint32_t sec = stamp.GetSec();
+				uint32_t nsec = stamp.GetFs() / 1000000;
+				uint32_t len = pack.m_data.size();
+				uint32_t caplen = min(len, (uint32_t)PCAP_SNAPLEN);
+				fwrite(&sec, sizeof(sec), 1, m_fp);
+				fwrite(&nsec, sizeof(nsec), 1, m_fp);
+				fwrite(&caplen, sizeof(caplen), 1, m_fp);
+				fwrite(&len, sizeof(len), 1, m_fp);
+				fwrite(pack.m_data.data(), 1, caplen, m_fp);
+			}
+			break;
+	}
+}
+
+/**
+	@brief Quotes a string for CSV or JSON output
+ */
+string PacketExporter::Quote(const string& str, bool json)
+{
+	string ret = "\"";
+	for(auto c : str)
+	{
+		if(c == '\"')
+			ret += json ? "\\\"" : "\"\"";
+		else if(json && (c == '\\') )
+			ret += "\\\\";
+		else if(json && ( (unsigned char)c < 0x20) )
+		{
+			char tmp[8];
+			snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+			ret += tmp;
+		}
+		else
+			ret += c;
+	}
+	ret += "\"";
+	return ret;
+}
@@ -0,0 +1,139 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of PacketExporter
+ */
+#ifndef PacketExporter_h
+#define PacketExporter_h
+
+#include "Event.h"
+
+/**
+	@brief Copy of a packet's contents, so it can be written out after the original has been deleted
+ */
+class ExportedPacket
+{
+public:
+	///@brief Timestamp of the start of the packet
+	TimePoint m_stamp;
+
+	///@brief Header values, in the same order as the decoder's header columns
+	std::vector<std::string> m_headers;
+
+	///@brief Packet data bytes
+	std::vector<uint8_t> m_data;
+};
+
+/**
+	@brief Streams decoded packets from a protocol analyzer to a file on a background thread
+
+	Packets are copied on ingest and written out in chunks, so a long capture can be logged in full even though the
+	packet history only keeps the last few waveforms.
+ */
+class PacketExporter
+{
+public:
+
+	enum Format
+	{
+		FORMAT_CSV,
+		FORMAT_JSON_LINES,
+		FORMAT_PCAP
+	};
+
+	PacketExporter(const std::string& path, Format format, const std::vector<std::string>& headers);
+	virtual ~PacketExporter();
+
+	PacketExporter(const PacketExporter&) =delete;
+	PacketExporter& operator=(const PacketExporter&) =delete;
+
+	///@brief Returns true if the output file was opened successfully
+	bool IsOpen()
+	{ return m_fp != nullptr; }
+
+	///@brief Returns the number of packets written out so far
+	size_t GetPacketCount()
+	{ return m_packetCount; }
+
+	///@brief Returns the output file path
+	const std::string& GetPath()
+	{ return m_path; }
+
+	void Enqueue(TimePoint stamp, const std::vector<Packet*>& packets);
+
+	static std::string GetFileMask(Format format);
+
+protected:
+	void ThreadProc();
+	void WriteHeader();
+	void WritePacket(const ExportedPacket& pack);
+
+	static std::string Quote(const std::string& str, bool json);
+
+	///@brief Output file path
+	std::string m_path;
+
+	///@brief Output format
+	Format m_format;
+
+	///@brief Names of the decoder's header columns
+	std::vector<std::string> m_headerNames;
+
+	///@brief Output file
+	FILE* m_fp;
+
+	///@brief Mutex controlling access to m_queue
+	std::mutex m_queueMutex;
+
+	///@brief Chunks of packets waiting to be written
+	std::deque< std::vector<ExportedPacket> > m_queue;
+
+	///@brief Signaled when m_queue has new data, or it's time to shut down
+	Event m_queueEvent;
+
+	///@brief Set to shut down the writer thread once the queue is empty
+	std::atomic<bool> m_shuttingDown;
+
+	///@brief Number of packets written out so far
+	std::atomic<size_t> m_packetCount;
+
+	///@brief True once any waveform has been queued, so m_lastStamp is valid
+	bool m_anyQueued;
+
+	///@brief Timestamp of the newest waveform queued so far
+	TimePoint m_lastStamp;
+
+	///@brief Writer thread
+	std::unique_ptr<std::thread> m_thread;
+};
+
+#endif
@@ -33,8 +33,10 @@
 	@brief Implementation of PacketManager
  */
 #include "ngscopeclient.h"
+#include "pthread_compat.h"
 #include "PacketManager.h"
 #include "Session.h"
+#include "MainWindow.h"
 
 using namespace std;
 
@@ -44,22 +46,26 @@ using namespace std;
 PacketManager::PacketManager(PacketDecoder* pd, Session& session)
 	: m_session(session)
 	, m_filter(pd)
+	, m_cancelFilter(false)
+	, m_filterDone(true)
+	, m_searchIndexEnabled(false)
+	, m_rowRefreshCursor(0, 0)
+	, m_rowRefreshRestart(false)
 {
 
 }
 
 PacketManager::~PacketManager()
 {
-	for(auto& it : m_packets)
-	{
-		for(auto p : it.second)
-		{
-			RemoveChildHistoryFrom(p);
-			delete p;
-		}
-	}
+	CancelFilterThread();
+
+	auto wnd = m_session.GetMainWindow();
+	if(wnd)
+		wnd->GetFrameScheduler().Cancel(this);
+
 	m_packets.clear();
 	m_childPackets.clear();
+	m_arenas.clear();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -74,265 +80,1213 @@ void PacketManager::RefreshRows()
 	//Clear all existing row state
 	m_rows.clear();
 
-	//Make a list of waveform timestamps and make sure we display them in order
-	vector<TimePoint> times;
-	for(auto& it : m_filteredPackets)
-		times.push_back(it.first);
-	std::sort(times.begin(), times.end());
-	LogTrace("%zu times\n", times.size());
+	//m_filteredPackets is a std::map so iterating it already gives us the waveforms in order
+	LogTrace("%zu times\n", m_filteredPackets.size());
+
+	double totalHeight = 0;
+	for(auto& it : m_filteredPackets)
+		AppendRows(it.first, m_rows, totalHeight);
+
+	LogTrace("%zu rows\n", m_rows.size());
+}
+
+/**
+	@brief Generates the displayed rows for a single waveform
+
+	@param wavetime		Timestamp of the waveform
+	@param rows			Row list to append to
+	@param totalHeight	Running total of row heights before the first new row, updated as rows are added
+ */
+void PacketManager::AppendRows(TimePoint wavetime, vector<RowData>& rows, double& totalHeight)
+{
+	double lineheight = ImGui::CalcTextSize("dummy text").y;
+	double padding = ImGui::GetStyle().CellPadding.y;
+
+	auto wit = m_filteredPackets.find(wavetime);
+	if(wit == m_filteredPackets.end())
+		return;
+	auto& wpackets = wit->second;
+
+	//Get markers for this waveform, if any
+	auto& markers = m_session.GetMarkers(wavetime);
+	size_t imarker = 0;
+	int64_t lastoff = 0;
+
+	LogTrace("Refreshing (markers: %zu at %s)\n", markers.size(), wavetime.PrettyPrint().c_str());
+
+	for(auto pack : wpackets)
+	{
+		//Add marker before this packet if needed
+		//(loop because we might have two or more markers between packets)
+		while( (imarker < markers.size()) &&
+			(markers[imarker].m_offset >= lastoff) &&
+			(markers[imarker].m_offset < pack->m_offset) )
+		{
+			RowData row(wavetime, markers[imarker]);
+			row.m_height = padding*2 + lineheight;
+			totalHeight += row.m_height;
+			row.m_totalHeight = totalHeight;
+			rows.push_back(row);
+
+			imarker ++;
+		}
+
+		//Add an entry for the top level
+		RowData dat(wavetime, pack);
+		lastoff = pack->m_offset;
+
+		//Calculate row height
+		double height = padding*2 + lineheight;
+
+		//Integrate heights
+		dat.m_height = height;
+		totalHeight += height;
+		dat.m_totalHeight = totalHeight;
+
+		//Save this row
+		rows.push_back(dat);
+
+		if(IsChildOpen(pack))
+		{
+			for(auto child : m_filteredChildPackets[pack])
+			{
+				//Add an entry for the top level
+				RowData cdat(wavetime, child);
+
+				//Calculate row height
+				height = padding*2 + lineheight;
+
+				//Integrate heights
+				cdat.m_height = height;
+				totalHeight += height;
+				cdat.m_totalHeight = totalHeight;
+
+				//Save this row
+				rows.push_back(cdat);
+			}
+		}
+	}
+}
+
+/**
+	@brief Finds the range of m_rows belonging to a single waveform
+
+	Rows are always kept in timestamp order, so this is a binary search.
+ */
+pair<vector<RowData>::iterator, vector<RowData>::iterator> PacketManager::FindRows(TimePoint wavetime)
+{
+	auto lo = lower_bound(m_rows.begin(), m_rows.end(), wavetime,
+		[](const RowData& row, const TimePoint& t) { return row.m_stamp < t; });
+	auto hi = upper_bound(lo, m_rows.end(), wavetime,
+		[](const TimePoint& t, const RowData& row) { return t < row.m_stamp; });
+	return make_pair(lo, hi);
+}
+
+/**
+	@brief Removes the displayed rows for a single waveform, without regenerating the rest
+ */
+void PacketManager::RemoveRows(TimePoint wavetime)
+{
+	auto range = FindRows(wavetime);
+	if(range.first == range.second)
+		return;
+
+	double removedHeight = 0;
+	for(auto it = range.first; it != range.second; it++)
+		removedHeight += it->m_height;
+
+	auto next = m_rows.erase(range.first, range.second);
+	for(; next != m_rows.end(); next++)
+		next->m_totalHeight -= removedHeight;
+}
+
+/**
+	@brief Generates the displayed rows for a single waveform and splices them into m_rows at the right place
+
+	New waveforms are almost always the most recent, so the common case is a plain append and none of the existing
+	rows need to be touched.
+ */
+void PacketManager::InsertRows(TimePoint wavetime)
+{
+	auto pos = FindRows(wavetime).first;
+	size_t ipos = pos - m_rows.begin();
+
+	double startHeight = 0;
+	if(ipos > 0)
+		startHeight = m_rows[ipos-1].m_totalHeight;
+
+	vector<RowData> newRows;
+	double totalHeight = startHeight;
+	AppendRows(wavetime, newRows, totalHeight);
+	if(newRows.empty())
+		return;
+
+	m_rows.insert(pos, newRows.begin(), newRows.end());
+
+	double addedHeight = totalHeight - startHeight;
+	for(size_t i = ipos + newRows.size(); i < m_rows.size(); i++)
+		m_rows[i].m_totalHeight += addedHeight;
+
+	LogTrace("Inserted %zu rows at %zu (%zu total)\n", newRows.size(), ipos, m_rows.size());
+}
+
+/**
+	@brief Called when a marker is added, removed, or modified
+
+	Marker rows can be anywhere in the history, so every waveform's rows have to be rebuilt. With a deep history that's
+	too slow to do in the frame the marker moved in, so it's spread over as many frames as it takes. Each waveform's
+	rows are swapped in whole, so the table is always consistent (if briefly stale) while the refresh runs.
+
+	Must be called from the GUI thread.
+ */
+void PacketManager::OnMarkerChanged()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	auto wnd = m_session.GetMainWindow();
+	if(!wnd)
+	{
+		RefreshRows();
+		return;
+	}
+
+	//If a refresh is already under way, start it over since waveforms it has done may have changed again
+	m_rowRefreshRestart = true;
+	wnd->GetFrameScheduler().Post(this, "RefreshRows", [this](double deadline) { return RefreshRowsSlice(deadline); });
+}
+
+/**
+	@brief Rebuilds the rows for as many waveforms as fit before the deadline, continuing from the last slice
+
+	The rows for all of the waveforms in the slice are replaced in one splice, so the heights of the rows after them
+	only have to be updated once.
+
+	@param deadline	Time to stop at (at least one waveform is always done)
+
+	@return True once every waveform's rows have been rebuilt
+ */
+bool PacketManager::RefreshRowsSlice(double deadline)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	auto it = m_rowRefreshRestart ? m_filteredPackets.begin() : m_filteredPackets.upper_bound(m_rowRefreshCursor);
+	m_rowRefreshRestart = false;
+	if(it == m_filteredPackets.end())
+		return true;
+
+	//Regenerate rows starting from wherever the first waveform's rows start now
+	size_t ipos = FindRows(it->first).first - m_rows.begin();
+	double startHeight = 0;
+	if(ipos > 0)
+		startHeight = m_rows[ipos-1].m_totalHeight;
+
+	vector<RowData> newRows;
+	double totalHeight = startHeight;
+	TimePoint last = it->first;
+	do
+	{
+		last = it->first;
+		AppendRows(last, newRows, totalHeight);
+		it ++;
+	} while( (it != m_filteredPackets.end()) && (GetTime() < deadline) );
+
+	//Swap them in for the old rows of the same waveforms
+	size_t iend = FindRows(last).second - m_rows.begin();
+	double oldHeight = 0;
+	if(iend > ipos)
+		oldHeight = m_rows[iend-1].m_totalHeight - startHeight;
+	m_rows.erase(m_rows.begin() + ipos, m_rows.begin() + iend);
+	m_rows.insert(m_rows.begin() + ipos, newRows.begin(), newRows.end());
+
+	double delta = (totalHeight - startHeight) - oldHeight;
+	if(delta != 0)
+	{
+		for(size_t i = ipos + newRows.size(); i < m_rows.size(); i++)
+			m_rows[i].m_totalHeight += delta;
+	}
+
+	m_rowRefreshCursor = last;
+	return (it == m_filteredPackets.end());
+}
+
+/**
+	@brief Called when the filter's output is swapped for one saved earlier, rather than being recomputed
+
+	We already have the packets for that waveform, but the filter's packet list is from its last run, so make sure
+	the next Update() doesn't pick them up.
+ */
+void PacketManager::OnOutputRestored()
+{
+	auto data = m_filter->GetData(0);
+	if(data)
+		m_cachekey = WaveformCacheKey(data);
+}
+
+/**
+	@brief Handle newly arrived waveform data (may be a change to parameters or a freshly arrived waveform)
+
+	Only the packets and rows for the new waveform are touched, the rest of the history is left as is.
+ */
+void PacketManager::Update()
+{
+	//Do nothing if there's no waveform to get a timestamp from
+	auto data = m_filter->GetData(0);
+	if(!data)
+		return;
+	TimePoint time(data->m_startTimestamp, data->m_startFemtoseconds);
+
+	//If waveform is unchanged, no action needed
+	WaveformCacheKey key(data);
+	if(key == m_cachekey)
+		return;
+
+	LogTrace("Updating\n");
+
+	//If we get here, waveform changed. Update cache key
+	m_cachekey = key;
+
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	//Copy the new packets and detach them so the filter doesn't delete them
+	AddPackets(time, m_filter->GetPackets(), true);
+	m_filter->DetachPackets();
+}
+
+/**
+	@brief Replaces the packets for one waveform with ones decoded outside the normal filter graph run
+
+	Takes ownership of the packets. They aren't merged, since decoders build merged headers from their own packet list.
+ */
+void PacketManager::ReplacePackets(TimePoint time, const vector<Packet*>& packets)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	AddPackets(time, packets, false);
+	OnOutputRestored();
+}
+
+/**
+	@brief Takes ownership of the packets for one waveform, replacing any we already had for it
+
+	Must be called with m_mutex held.
+
+	@param time		Timestamp of the waveform
+	@param packets	Packets decoded from it
+	@param merge	True to merge runs of similar packets under a header created by the decoder
+ */
+void PacketManager::AddPackets(TimePoint time, const vector<Packet*>& packets, bool merge)
+{
+	//Remove any old history we might have had from this timestamp
+	RemoveHistoryFrom(time);
+
+	//Do the merging now
+	{
+		auto& outpackets = m_packets[time];
+		outpackets.clear();
+
+		auto npackets = packets.size();
+
+		//Everything from this waveform, merged headers included, is owned by its arena
+		auto& arena = m_arenas[time];
+		arena.reserve(npackets);
+
+		//Log the packets as decoded, before merging
+		if(m_exporter)
+			m_exporter->Enqueue(time, packets);
+
+		Packet* parentOfGroup = nullptr;
+		Packet* firstChildPacketOfGroup = nullptr;
+		Packet* lastPacket = nullptr;
+		for(size_t i=0; i<npackets; i++)
+		{
+			auto p = packets[i];
+
+			//See if we should start a new merge group
+			bool starting_new_group;
+			if(!merge)
+				starting_new_group = false;
+			else if(i+1 >= npackets)							//No next packet to merge with
+				starting_new_group = false;
+			else if(!m_filter->CanMerge(p, p, packets[i+1]))	//This packet isn't compatible with the next
+				starting_new_group = false;
+			else if(firstChildPacketOfGroup == nullptr)			//If we get here, we're merging. But are we already?
+				starting_new_group = true;
+			else												//Already in a group, but it's not the same as the new one
+				starting_new_group = !m_filter->CanMerge(firstChildPacketOfGroup, lastPacket, p);
+
+			if(starting_new_group)
+			{
+				//Create the summary packet
+				firstChildPacketOfGroup = p;
+				parentOfGroup = m_filter->CreateMergedHeader(p, i);
+				outpackets.push_back(parentOfGroup);
+				arena.push_back(parentOfGroup);
+			}
+
+			//End a merge group
+			else if( (firstChildPacketOfGroup != nullptr) && !m_filter->CanMerge(firstChildPacketOfGroup, lastPacket, p) )
+			{
+				firstChildPacketOfGroup = nullptr;
+				parentOfGroup = nullptr;
+			}
+
+			//If we're a child of an group, add under the parent node
+			if(parentOfGroup)
+				m_childPackets[parentOfGroup].push_back(p);
+
+			//Otherwise add at the top level
+			else
+				outpackets.push_back(p);
+
+			arena.push_back(p);
+			lastPacket = p;
+		}
+	}
+
+	//Once find-next has been used, keep the search index up to date as waveforms arrive
+	if(m_searchIndexEnabled)
+		m_searchIndexes[time].Build(m_packets[time], m_childPackets);
+
+	//Run filters on just the new waveform and add its rows to the display
+	FilterPackets(time);
+	InsertRows(time);
+
+	//Index the new packets now, since the cursor is usually over the newest waveform
+	auto fit = m_filteredPackets.find(time);
+	if(fit != m_filteredPackets.end())
+		m_offsetIndexes[time].Build(fit->second, m_filteredChildPackets);
+}
+
+/**
+	@brief Sets the current filter expression
+
+	Any filter still being applied is cancelled. The new one is applied on a background thread, newest waveforms
+	first, and matches show up progressively as the GUI calls PollFilterResults(). Waveforms arriving in the
+	meantime are filtered by Update() as usual.
+ */
+void PacketManager::SetDisplayFilter(shared_ptr<ProtocolDisplayFilter> filter)
+{
+	//Must not hold the mutex here, the thread grabs it between waveforms
+	CancelFilterThread();
+
+	lock_guard<recursive_mutex> lock(m_mutex);
+	m_filterExpression = filter;
+	m_pendingFilterResults.clear();
+
+	//No filter is just a copy, no need to go to the background for that
+	if(filter == nullptr)
+	{
+		FilterPackets();
+		return;
+	}
+
+	m_filteredPackets.clear();
+	m_filteredChildPackets.clear();
+	m_offsetIndexes.clear();
+	m_rows.clear();
+
+	vector<TimePoint> times;
+	for(auto it = m_packets.rbegin(); it != m_packets.rend(); it++)
+		times.push_back(it->first);
+
+	m_cancelFilter = false;
+	m_filterDone = false;
+	m_filterThread = make_unique<thread>(&PacketManager::FilterThread, this, times);
+}
+
+/**
+	@brief Stops the background filter thread, if running, and waits for it to exit
+ */
+void PacketManager::CancelFilterThread()
+{
+	if(!m_filterThread)
+		return;
+
+	m_cancelFilter = true;
+	m_filterThread->join();
+	m_filterThread = nullptr;
+}
+
+/**
+	@brief Thread function for applying a display filter in the background
+
+	@param times	Timestamps of the waveforms to filter, in the order they should be processed
+ */
+void PacketManager::FilterThread(vector<TimePoint> times)
+{
+	pthread_setname_np_compat("PacketFilter");
+
+	for(auto t : times)
+	{
+		if(m_cancelFilter)
+			break;
+
+		//Hold the lock for one waveform at a time so the GUI and Update() are never blocked for long.
+		//The waveform may have been removed from history since we started.
+		lock_guard<recursive_mutex> lock(m_mutex);
+		auto it = m_packets.find(t);
+		if(it == m_packets.end())
+			continue;
+
+		FilterResult result(t);
+		string value;
+		if(PrepareColumnIndex(value))
+			MatchPacketsIndexed(m_columnIndexes[t], it->second, value, result.m_packets, result.m_children);
+		else
+			MatchPackets(it->second, result.m_packets, result.m_children);
+		m_pendingFilterResults.push_back(std::move(result));
+	}
+
+	m_filterDone = true;
+}
+
+/**
+	@brief Merges waveforms matched by the background filter thread into the displayed rows
+
+	Called from the GUI thread each frame.
+
+	@return True if any rows changed
+ */
+bool PacketManager::PollFilterResults()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	if(m_filterThread && m_filterDone)
+	{
+		m_filterThread->join();
+		m_filterThread = nullptr;
+	}
+
+	if(m_pendingFilterResults.empty())
+		return false;
+
+	for(auto& result : m_pendingFilterResults)
+	{
+		auto t = result.m_stamp;
+
+		//Update() may have already filtered this waveform, replace whatever is there
+		RemoveRows(t);
+		m_filteredPackets.erase(t);
+		m_offsetIndexes.erase(t);
+		auto pit = m_packets.find(t);
+		if(pit != m_packets.end())
+		{
+			for(auto p : pit->second)
+				m_filteredChildPackets.erase(p);
+		}
+
+		if(!result.m_packets.empty())
+			m_filteredPackets[t] = std::move(result.m_packets);
+		for(auto& c : result.m_children)
+			m_filteredChildPackets[c.first] = std::move(c.second);
+
+		InsertRows(t);
+	}
+	m_pendingFilterResults.clear();
+
+	return true;
+}
+
+/**
+	@brief Run the filter expression against all packets in the history, then regenerate the displayed rows
+ */
+void PacketManager::FilterPackets()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	m_filteredPackets.clear();
+	m_filteredChildPackets.clear();
+	m_offsetIndexes.clear();
+
+	if(m_filterExpression == nullptr)
+	{
+		for(auto& it : m_packets)
+			FilterPackets(it.first);
+	}
+
+	//Matching is read-only on the packet history, so waveforms can be checked in parallel.
+	//Results are merged into the filtered maps afterwards since those can't be written concurrently.
+	else
+	{
+		string value;
+		bool indexed = PrepareColumnIndex(value);
+
+		vector<map<TimePoint, vector<Packet*> >::iterator> buckets;
+		vector<PacketColumnIndex*> indexes;
+		for(auto it = m_packets.begin(); it != m_packets.end(); it++)
+		{
+			buckets.push_back(it);
+			if(indexed)
+				indexes.push_back(&m_columnIndexes[it->first]);
+		}
+
+		size_t nbuckets = buckets.size();
+		vector<vector<Packet*> > filtered(nbuckets);
+		vector<vector<pair<Packet*, vector<Packet*> > > > filteredChildren(nbuckets);
+
+		#pragma omp parallel for
+		for(size_t i=0; i<nbuckets; i++)
+		{
+			if(indexed)
+				MatchPacketsIndexed(*indexes[i], buckets[i]->second, value, filtered[i], filteredChildren[i]);
+			else
+				MatchPackets(buckets[i]->second, filtered[i], filteredChildren[i]);
+		}
+
+		for(size_t i=0; i<nbuckets; i++)
+		{
+			if(!filtered[i].empty())
+				m_filteredPackets[buckets[i]->first] = std::move(filtered[i]);
+			for(auto& c : filteredChildren[i])
+				m_filteredChildPackets[c.first] = std::move(c.second);
+		}
+	}
+
+	//Refresh the set of rows being displayed
+	RefreshRows();
+}
+
+/**
+	@brief Run the filter expression against the packets from a single waveform
+
+	Does not update the displayed rows.
+ */
+void PacketManager::FilterPackets(TimePoint timestamp)
+{
+	auto& packets = m_packets[timestamp];
+
+	//Start out by clearing output, then we can re-add the ones that match
+	for(auto p : packets)
+		m_filteredChildPackets.erase(p);
+	m_offsetIndexes.erase(timestamp);
+
+	//If we do NOT have a filter, early out: just copy stuff
+	if(m_filterExpression == nullptr)
+	{
+		m_filteredPackets[timestamp] = packets;
+		for(auto p : packets)
+		{
+			auto it = m_childPackets.find(p);
+			if( (it != m_childPackets.end()) && !it->second.empty() )
+				m_filteredChildPackets[p] = it->second;
+		}
+		return;
+	}
+
+	vector<Packet*> filtered;
+	vector<pair<Packet*, vector<Packet*> > > filteredChildren;
+	string value;
+	if(PrepareColumnIndex(value))
+		MatchPacketsIndexed(m_columnIndexes[timestamp], packets, value, filtered, filteredChildren);
+	else
+		MatchPackets(packets, filtered, filteredChildren);
+
+	//Don't leave empty entries around for waveforms with no matches
+	if(filtered.empty())
+		m_filteredPackets.erase(timestamp);
+	else
+		m_filteredPackets[timestamp] = std::move(filtered);
+	for(auto& c : filteredChildren)
+		m_filteredChildPackets[c.first] = std::move(c.second);
+}
+
+/**
+	@brief Checks a list of top level packets against the current filter expression
+
+	Only reads from the packet history, so it's safe to call from several threads at once.
+
+	@param packets			Top level packets to check
+	@param filtered			Top level packets that matched, or had a child that matched
+	@param filteredChildren	Matching children of each parent packet in filtered
+ */
+void PacketManager::MatchPackets(
+	const vector<Packet*>& packets,
+	vector<Packet*>& filtered,
+	vector<pair<Packet*, vector<Packet*> > >& filteredChildren)
+{
+	for(auto p : packets)
+	{
+		//If no children, just check the top level packet for a match
+		auto it = m_childPackets.find(p);
+		if( (it == m_childPackets.end()) || it->second.empty() )
+		{
+			if(m_filterExpression->Match(p))
+				filtered.push_back(p);
+		}
+
+		//We have children.
+		//Check them for matches, and add the parent if any child matches
+		else
+		{
+			vector<Packet*> matchedChildren;
+			for(auto c : it->second)
+			{
+				if(m_filterExpression->Match(c))
+					matchedChildren.push_back(c);
+			}
+			if(!matchedChildren.empty())
+			{
+				filtered.push_back(p);
+				filteredChildren.push_back(make_pair(p, std::move(matchedChildren)));
+			}
+		}
+	}
+}
+
+/**
+	@brief Checks a list of top level packets against a simple equality filter, using the column index
+
+	The index is built on first use and kept until the waveform is removed, so later filters on the same column
+	(typically while the user is still typing the value) are a single hash lookup per waveform.
+
+	Safe to call from several threads at once as long as each has a different index.
+ */
+void PacketManager::MatchPacketsIndexed(
+	PacketColumnIndex& index,
+	const vector<Packet*>& packets,
+	const string& value,
+	vector<Packet*>& filtered,
+	vector<pair<Packet*, vector<Packet*> > >& filteredChildren)
+{
+	if(!index.m_valid)
+		index.Build(m_indexColumn, packets, m_childPackets);
+
+	auto it = index.m_values.find(value);
+	if(it == index.m_values.end())
+		return;
+
+	//Entries are in display order, and all children of a given parent are consecutive
+	for(auto& entry : it->second)
+	{
+		auto parent = entry.first;
+		auto pack = entry.second;
+
+		if(parent == nullptr)
+			filtered.push_back(pack);
+
+		else
+		{
+			if(filteredChildren.empty() || (filteredChildren.back().first != parent) )
+			{
+				filtered.push_back(parent);
+				filteredChildren.push_back(make_pair(parent, vector<Packet*>()));
+			}
+			filteredChildren.back().second.push_back(pack);
+		}
+	}
+}
+
+/**
+	@brief Checks if the current filter can be evaluated with a column index, and sets up the index if so
+
+	@param value	Value to look up in the index
+
+	@return True if the filter is a simple equality test and the index should be used
+ */
+bool PacketManager::PrepareColumnIndex(string& value)
+{
+	string column;
+	if(!m_filterExpression || !m_filterExpression->GetEqualityMatch(column, value))
+		return false;
+
+	//Only keep an index for one column at a time so memory usage doesn't grow with every column ever filtered on
+	if(column != m_indexColumn)
+	{
+		m_columnIndexes.clear();
+		m_indexColumn = column;
+	}
+
+	return true;
+}
+
+/**
+	@brief Removes all history from the specified timestamp
+ */
+void PacketManager::RemoveHistoryFrom(TimePoint timestamp)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	//Drop the displayed rows first so we don't have anything left pointing to stale packets
+	RemoveRows(timestamp);
+
+	auto it = m_packets.find(timestamp);
+	if(it != m_packets.end())
+	{
+		for(auto p : it->second)
+			ForgetChildHistoryFrom(p);
+		m_packets.erase(it);
+	}
+
+	//Free every packet from the waveform at once, now nothing refers to them
+	m_arenas.erase(timestamp);
+
+	m_filteredPackets.erase(timestamp);
+	m_columnIndexes.erase(timestamp);
+	m_searchIndexes.erase(timestamp);
+	m_offsetIndexes.erase(timestamp);
+
+	//Don't publish background filter results pointing to the packets we just deleted
+	for(size_t i=0; i<m_pendingFilterResults.size(); )
+	{
+		if(m_pendingFilterResults[i].m_stamp == timestamp)
+			m_pendingFilterResults.erase(m_pendingFilterResults.begin() + i);
+		else
+			i++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Export
+
+/**
+	@brief Starts logging every packet decoded from now on to a file
+
+	@return True if the file was opened successfully
+ */
+bool PacketManager::StartExport(const string& path, PacketExporter::Format format)
+{
+	auto exporter = make_shared<PacketExporter>(path, format, m_filter->GetHeaders());
+	if(!exporter->IsOpen())
+		return false;
+
+	lock_guard<recursive_mutex> lock(m_mutex);
+	m_exporter = exporter;
+	return true;
+}
+
+/**
+	@brief Stops logging packets, flushing anything not yet written
+ */
+void PacketManager::StopExport()
+{
+	shared_ptr<PacketExporter> exporter;
+	{
+		lock_guard<recursive_mutex> lock(m_mutex);
+		exporter = m_exporter;
+		m_exporter = nullptr;
+	}
+
+	//Exporter finishes writing and closes the file when the last reference goes away
+	exporter = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Search
+
+/**
+	@brief Returns the displayed row for a packet, or null if it's not currently displayed
+ */
+const RowData* PacketManager::GetRowForPacket(TimePoint stamp, Packet* pack)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	//Rows within a waveform are in offset order, so skip straight to the ones starting where the packet does.
+	//A merged parent starts at the same offset as its first child, so there may be more than one.
+	auto range = FindRows(stamp);
+	auto it = lower_bound(range.first, range.second, pack->m_offset,
+		[](const RowData& row, int64_t off)
+			{ return (row.m_packet ? row.m_packet->m_offset : row.m_marker.m_offset) < off; });
+	for(; it != range.second; it++)
+	{
+		if(it->m_packet == pack)
+			return &(*it);
+		if(it->m_packet && (it->m_packet->m_offset > pack->m_offset) )
+			break;
+	}
+	return nullptr;
+}
+
+/**
+	@brief Finds the displayed packet under a cursor
+
+	@param stamp	Timestamp of the waveform the cursor is in
+	@param offset	Position of the cursor within the waveform
+
+	@return The innermost displayed packet containing the offset, or null if there is none
+ */
+Packet* PacketManager::FindPacketAtOffset(TimePoint stamp, int64_t offset)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+
+	auto it = m_offsetIndexes.find(stamp);
+	if(it == m_offsetIndexes.end())
+	{
+		auto fit = m_filteredPackets.find(stamp);
+		if(fit == m_filteredPackets.end())
+			return nullptr;
+
+		it = m_offsetIndexes.emplace(stamp, PacketOffsetIndex()).first;
+		it->second.Build(fit->second, m_filteredChildPackets);
+	}
+
+	return it->second.Find(offset);
+}
 
-	double totalHeight = 0;
-	double lineheight = ImGui::CalcTextSize("dummy text").y;
-	double padding = ImGui::GetStyle().CellPadding.y;
+/**
+	@brief Gets the search index for a waveform, building it if needed
+ */
+PacketSearchIndex& PacketManager::GetSearchIndex(TimePoint stamp)
+{
+	auto it = m_searchIndexes.find(stamp);
+	if(it != m_searchIndexes.end())
+		return it->second;
 
-	//Process packets from each waveform
-	for(auto wavetime : times)
-	{
-		auto& wpackets = m_filteredPackets[wavetime];
+	auto& index = m_searchIndexes[stamp];
+	index.Build(m_packets[stamp], m_childPackets);
+	return index;
+}
 
-		//Get markers for this waveform, if any
-		auto& markers = m_session.GetMarkers(wavetime);
-		size_t imarker = 0;
-		int64_t lastoff = 0;
+/**
+	@brief Finds the next displayed packet containing the query
 
-		LogTrace("Refreshing (markers: %zu at %s)\n", markers.size(), wavetime.PrettyPrint().c_str());
+	The query is matched case insensitively against header values and, if it's a string of hex bytes, against the
+	packet data. The search starts after the given packet and wraps around at the end of the history.
 
-		for(auto pack : wpackets)
-		{
-			//Add marker before this packet if needed
-			//(loop because we might have two or more markers between packets)
-			while( (imarker < markers.size()) &&
-				(markers[imarker].m_offset >= lastoff) &&
-				(markers[imarker].m_offset < pack->m_offset) )
-			{
-				RowData row(wavetime, markers[imarker]);
-				row.m_height = padding*2 + lineheight;
-				totalHeight += row.m_height;
-				row.m_totalHeight = totalHeight;
-				m_rows.push_back(row);
+	@param query	Text to look for
+	@param stamp	Timestamp of the waveform to start from. Updated to the waveform containing the match
+	@param pack		Packet to start after (null to start at the beginning of the waveform). Updated to the match
 
-				imarker ++;
-			}
+	@return True if a match was found
+ */
+bool PacketManager::FindNext(const string& query, TimePoint& stamp, Packet*& pack)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
 
-			//See if we have child packets
-			auto children = m_filteredChildPackets[pack];
+	string text;
+	for(auto c : query)
+		text += tolower((unsigned char)c);
+	if(text.empty())
+		return false;
 
-			//Add an entry for the top level
-			RowData dat(wavetime, pack);
-			lastoff = pack->m_offset;
+	//See if the query can also be read as data bytes (hex digits, optionally with a 0x prefix and spaces)
+	vector<uint8_t> bytes;
+	string hex;
+	for(auto c : text)
+	{
+		if(!isspace(c))
+			hex += c;
+	}
+	if(hex.find("0x") == 0)
+		hex = hex.substr(2);
+	if(!hex.empty() && ((hex.length() % 2) == 0) && (hex.find_first_not_of("0123456789abcdef") == string::npos) )
+	{
+		for(size_t i=0; i<hex.length(); i += 2)
+			bytes.push_back(stoul(hex.substr(i, 2), nullptr, 16));
+	}
 
-			//Calculate row height
-			double height = padding*2 + lineheight;
+	//Index everything we already have, and anything that comes in from now on
+	m_searchIndexEnabled = true;
+	if(m_packets.empty())
+		return false;
 
-			//Integrate heights
-			dat.m_height = height;
-			totalHeight += height;
-			dat.m_totalHeight = totalHeight;
+	//Start just after the current packet, or at the first waveform if we don't have a valid starting point
+	auto it = m_packets.find(stamp);
+	size_t start = 0;
+	if(it == m_packets.end())
+		it = m_packets.begin();
+	else if(pack)
+	{
+		auto& index = GetSearchIndex(it->first);
+		auto oit = index.m_ordinals.find(pack);
+		if(oit != index.m_ordinals.end())
+			start = oit->second + 1;
+	}
 
-			//Save this row
-			m_rows.push_back(dat);
+	//Visit every waveform, wrapping around, and finish back at the starting one for anything before the start point
+	for(size_t n=0; n <= m_packets.size(); n++)
+	{
+		auto& index = GetSearchIndex(it->first);
+		for(size_t i = index.FindNext(text, bytes, start); i != SIZE_MAX; i = index.FindNext(text, bytes, i+1))
+		{
+			auto parent = index.m_packets[i].first;
+			auto hit = index.m_packets[i].second;
 
-			if(IsChildOpen(pack))
+			//Skip anything hidden by the display filter
+			if(m_filterExpression)
 			{
-				for(auto child : children)
+				auto chit = m_childPackets.find(hit);
+				auto cit = m_filteredChildPackets.find(hit);
+				if( (chit != m_childPackets.end()) && !chit->second.empty() )
 				{
-					//Add an entry for the top level
-					RowData cdat(wavetime, child);
-
-					//Calculate row height
-					height = padding*2 + lineheight;
+					if( (cit == m_filteredChildPackets.end()) || cit->second.empty() )
+						continue;
+				}
+				else if(!m_filterExpression->Match(hit))
+					continue;
+			}
 
-					//Integrate heights
-					cdat.m_height = height;
-					totalHeight += height;
-					cdat.m_totalHeight = totalHeight;
+			stamp = it->first;
+			pack = hit;
 
-					//Save this row
-					m_rows.push_back(cdat);
-				}
+			//Make sure the match is actually displayed
+			if(parent && !IsChildOpen(parent))
+			{
+				SetChildOpen(parent, true);
+				RemoveRows(stamp);
+				InsertRows(stamp);
 			}
+			return true;
 		}
+
+		start = 0;
+		it ++;
+		if(it == m_packets.end())
+			it = m_packets.begin();
 	}
 
-	LogTrace("%zu rows\n", m_rows.size());
+	return false;
 }
 
-void PacketManager::OnMarkerChanged()
-{
-	lock_guard<recursive_mutex> lock(m_mutex);
-	RefreshRows();
-}
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PacketSearchIndex
 
 /**
-	@brief Handle newly arrived waveform data (may be a change to parameters or a freshly arrived waveform)
+	@brief Indexes the packets from one waveform
+
+	@param packets		Top level packets from one waveform
+	@param childPackets	Merged child packets
  */
-void PacketManager::Update()
+void PacketSearchIndex::Build(
+	const vector<Packet*>& packets,
+	const map<Packet*, vector<Packet*> >& childPackets)
 {
-	//Do nothing if there's no waveform to get a timestamp from
-	auto data = m_filter->GetData(0);
-	if(!data)
-		return;
-	TimePoint time(data->m_startTimestamp, data->m_startFemtoseconds);
-
-	//If waveform is unchanged, no action needed
-	WaveformCacheKey key(data);
-	if(key == m_cachekey)
-		return;
-
-	LogTrace("Updating\n");
-
-	//If we get here, waveform changed. Update cache key
-	m_cachekey = key;
-
-	//Remove any old history we might have had from this timestamp
-	RemoveHistoryFrom(time);
+	m_packets.clear();
+	m_ordinals.clear();
+	m_trigrams.clear();
 
-	//Copy the new packets and detach them so the filter doesn't delete them.
-	//Do the merging now
+	for(auto p : packets)
 	{
-		lock_guard<recursive_mutex> lock(m_mutex);
+		m_packets.push_back(make_pair(nullptr, p));
+		auto it = childPackets.find(p);
+		if(it != childPackets.end())
+		{
+			for(auto c : it->second)
+				m_packets.push_back(make_pair(p, c));
+		}
+	}
 
-		auto& outpackets = m_packets[time];
-		outpackets.clear();
+	string lower;
+	for(uint32_t i=0; i<m_packets.size(); i++)
+	{
+		auto pack = m_packets[i].second;
+		m_ordinals[pack] = i;
 
-		auto& packets = m_filter->GetPackets();
-		auto npackets = packets.size();
-		Packet* parentOfGroup = nullptr;
-		Packet* firstChildPacketOfGroup = nullptr;
-		Packet* lastPacket = nullptr;
-		for(size_t i=0; i<npackets; i++)
+		//Index each header value separately so trigrams don't span two columns
+		for(auto& it : pack->m_headers)
 		{
-			auto p = packets[i];
+			lower.clear();
+			for(auto c : it.second)
+				lower += tolower((unsigned char)c);
+			AddTrigrams(i, DOMAIN_TEXT, reinterpret_cast<const uint8_t*>(lower.c_str()), lower.length());
+		}
 
-			//See if we should start a new merge group
-			bool starting_new_group;
-			if(i+1 >= npackets)									//No next packet to merge with
-				starting_new_group = false;
-			else if(!m_filter->CanMerge(p, p, packets[i+1]))	//This packet isn't compatible with the next
-				starting_new_group = false;
-			else if(firstChildPacketOfGroup == nullptr)			//If we get here, we're merging. But are we already?
-				starting_new_group = true;
-			else												//Already in a group, but it's not the same as the new one
-				starting_new_group = !m_filter->CanMerge(firstChildPacketOfGroup, lastPacket, p);
+		AddTrigrams(i, DOMAIN_DATA, pack->m_data.data(), pack->m_data.size());
+	}
+}
 
-			if(starting_new_group)
-			{
-				//Create the summary packet
-				firstChildPacketOfGroup = p;
-				parentOfGroup = m_filter->CreateMergedHeader(p, i);
-				outpackets.push_back(parentOfGroup);
-			}
+void PacketSearchIndex::AddTrigrams(uint32_t ordinal, uint32_t domain, const uint8_t* p, size_t len)
+{
+	for(size_t i=0; i+3 <= len; i++)
+	{
+		uint32_t key = (domain << 24) | (p[i] << 16) | (p[i+1] << 8) | p[i+2];
+		auto& list = m_trigrams[key];
+		if(list.empty() || (list.back() != ordinal))
+			list.push_back(ordinal);
+	}
+}
 
-			//End a merge group
-			else if( (firstChildPacketOfGroup != nullptr) && !m_filter->CanMerge(firstChildPacketOfGroup, lastPacket, p) )
-			{
-				firstChildPacketOfGroup = nullptr;
-				parentOfGroup = nullptr;
-			}
+/**
+	@brief Finds the first packet at or after start matching the query
 
-			//If we're a child of an group, add under the parent node
-			if(parentOfGroup)
-				m_childPackets[parentOfGroup].push_back(p);
+	@param text		Lowercase text to look for in header values
+	@param bytes	Bytes to look for in packet data (ignored if empty)
+	@param start	Index within m_packets to start at
 
-			//Otherwise add at the top level
-			else
-				outpackets.push_back(p);
+	@return Index within m_packets of the match, or SIZE_MAX if none
+ */
+size_t PacketSearchIndex::FindNext(const string& text, const vector<uint8_t>& bytes, size_t start) const
+{
+	size_t ret = FindNextCandidate(DOMAIN_TEXT, reinterpret_cast<const uint8_t*>(text.c_str()), text.length(), start);
+	if(!bytes.empty())
+		ret = min(ret, FindNextCandidate(DOMAIN_DATA, bytes.data(), bytes.size(), start));
+	return ret;
+}
 
-			lastPacket = p;
+size_t PacketSearchIndex::FindNextCandidate(uint32_t domain, const uint8_t* p, size_t len, size_t start) const
+{
+	//Too short to have any trigrams, check everything
+	if(len < 3)
+	{
+		for(size_t i=start; i<m_packets.size(); i++)
+		{
+			if(Matches(i, domain, p, len))
+				return i;
 		}
+		return SIZE_MAX;
+	}
+
+	//Only packets containing every trigram of the query can match, so walk the shortest posting list
+	const vector<uint32_t>* shortest = nullptr;
+	for(size_t i=0; i+3 <= len; i++)
+	{
+		uint32_t key = (domain << 24) | (p[i] << 16) | (p[i+1] << 8) | p[i+2];
+		auto it = m_trigrams.find(key);
+		if(it == m_trigrams.end())
+			return SIZE_MAX;
+		if(!shortest || (it->second.size() < shortest->size()) )
+			shortest = &it->second;
 	}
-	m_filter->DetachPackets();
 
-	//Run filters
-	FilterPackets();
+	for(auto it = lower_bound(shortest->begin(), shortest->end(), start); it != shortest->end(); it++)
+	{
+		if(Matches(*it, domain, p, len))
+			return *it;
+	}
+	return SIZE_MAX;
 }
 
 /**
-	@brief Run the filter expression against the packets
+	@brief Checks a candidate packet for an exact match
  */
-void PacketManager::FilterPackets()
+bool PacketSearchIndex::Matches(size_t ordinal, uint32_t domain, const uint8_t* p, size_t len) const
 {
-	//If we do NOT have a filter, early out: just copy stuff
-	if(m_filterExpression == nullptr)
-	{
-		m_filteredPackets = m_packets;
-		m_filteredChildPackets = m_childPackets;
+	auto pack = m_packets[ordinal].second;
 
-		//but still refresh the set of rows being displayed
-		RefreshRows();
+	if(domain == DOMAIN_DATA)
+		return search(pack->m_data.begin(), pack->m_data.end(), p, p+len) != pack->m_data.end();
 
-		return;
+	string needle(reinterpret_cast<const char*>(p), len);
+	for(auto& it : pack->m_headers)
+	{
+		string lower;
+		for(auto c : it.second)
+			lower += tolower((unsigned char)c);
+		if(lower.find(needle) != string::npos)
+			return true;
 	}
+	return false;
+}
 
-	//We have a filter! Start out by clearing output, then we can re-add the ones that match
-	m_filteredPackets.clear();
-	m_filteredChildPackets.clear();
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PacketArena
+
+/**
+	@brief Frees every packet we own
+ */
+void PacketArena::clear()
+{
+	for(auto p : m_packets)
+		delete p;
+	m_packets.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PacketOffsetIndex
 
-	//Check all top level packets against the filter
-	for(auto it : m_packets)
+/**
+	@brief Indexes the displayed packets from one waveform
+
+	@param packets		Displayed top level packets from one waveform
+	@param childPackets	Displayed child packets of each parent
+ */
+void PacketOffsetIndex::Build(
+	const vector<Packet*>& packets,
+	const map<Packet*, vector<Packet*> >& childPackets)
+{
+	m_packets.clear();
+	m_maxEnd.clear();
+
+	int64_t maxEnd = INT64_MIN;
+	auto add = [&](Packet* pack)
 	{
-		auto timestamp = it.first;
-		auto& packets = it.second;
-		for(auto p : packets)
-		{
-			//If no children, just check the top level packet for a match
-			if(m_childPackets[p].empty())
-			{
-				if(m_filterExpression->Match(p))
-					m_filteredPackets[timestamp].push_back(p);
-			}
+		maxEnd = max(maxEnd, pack->m_offset + pack->m_len);
+		m_packets.push_back(pack);
+		m_maxEnd.push_back(maxEnd);
+	};
 
-			//We have children.
-			//Check them for matches, and add the parent if any child matches
-			else
-			{
-				bool anyChildMatched = false;
-				for(auto c : m_childPackets[p])
-				{
-					if(m_filterExpression->Match(c))
-					{
-						m_filteredChildPackets[p].push_back(c);
-						anyChildMatched = true;
-					}
-				}
-				if(anyChildMatched)
-					m_filteredPackets[timestamp].push_back(p);
-			}
+	for(auto p : packets)
+	{
+		auto it = childPackets.find(p);
+		if(it != childPackets.end())
+		{
+			for(auto c : it->second)
+				add(c);
 		}
+		add(p);
 	}
+}
 
-	//Refresh the set of rows being displayed
-	RefreshRows();
+/**
+	@brief Finds the packet containing an offset
+
+	Gives the same result as walking the packets in hit test order and stopping at the first one which doesn't end
+	before the offset: that's a hit if it starts at or before the offset, and a miss otherwise.
+
+	@return The packet, or null if the offset falls between packets
+ */
+Packet* PacketOffsetIndex::Find(int64_t offset) const
+{
+	auto it = lower_bound(m_maxEnd.begin(), m_maxEnd.end(), offset);
+	if(it == m_maxEnd.end())
+		return nullptr;
+
+	auto pack = m_packets[it - m_maxEnd.begin()];
+	if(pack->m_offset > offset)
+		return nullptr;
+	return pack;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PacketColumnIndex
+
 /**
-	@brief Removes all history from the specified timestamp
+	@brief Indexes the values of one header column
+
+	@param column		Name of the header column
+	@param packets		Top level packets from one waveform
+	@param childPackets	Merged child packets
  */
-void PacketManager::RemoveHistoryFrom(TimePoint timestamp)
+void PacketColumnIndex::Build(
+	const string& column,
+	const vector<Packet*>& packets,
+	const map<Packet*, vector<Packet*> >& childPackets)
 {
-	lock_guard<recursive_mutex> lock(m_mutex);
+	m_values.clear();
+
+	//Packets lacking the header evaluate to "NaN" in the filter, so index them the same way
+	static const string nan = "NaN";
+	auto add = [&](Packet* parent, Packet* pack)
+	{
+		auto it = pack->m_headers.find(column);
+		if(it != pack->m_headers.end())
+			m_values[it->second].push_back(make_pair(parent, pack));
+		else
+			m_values[nan].push_back(make_pair(parent, pack));
+	};
 
-	auto& packets = m_packets[timestamp];
 	for(auto p : packets)
 	{
-		RemoveChildHistoryFrom(p);
-		delete p;
+		auto it = childPackets.find(p);
+		if( (it == childPackets.end()) || it->second.empty() )
+			add(nullptr, p);
+		else
+		{
+			for(auto c : it->second)
+				add(p, c);
+		}
 	}
-	m_packets.erase(timestamp);
 
-	m_filteredPackets.erase(timestamp);
-
-	//update the list of displayed rows so we don't have anything left pointing to stale packets
-	RefreshRows();
+	m_valid = true;
 }
 
-void PacketManager::RemoveChildHistoryFrom(Packet* pack)
+/**
+	@brief Drops everything we know about a top level packet's children
+
+	The packets themselves are owned by the waveform's PacketArena.
+ */
+void PacketManager::ForgetChildHistoryFrom(Packet* pack)
 {
 	//For now, we can only have one level of hierarchy
 	//so no need to check for children of children
-	auto& children = m_childPackets[pack];
-	for(auto p : children)
-		delete p;
 	m_childPackets.erase(pack);
 	m_filteredChildPackets.erase(pack);
 	m_lastChildOpen.erase(pack);
@@ -341,6 +1295,20 @@ void PacketManager::RemoveChildHistoryFrom(Packet* pack)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // ProtocolDisplayFilter
 
+//Constant results returned by reference from the filter expression evaluator
+static const string g_filterTrue = "1";
+static const string g_filterFalse = "0";
+static const string g_filterNaN = "NaN";
+
+///@brief Decimal strings for every byte value, so data[] lookups don't need to format anything
+static const vector<string> g_filterByteValues = []()
+{
+	vector<string> ret;
+	for(int i=0; i<256; i++)
+		ret.push_back(to_string(i));
+	return ret;
+}();
+
 ProtocolDisplayFilter::ProtocolDisplayFilter(string str, size_t& i)
 {
 	//One or more clauses separated by operators
@@ -369,6 +1337,21 @@ ProtocolDisplayFilter::ProtocolDisplayFilter(string str, size_t& i)
 			i++;
 		}
 		m_operators.push_back(tmp);
+
+		if(tmp == "==")
+			m_operatorTypes.push_back(OP_EQUAL);
+		else if(tmp == "!=")
+			m_operatorTypes.push_back(OP_NOT_EQUAL);
+		else if(tmp == "&&")
+			m_operatorTypes.push_back(OP_AND);
+		else if(tmp == "||")
+			m_operatorTypes.push_back(OP_OR);
+		else if(tmp == "startswith")
+			m_operatorTypes.push_back(OP_STARTSWITH);
+		else if(tmp == "contains")
+			m_operatorTypes.push_back(OP_CONTAINS);
+		else
+			m_operatorTypes.push_back(OP_INVALID);
 	}
 }
 
@@ -389,18 +1372,10 @@ bool ProtocolDisplayFilter::Validate(vector<string> headers, bool nakedLiteralOK
 		return false;
 
 	//Operators must make sense. For now only equal/unequal and boolean and/or allowed
-	for(auto op : m_operators)
-	{
-		if( (op != "==") &&
-			(op != "!=") &&
-			(op != "||") &&
-			(op != "&&") &&
-			(op != "startswith") &&
-			(op != "contains")
-		)
-		{
+	for(auto op : m_operatorTypes)
+	{
+		if(op == OP_INVALID)
 			return false;
-		}
 	}
 
 	//If any clause is invalid, we're invalid
@@ -430,51 +1405,112 @@ void ProtocolDisplayFilter::EatSpaces(string str, size_t& i)
 		i++;
 }
 
-bool ProtocolDisplayFilter::Match(const Packet* pack)
+bool ProtocolDisplayFilter::Match(const Packet* pack) const
 {
 	if(m_clauses.empty())
 		return true;
 	else
-		return Evaluate(pack) != "0";
+		return Resolve(pack) != g_filterFalse;
+}
+
+/**
+	@brief Checks if this filter is a single equality test of a header field against a literal (e.g. id == "0x123")
+
+	Filters of this form can be answered from a PacketColumnIndex rather than evaluated for every packet.
+
+	@param column	Name of the header field
+	@param value	Value it has to be equal to
+ */
+bool ProtocolDisplayFilter::GetEqualityMatch(string& column, string& value) const
+{
+	if( (m_clauses.size() != 2) || (m_operatorTypes.size() != 1) || (m_operatorTypes[0] != OP_EQUAL) )
+		return false;
+
+	auto lhs = m_clauses[0];
+	auto rhs = m_clauses[1];
+	if(lhs->m_type != ProtocolDisplayFilterClause::TYPE_IDENTIFIER)
+		swap(lhs, rhs);
+	if(lhs->m_type != ProtocolDisplayFilterClause::TYPE_IDENTIFIER)
+		return false;
+
+	switch(rhs->m_type)
+	{
+		case ProtocolDisplayFilterClause::TYPE_STRING:
+			value = rhs->m_string;
+			break;
+
+		case ProtocolDisplayFilterClause::TYPE_REAL:
+		case ProtocolDisplayFilterClause::TYPE_INT:
+			value = rhs->m_literal;
+			break;
+
+		default:
+			return false;
+	}
+
+	column = lhs->m_identifier;
+	return true;
 }
 
 string ProtocolDisplayFilter::Evaluate(const Packet* pack)
+{
+	return Resolve(pack);
+}
+
+/**
+	@brief Evaluates the expression against a packet
+
+	Returns a reference to a string that already exists (a header value in the packet, a literal, or one of the
+	constant results) rather than building a new one, so matching doesn't allocate per packet.
+ */
+const string& ProtocolDisplayFilter::Resolve(const Packet* pack) const
 {
 	//Calling code checks for validity so no need to verify here
 
 	//For now, all operators have equal precedence and are evaluated left to right.
-	string current = m_clauses[0]->Evaluate(pack);
+	const string* current = &m_clauses[0]->Resolve(pack);
 	for(size_t i=1; i<m_clauses.size(); i++)
 	{
-		string rhs = m_clauses[i]->Evaluate(pack);
-		string op = m_operators[i-1];
-
-		bool a = (current != "0");
-		bool b = (rhs != "0");
+		auto& rhs = m_clauses[i]->Resolve(pack);
 
-		//== and != do exact string equality checks
 		bool temp = false;
-		if(op == "==")
-			temp = (current == rhs);
-		else if(op == "!=")
-			temp = (current != rhs);
-
-		//&& and || do boolean operations
-		else if(op == "&&")
-			temp = (a && b);
-		else if(op == "||")
-			temp = (a || b);
-
-		//String prefix
-		else if(op == "startswith")
-			temp = (current.find(rhs) == 0);
-		else if(op == "contains")
-			temp = (current.find(rhs) != string::npos);
+		switch(m_operatorTypes[i-1])
+		{
+			//== and != do exact string equality checks
+			case OP_EQUAL:
+				temp = (*current == rhs);
+				break;
+
+			case OP_NOT_EQUAL:
+				temp = (*current != rhs);
+				break;
+
+			//&& and || do boolean operations
+			case OP_AND:
+				temp = (*current != g_filterFalse) && (rhs != g_filterFalse);
+				break;
+
+			case OP_OR:
+				temp = (*current != g_filterFalse) || (rhs != g_filterFalse);
+				break;
+
+			//String prefix
+			case OP_STARTSWITH:
+				temp = (current->compare(0, rhs.length(), rhs) == 0);
+				break;
+
+			case OP_CONTAINS:
+				temp = (current->find(rhs) != string::npos);
+				break;
+
+			default:
+				break;
+		}
 
 		//done, convert back to string
-		current = temp ? "1" : "0";
+		current = temp ? &g_filterTrue : &g_filterFalse;
 	}
-	return current;
+	return *current;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -548,10 +1584,12 @@ ProtocolDisplayFilterClause::ProtocolDisplayFilterClause(string str, size_t& i)
 		}
 
 		//Hex string
+		char buf[32];
 		if(tmp.find("0x") == 0)
 		{
 			sscanf(tmp.c_str(), "%lx", (unsigned long*)&m_long);
 			m_type = TYPE_INT;
+			snprintf(buf, sizeof(buf), "%ld", m_long);
 		}
 
 		//Number with decimal point
@@ -559,14 +1597,18 @@ ProtocolDisplayFilterClause::ProtocolDisplayFilterClause(string str, size_t& i)
 		{
 			m_real = atof(tmp.c_str());
 			m_type = TYPE_REAL;
+			snprintf(buf, sizeof(buf), "%f", m_real);
 		}
 
 		//Number without decimal point
 		else
 		{
-			m_real = atol(tmp.c_str());
+			m_long = atol(tmp.c_str());
+			m_real = m_long;
 			m_type = TYPE_INT;
+			snprintf(buf, sizeof(buf), "%ld", m_long);
 		}
+		m_literal = buf;
 	}
 
 	//Identifier (or data)
@@ -631,20 +1673,25 @@ string ProtocolDisplayFilterClause::EatSpaces(string str)
 
 string ProtocolDisplayFilterClause::Evaluate(const Packet* pack)
 {
-	char tmp[32];
+	return Resolve(pack);
+}
 
+/**
+	@brief Evaluates the clause against a packet without making a copy of the result
+ */
+const string& ProtocolDisplayFilterClause::Resolve(const Packet* pack) const
+{
 	switch(m_type)
 	{
 		case TYPE_DATA:
 			{
-				string sindex = m_expression->Evaluate(pack);
-				int index = atoi(sindex.c_str());
+				int index = atoi(m_expression->Resolve(pack).c_str());
 
 				//Bounds check
-				if(pack->m_data.size() <= (size_t)index)
-					return "NaN";
+				if( (index < 0) || (pack->m_data.size() <= (size_t)index) )
+					return g_filterNaN;
 
-				return to_string(pack->m_data[index]);
+				return g_filterByteValues[pack->m_data[index]];
 			}
 			break;
 
@@ -654,38 +1701,34 @@ string ProtocolDisplayFilterClause::Evaluate(const Packet* pack)
 				if(it != pack->m_headers.end())
 					return it->second;
 				else
-					return "NaN";
+					return g_filterNaN;
 			}
 
 		case TYPE_STRING:
 			return m_string;
 
 		case TYPE_REAL:
-			snprintf(tmp, sizeof(tmp), "%f", m_real);
-			return tmp;
-
 		case TYPE_INT:
-			snprintf(tmp, sizeof(tmp), "%ld", m_long);
-			return tmp;
+			return m_literal;
 
 		case TYPE_EXPRESSION:
 			if(m_invert)
 			{
-				if(m_expression->Evaluate(pack) == "1")
-					return "0";
+				if(m_expression->Resolve(pack) == g_filterTrue)
+					return g_filterFalse;
 				else
-					return "1";
+					return g_filterTrue;
 			}
 			else
-				return m_expression->Evaluate(pack);
+				return m_expression->Resolve(pack);
 
 		case TYPE_ERROR:
 		default:
-			return "NaN";
+			return g_filterNaN;
 	}
 
 	//never happens because of the 'default" clause, but prevents -Wreturn-type warning with some gcc versions
-	return "NaN";
+	return g_filterNaN;
 }
 
 ProtocolDisplayFilterClause::~ProtocolDisplayFilterClause()
@@ -38,6 +38,9 @@
 #include "../../lib/scopehal/PacketDecoder.h"
 #include "Marker.h"
 #include "TextureManager.h"
+#include "PacketExporter.h"
+
+#include <unordered_map>
 
 class Session;
 
@@ -53,6 +56,8 @@ public:
 	, m_stamp(0, 0)
 	, m_packet(nullptr)
 	, m_marker(TimePoint(0,0), 0, "")
+	, m_scanlineSlot(0)
+	, m_scanlineSerial(0)
 	{}
 
 	RowData(TimePoint t, Packet* p)
@@ -61,6 +66,8 @@ public:
 	, m_stamp(t)
 	, m_packet(p)
 	, m_marker(t, 0, "")
+	, m_scanlineSlot(0)
+	, m_scanlineSerial(0)
 	{}
 
 	RowData(TimePoint t, Marker m)
@@ -69,6 +76,8 @@ public:
 	, m_stamp(t)
 	, m_packet(nullptr)
 	, m_marker(m)
+	, m_scanlineSlot(0)
+	, m_scanlineSerial(0)
 	{}
 
 	///@brief Height of this row
@@ -86,8 +95,94 @@ public:
 	///@brief The marker in this row (ignored if m_packet is valid)
 	Marker m_marker;
 
-	///@brief Texture containing the scanline image for this row (only valid if m_packet is a VideoScanlinePacket)
-	std::shared_ptr<Texture> m_texture;
+	///@brief Row of the dialog's scanline atlas holding this row's image (only used for VideoScanlinePacket)
+	size_t m_scanlineSlot;
+
+	///@brief Serial number of this row's image in the scanline atlas, or zero if it hasn't been uploaded
+	uint64_t m_scanlineSerial;
+};
+
+/**
+	@brief Index of the values of a single header column, for the packets from one waveform
+
+	Packets with children are indexed by their children's values (as the display filter only checks the children).
+ */
+class PacketColumnIndex
+{
+public:
+	PacketColumnIndex()
+	: m_valid(false)
+	{}
+
+	void Build(
+		const std::string& column,
+		const std::vector<Packet*>& packets,
+		const std::map<Packet*, std::vector<Packet*> >& childPackets);
+
+	///@brief True once Build() has been run
+	bool m_valid;
+
+	/**
+		@brief Map of header values to (parent, packet) pairs, in display order
+
+		Parent is null for top level packets.
+	 */
+	std::unordered_map<std::string, std::vector<std::pair<Packet*, Packet*> > > m_values;
+};
+
+/**
+	@brief Index of the displayed packets from one waveform by their position in the waveform, for cursor lookups
+
+	Children are checked before their parent, so a cursor over a merged group picks out the child under it.
+ */
+class PacketOffsetIndex
+{
+public:
+	void Build(
+		const std::vector<Packet*>& packets,
+		const std::map<Packet*, std::vector<Packet*> >& childPackets);
+
+	Packet* Find(int64_t offset) const;
+
+protected:
+	///@brief Packets in hit test order: each parent's children, then the parent itself
+	std::vector<Packet*> m_packets;
+
+	///@brief Largest end offset of any packet in m_packets up to and including each index (so it never decreases)
+	std::vector<int64_t> m_maxEnd;
+};
+
+/**
+	@brief Trigram index over the header text and data bytes of the packets from one waveform, for find-next
+ */
+class PacketSearchIndex
+{
+public:
+	void Build(
+		const std::vector<Packet*>& packets,
+		const std::map<Packet*, std::vector<Packet*> >& childPackets);
+
+	size_t FindNext(const std::string& text, const std::vector<uint8_t>& bytes, size_t start) const;
+
+	///@brief Packets in display order, as (parent, packet) pairs. Parent is null for top level packets
+	std::vector<std::pair<Packet*, Packet*> > m_packets;
+
+	///@brief Index of each packet within m_packets
+	std::unordered_map<Packet*, uint32_t> m_ordinals;
+
+protected:
+	void AddTrigrams(uint32_t ordinal, uint32_t domain, const uint8_t* p, size_t len);
+	size_t FindNextCandidate(uint32_t domain, const uint8_t* p, size_t len, size_t start) const;
+	bool Matches(size_t ordinal, uint32_t domain, const uint8_t* p, size_t len) const;
+
+	enum
+	{
+		DOMAIN_TEXT,
+		DOMAIN_DATA
+	};
+
+	///@brief Map of trigrams (tagged with the domain they came from) to ascending indexes within m_packets
+	std::unordered_map<uint32_t, std::vector<uint32_t> > m_trigrams;
 };
 
 class ProtocolDisplayFilter;
@@ -104,6 +199,7 @@ public:
 	bool Validate(std::vector<std::string> headers);
 
 	std::string Evaluate(const Packet* pack);
+	const std::string& Resolve(const Packet* pack) const;
 
 	static std::string EatSpaces(std::string str);
 
@@ -124,6 +220,9 @@ public:
 	long m_long;
 	ProtocolDisplayFilter* m_expression;
 	bool m_invert;
+
+	///@brief Numeric literals formatted once at parse time, so evaluation doesn't have to
+	std::string m_literal;
 };
 
 class ProtocolDisplayFilter
@@ -138,12 +237,63 @@ public:
 
 	bool Validate(std::vector<std::string> headers, bool nakedLiteralOK = false);
 
-	bool Match(const Packet* pack);
+	bool Match(const Packet* pack) const;
+	bool GetEqualityMatch(std::string& column, std::string& value) const;
 	std::string Evaluate(const Packet* pack);
+	const std::string& Resolve(const Packet* pack) const;
 
 protected:
 	std::vector<ProtocolDisplayFilterClause*> m_clauses;
 	std::vector<std::string> m_operators;
+
+	enum OperatorType
+	{
+		OP_EQUAL,
+		OP_NOT_EQUAL,
+		OP_AND,
+		OP_OR,
+		OP_STARTSWITH,
+		OP_CONTAINS,
+		OP_INVALID
+	};
+
+	///@brief Operators decoded from m_operators, so evaluation doesn't need string compares
+	std::vector<OperatorType> m_operatorTypes;
+};
+
+/**
+	@brief Owns every packet from one waveform: top level packets, merged headers, and their children
+
+	The packets are allocated by the decoder, so this can't make them contiguous, but it lets a whole waveform's worth
+	be freed in one pass without looking each one up in the child packet map first.
+ */
+class PacketArena
+{
+public:
+	PacketArena()
+	{}
+
+	~PacketArena()
+	{ clear(); }
+
+	PacketArena(const PacketArena&) =delete;
+	PacketArena& operator=(const PacketArena&) =delete;
+
+	///@brief Takes ownership of a packet
+	void push_back(Packet* pack)
+	{ m_packets.push_back(pack); }
+
+	void reserve(size_t n)
+	{ m_packets.reserve(n); }
+
+	size_t size() const
+	{ return m_packets.size(); }
+
+	void clear();
+
+protected:
+	///@brief Packets we own, in the order they were added
+	std::vector<Packet*> m_packets;
 };
 
 /**
@@ -156,6 +306,8 @@ public:
 	virtual ~PacketManager();
 
 	void Update();
+	void ReplacePackets(TimePoint time, const std::vector<Packet*>& packets);
+	void OnOutputRestored();
 	void RemoveHistoryFrom(TimePoint timestamp);
 
 	std::recursive_mutex& GetMutex()
@@ -173,16 +325,15 @@ public:
 	const std::vector<Packet*>& GetFilteredChildPackets(Packet* pack)
 	{ return m_filteredChildPackets[pack]; }
 
-	/**
-		@brief Sets the current filter expression
-	 */
-	void SetDisplayFilter(std::shared_ptr<ProtocolDisplayFilter> filter)
-	{
-		m_filterExpression = filter;
-		FilterPackets();
-	}
+	void SetDisplayFilter(std::shared_ptr<ProtocolDisplayFilter> filter);
+	bool PollFilterResults();
+
+	///@brief Returns true if a display filter is still being applied in the background
+	bool IsFiltering()
+	{ return m_filterThread && !m_filterDone; }
 
 	void FilterPackets();
+	void FilterPackets(TimePoint timestamp);
 
 	bool IsChildOpen(Packet* pack)
 	{ return m_lastChildOpen[pack]; }
@@ -193,10 +344,35 @@ public:
 	std::vector<RowData>& GetRows()
 	{ return m_rows; }
 
+	const RowData* GetRowForPacket(TimePoint stamp, Packet* pack);
+	Packet* FindPacketAtOffset(TimePoint stamp, int64_t offset);
+
+	bool FindNext(const std::string& query, TimePoint& stamp, Packet*& pack);
+
+	bool StartExport(const std::string& path, PacketExporter::Format format);
+	void StopExport();
+
+	///@brief Returns the exporter currently logging packets to disk, if any
+	std::shared_ptr<PacketExporter> GetExporter()
+	{ return m_exporter; }
+
 	void OnMarkerChanged();
 
 protected:
-	void RemoveChildHistoryFrom(Packet* pack);
+	void AddPackets(TimePoint time, const std::vector<Packet*>& packets, bool merge);
+	void ForgetChildHistoryFrom(Packet* pack);
+
+	void MatchPackets(
+		const std::vector<Packet*>& packets,
+		std::vector<Packet*>& filtered,
+		std::vector< std::pair<Packet*, std::vector<Packet*> > >& filteredChildren);
+	bool PrepareColumnIndex(std::string& value);
+	void MatchPacketsIndexed(
+		PacketColumnIndex& index,
+		const std::vector<Packet*>& packets,
+		const std::string& value,
+		std::vector<Packet*>& filtered,
+		std::vector< std::pair<Packet*, std::vector<Packet*> > >& filteredChildren);
 
 	///@brief Parent session object
 	Session& m_session;
@@ -207,12 +383,15 @@ protected:
 	///@brief The filter we're managing
 	PacketDecoder* m_filter;
 
-	///@brief Our saved packet data
+	///@brief Our saved packet data (ordered, since rows are built from it oldest first)
 	std::map<TimePoint, std::vector<Packet*> > m_packets;
 
 	///@brief Merged child packets
 	std::map<Packet*, std::vector<Packet*> > m_childPackets;
 
+	///@brief Storage for every packet in m_packets and m_childPackets, by waveform timestamp
+	std::unordered_map<TimePoint, PacketArena, TimePointHash> m_arenas;
+
 	///@brief Subset of m_packets that passed the current filter expression
 	std::map<TimePoint, std::vector<Packet*> > m_filteredPackets;
 
@@ -225,9 +404,76 @@ protected:
 	///@brief Current filter expression
 	std::shared_ptr<ProtocolDisplayFilter> m_filterExpression;
 
+	void FilterThread(std::vector<TimePoint> times);
+	void CancelFilterThread();
+
+	/**
+		@brief Packets from one waveform that matched the display filter, waiting to be published
+	 */
+	class FilterResult
+	{
+	public:
+		FilterResult(TimePoint t)
+		: m_stamp(t)
+		{}
+
+		TimePoint m_stamp;
+		std::vector<Packet*> m_packets;
+		std::vector< std::pair<Packet*, std::vector<Packet*> > > m_children;
+	};
+
+	///@brief Results from the background filter thread not yet merged into m_filteredPackets (protected by m_mutex)
+	std::vector<FilterResult> m_pendingFilterResults;
+
+	///@brief Background thread applying a new display filter
+	std::unique_ptr<std::thread> m_filterThread;
+
+	///@brief Set to abort the background filter thread
+	std::atomic<bool> m_cancelFilter;
+
+	///@brief Set by the background filter thread when it's finished
+	std::atomic<bool> m_filterDone;
+
+	PacketSearchIndex& GetSearchIndex(TimePoint stamp);
+
+	///@brief Set once find-next has been used, so new waveforms get indexed as they arrive
+	bool m_searchIndexEnabled;
+
+	///@brief Per-waveform search indexes
+	std::unordered_map<TimePoint, PacketSearchIndex, TimePointHash> m_searchIndexes;
+
+	///@brief Exporter logging every decoded packet to disk, if any
+	std::shared_ptr<PacketExporter> m_exporter;
+
+	///@brief Header column m_columnIndexes is built for (empty if none)
+	std::string m_indexColumn;
+
+	///@brief Per-waveform indexes of m_indexColumn, used for simple equality filters
+	std::unordered_map<TimePoint, PacketColumnIndex, TimePointHash> m_columnIndexes;
+
+	/**
+		@brief Per-waveform indexes of the displayed packets by offset
+
+		Dropped whenever a waveform's filtered packets change, and rebuilt the next time the cursor is looked up.
+	 */
+	std::unordered_map<TimePoint, PacketOffsetIndex, TimePointHash> m_offsetIndexes;
+
 	///@brief Update the list of rows being displayed
 	void RefreshRows();
 
+	bool RefreshRowsSlice(double deadline);
+
+	///@brief Last waveform whose rows were rebuilt by a refresh spread over several frames (protected by m_mutex)
+	TimePoint m_rowRefreshCursor;
+
+	///@brief True if the next slice of a spread out refresh should start over from the first waveform
+	bool m_rowRefreshRestart;
+
+	void AppendRows(TimePoint wavetime, std::vector<RowData>& rows, double& totalHeight);
+	std::pair<std::vector<RowData>::iterator, std::vector<RowData>::iterator> FindRows(TimePoint wavetime);
+	void RemoveRows(TimePoint wavetime);
+	void InsertRows(TimePoint wavetime);
+
 	///@brief The set of rows that are to be displayed, based on current tree expansion and filter state
 	std::vector<RowData> m_rows;
 
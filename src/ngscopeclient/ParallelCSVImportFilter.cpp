@@ -0,0 +1,164 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ParallelCSVImportFilter
+ */
+
+#include "ngscopeclient.h"
+#include "ParallelCSVImportFilter.h"
+#include "CSVParser.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ParallelCSVImportFilter::ParallelCSVImportFilter(const string& color)
+	: ImportFilter(color)
+{
+	m_fpname = "CSV File";
+	m_parameters[m_fpname] = FilterParameter(FilterParameter::TYPE_FILENAME, Unit(Unit::UNIT_COUNTS));
+	m_parameters[m_fpname].m_fileFilterMask = "*.csv";
+	m_parameters[m_fpname].m_fileFilterName = "Comma Separated Value files (*.csv)";
+	m_parameters[m_fpname].signal_changed().connect(
+		sigc::mem_fun(*this, &ParallelCSVImportFilter::OnFileNameChanged));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+string ParallelCSVImportFilter::GetProtocolName()
+{
+	return "Parallel CSV Import";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Actual decoder logic
+
+void ParallelCSVImportFilter::OnFileNameChanged()
+{
+	auto fname = m_parameters[m_fpname].ToString();
+	if(fname.empty())
+		return;
+
+	LogTrace("Importing %s\n", fname.c_str());
+	LogIndenter li;
+
+	double tstart = GetTime();
+	CSVParser parser;
+	if(!parser.Load(fname))
+	{
+		LogError("%s\n", parser.GetError().c_str());
+		return;
+	}
+	double tparse = GetTime() - tstart;
+
+	ClearStreams();
+	for(auto& name : parser.m_names)
+		AddStream(Unit(Unit::UNIT_VOLTS), name, Stream::STREAM_TYPE_ANALOG);
+
+	//See if the samples are evenly spaced
+	auto& t = parser.m_timestamps;
+	size_t len = t.size();
+	double t0 = t[0];
+	double dt = (len > 1) ? (t[len-1] - t0) / (len - 1) : 0;
+	double tolerance = fabs(dt) * 0.01;
+	size_t irregular = 0;
+	if(dt <= 0)
+		irregular = 1;
+	else
+	{
+		#pragma omp parallel for reduction(+:irregular)
+		for(size_t i=1; i<len; i++)
+		{
+			if(fabs( (t[i] - t[i-1]) - dt) > tolerance)
+				irregular ++;
+		}
+	}
+
+	auto trigphase = llround(t0 * FS_PER_SECOND);
+	auto now = time(nullptr);
+	if(irregular == 0)
+	{
+		auto timescale = llround(dt * FS_PER_SECOND);
+		for(size_t i=0; i<parser.m_columns.size(); i++)
+		{
+			auto wfm = new UniformAnalogWaveform;
+			wfm->m_timescale = timescale;
+			wfm->m_triggerPhase = trigphase;
+			wfm->m_startTimestamp = now;
+			wfm->m_startFemtoseconds = 0;
+			wfm->PrepareForCpuAccess();
+			wfm->Resize(len);
+			memcpy(wfm->m_samples.GetCpuPointer(), parser.m_columns[i].data(), len * sizeof(float));
+			wfm->MarkModifiedFromCpu();
+			SetData(wfm, i);
+		}
+	}
+
+	else
+	{
+		//Every stream shares the same timestamps, so only convert them once
+		vector<int64_t> offsets(len);
+		vector<int64_t> durations(len);
+		#pragma omp parallel for
+		for(size_t i=0; i<len; i++)
+			offsets[i] = llround( (t[i] - t0) * FS_PER_SECOND);
+		#pragma omp parallel for
+		for(size_t i=0; i+1<len; i++)
+			durations[i] = max<int64_t>(1, offsets[i+1] - offsets[i]);
+		durations[len-1] = (len > 1) ? durations[len-2] : 1;
+
+		for(size_t i=0; i<parser.m_columns.size(); i++)
+		{
+			auto wfm = new SparseAnalogWaveform;
+			wfm->m_timescale = 1;
+			wfm->m_triggerPhase = trigphase;
+			wfm->m_startTimestamp = now;
+			wfm->m_startFemtoseconds = 0;
+			wfm->PrepareForCpuAccess();
+			wfm->Resize(len);
+			memcpy(wfm->m_offsets.GetCpuPointer(), offsets.data(), len * sizeof(int64_t));
+			memcpy(wfm->m_durations.GetCpuPointer(), durations.data(), len * sizeof(int64_t));
+			memcpy(wfm->m_samples.GetCpuPointer(), parser.m_columns[i].data(), len * sizeof(float));
+			wfm->MarkModifiedFromCpu();
+			SetData(wfm, i);
+		}
+	}
+
+	LogTrace("Parsed %zu rows x %zu columns in %.3f ms (%zu bad lines), %s\n",
+		len,
+		parser.m_columns.size(),
+		tparse * 1000,
+		parser.GetBadLineCount(),
+		irregular ? "sparse" : "uniform");
+}
@@ -0,0 +1,203 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PathAutotuner
+ */
+
+#include "ngscopeclient.h"
+#include "PathAutotuner.h"
+#include "PreferenceManager.h"
+
+using namespace std;
+
+///@brief Preference the crossovers are persisted in
+#define AUTOTUNE_PREF "Performance.Autotuning.crossovers"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+PathAutotuner::PathAutotuner(PreferenceManager& prefs)
+	: m_prefs(prefs)
+{
+	//Driver updates can move the crossover, so include the driver version with the device
+	auto props = g_vkComputePhysicalDevice->getProperties();
+	char tmp[128];
+	snprintf(tmp, sizeof(tmp), " [%04x:%04x, driver %08x]", props.vendorID, props.deviceID, props.driverVersion);
+	m_device = string(props.deviceName.data()) + tmp;
+
+	Load();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decisions
+
+/**
+	@brief Gets the size bucket for a problem size (log2, rounded down)
+ */
+int PathAutotuner::GetBucket(uint64_t size)
+{
+	int bucket = 0;
+	while(size > 1)
+	{
+		size >>= 1;
+		bucket ++;
+	}
+	return bucket;
+}
+
+/**
+	@brief Decides which implementation of an operation to run
+
+	@param op	Name of the operation
+	@param size	Amount of work to do, in whatever units the operation scales with
+ */
+PathAutotuner::Path PathAutotuner::Choose(const string& op, uint64_t size)
+{
+	if(!m_prefs.GetBool("Performance.Autotuning.enable"))
+		return PATH_GPU;
+
+	int bucket = GetBucket(size);
+
+	lock_guard<mutex> lock(m_mutex);
+	auto& c = m_crossovers[m_device][op];
+	if(bucket <= c.m_lastCpuWin)
+		return PATH_CPU;
+	if(bucket >= c.m_firstGpuWin)
+		return PATH_GPU;
+	return PATH_MEASURE;
+}
+
+/**
+	@brief Reports how long each implementation took, after Choose() returned PATH_MEASURE
+
+	@param op		Name of the operation
+	@param size		Amount of work done, as passed to Choose()
+	@param cpuTime	Run time of the CPU implementation, in seconds
+	@param gpuTime	Run time of the GPU implementation, in seconds
+ */
+void PathAutotuner::Report(const string& op, uint64_t size, double cpuTime, double gpuTime)
+{
+	int bucket = GetBucket(size);
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto& c = m_crossovers[m_device][op];
+
+		//Keep the crossover consistent if a noisy measurement contradicts an earlier one: trust the newest
+		if(cpuTime < gpuTime)
+		{
+			c.m_lastCpuWin = max(c.m_lastCpuWin, bucket);
+			c.m_firstGpuWin = max(c.m_firstGpuWin, bucket + 1);
+		}
+		else
+		{
+			c.m_firstGpuWin = min(c.m_firstGpuWin, bucket);
+			c.m_lastCpuWin = min(c.m_lastCpuWin, bucket - 1);
+		}
+
+		LogTrace("Autotune %s at 2^%d: CPU %.3f ms, GPU %.3f ms (CPU up to 2^%d, GPU from 2^%d)\n",
+			op.c_str(), bucket, cpuTime * 1e3, gpuTime * 1e3, c.m_lastCpuWin, c.m_firstGpuWin);
+	}
+
+	Save();
+}
+
+/**
+	@brief Gets the crossovers measured for the current device
+ */
+map<string, AutotuneCrossover> PathAutotuner::GetCrossovers()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_crossovers[m_device];
+}
+
+/**
+	@brief Forgets everything measured for the current device, so it's measured again on next use
+ */
+void PathAutotuner::Reset()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_crossovers.erase(m_device);
+	}
+	Save();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Serialization
+
+/**
+	@brief Loads crossovers from preferences
+
+	Stored as one "device|operation|lastCpuWin|firstGpuWin" record per line.
+ */
+void PathAutotuner::Load()
+{
+	stringstream ss(m_prefs.GetString(AUTOTUNE_PREF));
+	string line;
+	while(getline(ss, line))
+	{
+		auto a = line.find('|');
+		auto b = line.find('|', a + 1);
+		auto c = line.find('|', b + 1);
+		if( (a == string::npos) || (b == string::npos) || (c == string::npos) )
+			continue;
+
+		AutotuneCrossover x;
+		x.m_lastCpuWin = atoi(line.substr(b + 1, c - b - 1).c_str());
+		x.m_firstGpuWin = atoi(line.substr(c + 1).c_str());
+		m_crossovers[line.substr(0, a)][line.substr(a + 1, b - a - 1)] = x;
+	}
+}
+
+/**
+	@brief Writes crossovers for every device back to preferences
+ */
+void PathAutotuner::Save()
+{
+	string str;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		for(auto& dev : m_crossovers)
+		{
+			for(auto& op : dev.second)
+			{
+				str += dev.first + "|" + op.first + "|" +
+					to_string(op.second.m_lastCpuWin) + "|" + to_string(op.second.m_firstGpuWin) + "\n";
+			}
+		}
+	}
+
+	m_prefs.AllPreferences().GetLeaf(AUTOTUNE_PREF).SetString(str);
+	m_prefs.SavePreferences();
+}
@@ -0,0 +1,113 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of PathAutotuner
+ */
+#ifndef PathAutotuner_h
+#define PathAutotuner_h
+
+class PreferenceManager;
+
+/**
+	@brief Crossover between the CPU and GPU implementations of one operation on one device
+
+	Sizes are bucketed by powers of two. GPU paths have a fixed dispatch overhead and CPU paths don't, so we assume
+	there's a single crossover: the CPU wins for everything up to some size and the GPU wins for everything above.
+ */
+class AutotuneCrossover
+{
+public:
+	AutotuneCrossover()
+	: m_lastCpuWin(-1)
+	, m_firstGpuWin(INT_MAX)
+	{}
+
+	///@brief Largest size bucket the CPU path was measured to be faster at (-1 if none)
+	int m_lastCpuWin;
+
+	///@brief Smallest size bucket the GPU path was measured to be faster at (INT_MAX if none)
+	int m_firstGpuWin;
+};
+
+/**
+	@brief Chooses between the CPU and GPU implementations of an operation, based on measurements
+
+	The first time an operation runs at a size we don't know the answer for, the caller is asked to run both paths
+	and report how long each took. The crossover is saved per GPU in preferences so it's only ever measured once.
+ */
+class PathAutotuner
+{
+public:
+	PathAutotuner(PreferenceManager& prefs);
+
+	enum Path
+	{
+		///@brief Run the CPU implementation
+		PATH_CPU,
+
+		///@brief Run the GPU implementation
+		PATH_GPU,
+
+		///@brief Run both, and report the time each took with Report()
+		PATH_MEASURE
+	};
+
+	Path Choose(const std::string& op, uint64_t size);
+	void Report(const std::string& op, uint64_t size, double cpuTime, double gpuTime);
+
+	std::map<std::string, AutotuneCrossover> GetCrossovers();
+	void Reset();
+
+	///@brief Gets the name of the device crossovers are being recorded for
+	const std::string& GetDeviceName() const
+	{ return m_device; }
+
+	static int GetBucket(uint64_t size);
+
+protected:
+	void Load();
+	void Save();
+
+	PreferenceManager& m_prefs;
+
+	///@brief Identifies the GPU in the persisted crossovers
+	std::string m_device;
+
+	///@brief Crossovers for every operation on every device, keyed by device then operation
+	std::map<std::string, std::map<std::string, AutotuneCrossover>> m_crossovers;
+
+	///@brief Mutex controlling access to m_crossovers
+	std::mutex m_mutex;
+};
+
+#endif
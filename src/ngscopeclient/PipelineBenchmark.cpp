@@ -0,0 +1,482 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PipelineBenchmark
+ */
+#include "ngscopeclient.h"
+#include "PipelineBenchmark.h"
+#include "MainWindow.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PipelineBenchmarkConfig
+
+/**
+	@brief Parses the whole of an argument as an unsigned integer
+
+	@throw invalid_argument if it's negative, or has anything after the number
+ */
+static uint64_t ParseUnsignedValue(const string& v)
+{
+	if(!v.empty() && (v[0] == '-'))
+		throw invalid_argument(v);
+
+	size_t end;
+	uint64_t ret = stoull(v, &end);
+	if(end != v.size())
+		throw invalid_argument(v);
+	return ret;
+}
+
+/**
+	@brief Parses the whole of an argument as a floating point number
+
+	@throw invalid_argument if it has anything after the number
+ */
+static double ParseDoubleValue(const string& v)
+{
+	size_t end;
+	double ret = stod(v, &end);
+	if(end != v.size())
+		throw invalid_argument(v);
+	return ret;
+}
+
+/**
+	@brief Parses a single benchmark-related command line argument
+
+	Arguments with a bad value are still consumed, and the problem is recorded in m_usageError.
+
+	@return True if the argument was consumed (i is advanced past any value it took)
+ */
+bool PipelineBenchmarkConfig::ParseArgument(int& i, int argc, char* argv[])
+{
+	string s(argv[i]);
+
+	if(s == "--benchmark")
+	{
+		m_enabled = true;
+		return true;
+	}
+
+	//Everything else takes a value
+	if(i+1 >= argc)
+		return false;
+	string v(argv[i+1]);
+
+	try
+	{
+		if(s == "--bench-channels")
+			m_channels = max<size_t>(1, ParseUnsignedValue(v));
+		else if(s == "--bench-depth")
+			m_depth = max<uint64_t>(1, ParseUnsignedValue(v));
+		else if(s == "--bench-rate")
+			m_triggerRate = ParseDoubleValue(v);
+		else if(s == "--bench-warmup")
+			m_warmup = ParseDoubleValue(v);
+		else if(s == "--bench-duration")
+			m_duration = ParseDoubleValue(v);
+		else if(s == "--bench-json")
+			m_jsonPath = v;
+		else if(s == "--bench-pressure-step")
+			m_pressureStep = static_cast<size_t>(Unit(Unit::UNIT_BYTES).ParseString(v));
+		else if(s == "--bench-pressure-interval")
+			m_pressureInterval = max(0.01, ParseDoubleValue(v));
+		else if(s == "--bench-pressure-max")
+			m_pressureMax = static_cast<size_t>(Unit(Unit::UNIT_BYTES).ParseString(v));
+		else if(s == "--bench-pressure-type")
+		{
+			if(v == "host")
+				m_pressureType = MemoryPressureType::Host;
+			else if(v == "device")
+				m_pressureType = MemoryPressureType::Device;
+			else if(m_usageError.empty())
+				m_usageError = "Unknown memory pressure type \"" + v + "\" (expected host or device)";
+		}
+		else
+			return false;
+	}
+
+	//stoull() and stod() throw invalid_argument or out_of_range
+	catch(const logic_error&)
+	{
+		if(m_usageError.empty())
+			m_usageError = "Invalid value \"" + v + "\" for " + s;
+	}
+
+	//Any benchmark setting implies we want to run one
+	m_enabled = true;
+	i++;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+PipelineBenchmark::PipelineBenchmark(Session& session, MainWindow* wnd, const PipelineBenchmarkConfig& config)
+	: m_state(STATE_SETUP)
+	, m_session(session)
+	, m_parent(wnd)
+	, m_config(config)
+	, m_tstate(0)
+	, m_tnextTrigger(0)
+	, m_armed(false)
+	, m_lastArmedCount(0)
+	, m_startCount(0)
+	, m_depth(0)
+	, m_channels(0)
+	, m_tpressureStep(0)
+	, m_pressureStepCount(0)
+	, m_pressureStepEvents(0)
+	, m_pressureStepFreed(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Run loop
+
+/**
+	@brief Advances the benchmark, called once per frame from the GUI thread
+
+	@return False once the benchmark has finished and the application should exit
+ */
+bool PipelineBenchmark::Poll()
+{
+	double now = GetTime();
+	switch(m_state)
+	{
+		case STATE_SETUP:
+			Start();
+			m_state = STATE_WARMUP;
+			m_tstate = now;
+			m_tnextTrigger = now;
+			LogNotice("Benchmark: warming up for %.1f s\n", m_config.m_warmup);
+			break;
+
+		case STATE_WARMUP:
+			Trigger(now);
+			if( (now - m_tstate) >= m_config.m_warmup)
+			{
+				m_session.GetMetricHistory().Clear();
+				m_startCount = m_session.GetDisplayedAcquisitionCount();
+				m_state = STATE_MEASURE;
+				m_tstate = now;
+				LogNotice("Benchmark: measuring for %.1f s\n", m_config.m_duration);
+
+				if(m_config.m_pressureStep)
+				{
+					m_pressure = make_unique<MemoryStressRamp>(
+						m_config.m_pressureType, m_config.m_pressureStep, m_config.m_pressureMax);
+					m_tpressureStep = now;
+					m_pressureStepCount = m_startCount;
+					m_pressureStepEvents = m_session.GetMemoryPressureRegistry().GetEventCount();
+					m_pressureStepFreed = m_session.GetMemoryPressureRegistry().GetBytesFreed();
+				}
+			}
+			break;
+
+		case STATE_MEASURE:
+			Trigger(now);
+			StepPressure(now);
+			if( (now - m_tstate) >= m_config.m_duration)
+			{
+				m_session.StopTrigger();
+				Report();
+				m_pressure = nullptr;
+				m_state = STATE_DONE;
+			}
+			break;
+
+		case STATE_DONE:
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+/**
+	@brief Creates the demo instrument and configures it as requested
+ */
+void PipelineBenchmark::Start()
+{
+	auto transport = SCPITransport::CreateTransport("null", "");
+	auto scope = shared_ptr<SCPIOscilloscope>(SCPIOscilloscope::CreateOscilloscope("demo", transport));
+	if(!scope)
+	{
+		LogError("Benchmark: failed to create demo oscilloscope\n");
+		delete transport;
+		return;
+	}
+	scope->m_nickname = "bench";
+
+	//Enable the requested number of channels
+	m_channels = 0;
+	vector<StreamDescriptor> streams;
+	for(size_t i=0; i<scope->GetChannelCount(); i++)
+	{
+		auto chan = scope->GetOscilloscopeChannel(i);
+		if(!chan || (chan->GetType(0) != Stream::STREAM_TYPE_ANALOG) )
+			continue;
+
+		if(m_channels < m_config.m_channels)
+		{
+			scope->EnableChannel(i);
+			streams.push_back(StreamDescriptor(chan, 0));
+			m_channels ++;
+		}
+		else
+			scope->DisableChannel(i);
+	}
+	if(m_channels < m_config.m_channels)
+		LogWarning("Benchmark: demo scope only has %zu analog channels\n", m_channels);
+
+	//Pick the smallest supported depth at least as deep as requested
+	auto depths = scope->GetSampleDepthsNonInterleaved();
+	m_depth = 0;
+	for(auto d : depths)
+	{
+		if( (d >= m_config.m_depth) && ( (m_depth == 0) || (d < m_depth) ) )
+			m_depth = d;
+	}
+	if( (m_depth == 0) && !depths.empty())
+		m_depth = *max_element(depths.begin(), depths.end());
+	scope->SetSampleDepth(m_depth);
+	if(m_depth != m_config.m_depth)
+		LogNotice("Benchmark: using depth %" PRIu64 " (nearest supported to %" PRIu64 ")\n", m_depth, m_config.m_depth);
+
+	//Add it to the session and give every channel a view so we exercise rasterization and tone mapping
+	m_session.AddInstrument(scope, false);
+	for(auto s : streams)
+		m_parent->FindAreaForStream(nullptr, s);
+
+	//Free run, unless we're rate limiting
+	if(m_config.m_triggerRate <= 0)
+		m_session.ArmTrigger(TriggerGroup::TRIGGER_TYPE_NORMAL);
+}
+
+/**
+	@brief Arms a single trigger if rate limiting and the previous acquisition has been displayed
+ */
+void PipelineBenchmark::Trigger(double now)
+{
+	if(m_config.m_triggerRate <= 0)
+		return;
+	if(now < m_tnextTrigger)
+		return;
+
+	//Wait for the previous acquisition to make it all the way through. If the pipeline can't keep up,
+	//the achieved rate will show up as lower than requested.
+	auto count = m_session.GetDisplayedAcquisitionCount();
+	if(m_armed && (count == m_lastArmedCount) )
+		return;
+
+	m_session.ArmTrigger(TriggerGroup::TRIGGER_TYPE_SINGLE);
+	m_armed = true;
+	m_lastArmedCount = count;
+	m_tnextTrigger = max(m_tnextTrigger + 1.0 / m_config.m_triggerRate, now);
+}
+
+/**
+	@brief Records how the pipeline did during the current memory pressure step, then allocates the next one
+
+	Once the ramp can't allocate any more, the final step is held until measurement ends so we can see whether
+	throughput recovers after history and pools have been reclaimed.
+ */
+void PipelineBenchmark::StepPressure(double now)
+{
+	if(!m_pressure)
+		return;
+	if( (now - m_tpressureStep) < m_config.m_pressureInterval)
+		return;
+
+	auto& registry = m_session.GetMemoryPressureRegistry();
+	auto& history = m_session.GetHistory();
+	auto count = m_session.GetDisplayedAcquisitionCount();
+	auto events = registry.GetEventCount();
+	auto freed = registry.GetBytesFreed();
+
+	PressureStep step;
+	step.m_allocated = m_pressure->GetAllocated();
+	step.m_rate = (count - m_pressureStepCount) / (now - m_tpressureStep);
+	step.m_historyPoints = history.GetPointCount();
+	step.m_historyBytes = history.GetMemoryUsage();
+	step.m_events = events - m_pressureStepEvents;
+	step.m_freed = freed - m_pressureStepFreed;
+	m_pressureSteps.push_back(step);
+
+	m_tpressureStep = now;
+	m_pressureStepCount = count;
+	m_pressureStepEvents = events;
+	m_pressureStepFreed = freed;
+
+	if(m_pressure->Step())
+	{
+		Unit bytes(Unit::UNIT_BYTES);
+		LogVerbose("Benchmark: memory pressure now %s\n", bytes.PrettyPrint(m_pressure->GetAllocated()).c_str());
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+/**
+	@brief Prints results to the log and, if requested, writes them to a JSON file
+ */
+void PipelineBenchmark::Report()
+{
+	double elapsed = GetTime() - m_tstate;
+	uint64_t count = m_session.GetDisplayedAcquisitionCount() - m_startCount;
+	double rate = count / elapsed;
+
+	LogNotice("Benchmark: %zu channels, depth %" PRIu64 ", %" PRIu64 " waveforms in %.2f s (%.2f WFM/s)\n",
+		m_channels, m_depth, count, elapsed, rate);
+	LogIndenter li;
+
+	auto& history = m_session.GetMetricHistory();
+	{
+		lock_guard<mutex> lock(history.GetMutex());
+		LogNotice("%-20s %8s %10s %10s %10s %10s\n", "Stage", "Samples", "p50 (ms)", "p95 (ms)", "p99 (ms)", "Max (ms)");
+		for(auto& it : history.GetSeries())
+		{
+			auto& stats = it.second.GetStats();
+			LogNotice("%-20s %8zu %10.3f %10.3f %10.3f %10.3f\n",
+				it.first.c_str(),
+				it.second.GetCount(),
+				stats.m_p50 * 1e3 / FS_PER_SECOND,
+				stats.m_p95 * 1e3 / FS_PER_SECOND,
+				stats.m_p99 * 1e3 / FS_PER_SECOND,
+				stats.m_max * 1e3 / FS_PER_SECOND);
+		}
+	}
+
+	if(!m_pressureSteps.empty())
+	{
+		Unit bytes(Unit::UNIT_BYTES);
+		LogNotice("Memory pressure (%s, %s allocated%s):\n",
+			(m_config.m_pressureType == MemoryPressureType::Host) ? "host" : "device",
+			bytes.PrettyPrint(m_pressure->GetAllocated()).c_str(),
+			m_pressure->HasFailed() ? ", stopped by allocation failure" : "");
+		LogIndenter li2;
+		LogNotice("%12s %10s %10s %12s %8s %12s\n", "Allocated", "WFM/s", "History", "History mem", "Events", "Reclaimed");
+		for(auto& step : m_pressureSteps)
+		{
+			LogNotice("%12s %10.2f %10zu %12s %8" PRIu64 " %12s\n",
+				bytes.PrettyPrint(step.m_allocated).c_str(),
+				step.m_rate,
+				step.m_historyPoints,
+				bytes.PrettyPrint(step.m_historyBytes).c_str(),
+				step.m_events,
+				bytes.PrettyPrint(step.m_freed).c_str());
+		}
+	}
+
+	if(!m_config.m_jsonPath.empty())
+		WriteJSON(elapsed, rate);
+}
+
+bool PipelineBenchmark::WriteJSON(double elapsed, double rate)
+{
+	FILE* fp = fopen(m_config.m_jsonPath.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Benchmark: failed to open %s for writing\n", m_config.m_jsonPath.c_str());
+		return false;
+	}
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"channels\": %zu,\n", m_channels);
+	fprintf(fp, "\t\"depth\": %" PRIu64 ",\n", m_depth);
+	fprintf(fp, "\t\"trigger_rate_requested\": %.6g,\n", m_config.m_triggerRate);
+	fprintf(fp, "\t\"duration_sec\": %.6g,\n", elapsed);
+	fprintf(fp, "\t\"waveforms_per_sec\": %.6g,\n", rate);
+	fprintf(fp, "\t\"stages\":\n");
+	fprintf(fp, "\t{\n");
+
+	auto& history = m_session.GetMetricHistory();
+	{
+		lock_guard<mutex> lock(history.GetMutex());
+		auto& series = history.GetSeries();
+		size_t i = 0;
+		for(auto& it : series)
+		{
+			//Series names are fixed strings from our own code, so no escaping needed
+			auto& stats = it.second.GetStats();
+			fprintf(fp,
+				"\t\t\"%s\": { \"samples\": %zu, \"p50_sec\": %.9g, \"p95_sec\": %.9g, \"p99_sec\": %.9g, "
+				"\"max_sec\": %.9g }%s\n",
+				it.first.c_str(),
+				it.second.GetCount(),
+				stats.m_p50 / FS_PER_SECOND,
+				stats.m_p95 / FS_PER_SECOND,
+				stats.m_p99 / FS_PER_SECOND,
+				stats.m_max / FS_PER_SECOND,
+				(++i < series.size()) ? "," : "");
+		}
+	}
+
+	fprintf(fp, "\t}%s\n", m_pressureSteps.empty() ? "" : ",");
+
+	if(!m_pressureSteps.empty())
+	{
+		fprintf(fp, "\t\"pressure_type\": \"%s\",\n",
+			(m_config.m_pressureType == MemoryPressureType::Host) ? "host" : "device");
+		fprintf(fp, "\t\"pressure_alloc_failed\": %s,\n", m_pressure->HasFailed() ? "true" : "false");
+		fprintf(fp, "\t\"pressure_steps\":\n");
+		fprintf(fp, "\t[\n");
+		for(size_t i=0; i<m_pressureSteps.size(); i++)
+		{
+			auto& step = m_pressureSteps[i];
+			fprintf(fp,
+				"\t\t{ \"allocated_bytes\": %zu, \"waveforms_per_sec\": %.6g, \"history_points\": %zu, "
+				"\"history_bytes\": %zu, \"pressure_events\": %" PRIu64 ", \"reclaimed_bytes\": %" PRIu64 " }%s\n",
+				step.m_allocated,
+				step.m_rate,
+				step.m_historyPoints,
+				step.m_historyBytes,
+				step.m_events,
+				step.m_freed,
+				(i+1 < m_pressureSteps.size()) ? "," : "");
+		}
+		fprintf(fp, "\t]\n");
+	}
+
+	fprintf(fp, "}\n");
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+	if(!ok)
+		LogError("Benchmark: failed to write %s\n", m_config.m_jsonPath.c_str());
+	return ok;
+}
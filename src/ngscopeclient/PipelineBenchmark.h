@@ -0,0 +1,211 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of PipelineBenchmark
+ */
+#ifndef PipelineBenchmark_h
+#define PipelineBenchmark_h
+
+#include "MemoryStressRamp.h"
+
+class Session;
+class MainWindow;
+
+/**
+	@brief Settings for a synthetic pipeline benchmark run
+ */
+class PipelineBenchmarkConfig
+{
+public:
+	PipelineBenchmarkConfig()
+	: m_enabled(false)
+	, m_channels(4)
+	, m_depth(1000000)
+	, m_triggerRate(0)
+	, m_warmup(2)
+	, m_duration(10)
+	, m_pressureStep(0)
+	, m_pressureInterval(1)
+	, m_pressureMax(SIZE_MAX)
+	, m_pressureType(MemoryPressureType::Host)
+	{}
+
+	///@brief True if a benchmark was requested on the command line
+	bool m_enabled;
+
+	///@brief Number of demo scope channels to enable
+	size_t m_channels;
+
+	///@brief Requested memory depth (rounded up to the nearest depth the demo scope supports)
+	uint64_t m_depth;
+
+	///@brief Trigger rate in Hz, or zero to free-run as fast as the pipeline allows
+	double m_triggerRate;
+
+	///@brief Time to run before measuring, in seconds, so caches and buffers are warm
+	double m_warmup;
+
+	///@brief Time to measure for, in seconds
+	double m_duration;
+
+	///@brief Path to write results to in JSON format, if not empty
+	std::string m_jsonPath;
+
+	///@brief Bytes to allocate per memory pressure step during measurement, or zero for no memory pressure
+	size_t m_pressureStep;
+
+	///@brief Time between memory pressure steps, in seconds
+	double m_pressureInterval;
+
+	///@brief Maximum memory to allocate for memory pressure, in bytes
+	size_t m_pressureMax;
+
+	///@brief Type of memory to allocate for memory pressure
+	MemoryPressureType m_pressureType;
+
+	/**
+		@brief Description of the first benchmark argument with a bad value, or empty if there wasn't one
+
+		Arguments are parsed before logging is set up, so main() reports this once it is.
+	 */
+	std::string m_usageError;
+
+	bool ParseArgument(int& i, int argc, char* argv[]);
+};
+
+/**
+	@brief Drives synthetic waveforms from a demo oscilloscope through the full acquisition pipeline and reports
+	throughput and latency
+
+	Everything downstream of the instrument (InstrumentThread, trigger groups, WaveformThread, filter graph,
+	rasterization and tone mapping) is the real code path used with hardware, so results are comparable between runs
+	on the same machine. Per-stage timings come from the session's MetricHistory, which is cleared once the warmup
+	period is over.
+ */
+class PipelineBenchmark
+{
+public:
+	PipelineBenchmark(Session& session, MainWindow* wnd, const PipelineBenchmarkConfig& config);
+
+	bool Poll();
+
+protected:
+	void Start();
+	void Trigger(double now);
+	void Report();
+	bool WriteJSON(double elapsed, double rate);
+	void StepPressure(double now);
+
+	/**
+		@brief State of the pipeline during one memory pressure step
+	 */
+	class PressureStep
+	{
+	public:
+		///@brief Bytes allocated by the ramp during this step
+		size_t m_allocated;
+
+		///@brief Waveforms per second displayed during this step
+		double m_rate;
+
+		///@brief Number of points in history at the end of the step
+		size_t m_historyPoints;
+
+		///@brief Sample data in history at the end of the step, in bytes
+		size_t m_historyBytes;
+
+		///@brief Memory pressure events handled during this step
+		uint64_t m_events;
+
+		///@brief Bytes reclaimed during this step
+		uint64_t m_freed;
+	};
+
+	enum State
+	{
+		STATE_SETUP,
+		STATE_WARMUP,
+		STATE_MEASURE,
+		STATE_DONE
+	} m_state;
+
+	///@brief The session being benchmarked
+	Session& m_session;
+
+	///@brief Top level window, used to create views for the demo channels
+	MainWindow* m_parent;
+
+	///@brief Benchmark settings
+	PipelineBenchmarkConfig m_config;
+
+	///@brief Time the current state was entered
+	double m_tstate;
+
+	///@brief Time of the next trigger when rate limited
+	double m_tnextTrigger;
+
+	///@brief True once we've armed a single trigger
+	bool m_armed;
+
+	///@brief Number of acquisitions displayed when the last single trigger was armed
+	uint64_t m_lastArmedCount;
+
+	///@brief Number of acquisitions displayed when measurement started
+	uint64_t m_startCount;
+
+	///@brief Actual memory depth chosen
+	uint64_t m_depth;
+
+	///@brief Actual number of channels enabled
+	size_t m_channels;
+
+	///@brief Memory allocated to put the pipeline under pressure, if requested
+	std::unique_ptr<MemoryStressRamp> m_pressure;
+
+	///@brief Time the current memory pressure step started
+	double m_tpressureStep;
+
+	///@brief Number of acquisitions displayed when the current memory pressure step started
+	uint64_t m_pressureStepCount;
+
+	///@brief Memory pressure events handled before the current step started
+	uint64_t m_pressureStepEvents;
+
+	///@brief Bytes reclaimed before the current step started
+	uint64_t m_pressureStepFreed;
+
+	///@brief Results of each memory pressure step
+	std::vector<PressureStep> m_pressureSteps;
+};
+
+#endif
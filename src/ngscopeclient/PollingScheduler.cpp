@@ -0,0 +1,207 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PollingScheduler
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "PollingScheduler.h"
+
+using namespace std;
+
+///@brief Longest a worker sleeps before checking whether any instrument was woken up early, in seconds
+static const double WAKE_CHECK_INTERVAL = 0.005;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+PollingScheduler::PollingScheduler(size_t nthreads)
+	: m_terminating(false)
+{
+	nthreads = max(nthreads, (size_t)1);
+	LogTrace("Starting %zu shared instrument polling threads\n", nthreads);
+
+	for(size_t i=0; i<nthreads; i++)
+		m_threads.push_back(thread(&PollingScheduler::WorkerThread, this));
+}
+
+/**
+	@brief Stops the workers
+
+	All instruments should have been removed by now, but any that weren't are torn down here.
+ */
+PollingScheduler::~PollingScheduler()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_terminating = true;
+	}
+	m_cond.notify_all();
+
+	for(auto& t : m_threads)
+		t.join();
+	m_threads.clear();
+
+	m_entries.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instrument management
+
+/**
+	@brief Starts polling an instrument
+
+	@param args			Same arguments as would be passed to InstrumentThread
+	@param targetRate	Desired poll rate, in Hz. Read before every poll, so it can be changed at any time.
+ */
+void PollingScheduler::Add(InstrumentThreadArgs args, atomic<float>* targetRate)
+{
+	auto entry = make_shared<Entry>(args, targetRate);
+	entry->m_rateWindowStart = GetTime();
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_entries.push_back(entry);
+	}
+	m_cond.notify_one();
+}
+
+/**
+	@brief Stops polling an instrument, waiting for a poll in progress to finish
+
+	The instrument's shutdown flag must already be set so its BERT scan thread (if any) can exit.
+ */
+void PollingScheduler::Remove(SCPIInstrument* inst)
+{
+	shared_ptr<Entry> entry;
+
+	{
+		unique_lock<mutex> lock(m_mutex);
+		for(size_t i=0; i<m_entries.size(); i++)
+		{
+			if(m_entries[i]->m_poller->GetInstrument().get() != inst)
+				continue;
+
+			entry = m_entries[i];
+			m_cond.wait(lock, [&]{ return !entry->m_busy; });
+			m_entries.erase(m_entries.begin() + i);
+			break;
+		}
+	}
+
+	//Tear down the poller outside the lock, since it may have to wait on a BERT scan
+	entry = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Worker threads
+
+void PollingScheduler::WorkerThread()
+{
+	pthread_setname_np_compat("PollScheduler");
+	Tracer::SetThreadName("PollScheduler");
+	ThreadRoleScope role(THREAD_ROLE_INSTRUMENT);
+
+	unique_lock<mutex> lock(m_mutex);
+	while(!m_terminating)
+	{
+		//Find the most overdue instrument nobody else is polling.
+		//Wake events can't all be waited on at once, so check them here and treat a signaled one as due now.
+		double now = GetTime();
+		double nextDeadline = now + WAKE_CHECK_INTERVAL;
+		shared_ptr<Entry> next;
+		for(auto& e : m_entries)
+		{
+			if(e->m_busy)
+				continue;
+			if(e->m_wakeEvent && e->m_wakeEvent->Peek())
+				e->m_deadline = now;
+
+			if(e->m_deadline <= now)
+			{
+				if(!next || (e->m_deadline < next->m_deadline) )
+					next = e;
+			}
+			else
+				nextDeadline = min(nextDeadline, e->m_deadline);
+		}
+
+		//Nothing due, sleep until something is (or might have been woken up)
+		if(!next)
+		{
+			m_cond.wait_for(lock, chrono::duration<double>(nextDeadline - now));
+			continue;
+		}
+
+		//Poll it without holding the lock so the other workers can keep going
+		next->m_busy = true;
+		lock.unlock();
+
+		double start = GetTime();
+		double waitTime;
+		{
+			TRACE_ZONE("Poll", next->m_poller->GetInstrument()->m_nickname.c_str());
+			waitTime = next->m_poller->Poll();
+		}
+
+		lock.lock();
+		now = GetTime();
+
+		//Schedule the next poll at the target rate, but never sooner than the instrument asked for.
+		//A zero wait means it has more work queued up (e.g. an arbitrary waveform upload in progress).
+		if(waitTime <= 0)
+			next->m_deadline = now;
+		else
+		{
+			float rate = next->m_targetRate ? next->m_targetRate->load() : 0;
+			double period = (rate > 0) ? (1.0 / rate) : 0;
+			next->m_deadline = max(start + period, now + waitTime);
+		}
+
+		//Update rate metrics about once a second
+		next->m_pollCount ++;
+		double dt = now - next->m_rateWindowStart;
+		if(dt >= 1)
+		{
+			if(next->m_achievedRate)
+				*next->m_achievedRate = next->m_pollCount / dt;
+			next->m_pollCount = 0;
+			next->m_rateWindowStart = now;
+		}
+
+		//Drop our reference before anyone waiting in Remove() can see the entry is idle,
+		//so the poller is always destroyed there and not on this thread
+		next->m_busy = false;
+		next = nullptr;
+		m_cond.notify_all();
+	}
+}
@@ -0,0 +1,124 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of PollingScheduler
+ */
+#ifndef PollingScheduler_h
+#define PollingScheduler_h
+
+#include "InstrumentPoller.h"
+
+/**
+	@brief Polls many slow instruments from a small, shared pool of threads
+
+	Power supplies, meters, loads and the like spend nearly all of their time waiting on the next poll, so giving
+	each one its own thread doesn't scale well to benches with dozens of them. Instead, each instrument gets a
+	target poll rate and a deadline for its next poll, and whichever worker is free polls the most overdue one.
+
+	An instrument is only ever polled by one worker at a time, so drivers see the same single-threaded access they'd
+	get from a dedicated InstrumentThread.
+ */
+class PollingScheduler
+{
+public:
+	PollingScheduler(size_t nthreads);
+	~PollingScheduler();
+
+	void Add(InstrumentThreadArgs args, std::atomic<float>* targetRate);
+	void Remove(SCPIInstrument* inst);
+
+	///@brief Gets the number of worker threads
+	size_t GetThreadCount()
+	{ return m_threads.size(); }
+
+protected:
+	void WorkerThread();
+
+	/**
+		@brief Scheduling state for a single instrument
+	 */
+	class Entry
+	{
+	public:
+		Entry(InstrumentThreadArgs args, std::atomic<float>* targetRate)
+		: m_poller(std::make_unique<InstrumentPoller>(args))
+		, m_wakeEvent(args.wakeEvent)
+		, m_targetRate(targetRate)
+		, m_achievedRate(args.pollRate)
+		, m_deadline(0)
+		, m_busy(false)
+		, m_rateWindowStart(0)
+		, m_pollCount(0)
+		{}
+
+		///@brief The instrument's polling state
+		std::unique_ptr<InstrumentPoller> m_poller;
+
+		///@brief Signaled when the instrument should be polled ahead of its deadline
+		Event* m_wakeEvent;
+
+		///@brief Desired poll rate in Hz (owned by the connection state so the GUI can change it)
+		std::atomic<float>* m_targetRate;
+
+		///@brief Measured poll rate in Hz, for display in the metrics dialog
+		std::atomic<float>* m_achievedRate;
+
+		///@brief Time at which the next poll is due
+		double m_deadline;
+
+		///@brief True while a worker is polling the instrument
+		bool m_busy;
+
+		///@brief Start of the current poll rate measurement window
+		double m_rateWindowStart;
+
+		///@brief Number of polls in the current measurement window
+		size_t m_pollCount;
+	};
+
+	///@brief Mutex protecting m_entries and everything in them except the poller itself
+	std::mutex m_mutex;
+
+	///@brief Signaled when entries are added, removed, or finish a poll
+	std::condition_variable m_cond;
+
+	///@brief Instruments being polled
+	std::vector<std::shared_ptr<Entry>> m_entries;
+
+	///@brief Worker threads
+	std::vector<std::thread> m_threads;
+
+	///@brief Set to shut the workers down
+	bool m_terminating;
+};
+
+#endif
@@ -125,7 +125,10 @@ bool PowerSupplyDialog::DoRender()
 		if(ImGui::CollapsingHeader("Global", ImGuiTreeNodeFlags_DefaultOpen))
 		{
 			if(ImGui::Checkbox("Output Enable", &m_masterEnable))
+			{
 				m_psu->SetMasterPowerEnable(m_masterEnable);
+				m_state->m_statusUpdateRequested = true;
+			}
 
 			HelpMarker(
 				"Top level output enable, gating all outputs from the PSU.\n"
@@ -202,7 +205,10 @@ void PowerSupplyDialog::ChannelSettings(int i, float v, float a, float etime)
 		if(m_psu->SupportsIndividualOutputSwitching())
 		{
 			if(ImGui::Checkbox("Output Enable", &m_channelUIState[i].m_outputEnabled))
+			{
 				m_psu->SetPowerChannelActive(i, m_channelUIState[i].m_outputEnabled);
+				m_state->m_statusUpdateRequested = true;
+			}
 			if(shdn)
 			{
 				//TODO: preference for configuring this?
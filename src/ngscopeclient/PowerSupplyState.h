@@ -62,6 +62,7 @@ public:
 		}
 
 		m_firstUpdateDone = false;
+		m_statusUpdateRequested = false;
 	}
 
 	std::unique_ptr<std::atomic<float>[]> m_channelVoltage;
@@ -72,6 +73,9 @@ public:
 
 	std::atomic<bool> m_firstUpdateDone;
 
+	///@brief Set by the UI after changing output state, to have the status flags re-read on the next poll
+	std::atomic<bool> m_statusUpdateRequested;
+
 	std::atomic<bool> m_masterEnable;
 };
 
@@ -151,6 +151,9 @@ private:
 	bool m_hasValue{false};
 	EnumMapping m_mapping;
 
+	///@brief Incremented every time the value changes, so PreferenceHandle knows when to re-read it
+	std::uint64_t m_generation{0};
+
 public:
 	Preference(PreferenceType type, std::string identifier)
 		: m_identifier{std::move(identifier)}, m_type{type}
@@ -207,6 +210,9 @@ public:
 	Unit& GetUnit();
 	const EnumMapping& GetMapping() const;
 
+	std::uint64_t GetGeneration() const
+	{ return m_generation; }
+
 	template< typename E >
 	E GetEnum() const
 	{
@@ -254,6 +260,7 @@ private:
 	{
 		new (&m_value) T(std::move(value));
 		m_hasValue = true;
+		m_generation ++;
 	}
 
 	void MoveFrom(Preference& other);
@@ -176,6 +176,10 @@ void PreferenceDialog::ProcessCategory(PreferenceCategory& cat)
  */
 void PreferenceDialog::ProcessPreference(Preference& pref)
 {
+	//Internal state persisted as a preference, not user facing
+	if(!pref.GetIsVisible())
+		return;
+
 	string label = pref.GetLabel() + "###" + pref.GetIdentifier();
 
 	switch(pref.GetType())
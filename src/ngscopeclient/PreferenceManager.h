@@ -87,13 +87,14 @@ public:
         return this->GetPreference(path).GetEnum<E>();
     }
 
+    const Preference& GetPreference(const std::string& path) const;
+
 private:
     // Internal helpers
     void DeterminePath();
     void InitializeDefaults();
     void LoadPreferences();
     bool HasPreferenceFile() const;
-    const Preference& GetPreference(const std::string& path) const;
 
 private:
     PreferenceCategory m_treeRoot;
@@ -101,4 +102,51 @@ private:
     std::string m_configDir;
 };
 
+/**
+	@brief A preference looked up once, for code which reads it every frame
+
+	The path is resolved when the handle is created, and the value is cached until the preference changes, so reading
+	it costs a compare rather than a walk of the preference tree and a type check.
+
+	Handles are not thread safe. Threads which read the same preference should each have their own handle.
+ */
+template<class T, T (Preference::*Getter)() const>
+class PreferenceHandle
+{
+public:
+	PreferenceHandle(const PreferenceManager& prefs, const std::string& path)
+		: m_pref(prefs.GetPreference(path))
+		, m_generation(m_pref.GetGeneration())
+		, m_value((m_pref.*Getter)())
+	{}
+
+	///@brief Gets the current value of the preference
+	T Get()
+	{
+		if(m_generation != m_pref.GetGeneration())
+		{
+			m_generation = m_pref.GetGeneration();
+			m_value = (m_pref.*Getter)();
+		}
+		return m_value;
+	}
+
+protected:
+	///@brief The preference we're reading
+	const Preference& m_pref;
+
+	///@brief Generation of m_pref that m_value was read from
+	uint64_t m_generation;
+
+	///@brief Cached value of m_pref
+	T m_value;
+};
+
+typedef PreferenceHandle<bool, &Preference::GetBool> BoolPreference;
+typedef PreferenceHandle<int64_t, &Preference::GetInt> IntPreference;
+typedef PreferenceHandle<int64_t, &Preference::GetEnumRaw> EnumRawPreference;
+typedef PreferenceHandle<double, &Preference::GetReal> RealPreference;
+typedef PreferenceHandle<ImU32, &Preference::GetColor> ColorPreference;
+typedef PreferenceHandle<FontDescription, &Preference::GetFont> FontPreference;
+
 #endif // PreferenceManager_h
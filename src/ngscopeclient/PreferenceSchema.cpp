@@ -209,6 +209,10 @@ void PreferenceManager::InitializeDefaults()
 				Preference::Color("instrument_disabled_badge_color", ColorFromString("#666666"))
 				.Label("Instrument disabled badge color")
 				.Description("Color for instrument 'disabled' badge"));
+			stream.AddPreference(
+				Preference::Color("instrument_idle_badge_color", ColorFromString("#4C7ACC"))
+				.Label("Instrument idle badge color")
+				.Description("Color for 'idle' badge, shown on channels turned off because nothing is using them"));
 			stream.AddPreference(
 				Preference::Color("instrument_offline_badge_color", ColorFromString("#CC4C4C"))
 				.Label("Instrument offline badge color")
@@ -405,6 +409,13 @@ void PreferenceManager::InitializeDefaults()
 				Preference::Font("x_axis_font", FontDescription(FindDataFile("fonts/DejaVuSans.ttf"), 15))
 				.Label("X axis font")
 				.Description("Font used for X axis text"));
+			timeline.AddPreference(
+				Preference::Bool("show_overview", true)
+				.Label("Show overview")
+				.Description(
+					"Show a strip above the timeline with the entire waveform of each analog channel in the group, "
+					"and the part of it currently in view.\n\n"
+					"Drag the view around the overview to navigate, or click elsewhere in it to jump there."));
 
 		auto& toolbar = appearance.AddCategory("Toolbar");
 			toolbar.AddPreference(
@@ -451,6 +462,61 @@ void PreferenceManager::InitializeDefaults()
 				)
 				.EnumValue("All non-MSO channels", HEADLESS_STARTUP_ALL_NON_MSO)
 				.EnumValue("Channel 1 only", HEADLESS_STARTUP_C1_ONLY) );
+			dgeneral.AddPreference(
+				Preference::Real("psu_status_interval", 1 * FS_PER_SECOND)
+				.Label("Power supply status poll interval")
+				.Unit(Unit::UNIT_FS)
+				.Description(
+				"How often to read back output enable, constant-current mode, and overcurrent shutdown state\n"
+				"from power supplies.\n\n"
+				"Measured voltage and current are read on every poll regardless of this setting. Status is also\n"
+				"refreshed immediately after changing an output from the power supply dialog.")
+				);
+			dgeneral.AddPreference(
+				Preference::Bool("consume_driven_acquisition", false)
+				.Label("Only acquire channels in use")
+				.Description(
+				"Turn off oscilloscope channels which aren't shown in any view, used by any filter or trigger, or\n"
+				"having measurement statistics tracked, and turn them back on as soon as something uses them.\n\n"
+				"Drivers only download enabled channels, so this can greatly speed up acquisition from slow\n"
+				"instruments. Channels are never turned off while recording, and one channel of each instrument\n"
+				"is always left on. Turned off channels are shown as IDLE in the stream browser.")
+				);
+			dgeneral.AddPreference(
+				Preference::Bool("parallel_session_load", true)
+				.Label("Connect to instruments in parallel")
+				.Description(
+				"When opening a session, connect to all of its instruments at the same time rather than one after another.\n\n"
+				"This greatly speeds up loading sessions with many networked instruments. Disable if a driver misbehaves\n"
+				"when initialized concurrently with others.")
+				);
+			dgeneral.AddPreference(
+				Preference::Bool("shared_polling", false)
+				.Label("Shared polling for non-scope instruments")
+				.Description(
+				"Poll power supplies, meters, loads, function generators and other non-oscilloscope instruments\n"
+				"from a small pool of shared threads instead of giving each one its own thread.\n\n"
+				"Useful on benches with many slow instruments. Oscilloscopes always get a dedicated thread.\n"
+				"Applies to instruments connected after the setting is changed.")
+				);
+			dgeneral.AddPreference(
+				Preference::Int("shared_polling_threads", 4)
+				.Label("Shared polling threads")
+				.Description(
+				"Number of threads used for shared polling.\n\n"
+				"An instrument is only polled by one thread at a time, so there is no benefit to having more threads\n"
+				"than instruments. Takes effect the next time a session is opened.")
+				.Unit(Unit::UNIT_COUNTS)
+				);
+			dgeneral.AddPreference(
+				Preference::Real("shared_polling_rate", 10)
+				.Label("Shared polling target rate")
+				.Unit(Unit::UNIT_HZ)
+				.Description(
+				"Default poll rate for instruments using shared polling. Can be adjusted per instrument from the\n"
+				"metrics dialog. The achieved rate may be lower if the instrument is slow to respond or all threads\n"
+				"are busy.")
+				);
 
 		auto& rigol = drivers.AddCategory("Rigol DHO");
 			rigol.AddPreference(
@@ -509,6 +575,149 @@ void PreferenceManager::InitializeDefaults()
 			.Label("Max recent files")
 			.Description("Maximum number of recent .scopesession file paths to save in history")
 			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Bool("lazy_load", true)
+			.Label("Lazy load history")
+			.Description(
+				"When opening a session, only load sample data for the most recent waveform.\n\n"
+				"Older history points are loaded in the background the first time they're selected.\n"
+				"This makes opening large sessions much faster.")
+			);
+		files.AddPreference(
+			Preference::Int("lazy_resident_points", 10)
+			.Label("Lazy load cache size")
+			.Description(
+				"Maximum number of lazily loaded history points to keep in memory.\n\n"
+				"Once more than this many have been loaded, the least recently used ones are freed and will be\n"
+				"loaded from the session file again if selected.")
+			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Int("lazy_prefetch_points", 2)
+			.Label("Lazy load prefetch depth")
+			.Description(
+				"Number of lazily loaded history points on each side of the selected one to load in the background,\n"
+				"so that stepping through history doesn't have to wait for the disk.\n\n"
+				"Limited to less than half of the lazy load cache size. Set to 0 to disable.")
+			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Bool("load_file_backed", true)
+			.Label("Load history to file-backed memory")
+			.Description(
+				"When opening a session, load historical waveforms into file-backed memory rather than RAM.\n\n"
+				"Large sessions can then be opened even if they don't fit in memory, since the OS pages sample data\n"
+				"in and out as needed. Waveforms are moved back to normal memory when selected in the history view.")
+			);
+		files.AddPreference(
+			Preference::Int("save_threads", 4)
+			.Label("Save threads")
+			.Description(
+				"Number of threads used to write waveform data files when saving a session.\n\n"
+				"Fast storage (e.g. NVMe arrays) may need several threads to reach full bandwidth.\n"
+				"Set to 1 for slow or rotating media.")
+			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Bool("async_writes", true)
+			.Label("Asynchronous writes")
+			.Description(
+				"Write waveform data files with direct I/O and several writes in flight (io_uring on Linux,\n"
+				"overlapped I/O on Windows), rather than through the C library's buffered streams.\n\n"
+				"This is used by session saving and the waveform recorder, and is much faster on NVMe storage.\n"
+				"It falls back to buffered writes automatically if the OS or file system doesn't support it.\n"
+				"Turn off if saving to a network share behaves oddly.")
+			);
+		files.AddPreference(
+			Preference::Int("load_threads", 8)
+			.Label("Load threads")
+			.Description(
+				"Number of threads used to read and decode waveform data files when opening a session.\n\n"
+				"Streams are loaded independently, so sessions with many channels or history points load faster\n"
+				"with more threads. Set to 1 for slow or rotating media.")
+			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Bool("incremental_save", true)
+			.Label("Incremental save")
+			.Description(
+				"Save only new waveform history when saving a session back to the file it was last saved to or\n"
+				"loaded from, leaving waveforms already in the data directory alone.\n\n"
+				"Incremental saves write waveform data from a background thread without stopping the trigger, so\n"
+				"acquisition can continue during the save."));
+		files.AddPreference(
+			Preference::Int("autosave_interval", 0)
+			.Label("Autosave interval")
+			.Description(
+				"Time between automatic saves of the current session, in minutes. Set to 0 to disable.\n\n"
+				"Autosave only applies to sessions which have already been saved to a file, and requires\n"
+				"incremental save to be enabled.")
+			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Real("record_queue_size", 1024.0 * 1024 * 1024)
+			.Label("Recorder queue size")
+			.Unit(Unit::UNIT_BYTES)
+			.Description(
+				"Maximum amount of sample data waiting to be written to disk while recording.\n\n"
+				"If the disk falls further behind than this, the recorder overflow policy takes effect.")
+			);
+		files.AddPreference(
+			Preference::Enum("record_overflow", RECORD_OVERFLOW_STALL)
+			.Label("Recorder overflow")
+			.Description(
+				"What to do when the recorder queue is full because the disk can't keep up with acquisition.\n\n"
+				"Stall: stop accepting new waveforms until there's room, which slows down acquisition but\n"
+				"records every waveform that's displayed.\n\n"
+				"Drop: keep acquiring at full speed, but leave new waveforms out of the recording (they're\n"
+				"still added to history). The number dropped is shown in the File menu.")
+			.EnumValue("Stall", RECORD_OVERFLOW_STALL)
+			.EnumValue("Drop", RECORD_OVERFLOW_DROP)
+			);
+		files.AddPreference(
+			Preference::Enum("compress_dense", COMPRESS_DENSE_NONE)
+			.Label("Compress dense analog waveforms")
+			.Description(
+				"Store uniformly sampled analog waveforms as integer ADC codes when saving a session.\n\n"
+				"Waveforms from 8-bit ADCs are 4x smaller as 8 bit codes than as 32-bit floating point.\n"
+				"16 bit codes are suitable for high resolution scopes.\n\n"
+				"Only waveforms whose samples all lie on a grid of ADC levels that fits in the selected width\n"
+				"are converted, so this is lossless. Anything else (e.g. filter outputs or averaged captures)\n"
+				"is saved as floating point unless lossy compression is enabled.")
+			.EnumValue("None", COMPRESS_DENSE_NONE)
+			.EnumValue("8 bits", COMPRESS_DENSE_8_BITS)
+			.EnumValue("16 bits", COMPRESS_DENSE_16_BITS)
+			);
+		files.AddPreference(
+			Preference::Bool("compress_dense_lossy", false)
+			.Label("Lossy dense compression")
+			.Description(
+				"Quantize every uniformly sampled analog waveform to the selected code width, even if it\n"
+				"isn't on a grid of ADC levels. The codes span the channel's full scale range, extended to\n"
+				"cover every sample.\n\n"
+				"This is LOSSY: waveforms with more resolution than the code width (e.g. filter outputs or\n"
+				"averaged captures) lose precision, and the original samples can't be recovered.")
+			);
+		files.AddPreference(
+			Preference::Bool("compress_sparse", false)
+			.Label("Compress sparse waveforms")
+			.Description(
+				"Delta-encode timestamps and run-length encode durations of sparse waveforms when saving a session,\n"
+				"if this makes the file smaller.\n\n"
+				"This reduces file size for protocol decodes and other sparse data, but loading is slightly slower\n"
+				"since the data can't be copied directly into memory.")
+			);
+		files.AddPreference(
+			Preference::Bool("pack_digital", true)
+			.Label("Pack digital waveforms")
+			.Description(
+				"Store digital waveform samples as one bit each when saving a session, rather than one byte.\n\n"
+				"This makes logic analyzer captures 8x smaller on disk.")
+			);
+		files.AddPreference(
+			Preference::Bool("share_timebase", true)
+			.Label("Share sparse timebases")
+			.Description(
+				"When several sparse waveforms from the same acquisition have identical timestamps and durations\n"
+				"(e.g. every bit of a logic analyzer capture), save them once and have the other files refer to it.\n\n"
+				"This makes wide sparse captures up to 2/3 smaller on disk. Sessions saved this way can't be\n"
+				"opened by older versions.")
+			);
 
 	auto& misc = this->m_treeRoot.AddCategory("Miscellaneous");
 		auto& menus = misc.AddCategory("Menus");
@@ -516,6 +725,501 @@ void PreferenceManager::InitializeDefaults()
 				Preference::Int("recent_instrument_count", 20)
 				.Label("Recent instrument count")
 				.Description("Number of recently used instruments to display"));
+		auto& mask = misc.AddCategory("Mask Testing");
+			mask.AddPreference(
+				Preference::Bool("enable", false)
+				.Label("Test each acquisition")
+				.Description(
+					"Test every live acquisition against the mask of each eye pattern, as it arrives.\n\n"
+					"The eye pattern only shows whether the mask was hit since it was last cleared. This also counts\n"
+					"hits per mask region and per acquisition, so failing acquisitions can be found in history.")
+				);
+			mask.AddPreference(
+				Preference::Enum("history_policy", MASK_FAIL_PIN)
+				.Label("History policy")
+				.Description(
+					"What to do with history when an acquisition fails a mask test.\n\n"
+					"Pin failures: failing acquisitions are pinned so they're never purged from history.\n"
+					"Keep only failures: failing acquisitions are pinned, and passing ones are dropped from history\n"
+					"as soon as a newer acquisition arrives, so a long soak test keeps nothing but the failures.")
+				.EnumValue("Keep all", MASK_FAIL_KEEP_ALL)
+				.EnumValue("Pin failures", MASK_FAIL_PIN)
+				.EnumValue("Keep only failures", MASK_FAIL_ONLY)
+				);
+			mask.AddPreference(
+				Preference::Bool("margin_search", true)
+				.Label("Measure mask margin")
+				.Description(
+					"Measure each eye pattern's integrated data against its mask after every acquisition.
+
+"
+					"Shows the hits under each mask region and how far the regions can be grown (as a percentage of
+"
+					"their size) before the allowed hit rate is exceeded. This runs on the GPU against the eye as
+"
+					"integrated so far, and works whether or not each acquisition is being tested.")
+				);
+		auto& viewer = misc.AddCategory("Remote Viewer");
+			viewer.AddPreference(
+				Preference::Bool("enable", false)
+				.Label("Serve remote viewers")
+				.Description(
+					"Listen for remote viewers to connect over TCP.\n\n"
+					"Viewers are sent each new acquisition decimated to min/max columns at their plot width, and\n"
+					"only pull full resolution samples for the range they're zoomed in on, so a session can be\n"
+					"followed from another machine without every waveform crossing the network.")
+				);
+			viewer.AddPreference(
+				Preference::Int("port", 5030)
+				.Label("Port")
+				.Description("TCP port to listen for remote viewers on"));
+		auto& automation = misc.AddCategory("Automation");
+			automation.AddPreference(
+				Preference::Bool("enable", false)
+				.Label("Enable automation server")
+				.Description(
+					"Listen for text commands over TCP, so test scripts can arm the trigger, wait for acquisitions,\n"
+					"read measurements and save the session without going through the GUI.\n\n"
+					"There is no authentication: anyone who can reach the port can control the session and write\n"
+					"files, so only enable this on a trusted network.")
+				);
+			automation.AddPreference(
+				Preference::Int("port", 5031)
+				.Label("Port")
+				.Description("TCP port to listen for automation clients on"));
+		auto& video = misc.AddCategory("Video Capture");
+			video.AddPreference(
+				Preference::String(
+					"encoder_command",
+					"ffmpeg -loglevel error -y -f rawvideo -pixel_format {pixfmt} -video_size {width}x{height} "
+					"-framerate {fps} -i - -vf \"pad=ceil(iw/2)*2:ceil(ih/2)*2\" -c:v libx264 -preset ultrafast "
+					"-pix_fmt yuv420p \"{file}\"")
+				.Label("Encoder command")
+				.Description(
+					"Command run to encode View | Record Video captures. Raw frames are written to its standard input.\n\n"
+					"{width}, {height}, {fps}, {pixfmt} (bgra or rgba) and {file} are replaced with the frame size,\n"
+					"frame rate, pixel format and output file name.")
+				);
+			video.AddPreference(
+				Preference::Int("frame_rate", 60)
+				.Label("Frame rate")
+				.Description(
+					"Frame rate of the recording, in frames per second.\n\n"
+					"Frames are repeated or skipped as needed so the video plays back in real time."));
+
+	auto& perf = this->m_treeRoot.AddCategory("Performance");
+		auto& history = perf.AddCategory("History");
+			history.AddPreference(
+				Preference::Real("gpu_budget", 2.0 * 1024 * 1024 * 1024)
+				.Label("GPU memory budget")
+				.Unit(Unit::UNIT_BYTES)
+				.Description(
+					"Amount of waveform history to keep in GPU-accessible memory.\n\n"
+					"Once the most recent history points use more than this, older points are moved to pinned\n"
+					"host memory. They are moved back when selected in the history view.")
+				);
+			history.AddPreference(
+				Preference::Real("host_budget", 8.0 * 1024 * 1024 * 1024)
+				.Label("Host memory budget")
+				.Unit(Unit::UNIT_BYTES)
+				.Description(
+					"Amount of waveform history to keep in pinned host memory, after the GPU budget is used up.\n\n"
+					"Points older than this are moved to file-backed memory if disk spilling is enabled.")
+				);
+			history.AddPreference(
+				Preference::Bool("spill_to_disk", true)
+				.Label("Spill to disk")
+				.Description(
+					"Move history points which don't fit in the GPU and host memory budgets to file-backed memory,\n"
+					"which the OS can page out to disk.\n\n"
+					"This allows very long histories (e.g. overnight soak tests) without running out of RAM,\n"
+					"at the cost of slower access to old waveforms.")
+				);
+			history.AddPreference(
+				Preference::Bool("compact_samples", false)
+				.Label("Store as ADC codes")
+				.Description(
+					"Store analog waveforms in history as 8 or 16 bit integers plus a gain and offset, rather than\n"
+					"32 bit floats, once a newer acquisition has arrived.\n\n"
+					"Only waveforms whose samples all lie exactly on the instrument's ADC levels are converted, so\n"
+					"nothing is lost. Waveforms are converted back to floats when the history point is selected or\n"
+					"saved. Searching history skips converted waveforms.")
+				);
+			history.AddPreference(
+				Preference::Real("max_size", 64.0 * 1024 * 1024 * 1024)
+				.Label("Maximum size")
+				.Unit(Unit::UNIT_BYTES)
+				.Description(
+					"Maximum total amount of waveform data to keep in history when spilling to disk is enabled.\n\n"
+					"The oldest un-pinned points are deleted once history grows beyond this size, or beyond the\n"
+					"history depth set in the history dialog, whichever comes first.\n\n"
+					"If spilling to disk is disabled, the sum of the GPU and host memory budgets is used instead.")
+				);
+			history.AddPreference(
+				Preference::Real("waveform_pool_size", 512.0 * 1024 * 1024)
+				.Label("Waveform pool size")
+				.Unit(Unit::UNIT_BYTES)
+				.Description(
+					"Maximum amount of sample data to keep in the waveform pool.\n\n"
+					"Waveforms deleted from history, and saved filter outputs which are discarded, are kept in the pool\n"
+					"for filters and lazily loaded history to reuse, rather than freeing and reallocating memory.\n"
+					"Pool hit rate is shown in the performance metrics dialog.")
+				);
+			history.AddPreference(
+				Preference::Int("filter_cache_points", 10)
+				.Label("Filter output cache size")
+				.Unit(Unit::UNIT_COUNTS)
+				.Description(
+					"Number of history points to keep filter outputs for.\n\n"
+					"When switching away from a history point, the outputs of every filter are saved with it, so that\n"
+					"switching back doesn't have to re-run protocol decodes, FFTs, etc. Saved outputs are discarded\n"
+					"if any filter is reconfigured. Stateful filters such as eye patterns restart integration from\n"
+					"scratch when a point without saved outputs is selected.\n\n"
+					"Set to 0 to disable.")
+				);
+			history.AddPreference(
+				Preference::Real("heap_fraction", 0.5)
+				.Label("Heap fraction")
+				.Unit(Unit::UNIT_PERCENT)
+				.Description(
+					"Maximum fraction of each Vulkan memory heap's budget which history may use.\n\n"
+					"The GPU and host memory budgets are reduced to fit within this fraction of the space the\n"
+					"driver reports is available, leaving room for filters and rendering.")
+				);
+			history.AddPreference(
+				Preference::Bool("thumbnails", true)
+				.Label("Thumbnails")
+				.Description(
+					"Show a small preview of each history point's analog waveforms in the history dialog.\n\n"
+					"Previews are reduced to a few dozen min/max bins on the GPU as each acquisition comes in, so\n"
+					"scrolling through history never has to load any waveform data.")
+				);
+		auto& memory = perf.AddCategory("Memory");
+			memory.AddPreference(
+				Preference::Real("high_water_mark", 0.9)
+				.Label("High-water mark")
+				.Unit(Unit::UNIT_PERCENT)
+				.Description(
+					"Fraction of a Vulkan memory heap's budget at which memory is freed proactively.\n\n"
+					"Once usage of the pinned or GPU memory heap goes over this fraction of the budget reported by the\n"
+					"driver, idle buffers and caches are freed and old history is moved to slower memory, just as if an\n"
+					"allocation had failed, until usage is back under the mark.\n\n"
+					"Set to 100% to only free memory once an allocation actually fails.\n"
+					"Requires VK_EXT_memory_budget support.")
+				);
+			memory.AddPreference(
+				Preference::Bool("huge_pages", false)
+				.Label("Huge pages for large buffers")
+				.Description(
+					"Ask the OS to back large CPU-side waveform buffers (history, file loading and saving) with\n"
+					"transparent huge pages, so CPU passes over multi-GB waveforms take fewer TLB misses.\n\n"
+					"Only has an effect on Linux with transparent huge pages set to \"madvise\" or \"always\".")
+				);
+			memory.AddPreference(
+				Preference::Bool("numa_placement", false)
+				.Label("NUMA-aware placement")
+				.Description(
+					"Place large CPU-side waveform buffers on the NUMA node of the threads which will process them.\n\n"
+					"Waveforms go to the node the waveform thread is pinned to, and save staging buffers to the\n"
+					"node the task pool is pinned to (see Performance | Threads). Does nothing for threads which\n"
+					"aren't pinned to CPUs on a single node. Linux only.")
+				);
+		auto& rendering = perf.AddCategory("Rendering");
+			rendering.AddPreference(
+				Preference::Bool("render_thread", false)
+				.Label("Separate render thread")
+				.Description(
+					"Acquire back buffers, submit frames to the GPU and present them from a thread of their own.\n\n"
+					"The UI thread hands each finished frame off and starts on the next one straight away, so\n"
+					"building the UI overlaps with the previous frame's trip through the swapchain. Tone mapping\n"
+					"still waits for the previous frame, since it writes to textures that frame is drawing from.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("cache_tone_map", true)
+				.Label("Replay tone mapping commands")
+				.Description(
+					"Record the tone mapping commands for analog and digital waveforms once, and resubmit them\n"
+					"unchanged until the set of displayed channels, their sizes, or their colors change.\n\n"
+					"This reduces CPU load with many waveforms on screen. Views containing eye patterns, spectrograms,\n"
+					"or other density plots always record tone mapping from scratch.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("cache_fonts", true)
+				.Label("Cache font atlas")
+				.Description(
+					"Save the rasterized fonts to disk and reuse them on the next startup, as long as the font\n"
+					"preferences, font files, and display scaling are unchanged.\n\n"
+					"This makes startup and switching between font settings faster.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("minmax_pyramid", true)
+				.Label("Min/max decimation")
+				.Description(
+					"When zoomed out on deep uniformly sampled analog waveforms, draw from a precomputed\n"
+					"min/max summary of the waveform rather than every sample.\n\n"
+					"This makes panning and zooming much faster on deep captures without hiding peaks,\n"
+					"at the cost of about 25% extra GPU memory per displayed waveform.\n"
+					"Intensity grading is approximate while decimation is in use.\n\n"
+					"Long spectrograms are likewise drawn from copies with fewer, brighter time bins.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("packed_sparse_timestamps", true)
+				.Label("Packed sparse timestamps")
+				.Description(
+					"Draw deep sparse waveforms (digital buses, trends, measurement outputs) from a copy of their\n"
+					"timestamps packed into 32-bit deltas, rather than the full 64-bit values.\n\n"
+					"This roughly halves the memory traffic of redrawing them, and avoids emulated 64-bit math on\n"
+					"GPUs without native support for it. Uses about 4 bytes of extra GPU memory per sample\n"
+					"(8 for waveforms drawn without interpolation).")
+				);
+			rendering.AddPreference(
+				Preference::Bool("gpu_protocol", true)
+				.Label("GPU protocol rendering")
+				.Description(
+					"Draw protocol decode cells too narrow to hold text with a compute shader, rather than as\n"
+					"individual shapes on the CPU.\n\n"
+					"This keeps dense decodes (8b/10b symbols, Ethernet, etc) fast to draw at any zoom level.\n"
+					"Cells wide enough for text are always drawn on the CPU.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("incremental_waterfall", true)
+				.Label("Incremental waterfall rendering")
+				.Description(
+					"When a waterfall scrolls with the view unchanged, only draw the new rows and rotate the\n"
+					"rest of the image in place rather than redrawing every pixel.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("incremental_append", true)
+				.Label("Incremental roll mode rendering")
+				.Description(
+					"When an instrument appends new samples to the existing waveform (e.g. in roll mode), only redraw\n"
+					"the part of the waveform the new samples cover, rather than the entire capture.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("reproject_preview", true)
+				.Label("Instant zoom and pan preview")
+				.Description(
+					"While waveforms are being redrawn after a zoom or pan, stretch and shift the previous image to\n"
+					"match the new view so the display responds immediately.\n\n"
+					"The preview is replaced by the full quality image as soon as it's ready.")
+				);
+			rendering.AddPreference(
+				Preference::Enum("present_mode", PRESENT_FIFO)
+					.Label("Present mode")
+					.Description(
+						"How finished frames are handed to the display.\n\n"
+						"FIFO waits for vertical sync and never tears.\n"
+						"Mailbox also never tears, but replaces a queued frame with a newer one rather than waiting,\n"
+						"which reduces latency at the cost of redrawing faster than the display refreshes.\n"
+						"Immediate shows frames as soon as they're done and may tear.\n\n"
+						"If the selected mode isn't supported by the display, FIFO is used.")
+					.EnumValue("FIFO (vsync)", PRESENT_FIFO)
+					.EnumValue("Mailbox", PRESENT_MAILBOX)
+					.EnumValue("Immediate", PRESENT_IMMEDIATE)
+				);
+			rendering.AddPreference(
+				Preference::Real("deferred_work_budget", 0.5)
+				.Label("Deferred work budget (fraction of a frame)")
+				.Description(
+					"How much of each display refresh interval the GUI may use, including drawing the windows,\n"
+					"before it stops working on deferrable jobs such as rebuilding protocol analyzer rows.\n\n"
+					"Lower values keep the frame rate steadier, higher values finish large jobs sooner.\n"
+					"At least one slice of deferred work is always done per frame.")
+				);
+			rendering.AddPreference(
+				Preference::Bool("half_precision_raster", false)
+				.Label("Half precision rasterization")
+				.Description(
+					"Store rasterized analog and digital waveforms as 16-bit rather than 32-bit floating point,\n"
+					"halving the GPU memory used per channel. Very bright pixels saturate sooner, and persistence\n"
+					"decays in coarser steps.")
+				);
+		auto& wfm = perf.AddCategory("Waveform Processing");
+			wfm.AddPreference(
+				Preference::Int("pipeline_depth", 1)
+				.Label("Pipeline depth")
+				.Description(
+					"Maximum number of acquisitions which may be processed ahead of the GUI.\n\n"
+					"At 1, each acquisition is downloaded, filtered, rasterized, and displayed before the next one\n"
+					"is downloaded.\n\n"
+					"At 2 or more, the next acquisition is downloaded while the GPU is still rendering the previous\n"
+					"one, and the GUI may fall up to this many acquisitions behind the waveform processing thread.\n"
+					"This improves waveforms-per-second on fast instruments at the cost of slightly higher latency\n"
+					"and memory usage."
+					)
+				.Unit(Unit::UNIT_COUNTS));
+			wfm.AddPreference(
+				Preference::Int("segment_batch_size", 1)
+				.Label("Segments per download")
+				.Description(
+					"Maximum number of queued triggers to pull from an instrument in one pass.\n\n"
+					"Instruments in segmented (fast frame / sequence) mode deliver many triggers at once. Rather than\n"
+					"filtering and rendering each one, up to this many are added straight to history as segments of\n"
+					"a single acquisition, and only the last one is displayed. Any segment can be viewed from the\n"
+					"history dialog.\n\n"
+					"Stateful filters such as eye patterns only see the displayed segments.\n"
+					"Set to 1 to process every trigger individually."
+					)
+				.Unit(Unit::UNIT_COUNTS));
+			wfm.AddPreference(
+				Preference::Bool("early_multiscope_rearm", false)
+				.Label("Early multi-scope re-arm")
+				.Description(
+					"In multi-scope free-run mode, re-arm every instrument in a trigger group as soon as all of\n"
+					"their waveforms have been downloaded, rather than after the acquisition has been displayed.\n\n"
+					"This takes filtering and rendering out of the dead time between triggers, so the trigger\n"
+					"rate is no longer limited by display latency. New triggers wait in each instrument's\n"
+					"pending waveform queue until the GUI catches up.")
+				);
+			wfm.AddPreference(
+				Preference::Bool("demand_driven_filters", true)
+				.Label("Only run displayed filters")
+				.Description(
+					"When a new acquisition arrives, only run filters whose output is displayed in a waveform view,\n"
+					"protocol analyzer, or measurement, plus anything feeding them.\n\n"
+					"Export filters, trend filters, and filters with \"Always run\" checked in their properties\n"
+					"are run regardless. Hidden filters are brought up to date as soon as they are displayed.\n\n"
+					"Disable to run the entire filter graph on every acquisition.")
+				);
+			wfm.AddPreference(
+				Preference::Bool("partition_by_trigger_group", true)
+				.Label("Only run filters for groups that triggered")
+				.Description(
+					"When some trigger groups have a new acquisition and others don't, only run the filters fed by\n"
+					"the groups that triggered. Filters fed only by the other groups keep their current outputs.\n\n"
+					"This stops a slow, deep-memory instrument's filters from holding back a fast free-running\n"
+					"instrument in another trigger group.\n\n"
+					"Disable to run the filters for every group on every acquisition.")
+				);
+			wfm.AddPreference(
+				Preference::Real("polled_coalesce_window", 50 * FS_PER_SECOND / 1000)
+				.Label("Polled instrument update window")
+				.Unit(Unit::UNIT_FS)
+				.Description(
+					"How long to wait for more updates from polled instruments (power supplies, multimeters,\n"
+					"loads, etc) before refreshing the filters that depend on them.\n\n"
+					"Updates from every instrument that arrive within this window are processed in a single\n"
+					"pass. Channels whose values haven't changed since the last poll don't trigger a refresh.")
+				);
+			wfm.AddPreference(
+				Preference::Bool("cancellable_refresh", true)
+				.Label("Cancellable filter refreshes")
+				.Description(
+					"When a filter is reconfigured or a history point is selected, run the affected filters one\n"
+					"level of the graph at a time, and abandon the refresh between levels if another one is requested.\n\n"
+					"This keeps repeated edits responsive on deep captures with slow decodes, at the cost of some\n"
+					"parallelism between independent branches of the graph.")
+				);
+			wfm.AddPreference(
+				Preference::Bool("upload_on_download", true)
+				.Label("Upload new waveforms in one batch")
+				.Description(
+					"Copy newly downloaded waveforms to the GPU in a single batch on a dedicated queue, alongside\n"
+					"any rendering of the previous acquisition still running on the GPU. Waveform processing waits\n"
+					"for the copy to finish before going on.\n\n"
+					"When disabled, each waveform is copied to the GPU on demand the first time a filter or the\n"
+					"renderer needs it.")
+				);
+			wfm.AddPreference(
+				Preference::Bool("preview_before_filters", true)
+				.Label("Preview deep captures")
+				.Description(
+					"On deep captures, draw the channels coming straight from instruments as soon as they've been\n"
+					"downloaded, then draw filter outputs once the filter graph has finished running.\n\n"
+					"The instrument channels show the new acquisition before the filtered waveforms do while this\n"
+					"is happening. Channels with persistence enabled wait for the filters, as usual.")
+				);
+			wfm.AddPreference(
+				Preference::Int("preview_min_depth", 10 * 1000 * 1000)
+				.Label("Preview depth threshold")
+				.Description(
+					"Only preview acquisitions in which at least one waveform has this many samples. Shallower\n"
+					"captures filter quickly enough that drawing them twice isn't worth it.")
+				.Unit(Unit::UNIT_SAMPLEDEPTH));
+			wfm.AddPreference(
+				Preference::Int("chunk_samples", 16 * 1024 * 1024)
+				.Label("Chunked run window size")
+				.Description(
+					"Number of input samples per window when running a filter in chunks from its properties dialog.\n\n"
+					"Chunked runs process captures too large to fit in GPU memory a window at a time. Larger\n"
+					"windows have less overhead from the overlap between them, but need more GPU memory.")
+				.Unit(Unit::UNIT_SAMPLEDEPTH));
+
+		auto& autotune = perf.AddCategory("Autotuning");
+			autotune.AddPreference(
+				Preference::Bool("enable", true)
+				.Label("Pick CPU or GPU paths by measurement")
+				.Description(
+					"For operations with both CPU and GPU implementations, time both the first time each is run\n"
+					"at a new problem size, and use whichever was faster from then on.\n\n"
+					"Results are remembered per GPU and driver version, and can be cleared from the performance\n"
+					"metrics dialog. When disabled, the GPU implementation is always used.")
+				);
+			autotune.AddPreference(
+				Preference::String("crossovers", "")
+				.Invisible()
+				);
+		auto& threads = perf.AddCategory("Threads");
+			threads.AddPreference(
+				Preference::Enum("instrument_priority", THREAD_PRIO_NORMAL)
+					.Label("Instrument thread priority")
+					.Description(
+						"Scheduling priority of the threads which talk to instruments.\n\n"
+						"Raising this keeps socket and USB reads going while filters are using every core, which\n"
+						"avoids buffer overruns on the instrument side.\n\n"
+						"High and Realtime usually need extra permissions on Linux (CAP_SYS_NICE, or a nice / rtprio\n"
+						"limit in limits.conf). If the priority can't be set, a warning is logged and the threads keep\n"
+						"their current priority.")
+					.EnumValue("Low", THREAD_PRIO_LOW)
+					.EnumValue("Normal", THREAD_PRIO_NORMAL)
+					.EnumValue("High", THREAD_PRIO_HIGH)
+					.EnumValue("Realtime", THREAD_PRIO_REALTIME)
+				);
+			threads.AddPreference(
+				Preference::String("instrument_cpus", "")
+				.Label("Instrument thread CPUs")
+				.Description(
+					"CPUs the instrument threads may run on, as a list of numbers and ranges like \"2-3,6\".\n\n"
+					"Leave blank to allow any CPU. To keep acquisition responsive under heavy filter load, give the\n"
+					"instrument threads their own cores and keep the waveform and task pool threads off them.\n"
+					"Not supported on macOS.")
+				);
+			threads.AddPreference(
+				Preference::Enum("waveform_priority", THREAD_PRIO_NORMAL)
+					.Label("Waveform thread priority")
+					.Description(
+						"Scheduling priority of the thread which runs the filter graph on each new waveform.\n\n"
+						"Realtime is not recommended: the filter graph can keep a core busy for a long time.")
+					.EnumValue("Low", THREAD_PRIO_LOW)
+					.EnumValue("Normal", THREAD_PRIO_NORMAL)
+					.EnumValue("High", THREAD_PRIO_HIGH)
+					.EnumValue("Realtime", THREAD_PRIO_REALTIME)
+				);
+			threads.AddPreference(
+				Preference::String("waveform_cpus", "")
+				.Label("Waveform thread CPUs")
+				.Description(
+					"CPUs the waveform processing thread may run on, in the same format as the instrument thread CPUs.\n\n"
+					"Leave blank to allow any CPU.")
+				);
+			threads.AddPreference(
+				Preference::Enum("pool_priority", THREAD_PRIO_NORMAL)
+					.Label("Task pool priority")
+					.Description(
+						"Scheduling priority of the worker threads used for parallel file loading and saving.\n\n"
+						"Set to Low to make big loads and saves get out of the way of acquisition and rendering.")
+					.EnumValue("Low", THREAD_PRIO_LOW)
+					.EnumValue("Normal", THREAD_PRIO_NORMAL)
+					.EnumValue("High", THREAD_PRIO_HIGH)
+					.EnumValue("Realtime", THREAD_PRIO_REALTIME)
+				);
+			threads.AddPreference(
+				Preference::String("pool_cpus", "")
+				.Label("Task pool CPUs")
+				.Description(
+					"CPUs the task pool workers may run on, in the same format as the instrument thread CPUs.\n\n"
+					"Leave blank to allow any CPU.")
+				);
 
 	auto& pwr = this->m_treeRoot.AddCategory("Power");
 		auto& events = pwr.AddCategory("Events");
@@ -530,19 +1234,22 @@ void PreferenceManager::InitializeDefaults()
 						"constant redraws increase power consumption.\n"
 						"\n"
 						"In Power mode, the event loop blocks until a GUI event (keystroke, mouse movement, etc.)\n"
-						"occurs, or a user-specified timeout elapses. This results in more jerky display updates\n"
-						"but keeps the CPU idle most of the time, saving power."
+						"occurs, new waveform or instrument data arrives, or a user-specified timeout elapses.\n"
+						"New data is still displayed as soon as it's ready, but the CPU stays idle the rest of\n"
+						"the time, saving power."
 						)
 					.EnumValue("Performance", 0)
 					.EnumValue("Power", 1)
 				);
 			events.AddPreference(
-				Preference::Real("polling_timeout", FS_PER_SECOND / 4)
+				Preference::Real("polling_timeout", FS_PER_SECOND)
 				.Label("Polling timeout")
 				.Unit(Unit::UNIT_FS)
 				.Description(
-					"Polling timeout for event loop in power-optimized mode.\n\n"
-					"Longer timeout values reduce power consumption, but also slows display updates.\n")
+					"Maximum time between redraws in power-optimized mode, if nothing else wakes up the event loop.\n\n"
+					"New waveforms and instrument readings are drawn immediately regardless of this setting, so it\n"
+					"only affects things that change without any input (such as tooltips appearing).\n"
+					"Set to zero to wait indefinitely.\n")
 				);
 
 
@@ -49,6 +49,13 @@ enum GuiTheme
 	THEME_CLASSIC = 2
 };
 
+enum PresentMode
+{
+	PRESENT_FIFO,
+	PRESENT_MAILBOX,
+	PRESENT_IMMEDIATE
+};
+
 enum ViewportMode
 {
 	VIEWPORT_ENABLE,
@@ -62,10 +69,38 @@ enum DataWidth
 	WIDTH_16_BITS
 };
 
+enum DenseCompression
+{
+	COMPRESS_DENSE_NONE,
+	COMPRESS_DENSE_8_BITS,
+	COMPRESS_DENSE_16_BITS
+};
+
+enum RecordOverflow
+{
+	RECORD_OVERFLOW_STALL,
+	RECORD_OVERFLOW_DROP
+};
+
 enum HeadlessStartupMode
 {
 	HEADLESS_STARTUP_ALL_NON_MSO,
 	HEADLESS_STARTUP_C1_ONLY
 };
 
+enum MaskFailPolicy
+{
+	MASK_FAIL_KEEP_ALL,
+	MASK_FAIL_PIN,
+	MASK_FAIL_ONLY
+};
+
+enum ThreadPriority
+{
+	THREAD_PRIO_LOW,
+	THREAD_PRIO_NORMAL,
+	THREAD_PRIO_HIGH,
+	THREAD_PRIO_REALTIME
+};
+
 #endif
@@ -0,0 +1,266 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ProfiledMutex and LockProfiler
+ */
+
+#include "ngscopeclient.h"
+#include "ProfiledMutex.h"
+
+using namespace std;
+
+#ifdef PROFILE_LOCKS
+
+///@brief Exclusive holds shorter than this (in ns) aren't worth cluttering the trace with
+static const int64_t LOCK_TRACE_MIN_HOLD = 100000;
+
+///@brief Every live ProfiledMutex
+static set<ProfiledMutexBase*>& GetLockRegistry()
+{
+	//Function-local so it's constructed before (and outlives) any global ProfiledMutex
+	static set<ProfiledMutexBase*> registry;
+	return registry;
+}
+
+///@brief Mutex controlling access to the lock registry and g_lockOrderViolations
+static mutex& GetLockRegistryMutex()
+{
+	static mutex registryMutex;
+	return registryMutex;
+}
+
+///@brief Pairs of (held, acquired) lock names which have already been reported as out of order
+static set<pair<string, string> > g_lockOrderViolations;
+
+///@brief Locks held by the calling thread, in the order they were acquired
+static thread_local vector<ProfiledMutexBase*> g_heldLocks;
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// LockProfiler
+
+/**
+	@brief Gets statistics for every lock, merged by name
+ */
+map<string, LockStats> LockProfiler::GetStats()
+{
+	map<string, LockStats> ret;
+
+#ifdef PROFILE_LOCKS
+	lock_guard<mutex> lock(GetLockRegistryMutex());
+	for(auto m : GetLockRegistry())
+	{
+		LockStats stats;
+		m->GetStats(stats);
+
+		auto& total = ret[m->GetName()];
+		total.m_acquisitions += stats.m_acquisitions;
+		total.m_contended += stats.m_contended;
+		total.m_waitTime += stats.m_waitTime;
+		total.m_maxWait = max(total.m_maxWait, stats.m_maxWait);
+		total.m_holdTime += stats.m_holdTime;
+		total.m_maxHold = max(total.m_maxHold, stats.m_maxHold);
+		total.m_orderViolations += stats.m_orderViolations;
+		for(auto& it : stats.m_contenders)
+			total.m_contenders[it.first] += it.second;
+	}
+#endif
+
+	return ret;
+}
+
+/**
+	@brief Resets statistics for every lock
+ */
+void LockProfiler::Clear()
+{
+#ifdef PROFILE_LOCKS
+	lock_guard<mutex> lock(GetLockRegistryMutex());
+	for(auto m : GetLockRegistry())
+		m->Clear();
+	g_lockOrderViolations.clear();
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ProfiledMutexBase
+
+ProfiledMutexBase::ProfiledMutexBase(const char* name, int rank)
+	: m_name(name)
+	, m_rank(rank)
+#ifdef PROFILE_LOCKS
+	, m_holdStart(0)
+	, m_holdDepth(0)
+#endif
+{
+#ifdef PROFILE_LOCKS
+	lock_guard<mutex> lock(GetLockRegistryMutex());
+	GetLockRegistry().emplace(this);
+#endif
+}
+
+ProfiledMutexBase::~ProfiledMutexBase()
+{
+#ifdef PROFILE_LOCKS
+	lock_guard<mutex> lock(GetLockRegistryMutex());
+	GetLockRegistry().erase(this);
+#endif
+}
+
+#ifdef PROFILE_LOCKS
+
+/**
+	@brief Copies out the statistics for this lock
+ */
+void ProfiledMutexBase::GetStats(LockStats& stats)
+{
+	lock_guard<mutex> lock(m_statsMutex);
+	stats = m_stats;
+}
+
+/**
+	@brief Resets the statistics for this lock
+ */
+void ProfiledMutexBase::Clear()
+{
+	lock_guard<mutex> lock(m_statsMutex);
+	m_stats = LockStats();
+}
+
+/**
+	@brief Checks that no lock which should come after this one is already held by the calling thread
+
+	Only checked in debug builds. Violations are logged once per pair of locks and counted, rather than asserted,
+	since some existing paths (e.g. arming a multi-scope trigger group) are known to break the documented order.
+ */
+void ProfiledMutexBase::CheckOrder()
+{
+#ifndef NDEBUG
+	if(m_rank == 0)
+		return;
+
+	for(auto held : g_heldLocks)
+	{
+		if( (held == this) || (held->m_rank <= m_rank) )
+			continue;
+
+		{
+			lock_guard<mutex> lock(m_statsMutex);
+			m_stats.m_orderViolations ++;
+		}
+
+		lock_guard<mutex> lock(GetLockRegistryMutex());
+		auto key = make_pair(string(held->m_name), string(m_name));
+		if(g_lockOrderViolations.find(key) == g_lockOrderViolations.end())
+		{
+			g_lockOrderViolations.emplace(key);
+			auto tname = Tracer::GetThreadName();
+			LogError("Lock order violation: %s locked while holding %s (thread %s)\n",
+				m_name, held->m_name, tname ? tname : "unnamed");
+		}
+		break;
+	}
+#endif
+}
+
+/**
+	@brief Records a lock acquisition which had to wait for another thread
+
+	@param start	Time the wait started, as returned by Tracer::Now()
+	@param end		Time the lock was acquired
+ */
+void ProfiledMutexBase::OnWait(int64_t start, int64_t end)
+{
+	auto tname = Tracer::GetThreadName();
+	int64_t dt = end - start;
+	{
+		lock_guard<mutex> lock(m_statsMutex);
+		m_stats.m_contended ++;
+		m_stats.m_waitTime += dt;
+		m_stats.m_maxWait = max(m_stats.m_maxWait, dt);
+		m_stats.m_contenders[tname ? tname : "unnamed"] ++;
+	}
+
+	Tracer::Record("Lock wait", start, end, m_name);
+}
+
+/**
+	@brief Records that the calling thread now holds the lock
+
+	@param exclusive	True for an exclusive lock, false for shared
+ */
+void ProfiledMutexBase::OnLocked(bool exclusive)
+{
+	g_heldLocks.push_back(this);
+
+	//Recursive locks only start a hold the first time
+	if(exclusive && (m_holdDepth++ == 0) )
+		m_holdStart = Tracer::Now();
+
+	lock_guard<mutex> lock(m_statsMutex);
+	m_stats.m_acquisitions ++;
+}
+
+/**
+	@brief Records that the calling thread is about to release the lock
+
+	@param exclusive	True for an exclusive lock, false for shared
+ */
+void ProfiledMutexBase::OnUnlocking(bool exclusive)
+{
+	//Usually the most recent lock is released first, so search from the end
+	for(size_t i=g_heldLocks.size(); i>0; i--)
+	{
+		if(g_heldLocks[i-1] == this)
+		{
+			g_heldLocks.erase(g_heldLocks.begin() + (i-1));
+			break;
+		}
+	}
+
+	if(!exclusive || (--m_holdDepth != 0) )
+		return;
+
+	auto now = Tracer::Now();
+	int64_t dt = now - m_holdStart;
+	{
+		lock_guard<mutex> lock(m_statsMutex);
+		m_stats.m_holdTime += dt;
+		m_stats.m_maxHold = max(m_stats.m_maxHold, dt);
+	}
+
+	if(dt >= LOCK_TRACE_MIN_HOLD)
+		Tracer::Record("Lock held", m_holdStart, now, m_name);
+}
+
+#endif
@@ -0,0 +1,279 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ProfiledMutex and LockProfiler
+ */
+#ifndef ProfiledMutex_h
+#define ProfiledMutex_h
+
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+#include "Tracer.h"
+
+/**
+	@brief Ranks of locks with a documented ordering
+
+	A thread holding a lock must not take one with a lower rank. See ProfiledMutexBase::GetRank().
+ */
+enum LockRank
+{
+	LOCK_RANK_NONE,
+	LOCK_RANK_WAVEFORM_WRITER,
+	LOCK_RANK_WAVEFORM_DATA,
+	LOCK_RANK_SCOPES,
+	LOCK_RANK_TRIGGER_GROUPS,
+	LOCK_RANK_VULKAN_ACTIVITY
+};
+
+/**
+	@brief Cumulative contention statistics for one named lock
+ */
+class LockStats
+{
+public:
+	LockStats()
+	: m_acquisitions(0)
+	, m_contended(0)
+	, m_waitTime(0)
+	, m_maxWait(0)
+	, m_holdTime(0)
+	, m_maxHold(0)
+	, m_orderViolations(0)
+	{}
+
+	///@brief Number of times the lock was acquired, shared or exclusive
+	uint64_t m_acquisitions;
+
+	///@brief Number of acquisitions which had to wait for another thread
+	uint64_t m_contended;
+
+	///@brief Total time spent waiting for the lock, in ns
+	int64_t m_waitTime;
+
+	///@brief Longest single wait, in ns
+	int64_t m_maxWait;
+
+	///@brief Total time the lock was held exclusively, in ns
+	int64_t m_holdTime;
+
+	///@brief Longest single exclusive hold, in ns
+	int64_t m_maxHold;
+
+	///@brief Number of times the lock was taken while holding a lock which should come after it
+	uint64_t m_orderViolations;
+
+	///@brief Names of threads which had to wait for the lock, and how many times each did
+	std::map<std::string, uint64_t> m_contenders;
+};
+
+/**
+	@brief Bookkeeping shared by all ProfiledMutex instances
+
+	Only does anything if ngscopeclient was built with PROFILE_LOCKS defined (cmake -DNGSCOPECLIENT_PROFILE_LOCKS=ON).
+	Otherwise ProfiledMutex compiles down to the mutex it wraps.
+ */
+class LockProfiler
+{
+public:
+
+	///@brief Checks if lock profiling was compiled in
+	static constexpr bool IsCompiledIn()
+	{
+#ifdef PROFILE_LOCKS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static std::map<std::string, LockStats> GetStats();
+	static void Clear();
+};
+
+/**
+	@brief Non-template part of ProfiledMutex: the name, ordering rank and statistics
+ */
+class ProfiledMutexBase
+{
+public:
+	ProfiledMutexBase(const char* name, int rank);
+	~ProfiledMutexBase();
+
+	ProfiledMutexBase(const ProfiledMutexBase&) =delete;
+	ProfiledMutexBase& operator=(const ProfiledMutexBase&) =delete;
+
+	///@brief Gets the name of the lock
+	const char* GetName() const
+	{ return m_name; }
+
+	/**
+		@brief Gets the rank of the lock
+
+		Locks with a lower rank must be locked first. Zero means the lock isn't part of any documented ordering.
+	 */
+	int GetRank() const
+	{ return m_rank; }
+
+#ifdef PROFILE_LOCKS
+	void GetStats(LockStats& stats);
+	void Clear();
+
+protected:
+	void CheckOrder();
+	void OnWait(int64_t start, int64_t end);
+	void OnLocked(bool exclusive);
+	void OnUnlocking(bool exclusive);
+#endif
+
+protected:
+	///@brief Name of the lock (must be a string literal or otherwise live forever)
+	const char* m_name;
+
+	///@brief Ordering rank, see GetRank()
+	int m_rank;
+
+#ifdef PROFILE_LOCKS
+	///@brief Mutex protecting the statistics (not the wrapped mutex)
+	std::mutex m_statsMutex;
+
+	///@brief Statistics since the last Clear()
+	LockStats m_stats;
+
+	///@brief Time the current exclusive hold started (only touched by the owning thread)
+	int64_t m_holdStart;
+
+	///@brief Recursion depth of the current exclusive hold (only touched by the owning thread)
+	int m_holdDepth;
+#endif
+};
+
+/**
+	@brief Drop-in wrapper around std::mutex, std::recursive_mutex or std::shared_mutex for finding lock contention
+
+	When built with PROFILE_LOCKS, records wait and hold times and the threads that had to wait for each named lock.
+	They're shown in the Metrics dialog, and waits are recorded as trace zones. Debug builds also check that ranked
+	locks are taken in rank order.
+
+	Without PROFILE_LOCKS every call is forwarded straight to the wrapped mutex.
+ */
+template<class M>
+class ProfiledMutex : public ProfiledMutexBase
+{
+public:
+	/**
+		@brief Creates the mutex
+
+		@param name		Name shown in statistics (must be a string literal or otherwise live forever)
+		@param rank		Ordering rank, see GetRank()
+	 */
+	ProfiledMutex(const char* name, int rank = LOCK_RANK_NONE)
+	: ProfiledMutexBase(name, rank)
+	{}
+
+	void lock()
+	{
+#ifdef PROFILE_LOCKS
+		CheckOrder();
+		if(!m_mutex.try_lock())
+		{
+			auto start = Tracer::Now();
+			m_mutex.lock();
+			OnWait(start, Tracer::Now());
+		}
+		OnLocked(true);
+#else
+		m_mutex.lock();
+#endif
+	}
+
+	bool try_lock()
+	{
+		if(!m_mutex.try_lock())
+			return false;
+#ifdef PROFILE_LOCKS
+		OnLocked(true);
+#endif
+		return true;
+	}
+
+	void unlock()
+	{
+#ifdef PROFILE_LOCKS
+		OnUnlocking(true);
+#endif
+		m_mutex.unlock();
+	}
+
+	//Shared locking is only instantiated if used, so these are harmless for the exclusive-only mutex types
+
+	void lock_shared()
+	{
+#ifdef PROFILE_LOCKS
+		CheckOrder();
+		if(!m_mutex.try_lock_shared())
+		{
+			auto start = Tracer::Now();
+			m_mutex.lock_shared();
+			OnWait(start, Tracer::Now());
+		}
+		OnLocked(false);
+#else
+		m_mutex.lock_shared();
+#endif
+	}
+
+	bool try_lock_shared()
+	{
+		if(!m_mutex.try_lock_shared())
+			return false;
+#ifdef PROFILE_LOCKS
+		OnLocked(false);
+#endif
+		return true;
+	}
+
+	void unlock_shared()
+	{
+#ifdef PROFILE_LOCKS
+		OnUnlocking(false);
+#endif
+		m_mutex.unlock_shared();
+	}
+
+protected:
+	M m_mutex;
+};
+
+#endif
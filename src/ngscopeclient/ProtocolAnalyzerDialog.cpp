@@ -60,6 +60,7 @@ ProtocolAnalyzerDialog::ProtocolAnalyzerDialog(
 	, m_needToScrollToSelectedPacket(false)
 	, m_firstDataBlockOfFrame(true)
 	, m_bytesPerLine(1)
+	, m_exportFormat(PacketExporter::FORMAT_CSV)
 {
 	//Hold a reference open to the filter so it doesn't disappear on us
 	m_filter->AddRef();
@@ -158,8 +159,9 @@ bool ProtocolAnalyzerDialog::DoRender()
 				idisplayed += it.second.size();
 		}
 		char stmp[128];
-		snprintf(stmp, sizeof(stmp), "%zu / %zu packets displayed (%.2f %%)\n",
-			idisplayed, itotal, idisplayed * 100.0 / itotal);
+		snprintf(stmp, sizeof(stmp), "%zu / %zu packets displayed (%.2f %%)%s\n",
+			idisplayed, itotal, idisplayed * 100.0 / itotal,
+			m_mgr->IsFiltering() ? ", still filtering" : "");
 
 		ImGui::BeginTooltip();
 		ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50);
@@ -178,10 +180,29 @@ bool ProtocolAnalyzerDialog::DoRender()
 			forceRefresh = true;
 	}
 
+	//Find the next packet containing some text or data bytes
+	bool findNext = false;
+	ImGui::SetNextItemWidth(20 * width);
+	if(ImGui::InputText("##search", &m_searchText, ImGuiInputTextFlags_EnterReturnsTrue))
+		findNext = true;
+	ImGui::SameLine();
+	if(ImGui::Button("Find Next"))
+		findNext = true;
+	if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+		ImGui::SetTooltip("Find the next packet with this text in any column, or these hex bytes in its data");
+	if(findNext)
+		FindNext();
+
+	ImGui::SameLine();
+	DoExportControls();
+
 	//Do an update cycle to make sure any recently acquired packets are captured
 	m_mgr->Update();
 
-	lock_guard<recursive_mutex> lock(m_mgr->GetMutex());
+	//Pick up anything the display filter has matched since last frame
+	m_mgr->PollFilterResults();
+
+	unique_lock<recursive_mutex> lock(m_mgr->GetMutex());
 	auto& rows = m_mgr->GetRows();
 
 	m_firstDataBlockOfFrame = true;
@@ -279,6 +300,9 @@ bool ProtocolAnalyzerDialog::DoRender()
 				bool open = false;
 				if(hasChildren)
 				{
+					//Search may have opened the node for us
+					if(m_mgr->IsChildOpen(pack))
+						ImGui::SetNextItemOpen(true);
 					open = ImGui::TreeNodeEx("##tree", ImGuiTreeNodeFlags_OpenOnArrow);
 
 					if(m_mgr->IsChildOpen(pack) != open)
@@ -413,16 +437,24 @@ bool ProtocolAnalyzerDialog::DoRender()
 		//Only scroll if requested packet is off screen
 		if(m_needToScrollToSelectedPacket && !visibleRowSelected)
 		{
-			//Go through our visible rows to find the closest packet
-			//(may not be the selected one we're just trying to scroll to that general area)
-			const auto sit = std::lower_bound(
-				rows.begin(),
-				rows.end(),
-				m_selectedPacket->m_offset,
-				[](const RowData& data, double f)
-					{ return f > (data.m_packet? data.m_packet->m_offset : data.m_marker.m_offset); });
-			auto& row = *sit;
-			ImGui::SetScrollFromPosY(ImGui::GetCursorStartPos().y + row.m_totalHeight);
+			//Scroll straight to the selected packet if it's displayed
+			auto prow = m_mgr->GetRowForPacket(m_lastSelectedWaveform, m_selectedPacket);
+			if(prow)
+				ImGui::SetScrollFromPosY(ImGui::GetCursorStartPos().y + prow->m_totalHeight);
+
+			else
+			{
+				//Go through our visible rows to find the closest packet
+				//(may not be the selected one we're just trying to scroll to that general area)
+				const auto sit = std::lower_bound(
+					rows.begin(),
+					rows.end(),
+					m_selectedPacket->m_offset,
+					[](const RowData& data, double f)
+						{ return f > (data.m_packet? data.m_packet->m_offset : data.m_marker.m_offset); });
+				auto& row = *sit;
+				ImGui::SetScrollFromPosY(ImGui::GetCursorStartPos().y + row.m_totalHeight);
+			}
 
 			m_needToScrollToSelectedPacket = false;
 		}
@@ -432,6 +464,13 @@ bool ProtocolAnalyzerDialog::DoRender()
 		g.NavId = navId;
 	}
 
+	//Upload any scanline images that came into view this frame
+	if(m_scanlines)
+		m_scanlines->Flush();
+
+	//SetDisplayFilter() waits for the filter thread, which needs the packet manager mutex
+	lock.unlock();
+
 	//Apply filter expressions
 	if( (updated && filterDirty) || forceRefresh)
 	{
@@ -456,57 +495,106 @@ bool ProtocolAnalyzerDialog::DoRender()
 }
 
 /**
-	@brief Handles the "image" column for packets
+	@brief Runs the controls for logging packets to disk
  */
-void ProtocolAnalyzerDialog::DoImageColumn(Packet* pack, vector<RowData>& rows, size_t nrow)
+void ProtocolAnalyzerDialog::DoExportControls()
 {
-	//TODO: get the actual texture
-	auto pos = ImGui::GetCursorScreenPos();
-	auto list = ImGui::GetWindowDrawList();
-	auto size = ImVec2(ImGui::GetContentRegionAvail().x, ImGui::GetTextLineHeight());
+	auto exporter = m_mgr->GetExporter();
+	if(exporter)
+	{
+		string label = string("Stop Logging (") + to_string(exporter->GetPacketCount()) + " packets)";
+		if(ImGui::Button(label.c_str()))
+			m_mgr->StopExport();
+		if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+			ImGui::SetTooltip("Logging to %s", exporter->GetPath().c_str());
+	}
 
-	//auto tex = m_parent.GetTextureManager()->GetTexture("visible-spectrum-380nm-750nm");
+	else
+	{
+		ImGui::SetNextItemWidth(8 * ImGui::GetFontSize());
+		ImGui::Combo("##exportformat", (int*)&m_exportFormat, "CSV\0JSON lines\0PCAP\0");
+		ImGui::SameLine();
+		if(ImGui::Button("Log to File...") && !m_exportBrowser)
+		{
+			auto mask = PacketExporter::GetFileMask(m_exportFormat);
+			m_exportBrowser = MakeFileBrowser(
+				&m_parent,
+				".",
+				"Log Packets",
+				string("Packet logs (") + mask + ")",
+				mask,
+				true);
+		}
+		if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+		{
+			ImGui::SetTooltip(
+				"Write every packet decoded from now on to a file.\n"
+				"Logging is not limited by the history depth.");
+		}
+	}
 
-	if(!rows[nrow].m_texture)
+	if(m_exportBrowser)
 	{
-		size_t width = pack->m_data.size() / 3;
+		m_exportBrowser->Render();
 
-		LogTrace("filling texture with 1x%zu pixels of scanline data\n", width);
-		LogIndenter li;
+		if(m_exportBrowser->IsClosedOK())
+		{
+			auto path = m_exportBrowser->GetFileName();
+			if(!m_mgr->StartExport(path, m_exportFormat))
+				ShowErrorPopup("Export failed", string("Could not open ") + path + " for writing");
+		}
 
-		//TODO: this and TextureManager::LoadTexture have a lot in common
-		//we should refactor into common code
-		VkDeviceSize devsize = width * 4;
+		if(m_exportBrowser->IsClosed())
+			m_exportBrowser = nullptr;
+	}
+}
 
-		//Allocate temporary staging buffer
-		vk::BufferCreateInfo bufinfo({}, devsize, vk::BufferUsageFlagBits::eTransferSrc);
-		vk::raii::Buffer stagingBuf(*g_vkComputeDevice, bufinfo);
+/**
+	@brief Selects the next packet matching the search text
+ */
+void ProtocolAnalyzerDialog::FindNext()
+{
+	auto stamp = m_lastSelectedWaveform;
+	auto pack = m_selectedPacket;
+	if(!m_mgr->FindNext(m_searchText, stamp, pack))
+		return;
 
-		//Figure out memory requirements of the buffer and decide what physical memory type to use
-		//For now, default to using the first type in the mask that is host visible
-		auto req = stagingBuf.getMemoryRequirements();
-		auto memProperties = g_vkComputePhysicalDevice->getMemoryProperties();
-		uint32_t memType = 0;
-		for(uint32_t i=0; i<32; i++)
-		{
-			//Skip anything not host visible since we have to be able to write to it
-			if(!(memProperties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible))
-				continue;
+	if( (m_lastSelectedWaveform != TimePoint(0, 0)) && (m_lastSelectedWaveform != stamp) )
+		m_waveformChanged = true;
+	m_lastSelectedWaveform = stamp;
+	m_selectedPacket = pack;
+	m_needToScrollToSelectedPacket = true;
 
-			//Stop if buffer is compatible
-			if(req.memoryTypeBits & (1 << i) )
-			{
-				memType = i;
-				break;
-			}
-		}
-		LogTrace("Using memory type %u for staging buffer\n", memType);
+	m_parent.NavigateToTimestamp(pack->m_offset, pack->m_len, StreamDescriptor(m_filter, 0));
+}
 
-		//Allocate the memory and bind to the buffer
-		vk::MemoryAllocateInfo minfo(req.size, memType);
-		vk::raii::DeviceMemory physMem(*g_vkComputeDevice, minfo);
-		auto mappedPtr = reinterpret_cast<uint8_t*>(physMem.mapMemory(0, req.size));
-		stagingBuf.bindMemory(*physMem, 0);
+/**
+	@brief Handles the "image" column for packets
+
+	Scanline images live in a shared atlas. Rows scrolling into view are written to its staging buffer here, and all of
+	them are uploaded together at the end of the frame.
+ */
+void ProtocolAnalyzerDialog::DoImageColumn(Packet* pack, vector<RowData>& rows, size_t nrow)
+{
+	auto pos = ImGui::GetCursorScreenPos();
+	auto list = ImGui::GetWindowDrawList();
+	auto size = ImVec2(ImGui::GetContentRegionAvail().x, ImGui::GetTextLineHeight());
+
+	size_t width = pack->m_data.size() / 3;
+	if(width == 0)
+		return;
+
+	if(!m_scanlines)
+		m_scanlines = make_unique<ScanlineAtlas>(m_parent.GetTextureManager(), "ProtocolAnalyzerDialog.scanlines");
+
+	auto& row = rows[nrow];
+	if(!m_scanlines->IsResident(row.m_scanlineSlot, row.m_scanlineSerial))
+	{
+		auto pixels = m_scanlines->Allocate(width, row.m_scanlineSlot, row.m_scanlineSerial);
+
+		//Every row of the atlas is already on screen, nothing we can do
+		if(!pixels)
+			return;
 
 		//Special case: RGB LED decodes can have scaling if not running at full brightness
 		float scale = 1;
@@ -514,51 +602,19 @@ void ProtocolAnalyzerDialog::DoImageColumn(Packet* pack, vector<RowData>& rows,
 		if(rgbf)
 			scale = rgbf->GetScale();
 
-		//Fill the mapped buffer with image data
 		for(size_t i=0; i<width; i++)
 		{
-			mappedPtr[i*4] 		= min(pack->m_data[i*3] * scale, 255.0f);
-			mappedPtr[i*4 + 1]	= min(pack->m_data[i*3 + 1] * scale, 255.0f);
-			mappedPtr[i*4 + 2]	= min(pack->m_data[i*3 + 2] * scale, 255.0f);
-			mappedPtr[i*4 + 3]	= 255;
+			pixels[i*4] 		= min(pack->m_data[i*3] * scale, 255.0f);
+			pixels[i*4 + 1]	= min(pack->m_data[i*3 + 1] * scale, 255.0f);
+			pixels[i*4 + 2]	= min(pack->m_data[i*3 + 2] * scale, 255.0f);
+			pixels[i*4 + 3]	= 255;
 		}
-		physMem.unmapMemory();
-
-		//NOTE: Assumes the render queue is also capable of transfers (see QueueManager)
-		vk::ImageCreateInfo imageInfo(
-			{},
-			vk::ImageType::e2D,
-			vk::Format::eR8G8B8A8Unorm,
-			vk::Extent3D(width, 1, 1),
-			1,
-			1,
-			VULKAN_HPP_NAMESPACE::SampleCountFlagBits::e1,
-			VULKAN_HPP_NAMESPACE::ImageTiling::eOptimal,
-			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-			vk::SharingMode::eExclusive,
-			{},
-			vk::ImageLayout::eUndefined
-			);
-
-		//Make the Vulkan texture for it
-		rows[nrow].m_texture = make_shared<Texture>(
-			*g_vkComputeDevice,
-			imageInfo,
-			stagingBuf,
-			width,
-			1,
-			m_parent.GetTextureManager(),
-			"ProtocolAnalyzerDialog.scanline",
-			false);
 	}
 
 	//Actually draw it
-	auto tex = rows[nrow].m_texture;
-	m_parent.AddTextureUsedThisFrame(tex);
-	list->AddImage(
-		tex->GetTexture(),
-		pos,
-		pos + size);
+	auto ref = m_scanlines->Use(row.m_scanlineSlot);
+	m_parent.AddTextureUsedThisFrame(m_scanlines->GetTexture());
+	list->AddImage(ref.m_id, pos, pos + size, ref.m_uv0, ref.m_uv1);
 }
 
 /**
@@ -767,37 +823,10 @@ void ProtocolAnalyzerDialog::OnCursorMoved(int64_t offset)
 		m_lastSelectedWaveform = TimePoint(data->m_startTimestamp, data->m_startFemtoseconds);
 	}
 
-	auto& allpackets = m_mgr->GetFilteredPackets();
-	auto it = allpackets.find(m_lastSelectedWaveform);
-	if(it == allpackets.end())
+	auto pack = m_mgr->FindPacketAtOffset(m_lastSelectedWaveform, offset);
+	if(!pack)
 		return;
-	auto packets = it->second;
-
-	//TODO: binary search vs linear
-	for(auto p : packets)
-	{
-		//Check child packets first
-		auto& children = m_mgr->GetFilteredChildPackets(p);
-		for(auto c : children)
-		{
-			if(offset > (c->m_offset + c->m_len) )
-				continue;
-			if(c->m_offset > offset)
-				return;
-
-			m_selectedPacket = c;
-			m_needToScrollToSelectedPacket = true;
-			return;
-		}
 
-		//If we get here no child hit, try to match parent
-		if(offset > (p->m_offset + p->m_len) )
-			continue;
-		if(p->m_offset > offset)
-			return;
-
-		m_selectedPacket = p;
-		m_needToScrollToSelectedPacket = true;
-		return;
-	}
+	m_selectedPacket = pack;
+	m_needToScrollToSelectedPacket = true;
 }
@@ -37,6 +37,7 @@
 
 #include "Dialog.h"
 #include "Session.h"
+#include "FileBrowser.h"
 
 #include "../scopehal/PacketDecoder.h"
 
@@ -112,6 +113,8 @@ protected:
 
 	void DoDataColumn(Packet* pack, ImFont* dataFont, std::vector<RowData>& rows, size_t nrow);
 	void DoImageColumn(Packet* pack, std::vector<RowData>& rows, size_t nrow);
+	void FindNext();
+	void DoExportControls();
 
 	///@brief True the first time DoDataColumn() is called in a given frame
 	bool m_firstDataBlockOfFrame;
@@ -124,6 +127,18 @@ protected:
 
 	///@brief Filter expression we're actually using
 	std::string m_committedFilterExpression;
+
+	///@brief Text to look for with "find next"
+	std::string m_searchText;
+
+	///@brief Format to log packets to disk in
+	PacketExporter::Format m_exportFormat;
+
+	///@brief Browser for choosing the packet log file
+	std::shared_ptr<FileBrowser> m_exportBrowser;
+
+	///@brief Images of the video scanline packets in view (created when the first one is drawn)
+	std::unique_ptr<ScanlineAtlas> m_scanlines;
 };
 
 #endif
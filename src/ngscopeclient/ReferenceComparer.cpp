@@ -0,0 +1,238 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ReferenceComparer
+ */
+
+#include "ngscopeclient.h"
+#include "ReferenceComparer.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ReferenceComparer::ReferenceComparer(const string& name)
+	: m_queue(g_vkQueueManager->GetComputeQueue(name + ".queue"))
+	, m_pool(*g_vkComputeDevice,
+		vk::CommandPoolCreateInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_queue->m_family ))
+	, m_cmdBuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice,
+		vk::CommandBufferAllocateInfo(*m_pool, vk::CommandBufferLevel::ePrimary, 1)).front()))
+	, m_reference(name + ".reference")
+	, m_timescale(0)
+	, m_triggerPhase(0)
+	, m_tolerance(0)
+	, m_allowedFailures(0)
+	, m_results(name + ".results")
+	, m_warnedTimescale(false)
+{
+	m_comparePipeline = make_shared<ComputePipeline>(
+		"shaders/ReferenceCompare.spv", 3, sizeof(ReferenceCompareArgs));
+
+	if(g_hasDebugUtils)
+	{
+		string poolName = name + ".pool";
+		string bufName = name + ".cmdbuf";
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandPool,
+				reinterpret_cast<uint64_t>(static_cast<VkCommandPool>(*m_pool)),
+				poolName.c_str()));
+
+		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT(
+				vk::ObjectType::eCommandBuffer,
+				reinterpret_cast<int64_t>(static_cast<VkCommandBuffer>(*m_cmdBuf)),
+				bufName.c_str()));
+	}
+
+	//The reference is written once and then only read by the shader, the results come back every time
+	m_reference.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_UNLIKELY);
+	m_reference.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_results.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_results.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reference setup
+
+/**
+	@brief Uses a copy of an existing waveform (e.g. the one currently displayed) as the reference
+
+	The caller must hold a shared lock on the waveform data.
+
+	@param wfm		Waveform to copy
+	@param source	Description of where the waveform came from, for display
+ */
+void ReferenceComparer::SetReference(UniformAnalogWaveform* wfm, const string& source)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	m_reference.CopyFrom(wfm->m_samples);
+	m_reference.PrepareForGpuAccess();
+	m_timescale = wfm->m_timescale;
+	m_triggerPhase = wfm->m_triggerPhase;
+	m_source = source;
+	m_warnedTimescale = false;
+}
+
+/**
+	@brief Uses a list of samples (e.g. loaded from a file) as the reference
+
+	@param samples		Sample values
+	@param timescale	Sample interval, in fs
+	@param triggerPhase	Time of the first sample, in fs from the trigger
+	@param source		Description of where the samples came from, for display
+ */
+void ReferenceComparer::SetReference(
+	const vector<float>& samples,
+	int64_t timescale,
+	int64_t triggerPhase,
+	const string& source)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	m_reference.resize(samples.size());
+	memcpy(m_reference.GetCpuPointer(), samples.data(), samples.size() * sizeof(float));
+	m_reference.MarkModifiedFromCpu();
+	m_reference.PrepareForGpuAccess();
+	m_timescale = timescale;
+	m_triggerPhase = triggerPhase;
+	m_source = source;
+	m_warnedTimescale = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Testing
+
+/**
+	@brief Compares a live acquisition against the reference
+
+	The caller must hold a shared lock on the waveform data, and the filter graph must have been run on the
+	waveform if it's a filter output.
+
+	@param wfm			The waveform to test
+	@param failed		Set true if more samples were out of band than allowed
+	@param failures		Number of out-of-band samples
+	@param firstFailure	Time of the first out-of-band sample, in fs from the trigger (zero if there were none)
+
+	@return True if a test was run, false if there's no reference or it doesn't line up with the waveform
+ */
+bool ReferenceComparer::Test(UniformAnalogWaveform* wfm, bool& failed, uint64_t& failures, int64_t& firstFailure)
+{
+	failed = false;
+	failures = 0;
+	firstFailure = 0;
+
+	lock_guard<mutex> lock(m_mutex);
+
+	int64_t reflen = m_reference.size();
+	int64_t len = wfm->size();
+	if( (reflen == 0) || (len == 0) )
+		return false;
+
+	if(wfm->m_timescale != m_timescale)
+	{
+		if(!m_warnedTimescale)
+		{
+			Unit fs(Unit::UNIT_FS);
+			LogWarning("Reference compare: sample interval is %s but reference is %s, not testing\n",
+				fs.PrettyPrint(wfm->m_timescale).c_str(),
+				fs.PrettyPrint(m_timescale).c_str());
+			m_warnedTimescale = true;
+		}
+		return false;
+	}
+
+	//Live sample i lines up with reference sample i + shift
+	int64_t shift = llround( (wfm->m_triggerPhase - m_triggerPhase) * 1.0 / m_timescale);
+	int64_t first = max((int64_t)0, -shift);
+	int64_t end = min(len, reflen - shift);
+	end = min(end, (int64_t)UINT32_MAX);
+	if(end <= first)
+		return false;
+
+	m_results.resize(2);
+	m_results[0] = 0;
+	m_results[1] = UINT32_MAX;
+	m_results.MarkModifiedFromCpu();
+
+	m_cmdBuf.reset();
+	m_cmdBuf.begin({});
+
+	wfm->m_samples.PrepareForGpuAccessNonblocking(false, m_cmdBuf);
+
+	//sync in case transfer happened in another thread
+	AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(m_cmdBuf);
+
+	ReferenceCompareArgs args;
+	args.first = first;
+	args.end = end;
+	args.shift = shift;
+	args.tolerance = m_tolerance;
+	m_comparePipeline->BindBufferNonblocking(0, m_results, m_cmdBuf);
+	m_comparePipeline->BindBufferNonblocking(1, wfm->m_samples, m_cmdBuf);
+	m_comparePipeline->BindBufferNonblocking(2, m_reference, m_cmdBuf);
+	uint32_t blocks = GetComputeBlockCount(end - first, 64);
+	if(blocks > 32768)
+		blocks = 32768;
+	m_comparePipeline->Dispatch(m_cmdBuf, args, blocks);
+	m_results.MarkModifiedFromGpu();
+
+	m_cmdBuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "reference compare");
+		m_queue->SubmitAndBlock(m_cmdBuf);
+	}
+
+	m_results.PrepareForCpuAccess();
+	failures = m_results[0];
+	if(failures)
+		firstFailure = m_results[1] * m_timescale + wfm->m_triggerPhase;
+	failed = (failures > m_allowedFailures);
+
+	lock_guard<mutex> lock2(m_statsMutex);
+	m_stats.m_acquisitions ++;
+	if(failed)
+		m_stats.m_failedAcquisitions ++;
+	m_stats.m_samples += end - first;
+	m_stats.m_failures += failures;
+	m_stats.m_lastFailures = failures;
+	m_stats.m_lastFirstFailure = firstFailure;
+	m_stats.m_lastFailed = failed;
+
+	return true;
+}
@@ -0,0 +1,207 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ReferenceComparer
+ */
+#ifndef ReferenceComparer_h
+#define ReferenceComparer_h
+
+class ReferenceCompareArgs
+{
+public:
+	uint32_t first;
+	uint32_t end;
+	int32_t shift;
+	float tolerance;
+};
+
+/**
+	@brief Cumulative results of comparing live acquisitions of one stream against its reference
+ */
+class ReferenceCompareStats
+{
+public:
+	ReferenceCompareStats()
+	: m_acquisitions(0)
+	, m_failedAcquisitions(0)
+	, m_samples(0)
+	, m_failures(0)
+	, m_lastFailures(0)
+	, m_lastFirstFailure(0)
+	, m_lastFailed(false)
+	{}
+
+	///@brief Number of acquisitions tested
+	uint64_t m_acquisitions;
+
+	///@brief Number of acquisitions with more out-of-band samples than allowed
+	uint64_t m_failedAcquisitions;
+
+	///@brief Number of samples tested
+	uint64_t m_samples;
+
+	///@brief Total number of out-of-band samples
+	uint64_t m_failures;
+
+	///@brief Number of out-of-band samples in the most recent acquisition
+	uint64_t m_lastFailures;
+
+	///@brief Time of the first out-of-band sample in the most recent acquisition, in fs from the trigger
+	int64_t m_lastFirstFailure;
+
+	///@brief True if the most recent acquisition failed
+	bool m_lastFailed;
+};
+
+/**
+	@brief Compares every sample of a live acquisition against a stored golden waveform on the GPU
+
+	The reference is uploaded once, and each acquisition is then checked in a single pass which counts the samples
+	falling outside the tolerance band around the reference and finds the first one. Doing the same with generic
+	filters would take a subtract, an absolute value and a couple of measurements per channel, each with its own
+	full size output buffer.
+
+	Live and reference samples are lined up by time relative to the trigger, so both must have the same sample
+	rate. Samples outside the span of the reference aren't tested.
+ */
+class ReferenceComparer
+{
+public:
+	ReferenceComparer(const std::string& name);
+
+	void SetReference(UniformAnalogWaveform* wfm, const std::string& source);
+	void SetReference(
+		const std::vector<float>& samples,
+		int64_t timescale,
+		int64_t triggerPhase,
+		const std::string& source);
+
+	bool Test(UniformAnalogWaveform* wfm, bool& failed, uint64_t& failures, int64_t& firstFailure);
+
+	///@brief Gets the maximum allowed distance from the reference, in the stream's units
+	float GetTolerance()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_tolerance;
+	}
+
+	///@brief Sets the maximum allowed distance from the reference, in the stream's units
+	void SetTolerance(float tolerance)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tolerance = tolerance;
+	}
+
+	///@brief Gets the number of out-of-band samples an acquisition may have and still pass
+	uint64_t GetAllowedFailures()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_allowedFailures;
+	}
+
+	///@brief Sets the number of out-of-band samples an acquisition may have and still pass
+	void SetAllowedFailures(uint64_t allowed)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_allowedFailures = allowed;
+	}
+
+	///@brief Gets a description of where the reference came from
+	std::string GetSource()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_source;
+	}
+
+	///@brief Gets the number of samples in the reference
+	size_t GetReferenceLength()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_reference.size();
+	}
+
+	///@brief Gets a copy of the cumulative results
+	ReferenceCompareStats GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		return m_stats;
+	}
+
+	///@brief Clears the cumulative results
+	void ResetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_stats = ReferenceCompareStats();
+	}
+
+protected:
+
+	///@brief Mutex protecting the reference and settings, held while a test is running
+	std::mutex m_mutex;
+
+	//Vulkan processing queues etc
+	std::shared_ptr<QueueHandle> m_queue;
+	vk::raii::CommandPool m_pool;
+	vk::raii::CommandBuffer m_cmdBuf;
+
+	std::shared_ptr<ComputePipeline> m_comparePipeline;
+
+	///@brief Reference samples, kept in GPU memory
+	AcceleratorBuffer<float> m_reference;
+
+	///@brief Sample interval of the reference, in fs
+	int64_t m_timescale;
+
+	///@brief Time of the first reference sample, in fs from the trigger
+	int64_t m_triggerPhase;
+
+	///@brief Description of where the reference came from
+	std::string m_source;
+
+	///@brief Maximum allowed distance from the reference
+	float m_tolerance;
+
+	///@brief Number of out-of-band samples an acquisition may have and still pass
+	uint64_t m_allowedFailures;
+
+	///@brief Out-of-band sample count, then index of the first out-of-band sample
+	AcceleratorBuffer<uint32_t> m_results;
+
+	///@brief True once we've warned about a sample rate mismatch, so we don't do it every acquisition
+	bool m_warnedTimescale;
+
+	std::mutex m_statsMutex;
+	ReferenceCompareStats m_stats;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of RollingBuffer
+ */
+#include "ngscopeclient.h"
+#include "RollingBuffer.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates an empty buffer
+
+	@param span			Time span to keep, in X axis units
+	@param decimation	Number of raw points reduced to each min/max pair, or 0 to disable decimation
+ */
+RollingBuffer::RollingBuffer(float span, size_t decimation)
+	: m_span(span)
+	, m_latest(0)
+	, m_offset(0)
+	, m_decimation(decimation)
+	, m_bucketCount(0)
+	, m_decimatedOffset(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Discards all points
+ */
+void RollingBuffer::Clear()
+{
+	m_data.clear();
+	m_offset = 0;
+	m_decimated.clear();
+	m_decimatedOffset = 0;
+	m_bucketCount = 0;
+	m_latest = 0;
+}
+
+/**
+	@brief Appends a point, discarding the oldest one if it's out of the span
+
+	X coordinates must be monotonically increasing.
+ */
+void RollingBuffer::AddPoint(float x, float y)
+{
+	ImVec2 point(x, y);
+	m_latest = x;
+	Push(m_data, m_offset, point);
+
+	if(m_decimation <= 1)
+		return;
+
+	//Accumulate the current bucket
+	if(m_bucketCount == 0)
+	{
+		m_bucketMin = point;
+		m_bucketMax = point;
+	}
+	else
+	{
+		if(y < m_bucketMin.y)
+			m_bucketMin = point;
+		if(y > m_bucketMax.y)
+			m_bucketMax = point;
+	}
+	m_bucketCount ++;
+
+	//Bucket is full, push its extremes in time order
+	if(m_bucketCount >= m_decimation)
+	{
+		if(m_bucketMin.x <= m_bucketMax.x)
+		{
+			Push(m_decimated, m_decimatedOffset, m_bucketMin);
+			Push(m_decimated, m_decimatedOffset, m_bucketMax);
+		}
+		else
+		{
+			Push(m_decimated, m_decimatedOffset, m_bucketMax);
+			Push(m_decimated, m_decimatedOffset, m_bucketMin);
+		}
+		m_bucketCount = 0;
+	}
+}
+
+/**
+	@brief Appends a point to a circular buffer
+
+	The oldest slot is reused if it's empty or its point has scrolled out of the span. Otherwise the buffer is
+	unrolled and doubled in size, with the new slots left empty, so growing costs O(1) amortized.
+ */
+void RollingBuffer::Push(ImVector<ImVec2>& buf, int& offset, ImVec2 point)
+{
+	if(!buf.empty())
+	{
+		auto& oldest = buf[offset];
+		if(isnan(oldest.x) || (oldest.x < (point.x - m_span)) )
+		{
+			oldest = point;
+			offset = (offset + 1) % buf.Size;
+			return;
+		}
+	}
+
+	int oldSize = buf.Size;
+	rotate(buf.begin(), buf.begin() + offset, buf.end());
+	buf.resize(max(16, 2*oldSize), ImVec2(NAN, NAN));
+	buf[oldSize] = point;
+	offset = (oldSize + 1) % buf.Size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rendering
+
+/**
+	@brief Draws the buffer as a line in the current ImPlot plot
+
+	@param label		Label of the line
+	@param maxPoints	If decimation is enabled and the buffer has more points than this, the decimated points are
+						drawn instead. Points in the last incomplete bucket are left out.
+ */
+void RollingBuffer::Plot(const char* label, size_t maxPoints)
+{
+	auto buf = &m_data;
+	int offset = m_offset;
+	if( (m_decimation > 1) && (static_cast<size_t>(m_data.Size) > maxPoints) && !m_decimated.empty() )
+	{
+		buf = &m_decimated;
+		offset = m_decimatedOffset;
+	}
+
+	if(buf->empty())
+		return;
+
+	ImPlot::PlotLine(
+		label,
+		&(*buf)[0].x,
+		&(*buf)[0].y,
+		buf->Size,
+		ImPlotLineFlags_SkipNaN,
+		offset,
+		sizeof(ImVec2));
+}
@@ -36,35 +36,79 @@
 #define RollingBuffer_h
 
 /**
-	@brief Realtime plot helper (based on implot_demo)
+	@brief Realtime plot helper keeping the last few seconds of a trend
+
+	Points are kept in a circular buffer which only grows when every point in it is still within the span, so adding
+	a point is O(1) amortized no matter how long the span is. Unused slots are filled with NaN so the buffer can be
+	handed straight to ImPlot along with GetOffset().
+
+	Points which have scrolled out of the span are only discarded once their slot is needed, so callers should set
+	the plot's X axis to end at GetLatestX().
+
+	For long spans, min/max decimation can be enabled: every N points are reduced to their minimum and maximum and
+	kept in a second, smaller buffer, which Plot() draws instead of the raw points once there are too many of them.
  */
-struct RollingBuffer
+class RollingBuffer
 {
-	float Span;
-	ImVector<ImVec2> Data;
-
-	RollingBuffer()
-	{
-		Span = 10.0f;
-		Data.reserve(2000);
-	}
-
-	void Clear()
-	{ Data.clear(); }
-
-	void AddPoint(float x, float y)
-	{
-		Data.push_back(ImVec2(x, y));
-
-		while(!Data.empty())
-		{
-			float tfirst = Data.begin()->x;
-			if(tfirst < (x - Span))
-				Data.erase(Data.begin());
-			else
-				break;
-		}
-	}
+public:
+	RollingBuffer(float span = 10.0f, size_t decimation = 0);
+
+	void Clear();
+	void AddPoint(float x, float y);
+	void Plot(const char* label, size_t maxPoints = 2048);
+
+	///@brief Sets the time span to keep
+	void SetSpan(float span)
+	{ m_span = span; }
+
+	///@brief Gets the time span to keep
+	float GetSpan()
+	{ return m_span; }
+
+	///@brief Gets the X coordinate of the newest point
+	float GetLatestX()
+	{ return m_latest; }
+
+	///@brief Gets the raw point buffer, including unused (NaN) slots
+	const ImVector<ImVec2>& GetData()
+	{ return m_data; }
+
+	///@brief Gets the index of the oldest slot in GetData()
+	int GetOffset()
+	{ return m_offset; }
+
+protected:
+	void Push(ImVector<ImVec2>& buf, int& offset, ImVec2 point);
+
+	///@brief Time span to keep
+	float m_span;
+
+	///@brief X coordinate of the newest point
+	float m_latest;
+
+	///@brief Raw points
+	ImVector<ImVec2> m_data;
+
+	///@brief Index of the oldest slot in m_data
+	int m_offset;
+
+	///@brief Number of raw points per decimated bucket (0 or 1 to disable decimation)
+	size_t m_decimation;
+
+	///@brief Number of raw points in the current bucket
+	size_t m_bucketCount;
+
+	///@brief Point with the lowest Y value in the current bucket
+	ImVec2 m_bucketMin;
+
+	///@brief Point with the highest Y value in the current bucket
+	ImVec2 m_bucketMax;
+
+	///@brief Min/max pairs of each completed bucket
+	ImVector<ImVec2> m_decimated;
+
+	///@brief Index of the oldest slot in m_decimated
+	int m_decimatedOffset;
 };
 
 #endif
@@ -0,0 +1,312 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SCPIBatch
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "SCPIBatch.h"
+
+using namespace std;
+
+///@brief Size of the chunks binary block replies are copied to disk in
+#define SCPI_BATCH_CHUNK_SIZE	(1024 * 1024)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts running a batch
+
+	@param transport	Transport to send the commands over. Must outlive the batch.
+	@param commands		Commands to send, as returned by Parse()
+	@param depth		Maximum number of queries awaiting a reply at once
+ */
+SCPIBatch::SCPIBatch(SCPITransport* transport, const vector<SCPIBatchCommand>& commands, size_t depth)
+	: m_transport(transport)
+	, m_depth(max(depth, (size_t)1))
+	, m_commands(commands)
+	, m_completed(0)
+	, m_cancel(false)
+	, m_done(false)
+{
+	m_thread = make_unique<thread>(&SCPIBatch::ThreadProc, this);
+}
+
+/**
+	@brief Stops the batch after the command in progress, and waits for it
+ */
+SCPIBatch::~SCPIBatch()
+{
+	m_cancel = true;
+	m_thread->join();
+	m_thread = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parsing
+
+/**
+	@brief Splits a script into commands
+
+	Each line is one command. Blank lines and lines starting with # are ignored. A query may be followed by
+	"> filename" to save its binary block reply to a file.
+
+	@param script	Script text
+	@param commands	Filled out with the commands
+	@param error	Set to a description of the problem if the script is invalid
+
+	@return True if the script is valid
+ */
+bool SCPIBatch::Parse(const string& script, vector<SCPIBatchCommand>& commands, string& error)
+{
+	commands.clear();
+
+	stringstream ss(script);
+	string line;
+	size_t lineNumber = 0;
+	while(getline(ss, line))
+	{
+		lineNumber ++;
+		line = Trim(line);
+		if(line.empty() || (line[0] == '#') )
+			continue;
+
+		//Look for a redirect, ignoring anything inside a quoted string argument
+		bool redirect = false;
+		string path;
+		bool quoted = false;
+		for(size_t i=0; i<line.length(); i++)
+		{
+			if(line[i] == '\"')
+				quoted = !quoted;
+			else if(!quoted && (line[i] == '>') )
+			{
+				redirect = true;
+				path = Trim(line.substr(i+1));
+				line = Trim(line.substr(0, i));
+				break;
+			}
+		}
+
+		SCPIBatchCommand cmd(line, path);
+		if(redirect)
+		{
+			if(path.empty())
+			{
+				error = "Line " + to_string(lineNumber) + ": missing file name after >";
+				return false;
+			}
+			if(!cmd.m_query)
+			{
+				error = "Line " + to_string(lineNumber) + ": only queries have a reply to save";
+				return false;
+			}
+		}
+		commands.push_back(cmd);
+	}
+
+	if(commands.empty())
+	{
+		error = "No commands to send";
+		return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Returns a copy of every command and its results so far, in script order
+ */
+vector<SCPIBatchCommand> SCPIBatch::GetResults()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_commands;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+/**
+	@brief Thread function sending the commands and collecting their replies
+ */
+void SCPIBatch::ThreadProc()
+{
+	pthread_setname_np_compat("SCPIBatch");
+	Tracer::SetThreadName("SCPIBatch");
+
+	//Anything already queued by the driver or console has to go out before our commands
+	m_transport->FlushCommandQueue();
+	lock_guard<recursive_mutex> lock(m_transport->GetMutex());
+
+	size_t count = m_commands.size();
+	vector<double> sendTimes(count, 0);
+	deque<size_t> inFlight;
+	size_t next = 0;
+	while(!m_cancel && ( (next < count) || !inFlight.empty() ) )
+	{
+		//Send commands until the window is full. Commands without a reply are done as soon as they're sent.
+		while( (next < count) && (inFlight.size() < m_depth) && !m_cancel)
+		{
+			string text;
+			bool query;
+			{
+				lock_guard<mutex> lock2(m_mutex);
+				text = m_commands[next].m_command;
+				query = m_commands[next].m_query;
+			}
+
+			sendTimes[next] = GetTime();
+			m_transport->SendCommandImmediate(text);
+
+			if(query)
+				inFlight.push_back(next);
+			else
+			{
+				lock_guard<mutex> lock2(m_mutex);
+				m_commands[next].m_done = true;
+				m_commands[next].m_latency = (GetTime() - sendTimes[next]) * FS_PER_SECOND;
+				m_completed ++;
+			}
+			next ++;
+		}
+		if(inFlight.empty())
+			continue;
+
+		//Replies come back in the order the queries were sent
+		size_t i = inFlight.front();
+		inFlight.pop_front();
+
+		SCPIBatchCommand cmd = m_commands[i];
+		bool inSync = true;
+		if(cmd.m_outputPath.empty())
+		{
+			cmd.m_reply = Trim(m_transport->ReadReply(false));
+			if(cmd.m_reply.empty())
+			{
+				cmd.m_reply = "Request timed out.";
+				cmd.m_failed = true;
+			}
+		}
+		else
+			inSync = ReadBinaryBlock(cmd);
+		cmd.m_latency = (GetTime() - sendTimes[i]) * FS_PER_SECOND;
+		cmd.m_done = true;
+
+		{
+			lock_guard<mutex> lock2(m_mutex);
+			m_commands[i] = cmd;
+		}
+		m_completed ++;
+
+		//If a block was malformed or cut short, we don't know where the next reply starts
+		if(!inSync)
+		{
+			LogWarning("SCPI batch stopped at \"%s\": %s\n", cmd.m_command.c_str(), cmd.m_reply.c_str());
+			break;
+		}
+	}
+
+	m_done = true;
+}
+
+/**
+	@brief Copies a definite length block reply to the command's output file
+
+	The block is drained from the transport even if the file can't be written, so later replies can still be read.
+
+	@return False if the reply wasn't a valid block, leaving the transport out of sync
+ */
+bool SCPIBatch::ReadBinaryBlock(SCPIBatchCommand& cmd)
+{
+	cmd.m_failed = true;
+
+	//Header is #, the number of length digits, then the length in ASCII
+	unsigned char header[2] = {0};
+	if( (m_transport->ReadRawData(2, header) != 2) || (header[0] != '#') || (header[1] < '1') || (header[1] > '9') )
+	{
+		cmd.m_reply = "Reply is not a definite length block";
+		return false;
+	}
+	size_t ndigits = header[1] - '0';
+	char digits[10] = {0};
+	if(m_transport->ReadRawData(ndigits, reinterpret_cast<unsigned char*>(digits)) != ndigits)
+	{
+		cmd.m_reply = "Block header was cut short";
+		return false;
+	}
+	size_t len = strtoull(digits, nullptr, 10);
+
+	FILE* fp = fopen(cmd.m_outputPath.c_str(), "wb");
+	bool writeFailed = (fp == nullptr);
+
+	vector<unsigned char> chunk(min(len, (size_t)SCPI_BATCH_CHUNK_SIZE));
+	size_t remaining = len;
+	while(remaining > 0)
+	{
+		size_t got = m_transport->ReadRawData(min(remaining, chunk.size()), chunk.data());
+		if(got == 0)
+		{
+			if(fp)
+				fclose(fp);
+			cmd.m_reply = "Block was cut short after " + to_string(len - remaining) + " bytes";
+			return false;
+		}
+
+		if(fp && (fwrite(chunk.data(), 1, got, fp) != got) )
+		{
+			fclose(fp);
+			fp = nullptr;
+			writeFailed = true;
+		}
+		remaining -= got;
+	}
+	if(fp && (fclose(fp) != 0) )
+		writeFailed = true;
+
+	//IEEE 488.2 terminates the block with a newline like any other reply
+	unsigned char terminator;
+	m_transport->ReadRawData(1, &terminator);
+
+	cmd.m_bytes = len;
+	Unit bytes(Unit::UNIT_BYTES);
+	if(writeFailed)
+		cmd.m_reply = "Couldn't write " + bytes.PrettyPrint(len) + " to " + cmd.m_outputPath;
+	else
+	{
+		cmd.m_reply = bytes.PrettyPrint(len) + " written to " + cmd.m_outputPath;
+		cmd.m_failed = false;
+	}
+	return true;
+}
@@ -0,0 +1,144 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SCPIBatch
+ */
+#ifndef SCPIBatch_h
+#define SCPIBatch_h
+
+/**
+	@brief One line of a SCPI batch script, and what happened when it was run
+ */
+class SCPIBatchCommand
+{
+public:
+	SCPIBatchCommand(const std::string& command, const std::string& outputPath)
+	: m_command(command)
+	, m_outputPath(outputPath)
+	, m_query(command.find('?') != std::string::npos)
+	, m_done(false)
+	, m_failed(false)
+	, m_latency(0)
+	, m_bytes(0)
+	{}
+
+	///@brief Command text as sent to the instrument
+	std::string m_command;
+
+	///@brief File the binary block reply is written to (empty if the reply is text)
+	std::string m_outputPath;
+
+	///@brief True if the command expects a reply
+	bool m_query;
+
+	///@brief True once the command has been sent, and its reply (if any) received
+	bool m_done;
+
+	///@brief True if the reply couldn't be read or written out
+	bool m_failed;
+
+	///@brief Time from sending the command to receiving the end of its reply, in fs
+	int64_t m_latency;
+
+	///@brief Text reply, or a description of what went wrong
+	std::string m_reply;
+
+	///@brief Size of a binary block reply, in bytes
+	size_t m_bytes;
+};
+
+/**
+	@brief Runs a list of SCPI commands against an instrument on a background thread
+
+	Up to a configurable number of queries are kept in flight at once, so the round trip time of the transport is
+	paid once per window rather than once per command. Replies are read back in the order the queries were sent.
+
+	A query whose reply is an IEEE 488.2 definite length block (#9001234567...) can be redirected to a file, in which
+	case the block is copied there in fixed size chunks as it arrives rather than being read into memory.
+
+	The transport mutex is held for the entire batch, so the instrument's own thread is locked out until it finishes.
+ */
+class SCPIBatch
+{
+public:
+	SCPIBatch(SCPITransport* transport, const std::vector<SCPIBatchCommand>& commands, size_t depth);
+	virtual ~SCPIBatch();
+
+	SCPIBatch(const SCPIBatch&) =delete;
+	SCPIBatch& operator=(const SCPIBatch&) =delete;
+
+	static bool Parse(const std::string& script, std::vector<SCPIBatchCommand>& commands, std::string& error);
+
+	///@brief Requests that the batch stop after the command currently being processed
+	void Cancel()
+	{ m_cancel = true; }
+
+	///@brief Returns true once every command has been processed, or the batch was stopped early
+	bool IsDone()
+	{ return m_done; }
+
+	///@brief Returns the number of commands processed so far
+	size_t GetCompletedCount()
+	{ return m_completed; }
+
+	std::vector<SCPIBatchCommand> GetResults();
+
+protected:
+	void ThreadProc();
+	bool ReadBinaryBlock(SCPIBatchCommand& cmd);
+
+	///@brief Transport the commands are sent over
+	SCPITransport* m_transport;
+
+	///@brief Maximum number of queries awaiting a reply at once
+	size_t m_depth;
+
+	///@brief Mutex controlling access to m_commands
+	std::mutex m_mutex;
+
+	///@brief The commands and their results, in script order
+	std::vector<SCPIBatchCommand> m_commands;
+
+	///@brief Number of commands processed so far
+	std::atomic<size_t> m_completed;
+
+	///@brief Set to stop the batch early
+	std::atomic<bool> m_cancel;
+
+	///@brief Set when the thread has finished
+	std::atomic<bool> m_done;
+
+	///@brief Worker thread
+	std::unique_ptr<std::thread> m_thread;
+};
+
+#endif
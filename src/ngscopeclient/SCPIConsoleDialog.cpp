@@ -51,6 +51,9 @@ SCPIConsoleDialog::SCPIConsoleDialog(MainWindow* parent, shared_ptr<SCPIInstrume
 	, m_parent(parent)
 	, m_inst(inst)
 	, m_commandPending(false)
+	, m_batchDepth(8)
+	, m_batchStartTime(0)
+	, m_batchEndTime(0)
 {
 }
 
@@ -62,6 +65,39 @@ SCPIConsoleDialog::~SCPIConsoleDialog()
 // Rendering
 
 bool SCPIConsoleDialog::DoRender()
+{
+	//Keep polling the batch even if its tab isn't visible
+	if(m_batch)
+	{
+		m_batchResults = m_batch->GetResults();
+		if(m_batch->IsDone() && (m_batchEndTime == 0) )
+			m_batchEndTime = GetTime();
+	}
+
+	if(ImGui::BeginTabBar("SCPIConsole", ImGuiTabBarFlags_None))
+	{
+		if(ImGui::BeginTabItem("Console"))
+		{
+			ConsoleTab();
+			ImGui::EndTabItem();
+		}
+
+		if(ImGui::BeginTabItem("Batch"))
+		{
+			BatchTab();
+			ImGui::EndTabItem();
+		}
+
+		ImGui::EndTabBar();
+	}
+
+	return true;
+}
+
+/**
+	@brief Interactive console sending one command at a time
+ */
+void SCPIConsoleDialog::ConsoleTab()
 {
 	auto csize = ImGui::GetContentRegionAvail();
 
@@ -93,7 +129,7 @@ bool SCPIConsoleDialog::DoRender()
 
 	//Command input box
 	ImGui::SetNextItemWidth(csize.x);
-	bool pending = m_commandPending;
+	bool pending = m_commandPending || (m_batch && !m_batch->IsDone());
 	if(pending)
 		ImGui::BeginDisabled();
 	if(ImGui::InputText("Command", &m_command, ImGuiInputTextFlags_EnterReturnsTrue))
@@ -122,6 +158,136 @@ bool SCPIConsoleDialog::DoRender()
 	}
 	if(pending)
 		ImGui::EndDisabled();
+}
 
-	return true;
+/**
+	@brief Batch mode sending a whole script, with several queries in flight at once
+ */
+void SCPIConsoleDialog::BatchTab()
+{
+	float width = 10 * ImGui::GetFontSize();
+	bool running = m_batch && !m_batch->IsDone();
+
+	ImGui::BeginDisabled(running);
+		ImGui::PushFont(m_parent->GetFontPref("Appearance.General.console_font"));
+		ImVec2 editsize(ImGui::GetContentRegionAvail().x, 10 * ImGui::GetTextLineHeightWithSpacing());
+		ImGui::InputTextMultiline("###Script", &m_batchScript, editsize);
+		ImGui::PopFont();
+	ImGui::EndDisabled();
+	HelpMarker(
+		"One command per line. Blank lines and lines starting with # are ignored.\n\n"
+		"End a query with \"> filename\" to save its binary block (#9...) reply to a file instead of displaying it.");
+
+	ImGui::SetNextItemWidth(width);
+	ImGui::BeginDisabled(running);
+		if(ImGui::InputInt("Pipeline depth", &m_batchDepth))
+			m_batchDepth = max(1, m_batchDepth);
+	ImGui::EndDisabled();
+	HelpMarker(
+		"Maximum number of queries sent ahead of the reply currently being waited on.\n\n"
+		"Higher values hide more of the round trip time, but some instruments drop commands if their input buffer\n"
+		"overflows. Set to 1 to send one query at a time.");
+
+	if(running)
+	{
+		if(ImGui::Button("Stop"))
+			m_batch->Cancel();
+	}
+	else
+	{
+		//Wait for any console query to finish first
+		ImGui::BeginDisabled(m_commandPending);
+		bool run = ImGui::Button("Run");
+		ImGui::EndDisabled();
+		if(run)
+		{
+			vector<SCPIBatchCommand> commands;
+			if(SCPIBatch::Parse(m_batchScript, commands, m_batchError))
+			{
+				m_batchError = "";
+				m_batchResults = commands;
+				m_batchStartTime = GetTime();
+				m_batchEndTime = 0;
+				m_batch = make_unique<SCPIBatch>(m_inst->GetTransport(), commands, m_batchDepth);
+			}
+		}
+	}
+
+	if(!m_batchError.empty())
+	{
+		ImGui::SameLine();
+		ImGui::TextColored(ImVec4(1, 0.3, 0.3, 1), "%s", m_batchError.c_str());
+	}
+	else if(m_batch)
+	{
+		Unit fs(Unit::UNIT_FS);
+		double end = (m_batchEndTime != 0) ? m_batchEndTime : GetTime();
+		ImGui::SameLine();
+		ImGui::Text("%zu / %zu commands, %s",
+			m_batch->GetCompletedCount(),
+			m_batchResults.size(),
+			fs.PrettyPrint((end - m_batchStartTime) * FS_PER_SECOND).c_str());
+	}
+
+	BatchResultsTable();
+}
+
+/**
+	@brief Table of every command in the last batch, with its latency and reply
+ */
+void SCPIConsoleDialog::BatchResultsTable()
+{
+	ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_ScrollY |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit;
+
+	float width = ImGui::GetFontSize();
+	if(!ImGui::BeginTable("batchresults", 3, flags, ImGui::GetContentRegionAvail()))
+		return;
+
+	ImGui::TableSetupScrollFreeze(0, 1);
+	ImGui::TableSetupColumn("Command", ImGuiTableColumnFlags_WidthFixed, 15*width);
+	ImGui::TableSetupColumn("Latency", ImGuiTableColumnFlags_WidthFixed, 6*width);
+	ImGui::TableSetupColumn("Reply", ImGuiTableColumnFlags_WidthStretch);
+	ImGui::TableHeadersRow();
+
+	Unit fs(Unit::UNIT_FS);
+	ImGui::PushFont(m_parent->GetFontPref("Appearance.General.console_font"));
+
+	//Scripts may have thousands of lines
+	ImGuiListClipper clipper;
+	clipper.Begin(m_batchResults.size());
+	while(clipper.Step())
+	{
+		for(int i=clipper.DisplayStart; i<clipper.DisplayEnd; i++)
+		{
+			auto& cmd = m_batchResults[i];
+			ImGui::PushID(i);
+			ImGui::TableNextRow(ImGuiTableRowFlags_None);
+
+			ImGui::TableSetColumnIndex(0);
+			ImGui::TextUnformatted(cmd.m_command.c_str());
+
+			if(cmd.m_done)
+			{
+				ImGui::TableSetColumnIndex(1);
+				ImGui::TextUnformatted(fs.PrettyPrint(cmd.m_latency).c_str());
+
+				ImGui::TableSetColumnIndex(2);
+				if(cmd.m_failed)
+					ImGui::TextColored(ImVec4(1, 0.3, 0.3, 1), "%s", cmd.m_reply.c_str());
+				else
+					ImGui::TextUnformatted(cmd.m_reply.c_str());
+			}
+
+			ImGui::PopID();
+		}
+	}
+
+	ImGui::PopFont();
+	ImGui::EndTable();
 }
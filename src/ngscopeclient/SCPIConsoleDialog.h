@@ -36,6 +36,7 @@
 #define SCPIConsoleDialog_h
 
 #include "Dialog.h"
+#include "SCPIBatch.h"
 #include <future>
 
 class MainWindow;
@@ -55,6 +56,10 @@ public:
 	{ return m_inst; }
 
 protected:
+	void ConsoleTab();
+	void BatchTab();
+	void BatchResultsTable();
+
 	MainWindow* m_parent;
 	std::shared_ptr<SCPIInstrument> m_inst;
 
@@ -64,6 +69,27 @@ protected:
 
 	bool m_commandPending;
 	std::future<std::string> m_commandReturnValue;
+
+	///@brief Script being edited in the batch tab
+	std::string m_batchScript;
+
+	///@brief Maximum number of batch queries awaiting a reply at once
+	int m_batchDepth;
+
+	///@brief Error from parsing the batch script, if any
+	std::string m_batchError;
+
+	///@brief The batch currently running or last run, if any
+	std::unique_ptr<SCPIBatch> m_batch;
+
+	///@brief Results of m_batch as of the last frame
+	std::vector<SCPIBatchCommand> m_batchResults;
+
+	///@brief Time m_batch was started, as returned by GetTime()
+	double m_batchStartTime;
+
+	///@brief Time m_batch finished (zero if still running)
+	double m_batchEndTime;
 };
 
 #endif
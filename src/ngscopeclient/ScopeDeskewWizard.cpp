@@ -80,8 +80,13 @@ ScopeDeskewWizard::ScopeDeskewWizard(
 	, m_lastTriggerFs(0)
 	, m_bestCorrelation(0)
 	, m_bestCorrelationOffset(0)
+	, m_bestCorrelationFraction(0)
+	, m_useFFTCorrelation(true)
 	, m_maxSkewSamples(30000)
 	, m_medianSkew(0)
+	, m_trackInBackground(false)
+	, m_trackInterval(10)
+	, m_trackSmoothing(0.2)
 	, m_queue(g_vkQueueManager->GetComputeQueue("ScopeDeskewWizard.queue"))
 	, m_pool(*g_vkComputeDevice,
 		vk::CommandPoolCreateInfo(
@@ -119,9 +124,12 @@ ScopeDeskewWizard::ScopeDeskewWizard(
 	m_corrOut.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_UNLIKELY);
 	m_corrOut.resize(2*m_maxSkewSamples);
 
-	m_gpuCorrelationAvailable = g_hasShaderInt64;
+	m_gpuCorrelationAvailable = DeskewCorrelator::IsAvailable();
+	if(m_gpuCorrelationAvailable)
+		m_correlator = make_unique<DeskewCorrelator>("ScopeDeskewWizard.fft");
 
-	//Clear out any existing skew calibration
+	//Clear out any existing skew calibration (and make sure a background tracker doesn't put it back)
+	m_session.StopDeskewTracking(m_secondary);
 	m_session.SetDeskew(m_secondary, 0);
 }
 
@@ -270,6 +278,15 @@ bool ScopeDeskewWizard::DoRender()
 			ImGui::Checkbox("Use external reference on primary", &m_useExtRefPrimary);
 			ImGui::Checkbox("Use external reference on secondary", &m_useExtRefSecondary);
 
+			if(m_gpuCorrelationAvailable)
+			{
+				ImGui::Checkbox("Use FFT correlation", &m_useFFTCorrelation);
+				HelpMarker(
+					"Calculate the cross-correlation in the frequency domain.\n\n"
+					"This is much faster for deep captures, handles any ratio of sample rates, and allows "
+					"mixing uniform and sparse waveforms. Turn it off to use the direct time-domain method.");
+			}
+
 			if(ImGui::Button("Start"))
 			{
 				LogTrace("Starting\n");
@@ -282,7 +299,7 @@ bool ScopeDeskewWizard::DoRender()
 				//Record the current waveform timestamp on each channel (if any)
 				//so we can check if new data has shown up
 				{
-					shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+					shared_lock lock(m_session.GetWaveformDataMutex());
 					auto data = m_primaryStream.GetData();
 					if(data)
 					{
@@ -462,7 +479,7 @@ void ScopeDeskewWizard::DoMainProcessingFlow()
 	{
 		case STATE_ACQUIRE:
 			{
-				shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+				shared_lock lock(m_session.GetWaveformDataMutex());
 
 				//Make sure we have a waveform
 				auto data = m_primaryStream.GetData();
@@ -517,9 +534,49 @@ void ScopeDeskewWizard::DoMainProcessingFlow()
 				Unit fs(Unit::UNIT_FS);
 				ImGui::TextWrapped("Calculated skew: %s", fs.PrettyPrint(m_medianSkew).c_str());
 
+				if(m_gpuCorrelationAvailable)
+				{
+					ImGui::Checkbox("Track drift in background", &m_trackInBackground);
+					HelpMarker(
+						"Keep correlating the calibration channels on live acquisitions and adjust the skew to "
+						"follow drift (e.g. from temperature changes during a long test).\n\n"
+						"The calibration signal must stay connected to both channels for this to work.");
+
+					if(m_trackInBackground)
+					{
+						ImGui::SetNextItemWidth(6*ImGui::GetFontSize());
+						ImGui::InputFloat("Interval (s)", &m_trackInterval);
+						HelpMarker("Minimum time between measurements.");
+						m_trackInterval = max(m_trackInterval, 0.1f);
+
+						ImGui::SetNextItemWidth(6*ImGui::GetFontSize());
+						ImGui::SliderFloat("Smoothing", &m_trackSmoothing, 0.01, 1);
+						HelpMarker(
+							"Weight given to each new measurement.\n\n"
+							"Smaller values reject more noise but respond more slowly to drift.");
+					}
+				}
+
 				if(ImGui::Button("Apply"))
 				{
 					m_session.SetDeskew(m_secondary, m_medianSkew);
+
+					//Measurements correlating much worse than calibration did are probably a false alignment
+					if(m_trackInBackground)
+					{
+						vector<float> correlations = m_correlations;
+						sort(correlations.begin(), correlations.end());
+						float minCorrelation = correlations.empty() ? 0 : correlations[correlations.size()/2] / 2;
+
+						m_session.StartDeskewTracking(
+							m_secondary,
+							m_primaryStream,
+							m_secondaryStream,
+							m_trackInterval,
+							m_trackSmoothing,
+							minCorrelation);
+					}
+
 					m_state = STATE_CLOSE;
 				}
 			}
@@ -541,31 +598,32 @@ void ScopeDeskewWizard::StartCorrelation()
 	auto spri = dynamic_cast<SparseAnalogWaveform*>(pri);
 	auto ssec = dynamic_cast<SparseAnalogWaveform*>(sec);
 
+	m_bestCorrelation = 0;
+	m_bestCorrelationOffset = 0;
+	m_bestCorrelationFraction = 0;
+
+	bool useFFT = m_gpuCorrelationAvailable && m_useFFTCorrelation;
+
+	//Frequency domain path handles any combination of sample rates and waveform types, so use it if we can
+	if(useFFT && (upri || spri) && (usec || ssec) )
+	{
+		m_correlator->Correlate(pri, sec, m_maxSkewSamples);
+		m_bestCorrelation = m_correlator->GetCorrelation();
+		double offset = m_correlator->GetOffset();
+		m_bestCorrelationOffset = llround(offset);
+		m_bestCorrelationFraction = offset - m_bestCorrelationOffset;
+	}
+
 	//Optimized path (if both waveforms are dense packed)
-	if(upri && usec)
+	else if(upri && usec)
 	{
 		//Fall back to software implementation
 		if(!m_gpuCorrelationAvailable)
 			DoProcessWaveformUniformUnequalRate(upri, usec);
 
-		//If sample rates are equal we can simplify things a lot
-		else if(upri->m_timescale == usec->m_timescale)
-			DoProcessWaveformUniformEqualRateVulkan(upri, usec);
-		/*
-		//Also special-case 2:1 sample rate ratio (primary 2x speed of secondary)
-		else if((m_primaryWaveform->m_timescale * 2) == m_secondaryWaveform->m_timescale)
-			DoProcessWaveformDensePackedDoubleRateGeneric();
-		*/
-
-		//Primary 4x rate of secondary?
-		//FIXME: this optimized shader seems to be giving erroneous results ~1ns offset from the true peak
-		//unsure if implementation or algorithm bug, but disable it for now
-		/*else if((upri->m_timescale * 4) == usec->m_timescale)
-			DoProcessWaveformUniform4xRateVulkan(upri, usec);*/
-
-		//Unequal sample rates, more math needed
+		//Small problems can be faster on the CPU than paying the GPU dispatch overhead
 		else
-			DoProcessWaveformUniformUnequalRateVulkan(upri, usec);
+			DoProcessWaveformUniformAutotuned(upri, usec);
 	}
 
 	//Fallback path (if at least one waveform is not dense packed)
@@ -574,12 +632,12 @@ void ScopeDeskewWizard::StartCorrelation()
 
 	else
 	{
-		LogError("Mixed sparse and uniform waveforms not implemented\n");
+		LogError("Mixed sparse and uniform waveforms require FFT correlation\n");
 		return;
 	}
 
 	//Collect the skew from this round
-	int64_t skew = m_bestCorrelationOffset * pri->m_timescale;
+	int64_t skew = llround( (m_bestCorrelationOffset + m_bestCorrelationFraction) * pri->m_timescale);
 	Unit fs(Unit::UNIT_FS);
 	LogTrace("Bxest correlation = %f (delta = %" PRId64 " / %s)\n",
 		m_bestCorrelation, m_bestCorrelationOffset, fs.PrettyPrint(skew).c_str());
@@ -594,9 +652,81 @@ void ScopeDeskewWizard::StartCorrelation()
 	}
 }
 
+/**
+	@brief Correlates two uniform waveforms on the GPU or the CPU, whichever the autotuner says is faster
+
+	If the autotuner hasn't seen this problem size before, both are run and timed, and the GPU result is kept.
+ */
+void ScopeDeskewWizard::DoProcessWaveformUniformAutotuned(UniformAnalogWaveform* upri, UniformAnalogWaveform* usec)
+{
+	string op = (upri->m_timescale == usec->m_timescale) ?
+		"Deskew uniform equal rate correlation" : "Deskew uniform unequal rate correlation";
+	uint64_t size = upri->size() * 2 * m_maxSkewSamples;
+
+	auto& tuner = m_session.GetAutotuner();
+	switch(tuner.Choose(op, size))
+	{
+		case PathAutotuner::PATH_CPU:
+			DoProcessWaveformUniformUnequalRate(upri, usec);
+			break;
+
+		case PathAutotuner::PATH_GPU:
+			DoProcessWaveformUniformVulkan(upri, usec);
+			break;
+
+		case PathAutotuner::PATH_MEASURE:
+			{
+				double start = GetTime();
+				DoProcessWaveformUniformUnequalRate(upri, usec);
+				double cpuTime = GetTime() - start;
+
+				//Discard the CPU result so the GPU path starts from scratch
+				m_bestCorrelation = 0;
+				m_bestCorrelationOffset = 0;
+				m_bestCorrelationFraction = 0;
+
+				//Upload the waveforms first so the GPU timing is just the correlation, like the CPU timing
+				upri->m_samples.PrepareForGpuAccess();
+				usec->m_samples.PrepareForGpuAccess();
+
+				start = GetTime();
+				DoProcessWaveformUniformVulkan(upri, usec);
+				double gpuTime = GetTime() - start;
+
+				tuner.Report(op, size, cpuTime, gpuTime);
+			}
+			break;
+	}
+}
+
+/**
+	@brief Correlates two uniform waveforms on the GPU, using the fastest shader for their sample rates
+ */
+void ScopeDeskewWizard::DoProcessWaveformUniformVulkan(UniformAnalogWaveform* upri, UniformAnalogWaveform* usec)
+{
+	//If sample rates are equal we can simplify things a lot
+	if(upri->m_timescale == usec->m_timescale)
+		DoProcessWaveformUniformEqualRateVulkan(upri, usec);
+	/*
+	//Also special-case 2:1 sample rate ratio (primary 2x speed of secondary)
+	else if((m_primaryWaveform->m_timescale * 2) == m_secondaryWaveform->m_timescale)
+		DoProcessWaveformDensePackedDoubleRateGeneric();
+	*/
+
+	//Primary 4x rate of secondary?
+	//FIXME: this optimized shader seems to be giving erroneous results ~1ns offset from the true peak
+	//unsure if implementation or algorithm bug, but disable it for now
+	/*else if((upri->m_timescale * 4) == usec->m_timescale)
+		DoProcessWaveformUniform4xRateVulkan(upri, usec);*/
+
+	//Unequal sample rates, more math needed
+	else
+		DoProcessWaveformUniformUnequalRateVulkan(upri, usec);
+}
+
 void ScopeDeskewWizard::DoProcessWaveformSparse(SparseAnalogWaveform* ppri, SparseAnalogWaveform* psec)
 {
-	shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+	shared_lock lock(m_session.GetWaveformDataMutex());
 
 	//Calculate cross-correlation between the primary and secondary waveforms at up to +/- half the waveform length
 	int64_t len = ppri->size();
@@ -768,7 +898,7 @@ void ScopeSyncWizard::DoProcessWaveformDensePackedEqualRateGeneric()
 */
 void ScopeDeskewWizard::DoProcessWaveformUniformUnequalRate(UniformAnalogWaveform* ppri, UniformAnalogWaveform* psec)
 {
-	shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+	shared_lock lock(m_session.GetWaveformDataMutex());
 
 	double start = GetTime();
 
@@ -932,18 +1062,7 @@ void ScopeDeskewWizard::PostprocessVulkanCorrelation()
 	m_corrOut.PrepareForCpuAccess();	//todo make this part of the same queue
 
 	//Crunch results
-	int64_t bestOffset = 0;
-	double bestCorr = 0;
-	for(int64_t i=0; i<2*m_maxSkewSamples; i++)
-	{
-		auto f = m_corrOut[i];
-		if(f > bestCorr)
-		{
-			bestCorr = f;
-			bestOffset = i - m_maxSkewSamples;
-		}
-	}
-
-	m_bestCorrelation = bestCorr;
-	m_bestCorrelationOffset = bestOffset;
+	int64_t bestIndex = 0;
+	DeskewCorrelator::FindPeak(m_corrOut, 2*m_maxSkewSamples, m_bestCorrelation, bestIndex, m_bestCorrelationFraction);
+	m_bestCorrelationOffset = bestIndex - m_maxSkewSamples;
 }
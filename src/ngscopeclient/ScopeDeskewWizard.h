@@ -37,6 +37,7 @@
 
 #include "Dialog.h"
 #include "Session.h"
+#include "DeskewCorrelator.h"
 
 class UniformCrossCorrelateArgs
 {
@@ -70,6 +71,8 @@ public:
 protected:
 	void DoMainProcessingFlow();
 	void StartCorrelation();
+	void DoProcessWaveformUniformAutotuned(UniformAnalogWaveform* ppri, UniformAnalogWaveform* psec);
+	void DoProcessWaveformUniformVulkan(UniformAnalogWaveform* ppri, UniformAnalogWaveform* psec);
 	void DoProcessWaveformUniformUnequalRate(UniformAnalogWaveform* ppri, UniformAnalogWaveform* psec);
 	void DoProcessWaveformUniform4xRateVulkan(UniformAnalogWaveform* ppri, UniformAnalogWaveform* psec);
 	void DoProcessWaveformUniformUnequalRateVulkan(UniformAnalogWaveform* ppri, UniformAnalogWaveform* psec);
@@ -116,14 +119,29 @@ protected:
 	float m_bestCorrelation;
 	int64_t m_bestCorrelationOffset;
 
+	///@brief Sub-sample refinement of m_bestCorrelationOffset, in primary samples
+	double m_bestCorrelationFraction;
+
 	bool m_gpuCorrelationAvailable;
 
+	///@brief True to correlate in the frequency domain rather than directly
+	bool m_useFFTCorrelation;
+
 	//Maximum number of samples offset to consider
 	int64_t m_maxSkewSamples;
 
 	///@brief Calculated total skew
 	int64_t m_medianSkew;
 
+	///@brief True to keep tracking skew drift in the background once calibration is done
+	bool m_trackInBackground;
+
+	///@brief Minimum time between background tracking measurements, in seconds
+	float m_trackInterval;
+
+	///@brief Weight given to each background tracking measurement
+	float m_trackSmoothing;
+
 	//Vulkan processing queues etc
 	std::shared_ptr<QueueHandle> m_queue;
 	vk::raii::CommandPool m_pool;
@@ -134,6 +152,9 @@ protected:
 	std::shared_ptr<ComputePipeline> m_uniformUnequalRatePipeline;
 	std::shared_ptr<ComputePipeline> m_uniformEqualRatePipeline;
 
+	//Frequency domain correlation
+	std::unique_ptr<DeskewCorrelator> m_correlator;
+
 	//Output correlation data
 	AcceleratorBuffer<float> m_corrOut;
 };
@@ -34,6 +34,7 @@
  */
 #include "ngscopeclient.h"
 #include "ngscopeclient-version.h"
+#include "pthread_compat.h"
 #include "Session.h"
 #include "../scopeprotocols/ExportFilter.h"
 #include "MainWindow.h"
@@ -44,15 +45,35 @@
 #include "PowerSupplyDialog.h"
 #include "RFGeneratorDialog.h"
 #include "PreferenceTypes.h"
+#include "DeskewTracker.h"
+#include "WaveformRecorder.h"
+#include "HostMemoryPolicy.h"
+#include "AsyncFileWriter.h"
+#include "AsyncProperty.h"
+#include "ViewerServer.h"
+#include "AutomationServer.h"
+#include "DataLogger.h"
+#include "MaskTester.h"
+#include "ReferenceComparer.h"
+#include "HistoryThumbnailer.h"
+#include "CSVParser.h"
+#include "WaveformKind.h"
 
 #include "../scopehal/LeCroyOscilloscope.h"
 #include "../scopehal/SiglentSCPIOscilloscope.h"
 #include "../scopehal/RigolOscilloscope.h"
 #include "../scopehal/MockOscilloscope.h"
 #include "../scopeprotocols/EyePattern.h"
+#include "../scopeprotocols/SpectrogramFilter.h"
+#include "../scopeprotocols/Waterfall.h"
 
 #include <fstream>
 #include <cinttypes>
+#include <future>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 #ifdef _WIN32
 #include <windows.h>
@@ -67,11 +88,218 @@
 extern Event g_waveformReadyEvent;
 extern Event g_waveformProcessedEvent;
 extern Event g_rerenderDoneEvent;
+extern Event g_waveformPreviewEvent;
 extern Event g_refilterRequestedEvent;
 extern Event g_partialRefilterRequestedEvent;
 extern Event g_refilterDoneEvent;
+extern Event g_waveformThreadWakeEvent;
+
+
+/**
+	@brief A history point whose metadata has been read from a saved session, but which hasn't been added to history yet
+ */
+class PendingHistoryLoad
+{
+public:
+	PendingHistoryLoad(TimePoint time, bool pinned, const string& label, bool lazy)
+	: m_time(time)
+	, m_pinned(pinned)
+	, m_label(label)
+	, m_lazy(lazy)
+	{}
+
+	///@brief Timestamp of the waveforms
+	TimePoint m_time;
+
+	///@brief True if the point is pinned
+	bool m_pinned;
+
+	///@brief Label for the point
+	string m_label;
+
+	///@brief True if sample data is to be loaded when first needed, rather than now
+	bool m_lazy;
+
+	///@brief Each stream with data at this point
+	vector<StreamDescriptor> m_streams;
+
+	///@brief Waveform for each stream (until loaded, just the metadata)
+	vector<WaveformBase*> m_waveforms;
+
+	///@brief Index of the load job for each stream, if not lazy
+	vector<size_t> m_jobs;
+
+	///@brief Where to load sample data from later, if lazy
+	vector<LazyWaveformSource> m_sources;
+};
+
+/**
+	@brief File header for the "sparsev2" waveform format
+
+	The header is followed by three sections (offsets, durations, samples), each starting on a SPARSEV2_ALIGN byte
+	boundary, so that unencoded sections can be copied straight into waveform buffers.
+ */
+#pragma pack(push, 1)
+class SparseV2Header
+{
+public:
+	///@brief Always "SPARSEV2"
+	char m_magic[8];
+
+	///@brief Encoding flags (see SparseV2Flags)
+	uint32_t m_flags;
+
+	///@brief Size of a single sample in the sample section, in bytes
+	uint32_t m_sampleSize;
+
+	///@brief Number of samples in the waveform
+	uint64_t m_count;
+
+	///@brief File offset of the offsets section
+	uint64_t m_offsetsStart;
+
+	///@brief Size of the offsets section, in bytes
+	uint64_t m_offsetsLen;
+
+	///@brief File offset of the durations section
+	uint64_t m_durationsStart;
+
+	///@brief Size of the durations section, in bytes
+	uint64_t m_durationsLen;
+
+	///@brief File offset of the samples section
+	uint64_t m_samplesStart;
+
+	///@brief Size of the samples section, in bytes
+	uint64_t m_samplesLen;
+};
+#pragma pack(pop)
+
+///@brief Alignment of each section in a sparsev2 file
+static const size_t SPARSEV2_ALIGN = 64;
+
+/**
+	@brief File header for the "densev2" waveform format
+
+	The header is followed by m_count unsigned integer codes, each representing the value (code*m_gain + m_offset).
+ */
+#pragma pack(push, 1)
+class DenseV2Header
+{
+public:
+	///@brief Always "DENSEV2" followed by a null
+	char m_magic[8];
+
+	///@brief Encoding of the sample codes (see DenseV2Codec)
+	uint32_t m_codec;
+
+	///@brief Reserved for future use, always zero
+	uint32_t m_reserved;
+
+	///@brief Number of samples in the waveform
+	uint64_t m_count;
+
+	///@brief Size of one code, in volts (or other Y axis unit)
+	double m_gain;
+
+	///@brief Value of code zero
+	double m_offset;
+};
+#pragma pack(pop)
+
+enum DenseV2Codec
+{
+	///@brief Samples are stored as uint8 codes
+	DENSEV2_CODEC_INT8 = 1,
+
+	///@brief Samples are stored as uint16 codes
+	DENSEV2_CODEC_INT16 = 2
+};
+
+///@brief Number of samples decoded per parallel work item when loading a densev2 file
+static const size_t DENSEV2_BLOCK_SIZE = 65536;
+
+/**
+	@brief File header for the "densebits" waveform format
+
+	The header is followed by (m_count+7)/8 bytes of digital samples, eight per byte, LSB first.
+ */
+#pragma pack(push, 1)
+class DenseBitsHeader
+{
+public:
+	///@brief Always "DENSEBIT"
+	char m_magic[8];
+
+	///@brief Number of samples in the waveform
+	uint64_t m_count;
+};
+#pragma pack(pop)
+
+/**
+	@brief File header for the binary waveform index (scope_N_index.bin) saved beside each scope's metadata YAML
+
+	The header is followed by m_count history point records, each of:
+		int64 timestamp, int64 femtoseconds, int32 waveform ID, uint8 pinned, string label, uint32 stream count
+	and then for each stream:
+		int32 channel, int32 stream, int64 timescale, int64 trigger phase, string format, string datatype
+
+	Strings are a uint32 length followed by that many bytes, with no terminator. All values are little endian.
+ */
+#pragma pack(push, 1)
+class WaveformIndexHeader
+{
+public:
+	///@brief Always "WFMINDEX"
+	char m_magic[8];
+
+	///@brief Version of the index format, currently always 2
+	uint32_t m_version;
+
+	///@brief Reserved for future use, always zero
+	uint32_t m_reserved;
+
+	///@brief Size of the YAML metadata file this index was written with, to detect hand edits
+	uint64_t m_yamlSize;
+
+	///@brief 64-bit FNV-1a hash of the YAML metadata file, to catch edits which don't change its size
+	uint64_t m_yamlHash;
+
+	///@brief Number of history point records
+	uint64_t m_count;
+};
+#pragma pack(pop)
+
+///@brief Number of digital samples packed or unpacked per parallel work item (must be a multiple of 8)
+static const size_t PACKED_BITS_BLOCK_SIZE = 65536;
+
+///@brief Number of sparsev1 records de-interleaved per parallel work item (must be a multiple of 4)
+static const size_t SPARSEV1_BLOCK_SIZE = 65536;
+
+///@brief Most committed acquisitions to keep waiting for their rasterization to be published, for latency measurement
+static const size_t MAX_LATENCY_AWAITING_TONE_MAP = 32;
 
-extern std::shared_mutex g_vulkanActivityMutex;
+///@brief Number of min/max bins in each trace of a history thumbnail
+static const size_t HISTORY_THUMBNAIL_BINS = 64;
+
+enum SparseV2Flags
+{
+	///@brief Offsets are stored as int32 deltas from the previous sample (first sample relative to zero)
+	SPARSEV2_OFFSETS_DELTA32 = 1,
+
+	///@brief Durations are stored as (int64 value, int64 count) runs
+	SPARSEV2_DURATIONS_RLE = 2,
+
+	///@brief Digital samples are packed eight per byte, LSB first
+	SPARSEV2_SAMPLES_PACKED = 4,
+
+	/**
+		@brief Offsets and durations are the same as another waveform in the same directory
+
+		The offsets section holds the name of that waveform's file and the durations section is empty.
+	 */
+	SPARSEV2_TIMEBASE_SHARED = 8
+};
 
 using namespace std;
 
@@ -80,21 +308,55 @@ using namespace std;
 
 Session::Session(MainWindow* wnd)
 	: m_fileLoadVersion(0)
+	, m_scopeMutex("Session.m_scopeMutex", LOCK_RANK_SCOPES)
+	, m_instrumentEpoch(0)
+	, m_waveformDataMutex("Session.m_waveformDataMutex", LOCK_RANK_WAVEFORM_DATA)
+	, m_waveformWriterMutex("Session.m_waveformWriterMutex", LOCK_RANK_WAVEFORM_WRITER)
 	, m_mainWindow(wnd)
 	, m_shuttingDown(false)
 	, m_modifiedSinceLastSave(false)
+	, m_triggerGroupMutex("Session.m_triggerGroupMutex", LOCK_RANK_TRIGGER_GROUPS)
+	, m_nextSavedId(0)
+	, m_saveDone(false)
+	, m_saveOk(false)
+	, m_consumeGeneration(0)
+	, m_lastConsumeScan(0)
+	, m_measurementRecomputeRunning(false)
+	, m_measurementRecomputeCancel(false)
+	, m_measurementRecomputeDone(0)
+	, m_measurementRecomputeTotal(0)
 	, m_tArm(0)
 	, m_tPrimaryTrigger(0)
 	, m_triggerArmed(false)
 	, m_triggerOneShot(false)
 	, m_graphExecutor(4)
 	, m_lastFilterGraphExecTime(0)
+	, m_gpuProfilingEnabled(false)
+	, m_gpuReadback(*this)
+	, m_displayedAcquisitionCount(0)
+	, m_filterConfigRevision(0)
+	, m_filterOutputsRevision(0)
+	, m_filterOutputRecycleHits(0)
+	, m_filterOutputRecycleMisses(0)
+	, m_perfClockMutex("Session.m_perfClockMutex")
+	, m_lastWaveformDownloadTime(0)
+	, m_lastWaveformDownloadDepth(0)
+	, m_lastAcquisitionCommitTime(0)
 	, m_history(*this)
+	, m_replay(*this)
+	, m_packetMgrMutex("Session.m_packetMgrMutex")
+	, m_rasterizedWaveformMutex("Session.m_rasterizedWaveformMutex")
 	, m_multiScope(false)
 	, m_nextMarkerNum(1)
+	, m_markerRevision(0)
+	, m_dirtyChannelsUrgent(false)
+	, m_tfirstPolledDirty(0)
+	, m_refilterAll(false)
+	, m_loadBatchDepth(0)
+	, m_loadBatchRefreshDeferred(false)
+	, m_autotuner(m_preferences)
+	, m_referenceFiltersComplete(false)
 {
-	CreateReferenceFilters();
-
 	SCPIOscilloscope::EnumDrivers(m_driverNamesByType["oscilloscope"]);
 	SCPIPowerSupply::EnumDrivers(m_driverNamesByType["psu"]);
 	SCPIRFSignalGenerator::EnumDrivers(m_driverNamesByType["rfgen"]);
@@ -106,6 +368,8 @@ Session::Session(MainWindow* wnd)
 	SCPIBERT::EnumDrivers(m_driverNamesByType["bert"]);
 	SCPIMiscInstrument::EnumDrivers(m_driverNamesByType["misc"]);
 	SCPIVNA::EnumDrivers(m_driverNamesByType["vna"]);
+
+	RegisterMemoryReclaimers();
 }
 
 Session::~Session()
@@ -127,9 +391,37 @@ void Session::ClearBackgroundThreads()
 {
 	LogTrace("Clearing background threads\n");
 
+	//Let any save or recording in progress finish, and disconnect remote viewers, since they're holding onto
+	//history points. The viewer server is restarted by UpdateViewerServer() if it's still enabled.
+	StopRecording();
+	WaitForBackgroundSave();
+	m_viewerServer = nullptr;
+
+	//Automation clients may be about to ask about instruments we're tearing down, so drop them too
+	m_automationServer = nullptr;
+
+	//Consume-driven acquisition state references channels of instruments we're about to tear down
+	m_autoDisabledChannels.clear();
+	m_consumeExemptChannels.clear();
+	m_consumeScansPending.clear();
+	m_consumeGeneration ++;
+	{
+		lock_guard<mutex> lock(m_consumeResultsMutex);
+		m_consumeResults.clear();
+	}
+
 	//Stop the trigger so there's no pending waveforms
 	StopTrigger(true);
 
+	//Deskew trackers reference channels of instruments we're about to tear down
+	m_deskewTrackers.clear();
+
+	//The recompute thread holds onto history points
+	StopMeasurementRecompute();
+
+	//Don't tear down the device under pipelines still being compiled
+	m_taskPool.Wait(m_pipelineWarmup);
+
 	//Shut down instrument threads.
 	//This has to happen before we terminate the WaveformThread, to avoid waveforms getting stuck
 	//which have been acquired but not processed
@@ -139,14 +431,19 @@ void Session::ClearBackgroundThreads()
 			it.second->Close();
 	}
 
+	//Nothing is producing readings any more, so the data log can be closed out
+	StopDataLogging();
+
 	//Clear our trigger state
 	//Important to signal the WaveformProcessingThread so it doesn't block waiting on response that's not going to come
+	//(set the shutdown flag first, so a pipelined WaveformThread waiting for a free slot doesn't go back to sleep)
+	m_shuttingDown = true;
 	g_waveformReadyEvent.Clear();
+	g_waveformPreviewEvent.Clear();
 	g_rerenderDoneEvent.Clear();
 	g_waveformProcessedEvent.Signal();
 
-	//Signal our other worker threads to exit, then wait until they do so
-	m_shuttingDown = true;
+	//Wait until our other worker threads exit
 	if(m_waveformThread)
 		m_waveformThread->join();
 	m_waveformThread = nullptr;
@@ -160,7 +457,7 @@ void Session::FlushConfigCache()
 	LogTrace("Flushing cache\n");
 	LogIndenter li;
 
-	lock_guard<mutex> lock(m_scopeMutex);
+	lock_guard lock(m_scopeMutex);
 	for(auto it : m_instrumentStates)
 		it.first->FlushConfigCache();
 }
@@ -173,11 +470,42 @@ void Session::Clear()
 	LogTrace("Clearing session\n");
 	LogIndenter li;
 
+	m_replay.Stop();
+
 	//This includes its own mutex lock on waveform data
 	//and can't happen after we hold the lock
 	ClearBackgroundThreads();
 
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
+	m_metricHistory.Clear();
+
+	//In case a load was aborted partway through
+	ClearPreconnectedInstruments();
+
+	{
+		lock_guard<mutex> lock(m_filterDemandMutex);
+		m_displayedFilters.clear();
+		m_alwaysRunFilters.clear();
+		m_lastDemandedFilters.clear();
+	}
+	{
+		lock_guard<mutex> lock(m_refreshPolicyMutex);
+		m_refreshPolicies.clear();
+	}
+	m_latencyTracker.Clear();
+	m_inFlightLatency = nullptr;
+	m_inFlightPoint = nullptr;
+	m_latencyAwaitingToneMap.clear();
+	m_latencyAwaitingPresent.clear();
+	{
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		m_polledChannelSnapshots.clear();
+	}
+
+	lock_guard wlock(m_waveformWriterMutex);
+	lock_guard lock(m_waveformDataMutex);
+
+	//Templates hold references to filters, drop them before we start freeing things
+	m_filterTemplates.clear();
 
 	/**
 		HACK: for now, export filters keep an open reference to themselves to avoid memory leaks
@@ -209,11 +537,14 @@ void Session::Clear()
 
 	//TODO: do we need to lock the mutex now that all of the background threads should have terminated?
 	//Might be redundant.
-	lock_guard<mutex> lock2(m_scopeMutex);
+	lock_guard lock2(m_scopeMutex);
 
 	//Delete scopes once we've terminated the threads
 	//Detach waveforms before we destroy the scope, since history owns them
-	//(but make sure they're actually *in* history first!)
+	//(but make sure they're actually *in* history first, including anything the GUI hasn't consumed yet!)
+	set<shared_ptr<TriggerGroup>> pendingGroups;
+	vector<double> pendingTimes;
+	CommitPendingAcquisitions(pendingGroups, pendingTimes, false);
 	m_history.AddHistory(m_oscilloscopes);
 	for(auto scope : m_oscilloscopes)
 	{
@@ -230,21 +561,44 @@ void Session::Clear()
 	//Clear history before destroying scopes (but after detaching waveforms)
 	//This ordering is important since waveforms removed from history get pushed into the WaveformPool of the scopes,
 	//so the scopes must not have been destroyed yet.
+	m_policyPoint = nullptr;
+	m_thumbnailAcquisitions.clear();
+	m_thumbnailer = nullptr;
+	{
+		lock_guard<mutex> lock(m_maskTesterMutex);
+		m_maskTesters.clear();
+	}
+	{
+		lock_guard<mutex> lock(m_referenceComparerMutex);
+		m_referenceComparers.clear();
+	}
+	{
+		lock_guard<mutex> lock(m_measurementStatsMutex);
+		m_measurementStats.clear();
+	}
 	m_history.clear();
+	m_waveformPool.Clear();
+	m_savedPoints.clear();
+	m_savedDataDir = "";
+	m_nextSavedId = 0;
 
 	m_oscilloscopes.clear();
 	m_psus.clear();
 	m_loads.clear();
 	m_meters.clear();
 	m_berts.clear();
-	m_scopeDeskewCal.clear();
+	{
+		lock_guard<mutex> lock3(m_deskewMutex);
+		m_scopeDeskewCal.clear();
+	}
 	m_markers.clear();
+	m_markerRevision ++;
 	m_instrumentStates.clear();
+	m_pollingScheduler = nullptr;
+	m_instrumentSnapshot = nullptr;
 
 	//Remove all trigger groups
 	m_triggerGroups.clear();
-	m_recentlyTriggeredScopes.clear();
-	m_recentlyTriggeredGroups.clear();
 
 	//Remove any existing IDs
 	m_idtable.clear();
@@ -258,7 +612,8 @@ void Session::Clear()
 vector<TimePoint> Session::GetMarkerTimes()
 {
 	vector<TimePoint> ret;
-	for(auto it : m_markers)
+	ret.reserve(m_markers.size());
+	for(auto& it : m_markers)
 		ret.push_back(it.first);
 	sort(ret.begin(), ret.end(), less<TimePoint>() );
 	return ret;
@@ -279,7 +634,7 @@ void Session::AddMarker(Marker m)
 	}
 
 	//Add the marker
-	m_markers[m.m_timestamp].push_back(m);
+	m_markers[m.m_timestamp].Insert(m);
 	OnMarkerChanged();
 }
 
@@ -290,10 +645,12 @@ void Session::AddMarker(Marker m)
  */
 void Session::OnMarkerChanged()
 {
-	//Sort our markers by timestamp
-	auto times = GetMarkerTimes();
-	for(auto t : times)
-		sort(m_markers[t].begin(), m_markers[t].end());
+	m_markerRevision ++;
+
+	//Markers may have been dragged to a new offset, put them back in order
+	//(lists are kept sorted on insertion, so this is just a linear check for all the untouched ones)
+	for(auto& it : m_markers)
+		it.second.Sort();
 
 	//Update the protocol analyzer views that might be displaying it
 	lock_guard lock(m_packetMgrMutex);
@@ -346,6 +703,56 @@ bool Session::PreLoadFromYaml(const YAML::Node& node, const std::string& /*dataD
 
 	@return			True if successful, false on error
  */
+/**
+	@brief Starts a batch of changes (such as loading a session) which shouldn't each cause a refresh
+
+	Until the matching EndLoadBatch(), requests to refresh filters are recorded but the WaveformThread isn't woken
+	for them, so it doesn't re-run the graph (and re-render) over and over against a half built session. Batches can
+	be nested.
+ */
+void Session::BeginLoadBatch()
+{
+	lock_guard<mutex> lock(m_dirtyChannelsMutex);
+	m_loadBatchDepth ++;
+}
+
+/**
+	@brief Ends a batch started by BeginLoadBatch()
+
+	When the outermost batch ends, a single refresh of the whole graph is issued if anything asked for one.
+
+	@param refresh	False to drop the deferred refresh (for example because the load failed and is being undone)
+ */
+void Session::EndLoadBatch(bool refresh)
+{
+	{
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		if(m_loadBatchDepth == 0)
+		{
+			LogError("Session::EndLoadBatch called without BeginLoadBatch (bug)\n");
+			return;
+		}
+		m_loadBatchDepth --;
+		if(m_loadBatchDepth > 0)
+			return;
+
+		refresh &= m_loadBatchRefreshDeferred;
+		m_loadBatchRefreshDeferred = false;
+	}
+
+	if(refresh)
+		RefreshAllFiltersNonblocking();
+}
+
+/**
+	@brief Checks if a load batch is in progress
+ */
+bool Session::InLoadBatch()
+{
+	lock_guard<mutex> lock(m_dirtyChannelsMutex);
+	return m_loadBatchDepth > 0;
+}
+
 bool Session::LoadFromYaml(const YAML::Node& node, const string& dataDir, bool online)
 {
 	LogTrace("Loading saved session from YAML node\n");
@@ -390,6 +797,238 @@ bool Session::LoadFromYaml(const YAML::Node& node, const string& dataDir, bool o
 	return true;
 }
 
+/**
+	@brief Gets the size of a file, or -1 if it can't be opened
+ */
+static int64_t GetFileLength(const string& path)
+{
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
+		return -1;
+	fseek(fp, 0, SEEK_END);
+	int64_t len = ftell(fp);
+	fclose(fp);
+	return len;
+}
+
+/**
+	@brief Appends a fixed size value to a binary index being built
+ */
+template<class T>
+static void AppendIndexValue(vector<uint8_t>& buf, T value)
+{
+	size_t off = buf.size();
+	buf.resize(off + sizeof(T));
+	memcpy(&buf[off], &value, sizeof(T));
+}
+
+/**
+	@brief Appends a length-prefixed string to a binary index being built
+ */
+static void AppendIndexString(vector<uint8_t>& buf, const string& str)
+{
+	AppendIndexValue<uint32_t>(buf, str.length());
+	buf.insert(buf.end(), str.begin(), str.end());
+}
+
+/**
+	@brief Bounds checked reader for the contents of a binary waveform index
+
+	Once a read runs off the end of the buffer, all further reads return zero / empty and m_ok is cleared.
+ */
+class WaveformIndexReader
+{
+public:
+	WaveformIndexReader(const vector<uint8_t>& buf)
+	: m_buf(buf)
+	, m_offset(0)
+	, m_ok(true)
+	{}
+
+	template<class T>
+	T Read()
+	{
+		T value = 0;
+		if(!m_ok || (m_buf.size() - m_offset < sizeof(T)) )
+			m_ok = false;
+		else
+		{
+			memcpy(&value, &m_buf[m_offset], sizeof(T));
+			m_offset += sizeof(T);
+		}
+		return value;
+	}
+
+	string ReadString()
+	{
+		size_t len = Read<uint32_t>();
+		if(!m_ok || (m_buf.size() - m_offset < len) )
+		{
+			m_ok = false;
+			return "";
+		}
+		string ret(reinterpret_cast<const char*>(&m_buf[m_offset]), len);
+		m_offset += len;
+		return ret;
+	}
+
+	///@brief The index contents
+	const vector<uint8_t>& m_buf;
+
+	///@brief Position of the next read
+	size_t m_offset;
+
+	///@brief False if a read has run off the end of the buffer
+	bool m_ok;
+};
+
+/**
+	@brief Computes the 64-bit FNV-1a hash of a file's contents
+
+	@return False if the file couldn't be read
+ */
+static bool HashFile(const string& path, uint64_t& hash)
+{
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
+		return false;
+
+	hash = 0xcbf29ce484222325ULL;
+	vector<uint8_t> buf(1024 * 1024);
+	size_t len;
+	while( (len = fread(&buf[0], 1, buf.size(), fp)) > 0)
+	{
+		for(size_t i=0; i<len; i++)
+			hash = (hash ^ buf[i]) * 0x100000001b3ULL;
+	}
+	bool ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+}
+
+/**
+	@brief Writes the binary index of a scope's waveform metadata
+
+	@param path			Path to the index file
+	@param yamlPath		Path to the YAML metadata file, which must already be written
+	@param waveforms	Metadata for each history point
+ */
+static bool WriteWaveformIndex(const string& path, const string& yamlPath, const vector<SavedWaveformMetadata>& waveforms)
+{
+	int64_t yamlSize = GetFileLength(yamlPath);
+	uint64_t yamlHash;
+	if( (yamlSize < 0) || !HashFile(yamlPath, yamlHash) )
+		return false;
+
+	WaveformIndexHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.m_magic, "WFMINDEX", sizeof(hdr.m_magic));
+	hdr.m_version = 2;
+	hdr.m_yamlSize = yamlSize;
+	hdr.m_yamlHash = yamlHash;
+	hdr.m_count = waveforms.size();
+
+	vector<uint8_t> buf(sizeof(hdr));
+	memcpy(&buf[0], &hdr, sizeof(hdr));
+	for(auto& wfm : waveforms)
+	{
+		AppendIndexValue<int64_t>(buf, wfm.m_time.first);
+		AppendIndexValue<int64_t>(buf, wfm.m_time.second);
+		AppendIndexValue<int32_t>(buf, wfm.m_id);
+		AppendIndexValue<uint8_t>(buf, wfm.m_pinned);
+		AppendIndexString(buf, wfm.m_label);
+		AppendIndexValue<uint32_t>(buf, wfm.m_streams.size());
+		for(auto& ch : wfm.m_streams)
+		{
+			AppendIndexValue<int32_t>(buf, ch.m_channel);
+			AppendIndexValue<int32_t>(buf, ch.m_stream);
+			AppendIndexValue<int64_t>(buf, ch.m_timescale);
+			AppendIndexValue<int64_t>(buf, ch.m_triggerPhase);
+			AppendIndexString(buf, ch.m_format);
+			AppendIndexString(buf, ch.m_datatype);
+		}
+	}
+
+	FILE* fp = fopen(path.c_str(), "wb");
+	if(!fp)
+		return false;
+	bool ok = (fwrite(&buf[0], 1, buf.size(), fp) == buf.size());
+	fclose(fp);
+	return ok;
+}
+
+/**
+	@brief Reads a scope's waveform metadata from its binary index, if there is a usable one
+
+	The index is ignored if it's missing, damaged, from another version, or doesn't match the size and hash of the
+	YAML metadata file (e.g. because the YAML was edited by hand, or saved by a version which didn't write an index).
+	Hashing the YAML is still far cheaper than parsing it.
+
+	@return True if the metadata was read from the index, false if the YAML needs to be parsed instead
+ */
+static bool ReadWaveformIndex(const string& path, const string& yamlPath, vector<SavedWaveformMetadata>& waveforms)
+{
+	int64_t len = GetFileLength(path);
+	if(len < (int64_t)sizeof(WaveformIndexHeader))
+		return false;
+
+	vector<uint8_t> buf(len);
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
+		return false;
+	bool ok = (fread(&buf[0], 1, len, fp) == (size_t)len);
+	fclose(fp);
+	if(!ok)
+		return false;
+
+	WaveformIndexHeader hdr;
+	memcpy(&hdr, &buf[0], sizeof(hdr));
+	if( (memcmp(hdr.m_magic, "WFMINDEX", sizeof(hdr.m_magic)) != 0) || (hdr.m_version != 2) )
+		return false;
+	uint64_t yamlHash;
+	if( (GetFileLength(yamlPath) != (int64_t)hdr.m_yamlSize) || !HashFile(yamlPath, yamlHash) ||
+		(yamlHash != hdr.m_yamlHash) )
+	{
+		LogTrace("%s does not match %s, ignoring it\n", path.c_str(), yamlPath.c_str());
+		return false;
+	}
+
+	WaveformIndexReader reader(buf);
+	reader.m_offset = sizeof(hdr);
+	vector<SavedWaveformMetadata> ret;
+	for(uint64_t i=0; (i < hdr.m_count) && reader.m_ok; i++)
+	{
+		SavedWaveformMetadata wfm;
+		wfm.m_time.first = reader.Read<int64_t>();
+		wfm.m_time.second = reader.Read<int64_t>();
+		wfm.m_id = reader.Read<int32_t>();
+		wfm.m_pinned = reader.Read<uint8_t>();
+		wfm.m_label = reader.ReadString();
+		uint32_t nstreams = reader.Read<uint32_t>();
+		for(uint32_t j=0; (j < nstreams) && reader.m_ok; j++)
+		{
+			SavedStreamMetadata ch;
+			ch.m_channel = reader.Read<int32_t>();
+			ch.m_stream = reader.Read<int32_t>();
+			ch.m_timescale = reader.Read<int64_t>();
+			ch.m_triggerPhase = reader.Read<int64_t>();
+			ch.m_format = reader.ReadString();
+			ch.m_datatype = reader.ReadString();
+			wfm.m_streams.push_back(ch);
+		}
+		ret.push_back(wfm);
+	}
+
+	if(!reader.m_ok)
+	{
+		LogWarning("%s is truncated, falling back to %s\n", path.c_str(), yamlPath.c_str());
+		return false;
+	}
+
+	waveforms.swap(ret);
+	return true;
+}
+
 //TODO: this should run in a background thread or something to keep the UI responsive
 bool Session::LoadWaveformData(int version, const string& dataDir)
 {
@@ -412,20 +1051,29 @@ bool Session::LoadWaveformData(int version, const string& dataDir)
 	}
 
 	//Load data for each scope
+	m_savedDataDir = dataDir;
 	for(size_t i=0; i<m_oscilloscopes.size(); i++)
 	{
 		auto scope = m_oscilloscopes[i];
 		int id = m_idtable[(Instrument*)scope.get()];
 
-		char tmp[512] = {0};
-		snprintf(tmp, sizeof(tmp), "%s/scope_%d_metadata.yml", dataDir.c_str(), id);
-		auto docs = YAML::LoadAllFromFile(tmp);
+		string base = dataDir + "/scope_" + to_string(id);
+		string yamlPath = base + "_metadata.yml";
 
-		//Nothing there? No waveforms at all, skip loading
-		if(docs.empty())
-			return true;
+		//Use the binary index if we have one, since parsing the YAML for a long history can take seconds
+		vector<SavedWaveformMetadata> waveforms;
+		if(!ReadWaveformIndex(base + "_index.bin", yamlPath, waveforms))
+		{
+			auto docs = YAML::LoadAllFromFile(yamlPath);
 
-		if(!LoadWaveformDataForScope(version, docs[0], scope, dataDir))
+			//Nothing there? No waveforms at all, skip loading
+			if(docs.empty())
+				return true;
+
+			ParseWaveformMetadata(version, docs[0], waveforms);
+		}
+
+		if(!LoadWaveformDataForScope(waveforms, scope, dataDir))
 		{
 			LogTrace("Waveform data loading failed\n");
 			return false;
@@ -446,7 +1094,8 @@ bool Session::LoadWaveformDataForFilters(
 		const string& dataDir)
 {
 	//Block filter graph from running while loading
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
+	lock_guard wlock(m_waveformWriterMutex);
+	lock_guard lock(m_waveformDataMutex);
 
 	if(!node)
 		return true;
@@ -456,6 +1105,10 @@ bool Session::LoadWaveformDataForFilters(
 
 	string filtdir = dataDir + "/filter_waveforms";
 
+	//Streams are independent, so gather them all up and load them in parallel
+	vector<WaveformLoadJob> jobs;
+	vector<StreamDescriptor> streams;
+
 	for(auto it : waveforms)
 	{
 		auto ftag = it.second;
@@ -476,7 +1129,7 @@ bool Session::LoadWaveformDataForFilters(
 				continue;
 
 			auto fmt = stag["format"].as<string>();
-			bool dense = (fmt == "densev1");
+			bool dense = (fmt == "densev1") || (fmt == "densev2") || (fmt == "densebits");
 
 			//TODO: we need to encode a digital path in the YAML once MemoryFilter has digital channel support
 			//TODO: support non-analog/digital captures (eyes, spectrograms, etc)
@@ -510,929 +1163,1380 @@ bool Session::LoadWaveformDataForFilters(
 			cap->m_startFemtoseconds = time_fsec;
 			cap->m_triggerPhase = stag["trigphase"].as<long long>();
 			cap->m_flags = stag["flags"].as<int>();
-			f->SetData(cap, i);
 
-			//Actually load the waveform
-			string fname = datdir + "/stream" + to_string(i) + ".bin";
-			DoLoadWaveformDataForStream(f, i, fmt, fname);
+			jobs.push_back(WaveformLoadJob(cap, fmt, datdir + "/stream" + to_string(i) + ".bin"));
+			streams.push_back(StreamDescriptor(f, i));
 		}
 	}
 
+	//Actually load the waveforms
+	ReadWaveformFiles(jobs);
+	for(size_t i=0; i<jobs.size(); i++)
+		streams[i].m_channel->SetData(jobs[i].m_wfm, streams[i].m_stream);
+
 	return true;
 }
 
 /**
-	@brief Loads waveform data for a single scope
- */
-bool Session::LoadWaveformDataForScope(
-	int version,
-	const YAML::Node& node,
-	shared_ptr<Oscilloscope> scope,
-	const std::string& dataDir)
-{
-	LogTrace("Loading waveform data for scope \"%s\"\n", scope->m_nickname.c_str());
-	LogIndenter li;
+	@brief Reads the per-waveform metadata for a scope from its YAML metadata file
 
-	TimePoint time(0, 0);
-	TimePoint newest(0, 0);
+	Older versions of the file format are converted to the current units (femtoseconds) here.
 
+	@param version		File format version
+	@param node			Root node of scope_N_metadata.yml
+	@param waveforms	Filled out with one entry per saved history point, in file order
+ */
+void Session::ParseWaveformMetadata(int version, const YAML::Node& node, vector<SavedWaveformMetadata>& waveforms)
+{
 	auto wavenode = node["waveforms"];
 	if(!wavenode)
+		return;
+
+	for(auto it : wavenode)
 	{
-		//No waveforms
-		return true;
-	}
-	int scope_id = m_idtable[(Instrument*)scope.get()];
+		auto wfm = it.second;
+		SavedWaveformMetadata meta;
 
-	//Clear out any old waveforms the instrument may have
-	for(size_t i=0; i<scope->GetChannelCount(); i++)
-	{
-		//Only delete waveforms from oscilloscope channels
-		//(this avoids crashing if the scope is a multi-function device with function generator etc)
-		auto chan = scope->GetOscilloscopeChannel(i);
-		if(!chan)
-			continue;
-
-		for(size_t j=0; j<chan->GetStreamCount(); j++)
-			chan->SetData(nullptr, j);
-	}
-
-	//Load the data for each waveform
-	for(auto it : wavenode)
-	{
 		//Top level metadata
 		bool timebase_is_ps = true;
-		auto wfm = it.second;
-		time.first = wfm["timestamp"].as<long long>();
+		meta.m_time.first = wfm["timestamp"].as<long long>();
 		if(wfm["time_psec"])
 		{
-			time.second = wfm["time_psec"].as<long long>() * 1000;
+			meta.m_time.second = wfm["time_psec"].as<long long>() * 1000;
 			timebase_is_ps = true;
 		}
 		else
 		{
-			time.second = wfm["time_fsec"].as<long long>();
+			meta.m_time.second = wfm["time_fsec"].as<long long>();
 			timebase_is_ps = false;
 		}
-		int waveform_id = wfm["id"].as<int>();
-		bool pinned = false;
+		meta.m_id = wfm["id"].as<int>();
 		if(wfm["pinned"])
 		{
 			if(version <= 1)
-				pinned = wfm["pinned"].as<int>();
+				meta.m_pinned = wfm["pinned"].as<int>();
 			else
-				pinned = wfm["pinned"].as<bool>();
+				meta.m_pinned = wfm["pinned"].as<bool>();
 		}
-		string label;
 		if(wfm["label"])
-			label = wfm["label"].as<string>();
+			meta.m_label = wfm["label"].as<string>();
+
+		for(auto jt : wfm["channels"])
+		{
+			auto ch = jt.second;
+			SavedStreamMetadata smeta;
+			smeta.m_channel = ch["index"].as<int>();
+			if(ch["stream"])
+				smeta.m_stream = ch["stream"].as<int>();
+
+			//Waveform format defaults to sparsev1 as that's what was used before
+			//the metadata file contained a format ID at all
+			if(ch["format"])
+				smeta.m_format = ch["format"].as<string>();
+			if(ch["datatype"])
+				smeta.m_datatype = ch["datatype"].as<string>();
+
+			smeta.m_timescale = ch["timescale"].as<long>();
+			if(timebase_is_ps)
+			{
+				smeta.m_timescale *= 1000;
+				smeta.m_triggerPhase = ch["trigphase"].as<float>() * 1000;
+			}
+			else
+				smeta.m_triggerPhase = ch["trigphase"].as<long long>();
+
+			meta.m_streams.push_back(smeta);
+		}
+
+		waveforms.push_back(meta);
+	}
+}
+
+/**
+	@brief Loads waveform data for a single scope
+ */
+bool Session::LoadWaveformDataForScope(
+	const vector<SavedWaveformMetadata>& waveforms,
+	shared_ptr<Oscilloscope> scope,
+	const std::string& dataDir)
+{
+	LogTrace("Loading waveform data for scope \"%s\"\n", scope->m_nickname.c_str());
+	LogIndenter li;
+
+	if(waveforms.empty())
+		return true;
+	int scope_id = m_idtable[(Instrument*)scope.get()];
+
+	//Load sample data straight into file-backed memory so large sessions don't have to fit in RAM.
+	//Whichever point gets displayed is moved back to normal memory by HistoryPoint::LoadHistoryToSession().
+	bool fileBacked = m_preferences.GetBool("Files.load_file_backed");
+
+	//In lazy mode, only the most recent waveform is loaded now. Everything else is loaded when first needed.
+	bool lazy = m_preferences.GetBool("Files.lazy_load");
+	size_t nwaveforms = waveforms.size();
+
+	//Eye patterns integrate over every acquisition, so they still have to be run against each point in turn
+	bool batched = InLoadBatch();
+	bool integrating = false;
+	if(batched)
+	{
+		lock_guard<mutex> lock(m_filterUpdatingMutex);
+		for(auto f : Filter::GetAllInstances())
+		{
+			if(dynamic_cast<EyePattern*>(f) != nullptr)
+				integrating = true;
+		}
+	}
+	size_t nwfm = 0;
+
+	//Clear out any old waveforms the instrument may have
+	for(size_t i=0; i<scope->GetChannelCount(); i++)
+	{
+		//Only delete waveforms from oscilloscope channels
+		//(this avoids crashing if the scope is a multi-function device with function generator etc)
+		auto chan = scope->GetOscilloscopeChannel(i);
+		if(!chan)
+			continue;
+
+		for(size_t j=0; j<chan->GetStreamCount(); j++)
+			chan->SetData(nullptr, j);
+	}
+
+	//Set up all of the waveforms first, so sample data for every history point can be loaded in one parallel batch
+	vector<PendingHistoryLoad> points;
+	vector<WaveformLoadJob> jobs;
+	set<TimePoint> timestamps;
+	for(auto& wfm : waveforms)
+	{
+		bool lazyPoint = lazy && (nwfm + 1 < nwaveforms);
+		nwfm ++;
 
+		auto time = wfm.m_time;
 		LogTrace("Loading waveform data at time %s\n", time.PrettyPrint().c_str());
 
 		//If we already have historical data from this timestamp, warn and drop the duplicate data
 		auto hist = m_history.GetHistory(time);
-		if(hist && (hist->m_history.find(scope) != hist->m_history.end()))
+		if( (hist && (hist->m_history.find(scope) != hist->m_history.end())) || timestamps.count(time) )
 		{
 			LogWarning("Session contains duplicate data for time %" PRId64 ".%" PRId64 ", discarding\n", static_cast<int64_t>(time.first), time.second);
 			continue;
 		}
 
-		//Set up channel metadata first (serialized)
-		auto chans = wfm["channels"];
-		vector<pair<int, int>> channels;	//pair<channel, stream>
-		vector<string> formats;
-		for(auto jt : chans)
-		{
-			auto ch = jt.second;
-			int channel_index = ch["index"].as<int>();
-			int stream = 0;
-			if(ch["stream"])
-				stream = ch["stream"].as<int>();
-			auto chan = scope->GetOscilloscopeChannel(channel_index);
-			channels.push_back(pair<int, int>(channel_index, stream));
+		timestamps.insert(time);
+		points.push_back(PendingHistoryLoad(time, wfm.m_pinned, wfm.m_label, lazyPoint));
+		auto& point = points.back();
 
-			//Waveform format defaults to sparsev1 as that's what was used before
-			//the metadata file contained a format ID at all
-			string format = "sparsev1";
-			if(ch["format"])
-				format = ch["format"].as<string>();
-			formats.push_back(format);
+		//Remember the point is already in the data directory, so saving back to it doesn't have to write it again
+		auto& saved = m_savedPoints[time];
+		saved.m_metadata[scope] = wfm;
+		saved.m_dirs.push_back(dataDir + "/scope_" + to_string(scope_id) + "_waveforms/waveform_" + to_string(wfm.m_id));
+		m_nextSavedId = max(m_nextSavedId, wfm.m_id + 1);
 
-			bool dense = (format == "densev1");
+		char tmp[512];
+		for(auto& ch : wfm.m_streams)
+		{
+			auto chan = scope->GetOscilloscopeChannel(ch.m_channel);
+			auto& format = ch.m_format;
+			bool dense = (format == "densev1") || (format == "densev2") || (format == "densebits");
 
 			//TODO: support non-analog/digital captures (eyes, spectrograms, etc)
 			WaveformBase* cap = nullptr;
-			SparseAnalogWaveform* sacap = nullptr;
-			UniformAnalogWaveform* uacap = nullptr;
-			SparseDigitalWaveform* sdcap = nullptr;
-			UniformDigitalWaveform* udcap = nullptr;
-			CANWaveform* sccap = nullptr;
 
 			//if datatype is specified, use that
-			if( (format == "sparsev1") && ch["datatype"] )
+			if( ( (format == "sparsev1") || (format == "sparsev2") ) && !ch.m_datatype.empty() )
 			{
-				auto dtype = ch["datatype"].as<string>();
+				auto& dtype = ch.m_datatype;
 				if(dtype == "analog")
-					cap = sacap = new SparseAnalogWaveform;
+					cap = new SparseAnalogWaveform;
 				else if(dtype == "digital")
-					cap = sdcap = new SparseDigitalWaveform;
+					cap = new SparseDigitalWaveform;
 				else if(dtype == "can")
-					cap = sccap = new CANWaveform;
+					cap = new CANWaveform;
 				else
-					LogError("Unrecognized sparsev1 datatype %s\n", dtype.c_str());
+					LogError("Unrecognized %s datatype %s\n", format.c_str(), dtype.c_str());
 			}
 
 			//if not guess based on stream type
 			else if(chan->GetType(0) == Stream::STREAM_TYPE_ANALOG)
 			{
 				if(dense)
-					cap = uacap = new UniformAnalogWaveform;
+					cap = new UniformAnalogWaveform;
 				else
-					cap = sacap = new SparseAnalogWaveform;
+					cap = new SparseAnalogWaveform;
 			}
 			else
 			{
 				if(dense)
-					cap = udcap = new UniformDigitalWaveform;
+					cap = new UniformDigitalWaveform;
 				else
-					cap = sdcap = new SparseDigitalWaveform;
+					cap = new SparseDigitalWaveform;
 			}
 
 			//Channel waveform metadata
-			cap->m_timescale = ch["timescale"].as<long>();
+			cap->m_timescale = ch.m_timescale;
 			cap->m_startTimestamp = time.first;
 			cap->m_startFemtoseconds = time.second;
-			if(timebase_is_ps)
-			{
-				cap->m_timescale *= 1000;
-				cap->m_triggerPhase = ch["trigphase"].as<float>() * 1000;
-			}
-			else
-				cap->m_triggerPhase = ch["trigphase"].as<long long>();
+			cap->m_triggerPhase = ch.m_triggerPhase;
 
-			chan->Detach(stream);
-			chan->SetData(cap, stream);
-		}
+			if(fileBacked && !lazyPoint)
+				HistoryPoint::SetWaveformTier(cap, HistoryPoint::TIER_DISK);
 
-		//Actually load the data for each channel
-		size_t nchans = channels.size();
-		char tmp[512];
-		for(size_t i=0; i<nchans; i++)
-		{
-			auto nchan = channels[i].first;
-			auto nstream = channels[i].second;
+			StreamDescriptor stream(chan, ch.m_stream);
+			point.m_streams.push_back(stream);
+			point.m_waveforms.push_back(cap);
 
-			if(nstream == 0)
+			//Queue the data to be loaded (or just remember where it is, if lazy loading)
+			if(ch.m_stream == 0)
 			{
 				snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms/waveform_%d/channel_%d.bin",
 					dataDir.c_str(),
 					scope_id,
-					waveform_id,
-					nchan);
+					wfm.m_id,
+					ch.m_channel);
 			}
 			else
 			{
 				snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms/waveform_%d/channel_%d_stream%d.bin",
 					dataDir.c_str(),
 					scope_id,
-					waveform_id,
-					nchan,
-					nstream);
+					wfm.m_id,
+					ch.m_channel,
+					ch.m_stream);
+			}
+
+			if(lazyPoint)
+				point.m_sources.push_back(LazyWaveformSource(scope, stream, format, tmp));
+			else
+			{
+				point.m_jobs.push_back(jobs.size());
+				jobs.push_back(WaveformLoadJob(cap, format, tmp));
 			}
+		}
+	}
+
+	//Load sample data for every stream we're not loading lazily
+	ReadWaveformFiles(jobs);
+
+	//Then add the history points in order, so filters see the same sequence of inputs as if they'd been loaded serially
+	for(auto& point : points)
+	{
+		for(size_t i=0; i<point.m_jobs.size(); i++)
+			point.m_waveforms[i] = jobs[point.m_jobs[i]].m_wfm;
 
-			DoLoadWaveformDataForStream(
-				scope->GetOscilloscopeChannel(nchan),
-				nstream,
-				formats[i],
-				tmp);
+		for(size_t i=0; i<point.m_streams.size(); i++)
+		{
+			auto& stream = point.m_streams[i];
+			stream.m_channel->Detach(stream.m_stream);
+			stream.m_channel->SetData(point.m_waveforms[i], stream.m_stream);
 		}
 
 		vector<shared_ptr<Oscilloscope>> temp;
 		temp.push_back(scope);
-		m_history.AddHistory(temp, false, pinned, label);
+		m_history.AddHistory(temp, false, point.m_pinned, point.m_label);
+		auto pt = m_history.GetHistory(point.m_time);
+		if(pt && point.m_lazy)
+			m_history.AddLazySources(pt, scope, point.m_sources);
+		else if(pt && fileBacked)
+			pt->m_tier = HistoryPoint::TIER_DISK;
 
 		//TODO: this is not good for multiscope
 		//TODO: handle eye patterns (need to know window size for it to work right)
-		RefreshAllFilters();
+		//In a load batch, only integrating filters need to see every point. Everything else just needs the last one,
+		//which the refresh at the end of the batch takes care of.
+		if(!point.m_lazy)
+		{
+			if(integrating || !batched)
+				RefreshAllFilters();
+			else
+				RefreshAllFiltersNonblocking();
+		}
 	}
+
+	//The most recent point is what's going to be displayed, so it should be in normal memory
+	if(fileBacked)
+	{
+		auto pt = m_history.GetHistory(m_history.GetMostRecentPoint());
+		if(pt)
+			pt->SetTier(HistoryPoint::TIER_GPU);
+	}
+
 	return true;
 }
 
-void Session::DoLoadWaveformDataForStream(
-	OscilloscopeChannel* chan,
-	int stream,
-	string format,
-	string fname
-	)
-{
-	auto cap = chan->GetData(stream);
-	auto sacap = dynamic_cast<SparseAnalogWaveform*>(cap);
-	auto uacap = dynamic_cast<UniformAnalogWaveform*>(cap);
-	auto sdcap = dynamic_cast<SparseDigitalWaveform*>(cap);
-	auto udcap = dynamic_cast<UniformDigitalWaveform*>(cap);
-	auto ccap = dynamic_cast<CANWaveform*>(cap);
+/**
+	@brief Checks that a section of a sparsev2 file lies within the file
+ */
+static bool CheckSparseV2Section(uint64_t start, uint64_t len, size_t filelen)
+{
+	return (start <= filelen) && (len <= filelen - start);
+}
 
-	cap->PrepareForCpuAccess();
+/**
+	@brief Unpacks digital samples stored eight per byte, LSB first
 
-	//Load samples into memory
-	unsigned char* buf = NULL;
+	@param pool		Pool to unpack on
+	@param bits		Packed samples
+	@param samples	Output buffer, must have room for n samples
+	@param n		Number of samples
+ */
+static void UnpackDigitalSamples(TaskPool& pool, const unsigned char* bits, bool* samples, size_t n)
+{
+	int64_t nblocks = (n + PACKED_BITS_BLOCK_SIZE - 1) / PACKED_BITS_BLOCK_SIZE;
+	pool.ParallelFor(0, nblocks, 1, [&](int64_t block)
+	{
+		size_t start = block * PACKED_BITS_BLOCK_SIZE;
+		size_t end = min(n, start + PACKED_BITS_BLOCK_SIZE);
+		for(size_t i=start; i<end; i++)
+			samples[i] = (bits[i / 8] >> (i % 8)) & 1;
+	});
+}
 
-	//Windows: use generic file reads for now
-	#ifdef _WIN32
-		FILE* fp = fopen(fname.c_str(), "rb");
-		if(!fp)
-		{
-			LogError("couldn't open %s\n", fname.c_str());
-			return;
-		}
+/**
+	@brief Loads sample data in the "densebits" format (see Session::SerializePackedDigitalWaveform) into a waveform
+ */
+static void LoadDenseBitsWaveform(TaskPool& pool, UniformDigitalWaveform* wfm, const unsigned char* buf, size_t len)
+{
+	if(!wfm)
+	{
+		LogError("densebits data can only be loaded into a uniform digital waveform\n");
+		return;
+	}
 
-		//Read the whole file into a buffer a megabyte at a time
-		fseek(fp, 0, SEEK_END);
-		long len = ftell(fp);
-		fseek(fp, 0, SEEK_SET);
-		buf = new unsigned char[len];
-		long len_remaining = len;
-		long blocksize = 1024*1024;
-		long read_offset = 0;
-		while(len_remaining > 0)
-		{
-			if(blocksize > len_remaining)
-				blocksize = len_remaining;
+	if(len < sizeof(DenseBitsHeader))
+	{
+		LogError("densebits file is too short to contain a header\n");
+		return;
+	}
+	DenseBitsHeader hdr;
+	memcpy(&hdr, buf, sizeof(hdr));
+	if(memcmp(hdr.m_magic, "DENSEBIT", sizeof(hdr.m_magic)) != 0)
+	{
+		LogError("Bad densebits header\n");
+		return;
+	}
 
-			//Most time is spent on the fread's when using this path
-			fread(buf + read_offset, 1, blocksize, fp);
+	size_t n = hdr.m_count;
+	if( (len - sizeof(hdr)) < (n + 7) / 8)
+	{
+		LogError("densebits file is truncated\n");
+		return;
+	}
 
-			len_remaining -= blocksize;
-			read_offset += blocksize;
-		}
-		fclose(fp);
+	wfm->Resize(n);
+	HostMemoryPolicy::ApplyToWaveform(wfm);
+	UnpackDigitalSamples(pool, buf + sizeof(hdr), wfm->m_samples.GetCpuPointer(), n);
+}
 
-	//On POSIX, just memory map the file
-	#else
-		int fd = open(fname.c_str(), O_RDONLY);
-		if(fd < 0)
-		{
-			LogError("couldn't open %s\n", fname.c_str());
-			return;
-		}
-		size_t len = lseek(fd, 0, SEEK_END);
-		buf = (unsigned char*)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
-	#endif
+/**
+	@brief Loads sample data in the "densev2" format (see Session::SerializeQuantizedWaveform) into a waveform
 
-	//Sparse interleaved
-	if(format == "sparsev1")
+	Blocks of codes are converted to floating point in parallel.
+ */
+static void LoadDenseV2Waveform(TaskPool& pool, UniformAnalogWaveform* wfm, const unsigned char* buf, size_t len)
+{
+	if(!wfm)
 	{
-		//Figure out how many samples we have
-		size_t samplesize = 2*sizeof(int64_t);
-		if(sacap)
-			samplesize += sizeof(float);
-		else if(sdcap)
-			samplesize += sizeof(bool);
-		else if(ccap)
-			samplesize += 2*sizeof(int32_t);
-		size_t nsamples = len / samplesize;
-		cap->Resize(nsamples);
-
-		//TODO: AVX this?
-		for(size_t j=0; j<nsamples; j++)
-		{
-			size_t offset = j*samplesize;
+		LogError("densev2 data can only be loaded into a uniform analog waveform\n");
+		return;
+	}
 
-			//Read start time and duration
-			int64_t* stime = reinterpret_cast<int64_t*>(buf+offset);
-			offset += 2*sizeof(int64_t);
+	if(len < sizeof(DenseV2Header))
+	{
+		LogError("densev2 file is too short to contain a header\n");
+		return;
+	}
+	DenseV2Header hdr;
+	memcpy(&hdr, buf, sizeof(hdr));
+	if(memcmp(hdr.m_magic, "DENSEV2", 8) != 0)
+	{
+		LogError("Bad densev2 header\n");
+		return;
+	}
 
-			//Read sample data
-			if(sacap)
-			{
-				//The file format assumes "float" is IEEE754 32-bit float.
-				//If your platform doesn't do that, good luck.
-				//cppcheck-suppress invalidPointerCast
-				sacap->m_samples[j] = *reinterpret_cast<float*>(buf+offset);
+	size_t codesize;
+	if(hdr.m_codec == DENSEV2_CODEC_INT8)
+		codesize = sizeof(uint8_t);
+	else if(hdr.m_codec == DENSEV2_CODEC_INT16)
+		codesize = sizeof(uint16_t);
+	else
+	{
+		LogError("Unknown densev2 codec %u\n", hdr.m_codec);
+		return;
+	}
 
-				sacap->m_offsets[j] = stime[0];
-				sacap->m_durations[j] = stime[1];
-			}
+	size_t n = hdr.m_count;
+	if( (len - sizeof(hdr)) / codesize < n)
+	{
+		LogError("densev2 file is truncated\n");
+		return;
+	}
 
-			else if(sdcap)
-			{
-				sdcap->m_samples[j] = *reinterpret_cast<bool*>(buf+offset);
-				sdcap->m_offsets[j] = stime[0];
-				sdcap->m_durations[j] = stime[1];
-			}
+	wfm->Resize(n);
+	HostMemoryPolicy::ApplyToWaveform(wfm);
+	float* samples = wfm->m_samples.GetCpuPointer();
+	const unsigned char* codes = buf + sizeof(hdr);
+	//Keep the full precision of the scale until the final result, so large offsets don't swamp small steps
+	double gain = hdr.m_gain;
+	double offset = hdr.m_offset;
 
-			//CAN capture
-			else if(ccap)
-			{
-				uint32_t* p = reinterpret_cast<uint32_t*>(buf+offset);
+	int64_t nblocks = (n + DENSEV2_BLOCK_SIZE - 1) / DENSEV2_BLOCK_SIZE;
+	pool.ParallelFor(0, nblocks, 1, [&](int64_t block)
+	{
+		size_t start = block * DENSEV2_BLOCK_SIZE;
+		size_t end = min(n, start + DENSEV2_BLOCK_SIZE);
 
-				ccap->m_samples[j] = CANSymbol((CANSymbol::stype)p[1], p[0]);
-				ccap->m_offsets[j] = stime[0];
-				ccap->m_durations[j] = stime[1];
-			}
+		if(hdr.m_codec == DENSEV2_CODEC_INT8)
+		{
+			for(size_t i=start; i<end; i++)
+				samples[i] = codes[i]*gain + offset;
 		}
-
-		//Quickly check if the waveform is dense packed, even if it was stored as sparse.
-		//Since we know samples must be monotonic and non-overlapping, we don't have to check every single one!
-		int64_t nlast = nsamples - 1;
-		if(sacap)
+		else
 		{
-			if( (sacap->m_offsets[0] == 0) &&
-				(sacap->m_offsets[nlast] == nlast) &&
-				(sacap->m_durations[nlast] == 1) )
+			for(size_t i=start; i<end; i++)
 			{
-				//Waveform was actually uniform, so convert it
-				cap = new UniformAnalogWaveform(*sacap);
-				chan->SetData(cap, stream);
+				uint16_t code;
+				memcpy(&code, codes + i*sizeof(uint16_t), sizeof(code));
+				samples[i] = code*gain + offset;
 			}
 		}
-	}
+	});
+}
 
-	//Dense packed
-	else if(format == "densev1")
-	{
-		//Figure out length
-		size_t nsamples = 0;
-		if(uacap)
-			nsamples = len / sizeof(float);
-		else if(udcap)
-			nsamples = len / sizeof(bool);
-		cap->Resize(nsamples);
+/**
+	@brief Splits the timestamps out of a block of sparsev1 records
 
-		//Read sample data
-		if(uacap)
-			memcpy(uacap->m_samples.GetCpuPointer(), buf, nsamples*sizeof(float));
-		else
-			memcpy(udcap->m_samples.GetCpuPointer(), buf, nsamples*sizeof(bool));
-	}
+	Each record starts with a 64-bit offset and duration, followed by the sample value.
 
-	else
+	@param buf			First record of the block
+	@param recordSize	Size of each record, in bytes
+	@param offsets		Output offsets
+	@param durations	Output durations
+	@param n			Number of records
+ */
+static void DeinterleaveSparseV1Times(
+	const unsigned char* buf,
+	size_t recordSize,
+	int64_t* offsets,
+	int64_t* durations,
+	size_t n)
+{
+	for(size_t i=0; i<n; i++)
 	{
-		LogError(
-			"Unknown waveform format \"%s\", perhaps this file was created by a newer version of ngscopeclient?\n",
-			format.c_str());
+		const unsigned char* p = buf + i*recordSize;
+		memcpy(&offsets[i], p, sizeof(int64_t));
+		memcpy(&durations[i], p + sizeof(int64_t), sizeof(int64_t));
 	}
-
-	cap->MarkModifiedFromCpu();
-
-	#ifdef _WIN32
-		delete[] buf;
-	#else
-		munmap(buf, len);
-		::close(fd);
-	#endif
 }
 
+#ifdef __x86_64__
 /**
-	@brief Performs an exhaustive search of the driver list to see which type this instrument is
-
-	TODO: we should really just unify the dynamic creation tables...
+	@brief AVX2 version of DeinterleaveSparseV1Times(), gathering four records at a time
  */
-string Session::GetRegisteredTypeOfDriver(const string& drivername)
+__attribute__((target("avx2")))
+static void DeinterleaveSparseV1TimesAVX2(
+	const unsigned char* buf,
+	size_t recordSize,
+	int64_t* offsets,
+	int64_t* durations,
+	size_t n)
 {
-	for(auto& it : m_driverNamesByType)
+	int64_t stride = recordSize;
+	__m256i index = _mm256_set_epi64x(3*stride, 2*stride, stride, 0);
+
+	size_t end = n - (n % 4);
+	for(size_t i=0; i<end; i += 4)
 	{
-		for(auto name : it.second)
-		{
-			if(name == drivername)
-				return it.first;
-		}
+		auto p = reinterpret_cast<const long long*>(buf + i*recordSize);
+		__m256i off = _mm256_i64gather_epi64(p, index, 1);
+		__m256i dur = _mm256_i64gather_epi64(p + 1, index, 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(offsets + i), off);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(durations + i), dur);
 	}
 
-	LogError("Couldn't find any driver called \"%s\"\n", drivername.c_str());
-	return "unknown";
+	DeinterleaveSparseV1Times(buf + end*recordSize, recordSize, offsets + end, durations + end, n - end);
 }
 
-bool Session::PreLoadInstruments(int version, const YAML::Node& node, bool online)
+/**
+	@brief Splits the 32-bit float sample values out of a block of sparsev1 analog records, four at a time
+ */
+__attribute__((target("avx2")))
+static void DeinterleaveSparseV1AnalogAVX2(const unsigned char* buf, float* samples, size_t n)
 {
-	LogTrace("Preloading saved instruments\n");
-	LogIndenter li;
+	const int64_t stride = 2*sizeof(int64_t) + sizeof(float);
+	__m256i index = _mm256_set_epi64x(3*stride, 2*stride, stride, 0);
 
-	m_warnings.clear();
-
-	if(!node)
+	size_t end = n - (n % 4);
+	for(size_t i=0; i<end; i += 4)
 	{
-		m_mainWindow->ShowErrorPopup(
-			"File load error",
-			"The session file is invalid because there is no \"instruments\" section.");
-		return false;
+		auto p = reinterpret_cast<const float*>(buf + i*stride + 2*sizeof(int64_t));
+		_mm_storeu_ps(samples + i, _mm256_i64gather_ps(p, index, 1));
 	}
 
-	//Load each instrument
-	for(auto it : node)
+	for(size_t i=end; i<n; i++)
+		memcpy(&samples[i], buf + i*stride + 2*sizeof(int64_t), sizeof(float));
+}
+#endif
+
+/**
+	@brief Splits the sample values out of a block of sparsev1 analog records
+ */
+static void DecodeSparseV1Samples(const unsigned char* p, size_t recordSize, float* samples, size_t n)
+{
+	//The file format assumes "float" is IEEE754 32-bit float.
+	//If your platform doesn't do that, good luck.
+	#ifdef __x86_64__
+	if(g_hasAvx2)
 	{
-		auto inst = it.second;
-		auto nick = inst["nick"].as<string>();
-		LogTrace("Loading instrument \"%s\"\n", nick.c_str());
+		DeinterleaveSparseV1AnalogAVX2(p, samples, n);
+		return;
+	}
+	#endif
 
-		//The "type" field in the scopesession format is actually redundant, we should be able to tell what the driver
-		//is based on which table it's found in!
-		string type = GetRegisteredTypeOfDriver(inst["driver"].as<string>());
-		if(type == "oscilloscope")
-		{
-			if(!PreLoadOscilloscope(version, inst, online))
-				return false;
-		}
-		else if(type == "psu")
-		{
-			if(!PreLoadPowerSupply(version, inst, online))
-				return false;
-		}
-		else if(type == "rfgen")
-		{
-			if(!PreLoadRFSignalGenerator(version, inst, online))
-				return false;
-		}
-		else if(type == "funcgen")
-		{
-			if(!PreLoadFunctionGenerator(version, inst, online))
-				return false;
-		}
-		else if(type == "multimeter")
-		{
-			if(!PreLoadMultimeter(version, inst, online))
-				return false;
-		}
-		else if(type == "spectrometer")
-		{
-			if(!PreLoadSpectrometer(version, inst, online))
-				return false;
-		}
-		else if(type == "sdr")
-		{
-			if(!PreLoadSDR(version, inst, online))
-				return false;
-		}
-		else if(type == "load")
-		{
-			if(!PreLoadLoad(version, inst, online))
-				return false;
-		}
-		else if(type == "bert")
-		{
-			if(!PreLoadBERT(version, inst, online))
-				return false;
-		}
-		else if(type == "misc")
-		{
-			if(!PreLoadMisc(version, inst, online))
-				return false;
-		}
-		else if(type == "vna")
-		{
-			if(!PreLoadVNA(version, inst, online))
-				return false;
-		}
+	for(size_t i=0; i<n; i++)
+		memcpy(&samples[i], p + i*recordSize + 2*sizeof(int64_t), sizeof(float));
+}
 
-		//Unknown instrument type - too new file format?
-		else
-		{
-			m_mainWindow->ShowErrorPopup(
-				"File load error",
-				string("Instrument ") + nick.c_str() + " is of unknown type " + type.c_str());
-			return false;
-		}
-	}
+/**
+	@brief Splits the sample values out of a block of sparsev1 digital records
+ */
+static void DecodeSparseV1Samples(const unsigned char* p, size_t recordSize, bool* samples, size_t n)
+{
+	for(size_t i=0; i<n; i++)
+		samples[i] = p[i*recordSize + 2*sizeof(int64_t)] != 0;
+}
 
-	return true;
+/**
+	@brief Splits the symbols out of a block of sparsev1 CAN records
+ */
+static void DecodeSparseV1Samples(const unsigned char* p, size_t recordSize, CANSymbol* samples, size_t n)
+{
+	for(size_t i=0; i<n; i++)
+	{
+		uint32_t sym[2];
+		memcpy(sym, p + i*recordSize + 2*sizeof(int64_t), sizeof(sym));
+		samples[i] = CANSymbol((CANSymbol::stype)sym[1], sym[0]);
+	}
 }
 
-bool Session::LoadInstruments(int version, const YAML::Node& node, bool /*online*/)
+/**
+	@brief Loads sparsev1 records into a waveform of one concrete sample type
+
+	@param pool			Pool to decode on
+	@param cap			The waveform to load into
+	@param buf			Contents of the file
+	@param len			Length of the file
+	@param valueSize	Size of the value field of each record in the file
+ */
+template<class W>
+static void LoadSparseV1Samples(TaskPool& pool, W* cap, const unsigned char* buf, size_t len, size_t valueSize)
 {
-	LogTrace("Loading saved instruments\n");
-	LogIndenter li;
+	//Figure out how many samples we have
+	size_t samplesize = 2*sizeof(int64_t) + valueSize;
+	size_t nsamples = len / samplesize;
+	cap->Resize(nsamples);
+	HostMemoryPolicy::ApplyToWaveform(cap);
+
+	int64_t* offsets = cap->m_offsets.GetCpuPointer();
+	int64_t* durations = cap->m_durations.GetCpuPointer();
+	auto samples = cap->m_samples.GetCpuPointer();
+
+	int64_t nblocks = (nsamples + SPARSEV1_BLOCK_SIZE - 1) / SPARSEV1_BLOCK_SIZE;
+	pool.ParallelFor(0, nblocks, 1, [&](int64_t block)
+	{
+		size_t start = block * SPARSEV1_BLOCK_SIZE;
+		size_t n = min(nsamples - start, SPARSEV1_BLOCK_SIZE);
+		const unsigned char* p = buf + start*samplesize;
+
+		//Read start time and duration
+		#ifdef __x86_64__
+		if(g_hasAvx2)
+			DeinterleaveSparseV1TimesAVX2(p, samplesize, offsets + start, durations + start, n);
+		else
+		#endif
+			DeinterleaveSparseV1Times(p, samplesize, offsets + start, durations + start, n);
 
-	//Load each instrument
-	for(auto it : node)
+		//Read sample data
+		DecodeSparseV1Samples(p, samplesize, samples + start, n);
+	});
+}
+
+/**
+	@brief Loads sample data in the "sparsev1" format (interleaved offset, duration, and value) into a waveform
+
+	Records are split into the waveform's separate offset, duration, and sample buffers in parallel blocks.
+
+	@param pool		Pool to decode on
+	@param cap		The waveform to load into (must be a sparse analog, digital, or CAN waveform)
+	@param buf		Contents of the file
+	@param len		Length of the file
+ */
+static void LoadSparseV1Waveform(TaskPool& pool, WaveformBase* cap, const unsigned char* buf, size_t len)
+{
+	switch(GetWaveformKind(cap))
 	{
-		auto inst = it.second;
-		auto nick = inst["nick"].as<string>();
-		LogTrace("Loading instrument \"%s\"\n", nick.c_str());
+		case WAVEFORM_KIND_SPARSE_ANALOG:
+			LoadSparseV1Samples(pool, static_cast<SparseAnalogWaveform*>(cap), buf, len, sizeof(float));
+			break;
 
-		auto pinst = reinterpret_cast<Instrument*>(m_idtable[inst["id"].as<uintptr_t>()]);
-		if(!pinst)
-			continue;
+		case WAVEFORM_KIND_SPARSE_DIGITAL:
+			LoadSparseV1Samples(pool, static_cast<SparseDigitalWaveform*>(cap), buf, len, sizeof(bool));
+			break;
 
-		pinst->LoadConfiguration(version, inst, m_idtable);
-	}
+		case WAVEFORM_KIND_SPARSE_CAN:
+			LoadSparseV1Samples(pool, static_cast<CANWaveform*>(cap), buf, len, 2*sizeof(int32_t));
+			break;
 
-	return true;
+		default:
+			LogError("sparsev1 data can only be loaded into a sparse analog, digital, or CAN waveform\n");
+			break;
+	}
 }
 
-SCPITransport* Session::CreateTransportForNode(const YAML::Node& node)
+/**
+	@brief Decodes the offsets and durations sections of a sparsev2 file into a waveform
+
+	The waveform must already be resized to hold hdr.m_count samples, and the section sizes must have been validated.
+
+	@param cap			The waveform to load into
+	@param hdr			Header of the file
+	@param offsets		Contents of the offsets section
+	@param durations	Contents of the durations section
+ */
+static void DecodeSparseV2Timebase(
+	SparseWaveformBase* cap,
+	const SparseV2Header& hdr,
+	const unsigned char* offsets,
+	const unsigned char* durations)
 {
-	//Create the scope
-	auto transport = SCPITransport::CreateTransport(node["transport"].as<string>(), node["args"].as<string>());
+	size_t n = hdr.m_count;
 
-	//Check if the transport failed to initialize
-	if((transport == nullptr) || !transport->IsConnected())
+	//Offsets
+	auto poff = cap->m_offsets.GetCpuPointer();
+	if(hdr.m_flags & SPARSEV2_OFFSETS_DELTA32)
 	{
-		m_mainWindow->ShowErrorPopup(
-			"Unable to reconnect",
-			string("Failed to connect to instrument using connection string ") + node["args"].as<string>() +
-			"Loading in offline mode.");
+		auto deltas = reinterpret_cast<const int32_t*>(offsets);
+		int64_t last = 0;
+		for(size_t i=0; i<n; i++)
+		{
+			last += deltas[i];
+			poff[i] = last;
+		}
 	}
+	else
+		memcpy(poff, offsets, n*sizeof(int64_t));
 
-	return transport;
+	//Durations
+	auto pdur = cap->m_durations.GetCpuPointer();
+	if(hdr.m_flags & SPARSEV2_DURATIONS_RLE)
+	{
+		auto runs = reinterpret_cast<const int64_t*>(durations);
+		size_t nruns = hdr.m_durationsLen / (2*sizeof(int64_t));
+		size_t pos = 0;
+		for(size_t i=0; i<nruns; i++)
+		{
+			size_t count = min((size_t)runs[i*2 + 1], n - pos);
+			fill(pdur + pos, pdur + pos + count, runs[i*2]);
+			pos += count;
+		}
+		if(pos != n)
+			LogWarning("sparsev2 duration runs cover %zu of %zu samples\n", pos, n);
+	}
+	else
+		memcpy(pdur, durations, n*sizeof(int64_t));
 }
 
-bool Session::VerifyInstrument(const YAML::Node& node, shared_ptr<Instrument> inst)
+/**
+	@brief Checks that the offset and duration sections of a sparsev2 header have the right sizes for its sample count
+ */
+static bool CheckSparseV2TimebaseSections(const SparseV2Header& hdr)
 {
-	//Sanity check make/model/serial. If mismatch, stop
-	//TODO: preference to enforce serial match?
-	if(node["name"].as<string>() != inst->GetName())
+	size_t n = hdr.m_count;
+	size_t expectedOffsetsLen = n * ( (hdr.m_flags & SPARSEV2_OFFSETS_DELTA32) ? sizeof(int32_t) : sizeof(int64_t) );
+	bool durationsOK;
+	if(hdr.m_flags & SPARSEV2_DURATIONS_RLE)
+		durationsOK = (hdr.m_durationsLen % (2*sizeof(int64_t))) == 0;
+	else
+		durationsOK = (hdr.m_durationsLen == n*sizeof(int64_t));
+	return (hdr.m_offsetsLen == expectedOffsetsLen) && durationsOK;
+}
+
+/**
+	@brief Loads the offsets and durations of a sparse waveform from the sparsev2 file it shares them with
+
+	Only the header and the two timebase sections of the other file are read.
+
+	@param cap		The waveform to load into, already resized to n samples
+	@param path		Path to the file holding the timebase
+	@param n		Number of samples expected
+ */
+static bool LoadSparseV2SharedTimebase(SparseWaveformBase* cap, const string& path, size_t n)
+{
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
 	{
-		m_mainWindow->ShowErrorPopup(
-			"Unable to reconnect",
-			string("Unable to connect to oscilloscope: instrument has model name \"") +
-			inst->GetName() + "\", save file has model name \"" + node["name"].as<string>()  + "\"");
+		LogError("couldn't open shared sparsev2 timebase %s\n", path.c_str());
 		return false;
 	}
-	else if(node["vendor"].as<string>() != inst->GetVendor())
+
+	SparseV2Header hdr;
+	bool ok = (1 == fread(&hdr, sizeof(hdr), 1, fp));
+	ok = ok && (memcmp(hdr.m_magic, "SPARSEV2", sizeof(hdr.m_magic)) == 0);
+
+	//Timebases are always shared directly from the file that holds them, never through another reference
+	ok = ok && !(hdr.m_flags & SPARSEV2_TIMEBASE_SHARED) && (hdr.m_count == n);
+	ok = ok && CheckSparseV2TimebaseSections(hdr);
+
+	vector<unsigned char> offsets;
+	vector<unsigned char> durations;
+	if(ok)
 	{
-		m_mainWindow->ShowErrorPopup(
-			"Unable to reconnect",
-			string("Unable to connect to oscilloscope: instrument has vendor \"") +
-			inst->GetVendor() + "\", save file has vendor \"" + node["vendor"].as<string>()  + "\"");
-		return false;
+		offsets.resize(hdr.m_offsetsLen);
+		durations.resize(hdr.m_durationsLen);
+		ok = (0 == fseek(fp, hdr.m_offsetsStart, SEEK_SET));
+		ok = ok && (offsets.size() == fread(offsets.data(), 1, offsets.size(), fp));
+		ok = ok && (0 == fseek(fp, hdr.m_durationsStart, SEEK_SET));
+		ok = ok && (durations.size() == fread(durations.data(), 1, durations.size(), fp));
 	}
-	else if(node["serial"].as<string>() != inst->GetSerial())
+	fclose(fp);
+
+	if(!ok)
 	{
-		m_mainWindow->ShowErrorPopup(
-			"Unable to reconnect",
-			string("Unable to connect to oscilloscope: instrument has serial \"") +
-			inst->GetSerial() + "\", save file has serial \"" + node["serial"].as<string>()  + "\"");
+		LogError("Shared sparsev2 timebase %s is missing or does not match\n", path.c_str());
 		return false;
 	}
 
+	DecodeSparseV2Timebase(cap, hdr, offsets.data(), durations.data());
 	return true;
 }
 
-bool Session::PreLoadOscilloscope(int version, const YAML::Node& node, bool online)
+/**
+	@brief Loads sample data in the "sparsev2" format (see Session::SerializeSparseWaveform) into a waveform
+
+	Unencoded sections are copied directly into the waveform's buffers with no per-sample processing.
+
+	@param pool		Pool to decode on
+	@param cap		The waveform to load into (must be a SparseWaveformBase of the right sample type)
+	@param buf		Contents of the file
+	@param len		Length of the file
+	@param fname	Path to the file, used to find the timebase if it's shared with another file
+ */
+static void LoadSparseV2Waveform(
+	TaskPool& pool,
+	SparseWaveformBase* cap,
+	const unsigned char* buf,
+	size_t len,
+	const string& fname)
 {
-	//Create the instrument
-	shared_ptr<Oscilloscope> scope = nullptr;
+	if(!cap)
+	{
+		LogError("sparsev2 data can only be loaded into a sparse waveform\n");
+		return;
+	}
 
-	auto transtype = node["transport"].as<string>();
-	auto driver = node["driver"].as<string>();
+	SparseV2Header hdr;
+	if(len < sizeof(hdr))
+	{
+		LogError("sparsev2 file is too short to contain a header\n");
+		return;
+	}
+	memcpy(&hdr, buf, sizeof(hdr));
+	if(memcmp(hdr.m_magic, "SPARSEV2", sizeof(hdr.m_magic)) != 0)
+	{
+		LogError("Bad sparsev2 header\n");
+		return;
+	}
+	if(!CheckSparseV2Section(hdr.m_offsetsStart, hdr.m_offsetsLen, len) ||
+		!CheckSparseV2Section(hdr.m_durationsStart, hdr.m_durationsLen, len) ||
+		!CheckSparseV2Section(hdr.m_samplesStart, hdr.m_samplesLen, len) )
+	{
+		LogError("sparsev2 file is truncated\n");
+		return;
+	}
 
-	if(online)
+	//Figure out the sample type
+	auto kind = GetWaveformKind(cap);
+	size_t samplesize = 0;
+	if(kind == WAVEFORM_KIND_SPARSE_ANALOG)
+		samplesize = sizeof(float);
+	else if(kind == WAVEFORM_KIND_SPARSE_DIGITAL)
+		samplesize = sizeof(bool);
+	else if(kind == WAVEFORM_KIND_SPARSE_CAN)
+		samplesize = 2*sizeof(uint32_t);
+	if( (samplesize == 0) || (hdr.m_sampleSize != samplesize) )
 	{
-		if( (transtype == "null") && (driver != "demo") )
-		{
-			m_mainWindow->ShowErrorPopup(
-				"Unable to reconnect",
-				"The session file does not contain any connection information.\n\n"
-				"Loading in offline mode.");
-		}
+		LogError("sparsev2 sample size %u does not match waveform type\n", hdr.m_sampleSize);
+		return;
+	}
 
-		else
-		{
-			//Create the scope
-			auto transport = CreateTransportForNode(node);
+	//Validate section sizes
+	size_t n = hdr.m_count;
+	bool packed = (hdr.m_flags & SPARSEV2_SAMPLES_PACKED) != 0;
+	bool shared = (hdr.m_flags & SPARSEV2_TIMEBASE_SHARED) != 0;
+	if(packed && (kind != WAVEFORM_KIND_SPARSE_DIGITAL) )
+	{
+		LogError("sparsev2 packed samples are only valid for digital waveforms\n");
+		return;
+	}
+	bool timebaseOK = shared ? (hdr.m_offsetsLen > 0) && (hdr.m_durationsLen == 0) : CheckSparseV2TimebaseSections(hdr);
+	size_t expectedSamplesLen = packed ? (n + 7) / 8 : n*samplesize;
+	if(!timebaseOK || (hdr.m_samplesLen != expectedSamplesLen) )
+	{
+		LogError("sparsev2 section sizes do not match sample count\n");
+		return;
+	}
 
-			if(transport && transport->IsConnected())
-			{
-				scope = Oscilloscope::CreateOscilloscope(driver, transport);
-				if(!VerifyInstrument(node, scope))
-					scope = nullptr;
-			}
-			else
-			{
-				delete transport;
+	cap->Resize(n);
+	HostMemoryPolicy::ApplyToWaveform(cap);
 
-				m_mainWindow->ShowErrorPopup(
-					"Unable to reconnect",
-					string("Failed to reconnect to oscilloscope at ") + node["args"].as<string>() + ".\n\n"
-					"Loading this instrument in offline mode.");
-			}
+	//Offsets and durations, either from this file or the one we share them with
+	if(shared)
+	{
+		string ref(reinterpret_cast<const char*>(buf + hdr.m_offsetsStart), hdr.m_offsetsLen);
+		string dir = fname.substr(0, fname.find_last_of("/\\") + 1);
+		if(!LoadSparseV2SharedTimebase(cap, dir + ref, n))
+		{
+			cap->Resize(0);
+			return;
 		}
 	}
+	else
+		DecodeSparseV2Timebase(cap, hdr, buf + hdr.m_offsetsStart, buf + hdr.m_durationsStart);
 
-	if(!scope)
+	//Samples
+	auto psamples = buf + hdr.m_samplesStart;
+	if(kind == WAVEFORM_KIND_SPARSE_ANALOG)
+		memcpy(static_cast<SparseAnalogWaveform*>(cap)->m_samples.GetCpuPointer(), psamples, n*sizeof(float));
+	else if(kind == WAVEFORM_KIND_SPARSE_DIGITAL)
 	{
-		//Create the mock scope
-		scope = make_shared<MockOscilloscope>(
-			node["name"].as<string>(),
-			node["vendor"].as<string>(),
-			node["serial"].as<string>(),
-			transtype,
-			driver,
-			node["args"].as<string>()
-			);
+		auto samples = static_cast<SparseDigitalWaveform*>(cap)->m_samples.GetCpuPointer();
+		if(packed)
+			UnpackDigitalSamples(pool, psamples, samples, n);
+		else
+			memcpy(samples, psamples, n*sizeof(bool));
 	}
+	else
+	{
+		auto p = reinterpret_cast<const uint32_t*>(psamples);
+		auto samples = static_cast<CANWaveform*>(cap)->m_samples.GetCpuPointer();
+		for(size_t i=0; i<n; i++)
+			samples[i] = CANSymbol((CANSymbol::stype)p[i*2 + 1], p[i*2]);
+	}
+}
 
-	//Make any config settings to the instrument from our preference settings
-	ApplyPreferences(scope);
+/**
+	@brief Loads sample data in the "densev1" format (see Session::SerializeUniformWaveform) into a waveform
 
-	//All good. Add to our list of scopes etc
-	AddInstrument(scope, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)scope.get());
+	The file is just the raw sample array, so this is a single copy of whatever sample type the waveform holds.
+ */
+template<class W>
+static void LoadDenseV1Waveform(W* cap, const unsigned char* buf, size_t len)
+{
+	typedef typename remove_pointer<decltype(cap->m_samples.GetCpuPointer())>::type sample_t;
 
-	//Load trigger deskew
-	if(node["triggerdeskew"])
-		m_scopeDeskewCal[scope] = node["triggerdeskew"].as<int64_t>();
+	size_t nsamples = len / sizeof(sample_t);
+	cap->Resize(nsamples);
+	HostMemoryPolicy::ApplyToWaveform(cap);
+	memcpy(cap->m_samples.GetCpuPointer(), buf, nsamples*sizeof(sample_t));
+}
 
-	//Run the preload
-	scope->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+/**
+	@brief Loads sample data from a saved session into a waveform
 
-	return true;
-}
+	This does not touch any session state, so it's safe to call from a background thread as long as nothing else is
+	using the waveform.
 
-bool Session::PreLoadVNA(int version, const YAML::Node& node, bool online)
-{
-	//Create the instrument
-	shared_ptr<Oscilloscope> scope = nullptr;
+	@param pool		Pool to decode on
+	@param cap		Waveform of the appropriate type for the format, with metadata already filled out
+	@param format	Format of the file (e.g. "sparsev2")
+	@param fname	Path to the file
+	@param fileSize	If not null, set to the size of the file in bytes (for throughput reporting)
 
-	auto transtype = node["transport"].as<string>();
-	auto driver = node["driver"].as<string>();
+	@return The waveform containing the loaded data. This may be a new waveform of a different type if the data
+			turned out to be better represented that way; if so, the caller is responsible for deleting the original.
+ */
+WaveformBase* Session::LoadWaveformFile(
+	TaskPool& pool,
+	WaveformBase* cap,
+	const string& format,
+	const string& fname,
+	size_t* fileSize)
+{
+	auto kind = GetWaveformKind(cap);
+	auto sacap = (kind == WAVEFORM_KIND_SPARSE_ANALOG) ? static_cast<SparseAnalogWaveform*>(cap) : nullptr;
+	auto uacap = (kind == WAVEFORM_KIND_UNIFORM_ANALOG) ? static_cast<UniformAnalogWaveform*>(cap) : nullptr;
+	auto udcap = (kind == WAVEFORM_KIND_UNIFORM_DIGITAL) ? static_cast<UniformDigitalWaveform*>(cap) : nullptr;
 
-	if(online)
-	{
-		if( (transtype == "null") && (driver != "demo") )
+	cap->PrepareForCpuAccess();
+
+	//Load samples into memory
+	unsigned char* buf = NULL;
+
+	//Windows: memory map the file too, so the loaders below decode straight out of the page cache
+	//rather than from a private copy of the whole file
+	#ifdef _WIN32
+		HANDLE hfile = CreateFileA(
+			fname.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			NULL,
+			OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN,
+			NULL);
+		if(hfile == INVALID_HANDLE_VALUE)
 		{
-			m_mainWindow->ShowErrorPopup(
-				"Unable to reconnect",
-				"The session file does not contain any connection information.\n\n"
-				"Loading in offline mode.");
+			LogError("couldn't open %s\n", fname.c_str());
+			return cap;
 		}
-
-		else
+		LARGE_INTEGER fsize;
+		if(!GetFileSizeEx(hfile, &fsize))
+			fsize.QuadPart = 0;
+		size_t len = fsize.QuadPart;
+
+		//Empty files can't be mapped, but there's nothing to decode anyway
+		HANDLE hmap = NULL;
+		if(len > 0)
 		{
-			//Create the scope
-			auto transport = CreateTransportForNode(node);
-
-			if(transport && transport->IsConnected())
+			hmap = CreateFileMappingA(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if(hmap)
+				buf = (unsigned char*)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+			if(!buf)
 			{
-				scope = SCPIVNA::CreateVNA(driver, transport);
-				if(!VerifyInstrument(node, scope))
-					scope = nullptr;
+				LogError("couldn't map %s\n", fname.c_str());
+				if(hmap)
+					CloseHandle(hmap);
+				CloseHandle(hfile);
+				return cap;
 			}
-			else
-			{
-				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
-					"Unable to reconnect",
-					string("Failed to reconnect to oscilloscope at ") + node["args"].as<string>() + ".\n\n"
-					"Loading this instrument in offline mode.");
-			}
+			//We read the whole file front to back exactly once, so ask for all of it up front
+			//rather than taking a page fault per 4 kB
+			#if _WIN32_WINNT >= 0x0602
+				WIN32_MEMORY_RANGE_ENTRY range;
+				range.VirtualAddress = buf;
+				range.NumberOfBytes = len;
+				PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+			#endif
 		}
-	}
 
-	if(!scope)
-	{
-		//Create the mock scope
-		scope = make_shared<MockOscilloscope>(
-			node["name"].as<string>(),
-			node["vendor"].as<string>(),
-			node["serial"].as<string>(),
-			transtype,
-			driver,
-			node["args"].as<string>()
-			);
-	}
+	//On POSIX, just memory map the file
+	#else
+		int fd = open(fname.c_str(), O_RDONLY);
+		if(fd < 0)
+		{
+			LogError("couldn't open %s\n", fname.c_str());
+			return cap;
+		}
+		size_t len = lseek(fd, 0, SEEK_END);
+		buf = (unsigned char*)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
 
-	//Make any config settings to the instrument from our preference settings
-	ApplyPreferences(scope);
+		//We read the whole file front to back exactly once, so let the kernel read ahead aggressively
+		madvise(buf, len, MADV_SEQUENTIAL);
+	#endif
 
-	//All good. Add to our list of scopes etc
-	AddInstrument(scope, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)scope.get());
+	if(fileSize)
+		*fileSize = len;
 
-	//Run the preload
-	scope->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	//Sparse interleaved
+	if(format == "sparsev1")
+		LoadSparseV1Waveform(pool, cap, buf, len);
 
-	return true;
-}
+	//Columnar
+	else if(format == "sparsev2")
+		LoadSparseV2Waveform(pool, GetSparseBase(cap, kind), buf, len, fname);
 
-bool Session::PreLoadLoad(int version, const YAML::Node& node, bool online)
-{
-	//Create the instrument
-	shared_ptr<SCPILoad> load = nullptr;
+	//Dense quantized
+	else if(format == "densev2")
+		LoadDenseV2Waveform(pool, uacap, buf, len);
 
-	auto transtype = node["transport"].as<string>();
-	auto driver = node["driver"].as<string>();
+	//Dense bit packed
+	else if(format == "densebits")
+		LoadDenseBitsWaveform(pool, udcap, buf, len);
 
-	if(online)
+	//Dense packed
+	else if(format == "densev1")
 	{
-		if( (transtype == "null") && (driver != "demoload") )
-		{
-			m_mainWindow->ShowErrorPopup(
-				"Unable to reconnect",
-				"The session file does not contain any connection information.\n\n"
-				"Loading in offline mode.");
-		}
-
+		if(uacap)
+			LoadDenseV1Waveform(uacap, buf, len);
+		else if(udcap)
+			LoadDenseV1Waveform(udcap, buf, len);
 		else
-		{
-			//Create the PSU
-			auto transport = CreateTransportForNode(node);
-
-			if(transport && transport->IsConnected())
-			{
-				load = SCPILoad::CreateLoad(driver, transport);
-				if(!VerifyInstrument(node, load))
-					load = nullptr;
-			}
-
-			else
-			{
-				delete transport;
-
-				m_mainWindow->ShowErrorPopup(
-					"Unable to reconnect",
-					string("Failed to reconnect to load at ") + node["args"].as<string>() + ".\n\n"
-					"Loading this instrument in offline mode.");
-			}
-		}
+			LogError("densev1 data can only be loaded into a uniform analog or digital waveform\n");
 	}
 
-	if(!load)
+	else
 	{
-		/*
-		//Create the mock scope
-		scope = new MockOscilloscope(
-			node["name"].as<string>(),
-			node["vendor"].as<string>(),
-			node["serial"].as<string>(),
-			transtype,
-			driver,
-			node["args"].as<string>()
-			);
-		*/
-		LogError("offline loading of loads not implemented yet\n");
-		return true;
+		LogError(
+			"Unknown waveform format \"%s\", perhaps this file was created by a newer version of ngscopeclient?\n",
+			format.c_str());
 	}
 
-	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(load);
+	//Quickly check if the waveform is dense packed, even if it was stored as sparse.
+	//Since we know samples must be monotonic and non-overlapping, we don't have to check every single one!
+	if(sacap && (sacap->size() > 0) )
+	{
+		int64_t nlast = sacap->size() - 1;
+		if( (sacap->m_offsets[0] == 0) &&
+			(sacap->m_offsets[nlast] == nlast) &&
+			(sacap->m_durations[nlast] == 1) )
+		{
+			//Waveform was actually uniform, so convert it
+			cap = new UniformAnalogWaveform(*sacap);
+		}
+	}
 
-	//All good. Add to our list of loads etc
-	AddInstrument(load, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)load.get());
+	cap->MarkModifiedFromCpu();
 
-	//Run the preload
-	load->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	#ifdef _WIN32
+		if(buf)
+			UnmapViewOfFile(buf);
+		if(hmap)
+			CloseHandle(hmap);
+		CloseHandle(hfile);
+	#else
+		munmap(buf, len);
+		::close(fd);
+	#endif
 
-	return true;
+	return cap;
 }
 
-bool Session::PreLoadMisc(int version, const YAML::Node& node, bool online)
-{
-	//Create the instrument
-	shared_ptr<SCPIMiscInstrument> misc = nullptr;
-
-	auto transtype = node["transport"].as<string>();
-	auto driver = node["driver"].as<string>();
+/**
+	@brief Performs an exhaustive search of the driver list to see which type this instrument is
 
-	if(online)
+	TODO: we should really just unify the dynamic creation tables...
+ */
+string Session::GetRegisteredTypeOfDriver(const string& drivername)
+{
+	for(auto& it : m_driverNamesByType)
 	{
-		if( (transtype == "null") && (driver != "demoload") )
+		for(auto name : it.second)
 		{
-			m_mainWindow->ShowErrorPopup(
-				"Unable to reconnect",
-				"The session file does not contain any connection information.\n\n"
-				"Loading in offline mode.");
+			if(name == drivername)
+				return it.first;
 		}
+	}
 
-		else
-		{
-			//Create the PSU
-			auto transport = CreateTransportForNode(node);
-
-			if(transport && transport->IsConnected())
-			{
-				misc = SCPIMiscInstrument::CreateInstrument(driver, transport);
-				if(!VerifyInstrument(node, misc))
-					misc = nullptr;
-			}
+	LogError("Couldn't find any driver called \"%s\"\n", drivername.c_str());
+	return "unknown";
+}
 
-			else
-			{
-				delete transport;
+bool Session::PreLoadInstruments(int version, const YAML::Node& node, bool online)
+{
+	LogTrace("Preloading saved instruments\n");
+	LogIndenter li;
 
-				m_mainWindow->ShowErrorPopup(
-					"Unable to reconnect",
-					string("Failed to reconnect to miscellaneous instrument at ") + node["args"].as<string>() + ".\n\n"
-					"Loading this instrument in offline mode.");
-			}
-		}
-	}
+	m_warnings.clear();
 
-	if(!misc)
+	if(!node)
 	{
-		/*
-		//Create the mock scope
-		scope = new MockOscilloscope(
-			node["name"].as<string>(),
-			node["vendor"].as<string>(),
-			node["serial"].as<string>(),
-			transtype,
-			driver,
-			node["args"].as<string>()
-			);
-		*/
-		LogError("offline loading of misc instruments not implemented yet\n");
-		return true;
+		m_mainWindow->ShowErrorPopup(
+			"File load error",
+			"The session file is invalid because there is no \"instruments\" section.");
+		return false;
 	}
 
-	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(misc);
-
-	//All good. Add to our list of loads etc
-	AddInstrument(misc);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)misc.get());
-
-	//Run the preload
-	misc->PreLoadConfiguration(version, node, m_idtable, m_warnings);
-
-	return true;
-}
-
-bool Session::PreLoadBERT(int version, const YAML::Node& node, bool online)
-{
-	//Create the instrument
-	shared_ptr<SCPIBERT> bert = nullptr;
-
-	auto transtype = node["transport"].as<string>();
-	auto driver = node["driver"].as<string>();
+	//Connect to everything at once, since most of the time is spent waiting on round trips to each instrument.
+	//Instruments are still added to the session one at a time, in file order, below.
+	if(online && m_preferences.GetBool("Drivers.General.parallel_session_load"))
+		PreconnectInstruments(node);
 
-	if(online)
+	//Load each instrument
+	bool ok = true;
+	for(auto it : node)
 	{
-		if(transtype == "null")
+		auto inst = it.second;
+		auto nick = inst["nick"].as<string>();
+		LogTrace("Loading instrument \"%s\"\n", nick.c_str());
+
+		//The "type" field in the scopesession format is actually redundant, we should be able to tell what the driver
+		//is based on which table it's found in!
+		string type = GetRegisteredTypeOfDriver(inst["driver"].as<string>());
+		if(type == "oscilloscope")
 		{
-			m_mainWindow->ShowErrorPopup(
-				"Unable to reconnect",
-				"The session file does not contain any connection information.\n\n"
-				"Loading in offline mode.");
+			if(!PreLoadOscilloscope(version, inst, online))
+				ok = false;
 		}
-
-		else
+		else if(type == "psu")
 		{
-			//Create the BERT
-			auto transport = CreateTransportForNode(node);
+			if(!PreLoadPowerSupply(version, inst, online))
+				ok = false;
+		}
+		else if(type == "rfgen")
+		{
+			if(!PreLoadRFSignalGenerator(version, inst, online))
+				ok = false;
+		}
+		else if(type == "funcgen")
+		{
+			if(!PreLoadFunctionGenerator(version, inst, online))
+				ok = false;
+		}
+		else if(type == "multimeter")
+		{
+			if(!PreLoadMultimeter(version, inst, online))
+				ok = false;
+		}
+		else if(type == "spectrometer")
+		{
+			if(!PreLoadSpectrometer(version, inst, online))
+				ok = false;
+		}
+		else if(type == "sdr")
+		{
+			if(!PreLoadSDR(version, inst, online))
+				ok = false;
+		}
+		else if(type == "load")
+		{
+			if(!PreLoadLoad(version, inst, online))
+				ok = false;
+		}
+		else if(type == "bert")
+		{
+			if(!PreLoadBERT(version, inst, online))
+				ok = false;
+		}
+		else if(type == "misc")
+		{
+			if(!PreLoadMisc(version, inst, online))
+				ok = false;
+		}
+		else if(type == "vna")
+		{
+			if(!PreLoadVNA(version, inst, online))
+				ok = false;
+		}
 
-			if(transport && transport->IsConnected())
-			{
-				bert = SCPIBERT::CreateBERT(driver, transport);
-				if(!VerifyInstrument(node, bert))
-					bert = nullptr;
-			}
+		//Unknown instrument type - too new file format?
+		else
+		{
+			m_mainWindow->ShowErrorPopup(
+				"File load error",
+				string("Instrument ") + nick.c_str() + " is of unknown type " + type.c_str());
+			ok = false;
+		}
 
-			else
+		if(!ok)
+			break;
+	}
+
+	//Clean up anything we connected to but didn't get to
+	ClearPreconnectedInstruments();
+
+	return ok;
+}
+
+bool Session::LoadInstruments(int version, const YAML::Node& node, bool /*online*/)
+{
+	LogTrace("Loading saved instruments\n");
+	LogIndenter li;
+
+	//Load each instrument
+	for(auto it : node)
+	{
+		auto inst = it.second;
+		auto nick = inst["nick"].as<string>();
+		LogTrace("Loading instrument \"%s\"\n", nick.c_str());
+
+		auto pinst = reinterpret_cast<Instrument*>(m_idtable[inst["id"].as<uintptr_t>()]);
+		if(!pinst)
+			continue;
+
+		pinst->LoadConfiguration(version, inst, m_idtable);
+	}
+
+	return true;
+}
+
+/**
+	@brief Connects to every instrument in a session file concurrently
+
+	Opens the transport to each instrument and creates its driver on a separate thread. The results are stashed in
+	m_preconnectedInstruments for CreateTransportForNode() and CreateInstrumentForNode() to pick up. Failed connections
+	aren't reported here; the PreLoad* functions handle them exactly as if they'd connected themselves. Exceptions
+	thrown by a transport or driver are logged, and the instrument is loaded offline.
+
+	@param node	The "instruments" section of the session file
+ */
+void Session::PreconnectInstruments(const YAML::Node& node)
+{
+	LogTrace("Connecting to instruments\n");
+	LogIndenter li;
+
+	double start = GetTime();
+
+	map<uintptr_t, future<PreconnectedInstrument>> pending;
+	for(auto it : node)
+	{
+		auto inst = it.second;
+		if(!inst["transport"] || !inst["args"] || !inst["driver"] || !inst["id"])
+			continue;
+
+		//Nothing to connect to, and these are fast to create anyway
+		auto transtype = inst["transport"].as<string>();
+		if(transtype == "null")
+			continue;
+
+		auto type = GetRegisteredTypeOfDriver(inst["driver"].as<string>());
+		auto driver = inst["driver"].as<string>();
+		auto args = inst["args"].as<string>();
+		pending[inst["id"].as<uintptr_t>()] = async(launch::async, [type, driver, transtype, args]
 			{
-				delete transport;
+				PreconnectedInstrument ret;
+				double tstart = GetTime();
 
-				m_mainWindow->ShowErrorPopup(
-					"Unable to reconnect",
-					string("Failed to reconnect to BERT at ") + node["args"].as<string>() + ".\n\n"
-					"Loading this instrument in offline mode.");
-			}
+				try
+				{
+					ret.m_transport = SCPITransport::CreateTransport(transtype, args);
+					if(ret.m_transport && ret.m_transport->IsConnected())
+						ret.m_inst = CreateInstrumentDriver(type, driver, ret.m_transport);
+				}
+
+				//Load the instrument offline, as if it hadn't connected. The driver may have taken ownership of the
+				//transport before it threw, so it isn't safe to delete.
+				catch(const exception& e)
+				{
+					ret.m_error = e.what();
+					ret.m_transport = nullptr;
+					ret.m_inst = nullptr;
+				}
+
+				ret.m_connectTime = GetTime() - tstart;
+				return ret;
+			});
+	}
+
+	for(auto& it : pending)
+	{
+		auto result = it.second.get();
+		if(!result.m_error.empty())
+			LogError("Instrument %zx failed to connect: %s\n", (size_t)it.first, result.m_error.c_str());
+		else if(result.m_inst)
+		{
+			LogTrace("Connected to %s %s in %.3f sec\n",
+				result.m_inst->GetVendor().c_str(), result.m_inst->GetName().c_str(), result.m_connectTime);
 		}
+		else
+			LogTrace("Instrument %zx failed to connect after %.3f sec\n", (size_t)it.first, result.m_connectTime);
+		m_preconnectedInstruments[it.first] = result;
 	}
 
-	if(!bert)
+	LogTrace("All instruments connected in %.3f sec\n", GetTime() - start);
+}
+
+/**
+	@brief Frees any instruments from PreconnectInstruments() that were never claimed
+ */
+void Session::ClearPreconnectedInstruments()
+{
+	for(auto& it : m_preconnectedInstruments)
 	{
-		/*
-		//Create the mock scope
-		scope = new MockOscilloscope(
-			node["name"].as<string>(),
-			node["vendor"].as<string>(),
-			node["serial"].as<string>(),
-			transtype,
-			driver,
-			node["args"].as<string>()
-			);
-		*/
-		LogError("offline loading of BERTs not implemented yet\n");
-		return true;
+		//Driver instances own their transport, so only delete bare transports
+		if(!it.second.m_inst)
+			delete it.second.m_transport;
 	}
+	m_preconnectedInstruments.clear();
+}
 
-	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(bert);
+/**
+	@brief Creates the driver for an instrument in a session file
 
-	//All good. Add to our list of berts etc
-	AddInstrument(bert, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)bert.get());
+	Returns the driver made by PreconnectInstruments() if there is one, otherwise creates it now.
 
-	//Run the preload
-	bert->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	@param node			Session file node for the instrument
+	@param type			Instrument type
+	@param transport	Transport returned by CreateTransportForNode()
+ */
+shared_ptr<Instrument> Session::CreateInstrumentForNode(
+	const YAML::Node& node,
+	const string& type,
+	SCPITransport* transport)
+{
+	auto it = m_preconnectedInstruments.find(node["id"].as<uintptr_t>());
+	if( (it != m_preconnectedInstruments.end()) && (it->second.m_transport == transport) )
+	{
+		auto inst = it->second.m_inst;
+		m_preconnectedInstruments.erase(it);
+		if(inst)
+			return inst;
+	}
+
+	return CreateInstrumentDriver(type, node["driver"].as<string>(), transport);
+}
+
+SCPITransport* Session::CreateTransportForNode(const YAML::Node& node)
+{
+	//Use the connection from PreconnectInstruments() if we have one
+	SCPITransport* transport = nullptr;
+	auto it = m_preconnectedInstruments.find(node["id"].as<uintptr_t>());
+	if(it != m_preconnectedInstruments.end())
+	{
+		transport = it->second.m_transport;
+
+		//If there's no driver instance, the caller owns the transport from here on
+		if(!it->second.m_inst)
+			m_preconnectedInstruments.erase(it);
+	}
+
+	//If not, create the transport
+	else
+		transport = SCPITransport::CreateTransport(node["transport"].as<string>(), node["args"].as<string>());
+
+	//Check if the transport failed to initialize
+	if((transport == nullptr) || !transport->IsConnected())
+	{
+		m_mainWindow->ShowErrorPopup(
+			"Unable to reconnect",
+			string("Failed to connect to instrument using connection string ") + node["args"].as<string>() +
+			"Loading in offline mode.");
+	}
+
+	return transport;
+}
+
+bool Session::VerifyInstrument(const YAML::Node& node, shared_ptr<Instrument> inst)
+{
+	//Sanity check make/model/serial. If mismatch, stop
+	//TODO: preference to enforce serial match?
+	if(node["name"].as<string>() != inst->GetName())
+	{
+		m_mainWindow->ShowErrorPopup(
+			"Unable to reconnect",
+			string("Unable to connect to oscilloscope: instrument has model name \"") +
+			inst->GetName() + "\", save file has model name \"" + node["name"].as<string>()  + "\"");
+		return false;
+	}
+	else if(node["vendor"].as<string>() != inst->GetVendor())
+	{
+		m_mainWindow->ShowErrorPopup(
+			"Unable to reconnect",
+			string("Unable to connect to oscilloscope: instrument has vendor \"") +
+			inst->GetVendor() + "\", save file has vendor \"" + node["vendor"].as<string>()  + "\"");
+		return false;
+	}
+	else if(node["serial"].as<string>() != inst->GetSerial())
+	{
+		m_mainWindow->ShowErrorPopup(
+			"Unable to reconnect",
+			string("Unable to connect to oscilloscope: instrument has serial \"") +
+			inst->GetSerial() + "\", save file has serial \"" + node["serial"].as<string>()  + "\"");
+		return false;
+	}
 
 	return true;
 }
 
-bool Session::PreLoadSDR(int version, const YAML::Node& node, bool online)
+bool Session::PreLoadOscilloscope(int version, const YAML::Node& node, bool online)
 {
 	//Create the instrument
-	shared_ptr<SCPISDR> sdr = nullptr;
+	shared_ptr<Oscilloscope> scope = nullptr;
 
 	auto transtype = node["transport"].as<string>();
 	auto driver = node["driver"].as<string>();
 
 	if(online)
 	{
-		if( (transtype == "null") && (driver != "demospec") )
+		if( (transtype == "null") && (driver != "demo") )
 		{
 			m_mainWindow->ShowErrorPopup(
 				"Unable to reconnect",
@@ -1442,33 +2546,31 @@ bool Session::PreLoadSDR(int version, const YAML::Node& node, bool online)
 
 		else
 		{
-			//Create the PSU
+			//Create the scope
 			auto transport = CreateTransportForNode(node);
 
 			if(transport && transport->IsConnected())
 			{
-				sdr = SCPISDR::CreateSDR(driver, transport);
-				if(!VerifyInstrument(node, sdr))
-					sdr = nullptr;
+				scope = dynamic_pointer_cast<Oscilloscope>(CreateInstrumentForNode(node, "oscilloscope", transport));
+				if(!VerifyInstrument(node, scope))
+					scope = nullptr;
 			}
-
 			else
 			{
 				delete transport;
 
 				m_mainWindow->ShowErrorPopup(
 					"Unable to reconnect",
-					string("Failed to reconnect to SDR at ") + node["args"].as<string>() + ".\n\n"
+					string("Failed to reconnect to oscilloscope at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
 			}
 		}
 	}
 
-	if(!sdr)
+	if(!scope)
 	{
-		/*
 		//Create the mock scope
-		scope = new MockOscilloscope(
+		scope = make_shared<MockOscilloscope>(
 			node["name"].as<string>(),
 			node["vendor"].as<string>(),
 			node["serial"].as<string>(),
@@ -1476,35 +2578,50 @@ bool Session::PreLoadSDR(int version, const YAML::Node& node, bool online)
 			driver,
 			node["args"].as<string>()
 			);
-		*/
-		LogError("offline loading of SDRs not implemented yet\n");
-		return true;
 	}
 
 	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(sdr);
+	ApplyPreferences(scope);
 
-	//All good. Add to our list of specs etc
-	AddInstrument(sdr, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)sdr.get());
+	//All good. Add to our list of scopes etc
+	AddInstrument(scope, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)scope.get());
+
+	//Load trigger deskew
+	if(node["triggerdeskew"])
+		SetDeskew(scope, node["triggerdeskew"].as<int64_t>());
+
+	//Load waveform queue limits
+	auto qnode = node["queuelimit"];
+	auto it = m_instrumentStates.find(scope);
+	if(qnode && (it != m_instrumentStates.end()) && it->second)
+	{
+		auto state = it->second;
+		if(qnode["mode"])
+			state->m_queueLimitByMemory = (qnode["mode"].as<string>() == "memory");
+		if(qnode["count"])
+			state->m_queueLimitCount = qnode["count"].as<size_t>();
+		if(qnode["bytes"])
+			state->m_queueLimitBytes = qnode["bytes"].as<int64_t>();
+	}
 
 	//Run the preload
-	sdr->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	scope->PreLoadConfiguration(version, node, m_idtable, m_warnings);
 
 	return true;
 }
 
-bool Session::PreLoadSpectrometer(int version, const YAML::Node& node, bool online)
+bool Session::PreLoadVNA(int version, const YAML::Node& node, bool online)
 {
 	//Create the instrument
-	shared_ptr<SCPISpectrometer> spec = nullptr;
+	shared_ptr<Oscilloscope> scope = nullptr;
 
 	auto transtype = node["transport"].as<string>();
 	auto driver = node["driver"].as<string>();
 
 	if(online)
 	{
-		if( (transtype == "null") && (driver != "demospec") )
+		if( (transtype == "null") && (driver != "demo") )
 		{
 			m_mainWindow->ShowErrorPopup(
 				"Unable to reconnect",
@@ -1514,33 +2631,31 @@ bool Session::PreLoadSpectrometer(int version, const YAML::Node& node, bool onli
 
 		else
 		{
-			//Create the PSU
+			//Create the scope
 			auto transport = CreateTransportForNode(node);
 
 			if(transport && transport->IsConnected())
 			{
-				spec = SCPISpectrometer::CreateSpectrometer(driver, transport);
-				if(!VerifyInstrument(node, spec))
-					spec = nullptr;
+				scope = dynamic_pointer_cast<Oscilloscope>(CreateInstrumentForNode(node, "vna", transport));
+				if(!VerifyInstrument(node, scope))
+					scope = nullptr;
 			}
-
 			else
 			{
 				delete transport;
 
 				m_mainWindow->ShowErrorPopup(
 					"Unable to reconnect",
-					string("Failed to reconnect to spectrometer at ") + node["args"].as<string>() + ".\n\n"
+					string("Failed to reconnect to oscilloscope at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
 			}
 		}
 	}
 
-	if(!spec)
+	if(!scope)
 	{
-		/*
 		//Create the mock scope
-		scope = new MockOscilloscope(
+		scope = make_shared<MockOscilloscope>(
 			node["name"].as<string>(),
 			node["vendor"].as<string>(),
 			node["serial"].as<string>(),
@@ -1548,35 +2663,32 @@ bool Session::PreLoadSpectrometer(int version, const YAML::Node& node, bool onli
 			driver,
 			node["args"].as<string>()
 			);
-		*/
-		LogError("offline loading of spectrometers not implemented yet\n");
-		return true;
 	}
 
 	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(spec);
+	ApplyPreferences(scope);
 
-	//All good. Add to our list of specs etc
-	AddInstrument(spec, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)spec.get());
+	//All good. Add to our list of scopes etc
+	AddInstrument(scope, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)scope.get());
 
 	//Run the preload
-	spec->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	scope->PreLoadConfiguration(version, node, m_idtable, m_warnings);
 
 	return true;
 }
 
-bool Session::PreLoadMultimeter(int version, const YAML::Node& node, bool online)
+bool Session::PreLoadLoad(int version, const YAML::Node& node, bool online)
 {
 	//Create the instrument
-	shared_ptr<SCPIMultimeter> meter = nullptr;
+	shared_ptr<SCPILoad> load = nullptr;
 
 	auto transtype = node["transport"].as<string>();
 	auto driver = node["driver"].as<string>();
 
 	if(online)
 	{
-		if( (transtype == "null") && (driver != "demometer") )
+		if( (transtype == "null") && (driver != "demoload") )
 		{
 			m_mainWindow->ShowErrorPopup(
 				"Unable to reconnect",
@@ -1591,9 +2703,9 @@ bool Session::PreLoadMultimeter(int version, const YAML::Node& node, bool online
 
 			if(transport && transport->IsConnected())
 			{
-				meter = SCPIMultimeter::CreateMultimeter(driver, transport);
-				if(!VerifyInstrument(node, meter))
-					meter = nullptr;
+				load = dynamic_pointer_cast<SCPILoad>(CreateInstrumentForNode(node, "load", transport));
+				if(!VerifyInstrument(node, load))
+					load = nullptr;
 			}
 
 			else
@@ -1602,13 +2714,13 @@ bool Session::PreLoadMultimeter(int version, const YAML::Node& node, bool online
 
 				m_mainWindow->ShowErrorPopup(
 					"Unable to reconnect",
-					string("Failed to reconnect to multimeter at ") + node["args"].as<string>() + ".\n\n"
+					string("Failed to reconnect to load at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
 			}
 		}
 	}
 
-	if(!meter)
+	if(!load)
 	{
 		/*
 		//Create the mock scope
@@ -1621,34 +2733,34 @@ bool Session::PreLoadMultimeter(int version, const YAML::Node& node, bool online
 			node["args"].as<string>()
 			);
 		*/
-		LogError("offline loading of multimeters not implemented yet\n");
+		LogError("offline loading of loads not implemented yet\n");
 		return true;
 	}
 
 	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(meter);
+	//ApplyPreferences(load);
 
-	//All good. Add to our list of meters etc
-	AddInstrument(meter, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)meter.get());
+	//All good. Add to our list of loads etc
+	AddInstrument(load, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)load.get());
 
 	//Run the preload
-	meter->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	load->PreLoadConfiguration(version, node, m_idtable, m_warnings);
 
 	return true;
 }
 
-bool Session::PreLoadPowerSupply(int version, const YAML::Node& node, bool online)
+bool Session::PreLoadMisc(int version, const YAML::Node& node, bool online)
 {
 	//Create the instrument
-	shared_ptr<SCPIPowerSupply> psu = nullptr;
+	shared_ptr<SCPIMiscInstrument> misc = nullptr;
 
 	auto transtype = node["transport"].as<string>();
 	auto driver = node["driver"].as<string>();
 
 	if(online)
 	{
-		if( (transtype == "null") && (driver != "demopsu") )
+		if( (transtype == "null") && (driver != "demoload") )
 		{
 			m_mainWindow->ShowErrorPopup(
 				"Unable to reconnect",
@@ -1663,9 +2775,9 @@ bool Session::PreLoadPowerSupply(int version, const YAML::Node& node, bool onlin
 
 			if(transport && transport->IsConnected())
 			{
-				psu = SCPIPowerSupply::CreatePowerSupply(driver, transport);
-				if(!VerifyInstrument(node, psu))
-					psu = nullptr;
+				misc = dynamic_pointer_cast<SCPIMiscInstrument>(CreateInstrumentForNode(node, "misc", transport));
+				if(!VerifyInstrument(node, misc))
+					misc = nullptr;
 			}
 
 			else
@@ -1674,13 +2786,13 @@ bool Session::PreLoadPowerSupply(int version, const YAML::Node& node, bool onlin
 
 				m_mainWindow->ShowErrorPopup(
 					"Unable to reconnect",
-					string("Failed to reconnect to power supply at ") + node["args"].as<string>() + ".\n\n"
+					string("Failed to reconnect to miscellaneous instrument at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
 			}
 		}
 	}
 
-	if(!psu)
+	if(!misc)
 	{
 		/*
 		//Create the mock scope
@@ -1693,27 +2805,27 @@ bool Session::PreLoadPowerSupply(int version, const YAML::Node& node, bool onlin
 			node["args"].as<string>()
 			);
 		*/
-		LogError("offline loading of power supplies not implemented yet\n");
+		LogError("offline loading of misc instruments not implemented yet\n");
 		return true;
 	}
 
 	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(psu);
+	//ApplyPreferences(misc);
 
-	//All good. Add to our list of scopes etc
-	AddInstrument(psu, false);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)psu.get());
+	//All good. Add to our list of loads etc
+	AddInstrument(misc);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)misc.get());
 
 	//Run the preload
-	psu->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	misc->PreLoadConfiguration(version, node, m_idtable, m_warnings);
 
 	return true;
 }
 
-bool Session::PreLoadRFSignalGenerator(int version, const YAML::Node& node, bool online)
+bool Session::PreLoadBERT(int version, const YAML::Node& node, bool online)
 {
 	//Create the instrument
-	shared_ptr<SCPIRFSignalGenerator> gen = nullptr;
+	shared_ptr<SCPIBERT> bert = nullptr;
 
 	auto transtype = node["transport"].as<string>();
 	auto driver = node["driver"].as<string>();
@@ -1730,14 +2842,14 @@ bool Session::PreLoadRFSignalGenerator(int version, const YAML::Node& node, bool
 
 		else
 		{
-			//Create the PSU
+			//Create the BERT
 			auto transport = CreateTransportForNode(node);
 
 			if(transport && transport->IsConnected())
 			{
-				gen = SCPIRFSignalGenerator::CreateRFSignalGenerator(driver, transport);
-				if(!VerifyInstrument(node, gen))
-					gen = nullptr;
+				bert = dynamic_pointer_cast<SCPIBERT>(CreateInstrumentForNode(node, "bert", transport));
+				if(!VerifyInstrument(node, bert))
+					bert = nullptr;
 			}
 
 			else
@@ -1746,13 +2858,13 @@ bool Session::PreLoadRFSignalGenerator(int version, const YAML::Node& node, bool
 
 				m_mainWindow->ShowErrorPopup(
 					"Unable to reconnect",
-					string("Failed to reconnect to RF signal generator at ") + node["args"].as<string>() + ".\n\n"
+					string("Failed to reconnect to BERT at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
 			}
 		}
 	}
 
-	if(!gen)
+	if(!bert)
 	{
 		/*
 		//Create the mock scope
@@ -1765,34 +2877,34 @@ bool Session::PreLoadRFSignalGenerator(int version, const YAML::Node& node, bool
 			node["args"].as<string>()
 			);
 		*/
-		LogError("offline loading of RF generators not implemented yet\n");
+		LogError("offline loading of BERTs not implemented yet\n");
 		return true;
 	}
 
 	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(gen);
+	//ApplyPreferences(bert);
 
-	//All good. Add to our list of generators etc
-	AddInstrument(gen);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)gen.get());
+	//All good. Add to our list of berts etc
+	AddInstrument(bert, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)bert.get());
 
 	//Run the preload
-	gen->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	bert->PreLoadConfiguration(version, node, m_idtable, m_warnings);
 
 	return true;
 }
 
-bool Session::PreLoadFunctionGenerator(int version, const YAML::Node& node, bool online)
+bool Session::PreLoadSDR(int version, const YAML::Node& node, bool online)
 {
 	//Create the instrument
-	shared_ptr<SCPIFunctionGenerator> gen = nullptr;
+	shared_ptr<SCPISDR> sdr = nullptr;
 
 	auto transtype = node["transport"].as<string>();
 	auto driver = node["driver"].as<string>();
 
 	if(online)
 	{
-		if(transtype == "null")
+		if( (transtype == "null") && (driver != "demospec") )
 		{
 			m_mainWindow->ShowErrorPopup(
 				"Unable to reconnect",
@@ -1807,9 +2919,9 @@ bool Session::PreLoadFunctionGenerator(int version, const YAML::Node& node, bool
 
 			if(transport && transport->IsConnected())
 			{
-				gen = SCPIFunctionGenerator::CreateFunctionGenerator(driver, transport);
-				if(!VerifyInstrument(node, gen))
-					gen = nullptr;
+				sdr = dynamic_pointer_cast<SCPISDR>(CreateInstrumentForNode(node, "sdr", transport));
+				if(!VerifyInstrument(node, sdr))
+					sdr = nullptr;
 			}
 
 			else
@@ -1818,13 +2930,13 @@ bool Session::PreLoadFunctionGenerator(int version, const YAML::Node& node, bool
 
 				m_mainWindow->ShowErrorPopup(
 					"Unable to reconnect",
-					string("Failed to reconnect to function generator at ") + node["args"].as<string>() + ".\n\n"
+					string("Failed to reconnect to SDR at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
 			}
 		}
 	}
 
-	if(!gen)
+	if(!sdr)
 	{
 		/*
 		//Create the mock scope
@@ -1837,1590 +2949,5467 @@ bool Session::PreLoadFunctionGenerator(int version, const YAML::Node& node, bool
 			node["args"].as<string>()
 			);
 		*/
-		LogError("offline loading of function generators not implemented yet\n");
+		LogError("offline loading of SDRs not implemented yet\n");
 		return true;
 	}
 
 	//Make any config settings to the instrument from our preference settings
-	//ApplyPreferences(gen);
+	//ApplyPreferences(sdr);
 
-	//All good. Add to our list of generators etc
-	AddInstrument(gen);
-	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)gen.get());
+	//All good. Add to our list of specs etc
+	AddInstrument(sdr, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)sdr.get());
 
 	//Run the preload
-	gen->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+	sdr->PreLoadConfiguration(version, node, m_idtable, m_warnings);
 
 	return true;
 }
 
-bool Session::LoadTriggerGroups(const YAML::Node& node)
+bool Session::PreLoadSpectrometer(int version, const YAML::Node& node, bool online)
 {
-	//No trigger groups node? Older session file, use default config (one group per scope)
-	if(!node)
-		return true;
-
-	LogTrace("Loading trigger groups\n");
-
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
+	//Create the instrument
+	shared_ptr<SCPISpectrometer> spec = nullptr;
 
-	//Clear out any existing trigger groups
-	m_triggerGroups.clear();
+	auto transtype = node["transport"].as<string>();
+	auto driver = node["driver"].as<string>();
 
-	for(auto it : node)
+	if(online)
 	{
-		auto gnode = it.second;
-
-		LogTrace("Loading trigger group %s\n", it.first.as<string>().c_str());
+		if( (transtype == "null") && (driver != "demospec") )
+		{
+			m_mainWindow->ShowErrorPopup(
+				"Unable to reconnect",
+				"The session file does not contain any connection information.\n\n"
+				"Loading in offline mode.");
+		}
 
-		//Load scopes
-		auto pri = gnode["primary"];
-		shared_ptr<TriggerGroup> group;
-		if(pri)
+		else
 		{
-			auto inst = reinterpret_cast<Instrument*>(m_idtable[pri.as<int64_t>()]);
-			auto sscope = dynamic_pointer_cast<Oscilloscope>(inst->shared_from_this());
-			group = make_shared<TriggerGroup>(sscope, this);
+			//Create the PSU
+			auto transport = CreateTransportForNode(node);
 
-			//Add secondaries
-			auto snode = gnode["secondaries"];
-			for(auto jt : snode)
+			if(transport && transport->IsConnected())
 			{
-				inst = reinterpret_cast<Instrument*>(m_idtable[jt.second.as<int64_t>()]);
-				sscope = dynamic_pointer_cast<Oscilloscope>(inst->shared_from_this());
-				group->m_secondaries.push_back(sscope);
+				spec = dynamic_pointer_cast<SCPISpectrometer>(CreateInstrumentForNode(node, "spectrometer", transport));
+				if(!VerifyInstrument(node, spec))
+					spec = nullptr;
 			}
-		}
 
-		//Load filters
-		auto filters = gnode["filters"];
-		if(filters)
-		{
-			if(!group)
-				group = make_shared<TriggerGroup>(nullptr, this);
+			else
+			{
+				delete transport;
 
-			for(auto fid : filters)
-				group->m_filters.push_back(reinterpret_cast<PausableFilter*>(m_idtable[fid.as<int64_t>()]));
+				m_mainWindow->ShowErrorPopup(
+					"Unable to reconnect",
+					string("Failed to reconnect to spectrometer at ") + node["args"].as<string>() + ".\n\n"
+					"Loading this instrument in offline mode.");
+			}
 		}
+	}
 
-		m_triggerGroups.push_back(group);
+	if(!spec)
+	{
+		/*
+		//Create the mock scope
+		scope = new MockOscilloscope(
+			node["name"].as<string>(),
+			node["vendor"].as<string>(),
+			node["serial"].as<string>(),
+			transtype,
+			driver,
+			node["args"].as<string>()
+			);
+		*/
+		LogError("offline loading of spectrometers not implemented yet\n");
+		return true;
+	}
 
-		//See if it's default enabled
-		auto dnode = gnode["default"];
-		if(dnode)
-			group->m_default = dnode.as<bool>();
+	//Make any config settings to the instrument from our preference settings
+	//ApplyPreferences(spec);
 
-		//Older file without the default flag
-		//Make all non-filter groups default
-		else
-			group->m_default = group->HasScopes();
-	}
+	//All good. Add to our list of specs etc
+	AddInstrument(spec, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)spec.get());
 
-	//Check all pausable filters and see if they are in a group
-	//(if not, add them to one)
-	auto filters = Filter::GetAllInstances();
-	for(auto f : filters)
+	//Run the preload
+	spec->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+
+	return true;
+}
+
+bool Session::PreLoadMultimeter(int version, const YAML::Node& node, bool online)
+{
+	//Create the instrument
+	shared_ptr<SCPIMultimeter> meter = nullptr;
+
+	auto transtype = node["transport"].as<string>();
+	auto driver = node["driver"].as<string>();
+
+	if(online)
 	{
-		//Skip if not a pausable filter, or not in the group
-		auto pf = dynamic_cast<PausableFilter*>(f);
-		if(!pf)
-			continue;
-		if(GetTriggerGroupForFilter(pf))
-			continue;
+		if( (transtype == "null") && (driver != "demometer") )
+		{
+			m_mainWindow->ShowErrorPopup(
+				"Unable to reconnect",
+				"The session file does not contain any connection information.\n\n"
+				"Loading in offline mode.");
+		}
 
-		//If we get here we have an orphaned filter not in a group
-		//Add the filter to the trend group by default
-		GetTrendFilterGroup()->AddFilter(pf);
+		else
+		{
+			//Create the PSU
+			auto transport = CreateTransportForNode(node);
+
+			if(transport && transport->IsConnected())
+			{
+				meter = dynamic_pointer_cast<SCPIMultimeter>(CreateInstrumentForNode(node, "multimeter", transport));
+				if(!VerifyInstrument(node, meter))
+					meter = nullptr;
+			}
+
+			else
+			{
+				delete transport;
+
+				m_mainWindow->ShowErrorPopup(
+					"Unable to reconnect",
+					string("Failed to reconnect to multimeter at ") + node["args"].as<string>() + ".\n\n"
+					"Loading this instrument in offline mode.");
+			}
+		}
+	}
+
+	if(!meter)
+	{
+		/*
+		//Create the mock scope
+		scope = new MockOscilloscope(
+			node["name"].as<string>(),
+			node["vendor"].as<string>(),
+			node["serial"].as<string>(),
+			transtype,
+			driver,
+			node["args"].as<string>()
+			);
+		*/
+		LogError("offline loading of multimeters not implemented yet\n");
+		return true;
+	}
+
+	//Make any config settings to the instrument from our preference settings
+	//ApplyPreferences(meter);
+
+	//All good. Add to our list of meters etc
+	AddInstrument(meter, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)meter.get());
+
+	//Run the preload
+	meter->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+
+	return true;
+}
+
+bool Session::PreLoadPowerSupply(int version, const YAML::Node& node, bool online)
+{
+	//Create the instrument
+	shared_ptr<SCPIPowerSupply> psu = nullptr;
+
+	auto transtype = node["transport"].as<string>();
+	auto driver = node["driver"].as<string>();
+
+	if(online)
+	{
+		if( (transtype == "null") && (driver != "demopsu") )
+		{
+			m_mainWindow->ShowErrorPopup(
+				"Unable to reconnect",
+				"The session file does not contain any connection information.\n\n"
+				"Loading in offline mode.");
+		}
+
+		else
+		{
+			//Create the PSU
+			auto transport = CreateTransportForNode(node);
+
+			if(transport && transport->IsConnected())
+			{
+				psu = dynamic_pointer_cast<SCPIPowerSupply>(CreateInstrumentForNode(node, "psu", transport));
+				if(!VerifyInstrument(node, psu))
+					psu = nullptr;
+			}
+
+			else
+			{
+				delete transport;
+
+				m_mainWindow->ShowErrorPopup(
+					"Unable to reconnect",
+					string("Failed to reconnect to power supply at ") + node["args"].as<string>() + ".\n\n"
+					"Loading this instrument in offline mode.");
+			}
+		}
+	}
+
+	if(!psu)
+	{
+		/*
+		//Create the mock scope
+		scope = new MockOscilloscope(
+			node["name"].as<string>(),
+			node["vendor"].as<string>(),
+			node["serial"].as<string>(),
+			transtype,
+			driver,
+			node["args"].as<string>()
+			);
+		*/
+		LogError("offline loading of power supplies not implemented yet\n");
+		return true;
+	}
+
+	//Make any config settings to the instrument from our preference settings
+	//ApplyPreferences(psu);
+
+	//All good. Add to our list of scopes etc
+	AddInstrument(psu, false);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)psu.get());
+
+	//Run the preload
+	psu->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+
+	return true;
+}
+
+bool Session::PreLoadRFSignalGenerator(int version, const YAML::Node& node, bool online)
+{
+	//Create the instrument
+	shared_ptr<SCPIRFSignalGenerator> gen = nullptr;
+
+	auto transtype = node["transport"].as<string>();
+	auto driver = node["driver"].as<string>();
+
+	if(online)
+	{
+		if(transtype == "null")
+		{
+			m_mainWindow->ShowErrorPopup(
+				"Unable to reconnect",
+				"The session file does not contain any connection information.\n\n"
+				"Loading in offline mode.");
+		}
+
+		else
+		{
+			//Create the PSU
+			auto transport = CreateTransportForNode(node);
+
+			if(transport && transport->IsConnected())
+			{
+				gen = dynamic_pointer_cast<SCPIRFSignalGenerator>(CreateInstrumentForNode(node, "rfgen", transport));
+				if(!VerifyInstrument(node, gen))
+					gen = nullptr;
+			}
+
+			else
+			{
+				delete transport;
+
+				m_mainWindow->ShowErrorPopup(
+					"Unable to reconnect",
+					string("Failed to reconnect to RF signal generator at ") + node["args"].as<string>() + ".\n\n"
+					"Loading this instrument in offline mode.");
+			}
+		}
+	}
+
+	if(!gen)
+	{
+		/*
+		//Create the mock scope
+		scope = new MockOscilloscope(
+			node["name"].as<string>(),
+			node["vendor"].as<string>(),
+			node["serial"].as<string>(),
+			transtype,
+			driver,
+			node["args"].as<string>()
+			);
+		*/
+		LogError("offline loading of RF generators not implemented yet\n");
+		return true;
+	}
+
+	//Make any config settings to the instrument from our preference settings
+	//ApplyPreferences(gen);
+
+	//All good. Add to our list of generators etc
+	AddInstrument(gen);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)gen.get());
+
+	//Run the preload
+	gen->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+
+	return true;
+}
+
+bool Session::PreLoadFunctionGenerator(int version, const YAML::Node& node, bool online)
+{
+	//Create the instrument
+	shared_ptr<SCPIFunctionGenerator> gen = nullptr;
+
+	auto transtype = node["transport"].as<string>();
+	auto driver = node["driver"].as<string>();
+
+	if(online)
+	{
+		if(transtype == "null")
+		{
+			m_mainWindow->ShowErrorPopup(
+				"Unable to reconnect",
+				"The session file does not contain any connection information.\n\n"
+				"Loading in offline mode.");
+		}
+
+		else
+		{
+			//Create the PSU
+			auto transport = CreateTransportForNode(node);
+
+			if(transport && transport->IsConnected())
+			{
+				gen = dynamic_pointer_cast<SCPIFunctionGenerator>(CreateInstrumentForNode(node, "funcgen", transport));
+				if(!VerifyInstrument(node, gen))
+					gen = nullptr;
+			}
+
+			else
+			{
+				delete transport;
+
+				m_mainWindow->ShowErrorPopup(
+					"Unable to reconnect",
+					string("Failed to reconnect to function generator at ") + node["args"].as<string>() + ".\n\n"
+					"Loading this instrument in offline mode.");
+			}
+		}
+	}
+
+	if(!gen)
+	{
+		/*
+		//Create the mock scope
+		scope = new MockOscilloscope(
+			node["name"].as<string>(),
+			node["vendor"].as<string>(),
+			node["serial"].as<string>(),
+			transtype,
+			driver,
+			node["args"].as<string>()
+			);
+		*/
+		LogError("offline loading of function generators not implemented yet\n");
+		return true;
+	}
+
+	//Make any config settings to the instrument from our preference settings
+	//ApplyPreferences(gen);
+
+	//All good. Add to our list of generators etc
+	AddInstrument(gen);
+	m_idtable.emplace(node["id"].as<uintptr_t>(), (Instrument*)gen.get());
+
+	//Run the preload
+	gen->PreLoadConfiguration(version, node, m_idtable, m_warnings);
+
+	return true;
+}
+
+bool Session::LoadTriggerGroups(const YAML::Node& node)
+{
+	//No trigger groups node? Older session file, use default config (one group per scope)
+	if(!node)
+		return true;
+
+	LogTrace("Loading trigger groups\n");
+
+	lock_guard lock(m_triggerGroupMutex);
+
+	//Clear out any existing trigger groups
+	m_triggerGroups.clear();
+
+	for(auto it : node)
+	{
+		auto gnode = it.second;
+
+		LogTrace("Loading trigger group %s\n", it.first.as<string>().c_str());
+
+		//Load scopes
+		auto pri = gnode["primary"];
+		shared_ptr<TriggerGroup> group;
+		if(pri)
+		{
+			auto inst = reinterpret_cast<Instrument*>(m_idtable[pri.as<int64_t>()]);
+			auto sscope = dynamic_pointer_cast<Oscilloscope>(inst->shared_from_this());
+			group = make_shared<TriggerGroup>(sscope, this);
+
+			//Add secondaries
+			auto snode = gnode["secondaries"];
+			for(auto jt : snode)
+			{
+				inst = reinterpret_cast<Instrument*>(m_idtable[jt.second.as<int64_t>()]);
+				sscope = dynamic_pointer_cast<Oscilloscope>(inst->shared_from_this());
+				group->m_secondaries.push_back(sscope);
+			}
+		}
+
+		//Load filters
+		auto filters = gnode["filters"];
+		if(filters)
+		{
+			if(!group)
+				group = make_shared<TriggerGroup>(nullptr, this);
+
+			for(auto fid : filters)
+				group->m_filters.push_back(reinterpret_cast<PausableFilter*>(m_idtable[fid.as<int64_t>()]));
+		}
+
+		m_triggerGroups.push_back(group);
+
+		//See if it's default enabled
+		auto dnode = gnode["default"];
+		if(dnode)
+			group->m_default = dnode.as<bool>();
+
+		//Older file without the default flag
+		//Make all non-filter groups default
+		else
+			group->m_default = group->HasScopes();
+	}
+
+	//Check all pausable filters and see if they are in a group
+	//(if not, add them to one)
+	auto filters = Filter::GetAllInstances();
+	for(auto f : filters)
+	{
+		//Skip if not a pausable filter, or not in the group
+		auto pf = dynamic_cast<PausableFilter*>(f);
+		if(!pf)
+			continue;
+		if(GetTriggerGroupForFilter(pf))
+			continue;
+
+		//If we get here we have an orphaned filter not in a group
+		//Add the filter to the trend group by default
+		GetTrendFilterGroup()->AddFilter(pf);
+	}
+
+	return true;
+}
+
+shared_ptr<TriggerGroup> Session::GetTrendFilterGroup()
+{
+	//Make sure the group is only trend filters (if it exists)
+	if(m_trendTriggerGroup != nullptr)
+	{
+		if(m_trendTriggerGroup->HasScopes())
+			m_trendTriggerGroup = nullptr;
+		else
+			return m_trendTriggerGroup;
+	}
+
+	//See if there is an existing filter-only group we can claim as the trend group
+	else
+	{
+		lock_guard lock(m_triggerGroupMutex);
+		for(auto g : m_triggerGroups)
+		{
+			if(!g->HasScopes() && !g->empty())
+			{
+				m_trendTriggerGroup = g;
+				return m_trendTriggerGroup;
+			}
+		}
+	}
+
+	//We don't have a group yet, make it
+	lock_guard lock(m_triggerGroupMutex);
+	m_trendTriggerGroup = make_shared<TriggerGroup>(nullptr, this);
+	m_trendTriggerGroup->m_default = false;
+	m_triggerGroups.push_back(m_trendTriggerGroup);
+
+	LogTrace("Making trend filter group\n");
+
+	return m_trendTriggerGroup;
+}
+
+bool Session::LoadFilters(int /*version*/, const YAML::Node& node)
+{
+	//No protocol decodes? Skip this section
+	if(!node)
+		return true;
+
+	//Load each decode
+	for(auto it : node)
+	{
+		auto dnode = it.second;
+
+		//Create the decode
+		auto proto = dnode["protocol"].as<string>();
+		auto filter = Filter::CreateFilter(proto, dnode["color"].as<string>());
+		if(filter == NULL)
+		{
+			m_mainWindow->ShowErrorPopup(
+				"Filter creation failed",
+				string("Unable to create filter \"") + proto + "\". Skipping...\n");
+			continue;
+		}
+
+		m_idtable.emplace(dnode["id"].as<uintptr_t>(), filter);
+
+		//Load parameters during the first pass.
+		//Parameters can't have dependencies on other channels etc.
+		//More importantly, parameters may change bus width etc
+		filter->LoadParameters(dnode, m_idtable);
+		if(dnode["always_run"] && dnode["always_run"].as<bool>())
+			SetFilterAlwaysRun(filter, true);
+		if(dnode["refresh_policy"])
+		{
+			FilterRefreshPolicy policy;
+			policy.Load(dnode["refresh_policy"]);
+			SetFilterRefreshPolicy(filter, policy);
+		}
+
+		//Create protocol analyzers
+		auto pd = dynamic_cast<PacketDecoder*>(filter);
+		if(pd)
+			AddPacketFilter(pd);
+
+		//Resize eye patterns to a reasonable default size
+		//TODO: ngscopeclient should save actual size
+		auto eye = dynamic_cast<EyePattern*>(filter);
+		if(eye)
+		{
+			eye->SetWidth(512);
+			eye->SetHeight(512);
+		}
+	}
+
+	//Make a second pass to configure the filter inputs, once all of them have been instantiated.
+	//Filters may depend on other filters as inputs, and serialization is not guaranteed to be a topological sort.
+	for(auto it : node)
+	{
+		auto dnode = it.second;
+		auto filter = static_cast<Filter*>(m_idtable[dnode["id"].as<uintptr_t>()]);
+		if(filter)
+			filter->LoadInputs(dnode, m_idtable);
+	}
+
+	return true;
+}
+
+bool Session::LoadInstrumentInputs(int /*version*/, const YAML::Node& node)
+{
+	//Nothing to do? Skip this section
+	if(!node)
+		return true;
+
+	//Check each instrument in the file and see if we have inputs that need to be hooked up
+	//Load each instrument
+	for(auto it : node)
+	{
+		auto inst = it.second;
+		auto nick = inst["nick"].as<string>();
+		LogTrace("Loading additional inputs for instrument \"%s\"\n", nick.c_str());
+
+		auto pinst = reinterpret_cast<Instrument*>(m_idtable[inst["id"].as<uintptr_t>()]);
+		if(!pinst)
+			continue;
+
+		for(size_t i=0; i<pinst->GetChannelCount(); i++)
+		{
+			auto chan = pinst->GetChannel(i);
+			auto key = "ch" + to_string(i);
+			auto channelNode = inst["channels"][key];
+
+			if(channelNode)
+				chan->LoadInputs(channelNode, m_idtable);
+		}
+	}
+
+	return true;
+}
+
+/**
+	@brief Serialize the configuration for all oscilloscopes
+ */
+YAML::Node Session::SerializeInstrumentConfiguration()
+{
+	YAML::Node node;
+
+	auto snapshot = GetInstrumentSnapshot();
+	for(auto inst : snapshot->m_instruments)
+	{
+		auto config = inst->SerializeConfiguration(m_idtable);
+		auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
+		if(scope)
+		{
+			{
+				lock_guard<mutex> lock(m_deskewMutex);
+				auto dit = m_scopeDeskewCal.find(scope);
+				if(dit != m_scopeDeskewCal.end())
+					config["triggerdeskew"] = dit->second;
+			}
+
+			auto it = m_instrumentStates.find(scope);
+			if( (it != m_instrumentStates.end()) && it->second)
+			{
+				auto state = it->second;
+				config["queuelimit"]["mode"] = state->m_queueLimitByMemory ? "memory" : "count";
+				config["queuelimit"]["count"] = state->m_queueLimitCount.load();
+				config["queuelimit"]["bytes"] = state->m_queueLimitBytes.load();
+			}
+
+			//Channels consume-driven acquisition turned off are only off until something uses them, so save them
+			//as they were before we touched them
+			for(size_t i=0; i<scope->GetChannelCount(); i++)
+			{
+				auto chnode = config["channels"]["ch" + to_string(i)];
+				if(chnode && chnode["enabled"] && IsChannelAutoDisabled(scope->GetOscilloscopeChannel(i)))
+					chnode["enabled"] = true;
+			}
+		}
+		node["inst" + config["id"].as<string>()] = config;
+	}
+
+	return node;
+}
+
+/**
+	@brief Serialize the configuration for all protocol decoders
+ */
+YAML::Node Session::SerializeFilterConfiguration()
+{
+	YAML::Node node;
+
+	auto set = Filter::GetAllInstances();
+	for(auto d : set)
+	{
+		YAML::Node filterNode = d->SerializeConfiguration(m_idtable);
+		if(IsFilterAlwaysRun(d))
+			filterNode["always_run"] = true;
+		auto policy = GetFilterRefreshPolicy(d);
+		if(!policy.IsDefault())
+			filterNode["refresh_policy"] = policy.Serialize();
+		node["filter" + filterNode["id"].as<string>()] = filterNode;
+	}
+
+	return node;
+}
+
+/**
+	@brief Serializes metadata about the session / software stack
+
+	Not currently used for anything, but might be helpful for troubleshooting etc in the future
+ */
+YAML::Node Session::SerializeMetadata()
+{
+	YAML::Node node;
+	node["appver"] = "ngscopeclient " NGSCOPECLIENT_VERSION;
+	node["appdate"] = __DATE__ " " __TIME__;
+
+	//Format timestamp
+	time_t now = time(nullptr);
+	struct tm ltime;
+#ifdef _WIN32
+	localtime_s(&ltime, &now);
+#else
+	localtime_r(&now, &ltime);
+#endif
+	char sdate[32];
+	char stime[32];
+	strftime(stime, sizeof(stime), "%X", &ltime);
+	strftime(sdate, sizeof(sdate), "%Y-%m-%d", &ltime);
+	node["created"] = string(sdate) + " " + string(stime);
+
+	return node;
+}
+
+YAML::Node Session::SerializeTriggerGroups()
+{
+	YAML::Node node;
+
+	lock_guard lock(m_triggerGroupMutex);
+	LogTrace("Serializing trigger groups (%zu total)\n", m_triggerGroups.size());
+	LogIndenter li;
+	for(auto group : m_triggerGroups)
+	{
+		auto gid = m_idtable.emplace(group.get());
+
+		//Make a node for the group
+		YAML::Node gnode;
+
+		//Primary
+		if(group->m_primary)
+			gnode["primary"] = m_idtable[(Instrument*)group->m_primary.get()];
+
+		//Secondaries
+		YAML::Node secnode;
+		for(size_t i=0; i<group->m_secondaries.size(); i++)
+			secnode[string("sec") + to_string(i)] = m_idtable[(Instrument*)group->m_secondaries[i].get()];
+		gnode["secondaries"] = secnode;
+
+		//Filters
+		YAML::Node fnode;
+		for(size_t i=0; i<group->m_filters.size(); i++)
+			fnode.push_back(m_idtable[group->m_filters[i]]);
+		gnode["filters"] = fnode;
+
+		node[string("group") + to_string(gid)] = gnode;
+
+		gnode["default"] = group->m_default;
+	}
+
+	return node;
+}
+
+YAML::Node Session::SerializeMarkers()
+{
+	YAML::Node node;
+
+	int nmarker = 0;
+	int nwfm = 0;
+	for(auto key : GetMarkerTimes())
+	{
+		auto& markers = m_markers[key];
+		if(markers.empty())
+			continue;
+
+		YAML::Node markerNode;
+		YAML::Node wfmNode;
+		wfmNode["timestamp"] = key.first;
+		wfmNode["time_fsec"] = key.second;
+
+		for(auto m : markers)
+		{
+			YAML::Node wfmMarkerNode;
+			wfmMarkerNode["offset"] = m.m_offset;
+			wfmMarkerNode["name"] = m.m_name;
+			wfmNode["markers"]["marker" + to_string(nmarker)] = wfmMarkerNode;
+
+			nmarker ++;
+		}
+
+		node["wfm" + to_string(nwfm)] = wfmNode;
+
+		nwfm ++;
+	}
+
+	return node;
+}
+
+/**
+	@brief Gets the number of bytes a waveform will take up on disk, for progress reporting
+ */
+static size_t GetSerializedSize(WaveformBase* wfm)
+{
+	size_t len = wfm->size();
+	size_t bytes = 0;
+	if(dynamic_cast<SparseWaveformBase*>(wfm) != nullptr)
+		bytes += 2*sizeof(int64_t);
+
+	if( (dynamic_cast<SparseAnalogWaveform*>(wfm) != nullptr) || (dynamic_cast<UniformAnalogWaveform*>(wfm) != nullptr) )
+		bytes += sizeof(float);
+	else if(dynamic_cast<CANWaveform*>(wfm) != nullptr)
+		bytes += 2*sizeof(uint32_t);
+	else
+		bytes += sizeof(bool);
+
+	return len * bytes;
+}
+
+/**
+	@brief Finds codes which represent every sample of a waveform exactly, if it's all on a grid of ADC levels
+
+	@param pool		Thread pool to scan the waveform with
+	@param wfm		The waveform
+	@param maxcode	Highest code the selected width can hold
+	@param gain		Set to the size of one code
+	@param offset	Set to the value of code zero
+
+	@return False if the samples aren't all on a grid of at most maxcode+1 levels (e.g. filter outputs, averaged
+			or interpolated data), so quantizing would lose information
+ */
+static bool FindLosslessScale(TaskPool& pool, UniformAnalogWaveform* wfm, double maxcode, double& gain, double& offset)
+{
+	gain = 1;
+	offset = 0;
+	size_t len = wfm->size();
+	if(len == 0)
+		return true;
+
+	float vmin;
+	float step;
+	size_t levels;
+	if(!HistoryCompactor::FindGrid(pool, wfm, vmin, step, levels) || (levels > maxcode + 1) )
+		return false;
+	gain = step;
+	offset = vmin;
+
+	//Same tolerance as history compaction: anything further from its level than this isn't ADC data
+	float tolerance = step * 0.01f;
+	float* samples = wfm->m_samples.GetCpuPointer();
+	int64_t nblocks = (len + DENSEV2_BLOCK_SIZE - 1) / DENSEV2_BLOCK_SIZE;
+	atomic<bool> ok(true);
+	pool.ParallelFor(0, nblocks, 1, [&](int64_t block)
+	{
+		size_t start = block * DENSEV2_BLOCK_SIZE;
+		size_t end = min(len, start + DENSEV2_BLOCK_SIZE);
+		for(size_t i=start; (i<end) && ok; i++)
+		{
+			double code = round( (samples[i] - offset) / gain );
+			if( (code > maxcode) || !(fabs(code*gain + offset - samples[i]) <= tolerance) )
+				ok = false;
+		}
+	});
+	return ok;
+}
+
+/**
+	@brief Finds codes spanning a channel's full scale range, extended as needed to cover every sample
+
+	This is lossy if the waveform has more resolution than the codes. Non-finite samples are ignored.
+
+	@param wfm		The waveform
+	@param chan		Channel the waveform belongs to
+	@param stream	Stream index within the channel
+	@param maxcode	Highest code the selected width can hold
+	@param gain		Set to the size of one code
+	@param offset	Set to the value of code zero
+ */
+static void FindLossyScale(
+	UniformAnalogWaveform* wfm,
+	OscilloscopeChannel* chan,
+	size_t stream,
+	double maxcode,
+	double& gain,
+	double& offset)
+{
+	//This is the current range, which may not be what it was when the waveform was captured.
+	//That's OK because the code range is extended to cover every sample.
+	float range = chan->GetVoltageRange(stream);
+	float center = -chan->GetOffset(stream);
+	float vmin = center - range/2;
+	float vmax = center + range/2;
+	if(!(range > 0))
+	{
+		vmin = FLT_MAX;
+		vmax = -FLT_MAX;
+	}
+
+	size_t len = wfm->size();
+	float* samples = wfm->m_samples.GetCpuPointer();
+	for(size_t i=0; i<len; i++)
+	{
+		float v = samples[i];
+		if(!isfinite(v))
+			continue;
+		vmin = min(vmin, v);
+		vmax = max(vmax, v);
+	}
+	if(vmin > vmax)
+	{
+		vmin = 0;
+		vmax = 0;
+	}
+
+	offset = vmin;
+	gain = (vmax > vmin) ? (double(vmax) - vmin) / maxcode : 1;
+}
+
+/**
+	@brief Sets the on-disk format of a dense waveform, enabling quantization or bit packing if requested
+
+	Unless lossy compression is allowed, analog waveforms are only quantized if every sample is on a grid of ADC
+	codes which fits in the requested width. Anything else is saved as floating point.
+
+	Must be called from the GUI thread, since the waveform may have to be moved to the CPU.
+
+	@param pool			Thread pool to scan the waveform with
+	@param job			Save job for the waveform
+	@param chnode		Metadata node for the waveform
+	@param chan			Channel the waveform belongs to (used to find the full scale range)
+	@param stream		Stream index within the channel
+	@param mode			Requested compression mode for analog waveforms
+	@param lossy		True to quantize analog waveforms even if that loses resolution
+	@param packDigital	True to store digital waveforms one bit per sample
+ */
+static void ConfigureDenseCompression(
+	TaskPool& pool,
+	WaveformSaveJob& job,
+	YAML::Node& chnode,
+	OscilloscopeChannel* chan,
+	size_t stream,
+	DenseCompression mode,
+	bool lossy,
+	bool packDigital)
+{
+	if(packDigital && (dynamic_cast<UniformDigitalWaveform*>(job.m_wfm) != nullptr) )
+	{
+		chnode["format"] = "densebits";
+		job.m_packBits = true;
+		job.m_bytes = sizeof(DenseBitsHeader) + (job.m_wfm->size() + 7) / 8;
+		return;
+	}
+
+	auto awfm = dynamic_cast<UniformAnalogWaveform*>(job.m_wfm);
+	if( (mode == COMPRESS_DENSE_NONE) || (awfm == nullptr) )
+	{
+		chnode["format"] = "densev1";
+		return;
+	}
+
+	double maxcode = (mode == COMPRESS_DENSE_8_BITS) ? UINT8_MAX : UINT16_MAX;
+	awfm->PrepareForCpuAccess();
+	if(lossy)
+		FindLossyScale(awfm, chan, stream, maxcode, job.m_codeGain, job.m_codeOffset);
+	else if(!FindLosslessScale(pool, awfm, maxcode, job.m_codeGain, job.m_codeOffset))
+	{
+		LogTrace("%s stream %zu isn't on a grid of ADC codes, saving as float\n",
+			chan->GetDisplayName().c_str(), stream);
+		chnode["format"] = "densev1";
+		return;
+	}
+	job.m_compression = mode;
+
+	chnode["format"] = "densev2";
+	if(mode == COMPRESS_DENSE_8_BITS)
+	{
+		chnode["codec"] = "int8";
+		job.m_bytes = sizeof(DenseV2Header) + job.m_wfm->size() * sizeof(uint8_t);
+	}
+	else
+	{
+		chnode["codec"] = "int16";
+		job.m_bytes = sizeof(DenseV2Header) + job.m_wfm->size() * sizeof(uint16_t);
+	}
+}
+
+/**
+	@brief Formats the YAML metadata for a history point which has already been saved, from its stored metadata
+ */
+static YAML::Node SerializeSavedWaveformMetadata(const SavedWaveformMetadata& meta)
+{
+	YAML::Node mnode;
+	mnode["timestamp"] = meta.m_time.first;
+	mnode["time_fsec"] = meta.m_time.second;
+	mnode["id"] = meta.m_id;
+	mnode["pinned"] = meta.m_pinned;
+	mnode["label"] = meta.m_label;
+
+	for(auto& smeta : meta.m_streams)
+	{
+		YAML::Node chnode;
+		chnode["index"] = smeta.m_channel;
+		chnode["stream"] = smeta.m_stream;
+		chnode["timescale"] = smeta.m_timescale;
+		chnode["trigphase"] = smeta.m_triggerPhase;
+		chnode["format"] = smeta.m_format;
+		if(!smeta.m_datatype.empty())
+			chnode["datatype"] = smeta.m_datatype;
+
+		mnode["channels"][string("ch") + to_string(smeta.m_channel) + "s" + to_string(smeta.m_stream)] = chnode;
+	}
+
+	return mnode;
+}
+
+/**
+	@brief Writes a scope's metadata file, and the binary index beside it, from saved metadata
+
+	@param yamlPath		Path to the scope_N_metadata.yml file
+	@param waveforms	Metadata for every history point in the file
+ */
+bool Session::WriteWaveformMetadata(const string& yamlPath, const vector<SavedWaveformMetadata>& waveforms)
+{
+	YAML::Node node;
+	for(auto& meta : waveforms)
+		node["waveforms"][string("wfm") + to_string(meta.m_id)] = SerializeSavedWaveformMetadata(meta);
+
+	ofstream outfs(yamlPath);
+	if(!outfs)
+		return false;
+	outfs << node;
+	outfs.close();
+	if(!outfs)
+		return false;
+
+	//The index is only an accelerator for loading, so the session is still usable without it
+	string base = yamlPath.substr(0, yamlPath.length() - strlen("_metadata.yml"));
+	if(!WriteWaveformIndex(base + "_index.bin", yamlPath, waveforms))
+		LogWarning("Failed to write waveform index %s_index.bin\n", base.c_str());
+
+	return true;
+}
+
+/**
+	@brief Starts streaming every new acquisition to a data directory, as well as adding it to history
+
+	The directory must already exist. Any recording already in progress is stopped first.
+
+	@param dataDir	Path to the data directory
+ */
+void Session::StartRecording(const string& dataDir)
+{
+	StopRecording();
+
+	size_t queueLimit = m_preferences.GetReal("Files.record_queue_size");
+	bool drop = (m_preferences.GetEnum<RecordOverflow>("Files.record_overflow") == RECORD_OVERFLOW_DROP);
+
+	LogNotice("Recording new waveforms to %s\n", dataDir.c_str());
+	m_recorder = make_shared<WaveformRecorder>(this, dataDir, queueLimit, drop);
+}
+
+/**
+	@brief Writes out any acquisitions still waiting to be recorded, then stops recording
+
+	Must be called from the GUI thread.
+ */
+void Session::StopRecording()
+{
+	if(!m_recorder)
+		return;
+
+	m_recorder->Stop();
+	m_recorder = nullptr;
+}
+
+/**
+	@brief Starts logging readings from power supplies, multimeters, and loads to disk
+
+	Any log already in progress is closed first.
+
+	@param logPath	Path to the .datalog file
+
+	@return True if the log was created successfully
+ */
+bool Session::StartDataLogging(const string& logPath)
+{
+	StopDataLogging();
+
+	auto logger = make_shared<DataLogger>(logPath);
+	if(!logger->IsOpen())
+		return false;
+
+	atomic_store(&m_dataLogger, logger);
+	return true;
+}
+
+/**
+	@brief Writes out any readings still queued, then closes the data log
+ */
+void Session::StopDataLogging()
+{
+	auto logger = atomic_exchange(&m_dataLogger, shared_ptr<DataLogger>());
+	if(logger)
+		logger->Stop();
+}
+
+/**
+	@brief Starts or stops the remote viewer server to match the preferences
+
+	Must be called from the GUI thread.
+ */
+void Session::UpdateViewerServer()
+{
+	bool enabled = m_preferences.GetBool("Miscellaneous.Remote Viewer.enable");
+	auto port = m_preferences.GetInt("Miscellaneous.Remote Viewer.port");
+
+	if(m_viewerServer && (!enabled || (m_viewerServer->GetPort() != port)) )
+		m_viewerServer = nullptr;
+	if(enabled && !m_viewerServer)
+		m_viewerServer = make_unique<ViewerServer>(port);
+}
+
+/**
+	@brief Starts or stops the automation server to match the preferences, then runs any commands it has queued up
+
+	Must be called from the GUI thread once per frame.
+ */
+void Session::UpdateAutomationServer()
+{
+	bool enabled = m_preferences.GetBool("Miscellaneous.Automation.enable");
+	auto port = m_preferences.GetInt("Miscellaneous.Automation.port");
+
+	if(m_automationServer && (!enabled || (m_automationServer->GetPort() != port)) )
+		m_automationServer = nullptr;
+	if(enabled && !m_automationServer)
+		m_automationServer = make_unique<AutomationServer>(port);
+
+	if(m_automationServer)
+		m_automationServer->RunPendingJobs(*this);
+}
+
+///@brief Minimum time between consume-driven acquisition scans, in seconds
+static const double CONSUME_SCAN_INTERVAL = 0.5;
+
+/**
+	@brief Turns channels of an instrument on from its polling thread, so the GUI doesn't wait for the round trip
+
+	@param scope	The instrument
+	@param indexes	Indexes of the channels to turn on
+ */
+static void QueueChannelEnable(Oscilloscope* scope, const vector<size_t>& indexes)
+{
+	if(indexes.empty())
+		return;
+
+	auto job = [scope, indexes]()
+	{
+		for(auto i : indexes)
+			scope->EnableChannel(i);
+	};
+	if(!InstrumentReadQueue::Post(scope, job))
+		job();
+}
+
+/**
+	@brief Turns instrument channels nothing is using off, and back on once something uses them
+
+	A channel is in use if it's shown in a waveform view, is an input to a filter or trigger, or has measurement
+	statistics tracked. While recording, every channel is in use since the recorder writes them all. Drivers only
+	download enabled channels, so on slow instruments this can cut the time per trigger a lot.
+
+	Only channels this function turned off are ever turned back on, and a channel the user turns back on by hand is
+	left alone from then on. At least one channel of each instrument is always left on, so it can still trigger.
+
+	Finding what's in use is done here, but checking and changing which channels are enabled can mean a round trip
+	to the instrument, so that part is queued to each instrument's polling thread. The results are picked up on a
+	later call. Scans are rate limited, and each instrument has at most one in flight.
+
+	Must be called from the GUI thread.
+ */
+void Session::UpdateConsumedChannels()
+{
+	ApplyConsumeScanResults();
+
+	if(!m_preferences.GetBool("Drivers.General.consume_driven_acquisition") || m_recorder || !m_mainWindow)
+	{
+		RestoreAutoDisabledChannels();
+		return;
+	}
+
+	double now = GetTime();
+	if( (now - m_lastConsumeScan) < CONSUME_SCAN_INTERVAL)
+		return;
+	m_lastConsumeScan = now;
+
+	//Find everything that's consuming a channel
+	set<FlowGraphNode*> consumed;
+	for(auto& group : m_mainWindow->GetWaveformGroups())
+	{
+		for(auto& area : group->GetWaveformAreas())
+		{
+			for(size_t i=0; i<area->GetStreamCount(); i++)
+				consumed.emplace(area->GetStream(i).m_channel);
+		}
+	}
+	for(auto f : Filter::GetAllInstances())
+	{
+		for(size_t i=0; i<f->GetInputCount(); i++)
+			consumed.emplace(f->GetInput(i).m_channel);
+	}
+	{
+		lock_guard<mutex> lock(m_measurementStatsMutex);
+		for(auto& it : m_measurementStats)
+			consumed.emplace(it.first.m_channel);
+	}
+
+	for(auto& pscope : GetScopes())
+	{
+		auto scope = pscope.get();
+		if(scope->IsOffline() || (m_consumeScansPending.find(scope) != m_consumeScansPending.end()) )
+			continue;
+
+		auto trig = scope->GetTrigger();
+		if(trig)
+		{
+			for(size_t i=0; i<trig->GetInputCount(); i++)
+				consumed.emplace(trig->GetInput(i).m_channel);
+		}
+
+		//Snapshot everything the scan needs, so it doesn't touch any GUI thread state
+		ConsumeScanResult state;
+		state.m_scope = scope;
+		state.m_generation = m_consumeGeneration;
+		vector<bool> inUse(scope->GetChannelCount());
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			inUse[i] = (consumed.find(chan) != consumed.end());
+			if(IsChannelAutoDisabled(chan))
+				state.m_autoDisabled.emplace(chan);
+			if(m_consumeExemptChannels.find(chan) != m_consumeExemptChannels.end())
+				state.m_exempt.emplace(chan);
+		}
+
+		auto job = [this, state, inUse]() mutable
+		{
+			auto scope = state.m_scope;
+
+			size_t nenabled = 0;
+			for(size_t i=0; i<scope->GetChannelCount(); i++)
+			{
+				if(scope->IsChannelEnabled(i))
+					nenabled ++;
+			}
+
+			for(size_t i=0; i<scope->GetChannelCount(); i++)
+			{
+				auto chan = scope->GetOscilloscopeChannel(i);
+				if(!chan || (chan == scope->GetExternalTrigger()) || !scope->CanEnableChannel(i))
+					continue;
+
+				bool on = scope->IsChannelEnabled(i);
+				if(state.m_autoDisabled.find(chan) != state.m_autoDisabled.end())
+				{
+					//Someone turned it back on by hand
+					if(on)
+					{
+						state.m_autoDisabled.erase(chan);
+						state.m_exempt.emplace(chan);
+					}
+
+					else if(inUse[i])
+					{
+						LogTrace("Enabling %s, it's in use again\n", chan->GetDisplayName().c_str());
+						scope->EnableChannel(i);
+						state.m_autoDisabled.erase(chan);
+						nenabled ++;
+					}
+				}
+
+				else if(on && !inUse[i] && (nenabled > 1) && (state.m_exempt.find(chan) == state.m_exempt.end()) )
+				{
+					LogTrace("Disabling %s, nothing is using it\n", chan->GetDisplayName().c_str());
+					scope->DisableChannel(i);
+					state.m_autoDisabled.emplace(chan);
+					nenabled --;
+				}
+			}
+
+			lock_guard<mutex> lock(m_consumeResultsMutex);
+			m_consumeResults.push_back(state);
+		};
+
+		m_consumeScansPending.emplace(scope);
+		if(!InstrumentReadQueue::Post(scope, job))
+			job();
+	}
+}
+
+/**
+	@brief Picks up the scans instrument threads have finished since the last call
+
+	Must be called from the GUI thread.
+ */
+void Session::ApplyConsumeScanResults()
+{
+	vector<ConsumeScanResult> results;
+	{
+		lock_guard<mutex> lock(m_consumeResultsMutex);
+		results.swap(m_consumeResults);
+	}
+
+	if(results.empty())
+		return;
+
+	//A scan can finish after its instrument was removed but before the polling thread stopped, so drop those
+	set<Oscilloscope*> scopes;
+	for(auto& scope : GetScopes())
+		scopes.emplace(scope.get());
+
+	for(auto& result : results)
+	{
+		auto scope = result.m_scope;
+		if(scopes.find(scope) == scopes.end())
+			continue;
+		m_consumeScansPending.erase(scope);
+
+		//Everything was turned back on while this scan was queued, so undo anything it turned off
+		if(result.m_generation != m_consumeGeneration)
+		{
+			vector<size_t> indexes;
+			for(auto chan : result.m_autoDisabled)
+				indexes.push_back(chan->GetIndex());
+			QueueChannelEnable(scope, indexes);
+			continue;
+		}
+
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			m_autoDisabledChannels.erase(chan);
+			m_consumeExemptChannels.erase(chan);
+		}
+		m_autoDisabledChannels.insert(result.m_autoDisabled.begin(), result.m_autoDisabled.end());
+		m_consumeExemptChannels.insert(result.m_exempt.begin(), result.m_exempt.end());
+	}
+}
+
+/**
+	@brief Turns every channel consume-driven acquisition turned off back on
+
+	The channels are turned on from each instrument's polling thread. Any scan still in flight is undone once it
+	finishes (see ApplyConsumeScanResults()).
+ */
+void Session::RestoreAutoDisabledChannels()
+{
+	m_consumeExemptChannels.clear();
+	if(m_autoDisabledChannels.empty() && m_consumeScansPending.empty())
+		return;
+	m_consumeGeneration ++;
+
+	map<Oscilloscope*, vector<size_t> > indexes;
+	for(auto chan : m_autoDisabledChannels)
+	{
+		auto scope = chan->GetScope();
+		if(scope && !scope->IsOffline())
+			indexes[scope].push_back(chan->GetIndex());
+	}
+	for(auto& it : indexes)
+		QueueChannelEnable(it.first, it.second);
+	m_autoDisabledChannels.clear();
+}
+
+/**
+	@brief Pushes the large buffer placement preferences to HostMemoryPolicy
+
+	Must be called from the GUI thread.
+ */
+void Session::UpdateHostMemoryPolicy()
+{
+	HostMemoryPolicy::Configure(
+		m_preferences.GetBool("Performance.Memory.huge_pages"),
+		m_preferences.GetBool("Performance.Memory.numa_placement"));
+}
+
+/**
+	@brief Pushes the thread priority and affinity preferences to ThreadRoles
+
+	Must be called from the GUI thread.
+ */
+void Session::UpdateThreadRoles()
+{
+	static const char* const prefixes[THREAD_ROLE_COUNT] =
+	{
+		"Performance.Threads.instrument",
+		"Performance.Threads.waveform",
+		"Performance.Threads.pool"
+	};
+
+	for(int i=0; i<THREAD_ROLE_COUNT; i++)
+	{
+		string prefix = prefixes[i];
+		auto cpus = m_preferences.GetString(prefix + "_cpus");
+
+		ThreadRoleSettings settings;
+		settings.m_priority = m_preferences.GetEnum<ThreadPriority>(prefix + "_priority");
+		if(!ThreadRoles::ParseCPUList(cpus, settings.m_cpus))
+		{
+			//Only complain once per edit, not every frame
+			if(cpus != m_badThreadCPUs[i])
+				LogWarning("Ignoring malformed CPU list \"%s\" for %s threads\n", cpus.c_str(),
+					ThreadRoles::GetRoleName(static_cast<ThreadRole>(i)));
+			m_badThreadCPUs[i] = cpus;
+			settings.m_cpus.clear();
+		}
+
+		ThreadRoles::Configure(static_cast<ThreadRole>(i), settings);
+	}
+}
+
+/**
+	@brief Saves all waveform data (historical waveforms and persisted filter outputs) to the session's data directory
+
+	This is a full save: everything in history is written out, regardless of what's already in the directory.
+ */
+bool Session::SerializeWaveforms(const string& dataDir)
+{
+	WaveformSavePlan plan;
+	bool ok = PrepareWaveformSave(dataDir, false, plan);
+	if(ok)
+		ok = FinishWaveformSave(plan);
+	ReleaseWaveformSave(plan, ok);
+
+	m_history.EnforceResidentCap();
+	return ok;
+}
+
+/**
+	@brief Starts an incremental save of waveform data, writing the sample data from a background thread
+
+	Only history points which aren't already in the data directory are written, and the GUI can keep running (and the
+	scope keep triggering) while they are. Must be called from the GUI thread with the waveform data mutex held.
+
+	Call PollBackgroundSave() every frame to clean up once the save completes.
+
+	@return False if the save could not be started
+ */
+bool Session::StartBackgroundWaveformSave(const string& dataDir)
+{
+	//Only one save at a time
+	WaitForBackgroundSave();
+
+	m_savePlan = make_unique<WaveformSavePlan>();
+	if(!PrepareWaveformSave(dataDir, true, *m_savePlan))
+	{
+		ReleaseWaveformSave(*m_savePlan, false);
+		m_savePlan = nullptr;
+		return false;
+	}
+
+	m_saveDone = false;
+	m_saveThread = make_unique<thread>([this]()
+	{
+		pthread_setname_np_compat("SessionSave");
+
+		m_saveOk = FinishWaveformSave(*m_savePlan);
+		m_saveDone = true;
+		WakeEventLoop();
+	});
+
+	return true;
+}
+
+/**
+	@brief Cleans up after a background save, if it's finished
+
+	Must be called from the GUI thread.
+
+	@return True if a background save finished since the last call
+ */
+bool Session::PollBackgroundSave()
+{
+	if(!m_saveThread || !m_saveDone)
+		return false;
+
+	WaitForBackgroundSave();
+	return true;
+}
+
+/**
+	@brief Blocks until any in-progress background save is complete, then cleans up after it
+
+	Must be called from the GUI thread.
+ */
+void Session::WaitForBackgroundSave()
+{
+	if(!m_saveThread)
+		return;
+
+	m_saveThread->join();
+	m_saveThread = nullptr;
+
+	if(!m_saveOk)
+		LogError("Background save of waveform data failed\n");
+	ReleaseWaveformSave(*m_savePlan, m_saveOk);
+	m_savePlan = nullptr;
+
+	m_history.EnforceResidentCap();
+}
+
+/**
+	@brief Sets up everything needed to write one history point to a data directory
+
+	Creates the point's directories and generates its metadata, but doesn't write any sample data.
+
+	@param hpoint			The point to save (must be loaded)
+	@param dataDir			Path to the data directory
+	@param numwfm			Waveform ID to save the point as
+	@param jobs				Sample data files to write are appended here
+	@param metadataNodes	YAML metadata for each scope's metadata file is added here
+	@param saved			Filled out with the point's metadata and directories
+ */
+void Session::PrepareHistoryPointSave(
+	HistoryPoint* hpoint,
+	const string& dataDir,
+	int numwfm,
+	vector<WaveformSaveJob>& jobs,
+	map<shared_ptr<Oscilloscope>, YAML::Node>& metadataNodes,
+	SavedHistoryPoint& saved)
+{
+	auto timestamp = hpoint->m_time;
+	auto compression = m_preferences.GetEnum<DenseCompression>("Files.compress_dense");
+	bool lossy = m_preferences.GetBool("Files.compress_dense_lossy");
+	bool packDigital = m_preferences.GetBool("Files.pack_digital");
+	bool shareTimebase = m_preferences.GetBool("Files.share_timebase");
+
+	//Save each scope
+	//TODO: Do we want to change the directory hierarchy in a future file format schema?
+	//For now, we stick with scope / waveform.
+	//In the future we might want trigger group / waveform / scope.
+	for(auto it : hpoint->m_history)
+	{
+		auto scope = it.first;
+		auto& hist = it.second;
+
+		//Make the directory for the scope if needed
+		string scopedir = dataDir + "/scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_waveforms";
+		#ifdef _WIN32
+			_mkdir(scopedir.c_str());
+		#else
+			mkdir(scopedir.c_str(), 0755);
+		#endif
+
+		//Make directory for this waveform
+		string datdir = scopedir + "/waveform_" + to_string(numwfm);
+		#ifdef _WIN32
+			mkdir(datdir.c_str());
+		#else
+			mkdir(datdir.c_str(), 0755);
+		#endif
+		saved.m_dirs.push_back(datdir);
+
+		//Format metadata for this waveform
+		YAML::Node mnode;
+		mnode["timestamp"] = timestamp.first;
+		mnode["time_fsec"] = timestamp.second;
+		mnode["id"] = numwfm;
+		mnode["pinned"] = hpoint->m_pinned;
+		mnode["label"] = hpoint->m_nickname;
+
+		SavedWaveformMetadata meta;
+		meta.m_time = timestamp;
+		meta.m_id = numwfm;
+		meta.m_pinned = hpoint->m_pinned;
+		meta.m_label = hpoint->m_nickname;
+
+		//Sparse waveforms in this point which hold their own timebase, and the files they're saved to.
+		//Later waveforms of the same length are checked against them when written.
+		vector<pair<SparseWaveformBase*, string> > timebases;
+
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto ochan = dynamic_cast<OscilloscopeChannel*>(scope->GetChannel(i));
+			if(!ochan)
+				continue;
+			for(size_t j=0; j<scope->GetChannel(i)->GetStreamCount(); j++)
+			{
+				StreamDescriptor stream(ochan, j);
+				if(hist.find(stream) == hist.end())
+					continue;
+				auto data = hist[stream];
+				if(data == nullptr)
+					continue;
+
+				//Got valid data, save the configuration for the channel
+				YAML::Node chnode;
+				chnode["index"] = i;
+				chnode["stream"] = j;
+				chnode["timescale"] = data->m_timescale;
+				chnode["trigphase"] = data->m_triggerPhase;
+				chnode["flags"] = (int)data->m_flags;
+				//don't serialize revision
+
+				//Save the actual waveform data
+				string datafile;
+				if(j == 0)
+					datafile = string("channel_") + to_string(i) + ".bin";
+				else
+					datafile = string("channel_") + to_string(i) + "_stream" + to_string(j) + ".bin";
+				string datapath = datdir + "/" + datafile;
+				auto sparse = dynamic_cast<SparseWaveformBase*>(data);
+				jobs.push_back(WaveformSaveJob(data, datapath, GetSerializedSize(data)));
+				if(sparse)
+				{
+					chnode["format"] = "sparsev2";
+
+					//See if an earlier waveform might have the same timebase
+					if(shareTimebase)
+					{
+						auto& job = jobs.back();
+						for(auto& t : timebases)
+						{
+							if(t.first->size() == sparse->size())
+							{
+								job.m_timebaseSource = t.first;
+								job.m_timebaseFile = t.second;
+								break;
+							}
+						}
+						if(!job.m_timebaseSource)
+							timebases.push_back(pair(sparse, datafile));
+					}
+
+					//Save type if it's a protocol waveform
+					//so if we do an offline load, we know what type of waveform to make
+					if(dynamic_cast<SparseAnalogWaveform*>(sparse) != nullptr)
+						chnode["datatype"] = "analog";
+					else if(dynamic_cast<SparseDigitalWaveform*>(sparse) != nullptr)
+						chnode["datatype"] = "digital";
+					else if(dynamic_cast<CANWaveform*>(sparse) != nullptr)
+						chnode["datatype"] = "can";
+				}
+				else
+					ConfigureDenseCompression(
+						m_taskPool, jobs.back(), chnode, ochan, j, compression, lossy, packDigital);
+
+				mnode["channels"][string("ch") + to_string(i) + "s" + to_string(j)] = chnode;
+
+				SavedStreamMetadata smeta;
+				smeta.m_channel = i;
+				smeta.m_stream = j;
+				smeta.m_format = chnode["format"].as<string>();
+				if(chnode["datatype"])
+					smeta.m_datatype = chnode["datatype"].as<string>();
+				smeta.m_timescale = data->m_timescale;
+				smeta.m_triggerPhase = data->m_triggerPhase;
+				meta.m_streams.push_back(smeta);
+			}
+		}
+
+		metadataNodes[scope]["waveforms"][string("wfm") + to_string(numwfm)] = mnode;
+		saved.m_metadata[scope] = meta;
+	}
+}
+
+/**
+	@brief Gathers everything needed to save the waveform data, and writes the small stuff
+
+	Must be called from the GUI thread with the waveform data mutex held. Creates all of the directories, generates
+	the metadata, and writes the filter waveforms. Scope sample data and metadata files are left for
+	FinishWaveformSave(), which doesn't touch any session state and so can run from another thread.
+
+	@param dataDir		Path to the data directory
+	@param incremental	If true, and the data directory is where our history was last saved to or loaded from, only
+						write history points which aren't already in it. If false, write everything.
+	@param plan			The save to be finished by FinishWaveformSave(). ReleaseWaveformSave() must be called on it
+						afterwards (from the GUI thread), even if this function fails.
+
+	@return				False if the filter waveforms could not be saved
+ */
+bool Session::PrepareWaveformSave(const string& dataDir, bool incremental, WaveformSavePlan& plan)
+{
+	if(!incremental || (dataDir != m_savedDataDir) )
+	{
+		m_savedPoints.clear();
+		m_nextSavedId = 0;
+	}
+	m_savedDataDir = dataDir;
+
+	//Anything we saved before which is no longer in history (or is no longer complete) has to go
+	for(auto it = m_savedPoints.begin(); it != m_savedPoints.end(); )
+	{
+		auto hpoint = m_history.GetHistory(it->first);
+		bool complete = (hpoint != nullptr);
+		if(hpoint)
+		{
+			for(auto& jt : hpoint->m_history)
+			{
+				if(it->second.m_metadata.find(jt.first) == it->second.m_metadata.end())
+					complete = false;
+			}
+		}
+
+		if(complete)
+			it ++;
+		else
+		{
+			for(auto& dir : it->second.m_dirs)
+				plan.m_staleDirs.push_back(dir);
+			it = m_savedPoints.erase(it);
+		}
+	}
+
+	//Metadata nodes for each scope, and the same metadata for the binary index
+	std::map<std::shared_ptr<Oscilloscope>, YAML::Node> metadataNodes;
+	map<shared_ptr<Oscilloscope>, vector<SavedWaveformMetadata>> indexes;
+
+	auto compression = m_preferences.GetEnum<DenseCompression>("Files.compress_dense");
+	bool lossy = m_preferences.GetBool("Files.compress_dense_lossy");
+	bool packDigital = m_preferences.GetBool("Files.pack_digital");
+
+	//Serialize data from each history point
+	for(auto& hpoint : m_history.m_history)
+	{
+		auto timestamp = hpoint->m_time;
+
+		//If it's already saved, reuse the existing sample data and just update the label etc
+		auto sit = m_savedPoints.find(timestamp);
+		if(sit != m_savedPoints.end())
+		{
+			for(auto& mit : sit->second.m_metadata)
+			{
+				auto& meta = mit.second;
+				meta.m_pinned = hpoint->m_pinned;
+				meta.m_label = hpoint->m_nickname;
+
+				metadataNodes[mit.first]["waveforms"][string("wfm") + to_string(meta.m_id)] =
+					SerializeSavedWaveformMetadata(meta);
+				indexes[mit.first].push_back(meta);
+			}
+			continue;
+		}
+
+		//Lazily loaded or compacted points need their sample data before we can save it.
+		//Hold onto the point until the save is done so nothing gets unloaded out from under us.
+		m_history.EnsureLoaded(hpoint.get(), false);
+		m_history.Expand(hpoint.get());
+		hpoint->m_readerRefs ++;
+		plan.m_points.push_back(hpoint);
+
+		auto& saved = m_savedPoints[timestamp];
+		PrepareHistoryPointSave(hpoint.get(), dataDir, m_nextSavedId ++, plan.m_jobs, metadataNodes, saved);
+		for(auto& it : saved.m_metadata)
+			indexes[it.first].push_back(it.second);
+	}
+
+	//Metadata files are written once the sample data is, so the directory never refers to data that isn't there
+	for(size_t i=0; i<m_oscilloscopes.size(); i++)
+	{
+		auto scope = m_oscilloscopes[i];
+		string fname = dataDir + "/scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_metadata.yml";
+		plan.m_metadata[fname] = metadataNodes[scope];
+		plan.m_indexes[fname] = indexes[scope];
+	}
+
+	//Make directory for filters
+	string filtdir = dataDir + "/filter_waveforms";
+	#ifdef _WIN32
+		mkdir(filtdir.c_str());
+	#else
+		mkdir(filtdir.c_str(), 0755);
+	#endif
+
+	//Find filters that need to be serialized.
+	//Filter outputs can change as soon as we release the waveform data mutex, so these are always written right now.
+	YAML::Node filterNode;
+	vector<WaveformSaveJob> filterJobs;
+	auto filters = Filter::GetAllInstances();
+	for(auto f : filters)
+	{
+		//If it's not being persisted, drop it
+		if(!f->ShouldPersistWaveform())
+			continue;
+
+		//Make directory for this filter
+		auto nfilter = m_idtable.emplace(f);
+		string datdir = filtdir + "/filter_" + to_string(nfilter);
+		#ifdef _WIN32
+			mkdir(datdir.c_str());
+		#else
+			mkdir(datdir.c_str(), 0755);
+		#endif
+
+		//There's no history timestamp so use timestamp of the first stream's waveform
+		//If no first stream what do we do?
+		auto wref = f->GetData(0);
+		if(!wref)
+		{
+			LogWarning("Don't know how to save filters without a slot 0 waveform\n");
+			continue;
+		}
+
+		//Format metadata for this waveform
+		//No labels etc because we're not in history
+		YAML::Node mnode;
+		mnode["timestamp"] = wref->m_startTimestamp;
+		mnode["time_fsec"] = wref->m_startFemtoseconds;
+		mnode["id"] = nfilter;
+
+		for(size_t j=0; j<f->GetStreamCount(); j++)
+		{
+			StreamDescriptor stream(f, j);
+			auto data = stream.GetData();
+			if(data == nullptr)
+				continue;
+
+			//Got valid data, save the configuration for the channel
+			YAML::Node chnode;
+			chnode["stream"] = j;
+			chnode["timescale"] = data->m_timescale;
+			chnode["trigphase"] = data->m_triggerPhase;
+			chnode["flags"] = (int)data->m_flags;
+			//don't serialize revision
+
+			//Save the actual waveform data
+			string datapath = datdir + "/stream" + to_string(j) + ".bin";
+			filterJobs.push_back(WaveformSaveJob(data, datapath, GetSerializedSize(data)));
+			if(dynamic_cast<SparseWaveformBase*>(data) != nullptr)
+				chnode["format"] = "sparsev2";
+			else
+				ConfigureDenseCompression(
+					m_taskPool, filterJobs.back(), chnode, f, j, compression, lossy, packDigital);
+
+			mnode["streams"][string("s") + to_string(j)] = chnode;
+		}
+
+		filterNode["waveforms"][string("filt") + to_string(nfilter)] = mnode;
+	}
+
+	//Move everything to the CPU now, since buffer transfers use the GPU queues which belong to this thread
+	for(auto& job : plan.m_jobs)
+		job.m_wfm->PrepareForCpuAccess();
+	for(auto& job : filterJobs)
+		job.m_wfm->PrepareForCpuAccess();
+
+	WriteWaveformFiles(filterJobs);
+
+	string fname = dataDir + "/filter_metadata.yml";
+	ofstream outfs(fname);
+	if(!outfs)
+		return false;
+	outfs << filterNode;
+	outfs.close();
+
+	return true;
+}
+
+/**
+	@brief Writes the scope sample data and metadata for a save set up by PrepareWaveformSave()
+
+	Only touches the plan, so this is safe to call from a background thread as long as the GUI thread doesn't call
+	ReleaseWaveformSave() until it's done.
+ */
+bool Session::FinishWaveformSave(WaveformSavePlan& plan)
+{
+	//All directories are created, now we can write the actual sample data
+	WriteWaveformFiles(plan.m_jobs);
+
+	//Then the metadata files
+	bool ok = true;
+	for(auto& it : plan.m_metadata)
+	{
+		auto& fname = it.first;
+		ofstream outfs(fname);
+		if(!outfs)
+		{
+			ok = false;
+			continue;
+		}
+		outfs << it.second;
+		outfs.close();
+
+		//The index is only an accelerator for loading, so the session is still usable without it
+		string base = fname.substr(0, fname.length() - strlen("_metadata.yml"));
+		if(!WriteWaveformIndex(base + "_index.bin", fname, plan.m_indexes[fname]))
+			LogWarning("Failed to write waveform index %s_index.bin\n", base.c_str());
+	}
+
+	//Nothing refers to the stale points any more, so they can go
+	if(ok)
+	{
+		for(auto& dir : plan.m_staleDirs)
+			::RemoveDirectory(dir);
+	}
+
+	return ok;
+}
+
+/**
+	@brief Lets go of the history points held by a save, once FinishWaveformSave() is done with them
+
+	Must be called from the GUI thread, since this may be the last reference to a point that's since been removed
+	from history.
+
+	@param plan	The save to clean up after
+	@param ok	True if the save succeeded. If not, we no longer know what's in the data directory, so the next save
+				will write everything again.
+ */
+void Session::ReleaseWaveformSave(WaveformSavePlan& plan, bool ok)
+{
+	for(auto& pt : plan.m_points)
+		pt->ReleaseReader();
+	plan.m_points.clear();
+	plan.m_jobs.clear();
+
+	if(!ok)
+	{
+		m_savedPoints.clear();
+		m_savedDataDir = "";
+		m_nextSavedId = 0;
+	}
+}
+
+/**
+	@brief Writes a set of waveform data files using a pool of worker threads
+
+	All waveforms must already have been moved to the CPU by the caller (from the GUI thread, since buffer transfers
+	use the GPU queues). Each worker writes whole files straight from the CPU-side buffers.
+
+	Errors on individual files are logged but do not abort the save, to match the behavior of the serial path.
+ */
+void Session::WriteWaveformFiles(vector<WaveformSaveJob>& jobs)
+{
+	if(jobs.empty())
+		return;
+
+	LogTrace("Writing %zu waveform files\n", jobs.size());
+	LogIndenter li;
+
+	double tstart = GetTime();
+	size_t totalBytes = 0;
+	for(auto& job : jobs)
+		totalBytes += job.m_bytes;
+
+	//Use at least one thread, but don't spin up more than we have files for
+	size_t nthreads = max((int64_t)1, m_preferences.GetInt("Files.save_threads"));
+	nthreads = min(nthreads, jobs.size());
+
+	atomic<size_t> nextJob(0);
+	atomic<size_t> jobsDone(0);
+	atomic<size_t> bytesDone(0);
+	auto worker = [&]()
+	{
+		pthread_setname_np_compat("WaveformSave");
+
+		while(true)
+		{
+			size_t i = nextJob ++;
+			if(i >= jobs.size())
+				break;
+			auto& job = jobs[i];
+
+			bool ok;
+			auto kind = GetWaveformKind(job.m_wfm);
+			if(IsSparseKind(kind))
+				ok = SerializeSparseWaveform(GetSparseBase(job.m_wfm, kind), job.m_path, &job);
+			else if( (kind == WAVEFORM_KIND_UNIFORM_ANALOG) && (job.m_compression != COMPRESS_DENSE_NONE) )
+				ok = SerializeQuantizedWaveform(static_cast<UniformAnalogWaveform*>(job.m_wfm), job);
+			else if( (kind == WAVEFORM_KIND_UNIFORM_DIGITAL) && job.m_packBits)
+				ok = SerializePackedDigitalWaveform(static_cast<UniformDigitalWaveform*>(job.m_wfm), job.m_path);
+			else
+				ok = SerializeUniformWaveform(GetUniformBase(job.m_wfm, kind), job.m_path);
+			if(!ok)
+				LogError("Failed to write waveform data to %s\n", job.m_path.c_str());
+
+			bytesDone += job.m_bytes;
+			jobsDone ++;
+		}
+	};
+
+	vector<thread> threads;
+	for(size_t i=0; i<nthreads; i++)
+		threads.push_back(thread(worker));
+
+	//Report progress while the workers run
+	Unit bytes(Unit::UNIT_BYTES);
+	double tlast = tstart;
+	while(jobsDone < jobs.size())
+	{
+		this_thread::sleep_for(chrono::milliseconds(10));
+
+		double now = GetTime();
+		if(now - tlast > 1)
+		{
+			tlast = now;
+			LogVerbose("Saved %zu / %zu waveforms (%s / %s)\n",
+				jobsDone.load(),
+				jobs.size(),
+				bytes.PrettyPrint(bytesDone.load(), 4).c_str(),
+				bytes.PrettyPrint(totalBytes, 4).c_str());
+		}
+	}
+
+	for(auto& t : threads)
+		t.join();
+
+	double dt = GetTime() - tstart;
+	LogVerbose("Saved %s of waveform data in %.3f sec (%s/s) using %zu threads\n",
+		bytes.PrettyPrint(totalBytes, 4).c_str(),
+		dt,
+		bytes.PrettyPrint(totalBytes / dt, 4).c_str(),
+		nthreads);
+}
+
+/**
+	@brief Reads a set of waveform data files using a pool of worker threads
+
+	Each job's waveform is replaced with the loaded one. If the loader returned a different object (e.g. sparse data
+	which turned out to be uniform), the original is deleted, so nothing else may hold a pointer to it.
+
+	Sample data is only written from the CPU side here; it's copied to the GPU the first time something needs it
+	there, as with any other waveform.
+ */
+void Session::ReadWaveformFiles(vector<WaveformLoadJob>& jobs)
+{
+	if(jobs.empty())
+		return;
+
+	LogTrace("Reading %zu waveform files\n", jobs.size());
+	LogIndenter li;
+
+	double tstart = GetTime();
+
+	//Use at least one thread, but don't spin up more than we have files for
+	size_t nthreads = max((int64_t)1, m_preferences.GetInt("Files.load_threads"));
+	nthreads = min(nthreads, jobs.size());
+
+	atomic<size_t> nextJob(0);
+	atomic<size_t> jobsDone(0);
+	atomic<size_t> bytesDone(0);
+	auto worker = [&]()
+	{
+		pthread_setname_np_compat("WaveformLoad");
+
+		while(true)
+		{
+			size_t i = nextJob ++;
+			if(i >= jobs.size())
+				break;
+			auto& job = jobs[i];
+
+			size_t len = 0;
+			auto wfm = LoadWaveformFile(m_taskPool, job.m_wfm, job.m_format, job.m_path, &len);
+			if(wfm != job.m_wfm)
+			{
+				delete job.m_wfm;
+				job.m_wfm = wfm;
+			}
+
+			bytesDone += len;
+			jobsDone ++;
+		}
+	};
+
+	vector<thread> threads;
+	for(size_t i=0; i<nthreads; i++)
+		threads.push_back(thread(worker));
+
+	//Report progress while the workers run.
+	//We don't know file sizes until they're opened, so estimate time remaining from the number of files done.
+	Unit bytes(Unit::UNIT_BYTES);
+	double tlast = tstart;
+	while(jobsDone < jobs.size())
+	{
+		this_thread::sleep_for(chrono::milliseconds(10));
+
+		double now = GetTime();
+		if(now - tlast > 1)
+		{
+			tlast = now;
+			size_t done = jobsDone.load();
+			double elapsed = now - tstart;
+			double remaining = 0;
+			if(done > 0)
+				remaining = elapsed * (jobs.size() - done) / done;
+			LogVerbose("Loaded %zu / %zu waveforms (%s, %s/s, about %.0f sec remaining)\n",
+				done,
+				jobs.size(),
+				bytes.PrettyPrint(bytesDone.load(), 4).c_str(),
+				bytes.PrettyPrint(bytesDone.load() / elapsed, 4).c_str(),
+				remaining);
+		}
+	}
+
+	for(auto& t : threads)
+		t.join();
+
+	double dt = GetTime() - tstart;
+	LogVerbose("Loaded %s of waveform data in %.3f sec (%s/s) using %zu threads\n",
+		bytes.PrettyPrint(bytesDone.load(), 4).c_str(),
+		dt,
+		bytes.PrettyPrint(bytesDone.load() / dt, 4).c_str(),
+		nthreads);
+}
+
+/**
+	@brief Writes an array of packed records converted from waveform samples, one block at a time
+
+	Only a single block of records is ever allocated, regardless of waveform size.
+
+	@param fp		File to write to
+	@param len		Number of records to write
+	@param pack		Function returning the on-disk record for a given sample index
+ */
+template<class R, class F>
+static bool WriteInterleavedBlocks(AsyncFileWriter& fp, size_t len, F pack)
+{
+	const size_t samples_per_block = 10000;
+	vector<R, AlignedAllocator<R, 64 > > block(min(len, samples_per_block));
+
+	for(size_t i=0; i<len; i+= samples_per_block)
+	{
+		size_t blocklen = min(len-i, samples_per_block);
+		for(size_t j=0; j<blocklen; j++)
+			block[j] = pack(i+j);
+
+		if(!fp.Write(&block[0], blocklen * sizeof(R)))
+		{
+			LogError("file write error\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+	@brief Packs digital samples eight per byte, LSB first
+
+	@param pool		Pool to pack on
+	@param samples	Samples to pack
+	@param n		Number of samples
+	@param bits		Output buffer, resized to (n+7)/8 bytes
+ */
+static void PackDigitalSamples(TaskPool& pool, const bool* samples, size_t n, vector<uint8_t>& bits)
+{
+	//Advise the buffer before resize() touches it, so the zero fill already lands in the right kind of memory
+	bits.reserve( (n + 7) / 8 );
+	HostMemoryPolicy::Apply(bits.data(), bits.capacity(), THREAD_ROLE_TASK_POOL);
+	bits.resize( (n + 7) / 8 );
+	uint8_t* out = bits.data();
+
+	//Blocks are a whole number of bytes, so no two threads ever write the same byte
+	int64_t nblocks = (n + PACKED_BITS_BLOCK_SIZE - 1) / PACKED_BITS_BLOCK_SIZE;
+	pool.ParallelFor(0, nblocks, 1, [&](int64_t block)
+	{
+		size_t start = block * PACKED_BITS_BLOCK_SIZE;
+		size_t end = min(n, start + PACKED_BITS_BLOCK_SIZE);
+		for(size_t i=start; i<end; i += 8)
+		{
+			uint8_t b = 0;
+			for(size_t j=0; (j < 8) && (i+j < end); j++)
+			{
+				if(samples[i+j])
+					b |= (1 << j);
+			}
+			out[i / 8] = b;
+		}
+	});
+}
+
+/**
+	@brief Writes zeroes to pad a file out to the next sparsev2 section boundary
+
+	@param fp		File to write to
+	@param pos		Current position in the file, updated to the new position
+ */
+static bool WriteSparseV2Padding(AsyncFileWriter& fp, size_t& pos)
+{
+	static const char zeroes[SPARSEV2_ALIGN] = {0};
+	size_t padlen = (SPARSEV2_ALIGN - (pos % SPARSEV2_ALIGN)) % SPARSEV2_ALIGN;
+	pos += padlen;
+	return fp.Write(zeroes, padlen);
+}
+
+/**
+	@brief Writes one section of a sparsev2 file, followed by padding to the next section boundary
+ */
+static bool WriteSparseV2Section(AsyncFileWriter& fp, const void* data, size_t len, size_t& pos)
+{
+	if(!fp.Write(data, len))
+		return false;
+	pos += len;
+	return WriteSparseV2Padding(fp, pos);
+}
+
+/**
+	@brief Saves waveform sample data in the "sparsev2" file format.
+
+	Columnar:
+		SparseV2Header
+		offsets section
+			int64[] offset
+			or int32[] delta from previous offset, if SPARSEV2_OFFSETS_DELTA32
+		durations section
+			int64[] duration
+			or {int64 duration, int64 count}[] runs, if SPARSEV2_DURATIONS_RLE
+		samples section
+			for analog
+				float[] voltage
+			for digital
+				bool[] voltage
+				or uint8[] samples packed eight per byte LSB first, if SPARSEV2_SAMPLES_PACKED
+			for CAN
+				{uint32 data, uint32 type}[]
+
+	Each section starts on a SPARSEV2_ALIGN byte boundary. Offset and duration encodings are only used if enabled in
+	the preferences and they don't make the section bigger, so by default each section is a straight copy of the buffer.
+	Digital samples are packed if enabled in the preferences.
+
+	If the job names another waveform with exactly the same offsets and durations, SPARSEV2_TIMEBASE_SHARED is set,
+	the offsets section holds the name of that waveform's file, and the durations section is empty.
+
+	This function is thread safe as long as the waveform (and the job's timebase source, if any) is already up to date
+	on the CPU.
+
+	@param wfm		The waveform to save
+	@param path		Path to the file
+	@param job		If not null, the job this file is being written for
+ */
+bool Session::SerializeSparseWaveform(SparseWaveformBase* wfm, const string& path, const WaveformSaveJob* job)
+{
+	wfm->PrepareForCpuAccess();
+	auto kind = GetWaveformKind(wfm);
+	auto achan = (kind == WAVEFORM_KIND_SPARSE_ANALOG) ? static_cast<SparseAnalogWaveform*>(wfm) : nullptr;
+	auto dchan = (kind == WAVEFORM_KIND_SPARSE_DIGITAL) ? static_cast<SparseDigitalWaveform*>(wfm) : nullptr;
+	auto cchan = (kind == WAVEFORM_KIND_SPARSE_CAN) ? static_cast<CANWaveform*>(wfm) : nullptr;
+	size_t len = wfm->size();
+	auto offsets = wfm->m_offsets.GetCpuPointer();
+	auto durations = wfm->m_durations.GetCpuPointer();
+
+	SparseV2Header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.m_magic, "SPARSEV2", sizeof(hdr.m_magic));
+	hdr.m_count = len;
+	if(achan)
+		hdr.m_sampleSize = sizeof(float);
+	else if(dchan)
+		hdr.m_sampleSize = sizeof(bool);
+	else if(cchan)
+		hdr.m_sampleSize = 2*sizeof(uint32_t);
+	else
+	{
+		//TODO: support other waveform types (buses, eyes, etc)
+		LogError("unrecognized sample type\n");
+		return false;
+	}
+
+	bool compress = m_preferences.GetBool("Files.compress_sparse");
+
+	//Refer to another file's timebase if it's identical to ours
+	bool shared = false;
+	if(job && job->m_timebaseSource && (job->m_timebaseSource->size() == len) )
+	{
+		auto src = job->m_timebaseSource;
+		shared =
+			(memcmp(src->m_offsets.GetCpuPointer(), offsets, len*sizeof(int64_t)) == 0) &&
+			(memcmp(src->m_durations.GetCpuPointer(), durations, len*sizeof(int64_t)) == 0);
+		if(shared)
+		{
+			hdr.m_flags |= SPARSEV2_TIMEBASE_SHARED;
+			compress = false;
+		}
+	}
+
+	//Delta encode offsets if every delta fits in 32 bits
+	vector<int32_t> deltas;
+	if(compress)
+	{
+		deltas.resize(len);
+		int64_t last = 0;
+		for(size_t i=0; i<len; i++)
+		{
+			int64_t delta = offsets[i] - last;
+			if( (delta < INT32_MIN) || (delta > INT32_MAX) )
+			{
+				deltas.clear();
+				break;
+			}
+			deltas[i] = delta;
+			last = offsets[i];
+		}
+		if(!deltas.empty())
+			hdr.m_flags |= SPARSEV2_OFFSETS_DELTA32;
+	}
+
+	//Run length encode durations if that doesn't make them any bigger
+	vector<int64_t> runs;
+	if(compress && (len > 0) )
+	{
+		int64_t value = durations[0];
+		int64_t count = 0;
+		for(size_t i=0; i<len; i++)
+		{
+			if(durations[i] != value)
+			{
+				runs.push_back(value);
+				runs.push_back(count);
+				value = durations[i];
+				count = 0;
+
+				if(runs.size() > len)
+					break;
+			}
+			count ++;
+		}
+		runs.push_back(value);
+		runs.push_back(count);
+
+		if(runs.size() > len)
+			runs.clear();
+		else
+			hdr.m_flags |= SPARSEV2_DURATIONS_RLE;
+	}
+
+	//Pack digital samples
+	vector<uint8_t> bits;
+	if(dchan && m_preferences.GetBool("Files.pack_digital"))
+	{
+		PackDigitalSamples(m_taskPool, dchan->m_samples.GetCpuPointer(), len, bits);
+		hdr.m_flags |= SPARSEV2_SAMPLES_PACKED;
+	}
+
+	//Lay out the sections
+	auto align = [](size_t pos) { return (pos + SPARSEV2_ALIGN - 1) / SPARSEV2_ALIGN * SPARSEV2_ALIGN; };
+	hdr.m_offsetsStart = align(sizeof(hdr));
+	if(shared)
+		hdr.m_offsetsLen = job->m_timebaseFile.length();
+	else
+		hdr.m_offsetsLen = deltas.empty() ? len*sizeof(int64_t) : len*sizeof(int32_t);
+	hdr.m_durationsStart = align(hdr.m_offsetsStart + hdr.m_offsetsLen);
+	if(shared)
+		hdr.m_durationsLen = 0;
+	else
+		hdr.m_durationsLen = runs.empty() ? len*sizeof(int64_t) : runs.size()*sizeof(int64_t);
+	hdr.m_samplesStart = align(hdr.m_durationsStart + hdr.m_durationsLen);
+	hdr.m_samplesLen = (hdr.m_flags & SPARSEV2_SAMPLES_PACKED) ? bits.size() : len * hdr.m_sampleSize;
+
+	AsyncFileWriter fp(m_preferences.GetBool("Files.async_writes"));
+	if(!fp.Open(path))
+		return false;
+
+	size_t pos = 0;
+	bool ok = WriteSparseV2Section(fp, &hdr, sizeof(hdr), pos);
+
+	if(shared)
+		ok = ok && WriteSparseV2Section(fp, job->m_timebaseFile.c_str(), hdr.m_offsetsLen, pos);
+	else if(deltas.empty())
+		ok = ok && WriteSparseV2Section(fp, offsets, hdr.m_offsetsLen, pos);
+	else
+		ok = ok && WriteSparseV2Section(fp, &deltas[0], hdr.m_offsetsLen, pos);
+
+	//Shared timebases have an empty durations section
+	if(!shared)
+	{
+		if(runs.empty())
+			ok = ok && WriteSparseV2Section(fp, durations, hdr.m_durationsLen, pos);
+		else
+			ok = ok && WriteSparseV2Section(fp, &runs[0], hdr.m_durationsLen, pos);
+	}
+
+	if(achan)
+		ok = ok && WriteSparseV2Section(fp, achan->m_samples.GetCpuPointer(), hdr.m_samplesLen, pos);
+	else if(dchan && (hdr.m_flags & SPARSEV2_SAMPLES_PACKED) )
+		ok = ok && WriteSparseV2Section(fp, bits.data(), hdr.m_samplesLen, pos);
+	else if(dchan)
+		ok = ok && WriteSparseV2Section(fp, dchan->m_samples.GetCpuPointer(), hdr.m_samplesLen, pos);
+
+	//CAN symbols don't have a fixed in-memory layout, so pack them
+	else
+	{
+		#pragma pack(push, 1)
+		class csample_t
+		{
+		public:
+			uint32_t data;
+			uint32_t type;
+
+			csample_t(CANSymbol s = CANSymbol())
+			: data(s.m_data), type(s.m_stype)
+			{}
+		};
+		#pragma pack(pop)
+
+		auto samples = cchan->m_samples.GetCpuPointer();
+		ok = ok && WriteInterleavedBlocks<csample_t>(fp, len, [&](size_t i)
+			{ return csample_t(samples[i]); });
+	}
+
+	ok = fp.Close() && ok;
+	if(!ok)
+		LogError("file write error\n");
+	return ok;
+}
+
+/**
+	@brief Saves waveform sample data in the "densev1" file format.
+
+	for analog
+		float[] voltage
+	for digital
+		bool[] voltage
+
+	Durations are implied {1....1} and offsets are implied {0...n-1}.
+
+	This function is thread safe as long as the waveform is already up to date on the CPU.
+ */
+bool Session::SerializeUniformWaveform(UniformWaveformBase* wfm, const string& path)
+{
+	AsyncFileWriter fp(m_preferences.GetBool("Files.async_writes"));
+	if(!fp.Open(path))
+		return false;
+
+	wfm->PrepareForCpuAccess();
+	size_t len = wfm->size();
+
+	//Write the whole buffer at once, there's no need to chunk since we're not copying anything
+	bool written = false;
+	bool known = DispatchWaveform(wfm, [&](auto typed)
+		{ written = fp.Write(typed->m_samples.GetCpuPointer(), len * sizeof(typed->m_samples[0])); });
+
+	bool ok = true;
+	if(!known)
+	{
+		//TODO: support other waveform types (buses, eyes, etc)
+		LogError("unrecognized sample type\n");
+		ok = false;
+	}
+	else if(!written)
+	{
+		LogError("file write error\n");
+		ok = false;
+	}
+
+	if(!fp.Close() && ok)
+	{
+		LogError("file write error\n");
+		ok = false;
+	}
+	return ok;
+}
+
+/**
+	@brief Saves digital waveform sample data in the "densebits" file format.
+
+	DenseBitsHeader
+	uint8_t[] samples, packed eight per byte LSB first
+
+	This function is thread safe as long as the waveform is already up to date on the CPU.
+ */
+bool Session::SerializePackedDigitalWaveform(UniformDigitalWaveform* wfm, const string& path)
+{
+	wfm->PrepareForCpuAccess();
+	size_t len = wfm->size();
+
+	DenseBitsHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.m_magic, "DENSEBIT", sizeof(hdr.m_magic));
+	hdr.m_count = len;
+
+	vector<uint8_t> bits;
+	PackDigitalSamples(m_taskPool, wfm->m_samples.GetCpuPointer(), len, bits);
+
+	AsyncFileWriter fp(m_preferences.GetBool("Files.async_writes"));
+	if(!fp.Open(path))
+		return false;
+
+	bool ok = fp.Write(&hdr, sizeof(hdr));
+	ok = ok && fp.Write(bits.data(), bits.size());
+	ok = fp.Close() && ok;
+	if(!ok)
+		LogError("file write error\n");
+	return ok;
+}
+
+/**
+	@brief Saves analog waveform sample data in the "densev2" file format.
+
+	DenseV2Header
+	uint8_t[] or uint16_t[] codes
+
+	Each code represents the value (code*gain + offset), using the scale ConfigureDenseCompression() chose for the
+	job. Non-finite samples are stored as code zero.
+
+	This function is thread safe as long as the waveform is already up to date on the CPU.
+ */
+bool Session::SerializeQuantizedWaveform(UniformAnalogWaveform* wfm, const WaveformSaveJob& job)
+{
+	wfm->PrepareForCpuAccess();
+	size_t len = wfm->size();
+	auto samples = wfm->m_samples.GetCpuPointer();
+
+	DenseV2Header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.m_magic, "DENSEV2", sizeof(hdr.m_magic));
+	hdr.m_count = len;
+	double maxcode;
+	if(job.m_compression == COMPRESS_DENSE_8_BITS)
+	{
+		hdr.m_codec = DENSEV2_CODEC_INT8;
+		maxcode = UINT8_MAX;
+	}
+	else
+	{
+		hdr.m_codec = DENSEV2_CODEC_INT16;
+		maxcode = UINT16_MAX;
+	}
+	hdr.m_offset = job.m_codeOffset;
+	hdr.m_gain = job.m_codeGain;
+
+	auto quantize = [&](size_t i)
+	{
+		float v = samples[i];
+		if(!isfinite(v))
+			return 0.0;
+		return min(maxcode, max(0.0, round( (v - hdr.m_offset) / hdr.m_gain )));
+	};
+
+	AsyncFileWriter fp(m_preferences.GetBool("Files.async_writes"));
+	if(!fp.Open(job.m_path))
+		return false;
+
+	bool ok = true;
+	if(!fp.Write(&hdr, sizeof(hdr)))
+	{
+		LogError("file write error\n");
+		ok = false;
+	}
+
+	if(hdr.m_codec == DENSEV2_CODEC_INT8)
+	{
+		ok = ok && WriteInterleavedBlocks<uint8_t>(fp, len, [&](size_t i)
+			{ return static_cast<uint8_t>(quantize(i)); });
+	}
+	else
+	{
+		ok = ok && WriteInterleavedBlocks<uint16_t>(fp, len, [&](size_t i)
+			{ return static_cast<uint16_t>(quantize(i)); });
+	}
+
+	if(!fp.Close() && ok)
+	{
+		LogError("file write error\n");
+		ok = false;
+	}
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Trigger group management
+
+/**
+	@brief Remove trigger groups with no instruments in them
+
+	Removes a maximum of one group per invocation.
+ */
+void Session::GarbageCollectTriggerGroups()
+{
+	lock_guard lock(m_triggerGroupMutex);
+
+	for(size_t i=0; i<m_triggerGroups.size(); i++)
+	{
+		if(m_triggerGroups[i]->empty())
+		{
+			LogTrace("Garbage collecting trigger group\n");
+			m_triggerGroups.erase(m_triggerGroups.begin() + i);
+			return;
+		}
+	}
+}
+
+/**
+	@brief Creates a new trigger group containing only the selected scope
+ */
+void Session::MakeNewTriggerGroup(shared_ptr<Oscilloscope> scope)
+{
+	lock_guard lock(m_triggerGroupMutex);
+	m_triggerGroups.push_back(make_shared<TriggerGroup>(scope, this));
+}
+
+void Session::MakeNewTriggerGroup(PausableFilter* filter)
+{
+	lock_guard lock(m_triggerGroupMutex);
+	auto group = make_shared<TriggerGroup>(nullptr, this);
+	group->m_default = false;
+	group->AddFilter(filter);
+	m_triggerGroups.push_back(group);
+}
+
+/**
+	@brief Starts tracking drift of a secondary instrument's skew in the background
+
+	Replaces any tracker already running for the same instrument.
+
+	@param secondary		The secondary instrument
+	@param primaryStream	Reference channel on the primary of the secondary's trigger group
+	@param secondaryStream	Same signal as seen by the secondary
+	@param interval			Minimum time between measurements, in seconds
+	@param smoothing		Weight given to each new measurement, in the range (0, 1]
+	@param minCorrelation	Measurements with a correlation below this are discarded
+ */
+void Session::StartDeskewTracking(
+	shared_ptr<Oscilloscope> secondary,
+	StreamDescriptor primaryStream,
+	StreamDescriptor secondaryStream,
+	double interval,
+	float smoothing,
+	float minCorrelation)
+{
+	if(!DeskewCorrelator::IsAvailable())
+	{
+		LogError("Background deskew tracking requires GPU correlation support\n");
+		return;
+	}
+
+	//Shut down the old one before spinning up a new one, so they don't fight
+	m_deskewTrackers.erase(secondary);
+	m_deskewTrackers[secondary] = make_shared<DeskewTracker>(
+		this, secondary, primaryStream, secondaryStream, interval, smoothing, minCorrelation);
+}
+
+/**
+	@brief Stops background deskew tracking of a secondary instrument, keeping the last calibration
+ */
+void Session::StopDeskewTracking(shared_ptr<Oscilloscope> secondary)
+{
+	m_deskewTrackers.erase(secondary);
+}
+
+/**
+	@brief Check if a scope is the primary of a group containing at least one other scope
+ */
+bool Session::IsPrimaryOfMultiScopeGroup(shared_ptr<Oscilloscope> scope)
+{
+	lock_guard lock(m_triggerGroupMutex);
+	for(auto group : m_triggerGroups)
+	{
+		if( (group->m_primary == scope) && !group->m_secondaries.empty())
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Check if a scope is a secondary within a multiscope group
+ */
+bool Session::IsSecondaryOfMultiScopeGroup(shared_ptr<Oscilloscope> scope)
+{
+	lock_guard lock(m_triggerGroupMutex);
+	for(auto group : m_triggerGroups)
+	{
+		//if primary we can't also be a secondary so stop looking
+		if(group->m_primary == scope)
+			return false;
+
+		for(auto sec : group->m_secondaries)
+		{
+			if(sec == scope)
+				return true;
+		}
+	}
+	return false;
+}
+
+/**
+	@brief Gets the trigger group that contains a specified scope
+ */
+shared_ptr<TriggerGroup> Session::GetTriggerGroupForScope(shared_ptr<Oscilloscope> scope)
+{
+	lock_guard lock(m_triggerGroupMutex);
+	for(auto group : m_triggerGroups)
+	{
+		if(group->m_primary == scope)
+			return group;
+
+		for(auto sec : group->m_secondaries)
+		{
+			if(sec == scope)
+				return group;
+		}
+	}
+
+	//should never get here
+	LogError("Scope is not part of a trigger group!\n");
+	return nullptr;
+}
+
+/**
+	@brief Gets the trigger group that contains a specified filter
+ */
+shared_ptr<TriggerGroup> Session::GetTriggerGroupForFilter(PausableFilter* filter)
+{
+	lock_guard lock(m_triggerGroupMutex);
+	for(auto group : m_triggerGroups)
+	{
+		for(auto f : group->m_filters)
+		{
+			if(f == filter)
+				return group;
+		}
+	}
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instrument management
+
+void Session::ApplyPreferences(shared_ptr<Oscilloscope> scope)
+{
+	//Apply driver-specific preference settings
+	auto lecroy = dynamic_pointer_cast<LeCroyOscilloscope>(scope);
+	if(lecroy)
+	{
+		if(m_preferences.GetBool("Drivers.Teledyne LeCroy.force_16bit"))
+			lecroy->ForceHDMode(true);
+
+		//else auto resolution depending on instrument type
+	}
+	auto siglent = dynamic_pointer_cast<SiglentSCPIOscilloscope>(scope);
+	if(siglent)
+	{
+		auto dataWidth = m_preferences.GetEnumRaw("Drivers.Siglent SDS HD.data_width");
+		if(dataWidth == WIDTH_8_BITS)
+		{
+			siglent->ForceHDMode(false);
+		}
+		else if(dataWidth == WIDTH_16_BITS)
+		{
+			siglent->ForceHDMode(true);
+		}
+	}
+	auto rigol = dynamic_pointer_cast<RigolOscilloscope>(scope);
+	if(rigol)
+	{
+		auto dataWidth = m_preferences.GetEnumRaw("Drivers.Rigol DHO.data_width");
+		if(dataWidth == WIDTH_8_BITS)
+		{
+			rigol->ForceHDMode(false);
+		}
+		else if(dataWidth == WIDTH_16_BITS)
+		{
+			rigol->ForceHDMode(true);
+		}
+	}
+}
+
+/**
+	@brief Starts the WaveformThread if we don't already have one
+ */
+void Session::StartWaveformThreadIfNeeded()
+{
+	if(m_waveformThread == nullptr)
+		m_waveformThread = make_unique<thread>(WaveformThread, this, &m_shuttingDown);
+}
+
+/**
+	@brief Creates a driver instance for an instrument of the given type
+
+	@param type			Instrument type, as used in m_driverNamesByType (e.g. "psu")
+	@param driver		Driver name
+	@param transport	Transport to the instrument
+
+	@return The new instrument, or null if the type or driver is unknown
+ */
+shared_ptr<Instrument> Session::CreateInstrumentDriver(
+	const string& type,
+	const string& driver,
+	SCPITransport* transport)
+{
+	shared_ptr<Instrument> inst = nullptr;
+
+	if(type == "bert")
+		inst = SCPIBERT::CreateBERT(driver, transport);
+	else if(type == "funcgen")
+		inst = SCPIFunctionGenerator::CreateFunctionGenerator(driver, transport);
+	else if(type == "load")
+		inst = SCPILoad::CreateLoad(driver, transport);
+	else if(type == "misc")
+		inst = SCPIMiscInstrument::CreateInstrument(driver, transport);
+	else if(type == "multimeter")
+		inst = SCPIMultimeter::CreateMultimeter(driver, transport);
+	else if(type == "psu")
+		inst = SCPIPowerSupply::CreatePowerSupply(driver, transport);
+	else if(type == "rfgen")
+		inst = SCPIRFSignalGenerator::CreateRFSignalGenerator(driver, transport);
+	else if(type == "sdr")
+		inst = SCPISDR::CreateSDR(driver, transport);
+	else if(type == "oscilloscope")
+		inst = SCPIOscilloscope::CreateOscilloscope(driver, transport);
+	else if(type == "spectrometer")
+		inst = SCPISpectrometer::CreateSpectrometer(driver, transport);
+	else if(type == "vna")
+		inst = SCPIVNA::CreateVNA(driver, transport);
+
+	return inst;
+}
+
+/**
+	@brief Creates a new instrument and adds it to the session
+ */
+void Session::CreateAndAddInstrument(const string& driver, SCPITransport* transport, const string& nickname)
+{
+	shared_ptr<Instrument> inst = nullptr;
+
+	//Search all types of instrument until we find the right one
+	//TODO: unify this when we get rid of this ugliness
+	for(auto it : m_driverNamesByType)
+	{
+		auto type = it.first;
+		auto& drivers = it.second;
+
+		for(auto name : drivers)
+		{
+			if(name == driver)
+			{
+				inst = CreateInstrumentDriver(type, driver, transport);
+				break;
+			}
+		}
+
+		if(inst)
+			break;
+	}
+
+	//If we couldn't make it, abort
+	if(!inst)
+	{
+		m_mainWindow->ShowErrorPopup(
+			"Driver error",
+			"Failed to create instrument driver instance of type \"" + driver + "\"");
+		delete transport;
+		return;
+	}
+
+	//Apply preference settings, if any, here
+	auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
+	if(scope)
+		ApplyPreferences(scope);
+
+	inst->m_nickname = nickname;
+	AddInstrument(inst);
+}
+
+/**
+	@brief Adds a new instrument to the session
+
+	@param inst				The instment to add
+	@param createDialogs	True if we should add waveform areas for each enabled channel
+							and/or dialogs if applicable
+ */
+void Session::AddInstrument(shared_ptr<Instrument> inst, bool createDialogs)
+{
+	m_modifiedSinceLastSave = true;
+
+	lock_guard lock(m_scopeMutex);
+
+	auto si = dynamic_pointer_cast<SCPIInstrument>(inst);
+	InstrumentThreadArgs args(si, this);
+
+	//Create shared state, if needed
+	auto psu = dynamic_pointer_cast<SCPIPowerSupply>(inst);
+	auto meter = dynamic_pointer_cast<SCPIMultimeter>(inst);
+	auto generator = dynamic_pointer_cast<SCPIFunctionGenerator>(inst);
+	auto load = dynamic_pointer_cast<SCPILoad>(inst);
+	auto bert = dynamic_pointer_cast<SCPIBERT>(inst);
+	auto rfgen = dynamic_pointer_cast<SCPIRFSignalGenerator>(inst);
+	auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
+	auto types = inst->GetInstrumentTypes();
+	if(psu && (types & Instrument::INST_PSU) )
+	{
+		auto state = make_shared<PowerSupplyState>(psu->GetChannelCount());
+		m_psus[psu] = state;
+		args.psustate = state;
+	}
+	if(meter && (types & Instrument::INST_DMM) )
+	{
+		auto state = make_shared<MultimeterState>();
+		m_meters[meter] = state;
+		args.meterstate = state;
+	}
+	if(load && (types & Instrument::INST_LOAD) )
+	{
+		auto state = make_shared<LoadState>(load->GetChannelCount());
+		m_loads[load] = state;
+		args.loadstate = state;
+	}
+	if(bert && (types & Instrument::INST_BERT) )
+	{
+		auto state = make_shared<BERTState>(bert->GetChannelCount());
+		m_berts[bert] = state;
+		args.bertstate = state;
+	}
+	if(scope && (types & Instrument::INST_OSCILLOSCOPE))
+	{
+		m_oscilloscopes.push_back(scope);
+		if(m_oscilloscopes.size() > 1)
+			m_multiScope = true;
+	}
+	if(generator && (types & Instrument::INST_FUNCTION) )
+	{
+		auto state = make_shared<FunctionGeneratorState>(generator);
+
+		m_awgs[generator] = state;
+		args.awgstate = state;
+	}
+
+	//Make the instrument thread.
+	//Scopes always get their own, since trigger polling is latency critical, but everything else can optionally
+	//share a small pool of threads
+	if(si)
+	{
+		auto& prefs = GetPreferences();
+		if(!scope && prefs.GetBool("Drivers.General.shared_polling"))
+		{
+			if(!m_pollingScheduler)
+			{
+				m_pollingScheduler = make_unique<PollingScheduler>(
+					prefs.GetInt("Drivers.General.shared_polling_threads"));
+			}
+			m_instrumentStates[inst] = make_shared<InstrumentConnectionState>(
+				args, m_pollingScheduler.get(), prefs.GetReal("Drivers.General.shared_polling_rate"));
+		}
+		else
+			m_instrumentStates[inst] = make_shared<InstrumentConnectionState>(args);
+	}
+	m_instrumentSnapshot = nullptr;
+
+	//Spawn dialogs/views if requested
+	if(createDialogs)
+	{
+		if(psu && (types & Instrument::INST_PSU) )
+			m_mainWindow->AddDialog(make_shared<PowerSupplyDialog>(psu, args.psustate, this));
+		if(meter && (types & Instrument::INST_DMM) )
+			m_mainWindow->AddDialog(make_shared<MultimeterDialog>(meter, args.meterstate, this));
+		if(generator && (types & Instrument::INST_FUNCTION) )
+		{
+			//If it's also a scope, don't show the generator dialog by default
+			//TODO: only if generator is currently producing a signal or something?
+			if(!scope)
+				m_mainWindow->AddDialog(make_shared<FunctionGeneratorDialog>(generator, args.awgstate, this));
+		}
+		if(load && (types & Instrument::INST_LOAD) )
+			m_mainWindow->AddDialog(make_shared<LoadDialog>(load, args.loadstate, this));
+		if(bert && (types & Instrument::INST_BERT) )
+			m_mainWindow->AddDialog(make_shared<BERTDialog>(bert, args.bertstate, this));
+		if(rfgen && (types & Instrument::INST_RF_GEN) )
+			m_mainWindow->AddDialog(make_shared<RFGeneratorDialog>(rfgen, this));
+	}
+	if(scope)
+	{
+		m_mainWindow->OnScopeAdded(scope, createDialogs);
+		if(!scope->IsOffline())
+			MakeNewTriggerGroup(scope);
+	}
+
+	m_mainWindow->AddToRecentInstrumentList(si);
+
+	StartWaveformThreadIfNeeded();
+}
+
+/**
+	@brief Removes an instrument from the session
+ */
+void Session::RemoveInstrument(shared_ptr<Instrument> inst)
+{
+	m_modifiedSinceLastSave = true;
+
+	//Remove instrument-specific state
+	auto psu = dynamic_pointer_cast<SCPIPowerSupply>(inst);
+	auto meter = dynamic_pointer_cast<SCPIMultimeter>(inst);
+	auto load = dynamic_pointer_cast<SCPILoad>(inst);
+	auto bert = dynamic_pointer_cast<SCPIBERT>(inst);
+	{
+		lock_guard lock(m_scopeMutex);
+		if(psu)
+			m_psus.erase(psu);
+		if(meter)
+			m_meters.erase(meter);
+		if(load)
+			m_loads.erase(load);
+		if(bert)
+			m_berts.erase(bert);
+		m_instrumentSnapshot = nullptr;
+	}
+
+	//TODO: find anything that might reference our channels and set those inputs to null
+
+	//Stop any deskew tracking involving this instrument
+	for(auto it = m_deskewTrackers.begin(); it != m_deskewTrackers.end(); )
+	{
+		auto group = GetTriggerGroupForScope(it->first);
+		if( (it->first == inst) || (group && (group->m_primary == inst)) )
+			it = m_deskewTrackers.erase(it);
+		else
+			it ++;
+	}
+
+	//Forget any channels consume-driven acquisition was tracking, and any golden references on them
+	{
+		auto scope = dynamic_cast<Oscilloscope*>(inst.get());
+		m_consumeScansPending.erase(scope);
+		lock_guard<mutex> lock(m_consumeResultsMutex);
+		for(auto it = m_consumeResults.begin(); it != m_consumeResults.end(); )
+		{
+			if(it->m_scope == scope)
+				it = m_consumeResults.erase(it);
+			else
+				it ++;
+		}
+	}
+	for(size_t i=0; i<inst->GetChannelCount(); i++)
+	{
+		auto chan = dynamic_cast<OscilloscopeChannel*>(inst->GetChannel(i));
+		m_autoDisabledChannels.erase(chan);
+		m_consumeExemptChannels.erase(chan);
+
+		lock_guard<mutex> lock(m_referenceComparerMutex);
+		for(auto it = m_referenceComparers.begin(); it != m_referenceComparers.end(); )
+		{
+			if(it->first.m_channel == chan)
+				it = m_referenceComparers.erase(it);
+			else
+				it ++;
+		}
+	}
+
+	//Clear worker threads etc
+	m_instrumentStates.erase(inst);
+
+	lock_guard lock(m_scopeMutex);
+	m_instrumentSnapshot = nullptr;
+}
+
+/**
+	@brief Adds a multimeter dialog to the session
+
+	Low level helper, intended to be only used by file loading
+ */
+void Session::AddMultimeterDialog(shared_ptr<SCPIMultimeter> meter)
+{
+	m_mainWindow->AddDialog(make_shared<MultimeterDialog>(meter, m_meters[meter], this));
+}
+
+/**
+	@brief Gets the current list of connected instruments and their channels
+
+	The snapshot is shared and never modified, so it can be kept as long as needed. It's rebuilt on the next call after
+	an instrument is added or removed; compare m_epoch to tell if anything changed.
+ */
+shared_ptr<const InstrumentSnapshot> Session::GetInstrumentSnapshot()
+{
+	lock_guard lock(m_scopeMutex);
+	if(m_instrumentSnapshot)
+		return m_instrumentSnapshot;
+
+	auto snapshot = make_shared<InstrumentSnapshot>(++m_instrumentEpoch);
+	auto& insts = snapshot->m_instruments;
+	for(auto& scope : m_oscilloscopes)
+		insts.emplace(scope);
+	for(auto& it : m_psus)
+		insts.emplace(it.first);
+	for(auto& it : m_berts)
+		insts.emplace(it.first);
+	for(auto& it : m_meters)
+		insts.emplace(it.first);
+	for(auto& it : m_loads)
+		insts.emplace(it.first);
+	for(auto& it : m_instrumentStates)
+		insts.emplace(it.first);
+
+	for(auto& inst : insts)
+	{
+		auto s = dynamic_pointer_cast<SCPIInstrument>(inst);
+		if(s != nullptr)
+			snapshot->m_scpiInstruments.emplace(s);
+
+		for(size_t i=0; i<inst->GetChannelCount(); i++)
+			snapshot->m_channels.emplace(inst->GetChannel(i));
+	}
+
+	m_instrumentSnapshot = snapshot;
+	return snapshot;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Trigger control
+
+/**
+	@brief Arms the trigger for all trigger groups
+
+	@param type		Type of trigger to start
+	@param all		If true, arm all groups in the sesison.
+					If false, only stop groups with the "default" flag set
+ */
+void Session::ArmTrigger(TriggerGroup::TriggerType type, bool all)
+{
+	LogTrace("Arming trigger\n");
+	LogIndenter li;
+
+	bool oneshot = (type == TriggerGroup::TRIGGER_TYPE_FORCED) || (type == TriggerGroup::TRIGGER_TYPE_SINGLE);
+	m_triggerOneShot = oneshot;
+
+	//Live data replaces anything being replayed
+	m_replay.Stop();
+
+	if(!HasOnlineScopes())
+	{
+		m_tArm = GetTime();
+		m_triggerArmed = true;
+		return;
+	}
+
+	m_tPrimaryTrigger = -1;
+
+	/*
+		If we have multiple scopes, always use single trigger to keep them synced.
+		Multi-trigger can lead to race conditions and dropped triggers if we're still downloading a secondary
+		instrument's waveform and the primary re-arms.
+
+		Also, order of arming is critical. Secondaries must be completely armed before the primary (instrument 0) to
+		ensure that the primary doesn't trigger until the secondaries are ready for the event.
+	*/
+
+	//Arm each trigger group (if it's defaulted)
+	{
+		lock_guard lock(m_triggerGroupMutex);
+		for(auto& group : m_triggerGroups)
+		{
+			if(group->m_default || all)
+				group->Arm(type);
+		}
+	}
+
+	LogTrace("All instruments are armed\n");
+	m_tArm = GetTime();
+	m_triggerArmed = true;
+
+	//Start polling right away rather than at the next idle poll
+	WakeInstrumentThreads();
+}
+
+/**
+	@brief Stop the trigger for the session
+
+	@param all		If true, stop all groups in the sesison.
+					If false, only stop groups with the "default" flag set
+ */
+void Session::StopTrigger(bool all)
+{
+	m_triggerArmed = false;
+	m_replay.Stop();
+
+	lock_guard wlock(m_waveformWriterMutex);
+	lock_guard lock(m_waveformDataMutex);
+	lock_guard lock2(m_triggerGroupMutex);
+	for(auto& group : m_triggerGroups)
+	{
+		if(group->m_default || all)
+			group->Stop();
+	}
+
+	WakeInstrumentThreads();
+}
+
+/**
+	@brief Wakes all instrument polling threads so they react to a state change without waiting for their next poll
+ */
+void Session::WakeInstrumentThreads()
+{
+	lock_guard lock(m_scopeMutex);
+	for(auto& it : m_instrumentStates)
+	{
+		if(it.second)
+			it.second->m_wakeEvent.Signal();
+	}
+}
+
+/**
+	@brief Returns true if we have at least one scope that isn't offline
+ */
+bool Session::HasOnlineScopes()
+{
+	for(auto scope : m_oscilloscopes)
+	{
+		if(!scope->IsOffline())
+			return true;
+	}
+	return false;
+}
+
+bool Session::CheckForPendingWaveforms()
+{
+	//Replayed history takes the place of the instruments
+	if(m_replay.IsRunning())
+		return m_replay.IsReady();
+
+	lock_guard lock(m_scopeMutex);
+
+	//No online scopes to poll? Re-run the filter graph if we're armed
+	if(!HasOnlineScopes())
+		return m_triggerArmed;
+
+	//Return true if any group has fully triggered
+	lock_guard lock2(m_triggerGroupMutex);
+	for(auto& group : m_triggerGroups)
+	{
+		if(group->CheckForPendingWaveforms())
+			return true;
+	}
+
+	//Nothing ready
+	return false;
+}
+
+/**
+	@brief Pull the waveform data out of the queue and make it current
+
+	The new waveforms are snapshotted into a PendingAcquisition which the GUI thread adds to history later on.
+ */
+/**
+	@brief Records a host-to-device copy of a buffer, if the GPU copy is out of date
+
+	@return True if a copy was recorded
+ */
+template<class T>
+static bool RecordBufferUpload(AcceleratorBuffer<T>& buf, vk::raii::CommandBuffer& cmdbuf)
+{
+	if( (buf.size() == 0) || !buf.IsGpuBufferStale() )
+		return false;
+
+	buf.PrepareForGpuAccessNonblocking(false, cmdbuf);
+	return true;
+}
+
+/**
+	@brief Records copies of every freshly downloaded waveform to the GPU
+
+	Called by the WaveformThread right after DownloadWaveforms(), so the copies can run on their own queue while the
+	previous acquisition is still being rasterized.
+
+	Waveforms which are already up to date on the GPU (or have no samples) are skipped.
+
+	The buffers are marked as current on the GPU as soon as their copies are recorded. So the caller must hold the
+	waveform data mutex exclusively until the command buffer completes, or someone else could read them early.
+
+	@param cmdbuf	Command buffer to record into. Must be in the recording state.
+
+	@return True if any copies were recorded
+ */
+bool Session::RecordWaveformUploads(vk::raii::CommandBuffer& cmdbuf)
+{
+	TRACE_ZONE("RecordWaveformUploads");
+
+	lock_guard lock(m_scopeMutex);
+
+	bool recorded = false;
+	for(auto scope : m_oscilloscopes)
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan || !scope->IsChannelEnabled(i))
+				continue;
+
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				auto data = chan->GetData(j);
+				if(!data)
+					continue;
+
+				auto sparse = dynamic_cast<SparseWaveformBase*>(data);
+				if(sparse)
+				{
+					recorded |= RecordBufferUpload(sparse->m_offsets, cmdbuf);
+					recorded |= RecordBufferUpload(sparse->m_durations, cmdbuf);
+				}
+
+				auto ua = dynamic_cast<UniformAnalogWaveform*>(data);
+				auto sa = dynamic_cast<SparseAnalogWaveform*>(data);
+				auto ud = dynamic_cast<UniformDigitalWaveform*>(data);
+				auto sd = dynamic_cast<SparseDigitalWaveform*>(data);
+				if(ua)
+					recorded |= RecordBufferUpload(ua->m_samples, cmdbuf);
+				else if(sa)
+					recorded |= RecordBufferUpload(sa->m_samples, cmdbuf);
+				else if(ud)
+					recorded |= RecordBufferUpload(ud->m_samples, cmdbuf);
+				else if(sd)
+					recorded |= RecordBufferUpload(sd->m_samples, cmdbuf);
+			}
+		}
 	}
 
-	return true;
+	if(recorded)
+		AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(cmdbuf);
+	return recorded;
 }
 
-shared_ptr<TriggerGroup> Session::GetTrendFilterGroup()
+void Session::DownloadWaveforms()
 {
-	//Make sure the group is only trend filters (if it exists)
-	if(m_trendTriggerGroup != nullptr)
+	TRACE_ZONE("DownloadWaveforms");
+	double tstart = GetTime();
 	{
-		if(m_trendTriggerGroup->HasScopes())
-			m_trendTriggerGroup = nullptr;
-		else
-			return m_trendTriggerGroup;
+		lock_guard lock(m_perfClockMutex);
+		m_waveformDownloadRate.Tick();
 	}
 
-	//See if there is an existing filter-only group we can claim as the trend group
-	else
+	unique_lock wlock(m_waveformWriterMutex);
+	unique_lock lock(m_waveformDataMutex);
+	unique_lock lock2(m_scopeMutex);
+	unique_lock lock3(m_triggerGroupMutex);
+
+	//New data is live, not from history
+	SetFilterHistoryPoint(nullptr);
+	m_lastWaveformDownloadDepth = 0;
+	m_inFlightLatency = nullptr;
+	m_inFlightPoint = nullptr;
+	m_lastDownloadedGroups.clear();
+
+	if(m_replay.IsRunning())
 	{
-		lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-		for(auto g : m_triggerGroups)
-		{
-			if(!g->HasScopes() && !g->empty())
-			{
-				m_trendTriggerGroup = g;
-				return m_trendTriggerGroup;
-			}
-		}
+		DownloadReplayedWaveforms(tstart);
+		return;
 	}
 
-	//We don't have a group yet, make it
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	m_trendTriggerGroup = make_shared<TriggerGroup>(nullptr, this);
-	m_trendTriggerGroup->m_default = false;
-	m_triggerGroups.push_back(m_trendTriggerGroup);
+	//Get the data from each  trigger group
+	PendingAcquisition acq;
+	acq.m_downloadTime = tstart;
+	vector<shared_ptr<Oscilloscope>> scopes;
+	for(auto group : m_triggerGroups)
+	{
+		if(!group->CheckForPendingWaveforms())
+			continue;
 
-	LogTrace("Making trend filter group\n");
+		group->DownloadWaveforms();
+		m_lastWaveformDownloadDepth = max(m_lastWaveformDownloadDepth.load(), group->GetLastDownloadDepth());
 
-	return m_trendTriggerGroup;
-}
+		//This group has recently triggered and should be added to history
+		acq.m_groups.emplace(group);
+		scopes.push_back(group->m_primary);
+		for(auto scope : group->m_secondaries)
+			scopes.push_back(scope);
+	}
 
-bool Session::LoadFilters(int /*version*/, const YAML::Node& node)
-{
-	//No protocol decodes? Skip this section
-	if(!node)
-		return true;
+	m_lastDownloadedGroups = acq.m_groups;
 
-	//Load each decode
-	for(auto it : node)
-	{
-		auto dnode = it.second;
+	//Snapshot the new waveforms before the next acquisition can replace them
+	acq.m_point = HistoryManager::CreateHistoryPoint(scopes);
+	vector<PendingAcquisition> segments;
+	segments.push_back(acq);
 
-		//Create the decode
-		auto proto = dnode["protocol"].as<string>();
-		auto filter = Filter::CreateFilter(proto, dnode["color"].as<string>());
-		if(filter == NULL)
+	//Segmented (fast frame) captures queue up many triggers at once. Pull the rest of them straight into history
+	//rather than running the filter graph and rendering for each one: only the last segment is displayed.
+	size_t maxSegments = max((int64_t)1, m_preferences.GetInt("Performance.Waveform Processing.segment_batch_size"));
+	while(segments.size() < maxSegments)
+	{
+		PendingAcquisition seg;
+		seg.m_downloadTime = GetTime();
+		vector<shared_ptr<Oscilloscope>> segScopes;
+		for(auto group : acq.m_groups)
 		{
-			m_mainWindow->ShowErrorPopup(
-				"Filter creation failed",
-				string("Unable to create filter \"") + proto + "\". Skipping...\n");
-			continue;
-		}
+			//Data being appended to the current waveform isn't a new segment
+			if(group->m_primary->IsAppendingToWaveform() || !group->CheckForPendingWaveforms())
+				continue;
 
-		m_idtable.emplace(dnode["id"].as<uintptr_t>(), filter);
+			group->DownloadWaveforms();
+			m_lastWaveformDownloadDepth = max(m_lastWaveformDownloadDepth.load(), group->GetLastDownloadDepth());
+			seg.m_groups.emplace(group);
+			segScopes.push_back(group->m_primary);
+			for(auto scope : group->m_secondaries)
+				segScopes.push_back(scope);
+		}
+		if(seg.m_groups.empty())
+			break;
 
-		//Load parameters during the first pass.
-		//Parameters can't have dependencies on other channels etc.
-		//More importantly, parameters may change bus width etc
-		filter->LoadParameters(dnode, m_idtable);
+		{
+			lock_guard lock(m_perfClockMutex);
+			m_waveformDownloadRate.Tick();
+		}
+		seg.m_point = HistoryManager::CreateHistoryPoint(segScopes);
+		segments.push_back(seg);
+	}
 
-		//Create protocol analyzers
-		auto pd = dynamic_cast<PacketDecoder*>(filter);
-		if(pd)
-			AddPacketFilter(pd);
+	//Number the segments so the history dialog can group them
+	if(segments.size() > 1)
+	{
+		LogTrace("Downloaded %zu segments\n", segments.size());
+		auto first = segments[0].m_point->m_time;
+		for(size_t i=0; i<segments.size(); i++)
+		{
+			auto& pt = segments[i].m_point;
+			pt->m_segmentGroup = first;
+			pt->m_segmentIndex = i;
+			pt->m_segmentCount = segments.size();
+		}
+	}
 
-		//Resize eye patterns to a reasonable default size
-		//TODO: ngscopeclient should save actual size
-		auto eye = dynamic_cast<EyePattern*>(filter);
-		if(eye)
+	//Only the last segment is displayed, so that's the one whose trip to the screen gets timed
+	auto& displayed = segments.back();
+	m_inFlightPoint = displayed.m_point;
+	if(!displayed.m_groups.empty())
+	{
+		auto latency = make_shared<AcquisitionLatency>();
+		double triggered = 0;
+		double popped = 0;
+		for(auto& g : displayed.m_groups)
 		{
-			eye->SetWidth(512);
-			eye->SetHeight(512);
+			double t = g->GetLastReadyTime();
+			latency->m_groups.push_back(pair(g, t));
+			if( (triggered == 0) || (t < triggered) )
+				triggered = t;
+			popped = max(popped, g->GetLastPopTime());
 		}
+		latency->Mark(AcquisitionLatency::STAGE_TRIGGER, triggered);
+		latency->Mark(AcquisitionLatency::STAGE_DOWNLOADED, popped);
+		displayed.m_latency = latency;
+		m_inFlightLatency = latency;
 	}
 
-	//Make a second pass to configure the filter inputs, once all of them have been instantiated.
-	//Filters may depend on other filters as inputs, and serialization is not guaranteed to be a topological sort.
-	for(auto it : node)
+	//Accumulations take every segment, not just the last one
+	for(auto f : GetAccumulateFilters())
 	{
-		auto dnode = it.second;
-		auto filter = static_cast<Filter*>(m_idtable[dnode["id"].as<uintptr_t>()]);
-		if(filter)
-			filter->LoadInputs(dnode, m_idtable);
+		for(auto& seg : segments)
+			f->OnNewPoint(seg.m_point);
 	}
 
-	return true;
-}
+	//Optionally re-arm multi-scope groups as soon as we're done here, rather than once the GUI has displayed the
+	//acquisition. Any trigger which comes in before then just waits in the scopes' pending queues.
+	bool rearm = m_preferences.GetBool("Performance.Waveform Processing.early_multiscope_rearm");
+	if(rearm)
+	{
+		for(auto& seg : segments)
+			seg.m_rearmed = true;
+	}
 
-bool Session::LoadInstrumentInputs(int /*version*/, const YAML::Node& node)
-{
-	//Nothing to do? Skip this section
-	if(!node)
-		return true;
+	//Waveforms were popped off the scopes' queues, so let any polling thread waiting for room carry on
+	for(auto& scope : scopes)
+	{
+		auto it = m_instrumentStates.find(scope);
+		if( (it != m_instrumentStates.end()) && it->second)
+			it->second->m_wakeEvent.Signal();
+	}
 
-	//Check each instrument in the file and see if we have inputs that need to be hooked up
-	//Load each instrument
-	for(auto it : node)
 	{
-		auto inst = it.second;
-		auto nick = inst["nick"].as<string>();
-		LogTrace("Loading additional inputs for instrument \"%s\"\n", nick.c_str());
+		lock_guard<mutex> lock4(m_pendingAcquisitionMutex);
+		for(auto& seg : segments)
+			m_pendingAcquisitions.push_back(seg);
+	}
 
-		auto pinst = reinterpret_cast<Instrument*>(m_idtable[inst["id"].as<uintptr_t>()]);
-		if(!pinst)
-			continue;
+	//The filter graph only runs on the last segment, so that's the only one mask tests and retention rules can check.
+	//Earlier segments are kept as usual.
+	for(size_t i=0; i+1 < segments.size(); i++)
+	{
+		auto& pt = segments[i].m_point;
+		pt->m_maskTestResult = HistoryPoint::MASK_NOT_TESTED;
+		pt->m_referenceResult = HistoryPoint::REFERENCE_NOT_TESTED;
+		pt->m_retentionDecision = RetentionPolicy::DECISION_NONE;
+	}
+	m_policyPoint = segments.back().m_point;
+	m_thumbnailAcquisitions.insert(m_thumbnailAcquisitions.end(), segments.begin(), segments.end());
 
-		for(size_t i=0; i<pinst->GetChannelCount(); i++)
-		{
-			auto chan = pinst->GetChannel(i);
-			auto key = "ch" + to_string(i);
-			auto channelNode = inst["channels"][key];
+	//If we're in offline one-shot mode, disarm the trigger
+	if( m_triggerGroups.empty() && m_triggerOneShot)
+		m_triggerArmed = false;
 
-			if(channelNode)
-				chan->LoadInputs(channelNode, m_idtable);
-		}
+	m_lastWaveformDownloadTime = (GetTime() - tstart) * FS_PER_SECOND;
+	m_metricHistory.Record("Download time", m_lastWaveformDownloadTime);
+	//Arming takes a round trip to every scope, so don't keep the GUI waiting on our locks in the meantime
+	if(rearm)
+	{
+		lock3.unlock();
+		lock2.unlock();
+		lock.unlock();
+		for(auto& group : acq.m_groups)
+			group->RearmIfMultiScope();
 	}
+}
 
-	return true;
+/**
+	@brief Decides if the acquisition DownloadWaveforms() just fetched should be drawn before running the filter graph
+
+	Deep captures can take a long time to filter. Rather than showing nothing new until every filter has run, the
+	WaveformThread can rasterize the raw instrument channels first as a preview, then draw everything once the
+	filter graph is done.
+
+	@return True if preview rendering is enabled and the last download was at least the configured depth
+ */
+bool Session::ShouldPreviewAcquisition()
+{
+	if(!m_preferences.GetBool("Performance.Waveform Processing.preview_before_filters"))
+		return false;
+
+	auto minDepth = m_preferences.GetInt("Performance.Waveform Processing.preview_min_depth");
+	return m_lastWaveformDownloadDepth >= (size_t)max((int64_t)1, minDepth);
 }
 
 /**
-	@brief Serialize the configuration for all oscilloscopes
+	@brief Loads the next replayed history point into the scopes, in place of downloading new waveforms
+
+	The point is treated as live data so the whole filter graph runs on it, rather than restoring any outputs saved
+	with it. It's already in history, so it isn't evaluated against retention policies or added again.
+
+	The caller must hold the waveform writer, waveform data, and scope mutexes.
+
+	@param tstart	Time the download started
  */
-YAML::Node Session::SerializeInstrumentConfiguration()
+void Session::DownloadReplayedWaveforms(double tstart)
 {
-	YAML::Node node;
+	auto pt = m_replay.Pop();
+	if(!pt)
+		return;
 
-	auto instruments = GetInstruments();
-	for(auto inst : instruments)
+	pt->AttachToScopes(m_oscilloscopes);
+
+	PendingAcquisition acq;
+	acq.m_point = pt;
+	acq.m_downloadTime = tstart;
+	acq.m_replayed = true;
+	m_inFlightPoint = pt;
 	{
-		auto config = inst->SerializeConfiguration(m_idtable);
-		auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
-		if(scope)
-		{
-			if(m_scopeDeskewCal.find(scope) != m_scopeDeskewCal.end())
-				config["triggerdeskew"] = m_scopeDeskewCal[scope];
-		}
-		node["inst" + config["id"].as<string>()] = config;
+		lock_guard<mutex> lock(m_pendingAcquisitionMutex);
+		m_pendingAcquisitions.push_back(acq);
 	}
+	m_policyPoint = nullptr;
 
-	return node;
+	m_lastWaveformDownloadTime = (GetTime() - tstart) * FS_PER_SECOND;
+	m_metricHistory.Record("Download time", m_lastWaveformDownloadTime);
 }
 
 /**
-	@brief Serialize the configuration for all protocol decoders
+	@brief Flags every acquisition up to and including one as having its image published to the GUI
+
+	Called by the WaveformThread right before it signals g_waveformReadyEvent.
+
+	@param point	History point of the displayed acquisition. If null (or not pending any more), everything
+					pending is flagged.
  */
-YAML::Node Session::SerializeFilterConfiguration()
+void Session::MarkAcquisitionRendered(shared_ptr<HistoryPoint> point)
 {
-	YAML::Node node;
+	lock_guard<mutex> lock(m_pendingAcquisitionMutex);
 
-	auto set = Filter::GetAllInstances();
-	for(auto d : set)
+	bool found = false;
+	for(auto& acq : m_pendingAcquisitions)
 	{
-		YAML::Node filterNode = d->SerializeConfiguration(m_idtable);
-		node["filter" + filterNode["id"].as<string>()] = filterNode;
+		if(point && (acq.m_point == point) )
+			found = true;
 	}
 
-	return node;
+	for(auto& acq : m_pendingAcquisitions)
+	{
+		acq.m_rendered = true;
+		if(found && (acq.m_point == point) )
+			break;
+	}
 }
 
 /**
-	@brief Serializes metadata about the session / software stack
+	@brief Makes the waveforms of an acquisition current on the instruments they came from
 
-	Not currently used for anything, but might be helpful for troubleshooting etc in the future
+	In pipelined mode, the WaveformThread downloads the next acquisition while the previous one is still being
+	rasterized. It puts the previous acquisition's waveforms back on the scopes until its image has been handed to the
+	GUI, so cursors, measurements and other readouts match what's on screen. Both acquisitions' history points own
+	their waveforms, so swapping between them doesn't copy or free anything.
+
+	@param point	History point of the acquisition
  */
-YAML::Node Session::SerializeMetadata()
+void Session::AttachAcquisition(shared_ptr<HistoryPoint> point)
 {
-	YAML::Node node;
-	node["appver"] = "ngscopeclient " NGSCOPECLIENT_VERSION;
-	node["appdate"] = __DATE__ " " __TIME__;
+	if(!point)
+		return;
 
-	//Format timestamp
-	time_t now = time(nullptr);
-	struct tm ltime;
-#ifdef _WIN32
-	localtime_s(&ltime, &now);
-#else
-	localtime_r(&now, &ltime);
-#endif
-	char sdate[32];
-	char stime[32];
-	strftime(stime, sizeof(stime), "%X", &ltime);
-	strftime(sdate, sizeof(sdate), "%Y-%m-%d", &ltime);
-	node["created"] = string(sdate) + " " + string(stime);
+	lock_guard wlock(m_waveformWriterMutex);
+	lock_guard lock(m_waveformDataMutex);
+	lock_guard lock2(m_scopeMutex);
 
-	return node;
+	//Instruments which didn't trigger keep whatever they had
+	vector<shared_ptr<Oscilloscope>> scopes;
+	for(auto& it : point->m_history)
+	{
+		if(find(m_oscilloscopes.begin(), m_oscilloscopes.end(), it.first) != m_oscilloscopes.end())
+			scopes.push_back(it.first);
+	}
+	point->AttachToScopes(scopes);
 }
 
-YAML::Node Session::SerializeTriggerGroups()
+/**
+	@brief Adds acquisitions downloaded by the WaveformThread to history
+
+	Must be called from the GUI thread, since that's the only thread allowed to modify the history list.
+
+	@param groups			Set of trigger groups which contributed data to any of the committed acquisitions, and
+							haven't been re-armed since
+	@param downloadTimes	Time each committed acquisition started downloading
+	@param renderedOnly		If true, stop at the first acquisition whose image hasn't been published yet, so history
+							and the waveform views stay in step with what's on screen
+ */
+void Session::CommitPendingAcquisitions(
+	set<shared_ptr<TriggerGroup>>& groups,
+	vector<double>& downloadTimes,
+	bool renderedOnly)
 {
-	YAML::Node node;
+	deque<PendingAcquisition> pending;
+	{
+		lock_guard<mutex> lock(m_pendingAcquisitionMutex);
+		while(!m_pendingAcquisitions.empty())
+		{
+			if(renderedOnly && !m_pendingAcquisitions.front().m_rendered)
+				break;
+			pending.push_back(m_pendingAcquisitions.front());
+			m_pendingAcquisitions.pop_front();
+		}
+	}
 
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	LogTrace("Serializing trigger groups (%zu total)\n", m_triggerGroups.size());
-	LogIndenter li;
-	for(auto group : m_triggerGroups)
+	for(auto& acq : pending)
 	{
-		auto gid = m_idtable.emplace(group.get());
+		if(acq.m_replayed)
+		{
+			m_replay.OnDisplayed(acq.m_point);
+			downloadTimes.push_back(acq.m_downloadTime);
+			continue;
+		}
 
-		//Make a node for the group
-		YAML::Node gnode;
+		m_history.AddHistoryPoint(acq.m_point, true, true);
+		if(acq.m_latency)
+			m_latencyAwaitingToneMap.push_back(acq.m_latency);
+		if(m_recorder)
+			m_recorder->Record(acq.m_point);
+		if(m_viewerServer)
+			m_viewerServer->OnNewPoint(acq.m_point);
+		if(m_automationServer)
+			m_automationServer->OnNewPoint(acq.m_point);
+		downloadTimes.push_back(acq.m_downloadTime);
+		if(!acq.m_rearmed)
+		{
+			for(auto& g : acq.m_groups)
+				groups.emplace(g);
+		}
+	}
+}
 
-		//Primary
-		if(group->m_primary)
-			gnode["primary"] = m_idtable[(Instrument*)group->m_primary.get()];
+/**
+	@brief Check if new waveform data has arrived
 
-		//Secondaries
-		YAML::Node secnode;
-		for(size_t i=0; i<group->m_secondaries.size(); i++)
-			secnode[string("sec") + to_string(i)] = m_idtable[(Instrument*)group->m_secondaries[i].get()];
-		gnode["secondaries"] = secnode;
+	This runs in the main GUI thread.
+
+	TODO: this might be best to move to MainWindow?
+
+	@return True if a new waveform came in, false if not
+ */
+bool Session::CheckForWaveforms(vk::raii::CommandBuffer& cmdbuf)
+{
+	bool hadNewWaveforms = false;
+
+	//Let go of anything the recorder has written.
+	//If it's fallen too far behind, leave new waveforms where they are so acquisition stalls until it catches up.
+	bool recorderBackedUp = false;
+	if(m_recorder)
+	{
+		m_recorder->Poll();
+		recorderBackedUp = m_recorder->IsBackedUp();
+	}
+
+	SeedAccumulations();
+
+	if(!recorderBackedUp && g_waveformReadyEvent.Peek())
+	{
+		TRACE_ZONE("CheckForWaveforms");
+		LogTrace("Waveform is ready\n");
+
+		//Add to history
+		//In pipelined mode there may be more than one acquisition waiting for us, but only the ones whose image has
+		//been published are committed. The rest wait for their own ready event.
+		set<shared_ptr<TriggerGroup>> groups;
+		vector<double> downloadTimes;
+		double tcommit = GetTime();
+		{
+			shared_lock lock2(m_waveformDataMutex);
+			CommitPendingAcquisitions(groups, downloadTimes, true);
+		}
+		m_history.ApplyPolicies();
+		m_lastAcquisitionCommitTime = (GetTime() - tcommit) * FS_PER_SECOND;
+		m_metricHistory.Record("Commit time", m_lastAcquisitionCommitTime);
+
+		//Tone-map all of our waveforms
+		//Generally does not need waveform data locked since it only works on the front rasterized buffers...
+		//but density functions like spectrogram are an exception as those don't have a render step.
+		//They only read the waveform data, though, so a shared lock is enough.
+		hadNewWaveforms = true;
+		{
+			shared_lock lock(m_waveformDataMutex);
+			m_mainWindow->ToneMapAllWaveforms(cmdbuf);
+		}
+		MarkLatencyToneMapped();
+
+		//Everything committed is now on screen
+		double now = GetTime();
+		for(auto t : downloadTimes)
+			m_metricHistory.Record("Download to display", (now - t) * FS_PER_SECOND);
+		m_displayedAcquisitionCount += downloadTimes.size();
+
+		//Release the waveform processing thread
+		g_waveformProcessedEvent.Signal();
 
-		//Filters
-		YAML::Node fnode;
-		for(size_t i=0; i<group->m_filters.size(); i++)
-			fnode.push_back(m_idtable[group->m_filters[i]]);
-		gnode["filters"] = fnode;
+		//Let background deskew trackers know there's something new to look at
+		for(auto& it : m_deskewTrackers)
+			it.second->OnNewWaveforms();
 
-		node[string("group") + to_string(gid)] = gnode;
+		//In multi-scope free-run mode, re-arm every instrument's trigger after we've processed all data
+		//(unless the WaveformThread already did so right after downloading it)
+		for(auto group : groups)
+			group->RearmIfMultiScope();
+	}
 
-		gnode["default"] = group->m_default;
+	//If a re-render operation completed (or a preview of an acquisition still being filtered is ready),
+	//tone map everything again
+	if((g_rerenderDoneEvent.Peek() || g_refilterDoneEvent.Peek() || g_waveformPreviewEvent.Peek()) && !hadNewWaveforms)
+	{
+		m_mainWindow->ToneMapAllWaveforms(cmdbuf);
+		MarkLatencyToneMapped();
 	}
 
-	return node;
+	return hadNewWaveforms;
 }
 
-YAML::Node Session::SerializeMarkers()
-{
-	YAML::Node node;
+/**
+	@brief Moves committed acquisitions whose rasterized waveforms have just been tone mapped on to waiting for present
 
-	int nmarker = 0;
-	int nwfm = 0;
-	for(auto it : m_markers)
+	In pipelined mode an acquisition can be committed to history before its own rasterization has been published, in
+	which case it waits for a later tone mapping pass.
+ */
+void Session::MarkLatencyToneMapped()
+{
+	double now = GetTime();
+	while(!m_latencyAwaitingToneMap.empty())
 	{
-		auto key = it.first;
-		auto& markers = it.second;
-		if(markers.empty())
-			continue;
+		auto lat = m_latencyAwaitingToneMap.front();
+		if(!lat->HasReached(AcquisitionLatency::STAGE_RASTERIZED))
+			break;
 
-		YAML::Node markerNode;
-		YAML::Node wfmNode;
-		wfmNode["timestamp"] = key.first;
-		wfmNode["time_fsec"] = key.second;
+		lat->Mark(AcquisitionLatency::STAGE_TONE_MAPPED, now);
+		m_latencyAwaitingPresent.push_back(lat);
+		m_latencyAwaitingToneMap.pop_front();
+	}
 
-		for(auto m : markers)
-		{
-			YAML::Node wfmMarkerNode;
-			wfmMarkerNode["offset"] = m.m_offset;
-			wfmMarkerNode["name"] = m.m_name;
-			wfmNode["markers"]["marker" + to_string(nmarker)] = wfmMarkerNode;
+	//If rasterization was skipped (e.g. during shutdown), don't hang on to the stragglers forever
+	while(m_latencyAwaitingToneMap.size() > MAX_LATENCY_AWAITING_TONE_MAP)
+		m_latencyAwaitingToneMap.pop_front();
+}
 
-			nmarker ++;
-		}
+/**
+	@brief Called by the main window once a frame has been presented, to finish timing the acquisitions in it
 
-		node["wfm" + to_string(nwfm)] = wfmNode;
+	@param now	Time the frame was queued for presentation
+ */
+void Session::OnFramePresented(double now)
+{
+	if(m_latencyAwaitingPresent.empty())
+		return;
 
-		nwfm ++;
+	for(auto& lat : m_latencyAwaitingPresent)
+	{
+		lat->Mark(AcquisitionLatency::STAGE_PRESENTED, now);
+		m_latencyTracker.Record(*lat);
+		m_metricHistory.Record(
+			"Trigger to display",
+			(now - lat->GetStageTime(AcquisitionLatency::STAGE_TRIGGER)) * FS_PER_SECOND);
 	}
-
-	return node;
+	m_latencyAwaitingPresent.clear();
 }
 
-bool Session::SerializeWaveforms(const string& dataDir)
-{
-	//Metadata nodes for each scope
-	std::map<std::shared_ptr<Oscilloscope>, YAML::Node> metadataNodes;
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Filter processing
 
-	//Serialize data from each history point
-	size_t numwfm = 0;
-	for(auto& hpoint : m_history.m_history)
+/**
+	@brief Gets every accumulation filter in the session
+ */
+set<WaveformAccumulateFilter*> Session::GetAccumulateFilters()
+{
+	set<Filter*> filters;
 	{
-		auto timestamp = hpoint->m_time;
-
-		//Save each scope
-		//TODO: Do we want to change the directory hierarchy in a future file format schema?
-		//For now, we stick with scope / waveform.
-		//In the future we might want trigger group / waveform / scope.
-		for(auto it : hpoint->m_history)
-		{
-			auto scope = it.first;
-			auto& hist = it.second;
-
-			//Make the directory for the scope if needed
-			string scopedir = dataDir + "/scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_waveforms";
-			#ifdef _WIN32
-				_mkdir(scopedir.c_str());
-			#else
-				mkdir(scopedir.c_str(), 0755);
-			#endif
+		lock_guard<mutex> lock(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
+	}
 
-			//Make directory for this waveform
-			string datdir = scopedir + "/waveform_" + to_string(numwfm);
-			#ifdef _WIN32
-				mkdir(datdir.c_str());
-			#else
-				mkdir(datdir.c_str(), 0755);
-			#endif
+	set<WaveformAccumulateFilter*> ret;
+	for(auto f : filters)
+	{
+		auto af = dynamic_cast<WaveformAccumulateFilter*>(f);
+		if(af)
+			ret.emplace(af);
+	}
+	return ret;
+}
 
-			//Format metadata for this waveform
-			YAML::Node mnode;
-			mnode["timestamp"] = timestamp.first;
-			mnode["time_fsec"] = timestamp.second;
-			mnode["id"] = numwfm;
-			mnode["pinned"] = hpoint->m_pinned;
-			mnode["label"] = hpoint->m_nickname;
-			for(size_t i=0; i<scope->GetChannelCount(); i++)
-			{
-				auto ochan = dynamic_cast<OscilloscopeChannel*>(scope->GetChannel(i));
-				if(!ochan)
-					continue;
-				for(size_t j=0; j<scope->GetChannel(i)->GetStreamCount(); j++)
-				{
-					StreamDescriptor stream(ochan, j);
-					if(hist.find(stream) == hist.end())
-						continue;
-					auto data = hist[stream];
-					if(data == nullptr)
-						continue;
+/**
+	@brief Hands history to any accumulation filters which need to rebuild from it
 
-					//Got valid data, save the configuration for the channel
-					YAML::Node chnode;
-					chnode["index"] = i;
-					chnode["stream"] = j;
-					chnode["timescale"] = data->m_timescale;
-					chnode["trigphase"] = data->m_triggerPhase;
-					chnode["flags"] = (int)data->m_flags;
-					//don't serialize revision
-
-					//Save the actual waveform data
-					string datapath = datdir;
-					if(j == 0)
-						datapath += string("/channel_") + to_string(i) + ".bin";
-					else
-						datapath += string("/channel_") + to_string(i) + "_stream" + to_string(j) + ".bin";
-					auto sparse = dynamic_cast<SparseWaveformBase*>(data);
-					auto uniform = dynamic_cast<UniformWaveformBase*>(data);
-					if(sparse)
-					{
-						chnode["format"] = "sparsev1";
-						SerializeSparseWaveform(sparse, datapath);
-
-						//Save type if it's a protocol waveform
-						//so if we do an offline load, we know what type of waveform to make
-						if(dynamic_cast<SparseAnalogWaveform*>(sparse) != nullptr)
-							chnode["datatype"] = "analog";
-						else if(dynamic_cast<SparseDigitalWaveform*>(sparse) != nullptr)
-							chnode["datatype"] = "digital";
-						else if(dynamic_cast<CANWaveform*>(sparse) != nullptr)
-							chnode["datatype"] = "can";
-					}
-					else
-					{
-						chnode["format"] = "densev1";
-						SerializeUniformWaveform(uniform, datapath);
-					}
+	Must be called from the GUI thread, since it walks the history list.
+ */
+void Session::SeedAccumulations()
+{
+	set<FlowGraphNode*> seeded;
+	for(auto f : GetAccumulateFilters())
+	{
+		if(!f->NeedsSeed())
+			continue;
 
-					mnode["channels"][string("ch") + to_string(i) + "s" + to_string(j)] = chnode;
-				}
-			}
+		lock_guard wlock(m_waveformWriterMutex);
+		lock_guard lock(m_waveformDataMutex);
+		f->Seed(m_history);
+		seeded.emplace(f);
+	}
 
-			metadataNodes[scope]["waveforms"][string("wfm") + to_string(numwfm)] = mnode;
-		}
+	//If we're stopped, there's no new acquisition on the way to pick up the result
+	if(!seeded.empty() && !m_triggerArmed)
+		RefreshFiltersNonblocking(seeded);
+}
 
-		numwfm ++;
+size_t Session::GetFilterCount()
+{
+	set<Filter*> filters;
+	{
+		lock_guard<mutex> lock2(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
 	}
+	return filters.size();
+}
 
-	//Write metadata files (by this point, data directories should have been created)
-	for(size_t i=0; i<m_oscilloscopes.size(); i++)
+/**
+	@brief Queues a request to refresh all filters the next time we poll stuff
+ */
+void Session::RefreshAllFiltersNonblocking()
+{
 	{
-		auto scope = m_oscilloscopes[i];
-		string fname = dataDir + "/scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_metadata.yml";
-
-		ofstream outfs(fname);
-		if(!outfs)
-			return false;
-		outfs << metadataNodes[scope];
-		outfs.close();
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		m_refilterAll = true;
+		if(m_loadBatchDepth > 0)
+		{
+			m_loadBatchRefreshDeferred = true;
+			return;
+		}
 	}
 
-	//Make directory for filters
-	string filtdir = dataDir + "/filter_waveforms";
-	#ifdef _WIN32
-		mkdir(filtdir.c_str());
-	#else
-		mkdir(filtdir.c_str(), 0755);
-	#endif
+	g_refilterRequestedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
+}
 
-	//Find filters that need to be serialized
-	YAML::Node filterNode;
-	auto filters = Filter::GetAllInstances();
-	for(auto f : filters)
-	{
-		//If it's not being persisted, drop it
-		if(!f->ShouldPersistWaveform())
-			continue;
+/**
+	@brief Queues a request to refresh only the filters affected by a change to some graph nodes
 
-		//Make directory for this filter
-		auto nfilter = m_idtable.emplace(f);
-		string datdir = filtdir + "/filter_" + to_string(nfilter);
-		#ifdef _WIN32
-			mkdir(datdir.c_str());
-		#else
-			mkdir(datdir.c_str(), 0755);
-		#endif
+	Everything downstream of the sources is refreshed, plus the sources themselves if they're filters. Requests made
+	before the WaveformThread gets to them are merged, and a pending full refresh takes priority.
 
-		//There's no history timestamp so use timestamp of the first stream's waveform
-		//If no first stream what do we do?
-		auto wref = f->GetData(0);
-		if(!wref)
+	@param sources	Nodes whose output changed (e.g. a reconfigured filter)
+ */
+void Session::RefreshFiltersNonblocking(const set<FlowGraphNode*>& sources)
+{
+	{
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		m_refilterSources.insert(sources.begin(), sources.end());
+		if(m_loadBatchDepth > 0)
 		{
-			LogWarning("Don't know how to save filters without a slot 0 waveform\n");
-			continue;
+			m_loadBatchRefreshDeferred = true;
+			return;
 		}
+	}
 
-		//Format metadata for this waveform
-		//No labels etc because we're not in history
-		YAML::Node mnode;
-		mnode["timestamp"] = wref->m_startTimestamp;
-		mnode["time_fsec"] = wref->m_startFemtoseconds;
-		mnode["id"] = nfilter;
+	g_refilterRequestedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
+}
 
-		for(size_t j=0; j<f->GetStreamCount(); j++)
-		{
-			StreamDescriptor stream(f, j);
-			auto data = stream.GetData();
-			if(data == nullptr)
-				continue;
+/**
+	@brief Queues a request to refresh everything downstream of the oscilloscopes
 
-			//Got valid data, save the configuration for the channel
-			YAML::Node chnode;
-			chnode["stream"] = j;
-			chnode["timescale"] = data->m_timescale;
-			chnode["trigphase"] = data->m_triggerPhase;
-			chnode["flags"] = (int)data->m_flags;
-			//don't serialize revision
+	Used after a history point has been loaded into the scopes. Filters fed only by other instruments keep their
+	current outputs, since those didn't change.
+ */
+void Session::RefreshScopeFiltersNonblocking()
+{
+	set<FlowGraphNode*> sources;
+	auto scopes = GetScopes();
+	for(auto scope : scopes)
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+			sources.emplace(scope->GetChannel(i));
+	}
+	RefreshFiltersNonblocking(sources);
+}
 
-			//Save the actual waveform data
-			string datapath = datdir + "/stream" + to_string(j) + ".bin";
-			auto sparse = dynamic_cast<SparseWaveformBase*>(data);
-			auto uniform = dynamic_cast<UniformWaveformBase*>(data);
-			if(sparse)
-			{
-				chnode["format"] = "sparsev1";
-				SerializeSparseWaveform(sparse, datapath);
-			}
-			else
-			{
-				chnode["format"] = "densev1";
-				SerializeUniformWaveform(uniform, datapath);
-			}
+/**
+	@brief Queues a request to refresh dirty filters the next time we poll stuff
 
-			mnode["streams"][string("s") + to_string(j)] = chnode;
+	Avoid waking up the waveform thread if we have no dirty filters, though.
+ */
+void Session::RefreshDirtyFiltersNonblocking()
+{
+	{
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		if(m_dirtyChannels.empty())
+			return;
+
+		//Still dirty once the batch is done, so the full refresh at the end picks it up
+		if(m_loadBatchDepth > 0)
+		{
+			m_loadBatchRefreshDeferred = true;
+			return;
 		}
 
-		filterNode["waveforms"][string("filt") + to_string(nfilter)] = mnode;
+		//Batch up updates from polled instruments, unless something else wants a refresh now
+		if(!m_dirtyChannelsUrgent)
+		{
+			double window = m_preferences.GetReal("Performance.Waveform Processing.polled_coalesce_window") /
+				FS_PER_SECOND;
+			if( (GetTime() - m_tfirstPolledDirty) < window)
+				return;
+		}
 	}
 
-	string fname = dataDir + "/filter_metadata.yml";
-	ofstream outfs(fname);
-	if(!outfs)
-		return false;
-	outfs << filterNode;
-	outfs.close();
+	g_partialRefilterRequestedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
+}
 
-	return true;
+/**
+	@brief Gets all of our graph nodes (filters plus instrument channels)
+ */
+set<FlowGraphNode*> Session::GetAllGraphNodes()
+{
+	//Start with instrument channels, which only change when instruments are added or removed
+	set<FlowGraphNode*> nodes = GetInstrumentSnapshot()->m_channels;
+
+	//then add all filters
+	{
+		lock_guard<mutex> lock2(m_filterUpdatingMutex);
+		auto filters = Filter::GetAllInstances();
+		for(auto f : filters)
+			nodes.emplace(f);
+	}
+
+	return nodes;
 }
 
 /**
-	@brief Saves waveform sample data in the "sparsev1" file format.
+	@brief Adds the runtime of each node from the last filter graph execution to the trace
 
-	Interleaved (slow):
-		int64 offset
-		int64 len
-		for analog
-			float voltage
-		for digital
-			bool voltage
+	The executor runs nodes in parallel inside the scope library and only reports how long each one took, so they're
+	drawn back to back on their own track starting when the graph started, rather than at their true start times.
  */
-bool Session::SerializeSparseWaveform(SparseWaveformBase* wfm, const string& path)
+static void TraceFilterRunTimes(int64_t start, const map<FlowGraphNode*, int64_t>& stats)
 {
-	FILE* fp = fopen(path.c_str(), "wb");
-	if(!fp)
-		return false;
+	if(!Tracer::IsEnabled())
+		return;
 
-	wfm->PrepareForCpuAccess();
-	auto achan = dynamic_cast<SparseAnalogWaveform*>(wfm);
-	auto dchan = dynamic_cast<SparseDigitalWaveform*>(wfm);
-	auto cchan = dynamic_cast<CANWaveform*>(wfm);
-	size_t len = wfm->size();
+	int64_t t = start;
+	for(auto& it : stats)
+	{
+		auto f = dynamic_cast<Filter*>(it.first);
+		string name = f ? f->GetDisplayName() : "(unknown)";
+		int64_t dur = it.second / 1000000;
+		Tracer::RecordOnTrack("Filter graph (serialized)", "Filter", t, t + dur, name.c_str());
+		t += dur;
+	}
+}
 
-	//Analog channels
-	const size_t samples_per_block = 10000;
-	if(achan)
+/**
+	@brief Runs every filter that anything depends on
+
+	@param throttle	True if the refresh is for a new acquisition, so filters may be held back by their refresh policies
+ */
+void Session::RefreshAllFilters(bool throttle)
+{
+	TRACE_ZONE("RefreshAllFilters");
+
+	set<Filter*> filters;
 	{
-		#pragma pack(push, 1)
-		class asample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			float voltage;
+		lock_guard<mutex> lock(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
+	}
+	RefreshFilters({GetDemandedGraphNodes()}, filters, false, throttle);
+}
 
-			asample_t(int64_t o=0, int64_t d=0, float v=0)
-			: off(o), dur(d), voltage(v)
-			{}
-		};
-		#pragma pack(pop)
+/**
+	@brief Runs the filters affected by a new live acquisition
 
-		//Copy sample data
-		vector<asample_t,	AlignedAllocator<asample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(asample_t(achan->m_offsets[i], achan->m_durations[i], achan->m_samples[i]));
+	Called by the WaveformThread after DownloadWaveforms(). If only some trigger groups fired, filters fed solely by
+	the groups which didn't are left alone, so a fast free-running scope isn't held back by the filter graph of a
+	slow deep-memory scope in another group. Independent partitions which did fire are run together, so the graph
+	executor can run them in parallel.
 
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			size_t blocklen = min(len-i, samples_per_block);
-			if(blocklen != fwrite(&samples[i], sizeof(asample_t), blocklen, fp))
-			{
-				LogError("file write error\n");
-				fclose(fp);
-				return false;
-			}
-		}
-	}
-	else if(dchan)
+	Filters which aren't fed by any trigger group (e.g. signal generators, or those fed by polled instruments) are
+	run every time, as before.
+ */
+void Session::RefreshTriggeredFilters()
+{
+	TRACE_ZONE("RefreshTriggeredFilters");
+
+	set<Filter*> filters;
 	{
-		#pragma pack(push, 1)
-		class dsample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			bool voltage;
+		lock_guard<mutex> lock(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
+	}
 
-			dsample_t(int64_t o=0, int64_t d=0, bool v=0)
-			: off(o), dur(d), voltage(v)
-			{}
-		};
-		#pragma pack(pop)
+	auto nodes = GetDemandedGraphNodes();
+	set<FlowGraphNode*> skipped;
+	if(m_preferences.GetBool("Performance.Waveform Processing.partition_by_trigger_group"))
+		PartitionByTriggerGroup(nodes, skipped);
+	RefreshFilters({nodes}, filters, false, true, skipped);
+}
 
-		//Copy sample data
-		vector<dsample_t,	AlignedAllocator<dsample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(dsample_t(dchan->m_offsets[i], dchan->m_durations[i], dchan->m_samples[i]));
+/**
+	@brief Removes nodes fed only by trigger groups which didn't fire from a refresh
 
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
+	@param nodes	Nodes to refresh. Anything fed by a group which didn't fire, and not by one which did, is removed
+	@param skipped	Set to the nodes which were removed
+ */
+void Session::PartitionByTriggerGroup(set<FlowGraphNode*>& nodes, set<FlowGraphNode*>& skipped)
+{
+	if(m_lastDownloadedGroups.empty())
+		return;
+
+	//Find the channels of every group, split by whether the group fired
+	set<FlowGraphNode*> fired;
+	set<FlowGraphNode*> idle;
+	{
+		lock_guard lock(m_triggerGroupMutex);
+		for(auto& group : m_triggerGroups)
 		{
-			size_t blocklen = min(len-i, samples_per_block);
-			if(blocklen != fwrite(&samples[i], sizeof(dsample_t), blocklen, fp))
+			if(!group->m_primary)
+				continue;
+
+			auto& dest = (m_lastDownloadedGroups.find(group) != m_lastDownloadedGroups.end()) ? fired : idle;
+			vector<shared_ptr<Oscilloscope>> scopes = group->m_secondaries;
+			scopes.push_back(group->m_primary);
+			for(auto& scope : scopes)
 			{
-				LogError("file write error\n");
-				fclose(fp);
+				for(size_t i=0; i<scope->GetChannelCount(); i++)
+					dest.emplace(scope->GetChannel(i));
 			}
 		}
 	}
-	else if(cchan)
-	{
-		#pragma pack(push, 1)
-		class csample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			uint32_t data;
-			uint32_t type;
-
-			csample_t(int64_t o=0, int64_t d=0, CANSymbol s = CANSymbol())
-			: off(o), dur(d), data(s.m_data), type(s.m_stype)
-			{}
-		};
-		#pragma pack(pop)
+	if(idle.empty())
+		return;
 
-		//Copy sample data
-		vector<csample_t,	AlignedAllocator<csample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(csample_t(cchan->m_offsets[i], cchan->m_durations[i], cchan->m_samples[i]));
+	set<FlowGraphNode*> firedCone;
+	set<FlowGraphNode*> idleCone;
+	{
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		GetDownstreamCone(fired, firedCone);
+		GetDownstreamCone(idle, idleCone);
+	}
 
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
+	for(auto it = nodes.begin(); it != nodes.end(); )
+	{
+		auto node = *it;
+		if( (idleCone.find(node) != idleCone.end()) && (firedCone.find(node) == firedCone.end()) )
 		{
-			size_t blocklen = min(len-i, samples_per_block);
-			if(blocklen != fwrite(&samples[i], sizeof(csample_t), blocklen, fp))
-			{
-				LogError("file write error\n");
-				fclose(fp);
-				return false;
-			}
+			skipped.emplace(node);
+			it = nodes.erase(it);
 		}
+		else
+			it ++;
 	}
-	else
+	if(skipped.empty())
+		return;
+
+	//Skipped filters keep their outputs from the last time their group fired, which aren't stale as such, but don't
+	//belong to this acquisition either: leave them out of the measurements and reference comparisons run on it
+	if(m_preferences.GetBool("Performance.Waveform Processing.demand_driven_filters"))
 	{
-		//TODO: support other waveform types (buses, eyes, etc)
-		LogError("unrecognized sample type\n");
-		fclose(fp);
-		return false;
+		lock_guard<mutex> lock(m_filterDemandMutex);
+		for(auto node : skipped)
+		{
+			auto f = dynamic_cast<Filter*>(node);
+			if(f)
+				m_lastDemandedFilters.erase(f);
+		}
 	}
-
-	fclose(fp);
-	return true;
 }
 
 /**
-	@brief Saves waveform sample data in the "densev1" file format.
+	@brief Runs the refresh requested by RefreshAllFiltersNonblocking() or RefreshFiltersNonblocking()
 
-	for analog
-		float[] voltage
-	for digital
-		bool[] voltage
+	Called by the WaveformThread when g_refilterRequestedEvent is signaled. Unless a full refresh was requested, only
+	the downstream cone of the queued sources is run.
 
-	Durations are implied {1....1} and offsets are implied {0...n-1}.
+	If cancellable refreshes are enabled, the nodes are run one topological level at a time, and the refresh is
+	abandoned between levels if another one has been requested in the meantime. Whatever didn't get to run is queued
+	for the next refresh, so the newest request starts as soon as the level in progress finishes.
+
+	@return False if the refresh was cancelled
  */
-bool Session::SerializeUniformWaveform(UniformWaveformBase* wfm, const string& path)
+bool Session::RefreshRequestedFilters()
 {
-	FILE* fp = fopen(path.c_str(), "wb");
-	if(!fp)
-		return false;
+	TRACE_ZONE("RefreshRequestedFilters");
 
-	wfm->PrepareForCpuAccess();
-	auto achan = dynamic_cast<UniformAnalogWaveform*>(wfm);
-	auto dchan = dynamic_cast<UniformDigitalWaveform*>(wfm);
-	size_t len = wfm->size();
+	auto demanded = GetDemandedGraphNodes();
+	bool cancellable = m_preferences.GetBool("Performance.Waveform Processing.cancellable_refresh");
 
-	//Analog channels
-	const size_t samples_per_block = 10000;
-	if(achan)
+	vector<set<FlowGraphNode*> > batches;
+	set<Filter*> filters;
 	{
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			size_t blocklen = min(len-i, samples_per_block);
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		bool all = m_refilterAll;
+		set<FlowGraphNode*> sources;
+		sources.swap(m_refilterSources);
+		m_refilterAll = false;
 
-			if(blocklen != fwrite(achan->m_samples.GetCpuPointer() + i, sizeof(float), blocklen, fp))
-			{
-				LogError("file write error\n");
-				return false;
-			}
+		set<FlowGraphNode*> nodes;
+		if(all)
+		{
+			nodes = demanded;
+			lock_guard<mutex> lock2(m_filterUpdatingMutex);
+			filters = Filter::GetAllInstances();
 		}
-	}
-	else if(dchan)
-	{
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
+		else
 		{
-			size_t blocklen = min(len-i, samples_per_block);
+			//Nothing outside the demanded set can affect anything on screen (this also drops deleted filters)
+			set<FlowGraphNode*> liveSources;
+			for(auto node : sources)
+			{
+				if(demanded.find(node) != demanded.end())
+					liveSources.emplace(node);
+			}
 
-			if(blocklen != fwrite(dchan->m_samples.GetCpuPointer() + i, sizeof(bool), blocklen, fp))
+			set<FlowGraphNode*> cone;
+			GetDownstreamCone(liveSources, cone);
+			for(auto node : cone)
 			{
-				LogError("file write error\n");
-				return false;
+				auto f = dynamic_cast<Filter*>(node);
+				if(f)
+					filters.emplace(f);
+				if(demanded.find(node) != demanded.end())
+					nodes.emplace(node);
 			}
 		}
-	}
-	else
-	{
-		//TODO: support other waveform types (buses, eyes, etc)
-		LogError("unrecognized sample type\n");
-		return false;
+		if(nodes.empty())
+			return true;
+
+		if(cancellable)
+		{
+			m_graphIndex.Update(GetAllGraphNodes());
+			m_graphIndex.GetLevels(nodes, batches);
+		}
+		else
+			batches.push_back(std::move(nodes));
 	}
 
-	fclose(fp);
-	return true;
+	return RefreshFilters(batches, filters, cancellable);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Trigger group management
-
 /**
-	@brief Remove trigger groups with no instruments in them
+	@brief Runs part or all of the filter graph, reusing outputs saved with the displayed history point if possible
 
-	Removes a maximum of one group per invocation.
+	@param batches		Graph nodes to run. Each batch is run once the one before it has finished.
+	@param filters		Filters whose outputs can be saved to and restored from history points. This must be every
+						filter whose output depends on the data being refreshed, even if it isn't going to run.
+	@param cancellable	If true, stop between batches if another refresh has been requested, and queue the
+						remaining batches for it
+	@param throttle		If true, skip filters which their refresh policies are holding back
+	@param skipped		Nodes the caller left out of the batches, which keep their current outputs
+
+	@return False if the refresh was cancelled
  */
-void Session::GarbageCollectTriggerGroups()
+bool Session::RefreshFilters(
+	const vector<set<FlowGraphNode*> >& batches,
+	const set<Filter*>& filters,
+	bool cancellable,
+	bool throttle,
+	const set<FlowGraphNode*>& skipped)
 {
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
+	double tstart = GetTime();
 
-	for(size_t i=0; i<m_triggerGroups.size(); i++)
+	bool cancelled = false;
+	map<FlowGraphNode*, int64_t> runtimes;
 	{
-		if(m_triggerGroups[i]->empty())
+		//Keep other writers out for the whole run, but only lock readers out while a batch is actually running
+		lock_guard wlock(m_waveformWriterMutex);
+
+		//If we're revisiting a history point we already computed, reuse the outputs instead
+		bool restored;
 		{
-			LogTrace("Garbage collecting trigger group\n");
-			m_triggerGroups.erase(m_triggerGroups.begin() + i);
-			return;
+			lock_guard lock(m_waveformDataMutex);
+			restored = SwapFilterOutputsForHistory(filters);
+		}
+		if(!restored)
+		{
+			//Expensive filters may sit this one out, keeping their last outputs
+			vector<set<FlowGraphNode*> > throttled;
+			set<FlowGraphNode*> held = skipped;
+			bool anyHeld = false;
+			if(throttle)
+			{
+				throttled = batches;
+				anyHeld = ApplyRefreshPolicies(throttled, held);
+			}
+			const auto& torun = anyHeld ? throttled : batches;
+
+			uint64_t rev = m_filterConfigRevision;
+			int64_t traceStart = Tracer::Now();
+			set<FlowGraphNode*> ran;
+			for(size_t i=0; i<torun.size(); i++)
+			{
+				//Don't clear the event, the WaveformThread needs to see it to start the newer refresh
+				if(cancellable && (i > 0) && g_refilterRequestedEvent.Peek(false))
+				{
+					lock_guard<mutex> lock2(m_dirtyChannelsMutex);
+					for(size_t j=i; j<torun.size(); j++)
+						m_refilterSources.insert(torun[j].begin(), torun[j].end());
+					cancelled = true;
+					break;
+				}
+
+				{
+					TRACE_ZONE("RunBlocking");
+					lock_guard lock(m_waveformDataMutex);
+					m_graphExecutor.RunBlocking(torun[i]);
+				}
+				for(auto& it : m_graphExecutor.GetRunTimes())
+					runtimes[it.first] = it.second;
+				ran.insert(torun[i].begin(), torun[i].end());
+			}
+			TraceFilterRunTimes(traceStart, runtimes);
+			{
+				//Held decoders still exist, their packet managers just have nothing new to pick up
+				TRACE_ZONE("UpdatePacketManagers");
+				ran.insert(held.begin(), held.end());
+				shared_lock lock(m_waveformDataMutex);
+				UpdatePacketManagers(ran);
+			}
+
+			//Some outputs are out of date, so they mustn't be saved with the history point they were run for
+			if(cancelled)
+			{
+				m_filterOutputsPoint.reset();
+				g_cancelledRefilters ++;
+			}
+			else
+			{
+				if(anyHeld || !held.empty())
+					m_filterOutputsPoint.reset();
+				m_filterOutputsRevision = rev;
+			}
 		}
 	}
+
+	UpdateFilterGraphRuntimeStats(tstart, runtimes);
+	return !cancelled;
 }
 
 /**
-	@brief Creates a new trigger group containing only the selected scope
+	@brief Publishes execution time of the filter graph run that just finished
+
+	@param tstart	Time the run was started, as returned by GetTime()
+	@param runtimes	Execution time of each node that ran
  */
-void Session::MakeNewTriggerGroup(shared_ptr<Oscilloscope> scope)
+void Session::UpdateFilterGraphRuntimeStats(double tstart, const map<FlowGraphNode*, int64_t>& runtimes)
 {
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	m_triggerGroups.push_back(make_shared<TriggerGroup>(scope, this));
-}
+	m_lastFilterGraphExecTime = (GetTime() - tstart) * FS_PER_SECOND;
+	m_metricHistory.Record("Filter graph", m_lastFilterGraphExecTime);
 
-void Session::MakeNewTriggerGroup(PausableFilter* filter)
-{
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	auto group = make_shared<TriggerGroup>(nullptr, this);
-	group->m_default = false;
-	group->AddFilter(filter);
-	m_triggerGroups.push_back(group);
+	m_metricHistory.RecordNodes(runtimes);
+	RecordRefreshPolicyRuns(runtimes);
+
+	lock_guard<mutex> lock(m_lastFilterGraphRuntimeMutex);
+	m_lastFilterGraphRuntimeStats = runtimes;
 }
 
 /**
-	@brief Check if a scope is the primary of a group containing at least one other scope
+	@brief Sets the history point the next full filter graph refresh is for
+
+	@param pt	The point being displayed, or null for live data
  */
-bool Session::IsPrimaryOfMultiScopeGroup(shared_ptr<Oscilloscope> scope)
+void Session::SetFilterHistoryPoint(shared_ptr<HistoryPoint> pt)
 {
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	for(auto group : m_triggerGroups)
-	{
-		if( (group->m_primary == scope) && !group->m_secondaries.empty())
-			return true;
-	}
-	return false;
+	lock_guard<mutex> lock(m_filterHistoryPointMutex);
+	m_filterHistoryPoint = pt;
 }
 
 /**
-	@brief Check if a scope is a secondary within a multiscope group
- */
-bool Session::IsSecondaryOfMultiScopeGroup(shared_ptr<Oscilloscope> scope)
-{
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	for(auto group : m_triggerGroups)
-	{
-		//if primary we can't also be a secondary so stop looking
-		if(group->m_primary == scope)
-			return false;
+	@brief Saves and restores filter outputs when the displayed history point changes
 
-		for(auto sec : group->m_secondaries)
-		{
-			if(sec == scope)
-				return true;
-		}
-	}
-	return false;
-}
+	The current outputs are moved into the history point they were computed from, and if the point being displayed now
+	has saved outputs from the same filter configuration, they're handed back to the filters. Each output waveform is
+	always owned by exactly one filter or history point, so nothing has to be copied.
 
-/**
-	@brief Gets the trigger group that contains a specified scope
+	Must be called with the waveform data mutex held.
+
+	@param filters	Filters whose outputs are being refreshed
+
+	@return True if saved outputs were restored, and the filter graph does not need to be run
  */
-shared_ptr<TriggerGroup> Session::GetTriggerGroupForScope(shared_ptr<Oscilloscope> scope)
+bool Session::SwapFilterOutputsForHistory(const set<Filter*>& filters)
 {
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	for(auto group : m_triggerGroups)
+	shared_ptr<HistoryPoint> target;
 	{
-		if(group->m_primary == scope)
-			return group;
-
-		for(auto sec : group->m_secondaries)
-		{
-			if(sec == scope)
-				return group;
-		}
+		lock_guard<mutex> lock(m_filterHistoryPointMutex);
+		target = m_filterHistoryPoint.lock();
 	}
+	auto current = m_filterOutputsPoint.lock();
+	m_filterOutputsPoint = target;
 
-	//should never get here
-	LogError("Scope is not part of a trigger group!\n");
-	return nullptr;
-}
-
-/**
-	@brief Gets the trigger group that contains a specified filter
- */
-shared_ptr<TriggerGroup> Session::GetTriggerGroupForFilter(PausableFilter* filter)
-{
-	lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-	for(auto group : m_triggerGroups)
+	//If caching is turned off, free anything we saved before it was
+	if(m_preferences.GetInt("Performance.History.filter_cache_points") <= 0)
 	{
-		for(auto f : group->m_filters)
+		for(auto& wp : m_filterCacheLRU)
 		{
-			if(f == filter)
-				return group;
+			auto pt = wp.lock();
+			if(pt)
+				pt->ClearFilterOutputs();
 		}
+		m_filterCacheLRU.clear();
+		return false;
 	}
 
-	return nullptr;
-}
+	//Same point as last time (e.g. filter reconfigured), so we have to recompute
+	if(current == target)
+		return false;
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Instrument management
+	if(current)
+		SaveFilterOutputs(current, filters);
+	if(target && RestoreFilterOutputs(target, filters))
+		return true;
 
-void Session::ApplyPreferences(shared_ptr<Oscilloscope> scope)
+	//Filters are going to run, so give them recycled buffers to write to instead of having them allocate new ones
+	if(current)
+		RecycleFilterOutputs(current, filters);
+	return false;
+}
+
+/**
+	@brief Moves the current filter outputs into the history point they were computed from
+ */
+void Session::SaveFilterOutputs(shared_ptr<HistoryPoint> pt, const set<Filter*>& filters)
 {
-	//Apply driver-specific preference settings
-	auto lecroy = dynamic_pointer_cast<LeCroyOscilloscope>(scope);
-	if(lecroy)
-	{
-		if(m_preferences.GetBool("Drivers.Teledyne LeCroy.force_16bit"))
-			lecroy->ForceHDMode(true);
+	//If filters were reconfigured since the outputs were computed, they're of no use to anyone
+	uint64_t rev = m_filterConfigRevision;
+	if(m_filterOutputsRevision != rev)
+		return;
 
-		//else auto resolution depending on instrument type
-	}
-	auto siglent = dynamic_pointer_cast<SiglentSCPIOscilloscope>(scope);
-	if(siglent)
-	{
-		auto dataWidth = m_preferences.GetEnumRaw("Drivers.Siglent SDS HD.data_width");
-		if(dataWidth == WIDTH_8_BITS)
-		{
-			siglent->ForceHDMode(false);
-		}
-		else if(dataWidth == WIDTH_16_BITS)
-		{
-			siglent->ForceHDMode(true);
-		}
-	}
-	auto rigol = dynamic_pointer_cast<RigolOscilloscope>(scope);
-	if(rigol)
-	{
-		auto dataWidth = m_preferences.GetEnumRaw("Drivers.Rigol DHO.data_width");
-		if(dataWidth == WIDTH_8_BITS)
-		{
-			rigol->ForceHDMode(false);
-		}
-		else if(dataWidth == WIDTH_16_BITS)
+	pt->ClearFilterOutputs();
+	for(auto f : filters)
+	{
+		for(size_t i=0; i<f->GetStreamCount(); i++)
 		{
-			rigol->ForceHDMode(true);
+			auto data = f->GetData(i);
+			if(!data)
+				continue;
+
+			//The filter will allocate a new output next time it runs
+			f->Detach(i);
+			pt->m_filterOutputs[StreamDescriptor(f, i)] = data;
 		}
 	}
+	pt->m_filterOutputFilters = filters;
+	pt->m_filterOutputRevision = rev;
+
+	//Drop the oldest saved outputs if we're over the limit
+	size_t cap = m_preferences.GetInt("Performance.History.filter_cache_points");
+	m_filterCacheLRU.remove_if([&](const weak_ptr<HistoryPoint>& wp)
+		{ return wp.expired() || (wp.lock() == pt); });
+	m_filterCacheLRU.push_front(pt);
+	while(m_filterCacheLRU.size() > cap)
+	{
+		auto old = m_filterCacheLRU.back().lock();
+		if(old)
+			old->ClearFilterOutputs();
+		m_filterCacheLRU.pop_back();
+	}
 }
 
 /**
-	@brief Starts the WaveformThread if we don't already have one
+	@brief Checks if a filter builds its output up over many refreshes, rather than recomputing it each time
+
+	These filters add each new input to whatever is already in their output waveform.
  */
-void Session::StartWaveformThreadIfNeeded()
+static bool IsAccumulatingFilter(Filter* f)
 {
-	if(m_waveformThread == nullptr)
-		m_waveformThread = make_unique<thread>(WaveformThread, this, &m_shuttingDown);
+	return
+		(dynamic_cast<EyePattern*>(f) != nullptr) ||
+		(dynamic_cast<Waterfall*>(f) != nullptr) ||
+		(dynamic_cast<SpectrogramFilter*>(f) != nullptr) ||
+		(dynamic_cast<WaveformAccumulateFilter*>(f) != nullptr) ||
+		(dynamic_cast<PausableFilter*>(f) != nullptr);
 }
 
 /**
-	@brief Creates a new instrument and adds it to the session
+	@brief Gives filters whose outputs were just saved to a history point a waveform from the pool to write to
+
+	Filters reuse any existing output waveform of the right type, so this saves them allocating a new one (and the
+	GPU memory behind it) every time the selected history point changes.
+
+	Accumulating filters are skipped. They would integrate on top of whatever the pooled waveform last held, so
+	they have to start again from an empty output of their own.
+
+	@param pt		The point the outputs were saved to
+	@param filters	All filters in the session
  */
-void Session::CreateAndAddInstrument(const string& driver, SCPITransport* transport, const string& nickname)
+void Session::RecycleFilterOutputs(shared_ptr<HistoryPoint> pt, const set<Filter*>& filters)
 {
-	shared_ptr<Instrument> inst = nullptr;
-
-	//Search all types of instrument until we find the right one
-	//TODO: unify this when we get rid of this ugliness
-	for(auto it : m_driverNamesByType)
+	for(auto f : filters)
 	{
-		auto type = it.first;
-		auto& drivers = it.second;
+		if(IsAccumulatingFilter(f))
+			continue;
 
-		for(auto name : drivers)
+		for(size_t i=0; i<f->GetStreamCount(); i++)
 		{
-			if(name == driver)
-			{
-				if(type == "bert")
-					inst = SCPIBERT::CreateBERT(driver, transport);
-				else if(type == "funcgen")
-					inst = SCPIFunctionGenerator::CreateFunctionGenerator(driver, transport);
-				else if(type == "load")
-					inst = SCPILoad::CreateLoad(driver, transport);
-				else if(type == "misc")
-					inst = SCPIMiscInstrument::CreateInstrument(driver, transport);
-				else if(type == "multimeter")
-					inst = SCPIMultimeter::CreateMultimeter(driver, transport);
-				else if(type == "psu")
-					inst = SCPIPowerSupply::CreatePowerSupply(driver, transport);
-				else if(type == "rfgen")
-					inst = SCPIRFSignalGenerator::CreateRFSignalGenerator(driver, transport);
-				else if(type == "sdr")
-					inst = SCPISDR::CreateSDR(driver, transport);
-				else if(type == "oscilloscope")
-					inst = SCPIOscilloscope::CreateOscilloscope(driver, transport);
-				else if(type == "spectrometer")
-					inst = SCPISpectrometer::CreateSpectrometer(driver, transport);
-				else if(type == "vna")
-					inst = SCPIVNA::CreateVNA(driver, transport);
+			if(f->GetData(i))
+				continue;
 
-				break;
+			auto it = pt->m_filterOutputs.find(StreamDescriptor(f, i));
+			if( (it == pt->m_filterOutputs.end()) || !it->second)
+				continue;
+
+			auto wfm = m_waveformPool.GetLike(it->second, it->second->size());
+			if(wfm)
+			{
+				f->SetData(wfm, i);
+				m_filterOutputRecycleHits ++;
 			}
+			else
+				m_filterOutputRecycleMisses ++;
 		}
+	}
+}
 
-		if(inst)
-			break;
+/**
+	@brief Hands filter outputs saved in a history point back to the filters
+
+	@return True if the outputs were restored, false if there are none or they're stale
+ */
+bool Session::RestoreFilterOutputs(shared_ptr<HistoryPoint> pt, const set<Filter*>& filters)
+{
+	if(pt->m_filterOutputFilters.empty())
+		return false;
+
+	//Outputs are only valid if the filter graph is exactly the same as when they were computed
+	uint64_t rev = m_filterConfigRevision;
+	if( (pt->m_filterOutputRevision != rev) || (pt->m_filterOutputFilters != filters) )
+	{
+		pt->ClearFilterOutputs();
+		return false;
 	}
 
-	//If we couldn't make it, abort
-	if(!inst)
+	LogTrace("Restoring saved filter outputs for %s\n", pt->m_time.PrettyPrint().c_str());
+	for(auto f : filters)
 	{
-		m_mainWindow->ShowErrorPopup(
-			"Driver error",
-			"Failed to create instrument driver instance of type \"" + driver + "\"");
-		delete transport;
-		return;
+		for(size_t i=0; i<f->GetStreamCount(); i++)
+		{
+			auto it = pt->m_filterOutputs.find(StreamDescriptor(f, i));
+			if(it == pt->m_filterOutputs.end())
+				f->SetData(nullptr, i);
+			else
+				f->SetData(it->second, i);
+		}
 	}
+	pt->m_filterOutputs.clear();
+	pt->m_filterOutputFilters.clear();
+	m_filterOutputsRevision = rev;
 
-	//Apply preference settings, if any, here
-	auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
-	if(scope)
-		ApplyPreferences(scope);
+	//Packets for this point are already in the packet managers
+	{
+		lock_guard lock(m_packetMgrMutex);
+		for(auto it : m_packetmgrs)
+			it.second->OnOutputRestored();
+	}
 
-	inst->m_nickname = nickname;
-	AddInstrument(inst);
+	return true;
 }
 
 /**
-	@brief Adds a new instrument to the session
+	@brief Refresh dirty filters (and anything in their downstream influence cone)
 
-	@param inst				The instment to add
-	@param createDialogs	True if we should add waveform areas for each enabled channel
-							and/or dialogs if applicable
+	@return True if at least one filter was refreshed, false if nothing was dirty
  */
-void Session::AddInstrument(shared_ptr<Instrument> inst, bool createDialogs)
+bool Session::RefreshDirtyFilters()
 {
-	m_modifiedSinceLastSave = true;
+	set<FlowGraphNode*> nodesToUpdate;
+	vector<set<FlowGraphNode*> > batches;
+	bool throttle;
 
-	lock_guard<mutex> lock(m_scopeMutex);
+	{
+		lock_guard<mutex> lock(m_dirtyChannelsMutex);
+		if(m_dirtyChannels.empty())
+			return false;
 
-	auto si = dynamic_pointer_cast<SCPIInstrument>(inst);
-	InstrumentThreadArgs args(si, this);
+		//Only new readings from polled instruments are fair game for refresh policies
+		throttle = !m_dirtyChannelsUrgent;
 
-	//Create shared state, if needed
-	auto psu = dynamic_pointer_cast<SCPIPowerSupply>(inst);
-	auto meter = dynamic_pointer_cast<SCPIMultimeter>(inst);
-	auto generator = dynamic_pointer_cast<SCPIFunctionGenerator>(inst);
-	auto load = dynamic_pointer_cast<SCPILoad>(inst);
-	auto bert = dynamic_pointer_cast<SCPIBERT>(inst);
-	auto rfgen = dynamic_pointer_cast<SCPIRFSignalGenerator>(inst);
-	auto scope = dynamic_pointer_cast<Oscilloscope>(inst);
-	auto types = inst->GetInstrumentTypes();
-	if(psu && (types & Instrument::INST_PSU) )
-	{
-		auto state = make_shared<PowerSupplyState>(psu->GetChannelCount());
-		m_psus[psu] = state;
-		args.psustate = state;
-	}
-	if(meter && (types & Instrument::INST_DMM) )
-	{
-		auto state = make_shared<MultimeterState>();
-		m_meters[meter] = state;
-		args.meterstate = state;
-	}
-	if(load && (types & Instrument::INST_LOAD) )
-	{
-		auto state = make_shared<LoadState>(load->GetChannelCount());
-		m_loads[load] = state;
-		args.loadstate = state;
-	}
-	if(bert && (types & Instrument::INST_BERT) )
-	{
-		auto state = make_shared<BERTState>(bert->GetChannelCount());
-		m_berts[bert] = state;
-		args.bertstate = state;
-	}
-	if(scope && (types & Instrument::INST_OSCILLOSCOPE))
-	{
-		m_oscilloscopes.push_back(scope);
-		if(m_oscilloscopes.size() > 1)
-			m_multiScope = true;
-	}
-	if(generator && (types & Instrument::INST_FUNCTION) )
-	{
-		auto state = make_shared<FunctionGeneratorState>(generator);
+		//Everything downstream of a dirty channel needs updating.
+		//Run it one level at a time so readers can get at waveform data in between.
+		GetDownstreamCone(m_dirtyChannels, nodesToUpdate);
+		m_graphIndex.GetLevels(nodesToUpdate, batches);
 
-		m_awgs[generator] = state;
-		args.awgstate = state;
+		//Reset list for next round
+		m_dirtyChannels.clear();
+		m_dirtyChannelsUrgent = false;
+		m_tfirstPolledDirty = 0;
 	}
+	if(nodesToUpdate.empty())
+		return false;
 
-	//Make the instrument thread
-	if(si)
-		m_instrumentStates[inst] = make_shared<InstrumentConnectionState>(args);
+	set<FlowGraphNode*> held;
+	if(throttle)
+		ApplyRefreshPolicies(batches, held);
 
-	//Spawn dialogs/views if requested
-	if(createDialogs)
+	//Refresh the dirty filters only
+	double tstart = GetTime();
+
+	//Outputs now depend on live data, not just the displayed history point
+	InvalidateFilterOutputCache();
+
+	map<FlowGraphNode*, int64_t> runtimes;
 	{
-		if(psu && (types & Instrument::INST_PSU) )
-			m_mainWindow->AddDialog(make_shared<PowerSupplyDialog>(psu, args.psustate, this));
-		if(meter && (types & Instrument::INST_DMM) )
-			m_mainWindow->AddDialog(make_shared<MultimeterDialog>(meter, args.meterstate, this));
-		if(generator && (types & Instrument::INST_FUNCTION) )
+		lock_guard wlock(m_waveformWriterMutex);
+		int64_t traceStart = Tracer::Now();
+		for(auto& batch : batches)
 		{
-			//If it's also a scope, don't show the generator dialog by default
-			//TODO: only if generator is currently producing a signal or something?
-			if(!scope)
-				m_mainWindow->AddDialog(make_shared<FunctionGeneratorDialog>(generator, args.awgstate, this));
+			TRACE_ZONE("RunBlocking", "dirty filters");
+
+			//Must lock mutexes in this order to avoid deadlock
+			lock_guard lock(m_waveformDataMutex);
+			shared_lock lock3(g_vulkanActivityMutex);
+			m_graphExecutor.RunBlocking(batch);
+			for(auto& it : m_graphExecutor.GetRunTimes())
+				runtimes[it.first] = it.second;
 		}
-		if(load && (types & Instrument::INST_LOAD) )
-			m_mainWindow->AddDialog(make_shared<LoadDialog>(load, args.loadstate, this));
-		if(bert && (types & Instrument::INST_BERT) )
-			m_mainWindow->AddDialog(make_shared<BERTDialog>(bert, args.bertstate, this));
-		if(rfgen && (types & Instrument::INST_RF_GEN) )
-			m_mainWindow->AddDialog(make_shared<RFGeneratorDialog>(rfgen, this));
-	}
-	if(scope)
-	{
-		m_mainWindow->OnScopeAdded(scope, createDialogs);
-		if(!scope->IsOffline())
-			MakeNewTriggerGroup(scope);
+		TraceFilterRunTimes(traceStart, runtimes);
+
+		shared_lock lock(m_waveformDataMutex);
+		UpdatePacketManagers(nodesToUpdate);
 	}
 
-	m_mainWindow->AddToRecentInstrumentList(si);
+	UpdateFilterGraphRuntimeStats(tstart, runtimes);
 
-	StartWaveformThreadIfNeeded();
+	return true;
 }
 
 /**
-	@brief Removes an instrument from the session
+	@brief Runs a set of filters one graph level at a time, without updating packet managers or runtime statistics
+
+	Used to run filters on data that isn't the session's current waveform, such as one chunk of a larger capture.
+	Must be called with the waveform writer and data mutexes held.
+
+	@param levels	Filters to run, each level depending only on the ones before it
  */
-void Session::RemoveInstrument(shared_ptr<Instrument> inst)
+void Session::RunFilterLevels(const vector<set<FlowGraphNode*>>& levels)
 {
-	m_modifiedSinceLastSave = true;
+	for(auto& level : levels)
+	{
+		shared_lock lock(g_vulkanActivityMutex);
+		m_graphExecutor.RunBlocking(level);
+	}
+}
 
-	//Remove instrument-specific state
-	auto psu = dynamic_pointer_cast<SCPIPowerSupply>(inst);
-	auto meter = dynamic_pointer_cast<SCPIMultimeter>(inst);
-	auto load = dynamic_pointer_cast<SCPILoad>(inst);
-	auto bert = dynamic_pointer_cast<SCPIBERT>(inst);
-	if(psu)
-		m_psus.erase(psu);
-	if(meter)
-		m_meters.erase(meter);
-	if(load)
-		m_loads.erase(load);
-	if(bert)
-		m_berts.erase(bert);
+/**
+	@brief Finds the graph nodes which need to run when the outputs of some nodes change
 
-	//TODO: find anything that might reference our channels and set those inputs to null
+	This is everything downstream of the sources, plus any sources which are filters themselves.
+	Must be called with m_dirtyChannelsMutex held.
 
-	//Clear worker threads etc
-	m_instrumentStates.erase(inst);
+	@param sources	Nodes whose outputs changed
+	@param nodes	Set to add the nodes to
+ */
+void Session::GetDownstreamCone(const set<FlowGraphNode*>& sources, set<FlowGraphNode*>& nodes)
+{
+	//The index only gets rebuilt if the graph has been edited since last time
+	m_graphIndex.Update(GetAllGraphNodes());
+	m_graphIndex.GetDownstream(sources, nodes);
+
+	for(auto node : sources)
+	{
+		auto f = dynamic_cast<Filter*>(node);
+		if(f)
+			nodes.emplace(f);
+	}
 }
 
 /**
-	@brief Adds a multimeter dialog to the session
-
-	Low level helper, intended to be only used by file loading
+	@brief Flags a single channel as dirty (updated outside of a global trigger event)
  */
-void Session::AddMultimeterDialog(shared_ptr<SCPIMultimeter> meter)
+void Session::MarkChannelDirty(InstrumentChannel* chan)
 {
-	m_mainWindow->AddDialog(make_shared<MultimeterDialog>(meter, m_meters[meter], this));
+	lock_guard<mutex> lock(m_dirtyChannelsMutex);
+	m_dirtyChannels.emplace(chan);
+	m_dirtyChannelsUrgent = true;
 }
 
 /**
-	@brief Returns a list of all connected SCPI instruments, of any type
+	@brief Flags a channel of a polled instrument (PSU, meter, load, etc) as dirty, if its value has changed
 
-	Multi-type instruments are only counted once.
+	Unlike MarkChannelDirty(), the refresh is deferred until the coalescing window has elapsed, so updates from many
+	instruments polling at once are handled by one partial refresh rather than one each.
  */
-set<shared_ptr<SCPIInstrument>> Session::GetSCPIInstruments()
+void Session::MarkPolledChannelDirty(InstrumentChannel* chan)
 {
-	lock_guard<mutex> lock(m_scopeMutex);
-
-	set<shared_ptr<SCPIInstrument>> insts;
-	for(auto& it : m_instrumentStates)
+	//See what the channel contains now
+	PolledChannelSnapshot snap;
+	for(size_t i=0; i<chan->GetStreamCount(); i++)
 	{
-		auto s = dynamic_pointer_cast<SCPIInstrument>(it.first);
-		if(s != nullptr)
-			insts.emplace(s);
+		if(chan->GetType(i) == Stream::STREAM_TYPE_ANALOG_SCALAR)
+			snap.m_values.push_back(chan->GetScalarValue(i));
+		else
+		{
+			auto data = chan->GetData(i);
+			snap.m_data.push_back(pair(data, data ? data->m_revision : 0));
+		}
 	}
-	for(auto& scope : m_oscilloscopes)
+
+	lock_guard<mutex> lock(m_dirtyChannelsMutex);
+
+	//Nothing changed? No need to refresh
+	auto it = m_polledChannelSnapshots.find(chan);
+	if( (it != m_polledChannelSnapshots.end()) && (it->second == snap) )
+		return;
+	m_polledChannelSnapshots[chan] = snap;
+
+	if(m_dirtyChannels.empty() || (m_tfirstPolledDirty == 0) )
+		m_tfirstPolledDirty = GetTime();
+	m_dirtyChannels.emplace(chan);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Demand-driven filter scheduling
+
+/**
+	@brief Gets the set of graph nodes which need to run for a full refresh
+
+	If demand-driven scheduling is enabled, this is every instrument channel plus the filters feeding (directly or
+	indirectly) something the user can see: waveform views, protocol analyzers, and measurements. Export filters,
+	trend filters (anything pausable, since they accumulate state across acquisitions), and filters flagged as
+	"always run" are always included.
+
+	Otherwise, it's every node in the graph.
+ */
+set<FlowGraphNode*> Session::GetDemandedGraphNodes()
+{
+	auto nodes = GetAllGraphNodes();
+
+	lock_guard<mutex> lock(m_filterDemandMutex);
+
+	//Forget always-run flags of filters that no longer exist, before another filter can be created at the same address
+	for(auto it = m_alwaysRunFilters.begin(); it != m_alwaysRunFilters.end(); )
 	{
-		auto s = dynamic_pointer_cast<SCPIInstrument>(scope);
-		if(s != nullptr)
-			insts.emplace(s);
+		if(nodes.find(*it) == nodes.end())
+			it = m_alwaysRunFilters.erase(it);
+		else
+			it ++;
 	}
-	for(auto& it : m_psus)
+
+	if(!m_preferences.GetBool("Performance.Waveform Processing.demand_driven_filters"))
+		return nodes;
+
+	//Seed the search with instrument channels and every filter that's a sink
+	set<FlowGraphNode*> demanded;
+	vector<FlowGraphNode*> pending;
+	for(auto node : nodes)
 	{
-		auto s = dynamic_pointer_cast<SCPIInstrument>(it.first);
-		if(s != nullptr)
-			insts.emplace(s);
+		auto f = dynamic_cast<Filter*>(node);
+		if( !f ||
+			(m_displayedFilters.find(f) != m_displayedFilters.end()) ||
+			(m_alwaysRunFilters.find(f) != m_alwaysRunFilters.end()) ||
+			dynamic_cast<ExportFilter*>(f) ||
+			dynamic_cast<PausableFilter*>(f) )
+		{
+			demanded.emplace(node);
+			pending.push_back(node);
+		}
 	}
-	for(auto& it : m_meters)
+
+	//Walk backwards through inputs to find everything the sinks depend on
+	while(!pending.empty())
 	{
-		auto s = dynamic_pointer_cast<SCPIInstrument>(it.first);
-		if(s != nullptr)
-			insts.emplace(s);
+		auto node = pending.back();
+		pending.pop_back();
+
+		for(size_t i=0; i<node->GetInputCount(); i++)
+		{
+			auto src = dynamic_cast<Filter*>(node->GetInput(i).m_channel);
+			if(!src || (nodes.find(src) == nodes.end()) )
+				continue;
+			if(demanded.emplace(src).second)
+				pending.push_back(src);
+		}
 	}
-	for(auto& it : m_loads)
+
+	//Remember what we ran, so newly displayed filters can be caught up
+	m_lastDemandedFilters.clear();
+	for(auto node : demanded)
 	{
-		auto s = dynamic_pointer_cast<SCPIInstrument>(it.first);
-		if(s != nullptr)
-			insts.emplace(s);
+		auto f = dynamic_cast<Filter*>(node);
+		if(f)
+			m_lastDemandedFilters.emplace(f);
 	}
-	for(auto& it : m_berts)
+
+	return demanded;
+}
+
+/**
+	@brief Updates the set of filters whose output is visible in the GUI
+
+	Called by the GUI thread every frame. Filters which were skipped by the last demand-driven refresh have stale
+	outputs, so any of those which just became visible are marked dirty to be refreshed on the current data.
+ */
+void Session::SetDisplayedFilters(const set<Filter*>& filters)
+{
+	vector<Filter*> stale;
 	{
-		auto b = dynamic_pointer_cast<SCPIBERT>(it.first);
-		if(b != nullptr)
-			insts.emplace(b);
+		lock_guard<mutex> lock(m_filterDemandMutex);
+		if(filters == m_displayedFilters)
+			return;
+
+		if(m_preferences.GetBool("Performance.Waveform Processing.demand_driven_filters"))
+		{
+			for(auto f : filters)
+			{
+				if( (m_displayedFilters.find(f) == m_displayedFilters.end()) &&
+					(m_lastDemandedFilters.find(f) == m_lastDemandedFilters.end()) )
+				{
+					stale.push_back(f);
+				}
+			}
+		}
+
+		m_displayedFilters = filters;
 	}
 
-	return insts;
+	for(auto f : stale)
+		MarkChannelDirty(f);
 }
 
 /**
-	@brief Returns a list of all connected instruments, of any type
-
-	Multi-type instruments are only counted once.
+	@brief Checks if a filter is flagged to run on every acquisition, regardless of whether it's displayed
  */
-set<shared_ptr<Instrument>> Session::GetInstruments()
+bool Session::IsFilterAlwaysRun(Filter* f)
 {
-	lock_guard<mutex> lock(m_scopeMutex);
+	lock_guard<mutex> lock(m_filterDemandMutex);
+	return m_alwaysRunFilters.find(f) != m_alwaysRunFilters.end();
+}
 
-	set<shared_ptr<Instrument>> insts;
-	for(auto& scope : m_oscilloscopes)
-		insts.emplace(scope);
-	for(auto& it : m_psus)
-		insts.emplace(it.first);
-	for(auto& it : m_berts)
-		insts.emplace(it.first);
-	for(auto& it : m_meters)
-		insts.emplace(it.first);
-	for(auto& it : m_loads)
-		insts.emplace(it.first);
-	for(auto& it : m_instrumentStates)
-		insts.emplace(it.first);
+/**
+	@brief Flags a filter to run on every acquisition (e.g. if it's used for logging), or clears the flag
+ */
+void Session::SetFilterAlwaysRun(Filter* f, bool alwaysRun)
+{
+	lock_guard<mutex> lock(m_filterDemandMutex);
+	if(alwaysRun)
+		m_alwaysRunFilters.emplace(f);
+	else
+		m_alwaysRunFilters.erase(f);
+	m_modifiedSinceLastSave = true;
+}
 
-	return insts;
+/**
+	@brief Gets the refresh policy of a filter
+ */
+FilterRefreshPolicy Session::GetFilterRefreshPolicy(Filter* f)
+{
+	lock_guard<mutex> lock(m_refreshPolicyMutex);
+	auto it = m_refreshPolicies.find(f);
+	if(it == m_refreshPolicies.end())
+		return FilterRefreshPolicy();
+	return it->second;
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Trigger control
+/**
+	@brief Sets how often a filter is run when new data arrives
+
+	Only the settings of the policy are used. If the filter already had one, its record of when the filter last ran
+	is kept, so changing the rate doesn't make it run right away.
+ */
+void Session::SetFilterRefreshPolicy(Filter* f, const FilterRefreshPolicy& policy)
+{
+	lock_guard<mutex> lock(m_refreshPolicyMutex);
+	if(policy.IsDefault())
+		m_refreshPolicies.erase(f);
+	else
+		m_refreshPolicies[f].SetConfig(policy);
+	m_modifiedSinceLastSave = true;
+}
 
 /**
-	@brief Arms the trigger for all trigger groups
+	@brief Removes filters held back by their refresh policies from a refresh triggered by new data
 
-	@param type		Type of trigger to start
-	@param all		If true, arm all groups in the sesison.
-					If false, only stop groups with the "default" flag set
+	A filter fed only by held filters would just recompute the output it already has (or, if it accumulates, count
+	the same data twice), so it's held as well.
+
+	@param batches	Nodes about to be run. Held nodes are removed.
+	@param held		Set to add the held nodes to
+
+	@return True if anything was held
  */
-void Session::ArmTrigger(TriggerGroup::TriggerType type, bool all)
+bool Session::ApplyRefreshPolicies(vector<set<FlowGraphNode*> >& batches, set<FlowGraphNode*>& held)
 {
-	LogTrace("Arming trigger\n");
-	LogIndenter li;
+	double now = GetTime();
 
-	bool oneshot = (type == TriggerGroup::TRIGGER_TYPE_FORCED) || (type == TriggerGroup::TRIGGER_TYPE_SINGLE);
-	m_triggerOneShot = oneshot;
+	lock_guard<mutex> lock(m_dirtyChannelsMutex);
+	lock_guard<mutex> lock2(m_refreshPolicyMutex);
+	if(m_refreshPolicies.empty())
+		return false;
 
-	if(!HasOnlineScopes())
+	auto nodes = GetAllGraphNodes();
+	m_graphIndex.Update(nodes);
+
+	//Forget about filters which have been deleted
+	for(auto it = m_refreshPolicies.begin(); it != m_refreshPolicies.end(); )
 	{
-		m_tArm = GetTime();
-		m_triggerArmed = true;
-		return;
+		if(nodes.find(it->first) == nodes.end())
+			it = m_refreshPolicies.erase(it);
+		else
+			++it;
 	}
 
-	m_tPrimaryTrigger = -1;
+	set<FlowGraphNode*> pending;
+	for(auto& batch : batches)
+		pending.insert(batch.begin(), batch.end());
 
-	/*
-		If we have multiple scopes, always use single trigger to keep them synced.
-		Multi-trigger can lead to race conditions and dropped triggers if we're still downloading a secondary
-		instrument's waveform and the primary re-arms.
+	//Visit in topological order, so we know whether a node's inputs are held by the time we get to it
+	for(auto node : m_graphIndex.GetTopologicalOrder())
+	{
+		auto f = dynamic_cast<Filter*>(node);
+		if(!f || (pending.find(node) == pending.end()) )
+			continue;
 
-		Also, order of arming is critical. Secondaries must be completely armed before the primary (instrument 0) to
-		ensure that the primary doesn't trigger until the secondaries are ready for the event.
-	*/
+		bool fedByHeld = (f->GetInputCount() > 0);
+		for(size_t i=0; i<f->GetInputCount(); i++)
+		{
+			if(held.find(f->GetInput(i).m_channel) == held.end())
+			{
+				fedByHeld = false;
+				break;
+			}
+		}
 
-	//Arm each trigger group (if it's defaulted)
-	{
-		lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
-		for(auto& group : m_triggerGroups)
+		if(!fedByHeld)
 		{
-			if(group->m_default || all)
-				group->Arm(type);
+			auto it = m_refreshPolicies.find(f);
+			if( (it == m_refreshPolicies.end()) || it->second.ShouldRun(now) )
+				continue;
 		}
+		held.emplace(node);
 	}
 
-	LogTrace("All instruments are armed\n");
-	m_tArm = GetTime();
-	m_triggerArmed = true;
+	if(held.empty())
+		return false;
+	for(auto& batch : batches)
+	{
+		for(auto node : held)
+			batch.erase(node);
+	}
+	return true;
 }
 
 /**
-	@brief Stop the trigger for the session
+	@brief Tells the refresh policies of filters which just ran when they did so
 
-	@param all		If true, stop all groups in the sesison.
-					If false, only stop groups with the "default" flag set
+	@param runtimes	Execution time of each node that ran
  */
-void Session::StopTrigger(bool all)
+void Session::RecordRefreshPolicyRuns(const map<FlowGraphNode*, int64_t>& runtimes)
 {
-	m_triggerArmed = false;
+	double now = GetTime();
 
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
-	lock_guard<recursive_mutex> lock2(m_triggerGroupMutex);
-	for(auto& group : m_triggerGroups)
+	lock_guard<mutex> lock(m_refreshPolicyMutex);
+	for(auto& it : m_refreshPolicies)
 	{
-		if(group->m_default || all)
-			group->Stop();
+		auto jt = runtimes.find(it.first);
+		if(jt != runtimes.end())
+			it.second.OnRun(now, jt->second * 1.0 / FS_PER_SECOND);
 	}
 }
 
 /**
-	@brief Returns true if we have at least one scope that isn't offline
+	@brief Clear state on all of our filters
  */
-bool Session::HasOnlineScopes()
+void Session::ClearSweeps()
 {
-	for(auto scope : m_oscilloscopes)
+	lock_guard wlock(m_waveformWriterMutex);
+	lock_guard lock(m_waveformDataMutex);
+
+	set<Filter*> filters;
 	{
-		if(!scope->IsOffline())
-			return true;
+		lock_guard<mutex> lock2(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
 	}
-	return false;
+
+	for(auto f : filters)
+		f->ClearSweeps();
+
+	{
+		lock_guard<mutex> lock3(m_maskTesterMutex);
+		for(auto& it : m_maskTesters)
+			it.second->ResetStats();
+	}
+
+	ResetMeasurementStatistics();
 }
 
-bool Session::CheckForPendingWaveforms()
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Mask testing
+
+/**
+	@brief Runs mask tests and reference comparisons, records measurements, and runs the history retention policy on
+	the most recently downloaded live acquisition
+
+	Called by the WaveformThread right after the filter graph has run on a new acquisition. The results are stored in
+	the acquisition's history point, and HistoryManager::ApplyPolicies() pins or drops the point once the GUI thread
+	has added it to history.
+ */
+void Session::EvaluateHistoryPolicies()
 {
-	lock_guard<mutex> lock(m_scopeMutex);
+	auto pt = m_policyPoint;
+	m_policyPoint = nullptr;
+	if(!pt)
+		return;
 
-	//No online scopes to poll? Re-run the filter graph if we're armed
-	if(!HasOnlineScopes())
-		return m_triggerArmed;
+	TRACE_ZONE("EvaluateHistoryPolicies");
 
-	//Return true if any group has fully triggered
-	lock_guard<recursive_mutex> lock2(m_triggerGroupMutex);
-	for(auto& group : m_triggerGroups)
+	//Must lock mutexes in this order to avoid deadlock
+	shared_lock lock(m_waveformDataMutex);
+	shared_lock lock2(g_vulkanActivityMutex);
+
+	set<Filter*> filters;
 	{
-		if(group->CheckForPendingWaveforms())
-			return true;
+		lock_guard<mutex> lock3(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
 	}
 
-	//Nothing ready
-	return false;
+	RunMaskTests(pt, filters);
+	RunReferenceCompares(pt, filters);
+	RecordMeasurements(pt, filters);
+
+	string reason;
+	RetentionPolicy::Decision decision;
+	{
+		bool referenceFailed = (pt->m_referenceResult == HistoryPoint::REFERENCE_FAIL);
+		lock_guard<mutex> lock3(m_history.m_retention.GetMutex());
+		decision = m_history.m_retention.Evaluate(filters, referenceFailed, reason);
+	}
+	pt->m_retentionReason = reason;
+	pt->m_retentionDecision = decision;
 }
 
 /**
-	@brief Pull the waveform data out of the queue and make it current
+	@brief Builds the history dialog's thumbnails for every point downloaded since the last call
+
+	Runs in the WaveformThread once the filter graph is done with the GPU. Only the instruments' uniformly sampled
+	analog streams are included, since those are the ones the min/max reduction works on.
  */
-void Session::DownloadWaveforms()
+void Session::GenerateHistoryThumbnails()
 {
-	{
-		lock_guard<mutex> lock(m_perfClockMutex);
-		m_waveformDownloadRate.Tick();
-	}
+	vector<PendingAcquisition> acqs;
+	acqs.swap(m_thumbnailAcquisitions);
+	if(acqs.empty() || !m_preferences.GetBool("Performance.History.thumbnails"))
+		return;
 
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
-	lock_guard<mutex> lock2(m_scopeMutex);
-	lock_guard<recursive_mutex> lock3(m_triggerGroupMutex);
+	TRACE_ZONE("GenerateHistoryThumbnails");
 
-	//Get the data from each  trigger group
-	for(auto group : m_triggerGroups)
+	//Must lock mutexes in this order to avoid deadlock
+	shared_lock lock(m_waveformDataMutex);
+	shared_lock lock2(g_vulkanActivityMutex);
+
+	if(!m_thumbnailer)
+		m_thumbnailer = make_unique<HistoryThumbnailer>("Session.thumbnailer");
+
+	for(auto& acq : acqs)
 	{
-		if(!group->CheckForPendingWaveforms())
-			continue;
+		auto pt = acq.m_point;
+
+		//Collect every analog waveform of every group so the whole point is reduced in one submission
+		vector<HistoryThumbnail> thumbnails;
+		vector<UniformAnalogWaveform*> waveforms;
+		vector<StreamDescriptor> streams;
+		vector<string> colors;
+		vector<size_t> owners;
+		for(auto& group : acq.m_groups)
+		{
+			vector<shared_ptr<Oscilloscope>> scopes;
+			scopes.push_back(group->m_primary);
+			for(auto& scope : group->m_secondaries)
+				scopes.push_back(scope);
 
-		group->DownloadWaveforms();
+			for(auto& scope : scopes)
+			{
+				auto it = pt->m_history.find(scope);
+				if(it == pt->m_history.end())
+					continue;
+
+				for(size_t i=0; i<scope->GetChannelCount(); i++)
+				{
+					auto chan = scope->GetOscilloscopeChannel(i);
+					if(!chan)
+						continue;
+					for(size_t j=0; j<chan->GetStreamCount(); j++)
+					{
+						StreamDescriptor stream(chan, j);
+						auto jt = it->second.find(stream);
+						if(jt == it->second.end())
+							continue;
+						auto wfm = dynamic_cast<UniformAnalogWaveform*>(jt->second);
+						if(!wfm)
+							continue;
+
+						waveforms.push_back(wfm);
+						streams.push_back(stream);
+						colors.push_back(chan->m_displaycolor);
+						owners.push_back(thumbnails.size());
+					}
+				}
+			}
+
+			HistoryThumbnail thumb;
+			thumb.m_group = group->GetDescription();
+			thumbnails.push_back(thumb);
+		}
+
+		vector<vector<float>> bins;
+		m_thumbnailer->Reduce(waveforms, HISTORY_THUMBNAIL_BINS, bins);
 
-		//This scope has recently triggered and should be added to history
+		//Scale to the channel's current vertical range, the same way the waveform area would show it
+		for(size_t i=0; i<waveforms.size(); i++)
 		{
-			lock_guard<mutex> lock4(m_recentlyTriggeredScopeMutex);
-			m_recentlyTriggeredScopes.emplace(group->m_primary);
-			m_recentlyTriggeredGroups.emplace(group);
-			for(auto scope : group->m_secondaries)
-				m_recentlyTriggeredScopes.emplace(scope);
+			float range = streams[i].GetVoltageRange();
+			float center = -streams[i].GetOffset();
+			if( bins[i].empty() || (range <= 0) )
+				continue;
+
+			HistoryThumbnailTrace trace;
+			trace.m_color = colors[i];
+			trace.m_bins.resize(bins[i].size());
+			for(size_t k=0; k<bins[i].size(); k++)
+				trace.m_bins[k] = min(1.0f, max(0.0f, (bins[i][k] - center) / range + 0.5f));
+			thumbnails[owners[i]].m_traces.push_back(trace);
 		}
-	}
 
-	//If we're in offline one-shot mode, disarm the trigger
-	if( m_triggerGroups.empty() && m_triggerOneShot)
-		m_triggerArmed = false;
+		pt->m_thumbnails = std::move(thumbnails);
+		pt->m_thumbnailsReady = true;
+	}
 }
 
 /**
-	@brief Check if new waveform data has arrived
-
-	This runs in the main GUI thread.
+	@brief Tests a live acquisition against every eye pattern mask
 
-	TODO: this might be best to move to MainWindow?
+	Must be called with the waveform data locked, after the filter graph has run on the acquisition.
 
-	@return True if a new waveform came in, false if not
+	@param pt		History point to store the result in
+	@param filters	All filters which currently exist
  */
-bool Session::CheckForWaveforms(vk::raii::CommandBuffer& cmdbuf)
+void Session::RunMaskTests(shared_ptr<HistoryPoint> pt, const set<Filter*>& filters)
 {
-	bool hadNewWaveforms = false;
-
-	if(g_waveformReadyEvent.Peek())
+	bool testAcquisitions = m_preferences.GetBool("Miscellaneous.Mask Testing.enable");
+	bool searchMargin = m_preferences.GetBool("Miscellaneous.Mask Testing.margin_search");
+	if(!testAcquisitions && !searchMargin)
 	{
-		LogTrace("Waveform is ready\n");
-
-		//Add to history
-		vector<shared_ptr<Oscilloscope>> scopes;
-		set<shared_ptr<TriggerGroup>> groups;
-		{
-			shared_lock<shared_mutex> lock2(m_waveformDataMutex);
-			lock_guard<mutex> lock(m_recentlyTriggeredScopeMutex);
-			for(auto scope : m_recentlyTriggeredScopes)
-				scopes.push_back(scope);
-			m_recentlyTriggeredScopes.clear();
+		pt->m_maskTestResult = HistoryPoint::MASK_NOT_TESTED;
+		return;
+	}
 
-			groups = m_recentlyTriggeredGroups;
-			m_recentlyTriggeredGroups.clear();
+	TRACE_ZONE("RunMaskTests");
 
-			m_history.AddHistory(scopes);
+	//Find a tester for every eye pattern with a mask, and forget about any which have been deleted
+	vector<pair<EyePattern*, shared_ptr<MaskTester>>> testers;
+	{
+		lock_guard<mutex> lock(m_maskTesterMutex);
+		for(auto it = m_maskTesters.begin(); it != m_maskTesters.end(); )
+		{
+			if(filters.find(it->first) == filters.end())
+				it = m_maskTesters.erase(it);
+			else
+				it++;
 		}
 
-		//Tone-map all of our waveforms
-		//Generally does not need waveform data locked since it only works on *rendered* data...
-		//but density functions like spectrogram are an exception as those don't have a render step.
-		//TODO: should we "snapshot" the waveform into a render buffer or something to avoid this sync point?
-		hadNewWaveforms = true;
+		for(auto f : filters)
 		{
-			lock_guard<shared_mutex> lock(m_waveformDataMutex);
-			m_mainWindow->ToneMapAllWaveforms(cmdbuf);
+			auto eye = dynamic_cast<EyePattern*>(f);
+			if(!eye || eye->GetMask().empty())
+				continue;
+
+			auto& tester = m_maskTesters[eye];
+			if(!tester)
+				tester = make_shared<MaskTester>(string("MaskTester.") + eye->GetHwname());
+			testers.push_back(pair<EyePattern*, shared_ptr<MaskTester>>(eye, tester));
 		}
+	}
 
-		//Release the waveform processing thread
-		g_waveformProcessedEvent.Signal();
+	bool tested = false;
+	bool failed = false;
+	uint64_t hits = 0;
+	for(auto& it : testers)
+	{
+		if(searchMargin)
+			it.second->AnalyzeEye(it.first);
+		if(!testAcquisitions)
+			continue;
 
-		//In multi-scope free-run mode, re-arm every instrument's trigger after we've processed all data
-		for(auto group : groups)
-			group->RearmIfMultiScope();
+		bool eyeFailed;
+		uint64_t eyeHits;
+		if(!it.second->Test(it.first, eyeFailed, eyeHits))
+			continue;
+
+		tested = true;
+		failed |= eyeFailed;
+		hits += eyeHits;
 	}
 
-	//If a re-render operation completed, tone map everything again
-	if((g_rerenderDoneEvent.Peek() || g_refilterDoneEvent.Peek()) && !hadNewWaveforms)
-		m_mainWindow->ToneMapAllWaveforms(cmdbuf);
+	pt->m_maskHits = hits;
+	if(!tested)
+		pt->m_maskTestResult = HistoryPoint::MASK_NOT_TESTED;
+	else if(failed)
+		pt->m_maskTestResult = HistoryPoint::MASK_FAIL;
+	else
+		pt->m_maskTestResult = HistoryPoint::MASK_PASS;
+}
 
-	return hadNewWaveforms;
+/**
+	@brief Gets the cumulative mask test results for an eye pattern
+
+	@return True if the eye has been tested, or its integrated data measured against the mask
+ */
+bool Session::GetMaskTestStats(EyePattern* eye, MaskTestStats& stats)
+{
+	shared_ptr<MaskTester> tester;
+	{
+		lock_guard<mutex> lock(m_maskTesterMutex);
+		auto it = m_maskTesters.find(eye);
+		if(it == m_maskTesters.end())
+			return false;
+		tester = it->second;
+	}
+
+	stats = tester->GetStats();
+	return (stats.m_acquisitions > 0) || stats.m_eyeValid;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Filter processing
+// Golden reference comparison
 
-size_t Session::GetFilterCount()
+/**
+	@brief Gets the comparer for a stream, creating one if it doesn't have a reference yet
+ */
+shared_ptr<ReferenceComparer> Session::GetOrCreateReferenceComparer(StreamDescriptor stream)
 {
-	set<Filter*> filters;
+	lock_guard<mutex> lock(m_referenceComparerMutex);
+	auto& comparer = m_referenceComparers[stream];
+	if(!comparer)
+		comparer = make_shared<ReferenceComparer>(string("ReferenceComparer.") + stream.GetName());
+	return comparer;
+}
+
+/**
+	@brief Uses the waveform currently displayed on a stream as its golden reference
+
+	Selecting a point in history first makes this load the reference from history.
+
+	@param stream		The stream to compare against the reference
+	@param tolerance	Maximum allowed distance from the reference, in the stream's units
+
+	@return True if the stream has uniformly sampled analog data which could be used as a reference
+ */
+bool Session::SetReferenceFromCurrent(StreamDescriptor stream, float tolerance)
+{
+	shared_lock lock(m_waveformDataMutex);
+
+	auto wfm = dynamic_cast<UniformAnalogWaveform*>(stream.GetData());
+	if(!wfm || (wfm->size() == 0) )
+		return false;
+
+	auto comparer = GetOrCreateReferenceComparer(stream);
+	TimePoint t(wfm->m_startTimestamp, wfm->m_startFemtoseconds);
+	comparer->SetReference(wfm, string("Acquisition at ") + t.PrettyPrint());
+	comparer->SetTolerance(tolerance);
+	comparer->ResetStats();
+	return true;
+}
+
+/**
+	@brief Loads a golden reference for a stream from a CSV file
+
+	The file has a time column (in seconds relative to the trigger, as written by the waveform exporter) and one or
+	more value columns. The column named after the stream is used if there is one, otherwise the first. Samples must
+	be evenly spaced at the same sample rate as the live data.
+
+	@param stream		The stream to compare against the reference
+	@param path			Path to the CSV file
+	@param tolerance	Maximum allowed distance from the reference, in the stream's units
+	@param err			Set to a description of the problem if the file couldn't be used
+
+	@return True if the reference was loaded
+ */
+bool Session::SetReferenceFromFile(StreamDescriptor stream, const string& path, float tolerance, string& err)
+{
+	CSVParser parser;
+	if(!parser.Load(path))
 	{
-		lock_guard<mutex> lock2(m_filterUpdatingMutex);
-		filters = Filter::GetAllInstances();
+		err = parser.GetError();
+		return false;
 	}
-	return filters.size();
+	if(parser.m_columns.empty() || (parser.m_timestamps.size() < 2) )
+	{
+		err = "File has no samples";
+		return false;
+	}
+
+	size_t column = 0;
+	for(size_t i=0; i<parser.m_names.size(); i++)
+	{
+		if(parser.m_names[i] == stream.GetName())
+			column = i;
+	}
+
+	int64_t timescale = llround( (parser.m_timestamps[1] - parser.m_timestamps[0]) * FS_PER_SECOND);
+	if(timescale <= 0)
+	{
+		err = "Timestamps aren't increasing";
+		return false;
+	}
+	int64_t triggerPhase = llround(parser.m_timestamps[0] * FS_PER_SECOND);
+
+	auto comparer = GetOrCreateReferenceComparer(stream);
+	comparer->SetReference(parser.m_columns[column], timescale, triggerPhase, path);
+	comparer->SetTolerance(tolerance);
+	comparer->ResetStats();
+	return true;
 }
 
 /**
-	@brief Queues a request to refresh all filters the next time we poll stuff
+	@brief Stops comparing a stream against its reference
  */
-void Session::RefreshAllFiltersNonblocking()
+void Session::RemoveReference(StreamDescriptor stream)
 {
-	g_refilterRequestedEvent.Signal();
+	lock_guard<mutex> lock(m_referenceComparerMutex);
+	m_referenceComparers.erase(stream);
 }
 
 /**
-	@brief Queues a request to refresh dirty filters the next time we poll stuff
-
-	Avoid waking up the waveform thread if we have no dirty filters, though.
+	@brief Gets every stream with a reference, and its comparer
  */
-void Session::RefreshDirtyFiltersNonblocking()
+map<StreamDescriptor, shared_ptr<ReferenceComparer> > Session::GetReferenceComparers()
 {
-	{
-		lock_guard<mutex> lock(m_dirtyChannelsMutex);
-		if(m_dirtyChannels.empty())
-			return;
-	}
-
-	g_partialRefilterRequestedEvent.Signal();
+	lock_guard<mutex> lock(m_referenceComparerMutex);
+	return m_referenceComparers;
 }
 
 /**
-	@brief Gets all of our graph nodes (filters plus instrument channels)
+	@brief Compares a live acquisition against every golden reference
+
+	Must be called with the waveform data locked, after the filter graph has run on the acquisition.
+
+	@param pt		History point to store the result in
+	@param filters	All filters which currently exist
  */
-set<FlowGraphNode*> Session::GetAllGraphNodes()
+void Session::RunReferenceCompares(shared_ptr<HistoryPoint> pt, const set<Filter*>& filters)
 {
-	//Start with all filters
-	set<FlowGraphNode*> nodes;
+	//Forget about references on filters which have been deleted
+	vector<pair<StreamDescriptor, shared_ptr<ReferenceComparer>>> comparers;
 	{
-		lock_guard<mutex> lock2(m_filterUpdatingMutex);
-		auto filters = Filter::GetAllInstances();
-		for(auto f : filters)
-			nodes.emplace(f);
+		lock_guard<mutex> lock(m_referenceComparerMutex);
+		for(auto it = m_referenceComparers.begin(); it != m_referenceComparers.end(); )
+		{
+			auto f = dynamic_cast<Filter*>(it->first.m_channel);
+			if(f && (filters.find(f) == filters.end()) )
+				it = m_referenceComparers.erase(it);
+			else
+			{
+				comparers.push_back(*it);
+				it++;
+			}
+		}
 	}
-
-	//then add instrument channels
-	auto insts = GetInstruments();
-	for(auto inst : insts)
+	if(comparers.empty())
 	{
-		for(size_t i=0; i<inst->GetChannelCount(); i++)
-			nodes.emplace(inst->GetChannel(i));
+		pt->m_referenceResult = HistoryPoint::REFERENCE_NOT_TESTED;
+		return;
 	}
 
-	return nodes;
-}
-
-void Session::RefreshAllFilters()
-{
-	double tstart = GetTime();
-
-	auto nodes = GetAllGraphNodes();
+	TRACE_ZONE("RunReferenceCompares");
 
+	//Filters skipped by demand-driven scheduling have stale outputs from an earlier acquisition
+	bool demandDriven = m_preferences.GetBool("Performance.Waveform Processing.demand_driven_filters");
+	set<Filter*> ran;
+	if(demandDriven)
 	{
-		//Must lock mutexes in this order to avoid deadlock
-		lock_guard<shared_mutex> lock(m_waveformDataMutex);
-		//shared_lock<shared_mutex> lock3(g_vulkanActivityMutex);
-		m_graphExecutor.RunBlocking(nodes);
-		UpdatePacketManagers(nodes);
+		lock_guard<mutex> lock(m_filterDemandMutex);
+		ran = m_lastDemandedFilters;
 	}
 
-	m_lastFilterGraphExecTime = (GetTime() - tstart) * FS_PER_SECOND;
+	bool tested = false;
+	bool failed = false;
+	uint64_t failures = 0;
+	int64_t firstFailure = 0;
+	for(auto& it : comparers)
 	{
-		lock_guard<mutex> lock(m_lastFilterGraphRuntimeMutex);
-		m_lastFilterGraphRuntimeStats = m_graphExecutor.GetRunTimes();
+		auto f = dynamic_cast<Filter*>(it.first.m_channel);
+		if(f && demandDriven && (ran.find(f) == ran.end()) )
+			continue;
+
+		auto wfm = dynamic_cast<UniformAnalogWaveform*>(it.first.GetData());
+		if(!wfm)
+			continue;
+
+		bool streamFailed;
+		uint64_t streamFailures;
+		int64_t streamFirst;
+		if(!it.second->Test(wfm, streamFailed, streamFailures, streamFirst))
+			continue;
+
+		tested = true;
+		failed |= streamFailed;
+		if(streamFailures && ( (failures == 0) || (streamFirst < firstFailure) ) )
+			firstFailure = streamFirst;
+		failures += streamFailures;
 	}
+
+	pt->m_referenceFailures = failures;
+	pt->m_referenceFirstFailure = firstFailure;
+	if(!tested)
+		pt->m_referenceResult = HistoryPoint::REFERENCE_NOT_TESTED;
+	else if(failed)
+		pt->m_referenceResult = HistoryPoint::REFERENCE_FAIL;
+	else
+		pt->m_referenceResult = HistoryPoint::REFERENCE_PASS;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Measurement statistics
+
 /**
-	@brief Refresh dirty filters (and anything in their downstream influence cone)
+	@brief Records the value of every scalar filter output for a live acquisition, and updates the running statistics
 
-	@return True if at least one filter was refreshed, false if nothing was dirty
+	Must be called with the waveform data locked, after the filter graph has run on the acquisition.
+
+	@param pt		History point to store the values in
+	@param filters	All filters which currently exist
  */
-bool Session::RefreshDirtyFilters()
+void Session::RecordMeasurements(shared_ptr<HistoryPoint> pt, const set<Filter*>& filters)
 {
-	set<FlowGraphNode*> nodesToUpdate;
+	TRACE_ZONE("RecordMeasurements");
 
+	//Filters skipped by demand-driven scheduling have stale outputs from an earlier acquisition
+	set<Filter*> ran = filters;
+	if(m_preferences.GetBool("Performance.Waveform Processing.demand_driven_filters"))
 	{
-		lock_guard<mutex> lock(m_dirtyChannelsMutex);
-		if(m_dirtyChannels.empty())
-			return false;
+		lock_guard<mutex> lock(m_filterDemandMutex);
+		ran = m_lastDemandedFilters;
+	}
 
-		//Start with all nodes
-		auto nodes = GetAllGraphNodes();
+	for(auto f : ran)
+	{
+		if(filters.find(f) == filters.end())
+			continue;
 
-		//Check each one to see if it needs updating
-		for(auto f : nodes)
+		for(size_t i=0; i<f->GetStreamCount(); i++)
 		{
-			if(f->IsDownstreamOf(m_dirtyChannels))
-				nodesToUpdate.emplace(f);
+			if(f->GetType(i) == Stream::STREAM_TYPE_ANALOG_SCALAR)
+				pt->m_measurements[StreamDescriptor(f, i)] = f->GetScalarValue(i);
 		}
+	}
 
-		//The filter itself needs to be updated too
-		for(auto node : m_dirtyChannels)
+	//Setting the flag under the lock means a recompute either sees the point or we've counted it here, never both
+	lock_guard<mutex> lock(m_measurementStatsMutex);
+	for(auto& it : m_measurementStats)
+	{
+		//Instrument scalar channels aren't filters, so pick them up now
+		auto jt = pt->m_measurements.find(it.first);
+		if(jt == pt->m_measurements.end())
 		{
-			auto f = dynamic_cast<Filter*>(node);
-			if(f)
-				nodesToUpdate.emplace(f);
+			if(dynamic_cast<Filter*>(it.first.m_channel))
+				continue;
+			jt = pt->m_measurements.emplace(it.first, it.first.GetScalarValue()).first;
 		}
 
-		//Reset list for next round
-		m_dirtyChannels.clear();
+		it.second.Add(jt->second);
 	}
-	if(nodesToUpdate.empty())
-		return false;
+	pt->m_measurementsRecorded = true;
+}
 
-	//Refresh the dirty filters only
-	double tstart = GetTime();
+/**
+	@brief Starts keeping running statistics for a scalar stream
+ */
+void Session::TrackMeasurementStatistics(StreamDescriptor stream)
+{
+	lock_guard<mutex> lock(m_measurementStatsMutex);
+	m_measurementStats[stream];
+}
 
-	{
-		//Must lock mutexes in this order to avoid deadlock
-		lock_guard<shared_mutex> lock(m_waveformDataMutex);
-		shared_lock<shared_mutex> lock3(g_vulkanActivityMutex);
-		m_graphExecutor.RunBlocking(nodesToUpdate);
-		UpdatePacketManagers(nodesToUpdate);
-	}
+/**
+	@brief Stops keeping running statistics for a scalar stream
+ */
+void Session::UntrackMeasurementStatistics(StreamDescriptor stream)
+{
+	lock_guard<mutex> lock(m_measurementStatsMutex);
+	m_measurementStats.erase(stream);
+}
 
-	m_lastFilterGraphExecTime = (GetTime() - tstart) * FS_PER_SECOND;
-	{
-		lock_guard<mutex> lock(m_lastFilterGraphRuntimeMutex);
-		m_lastFilterGraphRuntimeStats = m_graphExecutor.GetRunTimes();
-	}
+/**
+	@brief Gets the running statistics for a scalar stream
 
-	return true;
+	@param stream	The stream to look up
+	@param summary	Statistics, if the stream has any values
+	@param bins		Number of histogram bins to generate
+
+	@return True if the stream is tracked and has at least one value
+ */
+bool Session::GetMeasurementSummary(StreamDescriptor stream, MeasurementSummary& summary, size_t bins)
+{
+	lock_guard<mutex> lock(m_measurementStatsMutex);
+	auto it = m_measurementStats.find(stream);
+	if(it == m_measurementStats.end())
+		return false;
+
+	summary = it->second.GetSummary(bins);
+	return summary.m_count > 0;
 }
 
 /**
-	@brief Flags a single channel as dirty (updated outside of a global trigger event)
+	@brief Forgets every value in the running statistics, but keeps tracking the same streams
  */
-void Session::MarkChannelDirty(InstrumentChannel* chan)
+void Session::ResetMeasurementStatistics()
 {
-	lock_guard<mutex> lock(m_dirtyChannelsMutex);
-	m_dirtyChannels.emplace(chan);
+	lock_guard<mutex> lock(m_measurementStatsMutex);
+	for(auto& it : m_measurementStats)
+		it.second.Clear();
 }
 
 /**
-	@brief Clear state on all of our filters
+	@brief Rebuilds the running statistics from the measurements recorded in every point in history
+
+	The walk happens in a background thread. New acquisitions keep being added while it runs, so at the end the
+	statistics cover everything in history plus anything acquired since.
+
+	Must be called from the GUI thread, since it walks the history list.
  */
-void Session::ClearSweeps()
+void Session::RecomputeMeasurementStatistics()
 {
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
+	StopMeasurementRecompute();
 
-	set<Filter*> filters;
+	//Snapshot the points and clear the statistics atomically with respect to RecordMeasurements()
+	vector<shared_ptr<HistoryPoint>> points;
 	{
-		lock_guard<mutex> lock2(m_filterUpdatingMutex);
-		filters = Filter::GetAllInstances();
+		lock_guard<mutex> lock(m_measurementStatsMutex);
+		for(auto& pt : m_history.m_history)
+		{
+			if(pt->m_measurementsRecorded)
+				points.push_back(pt);
+		}
+
+		for(auto& it : m_measurementStats)
+			it.second.Clear();
 	}
 
-	for(auto f : filters)
-		f->ClearSweeps();
+	m_measurementRecomputeDone = 0;
+	m_measurementRecomputeTotal = points.size();
+	m_measurementRecomputeCancel = false;
+	m_measurementRecomputeRunning = true;
+	m_measurementRecomputeThread = make_unique<thread>([this, points]()
+	{
+		pthread_setname_np_compat("MeasRecompute");
+
+		for(auto& pt : points)
+		{
+			if(m_measurementRecomputeCancel)
+				break;
+
+			{
+				lock_guard<mutex> lock(m_measurementStatsMutex);
+				for(auto& it : m_measurementStats)
+				{
+					auto jt = pt->m_measurements.find(it.first);
+					if(jt != pt->m_measurements.end())
+						it.second.Add(jt->second);
+				}
+			}
+
+			m_measurementRecomputeDone ++;
+		}
+
+		m_measurementRecomputeRunning = false;
+	});
+}
+
+/**
+	@brief Aborts a history recompute in progress, if any, and waits for the thread to exit
+ */
+void Session::StopMeasurementRecompute()
+{
+	if(!m_measurementRecomputeThread)
+		return;
+
+	m_measurementRecomputeCancel = true;
+	m_measurementRecomputeThread->join();
+	m_measurementRecomputeThread = nullptr;
+	m_measurementRecomputeRunning = false;
 }
 
 /**
@@ -3428,7 +8417,7 @@ void Session::ClearSweeps()
  */
 void Session::UpdatePacketManagers(const set<FlowGraphNode*>& nodes)
 {
-	lock_guard<mutex> lock(m_packetMgrMutex);
+	lock_guard lock(m_packetMgrMutex);
 
 	set<PacketDecoder*> deletedFilters;
 	for(auto it : m_packetmgrs)
@@ -3454,7 +8443,7 @@ shared_ptr<PacketManager> Session::AddPacketFilter(PacketDecoder* filter)
 {
 	LogTrace("Adding packet manager for %s\n", filter->GetDisplayName().c_str());
 
-	lock_guard<mutex> lock(m_packetMgrMutex);
+	lock_guard lock(m_packetMgrMutex);
 	shared_ptr<PacketManager> ret = make_shared<PacketManager>(filter, *this);
 	m_packetmgrs[filter] = ret;
 	return ret;
@@ -3480,9 +8469,82 @@ int64_t Session::GetToneMapTime()
 	return m_mainWindow->GetToneMapTime();
 }
 
-void Session::RenderWaveformTextures(vk::raii::CommandBuffer& cmdbuf, vector<shared_ptr<DisplayedChannel> >& channels)
+/**
+	@brief Records rasterization of every visible waveform
+
+	@param cmdbuf			Command buffer to record into
+	@param channels			Filled out with the channels referenced by the command buffer
+	@param timer			If not null, timestamps are recorded around each shader dispatch
+	@param interruptible	If true, stop early if another re-render is requested while we're recording
+	@param previewOnly		If true, only draw raw instrument channels (see ShouldPreviewAcquisition())
+
+	@return False if recording was stopped early, leaving some waveforms out
+ */
+bool Session::RenderWaveformTextures(
+	vk::raii::CommandBuffer& cmdbuf,
+	vector<shared_ptr<DisplayedChannel> >& channels,
+	GpuTimer* timer,
+	bool interruptible,
+	bool previewOnly)
+{
+	return m_mainWindow->RenderWaveformTextures(cmdbuf, channels, timer, interruptible, previewOnly);
+}
+
+/**
+	@brief Turns per-shader GPU profiling of rasterization and tone mapping on or off
+
+	Profiling serializes every dispatch, so it's off by default.
+ */
+void Session::SetGpuProfilingEnabled(bool enabled)
+{
+	m_gpuProfilingEnabled = enabled;
+
+	lock_guard<mutex> lock(m_gpuTimingMutex);
+	m_lastRasterizeGpuTimings.clear();
+	m_lastToneMapGpuTimings.clear();
+}
+
+/**
+	@brief Publishes per-shader GPU times from a completed rasterization pass
+ */
+void Session::SetRasterizeGpuTimings(const vector<GpuTiming>& timings)
+{
+	lock_guard<mutex> lock(m_gpuTimingMutex);
+	m_lastRasterizeGpuTimings = timings;
+}
+
+/**
+	@brief Publishes per-shader GPU times from a completed tone mapping pass
+ */
+void Session::SetToneMapGpuTimings(const vector<GpuTiming>& timings)
+{
+	lock_guard<mutex> lock(m_gpuTimingMutex);
+	m_lastToneMapGpuTimings = timings;
+}
+
+/**
+	@brief Starts compiling rendering pipelines in the background, so the first waveform doesn't have to wait for them
+
+	Compiled pipelines go into the idle pool, where the views that need them will find them. Those created before the
+	warmup gets to them just compile their own as usual. The VkPipelineCache is saved at shutdown, so after the first
+	run this is mostly a cache lookup anyway.
+
+	@param keys		Pipelines to create, including duplicates if more than one view will need an instance
+ */
+void Session::WarmPipelines(const vector<ComputePipelineKey>& keys)
 {
-	m_mainWindow->RenderWaveformTextures(cmdbuf, channels);
+	map<ComputePipelineKey, size_t> counts;
+	for(auto& k : keys)
+		counts[k] ++;
+
+	LogTrace("Warming up %zu compute pipelines\n", counts.size());
+	for(auto& it : counts)
+	{
+		auto key = it.first;
+		auto count = it.second;
+		m_taskPool.Submit(m_pipelineWarmup, [this, key, count]()
+			{ m_pipelinePool.Warm(key, count); });
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -3490,6 +8552,9 @@ void Session::RenderWaveformTextures(vk::raii::CommandBuffer& cmdbuf, vector<sha
 
 /**
 	@brief Creates one filter of each known type to use as a reference for what inputs are legal to use to a new filter
+
+	This is done lazily the first time something needs the full list (typically a filter menu), since constructing
+	every filter is a noticeable fraction of startup time.
  */
 void Session::CreateReferenceFilters()
 {
@@ -3499,15 +8564,28 @@ void Session::CreateReferenceFilters()
 	Filter::EnumProtocols(names);
 
 	for(auto n : names)
-	{
-		auto f = Filter::CreateFilter(n.c_str(), "");;
-		f->HideFromList();
-		m_referenceFilters[n] = f;
-	}
+		GetReferenceFilter(n);
+	m_referenceFiltersComplete = true;
 
 	LogTrace("Created %zu reference filters in %.2f ms\n", m_referenceFilters.size(), (GetTime() - start) * 1000);
 }
 
+/**
+	@brief Gets the reference instance of a given filter, creating it if necessary
+ */
+Filter* Session::GetReferenceFilter(const string& name)
+{
+	auto it = m_referenceFilters.find(name);
+	if(it != m_referenceFilters.end())
+		return it->second;
+
+	auto f = Filter::CreateFilter(name.c_str(), "");
+	if(f)
+		f->HideFromList();
+	m_referenceFilters[name] = f;
+	return f;
+}
+
 /**
 	@brief Destroys the reference filters
 
@@ -3519,32 +8597,230 @@ void Session::DestroyReferenceFilters()
 	for(auto it : m_referenceFilters)
 		delete it.second;
 	m_referenceFilters.clear();
+	m_referenceFiltersComplete = false;
+}
+
+/**
+	@brief Registers everything in the session which can give up memory under memory pressure
+
+	Reclaimers which touch waveform data are only run if OnMemoryPressure() manages to get the waveform data mutex.
+ */
+void Session::RegisterMemoryReclaimers()
+{
+	//Idle waveforms are free to drop
+	m_memoryPressure.Register(
+		"Waveform pool",
+		RECLAIM_IDLE,
+		false,
+		[this](MemoryPressureType /*type*/) { return m_waveformPool.GetMemoryUsage(); },
+		[this](MemoryPressureType /*type*/, size_t bytes, size_t& freed)
+		{
+			freed = m_waveformPool.Free(bytes);
+			return (freed > 0);
+		});
+
+	//Saved filter outputs can be recomputed if the point is selected again
+	m_memoryPressure.Register(
+		"Filter output cache",
+		RECLAIM_DERIVED,
+		true,
+		[this](MemoryPressureType /*type*/) { return GetFilterCacheMemoryUsage(); },
+		[this](MemoryPressureType /*type*/, size_t bytes, size_t& freed)
+		{
+			freed = ReclaimFilterCache(bytes);
+			return (freed > 0);
+		});
+
+	//Old history points can be moved to slower memory
+	m_memoryPressure.Register(
+		"History",
+		RECLAIM_WAVEFORMS,
+		true,
+		[this](MemoryPressureType type) { return m_history.GetReclaimableMemory(type); },
+		[this](MemoryPressureType type, size_t bytes, size_t& freed)
+		{ return m_history.ReclaimMemory(type, bytes, freed); });
+
+	//The instrument drivers don't tell us how big their pools are, so only empty them if all else fails
+	m_memoryPressure.Register(
+		"Instrument waveform pools",
+		RECLAIM_LAST_RESORT,
+		false,
+		[](MemoryPressureType /*type*/) { return (size_t)0; },
+		[this](MemoryPressureType /*type*/, size_t /*bytes*/, size_t& freed)
+		{
+			freed = 0;
+			bool any = false;
+			lock_guard lock(m_scopeMutex);
+			for(auto scope : m_oscilloscopes)
+			{
+				if(scope->FreeWaveformPools())
+					any = true;
+			}
+			return any;
+		});
+}
+
+/**
+	@brief Gets the amount of sample data in filter outputs saved to history points
+ */
+size_t Session::GetFilterCacheMemoryUsage()
+{
+	size_t bytes = 0;
+	for(auto& wp : m_filterCacheLRU)
+	{
+		auto pt = wp.lock();
+		if(!pt)
+			continue;
+		for(auto it : pt->m_filterOutputs)
+		{
+			if(it.second)
+				bytes += WaveformPool::GetWaveformMemoryUsage(it.second);
+		}
+	}
+	return bytes;
+}
+
+/**
+	@brief Discards saved filter outputs, least recently used first, until at least the requested amount is freed
+
+	The caller must hold the waveform data mutex.
+
+	@return Number of bytes freed
+ */
+size_t Session::ReclaimFilterCache(size_t bytes)
+{
+	size_t freed = 0;
+	while(!m_filterCacheLRU.empty() && (freed < bytes) )
+	{
+		auto pt = m_filterCacheLRU.back().lock();
+		m_filterCacheLRU.pop_back();
+		if(!pt)
+			continue;
+
+		for(auto it : pt->m_filterOutputs)
+		{
+			if(it.second)
+				freed += WaveformPool::GetWaveformMemoryUsage(it.second);
+		}
+
+		//Delete rather than pooling them, we're trying to free memory
+		for(auto it : pt->m_filterOutputs)
+			delete it.second;
+		pt->m_filterOutputs.clear();
+		pt->m_filterOutputFilters.clear();
+	}
+	return freed;
+}
+
+/**
+	@brief Gets the amount of sample data in use, broken down by what it's used for
+
+	Waveforms attached to instrument channels are often also in history (the most recent point, or whichever point
+	is selected). Those are only counted as instrument waveforms.
+
+	Doesn't block: if the waveform data mutex is busy (e.g. the filter graph is running), nothing is measured.
+
+	@param instruments	Set to the size of waveforms attached to instrument channels
+	@param history		Set to the size of all other waveforms in history
+	@param filters		Set to the size of current filter outputs, plus outputs saved to history points
+
+	@return True if the usage was measured
+ */
+bool Session::GetSampleMemoryUsage(size_t& instruments, size_t& history, size_t& filters)
+{
+	shared_lock lock(m_waveformDataMutex, try_to_lock);
+	if(!lock.owns_lock())
+		return false;
+
+	//Instrument waveforms, and how much of that is also in history
+	instruments = 0;
+	size_t overlap = 0;
+	for(auto scope : GetScopes())
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan)
+				continue;
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				auto data = chan->GetData(j);
+				if(!data)
+					continue;
+
+				size_t bytes = WaveformPool::GetWaveformMemoryUsage(data);
+				instruments += bytes;
+
+				auto pt = m_history.GetHistory(TimePoint(data->m_startTimestamp, data->m_startFemtoseconds));
+				if(!pt)
+					continue;
+				auto hist = pt->m_history.find(scope);
+				if(hist == pt->m_history.end())
+					continue;
+				auto it = hist->second.find(StreamDescriptor(chan, j));
+				if( (it != hist->second.end()) && (it->second == data) )
+					overlap += bytes;
+			}
+		}
+	}
+
+	size_t total = m_history.GetMemoryUsage();
+	history = (total > overlap) ? (total - overlap) : 0;
+
+	//Filter outputs
+	set<Filter*> allFilters;
+	{
+		lock_guard<mutex> lock2(m_filterUpdatingMutex);
+		allFilters = Filter::GetAllInstances();
+	}
+	filters = GetFilterCacheMemoryUsage();
+	for(auto f : allFilters)
+	{
+		for(size_t i=0; i<f->GetStreamCount(); i++)
+		{
+			auto data = f->GetData(i);
+			if(data)
+				filters += WaveformPool::GetWaveformMemoryUsage(data);
+		}
+	}
+
+	return true;
 }
 
 /**
 	@brief Handler for low memory conditions
+
+	Frees just enough memory to satisfy the request, cheapest first (see RegisterMemoryReclaimers()).
  */
 bool Session::OnMemoryPressure(MemoryPressureLevel level, MemoryPressureType type, size_t requestedSize)
 {
 	LogDebug("Session::OnMemoryPressure\n");
 	LogIndenter li;
 
-	bool moreFreed = false;
-
-	//Free historical waveforms
-	if(m_history.OnMemoryPressure(level, type, requestedSize))
-		moreFreed = true;
-
-	//Free waveform pools
-	if(!moreFreed)
+	//Try to lock the waveform data mutex for up to 250ms, since most of what can be freed is waveform data
+	double end = GetTime() + 0.25;
+	bool gotMutex = false;
+	while(GetTime() < end)
 	{
-		std::lock_guard<std::mutex> lock(m_scopeMutex);
-		for(auto scope : m_oscilloscopes)
+		//Need the writer mutex too, or we could free data out from under a filter graph run between batches
+		if(!m_waveformWriterMutex.try_lock())
+			continue;
+		if(m_waveformDataMutex.try_lock())
 		{
-			if(scope->FreeWaveformPools())
-				moreFreed = true;
+			gotMutex = true;
+			break;
 		}
+		m_waveformWriterMutex.unlock();
 	}
+	if(!gotMutex)
+		LogDebug("Failed to lock waveform data mutex, only freeing idle buffers\n");
+
+	bool freed = m_memoryPressure.OnMemoryPressure(level, type, requestedSize, gotMutex);
 
-	return moreFreed;
+	if(gotMutex)
+	{
+		m_waveformDataMutex.unlock();
+		m_waveformWriterMutex.unlock();
+	}
+	return freed;
 }
@@ -38,27 +38,354 @@
 class MainWindow;
 class WaveformArea;
 class DisplayedChannel;
+class DeskewTracker;
+class WaveformRecorder;
+class ViewerServer;
+class AutomationServer;
+class DataLogger;
+class EyePattern;
+class MaskTester;
+class MaskTestStats;
+class ReferenceComparer;
+class HistoryThumbnailer;
 
 #include "../xptools/HzClock.h"
 #include "HistoryManager.h"
+#include "HistoryReplay.h"
 #include "PacketManager.h"
 #include "PreferenceManager.h"
+#include "PreferenceTypes.h"
 #include "Marker.h"
 #include "TriggerGroup.h"
+#include "AcquisitionLatency.h"
+#include "GpuTimer.h"
+#include "MetricHistory.h"
+#include "ComputePipelinePool.h"
+#include "MemoryPressureRegistry.h"
+#include "FilterGraphIndex.h"
+#include "FilterRefreshPolicy.h"
+#include "FilterGraphTemplate.h"
+#include "GpuReadback.h"
+#include "MeasurementStatistics.h"
+#include "PathAutotuner.h"
+#include "PollingScheduler.h"
+#include "TaskPool.h"
+#include "ThreadRoles.h"
+#include "WaveformAccumulateFilter.h"
 
 extern std::atomic<int64_t> g_lastWaveformRenderTime;
+extern std::atomic<int64_t> g_lastWaveformPipelineStallTime;
+extern std::atomic<int64_t> g_lastWaveformUploadTime;
+extern std::atomic<int64_t> g_lastWaveformProcessTime;
+extern std::atomic<int64_t> g_lastWaveformRasterizeWaitTime;
+extern std::atomic<int64_t> g_channelRasterizations;
+extern std::atomic<int64_t> g_skippedChannelRasterizations;
+extern std::atomic<int64_t> g_sharedIndexSearches;
+extern std::atomic<int64_t> g_sharedChannelRasterizations;
+extern std::atomic<int64_t> g_interruptedRerenders;
+extern std::atomic<int64_t> g_cancelledRefilters;
 
 class Session;
 
+/**
+	@brief An acquisition which has been downloaded by the WaveformThread but not yet added to history
+
+	The history point is created at download time (rather than when the GUI thread gets around to it) so that the
+	waveforms are accounted for even if the next acquisition replaces them before the GUI thread catches up.
+ */
+class PendingAcquisition
+{
+public:
+	PendingAcquisition()
+	: m_downloadTime(0)
+	, m_rearmed(false)
+	, m_replayed(false)
+	, m_rendered(false)
+	{}
+
+	///@brief History point containing the newly acquired waveforms
+	std::shared_ptr<HistoryPoint> m_point;
+
+	///@brief Trigger groups which contributed data to this acquisition
+	std::set<std::shared_ptr<TriggerGroup>> m_groups;
+
+	///@brief Time the WaveformThread started downloading this acquisition, for latency measurement
+	double m_downloadTime;
+
+	///@brief True if the trigger groups were re-armed right after downloading, rather than waiting for the GUI
+	bool m_rearmed;
+
+	///@brief True if m_point was replayed from history, rather than newly acquired
+	bool m_replayed;
+
+	/**
+		@brief True once the WaveformThread has published the image of this acquisition (or of a later one)
+
+		The GUI thread only commits acquisitions up to the one on screen, so in pipelined mode the next one waits.
+	 */
+	bool m_rendered;
+
+	///@brief Timestamps of this acquisition's progress to the screen (null if it's not going to be displayed)
+	std::shared_ptr<AcquisitionLatency> m_latency;
+};
+
+/**
+	@brief An instrument connected ahead of time while a session is being loaded
+
+	Session::PreconnectInstruments() opens the transports and creates the drivers for every instrument in the file
+	concurrently, then the PreLoad* functions pick them up in file order.
+ */
+class PreconnectedInstrument
+{
+public:
+	PreconnectedInstrument()
+	: m_transport(nullptr)
+	, m_connectTime(0)
+	{}
+
+	///@brief Transport to the instrument (may be null or disconnected if connecting failed)
+	SCPITransport* m_transport;
+
+	///@brief Driver instance, if the transport connected
+	std::shared_ptr<Instrument> m_inst;
+
+	///@brief Time taken to connect and initialize the driver, in seconds
+	double m_connectTime;
+
+	///@brief Message of the exception thrown while connecting, if there was one
+	std::string m_error;
+};
+
+/**
+	@brief A single waveform waiting to be written to disk by Session::SerializeWaveforms()
+ */
+class WaveformSaveJob
+{
+public:
+	WaveformSaveJob(WaveformBase* wfm, const std::string& path, size_t bytes)
+	: m_wfm(wfm)
+	, m_path(path)
+	, m_bytes(bytes)
+	, m_compression(COMPRESS_DENSE_NONE)
+	, m_codeGain(1)
+	, m_codeOffset(0)
+	, m_packBits(false)
+	, m_timebaseSource(nullptr)
+	{}
+
+	///@brief The waveform to save
+	WaveformBase* m_wfm;
+
+	///@brief Path to the .bin file
+	std::string m_path;
+
+	///@brief Expected size of the file, for progress reporting
+	size_t m_bytes;
+
+	///@brief Quantization to apply to dense analog waveforms (saved as densev2 if not COMPRESS_DENSE_NONE)
+	DenseCompression m_compression;
+
+	///@brief Size of one quantization code, in volts (or other Y axis unit)
+	double m_codeGain;
+
+	///@brief Value of quantization code zero
+	double m_codeOffset;
+
+	///@brief True to save a dense digital waveform one bit per sample (as densebits)
+	bool m_packBits;
+
+	/**
+		@brief Another sparse waveform in the same history point which may have the same offsets and durations
+
+		If it does, only a reference to its file (m_timebaseFile) is saved rather than a second copy of the timebase.
+	 */
+	SparseWaveformBase* m_timebaseSource;
+
+	///@brief Name of the file m_timebaseSource is saved to, relative to the directory of this one
+	std::string m_timebaseFile;
+};
+
+/**
+	@brief Outcome of a consume-driven acquisition scan of one instrument, which runs on its polling thread
+ */
+class ConsumeScanResult
+{
+public:
+	///@brief The instrument that was scanned
+	Oscilloscope* m_scope;
+
+	///@brief Value of Session::m_consumeGeneration when the scan was queued
+	uint64_t m_generation;
+
+	///@brief Channels of the instrument which are turned off because nothing is using them
+	std::set<OscilloscopeChannel*> m_autoDisabled;
+
+	///@brief Channels of the instrument the user turned back on after we turned them off
+	std::set<OscilloscopeChannel*> m_exempt;
+};
+
+/**
+	@brief Metadata for one stream of a history point in a saved session
+ */
+class SavedStreamMetadata
+{
+public:
+	SavedStreamMetadata()
+	: m_channel(0)
+	, m_stream(0)
+	, m_format("sparsev1")
+	, m_timescale(0)
+	, m_triggerPhase(0)
+	{}
+
+	///@brief Index of the channel within the scope
+	int m_channel;
+
+	///@brief Index of the stream within the channel
+	int m_stream;
+
+	///@brief Format of the sample data file (e.g. "sparsev2")
+	std::string m_format;
+
+	///@brief Type of sparse waveform ("analog", "digital", "can"), or empty to guess from the stream type
+	std::string m_datatype;
+
+	///@brief Timescale of the waveform, in fs
+	int64_t m_timescale;
+
+	///@brief Trigger phase of the waveform, in fs
+	int64_t m_triggerPhase;
+};
+
+/**
+	@brief Metadata for one history point of a scope in a saved session
+
+	Read from either scope_N_metadata.yml or the binary index saved beside it (scope_N_index.bin).
+ */
+class SavedWaveformMetadata
+{
+public:
+	SavedWaveformMetadata()
+	: m_time(0, 0)
+	, m_id(0)
+	, m_pinned(false)
+	{}
+
+	///@brief Timestamp of the history point
+	TimePoint m_time;
+
+	///@brief ID of the waveform, used to find its data directory
+	int m_id;
+
+	///@brief True if the point is pinned
+	bool m_pinned;
+
+	///@brief Label for the point
+	std::string m_label;
+
+	///@brief Each stream with data at this point
+	std::vector<SavedStreamMetadata> m_streams;
+};
+
+/**
+	@brief A waveform data file to be read by Session::ReadWaveformFiles()
+ */
+class WaveformLoadJob
+{
+public:
+	WaveformLoadJob(WaveformBase* wfm, const std::string& format, const std::string& path)
+	: m_wfm(wfm)
+	, m_format(format)
+	, m_path(path)
+	{}
+
+	/**
+		@brief The waveform to load into, with metadata already filled out
+
+		Replaced with the loaded waveform once the job completes, which may be a different object
+		(see Session::LoadWaveformFile).
+	 */
+	WaveformBase* m_wfm;
+
+	///@brief Format of the file (e.g. "sparsev2")
+	std::string m_format;
+
+	///@brief Path to the .bin file
+	std::string m_path;
+};
+
+/**
+	@brief A history point whose sample data is already in the session's data directory
+ */
+class SavedHistoryPoint
+{
+public:
+	///@brief Metadata the point was saved with, for each scope
+	std::map<std::shared_ptr<Oscilloscope>, SavedWaveformMetadata> m_metadata;
+
+	///@brief Directories holding the point's sample data, to delete if it's removed from history
+	std::vector<std::string> m_dirs;
+};
+
+/**
+	@brief Everything needed to finish saving a session's waveform data after it's been gathered by the GUI thread
+
+	See Session::PrepareWaveformSave().
+ */
+class WaveformSavePlan
+{
+public:
+	///@brief Sample data files to write
+	std::vector<WaveformSaveJob> m_jobs;
+
+	///@brief History points being written, held so their sample data stays put until we're done
+	std::vector<std::shared_ptr<HistoryPoint>> m_points;
+
+	///@brief Contents of each scope_N_metadata.yml, by path
+	std::map<std::string, YAML::Node> m_metadata;
+
+	///@brief Contents of the binary index for each metadata file, by path of the YAML
+	std::map<std::string, std::vector<SavedWaveformMetadata>> m_indexes;
+
+	///@brief Directories of points which are no longer in history, deleted once the new metadata is written
+	std::vector<std::string> m_staleDirs;
+};
+
 class InstrumentConnectionState
 {
 public:
-	InstrumentConnectionState(InstrumentThreadArgs args)
+	/**
+		@brief Starts polling an instrument
+
+		@param args			Arguments for the polling loop
+		@param scheduler	Shared scheduler to poll from, or null to spawn a dedicated thread
+		@param targetRate	Desired poll rate in Hz, if using a shared scheduler
+	 */
+	InstrumentConnectionState(
+		InstrumentThreadArgs args,
+		PollingScheduler* scheduler = nullptr,
+		float targetRate = 0)
+		: m_scheduler(scheduler)
+		, m_inst(args.inst)
 	{
 		m_shuttingDown = false;
-		args.shuttingDown = &m_shuttingDown;
-		m_thread = std::make_unique<std::thread>(InstrumentThread, args);
+		m_pollRate = 0;
+		m_targetPollRate = targetRate;
+		m_triggerRate = 0;
+		m_queueLimitByMemory = false;
+		m_queueLimitCount = 5;
+		m_queueLimitBytes = 1024LL * 1024LL * 1024LL;
+		m_queueLimit = 5;
+		m_queueStalls = 0;
 		m_lastTriggerState = Oscilloscope::TRIGGER_MODE_WAIT;
+		args.shuttingDown = &m_shuttingDown;
+		args.wakeEvent = &m_wakeEvent;
+		args.pollRate = &m_pollRate;
+		args.triggerRate = &m_triggerRate;
+		if(m_scheduler)
+			m_scheduler->Add(args, &m_targetPollRate);
+		else
+			m_thread = std::make_unique<std::thread>(InstrumentThread, args);
 	}
 
 	~InstrumentConnectionState()
@@ -70,19 +397,90 @@ public:
 		{
 			//Terminate the thread
 			m_shuttingDown = true;
+			m_wakeEvent.Signal();
 			m_thread->join();
 		}
 		m_thread = nullptr;
+
+		if(m_scheduler)
+		{
+			m_shuttingDown = true;
+			m_scheduler->Remove(m_inst.get());
+		}
+		m_scheduler = nullptr;
 	}
 
+	///@brief True if the instrument is polled by the session's shared PollingScheduler rather than its own thread
+	bool IsSharedPolling()
+	{ return m_scheduler != nullptr; }
+
 	///@brief Termination flag for shutting down the polling thread
 	std::atomic<bool> m_shuttingDown;
 
 	///@brief Thread for polling the instrument
 	std::unique_ptr<std::thread> m_thread;
 
+	///@brief Shared scheduler polling the instrument, if not using m_thread
+	PollingScheduler* m_scheduler;
+
+	///@brief The instrument being polled
+	std::shared_ptr<SCPIInstrument> m_inst;
+
+	///@brief Poll rate the shared scheduler aims for, in Hz (unused with a dedicated thread)
+	std::atomic<float> m_targetPollRate;
+
 	///@brief Cached trigger state, to reflect in the UI
 	Oscilloscope::TriggerMode m_lastTriggerState;
+
+	///@brief Signaled to wake the polling thread before its next scheduled poll
+	Event m_wakeEvent;
+
+	///@brief Rate at which the polling thread is checking the trigger (or polling, if shared), in Hz
+	std::atomic<float> m_pollRate;
+
+	///@brief Smoothed trigger rate seen by the polling thread, in Hz (0 if not triggering)
+	std::atomic<float> m_triggerRate;
+
+	///@brief True to cap the pending waveform queue by memory usage, false to cap by waveform count
+	std::atomic<bool> m_queueLimitByMemory;
+
+	///@brief Maximum number of pending waveforms, if capping by count
+	std::atomic<size_t> m_queueLimitCount;
+
+	///@brief Maximum estimated size of all pending waveforms, in bytes, if capping by memory
+	std::atomic<int64_t> m_queueLimitBytes;
+
+	///@brief Queue depth currently in effect, as computed by the polling thread
+	std::atomic<size_t> m_queueLimit;
+
+	///@brief Number of times polling was paused because the pending waveform queue was full
+	std::atomic<uint64_t> m_queueStalls;
+};
+
+/**
+	@brief Immutable list of connected instruments and their channels
+
+	Only rebuilt when an instrument is added or removed, so per-frame GUI code and every filter graph refresh can share
+	one copy instead of building their own sets under the scope mutex.
+ */
+class InstrumentSnapshot
+{
+public:
+	InstrumentSnapshot(uint64_t epoch)
+	: m_epoch(epoch)
+	{}
+
+	///@brief Incremented every time the list of instruments changes
+	uint64_t m_epoch;
+
+	///@brief All instruments (multi-type instruments are only listed once)
+	std::set<std::shared_ptr<Instrument>> m_instruments;
+
+	///@brief All SCPI instruments
+	std::set<std::shared_ptr<SCPIInstrument>> m_scpiInstruments;
+
+	///@brief Every channel of every instrument, as filter graph nodes
+	std::set<FlowGraphNode*> m_channels;
 };
 
 /**
@@ -99,28 +497,62 @@ public:
 
 	bool OnMemoryPressure(MemoryPressureLevel level, MemoryPressureType type, size_t requestedSize);
 
+	bool GetSampleMemoryUsage(size_t& instruments, size_t& history, size_t& filters);
+
+	///@brief Gets the registry of everything which can give up memory under memory pressure
+	MemoryPressureRegistry& GetMemoryPressureRegistry()
+	{ return m_memoryPressure; }
+
 	void ArmTrigger(TriggerGroup::TriggerType type, bool all=false);
 	void StopTrigger(bool all=false);
+	void WakeInstrumentThreads();
 	bool HasOnlineScopes();
 	void DownloadWaveforms();
+	bool RecordWaveformUploads(vk::raii::CommandBuffer& cmdbuf);
 	bool CheckForWaveforms(vk::raii::CommandBuffer& cmdbuf);
-	void RefreshAllFilters();
+	void RefreshAllFilters(bool throttle = false);
+	void RefreshTriggeredFilters();
 	void RefreshAllFiltersNonblocking();
+	void RefreshFiltersNonblocking(const std::set<FlowGraphNode*>& sources);
+	void RefreshScopeFiltersNonblocking();
+	bool RefreshRequestedFilters();
+	void RunFilterLevels(const std::vector<std::set<FlowGraphNode*>>& levels);
+	void SetFilterHistoryPoint(std::shared_ptr<HistoryPoint> pt);
+
+	/**
+		@brief Discards all saved per-history-point filter outputs, e.g. because filter parameters changed
+	 */
+	void InvalidateFilterOutputCache()
+	{ m_filterConfigRevision ++; }
+
 	void RefreshDirtyFiltersNonblocking();
 	bool RefreshDirtyFilters();
 	void FlushConfigCache();
 
 	void MarkChannelDirty(InstrumentChannel* chan);
+	void MarkPolledChannelDirty(InstrumentChannel* chan);
+
+	void SetDisplayedFilters(const std::set<Filter*>& filters);
+	bool IsFilterAlwaysRun(Filter* f);
+	void SetFilterAlwaysRun(Filter* f, bool alwaysRun);
+	FilterRefreshPolicy GetFilterRefreshPolicy(Filter* f);
+	void SetFilterRefreshPolicy(Filter* f, const FilterRefreshPolicy& policy);
 
-	void RenderWaveformTextures(
+	bool RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
-		std::vector<std::shared_ptr<DisplayedChannel> >& channels);
+		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
+		GpuTimer* timer = nullptr,
+		bool interruptible = false,
+		bool previewOnly = false);
 
 	void Clear();
 	void ClearBackgroundThreads();
 
 	bool PreLoadFromYaml(const YAML::Node& node, const std::string& dataDir, bool online);
 	bool LoadFromYaml(const YAML::Node& node, const std::string& dataDir, bool online);
+	void BeginLoadBatch();
+	void EndLoadBatch(bool refresh);
+	bool InLoadBatch();
 	YAML::Node SerializeInstrumentConfiguration();
 	YAML::Node SerializeMetadata();
 	YAML::Node SerializeTriggerGroups();
@@ -128,8 +560,66 @@ public:
 	YAML::Node SerializeFilterConfiguration();
 	YAML::Node SerializeMarkers();
 	bool SerializeWaveforms(const std::string& dataDir);
-	bool SerializeSparseWaveform(SparseWaveformBase* wfm, const std::string& path);
+	bool StartBackgroundWaveformSave(const std::string& dataDir);
+	bool PollBackgroundSave();
+	void WaitForBackgroundSave();
+
+	///@brief Returns true if waveform data is being written by a background save
+	bool IsBackgroundSaveInProgress()
+	{ return m_saveThread != nullptr; }
+
+	///@brief Returns the data directory our history was last saved to or loaded from (empty if none)
+	const std::string& GetSavedDataDir()
+	{ return m_savedDataDir; }
+
+	void PrepareHistoryPointSave(
+		HistoryPoint* hpoint,
+		const std::string& dataDir,
+		int numwfm,
+		std::vector<WaveformSaveJob>& jobs,
+		std::map<std::shared_ptr<Oscilloscope>, YAML::Node>& metadataNodes,
+		SavedHistoryPoint& saved);
+	static bool WriteWaveformMetadata(const std::string& yamlPath, const std::vector<SavedWaveformMetadata>& waveforms);
+
+	void StartRecording(const std::string& dataDir);
+	void StopRecording();
+
+	///@brief Returns the recorder streaming new waveforms to disk, if any
+	std::shared_ptr<WaveformRecorder> GetRecorder()
+	{ return m_recorder; }
+
+	bool StartDataLogging(const std::string& logPath);
+	void StopDataLogging();
+
+	///@brief Returns the log instrument readings are written to, if any. Safe to call from any thread.
+	std::shared_ptr<DataLogger> GetDataLogger()
+	{ return std::atomic_load(&m_dataLogger); }
+
+	void UpdateViewerServer();
+	void UpdateAutomationServer();
+	void UpdateConsumedChannels();
+
+	/**
+		@brief Checks if a channel was turned off by consume-driven acquisition because nothing was using it
+
+		Must be called from the GUI thread.
+	 */
+	bool IsChannelAutoDisabled(OscilloscopeChannel* chan)
+	{ return m_autoDisabledChannels.find(chan) != m_autoDisabledChannels.end(); }
+	void UpdateThreadRoles();
+	void UpdateHostMemoryPolicy();
+	bool SerializeSparseWaveform(SparseWaveformBase* wfm, const std::string& path, const WaveformSaveJob* job = nullptr);
 	bool SerializeUniformWaveform(UniformWaveformBase* wfm, const std::string& path);
+	bool SerializeQuantizedWaveform(UniformAnalogWaveform* wfm, const WaveformSaveJob& job);
+	bool SerializePackedDigitalWaveform(UniformDigitalWaveform* wfm, const std::string& path);
+	static WaveformBase* LoadWaveformFile(
+		TaskPool& pool,
+		WaveformBase* cap,
+		const std::string& format,
+		const std::string& fname,
+		size_t* fileSize = nullptr);
+	void WriteWaveformFiles(std::vector<WaveformSaveJob>& jobs);
+	void ReadWaveformFiles(std::vector<WaveformLoadJob>& jobs);
 
 	void AddMultimeterDialog(std::shared_ptr<SCPIMultimeter> meter);
 	std::shared_ptr<PacketManager> AddPacketFilter(PacketDecoder* filter);
@@ -149,7 +639,7 @@ public:
 	 */
 	std::shared_ptr<BERTState> GetBERTState(std::shared_ptr<BERT> bert)
 	{
-		std::lock_guard<std::mutex> lock(m_scopeMutex);
+		std::lock_guard lock(m_scopeMutex);
 		return m_berts[bert];
 	}
 
@@ -158,7 +648,7 @@ public:
 	 */
 	std::shared_ptr<PowerSupplyState> GetPSUState(std::shared_ptr<SCPIPowerSupply> psu)
 	{
-		std::lock_guard<std::mutex> lock(m_scopeMutex);
+		std::lock_guard lock(m_scopeMutex);
 		return m_psus[psu];
 	}
 
@@ -167,7 +657,7 @@ public:
 	 */
 	std::shared_ptr<FunctionGeneratorState> GetFunctionGeneratorState(std::shared_ptr<FunctionGenerator> awg)
 	{
-		std::lock_guard<std::mutex> lock(m_scopeMutex);
+		std::lock_guard lock(m_scopeMutex);
 		return m_awgs[awg];
 	}
 
@@ -176,7 +666,7 @@ public:
 	 */
 	std::shared_ptr<PacketManager> GetPacketManager(PacketDecoder* filter)
 	{
-		std::lock_guard<std::mutex> lock(m_packetMgrMutex);
+		std::lock_guard lock(m_packetMgrMutex);
 		return m_packetmgrs[filter];
 	}
 
@@ -194,18 +684,78 @@ public:
 	int64_t GetFilterGraphExecTime()
 	{ return m_lastFilterGraphExecTime.load(); }
 
+	///@brief Gets the number of filter outputs which were given a recycled buffer from the waveform pool
+	uint64_t GetFilterOutputRecycleHits()
+	{ return m_filterOutputRecycleHits.load(); }
+
+	///@brief Gets the number of filter outputs which found no suitable buffer in the pool and had to allocate one
+	uint64_t GetFilterOutputRecycleMisses()
+	{ return m_filterOutputRecycleMisses.load(); }
+
 	/**
 		@brief Gets the last run time of the waveform rendering shaders
 	 */
 	int64_t GetLastWaveformRenderTime()
 	{ return g_lastWaveformRenderTime.load(); }
 
+	/**
+		@brief Gets the time spent pulling the last set of waveforms out of the instrument queues
+	 */
+	int64_t GetLastWaveformDownloadTime()
+	{ return m_lastWaveformDownloadTime.load(); }
+
+	/**
+		@brief Gets the time the WaveformThread last spent blocked waiting for the GUI thread to consume a waveform
+	 */
+	int64_t GetLastWaveformPipelineStallTime()
+	{ return g_lastWaveformPipelineStallTime.load(); }
+
+	///@brief Gets the time the WaveformThread last spent copying freshly downloaded waveforms to the GPU
+	int64_t GetLastWaveformUploadTime()
+	{ return g_lastWaveformUploadTime.load(); }
+
+	///@brief Gets the time the WaveformThread last spent running the filter graph and history policies on new data
+	int64_t GetLastWaveformProcessTime()
+	{ return g_lastWaveformProcessTime.load(); }
+
+	///@brief Gets the time the WaveformThread last spent waiting for the GPU to finish a nonblocking rasterization
+	int64_t GetLastWaveformRasterizeWaitTime()
+	{ return g_lastWaveformRasterizeWaitTime.load(); }
+
+	///@brief Gets the time the GUI thread last spent adding newly displayed acquisitions to history
+	int64_t GetLastAcquisitionCommitTime()
+	{ return m_lastAcquisitionCommitTime.load(); }
+
+	/**
+		@brief Gets the number of acquisitions that have been processed but not yet consumed by the GUI thread
+	 */
+	size_t GetPendingAcquisitionCount()
+	{
+		std::lock_guard<std::mutex> lock(m_pendingAcquisitionMutex);
+		return m_pendingAcquisitions.size();
+	}
+
+	/**
+		@brief Gets the configured number of acquisitions the WaveformThread may process ahead of the GUI thread
+
+		A depth of 1 processes each acquisition in lockstep with the GUI.
+	 */
+	size_t GetWaveformPipelineDepth()
+	{
+		auto depth = m_preferences.GetInt("Performance.Waveform Processing.pipeline_depth");
+		if(depth < 1)
+			return 1;
+		return depth;
+	}
+
+	bool ShouldPreviewAcquisition();
+
 	/**
 		@brief Gets the average rate at which we are pulling waveforms off the scope, in Hz
 	 */
 	double GetWaveformDownloadRate()
 	{
-		std::lock_guard<std::mutex> lock(m_perfClockMutex);
+		std::lock_guard lock(m_perfClockMutex);
 		return m_waveformDownloadRate.GetAverageHz();
 	}
 
@@ -214,7 +764,7 @@ public:
 	 */
 	const std::vector<std::shared_ptr<Oscilloscope>> GetScopes()
 	{
-		std::lock_guard<std::mutex> lock(m_scopeMutex);
+		std::lock_guard lock(m_scopeMutex);
 		return m_oscilloscopes;
 	}
 
@@ -223,28 +773,20 @@ public:
 	 */
 	const std::vector<std::shared_ptr<BERT> > GetBERTs()
 	{
-		std::lock_guard<std::mutex> lock(m_scopeMutex);
+		std::lock_guard lock(m_scopeMutex);
 		std::vector<std::shared_ptr<BERT> > berts;
 		for(auto& it : m_berts)
 			berts.push_back(it.first);
 		return berts;
 	}
 
-	/**
-		@brief Gets the set of all SCPI instruments we're connect to (regardless of type)
-	 */
-	std::set<std::shared_ptr<SCPIInstrument>> GetSCPIInstruments();
-
-	/**
-		@brief Gets the set of all instruments we're connect to (regardless of type)
-	 */
-	std::set<std::shared_ptr<Instrument>> GetInstruments();
+	std::shared_ptr<const InstrumentSnapshot> GetInstrumentSnapshot();
 
 	/**
 		@brief Get the number of instruments we're connected to (regardless of type)
 	 */
 	size_t GetInstrumentCount()
-	{ return GetInstruments().size(); }
+	{ return GetInstrumentSnapshot()->m_instruments.size(); }
 
 	/**
 		@brief Check if we have data available from all of our scopes
@@ -254,15 +796,33 @@ public:
 	/**
 		@brief Get the mutex controlling access to waveform data
 	 */
-	std::shared_mutex& GetWaveformDataMutex()
+	ProfiledMutex<std::shared_mutex>& GetWaveformDataMutex()
 	{ return m_waveformDataMutex; }
 
+	/**
+		@brief Get the mutex which anything modifying waveform data must hold, before locking the waveform data mutex
+	 */
+	ProfiledMutex<std::recursive_mutex>& GetWaveformWriterMutex()
+	{ return m_waveformWriterMutex; }
+
 	/**
 		@brief Get our history manager
 	 */
 	HistoryManager& GetHistory()
 	{ return m_history; }
 
+	/**
+		@brief Get the controller for replaying history through the acquisition pipeline
+	 */
+	HistoryReplay& GetReplay()
+	{ return m_replay; }
+
+	/**
+		@brief Get the worker pool shared by parallel loops
+	 */
+	TaskPool& GetTaskPool()
+	{ return m_taskPool; }
+
 	/**
 		@brief Adds a marker
 	 */
@@ -272,10 +832,38 @@ public:
 
 	void ClearSweeps();
 
+	void EvaluateHistoryPolicies();
+	void GenerateHistoryThumbnails();
+	bool GetMaskTestStats(EyePattern* eye, MaskTestStats& stats);
+
+	bool SetReferenceFromCurrent(StreamDescriptor stream, float tolerance);
+	bool SetReferenceFromFile(StreamDescriptor stream, const std::string& path, float tolerance, std::string& err);
+	void RemoveReference(StreamDescriptor stream);
+	std::map<StreamDescriptor, std::shared_ptr<ReferenceComparer> > GetReferenceComparers();
+
+	void TrackMeasurementStatistics(StreamDescriptor stream);
+	void UntrackMeasurementStatistics(StreamDescriptor stream);
+	bool GetMeasurementSummary(StreamDescriptor stream, MeasurementSummary& summary, size_t bins);
+	void ResetMeasurementStatistics();
+	void RecomputeMeasurementStatistics();
+
+	///@brief Checks if measurement statistics are being recomputed from history in the background
+	bool IsRecomputingMeasurementStatistics()
+	{ return m_measurementRecomputeRunning; }
+
+	///@brief Gets the fraction of history points walked by the current recompute
+	float GetMeasurementRecomputeProgress()
+	{
+		size_t total = m_measurementRecomputeTotal;
+		if(total == 0)
+			return 1;
+		return m_measurementRecomputeDone.load() * 1.0f / total;
+	}
+
 	/**
 		@brief Get the mutex controlling access to rasterized waveforms
 	 */
-	std::mutex& GetRasterizedWaveformMutex()
+	ProfiledMutex<std::mutex>& GetRasterizedWaveformMutex()
 	{ return m_rasterizedWaveformMutex; }
 
 	/**
@@ -295,7 +883,7 @@ public:
 
 	std::vector<std::shared_ptr<TriggerGroup> > GetTriggerGroups()
 	{
-		std::lock_guard<std::recursive_mutex> lock(m_triggerGroupMutex);
+		std::lock_guard lock(m_triggerGroupMutex);
 		return m_triggerGroups;
 	}
 
@@ -305,10 +893,37 @@ public:
 	void MakeNewTriggerGroup(PausableFilter* filter);
 
 	int64_t GetDeskew(std::shared_ptr<Oscilloscope> scope)
-	{ return m_scopeDeskewCal[scope]; }
+	{
+		std::lock_guard<std::mutex> lock(m_deskewMutex);
+		auto it = m_scopeDeskewCal.find(scope);
+		if(it == m_scopeDeskewCal.end())
+			return 0;
+		return it->second;
+	}
 
 	void SetDeskew(std::shared_ptr<Oscilloscope> scope, int64_t skew)
-	{ m_scopeDeskewCal[scope] = skew; }
+	{
+		std::lock_guard<std::mutex> lock(m_deskewMutex);
+		m_scopeDeskewCal[scope] = skew;
+	}
+
+	void StartDeskewTracking(
+		std::shared_ptr<Oscilloscope> secondary,
+		StreamDescriptor primaryStream,
+		StreamDescriptor secondaryStream,
+		double interval,
+		float smoothing,
+		float minCorrelation);
+	void StopDeskewTracking(std::shared_ptr<Oscilloscope> secondary);
+
+	///@brief Gets the background deskew tracker for a secondary instrument, if any
+	std::shared_ptr<DeskewTracker> GetDeskewTracker(std::shared_ptr<Oscilloscope> secondary)
+	{
+		auto it = m_deskewTrackers.find(secondary);
+		if(it != m_deskewTrackers.end())
+			return it->second;
+		return nullptr;
+	}
 
 	bool IsPrimaryOfMultiScopeGroup(std::shared_ptr<Oscilloscope> scope);
 	bool IsSecondaryOfMultiScopeGroup(std::shared_ptr<Oscilloscope> scope);
@@ -340,14 +955,105 @@ public:
 		return m_lastFilterGraphRuntimeStats;
 	}
 
+	/**
+		@brief Checks if per-shader GPU timestamps should be recorded around rendering work
+	 */
+	bool IsGpuProfilingEnabled()
+	{ return m_gpuProfilingEnabled.load(); }
+
+	void SetGpuProfilingEnabled(bool enabled);
+
+	///@brief Return the per-shader GPU times from the last rasterization pass
+	std::vector<GpuTiming> GetRasterizeGpuTimings()
+	{
+		std::lock_guard<std::mutex> lock(m_gpuTimingMutex);
+		return m_lastRasterizeGpuTimings;
+	}
+
+	///@brief Return the per-shader GPU times from the last tone mapping pass
+	std::vector<GpuTiming> GetToneMapGpuTimings()
+	{
+		std::lock_guard<std::mutex> lock(m_gpuTimingMutex);
+		return m_lastToneMapGpuTimings;
+	}
+
+	void SetRasterizeGpuTimings(const std::vector<GpuTiming>& timings);
+	void SetToneMapGpuTimings(const std::vector<GpuTiming>& timings);
+
+	///@brief Gets the time series of performance metrics
+	MetricHistory& GetMetricHistory()
+	{ return m_metricHistory; }
+
+	///@brief Gets the trigger-to-display latency statistics of each trigger group
+	AcquisitionLatencyTracker& GetLatencyTracker()
+	{ return m_latencyTracker; }
+
+	/**
+		@brief Gets the timestamps of the acquisition the WaveformThread is processing
+
+		Only valid on the WaveformThread, between DownloadWaveforms() and the next call to it.
+	 */
+	std::shared_ptr<AcquisitionLatency> GetInFlightLatency()
+	{ return m_inFlightLatency; }
+
+	/**
+		@brief Gets the history point of the acquisition the WaveformThread is processing (the displayed segment)
+
+		Only valid on the WaveformThread, between DownloadWaveforms() and the next call to it.
+	 */
+	std::shared_ptr<HistoryPoint> GetInFlightPoint()
+	{ return m_inFlightPoint; }
+
+	void MarkAcquisitionRendered(std::shared_ptr<HistoryPoint> point);
+	void AttachAcquisition(std::shared_ptr<HistoryPoint> point);
+
+	void OnFramePresented(double now);
+
+	///@brief Gets the pool of idle compute pipelines
+	ComputePipelinePool& GetPipelinePool()
+	{ return m_pipelinePool; }
+
+	///@brief Gets the service for reading a few values out of GPU-resident waveforms
+	GpuReadback& GetGpuReadback()
+	{ return m_gpuReadback; }
+
+	void WarmPipelines(const std::vector<ComputePipelineKey>& keys);
+
+	///@brief Saves a filter graph template for use elsewhere in the session
+	void AddFilterTemplate(std::shared_ptr<FilterGraphTemplate> tmpl)
+	{ m_filterTemplates.push_back(tmpl); }
+
+	///@brief Gets all filter graph templates saved in this session
+	const std::vector<std::shared_ptr<FilterGraphTemplate> >& GetFilterTemplates()
+	{ return m_filterTemplates; }
+
+	///@brief Gets the pool of waveforms no longer used by history or filters
+	WaveformPool& GetWaveformPool()
+	{ return m_waveformPool; }
+
+	///@brief Gets the number of acquisitions which have been tone mapped and displayed since startup
+	uint64_t GetDisplayedAcquisitionCount()
+	{ return m_displayedAcquisitionCount; }
+
 protected:
 	void UpdatePacketManagers(const std::set<FlowGraphNode*>& nodes);
+	void UpdateFilterGraphRuntimeStats(double tstart, const std::map<FlowGraphNode*, int64_t>& runtimes);
 
 	std::string GetRegisteredTypeOfDriver(const std::string& drivername);
 
 	bool LoadInstruments(int version, const YAML::Node& node, bool online);
 	bool PreLoadInstruments(int version, const YAML::Node& node, bool online);
+	void PreconnectInstruments(const YAML::Node& node);
+	void ClearPreconnectedInstruments();
 	SCPITransport* CreateTransportForNode(const YAML::Node& node);
+	std::shared_ptr<Instrument> CreateInstrumentForNode(
+		const YAML::Node& node,
+		const std::string& type,
+		SCPITransport* transport);
+	static std::shared_ptr<Instrument> CreateInstrumentDriver(
+		const std::string& type,
+		const std::string& driver,
+		SCPITransport* transport);
 	bool VerifyInstrument(const YAML::Node& node, std::shared_ptr<Instrument> inst);
 	bool PreLoadVNA(int version, const YAML::Node& node, bool online);
 	bool PreLoadOscilloscope(int version, const YAML::Node& node, bool online);
@@ -364,34 +1070,60 @@ protected:
 	bool LoadInstrumentInputs(int version, const YAML::Node& node);
 	bool LoadWaveformData(int version, const std::string& dataDir);
 	bool LoadWaveformDataForScope(
-		int version,
-		const YAML::Node& node,
+		const std::vector<SavedWaveformMetadata>& waveforms,
 		std::shared_ptr<Oscilloscope> scope,
 		const std::string& dataDir);
+	static void ParseWaveformMetadata(
+		int version,
+		const YAML::Node& node,
+		std::vector<SavedWaveformMetadata>& waveforms);
 	bool LoadWaveformDataForFilters(
 		int version,
 		const YAML::Node& node,
 		const std::string& dataDir);
-	void DoLoadWaveformDataForStream(
-		OscilloscopeChannel* chan,
-		int stream,
-		std::string format,
-		std::string fname);
-
 	///@brief Version of the file being loaded
 	int m_fileLoadVersion;
 
 	///@brief Warnings generated by loading the current file
 	ConfigWarningList m_warnings;
 
+	///@brief Instruments connected by PreconnectInstruments() but not yet claimed by a PreLoad* call, by file ID
+	std::map<uintptr_t, PreconnectedInstrument> m_preconnectedInstruments;
+
 	///@brief Deskew correction coefficients for multi-scope
 	std::map<std::shared_ptr<Oscilloscope>, int64_t> m_scopeDeskewCal;
 
+	///@brief Mutex controlling access to m_scopeDeskewCal (updated by DeskewTracker threads)
+	std::mutex m_deskewMutex;
+
+	///@brief Background deskew trackers, indexed by secondary instrument (only accessed from the GUI thread)
+	std::map<std::shared_ptr<Oscilloscope>, std::shared_ptr<DeskewTracker> > m_deskewTrackers;
+
 	///@brief Mutex for controlling access to scope vectors
-	std::mutex m_scopeMutex;
+	ProfiledMutex<std::mutex> m_scopeMutex;
+
+	///@brief Current list of instruments, or null if it needs to be rebuilt (protected by m_scopeMutex)
+	std::shared_ptr<const InstrumentSnapshot> m_instrumentSnapshot;
 
-	///@brief Mutex for controlling access to waveform data
-	std::shared_mutex m_waveformDataMutex;
+	///@brief Epoch of the most recent instrument snapshot (protected by m_scopeMutex)
+	uint64_t m_instrumentEpoch;
+
+	/**
+		@brief Mutex for controlling access to waveform data
+
+		Readers take this shared. Writers take it exclusively, but only while data is actually changing: a filter graph
+		run locks it for one batch at a time, so the GUI can read waveforms between batches instead of waiting for the
+		whole graph.
+	 */
+	ProfiledMutex<std::shared_mutex> m_waveformDataMutex;
+
+	/**
+		@brief Serializes everything that modifies waveform data
+
+		Held for the whole of a filter graph run, acquisition download, session load, etc. so no other writer can get in
+		while the data mutex is released between batches. Must be locked before m_waveformDataMutex.
+	 */
+	ProfiledMutex<std::recursive_mutex> m_waveformWriterMutex;
 
 	///@brief Mutex for controlling access to filter graph
 	std::mutex m_filterUpdatingMutex;
@@ -430,7 +1162,20 @@ protected:
 	std::shared_ptr<TriggerGroup> m_trendTriggerGroup;
 
 	///@brief Mutex controlling access to m_triggerGroups
-	std::recursive_mutex m_triggerGroupMutex;
+	ProfiledMutex<std::recursive_mutex> m_triggerGroupMutex;
+
+	void PartitionByTriggerGroup(std::set<FlowGraphNode*>& nodes, std::set<FlowGraphNode*>& skipped);
+
+	/**
+		@brief Trigger groups the last live acquisition was downloaded from (WaveformThread only)
+
+		Empty if the last acquisition didn't come from trigger groups (e.g. replayed history), in which case the
+		whole graph is refreshed.
+	 */
+	std::set<std::shared_ptr<TriggerGroup>> m_lastDownloadedGroups;
+
+	///@brief Shared polling threads for non-scope instruments, created the first time one is added if enabled
+	std::unique_ptr<PollingScheduler> m_pollingScheduler;
 
 	///@brief Worker threads and other bookkeeping metadata for instruments
 	std::map<std::shared_ptr<Instrument>, std::shared_ptr<InstrumentConnectionState> > m_instrumentStates;
@@ -438,14 +1183,153 @@ protected:
 	///@brief Processing thread for waveform data
 	std::unique_ptr<std::thread> m_waveformThread;
 
-	///@brief Scopes whose data is currently being processed for history
-	std::set<std::shared_ptr<Oscilloscope> > m_recentlyTriggeredScopes;
+	bool PrepareWaveformSave(const std::string& dataDir, bool incremental, WaveformSavePlan& plan);
+	bool FinishWaveformSave(WaveformSavePlan& plan);
+	void ReleaseWaveformSave(WaveformSavePlan& plan, bool ok);
+
+	///@brief History points whose sample data is in m_savedDataDir, by timestamp
+	std::map<TimePoint, SavedHistoryPoint> m_savedPoints;
+
+	///@brief Data directory m_savedPoints refers to
+	std::string m_savedDataDir;
+
+	///@brief Waveform ID to give the next history point written to m_savedDataDir
+	int m_nextSavedId;
+
+	///@brief Thread writing waveform data for a background save
+	std::unique_ptr<std::thread> m_saveThread;
+
+	///@brief The save m_saveThread is working on
+	std::unique_ptr<WaveformSavePlan> m_savePlan;
+
+	///@brief Set by m_saveThread when it's done
+	std::atomic<bool> m_saveDone;
+
+	///@brief Set by m_saveThread to indicate whether the save succeeded
+	std::atomic<bool> m_saveOk;
+
+	///@brief Recorder streaming new waveforms to disk, if we're recording
+	std::shared_ptr<WaveformRecorder> m_recorder;
+
+	///@brief Server for remote viewers, if enabled
+	std::unique_ptr<ViewerServer> m_viewerServer;
+
+	///@brief Server for remote control clients, if enabled
+	std::unique_ptr<AutomationServer> m_automationServer;
+
+	void RestoreAutoDisabledChannels();
+	void ApplyConsumeScanResults();
+
+	///@brief Channels consume-driven acquisition turned off, and will turn back on once something uses them
+	std::set<OscilloscopeChannel*> m_autoDisabledChannels;
+
+	///@brief Channels the user turned back on after we turned them off, which we leave alone from then on
+	std::set<OscilloscopeChannel*> m_consumeExemptChannels;
+
+	///@brief Instruments with a consume-driven acquisition scan queued, which don't get another until it's done
+	std::set<Oscilloscope*> m_consumeScansPending;
+
+	///@brief Incremented whenever the auto-disabled channels are turned back on, so older scans are discarded
+	uint64_t m_consumeGeneration;
+
+	///@brief Time of the last consume-driven acquisition scan
+	double m_lastConsumeScan;
+
+	///@brief Mutex controlling access to m_consumeResults
+	std::mutex m_consumeResultsMutex;
+
+	///@brief Scans finished by instrument threads, waiting to be applied on the GUI thread
+	std::vector<ConsumeScanResult> m_consumeResults;
+
+	///@brief Last malformed CPU list we warned about for each thread role
+	std::string m_badThreadCPUs[THREAD_ROLE_COUNT];
+
+	///@brief Log of instrument readings, if logging. Only accessed atomically, since instrument threads poll it.
+	std::shared_ptr<DataLogger> m_dataLogger;
+
+	///@brief Acquisitions which have been downloaded but not yet added to history by the GUI thread
+	std::deque<PendingAcquisition> m_pendingAcquisitions;
+
+	///@brief Mutex to synchronize access to m_pendingAcquisitions
+	std::mutex m_pendingAcquisitionMutex;
+
+	void DownloadReplayedWaveforms(double tstart);
+	void CommitPendingAcquisitions(
+		std::set<std::shared_ptr<TriggerGroup>>& groups,
+		std::vector<double>& downloadTimes,
+		bool renderedOnly);
+	void MarkLatencyToneMapped();
+
+	///@brief Trigger-to-display latency statistics
+	AcquisitionLatencyTracker m_latencyTracker;
+
+	///@brief Timestamps of the acquisition last downloaded by the WaveformThread (only touched by that thread)
+	std::shared_ptr<AcquisitionLatency> m_inFlightLatency;
+
+	///@brief History point of the acquisition last downloaded by the WaveformThread (only touched by that thread)
+	std::shared_ptr<HistoryPoint> m_inFlightPoint;
+
+	///@brief Time the GUI thread last spent committing acquisitions to history, in fs
+	std::atomic<int64_t> m_lastAcquisitionCommitTime;
+
+	///@brief Committed acquisitions whose rasterization may not have been published yet (GUI thread only)
+	std::deque<std::shared_ptr<AcquisitionLatency> > m_latencyAwaitingToneMap;
+
+	///@brief Acquisitions tone mapped into the frame being drawn, waiting for it to be presented (GUI thread only)
+	std::vector<std::shared_ptr<AcquisitionLatency> > m_latencyAwaitingPresent;
 
-	///@brief Groups whose data is currently being processed
-	std::set<std::shared_ptr<TriggerGroup>> m_recentlyTriggeredGroups;
+	std::set<WaveformAccumulateFilter*> GetAccumulateFilters();
+	void SeedAccumulations();
 
-	///@brief Mutex to synchronize access to m_recentlyTriggeredScopes
-	std::mutex m_recentlyTriggeredScopeMutex;
+	void RunMaskTests(std::shared_ptr<HistoryPoint> pt, const std::set<Filter*>& filters);
+
+	///@brief Mask testers for eye patterns with a mask, created on demand by the WaveformThread
+	std::map<EyePattern*, std::shared_ptr<MaskTester> > m_maskTesters;
+
+	///@brief Mutex controlling access to m_maskTesters
+	std::mutex m_maskTesterMutex;
+
+	void RunReferenceCompares(std::shared_ptr<HistoryPoint> pt, const std::set<Filter*>& filters);
+	std::shared_ptr<ReferenceComparer> GetOrCreateReferenceComparer(StreamDescriptor stream);
+
+	///@brief Golden waveform comparers, one per stream with a reference loaded
+	std::map<StreamDescriptor, std::shared_ptr<ReferenceComparer> > m_referenceComparers;
+
+	///@brief Mutex controlling access to m_referenceComparers
+	std::mutex m_referenceComparerMutex;
+
+	///@brief Most recently downloaded live point, to record mask test and retention results in (WaveformThread only)
+	std::shared_ptr<HistoryPoint> m_policyPoint;
+
+	///@brief Points downloaded since the last thumbnail pass, with the groups they came from (WaveformThread only)
+	std::vector<PendingAcquisition> m_thumbnailAcquisitions;
+
+	///@brief GPU reduction for history thumbnails, created when first needed
+	std::unique_ptr<HistoryThumbnailer> m_thumbnailer;
+
+	void RecordMeasurements(std::shared_ptr<HistoryPoint> pt, const std::set<Filter*>& filters);
+	void StopMeasurementRecompute();
+
+	///@brief Running statistics for each scalar stream shown in the measurements dialog
+	std::map<StreamDescriptor, MeasurementStatistics> m_measurementStats;
+
+	///@brief Mutex controlling access to m_measurementStats and HistoryPoint::m_measurementsRecorded
+	std::mutex m_measurementStatsMutex;
+
+	///@brief Thread walking history to recompute m_measurementStats
+	std::unique_ptr<std::thread> m_measurementRecomputeThread;
+
+	///@brief Set while m_measurementRecomputeThread is walking history
+	std::atomic<bool> m_measurementRecomputeRunning;
+
+	///@brief Set to abort a recompute in progress
+	std::atomic<bool> m_measurementRecomputeCancel;
+
+	///@brief Number of points m_measurementRecomputeThread has walked
+	std::atomic<size_t> m_measurementRecomputeDone;
+
+	///@brief Number of points m_measurementRecomputeThread is walking
+	std::atomic<size_t> m_measurementRecomputeTotal;
 
 	///@brief Time we last armed the global trigger
 	double m_tArm;
@@ -471,23 +1355,118 @@ protected:
 	///@brief Performance stats from last graph execution
 	std::map<FlowGraphNode*, int64_t> m_lastFilterGraphRuntimeStats;
 
+	///@brief True if GPU timestamps should be recorded around rasterization and tone mapping
+	std::atomic<bool> m_gpuProfilingEnabled;
+
+	///@brief Mutex for controlling access to m_lastRasterizeGpuTimings and m_lastToneMapGpuTimings
+	std::mutex m_gpuTimingMutex;
+
+	///@brief Per-shader GPU times from the last profiled rasterization pass
+	std::vector<GpuTiming> m_lastRasterizeGpuTimings;
+
+	///@brief Per-shader GPU times from the last profiled tone mapping pass
+	std::vector<GpuTiming> m_lastToneMapGpuTimings;
+
+	///@brief History of performance metrics, for spotting spikes that the last-value counters miss
+	MetricHistory m_metricHistory;
+
+	///@brief Compute pipelines no longer used by closed views, kept around to reuse
+	ComputePipelinePool m_pipelinePool;
+
+	///@brief Background tasks compiling pipelines for m_pipelinePool ahead of time
+	TaskGroup m_pipelineWarmup;
+
+	///@brief Reads small parts of waveforms back for tooltips without downloading the whole buffer
+	GpuReadback m_gpuReadback;
+
+	///@brief Subgraphs saved from the filter graph editor, to be re-created for other streams
+	std::vector<std::shared_ptr<FilterGraphTemplate> > m_filterTemplates;
+
+	///@brief Subsystems which can free memory under memory pressure
+	MemoryPressureRegistry m_memoryPressure;
+
+	void RegisterMemoryReclaimers();
+	size_t GetFilterCacheMemoryUsage();
+	size_t ReclaimFilterCache(size_t bytes);
+
+	///@brief Waveforms no longer used by history or filters, kept around to reuse
+	///(declared before m_history so it outlives any history points)
+	WaveformPool m_waveformPool;
+
+	///@brief Number of acquisitions which have been tone mapped and displayed since startup
+	std::atomic<uint64_t> m_displayedAcquisitionCount;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Per history point filter output cache
+
+	bool RefreshFilters(
+		const std::vector<std::set<FlowGraphNode*> >& batches,
+		const std::set<Filter*>& filters,
+		bool cancellable = false,
+		bool throttle = false,
+		const std::set<FlowGraphNode*>& skipped = {});
+	bool SwapFilterOutputsForHistory(const std::set<Filter*>& filters);
+	void SaveFilterOutputs(std::shared_ptr<HistoryPoint> pt, const std::set<Filter*>& filters);
+	void RecycleFilterOutputs(std::shared_ptr<HistoryPoint> pt, const std::set<Filter*>& filters);
+	bool RestoreFilterOutputs(std::shared_ptr<HistoryPoint> pt, const std::set<Filter*>& filters);
+
+	///@brief Mutex controlling access to m_filterHistoryPoint
+	std::mutex m_filterHistoryPointMutex;
+
+	///@brief History point the next full filter graph refresh is for (null if live data)
+	std::weak_ptr<HistoryPoint> m_filterHistoryPoint;
+
+	///@brief History point the current filter outputs were computed from (only used by the WaveformThread)
+	std::weak_ptr<HistoryPoint> m_filterOutputsPoint;
+
+	///@brief Incremented whenever filter configuration changes, so saved outputs become stale
+	std::atomic<uint64_t> m_filterConfigRevision;
+
+	///@brief Value of m_filterConfigRevision when the current filter outputs were computed
+	uint64_t m_filterOutputsRevision;
+
+	///@brief History points with saved filter outputs, most recently saved first
+	std::list<std::weak_ptr<HistoryPoint>> m_filterCacheLRU;
+
+	///@brief Number of filter outputs served from the waveform pool by RecycleFilterOutputs()
+	std::atomic<uint64_t> m_filterOutputRecycleHits;
+
+	///@brief Number of filter outputs RecycleFilterOutputs() couldn't find a pooled buffer for
+	std::atomic<uint64_t> m_filterOutputRecycleMisses;
+
 	///@brief Mutex for controlling access to performance counters
-	std::mutex m_perfClockMutex;
+	ProfiledMutex<std::mutex> m_perfClockMutex;
 
 	///@brief Frequency at which we are pulling waveforms off of scopes
 	HzClock m_waveformDownloadRate;
 
+	///@brief Time spent on the last waveform download
+	std::atomic<int64_t> m_lastWaveformDownloadTime;
+
+	///@brief Number of samples in the deepest waveform fetched by the last waveform download
+	std::atomic<size_t> m_lastWaveformDownloadDepth;
+
+	/**
+		@brief Worker threads for parallel loops in the GUI process (waveform file encoding and decoding etc)
+
+		Declared before m_history so it outlives any background history loads using it.
+	 */
+	TaskPool m_taskPool;
+
 	///@brief Historical waveform data
 	HistoryManager m_history;
 
+	///@brief Replays history points as if they were live acquisitions
+	HistoryReplay m_replay;
+
 	///@brief Mutex for controlling access to m_packetmgrs
-	std::mutex m_packetMgrMutex;
+	ProfiledMutex<std::mutex> m_packetMgrMutex;
 
 	///@brief Historical packet data from filters
 	std::map<PacketDecoder*, std::shared_ptr<PacketManager> > m_packetmgrs;
 
 	///@brief Mutex for controlling access to rasterized waveforms
-	std::mutex m_rasterizedWaveformMutex;
+	ProfiledMutex<std::mutex> m_rasterizedWaveformMutex;
 
 	///@brief True if we have >1 oscilloscope
 	bool m_multiScope;
@@ -495,12 +1474,15 @@ protected:
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Markers
 
-	///@brief Map of waveform timestamps to markers
-	std::map<TimePoint, std::vector<Marker> > m_markers;
+	///@brief Map of waveform timestamps to markers (unordered, use GetMarkerTimes() to walk them in time order)
+	std::unordered_map<TimePoint, MarkerList, TimePointHash> m_markers;
 
 	///@brief Number for next autogenerated waveform name
 	int m_nextMarkerNum;
 
+	///@brief Incremented every time a marker is added, removed, or changed
+	uint64_t m_markerRevision;
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Partial graph refreshes
 
@@ -510,6 +1492,91 @@ protected:
 	///@brief Mutex controlling access to m_dirtyChannels
 	std::mutex m_dirtyChannelsMutex;
 
+	///@brief Dependency index of the filter graph, for finding what's downstream of m_dirtyChannels
+	FilterGraphIndex m_graphIndex;
+
+	///@brief True if m_dirtyChannels contains something that should be refreshed right away
+	bool m_dirtyChannelsUrgent;
+
+	///@brief Time the oldest coalesced (polled) entry in m_dirtyChannels was added, or zero if none
+	double m_tfirstPolledDirty;
+
+	/**
+		@brief Last seen contents of a polled instrument channel, to skip refreshes when nothing changed
+	 */
+	class PolledChannelSnapshot
+	{
+	public:
+		///@brief Value of each scalar stream
+		std::vector<float> m_values;
+
+		///@brief Waveform and revision of each non-scalar stream
+		std::vector<std::pair<WaveformBase*, uint64_t> > m_data;
+
+		bool operator==(const PolledChannelSnapshot& rhs) const
+		{ return (m_values == rhs.m_values) && (m_data == rhs.m_data); }
+	};
+
+	///@brief Last seen contents of each polled channel (only used as lookup keys, never dereferenced)
+	std::map<InstrumentChannel*, PolledChannelSnapshot> m_polledChannelSnapshots;
+
+	void GetDownstreamCone(const std::set<FlowGraphNode*>& sources, std::set<FlowGraphNode*>& nodes);
+
+	/**
+		@brief Nodes whose outputs changed, queued by RefreshFiltersNonblocking() for the next requested refresh
+
+		Protected by m_dirtyChannelsMutex. Pointers are only used as lookup keys until checked against the graph,
+		since a filter may be deleted before the refresh runs.
+	 */
+	std::set<FlowGraphNode*> m_refilterSources;
+
+	///@brief True if the next requested refresh has to run the whole graph (protected by m_dirtyChannelsMutex)
+	bool m_refilterAll;
+
+	///@brief Number of load batches in progress (protected by m_dirtyChannelsMutex)
+	int m_loadBatchDepth;
+
+	///@brief True if a refresh was held back by a load batch (protected by m_dirtyChannelsMutex)
+	bool m_loadBatchRefreshDeferred;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Demand-driven filter scheduling
+
+	std::set<FlowGraphNode*> GetDemandedGraphNodes();
+
+	///@brief Mutex controlling access to m_displayedFilters, m_alwaysRunFilters, and m_lastDemandedFilters
+	std::mutex m_filterDemandMutex;
+
+	/**
+		@brief Filters whose output the GUI is currently showing (waveform views, protocol analyzers, measurements)
+
+		Updated every frame by the GUI thread. Pointers are only used as lookup keys until checked against the
+		live filter list, since a filter may be deleted before the next update.
+	 */
+	std::set<Filter*> m_displayedFilters;
+
+	/**
+		@brief Filters the user asked to run on every acquisition, even if nothing displays them
+
+		Entries for deleted filters are removed by the next GetDemandedGraphNodes().
+	 */
+	std::set<Filter*> m_alwaysRunFilters;
+
+	///@brief Filters that were run by the last demand-driven refresh
+	std::set<Filter*> m_lastDemandedFilters;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Per-filter refresh rate limiting
+
+	bool ApplyRefreshPolicies(std::vector<std::set<FlowGraphNode*> >& batches, std::set<FlowGraphNode*>& held);
+	void RecordRefreshPolicyRuns(const std::map<FlowGraphNode*, int64_t>& runtimes);
+
+	///@brief Mutex controlling access to m_refreshPolicies
+	std::mutex m_refreshPolicyMutex;
+
+	///@brief Filters which don't run on every acquisition (filters not in the map do)
+	std::map<Filter*, FilterRefreshPolicy> m_refreshPolicies;
+
 public:
 
 	/**
@@ -521,9 +1588,18 @@ public:
 	/**
 		@brief Get the markers for a given waveform timestamp
 	 */
-	std::vector<Marker>& GetMarkers(TimePoint t)
+	MarkerList& GetMarkers(TimePoint t)
 	{ return m_markers[t]; }
 
+	/**
+		@brief Checks if a waveform has any markers, without creating an empty list for it
+	 */
+	bool HasMarkers(TimePoint t)
+	{
+		auto it = m_markers.find(t);
+		return (it != m_markers.end()) && !it->second.empty();
+	}
+
 	/**
 		@brief Get a list of timestamps for markers
 	 */
@@ -533,7 +1609,14 @@ public:
 		@brief Deletes markers for a waveform timestamp
 	 */
 	void RemoveMarkers(TimePoint t)
-	{ m_markers.erase(t); }
+	{
+		m_markers.erase(t);
+		m_markerRevision ++;
+	}
+
+	///@brief Gets a counter which changes every time a marker is added, removed, or changed
+	uint64_t GetMarkerRevision()
+	{ return m_markerRevision; }
 
 	void RemovePackets(TimePoint t);
 
@@ -555,23 +1638,30 @@ protected:
 	//Preferences state
 	PreferenceManager m_preferences;
 
+	///@brief Picks between the CPU and GPU implementations of operations which have both
+	PathAutotuner m_autotuner;
+
 public:
 	PreferenceManager& GetPreferences()
 	{ return m_preferences; }
 
+	PathAutotuner& GetAutotuner()
+	{ return m_autotuner; }
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Reference filters (used to query legal inputs to filters etc)
 
 public:
 
-	/**
-		@brief Gets the reference instance of a given filter
-	 */
-	Filter* GetReferenceFilter(const std::string& name)
-	{ return m_referenceFilters[name]; }
+	Filter* GetReferenceFilter(const std::string& name);
 
+	///@brief Gets the reference instances of every filter type
 	const std::map<std::string, Filter*>& GetReferenceFilters()
-	{ return m_referenceFilters; }
+	{
+		if(!m_referenceFiltersComplete)
+			CreateReferenceFilters();
+		return m_referenceFilters;
+	}
 
 	///@brief Get all of the drivers of a given type
 	const std::vector<std::string>& GetDriverNamesForType(const std::string& type)
@@ -588,6 +1678,9 @@ protected:
 
 	std::map<std::string, Filter*> m_referenceFilters;
 
+	///@brief True once m_referenceFilters contains every filter type
+	bool m_referenceFiltersComplete;
+
 	///@brief Map of "type" to drivername[]
 	std::map<std::string, std::vector<std::string> > m_driverNamesByType;
 };
@@ -113,6 +113,69 @@ StreamBrowserTimebaseInfo::StreamBrowserTimebaseInfo(shared_ptr<Oscilloscope> sc
 	*/
 }
 
+StreamBrowserQueueInfo::StreamBrowserQueueInfo(shared_ptr<InstrumentConnectionState> state)
+{
+	m_mode = state->m_queueLimitByMemory ? 1 : 0;
+
+	m_count = state->m_queueLimitCount;
+	m_committedCount = m_count;
+
+	m_committedBytes = state->m_queueLimitBytes;
+	m_bytes = Unit(Unit::UNIT_BYTES).PrettyPrintInt64(m_committedBytes);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cached display state
+
+/// @brief How long cached channel and instrument state is displayed before it's read again
+#define STREAM_BROWSER_REFRESH_SECONDS ((double)0.5)
+
+StreamBrowserChannelInfo::StreamBrowserChannelInfo(shared_ptr<Oscilloscope> scope, OscilloscopeChannel* chan, double now)
+	: m_enabled(chan->IsEnabled())
+	, m_time(now)
+{
+	for(size_t i=0; i<chan->GetStreamCount(); i++)
+	{
+		auto type = chan->GetType(i);
+		m_types.push_back(type);
+
+		if(type == Stream::STREAM_TYPE_ANALOG)
+		{
+			Unit unit = chan->GetYAxisUnits(i);
+			m_offsets.push_back(unit.PrettyPrint(chan->GetOffset(i)));
+			m_ranges.push_back(unit.PrettyPrint(chan->GetVoltageRange(i)));
+		}
+		else
+		{
+			m_offsets.push_back("");
+			m_ranges.push_back("");
+		}
+	}
+
+	if(scope && !m_types.empty() && (m_types[0] == Stream::STREAM_TYPE_DIGITAL) )
+		m_threshold = chan->GetYAxisUnits(0).PrettyPrint(scope->GetDigitalThreshold(chan->GetIndex()));
+}
+
+StreamBrowserScopeInfo::StreamBrowserScopeInfo(shared_ptr<Oscilloscope> scope, double now)
+	: m_offline(scope->IsOffline())
+	, m_lastEnabledChannel(0)
+	, m_time(now)
+{
+	for(size_t i=0; i<scope->GetChannelCount(); i++)
+	{
+		if(scope->IsChannelEnabled(i))
+			m_lastEnabledChannel = i;
+	}
+
+	if(scope->HasFrequencyControls())
+	{
+		m_depthText		= Unit(Unit::UNIT_SAMPLEDEPTH).PrettyPrint(scope->GetSampleDepth());
+		m_rbwText		= Unit(Unit::UNIT_HZ).PrettyPrint(scope->GetResolutionBandwidth());
+		m_centerText	= Unit(Unit::UNIT_HZ).PrettyPrint(scope->GetCenterFrequency(0));
+		m_spanText		= Unit(Unit::UNIT_HZ).PrettyPrint(scope->GetSpan());
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -120,6 +183,30 @@ StreamBrowserDialog::StreamBrowserDialog(Session& session, MainWindow* parent)
 	: Dialog("Stream Browser", "Stream Browser", ImVec2(550, 400))
 	, m_session(session)
 	, m_parent(parent)
+	, m_lastInstrumentEpoch(0)
+	, m_frameTime(0)
+	, m_awg50ohmsBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.awg_50ohms_badge_color")
+	, m_awgHizBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.awg_hiz_badge_color")
+	, m_downloadActiveBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.download_active_badge_color")
+	, m_downloadFinishedBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.download_finished_badge_color")
+	, m_downloadProgressBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.download_progress_badge_color")
+	, m_downloadWaitBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.download_wait_badge_color")
+	, m_instrumentBadgeLatchDuration(session.GetPreferences(), "Appearance.Stream Browser.instrument_badge_latch_duration")
+	, m_instrumentDisabledBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.instrument_disabled_badge_color")
+	, m_instrumentIdleBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.instrument_idle_badge_color")
+	, m_instrumentOffBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.instrument_off_badge_color")
+	, m_instrumentOfflineBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.instrument_offline_badge_color")
+	, m_instrumentOnBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.instrument_on_badge_color")
+	, m_instrumentPartialBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.instrument_partial_badge_color")
+	, m_psuCcBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.psu_cc_badge_color")
+	, m_psuCvBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.psu_cv_badge_color")
+	, m_psuMeasLabelColor(session.GetPreferences(), "Appearance.Stream Browser.psu_meas_label_color")
+	, m_psuSetLabelColor(session.GetPreferences(), "Appearance.Stream Browser.psu_set_label_color")
+	, m_triggerArmedBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.trigger_armed_badge_color")
+	, m_triggerAutoBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.trigger_auto_badge_color")
+	, m_triggerBusyBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.trigger_busy_badge_color")
+	, m_triggerStoppedBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.trigger_stopped_badge_color")
+	, m_triggerTriggeredBadgeColor(session.GetPreferences(), "Appearance.Stream Browser.trigger_triggered_badge_color")
 {
 
 }
@@ -167,14 +254,13 @@ void StreamBrowserDialog::startBadgeLine()
 */
 bool StreamBrowserDialog::renderInstrumentBadge(std::shared_ptr<Instrument> inst, bool latched, InstrumentBadge badge)
 {
-	auto& prefs = m_session.GetPreferences();
-	double now = GetTime();
+	double now = m_frameTime;
 	bool result = false;
 	if(latched)
 	{
 		std::pair<double,InstrumentBadge> old = m_instrumentLastBadge[inst];
 		double elapsed = now - old.first;
-		if(elapsed < prefs.GetReal("Appearance.Stream Browser.instrument_badge_latch_duration"))
+		if(elapsed < m_instrumentBadgeLatchDuration.Get())
 		{	// Keep previous badge
 			badge = old.second;
 		}
@@ -190,13 +276,13 @@ bool StreamBrowserDialog::renderInstrumentBadge(std::shared_ptr<Instrument> inst
 				* for trigger" or "currently
 				* capturing samples post-trigger",
 				* "ARMED" is unambiguous */
-			result = renderBadge(ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.trigger_armed_badge_color")), "ARMED", "A", NULL);
+			result = renderBadge(ImGui::ColorConvertU32ToFloat4(m_triggerArmedBadgeColor.Get()), "ARMED", "A", NULL);
 			break;
 		case StreamBrowserDialog::BADGE_STOPPED:
-			result = renderBadge(ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.trigger_stopped_badge_color")), "STOPPED", "STOP", "S", NULL);
+			result = renderBadge(ImGui::ColorConvertU32ToFloat4(m_triggerStoppedBadgeColor.Get()), "STOPPED", "STOP", "S", NULL);
 			break;
 		case StreamBrowserDialog::BADGE_TRIGGERED:
-			result = renderBadge(ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.trigger_triggered_badge_color")), "TRIGGERED", "TRIG'D", "T'D", "T", NULL);
+			result = renderBadge(ImGui::ColorConvertU32ToFloat4(m_triggerTriggeredBadgeColor.Get()), "TRIGGERED", "TRIG'D", "T'D", "T", NULL);
 			break;
 		case StreamBrowserDialog::BADGE_BUSY:
 			/* prefer language "BUSY" to "WAIT":
@@ -204,10 +290,10 @@ bool StreamBrowserDialog::renderInstrumentBadge(std::shared_ptr<Instrument> inst
 				* trigger", "BUSY" means "I am
 				* doing something internally and am
 				* not ready for some reason" */
-			result = renderBadge(ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.trigger_busy_badge_color")), "BUSY", "B", NULL);
+			result = renderBadge(ImGui::ColorConvertU32ToFloat4(m_triggerBusyBadgeColor.Get()), "BUSY", "B", NULL);
 			break;
 		case StreamBrowserDialog::BADGE_AUTO:
-			result = renderBadge(ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.trigger_auto_badge_color")), "AUTO", "A", NULL);
+			result = renderBadge(ImGui::ColorConvertU32ToFloat4(m_triggerAutoBadgeColor.Get()), "AUTO", "A", NULL);
 			break;
 		default:
 			break;
@@ -395,8 +481,7 @@ bool StreamBrowserDialog::renderToggle(const char* label, bool alignRight, ImVec
  */
 bool StreamBrowserDialog::renderOnOffToggle(const char* label, bool alignRight, bool curValue)
 {
-	auto& prefs = m_session.GetPreferences();
-	ImVec4 color = ImGui::ColorConvertU32ToFloat4((curValue ? prefs.GetColor("Appearance.Stream Browser.instrument_on_badge_color") : prefs.GetColor("Appearance.Stream Browser.instrument_off_badge_color")));
+	ImVec4 color = ImGui::ColorConvertU32ToFloat4((curValue ? m_instrumentOnBadgeColor.Get() : m_instrumentOffBadgeColor.Get()));
 	return renderToggle(label, alignRight, color, curValue);
 }
 
@@ -437,8 +522,7 @@ void StreamBrowserDialog::renderDownloadProgress(std::shared_ptr<Instrument> ins
 	ImVec4 color;
 	bool shouldRender = true;
 	bool hasProgress = false;
-	double elapsed = GetTime() - chan->GetDownloadStartTime();
-	auto& prefs = m_session.GetPreferences();
+	double elapsed = m_frameTime - chan->GetDownloadStartTime();
 
 
 	// determine what label we should apply, and while we are at
@@ -471,20 +555,20 @@ void StreamBrowserDialog::renderDownloadProgress(std::shared_ptr<Instrument> ins
 			if (elapsed > CHANNEL_DOWNLOAD_THRESHOLD_SLOW_SECONDS)
 				m_instrumentDownloadIsSlow[inst] = true;
 			hasProgress = m_instrumentDownloadIsSlow[inst];
-			color = ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.download_wait_badge_color"));
+			color = ImGui::ColorConvertU32ToFloat4(m_downloadWaitBadgeColor.Get());
 			break;
 		case InstrumentChannel::DownloadState::DOWNLOAD_IN_PROGRESS:
 			labels = download;
 			if (elapsed > CHANNEL_DOWNLOAD_THRESHOLD_SLOW_SECONDS)
 				m_instrumentDownloadIsSlow[inst] = true;
 			hasProgress = m_instrumentDownloadIsSlow[inst];
-			color = ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.download_progress_badge_color"));
+			color = ImGui::ColorConvertU32ToFloat4(m_downloadProgressBadgeColor.Get());
 			break;
 		case InstrumentChannel::DownloadState::DOWNLOAD_FINISHED:
 			labels = ready;
 			if (isLast && (elapsed < CHANNEL_DOWNLOAD_THRESHOLD_FAST_SECONDS))
 				m_instrumentDownloadIsSlow[inst] = false;
-			color = ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.download_finished_badge_color"));
+			color = ImGui::ColorConvertU32ToFloat4(m_downloadFinishedBadgeColor.Get());
 			break;
 		default:
 			shouldRender = false;
@@ -500,7 +584,7 @@ void StreamBrowserDialog::renderDownloadProgress(std::shared_ptr<Instrument> ins
 	if(!m_instrumentDownloadIsSlow[inst] && elapsed < CHANNEL_DOWNLOAD_THRESHOLD_SLOW_SECONDS)
 	{
 		labels = active;
-		color = ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.download_active_badge_color"));
+		color = ImGui::ColorConvertU32ToFloat4(m_downloadActiveBadgeColor.Get());
 		shouldRender = true;
 		hasProgress = false;
 	}
@@ -564,7 +648,6 @@ void StreamBrowserDialog::renderPsuRows(
 	bool &clicked,
 	bool &hovered)
 {
-	auto& prefs = m_session.GetPreferences();
 	// Row 1
 	ImGui::TableNextRow();
 	ImGui::TableSetColumnIndex(0);
@@ -572,7 +655,7 @@ void StreamBrowserDialog::renderPsuRows(
 	ImGui::TableSetColumnIndex(1);
 	StreamDescriptor sv(chan, isVoltage ? 1 : 3);
 	ImGui::PushID(isVoltage ? "sV" :  "sC");
-	ImGui::PushStyleColor(ImGuiCol_Text, ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.psu_set_label_color")));
+	ImGui::PushStyleColor(ImGuiCol_Text, ImGui::ColorConvertU32ToFloat4(m_psuSetLabelColor.Get()));
 	ImGui::Selectable("- Set");
 	ImGui::PopStyleColor();
 	if(ImGui::BeginDragDropSource())
@@ -595,14 +678,14 @@ void StreamBrowserDialog::renderPsuRows(
 	if((isVoltage && !cc) || (!isVoltage && cc))
 	{
 		ImGui::TableSetColumnIndex(0);
-		ImGui::PushStyleColor(ImGuiCol_Button, ImGui::ColorConvertU32ToFloat4(prefs.GetColor(isVoltage ? "Appearance.Stream Browser.psu_cv_badge_color" : "Appearance.Stream Browser.psu_cc_badge_color")));
+		ImGui::PushStyleColor(ImGuiCol_Button, ImGui::ColorConvertU32ToFloat4((isVoltage ? m_psuCvBadgeColor : m_psuCcBadgeColor).Get()));
 		ImGui::SmallButton(isVoltage ? "CV" : "CC");
 		ImGui::PopStyleColor();
 	}
 	ImGui::TableSetColumnIndex(1);
 	StreamDescriptor mv(chan, isVoltage ? 0 : 2);
 	ImGui::PushID(isVoltage ? "mV" :  "mC");
-	ImGui::PushStyleColor(ImGuiCol_Text, ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.psu_meas_label_color")));
+	ImGui::PushStyleColor(ImGuiCol_Text, ImGui::ColorConvertU32ToFloat4(m_psuMeasLabelColor.Get()));
 	ImGui::Selectable("- Meas.");
 	ImGui::PopStyleColor();
 	if(ImGui::BeginDragDropSource())
@@ -660,7 +743,6 @@ void StreamBrowserDialog::renderAwgProperties(std::shared_ptr<FunctionGenerator>
 		awgState->m_strFrequency[channelIndex] = hz.PrettyPrint(freq);
 	}
 
-	auto& prefs = m_session.GetPreferences();
 
 	//Impedance
 	ImGui::SetNextItemWidth(dwidth);
@@ -736,9 +818,8 @@ void StreamBrowserDialog::renderAwgProperties(std::shared_ptr<FunctionGenerator>
 		// ok, we have enough space draw preview
 		m_badgeXCur -= width;
 		ImGui::SameLine(m_badgeXCur);
-		ImGui::Image(
-			m_parent->GetTextureManager()->GetTexture(m_parent->GetIconForWaveformShape(shape)),
-			ImVec2(width,height));
+		auto icon = m_parent->GetTextureRef(m_parent->GetIconForWaveformShape(shape));
+		ImGui::Image(icon.m_id, ImVec2(width,height), icon.m_uv0, icon.m_uv1);
 		// Go back one line since preview spans on two text lines
 		ImGuiWindow *window = ImGui::GetCurrentWindowRead();
 		window->DC.CursorPos.y -= ImGui::GetFontSize();
@@ -782,9 +863,7 @@ void StreamBrowserDialog::renderAwgProperties(std::shared_ptr<FunctionGenerator>
 	bool changed = renderCombo(
 		"Impedance",
 		false,
-		ImGui::ColorConvertU32ToFloat4(prefs.GetColor(
-			isHiZ ? "Appearance.Stream Browser.awg_hiz_badge_color" :
-			"Appearance.Stream Browser.awg_50ohms_badge_color")),
+		ImGui::ColorConvertU32ToFloat4((isHiZ ? m_awgHizBadgeColor : m_awg50ohmsBadgeColor).Get()),
 		&comboValue,
 		"Hi-Z",
 		"50 Ω",
@@ -812,7 +891,6 @@ void StreamBrowserDialog::renderAwgProperties(std::shared_ptr<FunctionGenerator>
 void StreamBrowserDialog::renderInstrumentNode(shared_ptr<Instrument> instrument)
 {
 	// Get preferences for colors
-	auto& prefs = m_session.GetPreferences();
 
 	ImGui::PushID(instrument.get());
 	bool instIsOpen = ImGui::TreeNodeEx(instrument->m_nickname.c_str(), ImGuiTreeNodeFlags_DefaultOpen);
@@ -826,8 +904,8 @@ void StreamBrowserDialog::renderInstrumentNode(shared_ptr<Instrument> instrument
 	auto scope = std::dynamic_pointer_cast<Oscilloscope>(instrument);
 	if (scope)
 	{
-		if (scope->IsOffline())
-			renderBadge(ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.instrument_offline_badge_color")), "OFFLINE", "OFFL", NULL);
+		if (GetScopeInfo(scope).m_offline)
+			renderBadge(ImGui::ColorConvertU32ToFloat4(m_instrumentOfflineBadgeColor.Get()), "OFFLINE", "OFFL", NULL);
 		else
 		{
 			Oscilloscope::TriggerMode mode = state ? state->m_lastTriggerState : Oscilloscope::TRIGGER_MODE_STOP;
@@ -883,8 +961,8 @@ void StreamBrowserDialog::renderInstrumentNode(shared_ptr<Instrument> instrument
 				"###psuon",
 				true,
 				allOn ?
-				ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.instrument_on_badge_color")) :
-				ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.instrument_partial_badge_color")), true);
+				ImGui::ColorConvertU32ToFloat4(m_instrumentOnBadgeColor.Get()) :
+				ImGui::ColorConvertU32ToFloat4(m_instrumentPartialBadgeColor.Get()), true);
 		}
 		else
 		{
@@ -915,18 +993,15 @@ void StreamBrowserDialog::renderInstrumentNode(shared_ptr<Instrument> instrument
 					DoTimebaseSettings(scope);
 				if(scope->HasFrequencyControls())
 				{
-					auto sdepth_txt 	= Unit(Unit::UNIT_SAMPLEDEPTH).PrettyPrint(scope->GetSampleDepth());
-					auto rbw_txt    	= Unit(Unit::UNIT_HZ).PrettyPrint(scope->GetResolutionBandwidth());
-					auto centerFreq_txt = Unit(Unit::UNIT_HZ).PrettyPrint(scope->GetCenterFrequency(0));
-					auto span_txt 		= Unit(Unit::UNIT_HZ).PrettyPrint(scope->GetSpan());
+					auto& info = GetScopeInfo(scope);
 
 					bool clicked = false;
 					bool hovered = false;
 					if(!scope->HasTimebaseControls()) // Only render sample depth if it has not already been shown in timebase controls
-						renderInfoLink("Points", sdepth_txt.c_str(), clicked, hovered);
-					renderInfoLink("Rbw", rbw_txt.c_str(), clicked, hovered);
-					renderInfoLink("Center freq.", centerFreq_txt.c_str(), clicked, hovered);
-					renderInfoLink("Span", span_txt.c_str(), clicked, hovered);
+						renderInfoLink("Points", info.m_depthText.c_str(), clicked, hovered);
+					renderInfoLink("Rbw", info.m_rbwText.c_str(), clicked, hovered);
+					renderInfoLink("Center freq.", info.m_centerText.c_str(), clicked, hovered);
+					renderInfoLink("Span", info.m_spanText.c_str(), clicked, hovered);
 					if (clicked)
 						m_parent->ShowTimebaseProperties();
 					if (hovered)
@@ -936,17 +1011,25 @@ void StreamBrowserDialog::renderInstrumentNode(shared_ptr<Instrument> instrument
 				ImGui::TreePop();
 			}
 
-			for(size_t i = 0; i<channelCount; i++)
+			//Queue settings only make sense for instruments we're actively polling
+			if(state && ImGui::TreeNodeEx("Waveform Queue"))
 			{
-				if(scope->IsChannelEnabled(i))
-					lastEnabledChannelIndex = i;
+				DoQueueSettings(scope, state);
+				ImGui::TreePop();
 			}
+
+			lastEnabledChannelIndex = GetScopeInfo(scope).m_lastEnabledChannel;
 		}
 
 		for(size_t i=0; i<channelCount; i++)
 		{
-			// Iterate on each channel
+			// Iterate on each channel, skipping any that are scrolled out of view
+			auto chan = instrument->GetChannel(i);
+			if(SkipClippedNode(chan))
+				continue;
+			float ystart = ImGui::GetCursorPosY();
 			renderChannelNode(instrument,i,(i == lastEnabledChannelIndex));
+			SaveNodeHeight(chan, ystart);
 		}
 
 		ImGui::TreePop();
@@ -1003,7 +1086,67 @@ void StreamBrowserDialog::DoTimebaseSettings(shared_ptr<Oscilloscope> scope)
 	}
 
 	if(refresh)
+	{
 		m_timebaseConfig[scope] = make_shared<StreamBrowserTimebaseInfo>(scope);
+		m_scopeInfo.erase(scope);
+	}
+}
+
+/**
+	@brief Add nodes for pending waveform queue limits and status under an instrument
+ */
+void StreamBrowserDialog::DoQueueSettings(shared_ptr<Oscilloscope> scope, shared_ptr<InstrumentConnectionState> state)
+{
+	auto width = ImGui::GetFontSize() * 5;
+
+	if(m_queueConfig.find(scope) == m_queueConfig.end())
+		m_queueConfig[scope] = make_shared<StreamBrowserQueueInfo>(state);
+	auto& config = m_queueConfig[scope];
+
+	//Limit mode
+	static const vector<string> modeNames = { "Waveforms", "Memory" };
+	ImGui::SetNextItemWidth(width);
+	if(renderCombo("Limit By", false, ImGui::GetStyleColorVec4(ImGuiCol_FrameBg), config->m_mode, modeNames))
+		state->m_queueLimitByMemory = (config->m_mode == 1);
+	HelpMarker(
+		"How to decide when too many waveforms are waiting to be processed.\n\n"
+		"Once the limit is reached, no more waveforms are downloaded from the instrument until the queue drains.\n\n"
+		"A deeper queue absorbs short hiccups in processing at fast trigger rates, while a memory limit keeps very "
+		"deep captures from exhausting RAM.");
+
+	//The limit itself
+	ImGui::SetNextItemWidth(width);
+	if(config->m_mode == 0)
+	{
+		if(IntInputWithImplicitApply("Max Waveforms", config->m_count, config->m_committedCount))
+		{
+			config->m_committedCount = max(1, config->m_committedCount);
+			config->m_count = config->m_committedCount;
+			state->m_queueLimitCount = config->m_committedCount;
+		}
+	}
+	else
+	{
+		Unit bytes(Unit::UNIT_BYTES);
+		if(UnitInputWithImplicitApply("Max Memory", config->m_bytes, config->m_committedBytes, bytes))
+			state->m_queueLimitBytes = config->m_committedBytes;
+		HelpMarker(
+			"Estimated memory used by all pending waveforms.\n\n"
+			"Each waveform is assumed to take the current memory depth times the size of a sample, "
+			"for every enabled channel.");
+	}
+
+	//Current status
+	//(the memory based limit is only recomputed by the instrument thread when there's something in the queue)
+	Unit counts(Unit::UNIT_COUNTS);
+	size_t limit = state->m_queueLimitByMemory ? state->m_queueLimit.load() : state->m_queueLimitCount.load();
+	auto occupancy = counts.PrettyPrint(scope->GetPendingWaveformCount()) + " / " + counts.PrettyPrint(limit);
+	ImGui::Text("Pending: %s", occupancy.c_str());
+	ImGui::Text("Stalls: %s", counts.PrettyPrint(state->m_queueStalls).c_str());
+	HelpMarker(
+		"Number of times acquisition was paused because the queue was full.\n\n"
+		"Triggers which occur while paused are not captured. If this keeps climbing, processing cannot keep up "
+		"with the instrument.");
 }
 
 /**
@@ -1016,7 +1159,6 @@ void StreamBrowserDialog::DoTimebaseSettings(shared_ptr<Oscilloscope> scope)
 void StreamBrowserDialog::renderChannelNode(shared_ptr<Instrument> instrument, size_t channelIndex, bool isLast)
 {
 	// Get preferences for colors
-	auto& prefs = m_session.GetPreferences();
 
 	InstrumentChannel* channel = instrument->GetChannel(channelIndex);
 
@@ -1032,10 +1174,16 @@ void StreamBrowserDialog::renderChannelNode(shared_ptr<Instrument> instrument, s
 	auto awgchan = dynamic_cast<FunctionGeneratorChannel *>(channel);
 	bool renderProps = false;
 	bool isDigital = false;
+	bool isTrigger = false;
 	if (scopechan)
 	{
-		renderProps = scopechan->IsEnabled();
-		isDigital = scopechan->GetType(0) == Stream::STREAM_TYPE_DIGITAL;
+		auto& info = GetChannelInfo(scope, scopechan);
+		renderProps = info.m_enabled;
+		if(!info.m_types.empty())
+		{
+			isDigital = (info.m_types[0] == Stream::STREAM_TYPE_DIGITAL);
+			isTrigger = (info.m_types[0] == Stream::STREAM_TYPE_TRIGGER);
+		}
 	}
 	else if(awg && awgchan)
 	{
@@ -1096,12 +1244,16 @@ void StreamBrowserDialog::renderChannelNode(shared_ptr<Instrument> instrument, s
 	if (scopechan)
 	{
 		//No badge on trigger inputs
-		if(scopechan->GetType(0) == Stream::STREAM_TYPE_TRIGGER)
+		if(isTrigger)
 		{}
 
+		//Turned off by consume-driven acquisition, will come back on once something uses it
+		else if(!renderProps && m_session.IsChannelAutoDisabled(scopechan))
+			renderBadge(ImGui::ColorConvertU32ToFloat4(m_instrumentIdleBadgeColor.Get()), "IDLE", "--", NULL);
+
 		// Scope channel
-		else if (!scopechan->IsEnabled())
-			renderBadge(ImGui::ColorConvertU32ToFloat4(prefs.GetColor("Appearance.Stream Browser.instrument_disabled_badge_color")), "DISABLED", "DISA","--", NULL);
+		else if (!renderProps)
+			renderBadge(ImGui::ColorConvertU32ToFloat4(m_instrumentDisabledBadgeColor.Get()), "DISABLED", "DISA","--", NULL);
 
 		//Download in progress
 		else
@@ -1217,7 +1369,14 @@ void StreamBrowserDialog::renderStreamNode(shared_ptr<Instrument> instrument, In
 {
 	auto scope = std::dynamic_pointer_cast<Oscilloscope>(instrument);
 	auto scopechan = dynamic_cast<OscilloscopeChannel *>(channel);
-	Stream::StreamType type = scopechan ? scopechan->GetType(streamIndex) : Stream::StreamType::STREAM_TYPE_ANALOG;
+	StreamBrowserChannelInfo* info = nullptr;
+	Stream::StreamType type = Stream::StreamType::STREAM_TYPE_ANALOG;
+	if(scopechan)
+	{
+		info = &GetChannelInfo(scope, scopechan);
+		if(streamIndex < info->m_types.size())
+			type = info->m_types[streamIndex];
+	}
 
 	ImGui::PushID(streamIndex);
 
@@ -1264,24 +1423,21 @@ void StreamBrowserDialog::renderStreamNode(shared_ptr<Instrument> instrument, In
 			ImGui::BeginChild("stream_params", ImVec2(0, 0),
 				ImGuiChildFlags_AutoResizeY | ImGuiChildFlags_Border);
 
-			Unit unit = channel->GetYAxisUnits(streamIndex);
 			bool clicked = false;
 			bool hovered = false;
 			switch (type)
 			{
 				case Stream::STREAM_TYPE_ANALOG:
+					if(streamIndex < info->m_offsets.size())
 					{
-						auto offset_txt = unit.PrettyPrint(scopechan->GetOffset(streamIndex));
-						auto range_txt = unit.PrettyPrint(scopechan->GetVoltageRange(streamIndex));
-						renderInfoLink("Offset", offset_txt.c_str(), clicked, hovered);
-						renderInfoLink("Vertical range", range_txt.c_str(), clicked, hovered);
+						renderInfoLink("Offset", info->m_offsets[streamIndex].c_str(), clicked, hovered);
+						renderInfoLink("Vertical range", info->m_ranges[streamIndex].c_str(), clicked, hovered);
 					}
 					break;
 				case Stream::STREAM_TYPE_DIGITAL:
 					if(scope)
 					{
-						auto threshold_txt = unit.PrettyPrint(scope->GetDigitalThreshold(scopechan->GetIndex()));
-						renderInfoLink("Threshold", threshold_txt.c_str(), clicked, hovered);
+						renderInfoLink("Threshold", info->m_threshold.c_str(), clicked, hovered);
 						break;
 					}
 					//fall through
@@ -1384,20 +1540,41 @@ void StreamBrowserDialog::renderFilterNode(Filter* filter)
  */
 bool StreamBrowserDialog::DoRender()
 {
+	m_frameTime = GetTime();
+
+	//If anything was added or removed, forget cached state since a new channel may reuse an old one's address
+	auto snapshot = m_session.GetInstrumentSnapshot();
+	auto& insts = snapshot->m_instruments;
+	auto filters = Filter::GetAllInstances();
+	if( (snapshot->m_epoch != m_lastInstrumentEpoch) || (filters != m_lastFilters) )
+	{
+		m_channelInfo.clear();
+		m_scopeInfo.clear();
+		m_nodeHeights.clear();
+		m_lastInstrumentEpoch = snapshot->m_epoch;
+		m_lastFilters = filters;
+	}
+
 	//Add all instruments
-	auto insts = m_session.GetInstruments();
 	for(auto inst : insts)
 	{
+		if(SkipClippedNode(inst.get()))
+			continue;
+		float ystart = ImGui::GetCursorPosY();
 		renderInstrumentNode(inst);
+		SaveNodeHeight(inst.get(), ystart);
 	}
 
 	//Add all filters
 	if(ImGui::TreeNodeEx("Filters", ImGuiTreeNodeFlags_DefaultOpen))
 	{
-		auto filters = Filter::GetAllInstances();
 		for(auto f : filters)
 		{
+			if(SkipClippedNode(f))
+				continue;
+			float ystart = ImGui::GetCursorPosY();
 			renderFilterNode(f);
+			SaveNodeHeight(f, ystart);
 		}
 		ImGui::TreePop();
 	}
@@ -1405,6 +1582,67 @@ bool StreamBrowserDialog::DoRender()
 	return true;
 }
 
+/**
+	@brief Gets the cached display state of a channel or filter, reading it again if it's out of date
+
+	@param scope	The oscilloscope the channel belongs to (null for filters)
+	@param chan		The channel
+ */
+StreamBrowserChannelInfo& StreamBrowserDialog::GetChannelInfo(shared_ptr<Oscilloscope> scope, OscilloscopeChannel* chan)
+{
+	auto& info = m_channelInfo[chan];
+	if(!info || ( (m_frameTime - info->m_time) > STREAM_BROWSER_REFRESH_SECONDS) )
+		info = make_shared<StreamBrowserChannelInfo>(scope, chan, m_frameTime);
+	return *info;
+}
+
+/**
+	@brief Gets the cached display state of an oscilloscope, reading it again if it's out of date
+ */
+StreamBrowserScopeInfo& StreamBrowserDialog::GetScopeInfo(shared_ptr<Oscilloscope> scope)
+{
+	auto& info = m_scopeInfo[scope];
+	if(!info || ( (m_frameTime - info->m_time) > STREAM_BROWSER_REFRESH_SECONDS) )
+		info = make_shared<StreamBrowserScopeInfo>(scope, m_frameTime);
+	return *info;
+}
+
+/**
+	@brief Skips drawing a node which is entirely scrolled out of view
+
+	If the node was drawn before and wouldn't be visible at the current cursor position, space is reserved for it
+	instead, so the scroll bar stays the same.
+
+	@param node	The instrument, channel, or filter the node is for
+
+	@return True if the node should not be drawn
+ */
+bool StreamBrowserDialog::SkipClippedNode(const void* node)
+{
+	auto it = m_nodeHeights.find(node);
+	if(it == m_nodeHeights.end())
+		return false;
+
+	ImVec2 size(ImGui::GetContentRegionAvail().x, it->second);
+	if(ImGui::IsRectVisible(size))
+		return false;
+
+	ImGui::Dummy(ImVec2(0, it->second));
+	return true;
+}
+
+/**
+	@brief Remembers how much space a node took to draw, so it can be skipped while scrolled out of view
+
+	@param node		The instrument, channel, or filter the node is for
+	@param ystart	Cursor position before the node was drawn
+ */
+void StreamBrowserDialog::SaveNodeHeight(const void* node, float ystart)
+{
+	//Dummy items get spacing added after them, just like the last item of the node did
+	m_nodeHeights[node] = max(0.0f, ImGui::GetCursorPosY() - ystart - ImGui::GetStyle().ItemSpacing.y);
+}
+
 void StreamBrowserDialog::DoItemHelp()
 {
 	if(ImGui::IsItemHovered())
@@ -60,6 +60,74 @@ public:
 	int m_depth;
 };
 
+class StreamBrowserQueueInfo
+{
+public:
+	StreamBrowserQueueInfo(std::shared_ptr<InstrumentConnectionState> state);
+
+	//Limit mode (0 = count, 1 = memory)
+	int m_mode;
+
+	//Waveform count limit
+	int m_count;
+	int m_committedCount;
+
+	//Memory limit
+	std::string m_bytes;
+	int64_t m_committedBytes;
+};
+
+/**
+	@brief Display state of an oscilloscope channel or filter, cached so we don't query the driver every frame
+ */
+class StreamBrowserChannelInfo
+{
+public:
+	StreamBrowserChannelInfo(std::shared_ptr<Oscilloscope> scope, OscilloscopeChannel* chan, double now);
+
+	///@brief True if the channel is enabled
+	bool m_enabled;
+
+	///@brief Type of each stream
+	std::vector<Stream::StreamType> m_types;
+
+	///@brief Formatted offset of each analog stream
+	std::vector<std::string> m_offsets;
+
+	///@brief Formatted vertical range of each analog stream
+	std::vector<std::string> m_ranges;
+
+	///@brief Formatted threshold, for digital channels of an oscilloscope
+	std::string m_threshold;
+
+	///@brief Time the state was read
+	double m_time;
+};
+
+/**
+	@brief Display state of an oscilloscope, cached so we don't query the driver every frame
+ */
+class StreamBrowserScopeInfo
+{
+public:
+	StreamBrowserScopeInfo(std::shared_ptr<Oscilloscope> scope, double now);
+
+	///@brief True if the instrument is offline
+	bool m_offline;
+
+	///@brief Index of the last enabled channel
+	size_t m_lastEnabledChannel;
+
+	///@brief Formatted sample depth, RBW, center frequency and span (only if the scope has frequency controls)
+	std::string m_depthText;
+	std::string m_rbwText;
+	std::string m_centerText;
+	std::string m_spanText;
+
+	///@brief Time the state was read
+	double m_time;
+};
+
 class StreamBrowserDialog : public Dialog
 {
 public:
@@ -115,6 +183,7 @@ protected:
 	// Rendering of an instrument node
 	void renderInstrumentNode(std::shared_ptr<Instrument> instrument);
 	void DoTimebaseSettings(std::shared_ptr<Oscilloscope> scope);
+	void DoQueueSettings(std::shared_ptr<Oscilloscope> scope, std::shared_ptr<InstrumentConnectionState> state);
 
 	// Rendering of a channel node
 	void renderChannelNode(std::shared_ptr<Instrument> instrument, size_t channelIndex, bool isLast);
@@ -125,6 +194,12 @@ protected:
 	// Rendering of an Filter node
 	void renderFilterNode(Filter* filter);
 
+	// Caching and clipping
+	StreamBrowserChannelInfo& GetChannelInfo(std::shared_ptr<Oscilloscope> scope, OscilloscopeChannel* chan);
+	StreamBrowserScopeInfo& GetScopeInfo(std::shared_ptr<Oscilloscope> scope);
+	bool SkipClippedNode(const void* node);
+	void SaveNodeHeight(const void* node, float ystart);
+
 	Session& m_session;
 	MainWindow* m_parent;
 
@@ -138,6 +213,55 @@ protected:
 
 	///@brief Map of instruments to timebase settings
 	std::map<std::shared_ptr<Instrument>, std::shared_ptr<StreamBrowserTimebaseInfo> > m_timebaseConfig;
+
+	///@brief Map of instruments to pending waveform queue settings
+	std::map<std::shared_ptr<Instrument>, std::shared_ptr<StreamBrowserQueueInfo> > m_queueConfig;
+
+	///@brief Cached display state of each channel and filter
+	std::map<InstrumentChannel*, std::shared_ptr<StreamBrowserChannelInfo> > m_channelInfo;
+
+	///@brief Cached display state of each oscilloscope
+	std::map<std::shared_ptr<Instrument>, std::shared_ptr<StreamBrowserScopeInfo> > m_scopeInfo;
+
+	/**
+		@brief Height of each instrument, channel, and filter node the last time it was drawn
+
+		Nodes which are entirely scrolled out of view are replaced by a blank space of the same height.
+	 */
+	std::map<const void*, float> m_nodeHeights;
+
+	///@brief Epoch of the instrument snapshot last frame
+	uint64_t m_lastInstrumentEpoch;
+
+	///@brief Filters which existed last frame
+	std::set<Filter*> m_lastFilters;
+
+	///@brief Time the current frame started rendering
+	double m_frameTime;
+
+	//Appearance preferences read every frame
+	ColorPreference m_awg50ohmsBadgeColor;
+	ColorPreference m_awgHizBadgeColor;
+	ColorPreference m_downloadActiveBadgeColor;
+	ColorPreference m_downloadFinishedBadgeColor;
+	ColorPreference m_downloadProgressBadgeColor;
+	ColorPreference m_downloadWaitBadgeColor;
+	RealPreference m_instrumentBadgeLatchDuration;
+	ColorPreference m_instrumentDisabledBadgeColor;
+	ColorPreference m_instrumentIdleBadgeColor;
+	ColorPreference m_instrumentOffBadgeColor;
+	ColorPreference m_instrumentOfflineBadgeColor;
+	ColorPreference m_instrumentOnBadgeColor;
+	ColorPreference m_instrumentPartialBadgeColor;
+	ColorPreference m_psuCcBadgeColor;
+	ColorPreference m_psuCvBadgeColor;
+	ColorPreference m_psuMeasLabelColor;
+	ColorPreference m_psuSetLabelColor;
+	ColorPreference m_triggerArmedBadgeColor;
+	ColorPreference m_triggerAutoBadgeColor;
+	ColorPreference m_triggerBusyBadgeColor;
+	ColorPreference m_triggerStoppedBadgeColor;
+	ColorPreference m_triggerTriggeredBadgeColor;
 };
 
 #endif
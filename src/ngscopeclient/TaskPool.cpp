@@ -0,0 +1,259 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of TaskPool
+ */
+
+#include "ngscopeclient.h"
+#include "TaskPool.h"
+#include "ThreadRoles.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fstream>
+#endif
+
+using namespace std;
+
+///@brief The pool the current thread is a worker of, if any
+static thread_local TaskPool* g_currentPool = nullptr;
+
+///@brief Index of the current thread within g_currentPool
+static thread_local size_t g_currentWorker = 0;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates the pool
+
+	@param nthreads	Number of worker threads, or zero for one per physical core
+ */
+TaskPool::TaskPool(size_t nthreads)
+	: m_queued(0)
+	, m_nextQueue(0)
+	, m_stop(false)
+{
+	if(nthreads == 0)
+		nthreads = GetPhysicalCoreCount();
+	LogTrace("Starting task pool with %zu threads\n", nthreads);
+
+	//Create all of the queues before any worker starts looking for something to steal
+	for(size_t i=0; i<nthreads; i++)
+		m_workers.push_back(make_unique<Worker>());
+	for(size_t i=0; i<nthreads; i++)
+		m_workers[i]->m_thread = thread(&TaskPool::WorkerThread, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		lock_guard<mutex> lock(m_wakeMutex);
+		m_stop = true;
+	}
+	m_wakeCond.notify_all();
+
+	for(auto& w : m_workers)
+		w->m_thread.join();
+}
+
+/**
+	@brief Gets the number of physical CPU cores (not counting SMT siblings)
+
+	Loops in the pool are memory bound more often than not, so a second hardware thread on the same core buys little
+	and costs cache.
+ */
+size_t TaskPool::GetPhysicalCoreCount()
+{
+	size_t logical = max(1u, thread::hardware_concurrency());
+
+	#ifdef _WIN32
+		DWORD len = 0;
+		GetLogicalProcessorInformation(nullptr, &len);
+		vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if(info.empty() || !GetLogicalProcessorInformation(info.data(), &len))
+			return logical;
+
+		size_t cores = 0;
+		for(auto& i : info)
+		{
+			if(i.Relationship == RelationProcessorCore)
+				cores ++;
+		}
+		return cores ? cores : logical;
+
+	#else
+		//Each core shows up once per hardware thread with the same sibling list, so count distinct lists
+		set<string> cores;
+		for(size_t i=0; i<logical; i++)
+		{
+			char path[128];
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/topology/thread_siblings_list", i);
+			ifstream in(path);
+			string siblings;
+			if(!getline(in, siblings))
+				return logical;
+			cores.emplace(siblings);
+		}
+		return cores.size();
+	#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+
+/**
+	@brief Queues a task to run on the pool
+
+	Tasks submitted from a worker thread go on that worker's own queue, so they run on the same core unless another
+	worker is idle and steals them.
+
+	@param group	Group to add the task to
+	@param task		The task to run
+ */
+void TaskPool::Submit(TaskGroup& group, Task task)
+{
+	size_t queue;
+	if(g_currentPool == this)
+		queue = g_currentWorker;
+	else
+		queue = (m_nextQueue ++) % m_workers.size();
+
+	//Count the task before it's visible to thieves, so m_queued never goes negative
+	group.m_pending ++;
+	{
+		lock_guard<mutex> lock(m_wakeMutex);
+		m_queued ++;
+	}
+
+	{
+		auto& w = *m_workers[queue];
+		lock_guard<mutex> lock(w.m_mutex);
+		w.m_tasks.push_back(QueuedTask{std::move(task), &group});
+	}
+	m_wakeCond.notify_one();
+}
+
+/**
+	@brief Returns once every task in a group has finished, running queued tasks while waiting
+ */
+void TaskPool::Wait(TaskGroup& group)
+{
+	size_t self = (g_currentPool == this) ? g_currentWorker : 0;
+
+	while(!group.IsDone())
+	{
+		if(RunOneTask(self))
+			continue;
+
+		//Nothing left to steal, the rest of the group is running on other threads.
+		//Poll occasionally in case one of them spawns more work we could help with.
+		unique_lock<mutex> lock(group.m_mutex);
+		group.m_doneCond.wait_for(lock, chrono::milliseconds(1), [&]{ return group.IsDone(); });
+	}
+
+	//The last task may still be signaling the group. Don't let the caller destroy it until that's finished.
+	lock_guard<mutex> lock(group.m_mutex);
+}
+
+/**
+	@brief Runs one queued task, preferring our own queue and stealing from others if it's empty
+
+	@param self	Queue to look in first
+
+	@return True if a task was run
+ */
+bool TaskPool::RunOneTask(size_t self)
+{
+	QueuedTask task;
+	bool found = false;
+
+	//Newest first from our own queue, since it's most likely to still be in cache
+	{
+		auto& w = *m_workers[self];
+		lock_guard<mutex> lock(w.m_mutex);
+		if(!w.m_tasks.empty())
+		{
+			task = std::move(w.m_tasks.back());
+			w.m_tasks.pop_back();
+			found = true;
+		}
+	}
+
+	//Oldest first from everyone else, since it's the biggest chunk of remaining work
+	for(size_t i=1; !found && (i < m_workers.size()); i++)
+	{
+		auto& w = *m_workers[(self + i) % m_workers.size()];
+		lock_guard<mutex> lock(w.m_mutex);
+		if(!w.m_tasks.empty())
+		{
+			task = std::move(w.m_tasks.front());
+			w.m_tasks.pop_front();
+			found = true;
+		}
+	}
+
+	if(!found)
+		return false;
+	m_queued --;
+
+	task.m_task();
+
+	auto& group = *task.m_group;
+	lock_guard<mutex> lock(group.m_mutex);
+	if(--group.m_pending == 0)
+		group.m_doneCond.notify_all();
+	return true;
+}
+
+void TaskPool::WorkerThread(size_t index)
+{
+	pthread_setname_np_compat("TaskPool");
+	Tracer::SetThreadName("TaskPool");
+	ThreadRoleScope role(THREAD_ROLE_TASK_POOL);
+
+	g_currentPool = this;
+	g_currentWorker = index;
+
+	while(true)
+	{
+		if(RunOneTask(index))
+			continue;
+
+		unique_lock<mutex> lock(m_wakeMutex);
+		m_wakeCond.wait(lock, [&]{ return m_stop || (m_queued > 0); });
+		if(m_stop)
+			break;
+	}
+}
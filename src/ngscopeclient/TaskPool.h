@@ -0,0 +1,188 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of TaskPool
+ */
+#ifndef TaskPool_h
+#define TaskPool_h
+
+#include <condition_variable>
+#include <functional>
+
+/**
+	@brief A set of tasks submitted to a TaskPool which can be waited on together
+ */
+class TaskGroup
+{
+public:
+	TaskGroup()
+	: m_pending(0)
+	{}
+
+	~TaskGroup()
+	{ assert(m_pending == 0); }
+
+	///@brief Returns true if every task in the group has finished
+	bool IsDone() const
+	{ return m_pending == 0; }
+
+protected:
+	friend class TaskPool;
+
+	///@brief Number of tasks submitted but not yet finished
+	std::atomic<size_t> m_pending;
+
+	///@brief Mutex for m_doneCond
+	std::mutex m_mutex;
+
+	///@brief Signaled when m_pending reaches zero
+	std::condition_variable m_doneCond;
+};
+
+/**
+	@brief Persistent pool of worker threads with per-thread work stealing queues
+
+	Each worker pushes and pops the tasks it spawns from the back of its own queue, and steals from the front of other
+	workers' queues when it runs out, so nested parallelism (parallel loops inside tasks) stays on the worker that
+	created it without oversubscribing the machine. Threads waiting on a group run queued tasks rather than blocking,
+	so it's safe to wait from inside a task.
+
+	Tasks must not block for long on anything other than other tasks in the pool.
+ */
+class TaskPool
+{
+public:
+	TaskPool(size_t nthreads = 0);
+	~TaskPool();
+
+	typedef std::function<void()> Task;
+
+	void Submit(TaskGroup& group, Task task);
+	void Wait(TaskGroup& group);
+
+	/**
+		@brief Calls body(i) for every i in [begin, end), spread across the pool, and returns when all are done
+
+		The calling thread works on the loop too, so this can be called from any thread including pool workers.
+
+		@param begin	First index
+		@param end		One past the last index
+		@param grain	Minimum number of indexes to give to one task
+		@param body		Loop body
+	 */
+	template<class T>
+	void ParallelFor(int64_t begin, int64_t end, int64_t grain, T body)
+	{
+		int64_t n = end - begin;
+		if(n <= 0)
+			return;
+
+		//Enough chunks to balance load, but not so many the queue overhead dominates
+		int64_t nchunks = std::min( (n + grain - 1) / grain, (int64_t)(4 * m_workers.size()) );
+		if(nchunks <= 1)
+		{
+			for(int64_t i=begin; i<end; i++)
+				body(i);
+			return;
+		}
+		int64_t chunk = (n + nchunks - 1) / nchunks;
+
+		TaskGroup group;
+		for(int64_t start = begin + chunk; start < end; start += chunk)
+		{
+			int64_t last = std::min(end, start + chunk);
+			Submit(group, [start, last, &body]()
+				{
+					for(int64_t i=start; i<last; i++)
+						body(i);
+				});
+		}
+
+		//Do the first chunk ourselves, then help with the rest
+		for(int64_t i=begin; i<begin + chunk; i++)
+			body(i);
+		Wait(group);
+	}
+
+	///@brief Gets the number of worker threads
+	size_t GetThreadCount() const
+	{ return m_workers.size(); }
+
+	static size_t GetPhysicalCoreCount();
+
+protected:
+	void WorkerThread(size_t index);
+	bool RunOneTask(size_t self);
+
+	///@brief A task along with the group it belongs to
+	class QueuedTask
+	{
+	public:
+		Task m_task;
+		TaskGroup* m_group;
+	};
+
+	///@brief Per-worker state
+	class Worker
+	{
+	public:
+		///@brief Mutex controlling access to m_tasks
+		std::mutex m_mutex;
+
+		///@brief Tasks spawned by (or assigned to) this worker. The owner uses the back, thieves the front.
+		std::deque<QueuedTask> m_tasks;
+
+		///@brief The thread itself
+		std::thread m_thread;
+	};
+
+	///@brief Worker threads
+	std::vector<std::unique_ptr<Worker>> m_workers;
+
+	///@brief Number of tasks in all queues combined
+	std::atomic<size_t> m_queued;
+
+	///@brief Round robin counter for spreading tasks submitted from outside the pool across queues
+	std::atomic<size_t> m_nextQueue;
+
+	///@brief Set to shut down the workers
+	bool m_stop;
+
+	///@brief Mutex for m_wakeCond and m_stop
+	std::mutex m_wakeMutex;
+
+	///@brief Signaled when a task is queued or the pool is shutting down
+	std::condition_variable m_wakeCond;
+};
+
+#endif
@@ -57,92 +57,74 @@ Texture::Texture(
 	)
 	: m_image(device, imageInfo)
 {
-	auto req = m_image.getMemoryRequirements();
-
-	//Figure out memory requirements of the buffer and decide what physical memory type to use
-	uint32_t memType = 0;
-	auto memProperties = g_vkComputePhysicalDevice->getMemoryProperties();
-	for(uint32_t i=0; i<32; i++)
-	{
-		//Skip anything not device local, since we're optimizing this buffer for performance
-		if(!(memProperties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal))
-			continue;
-
-		//Stop if buffer is compatible
-		if(req.memoryTypeBits & (1 << i) )
-		{
-			memType = i;
-			break;
-		}
-	}
-	LogTrace("Using memory type %u for texture buffer\n", memType);
-
-	//Once the image is created, allocate device memory to back it
-	vk::MemoryAllocateInfo info(req.size, memType);
-	m_deviceMemory = make_unique<vk::raii::DeviceMemory>(*g_vkComputeDevice, info);
-	m_image.bindMemory(**m_deviceMemory, 0);
+	AllocateMemory(mgr);
 
 	//Transfer our image data over from the staging buffer
 	{
 		vk::raii::CommandBuffer& cmdBuf = mgr->GetCmdBuffer();
 		cmdBuf.begin({});
-
-		//Initial image layout transition
-		LayoutTransition(
-			cmdBuf,
-			vk::AccessFlagBits::eNone,
-			vk::AccessFlagBits::eTransferWrite,
-			vk::ImageLayout::eUndefined,
-			vk::ImageLayout::eTransferDstOptimal);
-
-		//Copy the buffer to the image
-		vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
-		vk::BufferImageCopy region(0, 0, 0, subresource, vk::Offset3D(0, 0, 0), vk::Extent3D(width, height, 1) );
-		cmdBuf.copyBufferToImage(*srcBuf, *m_image, vk::ImageLayout::eTransferDstOptimal, region);
-
-		//Convert to something optimal for texture reads
-		LayoutTransition(
-			cmdBuf,
-			vk::AccessFlagBits::eTransferWrite,
-			vk::AccessFlagBits::eShaderRead,
-			vk::ImageLayout::eTransferDstOptimal,
-			vk::ImageLayout::eShaderReadOnlyOptimal);
-
+		RecordUpload(cmdBuf, srcBuf, 0, width, height);
 		cmdBuf.end();
 
 		//Submit the request and block until it completes
 		mgr->GetQueue()->SubmitAndBlock(cmdBuf);
 	}
 
-	//Make a view for the image
-	vk::ImageViewCreateInfo vinfo(
-		{},
-		*m_image,
-		vk::ImageViewType::e2D,
-		vk::Format::eR8G8B8A8Unorm,
-		{},
-		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)
-		);
-	m_view = make_unique<vk::raii::ImageView>(*g_vkComputeDevice, vinfo);
+	CreateView(mgr, vk::Format::eR8G8B8A8Unorm, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, upsampleLinear);
+	SetName(name);
+}
 
-	m_texture = reinterpret_cast<intptr_t>(
-		ImGui_ImplVulkan_AddTexture(
-			upsampleLinear ? **mgr->GetSampler() : **mgr->GetNearestSampler(),
-			**m_view,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+/**
+	@brief Creates a texture from part of a staging buffer, recording the upload into a caller-supplied command buffer
 
+	The caller is responsible for submitting the command buffer, and keeping the staging buffer alive, before the
+	texture is used. This lets many textures be uploaded in a single submission.
+ */
+Texture::Texture(
+	const vk::raii::Device& device,
+	const vk::ImageCreateInfo& imageInfo,
+	vk::raii::CommandBuffer& cmdBuf,
+	const vk::raii::Buffer& srcBuf,
+	vk::DeviceSize srcOffset,
+	int width,
+	int height,
+	TextureManager* mgr,
+	const std::string& name,
+	bool upsampleLinear
+	)
+	: m_image(device, imageInfo)
+{
+	AllocateMemory(mgr);
+	RecordUpload(cmdBuf, srcBuf, srcOffset, width, height);
+	CreateView(mgr, vk::Format::eR8G8B8A8Unorm, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, upsampleLinear);
 	SetName(name);
 }
 
 /**
 	@brief Creates a blank texture, to be written to by a compute shader in the future
+
+	The texture is sampled in the general layout, and the caller is responsible for transitioning it there.
  */
 Texture::Texture(
 	const vk::raii::Device& device,
 	const vk::ImageCreateInfo& imageInfo,
 	TextureManager* mgr,
-	const string& name)
+	const string& name,
+	bool upsampleLinear)
 	: m_image(device, imageInfo)
+{
+	AllocateMemory(mgr);
+
+	//Don't fill anything, we'll be writing in a shader (or copying in) later on when the time is right
+
+	CreateView(mgr, imageInfo.format, VK_IMAGE_LAYOUT_GENERAL, upsampleLinear);
+	SetName(name);
+}
+
+/**
+	@brief Allocates device local memory for the image from the texture manager's pool, and binds it
+ */
+void Texture::AllocateMemory(TextureManager* mgr)
 {
 	auto req = m_image.getMemoryRequirements();
 
@@ -165,27 +147,63 @@ Texture::Texture(
 	LogTrace("Using memory type %u for texture buffer\n", memType);
 
 	//Once the image is created, allocate device memory to back it
-	vk::MemoryAllocateInfo info(req.size, memType);
-	m_deviceMemory = make_unique<vk::raii::DeviceMemory>(*g_vkComputeDevice, info);
-	m_image.bindMemory(**m_deviceMemory, 0);
+	m_deviceMemory = mgr->GetMemoryPool()->Allocate(req, memType);
+	m_image.bindMemory(m_deviceMemory->GetMemory(), m_deviceMemory->GetOffset());
+}
 
-	//Don't fill anything, we'll be writing in a shader later on when the time is right
+/**
+	@brief Records commands to copy image data from a staging buffer and get it ready for sampling
+ */
+void Texture::RecordUpload(
+	vk::raii::CommandBuffer& cmdBuf,
+	const vk::raii::Buffer& srcBuf,
+	vk::DeviceSize srcOffset,
+	int width,
+	int height)
+{
+	//Initial image layout transition
+	LayoutTransition(
+		cmdBuf,
+		vk::AccessFlagBits::eNone,
+		vk::AccessFlagBits::eTransferWrite,
+		vk::ImageLayout::eUndefined,
+		vk::ImageLayout::eTransferDstOptimal);
+
+	//Copy the buffer to the image
+	vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+	vk::BufferImageCopy region(
+		srcOffset, 0, 0, subresource, vk::Offset3D(0, 0, 0), vk::Extent3D(width, height, 1) );
+	cmdBuf.copyBufferToImage(*srcBuf, *m_image, vk::ImageLayout::eTransferDstOptimal, region);
+
+	//Convert to something optimal for texture reads
+	LayoutTransition(
+		cmdBuf,
+		vk::AccessFlagBits::eTransferWrite,
+		vk::AccessFlagBits::eShaderRead,
+		vk::ImageLayout::eTransferDstOptimal,
+		vk::ImageLayout::eShaderReadOnlyOptimal);
+}
 
-	//Make a view for the image
+/**
+	@brief Makes a view for the image and registers it with imgui
+ */
+void Texture::CreateView(TextureManager* mgr, vk::Format format, VkImageLayout layout, bool upsampleLinear)
+{
 	vk::ImageViewCreateInfo vinfo(
 		{},
 		*m_image,
 		vk::ImageViewType::e2D,
-		vk::Format::eR32G32B32A32Sfloat,
+		format,
 		{},
 		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)
 		);
 	m_view = make_unique<vk::raii::ImageView>(*g_vkComputeDevice, vinfo);
 
 	m_texture = reinterpret_cast<intptr_t>(
-		ImGui_ImplVulkan_AddTexture(**mgr->GetSampler(), **m_view, VK_IMAGE_LAYOUT_GENERAL));
-
-	SetName(name);
+		ImGui_ImplVulkan_AddTexture(
+			upsampleLinear ? **mgr->GetSampler() : **mgr->GetNearestSampler(),
+			**m_view,
+			layout));
 }
 
 void Texture::SetName(const string& name)
@@ -194,7 +212,7 @@ void Texture::SetName(const string& name)
 	{
 		//Not sure why this is being reported as a conflict by validation layers
 		//but let's go ahead and lock to be safe for now
-		//lock_guard<shared_mutex> lock(g_vulkanActivityMutex);
+		//lock_guard lock(g_vulkanActivityMutex);
 
 		string prefix = string("Texture.") + name;
 		string texName = prefix + ".dset";
@@ -220,11 +238,15 @@ void Texture::SetName(const string& name)
 				reinterpret_cast<uint64_t>(static_cast<VkImageView>(**m_view)),
 				viewName.c_str()));
 
-		g_vkComputeDevice->setDebugUtilsObjectNameEXT(
-			vk::DebugUtilsObjectNameInfoEXT(
-				vk::ObjectType::eDeviceMemory,
-				reinterpret_cast<uint64_t>(static_cast<VkDeviceMemory>(**m_deviceMemory)),
-				memName.c_str()));
+		//Pooled memory is shared with other textures, and named by the pool
+		if(m_deviceMemory->IsDedicated())
+		{
+			g_vkComputeDevice->setDebugUtilsObjectNameEXT(
+				vk::DebugUtilsObjectNameInfoEXT(
+					vk::ObjectType::eDeviceMemory,
+					reinterpret_cast<uint64_t>(static_cast<VkDeviceMemory>(m_deviceMemory->GetMemory())),
+					memName.c_str()));
+		}
 	}
 }
 
@@ -277,7 +299,8 @@ Texture::~Texture()
 // Construction / destruction
 
 TextureManager::TextureManager(shared_ptr<QueueHandle> queue)
-	: m_queue(queue)
+	: m_memoryPool(make_shared<DeviceMemoryPool>("TextureManager.pool"))
+	, m_queue(queue)
 {
 	//Make a sampler using configuration that matches imgui
 	vk::SamplerCreateInfo sinfo(
@@ -339,58 +362,74 @@ TextureManager::~TextureManager()
 // File loading
 
 /**
-	@brief Loads a texture from a file into a named resource
-
-	If an existing texture by the same name already exists, it is overwritten.
+	@brief An RGBA8888 image decoded from a file, waiting to be uploaded
  */
-void TextureManager::LoadTexture(
-	const string& name,
-	const string& path)
+class DecodedTextureImage
 {
-	LogTrace("Loading texture \"%s\" from file \"%s\"\n", name.c_str(), path.c_str());
-	LogIndenter li;
+public:
+	DecodedTextureImage()
+	: m_valid(false)
+	, m_width(0)
+	, m_height(0)
+	{}
 
+	bool m_valid;
+	size_t m_width;
+	size_t m_height;
+	vector<uint8_t> m_pixels;
+};
+
+/**
+	@brief Decodes a PNG file to RGBA8888 pixels
+
+	Only touches its own libpng state, so it's safe to call from several threads at once.
+ */
+static bool DecodePNG(const string& path, DecodedTextureImage& image)
+{
 	//Initialize libpng
 	auto png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
 	if(!png)
 	{
 		LogError("Failed to create PNG read struct\n");
-		return;
+		return false;
 	}
 	auto info = png_create_info_struct(png);
 	if(!info)
 	{
 		png_destroy_read_struct(&png, nullptr, nullptr);
 		LogError("Failed to create PNG info struct\n");
-		return;
+		return false;
 	}
 	auto end = png_create_info_struct(png);
 	if(!end)
 	{
 		png_destroy_read_struct(&png, &info, nullptr);
 		LogError("Failed to create PNG end info struct\n");
-		return;
+		return false;
 	}
 
 	//Prepare to load the file (assume it's a PNG for now)
 	FILE* fp = fopen(path.c_str(), "rb");
 	if(!fp)
 	{
+		png_destroy_read_struct(&png, &info, &end);
 		LogError("Failed to open texture file \"%s\"\n", path.c_str());
-		return;
+		return false;
 	}
 	uint8_t sig[8];
 	if(sizeof(sig) != fread(sig, 1, sizeof(sig), fp))
 	{
 		LogError("Failed to read signature of PNG file \"%s\"\n", path.c_str());
+		png_destroy_read_struct(&png, &info, &end);
 		fclose(fp);
-		return;
+		return false;
 	}
 	if(0 != png_sig_cmp(sig, 0, sizeof(sig)))
 	{
 		LogError("Bad magic number in PNG file \"%s\"\n", path.c_str());
+		png_destroy_read_struct(&png, &info, &end);
 		fclose(fp);
-		return;
+		return false;
 	}
 	png_init_io(png, fp);
 	png_set_sig_bytes(png, sizeof(sig));
@@ -408,19 +447,300 @@ void TextureManager::LoadTexture(
 		LogError("Image \"%s\" is not RGBA color type, don't know how to load it\n", path.c_str());
 		png_destroy_read_struct(&png, &info, &end);
 		fclose(fp);
-		return;
+		return false;
 	}
 	if(depth != 8)
 	{
 		LogError("Image \"%s\" is not 8 bits per channel, don't know how to load it\n", path.c_str());
 		png_destroy_read_struct(&png, &info, &end);
 		fclose(fp);
+		return false;
+	}
+
+	//Copy out the pixel data
+	size_t rowSize = width * 4;
+	image.m_width = width;
+	image.m_height = height;
+	image.m_pixels.resize(rowSize * height);
+	for(size_t y=0; y<height; y++)
+		memcpy(&image.m_pixels[y*rowSize], rowPtrs[y], rowSize);
+
+	//Clean up
+	png_destroy_read_struct(&png, &info, &end);
+	fclose(fp);
+	return true;
+}
+
+/**
+	@brief Loads a texture from a file into a named resource
+
+	If an existing texture by the same name already exists, it is overwritten.
+
+	Between BeginBatch() and EndBatch() the load is deferred, and all of the batched files are decoded and uploaded
+	together when the batch ends.
+ */
+void TextureManager::LoadTexture(
+	const string& name,
+	const string& path)
+{
+	if(!m_batchAtlasModes.empty())
+	{
+		m_pendingLoads.push_back(PendingTextureLoad(name, path, m_batchAtlasModes.back()));
+		return;
+	}
+
+	vector<PendingTextureLoad> files;
+	files.push_back(PendingTextureLoad(name, path, false));
+	LoadTextures(files);
+}
+
+/**
+	@brief Starts deferring LoadTexture() calls until the matching EndBatch()
+
+	Batches may be nested; textures are loaded when the outermost batch ends.
+
+	@param atlas	True to pack textures loaded in this batch (and not in a nested batch) into atlas pages
+ */
+void TextureManager::BeginBatch(bool atlas)
+{
+	m_batchAtlasModes.push_back(atlas);
+}
+
+/**
+	@brief Loads every texture requested since the outermost BeginBatch()
+ */
+void TextureManager::EndBatch()
+{
+	if(m_batchAtlasModes.empty())
+	{
+		LogError("TextureManager::EndBatch() called without BeginBatch() (bug)\n");
+		return;
+	}
+
+	m_batchAtlasModes.pop_back();
+	if(!m_batchAtlasModes.empty())
+		return;
+
+	vector<PendingTextureLoad> files;
+	files.swap(m_pendingLoads);
+	LoadTextures(files);
+}
+
+/**
+	@brief Location of an image within an atlas page
+ */
+class AtlasPlacement
+{
+public:
+	AtlasPlacement()
+	: m_page(0)
+	, m_x(0)
+	, m_y(0)
+	{}
+
+	size_t m_page;
+	size_t m_x;
+	size_t m_y;
+};
+
+/**
+	@brief State of an atlas page being packed
+
+	Images are packed onto shelves: rows of images placed left to right, each as tall as its tallest image.
+ */
+class AtlasPageLayout
+{
+public:
+	AtlasPageLayout()
+	: m_shelfY(0)
+	, m_shelfHeight(0)
+	, m_cursorX(0)
+	, m_height(0)
+	{}
+
+	size_t m_shelfY;
+	size_t m_shelfHeight;
+	size_t m_cursorX;
+	size_t m_height;
+};
+
+//Atlas page width (and maximum height), in pixels
+#define ATLAS_PAGE_SIZE 2048
+
+//Transparent gap between images in an atlas, so linear filtering doesn't bleed one icon into the next
+#define ATLAS_PADDING 2
+
+/**
+	@brief Decodes a set of image files in parallel, then uploads them all with a single queue submission
+
+	Files flagged for the atlas are packed into as few atlas pages as possible; anything too large for a page gets its
+	own texture instead.
+ */
+void TextureManager::LoadTextures(const vector<PendingTextureLoad>& files)
+{
+	if(files.empty())
 		return;
+
+	double start = GetTime();
+	LogTrace("Loading %zu textures\n", files.size());
+	LogIndenter li;
+
+	//Decode everything (libpng is by far the slowest part of this)
+	vector<DecodedTextureImage> images(files.size());
+	#pragma omp parallel for
+	for(size_t i=0; i<files.size(); i++)
+		images[i].m_valid = DecodePNG(files[i].m_path, images[i]);
+
+	//Decide which images go in the atlas, tallest first which packs shelves more tightly
+	size_t pageSize = min<size_t>(ATLAS_PAGE_SIZE, g_vkComputePhysicalDevice->getProperties().limits.maxImageDimension2D);
+	vector<size_t> atlasImages;
+	vector<size_t> standaloneImages;
+	for(size_t i=0; i<files.size(); i++)
+	{
+		if(!images[i].m_valid)
+			continue;
+
+		if(files[i].m_atlas && (images[i].m_width <= pageSize) && (images[i].m_height <= pageSize) )
+			atlasImages.push_back(i);
+		else
+			standaloneImages.push_back(i);
+	}
+	sort(atlasImages.begin(), atlasImages.end(), [&](size_t a, size_t b)
+		{
+			if(images[a].m_height != images[b].m_height)
+				return images[a].m_height > images[b].m_height;
+			return images[a].m_width > images[b].m_width;
+		});
+
+	//Pack them
+	vector<AtlasPlacement> placements(files.size());
+	vector<AtlasPageLayout> pages;
+	for(auto i : atlasImages)
+	{
+		auto w = images[i].m_width;
+		auto h = images[i].m_height;
+
+		if(pages.empty())
+			pages.push_back(AtlasPageLayout());
+		auto* page = &pages.back();
+
+		//Start a new shelf if this one is full
+		if(page->m_cursorX + w > pageSize)
+		{
+			page->m_shelfY += page->m_shelfHeight + ATLAS_PADDING;
+			page->m_shelfHeight = 0;
+			page->m_cursorX = 0;
+		}
+
+		//Start a new page if this one is full
+		if(page->m_shelfY + h > pageSize)
+		{
+			pages.push_back(AtlasPageLayout());
+			page = &pages.back();
+		}
+
+		placements[i].m_page = pages.size() - 1;
+		placements[i].m_x = page->m_cursorX;
+		placements[i].m_y = page->m_shelfY;
+
+		page->m_cursorX += w + ATLAS_PADDING;
+		page->m_shelfHeight = max(page->m_shelfHeight, h);
+		page->m_height = max(page->m_height, page->m_shelfY + h);
+	}
+
+	//Render the atlas pages on the CPU
+	vector<DecodedTextureImage> pageImages(pages.size());
+	for(size_t i=0; i<pages.size(); i++)
+	{
+		pageImages[i].m_valid = true;
+		pageImages[i].m_width = pageSize;
+		pageImages[i].m_height = pages[i].m_height;
+		pageImages[i].m_pixels.resize(pageSize * pages[i].m_height * 4, 0);
+	}
+	for(auto i : atlasImages)
+	{
+		auto& src = images[i];
+		auto& dst = pageImages[placements[i].m_page];
+		size_t rowSize = src.m_width * 4;
+		for(size_t y=0; y<src.m_height; y++)
+		{
+			memcpy(
+				&dst.m_pixels[( (placements[i].m_y + y) * dst.m_width + placements[i].m_x) * 4],
+				&src.m_pixels[y * rowSize],
+				rowSize);
+		}
+	}
+
+	//Everything we're actually going to upload: standalone images first, then atlas pages
+	vector<DecodedTextureImage*> uploads;
+	vector<string> uploadNames;
+	for(auto i : standaloneImages)
+	{
+		uploads.push_back(&images[i]);
+		uploadNames.push_back(files[i].m_name);
+	}
+	for(size_t i=0; i<pageImages.size(); i++)
+	{
+		uploads.push_back(&pageImages[i]);
+		uploadNames.push_back(string("atlas") + to_string(i));
+	}
+	if(uploads.empty())
+		return;
+	auto textures = UploadImages(uploads, uploadNames);
+
+	//Register the new textures, replacing any old ones by the same name
+	for(size_t i=0; i<standaloneImages.size(); i++)
+	{
+		auto& name = files[standaloneImages[i]].m_name;
+		m_atlasRegions.erase(name);
+		m_textures[name] = textures[i];
+	}
+	for(auto i : atlasImages)
+	{
+		auto& page = pageImages[placements[i].m_page];
+		float w = page.m_width;
+		float h = page.m_height;
+
+		AtlasRegion region;
+		region.m_texture = textures[standaloneImages.size() + placements[i].m_page];
+		region.m_uv0 = ImVec2(placements[i].m_x / w, placements[i].m_y / h);
+		region.m_uv1 = ImVec2(
+			(placements[i].m_x + images[i].m_width) / w,
+			(placements[i].m_y + images[i].m_height) / h);
+
+		auto& name = files[i].m_name;
+		m_textures.erase(name);
+		m_atlasRegions[name] = region;
+	}
+
+	LogTrace("Loaded %zu textures (%zu in %zu atlas pages) in %.2f ms\n",
+		standaloneImages.size() + atlasImages.size(),
+		atlasImages.size(),
+		pages.size(),
+		(GetTime() - start) * 1000);
+}
+
+/**
+	@brief Uploads a set of decoded images to new textures with a single queue submission
+
+	@param uploads	Images to upload
+	@param names	Debug name of each texture
+
+	@return The new textures, in the same order as the images
+ */
+vector<shared_ptr<Texture>> TextureManager::UploadImages(
+	const vector<DecodedTextureImage*>& uploads,
+	const vector<string>& names)
+{
+	//Pack all of the images into one staging buffer.
+	//Each image is a whole number of RGBA8888 texels, so offsets stay aligned as required by vkCmdCopyBufferToImage.
+	vector<VkDeviceSize> offsets(uploads.size());
+	VkDeviceSize size = 0;
+	for(size_t i=0; i<uploads.size(); i++)
+	{
+		offsets[i] = size;
+		size += uploads[i]->m_pixels.size();
 	}
-	int bytesPerComponent = 1;
-	size_t bytesPerPixel = 4*bytesPerComponent;
-	LogTrace("Image is %zu x %zu pixels, RGBA8888\n", width, height);
-	VkDeviceSize size = width * height * bytesPerPixel;
 
 	//Allocate temporary staging buffer
 	vk::BufferCreateInfo bufinfo({}, size, vk::BufferUsageFlagBits::eTransferSrc);
@@ -452,18 +772,173 @@ void TextureManager::LoadTexture(
 	auto mappedPtr = reinterpret_cast<uint8_t*>(physMem.mapMemory(0, req.size));
 	stagingBuf.bindMemory(*physMem, 0);
 
-	//Fill the mapped buffer with image data from the PNG
-	size_t rowSize = width * bytesPerPixel;
-	for(size_t y=0; y<height; y++)
-		memcpy(mappedPtr + (y*rowSize), rowPtrs[y], rowSize);
+	//Fill the mapped buffer with image data
+	for(size_t i=0; i<uploads.size(); i++)
+		memcpy(mappedPtr + offsets[i], uploads[i]->m_pixels.data(), uploads[i]->m_pixels.size());
 	physMem.unmapMemory();
 
-	//Make the texture object
+	//Make the texture objects, recording all of the uploads into one command buffer
+	vector<shared_ptr<Texture>> textures;
+	vk::raii::CommandBuffer& cmdBuf = GetCmdBuffer();
+	cmdBuf.begin({});
+	for(size_t i=0; i<uploads.size(); i++)
+	{
+		vk::ImageCreateInfo imageInfo(
+			{},
+			vk::ImageType::e2D,
+			vk::Format::eR8G8B8A8Unorm,
+			vk::Extent3D(uploads[i]->m_width, uploads[i]->m_height, 1),
+			1,
+			1,
+			VULKAN_HPP_NAMESPACE::SampleCountFlagBits::e1,
+			VULKAN_HPP_NAMESPACE::ImageTiling::eOptimal,
+			vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+			vk::SharingMode::eExclusive,
+			{},
+			vk::ImageLayout::eUndefined
+			);
+		textures.push_back(make_shared<Texture>(
+			*g_vkComputeDevice,
+			imageInfo,
+			cmdBuf,
+			stagingBuf,
+			offsets[i],
+			uploads[i]->m_width,
+			uploads[i]->m_height,
+			this,
+			names[i]));
+	}
+	cmdBuf.end();
+
+	//Submit the request and block until it completes, so the staging buffer can go away
+	m_queue->SubmitAndBlock(cmdBuf);
+
+	return textures;
+}
+
+/**
+	@brief Loads a set of equally sized images stacked top to bottom into a single texture
+
+	Each image is registered as a region of the strip under its own name, so it can be drawn with GetTextureRef(). The
+	strip itself is registered under the given name, so shaders can bind one texture for all of the images and select
+	one by its V coordinate (see GetStripRow()).
+
+	@param name		Name of the strip texture
+	@param files	Name and path of each image, top to bottom
+ */
+void TextureManager::LoadTextureStrip(const string& name, const vector<pair<string, string> >& files)
+{
+	if(files.empty())
+		return;
+
+	double start = GetTime();
+	LogTrace("Loading %zu images into texture strip %s\n", files.size(), name.c_str());
+	LogIndenter li;
+
+	vector<DecodedTextureImage> images(files.size());
+	#pragma omp parallel for
+	for(size_t i=0; i<files.size(); i++)
+		images[i].m_valid = DecodePNG(files[i].second, images[i]);
+
+	//All rows have to be the same size so each image is an exact band of the strip
+	size_t width = 0;
+	size_t rowHeight = 0;
+	for(size_t i=0; i<files.size(); i++)
+	{
+		if(!images[i].m_valid)
+			continue;
+
+		if(width == 0)
+		{
+			width = images[i].m_width;
+			rowHeight = images[i].m_height;
+		}
+		else if( (images[i].m_width != width) || (images[i].m_height != rowHeight) )
+		{
+			LogError("Image \"%s\" is not the same size as the rest of texture strip %s, skipping it\n",
+				files[i].second.c_str(), name.c_str());
+			images[i].m_valid = false;
+		}
+	}
+	if(width == 0)
+		return;
+
+	//Stack them up, leaving invalid rows transparent
+	DecodedTextureImage strip;
+	strip.m_valid = true;
+	strip.m_width = width;
+	strip.m_height = rowHeight * files.size();
+	strip.m_pixels.resize(width * strip.m_height * 4, 0);
+	size_t bandSize = width * rowHeight * 4;
+	for(size_t i=0; i<files.size(); i++)
+	{
+		if(images[i].m_valid)
+			memcpy(&strip.m_pixels[i * bandSize], images[i].m_pixels.data(), bandSize);
+	}
+
+	auto textures = UploadImages({&strip}, {name});
+
+	m_atlasRegions.erase(name);
+	m_textures[name] = textures[0];
+	float n = files.size();
+	for(size_t i=0; i<files.size(); i++)
+	{
+		AtlasRegion region;
+		region.m_texture = textures[0];
+		region.m_uv0 = ImVec2(0, i / n);
+		region.m_uv1 = ImVec2(1, (i+1) / n);
+
+		m_textures.erase(files[i].first);
+		m_atlasRegions[files[i].first] = region;
+	}
+
+	LogTrace("Loaded texture strip in %.2f ms\n", (GetTime() - start) * 1000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ScanlineAtlas
+
+/**
+	@brief Creates an empty atlas. Nothing is allocated on the GPU until the first row is.
+
+	@param mgr	Texture manager to get samplers and command buffers from
+	@param name	Debug name of the texture
+	@param rows	Number of images the atlas can hold at once
+ */
+ScanlineAtlas::ScanlineAtlas(TextureManager* mgr, const string& name, size_t rows)
+	: m_mgr(mgr)
+	, m_name(name)
+	, m_width(0)
+	, m_slots(rows)
+	, m_hand(0)
+	, m_nextSerial(1)
+	, m_needsInit(false)
+	, m_stagingPtr(nullptr)
+{
+}
+
+/**
+	@brief Makes a new texture and staging buffer wide enough for the given image, discarding every row
+ */
+void ScanlineAtlas::Reallocate(size_t width)
+{
+	//Round up to a power of two so a slightly wider image doesn't reallocate again
+	size_t newWidth = 256;
+	while(newWidth < width)
+		newWidth *= 2;
+	LogTrace("Reallocating scanline atlas %s (%zu x %zu)\n", m_name.c_str(), newWidth, m_slots.size());
+
+	m_width = newWidth;
+	for(auto& slot : m_slots)
+		slot = Slot();
+	m_pendingSlots.clear();
+
+	//Anything drawn earlier in this frame keeps the old texture alive through MainWindow's per-frame references
 	vk::ImageCreateInfo imageInfo(
 		{},
 		vk::ImageType::e2D,
 		vk::Format::eR8G8B8A8Unorm,
-		vk::Extent3D(width, height, 1),
+		vk::Extent3D(m_width, m_slots.size(), 1),
 		1,
 		1,
 		VULKAN_HPP_NAMESPACE::SampleCountFlagBits::e1,
@@ -473,9 +948,168 @@ void TextureManager::LoadTexture(
 		{},
 		vk::ImageLayout::eUndefined
 		);
-	m_textures[name] = make_shared<Texture>(*g_vkComputeDevice, imageInfo, stagingBuf, width, height, this, name);
+	m_texture = make_shared<Texture>(*g_vkComputeDevice, imageInfo, m_mgr, m_name, false);
+	m_needsInit = true;
 
-	//Clean up
-	png_destroy_read_struct(&png, &info, &end);
-	fclose(fp);
+	//Staging buffer has one band per row so rows can be written at any time, in any order
+	if(m_stagingMem)
+		m_stagingMem->unmapMemory();
+	m_stagingBuf = nullptr;
+	m_stagingMem = nullptr;
+	VkDeviceSize size = m_width * m_slots.size() * 4;
+	vk::BufferCreateInfo bufinfo({}, size, vk::BufferUsageFlagBits::eTransferSrc);
+	m_stagingBuf = make_unique<vk::raii::Buffer>(*g_vkComputeDevice, bufinfo);
+
+	//The buffer stays mapped, so prefer coherent memory so we never have to flush it
+	auto req = m_stagingBuf->getMemoryRequirements();
+	auto memProperties = g_vkComputePhysicalDevice->getMemoryProperties();
+	uint32_t memType = 0;
+	bool found = false;
+	for(uint32_t i=0; i<32; i++)
+	{
+		auto flags = memProperties.memoryTypes[i].propertyFlags;
+		if(!(req.memoryTypeBits & (1 << i)) || !(flags & vk::MemoryPropertyFlagBits::eHostVisible))
+			continue;
+		if(!found || (flags & vk::MemoryPropertyFlagBits::eHostCoherent))
+		{
+			memType = i;
+			found = true;
+		}
+		if(flags & vk::MemoryPropertyFlagBits::eHostCoherent)
+			break;
+	}
+	LogTrace("Using memory type %u for scanline staging buffer\n", memType);
+
+	vk::MemoryAllocateInfo minfo(req.size, memType);
+	m_stagingMem = make_unique<vk::raii::DeviceMemory>(*g_vkComputeDevice, minfo);
+	m_stagingBuf->bindMemory(**m_stagingMem, 0);
+	m_stagingPtr = reinterpret_cast<uint8_t*>(m_stagingMem->mapMemory(0, req.size));
+}
+
+/**
+	@brief Allocates a row for a new image
+
+	The least recently drawn row is reused if the atlas is full. Rows drawn in the current frame are never reused.
+
+	@param width	Width of the image, in pixels
+	@param slot		Set to the row the image was given
+	@param serial	Set to the serial number of the image, for IsResident()
+
+	@return Where to write the image, as width RGBA8888 pixels. Null if every row has been drawn this frame.
+ */
+uint8_t* ScanlineAtlas::Allocate(size_t width, size_t& slot, uint64_t& serial)
+{
+	if( (width > m_width) || !m_texture)
+		Reallocate(width);
+
+	//Clock replacement: anything not drawn this frame is fair game, but prefer empty rows
+	int frame = ImGui::GetFrameCount();
+	size_t n = m_slots.size();
+	for(size_t i=0; i<n; i++)
+	{
+		size_t j = (m_hand + i) % n;
+		auto& s = m_slots[j];
+		if(s.m_lastUsedFrame == frame)
+			continue;
+
+		m_hand = (j + 1) % n;
+		s.m_serial = m_nextSerial ++;
+		s.m_width = width;
+		s.m_lastUsedFrame = frame;
+		m_pendingSlots.push_back(j);
+
+		slot = j;
+		serial = s.m_serial;
+		return m_stagingPtr + j*m_width*4;
+	}
+
+	return nullptr;
+}
+
+/**
+	@brief Marks a row as drawn this frame and gets its location in the atlas
+ */
+TextureRef ScanlineAtlas::Use(size_t slot)
+{
+	auto& s = m_slots[slot];
+	s.m_lastUsedFrame = ImGui::GetFrameCount();
+
+	float n = m_slots.size();
+	return TextureRef(
+		m_texture->GetTexture(),
+		ImVec2(0, slot / n),
+		ImVec2(s.m_width * 1.0f / m_width, (slot + 1) / n));
+}
+
+/**
+	@brief Copies every row allocated since the last flush to the texture, in a single submission
+
+	Must be called after the rows are allocated and before the frame they're drawn in is rendered.
+ */
+void ScanlineAtlas::Flush()
+{
+	if(m_pendingSlots.empty() && !m_needsInit)
+		return;
+
+	vk::raii::CommandBuffer& cmdBuf = m_mgr->GetCmdBuffer();
+	cmdBuf.begin({});
+
+	//Wait for any earlier frames still sampling the texture before we overwrite rows.
+	//The texture always stays in the general layout so rows which aren't changing don't need to move.
+	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+	vk::ImageMemoryBarrier before(
+		m_needsInit ? vk::AccessFlagBits::eNone : vk::AccessFlagBits::eShaderRead,
+		vk::AccessFlagBits::eTransferWrite,
+		m_needsInit ? vk::ImageLayout::eUndefined : vk::ImageLayout::eGeneral,
+		vk::ImageLayout::eGeneral,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		m_texture->GetImage(),
+		range);
+	cmdBuf.pipelineBarrier(
+		vk::PipelineStageFlagBits::eFragmentShader,
+		vk::PipelineStageFlagBits::eTransfer,
+		{},
+		{},
+		{},
+		before);
+
+	vector<vk::BufferImageCopy> regions;
+	vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+	for(auto slot : m_pendingSlots)
+	{
+		regions.push_back(vk::BufferImageCopy(
+			slot*m_width*4,
+			0,
+			0,
+			subresource,
+			vk::Offset3D(0, slot, 0),
+			vk::Extent3D(m_slots[slot].m_width, 1, 1)));
+	}
+	if(!regions.empty())
+		cmdBuf.copyBufferToImage(**m_stagingBuf, m_texture->GetImage(), vk::ImageLayout::eGeneral, regions);
+
+	vk::ImageMemoryBarrier after(
+		vk::AccessFlagBits::eTransferWrite,
+		vk::AccessFlagBits::eShaderRead,
+		vk::ImageLayout::eGeneral,
+		vk::ImageLayout::eGeneral,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		m_texture->GetImage(),
+		range);
+	cmdBuf.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eFragmentShader,
+		{},
+		{},
+		{},
+		after);
+	cmdBuf.end();
+
+	//Block so the staging rows can be reused straight away
+	m_mgr->GetQueue()->SubmitAndBlock(cmdBuf);
+
+	m_pendingSlots.clear();
+	m_needsInit = false;
 }
@@ -35,7 +35,10 @@
 #ifndef TextureManager_h
 #define TextureManager_h
 
+#include "DeviceMemoryPool.h"
+
 class TextureManager;
+class DecodedTextureImage;
 
 /**
 	@brief Encapsulates the various Vulkan objects we need to represent texture image memory
@@ -59,8 +62,22 @@ public:
 	Texture(
 		const vk::raii::Device& device,
 		const vk::ImageCreateInfo& imageInfo,
+		vk::raii::CommandBuffer& cmdBuf,
+		const vk::raii::Buffer& srcBuf,
+		vk::DeviceSize srcOffset,
+		int width,
+		int height,
 		TextureManager* mgr,
-		const std::string& name = ""
+		const std::string& name = "",
+		bool upsampleLinear = true
+		);
+
+	Texture(
+		const vk::raii::Device& device,
+		const vk::ImageCreateInfo& imageInfo,
+		TextureManager* mgr,
+		const std::string& name = "",
+		bool upsampleLinear = true
 		);
 
 	~Texture();
@@ -77,6 +94,15 @@ public:
 	void SetName(const std::string& name);
 
 protected:
+	void AllocateMemory(TextureManager* mgr);
+	void RecordUpload(
+		vk::raii::CommandBuffer& cmdBuf,
+		const vk::raii::Buffer& srcBuf,
+		vk::DeviceSize srcOffset,
+		int width,
+		int height);
+	void CreateView(TextureManager* mgr, vk::Format format, VkImageLayout layout, bool upsampleLinear);
+
 	void LayoutTransition(
 		vk::raii::CommandBuffer& cmdBuf,
 		vk::AccessFlags src,
@@ -93,11 +119,72 @@ protected:
 	ImTextureID m_texture;
 
 	///@brief Device memory backing the image
-	std::unique_ptr<vk::raii::DeviceMemory> m_deviceMemory;
+	std::unique_ptr<DeviceMemoryAllocation> m_deviceMemory;
+};
+
+/**
+	@brief A texture, or a region of an atlas texture, ready to draw with imgui
+ */
+class TextureRef
+{
+public:
+	TextureRef(ImTextureID id = 0, ImVec2 uv0 = ImVec2(0, 0), ImVec2 uv1 = ImVec2(1, 1))
+	: m_id(id)
+	, m_uv0(uv0)
+	, m_uv1(uv1)
+	{}
+
+	///@brief Texture to bind
+	ImTextureID m_id;
+
+	///@brief Top left corner of the image within the texture
+	ImVec2 m_uv0;
+
+	///@brief Bottom right corner of the image within the texture
+	ImVec2 m_uv1;
+};
+
+/**
+	@brief A region of an atlas texture
+ */
+class AtlasRegion
+{
+public:
+	///@brief The atlas page containing the image (shared by every image on the page)
+	std::shared_ptr<Texture> m_texture;
+
+	///@brief Top left corner of the image within the page
+	ImVec2 m_uv0;
+
+	///@brief Bottom right corner of the image within the page
+	ImVec2 m_uv1;
+};
+
+/**
+	@brief A LoadTexture() call deferred until the end of a batch
+ */
+class PendingTextureLoad
+{
+public:
+	PendingTextureLoad(const std::string& name, const std::string& path, bool atlas)
+	: m_name(name)
+	, m_path(path)
+	, m_atlas(atlas)
+	{}
+
+	std::string m_name;
+	std::string m_path;
+
+	///@brief True to pack the image into an atlas page rather than giving it its own texture
+	bool m_atlas;
 };
 
 /**
 	@brief Manages loading and saving texture resources to files
+
+	Small images that are only ever drawn through imgui (icons) can be loaded into an atlas by loading them inside a
+	BeginBatch(true) / EndBatch() pair. Atlas images must be drawn with GetTextureRef() and its UV coordinates, since
+	GetTexture() and GetView() only work for images with their own texture.
  */
 class TextureManager
 {
@@ -109,11 +196,22 @@ public:
 		const std::string& name,
 		const std::string& path);
 
+	void LoadTextureStrip(const std::string& name, const std::vector<std::pair<std::string, std::string> >& files);
+
+	void BeginBatch(bool atlas = false);
+	void EndBatch();
+
 	ImTextureID GetTexture(const std::string& name)
 	{
 		auto it = m_textures.find(name);
 		if(it == m_textures.end())
 		{
+			if(m_atlasRegions.find(name) != m_atlasRegions.end())
+			{
+				LogFatal(
+					"Texture \"%s\" is packed into an atlas and must be drawn via GetTextureRef().\n",
+					name.c_str());
+			}
 			LogFatal(
 				"Texture \"%s\" not found. This is probably the result of a developer mistyping a texture ID.\n",
 				name.c_str());
@@ -122,14 +220,29 @@ public:
 			return it->second->GetTexture();
 	}
 
+	TextureRef GetTextureRef(const std::string& name)
+	{
+		auto it = m_atlasRegions.find(name);
+		if(it != m_atlasRegions.end())
+			return TextureRef(it->second.m_texture->GetTexture(), it->second.m_uv0, it->second.m_uv1);
+		return TextureRef(GetTexture(name));
+	}
+
 	std::unique_ptr<vk::raii::Sampler>& GetSampler()
 	{ return m_sampler; }
 
 	std::unique_ptr<vk::raii::Sampler>& GetNearestSampler()
 	{ return m_nearestSampler; }
 
+	///@brief Gets the pool texture memory is allocated from
+	std::shared_ptr<DeviceMemoryPool> GetMemoryPool()
+	{ return m_memoryPool; }
+
 	void clear()
-	{ m_textures.clear(); }
+	{
+		m_textures.clear();
+		m_atlasRegions.clear();
+	}
 
 	vk::raii::CommandBuffer& GetCmdBuffer()
 	{ return *m_cmdBuf; }
@@ -140,17 +253,136 @@ public:
 	vk::ImageView GetView(const std::string& name)
 	{ return m_textures[name]->GetView(); }
 
+	/**
+		@brief Gets the V coordinate of the middle of an image loaded with LoadTextureStrip()
+
+		Sampling the strip at this V coordinate reads from that image only, even with linear filtering.
+	 */
+	float GetStripRow(const std::string& name)
+	{
+		auto it = m_atlasRegions.find(name);
+		if(it == m_atlasRegions.end())
+			return 0.5;
+		return (it->second.m_uv0.y + it->second.m_uv1.y) * 0.5f;
+	}
+
 protected:
+	void LoadTextures(const std::vector<PendingTextureLoad>& files);
+	std::vector<std::shared_ptr<Texture> > UploadImages(
+		const std::vector<DecodedTextureImage*>& uploads,
+		const std::vector<std::string>& names);
+
+	///@brief Images with a texture of their own
 	std::map<std::string, std::shared_ptr<Texture> > m_textures;
 
+	///@brief Images packed into an atlas page
+	std::map<std::string, AtlasRegion> m_atlasRegions;
+
+	///@brief Atlas mode of each open BeginBatch() call, innermost last
+	std::vector<bool> m_batchAtlasModes;
+
+	///@brief Textures requested during the current batch
+	std::vector<PendingTextureLoad> m_pendingLoads;
+
 	///@brief Sampler for textures
 	std::unique_ptr<vk::raii::Sampler> m_sampler;
 
 	std::unique_ptr<vk::raii::Sampler> m_nearestSampler;
 
+	///@brief Device memory for textures (shared with every texture, which may outlive us)
+	std::shared_ptr<DeviceMemoryPool> m_memoryPool;
+
 	std::shared_ptr<QueueHandle> m_queue;
 	std::unique_ptr<vk::raii::CommandPool> m_cmdPool;
 	std::unique_ptr<vk::raii::CommandBuffer> m_cmdBuf;
 };
 
+/**
+	@brief A pool of single row images (e.g. decoded video scanlines) packed into one tall texture
+
+	Each row is written straight into its band of a persistently mapped staging buffer, and all rows allocated in a
+	frame are copied to the GPU in one submission by Flush(). Once every row is in use, the least recently drawn row
+	is reused, so rows which have scrolled out of view are evicted without any bookkeeping by the caller.
+
+	Callers keep the slot number and serial number returned by Allocate(), and check them with IsResident() before
+	drawing, since the slot may have been reused for another image since.
+ */
+class ScanlineAtlas
+{
+public:
+	ScanlineAtlas(TextureManager* mgr, const std::string& name, size_t rows = 1024);
+
+	bool IsResident(size_t slot, uint64_t serial)
+	{ return (slot < m_slots.size()) && (m_slots[slot].m_serial == serial) && (serial != 0); }
+
+	uint8_t* Allocate(size_t width, size_t& slot, uint64_t& serial);
+	TextureRef Use(size_t slot);
+	void Flush();
+
+	///@brief Gets the atlas texture (null until the first row is allocated)
+	std::shared_ptr<Texture> GetTexture()
+	{ return m_texture; }
+
+protected:
+	void Reallocate(size_t width);
+
+	/**
+		@brief State of one row of the atlas
+	 */
+	class Slot
+	{
+	public:
+		Slot()
+		: m_serial(0)
+		, m_width(0)
+		, m_lastUsedFrame(-1)
+		{}
+
+		///@brief Serial number of the image in this row (zero if empty)
+		uint64_t m_serial;
+
+		///@brief Width of the image in this row, in pixels
+		size_t m_width;
+
+		///@brief imgui frame number the row was last drawn in
+		int m_lastUsedFrame;
+	};
+
+	///@brief The texture manager we get our samplers and command buffer from
+	TextureManager* m_mgr;
+
+	///@brief Debug name of the texture
+	std::string m_name;
+
+	///@brief Width of the atlas, in pixels
+	size_t m_width;
+
+	///@brief State of each row
+	std::vector<Slot> m_slots;
+
+	///@brief Next row to consider for eviction (clock replacement)
+	size_t m_hand;
+
+	///@brief Serial number to give the next image
+	uint64_t m_nextSerial;
+
+	///@brief Rows written to the staging buffer but not yet copied to the texture
+	std::vector<size_t> m_pendingSlots;
+
+	///@brief True if the texture hasn't been transitioned out of the undefined layout yet
+	bool m_needsInit;
+
+	///@brief The atlas texture
+	std::shared_ptr<Texture> m_texture;
+
+	///@brief Staging buffer, one band per row
+	std::unique_ptr<vk::raii::Buffer> m_stagingBuf;
+
+	///@brief Host visible memory backing the staging buffer
+	std::unique_ptr<vk::raii::DeviceMemory> m_stagingMem;
+
+	///@brief Persistent mapping of the staging buffer
+	uint8_t* m_stagingPtr;
+};
+
 #endif
@@ -0,0 +1,454 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ThreadRoles
+ */
+
+#include "ngscopeclient.h"
+#include "ThreadRoles.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+using namespace std;
+
+/**
+	@brief A live thread which has declared a role
+ */
+struct RegisteredThread
+{
+	ThreadRole m_role;
+
+#ifdef _WIN32
+	///@brief Real (not pseudo) handle to the thread, so it can be adjusted from other threads
+	HANDLE m_handle;
+#elif defined(__linux__)
+	pthread_t m_thread;
+
+	///@brief Kernel thread ID, needed for setpriority()
+	pid_t m_tid;
+#endif
+};
+
+///@brief Mutex protecting all of the state below
+static mutex g_threadRoleMutex;
+
+///@brief Current settings for each role
+static ThreadRoleSettings g_threadRoleSettings[THREAD_ROLE_COUNT];
+
+///@brief True if we've already complained that a role's current settings couldn't be applied
+static bool g_threadRoleWarned[THREAD_ROLE_COUNT] = {false};
+
+///@brief Every live thread with a role
+static map<thread::id, RegisteredThread> g_registeredThreads;
+
+#ifdef __linux__
+
+///@brief Nice value used for each non-realtime priority
+static const int g_niceValues[] = { 10, 0, -10, 0 };
+
+///@brief SCHED_FIFO priority for realtime threads. Kept low so we don't starve kernel threads (e.g. IRQ handlers).
+static const int REALTIME_PRIORITY = 10;
+
+///@brief Gets the affinity mask of the thread calling it
+static cpu_set_t GetCurrentAffinity()
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(0 != sched_getaffinity(0, sizeof(set), &set))
+	{
+		for(int i=0; i<CPU_SETSIZE; i++)
+			CPU_SET(i, &set);
+	}
+	return set;
+}
+
+///@brief CPUs the process was allowed to run on at startup (captured before any thread was pinned)
+static const cpu_set_t g_processAffinity = GetCurrentAffinity();
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Applying settings
+
+/**
+	@brief Applies a role's settings to one thread
+
+	Must be called with g_threadRoleMutex held.
+
+	@param t		The thread
+	@param settings	Settings to apply
+	@param err		Description of what went wrong, if anything
+
+	@return True on success
+ */
+static bool ApplyToThread(const RegisteredThread& t, const ThreadRoleSettings& settings, string& err)
+{
+	bool ok = true;
+
+#ifdef _WIN32
+
+	static const int priorities[] =
+	{
+		THREAD_PRIORITY_BELOW_NORMAL,
+		THREAD_PRIORITY_NORMAL,
+		THREAD_PRIORITY_HIGHEST,
+		THREAD_PRIORITY_TIME_CRITICAL
+	};
+	if(!SetThreadPriority(t.m_handle, priorities[settings.m_priority]))
+	{
+		err = "SetThreadPriority failed (error " + to_string(GetLastError()) + ")";
+		ok = false;
+	}
+
+	DWORD_PTR processMask = 0;
+	DWORD_PTR systemMask = 0;
+	GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+
+	//Only CPUs in our own processor group can be addressed by a thread affinity mask
+	DWORD_PTR mask = processMask;
+	if(!settings.m_cpus.empty())
+	{
+		mask = 0;
+		for(auto cpu : settings.m_cpus)
+		{
+			if(cpu < sizeof(DWORD_PTR) * 8)
+				mask |= (DWORD_PTR)1 << cpu;
+		}
+		mask &= processMask;
+	}
+	if(mask == 0)
+	{
+		err = "none of the selected CPUs are available to this process";
+		ok = false;
+	}
+	else if(!SetThreadAffinityMask(t.m_handle, mask))
+	{
+		err = "SetThreadAffinityMask failed (error " + to_string(GetLastError()) + ")";
+		ok = false;
+	}
+
+#elif defined(__linux__)
+
+	//Switch scheduling policy first, since nice values don't do anything to SCHED_FIFO threads
+	sched_param param = {};
+	int policy = SCHED_OTHER;
+	if(settings.m_priority == THREAD_PRIO_REALTIME)
+	{
+		policy = SCHED_FIFO;
+		param.sched_priority = max(REALTIME_PRIORITY, sched_get_priority_min(SCHED_FIFO));
+	}
+	int ret = pthread_setschedparam(t.m_thread, policy, &param);
+	if(ret != 0)
+	{
+		err = string("couldn't set scheduling policy: ") + strerror(ret);
+		ok = false;
+	}
+	else if( (policy == SCHED_OTHER) &&
+		(0 != setpriority(PRIO_PROCESS, t.m_tid, g_niceValues[settings.m_priority])) )
+	{
+		err = string("couldn't set nice value: ") + strerror(errno);
+		ok = false;
+	}
+
+	cpu_set_t set = g_processAffinity;
+	if(!settings.m_cpus.empty())
+	{
+		CPU_ZERO(&set);
+		for(auto cpu : settings.m_cpus)
+		{
+			if(cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &set);
+		}
+		CPU_AND(&set, &set, &g_processAffinity);
+	}
+	if(CPU_COUNT(&set) == 0)
+	{
+		err = "none of the selected CPUs are available to this process";
+		ok = false;
+	}
+	else
+	{
+		ret = pthread_setaffinity_np(t.m_thread, sizeof(set), &set);
+		if(ret != 0)
+		{
+			err = string("couldn't set CPU affinity: ") + strerror(ret);
+			ok = false;
+		}
+	}
+
+#else
+
+	//No portable way to pin threads on macOS or the BSDs, so only the defaults are supported
+	if(settings != ThreadRoleSettings())
+	{
+		err = "thread priority and affinity aren't supported on this platform";
+		ok = false;
+	}
+	(void)t;
+
+#endif
+
+	return ok;
+}
+
+/**
+	@brief Applies a role's settings to one thread, and logs the first failure
+
+	Must be called with g_threadRoleMutex held.
+ */
+static void ApplyAndWarn(const RegisteredThread& t)
+{
+	string err;
+	if(!ApplyToThread(t, g_threadRoleSettings[t.m_role], err) && !g_threadRoleWarned[t.m_role])
+	{
+		LogWarning("Couldn't apply scheduling settings for %s threads: %s\n",
+			ThreadRoles::GetRoleName(t.m_role), err.c_str());
+		g_threadRoleWarned[t.m_role] = true;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Changes the settings for a role, and applies them to every live thread with that role
+
+	Does nothing if the settings are unchanged, so it's cheap to call every frame.
+ */
+void ThreadRoles::Configure(ThreadRole role, const ThreadRoleSettings& settings)
+{
+	lock_guard<mutex> lock(g_threadRoleMutex);
+	if(g_threadRoleSettings[role] == settings)
+		return;
+
+	LogTrace("Applying new scheduling settings to %s threads\n", GetRoleName(role));
+	g_threadRoleSettings[role] = settings;
+	g_threadRoleWarned[role] = false;
+
+	for(auto& it : g_registeredThreads)
+	{
+		if(it.second.m_role == role)
+			ApplyAndWarn(it.second);
+	}
+}
+
+/**
+	@brief Parses a list of CPU numbers and ranges, like "0-3,8,10-11"
+
+	@param str	The list
+	@param cpus	Sorted list of CPU numbers, without duplicates
+
+	@return True if the list was well formed (an empty string is an empty list)
+ */
+bool ThreadRoles::ParseCPUList(const string& str, vector<unsigned int>& cpus)
+{
+	//No sane machine has this many, so it's probably a typo rather than something we should try to allocate
+	static const unsigned long MAX_CPU = 4095;
+
+	cpus.clear();
+	set<unsigned int> found;
+
+	size_t pos = 0;
+	while(pos < str.length())
+	{
+		size_t end = str.find(',', pos);
+		if(end == string::npos)
+			end = str.length();
+		string item = str.substr(pos, end - pos);
+		pos = end + 1;
+
+		//Skip whitespace, and allow empty items (e.g. a trailing comma)
+		item.erase(remove_if(item.begin(), item.end(), [](char c) { return isspace(c); }), item.end());
+		if(item.empty())
+			continue;
+
+		const char* p = item.c_str();
+		char* next = nullptr;
+		if(!isdigit(*p))
+			return false;
+		unsigned long first = strtoul(p, &next, 10);
+		unsigned long last = first;
+		if(*next == '-')
+		{
+			p = next + 1;
+			if(!isdigit(*p))
+				return false;
+			last = strtoul(p, &next, 10);
+		}
+		if( (*next != '\0') || (last < first) || (last > MAX_CPU) )
+			return false;
+
+		for(unsigned long i=first; i<=last; i++)
+			found.emplace(i);
+	}
+
+	cpus.assign(found.begin(), found.end());
+	return true;
+}
+
+///@brief Gets a human readable name for a role, for log messages
+const char* ThreadRoles::GetRoleName(ThreadRole role)
+{
+	switch(role)
+	{
+		case THREAD_ROLE_INSTRUMENT:
+			return "instrument";
+
+		case THREAD_ROLE_WAVEFORM:
+			return "waveform processing";
+
+		case THREAD_ROLE_TASK_POOL:
+			return "task pool";
+
+		default:
+			return "unknown";
+	}
+}
+
+#ifdef __linux__
+/**
+	@brief Looks up which NUMA node a CPU belongs to
+
+	@return Node number, or -1 if unknown (e.g. kernel without NUMA support)
+ */
+static int GetCPUNumaNode(unsigned int cpu)
+{
+	//sysfs has a "nodeN" link in each CPU's directory
+	string path = "/sys/devices/system/cpu/cpu" + to_string(cpu);
+	DIR* dir = opendir(path.c_str());
+	if(!dir)
+		return -1;
+
+	int node = -1;
+	while(auto ent = readdir(dir))
+	{
+		if( (strncmp(ent->d_name, "node", 4) == 0) && isdigit(ent->d_name[4]) )
+		{
+			node = atoi(ent->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+#endif
+
+/**
+	@brief Gets the NUMA node threads with a role run on
+
+	@return The node, or -1 if the role isn't pinned to CPUs on a single node (or NUMA isn't supported here)
+ */
+int ThreadRoles::GetNumaNode(ThreadRole role)
+{
+#ifdef __linux__
+	vector<unsigned int> cpus;
+	{
+		lock_guard<mutex> lock(g_threadRoleMutex);
+		cpus = g_threadRoleSettings[role].m_cpus;
+	}
+
+	//Topology doesn't change at run time, so remember what we've looked up
+	static mutex cacheMutex;
+	static map<unsigned int, int> cache;
+	lock_guard<mutex> lock(cacheMutex);
+
+	int node = -1;
+	for(auto cpu : cpus)
+	{
+		auto it = cache.find(cpu);
+		if(it == cache.end())
+			it = cache.emplace(cpu, GetCPUNumaNode(cpu)).first;
+		if( (it->second < 0) || ( (node >= 0) && (node != it->second) ) )
+			return -1;
+		node = it->second;
+	}
+	return node;
+#else
+	(void)role;
+	return -1;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Registration
+
+/**
+	@brief Gives the current thread a role, and applies that role's settings to it
+ */
+void ThreadRoles::Register(ThreadRole role)
+{
+	RegisteredThread t;
+	t.m_role = role;
+#ifdef _WIN32
+	t.m_handle = OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, GetCurrentThreadId());
+	if(!t.m_handle)
+	{
+		LogWarning("Couldn't open handle to %s thread (error %lu)\n", GetRoleName(role), GetLastError());
+		return;
+	}
+#elif defined(__linux__)
+	t.m_thread = pthread_self();
+	t.m_tid = syscall(SYS_gettid);
+#endif
+
+	lock_guard<mutex> lock(g_threadRoleMutex);
+	g_registeredThreads[this_thread::get_id()] = t;
+
+	//Threads start out with the process defaults, so only touch them if the role has been customized
+	if(g_threadRoleSettings[role] != ThreadRoleSettings())
+		ApplyAndWarn(t);
+}
+
+/**
+	@brief Removes the current thread from the registry before it exits
+ */
+void ThreadRoles::Unregister()
+{
+	lock_guard<mutex> lock(g_threadRoleMutex);
+	auto it = g_registeredThreads.find(this_thread::get_id());
+	if(it == g_registeredThreads.end())
+		return;
+
+#ifdef _WIN32
+	CloseHandle(it->second.m_handle);
+#endif
+	g_registeredThreads.erase(it);
+}
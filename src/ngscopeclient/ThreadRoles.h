@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ThreadRoles
+ */
+#ifndef ThreadRoles_h
+#define ThreadRoles_h
+
+#include <string>
+#include <vector>
+
+#include "PreferenceTypes.h"
+
+/**
+	@brief Kinds of background thread which can be given their own priority and CPU affinity
+ */
+enum ThreadRole
+{
+	///@brief Threads talking to instruments (InstrumentThread, BERTThread, BERT scans)
+	THREAD_ROLE_INSTRUMENT,
+
+	///@brief The WaveformThread, which runs the filter graph on new waveforms
+	THREAD_ROLE_WAVEFORM,
+
+	///@brief Workers of the session's TaskPool
+	THREAD_ROLE_TASK_POOL,
+
+	THREAD_ROLE_COUNT
+};
+
+/**
+	@brief Scheduling settings for one thread role
+ */
+class ThreadRoleSettings
+{
+public:
+	ThreadRoleSettings()
+	: m_priority(THREAD_PRIO_NORMAL)
+	{}
+
+	bool operator==(const ThreadRoleSettings& rhs) const
+	{ return (m_priority == rhs.m_priority) && (m_cpus == rhs.m_cpus); }
+
+	bool operator!=(const ThreadRoleSettings& rhs) const
+	{ return !(*this == rhs); }
+
+	///@brief Scheduling priority
+	ThreadPriority m_priority;
+
+	///@brief CPUs the threads may run on, or empty for any CPU the process may use
+	std::vector<unsigned int> m_cpus;
+};
+
+/**
+	@brief Applies per-role priority and CPU affinity to background threads
+
+	Each thread declares its role with a ThreadRoleScope at the top of its entry point. Settings for a role can be
+	changed at any time from any thread, and are applied to every live thread with that role as well as to threads
+	started later.
+
+	Failures (typically not having permission to raise priority) are logged once per change of settings, and the
+	thread keeps running with whatever scheduling it had.
+ */
+class ThreadRoles
+{
+public:
+	static void Configure(ThreadRole role, const ThreadRoleSettings& settings);
+
+	static bool ParseCPUList(const std::string& str, std::vector<unsigned int>& cpus);
+	static const char* GetRoleName(ThreadRole role);
+	static int GetNumaNode(ThreadRole role);
+
+protected:
+	friend class ThreadRoleScope;
+
+	static void Register(ThreadRole role);
+	static void Unregister();
+};
+
+/**
+	@brief Gives the current thread a role for as long as the object is in scope
+ */
+class ThreadRoleScope
+{
+public:
+	ThreadRoleScope(ThreadRole role)
+	{ ThreadRoles::Register(role); }
+
+	~ThreadRoleScope()
+	{ ThreadRoles::Unregister(); }
+
+	ThreadRoleScope(const ThreadRoleScope&) = delete;
+	ThreadRoleScope& operator=(const ThreadRoleScope&) = delete;
+};
+
+#endif
@@ -0,0 +1,318 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of Tracer
+ */
+#include "ngscopeclient.h"
+#include "Tracer.h"
+
+using namespace std;
+
+///@brief Number of events each thread keeps before the oldest are overwritten
+#define TRACE_EVENTS_PER_THREAD	16384
+
+///@brief True if trace zones should be recorded
+atomic<bool> g_tracingEnabled(false);
+
+///@brief Mutex controlling access to g_traceBuffers and buffer names
+static mutex g_traceBufferMutex;
+
+///@brief Buffers for every thread which has ever recorded an event (never freed)
+static vector< unique_ptr<TraceThreadBuffer> > g_traceBuffers;
+
+///@brief Buffers for tracks which aren't tied to a thread, indexed by name (may be written from any thread)
+static map<string, TraceThreadBuffer*> g_traceTracks;
+
+///@brief This thread's buffer, if it has recorded anything yet
+static thread_local TraceThreadBuffer* g_threadTraceBuffer = nullptr;
+
+///@brief This thread's name, if set before its buffer was created
+static thread_local const char* g_threadTraceName = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TraceThreadBuffer
+
+TraceThreadBuffer::TraceThreadBuffer(uint32_t tid, size_t capacity)
+	: m_tid(tid)
+	, m_events(capacity)
+	, m_head(0)
+{
+}
+
+/**
+	@brief Appends an event to the buffer
+
+	Only one thread may append at a time: normally the owning thread, or anyone holding the track mutex.
+ */
+void TraceThreadBuffer::Append(const char* name, int64_t start, int64_t end, const char* detail)
+{
+	uint64_t head = m_head.load(memory_order_relaxed);
+	auto& ev = m_events[head & (m_events.size() - 1)];
+	ev.m_name = name;
+	ev.m_start = start;
+	ev.m_end = end;
+	if(detail)
+	{
+		strncpy(ev.m_detail, detail, sizeof(ev.m_detail) - 1);
+		ev.m_detail[sizeof(ev.m_detail) - 1] = '\0';
+	}
+	else
+		ev.m_detail[0] = '\0';
+
+	m_head.store(head + 1, memory_order_release);
+}
+
+/**
+	@brief Copies out every event ending at or after a given time
+
+	Events the owning thread may have overwritten while we were copying are discarded.
+
+	@param since	Earliest end time to include, in ns
+	@param events	Vector to append the events to
+ */
+void TraceThreadBuffer::Read(int64_t since, vector<TraceEvent>& events)
+{
+	size_t cap = m_events.size();
+	uint64_t head = m_head.load(memory_order_acquire);
+	uint64_t tail = (head > cap) ? (head - cap) : 0;
+
+	vector<TraceEvent> copy;
+	copy.reserve(head - tail);
+	for(uint64_t i=tail; i<head; i++)
+		copy.push_back(m_events[i & (cap - 1)]);
+
+	atomic_thread_fence(memory_order_acquire);
+	uint64_t newHead = m_head.load(memory_order_relaxed);
+	uint64_t safeTail = (newHead > cap) ? (newHead - cap) : 0;
+
+	for(uint64_t i=max(tail, safeTail); i<head; i++)
+	{
+		auto& ev = copy[i - tail];
+		if(ev.m_end >= since)
+			events.push_back(ev);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Tracer
+
+/**
+	@brief Turns recording of trace zones on or off
+
+	Events recorded before tracing was disabled are kept, so a trace can still be saved afterwards.
+ */
+void Tracer::SetEnabled(bool enabled)
+{
+	g_tracingEnabled = enabled;
+	if(enabled)
+		LogNotice("Tracing enabled\n");
+	else
+		LogNotice("Tracing disabled\n");
+}
+
+/**
+	@brief Sets the name the calling thread is shown with in the trace
+
+	@param name		Thread name (must be a string literal or otherwise live forever)
+ */
+void Tracer::SetThreadName(const char* name)
+{
+	g_threadTraceName = name;
+	if(g_threadTraceBuffer)
+	{
+		lock_guard<mutex> lock(g_traceBufferMutex);
+		g_threadTraceBuffer->m_name = name;
+	}
+}
+
+/**
+	@brief Gets the name set for the calling thread by SetThreadName(), or null if it hasn't been given one
+ */
+const char* Tracer::GetThreadName()
+{
+	return g_threadTraceName;
+}
+
+/**
+	@brief Gets the calling thread's buffer, creating it if this is the thread's first event
+ */
+TraceThreadBuffer* Tracer::GetThreadBuffer()
+{
+	if(!g_threadTraceBuffer)
+	{
+		lock_guard<mutex> lock(g_traceBufferMutex);
+		auto buf = make_unique<TraceThreadBuffer>(g_traceBuffers.size() + 1, TRACE_EVENTS_PER_THREAD);
+		if(g_threadTraceName)
+			buf->m_name = g_threadTraceName;
+		else
+			buf->m_name = string("Thread ") + to_string(buf->m_tid);
+		g_threadTraceBuffer = buf.get();
+		g_traceBuffers.push_back(std::move(buf));
+	}
+	return g_threadTraceBuffer;
+}
+
+/**
+	@brief Records a completed zone on the calling thread
+
+	@param name		Name of the zone (must be a string literal or otherwise live forever)
+	@param start	Start time, as returned by Now()
+	@param end		End time, as returned by Now()
+	@param detail	Optional extra information (copied, truncated if long)
+ */
+void Tracer::Record(const char* name, int64_t start, int64_t end, const char* detail)
+{
+	if(!IsEnabled())
+		return;
+	GetThreadBuffer()->Append(name, start, end, detail);
+}
+
+/**
+	@brief Records a zone on a named track rather than the calling thread's own
+
+	Used for things which don't correspond to what a single thread was doing, such as per-filter runtimes reported
+	by the filter graph executor after the fact. Slower than Record() since tracks may be shared between threads.
+
+	@param track	Name of the track (must be a string literal or otherwise live forever)
+	@param name		Name of the zone (must be a string literal or otherwise live forever)
+	@param start	Start time, as returned by Now()
+	@param end		End time, as returned by Now()
+	@param detail	Optional extra information (copied, truncated if long)
+ */
+void Tracer::RecordOnTrack(const char* track, const char* name, int64_t start, int64_t end, const char* detail)
+{
+	if(!IsEnabled())
+		return;
+
+	lock_guard<mutex> lock(g_traceBufferMutex);
+	auto it = g_traceTracks.find(track);
+	if(it == g_traceTracks.end())
+	{
+		auto buf = make_unique<TraceThreadBuffer>(g_traceBuffers.size() + 1, TRACE_EVENTS_PER_THREAD);
+		buf->m_name = track;
+		it = g_traceTracks.emplace(track, buf.get()).first;
+		g_traceBuffers.push_back(std::move(buf));
+	}
+	it->second->Append(name, start, end, detail);
+}
+
+/**
+	@brief Escapes a string for use in JSON
+ */
+static string JsonEscape(const char* str)
+{
+	string ret;
+	for(; *str; str++)
+	{
+		char c = *str;
+		if( (c == '\"') || (c == '\\') )
+		{
+			ret += '\\';
+			ret += c;
+		}
+		else if( (unsigned char)c < 0x20)
+			ret += ' ';
+		else
+			ret += c;
+	}
+	return ret;
+}
+
+/**
+	@brief Writes recent events from all threads in the Chrome trace event format
+
+	The file can be opened with Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+	@param path		Path to the output file
+	@param seconds	How far back in time to include events
+
+	@return True on success
+ */
+bool Tracer::WriteChromeTrace(const string& path, double seconds)
+{
+	int64_t now = Now();
+	int64_t since = now - static_cast<int64_t>(seconds * 1e9);
+
+	//Snapshot the buffers. The buffers themselves are never freed, so we can read them without holding the lock.
+	vector<TraceThreadBuffer*> buffers;
+	vector<string> names;
+	{
+		lock_guard<mutex> lock(g_traceBufferMutex);
+		for(auto& buf : g_traceBuffers)
+		{
+			buffers.push_back(buf.get());
+			names.push_back(buf->m_name);
+		}
+	}
+
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Failed to open trace file %s\n", path.c_str());
+		return false;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ngscopeclient\"}}");
+
+	size_t count = 0;
+	vector<TraceEvent> events;
+	for(size_t i=0; i<buffers.size(); i++)
+	{
+		auto buf = buffers[i];
+		fprintf(fp, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			buf->m_tid, JsonEscape(names[i].c_str()).c_str());
+
+		events.clear();
+		buf->Read(since, events);
+		for(auto& ev : events)
+		{
+			//Timestamps are in microseconds, relative to the start of the window
+			fprintf(fp, ",\n{\"ph\":\"X\",\"cat\":\"ngscopeclient\",\"name\":\"%s\",\"pid\":1,\"tid\":%u,"
+				"\"ts\":%.3f,\"dur\":%.3f",
+				JsonEscape(ev.m_name).c_str(),
+				buf->m_tid,
+				(ev.m_start - since) * 1e-3,
+				(ev.m_end - ev.m_start) * 1e-3);
+			if(ev.m_detail[0])
+				fprintf(fp, ",\"args\":{\"detail\":\"%s\"}", JsonEscape(ev.m_detail).c_str());
+			fprintf(fp, "}");
+		}
+		count += events.size();
+	}
+
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+
+	LogNotice("Wrote %zu trace events from %zu threads to %s\n", count, buffers.size(), path.c_str());
+	return true;
+}
@@ -0,0 +1,165 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of Tracer and TraceZone
+ */
+#ifndef Tracer_h
+#define Tracer_h
+
+#include <chrono>
+
+extern std::atomic<bool> g_tracingEnabled;
+
+/**
+	@brief A single completed zone in a trace
+ */
+class TraceEvent
+{
+public:
+	///@brief Name of the zone (must be a string literal or otherwise live forever)
+	const char* m_name;
+
+	///@brief Start time, in ns
+	int64_t m_start;
+
+	///@brief End time, in ns
+	int64_t m_end;
+
+	///@brief Optional extra information, e.g. the name of the filter being run (always null terminated)
+	char m_detail[64];
+};
+
+/**
+	@brief Ring buffer of trace events recorded by one thread
+
+	Only the owning thread ever writes to a buffer, so recording an event is just a copy and an atomic store.
+	Buffers outlive their threads so a trace can still include threads which have exited.
+ */
+class TraceThreadBuffer
+{
+public:
+	TraceThreadBuffer(uint32_t tid, size_t capacity);
+
+	void Append(const char* name, int64_t start, int64_t end, const char* detail);
+	void Read(int64_t since, std::vector<TraceEvent>& events);
+
+	///@brief Small integer identifying the thread in the trace
+	uint32_t m_tid;
+
+	///@brief Name of the thread, as set by Tracer::SetThreadName()
+	std::string m_name;
+
+protected:
+	///@brief Ring of events (size is a power of two)
+	std::vector<TraceEvent> m_events;
+
+	///@brief Total number of events ever written
+	std::atomic<uint64_t> m_head;
+};
+
+/**
+	@brief Lightweight tracing of hot paths, exportable as a Chrome/Perfetto trace
+
+	When tracing is disabled a TraceZone costs one relaxed atomic load.
+ */
+class Tracer
+{
+public:
+
+	///@brief Gets the current time in ns, on the same clock as all trace events
+	static int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void SetEnabled(bool enabled);
+
+	///@brief Checks if tracing is enabled
+	static bool IsEnabled()
+	{ return g_tracingEnabled.load(std::memory_order_relaxed); }
+
+	static void SetThreadName(const char* name);
+	static const char* GetThreadName();
+	static void Record(const char* name, int64_t start, int64_t end, const char* detail = nullptr);
+	static void RecordOnTrack(const char* track, const char* name, int64_t start, int64_t end, const char* detail);
+	static bool WriteChromeTrace(const std::string& path, double seconds);
+
+protected:
+	static TraceThreadBuffer* GetThreadBuffer();
+};
+
+/**
+	@brief Records the time from construction to destruction as a trace zone
+ */
+class TraceZone
+{
+public:
+	TraceZone(const char* name)
+		: m_name(name)
+		, m_detail(nullptr)
+		, m_start(Tracer::IsEnabled() ? Tracer::Now() : 0)
+	{}
+
+	/**
+		@brief Creates a zone with some extra information
+
+		The detail string is only copied when the zone ends, so it must remain valid until then.
+	 */
+	TraceZone(const char* name, const char* detail)
+		: m_name(name)
+		, m_detail(detail)
+		, m_start(Tracer::IsEnabled() ? Tracer::Now() : 0)
+	{}
+
+	~TraceZone()
+	{
+		if(m_start != 0)
+			Tracer::Record(m_name, m_start, Tracer::Now(), m_detail);
+	}
+
+	TraceZone(const TraceZone&) =delete;
+	TraceZone& operator=(const TraceZone&) =delete;
+
+protected:
+	const char* m_name;
+	const char* m_detail;
+	int64_t m_start;
+};
+
+#define TRACE_CONCAT2(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+///@brief Traces the rest of the enclosing scope
+#define TRACE_ZONE(...) TraceZone TRACE_CONCAT(traceZone, __LINE__)(__VA_ARGS__)
+
+#endif
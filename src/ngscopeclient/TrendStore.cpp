@@ -0,0 +1,279 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of TrendStore
+ */
+#include "ngscopeclient.h"
+#include "TrendStore.h"
+
+using namespace std;
+
+///@brief log2 of the number of samples in each bucket of the finest level
+static const size_t TREND_FIRST_LEVEL = 4;
+
+///@brief Minimum number of buckets per pixel column, so we never lose peaks
+static const double TREND_MIN_BUCKETS_PER_PIXEL = 4;
+
+///@brief Levels with fewer buckets than this aren't worth drawing instead of the level below
+static const size_t TREND_MIN_BUCKETS = 1024;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+TrendStore::TrendStore()
+	: m_source(nullptr)
+	, m_sourceCount(0)
+	, m_firstOffset(0)
+	, m_lastOffset(0)
+	, m_lastValue(0)
+	, m_timescale(0)
+	, m_startTimestamp(0)
+	, m_startFemtoseconds(0)
+{
+}
+
+/**
+	@brief Forgets everything, so the next Update() starts from scratch
+ */
+void TrendStore::Clear()
+{
+	m_source = nullptr;
+	m_sourceCount = 0;
+	m_levels.clear();
+	m_levelWaveforms.clear();
+	m_staleBuckets.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Updating
+
+/**
+	@brief Adds any samples appended to a waveform since the last call
+
+	Cheap if nothing has changed, so it's fine to call every time the waveform is drawn.
+ */
+void TrendStore::Update(SparseAnalogWaveform* data)
+{
+	data->PrepareForCpuAccess();
+	size_t len = data->size();
+
+	//Check that everything we've already summarized is still there
+	bool append =
+		(data == m_source) &&
+		(len >= m_sourceCount) &&
+		(data->m_timescale == m_timescale) &&
+		(data->m_startTimestamp == m_startTimestamp) &&
+		(data->m_startFemtoseconds == m_startFemtoseconds);
+	if(append && (m_sourceCount > 0) )
+	{
+		append =
+			(data->m_offsets[0] == m_firstOffset) &&
+			(data->m_offsets[m_sourceCount-1] == m_lastOffset) &&
+			(data->m_samples[m_sourceCount-1] == m_lastValue);
+	}
+
+	if(!append)
+	{
+		Clear();
+		m_source = data;
+		m_timescale = data->m_timescale;
+		m_startTimestamp = data->m_startTimestamp;
+		m_startFemtoseconds = data->m_startFemtoseconds;
+	}
+
+	if(len > m_sourceCount)
+		Append(data, m_sourceCount);
+}
+
+/**
+	@brief Adds samples from the specified index to the end of the waveform to every level
+ */
+void TrendStore::Append(SparseAnalogWaveform* data, size_t first)
+{
+	size_t len = data->size();
+	if(m_levels.empty())
+		AddLevel();
+
+	for(size_t i=first; i<len; i++)
+	{
+		float v = data->m_samples[i];
+		int64_t start = data->m_offsets[i];
+		int64_t end = start + data->m_durations[i];
+
+		for(size_t level=0; level<m_levels.size(); level++)
+		{
+			auto& buckets = m_levels[level];
+			size_t b = i >> (TREND_FIRST_LEVEL + level);
+			if(b == buckets.size())
+				buckets.push_back(TrendBucket{start, end, v, v, v, 1});
+			else
+			{
+				auto& bucket = buckets.back();
+				bucket.m_end = end;
+				bucket.m_min = min(bucket.m_min, v);
+				bucket.m_max = max(bucket.m_max, v);
+				bucket.m_sum += v;
+				bucket.m_count ++;
+			}
+			m_staleBuckets[level] = min(m_staleBuckets[level], b);
+		}
+	}
+
+	m_sourceCount = len;
+	m_firstOffset = data->m_offsets[0];
+	m_lastOffset = data->m_offsets[len-1];
+	m_lastValue = data->m_samples[len-1];
+
+	//Start a coarser level once the coarsest one has enough buckets to need decimating
+	while(m_levels.back().size() >= 2*TREND_MIN_BUCKETS)
+		AddLevel();
+}
+
+/**
+	@brief Adds a level half the size of the current coarsest one, by merging pairs of its buckets
+ */
+void TrendStore::AddLevel()
+{
+	vector<TrendBucket> buckets;
+	if(!m_levels.empty())
+	{
+		auto& prev = m_levels.back();
+		buckets.reserve( (prev.size() + 1) / 2);
+		for(size_t i=0; i<prev.size(); i += 2)
+		{
+			auto bucket = prev[i];
+			if(i+1 < prev.size())
+			{
+				auto& next = prev[i+1];
+				bucket.m_end = next.m_end;
+				bucket.m_min = min(bucket.m_min, next.m_min);
+				bucket.m_max = max(bucket.m_max, next.m_max);
+				bucket.m_sum += next.m_sum;
+				bucket.m_count += next.m_count;
+			}
+			buckets.push_back(bucket);
+		}
+	}
+
+	m_levels.push_back(std::move(buckets));
+	m_staleBuckets.push_back(0);
+
+	auto wfm = make_unique<SparseAnalogWaveform>();
+	wfm->m_samples.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	wfm->m_samples.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	wfm->m_offsets.SetCpuAccessHint(AcceleratorBuffer<int64_t>::HINT_LIKELY);
+	wfm->m_offsets.SetGpuAccessHint(AcceleratorBuffer<int64_t>::HINT_LIKELY);
+	wfm->m_durations.SetCpuAccessHint(AcceleratorBuffer<int64_t>::HINT_LIKELY);
+	wfm->m_durations.SetGpuAccessHint(AcceleratorBuffer<int64_t>::HINT_LIKELY);
+	m_levelWaveforms.push_back(std::move(wfm));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rendering
+
+/**
+	@brief Picks the decimation level to draw the waveform with at the current zoom
+
+	Must be called after Update().
+
+	@param pixelsPerX	Horizontal zoom, in pixels per X axis unit
+
+	@return The level to draw, or nullptr if the raw samples are sparse enough to draw as is
+ */
+SparseAnalogWaveform* TrendStore::GetLevel(double pixelsPerX)
+{
+	if(m_levels.empty() || (m_levels[0].size() < TREND_MIN_BUCKETS) )
+		return nullptr;
+
+	//Trends are usually sampled at a fairly even rate, so the average density is close enough
+	auto& first = m_levels[0].front();
+	auto& last = m_levels[0].back();
+	double span = (last.m_end - first.m_start) * m_timescale * pixelsPerX;
+	if(span <= 0)
+		return nullptr;
+	double bucketsPerPixel = m_levels[0].size() / span;
+	if(bucketsPerPixel < TREND_MIN_BUCKETS_PER_PIXEL)
+		return nullptr;
+
+	//Each level halves the number of buckets, go as coarse as we can while keeping enough buckets per pixel
+	size_t level = 0;
+	while( (level+1 < m_levels.size()) &&
+		(m_levels[level+1].size() >= TREND_MIN_BUCKETS) &&
+		(bucketsPerPixel / 2 >= TREND_MIN_BUCKETS_PER_PIXEL) )
+	{
+		level ++;
+		bucketsPerPixel /= 2;
+	}
+
+	UpdateLevelWaveform(level);
+	return m_levelWaveforms[level].get();
+}
+
+/**
+	@brief Rewrites the part of a level's waveform which has changed since it was last drawn
+ */
+void TrendStore::UpdateLevelWaveform(size_t level)
+{
+	auto& buckets = m_levels[level];
+	auto wfm = m_levelWaveforms[level].get();
+
+	wfm->m_timescale = m_source->m_timescale;
+	wfm->m_triggerPhase = m_source->m_triggerPhase;
+	wfm->m_startTimestamp = m_source->m_startTimestamp;
+	wfm->m_startFemtoseconds = m_source->m_startFemtoseconds;
+	wfm->m_flags = m_source->m_flags;
+	wfm->m_revision = m_source->m_revision;
+
+	size_t first = m_staleBuckets[level];
+	size_t len = buckets.size();
+	if(first >= len)
+		return;
+
+	wfm->PrepareForCpuAccess();
+	wfm->Resize(2 * len);
+	for(size_t i=first; i<len; i++)
+	{
+		auto& bucket = buckets[i];
+		int64_t mid = bucket.m_start + (bucket.m_end - bucket.m_start) / 2;
+
+		wfm->m_offsets[2*i] = bucket.m_start;
+		wfm->m_durations[2*i] = mid - bucket.m_start;
+		wfm->m_samples[2*i] = bucket.m_min;
+
+		wfm->m_offsets[2*i + 1] = mid;
+		wfm->m_durations[2*i + 1] = bucket.m_end - mid;
+		wfm->m_samples[2*i + 1] = bucket.m_max;
+	}
+	wfm->MarkModifiedFromCpu();
+
+	m_staleBuckets[level] = len;
+}
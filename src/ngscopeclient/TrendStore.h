@@ -0,0 +1,135 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of TrendStore
+ */
+#ifndef TrendStore_h
+#define TrendStore_h
+
+/**
+	@brief Summary of a run of consecutive trend samples
+ */
+class TrendBucket
+{
+public:
+	///@brief Start of the first sample, in timebase units
+	int64_t m_start;
+
+	///@brief End of the last sample, in timebase units
+	int64_t m_end;
+
+	///@brief Lowest sample value
+	float m_min;
+
+	///@brief Highest sample value
+	float m_max;
+
+	///@brief Sum of all sample values
+	double m_sum;
+
+	///@brief Number of samples in the bucket
+	size_t m_count;
+
+	///@brief Gets the average of the samples in the bucket
+	float GetMean() const
+	{ return m_sum / m_count; }
+};
+
+/**
+	@brief Multi-level min/max/mean decimation of a trend waveform that only ever grows at the end
+
+	Trend filters append a few samples to the same output waveform on every update, so drawing the whole thing again
+	gets slower and slower over a long run. This keeps a set of decimated copies instead: level N has one bucket for
+	every 2^(TREND_FIRST_LEVEL + N) samples. New samples only touch the last bucket of each level, so keeping up is
+	O(levels) per sample no matter how long the trend is.
+
+	Each level can be drawn as a sparse waveform with two samples per bucket (the minimum at the start of the bucket,
+	the maximum halfway through), so narrow spikes survive decimation.
+
+	If the source waveform changes in any way other than growing at the end (new waveform, old samples dropped,
+	timebase changed), everything is rebuilt from scratch.
+ */
+class TrendStore
+{
+public:
+	TrendStore();
+
+	void Clear();
+	void Update(SparseAnalogWaveform* data);
+	SparseAnalogWaveform* GetLevel(double pixelsPerX);
+
+	///@brief Gets the number of decimation levels currently maintained
+	size_t GetLevelCount()
+	{ return m_levels.size(); }
+
+	///@brief Gets the buckets of one decimation level
+	const std::vector<TrendBucket>& GetBuckets(size_t level)
+	{ return m_levels[level]; }
+
+protected:
+	void Append(SparseAnalogWaveform* data, size_t first);
+	void AddLevel();
+	void UpdateLevelWaveform(size_t level);
+
+	///@brief The waveform being summarized
+	SparseAnalogWaveform* m_source;
+
+	///@brief Number of samples of m_source which have been added to the buckets
+	size_t m_sourceCount;
+
+	///@brief Offset of m_source's first sample, to detect samples being dropped from the start
+	int64_t m_firstOffset;
+
+	///@brief Offset of the last sample added, to detect the waveform being overwritten
+	int64_t m_lastOffset;
+
+	///@brief Value of the last sample added, to detect the waveform being overwritten
+	float m_lastValue;
+
+	///@brief Timebase of m_source when it was summarized
+	int64_t m_timescale;
+
+	///@brief Start time of m_source when it was summarized
+	time_t m_startTimestamp;
+	int64_t m_startFemtoseconds;
+
+	///@brief Buckets of each decimation level, finest first
+	std::vector<std::vector<TrendBucket> > m_levels;
+
+	///@brief Each decimation level as a drawable waveform, updated on demand
+	std::vector<std::unique_ptr<SparseAnalogWaveform> > m_levelWaveforms;
+
+	///@brief First bucket of each level which is out of date in m_levelWaveforms
+	std::vector<size_t> m_staleBuckets;
+};
+
+#endif
@@ -30,6 +30,7 @@
 #include "ngscopeclient.h"
 #include "TriggerGroup.h"
 #include "Session.h"
+#include <future>
 
 using namespace std;
 
@@ -41,6 +42,9 @@ TriggerGroup::TriggerGroup(shared_ptr<Oscilloscope> primary, Session* session)
 	, m_default(true)
 	, m_session(session)
 	, m_multiScopeFreeRun(false)
+	, m_lastDownloadDepth(0)
+	, m_lastReadyTime(0)
+	, m_lastPopTime(0)
 {
 }
 
@@ -138,6 +142,71 @@ void TriggerGroup::AddFilter(PausableFilter* f)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Triggering
 
+/**
+	@brief Runs a function on each of a set of scopes in parallel, and waits for all of them to finish
+
+	Every scope has its own transport, so talking to all of them at once costs one round trip rather than one per scope.
+	If there's only one scope, the function is run inline rather than paying for a thread.
+ */
+template<class F>
+static void ForEachScopeInParallel(const vector<shared_ptr<Oscilloscope>>& scopes, F fn)
+{
+	if(scopes.size() == 1)
+	{
+		fn(scopes[0]);
+		return;
+	}
+
+	vector<future<void>> tasks;
+	for(auto& scope : scopes)
+		tasks.push_back(async(launch::async, fn, scope));
+	for(auto& t : tasks)
+		t.get();
+}
+
+/**
+	@brief Stops a scope and throws away anything it had queued up
+ */
+static void StopAndFlush(shared_ptr<Oscilloscope> scope)
+{
+	scope->Stop();
+
+	if(scope->HasPendingWaveforms())
+	{
+		LogWarning("Scope %s had pending waveforms before arming\n", scope->m_nickname.c_str());
+		scope->ClearPendingWaveforms();
+	}
+}
+
+/**
+	@brief Starts a single trigger on a secondary scope, and blocks until it reports that it's armed
+ */
+static void ArmSecondary(shared_ptr<Oscilloscope> scope)
+{
+	LogTrace("Starting trigger for secondary scope %s\n", scope->m_nickname.c_str());
+	scope->StartSingleTrigger();
+
+	double start = GetTime();
+	while(!scope->PeekTriggerArmed())
+	{
+		//After 3 sec of no activity, time out
+		//(must be longer than the default 2 sec socket timeout)
+		double now = GetTime();
+		if( (now - start) > 3)
+		{
+			LogWarning("Timeout waiting for scope %s to arm\n",  scope->m_nickname.c_str());
+			scope->Stop();
+			scope->StartSingleTrigger();
+			start = now;
+		}
+	}
+	LogTrace("Secondary %s is armed\n", scope->m_nickname.c_str());
+
+	//Scope is armed. Clear any garbage in the pending queue
+	//TODO: this should now be redundant, but verify?
+	scope->ClearPendingWaveforms();
+}
+
 /**
 	@brief Arm the trigger for the group
  */
@@ -154,62 +223,20 @@ void TriggerGroup::Arm(TriggerType type)
 	//In multi-scope mode, make sure all scopes are stopped with no pending waveforms
 	if(!m_secondaries.empty())
 	{
-		lock_guard<shared_mutex> lock(m_session->GetWaveformDataMutex());
-
-		for(auto scope : m_secondaries)
-		{
-			scope->Stop();
-
-			if(scope->HasPendingWaveforms())
-			{
-				LogWarning("Scope %s had pending waveforms before arming\n", scope->m_nickname.c_str());
-				scope->ClearPendingWaveforms();
-			}
-		}
-
-		m_primary->Stop();
+		lock_guard wlock(m_session->GetWaveformWriterMutex());
+		lock_guard lock(m_session->GetWaveformDataMutex());
 
-		if(m_primary->HasPendingWaveforms())
-		{
-			LogWarning("Scope %s had pending waveforms before arming\n", m_primary->m_nickname.c_str());
-			m_primary->ClearPendingWaveforms();
-		}
+		auto scopes = m_secondaries;
+		scopes.push_back(m_primary);
+		ForEachScopeInParallel(scopes, StopAndFlush);
 	}
 
 	//We're in multiscope normal mode if we're doing a non-oneshot trigger and have secondaries
 	m_multiScopeFreeRun = !oneshot && !m_secondaries.empty();
 
-	//Start secondaries (always in single shot mode)
-	for(auto scope : m_secondaries)
-	{
-		LogTrace("Starting trigger for secondary scope %s\n", scope->m_nickname.c_str());
-		scope->StartSingleTrigger();
-	}
-
-	//Verify all secondaries are armed
-	for(auto scope : m_secondaries)
-	{
-		double start = GetTime();
-
-		while(!scope->PeekTriggerArmed())
-		{
-			//After 3 sec of no activity, time out
-			//(must be longer than the default 2 sec socket timeout)
-			double now = GetTime();
-			if( (now - start) > 3)
-			{
-				LogWarning("Timeout waiting for scope %s to arm\n",  scope->m_nickname.c_str());
-				scope->Stop();
-				scope->StartSingleTrigger();
-				start = now;
-			}
-		}
-		LogTrace("Secondary is armed\n");
-
-		//Scope is armed. Clear any garbage in the pending queue
-		//TODO: this should now be redundant, but verify?
-		scope->ClearPendingWaveforms();
-	}
+	//Start secondaries (always in single shot mode) and wait until they're all armed
+	if(!m_secondaries.empty())
+		ForEachScopeInParallel(m_secondaries, ArmSecondary);
 
 	//Start the primary normally
 	//But if we have secondaries, do a single trigger so it doesn't re-arm before we've set up the secondaries
@@ -298,14 +325,29 @@ bool TriggerGroup::CheckForPendingWaveforms()
 	if(!m_primary)
 		return false;
 
-	//Make sure we have pending waveforms on everything
-	if(!m_primary->HasPendingWaveforms())
-		return false;
+	//Make sure we have pending waveforms on everything.
+	//Check every scope rather than stopping at the first one that isn't ready, so we know when each one came in.
+	double now = GetTime();
+	bool ready = true;
+	if(m_primary->HasPendingWaveforms())
+	{
+		if(m_readyTime.find(m_primary) == m_readyTime.end())
+			m_readyTime[m_primary] = now;
+	}
+	else
+		ready = false;
 	for(auto scope : m_secondaries)
 	{
-		if(!scope->HasPendingWaveforms())
-			return false;
+		if(scope->HasPendingWaveforms())
+		{
+			if(m_readyTime.find(scope) == m_readyTime.end())
+				m_readyTime[scope] = now;
+		}
+		else
+			ready = false;
 	}
+	if(!ready)
+		return false;
 
 	/*
 	//Keep track of when the primary instrument triggers.
@@ -353,15 +395,24 @@ bool TriggerGroup::CheckForPendingWaveforms()
  */
 void TriggerGroup::DownloadWaveforms()
 {
+	//Remember when the trigger was seen, for latency measurement
+	auto rit = m_readyTime.find(m_primary);
+	m_lastReadyTime = (rit != m_readyTime.end()) ? rit->second : GetTime();
+
 	//Grab the data from the primary
 	if(!m_primary->IsAppendingToWaveform())
 		DetachAllWaveforms(m_primary);
 	m_primary->PopPendingWaveform();
+	m_lastDownloadDepth = GetLoadedDepth(m_primary);
 
 	//All good if we're a single-scope trigger group.
 	//If not, we have more work to do
 	if(m_secondaries.empty())
+	{
+		m_readyTime.clear();
+		m_lastPopTime = GetTime();
 		return;
+	}
 
 	LogTrace("Multi scope: patching timestamps\n");
 
@@ -389,30 +440,99 @@ void TriggerGroup::DownloadWaveforms()
 			break;
 	}
 
-	//Grab the data from secondaries and retcon the timestamps so they match the primary's trigger
+	//Look up deskew values up front, the session's table isn't safe to touch from several threads at once
+	size_t nsec = m_secondaries.size();
+	vector<int64_t> deskew(nsec);
+	for(size_t i=0; i<nsec; i++)
+		deskew[i] = m_session->GetDeskew(m_secondaries[i]);
+
+	//Grab the data from secondaries and retcon the timestamps so they match the primary's trigger.
+	//Each scope is independent, so do them in parallel and the group only waits for the slowest one.
+	#pragma omp parallel for
+	for(size_t i=0; i<nsec; i++)
+		PatchSecondary(m_secondaries[i], timeSec, timeFs, deskew[i]);
 	for(auto scope : m_secondaries)
+		m_lastDownloadDepth = max(m_lastDownloadDepth, GetLoadedDepth(scope));
+
+	//Figure out how far behind the primary each secondary was
 	{
-		if(!scope->IsAppendingToWaveform())
-			DetachAllWaveforms(scope);
-		scope->PopPendingWaveform();
+		lock_guard<mutex> lock(m_lagMutex);
+		m_lag.clear();
+		auto pit = m_readyTime.find(m_primary);
+		for(auto scope : m_secondaries)
+		{
+			auto sit = m_readyTime.find(scope);
+			if( (pit != m_readyTime.end()) && (sit != m_readyTime.end()) )
+				m_lag[scope] = sit->second - pit->second;
+		}
+	}
+	m_readyTime.clear();
+	m_lastPopTime = GetTime();
+}
+
+/**
+	@brief Pops the pending waveform from a secondary and aligns its timestamps with the primary's trigger
 
-		for(size_t j=0; j<scope->GetChannelCount(); j++)
+	Only touches state belonging to the one scope, so it's safe to call for several secondaries in parallel.
+ */
+void TriggerGroup::PatchSecondary(shared_ptr<Oscilloscope> scope, time_t timeSec, int64_t timeFs, int64_t deskew)
+{
+	if(!scope->IsAppendingToWaveform())
+		DetachAllWaveforms(scope);
+	scope->PopPendingWaveform();
+
+	for(size_t j=0; j<scope->GetChannelCount(); j++)
+	{
+		auto chan = scope->GetOscilloscopeChannel(j);
+		if(!chan)
+			continue;
+		for(size_t k=0; k<chan->GetStreamCount(); k++)
 		{
-			auto chan = scope->GetOscilloscopeChannel(j);
-			if(!chan)
+			auto data = chan->GetData(k);
+			if(data == nullptr)
 				continue;
-			for(size_t k=0; k<chan->GetStreamCount(); k++)
-			{
-				auto data = chan->GetData(k);
-				if(data == nullptr)
-					continue;
 
-				data->m_startTimestamp = timeSec;
-				data->m_startFemtoseconds = timeFs;
-				data->m_triggerPhase -= m_session->GetDeskew(scope);
-			}
+			data->m_startTimestamp = timeSec;
+			data->m_startFemtoseconds = timeFs;
+			data->m_triggerPhase -= deskew;
+		}
+	}
+}
+
+/**
+	@brief Gets how long after the primary a secondary had its waveform ready, for the most recent acquisition
+
+	@return Lag in seconds, or zero if the scope isn't a secondary or no acquisitions have been made
+ */
+double TriggerGroup::GetLag(shared_ptr<Oscilloscope> scope)
+{
+	lock_guard<mutex> lock(m_lagMutex);
+	auto it = m_lag.find(scope);
+	if(it == m_lag.end())
+		return 0;
+	return it->second;
+}
+
+/**
+	@brief Gets the number of samples in the deepest waveform currently loaded on any channel of a scope
+ */
+size_t TriggerGroup::GetLoadedDepth(shared_ptr<Oscilloscope> scope)
+{
+	size_t depth = 0;
+	for(size_t i=0; i<scope->GetChannelCount(); i++)
+	{
+		auto chan = scope->GetOscilloscopeChannel(i);
+		if(!chan)
+			continue;
+
+		for(size_t j=0; j<chan->GetStreamCount(); j++)
+		{
+			auto data = chan->GetData(j);
+			if(data)
+				depth = max(depth, data->size());
 		}
 	}
+	return depth;
 }
 
 void TriggerGroup::DetachAllWaveforms(shared_ptr<Oscilloscope> scope)
@@ -94,16 +94,50 @@ public:
 
 	std::string GetDescription();
 
+	double GetLag(std::shared_ptr<Oscilloscope> scope);
+
+	///@brief Gets the number of samples in the deepest waveform fetched by the last DownloadWaveforms() call
+	size_t GetLastDownloadDepth()
+	{ return m_lastDownloadDepth; }
+
+	///@brief Gets the time (from GetTime()) the primary was first seen triggered, for the last DownloadWaveforms() call
+	double GetLastReadyTime()
+	{ return m_lastReadyTime; }
+
+	///@brief Gets the time (from GetTime()) the last DownloadWaveforms() call finished popping waveforms
+	double GetLastPopTime()
+	{ return m_lastPopTime; }
+
 	///@brief True if we should be activated when the start/stop toolbar button is clicked
 	bool m_default;
 
 protected:
 	void DetachAllWaveforms(std::shared_ptr<Oscilloscope> scope);
+	static size_t GetLoadedDepth(std::shared_ptr<Oscilloscope> scope);
+	void PatchSecondary(std::shared_ptr<Oscilloscope> scope, time_t timeSec, int64_t timeFs, int64_t deskew);
 
 	Session* m_session;
 
+	///@brief Time (from GetTime()) at which each scope was first seen with a pending waveform this acquisition
+	std::map<std::shared_ptr<Oscilloscope>, double> m_readyTime;
+
+	///@brief Mutex protecting m_lag
+	std::mutex m_lagMutex;
+
+	///@brief How long after the primary each secondary had its waveform ready, in seconds, for the last acquisition
+	std::map<std::shared_ptr<Oscilloscope>, double> m_lag;
+
 	///@brief True if we have multiple scopes and are in normal trigger mode
 	bool m_multiScopeFreeRun;
+
+	///@brief Number of samples in the deepest waveform fetched by the last DownloadWaveforms() call
+	size_t m_lastDownloadDepth;
+
+	///@brief Time the primary was first seen with a pending waveform, for the last DownloadWaveforms() call
+	double m_lastReadyTime;
+
+	///@brief Time the last DownloadWaveforms() call finished
+	double m_lastPopTime;
 };
 
 #endif
@@ -49,7 +49,7 @@ TriggerPropertiesPage::TriggerPropertiesPage(shared_ptr<Oscilloscope> scope)
 	: m_scope(scope)
 	, m_committedLevel(0)
 	, m_cdrLockState(false)
-	, m_tLastCdrPoll(0)
+	, m_liveCdrLock(false, 1)
 {
 	auto trig = m_scope->GetTrigger();
 	if(!trig)
@@ -61,7 +61,8 @@ TriggerPropertiesPage::TriggerPropertiesPage(shared_ptr<Oscilloscope> scope)
 	m_triggerLevel = volts.PrettyPrint(m_committedLevel);
 
 	Unit fs(Unit::UNIT_FS);
-	m_committedTriggerOffset = scope->GetTriggerOffset();
+	m_liveTriggerOffset.Set(scope->GetTriggerOffset());
+	m_committedTriggerOffset = m_liveTriggerOffset.Get();
 	m_triggerOffset = fs.PrettyPrint(m_committedTriggerOffset);
 }
 
@@ -102,9 +103,11 @@ void TriggerPropertiesPage::Render(bool graphEditorMode)
 	{
 		if(StartSection("Position", graphEditorMode))
 		{
-			//Check if trigger offset changed outside the dialog
+			//Check if trigger offset changed outside the dialog (without blocking on the instrument to find out)
 			Unit fs(Unit::UNIT_FS);
-			float off = m_scope->GetTriggerOffset();
+			auto scope = m_scope;
+			m_liveTriggerOffset.Refresh(scope.get(), [scope]() { return scope->GetTriggerOffset(); });
+			float off = m_liveTriggerOffset.Get();
 			if(m_committedTriggerOffset != off)
 			{
 				m_committedTriggerOffset = off;
@@ -118,7 +121,8 @@ void TriggerPropertiesPage::Render(bool graphEditorMode)
 				m_committedTriggerOffset,
 				fs))
 			{
-				m_scope->SetTriggerOffset(off);
+				m_scope->SetTriggerOffset(m_committedTriggerOffset);
+				m_liveTriggerOffset.Set(m_committedTriggerOffset);
 			}
 
 			Dialog::HelpMarker(
@@ -216,14 +220,15 @@ void TriggerPropertiesPage::Render(bool graphEditorMode)
 					}
 				}
 
-				//Show lock status, but limit polling rate to 1 Hz
-				double now = GetTime();
-				bool locked = m_cdrLockState;
-				if( (now - m_tLastCdrPoll) > 1)
+				//Show lock status, but limit polling rate to 1 Hz.
+				//Look the trigger up again when the read runs, in case it was replaced while the read was queued.
+				auto scope = m_scope;
+				m_liveCdrLock.Refresh(scope.get(), [scope]()
 				{
-					locked = cdrtrig->IsCDRLocked();
-					m_tLastCdrPoll = now;
-				}
+					auto t = dynamic_cast<CDRTrigger*>(scope->GetTrigger());
+					return t ? t->IsCDRLocked() : false;
+				});
+				bool locked = m_liveCdrLock.Get();
 
 				ImGui::BeginDisabled();
 				ImGui::Checkbox("PLL Lock", &locked);
@@ -59,10 +59,15 @@ protected:
 	float m_committedTriggerOffset = 0;
 	std::string m_triggerOffset;
 
+	///@brief Trigger offset as last read from the instrument
+	AsyncProperty<int64_t> m_liveTriggerOffset;
+
 	std::map<std::string, std::string> m_paramTempValues;
 
 	bool m_cdrLockState;
-	double m_tLastCdrPoll;
+
+	///@brief CDR lock status as last read from the instrument (polled at 1 Hz)
+	AsyncProperty<bool> m_liveCdrLock;
 };
 
 class TriggerPropertiesDialog : public Dialog
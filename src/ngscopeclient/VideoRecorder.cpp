@@ -0,0 +1,207 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of VideoRecorder
+ */
+
+#include "ngscopeclient.h"
+#include "VideoRecorder.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb"
+#else
+#define PIPE_WRITE_MODE "w"
+#include <csignal>
+#endif
+
+using namespace std;
+
+///@brief Most times a late frame is repeated, so a long stall doesn't turn into a burst of writes
+static const size_t VIDEO_MAX_REPEATS = 600;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts the encoder
+
+	@param command	Encoder command line, with placeholders (see class description)
+	@param path		Output file
+	@param width	Frame width, in pixels
+	@param height	Frame height, in pixels
+	@param bgra		True if pixels are B8G8R8A8, false if R8G8B8A8
+	@param fps		Output frame rate
+ */
+VideoRecorder::VideoRecorder(
+	const string& command,
+	const string& path,
+	size_t width,
+	size_t height,
+	bool bgra,
+	int fps)
+	: m_pipe(nullptr)
+	, m_width(width)
+	, m_height(height)
+	, m_fps(max(1, fps))
+	, m_terminating(false)
+	, m_framesWritten(0)
+	, m_framesSkipped(0)
+{
+	string cmd = command;
+	vector<pair<string, string>> substitutions =
+	{
+		{ "{width}", to_string(width) },
+		{ "{height}", to_string(height) },
+		{ "{fps}", to_string(m_fps) },
+		{ "{pixfmt}", bgra ? "bgra" : "rgba" },
+		{ "{file}", path }
+	};
+	for(auto& s : substitutions)
+	{
+		size_t pos;
+		while( (pos = cmd.find(s.first)) != string::npos)
+			cmd.replace(pos, s.first.length(), s.second);
+	}
+
+	//If the encoder dies, we want fwrite() to fail rather than SIGPIPE taking the whole application down
+	#ifndef _WIN32
+		signal(SIGPIPE, SIG_IGN);
+	#endif
+
+	LogTrace("Starting video encoder: %s\n", cmd.c_str());
+	m_pipe = popen(cmd.c_str(), PIPE_WRITE_MODE);
+	if(!m_pipe)
+	{
+		LogError("Couldn't start video encoder \"%s\"\n", cmd.c_str());
+		return;
+	}
+
+	m_thread = thread(&VideoRecorder::WorkerThread, this);
+}
+
+/**
+	@brief Encodes any frames still queued, then waits for the encoder to finish the file
+ */
+VideoRecorder::~VideoRecorder()
+{
+	if(!m_pipe)
+		return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_terminating = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+
+	int ret = pclose(m_pipe);
+	if(ret != 0)
+		LogWarning("Video encoder exited with status %d\n", ret);
+	LogTrace("Video capture finished: %zu frames written, %zu skipped\n",
+		m_framesWritten.load(), m_framesSkipped.load());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Frame handling
+
+/**
+	@brief Queues a frame for encoding
+
+	@param pixels		Frame contents, tightly packed. Must stay valid until *busy is cleared.
+	@param timestamp	Time the frame was rendered, from GetTime()
+	@param busy			Set now, and cleared by the worker thread once it's done with pixels
+ */
+void VideoRecorder::Submit(const uint8_t* pixels, double timestamp, atomic<bool>* busy)
+{
+	*busy = true;
+	if(!m_pipe)
+	{
+		*busy = false;
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_frames.push_back({pixels, timestamp, busy});
+	}
+	m_wake.notify_one();
+}
+
+void VideoRecorder::WorkerThread()
+{
+	pthread_setname_np_compat("VideoRecorder");
+
+	size_t frameSize = m_width * m_height * 4;
+	double tstart = -1;
+	size_t position = 0;
+	bool failed = false;
+	while(true)
+	{
+		Frame frame;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]{ return !m_frames.empty() || m_terminating; });
+			if(m_frames.empty())
+				break;
+			frame = m_frames.front();
+			m_frames.pop_front();
+		}
+
+		//Figure out which output frame this one lands on, and fill up to it
+		if(tstart < 0)
+			tstart = frame.m_timestamp;
+		size_t target = static_cast<size_t>( (frame.m_timestamp - tstart) * m_fps) + 1;
+		if(target <= position)
+			m_framesSkipped ++;
+		else if(!failed)
+		{
+			size_t count = min(target - position, VIDEO_MAX_REPEATS);
+			for(size_t i=0; i<count; i++)
+			{
+				if(fwrite(frame.m_pixels, 1, frameSize, m_pipe) != frameSize)
+				{
+					LogError("Video encoder stopped accepting frames\n");
+					failed = true;
+					break;
+				}
+				m_framesWritten ++;
+			}
+
+			//If we hit the repeat limit the gap comes out shorter than it was, but we stay in step with real time
+			position = target;
+		}
+
+		*frame.m_busy = false;
+	}
+}
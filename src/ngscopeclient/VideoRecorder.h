@@ -0,0 +1,128 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of VideoRecorder
+ */
+#ifndef VideoRecorder_h
+#define VideoRecorder_h
+
+#include <condition_variable>
+
+/**
+	@brief Feeds captured window images to an external video encoder on a worker thread
+
+	Frames are raw 32-bit pixels, handed over by pointer into a staging buffer the caller owns. The worker writes them
+	down a pipe to the encoder command and then clears the frame's busy flag, so the caller knows it can reuse the
+	buffer. The caller is expected to skip capturing a frame rather than wait if every buffer is busy.
+
+	The encoder is fed a constant frame rate: frames arriving faster than that are dropped, and if frames arrive late
+	(e.g. nothing changed on screen so the GUI idled) the last one is repeated, so the recording plays back in real
+	time.
+
+	The command may contain {width}, {height}, {fps}, {pixfmt} (bgra or rgba, in ffmpeg naming) and {file}, which are
+	replaced before it's run.
+ */
+class VideoRecorder
+{
+public:
+	VideoRecorder(
+		const std::string& command,
+		const std::string& path,
+		size_t width,
+		size_t height,
+		bool bgra,
+		int fps);
+	~VideoRecorder();
+
+	///@brief Check if the encoder was started successfully
+	bool IsOK()
+	{ return m_pipe != nullptr; }
+
+	size_t GetWidth()
+	{ return m_width; }
+
+	size_t GetHeight()
+	{ return m_height; }
+
+	void Submit(const uint8_t* pixels, double timestamp, std::atomic<bool>* busy);
+
+	///@brief Number of frames written to the encoder (including repeats)
+	size_t GetFramesWritten()
+	{ return m_framesWritten; }
+
+	///@brief Number of captured frames which weren't needed at the output frame rate
+	size_t GetFramesSkipped()
+	{ return m_framesSkipped; }
+
+protected:
+	void WorkerThread();
+
+	///@brief A captured frame
+	class Frame
+	{
+	public:
+		const uint8_t* m_pixels;
+		double m_timestamp;
+		std::atomic<bool>* m_busy;
+	};
+
+	///@brief Pipe to the encoder process
+	FILE* m_pipe;
+
+	///@brief Frame size, in pixels
+	size_t m_width;
+
+	///@brief Frame size, in pixels
+	size_t m_height;
+
+	///@brief Output frame rate
+	int m_fps;
+
+	///@brief Guards m_frames and m_terminating
+	std::mutex m_mutex;
+
+	///@brief Signalled when a frame is queued or we're shutting down
+	std::condition_variable m_wake;
+
+	///@brief Frames waiting to be encoded, oldest first
+	std::deque<Frame> m_frames;
+
+	///@brief Set to stop the worker thread once m_frames is drained
+	bool m_terminating;
+
+	std::atomic<size_t> m_framesWritten;
+	std::atomic<size_t> m_framesSkipped;
+
+	std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,429 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ViewerServer
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "ViewerServer.h"
+#include "HistoryManager.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+using namespace std;
+
+///@brief Largest number of columns a viewer may ask for
+#define VIEWER_MAX_COLUMNS 65536
+
+/**
+	@brief Random access to the sample times and values of an analog or digital waveform, uniform or sparse
+ */
+class ViewerSampleReader
+{
+public:
+	ViewerSampleReader()
+	: m_offsets(nullptr)
+	, m_durations(nullptr)
+	, m_analog(nullptr)
+	, m_digital(nullptr)
+	, m_count(0)
+	, m_timescale(0)
+	, m_triggerPhase(0)
+	{}
+
+	/**
+		@brief Sets up the reader for a waveform
+
+		@return False if the waveform isn't a type we can serve
+	 */
+	bool Init(WaveformBase* wfm)
+	{
+		m_timescale = wfm->m_timescale;
+		m_triggerPhase = wfm->m_triggerPhase;
+
+		auto sparse = dynamic_cast<SparseWaveformBase*>(wfm);
+		if(sparse)
+		{
+			m_offsets = sparse->m_offsets.GetCpuPointer();
+			m_durations = sparse->m_durations.GetCpuPointer();
+		}
+
+		if(auto ua = dynamic_cast<UniformAnalogWaveform*>(wfm))
+			m_analog = ua->m_samples.GetCpuPointer();
+		else if(auto sa = dynamic_cast<SparseAnalogWaveform*>(wfm))
+			m_analog = sa->m_samples.GetCpuPointer();
+		else if(auto ud = dynamic_cast<UniformDigitalWaveform*>(wfm))
+			m_digital = ud->m_samples.GetCpuPointer();
+		else if(auto sd = dynamic_cast<SparseDigitalWaveform*>(wfm))
+			m_digital = sd->m_samples.GetCpuPointer();
+		else
+			return false;
+
+		m_count = wfm->size();
+		return true;
+	}
+
+	///@brief Gets the start time of a sample, in fs from the trigger
+	int64_t GetTime(size_t i)
+	{ return (m_offsets ? m_offsets[i] : (int64_t)i) * m_timescale + m_triggerPhase; }
+
+	///@brief Gets the end time of a sample, in fs from the trigger
+	int64_t GetEnd(size_t i)
+	{ return GetTime(i) + (m_durations ? m_durations[i] : 1) * m_timescale; }
+
+	///@brief Gets the value of a sample
+	float GetValue(size_t i)
+	{
+		if(m_analog)
+			return m_analog[i];
+		return m_digital[i] ? 1 : 0;
+	}
+
+	///@brief Gets the index of the first sample starting at or after a time
+	size_t LowerBound(int64_t t)
+	{
+		size_t lo = 0;
+		size_t hi = m_count;
+		while(lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if(GetTime(mid) < t)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	const int64_t* m_offsets;
+	const int64_t* m_durations;
+	const float* m_analog;
+	const bool* m_digital;
+	size_t m_count;
+	int64_t m_timescale;
+	int64_t m_triggerPhase;
+};
+
+/**
+	@brief Shuts down a socket, waking up anything blocked on it
+ */
+static void ShutdownSocket(ZSOCKET fd)
+{
+	#ifdef _WIN32
+		shutdown(fd, SD_BOTH);
+	#else
+		shutdown(fd, SHUT_RDWR);
+	#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts listening for remote viewers
+
+	@param port	TCP port to listen on
+ */
+ViewerServer::ViewerServer(uint16_t port)
+	: m_port(port)
+	, m_listener(AF_INET6, SOCK_STREAM, IPPROTO_TCP)
+	, m_clientCount(0)
+	, m_shuttingDown(false)
+{
+	if(!m_listener.Bind(port) || !m_listener.Listen())
+	{
+		LogError("Remote viewer server failed to listen on port %u\n", port);
+		return;
+	}
+
+	LogNotice("Remote viewer server listening on port %u\n", port);
+	m_listenThread = make_unique<thread>(&ViewerServer::ListenThreadProc, this);
+}
+
+/**
+	@brief Disconnects all viewers and stops listening
+
+	Must be called from the GUI thread, since it may release the last reference to a history point.
+ */
+ViewerServer::~ViewerServer()
+{
+	m_shuttingDown = true;
+
+	//Stop accepting new connections
+	ShutdownSocket((ZSOCKET)m_listener);
+	if(m_listenThread)
+		m_listenThread->join();
+	m_listener.Close();
+
+	//Then kick off everyone who's already connected
+	{
+		lock_guard<mutex> lock(m_clientMutex);
+		for(auto fd : m_clientSockets)
+			ShutdownSocket(fd);
+	}
+	for(auto& t : m_clientThreads)
+		t.join();
+
+	ReleasePoint();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GUI thread interface
+
+/**
+	@brief Makes a new acquisition available to viewers
+
+	Must be called from the GUI thread with the waveform data mutex held. If a viewer is busy reading the previous
+	acquisition, this one is skipped.
+ */
+void ViewerServer::OnNewPoint(shared_ptr<HistoryPoint> pt)
+{
+	unique_lock<shared_mutex> lock(m_pointMutex, try_to_lock);
+	if(!lock.owns_lock())
+		return;
+
+	ReleasePoint();
+
+	//Hold onto the point so it isn't evicted or moved between memory tiers while viewers read it
+	m_point = pt;
+	pt->m_readerRefs ++;
+
+	for(auto& it : pt->m_history)
+	{
+		for(auto& jt : it.second)
+		{
+			auto wfm = jt.second;
+			ViewerSampleReader reader;
+			if(!wfm || !reader.Init(wfm))
+				continue;
+
+			//Buffer transfers use the GPU queues which belong to this thread, so get everything to the CPU now
+			wfm->PrepareForCpuAccess();
+			m_streams.push_back(jt.first);
+			m_waveforms.push_back(wfm);
+		}
+	}
+}
+
+/**
+	@brief Lets go of the current point (must hold m_pointMutex exclusively, or be shutting down)
+ */
+void ViewerServer::ReleasePoint()
+{
+	if(m_point)
+		m_point->ReleaseReader();
+	m_point = nullptr;
+	m_streams.clear();
+	m_waveforms.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Network threads
+
+/**
+	@brief Thread function accepting new viewer connections
+ */
+void ViewerServer::ListenThreadProc()
+{
+	pthread_setname_np_compat("ViewerListen");
+
+	while(!m_shuttingDown)
+	{
+		Socket client = m_listener.Accept();
+		if(!client.IsValid() || m_shuttingDown)
+			break;
+		if(!client.DisableNagle())
+			LogWarning("Failed to disable Nagle on remote viewer socket\n");
+
+		LogNotice("Remote viewer connected\n");
+
+		auto fd = client.Detach();
+		{
+			lock_guard<mutex> lock(m_clientMutex);
+			m_clientSockets.emplace(fd);
+		}
+		m_clientThreads.push_back(thread(&ViewerServer::ClientThreadProc, this, fd));
+	}
+}
+
+/**
+	@brief Thread function serving requests from one viewer until it disconnects
+ */
+void ViewerServer::ClientThreadProc(ZSOCKET fd)
+{
+	pthread_setname_np_compat("ViewerClient");
+	m_clientCount ++;
+
+	{
+		Socket sock(fd, AF_INET6);
+		while(!m_shuttingDown)
+		{
+			ViewerRequestHeader hdr;
+			if(!sock.RecvLooped((uint8_t*)&hdr, sizeof(hdr)))
+				break;
+
+			bool ok = false;
+			if(hdr.m_type == VIEWER_REQ_FRAME)
+			{
+				ViewerFrameRequest req;
+				ok = sock.RecvLooped((uint8_t*)&req, sizeof(req)) && SendFrame(sock, req);
+			}
+			else if(hdr.m_type == VIEWER_REQ_SAMPLES)
+			{
+				ViewerSamplesRequest req;
+				ok = sock.RecvLooped((uint8_t*)&req, sizeof(req)) && SendSamples(sock, req);
+			}
+			else
+				LogWarning("Unknown remote viewer request type %u, disconnecting\n", hdr.m_type);
+
+			if(!ok)
+				break;
+		}
+
+		//Once we're out of the list nobody else will touch the socket, so it's safe to close
+		lock_guard<mutex> lock(m_clientMutex);
+		m_clientSockets.erase(fd);
+	}
+
+	m_clientCount --;
+	LogNotice("Remote viewer disconnected\n");
+}
+
+/**
+	@brief Sends the newest acquisition to a viewer, decimated to min/max columns
+ */
+bool ViewerServer::SendFrame(Socket& sock, const ViewerFrameRequest& req)
+{
+	shared_lock<shared_mutex> lock(m_pointMutex);
+
+	ViewerFrameHeader fhdr;
+	memcpy(fhdr.m_magic, "NGSVIEW1", sizeof(fhdr.m_magic));
+	fhdr.m_timestamp = m_point ? m_point->m_time.first : 0;
+	fhdr.m_femtoseconds = m_point ? m_point->m_time.second : 0;
+	fhdr.m_streamCount = m_streams.size();
+
+	//Don't send the same acquisition twice
+	if( (fhdr.m_timestamp == req.m_lastTimestamp) && (fhdr.m_femtoseconds == req.m_lastFemtoseconds) )
+		fhdr.m_streamCount = 0;
+	if(!sock.SendLooped((uint8_t*)&fhdr, sizeof(fhdr)))
+		return false;
+
+	uint32_t columns = min(max(req.m_columns, (uint32_t)1), (uint32_t)VIEWER_MAX_COLUMNS);
+	vector<float> minmax(columns * 2);
+	for(size_t i=0; i<fhdr.m_streamCount; i++)
+	{
+		auto& stream = m_streams[i];
+		ViewerSampleReader reader;
+		reader.Init(m_waveforms[i]);
+
+		ViewerStreamHeader shdr;
+		memset(&shdr, 0, sizeof(shdr));
+		strncpy(shdr.m_name, stream.GetName().c_str(), sizeof(shdr.m_name) - 1);
+		shdr.m_unit = stream.GetYAxisUnits().GetType();
+		shdr.m_sampleCount = reader.m_count;
+		shdr.m_columns = columns;
+		if(reader.m_count)
+		{
+			shdr.m_start = reader.GetTime(0);
+			shdr.m_end = reader.GetEnd(reader.m_count - 1);
+		}
+
+		//Min and max of every sample starting in each column
+		float nan = numeric_limits<float>::quiet_NaN();
+		fill(minmax.begin(), minmax.end(), nan);
+		double colsPerFs = (double)columns / max((int64_t)1, shdr.m_end - shdr.m_start);
+		for(size_t j=0; j<reader.m_count; j++)
+		{
+			size_t col = min((size_t)((reader.GetTime(j) - shdr.m_start) * colsPerFs), (size_t)columns - 1);
+			float v = reader.GetValue(j);
+			float& vmin = minmax[col*2];
+			float& vmax = minmax[col*2 + 1];
+			if(isnan(vmin))
+			{
+				vmin = v;
+				vmax = v;
+			}
+			else
+			{
+				vmin = min(vmin, v);
+				vmax = max(vmax, v);
+			}
+		}
+
+		if(!sock.SendLooped((uint8_t*)&shdr, sizeof(shdr)))
+			return false;
+		if(!sock.SendLooped((uint8_t*)&minmax[0], minmax.size() * sizeof(float)))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+	@brief Sends full resolution samples for part of one stream of the newest acquisition
+ */
+bool ViewerServer::SendSamples(Socket& sock, const ViewerSamplesRequest& req)
+{
+	shared_lock<shared_mutex> lock(m_pointMutex);
+
+	vector<ViewerSample> samples;
+	if( (req.m_stream < m_waveforms.size()) && (req.m_maxSamples > 0) )
+	{
+		ViewerSampleReader reader;
+		reader.Init(m_waveforms[req.m_stream]);
+
+		//Find the range, and skip samples if there are more than the viewer wants
+		size_t first = reader.LowerBound(req.m_start);
+		size_t last = reader.LowerBound(req.m_end + 1);
+		size_t count = (last > first) ? (last - first) : 0;
+		size_t step = max((size_t)1, (count + req.m_maxSamples - 1) / req.m_maxSamples);
+
+		samples.reserve(count / step + 1);
+		for(size_t i=first; i<last; i += step)
+		{
+			ViewerSample s;
+			s.m_time = reader.GetTime(i);
+			s.m_value = reader.GetValue(i);
+			samples.push_back(s);
+		}
+	}
+
+	ViewerSamplesHeader hdr;
+	hdr.m_count = samples.size();
+	if(!sock.SendLooped((uint8_t*)&hdr, sizeof(hdr)))
+		return false;
+	if(samples.empty())
+		return true;
+	return sock.SendLooped((uint8_t*)&samples[0], samples.size() * sizeof(ViewerSample));
+}
@@ -0,0 +1,243 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ViewerServer
+ */
+#ifndef ViewerServer_h
+#define ViewerServer_h
+
+#include "../xptools/Socket.h"
+
+class HistoryPoint;
+
+/**
+	@brief Types of request a remote viewer can send
+
+	Every request starts with a ViewerRequestHeader and gets exactly one reply, so the viewer is in charge of pacing.
+	All fields are little endian.
+ */
+enum ViewerRequestType
+{
+	/**
+		@brief Get a decimated copy of the newest acquisition
+
+		Followed by a ViewerFrameRequest. Replied to with a ViewerFrameHeader, followed by a ViewerStreamHeader and
+		m_columns pairs of (min, max) floats for each stream. If the newest acquisition is the one the viewer already
+		has, the reply has no streams.
+	 */
+	VIEWER_REQ_FRAME = 1,
+
+	/**
+		@brief Get full resolution samples for part of one stream of the newest acquisition
+
+		Followed by a ViewerSamplesRequest. Replied to with a ViewerSamplesHeader, followed by m_count ViewerSamples.
+	 */
+	VIEWER_REQ_SAMPLES = 2
+};
+
+#pragma pack(push, 1)
+
+///@brief Start of every request from a remote viewer
+class ViewerRequestHeader
+{
+public:
+	///@brief Type of the request (a ViewerRequestType)
+	uint32_t m_type;
+};
+
+///@brief Body of a VIEWER_REQ_FRAME request
+class ViewerFrameRequest
+{
+public:
+	///@brief Number of columns to decimate each stream to (typically the width of the plot, in pixels)
+	uint32_t m_columns;
+
+	///@brief Timestamp of the acquisition the viewer already has (zero if none)
+	int64_t m_lastTimestamp;
+	int64_t m_lastFemtoseconds;
+};
+
+///@brief Body of a VIEWER_REQ_SAMPLES request
+class ViewerSamplesRequest
+{
+public:
+	///@brief Index of the stream, in the order they were sent in the last frame
+	uint32_t m_stream;
+
+	///@brief Start of the range to fetch, in fs from the trigger
+	int64_t m_start;
+
+	///@brief End of the range to fetch, in fs from the trigger
+	int64_t m_end;
+
+	///@brief Maximum number of samples to send (the range is decimated by skipping samples if it has more)
+	uint32_t m_maxSamples;
+};
+
+///@brief Reply to a VIEWER_REQ_FRAME request
+class ViewerFrameHeader
+{
+public:
+	///@brief Always "NGSVIEW1"
+	char m_magic[8];
+
+	///@brief Timestamp of the acquisition
+	int64_t m_timestamp;
+	int64_t m_femtoseconds;
+
+	///@brief Number of streams which follow
+	uint32_t m_streamCount;
+};
+
+///@brief Header for one stream in a ViewerFrameHeader reply
+class ViewerStreamHeader
+{
+public:
+	///@brief Display name of the stream, null padded
+	char m_name[32];
+
+	///@brief Y axis unit of the stream (a Unit::UnitType)
+	uint32_t m_unit;
+
+	///@brief Time of the first sample, in fs from the trigger
+	int64_t m_start;
+
+	///@brief Time of the end of the last sample, in fs from the trigger
+	int64_t m_end;
+
+	///@brief Number of samples in the full resolution waveform
+	uint64_t m_sampleCount;
+
+	///@brief Number of (min, max) pairs which follow. Columns with no samples in them are NaN.
+	uint32_t m_columns;
+};
+
+///@brief Reply to a VIEWER_REQ_SAMPLES request
+class ViewerSamplesHeader
+{
+public:
+	///@brief Number of (time, value) pairs which follow
+	uint32_t m_count;
+};
+
+///@brief One full resolution sample in a VIEWER_REQ_SAMPLES reply
+class ViewerSample
+{
+public:
+	///@brief Time of the sample, in fs from the trigger
+	int64_t m_time;
+
+	///@brief Value of the sample (0 or 1 for digital streams)
+	float m_value;
+};
+
+#pragma pack(pop)
+
+/**
+	@brief Serves decimated, render-ready copies of new acquisitions to remote viewers over TCP
+
+	Lets a viewer on another machine follow a session running next to the instruments without every waveform crossing
+	the network at full resolution: the viewer asks for each acquisition decimated to min/max columns at its plot
+	width, and only pulls full resolution samples for the range it's zoomed in on.
+
+	The GUI thread hands over each new acquisition with OnNewPoint(). Each connected viewer is served by its own
+	thread, which decimates the data on demand.
+ */
+class ViewerServer
+{
+public:
+	ViewerServer(uint16_t port);
+	virtual ~ViewerServer();
+
+	ViewerServer(const ViewerServer&) =delete;
+	ViewerServer& operator=(const ViewerServer&) =delete;
+
+	void OnNewPoint(std::shared_ptr<HistoryPoint> pt);
+
+	///@brief Returns the port we're listening on
+	uint16_t GetPort()
+	{ return m_port; }
+
+	///@brief Returns the number of viewers connected
+	size_t GetClientCount()
+	{ return m_clientCount; }
+
+protected:
+	void ListenThreadProc();
+	void ClientThreadProc(ZSOCKET fd);
+	bool SendFrame(Socket& sock, const ViewerFrameRequest& req);
+	bool SendSamples(Socket& sock, const ViewerSamplesRequest& req);
+	void ReleasePoint();
+
+	///@brief Port we're listening on
+	uint16_t m_port;
+
+	///@brief Socket waiting for viewers to connect
+	Socket m_listener;
+
+	/**
+		@brief Controls access to m_point
+
+		Viewer threads hold it shared while reading sample data. OnNewPoint() only swaps in a new point if it can get
+		the lock without waiting, so a slow viewer just sees fewer acquisitions rather than holding up the GUI.
+	 */
+	std::shared_mutex m_pointMutex;
+
+	///@brief The newest acquisition we've been given
+	std::shared_ptr<HistoryPoint> m_point;
+
+	///@brief Streams of m_point with data we can send, in the order they're sent
+	std::vector<StreamDescriptor> m_streams;
+
+	///@brief Sample data of each of m_streams
+	std::vector<WaveformBase*> m_waveforms;
+
+	///@brief Mutex controlling access to m_clientSockets
+	std::mutex m_clientMutex;
+
+	///@brief Sockets of connected viewers, so they can be shut down when we exit
+	std::set<ZSOCKET> m_clientSockets;
+
+	///@brief Number of viewers connected
+	std::atomic<size_t> m_clientCount;
+
+	///@brief Set to shut down all of our threads
+	std::atomic<bool> m_shuttingDown;
+
+	///@brief Thread accepting new connections
+	std::unique_ptr<std::thread> m_listenThread;
+
+	///@brief Threads serving each viewer
+	std::vector<std::thread> m_clientThreads;
+};
+
+#endif
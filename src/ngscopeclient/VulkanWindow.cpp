@@ -34,14 +34,19 @@
  */
 
 #include "ngscopeclient.h"
+#include "pthread_compat.h"
 #include "TextureManager.h"
 #include "VulkanWindow.h"
 #include "VulkanFFTPlan.h"
+#include "VideoRecorder.h"
 
 using namespace std;
 
 #define PREFERRED_IMAGE_COUNT 2
 
+///@brief Number of staging buffers for video capture (frames in flight between the GPU and the encoder)
+#define CAPTURE_RING_SIZE 4
+
 static void Mutexed_ImGui_ImplVulkan_CreateWindow(ImGuiViewport* viewport);
 static void Mutexed_ImGui_ImplVulkan_DestroyWindow(ImGuiViewport* viewport);
 static void Mutexed_ImGui_ImplVulkan_SetWindowSize(ImGuiViewport* viewport, ImVec2 size);
@@ -66,6 +71,9 @@ VulkanWindow::VulkanWindow(const string& title, shared_ptr<QueueHandle> queue)
 	, m_semaphoreIndex(0)
 	, m_frameIndex(0)
 	, m_lastFrameIndex(0)
+	, m_lastFrameLatency(0)
+	, m_requestedPresentMode(vk::PresentModeKHR::eFifo)
+	, m_presentMode(vk::PresentModeKHR::eFifo)
 	, m_width(0)
 	, m_height(0)
 	, m_fullscreen(false)
@@ -73,11 +81,21 @@ VulkanWindow::VulkanWindow(const string& title, shared_ptr<QueueHandle> queue)
 	, m_windowedY(0)
 	, m_windowedWidth(0)
 	, m_windowedHeight(0)
+	, m_renderThreadRequested(false)
+	, m_renderThreadBusy(false)
+	, m_renderThreadTerminating(false)
+	, m_presentCount(0)
+	, m_presentCountSeen(0)
+	, m_lastPresentTime(0)
+	, m_captureSupported(false)
+	, m_surfaceIsBGRA(false)
+	, m_captureDropped(0)
 {
 	//Initialize ImGui
 	IMGUI_CHECKVERSION();
 	LogDebug("Using ImGui version %s\n", IMGUI_VERSION);
 	m_context = ImGui::CreateContext();
+	m_plotContext = ImPlot::CreateContext();
 	ImGuiIO& io = ImGui::GetIO();
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
 	io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
@@ -278,8 +296,10 @@ VulkanWindow::~VulkanWindow()
 {
 	LogTrace("Shutting down Vulkan\n");
 
+	StopRenderThread();
 	g_vkComputeDevice->waitIdle();
 
+	StopVideoCapture();
 	m_texturesUsedThisFrame.clear();
 
 	m_renderPass = nullptr;
@@ -289,6 +309,7 @@ VulkanWindow::~VulkanWindow()
 
 	ImGui_ImplVulkan_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
+	ImPlot::DestroyContext(m_plotContext);
 	ImGui::DestroyContext(m_context);
 
 	m_imguiDescriptorPool = nullptr;
@@ -303,10 +324,9 @@ VulkanWindow::~VulkanWindow()
 bool VulkanWindow::UpdateFramebuffer()
 {
 	LogTrace("Recreating framebuffer due to window resize\n");
-	lock_guard<shared_mutex> lock(g_vulkanActivityMutex);
 
 	//Wait until any previous rendering has finished
-	g_vkComputeDevice->waitIdle();
+	WaitForRenderQueueIdle();
 
 	//Get current size of the surface
 	//If size doesn't match up, early out. We're probably in the middle of a resize.
@@ -322,6 +342,13 @@ bool VulkanWindow::UpdateFramebuffer()
 		return false;
 	}
 
+	//The recording can't change size part way through
+	if(m_recorder && ( (m_recorder->GetWidth() != (size_t)m_width) || (m_recorder->GetHeight() != (size_t)m_height) ) )
+	{
+		LogWarning("Window was resized, stopping video capture\n");
+		StopVideoCapture();
+	}
+
 	m_minImageCount = caps.minImageCount;
 	int imageCount;
 	if(caps.minImageCount > PREFERRED_IMAGE_COUNT)
@@ -351,6 +378,34 @@ bool VulkanWindow::UpdateFramebuffer()
 		requestSurfaceColorSpace);
 	vk::Format surfaceFormat = static_cast<vk::Format>(format.format);
 
+	//Video capture copies the back buffer out after drawing, which needs transfer source usage and a format we know
+	vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment;
+	m_surfaceIsBGRA = (surfaceFormat == vk::Format::eB8G8R8A8Unorm) || (surfaceFormat == vk::Format::eB8G8R8A8Srgb);
+	bool isRGBA = (surfaceFormat == vk::Format::eR8G8B8A8Unorm) || (surfaceFormat == vk::Format::eR8G8B8A8Srgb);
+	m_captureSupported =
+		(caps.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc) && (m_surfaceIsBGRA || isRGBA);
+	if(m_captureSupported)
+		usage |= vk::ImageUsageFlagBits::eTransferSrc;
+	else if(m_recorder)
+	{
+		LogWarning("New swapchain can't be captured, stopping video capture\n");
+		StopVideoCapture();
+	}
+
+	//FIFO is always available, anything else has to be checked
+	m_presentMode = vk::PresentModeKHR::eFifo;
+	if(m_requestedPresentMode != vk::PresentModeKHR::eFifo)
+	{
+		auto modes = g_vkComputePhysicalDevice->getSurfacePresentModesKHR(**m_surface);
+		if(find(modes.begin(), modes.end(), m_requestedPresentMode) != modes.end())
+			m_presentMode = m_requestedPresentMode;
+		else
+		{
+			LogDebug("Present mode %s not supported by this surface, using FIFO\n",
+				vk::to_string(m_requestedPresentMode).c_str());
+		}
+	}
+
 	//Save old swapchain
 	unique_ptr<vk::raii::SwapchainKHR> oldSwapchain = std::move(m_swapchain);
 
@@ -366,12 +421,12 @@ bool VulkanWindow::UpdateFramebuffer()
 		static_cast<vk::ColorSpaceKHR>(format.colorSpace),
 		vk::Extent2D(m_width, m_height),
 		1,
-		vk::ImageUsageFlagBits::eColorAttachment,
+		usage,
 		vk::SharingMode::eExclusive,
 		{},
 		vk::SurfaceTransformFlagBitsKHR::eIdentity,
 		vk::CompositeAlphaFlagBitsKHR::eOpaque,
-		vk::PresentModeKHR::eFifo /*vk::PresentModeKHR::eImmediate*/ , //switch to eImmediate for benchmarking FPS
+		m_presentMode,
 		true,
 		oldSwapchainIfValid);
 	m_swapchain = make_unique<vk::raii::SwapchainKHR>(*g_vkComputeDevice, chainInfo);
@@ -405,6 +460,7 @@ bool VulkanWindow::UpdateFramebuffer()
 	auto nbuffers = m_backBuffers.size();
 	m_backBufferViews.resize(nbuffers);
 	m_framebuffers.resize(nbuffers);
+	m_frameStartTimes.resize(nbuffers, 0);
 	m_texturesUsedThisFrame.resize(nbuffers);
 	for (uint32_t i = 0; i < nbuffers; i++)
 	{
@@ -428,6 +484,21 @@ bool VulkanWindow::UpdateFramebuffer()
 	return true;
 }
 
+/**
+	@brief Waits for everything submitted to the render queue, including presentation, to finish
+
+	The swapchain, framebuffers and per-frame command buffers are only ever used by the render queue, so this is all
+	that's needed before recreating them. Idling the whole device instead would mean taking g_vulkanActivityMutex
+	exclusively, which stalls instrument downloads and filter graph execution (and waits for any deep download in
+	progress to finish) every time the window is resized.
+ */
+void VulkanWindow::WaitForRenderQueueIdle()
+{
+	TRACE_ZONE("Wait for render queue");
+	QueueLock qlock(m_renderQueue);
+	(*qlock).waitIdle();
+}
+
 float VulkanWindow::GetContentScale()
 {
 	float xscale;
@@ -438,16 +509,65 @@ float VulkanWindow::GetContentScale()
 	return (xscale + yscale) / 2;
 }
 
+/**
+	@brief Selects the present mode to use
+
+	Takes effect when the swapchain is next recreated, which is forced if the mode changed. If the surface doesn't
+	support the mode, FIFO (vsync) is used instead.
+ */
+void VulkanWindow::SetPresentMode(vk::PresentModeKHR mode)
+{
+	if(mode == m_requestedPresentMode)
+		return;
+
+	LogTrace("Present mode changed to %s\n", vk::to_string(mode).c_str());
+	m_requestedPresentMode = mode;
+	m_resizeEventPending = true;
+}
+
+/**
+	@brief Updates the frame latency if the frame last submitted with the given fence has completed
+
+	@param index	Index of the fence to check
+	@param block	If true, wait for the frame to complete
+ */
+void VulkanWindow::CheckFrameComplete(uint32_t index, bool block)
+{
+	if(index >= m_fences.size())
+		return;
+
+	if(block)
+	{
+		TRACE_ZONE("Wait for previous frame");
+		(void)g_vkComputeDevice->waitForFences({**m_fences[index]}, VK_TRUE, UINT64_MAX);
+	}
+	else if(m_fences[index]->getStatus() != vk::Result::eSuccess)
+		return;
+
+	if( (index < m_frameStartTimes.size()) && (m_frameStartTimes[index] != 0) )
+	{
+		m_lastFrameLatency = (GetTime() - m_frameStartTimes[index]) * FS_PER_SECOND;
+		m_frameStartTimes[index] = 0;
+	}
+}
+
 void VulkanWindow::Render()
 {
+	//Start or stop the render thread between frames, so a frame is never split across the two models
+	if(m_renderThreadRequested && !m_renderThread)
+		StartRenderThread();
+	else if(!m_renderThreadRequested && m_renderThread)
+		StopRenderThread();
+	bool threaded = (m_renderThread != nullptr);
+
 	if(m_softwareResizeRequested)
 	{
 		m_softwareResizeRequested = false;
 		LogTrace("Software window resize to (%d, %d)\n", m_pendingWidth, m_pendingHeight);
 
-		//can't resize the window during any other vulkan activity
-		lock_guard<shared_mutex> lock(g_vulkanActivityMutex);
-		g_vkComputeDevice->waitIdle();
+		//Don't resize the window while the last frame is still being drawn onto it
+		WaitForRenderThreadIdle();
+		WaitForRenderQueueIdle();
 		glfwSetWindowSize(m_window, m_pendingWidth, m_pendingHeight);
 		return;
 	}
@@ -456,10 +576,14 @@ void VulkanWindow::Render()
 	if(m_resizeEventPending)
 	{
 		//If resize fails, wait a frame and try again. Don't redraw onto the incomplete framebuffer.
+		WaitForRenderThreadIdle();
 		if(!UpdateFramebuffer())
 			return;
 	}
 
+	TRACE_ZONE("Frame");
+	double frameStart = GetTime();
+
 	//Start frame
 	{
 		QueueLock qlock(m_renderQueue);
@@ -469,21 +593,46 @@ void VulkanWindow::Render()
 	ImGui::NewFrame();
 
 	//Make sure the old frame has completed
-	//Otherwise we risk modifying textures that last frame is still using
-	(void)g_vkComputeDevice->waitForFences({**m_fences[m_frameIndex]}, VK_TRUE, UINT64_MAX);
+	//Otherwise we risk modifying textures that last frame is still using (tone mapping writes them in place)
+	//With a render thread, only tone mapping waits for this (see WaitForPreviousFrame()) so the rest of the UI can be
+	//built while the GPU is still busy with the last frame.
+	if(threaded)
+		PollPresented();
+	else
+	{
+		CheckFrameComplete(m_frameIndex, true);
+		HandOffCaptures(-1);
+	}
 
 	//Draw all of our application UI objects
-	RenderUI();
+	{
+		TRACE_ZONE("RenderUI");
+		RenderUI();
+	}
 
 	//Internal GUI rendering
-	set<shared_ptr<Texture> > texturesToClear = m_texturesUsedThisFrame[m_lastFrameIndex];
-	m_texturesUsedThisFrame[m_lastFrameIndex].clear();
-	ImGui::Render();
+	set<shared_ptr<Texture> > texturesToClear;
+	if(!threaded)
+	{
+		texturesToClear = m_texturesUsedThisFrame[m_lastFrameIndex];
+		m_texturesUsedThisFrame[m_lastFrameIndex].clear();
+	}
+	{
+		TRACE_ZONE("ImGui::Render");
+		ImGui::Render();
+	}
 
 	//Render the main window
 	ImDrawData* main_draw_data = ImGui::GetDrawData();
 	const bool main_is_minimized = (main_draw_data->DisplaySize.x <= 0.0f || main_draw_data->DisplaySize.y <= 0.0f);
-	if(!main_is_minimized)
+	if(threaded)
+	{
+		if(main_is_minimized)
+			m_uiTextures.clear();
+		else
+			QueueFrame(main_draw_data, frameStart);
+	}
+	else if(!main_is_minimized)
 	{
 		//Get the next frame to draw onto
 		try
@@ -514,42 +663,10 @@ void VulkanWindow::Render()
 			return;
 		}
 
-		//Reset fences for next frame
-		g_vkComputeDevice->resetFences({**m_fences[m_frameIndex]});
-		(*QueueLock(m_renderQueue)).waitIdle();
-
-		//Start render pass
-		auto& cmdBuf = *m_cmdBuffers[m_frameIndex];
-		cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-		vk::ClearValue clearValue;
-		vk::ClearColorValue clearColor;
-		clearColor.setFloat32({0.1f, 0.1f, 0.1f, 1.0f});
-		clearValue.setColor(clearColor);
-		vk::RenderPassBeginInfo passInfo(
-			**m_renderPass,
-			**m_framebuffers[m_frameIndex],
-			vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(m_width, m_height)),
-			clearValue);
-		cmdBuf.beginRenderPass(passInfo, vk::SubpassContents::eInline);
-
-		//Draw GUI
-		ImGui_ImplVulkan_RenderDrawData(main_draw_data, *cmdBuf);
-
-		//Draw waveform data etc
-		DoRender(cmdBuf);
-
-		//Finish up and submit
-		cmdBuf.endRenderPass();
-		cmdBuf.end();
-
-		vk::PipelineStageFlags flags(vk::PipelineStageFlagBits::eColorAttachmentOutput);
-		vk::SubmitInfo info(
-			**m_imageAcquiredSemaphores[m_semaphoreIndex],
-			flags,
-			*cmdBuf,
-			**m_renderCompleteSemaphores[m_semaphoreIndex]);
-		QueueLock qlock(m_renderQueue);
-		(*qlock).submit(info, **m_fences[m_frameIndex]);
+		//The last frame drawn to this image was submitted before the one we already waited for, so this won't block
+		CheckFrameComplete(m_frameIndex, true);
+		HandOffCaptures(m_frameIndex);
+		RecordAndSubmitFrame(main_draw_data, frameStart);
 	}
 
 	// if (!m_resizeEventPending)
@@ -563,36 +680,573 @@ void VulkanWindow::Render()
 	}
 
 	//Present the main window
-	if(!main_is_minimized)
+	if(!threaded && !main_is_minimized)
 	{
-		vk::PresentInfoKHR presentInfo(**m_renderCompleteSemaphores[m_semaphoreIndex], **m_swapchain, m_frameIndex);
-		m_semaphoreIndex = (m_semaphoreIndex + 1) % m_backBuffers.size();
-		try
+		if(!PresentFrame())
+			return;
+		OnFramePresented(GetTime());
+
+		//If the GPU has already finished this frame, measure its latency now rather than when we next wait for it
+		CheckFrameComplete(m_frameIndex, false);
+	}
+
+	//We can now free references to last frame's textures
+	//This will delete them if the containing object was destroyed that frame
+	texturesToClear.clear();
+}
+
+/**
+	@brief Records the main window's frame into the command buffer for the current back buffer, and submits it
+
+	The caller must have acquired m_frameIndex and waited for the last frame drawn to it.
+
+	@param drawData		ImGui draw data for the main viewport
+	@param frameStart	Time the frame started sampling input, for latency measurement
+ */
+void VulkanWindow::RecordAndSubmitFrame(ImDrawData* drawData, double frameStart)
+{
+	TRACE_ZONE("Record and submit frame");
+
+	//Reset fences for next frame.
+	//Anything else on the queue (tone mapping etc) is ordered by queue submission, so no need to idle it.
+	g_vkComputeDevice->resetFences({**m_fences[m_frameIndex]});
+	m_frameStartTimes[m_frameIndex] = frameStart;
+
+	//Start render pass
+	auto& cmdBuf = *m_cmdBuffers[m_frameIndex];
+	cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	vk::ClearValue clearValue;
+	vk::ClearColorValue clearColor;
+	clearColor.setFloat32({0.1f, 0.1f, 0.1f, 1.0f});
+	clearValue.setColor(clearColor);
+	vk::RenderPassBeginInfo passInfo(
+		**m_renderPass,
+		**m_framebuffers[m_frameIndex],
+		vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(m_width, m_height)),
+		clearValue);
+	cmdBuf.beginRenderPass(passInfo, vk::SubpassContents::eInline);
+
+	//Draw GUI
+	//(the backend isn't thread safe, and with a render thread the UI thread may be drawing platform windows)
+	{
+		QueueLock qlock(m_renderQueue);
+		ImGui_ImplVulkan_RenderDrawData(drawData, *cmdBuf);
+	}
+
+	//Draw waveform data etc
+	DoRender(cmdBuf);
+
+	//Finish up and submit
+	cmdBuf.endRenderPass();
+	if(m_recorder)
+		RecordCapture(cmdBuf, frameStart);
+	cmdBuf.end();
+
+	vk::PipelineStageFlags flags(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+	vk::SubmitInfo info(
+		**m_imageAcquiredSemaphores[m_semaphoreIndex],
+		flags,
+		*cmdBuf,
+		**m_renderCompleteSemaphores[m_semaphoreIndex]);
+	QueueLock qlock(m_renderQueue);
+	(*qlock).submit(info, **m_fences[m_frameIndex]);
+}
+
+/**
+	@brief Queues the frame last submitted by RecordAndSubmitFrame() for presentation
+
+	@return False if the swapchain needs to be recreated
+ */
+bool VulkanWindow::PresentFrame()
+{
+	TRACE_ZONE("Present");
+	vk::PresentInfoKHR presentInfo(**m_renderCompleteSemaphores[m_semaphoreIndex], **m_swapchain, m_frameIndex);
+	m_semaphoreIndex = (m_semaphoreIndex + 1) % m_backBuffers.size();
+	try
+	{
+		//No need to idle the queue first, presentation waits on the render complete semaphore
+		QueueLock qlock(m_renderQueue);
+		if(vk::Result::eSuboptimalKHR == (*qlock).presentKHR(presentInfo))
 		{
-			QueueLock qlock(m_renderQueue);
-			(*qlock).waitIdle();
-			if(vk::Result::eSuboptimalKHR == (*qlock).presentKHR(presentInfo))
+			LogTrace("eSuboptimal at present\n");
+			m_resizeEventPending = true;
+			return false;
+		}
+	}
+	catch(const vk::OutOfDateKHRError& err)
+	{
+		LogTrace("OutOfDateKHRError at present\n");
+		m_resizeEventPending = true;
+		return false;
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Render thread
+
+/**
+	@brief Starts submitting and presenting frames from a thread of their own
+
+	The UI thread keeps building ImGui frames (and tone mapping, which has to stay in step with the UI that shows it)
+	but hands each finished frame off to the render thread rather than waiting for a back buffer, recording and
+	presenting it. One frame can wait in m_queuedFrame while another is being submitted, so building frame N+1 overlaps
+	with frame N's trip through the swapchain and the GPU.
+ */
+void VulkanWindow::StartRenderThread()
+{
+	LogTrace("Starting render thread\n");
+
+	//Anything the UI thread submitted itself needs to be finished before the render thread starts acquiring images
+	WaitForRenderQueueIdle();
+	HandOffCaptures(-1);
+
+	m_renderThreadTerminating = false;
+	m_renderThreadBusy = false;
+	m_presentCountSeen = m_presentCount;
+	m_renderThread = make_unique<thread>(&VulkanWindow::RenderThread, this);
+}
+
+/**
+	@brief Submits every frame still queued, then stops the render thread
+ */
+void VulkanWindow::StopRenderThread()
+{
+	if(!m_renderThread)
+		return;
+
+	LogTrace("Stopping render thread\n");
+	{
+		lock_guard<mutex> lock(m_renderThreadMutex);
+		m_renderThreadTerminating = true;
+	}
+	m_renderThreadWake.notify_all();
+	m_renderThread->join();
+	m_renderThread = nullptr;
+
+	//Textures for the frame in progress belong to the UI thread's bookkeeping again
+	for(auto& tex : m_uiTextures)
+		m_texturesUsedThisFrame[m_frameIndex].emplace(tex);
+	m_uiTextures.clear();
+	PollPresented();
+}
+
+void VulkanWindow::RenderThread()
+{
+	pthread_setname_np_compat("RenderThread");
+
+	while(true)
+	{
+		{
+			unique_lock<mutex> lock(m_renderThreadMutex);
+			m_renderThreadWake.wait(lock, [&]{ return m_queuedFrame || m_renderThreadTerminating; });
+			if(!m_queuedFrame)
+				break;
+			m_renderThreadBusy = true;
+		}
+
+		SubmitQueuedFrame();
+
+		{
+			lock_guard<mutex> lock(m_renderThreadMutex);
+			m_renderThreadBusy = false;
+		}
+		m_renderThreadWake.notify_all();
+	}
+}
+
+/**
+	@brief Submits and presents the frame waiting in m_queuedFrame (render thread only)
+ */
+void VulkanWindow::SubmitQueuedFrame()
+{
+	TRACE_ZONE("Submit queued frame");
+
+	//Take the frame, which frees up the slot so the UI thread can queue the next one while we work on this one
+	unique_ptr<QueuedFrame> frame;
+	{
+		lock_guard<mutex> lock(m_renderThreadMutex);
+		frame = std::move(m_queuedFrame);
+	}
+	m_renderThreadWake.notify_all();
+
+	//Don't draw onto a swapchain which is about to be recreated, the UI thread will sort it out next frame
+	if(m_resizeEventPending)
+	{
+		ReleaseTextures(std::move(frame->m_textures));
+		return;
+	}
+
+	shared_lock lock(g_vulkanActivityMutex);
+
+	try
+	{
+		auto result = m_swapchain->acquireNextImage(UINT64_MAX, **m_imageAcquiredSemaphores[m_semaphoreIndex], {});
+		m_lastFrameIndex = m_frameIndex;
+		m_frameIndex = result.second;
+		if(result.first == vk::Result::eSuboptimalKHR)
+			LogTrace("eSuboptimalKHR\n");
+	}
+	catch(const vk::OutOfDateKHRError& err)
+	{
+		LogTrace("OutOfDateKHR\n");
+		m_resizeEventPending = true;
+		ReleaseTextures(std::move(frame->m_textures));
+		return;
+	}
+
+	//Once the last frame drawn to this image is done, its textures can go back to the UI thread to be freed
+	CheckFrameComplete(m_frameIndex, true);
+	HandOffCaptures(m_frameIndex);
+	ReleaseTextures(std::move(m_texturesUsedThisFrame[m_frameIndex]));
+	m_texturesUsedThisFrame[m_frameIndex] = std::move(frame->m_textures);
+
+	RecordAndSubmitFrame(&frame->m_drawData, frame->m_frameStart);
+	if(!PresentFrame())
+		return;
+
+	m_lastPresentTime = GetTime();
+	m_presentCount ++;
+	CheckFrameComplete(m_frameIndex, false);
+}
+
+/**
+	@brief Passes textures the render thread no longer needs to the UI thread, which drops them in PollPresented()
+
+	This may drop the last reference to a texture, and deleting one calls into the imgui backend, which isn't thread
+	safe. Render thread only.
+ */
+void VulkanWindow::ReleaseTextures(set<shared_ptr<Texture> >&& textures)
+{
+	if(textures.empty())
+		return;
+
+	lock_guard<mutex> lock(m_renderThreadMutex);
+	m_releasedTextures.push_back(std::move(textures));
+	textures.clear();
+}
+
+/**
+	@brief Hands the frame the UI thread just built to the render thread
+
+	Blocks if the render thread already has a frame waiting, so the UI thread never gets more than one frame ahead.
+
+	@param drawData		ImGui draw data for the main viewport
+	@param frameStart	Time the frame started sampling input, for latency measurement
+ */
+void VulkanWindow::QueueFrame(ImDrawData* drawData, double frameStart)
+{
+	auto frame = make_unique<QueuedFrame>();
+	frame->m_drawData = *drawData;
+	for(int i=0; i<drawData->CmdListsCount; i++)
+		frame->m_drawData.CmdLists[i] = drawData->CmdLists[i]->CloneOutput();
+	frame->m_textures = std::move(m_uiTextures);
+	m_uiTextures.clear();
+	frame->m_frameStart = frameStart;
+
+	{
+		TRACE_ZONE("Wait for render thread");
+		unique_lock<mutex> lock(m_renderThreadMutex);
+		m_renderThreadWake.wait(lock, [&]{ return !m_queuedFrame; });
+		m_queuedFrame = std::move(frame);
+	}
+	m_renderThreadWake.notify_all();
+}
+
+/**
+	@brief Waits until the render thread has submitted everything queued and is idle
+
+	Does nothing if there's no render thread.
+ */
+void VulkanWindow::WaitForRenderThreadIdle()
+{
+	if(!m_renderThread)
+		return;
+
+	TRACE_ZONE("Wait for render thread idle");
+	unique_lock<mutex> lock(m_renderThreadMutex);
+	m_renderThreadWake.wait(lock, [&]{ return !m_queuedFrame && !m_renderThreadBusy; });
+}
+
+/**
+	@brief Waits for the GPU to finish the last frame handed to the render thread
+
+	Called before anything which writes to textures in place, such as tone mapping. Without a render thread this was
+	already done at the start of the frame, so it does nothing.
+ */
+void VulkanWindow::WaitForPreviousFrame()
+{
+	if(!m_renderThread)
+		return;
+
+	WaitForRenderThreadIdle();
+	CheckFrameComplete(m_frameIndex, true);
+	PollPresented();
+}
+
+/**
+	@brief Calls OnFramePresented() on the UI thread if the render thread has presented anything since the last call
+
+	Also frees any textures the render thread has finished with, since that can only be done on the UI thread.
+ */
+void VulkanWindow::PollPresented()
+{
+	vector< set<shared_ptr<Texture> > > released;
+	{
+		lock_guard<mutex> lock(m_renderThreadMutex);
+		released.swap(m_releasedTextures);
+	}
+	released.clear();
+
+	uint64_t count = m_presentCount;
+	if(count == m_presentCountSeen)
+		return;
+	m_presentCountSeen = count;
+	OnFramePresented(m_lastPresentTime);
+}
+
+void VulkanWindow::RenderUI()
+{
+}
+
+/**
+	@brief Called on the UI thread once the main window's frame has been queued for presentation
+
+	With a render thread, this may be a frame or so after the fact.
+
+	@param presentTime	Time the frame was queued for presentation
+ */
+void VulkanWindow::OnFramePresented(double /*presentTime*/)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Video capture
+
+/**
+	@brief Starts recording the window contents
+
+	Each frame is copied out of the back buffer, after it's drawn, into one of a ring of host visible buffers. When
+	the frame's fence signals (which we notice while starting a later frame) the buffer is handed to a VideoRecorder,
+	which feeds it to the encoder from its own thread. Nothing on the render path waits for the copy or the encoder; if
+	every buffer is still in use the frame just isn't captured.
+
+	@param command	Encoder command line (see VideoRecorder)
+	@param path		Output file
+	@param fps		Output frame rate
+
+	@return True if recording started
+ */
+bool VulkanWindow::StartVideoCapture(const string& command, const string& path, int fps)
+{
+	StopVideoCapture();
+
+	//The render thread records the copies, so it mustn't see the ring half built
+	WaitForRenderThreadIdle();
+
+	if(!m_captureSupported)
+	{
+		LogError("This swapchain can't be used as a transfer source, so video can't be captured\n");
+		return false;
+	}
+
+	//Allocate the staging buffers, preferring cached memory since we're reading it back
+	VkDeviceSize size = m_width * m_height * 4;
+	auto memProperties = g_vkComputePhysicalDevice->getMemoryProperties();
+	for(size_t i=0; i<CAPTURE_RING_SIZE; i++)
+	{
+		auto buf = make_unique<CaptureBuffer>();
+		vk::BufferCreateInfo bufinfo({}, size, vk::BufferUsageFlagBits::eTransferDst);
+		buf->m_buffer = make_unique<vk::raii::Buffer>(*g_vkComputeDevice, bufinfo);
+
+		auto req = buf->m_buffer->getMemoryRequirements();
+		uint32_t memType = 0;
+		int bestScore = -1;
+		for(uint32_t j=0; j<memProperties.memoryTypeCount; j++)
+		{
+			auto flags = memProperties.memoryTypes[j].propertyFlags;
+			if(!(req.memoryTypeBits & (1 << j)) || !(flags & vk::MemoryPropertyFlagBits::eHostVisible))
+				continue;
+			int score = 0;
+			if(flags & vk::MemoryPropertyFlagBits::eHostCached)
+				score += 2;
+			if(flags & vk::MemoryPropertyFlagBits::eHostCoherent)
+				score += 1;
+			if(score > bestScore)
 			{
-				LogTrace("eSuboptimal at present\n");
-				m_resizeEventPending = true;
-				return;
+				memType = j;
+				bestScore = score;
 			}
 		}
-		catch(const vk::OutOfDateKHRError& err)
+		if(bestScore < 0)
 		{
-			LogTrace("OutOfDateKHRError at present\n");
-			m_resizeEventPending = true;
-			return;
+			LogError("No host visible memory for video capture\n");
+			m_captureBuffers.clear();
+			return false;
 		}
+		if(i == 0)
+			LogTrace("Using memory type %u for video capture staging buffers\n", memType);
+
+		vk::MemoryAllocateInfo minfo(req.size, memType);
+		buf->m_memory = make_unique<vk::raii::DeviceMemory>(*g_vkComputeDevice, minfo);
+		buf->m_buffer->bindMemory(**buf->m_memory, 0);
+		buf->m_ptr = reinterpret_cast<uint8_t*>(buf->m_memory->mapMemory(0, req.size));
+		buf->m_coherent = (bool)(memProperties.memoryTypes[memType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+		m_captureBuffers.push_back(std::move(buf));
 	}
 
-	//We can now free references to last frame's textures
-	//This will delete them if the containing object was destroyed that frame
-	texturesToClear.clear();
+	m_recorder = make_unique<VideoRecorder>(command, path, m_width, m_height, m_surfaceIsBGRA, fps);
+	if(!m_recorder->IsOK())
+	{
+		m_recorder = nullptr;
+		m_captureBuffers.clear();
+		return false;
+	}
+
+	m_captureDropped = 0;
+	LogNotice("Recording video to %s (%d x %d)\n", path.c_str(), m_width, m_height);
+	return true;
 }
 
-void VulkanWindow::RenderUI()
+/**
+	@brief Stops recording, encoding every frame captured so far
+ */
+void VulkanWindow::StopVideoCapture()
 {
+	if(!m_recorder)
+		return;
+
+	//Let in-flight copies finish so the last few frames make it into the file
+	WaitForRenderThreadIdle();
+	WaitForRenderQueueIdle();
+	for(size_t i=0; i<m_fences.size(); i++)
+		HandOffCaptures(i);
+
+	//Destroying the recorder drains its queue, so no buffer is busy after this
+	m_recorder = nullptr;
+	for(auto& buf : m_captureBuffers)
+		buf->m_memory->unmapMemory();
+	m_captureBuffers.clear();
+
+	if(m_captureDropped)
+		LogNotice("Video capture skipped %zu frames because the encoder couldn't keep up\n", m_captureDropped);
+}
+
+/**
+	@brief Records a copy of the back buffer into a free capture buffer
+
+	Called after the render pass, when the image is in the present layout.
+ */
+void VulkanWindow::RecordCapture(vk::raii::CommandBuffer& cmdBuf, double frameStart)
+{
+	CaptureBuffer* target = nullptr;
+	for(auto& buf : m_captureBuffers)
+	{
+		if(!buf->m_pending && !buf->m_busy)
+		{
+			target = buf.get();
+			break;
+		}
+	}
+	if(!target)
+	{
+		m_captureDropped ++;
+		return;
+	}
+
+	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+	vk::Image image = m_backBuffers[m_frameIndex];
+
+	vk::ImageMemoryBarrier toTransfer(
+		vk::AccessFlagBits::eColorAttachmentWrite,
+		vk::AccessFlagBits::eTransferRead,
+		vk::ImageLayout::ePresentSrcKHR,
+		vk::ImageLayout::eTransferSrcOptimal,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		image,
+		range);
+	cmdBuf.pipelineBarrier(
+		vk::PipelineStageFlagBits::eColorAttachmentOutput,
+		vk::PipelineStageFlagBits::eTransfer,
+		{},
+		{},
+		{},
+		toTransfer);
+
+	vk::BufferImageCopy region(
+		0,
+		0,
+		0,
+		vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+		vk::Offset3D(0, 0, 0),
+		vk::Extent3D(m_width, m_height, 1));
+	cmdBuf.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, **target->m_buffer, region);
+
+	//Put the image back for presentation, and make the copy visible to the host
+	vk::ImageMemoryBarrier toPresent(
+		vk::AccessFlagBits::eTransferRead,
+		{},
+		vk::ImageLayout::eTransferSrcOptimal,
+		vk::ImageLayout::ePresentSrcKHR,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		image,
+		range);
+	vk::BufferMemoryBarrier toHost(
+		vk::AccessFlagBits::eTransferWrite,
+		vk::AccessFlagBits::eHostRead,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		**target->m_buffer,
+		0,
+		VK_WHOLE_SIZE);
+	cmdBuf.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eBottomOfPipe | vk::PipelineStageFlagBits::eHost,
+		{},
+		{},
+		toHost,
+		toPresent);
+
+	target->m_pending = true;
+	target->m_fenceIndex = m_frameIndex;
+	target->m_timestamp = frameStart;
+}
+
+/**
+	@brief Passes captures whose copies have completed to the recorder, oldest first
+
+	@param completedFence	Index of a fence known to have signaled (and about to be reset), or -1 to only
+							check fences without waiting
+ */
+void VulkanWindow::HandOffCaptures(int completedFence)
+{
+	if(!m_recorder)
+		return;
+
+	vector<CaptureBuffer*> done;
+	for(auto& buf : m_captureBuffers)
+	{
+		if(!buf->m_pending)
+			continue;
+		if( (static_cast<int>(buf->m_fenceIndex) == completedFence) ||
+			(m_fences[buf->m_fenceIndex]->getStatus() == vk::Result::eSuccess) )
+		{
+			done.push_back(buf.get());
+		}
+	}
+	sort(done.begin(), done.end(),
+		[](CaptureBuffer* a, CaptureBuffer* b) { return a->m_timestamp < b->m_timestamp; });
+
+	for(auto buf : done)
+	{
+		if(!buf->m_coherent)
+			g_vkComputeDevice->invalidateMappedMemoryRanges(vk::MappedMemoryRange(**buf->m_memory, 0, VK_WHOLE_SIZE));
+		buf->m_pending = false;
+		m_recorder->Submit(buf->m_ptr, buf->m_timestamp, &buf->m_busy);
+	}
 }
 
 void VulkanWindow::DoRender(vk::raii::CommandBuffer& /*cmdBuf*/)
@@ -658,23 +1312,29 @@ void VulkanWindow::SetFullscreen(bool fullscreen)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // ImGui hooks
 
+/*
+	The ImGui Vulkan backend idles the whole device when it creates or resizes the swapchain of a secondary viewport,
+	which requires every queue to be externally synchronized. So unlike the main window, these still have to keep all
+	other Vulkan activity out while they run.
+ */
+
 static void Mutexed_ImGui_ImplVulkan_CreateWindow(ImGuiViewport* viewport)
 {
-	lock_guard<shared_mutex> lock(g_vulkanActivityMutex);
+	lock_guard lock(g_vulkanActivityMutex);
 	g_vkComputeDevice->waitIdle();
 	ImGui_ImplVulkan_CreateWindow(viewport);
 }
 
 static void Mutexed_ImGui_ImplVulkan_DestroyWindow(ImGuiViewport* viewport)
 {
-	lock_guard<shared_mutex> lock(g_vulkanActivityMutex);
+	lock_guard lock(g_vulkanActivityMutex);
 	g_vkComputeDevice->waitIdle();
 	ImGui_ImplVulkan_DestroyWindow(viewport);
 }
 
 static void Mutexed_ImGui_ImplVulkan_SetWindowSize(ImGuiViewport* viewport, ImVec2 size)
 {
-	lock_guard<shared_mutex> lock(g_vulkanActivityMutex);
+	lock_guard lock(g_vulkanActivityMutex);
 	g_vkComputeDevice->waitIdle();
 	ImGui_ImplVulkan_SetWindowSize(viewport, size);
 }
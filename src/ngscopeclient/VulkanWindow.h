@@ -35,7 +35,10 @@
 #ifndef VulkanWindow_h
 #define VulkanWindow_h
 
+#include <condition_variable>
+
 class Texture;
+class VideoRecorder;
 
 /**
 	@brief A GLFW window containing a Vulkan surface
@@ -59,17 +62,86 @@ public:
 	{ return m_renderQueue; }
 
 	void AddTextureUsedThisFrame(std::shared_ptr<Texture> tex)
-	{ m_texturesUsedThisFrame[m_frameIndex].emplace(tex); }
+	{
+		if(m_renderThread)
+			m_uiTextures.emplace(tex);
+		else
+			m_texturesUsedThisFrame[m_frameIndex].emplace(tex);
+	}
 
 	bool IsFullscreen()
 	{ return m_fullscreen; }
 
+	void SetPresentMode(vk::PresentModeKHR mode);
+
+	/**
+		@brief Selects whether frames are submitted and presented by a separate render thread
+
+		Takes effect at the start of the next frame.
+	 */
+	void SetRenderThreadEnabled(bool enabled)
+	{ m_renderThreadRequested = enabled; }
+
+	///@brief Check if frames are currently being submitted by the render thread
+	bool IsRenderThreadRunning()
+	{ return m_renderThread != nullptr; }
+
+	///@brief Gets the present mode the swapchain is actually using (may differ from the requested one)
+	vk::PresentModeKHR GetPresentMode()
+	{ return m_presentMode; }
+
+	/**
+		@brief Gets the time from the start of the most recently completed frame until it finished rendering, in fs
+
+		Measured from when the frame started sampling input to when its fence was first seen signaled, so this is
+		an upper bound. Time spent waiting for scanout after that isn't included.
+	 */
+	int64_t GetLastFrameLatency()
+	{ return m_lastFrameLatency; }
+
+	bool StartVideoCapture(const std::string& command, const std::string& path, int fps);
+	void StopVideoCapture();
+
+	///@brief Check if the window contents are being recorded
+	bool IsCapturingVideo()
+	{ return m_recorder != nullptr; }
+
+	///@brief Check if the swapchain can be copied from, which video capture needs
+	bool IsVideoCaptureSupported()
+	{ return m_captureSupported; }
+
+	VideoRecorder* GetVideoRecorder()
+	{ return m_recorder.get(); }
+
+	///@brief Number of frames not captured because every staging buffer was still waiting on the encoder
+	size_t GetCaptureDroppedCount()
+	{ return m_captureDropped; }
+
 protected:
 	bool UpdateFramebuffer();
+	void WaitForRenderQueueIdle();
+	void CheckFrameComplete(uint32_t index, bool block);
 	void SetFullscreen(bool fullscreen);
 
+	void RecordAndSubmitFrame(ImDrawData* drawData, double frameStart);
+	bool PresentFrame();
+
+	void StartRenderThread();
+	void StopRenderThread();
+	void RenderThread();
+	void QueueFrame(ImDrawData* drawData, double frameStart);
+	void SubmitQueuedFrame();
+	void ReleaseTextures(std::set<std::shared_ptr<Texture> >&& textures);
+	void WaitForRenderThreadIdle();
+	void WaitForPreviousFrame();
+	void PollPresented();
+
 	virtual void DoRender(vk::raii::CommandBuffer& cmdBuf);
 	virtual void RenderUI();
+	virtual void OnFramePresented(double presentTime);
+
+	void RecordCapture(vk::raii::CommandBuffer& cmdBuf, double frameStart);
+	void HandOffCaptures(int completedFence);
 
 	///@brief The underlying GLFW window object
 	GLFWwindow* m_window;
@@ -77,6 +149,9 @@ protected:
 	///@brief ImGui context for GUI objects
 	ImGuiContext* m_context;
 
+	///@brief ImPlot context for plots
+	ImPlotContext* m_plotContext;
+
 	///@brief Surface for drawing onto
 	std::shared_ptr<vk::raii::SurfaceKHR> m_surface;
 
@@ -86,8 +161,8 @@ protected:
 	///@brief Queue for rendering to
 	std::shared_ptr<QueueHandle> m_renderQueue;
 
-	///@brief Set true if we have to handle a resize event
-	bool m_resizeEventPending;
+	///@brief Set true if we have to handle a resize event (by the render thread too, if the swapchain goes out of date)
+	std::atomic<bool> m_resizeEventPending;
 
 	///@brief Set true if a resize was requested by software (i.e. we need to resize to m_pendingWidth / m_pendingHeight)
 	bool m_softwareResizeRequested;
@@ -122,6 +197,18 @@ protected:
 	///@brief Frame fences
 	std::vector<std::unique_ptr<vk::raii::Fence> > m_fences;
 
+	///@brief Start time of the frame last submitted with each fence, or zero if it's been seen complete
+	std::vector<double> m_frameStartTimes;
+
+	///@brief Latency of the most recently completed frame, in fs (see GetLastFrameLatency())
+	std::atomic<int64_t> m_lastFrameLatency;
+
+	///@brief Present mode requested by the application
+	vk::PresentModeKHR m_requestedPresentMode;
+
+	///@brief Present mode of the current swapchain
+	vk::PresentModeKHR m_presentMode;
+
 	///@brief Back buffer view
 	std::vector<std::unique_ptr<vk::raii::ImageView> > m_backBufferViews;
 
@@ -173,6 +260,125 @@ protected:
 	///@brief Textures used this frame
 	std::vector< std::set<std::shared_ptr<Texture> > > m_texturesUsedThisFrame;
 
+	/**
+		@brief A frame built by the UI thread, waiting for the render thread to submit it
+
+		The draw lists are copies, since ImGui reuses its own as soon as the next frame starts.
+	 */
+	class QueuedFrame
+	{
+	public:
+		QueuedFrame()
+			: m_frameStart(0)
+		{}
+
+		~QueuedFrame()
+		{
+			for(auto list : m_drawData.CmdLists)
+				IM_DELETE(list);
+		}
+
+		///@brief Copy of ImGui's draw data for the main viewport, owning its draw lists
+		ImDrawData m_drawData;
+
+		///@brief Textures the frame draws from, kept alive until the GPU is done with them
+		std::set<std::shared_ptr<Texture> > m_textures;
+
+		///@brief Time the UI thread started building the frame
+		double m_frameStart;
+	};
+
+	///@brief Render thread, if frames are submitted from one (null if the UI thread submits them itself)
+	std::unique_ptr<std::thread> m_renderThread;
+
+	///@brief True if the render thread should be running (see SetRenderThreadEnabled())
+	bool m_renderThreadRequested;
+
+	///@brief Mutex protecting m_queuedFrame, m_renderThreadBusy, m_renderThreadTerminating and m_releasedTextures
+	std::mutex m_renderThreadMutex;
+
+	///@brief Signaled whenever a frame is queued, the render thread picks one up or finishes one, or it should exit
+	std::condition_variable m_renderThreadWake;
+
+	///@brief The next frame for the render thread to submit, if the UI thread got ahead of it
+	std::unique_ptr<QueuedFrame> m_queuedFrame;
+
+	///@brief True while the render thread is submitting or presenting a frame
+	bool m_renderThreadBusy;
+
+	///@brief Set to tell the render thread to exit once it's out of frames
+	bool m_renderThreadTerminating;
+
+	///@brief Textures used by the frame the UI thread is building, when the render thread is running
+	std::set<std::shared_ptr<Texture> > m_uiTextures;
+
+	/**
+		@brief Textures the render thread is done with, for the UI thread to drop (see PollPresented())
+
+		Dropping the last reference to a texture removes it from the imgui backend, which isn't thread safe, so
+		this has to happen on the same thread which adds them.
+	 */
+	std::vector< std::set<std::shared_ptr<Texture> > > m_releasedTextures;
+
+	///@brief Number of frames the render thread has presented
+	std::atomic<uint64_t> m_presentCount;
+
+	///@brief Value of m_presentCount when the UI thread last called OnFramePresented()
+	uint64_t m_presentCountSeen;
+
+	///@brief Time the render thread last presented a frame
+	std::atomic<double> m_lastPresentTime;
+
+	///@brief A host visible buffer the composed frame is copied into for video capture
+	class CaptureBuffer
+	{
+	public:
+		CaptureBuffer()
+			: m_ptr(nullptr)
+			, m_coherent(true)
+			, m_pending(false)
+			, m_fenceIndex(0)
+			, m_timestamp(0)
+			, m_busy(false)
+		{}
+
+		std::unique_ptr<vk::raii::Buffer> m_buffer;
+		std::unique_ptr<vk::raii::DeviceMemory> m_memory;
+
+		///@brief Persistent mapping of m_memory
+		uint8_t* m_ptr;
+
+		///@brief False if the mapping has to be invalidated before reading
+		bool m_coherent;
+
+		///@brief True if a copy into this buffer has been submitted but not handed to the recorder yet
+		bool m_pending;
+
+		///@brief Index of the frame fence which signals when the copy is done
+		uint32_t m_fenceIndex;
+
+		///@brief Start time of the frame captured into this buffer
+		double m_timestamp;
+
+		///@brief True while the recorder is reading from the buffer
+		std::atomic<bool> m_busy;
+	};
+
+	///@brief Ring of staging buffers for video capture, so readback never waits on the GPU or the encoder
+	std::vector<std::unique_ptr<CaptureBuffer> > m_captureBuffers;
+
+	///@brief The video encoder, if recording (declared after m_captureBuffers so it's destroyed first)
+	std::unique_ptr<VideoRecorder> m_recorder;
+
+	///@brief True if the swapchain images can be used as a transfer source
+	bool m_captureSupported;
+
+	///@brief True if the swapchain is BGRA rather than RGBA
+	bool m_surfaceIsBGRA;
+
+	///@brief Number of frames skipped because no capture buffer was free
+	size_t m_captureDropped;
+
 };
 
 #endif
@@ -0,0 +1,405 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformAccumulateFilter
+ */
+
+#include "ngscopeclient.h"
+#include "WaveformAccumulateFilter.h"
+#include "HistoryManager.h"
+
+using namespace std;
+
+///@brief Most thread blocks dispatched in X before wrapping into Y
+static const size_t ACCUMULATE_MAX_X_BLOCKS = 32768;
+
+///@brief Most downloaded points we'll hold on to if the filter isn't being refreshed
+static const size_t ACCUMULATE_MAX_PENDING = 256;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformAccumulateFilter::WaveformAccumulateFilter(const string& color)
+	: Filter(color, CAT_MATH)
+	, m_depthName("Depth")
+	, m_depth(-1)
+	, m_seedRequested(false)
+	, m_seedReady(false)
+	, m_lastTime(0, 0)
+	, m_count(0)
+	, m_length(0)
+	, m_sum("WaveformAccumulateFilter.sum")
+	, m_min("WaveformAccumulateFilter.min")
+	, m_max("WaveformAccumulateFilter.max")
+{
+	AddStream(Unit(Unit::UNIT_VOLTS), "average", Stream::STREAM_TYPE_ANALOG);
+	AddStream(Unit(Unit::UNIT_VOLTS), "min", Stream::STREAM_TYPE_ANALOG);
+	AddStream(Unit(Unit::UNIT_VOLTS), "max", Stream::STREAM_TYPE_ANALOG);
+	CreateInput("din");
+
+	m_parameters[m_depthName] = FilterParameter(FilterParameter::TYPE_INT, Unit(Unit::UNIT_COUNTS));
+	m_parameters[m_depthName].SetIntVal(0);
+
+	//The running state is never needed on the CPU
+	m_sum.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+	m_sum.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_min.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+	m_min.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_max.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+	m_max.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+
+	m_accumulatePipeline = make_shared<ComputePipeline>(
+		"shaders/WaveformAccumulate.spv", 7, sizeof(WaveformAccumulateArgs));
+}
+
+WaveformAccumulateFilter::~WaveformAccumulateFilter()
+{
+	lock_guard<mutex> lock(m_mutex);
+	Release(m_pending);
+	Release(m_window);
+	Release(m_seed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Factory methods
+
+bool WaveformAccumulateFilter::ValidateChannel(size_t i, StreamDescriptor stream)
+{
+	if(stream.m_channel == nullptr)
+		return false;
+
+	//History only stores instrument waveforms, so we can't rebuild anything else from it
+	if(dynamic_cast<Filter*>(stream.m_channel) != nullptr)
+		return false;
+
+	return (i == 0) && (stream.GetType() == Stream::STREAM_TYPE_ANALOG);
+}
+
+string WaveformAccumulateFilter::GetProtocolName()
+{
+	return "Accumulate";
+}
+
+Filter::DataLocation WaveformAccumulateFilter::GetInputLocation()
+{
+	//We read the waveforms out of history rather than the input
+	return LOC_DONTCARE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Feeding acquisitions in
+
+/**
+	@brief Queues a newly downloaded point to be accumulated by the next Refresh()
+
+	Called by the WaveformThread for every acquisition, including each segment of a segmented capture (which only
+	runs the filter graph once). The point is held until it's been accumulated.
+ */
+void WaveformAccumulateFilter::OnNewPoint(shared_ptr<HistoryPoint> pt)
+{
+	auto wfm = FindInput(pt.get());
+	if(!wfm || wfm->empty())
+		return;
+
+	lock_guard<mutex> lock(m_mutex);
+	pt->m_readerRefs ++;
+	m_pending.push_back(Entry{pt, wfm});
+
+	//Don't pin an unbounded amount of history if nothing is refreshing us
+	while(m_pending.size() > ACCUMULATE_MAX_PENDING)
+	{
+		m_pending.front().m_point->ReleaseReader();
+		m_pending.pop_front();
+	}
+}
+
+/**
+	@brief Gathers the points needed to rebuild the state from history, after the depth has changed
+
+	Must be called from the GUI thread (since it walks the history list) with the waveform writer and data mutexes
+	held. The rebuild itself is done by the next Refresh().
+ */
+void WaveformAccumulateFilter::Seed(HistoryManager& history)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(!m_seedRequested)
+		return;
+	m_seedRequested = false;
+
+	Release(m_seed);
+	for(auto it = history.m_history.rbegin(); it != history.m_history.rend(); it++)
+	{
+		if( (m_depth > 0) && (m_seed.size() >= (size_t)m_depth) )
+			break;
+
+		//Don't go loading points from disk just for this
+		auto pt = *it;
+		if(!pt->IsResident() || pt->IsLoading())
+			continue;
+		auto wfm = FindInput(pt.get());
+		if(!wfm)
+			continue;
+
+		//Bring the samples back where the shader can get at them, same as loading the point would
+		history.Expand(pt.get());
+		if(wfm->empty())
+			continue;
+		if(pt->m_tier != HistoryPoint::TIER_GPU)
+			pt->SetTier(HistoryPoint::TIER_GPU);
+
+		pt->m_readerRefs ++;
+		m_seed.push_front(Entry{pt, wfm});
+	}
+	m_seedReady = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Actual decoder logic
+
+void WaveformAccumulateFilter::ClearSweeps()
+{
+	lock_guard<mutex> lock(m_mutex);
+	Release(m_window);
+	m_count = 0;
+	m_length = 0;
+	ClearOutputs();
+}
+
+void WaveformAccumulateFilter::Refresh(vk::raii::CommandBuffer& cmdBuf, shared_ptr<QueueHandle> queue)
+{
+	if(!VerifyAllInputsOK())
+	{
+		ClearOutputs();
+		return;
+	}
+	for(size_t i=0; i<3; i++)
+		SetYAxisUnits(GetInput(0).GetYAxisUnits(), i);
+
+	lock_guard<mutex> lock(m_mutex);
+
+	//Rebuild from history as soon as the depth changes, rather than waiting for the window to refill
+	auto depth = max((int64_t)0, m_parameters[m_depthName].GetIntVal());
+	if(depth != m_depth)
+	{
+		m_depth = depth;
+		m_seedRequested = true;
+		m_seedReady = false;
+		Release(m_seed);
+	}
+
+	bool reset = false;
+	if(m_seedReady)
+	{
+		//Points still pending may already be in history, don't count them twice
+		Release(m_window);
+		m_window.swap(m_seed);
+		m_seedReady = false;
+		m_count = 0;
+		m_length = 0;
+		m_lastTime = m_window.empty() ? TimePoint(0, 0) : m_window.back().m_point->m_time;
+		reset = true;
+	}
+
+	//Pick up new acquisitions. Anything older than what we already have is history being replayed or reloaded.
+	size_t firstNew = m_window.size();
+	while(!m_pending.empty())
+	{
+		auto e = m_pending.front();
+		m_pending.pop_front();
+		if(!(m_lastTime < e.m_point->m_time))
+		{
+			e.m_point->ReleaseReader();
+			continue;
+		}
+		m_lastTime = e.m_point->m_time;
+		m_window.push_back(e);
+	}
+
+	//Start over if the record length changed
+	for(size_t i=0; i<m_window.size(); i++)
+	{
+		if(m_window[i].m_wfm->size() == m_window.back().m_wfm->size())
+			continue;
+
+		m_window[i].m_point->ReleaseReader();
+		m_window.erase(m_window.begin() + i);
+		i --;
+		if(firstNew > 0)
+			firstNew --;
+		reset = true;
+	}
+	if(!m_window.empty() && (m_window.back().m_wfm->size() != m_length))
+		reset = true;
+
+	//Slide the window
+	while( (m_depth > 0) && (m_window.size() > (size_t)m_depth) )
+	{
+		m_window.front().m_point->ReleaseReader();
+		m_window.pop_front();
+		reset = true;
+	}
+
+	//Nothing new, keep whatever we last output
+	if(!reset && (firstNew == m_window.size()) )
+		return;
+
+	vector<UniformAnalogWaveform*> wfms;
+	for(size_t i = (reset ? 0 : firstNew); i<m_window.size(); i++)
+		wfms.push_back(m_window[i].m_wfm);
+	if(wfms.empty())
+	{
+		m_count = 0;
+		m_length = 0;
+		ClearOutputs();
+		return;
+	}
+
+	Accumulate(cmdBuf, queue, wfms, reset, m_window.back().m_wfm);
+
+	//With no depth limit nothing ever needs to be rebuilt, so don't pin the points in history
+	if(m_depth == 0)
+		Release(m_window);
+}
+
+/**
+	@brief Folds a batch of waveforms into the running state and outputs the result
+
+	Everything is recorded into one command buffer, so rebuilding the whole window is a single submit.
+
+	@param cmdBuf	Command buffer to record into
+	@param queue	Queue the command buffer will be submitted to
+	@param wfms		Waveforms to add to the state, oldest first
+	@param reset	True to discard the existing state first
+	@param timebase	Waveform to copy timestamps and timebase of the outputs from
+ */
+void WaveformAccumulateFilter::Accumulate(
+	vk::raii::CommandBuffer& cmdBuf,
+	shared_ptr<QueueHandle> /*queue*/,
+	const vector<UniformAnalogWaveform*>& wfms,
+	bool reset,
+	WaveformBase* timebase)
+{
+	size_t len = timebase->size();
+	if(reset)
+	{
+		m_count = 0;
+		m_length = len;
+		m_sum.resize(len);
+		m_min.resize(len);
+		m_max.resize(len);
+	}
+	m_count += wfms.size();
+
+	UniformAnalogWaveform* outs[3];
+	for(size_t i=0; i<3; i++)
+	{
+		outs[i] = SetupEmptyUniformAnalogOutputWaveform(timebase, i);
+		outs[i]->Resize(len);
+	}
+
+	for(auto w : wfms)
+		w->m_samples.PrepareForGpuAccessNonblocking(false, cmdBuf);
+	m_sum.PrepareForGpuAccessNonblocking(true, cmdBuf);
+	m_min.PrepareForGpuAccessNonblocking(true, cmdBuf);
+	m_max.PrepareForGpuAccessNonblocking(true, cmdBuf);
+	AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(cmdBuf);
+
+	//Very deep waveforms can need more thread blocks than we can dispatch in one dimension
+	size_t xblocks = min<size_t>(GetComputeBlockCount(len, 64), ACCUMULATE_MAX_X_BLOCKS);
+	size_t yblocks = GetComputeBlockCount(len, xblocks*64);
+
+	WaveformAccumulateArgs args;
+	args.numSamples = len;
+	args.stride = xblocks*64;
+	args.scale = 1.0f / m_count;
+
+	m_accumulatePipeline->BindBufferNonblocking(1, m_sum, cmdBuf);
+	m_accumulatePipeline->BindBufferNonblocking(2, m_min, cmdBuf);
+	m_accumulatePipeline->BindBufferNonblocking(3, m_max, cmdBuf);
+	m_accumulatePipeline->BindBufferNonblocking(4, outs[0]->m_samples, cmdBuf, true);
+	m_accumulatePipeline->BindBufferNonblocking(5, outs[1]->m_samples, cmdBuf, true);
+	m_accumulatePipeline->BindBufferNonblocking(6, outs[2]->m_samples, cmdBuf, true);
+	for(size_t i=0; i<wfms.size(); i++)
+	{
+		args.mode = (reset && (i == 0)) ? WaveformAccumulateArgs::MODE_RESET : WaveformAccumulateArgs::MODE_ADD;
+		args.writeOutputs = (i+1 == wfms.size());
+
+		m_accumulatePipeline->BindBufferNonblocking(0, wfms[i]->m_samples, cmdBuf);
+		m_accumulatePipeline->Dispatch(cmdBuf, args, xblocks, yblocks);
+		m_accumulatePipeline->AddComputeMemoryBarrier(cmdBuf);
+	}
+
+	m_sum.MarkModifiedFromGpu();
+	m_min.MarkModifiedFromGpu();
+	m_max.MarkModifiedFromGpu();
+	for(size_t i=0; i<3; i++)
+		outs[i]->m_samples.MarkModifiedFromGpu();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+/**
+	@brief Finds the waveform for our input stream in a history point
+
+	@return The waveform, or null if the point doesn't have one
+ */
+UniformAnalogWaveform* WaveformAccumulateFilter::FindInput(HistoryPoint* pt)
+{
+	auto stream = GetInput(0);
+	if(stream.m_channel == nullptr)
+		return nullptr;
+
+	for(auto& it : pt->m_history)
+	{
+		auto jt = it.second.find(stream);
+		if(jt != it.second.end())
+			return dynamic_cast<UniformAnalogWaveform*>(jt->second);
+	}
+	return nullptr;
+}
+
+/**
+	@brief Lets go of a list of held points
+ */
+void WaveformAccumulateFilter::Release(deque<Entry>& entries)
+{
+	for(auto& e : entries)
+		e.m_point->ReleaseReader();
+	entries.clear();
+}
+
+void WaveformAccumulateFilter::ClearOutputs()
+{
+	for(size_t i=0; i<3; i++)
+		SetData(nullptr, i);
+}
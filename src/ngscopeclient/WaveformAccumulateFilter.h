@@ -0,0 +1,168 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformAccumulateFilter
+ */
+#ifndef WaveformAccumulateFilter_h
+#define WaveformAccumulateFilter_h
+
+class HistoryManager;
+class HistoryPoint;
+
+///@brief Push constants for WaveformAccumulate.glsl
+class WaveformAccumulateArgs
+{
+public:
+	enum Mode
+	{
+		///@brief Fold the input into the running state
+		MODE_ADD,
+
+		///@brief Replace the running state with the input
+		MODE_RESET
+	};
+
+	uint32_t numSamples;
+	uint32_t stride;
+	uint32_t mode;
+	uint32_t writeOutputs;
+	float scale;
+};
+
+/**
+	@brief Running average and min/max envelope of an instrument channel, kept in GPU memory
+
+	Each new acquisition is folded into the running sum, minimum, and maximum by a compute shader, so the cost per
+	acquisition doesn't depend on how many are being accumulated. Unlike persistence, the result is independent of
+	any view and survives zooming, panning, and clearing persistence.
+
+	A depth of zero accumulates everything since the filter was created (or its sweeps were cleared). A nonzero depth
+	keeps a window of the most recent acquisitions, which are held so history doesn't evict them. An envelope can't
+	have a waveform taken back out of it, so once the window is full the state is rebuilt from the whole window, as a
+	single batch of dispatches, every time it slides.
+
+	Changing the depth rebuilds from the points already in history, so the result is available immediately rather
+	than after another N triggers. Since history only stores instrument waveforms, only those can be accumulated.
+ */
+class WaveformAccumulateFilter : public Filter
+{
+public:
+	WaveformAccumulateFilter(const std::string& color);
+	virtual ~WaveformAccumulateFilter();
+
+	virtual void Refresh(vk::raii::CommandBuffer& cmdBuf, std::shared_ptr<QueueHandle> queue) override;
+	virtual DataLocation GetInputLocation() override;
+
+	static std::string GetProtocolName();
+
+	virtual bool ValidateChannel(size_t i, StreamDescriptor stream) override;
+	virtual void ClearSweeps() override;
+
+	void OnNewPoint(std::shared_ptr<HistoryPoint> pt);
+
+	/**
+		@brief Check if the filter is waiting for Seed() to be called
+	 */
+	bool NeedsSeed()
+	{ return m_seedRequested; }
+
+	void Seed(HistoryManager& history);
+
+	PROTOCOL_DECODER_INITPROC(WaveformAccumulateFilter)
+
+protected:
+
+	///@brief An acquisition in the accumulation window
+	class Entry
+	{
+	public:
+		std::shared_ptr<HistoryPoint> m_point;
+		UniformAnalogWaveform* m_wfm;
+	};
+
+	UniformAnalogWaveform* FindInput(HistoryPoint* pt);
+	void Release(std::deque<Entry>& entries);
+	void ClearOutputs();
+
+	void Accumulate(
+		vk::raii::CommandBuffer& cmdBuf,
+		std::shared_ptr<QueueHandle> queue,
+		const std::vector<UniformAnalogWaveform*>& wfms,
+		bool reset,
+		WaveformBase* timebase);
+
+	///@brief Name of the depth parameter
+	std::string m_depthName;
+
+	///@brief Guards everything below, since points arrive from the WaveformThread and seeds from the GUI thread
+	std::mutex m_mutex;
+
+	///@brief Depth the current state was built with (-1 if nothing has been built yet)
+	int64_t m_depth;
+
+	///@brief Acquisitions downloaded but not accumulated yet, oldest first
+	std::deque<Entry> m_pending;
+
+	///@brief Acquisitions in the window, oldest first (only kept for a nonzero depth)
+	std::deque<Entry> m_window;
+
+	///@brief Points gathered from history by Seed(), oldest first
+	std::deque<Entry> m_seed;
+
+	///@brief True if Seed() needs to be called
+	std::atomic<bool> m_seedRequested;
+
+	///@brief True if m_seed is ready to be used by the next Refresh()
+	bool m_seedReady;
+
+	///@brief Timestamp of the newest acquisition accumulated so far
+	TimePoint m_lastTime;
+
+	///@brief Number of acquisitions in the running state
+	size_t m_count;
+
+	///@brief Number of samples in the running state
+	size_t m_length;
+
+	///@brief Running sum of every accumulated waveform
+	AcceleratorBuffer<float> m_sum;
+
+	///@brief Running minimum of every accumulated waveform
+	AcceleratorBuffer<float> m_min;
+
+	///@brief Running maximum of every accumulated waveform
+	AcceleratorBuffer<float> m_max;
+
+	std::shared_ptr<ComputePipeline> m_accumulatePipeline;
+};
+
+#endif
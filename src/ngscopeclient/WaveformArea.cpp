@@ -34,7 +34,10 @@
  */
 #include "ngscopeclient.h"
 #include "WaveformArea.h"
+#include "BufferTransferTracker.h"
 #include "MainWindow.h"
+#include "MaskTester.h"
+#include "WaveformKind.h"
 #include "../../scopehal/TwoLevelTrigger.h"
 #include "../../scopeprotocols/ConstellationFilter.h"
 #include "../../scopeprotocols/EyePattern.h"
@@ -44,77 +47,197 @@
 
 #include "imgui_internal.h"	//for SetItemUsingMouseWheel
 
+#include <cinttypes>
+
 using namespace std;
 
+///@brief log2 of the number of samples in each bin of the finest min/max pyramid level
+static const size_t PYRAMID_FIRST_LEVEL = 4;
+
+///@brief Minimum number of pyramid bins per pixel column, so we never lose peaks
+static const double PYRAMID_MIN_BINS_PER_PIXEL = 4;
+
+///@brief Pyramid levels smaller than this aren't worth building
+static const size_t PYRAMID_MIN_BINS = 4096;
+
+///@brief Maximum number of thread blocks in the X dimension of a pyramid build dispatch
+static const size_t PYRAMID_MAX_X_BLOCKS = 32768;
+
+///@brief Number of samples per block of packed sparse timestamps. Must match SPARSE_PACK_BLOCK in the shaders.
+static const size_t SPARSE_PACK_BLOCK = 1024;
+
+///@brief Sparse waveforms shorter than this are drawn from their 64-bit timestamps, packing isn't worth it
+static const size_t SPARSE_PACK_MIN_SAMPLES = 16384;
+
+///@brief Maximum number of thread blocks in the X dimension of a timestamp packing dispatch
+static const size_t SPARSE_PACK_MAX_X_BLOCKS = 32768;
+
+///@brief Number of time bins of the raw spectrogram merged into each time bin of the finest spectrogram pyramid level
+static const size_t SPECTROGRAM_PYRAMID_FIRST_FACTOR = 4;
+
+///@brief Minimum number of spectrogram pyramid time bins per pixel column, so short bursts aren't lost
+static const double SPECTROGRAM_PYRAMID_MIN_BINS_PER_PIXEL = 2;
+
+///@brief Spectrogram pyramid levels with fewer time bins than this aren't worth building
+static const size_t SPECTROGRAM_PYRAMID_MIN_COLUMNS = 1024;
+
+///@brief Maximum number of thread blocks in the Y dimension of a spectrogram pyramid build dispatch
+static const size_t SPECTROGRAM_PYRAMID_MAX_Y_BLOCKS = 32768;
+
+///@brief Most samples (or bins of the previous pass) merged into one bin by each pass of the overview reduction
+static const size_t OVERVIEW_MAX_FACTOR = 256;
+
+///@brief Number of planes (sample count, red, green, blue) in a rasterized protocol waveform
+static const size_t PROTOCOL_RASTER_PLANES = 4;
+
+///@brief Number of rows drawn by each workgroup of the waveform rasterization shader (MAX_HEIGHT in the shader)
+static const size_t RASTER_TILE_HEIGHT = 2048;
+
+///@brief Fraction of the requested size added as slack when growing raster buffers and textures
+static const size_t RESIZE_SLACK_DIVISOR = 8;
+
+/**
+	@brief Gets the capacity to allocate for a raster buffer or texture dimension, leaving room to grow
+
+	While a splitter or the window is being dragged, the size changes a little every frame. Allocating with some slack
+	(and only shrinking once the size falls below half the capacity) means most of those frames reuse what's there.
+ */
+static size_t GetResizeCapacity(size_t n)
+{
+	return n + n / RESIZE_SLACK_DIVISOR + 8;
+}
+
+/**
+	@brief Checks if an allocation of a given capacity can be reused for a new size
+ */
+static bool FitsResizeCapacity(size_t n, size_t capacity)
+{
+	return (n <= capacity) && (n * 2 >= capacity);
+}
+
+///@brief Time, in seconds, a peak label takes to fade out after the peak disappears
+static const double PEAK_FADE_TIME = 1;
+
+///@brief Time, in seconds, after a peak disappears before its label is deleted
+static const double PEAK_GC_TIME = 2;
+
+/**
+	@brief Fills the color cache of a protocol waveform
+
+	The GUI thread (cell layout) and the WaveformThread (GPU rasterization) both need the colors, so make sure they
+	don't try to fill the cache at the same time.
+ */
+static void CacheProtocolColors(SparseWaveformBase* data)
+{
+	static mutex cacheMutex;
+	lock_guard<mutex> lock(cacheMutex);
+	data->CacheColors();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // DisplayedChannel
 
 DisplayedChannel::DisplayedChannel(StreamDescriptor stream, Session& session)
-		: m_colorRamp("eye-gradient-viridis")
+		: m_peakSource(nullptr)
+		, m_peakRevision(0)
+		, m_colorRamp("eye-gradient-viridis")
 		, m_stream(stream)
 		, m_session(session)
-		, m_rasterizedWaveform("DisplayedChannel.m_rasterizedWaveform")
+		, m_rasterizedWaveform0("DisplayedChannel.m_rasterizedWaveform0")
+		, m_rasterizedWaveform1("DisplayedChannel.m_rasterizedWaveform1")
+		, m_frontBuffer(0)
+		, m_backBufferReady(false)
 		, m_indexBuffer("DisplayedChannel.m_indexBuffer")
-		, m_rasterizedX(0)
-		, m_rasterizedY(0)
+		, m_indexTargets("DisplayedChannel.m_indexTargets")
+		, m_sparseRangeWaveform(nullptr)
+		, m_sparseRangeRevision(0)
+		, m_sparseFirstOffset(0)
+		, m_sparseLastOffset(0)
+		, m_packedHeaders("DisplayedChannel.m_packedHeaders")
+		, m_packedDeltas("DisplayedChannel.m_packedDeltas")
+		, m_packedDurations("DisplayedChannel.m_packedDurations")
+		, m_packedSource(nullptr)
+		, m_packedRevision(0)
+		, m_packedSize(0)
+		, m_packedHasDurations(false)
+		, m_protocolColors("DisplayedChannel.m_protocolColors")
+		, m_protocolColorsSource(nullptr)
+		, m_protocolColorsRevision(0)
+		, m_pyramidSource(nullptr)
+		, m_pyramidRevision(0)
+		, m_spectrogramPyramidSource(nullptr)
+		, m_spectrogramPyramidRevision(0)
+		, m_overview("DisplayedChannel.m_overview")
+		, m_overviewSource(nullptr)
+		, m_overviewRevision(0)
+		, m_overviewRequestedBins(0)
+		, m_overviewSamplesPerBin(1)
+		, m_rasterizedX{0, 0}
+		, m_rasterizedY{0, 0}
+		, m_rasterizedHalf{false, false}
+		, m_rasterizedXAxisOffset{0, 0}
+		, m_rasterizedPixelsPerX{0, 0}
+		, m_textureXAxisOffset(0)
+		, m_texturePixelsPerX(0)
+		, m_halfPrecisionPipelines(false)
+		, m_textureBytes(0)
+		, m_textureWidth(0)
+		, m_textureHeight(0)
 		, m_cachedX(0)
 		, m_cachedY(0)
 		, m_persistenceEnabled(false)
 		, m_yButtonPos(0)
+		, m_minmaxPyramidPref(session.GetPreferences(), "Performance.Rendering.minmax_pyramid")
+		, m_packedTimestampsPref(session.GetPreferences(), "Performance.Rendering.packed_sparse_timestamps")
 {
 	auto schan = dynamic_cast<OscilloscopeChannel*>(stream.m_channel);
 	if(schan)
 		schan->AddRef();
 
-	vk::CommandPoolCreateInfo cmdPoolInfo(
-		vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-		session.GetMainWindow()->GetRenderQueue()->m_family );
-	m_utilCmdPool = std::make_unique<vk::raii::CommandPool>(*g_vkComputeDevice, cmdPoolInfo);
-	vk::CommandBufferAllocateInfo bufinfo(**m_utilCmdPool, vk::CommandBufferLevel::ePrimary, 1);
-
-	m_utilCmdBuffer = make_unique<vk::raii::CommandBuffer>(
-			std::move(vk::raii::CommandBuffers(*g_vkComputeDevice, bufinfo).front()));
-
-	//Use GPU-side memory for rasterized waveform
-	//TODO: instead of using CPU-side mirror, use a shader to memset it when clearing?
-	m_rasterizedWaveform.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
-	m_rasterizedWaveform.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
-
-	//Use pinned memory for index buffer since it should only be read once
-	m_indexBuffer.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
-	m_indexBuffer.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_UNLIKELY);
-
-	//Create tone map pipeline depending on waveform type
-	switch(m_stream.GetType())
+	//Use GPU-side memory for rasterized waveform. It's cleared and copied on the GPU, the CPU-side mirror is only
+	//for the rare paths that read the image back
+	m_rasterizedWaveform0.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_rasterizedWaveform0.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_rasterizedWaveform1.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_rasterizedWaveform1.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+
+	//Index buffer is generated and consumed entirely on the GPU
+	m_indexBuffer.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+	m_indexBuffer.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	//Use pinned memory for index targets since they're written by the CPU and only read once
+	m_indexTargets.SetCpuAccessHint(AcceleratorBuffer<int64_t>::HINT_LIKELY);
+	m_indexTargets.SetGpuAccessHint(AcceleratorBuffer<int64_t>::HINT_UNLIKELY);
+
+	//Packed timestamps are built and consumed entirely on the GPU
+	m_packedHeaders.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+	m_packedHeaders.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_packedDeltas.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+	m_packedDeltas.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_packedDurations.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+	m_packedDurations.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	//Protocol colors only change when a new waveform arrives
+	m_protocolColors.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	m_protocolColors.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+
+	//The overview is reduced on the GPU and drawn from the CPU, the passes in between never leave the GPU
+	m_overview.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	m_overview.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	for(auto& buf : m_overviewScratch)
 	{
-		case Stream::STREAM_TYPE_EYE:
-			m_toneMapPipe = make_shared<ComputePipeline>(
-				"shaders/EyeToneMap.spv", 1, sizeof(EyeToneMapArgs), 1, 1);
-			break;
-
-		case Stream::STREAM_TYPE_CONSTELLATION:
-			m_toneMapPipe = make_shared<ComputePipeline>(
-				"shaders/ConstellationToneMap.spv", 1, sizeof(ConstellationToneMapArgs), 1, 1);
-			break;
-
-		case Stream::STREAM_TYPE_WATERFALL:
-			m_toneMapPipe = make_shared<ComputePipeline>(
-				"shaders/WaterfallToneMap.spv", 1, sizeof(WaterfallToneMapArgs), 1, 1);
-			break;
-
-		case Stream::STREAM_TYPE_SPECTROGRAM:
-			m_toneMapPipe = make_shared<ComputePipeline>(
-				"shaders/SpectrogramToneMap.spv", 1, sizeof(SpectrogramToneMapArgs), 1, 1);
-			break;
-
-		default:
-			m_toneMapPipe = make_shared<ComputePipeline>(
-				"shaders/WaveformToneMap.spv", 1, sizeof(WaveformToneMapArgs), 1);
+		buf.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+		buf.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
 	}
+
+	//The command pool and pipelines are created when first needed, so building a lot of views at once (e.g. when
+	//loading a session) doesn't stall on creating Vulkan objects for channels which may never be drawn
 }
 
 DisplayedChannel::~DisplayedChannel()
 {
+	ReleasePipelines();
+
 	auto schan = dynamic_cast<OscilloscopeChannel*>(m_stream.m_channel);
 	if(schan)
 	{
@@ -177,7 +300,7 @@ bool DisplayedChannel::UpdateSize(ImVec2 newSize, MainWindow* top)
 			{
 				eye->SetWidth(roundedX);
 				eye->SetHeight(roundedY);
-				eye->Refresh(*m_utilCmdBuffer, m_session.GetMainWindow()->GetRenderQueue());
+				eye->Refresh(GetUtilCmdBuffer(), m_session.GetMainWindow()->GetRenderQueue());
 			}
 
 			x = roundedX;
@@ -228,14 +351,30 @@ bool DisplayedChannel::UpdateSize(ImVec2 newSize, MainWindow* top)
 			y = roundedY;
 		}
 
-		LogTrace("Displayed channel resized (to %zu x %zu), reallocating texture\n", x, y);
+		//Waveforms we rasterize ourselves are tone mapped into the top left corner of the texture and drawn cropped
+		//to that, so the texture can be bigger than needed. Keep it unless the size has moved well past it.
+		size_t texX = x;
+		size_t texY = y;
+		bool cropped = IsRasterizedType();
+		if(cropped)
+		{
+			bool reuse = m_texture &&
+				FitsResizeCapacity(x, m_textureWidth) && FitsResizeCapacity(y, m_textureHeight);
+			if(reuse)
+				return true;
+
+			texX = GetResizeCapacity(x);
+			texY = GetResizeCapacity(y);
+		}
+
+		LogTrace("Displayed channel resized (to %zu x %zu), reallocating texture (%zu x %zu)\n", x, y, texX, texY);
 
 		//NOTE: Assumes the render queue is also capable of transfers (see QueueManager)
 		vk::ImageCreateInfo imageInfo(
 			{},
 			vk::ImageType::e2D,
 			vk::Format::eR32G32B32A32Sfloat,
-			vk::Extent3D(x, y, 1),
+			vk::Extent3D(texX, texY, 1),
 			1,
 			1,
 			VULKAN_HPP_NAMESPACE::SampleCountFlagBits::e1,
@@ -253,6 +392,9 @@ bool DisplayedChannel::UpdateSize(ImVec2 newSize, MainWindow* top)
 		//Make the new texture and mark that as in use too
 		m_texture = make_shared<Texture>(
 			*g_vkComputeDevice, imageInfo, top->GetTextureManager(), "DisplayedChannel.m_texture");
+		m_textureBytes = texX * texY * 4 * sizeof(float);
+		m_textureWidth = texX;
+		m_textureHeight = texY;
 		top->AddTextureUsedThisFrame(m_texture);
 
 		//Add a barrier to convert the image format to "general"
@@ -275,39 +417,903 @@ bool DisplayedChannel::UpdateSize(ImVec2 newSize, MainWindow* top)
 				{},
 				{},
 				barrier);
+
 		g_vkTransferCommandBuffer->end();
 		g_vkTransferQueue->SubmitAndBlock(*g_vkTransferCommandBuffer);
 
-		return true;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+	@brief Prepares to rasterize the waveform into the back buffer at the specified resolution
+
+	The back buffer is shown the next time SwapRasterizedWaveforms() is called.
+
+	@param cmdbuf			Command buffer the rasterization is being recorded into. Clearing or copying the back
+							buffer is recorded here, ahead of the rasterization shader.
+	@param x				Width of the image
+	@param y				Height of the image
+	@param halfPrecision	If true, pack the image as fp16 with two rows per 32-bit word, halving its size
+ */
+void DisplayedChannel::PrepareToRasterize(vk::raii::CommandBuffer& cmdbuf, size_t x, size_t y, bool halfPrecision)
+{
+	int front = m_frontBuffer;
+	int back = 1 - front;
+	auto& buf = GetRasterizedBuffer(back);
+
+	bool sizeChanged =
+		(m_rasterizedX[back] != x) || (m_rasterizedY[back] != y) || (m_rasterizedHalf[back] != halfPrecision);
+
+	m_rasterizedX[back] = x;
+	m_rasterizedY[back] = y;
+	m_rasterizedHalf[back] = halfPrecision;
+	m_backBufferReady = true;
+
+	size_t nwords = halfPrecision ? x * ( (y+1) / 2) : x*y;
+	if(sizeChanged)
+		ResizeRasterBuffer(buf, nwords);
+
+	//Persistence accumulates on top of the last image, which is in the front buffer
+	if( m_persistenceEnabled && (nwords > 0) &&
+		(m_rasterizedX[front] == x) && (m_rasterizedY[front] == y) && (m_rasterizedHalf[front] == halfPrecision) )
+	{
+		RecordCopyFromFront(cmdbuf);
+	}
+
+	//Otherwise fill a resized buffer with black (all zero bits is 0.0 in both formats) on the GPU, rather than
+	//clearing the CPU side and uploading the whole thing
+	else if(sizeChanged && (nwords > 0) )
+	{
+		buf.PrepareForGpuAccessNonblocking(true, cmdbuf);
+		cmdbuf.fillBuffer(buf.GetBuffer(), 0, nwords * sizeof(float), 0);
+		buf.MarkModifiedFromGpu();
+		AddRasterTransferBarrier(cmdbuf);
+	}
+
+	//Allocate index buffer for sparse waveforms
+	if(!IsDensePacked())
+	{
+		m_indexBuffer.resize(x);
+		m_indexTargets.resize(x);
+	}
+}
+
+/**
+	@brief Gets the RGBA color of each sample of a protocol waveform, updating it if the waveform has changed
+ */
+AcceleratorBuffer<uint32_t>& DisplayedChannel::GetProtocolColors(SparseWaveformBase* data)
+{
+	if( (m_protocolColorsSource == data) &&
+		(m_protocolColorsRevision == data->m_revision) &&
+		(m_protocolColors.size() == data->size()) )
+	{
+		return m_protocolColors;
+	}
+
+	CacheProtocolColors(data);
+
+	//Repack in a fixed byte order since IM_COL32 order is configurable
+	size_t len = data->size();
+	m_protocolColors.resize(len);
+	BufferTransferTracker::PrepareForCpuAccess("DisplayedChannel::GetProtocolColors", m_protocolColors);
+	for(size_t i=0; i<len; i++)
+	{
+		auto c = data->GetColorCached(i);
+		m_protocolColors[i] =
+			( (c >> IM_COL32_R_SHIFT) & 0xff ) |
+			( ( (c >> IM_COL32_G_SHIFT) & 0xff ) << 8) |
+			( ( (c >> IM_COL32_B_SHIFT) & 0xff ) << 16) |
+			(0xffu << 24);
+	}
+	m_protocolColors.MarkModifiedFromCpu();
+
+	m_protocolColorsSource = data;
+	m_protocolColorsRevision = data->m_revision;
+	return m_protocolColors;
+}
+
+/**
+	@brief Resizes a raster buffer, keeping some spare capacity so small changes in size don't reallocate it
+ */
+void DisplayedChannel::ResizeRasterBuffer(AcceleratorBuffer<float>& buf, size_t nwords)
+{
+	if(!FitsResizeCapacity(nwords, buf.capacity()))
+	{
+		buf.clear();
+		buf.shrink_to_fit();
+		buf.reserve(GetResizeCapacity(nwords));
+	}
+	buf.resize(nwords);
+}
+
+/**
+	@brief Records a copy of the front buffer into the back buffer, which must already be the same size
+ */
+void DisplayedChannel::RecordCopyFromFront(vk::raii::CommandBuffer& cmdbuf)
+{
+	auto& src = GetRasterizedBuffer(m_frontBuffer);
+	auto& dst = GetRasterizedBuffer(1 - m_frontBuffer);
+	if(dst.empty())
+		return;
+
+	src.PrepareForGpuAccessNonblocking(false, cmdbuf);
+	dst.PrepareForGpuAccessNonblocking(true, cmdbuf);
+	cmdbuf.copyBuffer(src.GetBuffer(), dst.GetBuffer(), vk::BufferCopy(0, 0, dst.size() * sizeof(float)));
+	dst.MarkModifiedFromGpu();
+	AddRasterTransferBarrier(cmdbuf);
+}
+
+/**
+	@brief Makes a clear or copy into a raster buffer visible to the shaders and transfers recorded after it
+ */
+void DisplayedChannel::AddRasterTransferBarrier(vk::raii::CommandBuffer& cmdbuf)
+{
+	vk::MemoryBarrier barrier(
+		vk::AccessFlagBits::eTransferWrite,
+		vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite |
+			vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite);
+	cmdbuf.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+		{},
+		barrier,
+		{},
+		{});
+}
+
+/**
+	@brief Copies the image in the front buffer into the back buffer, so only part of it needs to be redrawn
+
+	Must be called after PrepareToRasterize(). The copy is recorded into the same command buffer, ahead of the
+	rasterization shader.
+
+	@return False if the front buffer is a different size and can't be reused
+ */
+bool DisplayedChannel::KeepFrontImage(vk::raii::CommandBuffer& cmdbuf)
+{
+	int front = m_frontBuffer;
+	int back = 1 - front;
+	if( (m_rasterizedX[front] != m_rasterizedX[back]) ||
+		(m_rasterizedY[front] != m_rasterizedY[back]) ||
+		(m_rasterizedHalf[front] != m_rasterizedHalf[back]) )
+	{
+		return false;
+	}
+
+	//Persistence already copied it
+	if(!m_persistenceEnabled)
+		RecordCopyFromFront(cmdbuf);
+	return true;
+}
+
+/**
+	@brief Selects fp16 or fp32 output for the analog and digital rasterization pipelines
+
+	The pipelines are recreated the next time they're used if the format changed.
+ */
+void DisplayedChannel::SetHalfPrecisionRasterization(bool half)
+{
+	if(m_halfPrecisionPipelines == half)
+		return;
+
+	m_halfPrecisionPipelines = half;
+
+	auto& pool = m_session.GetPipelinePool();
+	pool.Release(m_uniformAnalogComputePipeline);
+	pool.Release(m_histogramComputePipeline);
+	pool.Release(m_sparseAnalogComputePipeline);
+	pool.Release(m_uniformDigitalComputePipeline);
+	pool.Release(m_sparseDigitalComputePipeline);
+	pool.Release(m_packedSparseAnalogComputePipeline);
+	pool.Release(m_packedSparseDigitalComputePipeline);
+}
+
+/**
+	@brief Gets the command buffer for one-off GPU work outside the render pass, creating it if necessary
+ */
+vk::raii::CommandBuffer& DisplayedChannel::GetUtilCmdBuffer()
+{
+	if(m_utilCmdBuffer == nullptr)
+	{
+		vk::CommandPoolCreateInfo cmdPoolInfo(
+			vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			m_session.GetMainWindow()->GetRenderQueue()->m_family );
+		m_utilCmdPool = std::make_unique<vk::raii::CommandPool>(*g_vkComputeDevice, cmdPoolInfo);
+		vk::CommandBufferAllocateInfo bufinfo(**m_utilCmdPool, vk::CommandBufferLevel::ePrimary, 1);
+
+		m_utilCmdBuffer = make_unique<vk::raii::CommandBuffer>(
+				std::move(vk::raii::CommandBuffers(*g_vkComputeDevice, bufinfo).front()));
+	}
+	return *m_utilCmdBuffer;
+}
+
+/**
+	@brief Gets a compute pipeline from the session's pool, creating it if there's no idle one for the shader
+ */
+shared_ptr<ComputePipeline> DisplayedChannel::GetPooledPipeline(const ComputePipelineKey& key)
+{
+	return m_session.GetPipelinePool().Get(key);
+}
+
+/**
+	@brief Gets the key of the tone map pipeline for our stream type
+ */
+ComputePipelineKey DisplayedChannel::GetToneMapPipelineKey()
+{
+	switch(m_stream.GetType())
+	{
+		case Stream::STREAM_TYPE_EYE:
+			return ComputePipelineKey("shaders/EyeToneMap.spv", 1, sizeof(EyeToneMapArgs), 1, 1);
+
+		case Stream::STREAM_TYPE_CONSTELLATION:
+			return ComputePipelineKey("shaders/ConstellationToneMap.spv", 1, sizeof(ConstellationToneMapArgs), 1, 1);
+
+		case Stream::STREAM_TYPE_WATERFALL:
+			return ComputePipelineKey("shaders/WaterfallToneMap.spv", 1, sizeof(WaterfallToneMapArgs), 1, 1);
+
+		case Stream::STREAM_TYPE_SPECTROGRAM:
+			return ComputePipelineKey("shaders/SpectrogramToneMap.spv", 1, sizeof(SpectrogramToneMapArgs), 1, 1);
+
+		case Stream::STREAM_TYPE_PROTOCOL:
+			return ComputePipelineKey("shaders/ProtocolToneMap.spv", 1, sizeof(ProtocolToneMapArgs), 1);
+
+		default:
+			return ComputePipelineKey("shaders/WaveformToneMap.spv", 1, sizeof(WaveformToneMapArgs), 1);
+	}
+}
+
+/**
+	@brief Gets the key of the pipeline for drawing uniform analog waveforms
+ */
+ComputePipelineKey DisplayedChannel::GetUniformAnalogPipelineKey(bool halfPrecision)
+{
+	string suffix;
+	if(ZeroHoldFlagSet())
+		suffix += ".zerohold";
+	if(g_hasShaderInt64)
+		suffix += ".int64";
+	if(halfPrecision)
+		suffix += ".half";
+	return ComputePipelineKey(
+		"shaders/waveform-compute.analog" + suffix + ".dense.spv", 2, sizeof(ConfigPushConstants));
+}
+
+/**
+	@brief Gets the key of the pipeline for drawing histogram waveforms
+ */
+ComputePipelineKey DisplayedChannel::GetHistogramPipelineKey(bool halfPrecision)
+{
+	string suffix;
+	if(g_hasShaderInt64)
+		suffix += ".int64";
+	if(halfPrecision)
+		suffix += ".half";
+	return ComputePipelineKey(
+		"shaders/waveform-compute.histogram" + suffix + ".dense.spv", 2, sizeof(ConfigPushConstants));
+}
+
+/**
+	@brief Gets the key of the pipeline for drawing sparse analog waveforms
+
+	@param halfPrecision	True if rasterizing at fp16
+	@param packed			True to draw from packed timestamps (see PackSparseTimestamps())
+ */
+ComputePipelineKey DisplayedChannel::GetSparseAnalogPipelineKey(bool halfPrecision, bool packed)
+{
+	string suffix;
+	int durationSSBOs = 0;
+	if(ZeroHoldFlagSet())
+	{
+		suffix += ".zerohold";
+		durationSSBOs++;
+	}
+	if(g_hasShaderInt64)
+		suffix += ".int64";
+	if(halfPrecision)
+		suffix += ".half";
+
+	//Packed variants add the block headers and deltas after the index buffer, and a packed copy of the durations
+	if(packed)
+	{
+		return ComputePipelineKey(
+			"shaders/waveform-compute.analog" + suffix + ".compact.spv",
+			2*durationSSBOs + 6,
+			sizeof(ConfigPushConstants));
+	}
+	return ComputePipelineKey(
+		"shaders/waveform-compute.analog" + suffix + ".spv", durationSSBOs + 4, sizeof(ConfigPushConstants));
+}
+
+/**
+	@brief Gets the key of the pipeline for drawing uniform digital waveforms
+ */
+ComputePipelineKey DisplayedChannel::GetUniformDigitalPipelineKey(bool halfPrecision)
+{
+	string suffix;
+	if(g_hasShaderInt64)
+		suffix += ".int64";
+	if(halfPrecision)
+		suffix += ".half";
+	return ComputePipelineKey(
+		"shaders/waveform-compute.digital" + suffix + ".dense.spv", 2, sizeof(ConfigPushConstants));
+}
+
+/**
+	@brief Gets the key of the pipeline for drawing sparse digital waveforms
+
+	@param halfPrecision	True if rasterizing at fp16
+	@param packed			True to draw from packed timestamps (see PackSparseTimestamps())
+ */
+ComputePipelineKey DisplayedChannel::GetSparseDigitalPipelineKey(bool halfPrecision, bool packed)
+{
+	string suffix;
+	int durationSSBOs = 0;	//TODO: support gaps
+	if(g_hasShaderInt64)
+		suffix += ".int64";
+	if(halfPrecision)
+		suffix += ".half";
+	if(packed)
+	{
+		return ComputePipelineKey(
+			"shaders/waveform-compute.digital" + suffix + ".compact.spv",
+			2*durationSSBOs + 6,
+			sizeof(ConfigPushConstants));
+	}
+	return ComputePipelineKey(
+		"shaders/waveform-compute.digital" + suffix + ".spv", durationSSBOs + 4, sizeof(ConfigPushConstants));
+}
+
+/**
+	@brief Gets the keys of every pipeline we expect to need to draw our stream
+
+	If there's no waveform yet, we don't know if it'll be uniform or sparse. Analog channels are almost always
+	uniform, but digital ones are common either way so both are included.
+
+	@param keys				Keys are appended to this
+	@param halfPrecision	True if rasterization is going to be done at fp16
+ */
+void DisplayedChannel::GetWarmupPipelineKeys(vector<ComputePipelineKey>& keys, bool halfPrecision)
+{
+	keys.push_back(GetToneMapPipelineKey());
+
+	bool known = (m_stream.GetData() != nullptr);
+	bool dense = IsDensePacked();
+
+	switch(m_stream.GetType())
+	{
+		case Stream::STREAM_TYPE_ANALOG:
+			if(known && !dense)
+			{
+				keys.push_back(GetSparseAnalogPipelineKey(halfPrecision));
+				keys.push_back(GetIndexPipelineKey());
+				if(m_packedTimestampsPref.Get())
+				{
+					keys.push_back(GetSparseAnalogPipelineKey(halfPrecision, true));
+					keys.push_back(GetTimestampPackPipelineKey());
+				}
+			}
+			else if(ShouldFillUnder())
+				keys.push_back(GetHistogramPipelineKey(halfPrecision));
+			else
+			{
+				keys.push_back(GetUniformAnalogPipelineKey(halfPrecision));
+				if(!ZeroHoldFlagSet())
+					keys.push_back(GetPyramidPipelineKey());
+			}
+			break;
+
+		case Stream::STREAM_TYPE_DIGITAL:
+			if(!known || dense)
+				keys.push_back(GetUniformDigitalPipelineKey(halfPrecision));
+			if(!known || !dense)
+			{
+				keys.push_back(GetSparseDigitalPipelineKey(halfPrecision));
+				keys.push_back(GetIndexPipelineKey());
+				if(m_packedTimestampsPref.Get())
+				{
+					keys.push_back(GetSparseDigitalPipelineKey(halfPrecision, true));
+					keys.push_back(GetTimestampPackPipelineKey());
+				}
+			}
+			break;
+
+		case Stream::STREAM_TYPE_PROTOCOL:
+			keys.push_back(GetProtocolRasterizePipelineKey());
+			keys.push_back(GetIndexPipelineKey());
+			break;
+
+		default:
+			break;
+	}
+}
+
+/**
+	@brief Returns all of our compute pipelines to the session's pool so the next channel created can reuse them
+
+	The session keeps channels alive until any rendering using them has completed, so by the time we're destroyed
+	nothing is still using the pipelines.
+ */
+void DisplayedChannel::ReleasePipelines()
+{
+	auto& pool = m_session.GetPipelinePool();
+	pool.Release(m_toneMapPipe);
+	pool.Release(m_uniformAnalogComputePipeline);
+	pool.Release(m_histogramComputePipeline);
+	pool.Release(m_sparseAnalogComputePipeline);
+	pool.Release(m_uniformDigitalComputePipeline);
+	pool.Release(m_sparseDigitalComputePipeline);
+	pool.Release(m_packedSparseAnalogComputePipeline);
+	pool.Release(m_packedSparseDigitalComputePipeline);
+	pool.Release(m_indexComputePipeline);
+	pool.Release(m_timestampPackPipeline);
+	pool.Release(m_pyramidComputePipeline);
+	pool.Release(m_protocolRasterizePipeline);
+}
+
+/**
+	@brief Gets the total size of both rasterized waveform buffers, in bytes
+
+	Must be called with the session's rasterized waveform mutex held.
+ */
+size_t DisplayedChannel::GetRasterMemoryUsage()
+{
+	return (m_rasterizedWaveform0.size() + m_rasterizedWaveform1.size()) * sizeof(float);
+}
+
+/**
+	@brief Makes the back buffer the front buffer, if anything was rendered into it since the last swap
+
+	Must be called from the WaveformThread with the session's rasterized waveform mutex held, once the commands
+	rendering into the back buffer have completed.
+ */
+void DisplayedChannel::SwapRasterizedWaveforms()
+{
+	m_rasterSource = m_nextRasterSource;
+
+	if(!m_backBufferReady)
+		return;
+
+	m_frontBuffer = 1 - m_frontBuffer;
+	m_backBufferReady = false;
+}
+
+/**
+	@brief Chooses another channel to show the rasterized image of instead of our own, starting from the next swap
+
+	@param source	Channel which rasterized the same image this pass, or null to show our own image
+ */
+void DisplayedChannel::SetRasterSource(shared_ptr<DisplayedChannel> source)
+{
+	m_nextRasterSource = source;
+}
+
+/**
+	@brief Gets the coarsest level of the min/max pyramid which can draw a waveform at the current zoom without loss
+
+	The pyramid is built on the GPU the first time it's needed for each new waveform.
+
+	@param data				The waveform being drawn
+	@param samplesPerPixel	Number of raw samples per X axis pixel at the current zoom
+	@param cmdbuf			Command buffer to record the pyramid build into, if it's needed
+
+	@return The pyramid level to draw, or nullptr to draw the raw samples
+ */
+UniformAnalogWaveform* DisplayedChannel::GetPyramidLevel(
+	UniformAnalogWaveform* data,
+	double samplesPerPixel,
+	vk::raii::CommandBuffer& cmdbuf)
+{
+	if(!m_minmaxPyramidPref.Get())
+	{
+		m_pyramid.clear();
+		m_pyramidSource = nullptr;
+		return nullptr;
+	}
+
+	//Don't bother unless we have enough samples per pixel for even the finest level to be useful
+	double binsPerPixel = samplesPerPixel / (1 << PYRAMID_FIRST_LEVEL);
+	if(binsPerPixel < PYRAMID_MIN_BINS_PER_PIXEL)
+		return nullptr;
+
+	if( (m_pyramidSource != data) || (m_pyramidRevision != data->m_revision) )
+		BuildPyramid(data, cmdbuf);
+	if(m_pyramid.empty())
+		return nullptr;
+
+	//Each level halves the number of bins, go as coarse as we can while keeping enough bins per pixel
+	size_t level = 0;
+	while( (level+1 < m_pyramid.size()) && (binsPerPixel / 2 >= PYRAMID_MIN_BINS_PER_PIXEL) )
+	{
+		level ++;
+		binsPerPixel /= 2;
+	}
+	return m_pyramid[level].get();
+}
+
+/**
+	@brief Gets a decimated copy of a trend filter output to draw instead of the raw samples
+
+	Trend filters keep appending to the same waveform, so only the samples added since the last call are decimated.
+	Other sparse waveforms are drawn as is, since they're usually replaced wholesale and would have to be decimated
+	from scratch every time.
+
+	@param data			The waveform being drawn
+	@param pixelsPerX	Horizontal zoom, in pixels per X axis unit
+
+	@return The decimated waveform to draw, or nullptr to draw the raw samples
+ */
+SparseAnalogWaveform* DisplayedChannel::GetTrendLevel(SparseAnalogWaveform* data, double pixelsPerX)
+{
+	if(!m_minmaxPyramidPref.Get() || (dynamic_cast<PausableFilter*>(m_stream.m_channel) == nullptr) )
+	{
+		m_trendStore.Clear();
+		return nullptr;
+	}
+
+	m_trendStore.Update(data);
+	return m_trendStore.GetLevel(pixelsPerX);
+}
+
+/**
+	@brief Builds the min/max pyramid for a waveform
+
+	Level 0 has bins of 2^PYRAMID_FIRST_LEVEL samples, and each level after that halves the number of bins. Levels
+	with fewer than PYRAMID_MIN_BINS bins aren't built, since the raw data is cheap enough to draw at that point.
+ */
+void DisplayedChannel::BuildPyramid(UniformAnalogWaveform* data, vk::raii::CommandBuffer& cmdbuf)
+{
+	m_pyramidSource = data;
+	m_pyramidRevision = data->m_revision;
+
+	if(m_pyramidComputePipeline == nullptr)
+		m_pyramidComputePipeline = GetPooledPipeline(GetPyramidPipelineKey());
+
+	AcceleratorBuffer<float>* input = &data->m_samples;
+	size_t inputLen = data->size();
+	size_t factor = 1 << PYRAMID_FIRST_LEVEL;
+	bool interleaved = false;
+	size_t nlevels = 0;
+	for(size_t shift = PYRAMID_FIRST_LEVEL; ; shift ++)
+	{
+		size_t outputLen = (inputLen + factor - 1) / factor;
+		if(outputLen < PYRAMID_MIN_BINS)
+			break;
+
+		if(m_pyramid.size() <= nlevels)
+		{
+			auto wfm = make_unique<UniformAnalogWaveform>();
+			wfm->m_samples.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+			wfm->m_samples.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+			m_pyramid.push_back(std::move(wfm));
+		}
+
+		//Min of each bin goes at the start of the bin, max halfway through it
+		auto level = m_pyramid[nlevels].get();
+		level->m_timescale = data->m_timescale << (shift - 1);
+		level->m_triggerPhase = data->m_triggerPhase;
+		level->m_startTimestamp = data->m_startTimestamp;
+		level->m_startFemtoseconds = data->m_startFemtoseconds;
+		level->m_flags = data->m_flags;
+		level->m_revision = data->m_revision;
+		level->Resize(2 * outputLen);
+
+		//Very deep waveforms can need more thread blocks than we can dispatch in one dimension
+		size_t xblocks = min<size_t>(GetComputeBlockCount(outputLen, 64), PYRAMID_MAX_X_BLOCKS);
+		size_t yblocks = GetComputeBlockCount(outputLen, xblocks*64);
+
+		WaveformPyramidArgs args(inputLen, outputLen, factor, interleaved, xblocks*64);
+		m_pyramidComputePipeline->BindBufferNonblocking(0, *input, cmdbuf);
+		m_pyramidComputePipeline->BindBufferNonblocking(1, level->m_samples, cmdbuf, true);
+		m_pyramidComputePipeline->Dispatch(cmdbuf, args, xblocks, yblocks);
+		m_pyramidComputePipeline->AddComputeMemoryBarrier(cmdbuf);
+		level->m_samples.MarkModifiedFromGpu();
+
+		input = &level->m_samples;
+		inputLen = outputLen;
+		factor = 2;
+		interleaved = true;
+		nlevels ++;
+	}
+
+	m_pyramid.resize(nlevels);
+}
+
+/**
+	@brief Gets the coarsest level of the spectrogram pyramid which can be tone mapped at the current zoom without loss
+
+	The tone map keeps the brightest bin under each pixel, but only looks at so many of them. Zoomed out far enough
+	on a long spectrogram, it would otherwise skip most of the input and alias.
+
+	@param data			The spectrogram being drawn
+	@param binsPerPixel	Number of time bins of the raw spectrogram per X axis pixel at the current zoom
+	@param cmdbuf		Command buffer to record the pyramid build into, if it's needed
+	@param width		Set to the number of time bins in the returned level
+	@param factor		Set to the number of raw time bins merged into each time bin of the returned level
+
+	@return The pyramid level to tone map, or nullptr to tone map the raw spectrogram
+ */
+AcceleratorBuffer<float>* DisplayedChannel::GetSpectrogramLevel(
+	SpectrogramWaveform* data,
+	double binsPerPixel,
+	vk::raii::CommandBuffer& cmdbuf,
+	size_t& width,
+	size_t& factor)
+{
+	if(!m_minmaxPyramidPref.Get())
+	{
+		m_spectrogramPyramid.clear();
+		m_spectrogramPyramidWidths.clear();
+		m_spectrogramPyramidSource = nullptr;
+		return nullptr;
+	}
+
+	double levelBinsPerPixel = binsPerPixel / SPECTROGRAM_PYRAMID_FIRST_FACTOR;
+	if(levelBinsPerPixel < SPECTROGRAM_PYRAMID_MIN_BINS_PER_PIXEL)
+		return nullptr;
+
+	if( (m_spectrogramPyramidSource != data) || (m_spectrogramPyramidRevision != data->m_revision) )
+		BuildSpectrogramPyramid(data, cmdbuf);
+	if(m_spectrogramPyramid.empty())
+		return nullptr;
+
+	//Each level halves the number of time bins, go as coarse as we can while keeping enough of them per pixel
+	size_t level = 0;
+	factor = SPECTROGRAM_PYRAMID_FIRST_FACTOR;
+	while( (level+1 < m_spectrogramPyramid.size()) &&
+		(levelBinsPerPixel / 2 >= SPECTROGRAM_PYRAMID_MIN_BINS_PER_PIXEL) )
+	{
+		level ++;
+		factor *= 2;
+		levelBinsPerPixel /= 2;
+	}
+	width = m_spectrogramPyramidWidths[level];
+	return m_spectrogramPyramid[level].get();
+}
+
+/**
+	@brief Builds the decimation pyramid for a spectrogram
+
+	Level 0 merges SPECTROGRAM_PYRAMID_FIRST_FACTOR time bins, and each level after that halves the number of time
+	bins again, so the whole pyramid takes about a third of the memory of the spectrogram itself. Levels with fewer
+	than SPECTROGRAM_PYRAMID_MIN_COLUMNS time bins aren't built.
+ */
+void DisplayedChannel::BuildSpectrogramPyramid(SpectrogramWaveform* data, vk::raii::CommandBuffer& cmdbuf)
+{
+	m_spectrogramPyramidSource = data;
+	m_spectrogramPyramidRevision = data->m_revision;
+
+	if(m_spectrogramPyramidPipeline == nullptr)
+	{
+		m_spectrogramPyramidPipeline = make_shared<ComputePipeline>(
+			"shaders/SpectrogramPyramid.spv", 2, sizeof(SpectrogramPyramidArgs));
+	}
+
+	AcceleratorBuffer<float>* input = &data->GetOutData();
+	size_t inputWidth = data->GetWidth();
+	size_t height = data->GetHeight();
+	size_t factor = SPECTROGRAM_PYRAMID_FIRST_FACTOR;
+	size_t nlevels = 0;
+	while(true)
+	{
+		size_t outputWidth = (inputWidth + factor - 1) / factor;
+		if( (outputWidth < SPECTROGRAM_PYRAMID_MIN_COLUMNS) || (height == 0) )
+			break;
+
+		if(m_spectrogramPyramid.size() <= nlevels)
+		{
+			auto buf = make_unique<AcceleratorBuffer<float> >("DisplayedChannel.m_spectrogramPyramid");
+			buf->SetCpuAccessHint(AcceleratorBuffer<float>::HINT_NEVER);
+			buf->SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+			m_spectrogramPyramid.push_back(std::move(buf));
+		}
+		m_spectrogramPyramidWidths.resize(nlevels+1);
+		m_spectrogramPyramidWidths[nlevels] = outputWidth;
+
+		auto& level = *m_spectrogramPyramid[nlevels];
+		level.resize(outputWidth * height);
+
+		SpectrogramPyramidArgs args(inputWidth, outputWidth, height, factor);
+		m_spectrogramPyramidPipeline->BindBufferNonblocking(0, *input, cmdbuf);
+		m_spectrogramPyramidPipeline->BindBufferNonblocking(1, level, cmdbuf, true);
+		m_spectrogramPyramidPipeline->Dispatch(
+			cmdbuf,
+			args,
+			GetComputeBlockCount(outputWidth, 64),
+			min(height, SPECTROGRAM_PYRAMID_MAX_Y_BLOCKS));
+		m_spectrogramPyramidPipeline->AddComputeMemoryBarrier(cmdbuf);
+		level.MarkModifiedFromGpu();
+
+		input = &level;
+		inputWidth = outputWidth;
+		factor = 2;
+		nlevels ++;
+	}
+
+	m_spectrogramPyramid.resize(nlevels);
+	m_spectrogramPyramidWidths.resize(nlevels);
+}
+
+/**
+	@brief Builds the min/max summary of a whole waveform, for the overview strip above the group's timeline
+
+	The summary only depends on the waveform, so it's rebuilt once per new waveform rather than every time the view
+	moves. Deep waveforms are reduced in several passes so no one thread has to walk a huge slice of the samples.
+
+	Runs on the GUI thread, with a pipeline of our own so it can't race the WaveformThread's pyramid builds.
+
+	@param data		Waveform to summarize
+	@param bins		Maximum number of bins to summarize it into
+	@param queue	Queue to run the reduction on
+
+	@return True if GetOverview() is valid for the waveform
+ */
+bool DisplayedChannel::UpdateOverview(UniformAnalogWaveform* data, size_t bins, shared_ptr<QueueHandle> queue)
+{
+	if( (m_overviewSource == data) && (m_overviewRevision == data->m_revision) && (m_overviewRequestedBins == bins) )
+		return true;
+
+	size_t len = data->size();
+	if( (len == 0) || (bins == 0) )
+		return false;
+
+	if(m_overviewComputePipeline == nullptr)
+	{
+		m_overviewComputePipeline = make_shared<ComputePipeline>(
+			"shaders/WaveformPyramid.spv", 2, sizeof(WaveformPyramidArgs));
+	}
+
+	shared_lock lock(g_vulkanActivityMutex);
+
+	auto& cmdbuf = GetUtilCmdBuffer();
+	cmdbuf.reset();
+	cmdbuf.begin({});
+
+	data->m_samples.PrepareForGpuAccessNonblocking(false, cmdbuf);
+	AcceleratorBuffer<float>::HostToDeviceTransferMemoryBarrier(cmdbuf);
+
+	AcceleratorBuffer<float>* input = &data->m_samples;
+	size_t inputLen = len;
+	size_t samplesPerBin = 1;
+	bool interleaved = false;
+	for(size_t pass = 0; ; pass ++)
+	{
+		size_t factor = min(OVERVIEW_MAX_FACTOR, max((size_t)1, (inputLen + bins - 1) / bins));
+		size_t outputLen = (inputLen + factor - 1) / factor;
+		bool last = (outputLen <= bins);
+		auto& output = last ? m_overview : m_overviewScratch[pass % 2];
+		output.resize(2 * outputLen);
+
+		size_t xblocks = min<size_t>(GetComputeBlockCount(outputLen, 64), PYRAMID_MAX_X_BLOCKS);
+		size_t yblocks = GetComputeBlockCount(outputLen, xblocks*64);
+
+		WaveformPyramidArgs args(inputLen, outputLen, factor, interleaved, xblocks*64);
+		m_overviewComputePipeline->BindBufferNonblocking(0, *input, cmdbuf);
+		m_overviewComputePipeline->BindBufferNonblocking(1, output, cmdbuf, true);
+		m_overviewComputePipeline->Dispatch(cmdbuf, args, xblocks, yblocks);
+		m_overviewComputePipeline->AddComputeMemoryBarrier(cmdbuf);
+		output.MarkModifiedFromGpu();
+
+		input = &output;
+		inputLen = outputLen;
+		samplesPerBin *= factor;
+		interleaved = true;
+		if(last)
+			break;
+	}
+
+	cmdbuf.end();
+	{
+		TRACE_ZONE("Vulkan submit", "overview");
+		queue->SubmitAndBlock(cmdbuf);
 	}
+	m_overview.PrepareForCpuAccess();
 
-	return false;
+	m_overviewSource = data;
+	m_overviewRevision = data->m_revision;
+	m_overviewRequestedBins = bins;
+	m_overviewSamplesPerBin = samplesPerBin;
+	return true;
 }
 
 /**
-	@brief Prepares to rasterize the waveform at the specified resolution
+	@brief Gets the offsets of the first and last samples of a sparse waveform
+
+	The values are cached so that we only have to pull the offsets back to the CPU once per new waveform, rather than
+	on every re-render.
  */
-void DisplayedChannel::PrepareToRasterize(size_t x, size_t y)
+void DisplayedChannel::GetSparseOffsetRange(SparseWaveformBase* data, int64_t& first, int64_t& last)
 {
-	bool sizeChanged = (m_rasterizedX != x) || (m_rasterizedY != y);
+	if( (m_sparseRangeWaveform != data) || (m_sparseRangeRevision != data->m_revision) )
+	{
+		BufferTransferTracker::PrepareForCpuAccess("DisplayedChannel::GetSparseOffsetRange", data->m_offsets);
+		m_sparseFirstOffset = data->m_offsets[0];
+		m_sparseLastOffset = data->m_offsets[data->size() - 1];
+		m_sparseRangeWaveform = data;
+		m_sparseRangeRevision = data->m_revision;
+	}
+
+	first = m_sparseFirstOffset;
+	last = m_sparseLastOffset;
+}
+
+/**
+	@brief Makes sure the packed timestamps of a sparse waveform are up to date, building them if necessary
 
-	m_rasterizedX = x;
-	m_rasterizedY = y;
+	Sparse offsets and durations are 64 bits per sample, but within a capture they're usually small. Packing stores
+	them as 32-bit deltas from a 64-bit base per block of SPARSE_PACK_BLOCK samples, and leaves out durations entirely
+	for blocks where each sample lasts until the next one. Blocks which don't fit are flagged, and the rasterizer falls
+	back to the original data for those, so this never changes what gets drawn.
 
-	if(sizeChanged)
+	The packed copy is built on the GPU once per waveform revision and reused for every redraw (panning, zooming,
+	persistence) until the waveform changes.
+
+	@param data			The waveform being drawn
+	@param durations	True if the durations are needed too
+	@param cmdbuf		Command buffer to record the packing into, if it's needed
+
+	@return True if the packed timestamps can be used, false to draw from the 64-bit ones
+ */
+bool DisplayedChannel::PackSparseTimestamps(SparseWaveformBase* data, bool durations, vk::raii::CommandBuffer& cmdbuf)
+{
+	if(!m_packedTimestampsPref.Get() || (data->size() < SPARSE_PACK_MIN_SAMPLES) )
 	{
-		size_t npixels = x*y;
-		m_rasterizedWaveform.resize(npixels);
+		if(m_packedSource)
+		{
+			m_packedHeaders.clear();
+			m_packedHeaders.shrink_to_fit();
+			m_packedDeltas.clear();
+			m_packedDeltas.shrink_to_fit();
+			m_packedDurations.clear();
+			m_packedDurations.shrink_to_fit();
+			m_packedSource = nullptr;
+		}
+		return false;
+	}
 
-		//fill with black
-		m_rasterizedWaveform.PrepareForCpuAccess();
-		memset(m_rasterizedWaveform.GetCpuPointer(), 0, npixels * sizeof(float));
-		m_rasterizedWaveform.MarkModifiedFromCpu();
+	//Reuse the last packing if nothing changed (and it has durations, if we need them now)
+	size_t len = data->size();
+	if( (m_packedSource == data) &&
+		(m_packedRevision == data->m_revision) &&
+		(m_packedSize == len) &&
+		(m_packedHasDurations || !durations) )
+	{
+		return true;
 	}
 
-	//Allocate index buffer for sparse waveforms
-	if(!IsDensePacked())
-		m_indexBuffer.resize(x);
+	if(m_timestampPackPipeline == nullptr)
+		m_timestampPackPipeline = GetPooledPipeline(GetTimestampPackPipelineKey());
+
+	size_t nblocks = (len + SPARSE_PACK_BLOCK - 1) / SPARSE_PACK_BLOCK;
+	m_packedHeaders.resize(4 * nblocks);
+	m_packedDeltas.resize(len);
+
+	//The shader always binds the durations, but only touches them if asked to
+	m_packedDurations.resize(durations ? len : 1);
+
+	//Very deep waveforms can need more blocks than we can dispatch in one dimension
+	size_t xblocks = min(nblocks, SPARSE_PACK_MAX_X_BLOCKS);
+	size_t yblocks = (nblocks + xblocks - 1) / xblocks;
+
+	SparseTimestampPackArgs args(len, durations, xblocks);
+	m_timestampPackPipeline->BindBufferNonblocking(0, data->m_offsets, cmdbuf);
+	m_timestampPackPipeline->BindBufferNonblocking(1, data->m_durations, cmdbuf);
+	m_timestampPackPipeline->BindBufferNonblocking(2, m_packedHeaders, cmdbuf, true);
+	m_timestampPackPipeline->BindBufferNonblocking(3, m_packedDeltas, cmdbuf, true);
+	m_timestampPackPipeline->BindBufferNonblocking(4, m_packedDurations, cmdbuf, true);
+	m_timestampPackPipeline->Dispatch(cmdbuf, args, xblocks, yblocks);
+	m_timestampPackPipeline->AddComputeMemoryBarrier(cmdbuf);
+	m_packedHeaders.MarkModifiedFromGpu();
+	m_packedDeltas.MarkModifiedFromGpu();
+	m_packedDurations.MarkModifiedFromGpu();
+
+	m_packedSource = data;
+	m_packedRevision = data->m_revision;
+	m_packedSize = len;
+	m_packedHasDurations = durations;
+	return true;
 }
 
 /**
@@ -341,6 +1347,13 @@ WaveformArea::WaveformArea(StreamDescriptor stream, shared_ptr<WaveformGroup> gr
 	, m_tLastMouseMove(GetTime())
 	, m_mouseOverTriggerArrow(false)
 	, m_mouseOverBERTarget(false)
+	, m_tooltipBERWaveform(nullptr)
+	, m_tooltipBERRevision(0)
+	, m_tooltipBERPos{-1, -1}
+	, m_tooltipBER(0)
+	, m_tooltipBERRequestWaveform(nullptr)
+	, m_tooltipBERRequestRevision(0)
+	, m_tooltipBERRequestTag(0)
 	, m_triggerLevelDuringDrag(0)
 	, m_xAxisPosDuringDrag(0)
 	, m_triggerDuringDrag(nullptr)
@@ -350,6 +1363,26 @@ WaveformArea::WaveformArea(StreamDescriptor stream, shared_ptr<WaveformGroup> gr
 	, m_dragPeakLabel(nullptr)
 	, m_mouseOverButton(false)
 	, m_yAxisCursorMode(Y_CURSOR_NONE)
+	, m_cursor1Color(parent->GetSession().GetPreferences(), "Appearance.Cursors.cursor_1_color")
+	, m_cursor2Color(parent->GetSession().GetPreferences(), "Appearance.Cursors.cursor_2_color")
+	, m_cursorFillColor(parent->GetSession().GetPreferences(), "Appearance.Cursors.cursor_fill_color")
+	, m_maskColor(parent->GetSession().GetPreferences(), "Appearance.Eye Patterns.mask_color")
+	, m_maskBorderPassColor(parent->GetSession().GetPreferences(), "Appearance.Eye Patterns.border_color_pass")
+	, m_maskBorderFailColor(parent->GetSession().GetPreferences(), "Appearance.Eye Patterns.border_color_fail")
+	, m_constellationPointColor(parent->GetSession().GetPreferences(), "Appearance.Constellations.point_color")
+	, m_peakTextColor(parent->GetSession().GetPreferences(), "Appearance.Peaks.peak_text_color")
+	, m_backgroundBottomColor(parent->GetSession().GetPreferences(), "Appearance.Graphs.bottom_color")
+	, m_backgroundTopColor(parent->GetSession().GetPreferences(), "Appearance.Graphs.top_color")
+	, m_gridCenterlineColor(parent->GetSession().GetPreferences(), "Appearance.Graphs.grid_centerline_color")
+	, m_gridColor(parent->GetSession().GetPreferences(), "Appearance.Graphs.grid_color")
+	, m_gridCenterlineWidth(parent->GetSession().GetPreferences(), "Appearance.Graphs.grid_centerline_width")
+	, m_gridWidth(parent->GetSession().GetPreferences(), "Appearance.Graphs.grid_width")
+	, m_yAxisTextColor(parent->GetSession().GetPreferences(), "Appearance.Graphs.y_axis_text_color")
+	, m_timelineAxisColor(parent->GetSession().GetPreferences(), "Appearance.Timeline.axis_color")
+	, m_incrementalWaterfallPref(parent->GetSession().GetPreferences(), "Performance.Rendering.incremental_waterfall")
+	, m_reprojectPref(parent->GetSession().GetPreferences(), "Performance.Rendering.reproject_preview")
+	, m_halfPrecisionRasterPref(parent->GetSession().GetPreferences(), "Performance.Rendering.half_precision_raster")
+	, m_incrementalAppendPref(parent->GetSession().GetPreferences(), "Performance.Rendering.incremental_append")
 {
 	m_yAxisCursorPositions[0] = 0;
 	m_yAxisCursorPositions[1] = 0;
@@ -359,6 +1392,7 @@ WaveformArea::WaveformArea(StreamDescriptor stream, shared_ptr<WaveformGroup> gr
 
 WaveformArea::~WaveformArea()
 {
+	m_parent->GetSession().GetGpuReadback().Cancel(this);
 	m_displayedChannels.clear();
 }
 
@@ -669,11 +1703,6 @@ bool WaveformArea::Render(int iArea, int numAreas, ImVec2 clientArea)
 	float yAxisWidth = m_group->GetYAxisWidth();
 	float yAxisWidthSpaced = yAxisWidth + spacing;
 
-	//Settings calculated by RenderGrid() then reused in RenderYAxis()
-	map<float, float> gridmap;
-	float vbot = 0.0f;
-	float vtop = 0.0f;
-
 	auto cpos = ImGui::GetCursorPos();
 	if(ImGui::BeginChild(ImGui::GetID(this), ImVec2(clientArea.x - yAxisWidthSpaced, unspacedHeightPerArea)))
 	{
@@ -687,7 +1716,7 @@ bool WaveformArea::Render(int iArea, int numAreas, ImVec2 clientArea)
 
 		//Draw the background
 		RenderBackgroundGradient(pos, csize);
-		RenderGrid(pos, csize, gridmap, vbot, vtop);
+		RenderGrid(pos, csize);
 
 		//Blank out space for the actual waveform
 		ImGui::Dummy(ImVec2(csize.x, csize.y));
@@ -743,7 +1772,7 @@ bool WaveformArea::Render(int iArea, int numAreas, ImVec2 clientArea)
 		m_parent->AddStatusHelp("mouse_wheel", "Zoom horizontal axis");
 
 	//Draw the vertical scale on the right side of the plot
-	RenderYAxis(ImVec2(yAxisWidth, unspacedHeightPerArea), gridmap, vbot, vtop);
+	RenderYAxis(ImVec2(yAxisWidth, unspacedHeightPerArea));
 
 	//Render the Y axis cursors (if we have any) over the top of everything else
 	auto oldpos = ImGui::GetCursorPos();
@@ -787,10 +1816,9 @@ void WaveformArea::RenderYAxisCursors(ImVec2 pos, ImVec2 size, float yAxisWidth)
 	{
 		auto list = ImGui::GetWindowDrawList();
 
-		auto& prefs = m_parent->GetSession().GetPreferences();
-		auto cursor0_color = prefs.GetColor("Appearance.Cursors.cursor_1_color");
-		auto cursor1_color = prefs.GetColor("Appearance.Cursors.cursor_2_color");
-		auto fill_color = prefs.GetColor("Appearance.Cursors.cursor_fill_color");
+		auto cursor0_color = m_cursor1Color.Get();
+		auto cursor1_color = m_cursor2Color.Get();
+		auto fill_color = m_cursorFillColor.Get();
 		auto font = m_parent->GetFontPref("Appearance.Cursors.label_font");
 
 		float ypos0 = round(YAxisUnitsToYPosition(m_yAxisCursorPositions[0]));
@@ -959,15 +1987,17 @@ void WaveformArea::PlotContextMenu()
 		auto& markers = m_parent->GetSession().GetMarkers(GetWaveformTimestamp());
 		bool hitMarker = false;
 		size_t selectedMarker = 0;
-		for(size_t i=0; i<markers.size(); i++)
+		float searchRadius = 0.25 * ImGui::GetFontSize();
+		auto nearby = markers.GetRange(
+			m_group->XPositionToXAxisUnits(lastRightClickPos - searchRadius - 1),
+			m_group->XPositionToXAxisUnits(lastRightClickPos + searchRadius + 1));
+		for(auto it = nearby.first; it != nearby.second; it++)
 		{
-			auto& m = markers[i];
-			float xpos = round(m_group->XAxisUnitsToXPosition(m.m_offset));
-			float searchRadius = 0.25 * ImGui::GetFontSize();
+			float xpos = round(m_group->XAxisUnitsToXPosition(it->m_offset));
 			if(fabs(xpos - lastRightClickPos) < searchRadius)
 			{
 				hitMarker = true;
-				selectedMarker = i;
+				selectedMarker = it - markers.begin();
 				break;
 			}
 		}
@@ -1110,14 +2140,54 @@ void WaveformArea::RenderAnalogWaveform(shared_ptr<DisplayedChannel> channel, Im
 		m_parent->SetNeedRender();
 
 	//Render the tone mapped output (if we have it)
-	auto tex = channel->GetTexture();
-	if(tex != nullptr)
-		list->AddImage(tex->GetTexture(), start, ImVec2(start.x+size.x, start.y+size.y), ImVec2(0, 1), ImVec2(1, 0) );
+	DrawReprojectedTexture(list, channel, start, size);
 
 	//If it's a peak detection filter, draw the peaks and annotations
 	auto pf = dynamic_cast<PeakDetectionFilter*>(stream.m_channel);
 	if(pf)
+	{
+		UpdateSpectrumPeaks(channel);
 		RenderSpectrumPeaks(list, channel);
+	}
+}
+
+/**
+	@brief Draws the tone mapped texture of an analog or digital channel, lined up with the current X axis view
+
+	The texture shows the view the waveform was last rasterized with. After a zoom or pan, the old image is stretched
+	and shifted to match the new view until the WaveformThread has drawn a new one, so the display responds on the
+	very next frame even if rasterizing a deep waveform takes much longer than that.
+ */
+void WaveformArea::DrawReprojectedTexture(
+	ImDrawList* list,
+	shared_ptr<DisplayedChannel> channel,
+	ImVec2 start,
+	ImVec2 size)
+{
+	auto tex = channel->GetTexture();
+	if(tex == nullptr)
+		return;
+
+	ImVec2 end(start.x + size.x, start.y + size.y);
+	auto uv = channel->GetTextureUVMax();
+
+	double oldScale = channel->GetTexturePixelsPerX();
+	double newScale = m_group->GetPixelsPerXUnit();
+	int64_t oldOffset = channel->GetTextureXAxisOffset();
+	int64_t newOffset = m_group->GetXAxisOffset();
+	if( !m_reprojectPref.Get() || (oldScale <= 0) || ( (oldScale == newScale) && (oldOffset == newOffset) ) )
+	{
+		list->AddImage(tex->GetTexture(), start, end, ImVec2(0, uv.y), ImVec2(uv.x, 0) );
+		return;
+	}
+
+	//Find where the left and right edges of the old view land in the new one
+	float left = start.x + (oldOffset - newOffset) * newScale;
+	float right = left + size.x * newScale / oldScale;
+
+	list->PushClipRect(start, end, true);
+	list->AddImage(tex->GetTexture(), ImVec2(left, start.y), ImVec2(right, end.y), ImVec2(0, uv.y), ImVec2(uv.x, 0) );
+	list->PopClipRect();
 }
 
 /**
@@ -1142,8 +2212,18 @@ void WaveformArea::RenderWaterfallWaveform(shared_ptr<DisplayedChannel> channel,
 
 	//Render the tone mapped output (if we have it)
 	auto tex = channel->GetTexture();
-	if(tex != nullptr)
-		list->AddImage(tex->GetTexture(), start, ImVec2(start.x+size.x, start.y+size.y), ImVec2(0, 1), ImVec2(1, 0) );
+	if(tex == nullptr)
+		return;
+
+	//The texture is a ring of rows, draw the part above the wrap point at the top and the rest below it
+	auto& state = channel->m_waterfallState;
+	float split = 0;
+	if( (state.m_texture == tex.get()) && (state.m_outheight > 0) )
+		split = state.m_rowOffset * 1.0f / state.m_outheight;
+	float ysplit = start.y + size.y*split;
+	if(split > 0)
+		list->AddImage(tex->GetTexture(), start, ImVec2(start.x+size.x, ysplit), ImVec2(0, split), ImVec2(1, 0) );
+	list->AddImage(tex->GetTexture(), ImVec2(start.x, ysplit), ImVec2(start.x+size.x, start.y+size.y), ImVec2(0, 1), ImVec2(1, split) );
 }
 
 /**
@@ -1203,10 +2283,9 @@ void WaveformArea::RenderEyeWaveform(shared_ptr<DisplayedChannel> channel, ImVec
 	auto bichan = dynamic_cast<BERTInputChannel*>(stream.m_channel);
 	if(eye || bichan)
 	{
-		auto& prefs = m_parent->GetSession().GetPreferences();
-		auto color = prefs.GetColor("Appearance.Eye Patterns.mask_color");
-		auto borderpass = prefs.GetColor("Appearance.Eye Patterns.border_color_pass");
-		auto borderfailed = prefs.GetColor("Appearance.Eye Patterns.border_color_fail");
+		auto color = m_maskColor.Get();
+		auto borderpass = m_maskBorderPassColor.Get();
+		auto borderfailed = m_maskBorderFailColor.Get();
 
 		auto& mask = eye ? eye->GetMask() : bichan->GetMask();
 		auto polygons = mask.GetPolygons();
@@ -1275,10 +2354,9 @@ void WaveformArea::RenderConstellationWaveform(shared_ptr<DisplayedChannel> chan
 	auto cfilt = dynamic_cast<ConstellationFilter*>(stream.m_channel);
 	if(cfilt)
 	{
-		auto& prefs = m_parent->GetSession().GetPreferences();
 		auto& points = cfilt->GetNominalPoints();
 
-		auto color = prefs.GetColor("Appearance.Constellations.point_color");
+		auto color = m_constellationPointColor.Get();
 
 		//TODO: dynamic size?
 		float pointsize = ImGui::GetFontSize() * 0.5;
@@ -1321,50 +2399,148 @@ ImVec2 WaveformArea::ClosestPointOnLineSegment(ImVec2 lineA, ImVec2 lineB, ImVec
 }
 
 /**
-	@brief Draw peaks from a FFT or similar waveform
+	@brief Matches the peaks of a new waveform against the existing labels
+
+	Only does anything once per waveform revision. Labels are kept sorted by peak position, so each peak only has to be
+	compared to the nearest label on either side of it.
  */
-void WaveformArea::RenderSpectrumPeaks(ImDrawList* list, shared_ptr<DisplayedChannel> channel)
+void WaveformArea::UpdateSpectrumPeaks(shared_ptr<DisplayedChannel> channel)
 {
 	auto stream = channel->GetStream();
 	auto data = stream.GetData();
-	auto& peaks = dynamic_cast<PeakDetectionFilter*>(stream.m_channel)->GetPeaks();
+	if(data == nullptr)
+		return;
+	if( (channel->m_peakSource == data) && (channel->m_peakRevision == data->m_revision) )
+		return;
+	channel->m_peakSource = data;
+	channel->m_peakRevision = data->m_revision;
 
-	//TODO: add a preference for peak circle color and size?
-	ImU32 circleColor = 0xffffffff;
-	ImU32 lineColor = ColorFromString("#00ff00ff");
-	float radius = ImGui::GetFontSize() * 0.5;
+	auto& peaks = dynamic_cast<PeakDetectionFilter*>(stream.m_channel)->GetPeaks();
+	auto& labels = channel->m_peakLabels;
+	double now = GetTime();
 
 	//Distance within which two peaks are considered to be the same
 	float neighborThresholdPixels = 3 * ImGui::GetFontSize();
 	int64_t neighborThresholdXUnits = m_group->PixelsToXAxisUnits(neighborThresholdPixels);
 
-	//Go through the list of peaks and decay all of the alpha values
-	vector<size_t> peaksToDelete;
-	for(size_t i=0; i<channel->m_peakLabels.size(); i++)
+	//Assume every label has lost its peak until we find it again
+	for(auto& it : labels)
+	{
+		if(it.second.m_tMissing < 0)
+			it.second.m_tMissing = now;
+	}
+
+	//Visit peaks in order of position
+	vector< pair<int64_t, size_t> > sorted;
+	sorted.reserve(peaks.size());
+	for(size_t i=0; i<peaks.size(); i++)
+		sorted.push_back(pair<int64_t, size_t>((peaks[i].m_x * data->m_timescale) + data->m_triggerPhase, i));
+	sort(sorted.begin(), sorted.end());
+
+	for(auto& sp : sorted)
 	{
-		channel->m_peakLabels[i].m_peakAlpha -= 4;
-		if(channel->m_peakLabels[i].m_peakAlpha < -255)
+		auto x = sp.first;
+		auto& p = peaks[sp.second];
+
+		//Check the labels on either side of this peak for one fairly close to it
+		auto best = labels.end();
+		auto it = labels.lower_bound(x);
+		if( (it != labels.end()) && (llabs(it->first - x) < neighborThresholdXUnits) )
+			best = it;
+		if(it != labels.begin())
 		{
-			peaksToDelete.push_back(i);
+			auto prev = std::prev(it);
+			if( (llabs(prev->first - x) < neighborThresholdXUnits) &&
+				( (best == labels.end()) || (llabs(prev->first - x) < llabs(best->first - x)) ) )
+			{
+				best = prev;
+			}
+		}
 
-			//Stop dragging if we're deleting it
-			if( (&channel->m_peakLabels[i] == m_dragPeakLabel) && (m_dragState = DRAG_STATE_PEAK_MARKER) )
+		//This peak is close enough we'll call it the same. Update the position.
+		if(best != labels.end())
+		{
+			auto& label = best->second;
+			label.m_peakXpos = x;
+			label.m_peakYpos = p.m_y;
+			label.m_fwhm = p.m_fwhm;
+			label.m_tMissing = -1;
+
+			//Re-key the label by its new position (moving the node, so the label itself stays put in memory)
+			if(best->first != x)
 			{
-				m_dragState = DRAG_STATE_NONE;
-				m_dragPeakLabel = nullptr;
+				auto node = labels.extract(best);
+				node.key() = x;
+				labels.insert(move(node));
 			}
+			continue;
 		}
+
+		//Not found, create a new peak
+		auto& npeak = labels[x];
+
+		//Initial X position is just left of the peak
+		npeak.m_labelXpos = x - m_group->PixelsToXAxisUnits(5 * ImGui::GetFontSize());
+		npeak.m_peakXpos = x;
+		npeak.m_peakYpos = p.m_y;
+		npeak.m_labelXsize = 0;
+		npeak.m_labelYsize = 0;
+		npeak.m_fwhm = p.m_fwhm;
+		npeak.m_tMissing = -1;
+
+		//Initial Y position is above the peak if in the bottom half, otherwise below
+		if(p.m_y > stream.GetOffset())
+			npeak.m_labelYpos = p.m_y + PixelsToYAxisUnits(3*ImGui::GetFontSize());
+		else
+			npeak.m_labelYpos = p.m_y - PixelsToYAxisUnits(3*ImGui::GetFontSize());
+
+		//Default to 100% alpha
+		npeak.m_peakAlpha = 255;
 	}
-	if(!peaksToDelete.empty())
+
+	//Garbage collect labels whose peaks have been gone for a while
+	for(auto it = labels.begin(); it != labels.end(); )
 	{
-		for(ssize_t n=peaksToDelete.size() - 1; n >= 0; n--)
-			channel->m_peakLabels.erase(channel->m_peakLabels.begin() + n);
+		auto& label = it->second;
+		if( (label.m_tMissing < 0) || (now - label.m_tMissing < PEAK_GC_TIME) )
+		{
+			it++;
+			continue;
+		}
+
+		//Stop dragging if we're deleting it
+		if( (&label == m_dragPeakLabel) && (m_dragState == DRAG_STATE_PEAK_MARKER) )
+		{
+			m_dragState = DRAG_STATE_NONE;
+			m_dragPeakLabel = nullptr;
+		}
+
+		it = labels.erase(it);
 	}
+}
+
+/**
+	@brief Draw peaks from a FFT or similar waveform
+
+	Matching peaks to labels is done by UpdateSpectrumPeaks() when a new waveform arrives, this just draws the labels
+	and nudges them around.
+ */
+void WaveformArea::RenderSpectrumPeaks(ImDrawList* list, shared_ptr<DisplayedChannel> channel)
+{
+	auto stream = channel->GetStream();
+	auto data = stream.GetData();
+	if(data == nullptr)
+		return;
+	auto& peaks = dynamic_cast<PeakDetectionFilter*>(stream.m_channel)->GetPeaks();
+
+	//TODO: add a preference for peak circle color and size?
+	ImU32 circleColor = 0xffffffff;
+	ImU32 lineColor = ColorFromString("#00ff00ff");
+	float radius = ImGui::GetFontSize() * 0.5;
 
-	//Initial peak processing
-	for(auto p : peaks)
+	//Draw the circle for each peak
+	for(auto& p : peaks)
 	{
-		//Draw the circle for the peak
 		auto x = (p.m_x * data->m_timescale) + data->m_triggerPhase;
 		list->AddCircle(
 			ImVec2(m_group->XAxisUnitsToXPosition(x), YAxisUnitsToYPosition(p.m_y)),
@@ -1372,45 +2548,6 @@ void WaveformArea::RenderSpectrumPeaks(ImDrawList* list, shared_ptr<DisplayedCha
 			circleColor,
 			0,
 			1);
-
-		//Check for peaks fairly close to this one
-		bool hit = false;
-		for(size_t i=0; i<channel->m_peakLabels.size(); i++)
-		{
-			if( llabs(channel->m_peakLabels[i].m_peakXpos - x) < neighborThresholdXUnits )
-			{
-				//This peak is close enough we'll call it the same. Update the position.
-				hit = true;
-				channel->m_peakLabels[i].m_peakXpos = x;
-				channel->m_peakLabels[i].m_peakYpos = p.m_y;
-				channel->m_peakLabels[i].m_peakAlpha = 255;
-				channel->m_peakLabels[i].m_fwhm = p.m_fwhm;
-				break;
-			}
-		}
-
-		//Not found, create a new peak
-		if(!hit)
-		{
-			PeakLabel npeak;
-
-			//Initial X position is just left of the peak
-			npeak.m_labelXpos = x - m_group->PixelsToXAxisUnits(5 * ImGui::GetFontSize());
-			npeak.m_peakXpos = x;
-			npeak.m_peakYpos = p.m_y;
-			npeak.m_fwhm = p.m_fwhm;
-
-			//Initial Y position is above the peak if in the bottom half, otherwise below
-			if(p.m_y > stream.GetOffset())
-				npeak.m_labelYpos = p.m_y + PixelsToYAxisUnits(3*ImGui::GetFontSize());
-			else
-				npeak.m_labelYpos = p.m_y - PixelsToYAxisUnits(3*ImGui::GetFontSize());
-
-			//Default to 100% alpha
-			npeak.m_peakAlpha = 255;
-
-			channel->m_peakLabels.push_back(npeak);
-		}
 	}
 
 	//Foreground color is used to determine background color and hovered/active colors
@@ -1424,13 +2561,22 @@ void WaveformArea::RenderSpectrumPeaks(ImDrawList* list, shared_ptr<DisplayedCha
 	//Draw the peaks and update X/Y size for collision detection
 	auto font = m_parent->GetFontPref("Appearance.Peaks.label_font");
 	auto fontSize = font->FontSize * ImGui::GetIO().FontGlobalScale;
-	auto& prefs = m_parent->GetSession().GetPreferences();
-	auto textColor = prefs.GetColor("Appearance.Peaks.peak_text_color");
+	auto textColor = m_peakTextColor.Get();
 	auto mousePos = ImGui::GetMousePos();
 	float springMaxLength = 15 * ImGui::GetFontSize();
-	for(size_t i=0; i<channel->m_peakLabels.size(); i++)
+	double now = GetTime();
+	auto& labels = channel->m_peakLabels;
+	for(auto it = labels.begin(); it != labels.end(); it++)
 	{
-		auto& label = channel->m_peakLabels[i];
+		auto& label = it->second;
+
+		//Fade out labels whose peak has gone away
+		if(label.m_tMissing < 0)
+			label.m_peakAlpha = 255;
+		else
+			label.m_peakAlpha = 255 - static_cast<int>(255 * (now - label.m_tMissing) / PEAK_FADE_TIME);
+		if(label.m_peakAlpha <= 0)
+			continue;
 
 		//Figure out text size
 		string str =
@@ -1451,8 +2597,6 @@ void WaveformArea::RenderSpectrumPeaks(ImDrawList* list, shared_ptr<DisplayedCha
 		float labelBottom = labelYpos + yrad;
 
 		//Update alpha
-		if(label.m_peakAlpha < 0)
-			continue;
 		lineColor &= ~(0xff << IM_COL32_A_SHIFT);
 		lineColor |= (label.m_peakAlpha << IM_COL32_A_SHIFT);
 
@@ -1575,9 +2719,9 @@ void WaveformArea::RenderSpectrumPeaks(ImDrawList* list, shared_ptr<DisplayedCha
 
 		//Physics 3: If labels collide, move them apart
 		//Only search labels after this one, to avoid moving stuff twice
-		for(size_t j=i+1; j<channel->m_peakLabels.size(); j++)
+		for(auto jt = std::next(it); jt != labels.end(); jt++)
 		{
-			auto& jlabel = channel->m_peakLabels[j];
+			auto& jlabel = jt->second;
 			ImVec2 jpos(m_group->XAxisUnitsToXPosition(jlabel.m_labelXpos), YAxisUnitsToYPosition(jlabel.m_labelYpos));
 			ImVec2 jsize(m_group->XAxisUnitsToPixels(jlabel.m_labelXsize), YAxisUnitsToPixels(jlabel.m_labelYsize));
 
@@ -1627,22 +2771,21 @@ void WaveformArea::RenderDigitalWaveform(shared_ptr<DisplayedChannel> channel, I
 		m_parent->SetNeedRender();
 
 	//Render the tone mapped output (if we have it)
-	auto tex = channel->GetTexture();
-	if(tex != nullptr)
-	{
-		auto ypos = channel->GetYButtonPos() + start.y;
-		list->AddImage(
-			tex->GetTexture(),
-			ImVec2(start.x, ypos - m_channelButtonHeight),
-			ImVec2(start.x+size.x, ypos),
-			ImVec2(0, 1),
-			ImVec2(1, 0) );
-	}
+	auto ypos = channel->GetYButtonPos() + start.y;
+	DrawReprojectedTexture(
+		list,
+		channel,
+		ImVec2(start.x, ypos - m_channelButtonHeight),
+		ImVec2(size.x, m_channelButtonHeight));
 }
 
 /**
 	@brief Renders a single protocol waveform (assume it's sparse)
 
+	Laying out the visible cells (merging skinny samples, fitting and trimming text) is expensive with dense decodes, so
+	the layout is cached in the channel and only redone when the waveform or the view changes. Other frames just draw
+	the cached cells.
+
 	TODO: should we ever support uniform protocol data? maybe coming off some kind of analyzer?
  */
 void WaveformArea::RenderProtocolWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size)
@@ -1651,16 +2794,72 @@ void WaveformArea::RenderProtocolWaveform(std::shared_ptr<DisplayedChannel> chan
 	auto data = dynamic_cast<SparseWaveformBase*>(stream.GetData());
 	if(data == nullptr)
 		return;
-	data->CacheColors();
 
+	//Check if anything the layout depends on has changed
+	auto font = m_parent->GetFontPref("Appearance.Decodes.protocol_font");
+	ProtocolLayoutState state;
+	state.m_data = data;
+	state.m_revision = data->m_revision;
+	state.m_size = data->size();
+	state.m_xAxisOffset = m_group->GetXAxisOffset();
+	state.m_pixelsPerX = m_group->GetPixelsPerXUnit();
+	state.m_xOrigin = m_group->XAxisUnitsToXPosition(state.m_xAxisOffset);
+	state.m_left = start.x;
+	state.m_right = start.x + size.x;
+	state.m_font = font;
+	state.m_fontSize = font->FontSize * ImGui::GetIO().FontGlobalScale;
+	state.m_skipNarrowCells = IsGpuProtocolRenderingEnabled();
+	if(state != channel->m_protocolLayoutState)
+	{
+		LayoutProtocolWaveform(data, state, channel->m_protocolLayout);
+		channel->m_protocolLayoutState = state;
+	}
+
+	float ybot = (channel->GetYButtonPos() * ImGui::GetWindowDpiScale()) + start.y;
+	float ytop = ybot - m_channelButtonHeight;
+	float ymid = ybot - m_channelButtonHeight/2;
 	auto list = ImGui::GetWindowDrawList();
 
+	//Narrow cells are rasterized on the GPU, draw the tone mapped output under the wide ones (if we have it)
+	if(state.m_skipNarrowCells)
+	{
+		if(channel->UpdateSize(ImVec2(size.x, m_channelButtonHeight), m_parent))
+			m_parent->SetNeedRender();
+
+		auto tex = channel->GetTexture();
+		if(tex != nullptr)
+		{
+			auto uv = channel->GetTextureUVMax();
+			list->AddImage(
+				tex->GetTexture(),
+				ImVec2(start.x, ytop),
+				ImVec2(start.x+size.x, ybot),
+				ImVec2(0, uv.y),
+				ImVec2(uv.x, 0) );
+		}
+	}
+
+	//Draw the cached cells
+	for(auto& cell : channel->m_protocolLayout)
+		RenderProtocolCell(list, cell, font, state.m_fontSize, ybot, ymid, ytop);
+}
+
+/**
+	@brief Calculates the position, color, and text of every protocol cell visible with the given view settings
+ */
+void WaveformArea::LayoutProtocolWaveform(
+	SparseWaveformBase* data,
+	const ProtocolLayoutState& state,
+	vector<ProtocolCell>& cells)
+{
+	cells.clear();
+	CacheProtocolColors(data);
+
 	//Calculate a bunch of constants
-	int64_t offset = m_group->GetXAxisOffset();
-	int64_t offset_samples = (offset - data->m_triggerPhase) / data->m_timescale;
+	int64_t offset_samples = (state.m_xAxisOffset - data->m_triggerPhase) / data->m_timescale;
 
 	//Find the index of the first sample visible on screen
-	data->PrepareForCpuAccess();
+	BufferTransferTracker::PrepareForCpuAccess("WaveformArea::LayoutProtocolWaveform", data);
 	auto ifirst = BinarySearchForGequal(
 		data->m_offsets.GetCpuPointer(),
 		data->size(),
@@ -1671,13 +2870,10 @@ void WaveformArea::RenderProtocolWaveform(std::shared_ptr<DisplayedChannel> chan
 	if(ifirst > 0)
 		ifirst --;
 
-	float ybot = (channel->GetYButtonPos() * ImGui::GetWindowDpiScale()) + start.y;
-	float ytop = ybot - m_channelButtonHeight;
-	float ymid = ybot - m_channelButtonHeight/2;
-
-	//Draw the actual stuff
+	//Lay out the actual stuff
 	size_t len = data->size();
-	size_t xend = start.x + size.x;
+	float xstart = state.m_left;
+	float xend = state.m_right;
 	for(size_t i=ifirst; i<len; i++)
 	{
 		int64_t tstart = (data->m_offsets[i] * data->m_timescale) + data->m_triggerPhase;
@@ -1686,7 +2882,7 @@ void WaveformArea::RenderProtocolWaveform(std::shared_ptr<DisplayedChannel> chan
 		double xs = m_group->XAxisUnitsToXPosition(tstart);
 		double xe = m_group->XAxisUnitsToXPosition(end);
 
-		if(xe < start.x)
+		if(xe < xstart)
 			continue;
 		if(xs > xend)
 			break;
@@ -1696,6 +2892,9 @@ void WaveformArea::RenderProtocolWaveform(std::shared_ptr<DisplayedChannel> chan
 		if(cellwidth < 2)
 		{
 			//This sample is really skinny. There's no text to render so don't waste time with that.
+			//If the GPU is drawing skinny samples, we don't need to do anything at all.
+			if(state.m_skipNarrowCells)
+				continue;
 
 			//Average the color of all samples touching this pixel
 			size_t nmerged = 1;
@@ -1731,36 +2930,26 @@ void WaveformArea::RenderProtocolWaveform(std::shared_ptr<DisplayedChannel> chan
 				((static_cast<int>(sum_blue) & 0xff) << IM_COL32_B_SHIFT) |
 				(0xff << IM_COL32_A_SHIFT);
 
-
-			RenderComplexSignal(
-				list,
-				start.x, xend,
-				xs, xe, 5,
-				ybot, ymid, ytop,
-				"",
-				color);
+			cells.push_back(LayoutComplexSignal(state, xstart, xend, xs, xe, 5, "", color));
 		}
 		else
-		{
-			RenderComplexSignal(
-				list,
-				start.x, xend,
-				xs, xe, 5,
-				ybot, ymid, ytop,
-				data->GetText(i),
-				color);
-		}
+			cells.push_back(LayoutComplexSignal(state, xstart, xend, xs, xe, 5, data->GetText(i), color));
 	}
 }
 
-void WaveformArea::RenderComplexSignal(
-		ImDrawList* list,
+/**
+	@brief Figures out where a single protocol cell goes and how much of its text fits
+ */
+ProtocolCell WaveformArea::LayoutComplexSignal(
+		const ProtocolLayoutState& state,
 		int visleft, int visright,
 		float xstart, float xend, float xoff,
-		float ybot, float ymid, float ytop,
 		string str,
 		ImU32 color)
 {
+	ProtocolCell cell;
+	cell.m_color = color;
+
 	//Clamp start point to left side of display
 	if(xstart < visleft)
 		xstart = visleft;
@@ -1781,11 +2970,10 @@ void WaveformArea::RenderComplexSignal(
 	//If the space is tiny, don't even attempt to render it.
 	//Figuring out text size is expensive when we have hundreds or thousands of packets on screen, but in this case
 	//we *know* it won't fit.
-	bool drew_text = false;
 	if(available_width > 15)
 	{
-		auto font = m_parent->GetFontPref("Appearance.Decodes.protocol_font");
-		auto fontSize = font->FontSize * ImGui::GetIO().FontGlobalScale;
+		auto font = state.m_font;
+		auto fontSize = state.m_fontSize;
 		auto textsize = font->CalcTextSizeA(fontSize, FLT_MAX, 0, str.c_str());
 
 		//Minimum width (if outline ends up being smaller than this, just fill)
@@ -1831,7 +3019,7 @@ void WaveformArea::RenderComplexSignal(
 				str = "";
 		}
 
-		//Draw the text
+		//Decide what text to draw
 		if(str != "")
 		{
 			//If we need to trim, decide which way to do it.
@@ -1874,39 +3062,64 @@ void WaveformArea::RenderComplexSignal(
 				}
 			}
 
-			//Draw filler to darken background for better contrast
-			ImU32 bgcolor = (0xc0 << IM_COL32_A_SHIFT);
-			MakePathSignalBody(list, xstart, xend, ybot, ymid, ytop);
-			list->PathFillConvex(bgcolor);
-
-			drew_text = true;
-			ImU32 textcolor = 0xffffffff;	//TODO: figure out color based on theme or something
-			list->AddText(font, fontSize, ImVec2(xp, ymid-textsize.y/2), textcolor, str_render.c_str());
+			cell.m_drawText = true;
+			cell.m_text = str_render;
+			cell.m_textX = xp;
+			cell.m_textHeight = textsize.y;
 		}
 	}
 
+	//Text background is drawn from the clamped start to the unclamped end, the filler and outline only to the
+	//right side of the display
+	cell.m_xstart = xstart;
+	cell.m_xendText = xend;
 	if(xend > visright)
 		xend = visright;
+	cell.m_xend = xend;
+
+	return cell;
+}
+
+/**
+	@brief Draws a protocol cell laid out by LayoutComplexSignal()
+ */
+void WaveformArea::RenderProtocolCell(
+	ImDrawList* list,
+	const ProtocolCell& cell,
+	ImFont* font,
+	float fontSize,
+	float ybot, float ymid, float ytop)
+{
+	if(cell.m_drawText)
+	{
+		//Draw filler to darken background for better contrast
+		ImU32 bgcolor = (0xc0 << IM_COL32_A_SHIFT);
+		MakePathSignalBody(list, cell.m_xstart, cell.m_xendText, ybot, ymid, ytop);
+		list->PathFillConvex(bgcolor);
+
+		ImU32 textcolor = 0xffffffff;	//TODO: figure out color based on theme or something
+		list->AddText(font, fontSize, ImVec2(cell.m_textX, ymid-cell.m_textHeight/2), textcolor, cell.m_text.c_str());
+	}
 
 	//If no text fit, draw filler instead
-	if(!drew_text)
+	else
 	{
-		float r = ((color >> IM_COL32_R_SHIFT) & 0xff) / 4;
-		float g = ((color >> IM_COL32_G_SHIFT) & 0xff) / 4;
-		float b = ((color >> IM_COL32_B_SHIFT) & 0xff) / 4;
+		float r = ((cell.m_color >> IM_COL32_R_SHIFT) & 0xff) / 4;
+		float g = ((cell.m_color >> IM_COL32_G_SHIFT) & 0xff) / 4;
+		float b = ((cell.m_color >> IM_COL32_B_SHIFT) & 0xff) / 4;
 		ImU32 darkcolor =
 			((static_cast<int>(r) & 0xff) << IM_COL32_R_SHIFT) |
 			((static_cast<int>(g) & 0xff) << IM_COL32_G_SHIFT) |
 			((static_cast<int>(b) & 0xff) << IM_COL32_B_SHIFT) |
 			(0xff << IM_COL32_A_SHIFT);
 
-		MakePathSignalBody(list, xstart, xend, ybot, ymid, ytop);
+		MakePathSignalBody(list, cell.m_xstart, cell.m_xend, ybot, ymid, ytop);
 		list->PathFillConvex(darkcolor);
 	}
 
 	//Draw the body outline after any filler so it shows up on top
-	MakePathSignalBody(list, xstart, xend, ybot, ymid, ytop);
-	list->PathStroke(color, 0, 2);
+	MakePathSignalBody(list, cell.m_xstart, cell.m_xend, ybot, ymid, ytop);
+	list->PathStroke(cell.m_color, 0, 2);
 }
 
 void WaveformArea::MakePathSignalBody(ImDrawList* list, float xstart, float xend, float ybot, float ymid, float ytop)
@@ -1925,10 +3138,115 @@ void WaveformArea::MakePathSignalBody(ImDrawList* list, float xstart, float xend
 	list->PathLineTo(ImVec2(xstart, 			ymid));	//left point again
 }
 
+/**
+	@brief Appends everything that goes into our tone mapping commands to a layout descriptor
+
+	If the layout is the same as last time, the previously recorded tone mapping commands can be replayed as-is.
+
+	@return False if we have channels whose tone mapping commands can't be replayed (they depend on waveform data,
+			or need a buffer uploaded first)
+ */
+bool WaveformArea::GetToneMapLayout(vector<uintptr_t>& layout)
+{
+	bool ok = true;
+
+	//Trace intensity is a push constant of the tone mapping shader
+	float alpha = m_parent->GetTraceAlpha();
+	uint32_t alphaBits;
+	memcpy(&alphaBits, &alpha, sizeof(alphaBits));
+	for(auto& chan : m_displayedChannels)
+	{
+		auto stream = chan->GetStream();
+		if(stream.IsOutOfRange())
+			continue;
+
+		switch(stream.GetType())
+		{
+			case Stream::STREAM_TYPE_ANALOG:
+			case Stream::STREAM_TYPE_DIGITAL:
+				{
+					auto tex = chan->GetTexture();
+					layout.push_back(reinterpret_cast<uintptr_t>(tex.get()));
+					if(tex)
+						layout.push_back(reinterpret_cast<uintptr_t>(static_cast<VkImage>(tex->GetImage())));
+					layout.push_back(reinterpret_cast<uintptr_t>(chan->GetToneMapPipeline().get()));
+					layout.push_back(reinterpret_cast<uintptr_t>(&chan->GetRasterizedWaveform()));
+					layout.push_back(chan->GetRasterizedX());
+					layout.push_back(chan->GetRasterizedY());
+					layout.push_back(ColorFromString(stream.m_channel->m_displaycolor));
+					layout.push_back(alphaBits);
+					layout.push_back(chan->IsRasterizedHalfPrecision());
+
+					//Replaying would re-upload stale CPU side data
+					if(chan->GetRasterizedWaveform().IsGpuBufferStale())
+						ok = false;
+				}
+				break;
+
+			case Stream::STREAM_TYPE_PROTOCOL:
+				if(IsGpuProtocolRenderingEnabled())
+				{
+					auto tex = chan->GetTexture();
+					layout.push_back(reinterpret_cast<uintptr_t>(tex.get()));
+					if(tex)
+						layout.push_back(reinterpret_cast<uintptr_t>(static_cast<VkImage>(tex->GetImage())));
+					layout.push_back(reinterpret_cast<uintptr_t>(chan->GetToneMapPipeline().get()));
+					layout.push_back(reinterpret_cast<uintptr_t>(&chan->GetRasterizedWaveform()));
+					layout.push_back(chan->GetRasterizedX());
+					layout.push_back(m_channelButtonHeight);
+
+					if(chan->GetRasterizedWaveform().IsGpuBufferStale())
+						ok = false;
+				}
+				break;
+
+			//no tone mapping required
+			case Stream::STREAM_TYPE_ANALOG_SCALAR:
+				break;
+
+			//density plots read waveform data directly
+			default:
+				ok = false;
+				break;
+		}
+	}
+
+	return ok;
+}
+
+/**
+	@brief Notes that every analog and digital channel's texture now shows its front buffer
+
+	Must be called with the session's rasterized waveform mutex held, after tone mapping has completed.
+ */
+void WaveformArea::LatchTextureViews()
+{
+	for(auto& chan : m_displayedChannels)
+	{
+		switch(chan->GetStream().GetType())
+		{
+			case Stream::STREAM_TYPE_ANALOG:
+			case Stream::STREAM_TYPE_DIGITAL:
+				chan->LatchTextureView();
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
 /**
 	@brief Tone map our waveforms
+
+	Each channel writes only its own texture, so the dispatches are recorded back to back with nothing in between and
+	the GPU is free to overlap them. The caller records a single barrier before anything reads the textures (see
+	MainWindow::ToneMapAllWaveforms()).
+
+	@param cmdbuf	Command buffer to record into
+	@param timer	If not null, timestamps are recorded around each channel's tone mapping
  */
-void WaveformArea::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
+void WaveformArea::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf, GpuTimer* timer)
 {
 	for(auto& chan : m_displayedChannels)
 	{
@@ -1936,31 +3254,46 @@ void WaveformArea::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
 		if(chan->GetStream().IsOutOfRange())
 			continue;
 
+		size_t span = SIZE_MAX;
 		switch(stream.GetType())
 		{
 			case Stream::STREAM_TYPE_ANALOG:
 			case Stream::STREAM_TYPE_DIGITAL:
+				if(timer)
+					span = timer->Begin(cmdbuf, stream.GetName(), "WaveformToneMap");
 				ToneMapAnalogOrDigitalWaveform(chan, cmdbuf);
 				break;
 
 			case Stream::STREAM_TYPE_WATERFALL:
+				if(timer)
+					span = timer->Begin(cmdbuf, stream.GetName(), "WaterfallToneMap");
 				ToneMapWaterfallWaveform(chan, cmdbuf);
 				break;
 
 			case Stream::STREAM_TYPE_SPECTROGRAM:
+				if(timer)
+					span = timer->Begin(cmdbuf, stream.GetName(), "SpectrogramToneMap");
 				ToneMapSpectrogramWaveform(chan, cmdbuf);
 				break;
 
 			case Stream::STREAM_TYPE_EYE:
+				if(timer)
+					span = timer->Begin(cmdbuf, stream.GetName(), "EyeToneMap");
 				ToneMapEyeWaveform(chan, cmdbuf);
 				break;
 
 			case Stream::STREAM_TYPE_CONSTELLATION:
+				if(timer)
+					span = timer->Begin(cmdbuf, stream.GetName(), "ConstellationToneMap");
 				ToneMapConstellationWaveform(chan, cmdbuf);
 				break;
 
-			//no tone mapping required
 			case Stream::STREAM_TYPE_PROTOCOL:
+				if(!IsGpuProtocolRenderingEnabled())
+					break;
+				if(timer)
+					span = timer->Begin(cmdbuf, stream.GetName(), "ProtocolToneMap");
+				ToneMapProtocolWaveform(chan, cmdbuf);
 				break;
 
 			//nothing to draw, it's not a waveform (shouldn't even be here)
@@ -1971,6 +3304,9 @@ void WaveformArea::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
 				LogWarning("Unimplemented stream type %d, don't know how to tone map it\n", stream.GetType());
 				break;
 		}
+
+		if(timer)
+			timer->End(cmdbuf, span);
 	}
 }
 
@@ -1983,28 +3319,57 @@ void WaveformArea::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
 	@param chans				Set of channels we rendered into
 								Used to keep references active until rendering completes if we close them this frame
 	@param clearPersistence		True if persistence maps should be erased before rendering
+	@param searches				Index searches already recorded by other areas in this group
+	@param shares				Images already rasterized by other channels during this pass
+	@param timer				If not null, timestamps are recorded around each shader dispatch
+	@param previewOnly			If true, only draw channels coming straight from an instrument, since filter
+								outputs are still being computed. Persistent channels are skipped too, so the
+								acquisition isn't accumulated twice once the full render comes along.
  */
 void WaveformArea::RenderWaveformTextures(
 	vk::raii::CommandBuffer& cmdbuf,
 	vector<shared_ptr<DisplayedChannel> >& chans,
-	bool clearPersistence)
+	bool clearPersistence,
+	IndexSearchCache& searches,
+	RasterShareCache& shares,
+	GpuTimer* timer,
+	bool previewOnly)
 {
-	chans = m_displayedChannels;
-
-	bool clearThisAreaOnly = m_clearPersistence.exchange(false);
+	bool clearThisAreaOnly = previewOnly ? false : m_clearPersistence.exchange(false);
 	bool clearing = clearThisAreaOnly || clearPersistence;
 
-	for(auto& chan : chans)
+	//Set up every channel first, so we only need one barrier for all of the index searches
+	//and one for all of the rasterization shaders rather than a pair per channel
+	vector<PendingRasterization> jobs;
+	bool indexed = false;
+	for(auto& chan : m_displayedChannels)
 	{
 		auto stream = chan->GetStream();
+
+		//Only channels we hand back get their buffers swapped afterwards, so skipped ones keep showing what they had
+		if(previewOnly)
+		{
+			if( (dynamic_cast<Filter*>(stream.m_channel) != nullptr) || chan->IsPersistenceEnabled() )
+				continue;
+		}
+		chans.push_back(chan);
+
 		if(chan->GetStream().IsOutOfRange())
 			continue;
 
+		//Show our own image unless we find another channel that has already drawn it this pass
+		chan->SetRasterSource(nullptr);
+
 		switch(stream.GetType())
 		{
 			case Stream::STREAM_TYPE_ANALOG:
 			case Stream::STREAM_TYPE_DIGITAL:
-				RasterizeAnalogOrDigitalWaveform(chan, cmdbuf, clearing);
+				{
+					PendingRasterization job;
+					if(PrepareAnalogOrDigitalRasterization(
+						chan, cmdbuf, clearing, job, indexed, searches, shares, timer))
+						jobs.push_back(job);
+				}
 				break;
 
 			//no background rendering required, we do everything in Refresh()
@@ -2014,8 +3379,14 @@ void WaveformArea::RenderWaveformTextures(
 			case Stream::STREAM_TYPE_SPECTROGRAM:
 				break;
 
-			//no background rendering required, we draw everything live
+			//Narrow cells are rasterized, wide ones and text are drawn live
 			case Stream::STREAM_TYPE_PROTOCOL:
+				if(IsGpuProtocolRenderingEnabled())
+				{
+					PendingRasterization job;
+					if(PrepareProtocolRasterization(chan, cmdbuf, job, indexed, searches, shares, timer))
+						jobs.push_back(job);
+				}
 				break;
 
 			//nothing to draw, it's not a waveform (shouldn't even be here)
@@ -2027,18 +3398,61 @@ void WaveformArea::RenderWaveformTextures(
 				break;
 		}
 	}
+	if(jobs.empty())
+		return;
+
+	//Sparse index searches have to finish before the rasterizers read them
+	if(indexed)
+		jobs[0].m_pipeline->AddComputeMemoryBarrier(cmdbuf);
+
+	//Channels don't share any output buffers, so the dispatches can all run concurrently
+	//(unless we're profiling, in which case the timer serializes them)
+	for(auto& job : jobs)
+	{
+		size_t span = SIZE_MAX;
+		if(timer)
+			span = timer->Begin(cmdbuf, job.m_channel, job.m_shader);
+		job.m_pipeline->Dispatch(cmdbuf, job.m_config, job.m_columns, job.m_tiles, 1);
+		if(timer)
+			timer->End(cmdbuf, span);
+		job.m_output->MarkModifiedFromGpu();
+		g_channelRasterizations ++;
+	}
+	jobs.back().m_pipeline->AddComputeMemoryBarrier(cmdbuf);
 }
 
-void WaveformArea::RasterizeAnalogOrDigitalWaveform(
+/**
+	@brief Sets up rasterization of an analog or digital waveform
+
+	Records any preprocessing (X axis index search, min/max pyramid) and binds the shader's buffers, but doesn't
+	dispatch the rasterization shader itself.
+
+	@param channel			The channel to rasterize
+	@param cmdbuf			Command buffer to record into
+	@param clearPersistence	True if the persistence map should be erased before rendering
+	@param job				Filled out with the rasterization dispatch to record
+	@param indexed			Set to true if an index search was recorded (and a barrier is needed before dispatching)
+	@param searches			Index searches already recorded in this group, which can be reused
+	@param shares			Images already rasterized during this pass, which can be shown instead of drawing our own
+	@param timer			If not null, timestamps are recorded around the index search
+
+	@return True if the channel needs to be rasterized, false if it's empty, unchanged, or shared
+ */
+bool WaveformArea::PrepareAnalogOrDigitalRasterization(
 	shared_ptr<DisplayedChannel> channel,
 	vk::raii::CommandBuffer& cmdbuf,
-	bool clearPersistence
+	bool clearPersistence,
+	PendingRasterization& job,
+	bool& indexed,
+	IndexSearchCache& searches,
+	RasterShareCache& shares,
+	GpuTimer* timer
 	)
 {
 	if(m_height < 0)
 	{
 		LogWarning("WaveformArea has negative height, cannot render\n");
-		return;
+		return false;
 	}
 
 	auto stream = channel->GetStream();
@@ -2048,49 +3462,127 @@ void WaveformArea::RasterizeAnalogOrDigitalWaveform(
 	//If no data (or an empty buffer with no samples), set to 0x0 pixels and return
 	if( (data == nullptr) || data->empty() )
 	{
-		channel->PrepareToRasterize(0, 0);
-		return;
+		channel->PrepareToRasterize(cmdbuf, 0, 0);
+		channel->UpdateRasterizeState(RasterizeState());
+		return false;
 	}
 	size_t w = m_width;
 	size_t h = m_height;
 	if(channel->GetStream().GetType() == Stream::STREAM_TYPE_DIGITAL)
 		h = m_channelButtonHeight;
-	channel->PrepareToRasterize(w, h);
+
+	//Skip the channel entirely if nothing that affects the rasterized image has changed since last time
+	//(e.g. a partial refilter that only touched other channels)
+	RasterizeState state;
+	state.m_data = data;
+	state.m_revision = data->m_revision;
+	state.m_flags = stream.GetFlags();
+	state.m_xAxisOffset = m_group->GetXAxisOffset();
+	state.m_pixelsPerX = m_group->GetPixelsPerXUnit();
+	state.m_pixelsPerY = m_pixelsPerYAxisUnit;
+	state.m_yoff = stream.GetOffset();
+	state.m_width = w;
+	state.m_height = h;
+	state.m_persistence = channel->IsPersistenceEnabled();
+	state.m_halfPrecision =
+		m_halfPrecisionRasterPref.Get();
+	state.m_size = data->size();
+	if(ShareRasterization(channel, state, shares))
+		return false;
+	RasterizeState prevState = channel->GetRasterizeState();
+	if(!channel->UpdateRasterizeState(state) && !clearPersistence)
+	{
+		g_skippedChannelRasterizations ++;
+		shares.Add(state, channel);
+		return false;
+	}
+	channel->PrepareToRasterize(cmdbuf, w, h, state.m_halfPrecision);
+	channel->SetRasterizedView(state.m_xAxisOffset, state.m_pixelsPerX);
+	channel->SetHalfPrecisionRasterization(state.m_halfPrecision);
 
 	shared_ptr<ComputePipeline> comp;
 
+	//When zoomed out on a deep uniform analog waveform, draw a level of the min/max pyramid instead of the raw
+	//samples. This keeps rasterization time proportional to window width rather than memory depth.
+	//Pyramid and trend levels are the same kind of waveform as the one they were built from.
+	double pixelsPerX = m_group->GetPixelsPerXUnit();
+	auto raw = data;
+	auto kind = GetWaveformKind(data);
+	if( (kind == WAVEFORM_KIND_UNIFORM_ANALOG) && !channel->ShouldFillUnder() && !channel->ZeroHoldFlagSet())
+	{
+		auto uaraw = static_cast<UniformAnalogWaveform*>(data);
+		auto level = channel->GetPyramidLevel(uaraw, 1.0 / (pixelsPerX * data->m_timescale), cmdbuf);
+		if(level)
+			data = level;
+	}
+
+	//Same for long running trends, which are sparse and only ever grow
+	if( (kind == WAVEFORM_KIND_SPARSE_ANALOG) && !channel->ShouldFillUnder())
+	{
+		auto saraw = static_cast<SparseAnalogWaveform*>(data);
+		auto level = channel->GetTrendLevel(saraw, pixelsPerX);
+		if(level)
+			data = level;
+	}
+
 	//Calculate a bunch of constants
 	int64_t offset = m_group->GetXAxisOffset();
 	int64_t innerxoff = offset / data->m_timescale;
 	int64_t fractional_offset = offset % data->m_timescale;
 	int64_t offset_samples = (offset - data->m_triggerPhase) / data->m_timescale;
-	double pixelsPerX = m_group->GetPixelsPerXUnit();
 	double xscale = data->m_timescale * pixelsPerX;
 
 	//Figure out which shader to use
-	auto udata = dynamic_cast<UniformWaveformBase*>(data);
-	auto sdata = dynamic_cast<SparseWaveformBase*>(data);
-	auto uadata = dynamic_cast<UniformAnalogWaveform*>(data);
-	auto sadata = dynamic_cast<SparseAnalogWaveform*>(data);
-	auto uddata = dynamic_cast<UniformDigitalWaveform*>(data);
-	auto sddata = dynamic_cast<SparseDigitalWaveform*>(data);
+	auto udata = GetUniformBase(data, kind);
+	auto sdata = GetSparseBase(data, kind);
+	auto uadata = (kind == WAVEFORM_KIND_UNIFORM_ANALOG) ? static_cast<UniformAnalogWaveform*>(data) : nullptr;
+	auto sadata = (kind == WAVEFORM_KIND_SPARSE_ANALOG) ? static_cast<SparseAnalogWaveform*>(data) : nullptr;
+	auto uddata = (kind == WAVEFORM_KIND_UNIFORM_DIGITAL) ? static_cast<UniformDigitalWaveform*>(data) : nullptr;
+	auto sddata = (kind == WAVEFORM_KIND_SPARSE_DIGITAL) ? static_cast<SparseDigitalWaveform*>(data) : nullptr;
+
+	//Draw sparse waveforms from packed 32-bit timestamps if we can.
+	//Not while the instrument is appending to the waveform, since every update would have to repack all of it.
+	bool packed = false;
+	if(sadata || sddata)
+	{
+		auto pscope = stream.m_channel->GetScope();
+		if( (pscope == nullptr) || !pscope->IsAppendingToWaveform() )
+			packed = channel->PackSparseTimestamps(sdata, channel->ShouldMapDurations(), cmdbuf);
+	}
+
 	if(uadata)
 	{
 		if(channel->ShouldFillUnder())
+		{
 			comp = channel->GetHistogramPipeline();
+			job.m_shader = "waveform-compute.histogram.dense";
+		}
 		else
+		{
 			comp = channel->GetUniformAnalogPipeline();
+			job.m_shader = "waveform-compute.analog.dense";
+		}
 	}
 	else if(uddata)
+	{
 		comp = channel->GetUniformDigitalPipeline();
+		job.m_shader = "waveform-compute.digital.dense";
+	}
 	else if(sadata)
-		comp = channel->GetSparseAnalogPipeline();
+	{
+		comp = packed ? channel->GetPackedSparseAnalogPipeline() : channel->GetSparseAnalogPipeline();
+		job.m_shader = packed ? "waveform-compute.analog.compact" : "waveform-compute.analog";
+	}
 	else if(sddata)
-		comp = channel->GetSparseDigitalPipeline();
+	{
+		comp = packed ? channel->GetPackedSparseDigitalPipeline() : channel->GetSparseDigitalPipeline();
+		job.m_shader = packed ? "waveform-compute.digital.compact" : "waveform-compute.digital";
+	}
+	job.m_channel = stream.GetName();
 	if(!comp)
 	{
 		LogWarning("no pipeline found\n");
-		return;
+		return false;
 	}
 
 	//Bind input buffers
@@ -2105,49 +3597,94 @@ void WaveformArea::RasterizeAnalogOrDigitalWaveform(
 		if(sddata)
 			comp->BindBufferNonblocking(1, sddata->m_samples, cmdbuf);
 
-		//Map offsets and, if requested, durations
+		//Map offsets and, if requested, durations.
+		//Packed timestamps still need the 64-bit ones, for blocks which didn't fit.
 		comp->BindBufferNonblocking(2, sdata->m_offsets, cmdbuf);
-		if(channel->ShouldMapDurations())
+		if(packed)
+		{
+			comp->BindBufferNonblocking(4, channel->GetPackedHeaders(), cmdbuf);
+			comp->BindBufferNonblocking(5, channel->GetPackedDeltas(), cmdbuf);
+			if(channel->ShouldMapDurations())
+			{
+				comp->BindBufferNonblocking(6, sdata->m_durations, cmdbuf);
+				comp->BindBufferNonblocking(7, channel->GetPackedDurations(), cmdbuf);
+			}
+		}
+		else if(channel->ShouldMapDurations())
 			comp->BindBufferNonblocking(4, sdata->m_durations, cmdbuf);
 
-		//Calculate indexes for X axis
-		auto& ibuf = channel->GetIndexBuffer();
-		ibuf.PrepareForCpuAccess();
-		sdata->m_offsets.PrepareForCpuAccess();
-		for(size_t i=0; i<w; i++)
+		//If another channel in this group already searched the same waveform at the same view, reuse its results
+		IndexSearchKey key = {data, data->m_revision, data->size(), w, xscale, offset_samples};
+		auto it = searches.m_searches.find(key);
+		if(it != searches.m_searches.end())
+		{
+			comp->BindBufferNonblocking(3, it->second->GetIndexBuffer(), cmdbuf);
+			g_sharedIndexSearches ++;
+		}
+
+		else
 		{
-			int64_t target = floor(i / xscale) + offset_samples;
-			ibuf[i] = BinarySearchForGequal(
-				sdata->m_offsets.GetCpuPointer(),
-				data->size(),
-				target);
+			//Calculate the first offset for each X axis column on the CPU (cheap, and needs 64-bit math),
+			//then search for the matching sample indexes on the GPU so the offsets never have to leave the device
+			auto& targets = channel->GetIndexTargets();
+			BufferTransferTracker::PrepareForCpuAccess("WaveformArea::PrepareAnalogOrDigitalRasterization", targets);
+			for(size_t i=0; i<w; i++)
+				targets[i] = floor(i / xscale) + offset_samples;
+			targets.MarkModifiedFromCpu();
+
+			auto& ibuf = channel->GetIndexBuffer();
+			auto ipipe = channel->GetIndexPipeline();
+			ipipe->BindBufferNonblocking(0, sdata->m_offsets, cmdbuf);
+			ipipe->BindBufferNonblocking(1, targets, cmdbuf);
+			ipipe->BindBufferNonblocking(2, ibuf, cmdbuf, true);
+			WaveformIndexArgs iargs(data->size(), w);
+			size_t span = SIZE_MAX;
+			if(timer)
+				span = timer->Begin(cmdbuf, stream.GetName(), "WaveformIndex");
+			ipipe->Dispatch(cmdbuf, iargs, GetComputeBlockCount(w, 64));
+			if(timer)
+				timer->End(cmdbuf, span);
+			ibuf.MarkModifiedFromGpu();
+			indexed = true;
+			searches.m_searches[key] = channel.get();
+
+			comp->BindBufferNonblocking(3, ibuf, cmdbuf);
 		}
-		ibuf.MarkModifiedFromCpu();
-		comp->BindBufferNonblocking(3, ibuf, cmdbuf);
 	}
 
 	//Bind output texture and bail if there's nothing there
-	auto& imgOut = channel->GetRasterizedWaveform();
+	auto& imgOut = channel->GetBackRasterizedWaveform();
 	if(imgOut.empty())
-		return;
+		return false;
 	comp->BindBufferNonblocking(0, imgOut, cmdbuf);
 
 	//Scale alpha by zoom.
-	//As we zoom out more, reduce alpha to get proper intensity grading
-	//TODO: make this constant, then apply a second alpha pass in tone mapping?
-	//This will eliminate the need for a (potentially heavy) re-render when adjusting the slider.
-	float alpha = m_parent->GetTraceAlpha();
-	auto end = data->size() - 1;
-	int64_t firstOff = GetOffsetScaled(sdata, udata, 0);
-	int64_t lastOff = GetOffsetScaled(sdata, udata, end);
-	float capture_len = lastOff - firstOff;
+	//As we zoom out more, reduce alpha to get proper intensity grading.
+	//The intensity slider isn't included here, it's applied during tone mapping so adjusting it doesn't need a re-render.
+	float capture_len;
+	int64_t lastOff;
+	if(sdata)
+	{
+		int64_t firstOff;
+		channel->GetSparseOffsetRange(sdata, firstOff, lastOff);
+		capture_len = (lastOff - firstOff) * data->m_timescale;
+	}
+	else
+	{
+		auto end = data->size() - 1;
+		lastOff = end;
+		capture_len = GetOffsetScaled(sdata, udata, end) - GetOffsetScaled(sdata, udata, 0);
+	}
 	float avg_sample_len = capture_len / data->size();
 	float samplesPerPixel = 1.0 / (pixelsPerX * avg_sample_len);
-	float alpha_scaled = alpha / sqrt(samplesPerPixel);
+	float alpha_scaled = 1.0 / sqrt(samplesPerPixel);
 	alpha_scaled = min(1.0f, alpha_scaled) * 2;
+	auto& newState = channel->GetRasterizeState();
+	newState.m_lastOffset = lastOff;
+	newState.m_scaledAlpha = alpha_scaled;
 
 	//Fill shader configuration
-	ConfigPushConstants config;
+	auto& config = job.m_config;
 	config.innerXoff = -innerxoff;
 	config.windowHeight = h;
 	config.windowWidth = w;
@@ -2172,11 +3709,225 @@ void WaveformArea::RasterizeAnalogOrDigitalWaveform(
 		config.persistScale = m_parent->GetPersistDecay();
 	else
 		config.persistScale = 0;
+	config.firstColumn = 0;
+
+	//If the instrument only appended samples to the waveform we drew last time (roll mode etc), the columns to the left
+	//of the previous last sample are unchanged. Keep them and only redraw from there on, so the cost of each update is
+	//proportional to the new data rather than the whole capture.
+	auto scope = stream.m_channel->GetScope();
+	if( (scope != nullptr) &&
+		scope->IsAppendingToWaveform() &&
+		(data == raw) &&
+		(config.persistScale == 0) &&
+		prevState.IsAppendedBy(state) &&
+		(prevState.m_scaledAlpha == alpha_scaled) &&
+		m_incrementalAppendPref.Get() &&
+		channel->KeepFrontImage(cmdbuf) )
+	{
+		//Step back a column since the last sample's column may have been partially drawn
+		double xlast = (prevState.m_lastOffset - innerxoff) * xscale + config.xoff;
+		int64_t first = max( (int64_t)0, (int64_t)floor(xlast) - 1);
+		if(first >= (int64_t)w)
+		{
+			g_skippedChannelRasterizations ++;
+			shares.Add(state, channel);
+			return false;
+		}
+		config.firstColumn = first;
+	}
+	shares.Add(state, channel);
+
+	job.m_pipeline = comp;
+	job.m_columns = w - config.firstColumn;
+	job.m_tiles = GetComputeBlockCount(h, RASTER_TILE_HEIGHT);
+	job.m_output = &imgOut;
+	return true;
+}
+
+/**
+	@brief Shows another channel's image rather than rasterizing our own, if one drew exactly the same thing this pass
+
+	@param channel	The channel about to be rasterized
+	@param state	State it would be rasterized with
+	@param shares	Images rasterized so far during this pass
+
+	@return True if the channel is sharing another one's image and doesn't need rasterizing
+ */
+bool WaveformArea::ShareRasterization(
+	shared_ptr<DisplayedChannel> channel,
+	const RasterizeState& state,
+	RasterShareCache& shares)
+{
+	auto source = shares.Find(state);
+	if(!source)
+		return false;
+
+	channel->SetRasterSource(source);
+
+	//Our own buffers are going stale. Forget what's in them so we redraw ourselves once the views stop matching.
+	channel->UpdateRasterizeState(RasterizeState());
+	g_sharedChannelRasterizations ++;
+	return true;
+}
+
+/**
+	@brief Checks if cells of protocol waveforms too narrow for text should be drawn by the GPU
+ */
+bool WaveformArea::IsGpuProtocolRenderingEnabled()
+{
+	return m_parent->GetSession().GetPreferences().GetBool("Performance.Rendering.gpu_protocol");
+}
+
+/**
+	@brief Sets up rasterization of the narrow cells of a protocol waveform
+
+	Each column of the output gets the average color of all cells less than two pixels wide touching it. Wider cells
+	(which may have text in them) are still drawn by RenderProtocolWaveform().
+
+	@param channel			The channel to rasterize
+	@param cmdbuf			Command buffer to record into
+	@param job				Filled out with the rasterization dispatch to record
+	@param indexed			Set to true if an index search was recorded (and a barrier is needed before dispatching)
+	@param searches			Index searches already recorded in this group, which can be reused
+	@param shares			Images already rasterized during this pass, which can be shown instead of drawing our own
+	@param timer			If not null, timestamps are recorded around the index search
+
+	@return True if the channel needs to be rasterized, false if it's empty, unchanged, or shared
+ */
+bool WaveformArea::PrepareProtocolRasterization(
+	shared_ptr<DisplayedChannel> channel,
+	vk::raii::CommandBuffer& cmdbuf,
+	PendingRasterization& job,
+	bool& indexed,
+	IndexSearchCache& searches,
+	RasterShareCache& shares,
+	GpuTimer* timer)
+{
+	auto stream = channel->GetStream();
+	auto data = dynamic_cast<SparseWaveformBase*>(stream.GetData());
+	if( (data == nullptr) || data->empty() )
+	{
+		channel->PrepareToRasterize(cmdbuf, 0, 0);
+		channel->UpdateRasterizeState(RasterizeState());
+		return false;
+	}
+	size_t w = m_width;
+
+	//Skip the channel entirely if nothing that affects the rasterized image has changed since last time
+	RasterizeState state;
+	state.m_data = data;
+	state.m_revision = data->m_revision;
+	state.m_xAxisOffset = m_group->GetXAxisOffset();
+	state.m_pixelsPerX = m_group->GetPixelsPerXUnit();
+	state.m_width = w;
+	state.m_height = PROTOCOL_RASTER_PLANES;
+	state.m_size = data->size();
+	if(ShareRasterization(channel, state, shares))
+		return false;
+	if(!channel->UpdateRasterizeState(state))
+	{
+		g_skippedChannelRasterizations ++;
+		shares.Add(state, channel);
+		return false;
+	}
+	channel->PrepareToRasterize(cmdbuf, w, PROTOCOL_RASTER_PLANES);
+	auto& imgOut = channel->GetBackRasterizedWaveform();
+	if(imgOut.empty())
+		return false;
+
+	//Calculate a bunch of constants
+	int64_t offset = m_group->GetXAxisOffset();
+	int64_t offset_samples = (offset - data->m_triggerPhase) / data->m_timescale;
+	double xscale = data->m_timescale * m_group->GetPixelsPerXUnit();
+
+	//Same per-column index search as sparse analog and digital waveforms, but with one extra column
+	//so each column knows where the next one starts. Reuse another channel's search if it's the same one.
+	IndexSearchKey key = {data, data->m_revision, data->size(), w+1, xscale, offset_samples};
+	auto it = searches.m_searches.find(key);
+	DisplayedChannel* searched = channel.get();
+	if(it != searches.m_searches.end())
+	{
+		searched = it->second;
+		g_sharedIndexSearches ++;
+	}
+	else
+	{
+		auto& targets = channel->GetIndexTargets();
+		auto& ibuf = channel->GetIndexBuffer();
+		targets.resize(w+1);
+		ibuf.resize(w+1);
+		BufferTransferTracker::PrepareForCpuAccess("WaveformArea::PrepareProtocolRasterization", targets);
+		for(size_t i=0; i<=w; i++)
+			targets[i] = floor(i / xscale) + offset_samples;
+		targets.MarkModifiedFromCpu();
+
+		auto ipipe = channel->GetIndexPipeline();
+		ipipe->BindBufferNonblocking(0, data->m_offsets, cmdbuf);
+		ipipe->BindBufferNonblocking(1, targets, cmdbuf);
+		ipipe->BindBufferNonblocking(2, ibuf, cmdbuf, true);
+		WaveformIndexArgs iargs(data->size(), w+1);
+		size_t span = SIZE_MAX;
+		if(timer)
+			span = timer->Begin(cmdbuf, stream.GetName(), "WaveformIndex");
+		ipipe->Dispatch(cmdbuf, iargs, GetComputeBlockCount(w+1, 64));
+		if(timer)
+			timer->End(cmdbuf, span);
+		ibuf.MarkModifiedFromGpu();
+		indexed = true;
+		searches.m_searches[key] = searched;
+	}
+
+	//Bind everything else
+	auto comp = channel->GetProtocolRasterizePipeline();
+	comp->BindBufferNonblocking(0, imgOut, cmdbuf);
+	comp->BindBufferNonblocking(1, data->m_offsets, cmdbuf);
+	comp->BindBufferNonblocking(2, data->m_durations, cmdbuf);
+	comp->BindBufferNonblocking(3, searched->GetIndexBuffer(), cmdbuf);
+	comp->BindBufferNonblocking(4, searched->GetIndexTargets(), cmdbuf);
+	comp->BindBufferNonblocking(5, channel->GetProtocolColors(data), cmdbuf);
+
+	//Only a few fields of the config are used
+	auto& config = job.m_config;
+	config = ConfigPushConstants();
+	config.windowHeight = PROTOCOL_RASTER_PLANES;
+	config.windowWidth = w;
+	config.memDepth = data->size();
+	config.xscale = xscale;
+	shares.Add(state, channel);
+
+	job.m_pipeline = comp;
+	job.m_columns = GetComputeBlockCount(w, 64);
+	job.m_output = &imgOut;
+	job.m_shader = "ProtocolRasterize";
+	job.m_channel = stream.GetName();
+	return true;
+}
+
+/**
+	@brief Tone maps the narrow cells of a protocol waveform by converting the per-column colors to RGBA
+ */
+void WaveformArea::ToneMapProtocolWaveform(shared_ptr<DisplayedChannel> channel, vk::raii::CommandBuffer& cmdbuf)
+{
+	auto tex = channel->GetTexture();
+	if(tex == nullptr)
+		return;
+
+	//Nothing to draw? Early out if we haven't processed the window resize yet or there's no data
+	size_t width = channel->GetRasterizedX();
+	size_t height = m_channelButtonHeight;
+	if( (width == 0) || (height == 0) || (channel->GetRasterizedY() != PROTOCOL_RASTER_PLANES) )
+		return;
 
-	//Dispatch the shader
-	comp->Dispatch(cmdbuf, config, w, 1, 1);
-	comp->AddComputeMemoryBarrier(cmdbuf);
-	imgOut.MarkModifiedFromGpu();
+	//Run the actual compute shader
+	auto pipe = channel->GetToneMapPipeline();
+	pipe->BindBufferNonblocking(0, channel->GetRasterizedWaveform(), cmdbuf);
+	pipe->BindStorageImage(
+		1,
+		**m_parent->GetTextureManager()->GetSampler(),
+		tex->GetView(),
+		vk::ImageLayout::eGeneral);
+	ProtocolToneMapArgs args(width, height);
+	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(width, 64), height);
 }
 
 /**
@@ -2203,27 +3954,8 @@ void WaveformArea::ToneMapAnalogOrDigitalWaveform(shared_ptr<DisplayedChannel> c
 		tex->GetView(),
 		vk::ImageLayout::eGeneral);
 	auto color = ImGui::ColorConvertU32ToFloat4(ColorFromString(channel->GetStream().m_channel->m_displaycolor));
-	WaveformToneMapArgs args(color, width, height);
+	WaveformToneMapArgs args(color, width, height, m_parent->GetTraceAlpha(), channel->IsRasterizedHalfPrecision());
 	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(width, 64), height);
-
-	//Add a barrier before we read from the fragment shader
-	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-	vk::ImageMemoryBarrier barrier(
-		vk::AccessFlagBits::eShaderWrite,
-		vk::AccessFlagBits::eShaderRead,
-		vk::ImageLayout::eGeneral,
-		vk::ImageLayout::eGeneral,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		tex->GetImage(),
-		range);
-	cmdbuf.pipelineBarrier(
-			vk::PipelineStageFlagBits::eComputeShader,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			{},
-			{},
-			{},
-			barrier);
 }
 
 /**
@@ -2257,8 +3989,9 @@ void WaveformArea::ToneMapWaterfallWaveform(std::shared_ptr<DisplayedChannel> ch
 	pipe->BindSampledImage(
 		2,
 		**texmgr->GetSampler(),
-		texmgr->GetView(channel->m_colorRamp),
+		texmgr->GetView("eye-gradients"),
 		vk::ImageLayout::eShaderReadOnlyOptimal);
+	float rampRow = texmgr->GetStripRow(channel->m_colorRamp);
 
 	int64_t offset = m_group->GetXAxisOffset();
 	int64_t offset_samples = (offset - data->m_triggerPhase) / data->m_timescale;
@@ -2266,27 +3999,35 @@ void WaveformArea::ToneMapWaterfallWaveform(std::shared_ptr<DisplayedChannel> ch
 	double pixelsPerX = m_group->GetPixelsPerXUnit();
 	double xscale = data->m_timescale * pixelsPerX;
 
-	WaterfallToneMapArgs args(width, height, m_width, m_height, offset_samples, xscale );
-	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(m_width, 64), m_height);
+	//If the view hasn't changed, the waterfall has just scrolled by one row per update since last time.
+	//Rotate the texture instead of moving every pixel, and only draw the new rows.
+	WaterfallToneMapState state;
+	state.m_data = data;
+	state.m_revision = data->m_revision;
+	state.m_texture = tex.get();
+	state.m_outwidth = m_width;
+	state.m_outheight = m_height;
+	state.m_offsetSamples = offset_samples;
+	state.m_xscale = xscale;
+	state.m_colorRamp = channel->m_colorRamp;
+	auto& prevState = channel->m_waterfallState;
+	uint32_t firstRow = 0;
+	uint64_t newRows = state.m_revision - prevState.m_revision;
+	if( prevState.IsScrolledBy(state) &&
+		(newRows < state.m_outheight) &&
+		m_incrementalWaterfallPref.Get() )
+	{
+		if(newRows == 0)
+			return;
 
-	//Add a barrier before we read from the fragment shader
-	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-	vk::ImageMemoryBarrier barrier(
-		vk::AccessFlagBits::eShaderWrite,
-		vk::AccessFlagBits::eShaderRead,
-		vk::ImageLayout::eGeneral,
-		vk::ImageLayout::eGeneral,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		tex->GetImage(),
-		range);
-	cmdbuf.pipelineBarrier(
-			vk::PipelineStageFlagBits::eComputeShader,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			{},
-			{},
-			{},
-			barrier);
+		firstRow = state.m_outheight - newRows;
+		state.m_rowOffset = (prevState.m_rowOffset + newRows) % state.m_outheight;
+	}
+	prevState = state;
+
+	WaterfallToneMapArgs args(
+		width, height, m_width, m_height, offset_samples, xscale, firstRow, state.m_rowOffset, rampRow);
+	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(m_width, 64), m_height - firstRow);
 }
 
 /**
@@ -2303,15 +4044,32 @@ void WaveformArea::ToneMapSpectrogramWaveform(std::shared_ptr<DisplayedChannel>
 		return;
 
 	//Nothing to draw? Early out if we haven't processed the window resize yet or there's no data
-	auto width = data->GetWidth();
+	size_t width = data->GetWidth();
 	auto height = data->GetHeight();
 	if( (width == 0) || (height == 0) )
 		return;
 
+	int64_t offset = m_group->GetXAxisOffset();
+	int64_t offset_samples = (offset - data->m_triggerPhase) / data->m_timescale;
+
+	//Invert X (and Y) scales because multiply in the shader is faster than divide
+	double xscale = 1.0 / (data->m_timescale * m_group->GetPixelsPerXUnit());
+
+	//When zoomed out, read a decimated copy so every time bin is still looked at
+	AcceleratorBuffer<float>* input = &data->GetOutData();
+	size_t factor = 1;
+	auto level = channel->GetSpectrogramLevel(data, xscale, cmdbuf, width, factor);
+	if(level)
+	{
+		input = level;
+		offset_samples = floor(offset_samples * 1.0 / factor);
+		xscale /= factor;
+	}
+
 	//Run the actual compute shader
 	auto pipe = channel->GetToneMapPipeline();
 	const auto& texmgr = m_parent->GetTextureManager();
-	pipe->BindBufferNonblocking(0, data->GetOutData(), cmdbuf);
+	pipe->BindBufferNonblocking(0, *input, cmdbuf);
 	pipe->BindStorageImage(
 		1,
 		**texmgr->GetSampler(),
@@ -2320,14 +4078,9 @@ void WaveformArea::ToneMapSpectrogramWaveform(std::shared_ptr<DisplayedChannel>
 	pipe->BindSampledImage(
 		2,
 		**texmgr->GetSampler(),
-		texmgr->GetView(channel->m_colorRamp),
+		texmgr->GetView("eye-gradients"),
 		vk::ImageLayout::eShaderReadOnlyOptimal);
-
-	int64_t offset = m_group->GetXAxisOffset();
-	int64_t offset_samples = (offset - data->m_triggerPhase) / data->m_timescale;
-
-	//Invert X (and Y) scales because multiply in the shader is faster than divide
-	double xscale = 1.0 / (data->m_timescale * m_group->GetPixelsPerXUnit());
+	float rampRow = texmgr->GetStripRow(channel->m_colorRamp);
 
 	//Rescale Y offset to screen pixels
 	//Note that we actually care about offset from our *bottom*, but GetOffset() returns offset from our *midpoint*
@@ -2339,27 +4092,8 @@ void WaveformArea::ToneMapSpectrogramWaveform(std::shared_ptr<DisplayedChannel>
 	//Rescale Y to "spectrogram bins per pixel" vs "Hz per pixel"
 	float yscale = 1.0 / (m_pixelsPerYAxisUnit * data->GetBinSize());
 
-	SpectrogramToneMapArgs args(width, height, m_width, m_height, offset_samples, xscale, yoff, yscale);
+	SpectrogramToneMapArgs args(width, height, m_width, m_height, offset_samples, xscale, yoff, yscale, rampRow);
 	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(m_width, 64), m_height);
-
-	//Add a barrier before we read from the fragment shader
-	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-	vk::ImageMemoryBarrier barrier(
-		vk::AccessFlagBits::eShaderWrite,
-		vk::AccessFlagBits::eShaderRead,
-		vk::ImageLayout::eGeneral,
-		vk::ImageLayout::eGeneral,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		tex->GetImage(),
-		range);
-	cmdbuf.pipelineBarrier(
-			vk::PipelineStageFlagBits::eComputeShader,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			{},
-			{},
-			{},
-			barrier);
 }
 
 /**
@@ -2393,30 +4127,12 @@ void WaveformArea::ToneMapEyeWaveform(std::shared_ptr<DisplayedChannel> channel,
 	pipe->BindSampledImage(
 		2,
 		**texmgr->GetSampler(),
-		texmgr->GetView(channel->m_colorRamp),
+		texmgr->GetView("eye-gradients"),
 		vk::ImageLayout::eShaderReadOnlyOptimal);
+	float rampRow = texmgr->GetStripRow(channel->m_colorRamp);
 
-	EyeToneMapArgs args(width, height);
+	EyeToneMapArgs args(width, height, rampRow);
 	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(width, 64), height);
-
-	//Add a barrier before we read from the fragment shader
-	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-	vk::ImageMemoryBarrier barrier(
-		vk::AccessFlagBits::eShaderWrite,
-		vk::AccessFlagBits::eShaderRead,
-		vk::ImageLayout::eGeneral,
-		vk::ImageLayout::eGeneral,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		tex->GetImage(),
-		range);
-	cmdbuf.pipelineBarrier(
-			vk::PipelineStageFlagBits::eComputeShader,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			{},
-			{},
-			{},
-			barrier);
 }
 
 /**
@@ -2450,30 +4166,12 @@ void WaveformArea::ToneMapConstellationWaveform(std::shared_ptr<DisplayedChannel
 	pipe->BindSampledImage(
 		2,
 		**texmgr->GetSampler(),
-		texmgr->GetView(channel->m_colorRamp),
+		texmgr->GetView("eye-gradients"),
 		vk::ImageLayout::eShaderReadOnlyOptimal);
+	float rampRow = texmgr->GetStripRow(channel->m_colorRamp);
 
-	ConstellationToneMapArgs args(width, height);
+	ConstellationToneMapArgs args(width, height, rampRow);
 	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(width, 64), height);
-
-	//Add a barrier before we read from the fragment shader
-	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-	vk::ImageMemoryBarrier barrier(
-		vk::AccessFlagBits::eShaderWrite,
-		vk::AccessFlagBits::eShaderRead,
-		vk::ImageLayout::eGeneral,
-		vk::ImageLayout::eGeneral,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		tex->GetImage(),
-		range);
-	cmdbuf.pipelineBarrier(
-			vk::PipelineStageFlagBits::eComputeShader,
-			vk::PipelineStageFlagBits::eFragmentShader,
-			{},
-			{},
-			{},
-			barrier);
 }
 
 /**
@@ -2483,9 +4181,8 @@ void WaveformArea::ToneMapConstellationWaveform(std::shared_ptr<DisplayedChannel
  */
 void WaveformArea::RenderBackgroundGradient(ImVec2 start, ImVec2 size)
 {
-	auto& prefs = m_parent->GetSession().GetPreferences();
-	auto color_bottom = prefs.GetColor("Appearance.Graphs.bottom_color");
-	auto color_top = prefs.GetColor("Appearance.Graphs.top_color");
+	auto color_bottom = m_backgroundBottomColor.Get();
+	auto color_top = m_backgroundTopColor.Get();
 
 	ImDrawList* draw_list = ImGui::GetWindowDrawList();
 	draw_list->AddRectFilledMultiColor(
@@ -2509,17 +4206,15 @@ void WaveformArea::RenderBackgroundGradient(ImVec2 start, ImVec2 size)
 }
 
 /**
-	@brief Renders grid lines
+	@brief Calculates the positions of the grid lines into m_gridCache
+
+	@return False if the current scale can't be drawn
  */
-void WaveformArea::RenderGrid(ImVec2 start, ImVec2 size, map<float, float>& gridmap, float& vbot, float& vtop)
+bool WaveformArea::CalculateGrid(float ytop, float ybot, float theight, Unit unit)
 {
-	//Early out if we're not displaying any analog waveforms
-	auto stream = GetFirstAnalogOrDensityStream();
-	if(!stream)
-		return;
+	auto& gridmap = m_gridCache.m_gridmap;
+	gridmap.clear();
 
-	float ytop = start.y;
-	float ybot = start.y + size.y;
 	float halfheight = m_height / 2;
 
 	//Volts from the center line of our graph to the top. May not be the max value in the signal.
@@ -2529,11 +4224,9 @@ void WaveformArea::RenderGrid(ImVec2 start, ImVec2 size, map<float, float>& grid
 	if( (volts_per_half_span < -FLT_MAX/2) || (volts_per_half_span > FLT_MAX/2) )
 	{
 		LogWarning("WaveformArea: invalid grid span (%f)\n", volts_per_half_span);
-		return;
+		return false;
 	}
 
-	float theight = ImGui::GetFontSize();
-
 	//Decide what voltage step to use. Pick from a list (in volts)
 	int min_steps = 1;								//Always have at least one division
 	int max_steps = floor(halfheight / theight);	//Do not have more divisions than can fit given our font size
@@ -2541,9 +4234,9 @@ void WaveformArea::RenderGrid(ImVec2 start, ImVec2 size, map<float, float>& grid
 	float selected_step = PickStepSize(volts_per_half_span, min_steps, max_steps);
 
 	//Special case a few scenarios
-	if(stream.GetYAxisUnits() == Unit::UNIT_LOG_BER)
+	if(unit == Unit::UNIT_LOG_BER)
 		selected_step = 2;
-	if(stream.GetYAxisUnits() == Unit::UNIT_HEXNUM)
+	if(unit == Unit::UNIT_HEXNUM)
 	{
 		//round to next power of two
 		selected_step = pow(2, round(log2(selected_step)));
@@ -2554,12 +4247,14 @@ void WaveformArea::RenderGrid(ImVec2 start, ImVec2 size, map<float, float>& grid
 	float top_edge = (ytop + theight/2);
 
 	//Offset things so that the grid lines are at sensible locations
-	vbot = YPositionToYAxisUnits(ybot);
-	vtop = YPositionToYAxisUnits(ytop);
+	float vbot = YPositionToYAxisUnits(ybot);
+	float vtop = YPositionToYAxisUnits(ytop);
 	float vmid = (vbot + vtop)/2;
-	float yzero = YAxisUnitsToYPosition(0);
 	float zero_offset = fmodf(vmid, selected_step);
 	vmid -= zero_offset;
+	m_gridCache.m_vbot = vbot;
+	m_gridCache.m_vtop = vtop;
+	m_gridCache.m_yzero = YAxisUnitsToYPosition(0);
 
 	//Calculate grid positions
 	size_t igrid = 0;
@@ -2592,12 +4287,56 @@ void WaveformArea::RenderGrid(ImVec2 start, ImVec2 size, map<float, float>& grid
 			break;
 	}
 
+	return true;
+}
+
+/**
+	@brief Renders grid lines
+
+	The grid positions are kept in m_gridCache, and only recalculated when the view changes.
+ */
+void WaveformArea::RenderGrid(ImVec2 start, ImVec2 size)
+{
+	//Early out if we're not displaying any analog waveforms
+	auto stream = GetFirstAnalogOrDensityStream();
+	if(!stream)
+	{
+		m_gridCache.m_gridValid = false;
+		m_gridCache.m_labelsValid = false;
+		m_gridCache.m_gridmap.clear();
+		return;
+	}
+
+	float ytop = start.y;
+	float ybot = start.y + size.y;
+	float theight = ImGui::GetFontSize();
+
+	YAxisGridKey key;
+	key.m_ytop = ytop;
+	key.m_ybot = ybot;
+	key.m_ymid = m_ymid;
+	key.m_height = m_height;
+	key.m_pixelsPerYAxisUnit = m_pixelsPerYAxisUnit;
+	key.m_yAxisOffset = m_yAxisOffset;
+	key.m_fontSize = theight;
+	key.m_unit = stream.GetYAxisUnits();
+	if(!m_gridCache.m_gridValid || !(m_gridCache.m_key == key))
+	{
+		m_gridCache.m_key = key;
+		m_gridCache.m_labelsValid = false;
+		m_gridCache.m_gridValid = CalculateGrid(ytop, ybot, theight, key.m_unit);
+	}
+	if(!m_gridCache.m_gridValid)
+		return;
+
+	auto& gridmap = m_gridCache.m_gridmap;
+	float yzero = m_gridCache.m_yzero;
+
 	//Style settings
-	auto& prefs = m_parent->GetSession().GetPreferences();
-	auto axisColor = prefs.GetColor("Appearance.Graphs.grid_centerline_color");
-	auto gridColor = prefs.GetColor("Appearance.Graphs.grid_color");
-	auto axisWidth = prefs.GetReal("Appearance.Graphs.grid_centerline_width");
-	auto gridWidth = prefs.GetReal("Appearance.Graphs.grid_width");
+	auto axisColor = m_gridCenterlineColor.Get();
+	auto gridColor = m_gridColor.Get();
+	auto axisWidth = m_gridCenterlineWidth.Get();
+	auto gridWidth = m_gridWidth.Get();
 
 	auto list = ImGui::GetWindowDrawList();
 	float left = start.x;
@@ -2627,7 +4366,7 @@ void WaveformArea::RenderGrid(ImVec2 start, ImVec2 size, map<float, float>& grid
 /**
 	@brief Renders the Y axis scale
  */
-void WaveformArea::RenderYAxis(ImVec2 size, map<float, float>& gridmap, float vbot, float vtop)
+void WaveformArea::RenderYAxis(ImVec2 size)
 {
 	ImGui::SameLine(0, 0);
 	ImGui::BeginChild("yaxis", size);
@@ -2640,9 +4379,8 @@ void WaveformArea::RenderYAxis(ImVec2 size, map<float, float>& gridmap, float vb
 
 	//Style settings
 	auto font = m_parent->GetFontPref("Appearance.Graphs.y_axis_font");
-	auto& prefs = m_parent->GetSession().GetPreferences();
 	float theight = font->FontSize * ImGui::GetIO().FontGlobalScale;
-	auto textColor = prefs.GetColor("Appearance.Graphs.y_axis_text_color");
+	auto textColor = m_yAxisTextColor.Get();
 
 	//Reserve an empty area we're going to draw into
 	ImGui::Dummy(size);
@@ -2677,23 +4415,45 @@ void WaveformArea::RenderYAxis(ImVec2 size, map<float, float>& gridmap, float vb
 		}
 	}
 
+	//Format the Y axis labels if the grid or font changed since last frame
+	auto& cache = m_gridCache;
+	if(!cache.m_labelsValid || (cache.m_labelFont != font) || (cache.m_labelFontSize != theight) ||
+		!(cache.m_labelUnit == m_yAxisUnit) )
+	{
+		cache.m_labels.clear();
+		for(auto it : cache.m_gridmap)
+		{
+			float vlo = YPositionToYAxisUnits(it.second - 0.5);
+			float vhi = YPositionToYAxisUnits(it.second + 0.5);
+
+			YAxisLabel label;
+			label.m_y = it.second;
+			label.m_text = m_yAxisUnit.PrettyPrintRange(vlo, vhi, cache.m_vbot, cache.m_vtop);
+			label.m_size = font->CalcTextSizeA(theight, FLT_MAX, 0, label.m_text.c_str());
+			cache.m_labels.push_back(label);
+		}
+		cache.m_labelFont = font;
+		cache.m_labelFontSize = theight;
+		cache.m_labelUnit = m_yAxisUnit;
+		cache.m_labelsValid = true;
+	}
+
 	//Draw text for the Y axis labels
 	float xmargin = 5;
-	for(auto it : gridmap)
+	for(auto& label : cache.m_labels)
 	{
-		float vlo = YPositionToYAxisUnits(it.second - 0.5);
-		float vhi = YPositionToYAxisUnits(it.second + 0.5);
-		auto label = m_yAxisUnit.PrettyPrintRange(vlo, vhi, vbot, vtop);
-
-		float y = it.second - theight/2;
+		float y = label.m_y - theight/2;
 		if(y > ybot)
 			continue;
 		if(y < ytop)
 			continue;
 
-		auto tsize = font->CalcTextSizeA(theight, FLT_MAX, 0, label.c_str());
-
-		draw_list->AddText(font, theight, ImVec2(origin.x + size.x - tsize.x - xmargin, y), textColor, label.c_str());
+		draw_list->AddText(
+			font,
+			theight,
+			ImVec2(origin.x + size.x - label.m_size.x - xmargin, y),
+			textColor,
+			label.m_text.c_str());
 	}
 
 	ImGui::EndChild();
@@ -2771,7 +4531,7 @@ void WaveformArea::RenderCursors(ImVec2 start, ImVec2 size)
 	auto mouse = ImGui::GetMousePos();
 	if(m_group->IsDraggingTrigger())
 	{
-		auto color = m_parent->GetSession().GetPreferences().GetColor("Appearance.Timeline.axis_color");
+		auto color = m_timelineAxisColor.Get();
 		draw_list->AddLine(
 			ImVec2(mouse.x, start.y),
 			ImVec2(mouse.x, start.y + size.y),
@@ -2885,7 +4645,54 @@ void WaveformArea::RenderEyePatternTooltip(ImVec2 start, ImVec2 size)
 		//Calculate the BER at this point
 		//TODO: this currently assumes the midpoint of the waveform is the zero point,
 		//which is only true for NRZ waveforms (not PAM / MLT3)
-		auto ber = eyedata->GetBERAtPoint(delta.x, delta.y, eyedata->GetWidth() / 2, eyedata->GetHeight() / 2);
+		//The integration buffer is usually on the GPU, so rather than downloading it all we ask for the row and
+		//column through the mouse position, and show the result when it arrives (normally the next frame)
+		int64_t x = delta.x;
+		int64_t y = delta.y;
+		size_t width = eyedata->GetWidth();
+		size_t height = eyedata->GetHeight();
+		auto& readback = m_parent->GetSession().GetGpuReadback();
+		uint64_t tag = (static_cast<uint64_t>(x) << 32) | static_cast<uint64_t>(y);
+
+		GpuReadbackResult result;
+		if(readback.GetResult(this, result) &&
+			(result.m_data == eyedata) &&
+			(result.m_revision == eyedata->m_revision) &&
+			(result.m_words.size() == 2 * (width + height)) )
+		{
+			int64_t rx = result.m_tag >> 32;
+			int64_t ry = result.m_tag & 0xffffffff;
+			m_tooltipBER = GetBERFromProfiles(result.m_words, width, height, rx, ry);
+			m_tooltipBERWaveform = eyedata;
+			m_tooltipBERRevision = eyedata->m_revision;
+			m_tooltipBERPos[0] = rx;
+			m_tooltipBERPos[1] = ry;
+		}
+
+		bool current =
+			(m_tooltipBERWaveform == eyedata) &&
+			(m_tooltipBERRevision == eyedata->m_revision) &&
+			(m_tooltipBERPos[0] == x) &&
+			(m_tooltipBERPos[1] == y);
+		bool requested =
+			(m_tooltipBERRequestWaveform == eyedata) &&
+			(m_tooltipBERRequestRevision == eyedata->m_revision) &&
+			(m_tooltipBERRequestTag == tag);
+		if(!current && !requested)
+		{
+			vector<uint32_t> indexes;
+			indexes.reserve(width + height);
+			for(size_t i=0; i<width; i++)
+				indexes.push_back(y*width + i);
+			for(size_t i=0; i<height; i++)
+				indexes.push_back(i*width + x);
+			readback.Request(this, firstStream, GpuReadback::SOURCE_EYE_ACCUM, indexes, tag);
+
+			m_tooltipBERRequestWaveform = eyedata;
+			m_tooltipBERRequestRevision = eyedata->m_revision;
+			m_tooltipBERRequestTag = tag;
+		}
+		auto ber = m_tooltipBER;
 
 		ImGui::BeginTooltip();
 		ImGui::PushTextWrapPos(ImGui::GetFontSize() * 50);
@@ -2908,6 +4715,45 @@ void WaveformArea::RenderEyePatternTooltip(ImVec2 start, ImVec2 size)
 	}
 }
 
+/**
+	@brief Estimates the BER at a point in an eye from the row and column of the integration buffer through it
+
+	A sample taken at this point is wrong if the signal was between it and the center of the eye: vertically, the
+	hits in the column between the point and the midline, and horizontally, the hits in the row between the point and
+	the center. The larger of the two, as a fraction of every hit in the column, is the BER.
+
+	@param words	Row y, then column x, of the integration buffer as read back by GpuReadback (two words per bin)
+	@param width	Width of the integration buffer
+	@param height	Height of the integration buffer
+	@param x		X position of the point
+	@param y		Y position of the point
+ */
+float WaveformArea::GetBERFromProfiles(const vector<uint32_t>& words, size_t width, size_t height, int64_t x, int64_t y)
+{
+	auto bins = reinterpret_cast<const int64_t*>(words.data());
+	auto row = bins;
+	auto col = bins + width;
+
+	int64_t xmid = width / 2;
+	int64_t ymid = height / 2;
+
+	int64_t total = 0;
+	for(size_t i=0; i<height; i++)
+		total += col[i];
+	if(total == 0)
+		return 0;
+
+	int64_t vhits = 0;
+	for(int64_t i=min(y, ymid); i<=max(y, ymid); i++)
+		vhits += col[i];
+
+	int64_t hhits = 0;
+	for(int64_t i=min(x, xmid); i<=max(x, xmid); i++)
+		hhits += row[i];
+
+	return min(1.0, max(vhits, hhits) * 1.0 / total);
+}
+
 /**
 	@brief Look for mismatched vertical scales and display warning message
  */
@@ -2953,10 +4799,13 @@ void WaveformArea::CheckForScaleMismatch(ImVec2 start, ImVec2 size)
 
 	//Warning icon
 	auto list = ImGui::GetWindowDrawList();
+	auto warning = m_parent->GetTextureRef("warning");
 	list->AddImage(
-		m_parent->GetTextureManager()->GetTexture("warning"),
+		warning.m_id,
 		ImVec2(center.x - 0.5, center.y - warningSize/2 - 0.5),
-		ImVec2(center.x + warningSize + 0.5, center.y + warningSize/2 + 0.5));
+		ImVec2(center.x + warningSize + 0.5, center.y + warningSize/2 + 0.5),
+		warning.m_uv0,
+		warning.m_uv1);
 
 	//Prepare to draw text
 	center.x += warningSize;
@@ -3588,10 +5437,13 @@ void WaveformArea::DrawDropRangeMismatchMessage(
 		float warningSize = ImGui::GetFontSize() * 3;
 
 		//Warning icon
+		auto warning = m_parent->GetTextureRef("warning");
 		list->AddImage(
-			m_parent->GetTextureManager()->GetTexture("warning"),
+			warning.m_id,
 			ImVec2(center.x - 0.5, center.y - warningSize/2 - 0.5),
-			ImVec2(center.x + warningSize + 0.5, center.y + warningSize/2 + 0.5));
+			ImVec2(center.x + warningSize + 0.5, center.y + warningSize/2 + 0.5),
+			warning.m_uv0,
+			warning.m_uv1);
 
 		//Prepare to draw text
 		center.x += warningSize;
@@ -3734,6 +5586,42 @@ void WaveformArea::ChannelButton(shared_ptr<DisplayedChannel> chan, size_t index
 						tooltip += "(PASS)";
 					else
 						tooltip += "(FAIL)";
+
+					//Per-acquisition results, if we're testing live data
+					MaskTestStats stats;
+					if(m_parent->GetSession().GetMaskTestStats(echan, stats) && (stats.m_acquisitions > 0) )
+					{
+						snprintf(tmp, sizeof(tmp),
+							"\nAcquisitions failed: %" PRIu64 " of %" PRIu64 " (last: %" PRIu64 " hits)",
+							stats.m_failedAcquisitions,
+							stats.m_acquisitions,
+							stats.m_lastHits);
+						tooltip += tmp;
+						for(size_t i=0; i<stats.m_regionHits.size(); i++)
+						{
+							snprintf(tmp, sizeof(tmp), "\nRegion %zu: %" PRIu64 " hits", i+1, stats.m_regionHits[i]);
+							tooltip += tmp;
+						}
+					}
+
+					//Margin of the integrated eye
+					if(stats.m_eyeValid)
+					{
+						if(stats.m_eyeMargin < 0)
+							tooltip += "\nMask margin: fails as drawn";
+						else
+						{
+							snprintf(tmp, sizeof(tmp), "\nMask margin: %s%.1f %%",
+								stats.m_eyeMarginUnbounded ? ">" : "", stats.m_eyeMargin * 100);
+							tooltip += tmp;
+						}
+						for(size_t i=0; i<stats.m_eyeRegionHits.size(); i++)
+						{
+							snprintf(tmp, sizeof(tmp), "\nRegion %zu (integrated): %" PRIu64 " hits",
+								i+1, stats.m_eyeRegionHits[i]);
+							tooltip += tmp;
+						}
+					}
 				}
 			}
 			else if(cdata)
@@ -3806,12 +5694,13 @@ void WaveformArea::ChannelButton(shared_ptr<DisplayedChannel> chan, size_t index
 					auto displayName = m_parent->GetEyeGradientFriendlyName(internalName);
 
 					ImVec2 p = ImGui::GetCursorScreenPos();
+					auto tex = m_parent->GetTextureRef(internalName);
 					list->AddImage(
-						m_parent->GetTexture(internalName),
+						tex.m_id,
 						p,
 						ImVec2(p.x + gradsize.x, p.y + gradsize.y),
-						ImVec2(0, 0),
-						ImVec2(1, 1));
+						tex.m_uv0,
+						tex.m_uv1);
 					ImGui::Dummy(gradsize);
 					ImGui::SameLine();
 
@@ -38,19 +38,26 @@
 class WaveformArea;
 class WaveformGroup;
 class MainWindow;
+class GpuTimer;
+class SpectrogramWaveform;
 
 #include "TextureManager.h"
+#include "ComputePipelinePool.h"
+#include "TrendStore.h"
 #include "Marker.h"
+#include "PreferenceManager.h"
 
 class WaveformToneMapArgs
 {
 public:
-	WaveformToneMapArgs(ImVec4 channelColor, uint32_t w, uint32_t h)
+	WaveformToneMapArgs(ImVec4 channelColor, uint32_t w, uint32_t h, float alpha, bool halfPrecision)
 	: m_red(channelColor.x)
 	, m_green(channelColor.y)
 	, m_blue(channelColor.z)
 	, m_width(w)
 	, m_height(h)
+	, m_alpha(alpha)
+	, m_halfPrecision(halfPrecision)
 	{}
 
 	float m_red;
@@ -58,42 +65,136 @@ public:
 	float m_blue;
 	uint32_t m_width;
 	uint32_t m_height;
+	float m_alpha;
+	uint32_t m_halfPrecision;
 };
 
 class EyeToneMapArgs
 {
 public:
-	EyeToneMapArgs(uint32_t w, uint32_t h)
+	EyeToneMapArgs(uint32_t w, uint32_t h, float rampRow)
 	: m_width(w)
 	, m_height(h)
+	, m_rampRow(rampRow)
 	{}
 
 	uint32_t m_width;
 	uint32_t m_height;
+
+	///@brief V coordinate of the color ramp within the gradient strip
+	float m_rampRow;
+};
+
+class WaveformIndexArgs
+{
+public:
+	WaveformIndexArgs(uint32_t depth, uint32_t w)
+	: m_memDepth(depth)
+	, m_width(w)
+	{}
+
+	uint32_t m_memDepth;
+	uint32_t m_width;
+};
+
+class SparseTimestampPackArgs
+{
+public:
+	SparseTimestampPackArgs(uint32_t depth, bool durations, uint32_t stride)
+	: m_memDepth(depth)
+	, m_packDurations(durations)
+	, m_stride(stride)
+	{}
+
+	uint32_t m_memDepth;
+	uint32_t m_packDurations;
+	uint32_t m_stride;
+};
+
+class ProtocolToneMapArgs
+{
+public:
+	ProtocolToneMapArgs(uint32_t w, uint32_t h)
+	: m_width(w)
+	, m_height(h)
+	{}
+
+	uint32_t m_width;
+	uint32_t m_height;
+};
+
+class WaveformPyramidArgs
+{
+public:
+	WaveformPyramidArgs(uint32_t inlen, uint32_t outlen, uint32_t factor, bool interleaved, uint32_t stride)
+	: m_inputLen(inlen)
+	, m_outputLen(outlen)
+	, m_factor(factor)
+	, m_interleaved(interleaved)
+	, m_stride(stride)
+	{}
+
+	uint32_t m_inputLen;
+	uint32_t m_outputLen;
+	uint32_t m_factor;
+	uint32_t m_interleaved;
+	uint32_t m_stride;
+};
+
+class SpectrogramPyramidArgs
+{
+public:
+	SpectrogramPyramidArgs(uint32_t inwidth, uint32_t outwidth, uint32_t height, uint32_t factor)
+	: m_inputWidth(inwidth)
+	, m_outputWidth(outwidth)
+	, m_height(height)
+	, m_factor(factor)
+	{}
+
+	uint32_t m_inputWidth;
+	uint32_t m_outputWidth;
+	uint32_t m_height;
+	uint32_t m_factor;
 };
 
 class ConstellationToneMapArgs
 {
 public:
-	ConstellationToneMapArgs(uint32_t w, uint32_t h)
+	ConstellationToneMapArgs(uint32_t w, uint32_t h, float rampRow)
 	: m_width(w)
 	, m_height(h)
+	, m_rampRow(rampRow)
 	{}
 
 	uint32_t m_width;
 	uint32_t m_height;
+
+	///@brief V coordinate of the color ramp within the gradient strip
+	float m_rampRow;
 };
 
 class WaterfallToneMapArgs
 {
 public:
-	WaterfallToneMapArgs(uint32_t w, uint32_t h, uint32_t outwidth, uint32_t outheight, uint32_t o, float x)
+	WaterfallToneMapArgs(
+		uint32_t w,
+		uint32_t h,
+		uint32_t outwidth,
+		uint32_t outheight,
+		uint32_t o,
+		float x,
+		uint32_t firstRow,
+		uint32_t rowOffset,
+		float rampRow)
 	: m_width(w)
 	, m_height(h)
 	, m_outwidth(outwidth)
 	, m_outheight(outheight)
 	, m_offsetSamples(o)
 	, m_xscale(x)
+	, m_firstRow(firstRow)
+	, m_rowOffset(rowOffset)
+	, m_rampRow(rampRow)
 	{}
 
 	uint32_t m_width;
@@ -102,13 +203,18 @@ public:
 	uint32_t m_outheight;
 	uint32_t m_offsetSamples;
 	float m_xscale;
+	uint32_t m_firstRow;
+	uint32_t m_rowOffset;
+
+	///@brief V coordinate of the color ramp within the gradient strip
+	float m_rampRow;
 };
 
 class SpectrogramToneMapArgs
 {
 public:
 	SpectrogramToneMapArgs(uint32_t w, uint32_t h, uint32_t outwidth, uint32_t outheight, uint32_t xo,
-		float x, int32_t yo, float y)
+		float x, int32_t yo, float y, float rampRow)
 	: m_width(w)
 	, m_height(h)
 	, m_outwidth(outwidth)
@@ -117,6 +223,7 @@ public:
 	, m_xscale(x)
 	, m_yoff(yo)
 	, m_yscale(y)
+	, m_rampRow(rampRow)
 	{}
 
 	uint32_t m_width;
@@ -127,6 +234,9 @@ public:
 	float m_xscale;
 	int32_t m_yoff;
 	float m_yscale;
+
+	///@brief V coordinate of the color ramp within the gradient strip
+	float m_rampRow;
 };
 
 struct ConfigPushConstants
@@ -143,6 +253,7 @@ struct ConfigPushConstants
 	float yscale;
 	float yoff;
 	float persistScale;
+	uint32_t firstColumn;
 };
 
 /**
@@ -171,18 +282,319 @@ struct PeakLabel
 	int64_t m_labelYsize;
 
 	/**
-		@brief Alpha decay. Decays by a small amount per frame after the peak disappears
+		@brief Alpha value the label was last drawn with
 
 		255 = fully visible
 		0 = invisible
-		Negative = invisible for several frames (eventually will be garbage collected)
 	 */
 	int m_peakAlpha;
 
+	/**
+		@brief Time the peak disappeared from the waveform, or negative if it's still present
+
+		The label fades out over PEAK_FADE_TIME after this, and is garbage collected once it's been gone for a while.
+	 */
+	double m_tMissing;
+
 	///@brief Calculated FWHM of the peak
 	float m_fwhm;
 };
 
+/**
+	@brief Everything which affects the rasterized image of a DisplayedChannel
+
+	If none of this has changed since the last time a channel was rasterized, the existing image is still valid and
+	we can skip re-rendering it.
+ */
+class RasterizeState
+{
+public:
+	RasterizeState()
+	: m_data(nullptr)
+	, m_revision(0)
+	, m_flags(0)
+	, m_xAxisOffset(0)
+	, m_pixelsPerX(0)
+	, m_pixelsPerY(0)
+	, m_yoff(0)
+	, m_width(0)
+	, m_height(0)
+	, m_persistence(false)
+	, m_halfPrecision(false)
+	, m_size(0)
+	, m_lastOffset(0)
+	, m_scaledAlpha(0)
+	{}
+
+	bool operator==(const RasterizeState& rhs) const
+	{
+		return
+			(m_data == rhs.m_data) &&
+			(m_revision == rhs.m_revision) &&
+			(m_flags == rhs.m_flags) &&
+			(m_xAxisOffset == rhs.m_xAxisOffset) &&
+			(m_pixelsPerX == rhs.m_pixelsPerX) &&
+			(m_pixelsPerY == rhs.m_pixelsPerY) &&
+			(m_yoff == rhs.m_yoff) &&
+			(m_width == rhs.m_width) &&
+			(m_height == rhs.m_height) &&
+			(m_persistence == rhs.m_persistence) &&
+			(m_halfPrecision == rhs.m_halfPrecision) &&
+			(m_size == rhs.m_size);
+	}
+
+	bool operator!=(const RasterizeState& rhs) const
+	{ return !(*this == rhs); }
+
+	/**
+		@brief Checks if the only difference between this state and a later one is samples appended to the waveform
+
+		If so (and the samples already present weren't modified), only the right side of the image needs redrawing.
+	 */
+	bool IsAppendedBy(const RasterizeState& next) const
+	{
+		return
+			(m_data == next.m_data) &&
+			(m_size > 0) &&
+			(next.m_size > m_size) &&
+			(m_flags == next.m_flags) &&
+			(m_xAxisOffset == next.m_xAxisOffset) &&
+			(m_pixelsPerX == next.m_pixelsPerX) &&
+			(m_pixelsPerY == next.m_pixelsPerY) &&
+			(m_yoff == next.m_yoff) &&
+			(m_width == next.m_width) &&
+			(m_height == next.m_height) &&
+			(m_persistence == next.m_persistence) &&
+			(m_halfPrecision == next.m_halfPrecision);
+	}
+
+	///@brief The waveform being drawn
+	WaveformBase* m_data;
+
+	///@brief Revision of the waveform being drawn
+	uint64_t m_revision;
+
+	///@brief Stream flags (interpolation, fill under, etc)
+	uint8_t m_flags;
+
+	///@brief X axis offset of the group
+	int64_t m_xAxisOffset;
+
+	///@brief X axis scale
+	double m_pixelsPerX;
+
+	///@brief Y axis scale
+	float m_pixelsPerY;
+
+	///@brief Y axis offset of the stream
+	float m_yoff;
+
+	///@brief Width of the rasterized image
+	size_t m_width;
+
+	///@brief Height of the rasterized image
+	size_t m_height;
+
+	/**
+		@brief True if persistence is enabled
+
+		Trace intensity and the persistence decay factor aren't part of the state: intensity is applied during tone
+		mapping, and the decay factor only affects how the next waveform is accumulated onto the existing image.
+	 */
+	bool m_persistence;
+
+	///@brief True if the image is stored as packed fp16 rather than fp32
+	bool m_halfPrecision;
+
+	///@brief Number of samples in the waveform
+	size_t m_size;
+
+	///@brief Offset of the last sample drawn, in timebase units (not compared, filled in once it's known)
+	int64_t m_lastOffset;
+
+	///@brief Zoom adjusted alpha the image was drawn with (not compared, filled in once it's known)
+	float m_scaledAlpha;
+};
+
+/**
+	@brief State a waterfall's texture was last tone mapped with
+
+	A waterfall scrolls by one row per update. If nothing but the waveform revision has changed since the last tone
+	map, only the new rows need to be drawn: the texture is treated as a ring of rows starting at m_rowOffset.
+ */
+class WaterfallToneMapState
+{
+public:
+	WaterfallToneMapState()
+	: m_data(nullptr)
+	, m_revision(0)
+	, m_texture(nullptr)
+	, m_outwidth(0)
+	, m_outheight(0)
+	, m_offsetSamples(0)
+	, m_xscale(0)
+	, m_rowOffset(0)
+	{}
+
+	///@brief Checks if the only difference between this state and a later one is new rows scrolling in
+	bool IsScrolledBy(const WaterfallToneMapState& next) const
+	{
+		return
+			(m_data == next.m_data) &&
+			(m_texture == next.m_texture) &&
+			(m_outwidth == next.m_outwidth) &&
+			(m_outheight == next.m_outheight) &&
+			(m_offsetSamples == next.m_offsetSamples) &&
+			(m_xscale == next.m_xscale) &&
+			(m_colorRamp == next.m_colorRamp);
+	}
+
+	///@brief The waveform being drawn
+	WaveformBase* m_data;
+
+	///@brief Revision of the waveform being drawn
+	uint64_t m_revision;
+
+	///@brief The texture being drawn into
+	Texture* m_texture;
+
+	///@brief Width of the output image
+	uint32_t m_outwidth;
+
+	///@brief Height of the output image
+	uint32_t m_outheight;
+
+	///@brief First FFT bin drawn
+	uint32_t m_offsetSamples;
+
+	///@brief Pixels per FFT bin
+	float m_xscale;
+
+	///@brief Color ramp used for tone mapping
+	std::string m_colorRamp;
+
+	///@brief Texture row holding the bottom (oldest) row of the display
+	uint32_t m_rowOffset;
+};
+
+/**
+	@brief Everything which affects the layout of a protocol waveform's cells
+
+	If none of this has changed since the last frame, the cached ProtocolCell list is still valid.
+ */
+class ProtocolLayoutState
+{
+public:
+	ProtocolLayoutState()
+	: m_data(nullptr)
+	, m_revision(0)
+	, m_size(0)
+	, m_xAxisOffset(0)
+	, m_pixelsPerX(0)
+	, m_xOrigin(0)
+	, m_left(0)
+	, m_right(0)
+	, m_font(nullptr)
+	, m_fontSize(0)
+	, m_skipNarrowCells(false)
+	{}
+
+	bool operator==(const ProtocolLayoutState& rhs) const
+	{
+		return
+			(m_data == rhs.m_data) &&
+			(m_revision == rhs.m_revision) &&
+			(m_size == rhs.m_size) &&
+			(m_xAxisOffset == rhs.m_xAxisOffset) &&
+			(m_pixelsPerX == rhs.m_pixelsPerX) &&
+			(m_xOrigin == rhs.m_xOrigin) &&
+			(m_left == rhs.m_left) &&
+			(m_right == rhs.m_right) &&
+			(m_font == rhs.m_font) &&
+			(m_fontSize == rhs.m_fontSize) &&
+			(m_skipNarrowCells == rhs.m_skipNarrowCells);
+	}
+
+	bool operator!=(const ProtocolLayoutState& rhs) const
+	{ return !(*this == rhs); }
+
+	///@brief The waveform being drawn
+	WaveformBase* m_data;
+
+	///@brief Revision of the waveform being drawn
+	uint64_t m_revision;
+
+	///@brief Number of samples in the waveform
+	size_t m_size;
+
+	///@brief X axis offset of the group
+	int64_t m_xAxisOffset;
+
+	///@brief X axis scale
+	float m_pixelsPerX;
+
+	///@brief Screen X position of the group's X axis offset
+	float m_xOrigin;
+
+	///@brief Screen X position of the left side of the plot
+	float m_left;
+
+	///@brief Screen X position of the right side of the plot
+	float m_right;
+
+	///@brief Font the text is drawn in
+	ImFont* m_font;
+
+	///@brief Scaled size of m_font
+	float m_fontSize;
+
+	///@brief True if cells too narrow for text are drawn by the GPU rasterizer, and should be left out of the layout
+	bool m_skipNarrowCells;
+};
+
+/**
+	@brief A single laid out cell of a protocol waveform, in screen X coordinates
+
+	Y coordinates aren't stored since they only depend on the channel's button position and are cheap to recompute.
+ */
+class ProtocolCell
+{
+public:
+	ProtocolCell()
+	: m_xstart(0)
+	, m_xend(0)
+	, m_xendText(0)
+	, m_color(0)
+	, m_drawText(false)
+	, m_textX(0)
+	, m_textHeight(0)
+	{}
+
+	///@brief Left side of the cell, clamped to the left side of the plot
+	float m_xstart;
+
+	///@brief Right side of the cell, clamped to the right side of the plot
+	float m_xend;
+
+	///@brief Right side of the text background (not clamped)
+	float m_xendText;
+
+	///@brief Outline color (averaged, if several skinny samples were merged into this cell)
+	ImU32 m_color;
+
+	///@brief True if any text fit in the cell
+	bool m_drawText;
+
+	///@brief Text to draw, already trimmed to fit
+	std::string m_text;
+
+	///@brief X position of the text
+	float m_textX;
+
+	///@brief Height of the text
+	float m_textHeight;
+};
+
 /**
 	@brief Context data for a single channel being displayed within a WaveformArea
  */
@@ -205,26 +617,135 @@ public:
 	{ return m_texture; }
 
 	void SetTexture(std::shared_ptr<Texture> tex)
-	{ m_texture = tex; }
+	{
+		m_texture = tex;
+		m_textureWidth = 0;
+		m_textureHeight = 0;
+	}
+
+	/**
+		@brief Gets the bottom right texture coordinate of the part of the texture holding the image
+
+		Textures of rasterized waveforms are allocated with some slack, and the image only fills the top left corner.
+	 */
+	ImVec2 GetTextureUVMax()
+	{
+		if( (m_textureWidth == 0) || (m_textureHeight == 0) )
+			return ImVec2(1, 1);
+		return ImVec2(m_cachedX * 1.0f / m_textureWidth, m_cachedY * 1.0f / m_textureHeight);
+	}
 
-	void PrepareToRasterize(size_t x, size_t y);
+	///@brief Checks if this is a stream we rasterize into m_rasterizedWaveform0/1 ourselves
+	bool IsRasterizedType()
+	{
+		auto type = m_stream.GetType();
+		return (type == Stream::STREAM_TYPE_ANALOG) ||
+			(type == Stream::STREAM_TYPE_DIGITAL) ||
+			(type == Stream::STREAM_TYPE_PROTOCOL);
+	}
+
+	void PrepareToRasterize(vk::raii::CommandBuffer& cmdbuf, size_t x, size_t y, bool halfPrecision = false);
+	void SetHalfPrecisionRasterization(bool half);
+	size_t GetRasterMemoryUsage();
+	bool KeepFrontImage(vk::raii::CommandBuffer& cmdbuf);
+	void SwapRasterizedWaveforms();
+	void SetRasterSource(std::shared_ptr<DisplayedChannel> source);
+
+	///@brief Checks if we're showing another channel's rasterized image rather than our own
+	bool IsSharingRasterization()
+	{ return m_rasterSource != nullptr; }
 
 	bool UpdateSize(ImVec2 newSize, MainWindow* top);
 
+	/**
+		@brief Gets the front rasterized waveform buffer (the most recent complete image, used for tone mapping)
+	 */
 	AcceleratorBuffer<float>& GetRasterizedWaveform()
-	{ return m_rasterizedWaveform; }
+	{
+		if(m_rasterSource)
+			return m_rasterSource->GetRasterizedWaveform();
+		return GetRasterizedBuffer(m_frontBuffer);
+	}
 
 	/**
-		@brief Return the X axis size of the rasterized waveform
+		@brief Gets the back rasterized waveform buffer (the one the WaveformThread is currently drawing into)
+	 */
+	AcceleratorBuffer<float>& GetBackRasterizedWaveform()
+	{ return GetRasterizedBuffer(1 - m_frontBuffer); }
+
+	/**
+		@brief Return the X axis size of the rasterized waveform in the front buffer
 	 */
 	size_t GetRasterizedX()
-	{ return m_rasterizedX; }
+	{
+		if(m_rasterSource)
+			return m_rasterSource->GetRasterizedX();
+		return m_rasterizedX[m_frontBuffer];
+	}
 
 	/**
-		@brief Return the Y axis size of the rasterized waveform
+		@brief Return the Y axis size of the rasterized waveform in the front buffer
 	 */
 	size_t GetRasterizedY()
-	{ return m_rasterizedY; }
+	{
+		if(m_rasterSource)
+			return m_rasterSource->GetRasterizedY();
+		return m_rasterizedY[m_frontBuffer];
+	}
+
+	/**
+		@brief Checks if the front buffer is packed fp16 (two rows per 32-bit word) rather than fp32
+	 */
+	bool IsRasterizedHalfPrecision()
+	{
+		if(m_rasterSource)
+			return m_rasterSource->IsRasterizedHalfPrecision();
+		return m_rasterizedHalf[m_frontBuffer];
+	}
+
+	/**
+		@brief Records the X axis view the back buffer is about to be rasterized with
+
+		Must be called after PrepareToRasterize().
+	 */
+	void SetRasterizedView(int64_t xAxisOffset, double pixelsPerX)
+	{
+		m_rasterizedXAxisOffset[1 - m_frontBuffer] = xAxisOffset;
+		m_rasterizedPixelsPerX[1 - m_frontBuffer] = pixelsPerX;
+	}
+
+	/**
+		@brief Notes that the texture now shows the front buffer, so it was drawn with the front buffer's X axis view
+
+		Must be called with the session's rasterized waveform mutex held, after tone mapping has completed.
+	 */
+	void LatchTextureView()
+	{
+		if(m_rasterSource)
+		{
+			m_textureXAxisOffset = m_rasterSource->m_rasterizedXAxisOffset[m_rasterSource->m_frontBuffer];
+			m_texturePixelsPerX = m_rasterSource->m_rasterizedPixelsPerX[m_rasterSource->m_frontBuffer];
+		}
+		else
+		{
+			m_textureXAxisOffset = m_rasterizedXAxisOffset[m_frontBuffer];
+			m_texturePixelsPerX = m_rasterizedPixelsPerX[m_frontBuffer];
+		}
+	}
+
+	///@brief Gets the X axis offset of the view shown in the texture
+	int64_t GetTextureXAxisOffset()
+	{ return m_textureXAxisOffset; }
+
+	///@brief Gets the X axis scale of the view shown in the texture, or zero if nothing has been drawn yet
+	double GetTexturePixelsPerX()
+	{ return m_texturePixelsPerX; }
+
+	/**
+		@brief Gets the size of the tone mapped texture, in bytes
+	 */
+	size_t GetTextureMemoryUsage()
+	{ return m_textureBytes; }
 
 	/**
 		@brief Gets the pipeline for drawing uniform analog waveforms, creating it if necessary
@@ -233,17 +754,7 @@ public:
 	std::shared_ptr<ComputePipeline> GetUniformAnalogPipeline()
 	{
 		if(m_uniformAnalogComputePipeline == nullptr)
-		{
-			std::string base = "shaders/waveform-compute.";
-			std::string suffix;
-			if(ZeroHoldFlagSet())
-				suffix += ".zerohold";
-			if(g_hasShaderInt64)
-				suffix += ".int64";
-			m_uniformAnalogComputePipeline = std::make_shared<ComputePipeline>(
-				base + "analog" + suffix + ".dense.spv", 2, sizeof(ConfigPushConstants));
-		}
-
+			m_uniformAnalogComputePipeline = GetPooledPipeline(GetUniformAnalogPipelineKey(m_halfPrecisionPipelines));
 		return m_uniformAnalogComputePipeline;
 	}
 
@@ -254,15 +765,7 @@ public:
 	std::shared_ptr<ComputePipeline> GetHistogramPipeline()
 	{
 		if(m_histogramComputePipeline == nullptr)
-		{
-			std::string base = "shaders/waveform-compute.";
-			std::string suffix;
-			if(g_hasShaderInt64)
-				suffix += ".int64";
-			m_histogramComputePipeline = std::make_shared<ComputePipeline>(
-				base + "histogram" + suffix + ".dense.spv", 2, sizeof(ConfigPushConstants));
-		}
-
+			m_histogramComputePipeline = GetPooledPipeline(GetHistogramPipelineKey(m_halfPrecisionPipelines));
 		return m_histogramComputePipeline;
 	}
 
@@ -273,22 +776,22 @@ public:
 	std::shared_ptr<ComputePipeline> GetSparseAnalogPipeline()
 	{
 		if(m_sparseAnalogComputePipeline == nullptr)
+			m_sparseAnalogComputePipeline = GetPooledPipeline(GetSparseAnalogPipelineKey(m_halfPrecisionPipelines));
+		return m_sparseAnalogComputePipeline;
+	}
+
+	/**
+		@brief Gets the pipeline for drawing sparse analog waveforms with packed timestamps, creating it if necessary
+	*/
+	__attribute__((noinline))
+	std::shared_ptr<ComputePipeline> GetPackedSparseAnalogPipeline()
+	{
+		if(m_packedSparseAnalogComputePipeline == nullptr)
 		{
-			std::string base = "shaders/waveform-compute.";
-			std::string suffix;
-			int durationSSBOs = 0;
-			if(ZeroHoldFlagSet())
-			{
-				suffix += ".zerohold";
-				durationSSBOs++;
-			}
-			if(g_hasShaderInt64)
-				suffix += ".int64";
-			m_sparseAnalogComputePipeline = std::make_shared<ComputePipeline>(
-				base + "analog" + suffix + ".spv", durationSSBOs + 4, sizeof(ConfigPushConstants));
+			m_packedSparseAnalogComputePipeline =
+				GetPooledPipeline(GetSparseAnalogPipelineKey(m_halfPrecisionPipelines, true));
 		}
-
-		return m_sparseAnalogComputePipeline;
+		return m_packedSparseAnalogComputePipeline;
 	}
 
 	/**
@@ -298,15 +801,7 @@ public:
 	std::shared_ptr<ComputePipeline> GetUniformDigitalPipeline()
 	{
 		if(m_uniformDigitalComputePipeline == nullptr)
-		{
-			std::string base = "shaders/waveform-compute.";
-			std::string suffix;
-			if(g_hasShaderInt64)
-				suffix += ".int64";
-			m_uniformDigitalComputePipeline = std::make_shared<ComputePipeline>(
-				base + "digital" + suffix + ".dense.spv", 2, sizeof(ConfigPushConstants));
-		}
-
+			m_uniformDigitalComputePipeline = GetPooledPipeline(GetUniformDigitalPipelineKey(m_halfPrecisionPipelines));
 		return m_uniformDigitalComputePipeline;
 	}
 
@@ -317,21 +812,57 @@ public:
 	std::shared_ptr<ComputePipeline> GetSparseDigitalPipeline()
 	{
 		if(m_sparseDigitalComputePipeline == nullptr)
+			m_sparseDigitalComputePipeline = GetPooledPipeline(GetSparseDigitalPipelineKey(m_halfPrecisionPipelines));
+		return m_sparseDigitalComputePipeline;
+	}
+
+	/**
+		@brief Gets the pipeline for drawing sparse digital waveforms with packed timestamps, creating it if necessary
+	*/
+	__attribute__((noinline))
+	std::shared_ptr<ComputePipeline> GetPackedSparseDigitalPipeline()
+	{
+		if(m_packedSparseDigitalComputePipeline == nullptr)
 		{
-			std::string base = "shaders/waveform-compute.";
-			std::string suffix;
-			int durationSSBOs = 0;	//TODO: support gaps
-			if(g_hasShaderInt64)
-				suffix += ".int64";
-			m_sparseDigitalComputePipeline = std::make_shared<ComputePipeline>(
-				base + "digital" + suffix + ".spv", durationSSBOs + 4, sizeof(ConfigPushConstants));
+			m_packedSparseDigitalComputePipeline =
+				GetPooledPipeline(GetSparseDigitalPipelineKey(m_halfPrecisionPipelines, true));
 		}
+		return m_packedSparseDigitalComputePipeline;
+	}
 
-		return m_sparseDigitalComputePipeline;
+	/**
+		@brief Gets the pipeline for generating X axis indexes of sparse waveforms, creating it if necessary
+	*/
+	std::shared_ptr<ComputePipeline> GetIndexPipeline()
+	{
+		if(m_indexComputePipeline == nullptr)
+			m_indexComputePipeline = GetPooledPipeline(GetIndexPipelineKey());
+		return m_indexComputePipeline;
 	}
 
+	/**
+		@brief Gets the pipeline for rasterizing narrow protocol cells, creating it if necessary
+	*/
+	std::shared_ptr<ComputePipeline> GetProtocolRasterizePipeline()
+	{
+		if(m_protocolRasterizePipeline == nullptr)
+			m_protocolRasterizePipeline = GetPooledPipeline(GetProtocolRasterizePipelineKey());
+		return m_protocolRasterizePipeline;
+	}
+
+	void GetWarmupPipelineKeys(std::vector<ComputePipelineKey>& keys, bool halfPrecision);
+
+	AcceleratorBuffer<uint32_t>& GetProtocolColors(SparseWaveformBase* data);
+
+	/**
+		@brief Gets the pipeline for tone mapping our rasterized waveform, creating it if necessary
+	*/
 	std::shared_ptr<ComputePipeline> GetToneMapPipeline()
-	{ return m_toneMapPipe; }
+	{
+		if(m_toneMapPipe == nullptr)
+			m_toneMapPipe = GetPooledPipeline(GetToneMapPipelineKey());
+		return m_toneMapPipe;
+	}
 
 	bool ZeroHoldFlagSet()
 	{
@@ -371,34 +902,307 @@ public:
 	AcceleratorBuffer<uint32_t>& GetIndexBuffer()
 	{ return m_indexBuffer; }
 
+	AcceleratorBuffer<int64_t>& GetIndexTargets()
+	{ return m_indexTargets; }
+
+	/**
+		@brief Records the state a channel is about to be rasterized with
+
+		@return True if the state differs from the last rasterization, i.e. the existing image is stale
+	 */
+	bool UpdateRasterizeState(const RasterizeState& state)
+	{
+		bool changed = (state != m_lastRasterizeState);
+		m_lastRasterizeState = state;
+		return changed;
+	}
+
+	///@brief Gets the state we were last rasterized with
+	RasterizeState& GetRasterizeState()
+	{ return m_lastRasterizeState; }
+
+	void GetSparseOffsetRange(SparseWaveformBase* data, int64_t& first, int64_t& last);
+
+	bool PackSparseTimestamps(SparseWaveformBase* data, bool durations, vk::raii::CommandBuffer& cmdbuf);
+
+	///@brief Gets the base offset and flags of each block of packed timestamps, as four words per block
+	AcceleratorBuffer<uint32_t>& GetPackedHeaders()
+	{ return m_packedHeaders; }
+
+	///@brief Gets the offset of each sample relative to its block in the packed timestamps
+	AcceleratorBuffer<uint32_t>& GetPackedDeltas()
+	{ return m_packedDeltas; }
+
+	///@brief Gets the 32-bit durations of the packed timestamps
+	AcceleratorBuffer<uint32_t>& GetPackedDurations()
+	{ return m_packedDurations; }
+
+	UniformAnalogWaveform* GetPyramidLevel(
+		UniformAnalogWaveform* data,
+		double samplesPerPixel,
+		vk::raii::CommandBuffer& cmdbuf);
+
+	SparseAnalogWaveform* GetTrendLevel(SparseAnalogWaveform* data, double pixelsPerX);
+
+	AcceleratorBuffer<float>* GetSpectrogramLevel(
+		SpectrogramWaveform* data,
+		double binsPerPixel,
+		vk::raii::CommandBuffer& cmdbuf,
+		size_t& width,
+		size_t& factor);
+
+	bool UpdateOverview(UniformAnalogWaveform* data, size_t bins, std::shared_ptr<QueueHandle> queue);
+
+	///@brief Gets the overview built by UpdateOverview(), as interleaved (min, max) pairs
+	AcceleratorBuffer<float>& GetOverview()
+	{ return m_overview; }
+
+	///@brief Gets the number of raw samples summarized by each bin of the overview
+	size_t GetOverviewSamplesPerBin()
+	{ return m_overviewSamplesPerBin; }
+
 	void SetYButtonPos(float y)
 	{ m_yButtonPos = y; }
 
 	float GetYButtonPos()
 	{ return m_yButtonPos; }
 
-	///@brief Active labels for peaks associated with the current waveform
-	std::vector<PeakLabel> m_peakLabels;
+	/**
+		@brief Active labels for peaks associated with the current waveform, sorted by X axis position of the peak
+
+		A map rather than a vector so labels don't move in memory when others are added or removed (the one being
+		dragged is referenced by pointer).
+	 */
+	std::map<int64_t, PeakLabel> m_peakLabels;
+
+	///@brief Waveform m_peakLabels were last matched against
+	WaveformBase* m_peakSource;
+
+	///@brief Revision of m_peakSource m_peakLabels were last matched against
+	uint64_t m_peakRevision;
 
 	std::string m_colorRamp;
 
+	///@brief State the texture of a waterfall was last tone mapped with
+	WaterfallToneMapState m_waterfallState;
+
+	///@brief State m_protocolLayout was built with
+	ProtocolLayoutState m_protocolLayoutState;
+
+	///@brief Cached layout of visible cells, for protocol waveforms
+	std::vector<ProtocolCell> m_protocolLayout;
+
 protected:
 	StreamDescriptor m_stream;
 
 	///@brief Parent session object
 	Session& m_session;
 
-	///@brief Buffer storing our rasterized waveform, prior to tone mapping
-	AcceleratorBuffer<float> m_rasterizedWaveform;
+	AcceleratorBuffer<float>& GetRasterizedBuffer(int i)
+	{ return (i == 0) ? m_rasterizedWaveform0 : m_rasterizedWaveform1; }
+
+	void ResizeRasterBuffer(AcceleratorBuffer<float>& buf, size_t nwords);
+	void RecordCopyFromFront(vk::raii::CommandBuffer& cmdbuf);
+	static void AddRasterTransferBarrier(vk::raii::CommandBuffer& cmdbuf);
+
+	std::shared_ptr<ComputePipeline> GetPooledPipeline(const ComputePipelineKey& key);
+	vk::raii::CommandBuffer& GetUtilCmdBuffer();
+	void ReleasePipelines();
+
+	ComputePipelineKey GetToneMapPipelineKey();
+	ComputePipelineKey GetUniformAnalogPipelineKey(bool halfPrecision);
+	ComputePipelineKey GetHistogramPipelineKey(bool halfPrecision);
+	ComputePipelineKey GetSparseAnalogPipelineKey(bool halfPrecision, bool packed = false);
+	ComputePipelineKey GetUniformDigitalPipelineKey(bool halfPrecision);
+	ComputePipelineKey GetSparseDigitalPipelineKey(bool halfPrecision, bool packed = false);
+
+	///@brief Gets the key of the pipeline for generating X axis indexes of sparse waveforms
+	static ComputePipelineKey GetIndexPipelineKey()
+	{ return ComputePipelineKey("shaders/WaveformIndex.spv", 3, sizeof(WaveformIndexArgs)); }
+
+	///@brief Gets the key of the pipeline for packing sparse timestamps into 32-bit deltas
+	static ComputePipelineKey GetTimestampPackPipelineKey()
+	{ return ComputePipelineKey("shaders/SparseTimestampPack.spv", 5, sizeof(SparseTimestampPackArgs)); }
+
+	///@brief Gets the key of the pipeline for rasterizing narrow protocol cells
+	static ComputePipelineKey GetProtocolRasterizePipelineKey()
+	{ return ComputePipelineKey("shaders/ProtocolRasterize.spv", 6, sizeof(ConfigPushConstants)); }
+
+	///@brief Gets the key of the pipeline for building min/max pyramid levels
+	static ComputePipelineKey GetPyramidPipelineKey()
+	{ return ComputePipelineKey("shaders/WaveformPyramid.spv", 2, sizeof(WaveformPyramidArgs)); }
+
+	///@brief First buffer storing our rasterized waveform, prior to tone mapping
+	AcceleratorBuffer<float> m_rasterizedWaveform0;
+
+	///@brief Second buffer storing our rasterized waveform, prior to tone mapping
+	AcceleratorBuffer<float> m_rasterizedWaveform1;
+
+	/**
+		@brief Index of the rasterized waveform buffer which is ready for tone mapping
+
+		Only changed by the WaveformThread, with the session's rasterized waveform mutex held.
+	 */
+	int m_frontBuffer;
+
+	///@brief True if the back buffer has been prepared for rendering since the last swap
+	bool m_backBufferReady;
+
+	/**
+		@brief Channel whose front buffer we show instead of our own, if another area drew the exact same image
+
+		Read by the GUI's tone mapping, so it's only changed in SwapRasterizedWaveforms(). A source never has a
+		source of its own, since each render pass rasterizes every source itself.
+	 */
+	std::shared_ptr<DisplayedChannel> m_rasterSource;
+
+	///@brief Value m_rasterSource will take at the next swap
+	std::shared_ptr<DisplayedChannel> m_nextRasterSource;
 
 	///@brief Buffer for X axis indexes (only used for sparse waveforms)
 	AcceleratorBuffer<uint32_t> m_indexBuffer;
 
-	///@brief X axis size of rasterized waveform
-	size_t m_rasterizedX;
+	///@brief State we were last rasterized with
+	RasterizeState m_lastRasterizeState;
+
+	///@brief First offset to be drawn in each X axis column, used to generate m_indexBuffer
+	AcceleratorBuffer<int64_t> m_indexTargets;
+
+	///@brief Waveform that m_sparseFirstOffset and m_sparseLastOffset were read from
+	WaveformBase* m_sparseRangeWaveform;
 
-	///@brief Y axis size of rasterized waveform
-	size_t m_rasterizedY;
+	///@brief Revision of m_sparseRangeWaveform that m_sparseFirstOffset and m_sparseLastOffset were read from
+	uint64_t m_sparseRangeRevision;
+
+	///@brief Offset of the first sample in the last sparse waveform we drew
+	int64_t m_sparseFirstOffset;
+
+	///@brief Offset of the last sample in the last sparse waveform we drew
+	int64_t m_sparseLastOffset;
+
+	/**
+		@brief Base offset and flags of each block of packed timestamps of the sparse waveform being drawn
+
+		Packed timestamps are a copy of the waveform's offsets as 32-bit deltas from the first offset of each block of
+		samples, so rasterizing reads half as much timestamp data (and no 64-bit math) on every redraw.
+	 */
+	AcceleratorBuffer<uint32_t> m_packedHeaders;
+
+	///@brief Offset of each sample relative to the base of its block
+	AcceleratorBuffer<uint32_t> m_packedDeltas;
+
+	///@brief 32-bit copy of the durations, for blocks which don't imply them from the next offset
+	AcceleratorBuffer<uint32_t> m_packedDurations;
+
+	///@brief Waveform that the packed timestamps were built from
+	WaveformBase* m_packedSource;
+
+	///@brief Revision of m_packedSource that the packed timestamps were built from
+	uint64_t m_packedRevision;
+
+	///@brief Number of samples in m_packedSource when the packed timestamps were built
+	size_t m_packedSize;
+
+	///@brief True if m_packedDurations was filled in
+	bool m_packedHasDurations;
+
+	///@brief RGBA color of each sample of a protocol waveform, for the GPU rasterizer
+	AcceleratorBuffer<uint32_t> m_protocolColors;
+
+	///@brief Waveform that m_protocolColors was read from
+	WaveformBase* m_protocolColorsSource;
+
+	///@brief Revision of m_protocolColorsSource that m_protocolColors was read from
+	uint64_t m_protocolColorsRevision;
+
+	void BuildPyramid(UniformAnalogWaveform* data, vk::raii::CommandBuffer& cmdbuf);
+
+	/**
+		@brief Min/max decimation pyramid of the waveform being drawn, finest level first
+
+		Each level is stored as a waveform of interleaved (min, max) pairs, so it can be drawn with the same shaders
+		as the raw data.
+	 */
+	std::vector<std::unique_ptr<UniformAnalogWaveform> > m_pyramid;
+
+	///@brief Waveform that m_pyramid was built from
+	WaveformBase* m_pyramidSource;
+
+	///@brief Revision of m_pyramidSource that m_pyramid was built from
+	uint64_t m_pyramidRevision;
+
+	void BuildSpectrogramPyramid(SpectrogramWaveform* data, vk::raii::CommandBuffer& cmdbuf);
+
+	/**
+		@brief Decimated copies of the spectrogram being drawn, finest level first
+
+		Each level has the same frequency bins as the spectrogram, and halves the number of time bins of the one
+		before it. Only used by tone mapping, so it's only ever touched by the GUI thread.
+	 */
+	std::vector<std::unique_ptr<AcceleratorBuffer<float> > > m_spectrogramPyramid;
+
+	///@brief Number of time bins in each level of m_spectrogramPyramid
+	std::vector<size_t> m_spectrogramPyramidWidths;
+
+	///@brief Spectrogram that m_spectrogramPyramid was built from
+	WaveformBase* m_spectrogramPyramidSource;
+
+	///@brief Revision of m_spectrogramPyramidSource that m_spectrogramPyramid was built from
+	uint64_t m_spectrogramPyramidRevision;
+
+	///@brief Decimated copies of the trend being drawn, if this is the output of a trend filter
+	TrendStore m_trendStore;
+
+	///@brief Min/max summary of the whole waveform, for the overview strip above the timeline
+	AcceleratorBuffer<float> m_overview;
+
+	///@brief Intermediate passes of the overview reduction
+	AcceleratorBuffer<float> m_overviewScratch[2];
+
+	///@brief Waveform that m_overview was built from
+	WaveformBase* m_overviewSource;
+
+	///@brief Revision of m_overviewSource that m_overview was built from
+	uint64_t m_overviewRevision;
+
+	///@brief Number of bins requested when m_overview was built
+	size_t m_overviewRequestedBins;
+
+	///@brief Number of raw samples in each bin of m_overview
+	size_t m_overviewSamplesPerBin;
+
+	///@brief X axis size of each rasterized waveform buffer
+	size_t m_rasterizedX[2];
+
+	///@brief Y axis size of each rasterized waveform buffer
+	size_t m_rasterizedY[2];
+
+	///@brief True if each rasterized waveform buffer is packed fp16 rather than fp32
+	bool m_rasterizedHalf[2];
+
+	///@brief X axis offset of the view each rasterized waveform buffer was drawn with
+	int64_t m_rasterizedXAxisOffset[2];
+
+	///@brief X axis scale of the view each rasterized waveform buffer was drawn with
+	double m_rasterizedPixelsPerX[2];
+
+	///@brief X axis offset of the view shown in m_texture
+	int64_t m_textureXAxisOffset;
+
+	///@brief X axis scale of the view shown in m_texture
+	double m_texturePixelsPerX;
+
+	///@brief True if the rasterization pipelines were created for fp16 output
+	bool m_halfPrecisionPipelines;
+
+	///@brief Size of m_texture, in bytes
+	size_t m_textureBytes;
+
+	///@brief Allocated width of m_texture, which may be more than m_cachedX (zero if unknown)
+	size_t m_textureWidth;
+
+	///@brief Allocated height of m_texture, which may be more than m_cachedY (zero if unknown)
+	size_t m_textureHeight;
 
 	///@brief The texture storing our final rendered waveform
 	std::shared_ptr<Texture> m_texture;
@@ -430,13 +1234,271 @@ protected:
 	///@brief Compute pipeline for rendering sparse digital waveforms
 	std::shared_ptr<ComputePipeline> m_sparseDigitalComputePipeline;
 
+	///@brief Compute pipeline for rendering sparse analog waveforms from packed timestamps
+	std::shared_ptr<ComputePipeline> m_packedSparseAnalogComputePipeline;
+
+	///@brief Compute pipeline for rendering sparse digital waveforms from packed timestamps
+	std::shared_ptr<ComputePipeline> m_packedSparseDigitalComputePipeline;
+
+	///@brief Compute pipeline for building the packed timestamps
+	std::shared_ptr<ComputePipeline> m_timestampPackPipeline;
+
+	///@brief Compute pipeline for generating X axis indexes of sparse waveforms
+	std::shared_ptr<ComputePipeline> m_indexComputePipeline;
+
+	///@brief Compute pipeline for building levels of m_pyramid
+	std::shared_ptr<ComputePipeline> m_pyramidComputePipeline;
+
+	///@brief Compute pipeline for building m_overview (not pooled, since it runs on the GUI thread)
+	std::shared_ptr<ComputePipeline> m_overviewComputePipeline;
+
+	///@brief Compute pipeline for building levels of m_spectrogramPyramid (GUI thread only, like the overview)
+	std::shared_ptr<ComputePipeline> m_spectrogramPyramidPipeline;
+
+	///@brief Compute pipeline for rasterizing narrow cells of protocol waveforms
+	std::shared_ptr<ComputePipeline> m_protocolRasterizePipeline;
+
 	///@brief Y axis position of our button within the view
 	float m_yButtonPos;
 
+	///@brief Pyramid preference, read by the WaveformThread every time we're rasterized
+	BoolPreference m_minmaxPyramidPref;
+
+	///@brief Packed sparse timestamp preference, read by the WaveformThread every time we're rasterized
+	BoolPreference m_packedTimestampsPref;
+
+	///@brief Command pool for m_utilCmdBuffer (created on first use)
 	std::unique_ptr<vk::raii::CommandPool> m_utilCmdPool;
+
+	///@brief Command buffer for one-off GPU work outside the render pass (created on first use)
 	std::unique_ptr<vk::raii::CommandBuffer> m_utilCmdBuffer;
 };
 
+/**
+	@brief A rasterization shader dispatch which has been set up, but not recorded yet
+
+	All of the analog and digital channels in a WaveformArea are set up first, then their dispatches are recorded
+	back to back. Each channel only touches its own buffers, so one barrier at the end covers all of them.
+ */
+class PendingRasterization
+{
+public:
+	PendingRasterization()
+	: m_columns(0)
+	, m_tiles(1)
+	, m_output(nullptr)
+	, m_shader("")
+	{}
+
+	///@brief Shader to run
+	std::shared_ptr<ComputePipeline> m_pipeline;
+
+	///@brief Push constants for the shader
+	ConfigPushConstants m_config;
+
+	///@brief Number of thread blocks to dispatch (for the waveform shaders, columns starting from m_config.firstColumn)
+	size_t m_columns;
+
+	///@brief Number of thread blocks in the Y axis (for the waveform shaders, tiles of RASTER_TILE_HEIGHT rows)
+	size_t m_tiles;
+
+	///@brief Image being drawn into
+	AcceleratorBuffer<float>* m_output;
+
+	///@brief Name of the shader, for profiling
+	const char* m_shader;
+
+	///@brief Name of the channel being drawn, for profiling
+	std::string m_channel;
+};
+
+/**
+	@brief Identifies the per-column sample index search for one sparse waveform at one zoom and pan position
+ */
+class IndexSearchKey
+{
+public:
+	bool operator<(const IndexSearchKey& rhs) const
+	{
+		return std::tie(m_data, m_revision, m_size, m_columns, m_xscale, m_offsetSamples) <
+			std::tie(rhs.m_data, rhs.m_revision, rhs.m_size, rhs.m_columns, rhs.m_xscale, rhs.m_offsetSamples);
+	}
+
+	///@brief Waveform whose offsets are being searched
+	const WaveformBase* m_data;
+
+	///@brief Revision of the waveform
+	uint64_t m_revision;
+
+	///@brief Number of samples in the waveform
+	size_t m_size;
+
+	///@brief Number of X axis columns searched
+	size_t m_columns;
+
+	///@brief Pixels per sample
+	double m_xscale;
+
+	///@brief Sample index of the left edge of the plot
+	int64_t m_offsetSamples;
+};
+
+/**
+	@brief Index searches recorded so far during one render of a WaveformGroup
+
+	Every area in a group shares the same timebase, so any channel drawing a waveform that was already searched at
+	the same view can bind the earlier channel's results rather than dispatching its own search.
+ */
+class IndexSearchCache
+{
+public:
+	///@brief Channel whose index buffer (and targets) hold the result of each search
+	std::map<IndexSearchKey, DisplayedChannel*> m_searches;
+};
+
+/**
+	@brief Images rasterized so far during one render pass, across every WaveformGroup
+
+	The same stream shown in several areas (an overview and a zoom that happen to line up, or the same channel twice
+	with different color ramps) at the same size and view produces the same image. Only the first channel to need
+	each image draws it, the others tone map straight out of its buffer.
+ */
+class RasterShareCache
+{
+public:
+	/**
+		@brief Finds the channel which drew an image this pass, if any
+	 */
+	std::shared_ptr<DisplayedChannel> Find(const RasterizeState& state)
+	{
+		for(auto& it : m_sources)
+		{
+			if(it.first == state)
+				return it.second;
+		}
+		return nullptr;
+	}
+
+	/**
+		@brief Records that a channel's buffer holds the image for a state once this pass completes
+
+		Persistent images depend on everything the channel drew before, so they're never shared.
+	 */
+	void Add(const RasterizeState& state, std::shared_ptr<DisplayedChannel> channel)
+	{
+		if(!state.m_persistence)
+			m_sources.push_back(std::make_pair(state, channel));
+	}
+
+	///@brief Channel drawing each image. There are only ever a few dozen, so a linear search is plenty.
+	std::vector< std::pair<RasterizeState, std::shared_ptr<DisplayedChannel> > > m_sources;
+};
+
+/**
+	@brief Everything the Y axis grid of a WaveformArea depends on
+ */
+class YAxisGridKey
+{
+public:
+	YAxisGridKey()
+	: m_ytop(0)
+	, m_ybot(0)
+	, m_ymid(0)
+	, m_height(0)
+	, m_pixelsPerYAxisUnit(0)
+	, m_yAxisOffset(0)
+	, m_fontSize(0)
+	, m_unit(Unit::UNIT_COUNTS)
+	{}
+
+	bool operator==(const YAxisGridKey& rhs) const
+	{
+		return
+			(m_ytop == rhs.m_ytop) &&
+			(m_ybot == rhs.m_ybot) &&
+			(m_ymid == rhs.m_ymid) &&
+			(m_height == rhs.m_height) &&
+			(m_pixelsPerYAxisUnit == rhs.m_pixelsPerYAxisUnit) &&
+			(m_yAxisOffset == rhs.m_yAxisOffset) &&
+			(m_fontSize == rhs.m_fontSize) &&
+			(m_unit == rhs.m_unit);
+	}
+
+	float m_ytop;
+	float m_ybot;
+	float m_ymid;
+	float m_height;
+	float m_pixelsPerYAxisUnit;
+	float m_yAxisOffset;
+
+	///@brief Font size used to decide how many divisions fit
+	float m_fontSize;
+
+	///@brief Unit of the first analog stream, which picks the step size
+	Unit m_unit;
+};
+
+///@brief A formatted Y axis label
+class YAxisLabel
+{
+public:
+	///@brief Y position of the grid line being labeled
+	float m_y;
+
+	std::string m_text;
+
+	///@brief Size of m_text in the label font
+	ImVec2 m_size;
+};
+
+/**
+	@brief Y axis grid lines and labels of a WaveformArea, kept until the view changes
+
+	Picking the step size and formatting every label adds up to a lot of string formatting per frame with many areas
+	open, so it's only redone when something it depends on changes. The grid is computed by RenderGrid() and the
+	labels by RenderYAxis(), since the label font is only known there.
+ */
+class YAxisGridCache
+{
+public:
+	YAxisGridCache()
+	: m_gridValid(false)
+	, m_vbot(0)
+	, m_vtop(0)
+	, m_yzero(0)
+	, m_labelsValid(false)
+	, m_labelFont(nullptr)
+	, m_labelFontSize(0)
+	, m_labelUnit(Unit::UNIT_COUNTS)
+	{}
+
+	///@brief Inputs the grid was last computed from
+	YAxisGridKey m_key;
+
+	bool m_gridValid;
+
+	///@brief Position of each grid line, indexed by value
+	std::map<float, float> m_gridmap;
+
+	///@brief Value at the bottom of the plot
+	float m_vbot;
+
+	///@brief Value at the top of the plot
+	float m_vtop;
+
+	///@brief Y position of the zero line
+	float m_yzero;
+
+	///@brief True if m_labels match m_gridmap and the label settings below
+	bool m_labelsValid;
+
+	ImFont* m_labelFont;
+	float m_labelFontSize;
+	Unit m_labelUnit;
+
+	std::vector<YAxisLabel> m_labels;
+};
+
 /**
 	@brief A WaveformArea is a plot that displays one or more OscilloscopeChannel's worth of data
 
@@ -452,9 +1514,15 @@ public:
 	void RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
 		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
-		bool clearPersistence);
+		bool clearPersistence,
+		IndexSearchCache& searches,
+		RasterShareCache& shares,
+		GpuTimer* timer = nullptr,
+		bool previewOnly = false);
 	void ReferenceWaveformTextures();
-	void ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf);
+	void ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf, GpuTimer* timer = nullptr);
+	bool GetToneMapLayout(std::vector<uintptr_t>& layout);
+	void LatchTextureViews();
 
 	size_t GetStreamCount()
 	{ return m_displayedChannels.size(); }
@@ -493,8 +1561,9 @@ public:
 protected:
 	void ChannelButton(std::shared_ptr<DisplayedChannel> chan, size_t index);
 	void RenderBackgroundGradient(ImVec2 start, ImVec2 size);
-	void RenderGrid(ImVec2 start, ImVec2 size, std::map<float, float>& gridmap, float& vbot, float& vtop);
-	void RenderYAxis(ImVec2 size, std::map<float, float>& gridmap, float vbot, float vtop);
+	bool CalculateGrid(float ytop, float ybot, float theight, Unit unit);
+	void RenderGrid(ImVec2 start, ImVec2 size);
+	void RenderYAxis(ImVec2 size);
 	void RenderTriggerLevelArrows(ImVec2 start, ImVec2 size);
 	void RenderBERLevelArrows(ImVec2 start, ImVec2 size);
 	void RenderCursors(ImVec2 start, ImVec2 size);
@@ -502,32 +1571,64 @@ protected:
 	void RenderBERSamplingPoint(ImVec2 start, ImVec2 size);
 	void CheckForScaleMismatch(ImVec2 start, ImVec2 size);
 	void RenderEyePatternTooltip(ImVec2 start, ImVec2 size);
+	static float GetBERFromProfiles(
+		const std::vector<uint32_t>& words, size_t width, size_t height, int64_t x, int64_t y);
 	void RenderWaveforms(ImVec2 start, ImVec2 size);
 	void RenderAnalogWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
+	void DrawReprojectedTexture(ImDrawList* list, std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
 	void RenderEyeWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
 	void RenderConstellationWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
 	void RenderWaterfallWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
 	void RenderSpectrogramWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
+	void UpdateSpectrumPeaks(std::shared_ptr<DisplayedChannel> channel);
 	void RenderSpectrumPeaks(ImDrawList* list, std::shared_ptr<DisplayedChannel> channel);
 	void RenderDigitalWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
 	void RenderProtocolWaveform(std::shared_ptr<DisplayedChannel> channel, ImVec2 start, ImVec2 size);
-	void RenderComplexSignal(
-		ImDrawList* list,
+	void LayoutProtocolWaveform(
+		SparseWaveformBase* data,
+		const ProtocolLayoutState& state,
+		std::vector<ProtocolCell>& cells);
+	ProtocolCell LayoutComplexSignal(
+		const ProtocolLayoutState& state,
 		int visleft, int visright,
 		float xstart, float xend, float xoff,
-		float ybot, float ymid, float ytop,
 		std::string str,
 		ImU32 color);
+	void RenderProtocolCell(
+		ImDrawList* list,
+		const ProtocolCell& cell,
+		ImFont* font,
+		float fontSize,
+		float ybot, float ymid, float ytop);
 	void MakePathSignalBody(ImDrawList* list, float xstart, float xend, float ybot, float ymid, float ytop);
 	void ToneMapAnalogOrDigitalWaveform(std::shared_ptr<DisplayedChannel> channel, vk::raii::CommandBuffer& cmdbuf);
 	void ToneMapEyeWaveform(std::shared_ptr<DisplayedChannel> channel, vk::raii::CommandBuffer& cmdbuf);
 	void ToneMapConstellationWaveform(std::shared_ptr<DisplayedChannel> channel, vk::raii::CommandBuffer& cmdbuf);
 	void ToneMapWaterfallWaveform(std::shared_ptr<DisplayedChannel> channel, vk::raii::CommandBuffer& cmdbuf);
 	void ToneMapSpectrogramWaveform(std::shared_ptr<DisplayedChannel> channel, vk::raii::CommandBuffer& cmdbuf);
-	void RasterizeAnalogOrDigitalWaveform(
+	void ToneMapProtocolWaveform(std::shared_ptr<DisplayedChannel> channel, vk::raii::CommandBuffer& cmdbuf);
+	bool PrepareAnalogOrDigitalRasterization(
+		std::shared_ptr<DisplayedChannel> channel,
+		vk::raii::CommandBuffer& cmdbuf,
+		bool clearPersistence,
+		PendingRasterization& job,
+		bool& indexed,
+		IndexSearchCache& searches,
+		RasterShareCache& shares,
+		GpuTimer* timer);
+	bool PrepareProtocolRasterization(
 		std::shared_ptr<DisplayedChannel> channel,
 		vk::raii::CommandBuffer& cmdbuf,
-		bool clearPersistence);
+		PendingRasterization& job,
+		bool& indexed,
+		IndexSearchCache& searches,
+		RasterShareCache& shares,
+		GpuTimer* timer);
+	bool ShareRasterization(
+		std::shared_ptr<DisplayedChannel> channel,
+		const RasterizeState& state,
+		RasterShareCache& shares);
+	bool IsGpuProtocolRenderingEnabled();
 	void PlotContextMenu();
 
 	void DrawDropRangeMismatchMessage(
@@ -584,6 +1685,9 @@ protected:
 	///@brief Cached Y axis unit
 	Unit m_yAxisUnit;
 
+	///@brief Grid lines and labels from the last frame
+	YAxisGridCache m_gridCache;
+
 	///@brief Drag and drop of UI elements
 	enum DragState
 	{
@@ -630,6 +1734,27 @@ protected:
 	///@brief True if mouse is over the BER sampling location
 	bool m_mouseOverBERTarget;
 
+	///@brief Eye waveform m_tooltipBER was calculated from
+	WaveformBase* m_tooltipBERWaveform;
+
+	///@brief Revision of m_tooltipBERWaveform that m_tooltipBER was calculated from
+	uint64_t m_tooltipBERRevision;
+
+	///@brief Integration buffer position m_tooltipBER was calculated at
+	int64_t m_tooltipBERPos[2];
+
+	///@brief BER shown in the eye pattern tooltip
+	float m_tooltipBER;
+
+	///@brief Eye waveform the last tooltip readback was requested for
+	WaveformBase* m_tooltipBERRequestWaveform;
+
+	///@brief Revision of m_tooltipBERRequestWaveform the last tooltip readback was requested for
+	uint64_t m_tooltipBERRequestRevision;
+
+	///@brief Position the last tooltip readback was requested for (x in the high half, y in the low half)
+	uint64_t m_tooltipBERRequestTag;
+
 	///@brief Current trigger level, if dragging
 	float m_triggerLevelDuringDrag;
 
@@ -679,6 +1804,30 @@ protected:
 	///@brief Position of the Y axis cursor(s)
 	float m_yAxisCursorPositions[2];
 
+	//Appearance preferences read by the GUI thread every frame
+	ColorPreference m_cursor1Color;
+	ColorPreference m_cursor2Color;
+	ColorPreference m_cursorFillColor;
+	ColorPreference m_maskColor;
+	ColorPreference m_maskBorderPassColor;
+	ColorPreference m_maskBorderFailColor;
+	ColorPreference m_constellationPointColor;
+	ColorPreference m_peakTextColor;
+	ColorPreference m_backgroundBottomColor;
+	ColorPreference m_backgroundTopColor;
+	ColorPreference m_gridCenterlineColor;
+	ColorPreference m_gridColor;
+	RealPreference m_gridCenterlineWidth;
+	RealPreference m_gridWidth;
+	ColorPreference m_yAxisTextColor;
+	ColorPreference m_timelineAxisColor;
+	BoolPreference m_incrementalWaterfallPref;
+	BoolPreference m_reprojectPref;
+
+	//Rendering preferences read by the WaveformThread every time we're rasterized
+	BoolPreference m_halfPrecisionRasterPref;
+	BoolPreference m_incrementalAppendPref;
+
 	void DoCursor(int iCursor, DragState state);
 };
 
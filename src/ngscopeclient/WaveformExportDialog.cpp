@@ -0,0 +1,231 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformExportDialog
+ */
+
+#include "ngscopeclient.h"
+#include "WaveformExportDialog.h"
+#include "MainWindow.h"
+#include "FileBrowser.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformExportDialog::WaveformExportDialog(Session& session, MainWindow& parent)
+	: Dialog("Waveform Export", "WaveformExport", ImVec2(450, 400))
+	, m_session(session)
+	, m_parent(parent)
+	, m_format(WaveformExporter::FORMAT_CSV)
+	, m_pinnedOnly(false)
+	, m_reported(false)
+{
+}
+
+WaveformExportDialog::~WaveformExportDialog()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rendering
+
+/**
+	@brief Renders the dialog and handles UI events
+
+	@return		True if we should continue showing the dialog
+				False if it's been closed
+ */
+bool WaveformExportDialog::DoRender()
+{
+	SetupControls();
+
+	if(m_exporter)
+	{
+		Unit bytes(Unit::UNIT_BYTES);
+		if(!m_exporter->IsDone())
+		{
+			string label = string("Exporting (") + bytes.PrettyPrint(m_exporter->GetWrittenBytes(), 4) + ")";
+			ImGui::ProgressBar(m_exporter->GetProgress(), ImVec2(-1, 0), label.c_str());
+			if(ImGui::Button("Cancel"))
+				m_exporter->Cancel();
+		}
+		else
+		{
+			if(!m_reported)
+			{
+				m_reported = true;
+				if(!m_exporter->IsOK())
+					ShowErrorPopup("Export failed", m_exporter->GetError());
+			}
+
+			ImGui::Text("Wrote %s to %s",
+				bytes.PrettyPrint(m_exporter->GetWrittenBytes(), 4).c_str(),
+				m_exporter->GetPath().c_str());
+			auto skipped = m_exporter->GetSkippedCount();
+			if(skipped)
+			{
+				ImGui::SameLine();
+				ImGui::TextDisabled("(%zu skipped)", skipped);
+				Tooltip(
+					"Waveforms missing from an acquisition, loaded lazily from a session and not yet viewed,\n"
+					"or stored compacted can't be exported.");
+			}
+		}
+	}
+
+	if(m_browser)
+	{
+		m_browser->Render();
+
+		if(m_browser->IsClosedOK())
+			StartExport(m_browser->GetFileName());
+
+		if(m_browser->IsClosed())
+			m_browser = nullptr;
+	}
+
+	return true;
+}
+
+/**
+	@brief Shows the controls for choosing what to export
+ */
+void WaveformExportDialog::SetupControls()
+{
+	float width = ImGui::GetFontSize();
+	bool busy = m_exporter && !m_exporter->IsDone();
+	if(busy)
+		ImGui::BeginDisabled();
+
+	auto format = static_cast<WaveformExporter::Format>(m_format);
+	ImGui::SetNextItemWidth(10 * width);
+	if(Combo("Format", {"CSV", "WAV"}, m_format))
+		format = static_cast<WaveformExporter::Format>(m_format);
+	HelpMarker(
+		"CSV has one row per sample, for every selected channel of every acquisition.\n\n"
+		"WAV has one channel per selected stream, with acquisitions back to back. "
+		"Only analog channels can be exported, and files are limited to 4 GB.");
+
+	//Only instrument waveforms are stored in history, so we can't export filter outputs
+	vector<StreamDescriptor> checked;
+	float height = ImGui::GetContentRegionAvail().y - 4*ImGui::GetFrameHeightWithSpacing();
+	if(ImGui::BeginChild("Streams", ImVec2(0, max(height, 4*width)), true))
+	{
+		for(auto scope : m_session.GetScopes())
+		{
+			for(size_t i=0; i<scope->GetChannelCount(); i++)
+			{
+				auto chan = scope->GetOscilloscopeChannel(i);
+				if(!chan)
+					continue;
+
+				for(size_t j=0; j<chan->GetStreamCount(); j++)
+				{
+					StreamDescriptor stream(chan, j);
+					if(!WaveformExporter::CanExport(stream, format))
+						continue;
+
+					bool selected = (m_selected.find(stream) != m_selected.end());
+					if(ImGui::Checkbox(stream.GetName().c_str(), &selected))
+					{
+						if(selected)
+							m_selected.emplace(stream);
+						else
+							m_selected.erase(stream);
+					}
+					if(selected)
+						checked.push_back(stream);
+				}
+			}
+		}
+	}
+	ImGui::EndChild();
+
+	ImGui::Checkbox("Pinned acquisitions only", &m_pinnedOnly);
+
+	if(checked.empty())
+		ImGui::BeginDisabled();
+	if(ImGui::Button("Export...") && !m_browser)
+	{
+		auto mask = WaveformExporter::GetFileMask(format);
+		m_browser = MakeFileBrowser(
+			&m_parent,
+			".",
+			"Export Waveforms",
+			(format == WaveformExporter::FORMAT_WAV ? "WAV files (" : "CSV files (") + mask + ")",
+			mask,
+			true);
+	}
+	if(checked.empty())
+		ImGui::EndDisabled();
+
+	if(busy)
+		ImGui::EndDisabled();
+}
+
+/**
+	@brief Starts exporting the checked streams to a file
+ */
+void WaveformExportDialog::StartExport(const string& path)
+{
+	//Export streams in the order they're listed, not by set (pointer) order
+	auto format = static_cast<WaveformExporter::Format>(m_format);
+	vector<StreamDescriptor> streams;
+	for(auto scope : m_session.GetScopes())
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan)
+				continue;
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				StreamDescriptor stream(chan, j);
+				if( (m_selected.find(stream) != m_selected.end()) && WaveformExporter::CanExport(stream, format) )
+					streams.push_back(stream);
+			}
+		}
+	}
+
+	vector<shared_ptr<HistoryPoint>> points;
+	for(auto& pt : m_session.GetHistory().m_history)
+	{
+		if(!m_pinnedOnly || pt->m_pinned)
+			points.push_back(pt);
+	}
+
+	m_exporter = nullptr;
+	m_reported = false;
+	m_exporter = make_unique<WaveformExporter>(m_session, path, format, streams, points);
+}
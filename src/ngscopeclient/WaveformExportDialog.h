@@ -0,0 +1,81 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformExportDialog
+ */
+#ifndef WaveformExportDialog_h
+#define WaveformExportDialog_h
+
+#include "Dialog.h"
+#include "WaveformExporter.h"
+
+class MainWindow;
+class FileBrowser;
+
+/**
+	@brief Exports full resolution sample data for selected streams across history to a file
+ */
+class WaveformExportDialog : public Dialog
+{
+public:
+	WaveformExportDialog(Session& session, MainWindow& parent);
+	virtual ~WaveformExportDialog();
+
+	virtual bool DoRender();
+
+protected:
+	void SetupControls();
+	void StartExport(const std::string& path);
+
+	Session& m_session;
+	MainWindow& m_parent;
+
+	///@brief Output format
+	int m_format;
+
+	///@brief Streams checked for export
+	std::set<StreamDescriptor> m_selected;
+
+	///@brief True to only export pinned acquisitions
+	bool m_pinnedOnly;
+
+	///@brief Browser for choosing the output file
+	std::shared_ptr<FileBrowser> m_browser;
+
+	///@brief The export in progress, or the last one run
+	std::unique_ptr<WaveformExporter> m_exporter;
+
+	///@brief True if we've already reported the outcome of m_exporter
+	bool m_reported;
+};
+
+#endif
@@ -0,0 +1,524 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformExporter
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "AsyncFileWriter.h"
+#include "Session.h"
+#include "WaveformExporter.h"
+#include <charconv>
+#include <cinttypes>
+
+using namespace std;
+
+///@brief Number of samples encoded by one task
+#define EXPORT_CHUNK_SAMPLES 32768
+
+///@brief Size of a WAV header with fmt, fact and data chunks
+#define WAV_HEADER_SIZE 56
+
+///@brief WAVE_FORMAT_IEEE_FLOAT
+#define WAV_FORMAT_FLOAT 3
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Holds the points to export and starts the writer thread
+
+	Must be called from the GUI thread.
+ */
+WaveformExporter::WaveformExporter(
+	Session& session,
+	const string& path,
+	Format format,
+	const vector<StreamDescriptor>& streams,
+	const vector<shared_ptr<HistoryPoint>>& points)
+	: m_session(session)
+	, m_path(path)
+	, m_format(format)
+	, m_streams(streams)
+	, m_points(points)
+	, m_released(0)
+	, m_exported(0)
+	, m_skipped(0)
+	, m_writtenBytes(0)
+	, m_cancel(false)
+	, m_done(false)
+	, m_ok(true)
+{
+	for(auto s : m_streams)
+		m_streamNames.push_back(s.GetName());
+
+	//Hold every point so it isn't evicted or moved to another tier while we're reading it,
+	//and move everything to the CPU now since buffer transfers use the GPU queues which belong to this thread
+	{
+		shared_lock lock(m_session.GetWaveformDataMutex());
+		for(auto& pt : m_points)
+		{
+			pt->m_readerRefs ++;
+			for(auto s : m_streams)
+			{
+				auto wfm = GetWaveform(pt.get(), s);
+				if(wfm)
+					wfm->PrepareForCpuAccess();
+			}
+		}
+	}
+
+	m_thread = make_unique<thread>(&WaveformExporter::ThreadProc, this);
+}
+
+WaveformExporter::~WaveformExporter()
+{
+	m_cancel = true;
+	if(m_thread)
+		m_thread->join();
+
+	//In case the thread didn't get that far
+	Release(m_points.size());
+}
+
+/**
+	@brief Drops the reader references on every point before the specified index
+ */
+void WaveformExporter::Release(size_t upto)
+{
+	for(; m_released < upto; m_released ++)
+		m_points[m_released]->ReleaseReader();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+string WaveformExporter::GetFileMask(Format format)
+{
+	switch(format)
+	{
+		case FORMAT_WAV:
+			return "*.wav";
+
+		case FORMAT_CSV:
+		default:
+			return "*.csv";
+	}
+}
+
+/**
+	@brief Checks if a stream can be written in the specified format
+
+	Only instrument waveforms are kept in history. WAV files can only hold analog samples.
+ */
+bool WaveformExporter::CanExport(StreamDescriptor stream, Format format)
+{
+	auto chan = dynamic_cast<OscilloscopeChannel*>(stream.m_channel);
+	if(!chan || !chan->GetScope() || dynamic_cast<Filter*>(chan))
+		return false;
+
+	switch(stream.GetType())
+	{
+		case Stream::STREAM_TYPE_ANALOG:
+			return true;
+
+		case Stream::STREAM_TYPE_DIGITAL:
+			return (format == FORMAT_CSV);
+
+		default:
+			return false;
+	}
+}
+
+/**
+	@brief Finds the waveform for a stream in a point
+
+	Must be called with the waveform data mutex held.
+
+	@return The waveform, or null if the point has no float samples for the stream
+ */
+WaveformBase* WaveformExporter::GetWaveform(HistoryPoint* pt, StreamDescriptor stream)
+{
+	if(!pt->IsResident() || pt->IsLoading())
+		return nullptr;
+
+	auto chan = dynamic_cast<OscilloscopeChannel*>(stream.m_channel);
+	if(!chan)
+		return nullptr;
+
+	WaveformBase* wfm = nullptr;
+	for(auto& it : pt->m_history)
+	{
+		if(it.first.get() != chan->GetScope())
+			continue;
+		auto wit = it.second.find(stream);
+		if(wit != it.second.end())
+			wfm = wit->second;
+	}
+
+	//Compacted waveforms have no float samples until they're expanded
+	if(wfm && (pt->m_compactSamples.find(wfm) != pt->m_compactSamples.end()) )
+		return nullptr;
+
+	return wfm;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Encoding helpers
+
+static int64_t SampleTime(UniformWaveformBase* wfm, size_t i)
+{ return i * wfm->m_timescale + wfm->m_triggerPhase; }
+
+static int64_t SampleTime(SparseWaveformBase* wfm, size_t i)
+{ return wfm->m_offsets[i] * wfm->m_timescale + wfm->m_triggerPhase; }
+
+static void AppendInt(string& out, int64_t v)
+{
+	char tmp[24];
+	auto res = to_chars(tmp, tmp + sizeof(tmp), v);
+	out.append(tmp, res.ptr);
+}
+
+/**
+	@brief Appends the shortest text which reads back as exactly the same float
+ */
+static void AppendValue(string& out, float v)
+{
+	char tmp[32];
+	auto res = to_chars(tmp, tmp + sizeof(tmp), v);
+	out.append(tmp, res.ptr);
+}
+
+static void AppendValue(string& out, bool v)
+{ out += v ? '1' : '0'; }
+
+/**
+	@brief Formats one chunk of a waveform as CSV rows
+ */
+template<class T>
+static void EncodeCSV(string& out, const string& prefix, T* wfm, size_t start, size_t end)
+{
+	out.clear();
+	out.reserve( (end - start) * (prefix.size() + 32) );
+	for(size_t i=start; i<end; i++)
+	{
+		out += prefix;
+		AppendInt(out, SampleTime(wfm, i));
+		out += ',';
+		AppendValue(out, wfm->m_samples[i]);
+		out += '\n';
+	}
+}
+
+static void EncodeCSV(string& out, const string& prefix, WaveformBase* wfm, size_t start, size_t end)
+{
+	if(auto ua = dynamic_cast<UniformAnalogWaveform*>(wfm))
+		EncodeCSV(out, prefix, ua, start, end);
+	else if(auto sa = dynamic_cast<SparseAnalogWaveform*>(wfm))
+		EncodeCSV(out, prefix, sa, start, end);
+	else if(auto ud = dynamic_cast<UniformDigitalWaveform*>(wfm))
+		EncodeCSV(out, prefix, ud, start, end);
+	else if(auto sd = dynamic_cast<SparseDigitalWaveform*>(wfm))
+		EncodeCSV(out, prefix, sd, start, end);
+	else
+		out.clear();
+}
+
+/**
+	@brief Quotes a string for use as a CSV field
+ */
+static string QuoteCSV(const string& str)
+{
+	string ret = "\"";
+	for(auto c : str)
+	{
+		if(c == '\"')
+			ret += '\"';
+		ret += c;
+	}
+	ret += "\"";
+	return ret;
+}
+
+static void Put16(uint8_t* p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+static void Put32(uint8_t* p, uint32_t v)
+{
+	for(int i=0; i<4; i++)
+		p[i] = (v >> (8*i)) & 0xff;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Exporting
+
+void WaveformExporter::ThreadProc()
+{
+	pthread_setname_np_compat("WaveformExport");
+	Tracer::SetThreadName("WaveformExport");
+
+	AsyncFileWriter writer;
+	if(!writer.Open(m_path))
+	{
+		m_error = string("Could not open ") + m_path + " for writing";
+		m_ok = false;
+	}
+	else
+	{
+		if(m_format == FORMAT_WAV)
+			ExportWAV(writer);
+		else
+			ExportCSV(writer);
+
+		if(!writer.Close() && m_ok)
+		{
+			m_error = string("Error writing to ") + m_path;
+			m_ok = false;
+		}
+	}
+
+	LogTrace("Waveform export to %s done (%zu bytes, %zu waveforms skipped)\n",
+		m_path.c_str(), m_writtenBytes.load(), m_skipped.load());
+	m_done = true;
+}
+
+/**
+	@brief Writes a block of data to the output file, and flags an error if it fails
+ */
+bool WaveformExporter::Write(AsyncFileWriter& writer, const void* data, size_t len)
+{
+	if(!writer.Write(data, len))
+	{
+		if(m_ok)
+			m_error = string("Error writing to ") + m_path;
+		m_ok = false;
+		return false;
+	}
+
+	m_writtenBytes += len;
+	return true;
+}
+
+/**
+	@brief Writes every stream of every point as CSV
+ */
+void WaveformExporter::ExportCSV(AsyncFileWriter& writer)
+{
+	string header = "acquisition,stream,time_fs,value\n";
+	if(!Write(writer, header.c_str(), header.length()))
+		return;
+
+	auto& pool = m_session.GetTaskPool();
+	size_t batchChunks = 4 * max(pool.GetThreadCount(), (size_t)1);
+	size_t batchSamples = batchChunks * EXPORT_CHUNK_SAMPLES;
+	vector<string> encoded(batchChunks);
+
+	for(size_t ip=0; (ip < m_points.size()) && !m_cancel && m_ok; ip++)
+	{
+		auto pt = m_points[ip].get();
+
+		//Acquisition time as seconds since the epoch, to full precision
+		char stamp[64];
+		snprintf(stamp, sizeof(stamp), "%" PRId64 ".%015" PRId64,
+			static_cast<int64_t>(pt->m_time.GetSec()),
+			static_cast<int64_t>(pt->m_time.GetFs()));
+
+		for(size_t is=0; (is < m_streams.size()) && !m_cancel && m_ok; is++)
+		{
+			string prefix = string(stamp) + "," + QuoteCSV(m_streamNames[is]) + ",";
+
+			for(size_t start=0; !m_cancel && m_ok; start += batchSamples)
+			{
+				//Only hold the lock while we're reading this batch
+				size_t nchunks = 0;
+				{
+					shared_lock lock(m_session.GetWaveformDataMutex());
+					auto wfm = GetWaveform(pt, m_streams[is]);
+					if(!wfm)
+					{
+						if(start == 0)
+							m_skipped ++;
+						break;
+					}
+
+					size_t len = wfm->size();
+					if(start >= len)
+						break;
+					nchunks = min(batchChunks, (len - start + EXPORT_CHUNK_SAMPLES - 1) / EXPORT_CHUNK_SAMPLES);
+
+					pool.ParallelFor(0, nchunks, 1, [&](int64_t i)
+						{
+							size_t cstart = start + i*EXPORT_CHUNK_SAMPLES;
+							size_t cend = min(len, cstart + EXPORT_CHUNK_SAMPLES);
+							EncodeCSV(encoded[i], prefix, wfm, cstart, cend);
+						});
+				}
+
+				for(size_t i=0; i<nchunks; i++)
+				{
+					if(!Write(writer, encoded[i].c_str(), encoded[i].length()))
+						break;
+				}
+			}
+		}
+
+		m_exported ++;
+		Release(ip + 1);
+	}
+}
+
+/**
+	@brief Writes every point as a block of frames in a multi-channel float WAV file
+
+	Each stream is one channel, at the sample rate of the first waveform found. Within a point, streams shorter than
+	the longest one are padded with zeroes. Sparse waveforms can't be represented and are skipped.
+ */
+void WaveformExporter::ExportWAV(AsyncFileWriter& writer)
+{
+	size_t nch = m_streams.size();
+	if(nch == 0)
+		return;
+
+	//Work out the size of each point up front, since the header has to have the total length
+	vector<size_t> frames(m_points.size(), 0);
+	size_t totalFrames = 0;
+	int64_t timescale = 0;
+	{
+		shared_lock lock(m_session.GetWaveformDataMutex());
+		for(size_t ip=0; ip<m_points.size(); ip++)
+		{
+			for(auto s : m_streams)
+			{
+				auto wfm = dynamic_cast<UniformAnalogWaveform*>(GetWaveform(m_points[ip].get(), s));
+				if(!wfm)
+					continue;
+
+				if(timescale == 0)
+					timescale = wfm->m_timescale;
+				else if(timescale != wfm->m_timescale)
+					LogWarning("Waveform export: %s has a different sample rate, exporting at the first one found\n",
+						s.GetName().c_str());
+				frames[ip] = max(frames[ip], wfm->size());
+			}
+			totalFrames += frames[ip];
+		}
+	}
+
+	size_t frameSize = nch * sizeof(float);
+	uint64_t dataBytes = static_cast<uint64_t>(totalFrames) * frameSize;
+	if(dataBytes + WAV_HEADER_SIZE > 0xffffffffULL)
+	{
+		m_error = "Too much data for a WAV file (4 GB limit), export fewer acquisitions or use CSV";
+		m_ok = false;
+		return;
+	}
+	if(timescale <= 0)
+		timescale = 1;
+
+	//The header only has 32 bits for the sample rate, so anything over ~4.29 GS/s can't be stored as-is
+	double fullRate = FS_PER_SECOND / timescale;
+	uint32_t rate = 0xffffffff;
+	if(fullRate < rate)
+		rate = static_cast<uint32_t>(llround(fullRate));
+	else
+		LogWarning("Waveform export: sample rate too high for a WAV header, writing %u Hz instead\n", rate);
+	uint8_t hdr[WAV_HEADER_SIZE];
+	memcpy(hdr, "RIFF", 4);
+	Put32(hdr + 4, static_cast<uint32_t>(dataBytes + WAV_HEADER_SIZE - 8));
+	memcpy(hdr + 8, "WAVE", 4);
+	memcpy(hdr + 12, "fmt ", 4);
+	Put32(hdr + 16, 16);
+	Put16(hdr + 20, WAV_FORMAT_FLOAT);
+	Put16(hdr + 22, nch);
+	Put32(hdr + 24, rate);
+	Put32(hdr + 28, static_cast<uint32_t>(min<uint64_t>(0xffffffff, static_cast<uint64_t>(rate) * frameSize)));
+	Put16(hdr + 32, frameSize);
+	Put16(hdr + 34, 32);
+	memcpy(hdr + 36, "fact", 4);
+	Put32(hdr + 40, 4);
+	Put32(hdr + 44, static_cast<uint32_t>(totalFrames));
+	memcpy(hdr + 48, "data", 4);
+	Put32(hdr + 52, static_cast<uint32_t>(dataBytes));
+	if(!Write(writer, hdr, sizeof(hdr)))
+		return;
+
+	//Floats go out as-is, since every platform we build for is little endian
+	auto& pool = m_session.GetTaskPool();
+	size_t batchChunks = 4 * max(pool.GetThreadCount(), (size_t)1);
+	size_t batchFrames = batchChunks * EXPORT_CHUNK_SAMPLES;
+	vector<float> buf;
+	vector<UniformAnalogWaveform*> wfms(nch);
+	for(size_t ip=0; (ip < m_points.size()) && !m_cancel && m_ok; ip++)
+	{
+		auto pt = m_points[ip].get();
+		for(size_t start=0; (start < frames[ip]) && !m_cancel && m_ok; start += batchFrames)
+		{
+			size_t count = min(batchFrames, frames[ip] - start);
+			buf.resize(count * nch);
+			{
+				shared_lock lock(m_session.GetWaveformDataMutex());
+				for(size_t ch=0; ch<nch; ch++)
+				{
+					wfms[ch] = dynamic_cast<UniformAnalogWaveform*>(GetWaveform(pt, m_streams[ch]));
+					if(!wfms[ch] && (start == 0) )
+						m_skipped ++;
+				}
+
+				//Anything which went away since we sized the file is written as silence, so the header stays right
+				size_t nchunks = (count + EXPORT_CHUNK_SAMPLES - 1) / EXPORT_CHUNK_SAMPLES;
+				pool.ParallelFor(0, nchunks, 1, [&](int64_t i)
+					{
+						size_t cstart = i*EXPORT_CHUNK_SAMPLES;
+						size_t cend = min(count, cstart + EXPORT_CHUNK_SAMPLES);
+						for(size_t ch=0; ch<nch; ch++)
+						{
+							auto wfm = wfms[ch];
+							size_t len = wfm ? wfm->size() : 0;
+							for(size_t j=cstart; j<cend; j++)
+							{
+								size_t k = start + j;
+								buf[j*nch + ch] = (k < len) ? wfm->m_samples[k] : 0;
+							}
+						}
+					});
+			}
+
+			Write(writer, &buf[0], buf.size() * sizeof(float));
+		}
+
+		m_exported ++;
+		Release(ip + 1);
+	}
+}
@@ -0,0 +1,171 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformExporter
+ */
+#ifndef WaveformExporter_h
+#define WaveformExporter_h
+
+class Session;
+class HistoryPoint;
+class AsyncFileWriter;
+
+/**
+	@brief Writes full resolution sample data for a set of streams across many history points to one file
+
+	Sample data is read in place from each point (which is held so it isn't evicted or moved between memory tiers until
+	it's been written), in batches of fixed size chunks. Each batch is encoded by the session task pool in parallel,
+	since formatting numbers as text is far slower than the disk for CSV, then written out in order by a background
+	thread. The data mutex is only held while a batch is being encoded, so acquisition isn't stalled for the whole of
+	a long waveform.
+
+	As with HistorySearch, only instrument waveforms are stored in history so filter outputs can't be exported, and
+	points which were loaded lazily and aren't resident or which are stored as integer codes are skipped.
+ */
+class WaveformExporter
+{
+public:
+
+	enum Format
+	{
+		///@brief One row per sample: acquisition time, stream, sample time, value
+		FORMAT_CSV,
+
+		///@brief 32-bit float WAV, one channel per stream, with acquisitions back to back
+		FORMAT_WAV
+	};
+
+	WaveformExporter(
+		Session& session,
+		const std::string& path,
+		Format format,
+		const std::vector<StreamDescriptor>& streams,
+		const std::vector<std::shared_ptr<HistoryPoint>>& points);
+	~WaveformExporter();
+
+	WaveformExporter(const WaveformExporter&) =delete;
+	WaveformExporter& operator=(const WaveformExporter&) =delete;
+
+	///@brief Checks if the export has finished (or failed, or was cancelled)
+	bool IsDone()
+	{ return m_done; }
+
+	///@brief Checks if everything so far has been written successfully
+	bool IsOK()
+	{ return m_ok; }
+
+	///@brief Gets a description of what went wrong, if IsOK() is false. Only valid once IsDone() is true.
+	const std::string& GetError()
+	{ return m_error; }
+
+	///@brief Stops the export after the current batch
+	void Cancel()
+	{ m_cancel = true; }
+
+	///@brief Gets the fraction of points exported so far
+	float GetProgress()
+	{
+		if(m_points.empty())
+			return 1;
+		return m_exported.load() * 1.0f / m_points.size();
+	}
+
+	///@brief Gets the number of waveforms which couldn't be exported
+	size_t GetSkippedCount()
+	{ return m_skipped; }
+
+	///@brief Gets the number of bytes written so far
+	size_t GetWrittenBytes()
+	{ return m_writtenBytes; }
+
+	///@brief Gets the output file path
+	const std::string& GetPath()
+	{ return m_path; }
+
+	static std::string GetFileMask(Format format);
+	static bool CanExport(StreamDescriptor stream, Format format);
+
+protected:
+	void ThreadProc();
+	void ExportCSV(AsyncFileWriter& writer);
+	void ExportWAV(AsyncFileWriter& writer);
+	WaveformBase* GetWaveform(HistoryPoint* pt, StreamDescriptor stream);
+	bool Write(AsyncFileWriter& writer, const void* data, size_t len);
+	void Release(size_t upto);
+
+	///@brief The session the points came from
+	Session& m_session;
+
+	///@brief Output file path
+	std::string m_path;
+
+	///@brief Output format
+	Format m_format;
+
+	///@brief Streams to export, in column (or channel) order
+	std::vector<StreamDescriptor> m_streams;
+
+	///@brief Names of m_streams, saved up front since the channels may be renamed while we're running
+	std::vector<std::string> m_streamNames;
+
+	///@brief Points to export, oldest first, each holding a reader reference until it's been written
+	std::vector<std::shared_ptr<HistoryPoint>> m_points;
+
+	///@brief Index of the first point whose reader reference hasn't been released yet
+	size_t m_released;
+
+	///@brief Number of points exported so far
+	std::atomic<size_t> m_exported;
+
+	///@brief Number of waveforms skipped
+	std::atomic<size_t> m_skipped;
+
+	///@brief Number of bytes written so far
+	std::atomic<size_t> m_writtenBytes;
+
+	///@brief Set to stop early
+	std::atomic<bool> m_cancel;
+
+	///@brief Set once the writer thread has finished
+	std::atomic<bool> m_done;
+
+	///@brief False if anything went wrong
+	std::atomic<bool> m_ok;
+
+	///@brief Description of the failure, if any (writer thread only until m_done is set)
+	std::string m_error;
+
+	///@brief Writer thread
+	std::unique_ptr<std::thread> m_thread;
+};
+
+#endif
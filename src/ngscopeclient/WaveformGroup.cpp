@@ -42,6 +42,8 @@
 
 using namespace std;
 
+extern Event g_rerenderRequestedEvent;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -58,11 +60,24 @@ WaveformGroup::WaveformGroup(MainWindow* parent, const string& title)
 	, m_dragMarker(nullptr)
 	, m_tLastMouseMove(GetTime())
 	, m_timelineHeight(0)
+	, m_overviewHeight(0)
+	, m_overviewDragOffset(0)
+	, m_overviewDragGrab(0)
+	, m_visible(true)
+	, m_deferredRender(false)
 	, m_mouseOverTriggerArrow(false)
 	, m_mouseOverMarker(false)
 	, m_scopeTriggerDuringDrag(nullptr)
 	, m_displayingEye(false)
 	, m_xAxisCursorMode(X_CURSOR_NONE)
+	, m_markerColor(parent->GetSession().GetPreferences(), "Appearance.Cursors.marker_color")
+	, m_hoverColor(parent->GetSession().GetPreferences(), "Appearance.Cursors.hover_color")
+	, m_cursor1Color(parent->GetSession().GetPreferences(), "Appearance.Cursors.cursor_1_color")
+	, m_cursor2Color(parent->GetSession().GetPreferences(), "Appearance.Cursors.cursor_2_color")
+	, m_cursorFillColor(parent->GetSession().GetPreferences(), "Appearance.Cursors.cursor_fill_color")
+	, m_axisColor(parent->GetSession().GetPreferences(), "Appearance.Timeline.axis_color")
+	, m_axisTextColor(parent->GetSession().GetPreferences(), "Appearance.Timeline.text_color")
+	, m_showOverview(parent->GetSession().GetPreferences(), "Appearance.Timeline.show_overview")
 {
 	m_xAxisCursorPositions[0] = 0;
 	m_xAxisCursorPositions[1] = 0;
@@ -108,14 +123,55 @@ void WaveformGroup::AddArea(shared_ptr<WaveformArea>& area)
 /**
 	@brief Run the tone-mapping shader on all of our waveforms
 
-	Called by MainWindow::ToneMapAllWaveforms() at the start of each frame if new data is ready to render
+	Called by MainWindow::ToneMapAllWaveforms() at the start of each frame if new data is ready to render.
+	Nothing is done if we're hidden, we catch up once we're visible again.
+ */
+void WaveformGroup::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf, GpuTimer* timer)
+{
+	if(!m_visible)
+	{
+		m_deferredRender = true;
+		return;
+	}
+
+	auto areas = GetWaveformAreas();
+
+	for(auto a : areas)
+		a->ToneMapAllWaveforms(cmdbuf, timer);
+}
+
+/**
+	@brief Appends the state of every channel's tone mapping dispatch to a layout descriptor
+
+	@return False if any channel can't have its tone mapping commands replayed
  */
-void WaveformGroup::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
+bool WaveformGroup::GetToneMapLayout(vector<uintptr_t>& layout)
 {
+	//Hidden groups aren't tone mapped, so they don't contribute anything
+	if(!m_visible)
+		return true;
+
 	auto areas = GetWaveformAreas();
 
+	bool ok = true;
+	for(auto a : areas)
+		ok = a->GetToneMapLayout(layout) && ok;
+	return ok;
+}
+
+/**
+	@brief Notes that every channel's texture now shows the image it was tone mapped from
+
+	Hidden groups aren't tone mapped, so their textures still show whatever they did before.
+ */
+void WaveformGroup::LatchTextureViews()
+{
+	if(!m_visible)
+		return;
+
+	auto areas = GetWaveformAreas();
 	for(auto a : areas)
-		a->ToneMapAllWaveforms(cmdbuf);
+		a->LatchTextureViews();
 }
 
 void WaveformGroup::ReferenceWaveformTextures()
@@ -125,16 +181,60 @@ void WaveformGroup::ReferenceWaveformTextures()
 		a->ReferenceWaveformTextures();
 }
 
-void WaveformGroup::RenderWaveformTextures(
+/**
+	@brief Records rasterization of every waveform in the group
+
+	@param cmdbuf			Command buffer to record into
+	@param channels			Filled out with the channels referenced by the command buffer
+	@param shares			Images rasterized so far during this pass, by this group or any other
+	@param clearPersistence	True to clear persistence of every waveform
+	@param timer			If not null, timestamps are recorded around each shader dispatch
+	@param interruptible	If true, stop before the next area if another re-render has been requested, since
+							anything we'd draw is already out of date
+	@param previewOnly		If true, only draw raw instrument channels without persistence
+
+	@return False if we stopped early
+ */
+bool WaveformGroup::RenderWaveformTextures(
 	vk::raii::CommandBuffer& cmdbuf,
 	vector<shared_ptr<DisplayedChannel> >& channels,
-	bool clearPersistence)
+	RasterShareCache& shares,
+	bool clearPersistence,
+	GpuTimer* timer,
+	bool interruptible,
+	bool previewOnly)
 {
-	bool clearThisGroupOnly = m_clearPersistence.exchange(false);
+	//Don't spend time drawing anything nobody can see. Leave the persistence clear request for later too.
+	//(a preview is followed by a full render straight away, which will take care of that)
+	if(!m_visible)
+	{
+		if(previewOnly)
+			return true;
+		if(clearPersistence)
+			m_clearPersistence = true;
+		m_deferredRender = true;
+		return true;
+	}
+
+	bool clearThisGroupOnly = previewOnly ? false : m_clearPersistence.exchange(false);
+
+	//Channels displayed in more than one area share their index searches for this render
+	IndexSearchCache searches;
 
 	auto areas = GetWaveformAreas();
 	for(auto a : areas)
-		a->RenderWaveformTextures(cmdbuf, channels, clearThisGroupOnly || clearPersistence);
+	{
+		if(interruptible && g_rerenderRequestedEvent.Peek(false))
+		{
+			if(clearThisGroupOnly)
+				m_clearPersistence = true;
+			return false;
+		}
+
+		a->RenderWaveformTextures(
+			cmdbuf, channels, clearThisGroupOnly || clearPersistence, searches, shares, timer, previewOnly);
+	}
+	return true;
 }
 
 bool WaveformGroup::Render()
@@ -146,11 +246,17 @@ bool WaveformGroup::Render()
 	if(!ImGui::Begin(GetID().c_str(), &open, ImGuiWindowFlags_NoScrollWithMouse))
 	{
 		//tabbed out, don't draw anything until we're back in the foreground
+		m_visible = false;
 		TitleHoverHelp();
 		ImGui::End();
 		return true;
 	}
 
+	//If we skipped any rendering while hidden, catch up now
+	m_visible = true;
+	if(m_deferredRender.exchange(false))
+		m_parent->SetNeedRender();
+
 	//Check for right click on the title bar
 	//see https://github.com/ocornut/imgui/issues/7914
 	if(ImGui::BeginPopupContextItem())
@@ -198,7 +304,16 @@ bool WaveformGroup::Render()
 		}
 	}
 
-	//Render the timeline
+	//Render the overview of the whole capture, then the timeline.
+	//Cursors and markers are drawn from the top of the timeline down.
+	m_overviewHeight = 0;
+	if(m_showOverview.Get() && !m_displayingEye)
+	{
+		m_overviewHeight = 2 * ImGui::GetFontSize();
+		clientArea.y -= m_overviewHeight;
+		RenderOverview(plotWidth, m_overviewHeight);
+		pos.y += m_overviewHeight;
+	}
 	m_timelineHeight = 2.5 * ImGui::GetFontSize();
 	clientArea.y -= m_timelineHeight;
 	RenderTimeline(plotWidth, m_timelineHeight);
@@ -234,6 +349,8 @@ bool WaveformGroup::Render()
 	RenderXAxisCursors(pos, plotSize);
 	if(m_xAxisCursorMode != X_CURSOR_NONE)
 		DoCursorReadouts();
+	else
+		m_rangeIndexes.clear();
 	RenderMarkers(pos, plotSize);
 
 	ImGui::End();
@@ -394,6 +511,25 @@ void WaveformGroup::DoCursorReadouts()
 						ImGui::TableSetColumnIndex(3);
 						RightJustifiedText(svd);
 
+						//Show statistics between the cursors when hovering over the delta
+						//(only index the waveform when asked, since it takes a pass over the whole thing)
+						WaveformRangeIndex* rangeIndex = nullptr;
+						auto yunit = stream.GetYAxisUnits();
+						if( (stream.GetType() == Stream::STREAM_TYPE_ANALOG) && ImGui::IsItemHovered() )
+							rangeIndex = GetRangeIndex(data, yunit);
+						size_t first;
+						size_t last;
+						if(rangeIndex && rangeIndex->GetRange(m_xAxisCursorPositions[0], m_xAxisCursorPositions[1], first, last))
+						{
+							ImGui::BeginTooltip();
+							ImGui::Text("Samples: %zu", last - first + 1);
+							ImGui::Text("Min: %s", yunit.PrettyPrint(rangeIndex->GetMin(first, last)).c_str());
+							ImGui::Text("Max: %s", yunit.PrettyPrint(rangeIndex->GetMax(first, last)).c_str());
+							ImGui::Text("Mean: %s", yunit.PrettyPrint(rangeIndex->GetMean(first, last)).c_str());
+							ImGui::Text("RMS: %s", yunit.PrettyPrint(rangeIndex->GetRMS(first, last)).c_str());
+							ImGui::EndTooltip();
+						}
+
 						//In-band power
 						Unit punit(Unit::UNIT_COUNTS);
 						bool ok = true;
@@ -431,6 +567,35 @@ void WaveformGroup::DoCursorReadouts()
 		}
 	}
 	ImGui::End();
+
+	//Forget indexes of waveforms we didn't read out this frame
+	for(auto it = m_rangeIndexes.begin(); it != m_rangeIndexes.end(); )
+	{
+		if(!it->second.m_used)
+			it = m_rangeIndexes.erase(it);
+		else
+		{
+			it->second.m_used = false;
+			it ++;
+		}
+	}
+}
+
+/**
+	@brief Gets the range index for a waveform, building it if necessary
+
+	@return The index, or null if the waveform can't be indexed (not analog, or empty)
+ */
+WaveformRangeIndex* WaveformGroup::GetRangeIndex(WaveformBase* wfm, Unit yunit)
+{
+	if(wfm == nullptr)
+		return nullptr;
+
+	auto& index = m_rangeIndexes[wfm];
+	index.m_used = true;
+	if(!index.IsCurrent(wfm, yunit) && !index.Build(wfm, yunit))
+		return nullptr;
+	return &index;
 }
 
 /**
@@ -438,42 +603,19 @@ void WaveformGroup::DoCursorReadouts()
  */
 float WaveformGroup::GetInBandPower(WaveformBase* wfm, Unit yunit, int64_t t1, int64_t t2)
 {
-	auto swfm = dynamic_cast<SparseAnalogWaveform*>(wfm);
-	auto uwfm = dynamic_cast<UniformAnalogWaveform*>(wfm);
-
 	//Make sure we have data
-	if(!swfm && !uwfm)
-		return 0;
-	if(!wfm->size())
+	auto index = GetRangeIndex(wfm, yunit);
+	if(!index)
 		return 0;
 
-	//Get the samples and start/end indexex
-	auto& samples = swfm ? swfm->m_samples : uwfm->m_samples;
-	bool err1;
-	bool err2;
-	auto ileft = GetIndexNearestAtOrBeforeTimestamp(wfm, t1, err1);
-	auto iright = GetIndexNearestAtOrBeforeTimestamp(wfm, t2, err2);
-	if(err1)
-		ileft = 0;
-	if(err2)
-		iright = wfm->size() - 1;
-
 	//Sum the in-band power
-	//Note that if it's in dBm we have to go to linear units and back
-	bool is_log = (yunit == Unit::UNIT_DBM);
-	bool is_irradiance = (yunit == Unit::UNIT_W_M2_NM);
+	//Note that if it's in dBm we have to go back to log units
+	size_t first;
+	size_t last;
 	float total = 0;
-	for(size_t i=ileft; i <= iright; i++)
-	{
-		float f = samples[i];
-		if(is_log)
-			total += pow(10, (f - 30) / 10);	//assume
-		else if(is_irradiance)
-			total += f * GetDurationScaled(swfm, uwfm, i) * 1e-3;	//scale by pm to nm
-		else
-			total += f;
-	}
-	if(is_log)
+	if(index->GetRange(t1, t2, first, last))
+		total = index->GetLinearPower(first, last);
+	if(yunit == Unit::UNIT_DBM)
 		total = 10 * log10(total) + 30;
 
 	return total;
@@ -500,6 +642,13 @@ void WaveformGroup::RenderMarkers(ImVec2 pos, ImVec2 size)
 	auto wavetime = m_areas[0]->GetWaveformTimestamp();
 	auto& markers = session.GetMarkers(wavetime);
 
+	//Only look at markers which might be visible. Labels are drawn to the left of the line,
+	//so include some markers just past the right edge too.
+	float labelMargin = 20 * ImGui::GetFontSize();
+	auto visible = markers.GetRange(
+		XPositionToXAxisUnits(pos.x),
+		XPositionToXAxisUnits(pos.x + size.x + labelMargin));
+
 	auto packetHover = session.GetHoveredPacketTimestamp();
 
 	//Create a child window for all of our drawing
@@ -509,15 +658,16 @@ void WaveformGroup::RenderMarkers(ImVec2 pos, ImVec2 size)
 	{
 		auto list = ImGui::GetWindowDrawList();
 
-		auto& prefs = m_parent->GetSession().GetPreferences();
-		auto color = prefs.GetColor("Appearance.Cursors.marker_color");
-		auto hcolor = prefs.GetColor("Appearance.Cursors.hover_color");
+		auto color = m_markerColor.Get();
+		auto hcolor = m_hoverColor.Get();
 		auto font = m_parent->GetFontPref("Appearance.Cursors.label_font");
 		auto fontSize = font->FontSize * ImGui::GetIO().FontGlobalScale;
 
 		//Draw the markers
-		for(auto& m : markers)
+		for(auto it = visible.first; it != visible.second; it++)
 		{
+			auto& m = *it;
+
 			//Lines
 			float xpos = round(XAxisUnitsToXPosition(m.m_offset));
 			list->AddLine(ImVec2(xpos, pos.y), ImVec2(xpos, pos.y + size.y), color);
@@ -561,8 +711,10 @@ void WaveformGroup::RenderMarkers(ImVec2 pos, ImVec2 size)
 	auto mouse = ImGui::GetMousePos();
 	if(!IsMouseOverButtonInWaveformArea())
 	{
-		for(auto& m : markers)
+		for(auto it = visible.first; it != visible.second; it++)
 		{
+			auto& m = *it;
+
 			//Child window doesn't get mouse events (this flag is needed so we can pass mouse events to the WaveformArea's)
 			//So we have to do all of our interaction processing inside the top level window
 			//TODO: this is basically DoCursor(), can we de-duplicate this code?
@@ -666,10 +818,9 @@ void WaveformGroup::RenderXAxisCursors(ImVec2 pos, ImVec2 size)
 	{
 		auto list = ImGui::GetWindowDrawList();
 
-		auto& prefs = m_parent->GetSession().GetPreferences();
-		auto cursor0_color = prefs.GetColor("Appearance.Cursors.cursor_1_color");
-		auto cursor1_color = prefs.GetColor("Appearance.Cursors.cursor_2_color");
-		auto fill_color = prefs.GetColor("Appearance.Cursors.cursor_fill_color");
+		auto cursor0_color = m_cursor1Color.Get();
+		auto cursor1_color = m_cursor2Color.Get();
+		auto fill_color = m_cursorFillColor.Get();
 		auto font = m_parent->GetFontPref("Appearance.Cursors.label_font");
 
 		float xpos0 = round(XAxisUnitsToXPosition(m_xAxisCursorPositions[0]));
@@ -836,6 +987,150 @@ void WaveformGroup::DoCursor(int iCursor, DragState state)
 	}
 }
 
+/**
+	@brief Draws a strip showing every analog waveform in the group in full, with the current view marked on it
+
+	The min/max summary of each waveform is only rebuilt when the waveform changes. Dragging the view rectangle
+	doesn't touch the main view until the mouse is released, so the waveforms are only re-rendered once.
+ */
+void WaveformGroup::RenderOverview(float width, float height)
+{
+	ImGui::BeginChild("overview", ImVec2(width, height));
+
+	auto list = ImGui::GetWindowDrawList();
+	auto pos = ImGui::GetWindowPos();
+	ImGui::Dummy(ImVec2(width, height));
+	if(width < 1)
+	{
+		ImGui::EndChild();
+		return;
+	}
+
+	//Summarize at a power of two of bins per pixel, so resizing the window doesn't rebuild the summaries every frame
+	size_t bins = 256;
+	while(bins < width)
+		bins *= 2;
+
+	//Gather summaries and find the extent of the whole capture
+	struct OverviewChannel
+	{
+		shared_ptr<DisplayedChannel> m_channel;
+		UniformAnalogWaveform* m_data;
+	};
+	vector<OverviewChannel> channels;
+	int64_t start = INT64_MAX;
+	int64_t end = -INT64_MAX;
+	auto queue = m_parent->GetRenderQueue();
+	for(auto a : GetWaveformAreas())
+	{
+		for(size_t i=0; i<a->GetStreamCount(); i++)
+		{
+			auto chan = a->GetDisplayedChannel(i);
+			auto stream = chan->GetStream();
+			if(stream.GetType() != Stream::STREAM_TYPE_ANALOG)
+				continue;
+			auto data = dynamic_cast<UniformAnalogWaveform*>(stream.GetData());
+			if(!data || !chan->UpdateOverview(data, bins, queue))
+				continue;
+
+			channels.push_back({chan, data});
+			start = min(start, data->m_triggerPhase);
+			end = max(end, data->m_triggerPhase + (int64_t)data->size() * data->m_timescale);
+		}
+	}
+
+	list->AddRectFilled(pos, ImVec2(pos.x + width, pos.y + height), ImGui::GetColorU32(ImGuiCol_FrameBg));
+	if(channels.empty() || (end <= start))
+	{
+		ImGui::EndChild();
+		return;
+	}
+	double xscale = width / (end - start);
+
+	//Merge bins into pixel columns, and scale each channel to its own range so they're all visible
+	vector<float> colMin;
+	vector<float> colMax;
+	for(auto& c : channels)
+	{
+		auto& overview = c.m_channel->GetOverview();
+		size_t nbins = overview.size() / 2;
+		int64_t binWidth = c.m_channel->GetOverviewSamplesPerBin() * c.m_data->m_timescale;
+
+		float vmin = FLT_MAX;
+		float vmax = -FLT_MAX;
+		colMin.assign((size_t)width, FLT_MAX);
+		colMax.assign((size_t)width, -FLT_MAX);
+		for(size_t i=0; i<nbins; i++)
+		{
+			float lo = overview[i*2];
+			float hi = overview[i*2 + 1];
+			vmin = min(vmin, lo);
+			vmax = max(vmax, hi);
+
+			int64_t t = c.m_data->m_triggerPhase + i*binWidth;
+			size_t x0 = min<size_t>(colMin.size() - 1, (t - start) * xscale);
+			size_t x1 = min<size_t>(colMin.size() - 1, (t + binWidth - start) * xscale);
+			for(size_t x = x0; x <= x1; x++)
+			{
+				colMin[x] = min(colMin[x], lo);
+				colMax[x] = max(colMax[x], hi);
+			}
+		}
+
+		float vrange = max(vmax - vmin, FLT_MIN);
+		float yscale = (height - 2) / vrange;
+		auto color = ColorFromString(c.m_channel->GetStream().m_channel->m_displaycolor);
+		for(size_t x=0; x<colMin.size(); x++)
+		{
+			if(colMin[x] > colMax[x])
+				continue;
+			float ytop = pos.y + 1 + (vmax - colMax[x]) * yscale;
+			float ybot = pos.y + 1 + (vmax - colMin[x]) * yscale;
+			list->AddRectFilled(ImVec2(pos.x + x, ytop), ImVec2(pos.x + x + 1, max(ybot, ytop + 1)), color);
+		}
+	}
+
+	//Handle clicking and dragging
+	int64_t viewWidth = PixelsToXAxisUnits(width);
+	auto mouse = ImGui::GetMousePos();
+	int64_t mouseTime = start + (mouse.x - pos.x) / xscale;
+	if(ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+	{
+		//Grab the view where it was clicked, or center it on the click if outside it
+		m_overviewDragGrab = mouseTime - m_xAxisOffset;
+		if( (m_overviewDragGrab < 0) || (m_overviewDragGrab > viewWidth) )
+			m_overviewDragGrab = viewWidth / 2;
+		m_dragState = DRAG_STATE_OVERVIEW;
+	}
+	int64_t viewStart = m_xAxisOffset;
+	if(m_dragState == DRAG_STATE_OVERVIEW)
+	{
+		m_overviewDragOffset = mouseTime - m_overviewDragGrab;
+		viewStart = m_overviewDragOffset;
+
+		if(ImGui::IsMouseReleased(ImGuiMouseButton_Left))
+		{
+			m_dragState = DRAG_STATE_NONE;
+			if(m_xAxisOffset != m_overviewDragOffset)
+			{
+				m_xAxisOffset = m_overviewDragOffset;
+				ClearPersistence();
+			}
+		}
+	}
+
+	//Current view, kept at least a few pixels wide so it's still visible when zoomed far in
+	float vx0 = pos.x + (viewStart - start) * xscale;
+	float vx1 = max(vx0 + 3, (float)(pos.x + (viewStart + viewWidth - start) * xscale));
+	list->AddRectFilled(ImVec2(vx0, pos.y), ImVec2(vx1, pos.y + height), ImGui::GetColorU32(ImGuiCol_Text, 0.15));
+	list->AddRect(ImVec2(vx0, pos.y), ImVec2(vx1, pos.y + height), ImGui::GetColorU32(ImGuiCol_Text));
+
+	if(ImGui::IsWindowHovered())
+		m_parent->AddStatusHelp("mouse_lmb_drag", "Move view");
+
+	ImGui::EndChild();
+}
+
 void WaveformGroup::RenderTimeline(float width, float height)
 {
 	ImGui::BeginChild("timeline", ImVec2(width, height));
@@ -843,9 +1138,8 @@ void WaveformGroup::RenderTimeline(float width, float height)
 	auto list = ImGui::GetWindowDrawList();
 
 	//Style settings
-	auto& prefs = m_parent->GetSession().GetPreferences();
-	auto color = prefs.GetColor("Appearance.Timeline.axis_color");
-	auto textcolor = prefs.GetColor("Appearance.Timeline.text_color");
+	auto color = m_axisColor.Get();
+	auto textcolor = m_axisTextColor.Get();
 	auto font = m_parent->GetFontPref("Appearance.Timeline.x_axis_font");
 	float fontSize = font->FontSize * ImGui::GetIO().FontGlobalScale;
 
@@ -967,6 +1261,75 @@ void WaveformGroup::RenderTimeline(float width, float height)
 	list->PathLineTo(ImVec2(pos.x + width, pos.y));
 	list->PathStroke(color, 0, thickLineWidth);
 
+	//Tick positions and labels only change when the view does
+	TimelineTickKey key;
+	key.m_width = width;
+	key.m_pixelsPerXUnit = m_pixelsPerXUnit;
+	key.m_xAxisOffset = m_xAxisOffset;
+	key.m_minLabelSpacing = min_label_grad_width;
+	key.m_unit = m_xAxisUnit;
+	if(!m_tickCache.m_valid || !(m_tickCache.m_key == key))
+	{
+		m_tickCache.m_key = key;
+		m_tickCache.m_valid = true;
+		CalculateTicks(width, min_label_grad_width);
+	}
+
+	for(auto x : m_tickCache.m_fineTicks)
+	{
+		list->PathLineTo(ImVec2(pos.x + x, pos.y));
+		list->PathLineTo(ImVec2(pos.x + x, pos.y + fineTickLength));
+		list->PathStroke(color, 0, thinLineWidth);
+	}
+
+	float textMargin = 2;
+	for(auto& label : m_tickCache.m_labels)
+	{
+		//Coarse ticks
+		float x = pos.x + label.first;
+		list->PathLineTo(ImVec2(x, pos.y));
+		list->PathLineTo(ImVec2(x, pos.y + coarseTickLength));
+		list->PathStroke(color, 0, thickLineWidth);
+
+		//Render label
+		list->AddText(
+			font,
+			fontSize,
+			ImVec2(x + textMargin, ymid),
+			textcolor,
+			label.second.c_str());
+	}
+
+	RenderTriggerPositionArrows(pos, height);
+
+	//Help messages in status bar
+	if(ImGui::IsWindowHovered())
+	{
+		if(m_mouseOverTriggerArrow)
+			m_parent->AddStatusHelp("mouse_lmb_drag", "Move trigger position");
+		else
+			m_parent->AddStatusHelp("mouse_lmb_drag", "Pan timeline");
+
+		m_parent->AddStatusHelp("mouse_lmb_double", "Open timebase properties");
+
+		m_parent->AddStatusHelp("mouse_wheel", "Zoom horizontal axis");
+		m_parent->AddStatusHelp("mouse_mmb", "Autoscale horizontal axis to waveforms");
+	}
+
+	ImGui::EndChild();
+}
+
+/**
+	@brief Calculates the positions and labels of the timeline's tick marks into m_tickCache
+
+	@param width				Width of the timeline, in pixels
+	@param min_label_grad_width	Minimum distance between labels, in pixels
+ */
+void WaveformGroup::CalculateTicks(float width, double min_label_grad_width)
+{
+	m_tickCache.m_fineTicks.clear();
+	m_tickCache.m_labels.clear();
+
 	//Figure out rounding granularity, based on our time scales
 	float xscale = m_pixelsPerXUnit;
 	int64_t width_xunits = width / xscale;
@@ -981,15 +1344,11 @@ void WaveformGroup::RenderTimeline(float width, float height)
 	double log_units = log(units_per_grad) / log(base);
 	double log_units_rounded = ceil(log_units);
 	double units_rounded = pow(base, log_units_rounded);
-	float textMargin = 2;
 	int64_t grad_xunits_rounded = round(units_rounded * round_divisor);
 
 	//avoid divide-by-zero in weird cases with no waveform etc
 	if(grad_xunits_rounded == 0)
-	{
-		ImGui::EndChild();
 		return;
-	}
 
 	//Calculate number of ticks within a division
 	double nsubticks = 5;
@@ -998,12 +1357,12 @@ void WaveformGroup::RenderTimeline(float width, float height)
 	//Find the start time (rounded as needed)
 	double tstart = round(m_xAxisOffset / grad_xunits_rounded) * grad_xunits_rounded;
 
-	//Print tick marks and labels
+	//Find tick marks and labels
 	for(double t = tstart - grad_xunits_rounded; t < (tstart + width_xunits + grad_xunits_rounded); t += grad_xunits_rounded)
 	{
 		double x = (t - m_xAxisOffset) * xscale;
 
-		//Draw fine ticks first (even if the labeled graduation doesn't fit)
+		//Fine ticks first (even if the labeled graduation doesn't fit)
 		for(int tick=1; tick < nsubticks; tick++)
 		{
 			double subx = (t - m_xAxisOffset + tick*subtick) * xscale;
@@ -1012,11 +1371,7 @@ void WaveformGroup::RenderTimeline(float width, float height)
 				continue;
 			if(subx > width)
 				break;
-			subx += pos.x;
-
-			list->PathLineTo(ImVec2(subx, pos.y));
-			list->PathLineTo(ImVec2(subx, pos.y + fineTickLength));
-			list->PathStroke(color, 0, thinLineWidth);
+			m_tickCache.m_fineTicks.push_back(subx);
 		}
 
 		if(x < 0)
@@ -1024,38 +1379,8 @@ void WaveformGroup::RenderTimeline(float width, float height)
 		if(x > width)
 			break;
 
-		//Coarse ticks
-		x += pos.x;
-		list->PathLineTo(ImVec2(x, pos.y));
-		list->PathLineTo(ImVec2(x, pos.y + coarseTickLength));
-		list->PathStroke(color, 0, thickLineWidth);
-
-		//Render label
-		list->AddText(
-			font,
-			fontSize,
-			ImVec2(x + textMargin, ymid),
-			textcolor,
-			m_xAxisUnit.PrettyPrint(t).c_str());
+		m_tickCache.m_labels.push_back(pair<float, string>(x, m_xAxisUnit.PrettyPrint(t)));
 	}
-
-	RenderTriggerPositionArrows(pos, height);
-
-	//Help messages in status bar
-	if(ImGui::IsWindowHovered())
-	{
-		if(m_mouseOverTriggerArrow)
-			m_parent->AddStatusHelp("mouse_lmb_drag", "Move trigger position");
-		else
-			m_parent->AddStatusHelp("mouse_lmb_drag", "Pan timeline");
-
-		m_parent->AddStatusHelp("mouse_lmb_double", "Open timebase properties");
-
-		m_parent->AddStatusHelp("mouse_wheel", "Zoom horizontal axis");
-		m_parent->AddStatusHelp("mouse_mmb", "Autoscale horizontal axis to waveforms");
-	}
-
-	ImGui::EndChild();
 }
 
 /**
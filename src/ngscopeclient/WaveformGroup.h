@@ -36,6 +36,58 @@
 #define WaveformGroup_h
 
 #include "WaveformArea.h"
+#include "WaveformRangeIndex.h"
+
+/**
+	@brief Everything the tick marks on a WaveformGroup's timeline depend on
+ */
+class TimelineTickKey
+{
+public:
+	TimelineTickKey()
+	: m_width(0)
+	, m_pixelsPerXUnit(0)
+	, m_xAxisOffset(0)
+	, m_minLabelSpacing(0)
+	, m_unit(Unit::UNIT_FS)
+	{}
+
+	bool operator==(const TimelineTickKey& rhs) const
+	{
+		return
+			(m_width == rhs.m_width) &&
+			(m_pixelsPerXUnit == rhs.m_pixelsPerXUnit) &&
+			(m_xAxisOffset == rhs.m_xAxisOffset) &&
+			(m_minLabelSpacing == rhs.m_minLabelSpacing) &&
+			(m_unit == rhs.m_unit);
+	}
+
+	float m_width;
+	float m_pixelsPerXUnit;
+	int64_t m_xAxisOffset;
+	double m_minLabelSpacing;
+	Unit m_unit;
+};
+
+/**
+	@brief Tick marks and formatted labels of a WaveformGroup's timeline, kept until the view changes
+ */
+class TimelineTickCache
+{
+public:
+	TimelineTickCache()
+	: m_valid(false)
+	{}
+
+	TimelineTickKey m_key;
+	bool m_valid;
+
+	///@brief X position of each fine tick, relative to the left of the timeline
+	std::vector<float> m_fineTicks;
+
+	///@brief X position (relative to the left of the timeline) and label of each coarse tick
+	std::vector<std::pair<float, std::string> > m_labels;
+};
 
 /**
 	@brief A WaveformGroup is a container for one or more WaveformArea's.
@@ -49,13 +101,26 @@ public:
 	void Clear();
 
 	bool Render();
-	void ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf);
+
+	/**
+		@brief Check if the group was drawn last frame (i.e. not in a background tab or collapsed)
+	 */
+	bool IsVisible()
+	{ return m_visible; }
+
+	void ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf, GpuTimer* timer = nullptr);
+	bool GetToneMapLayout(std::vector<uintptr_t>& layout);
+	void LatchTextureViews();
 	void ReferenceWaveformTextures();
 
-	void RenderWaveformTextures(
+	bool RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
 		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
-		bool clearPersistence);
+		RasterShareCache& shares,
+		bool clearPersistence,
+		GpuTimer* timer = nullptr,
+		bool interruptible = false,
+		bool previewOnly = false);
 
 	const std::string GetID()
 	{ return m_title + "###" + m_id; }
@@ -137,7 +202,9 @@ public:
 	{ return m_dragState == DRAG_STATE_TRIGGER; }
 
 protected:
+	void RenderOverview(float width, float height);
 	void RenderTimeline(float width, float height);
+	void CalculateTicks(float width, double min_label_grad_width);
 	void RenderTriggerPositionArrows(ImVec2 pos, float height);
 	void RenderXAxisCursors(ImVec2 pos, ImVec2 size);
 	void RenderMarkers(ImVec2 pos, ImVec2 size);
@@ -145,6 +212,7 @@ protected:
 
 	void TitleHoverHelp();
 
+	WaveformRangeIndex* GetRangeIndex(WaveformBase* wfm, Unit yunit);
 	float GetInBandPower(WaveformBase* wfm, Unit yunit, int64_t t1, int64_t t2);
 
 	bool IsMouseOverButtonInWaveformArea();
@@ -156,7 +224,8 @@ protected:
 		DRAG_STATE_X_CURSOR0,
 		DRAG_STATE_X_CURSOR1,
 		DRAG_STATE_MARKER,
-		DRAG_STATE_TRIGGER
+		DRAG_STATE_TRIGGER,
+		DRAG_STATE_OVERVIEW
 	};
 
 	void DoCursor(int iCursor, DragState state);
@@ -209,9 +278,27 @@ protected:
 	///@brief Height of the timeline
 	float m_timelineHeight;
 
+	///@brief Tick marks drawn on the timeline last frame
+	TimelineTickCache m_tickCache;
+
+	///@brief Height of the overview strip above the timeline (zero if hidden)
+	float m_overviewHeight;
+
+	///@brief X axis offset the view will move to when an overview drag is released
+	int64_t m_overviewDragOffset;
+
+	///@brief Distance from the left edge of the view to the point grabbed in the overview, in X axis units
+	int64_t m_overviewDragGrab;
+
 	///@brief True if clearing persistence
 	std::atomic<bool> m_clearPersistence;
 
+	///@brief True if the group was drawn last frame
+	std::atomic<bool> m_visible;
+
+	///@brief True if rasterization or tone mapping was skipped while we were hidden, so our images are stale
+	std::atomic<bool> m_deferredRender;
+
 	///@brief True if mouse is over a trigger arrow
 	bool m_mouseOverTriggerArrow;
 
@@ -224,6 +311,9 @@ protected:
 	///@brief True if we're displaying an eye pattern (fixed x axis scale)
 	bool m_displayingEye;
 
+	///@brief Range statistics for each waveform shown in the cursor readout
+	std::map<WaveformBase*, WaveformRangeIndex> m_rangeIndexes;
+
 public:
 
 	///@brief Type of X axis cursor we're displaying
@@ -236,6 +326,17 @@ public:
 
 	///@brief Position (in X axis units) of each cursor
 	int64_t m_xAxisCursorPositions[2];
+
+	//Colors used every frame
+	ColorPreference m_markerColor;
+	ColorPreference m_hoverColor;
+	ColorPreference m_cursor1Color;
+	ColorPreference m_cursor2Color;
+	ColorPreference m_cursorFillColor;
+	ColorPreference m_axisColor;
+	ColorPreference m_axisTextColor;
+
+	BoolPreference m_showOverview;
 };
 
 #endif
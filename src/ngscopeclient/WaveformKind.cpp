@@ -0,0 +1,115 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of GetWaveformKind
+ */
+
+#include "ngscopeclient.h"
+#include "WaveformKind.h"
+#include "../scopeprotocols/CANDecoder.h"
+
+#include <typeindex>
+#include <unordered_map>
+
+using namespace std;
+
+///@brief Kinds of every waveform type seen so far
+static unordered_map<type_index, WaveformKind> g_waveformKinds;
+
+///@brief Protects g_waveformKinds
+static shared_mutex g_waveformKindMutex;
+
+/**
+	@brief Figures out the kind of a waveform the slow way
+ */
+static WaveformKind ClassifyWaveform(const WaveformBase* wfm)
+{
+	if(dynamic_cast<const UniformAnalogWaveform*>(wfm))
+		return WAVEFORM_KIND_UNIFORM_ANALOG;
+	if(dynamic_cast<const UniformDigitalWaveform*>(wfm))
+		return WAVEFORM_KIND_UNIFORM_DIGITAL;
+	if(dynamic_cast<const SparseAnalogWaveform*>(wfm))
+		return WAVEFORM_KIND_SPARSE_ANALOG;
+	if(dynamic_cast<const SparseDigitalWaveform*>(wfm))
+		return WAVEFORM_KIND_SPARSE_DIGITAL;
+	if(dynamic_cast<const CANWaveform*>(wfm))
+		return WAVEFORM_KIND_SPARSE_CAN;
+	if(dynamic_cast<const UniformWaveformBase*>(wfm))
+		return WAVEFORM_KIND_UNIFORM_OTHER;
+	if(dynamic_cast<const SparseWaveformBase*>(wfm))
+		return WAVEFORM_KIND_SPARSE_OTHER;
+	return WAVEFORM_KIND_OTHER;
+}
+
+/**
+	@brief Gets the kind of a waveform
+
+	The first waveform of each C++ type is classified with dynamic_cast, and the result is cached by type. After that
+	a lookup costs one typeid() and, unless it's the same type this thread looked up last, one hash table probe.
+
+	Safe to call from any thread.
+ */
+WaveformKind GetWaveformKind(const WaveformBase* wfm)
+{
+	if(!wfm)
+		return WAVEFORM_KIND_NONE;
+
+	//Callers tend to look at many waveforms of the same type in a row, so check that first
+	const type_info* type = &typeid(*wfm);
+	thread_local const type_info* lastType = nullptr;
+	thread_local WaveformKind lastKind = WAVEFORM_KIND_NONE;
+	if(type == lastType)
+		return lastKind;
+
+	WaveformKind kind = WAVEFORM_KIND_OTHER;
+	bool found = false;
+	{
+		shared_lock<shared_mutex> lock(g_waveformKindMutex);
+		auto it = g_waveformKinds.find(type_index(*type));
+		if(it != g_waveformKinds.end())
+		{
+			kind = it->second;
+			found = true;
+		}
+	}
+
+	if(!found)
+	{
+		kind = ClassifyWaveform(wfm);
+		lock_guard<shared_mutex> lock(g_waveformKindMutex);
+		g_waveformKinds[type_index(*type)] = kind;
+	}
+
+	lastType = type;
+	lastKind = kind;
+	return kind;
+}
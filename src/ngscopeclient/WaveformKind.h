@@ -0,0 +1,191 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformKind and the waveform type dispatch helpers
+ */
+#ifndef WaveformKind_h
+#define WaveformKind_h
+
+/**
+	@brief The concrete sample layout of a waveform, as far as the hot paths in ngscopeclient care
+
+	Rasterization, loading, saving, and statistics each need to know which of a handful of types a waveform is before
+	they can touch its samples. Looking that up with a chain of dynamic_casts costs one failed RTTI walk per candidate
+	type, per waveform, per frame; GetWaveformKind() does the walk once per C++ type and caches the answer.
+ */
+enum WaveformKind
+{
+	///@brief Null waveform
+	WAVEFORM_KIND_NONE,
+
+	WAVEFORM_KIND_UNIFORM_ANALOG,
+	WAVEFORM_KIND_UNIFORM_DIGITAL,
+	WAVEFORM_KIND_SPARSE_ANALOG,
+	WAVEFORM_KIND_SPARSE_DIGITAL,
+	WAVEFORM_KIND_SPARSE_CAN,
+
+	///@brief Uniform waveform of some other sample type (protocol decodes etc)
+	WAVEFORM_KIND_UNIFORM_OTHER,
+
+	///@brief Sparse waveform of some other sample type (protocol decodes etc)
+	WAVEFORM_KIND_SPARSE_OTHER,
+
+	///@brief Neither uniform nor sparse (eye patterns, spectrograms, etc)
+	WAVEFORM_KIND_OTHER
+};
+
+WaveformKind GetWaveformKind(const WaveformBase* wfm);
+
+///@brief Returns true if waveforms of this kind are a UniformWaveformBase
+inline bool IsUniformKind(WaveformKind kind)
+{
+	return
+		(kind == WAVEFORM_KIND_UNIFORM_ANALOG) ||
+		(kind == WAVEFORM_KIND_UNIFORM_DIGITAL) ||
+		(kind == WAVEFORM_KIND_UNIFORM_OTHER);
+}
+
+///@brief Returns true if waveforms of this kind are a SparseWaveformBase
+inline bool IsSparseKind(WaveformKind kind)
+{
+	return
+		(kind == WAVEFORM_KIND_SPARSE_ANALOG) ||
+		(kind == WAVEFORM_KIND_SPARSE_DIGITAL) ||
+		(kind == WAVEFORM_KIND_SPARSE_CAN) ||
+		(kind == WAVEFORM_KIND_SPARSE_OTHER);
+}
+
+///@brief Returns true if waveforms of this kind have float samples
+inline bool IsAnalogKind(WaveformKind kind)
+{ return (kind == WAVEFORM_KIND_UNIFORM_ANALOG) || (kind == WAVEFORM_KIND_SPARSE_ANALOG); }
+
+///@brief Returns true if waveforms of this kind have bool samples
+inline bool IsDigitalKind(WaveformKind kind)
+{ return (kind == WAVEFORM_KIND_UNIFORM_DIGITAL) || (kind == WAVEFORM_KIND_SPARSE_DIGITAL); }
+
+/**
+	@brief Casts a waveform to UniformWaveformBase if it is one, without RTTI
+ */
+inline UniformWaveformBase* GetUniformBase(WaveformBase* wfm, WaveformKind kind)
+{
+	switch(kind)
+	{
+		case WAVEFORM_KIND_UNIFORM_ANALOG:
+			return static_cast<UniformAnalogWaveform*>(wfm);
+		case WAVEFORM_KIND_UNIFORM_DIGITAL:
+			return static_cast<UniformDigitalWaveform*>(wfm);
+
+		//Other sample types can't be static_cast without knowing the type, but this is off the hot path
+		case WAVEFORM_KIND_UNIFORM_OTHER:
+			return dynamic_cast<UniformWaveformBase*>(wfm);
+
+		default:
+			return nullptr;
+	}
+}
+
+/**
+	@brief Casts a waveform to SparseWaveformBase if it is one, without RTTI
+ */
+inline SparseWaveformBase* GetSparseBase(WaveformBase* wfm, WaveformKind kind)
+{
+	switch(kind)
+	{
+		case WAVEFORM_KIND_SPARSE_ANALOG:
+			return static_cast<SparseAnalogWaveform*>(wfm);
+		case WAVEFORM_KIND_SPARSE_DIGITAL:
+			return static_cast<SparseDigitalWaveform*>(wfm);
+
+		case WAVEFORM_KIND_SPARSE_CAN:
+		case WAVEFORM_KIND_SPARSE_OTHER:
+			return dynamic_cast<SparseWaveformBase*>(wfm);
+
+		default:
+			return nullptr;
+	}
+}
+
+/**
+	@brief Calls a functor with a waveform cast to its concrete analog or digital type
+
+	This is how a caller picks a sample-type-specialized kernel once per waveform: pass a generic lambda, and it's
+	instantiated once for each of UniformAnalogWaveform, UniformDigitalWaveform, SparseAnalogWaveform, and
+	SparseDigitalWaveform.
+
+	@return False (without calling f) if the waveform is null or of some other type
+ */
+template<class F>
+bool DispatchWaveform(WaveformBase* wfm, F&& f)
+{
+	switch(GetWaveformKind(wfm))
+	{
+		case WAVEFORM_KIND_UNIFORM_ANALOG:
+			f(static_cast<UniformAnalogWaveform*>(wfm));
+			return true;
+		case WAVEFORM_KIND_UNIFORM_DIGITAL:
+			f(static_cast<UniformDigitalWaveform*>(wfm));
+			return true;
+		case WAVEFORM_KIND_SPARSE_ANALOG:
+			f(static_cast<SparseAnalogWaveform*>(wfm));
+			return true;
+		case WAVEFORM_KIND_SPARSE_DIGITAL:
+			f(static_cast<SparseDigitalWaveform*>(wfm));
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+/**
+	@brief Calls a functor with a waveform cast to UniformAnalogWaveform or SparseAnalogWaveform
+
+	@return False (without calling f) if the waveform is not analog
+ */
+template<class F>
+bool DispatchAnalogWaveform(WaveformBase* wfm, F&& f)
+{
+	switch(GetWaveformKind(wfm))
+	{
+		case WAVEFORM_KIND_UNIFORM_ANALOG:
+			f(static_cast<UniformAnalogWaveform*>(wfm));
+			return true;
+		case WAVEFORM_KIND_SPARSE_ANALOG:
+			f(static_cast<SparseAnalogWaveform*>(wfm));
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+#endif
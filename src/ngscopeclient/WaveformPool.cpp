@@ -0,0 +1,260 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformPool
+ */
+#include "ngscopeclient.h"
+#include "WaveformPool.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformPool::WaveformPool()
+	: m_memoryUsage(0)
+	, m_maxSize(0)
+	, m_hits(0)
+	, m_misses(0)
+	, m_drops(0)
+{
+}
+
+WaveformPool::~WaveformPool()
+{
+	Clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Pool management
+
+/**
+	@brief Gets the size bucket a waveform of a given number of samples goes in
+
+	Bucket N holds waveforms of 2^(N-1) to 2^N - 1 samples, with empty waveforms in bucket 0.
+ */
+size_t WaveformPool::GetBucket(size_t size)
+{
+	size_t bucket = 0;
+	while(size)
+	{
+		bucket ++;
+		size >>= 1;
+	}
+	return bucket;
+}
+
+/**
+	@brief Gets the approximate number of bytes of sample data in a waveform
+ */
+size_t WaveformPool::GetWaveformMemoryUsage(WaveformBase* wfm)
+{
+	size_t bytes = 0;
+	size_t len = wfm->size();
+	if(dynamic_cast<SparseWaveformBase*>(wfm) != nullptr)
+		bytes += len * 2 * sizeof(int64_t);
+
+	if( (dynamic_cast<UniformAnalogWaveform*>(wfm) != nullptr) ||
+		(dynamic_cast<SparseAnalogWaveform*>(wfm) != nullptr) )
+	{
+		bytes += len * sizeof(float);
+	}
+	else if( (dynamic_cast<UniformDigitalWaveform*>(wfm) != nullptr) ||
+		(dynamic_cast<SparseDigitalWaveform*>(wfm) != nullptr) )
+	{
+		bytes += len * sizeof(bool);
+	}
+	return bytes;
+}
+
+/**
+	@brief Adds a waveform which is no longer in use to the pool
+
+	The pool takes ownership of the waveform. It's deleted right away if the pool is full.
+ */
+void WaveformPool::Add(WaveformBase* wfm)
+{
+	if(!wfm)
+		return;
+
+	size_t bytes = GetWaveformMemoryUsage(wfm);
+	if(m_memoryUsage + bytes > m_maxSize)
+	{
+		m_drops ++;
+		delete wfm;
+		return;
+	}
+
+	lock_guard<mutex> lock(m_mutex);
+	m_free[PoolKey(typeid(*wfm), GetBucket(wfm->size()))].push_back(wfm);
+	m_memoryUsage += bytes;
+}
+
+/**
+	@brief Removes a waveform of the specified type, with room for at least the specified number of samples, from
+	the pool
+
+	@return The waveform, or nullptr if there isn't one
+ */
+WaveformBase* WaveformPool::Take(type_index type, size_t size)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	//Look in our own bucket first (not everything in it is big enough), then the next one up (which all is).
+	//Don't go any bigger than that, or small requests would tie up much larger buffers.
+	size_t bucket = GetBucket(size);
+	for(size_t b = bucket; b <= bucket+1; b++)
+	{
+		auto it = m_free.find(PoolKey(type, b));
+		if(it == m_free.end())
+			continue;
+
+		auto& wfms = it->second;
+		for(size_t i=0; i<wfms.size(); i++)
+		{
+			auto wfm = wfms[i];
+			if(wfm->size() < size)
+				continue;
+
+			wfms[i] = wfms.back();
+			wfms.pop_back();
+			m_memoryUsage -= GetWaveformMemoryUsage(wfm);
+			m_hits ++;
+			return wfm;
+		}
+	}
+
+	m_misses ++;
+	return nullptr;
+}
+
+/**
+	@brief Gets a pooled waveform of the same type as an existing one
+
+	Unlike Get(), this doesn't allocate anything on a miss since the pool has no way to create a waveform of an
+	arbitrary type.
+
+	@param wfm		The waveform whose type we want
+	@param size		Number of samples the caller is going to put in the waveform
+
+	@return The waveform, or nullptr if nothing suitable is in the pool
+ */
+WaveformBase* WaveformPool::GetLike(WaveformBase* wfm, size_t size)
+{
+	return Take(typeid(*wfm), size);
+}
+
+/**
+	@brief Sets the maximum amount of sample data the pool may hold, in bytes
+
+	Waveforms added to a full pool are deleted. If the pool is already over the new limit, it's emptied.
+ */
+void WaveformPool::SetMaxSize(size_t bytes)
+{
+	m_maxSize = bytes;
+	if(m_memoryUsage > bytes)
+		Clear();
+}
+
+/**
+	@brief Gets the number of waveforms currently in the pool
+ */
+size_t WaveformPool::GetWaveformCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	size_t count = 0;
+	for(auto& it : m_free)
+		count += it.second.size();
+	return count;
+}
+
+/**
+	@brief Deletes waveforms from the pool, largest first, until at least the requested amount has been freed
+
+	@return Number of bytes freed
+ */
+size_t WaveformPool::Free(size_t bytes)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	//Walk buckets from largest to smallest, regardless of type
+	vector<PoolKey> keys;
+	for(auto& it : m_free)
+		keys.push_back(it.first);
+	sort(keys.begin(), keys.end(),
+		[](const PoolKey& a, const PoolKey& b) { return a.second > b.second; });
+
+	size_t freed = 0;
+	for(auto& key : keys)
+	{
+		auto& wfms = m_free[key];
+		while(!wfms.empty() && (freed < bytes) )
+		{
+			auto wfm = wfms.back();
+			wfms.pop_back();
+
+			size_t size = GetWaveformMemoryUsage(wfm);
+			freed += size;
+			m_memoryUsage -= size;
+			delete wfm;
+		}
+
+		if(freed >= bytes)
+			break;
+	}
+
+	return freed;
+}
+
+/**
+	@brief Deletes everything in the pool
+
+	@return True if anything was freed
+ */
+bool WaveformPool::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	bool freed = false;
+	for(auto& it : m_free)
+	{
+		for(auto wfm : it.second)
+		{
+			delete wfm;
+			freed = true;
+		}
+	}
+	m_free.clear();
+	m_memoryUsage = 0;
+	return freed;
+}
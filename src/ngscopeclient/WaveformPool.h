@@ -0,0 +1,130 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformPool
+ */
+#ifndef WaveformPool_h
+#define WaveformPool_h
+
+#include <typeindex>
+
+/**
+	@brief Pool of waveforms which are no longer in use, organized by type and size, so they can be reused rather
+	than freed and reallocated
+
+	The instrument drivers keep their own pools of UniformAnalogWaveform and SparseDigitalWaveform, which history
+	points return those types to when they're deleted. Everything else (other waveform types, filter outputs, data
+	from lazily loaded points) comes here instead.
+
+	Waveforms are bucketed by powers of two of their size, and are handed out with their old contents intact. Callers
+	are expected to resize and overwrite them.
+ */
+class WaveformPool
+{
+public:
+	WaveformPool();
+	~WaveformPool();
+
+	void Add(WaveformBase* wfm);
+
+	/**
+		@brief Gets a waveform of the specified type, reusing a pooled one if possible
+
+		@param size		Number of samples the caller is going to put in the waveform
+	 */
+	template<class T>
+	T* Get(size_t size)
+	{
+		auto wfm = Take(typeid(T), size);
+		if(wfm)
+			return static_cast<T*>(wfm);
+		return new T;
+	}
+
+	WaveformBase* GetLike(WaveformBase* wfm, size_t size);
+
+	bool Clear();
+	size_t Free(size_t bytes);
+
+	void SetMaxSize(size_t bytes);
+
+	///@brief Gets the number of requests which were served from the pool
+	uint64_t GetHitCount()
+	{ return m_hits; }
+
+	///@brief Gets the number of requests which had to allocate a new waveform
+	uint64_t GetMissCount()
+	{ return m_misses; }
+
+	///@brief Gets the number of waveforms which were deleted rather than pooled because the pool was full
+	uint64_t GetDropCount()
+	{ return m_drops; }
+
+	///@brief Gets the amount of sample data currently in the pool, in bytes
+	size_t GetMemoryUsage()
+	{ return m_memoryUsage; }
+
+	size_t GetWaveformCount();
+
+	static size_t GetWaveformMemoryUsage(WaveformBase* wfm);
+
+protected:
+	WaveformBase* Take(std::type_index type, size_t size);
+
+	static size_t GetBucket(size_t size);
+
+	///@brief Key for a set of waveforms which are interchangeable
+	typedef std::pair<std::type_index, size_t> PoolKey;
+
+	///@brief Mutex protecting the pool, since waveforms are added and taken from several threads
+	std::mutex m_mutex;
+
+	///@brief Waveforms in the pool, by type and size bucket
+	std::map<PoolKey, std::vector<WaveformBase*> > m_free;
+
+	///@brief Total of GetWaveformMemoryUsage() across all waveforms in m_free
+	std::atomic<size_t> m_memoryUsage;
+
+	///@brief Maximum value of m_memoryUsage
+	std::atomic<size_t> m_maxSize;
+
+	///@brief Number of requests served from the pool
+	std::atomic<uint64_t> m_hits;
+
+	///@brief Number of requests which found nothing suitable in the pool
+	std::atomic<uint64_t> m_misses;
+
+	///@brief Number of waveforms deleted because the pool was full
+	std::atomic<uint64_t> m_drops;
+};
+
+#endif
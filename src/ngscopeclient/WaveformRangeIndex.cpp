@@ -0,0 +1,272 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformRangeIndex
+ */
+#include "ngscopeclient.h"
+#include "WaveformRangeIndex.h"
+#include "WaveformKind.h"
+
+using namespace std;
+
+///@brief How sample values are converted to linear power
+enum PowerMode
+{
+	POWER_PLAIN,
+	POWER_DBM,
+	POWER_IRRADIANCE
+};
+
+///@brief Width of a uniform sample, in X axis units
+static int64_t GetScaledDuration(UniformAnalogWaveform* wfm, size_t /*i*/)
+{ return wfm->m_timescale; }
+
+///@brief Width of a sparse sample, in X axis units
+static int64_t GetScaledDuration(SparseAnalogWaveform* wfm, size_t i)
+{ return wfm->m_durations.GetCpuPointer()[i] * wfm->m_timescale; }
+
+/**
+	@brief Calculates the per-sample terms of the running sums
+
+	Instantiated for each waveform type and power conversion, so the loop body doesn't have to check either.
+ */
+template<class W, PowerMode mode>
+static void IndexSamples(W* wfm, size_t len, double* sum, double* squares, double* power)
+{
+	const float* samples = wfm->m_samples.GetCpuPointer();
+
+	#pragma omp parallel for
+	for(size_t i=0; i<len; i++)
+	{
+		double f = samples[i];
+		sum[i] = f;
+		squares[i] = f*f;
+		if constexpr(mode == POWER_DBM)
+			power[i] = pow(10, (f - 30) / 10);	//assume
+		else if constexpr(mode == POWER_IRRADIANCE)
+			power[i] = f * GetScaledDuration(wfm, i) * 1e-3;	//scale by pm to nm
+		else
+			power[i] = f;
+	}
+}
+
+/**
+	@brief Fills the leaves of the min/max segment trees
+ */
+template<class W>
+static void FillMinMaxLeaves(W* wfm, size_t len, float* minLeaves, float* maxLeaves)
+{
+	const float* samples = wfm->m_samples.GetCpuPointer();
+	memcpy(minLeaves, samples, len * sizeof(float));
+	memcpy(maxLeaves, samples, len * sizeof(float));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformRangeIndex::WaveformRangeIndex()
+	: m_used(false)
+	, m_waveform(nullptr)
+	, m_revision(0)
+	, m_unit(Unit::UNIT_COUNTS)
+	, m_size(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Index building
+
+/**
+	@brief Checks if the index is up to date for a waveform
+ */
+bool WaveformRangeIndex::IsCurrent(WaveformBase* wfm, Unit yunit)
+{
+	return
+		(m_waveform == wfm) &&
+		(wfm != nullptr) &&
+		(m_revision == wfm->m_revision) &&
+		(m_size == wfm->size()) &&
+		(m_unit == yunit);
+}
+
+/**
+	@brief Indexes a waveform
+
+	@param wfm		The waveform to index (must be sparse or uniform analog)
+	@param yunit	Y axis unit of the waveform, used to decide how to convert samples to linear power
+
+	@return False if the waveform isn't analog or is empty
+ */
+bool WaveformRangeIndex::Build(WaveformBase* wfm, Unit yunit)
+{
+	m_waveform = nullptr;
+	m_size = 0;
+	m_minTree.clear();
+	m_maxTree.clear();
+
+	if(!IsAnalogKind(GetWaveformKind(wfm)))
+		return false;
+	size_t len = wfm->size();
+	if(!len)
+		return false;
+
+	wfm->PrepareForCpuAccess();
+
+	//Note that if it's in dBm we have to go to linear units
+	PowerMode mode = POWER_PLAIN;
+	if(yunit == Unit::UNIT_DBM)
+		mode = POWER_DBM;
+	else if(yunit == Unit::UNIT_W_M2_NM)
+		mode = POWER_IRRADIANCE;
+
+	//Calculate per-sample terms in parallel, then do the running sums
+	m_sum.resize(len + 1);
+	m_sumSquares.resize(len + 1);
+	m_power.resize(len + 1);
+	m_sum[0] = 0;
+	m_sumSquares[0] = 0;
+	m_power[0] = 0;
+	double* sum = &m_sum[1];
+	double* squares = &m_sumSquares[1];
+	double* power = &m_power[1];
+	DispatchAnalogWaveform(wfm, [&](auto typed)
+	{
+		typedef typename remove_pointer<decltype(typed)>::type W;
+		switch(mode)
+		{
+			case POWER_DBM:
+				IndexSamples<W, POWER_DBM>(typed, len, sum, squares, power);
+				break;
+
+			case POWER_IRRADIANCE:
+				IndexSamples<W, POWER_IRRADIANCE>(typed, len, sum, squares, power);
+				break;
+
+			default:
+				IndexSamples<W, POWER_PLAIN>(typed, len, sum, squares, power);
+				break;
+		}
+	});
+	for(size_t i=1; i<len; i++)
+	{
+		sum[i] += sum[i-1];
+		squares[i] += squares[i-1];
+		power[i] += power[i-1];
+	}
+
+	m_waveform = wfm;
+	m_revision = wfm->m_revision;
+	m_unit = yunit;
+	m_size = len;
+	return true;
+}
+
+/**
+	@brief Builds the min/max segment trees from the indexed waveform
+ */
+void WaveformRangeIndex::BuildMinMax()
+{
+	m_minTree.resize(2*m_size);
+	m_maxTree.resize(2*m_size);
+	DispatchAnalogWaveform(m_waveform, [&](auto typed)
+		{ FillMinMaxLeaves(typed, m_size, &m_minTree[m_size], &m_maxTree[m_size]); });
+	for(size_t i=m_size-1; i>0; i--)
+	{
+		m_minTree[i] = min(m_minTree[2*i], m_minTree[2*i + 1]);
+		m_maxTree[i] = max(m_maxTree[2*i], m_maxTree[2*i + 1]);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queries
+
+/**
+	@brief Finds the range of samples between two X axis positions
+
+	Positions off either end of the waveform are clamped to the first or last sample.
+
+	@return False if there are no samples in the range
+ */
+bool WaveformRangeIndex::GetRange(int64_t t1, int64_t t2, size_t& first, size_t& last)
+{
+	if(!m_size)
+		return false;
+
+	bool err1;
+	bool err2;
+	first = GetIndexNearestAtOrBeforeTimestamp(m_waveform, t1, err1);
+	last = GetIndexNearestAtOrBeforeTimestamp(m_waveform, t2, err2);
+	if(err1)
+		first = 0;
+	if(err2)
+		last = m_size - 1;
+
+	return (first <= last) && (last < m_size);
+}
+
+/**
+	@brief Gets the smallest sample value from first to last, inclusive
+ */
+float WaveformRangeIndex::GetMin(size_t first, size_t last)
+{
+	if(m_minTree.empty())
+		BuildMinMax();
+
+	float ret = FLT_MAX;
+	for(size_t l = first + m_size, r = last + m_size + 1; l < r; l /= 2, r /= 2)
+	{
+		if(l & 1)
+			ret = min(ret, m_minTree[l++]);
+		if(r & 1)
+			ret = min(ret, m_minTree[--r]);
+	}
+	return ret;
+}
+
+/**
+	@brief Gets the largest sample value from first to last, inclusive
+ */
+float WaveformRangeIndex::GetMax(size_t first, size_t last)
+{
+	if(m_maxTree.empty())
+		BuildMinMax();
+
+	float ret = -FLT_MAX;
+	for(size_t l = first + m_size, r = last + m_size + 1; l < r; l /= 2, r /= 2)
+	{
+		if(l & 1)
+			ret = max(ret, m_maxTree[l++]);
+		if(r & 1)
+			ret = max(ret, m_maxTree[--r]);
+	}
+	return ret;
+}
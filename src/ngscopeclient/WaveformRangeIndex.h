@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* glscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformRangeIndex
+ */
+#ifndef WaveformRangeIndex_h
+#define WaveformRangeIndex_h
+
+/**
+	@brief Auxiliary index over an analog waveform for fast statistics on any range of samples
+
+	Holds running sums of the sample values, their squares, and their linear power, so the sum, mean, RMS, and
+	in-band power of any range take O(1). Minimum and maximum use a segment tree (O(log n) per query), which is only
+	built the first time it's needed since it's bigger than the sums.
+
+	The index is tied to one revision of one waveform. Call IsCurrent() before each use and Build() again if the
+	waveform has changed.
+ */
+class WaveformRangeIndex
+{
+public:
+	WaveformRangeIndex();
+
+	bool IsCurrent(WaveformBase* wfm, Unit yunit);
+	bool Build(WaveformBase* wfm, Unit yunit);
+
+	bool GetRange(int64_t t1, int64_t t2, size_t& first, size_t& last);
+
+	///@brief Gets the number of samples indexed
+	size_t size()
+	{ return m_size; }
+
+	/**
+		@brief Gets the sum of sample values first to last, inclusive
+	 */
+	double GetSum(size_t first, size_t last)
+	{ return m_sum[last+1] - m_sum[first]; }
+
+	/**
+		@brief Gets the mean of sample values first to last, inclusive
+	 */
+	double GetMean(size_t first, size_t last)
+	{ return GetSum(first, last) / (last - first + 1); }
+
+	/**
+		@brief Gets the RMS of sample values first to last, inclusive
+	 */
+	double GetRMS(size_t first, size_t last)
+	{ return sqrt(std::max(0.0, (m_sumSquares[last+1] - m_sumSquares[first]) / (last - first + 1))); }
+
+	/**
+		@brief Gets the total linear power of samples first to last, inclusive
+
+		This is in mW for dBm waveforms, W/m² for W/m²/nm waveforms, and the plain sum of values otherwise.
+	 */
+	double GetLinearPower(size_t first, size_t last)
+	{ return m_power[last+1] - m_power[first]; }
+
+	float GetMin(size_t first, size_t last);
+	float GetMax(size_t first, size_t last);
+
+	///@brief Set by the owner when the index is used, so stale ones can be cleaned up
+	bool m_used;
+
+protected:
+	void BuildMinMax();
+
+	///@brief The waveform we indexed
+	WaveformBase* m_waveform;
+
+	///@brief Revision of m_waveform we indexed
+	uint64_t m_revision;
+
+	///@brief Y axis unit of m_waveform we indexed
+	Unit m_unit;
+
+	///@brief Number of samples indexed
+	size_t m_size;
+
+	///@brief m_sum[i] is the sum of samples 0 to i-1
+	std::vector<double> m_sum;
+
+	///@brief m_sumSquares[i] is the sum of squares of samples 0 to i-1
+	std::vector<double> m_sumSquares;
+
+	///@brief m_power[i] is the total linear power of samples 0 to i-1
+	std::vector<double> m_power;
+
+	///@brief Bottom-up segment tree of minimums (leaves at m_size ... 2*m_size-1), empty until first needed
+	std::vector<float> m_minTree;
+
+	///@brief Bottom-up segment tree of maximums, same layout as m_minTree
+	std::vector<float> m_maxTree;
+};
+
+#endif
@@ -0,0 +1,260 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformRecorder
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "WaveformRecorder.h"
+
+using namespace std;
+
+///@brief Minimum time between updates of the metadata files while recording, in seconds
+#define RECORDER_METADATA_INTERVAL 10
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts recording to a data directory
+
+	@param session			The session to record
+	@param dataDir			Path to the data directory, which must already exist and be empty
+	@param queueLimit		Maximum amount of sample data to queue for writing, in bytes
+	@param dropOnOverflow	True to drop new points if the queue is full, false to stall acquisition until there's room
+ */
+WaveformRecorder::WaveformRecorder(Session* session, const string& dataDir, size_t queueLimit, bool dropOnOverflow)
+	: m_session(session)
+	, m_dataDir(dataDir)
+	, m_queueLimit(queueLimit)
+	, m_dropOnOverflow(dropOnOverflow)
+	, m_nextId(0)
+	, m_lastMetadataWrite(GetTime())
+	, m_queuedBytes(0)
+	, m_writtenBytes(0)
+	, m_written(0)
+	, m_dropped(0)
+	, m_shuttingDown(false)
+{
+	//Every scope gets a metadata file, even if nothing is ever recorded, so the session can be loaded
+	for(auto& scope : session->GetScopes())
+	{
+		string yamlPath = dataDir + "/scope_" + to_string(session->m_idtable[(Instrument*)scope.get()]) + "_metadata.yml";
+		m_metadata[yamlPath];
+	}
+	WriteMetadata();
+
+	m_thread = make_unique<thread>(&WaveformRecorder::ThreadProc, this);
+}
+
+WaveformRecorder::~WaveformRecorder()
+{
+	Stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GUI thread interface
+
+/**
+	@brief Queues a newly acquired history point to be written
+
+	Must be called from the GUI thread with the waveform data mutex held.
+
+	@return False if the point was dropped because the queue is full
+ */
+bool WaveformRecorder::Record(shared_ptr<HistoryPoint> pt)
+{
+	if(!m_thread)
+		return false;
+
+	RecordedPoint rec;
+
+	//Generate the metadata and figure out what files we're going to write
+	map<shared_ptr<Oscilloscope>, YAML::Node> metadataNodes;
+	SavedHistoryPoint saved;
+	m_session->PrepareHistoryPointSave(pt.get(), m_dataDir, m_nextId, rec.m_jobs, metadataNodes, saved);
+	for(auto& job : rec.m_jobs)
+		rec.m_bytes += job.m_bytes;
+
+	//Check for room before doing anything expensive
+	if(m_dropOnOverflow && (m_queuedBytes + rec.m_bytes > m_queueLimit) && (m_queuedBytes > 0) )
+	{
+		m_dropped ++;
+		for(auto& dir : saved.m_dirs)
+			::RemoveDirectory(dir);
+		return false;
+	}
+	m_nextId ++;
+
+	for(auto& it : saved.m_metadata)
+	{
+		string yamlPath = m_dataDir + "/scope_" +
+			to_string(m_session->m_idtable[(Instrument*)it.first.get()]) + "_metadata.yml";
+		rec.m_metadata[yamlPath] = it.second;
+	}
+
+	//Move everything to the CPU now, since buffer transfers use the GPU queues which belong to this thread
+	for(auto& job : rec.m_jobs)
+		job.m_wfm->PrepareForCpuAccess();
+
+	//Hold onto the point until it's written, so it isn't evicted or moved between memory tiers
+	pt->m_readerRefs ++;
+	rec.m_point = pt;
+
+	m_queuedBytes += rec.m_bytes;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_queue.push_back(std::move(rec));
+	}
+	m_wakeEvent.Signal();
+
+	return true;
+}
+
+/**
+	@brief Returns true if the queue is full and the session should stop accepting new waveforms until it drains
+
+	Always false if we're dropping points on overflow instead.
+ */
+bool WaveformRecorder::IsBackedUp()
+{
+	return !m_dropOnOverflow && (m_queuedBytes >= m_queueLimit);
+}
+
+/**
+	@brief Lets go of any history points which have been written
+
+	Must be called from the GUI thread, since this may be the last reference to a point that's since been removed
+	from history.
+ */
+void WaveformRecorder::Poll()
+{
+	vector<shared_ptr<HistoryPoint>> done;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		done.swap(m_done);
+	}
+
+	for(auto& pt : done)
+		pt->ReleaseReader();
+}
+
+/**
+	@brief Finishes writing everything in the queue and stops recording
+
+	Must be called from the GUI thread.
+ */
+void WaveformRecorder::Stop()
+{
+	if(!m_thread)
+		return;
+
+	m_shuttingDown = true;
+	m_wakeEvent.Signal();
+	m_thread->join();
+	m_thread = nullptr;
+
+	Poll();
+
+	LogNotice("Recording to %s stopped: %zu waveforms written (%s), %zu dropped\n",
+		m_dataDir.c_str(),
+		m_written.load(),
+		Unit(Unit::UNIT_BYTES).PrettyPrint(m_writtenBytes.load(), 4).c_str(),
+		m_dropped.load());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Writer thread
+
+/**
+	@brief Thread function writing queued points to disk in order
+ */
+void WaveformRecorder::ThreadProc()
+{
+	pthread_setname_np_compat("Recorder");
+
+	while(true)
+	{
+		m_wakeEvent.Block();
+
+		//Drain the queue before shutting down, so nothing acquired while recording is lost
+		while(true)
+		{
+			RecordedPoint rec;
+			{
+				lock_guard<mutex> lock(m_mutex);
+				if(m_queue.empty())
+					break;
+				rec = std::move(m_queue.front());
+				m_queue.pop_front();
+			}
+
+			m_session->WriteWaveformFiles(rec.m_jobs);
+			for(auto& it : rec.m_metadata)
+				m_metadata[it.first].push_back(it.second);
+
+			m_writtenBytes += rec.m_bytes;
+			m_queuedBytes -= rec.m_bytes;
+			m_written ++;
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_done.push_back(std::move(rec.m_point));
+			}
+
+			//Keep the metadata reasonably fresh, so a crash mid-recording doesn't lose everything
+			if(GetTime() - m_lastMetadataWrite > RECORDER_METADATA_INTERVAL)
+				WriteMetadata();
+
+			//Let the GUI thread release the point, and take new waveforms if it was waiting for room
+			WakeEventLoop();
+		}
+
+		if(m_shuttingDown)
+			break;
+	}
+
+	WriteMetadata();
+}
+
+/**
+	@brief Writes the metadata files for everything recorded so far
+ */
+void WaveformRecorder::WriteMetadata()
+{
+	m_lastMetadataWrite = GetTime();
+
+	for(auto& it : m_metadata)
+	{
+		if(!Session::WriteWaveformMetadata(it.first, it.second))
+			LogError("Failed to write recording metadata %s\n", it.first.c_str());
+	}
+}
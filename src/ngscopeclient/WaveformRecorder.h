@@ -0,0 +1,166 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformRecorder
+ */
+#ifndef WaveformRecorder_h
+#define WaveformRecorder_h
+
+#include "Event.h"
+#include "Session.h"
+
+/**
+	@brief A history point waiting to be written by a WaveformRecorder
+ */
+class RecordedPoint
+{
+public:
+	RecordedPoint()
+	: m_bytes(0)
+	{}
+
+	///@brief The point being written, held so its sample data stays put until we're done
+	std::shared_ptr<HistoryPoint> m_point;
+
+	///@brief Sample data files to write
+	std::vector<WaveformSaveJob> m_jobs;
+
+	///@brief Metadata for the point, by path of each scope's metadata file
+	std::map<std::string, SavedWaveformMetadata> m_metadata;
+
+	///@brief Total size of the sample data files
+	size_t m_bytes;
+};
+
+/**
+	@brief Streams every new acquisition to a session data directory on disk as it arrives
+
+	The GUI thread hands each history point over as it's committed, and a background thread writes them out in order,
+	so a long capture is bounded only by disk space rather than the history depth. Everything is written in the normal
+	session format, so the recording can be opened like any other session once it's stopped.
+
+	If the disk can't keep up, the queue of points waiting to be written is limited in size. Depending on the
+	overflow policy, either the session stops accepting new waveforms until there's room (stalling acquisition) or
+	new points are dropped and counted.
+ */
+class WaveformRecorder
+{
+public:
+	WaveformRecorder(Session* session, const std::string& dataDir, size_t queueLimit, bool dropOnOverflow);
+	virtual ~WaveformRecorder();
+
+	WaveformRecorder(const WaveformRecorder&) =delete;
+	WaveformRecorder& operator=(const WaveformRecorder&) =delete;
+
+	bool Record(std::shared_ptr<HistoryPoint> pt);
+	void Poll();
+	void Stop();
+
+	bool IsBackedUp();
+
+	///@brief Returns the data directory we're recording to
+	const std::string& GetDataDir()
+	{ return m_dataDir; }
+
+	///@brief Returns the number of history points written to disk so far
+	size_t GetWrittenCount()
+	{ return m_written; }
+
+	///@brief Returns the number of history points dropped because the disk couldn't keep up
+	size_t GetDroppedCount()
+	{ return m_dropped; }
+
+	///@brief Returns the amount of sample data written to disk so far
+	size_t GetWrittenBytes()
+	{ return m_writtenBytes; }
+
+	///@brief Returns the amount of sample data waiting to be written
+	size_t GetQueuedBytes()
+	{ return m_queuedBytes; }
+
+protected:
+	void ThreadProc();
+	void WriteMetadata();
+
+	///@brief The session we're recording
+	Session* m_session;
+
+	///@brief Path to the data directory we're writing to
+	std::string m_dataDir;
+
+	///@brief Maximum amount of sample data to queue for writing, in bytes
+	size_t m_queueLimit;
+
+	///@brief True to drop new points if the queue is full, false to stall acquisition
+	bool m_dropOnOverflow;
+
+	///@brief Waveform ID to give the next point recorded
+	int m_nextId;
+
+	///@brief Mutex controlling access to m_queue and m_done
+	std::mutex m_mutex;
+
+	///@brief Points waiting to be written, oldest first
+	std::deque<RecordedPoint> m_queue;
+
+	///@brief Points which have been written, waiting for the GUI thread to let go of them
+	std::vector<std::shared_ptr<HistoryPoint>> m_done;
+
+	///@brief Metadata for everything written so far, by path of each scope's metadata file (writer thread only)
+	std::map<std::string, std::vector<SavedWaveformMetadata>> m_metadata;
+
+	///@brief Time the metadata files were last updated (writer thread only)
+	double m_lastMetadataWrite;
+
+	///@brief Amount of sample data in m_queue
+	std::atomic<size_t> m_queuedBytes;
+
+	///@brief Amount of sample data written so far
+	std::atomic<size_t> m_writtenBytes;
+
+	///@brief Number of points written so far
+	std::atomic<size_t> m_written;
+
+	///@brief Number of points dropped due to a full queue
+	std::atomic<size_t> m_dropped;
+
+	///@brief Signaled when there's something to write, or to shut down
+	Event m_wakeEvent;
+
+	///@brief Set to shut down the writer thread once the queue is empty
+	std::atomic<bool> m_shuttingDown;
+
+	///@brief Writer thread
+	std::unique_ptr<std::thread> m_thread;
+};
+
+#endif
@@ -49,21 +49,125 @@ Event g_refilterDoneEvent;
 Event g_waveformReadyEvent;
 Event g_waveformProcessedEvent;
 
+///@brief Signaled when the raw instrument channels of an acquisition have been drawn, ahead of its filter outputs
+Event g_waveformPreviewEvent;
+
+///@brief Signaled when the WaveformThread has something new to do (new waveform, refilter or rerender request)
+Event g_waveformThreadWakeEvent;
+
 ///@brief Time spent on the last cycle of waveform rendering shaders
 atomic<int64_t> g_lastWaveformRenderTime;
 
-void RenderAllWaveforms(vk::raii::CommandBuffer& cmdbuf, Session* session, shared_ptr<QueueHandle> queue);
+///@brief Time the WaveformThread last spent waiting for the GUI thread to consume an acquisition
+atomic<int64_t> g_lastWaveformPipelineStallTime;
+
+///@brief Time the WaveformThread last spent copying freshly downloaded waveforms to the GPU
+atomic<int64_t> g_lastWaveformUploadTime;
+
+///@brief Time the WaveformThread last spent running the filter graph and history policies on a new acquisition
+atomic<int64_t> g_lastWaveformProcessTime;
+
+///@brief Time the WaveformThread last spent waiting for the GPU to finish a nonblocking rasterization pass
+atomic<int64_t> g_lastWaveformRasterizeWaitTime;
+
+///@brief Total number of times a displayed channel has been rasterized
+atomic<int64_t> g_channelRasterizations;
+
+///@brief Total number of times rasterizing a displayed channel was skipped because nothing had changed
+atomic<int64_t> g_skippedChannelRasterizations;
+
+///@brief Total number of sparse index searches skipped because another channel in the group had already done them
+atomic<int64_t> g_sharedIndexSearches;
+
+///@brief Total number of times a displayed channel showed another channel's identical image rather than rasterizing
+atomic<int64_t> g_sharedChannelRasterizations;
+
+///@brief Total number of re-render passes cut short because the view changed again while they were being recorded
+atomic<int64_t> g_interruptedRerenders;
+
+///@brief Total number of requested filter graph refreshes abandoned because a newer one was requested while they ran
+atomic<int64_t> g_cancelledRefilters;
+
+bool RenderAllWaveforms(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	vector< shared_ptr<DisplayedChannel> >& channels,
+	GpuTimer* timer,
+	vk::raii::Fence* fence = nullptr,
+	bool interruptible = false,
+	bool previewOnly = false);
+
+/**
+	@brief Bookkeeping for a rasterization pass which has been submitted to the GPU but not waited on yet
+ */
+class InFlightRender
+{
+public:
+	InFlightRender()
+	: m_pending(false)
+	, m_tstart(0)
+	, m_doneEvent(nullptr)
+	, m_timed(false)
+	{}
+
+	///@brief True if a rasterization pass is still running
+	bool m_pending;
+
+	///@brief Time the rasterization was started
+	double m_tstart;
+
+	///@brief Event to signal once the rasterized waveforms have been published
+	Event* m_doneEvent;
+
+	///@brief Signaled by the GPU when the rasterization pass completes
+	unique_ptr<vk::raii::Fence> m_fence;
+
+	///@brief Displayed channels referenced by the pending command buffer
+	vector< shared_ptr<DisplayedChannel> > m_channels;
+
+	///@brief Timestamps for per-shader profiling
+	unique_ptr<GpuTimer> m_timer;
+
+	///@brief True if the pending command buffer has timestamps to read back
+	bool m_timed;
+
+	///@brief Timestamps of the acquisition being rasterized, if it's a new one
+	shared_ptr<AcquisitionLatency> m_latency;
+
+	///@brief History point of the acquisition being rasterized, if it's a new one
+	shared_ptr<HistoryPoint> m_point;
+};
+
+bool StartPendingRender(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	InFlightRender& render,
+	Event* doneEvent,
+	bool interruptible = false,
+	bool previewOnly = false);
+void FinishPendingRender(Session* session, InFlightRender& render, atomic<bool>* shuttingDown);
+void WaitForPipelineSlot(Session* session, size_t depth, atomic<bool>* shuttingDown);
+void PublishRasterizedWaveforms(Session* session, vector< shared_ptr<DisplayedChannel> >& channels);
+bool UploadWaveforms(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	vk::raii::Fence& fence);
 
 /**
 	@brief Mutex for controlling access to background Vulkan activity
 
 	Arbitrarily many threads can own this mutex at once, but recreating the swapchain conflicts with any and all uses
  */
-std::shared_mutex g_vulkanActivityMutex;
+ProfiledMutex<std::shared_mutex> g_vulkanActivityMutex("g_vulkanActivityMutex", LOCK_RANK_VULKAN_ACTIVITY);
 
 void WaveformThread(Session* session, atomic<bool>* shuttingDown)
 {
 	pthread_setname_np_compat("WaveformThread");
+	Tracer::SetThreadName("WaveformThread");
+	ThreadRoleScope role(THREAD_ROLE_WAVEFORM);
 
 	LogTrace("Starting\n");
 
@@ -96,77 +200,410 @@ void WaveformThread(Session* session, atomic<bool>* shuttingDown)
 				bufname.c_str()));
 	}
 
+	//Separate queue and command buffer for copying newly downloaded waveforms to the GPU.
+	//This lets the copies run alongside a nonblocking rasterization of the previous acquisition.
+	shared_ptr<QueueHandle> uploadQueue(g_vkQueueManager->GetComputeQueue("WaveformThread.upload"));
+	vk::CommandPoolCreateInfo uploadPoolInfo(
+		vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+		uploadQueue->m_family );
+	vk::raii::CommandPool uploadPool(*g_vkComputeDevice, uploadPoolInfo);
+	vk::CommandBufferAllocateInfo uploadBufInfo(*uploadPool, vk::CommandBufferLevel::ePrimary, 1);
+	vk::raii::CommandBuffer uploadCmdbuf(
+		std::move(vk::raii::CommandBuffers(*g_vkComputeDevice, uploadBufInfo).front()));
+	vk::raii::Fence uploadFence(*g_vkComputeDevice, vk::FenceCreateInfo());
+
+	//Rasterization pass which has been submitted to the GPU but not handed off to the GUI yet
+	InFlightRender render;
+	render.m_fence = make_unique<vk::raii::Fence>(*g_vkComputeDevice, vk::FenceCreateInfo());
+	render.m_timer = make_unique<GpuTimer>(queue->m_family, "WaveformThread.timer");
+
+	//Set if the last re-render was cut short by a newer request. The next one always runs to completion, so the
+	//display keeps up (one pass behind at worst) during continuous panning and zooming.
+	bool rerenderInterrupted = false;
+
 	while(!*shuttingDown)
 	{
+		//If the GPU has finished the last rasterization pass, hand it off to the GUI right away
+		if(render.m_pending && (render.m_fence->getStatus() == vk::Result::eSuccess) )
+			FinishPendingRender(session, render, shuttingDown);
+
 		//If re-running the filter graph was requested, do that (and re-render)
 		if(g_refilterRequestedEvent.Peek())
 		{
 			//Clear any partial filter refresh event, if one was present (it's now redundant)
 			g_partialRefilterRequestedEvent.Peek();
 
+			//Filters must not overwrite anything the previous rasterization is still reading
+			FinishPendingRender(session, render, shuttingDown);
+
+			TRACE_ZONE("Refilter request");
 			LogTrace("WaveformThread: re-running filter graph and re-rendering\n");
-			session->RefreshAllFilters();
-			RenderAllWaveforms(cmdbuf, session, queue);
-			g_refilterDoneEvent.Signal();
+
+			//If a newer refresh came in while we were running, skip drawing the outdated outputs and start on it
+			if(session->RefreshRequestedFilters())
+				StartPendingRender(cmdbuf, session, queue, render, &g_refilterDoneEvent);
 			continue;
 		}
 
 		if(g_partialRefilterRequestedEvent.Peek())
 		{
+			FinishPendingRender(session, render, shuttingDown);
+
+			TRACE_ZONE("Partial refilter request");
 			LogTrace("WaveformThread: re-running partial filter graph and re-rendering\n");
 			if(session->RefreshDirtyFilters())
-				RenderAllWaveforms(cmdbuf, session, queue);
-			g_refilterDoneEvent.Signal();
+				StartPendingRender(cmdbuf, session, queue, render, &g_refilterDoneEvent);
+			else
+			{
+				g_refilterDoneEvent.Signal();
+				WakeEventLoop();
+			}
 			continue;
 		}
 
 		//If re-rendering was requested due to a window resize etc, do that.
 		if(g_rerenderRequestedEvent.Peek())
 		{
+			FinishPendingRender(session, render, shuttingDown);
+
+			TRACE_ZONE("Rerender request");
 			LogTrace("WaveformThread: re-rendering\n");
-			RenderAllWaveforms(cmdbuf, session, queue);
-			g_rerenderDoneEvent.Signal();
+			rerenderInterrupted =
+				!StartPendingRender(cmdbuf, session, queue, render, &g_rerenderDoneEvent, !rerenderInterrupted);
+			if(rerenderInterrupted)
+				g_interruptedRerenders ++;
 			continue;
 		}
 
 		//Wait for data to be available from all scopes
 		if(!session->CheckForPendingWaveforms())
 		{
-			this_thread::sleep_for(chrono::milliseconds(1));
+			//Nothing new came in. Sleep until something does, or a request comes in.
+			//If a rasterization is in flight, check the GPU again shortly rather than making the GUI wait for it.
+			if(render.m_pending)
+				g_waveformThreadWakeEvent.BlockFor(chrono::milliseconds(1));
+			else
+				g_waveformThreadWakeEvent.BlockFor(chrono::milliseconds(10));
 			continue;
 		}
 
-		//We've got data. Download it, then run the filter graph
+		TRACE_ZONE("Process acquisition");
+		size_t depth = session->GetWaveformPipelineDepth();
+
+		//We've got data. Download it.
+		//In pipelined mode, this overlaps with the GPU rasterizing the previous acquisition: the rasterizer only
+		//reads the previous waveforms (which are now owned by the pending history point) and filter outputs.
+		//In lockstep mode the live waveforms aren't handed off anywhere, so any re-render has to finish first.
+		if(depth <= 1)
+			FinishPendingRender(session, render, shuttingDown);
 		session->DownloadWaveforms();
-		session->RefreshAllFilters();
+		auto point = session->GetInFlightPoint();
+		bool uploaded = false;
+		if(session->GetPreferences().GetBool("Performance.Waveform Processing.upload_on_download"))
+		{
+			double tupload = GetTime();
+			uploaded = UploadWaveforms(uploadCmdbuf, session, uploadQueue, uploadFence);
+			g_lastWaveformUploadTime = (GetTime() - tupload) * FS_PER_SECOND;
+			session->GetMetricHistory().Record("Upload time", g_lastWaveformUploadTime);
+		}
+
+		//The previous acquisition isn't on screen yet, so put its waveforms back on the scopes until it is.
+		//Otherwise the GUI would show its image with the new acquisition's cursors and readouts.
+		bool swapped = render.m_pending && render.m_point && point;
+		if(swapped)
+			session->AttachAcquisition(render.m_point);
+
+		//Filter outputs are updated in place, so the previous rasterization has to be done before we can run the
+		//filter graph. Once it is, hand the previous acquisition off to the GUI and keep going.
+		FinishPendingRender(session, render, shuttingDown);
+		if(swapped)
+			session->AttachAcquisition(point);
+
+		//On deep captures, draw the raw channels now so something shows up while the filter graph is grinding away.
+		//The filters only read these waveforms, so if they're already on the GPU the preview can run alongside them.
+		//If not, the rasterizer's on-demand copies have to land before any filter goes looking at the same buffers.
+		bool preview = session->ShouldPreviewAcquisition();
+		if(preview)
+		{
+			TRACE_ZONE("Preview");
+			StartPendingRender(cmdbuf, session, queue, render, &g_waveformPreviewEvent, false, true);
+			if(!uploaded)
+				FinishPendingRender(session, render, shuttingDown);
+		}
+
+		double tprocess = GetTime();
+		session->RefreshTriggeredFilters();
+		session->EvaluateHistoryPolicies();
+		session->GenerateHistoryThumbnails();
+		g_lastWaveformProcessTime = (GetTime() - tprocess) * FS_PER_SECOND;
+		session->GetMetricHistory().Record("Process time", g_lastWaveformProcessTime);
+		auto latency = session->GetInFlightLatency();
+		if(latency)
+			latency->Mark(AcquisitionLatency::STAGE_FILTERED, GetTime());
+
+		//The full render draws into the same back buffers as the preview
+		if(preview)
+			FinishPendingRender(session, render, shuttingDown);
 
 		//Rerun the heavyweight rendering shaders
-		RenderAllWaveforms(cmdbuf, session, queue);
+		if(depth > 1)
+		{
+			StartPendingRender(cmdbuf, session, queue, render, &g_waveformReadyEvent);
+			render.m_latency = latency;
+			render.m_point = point;
+		}
 
-		//Unblock the UI threads, then wait for acknowledgement that it's processed
-		g_waveformReadyEvent.Signal();
-		g_waveformProcessedEvent.Block();
+		//Lockstep mode: unblock the UI threads, then wait for acknowledgement that it's processed
+		else
+		{
+			GpuTimer* timer = session->IsGpuProfilingEnabled() ? render.m_timer.get() : nullptr;
+			RenderAllWaveforms(cmdbuf, session, queue, render.m_channels, timer);
+			if(latency)
+				latency->Mark(AcquisitionLatency::STAGE_RASTERIZED, GetTime());
+
+			TRACE_ZONE("Wait for GUI");
+			double tstall = GetTime();
+			session->MarkAcquisitionRendered(point);
+			g_waveformReadyEvent.Signal();
+			WakeEventLoop();
+			g_waveformProcessedEvent.Block();
+			g_lastWaveformPipelineStallTime = (GetTime() - tstall) * FS_PER_SECOND;
+			session->GetMetricHistory().Record("Pipeline stall", g_lastWaveformPipelineStallTime);
+		}
 	}
 
+	//Make sure the GPU isn't still using anything we're about to free
+	if(render.m_pending)
+		(void)g_vkComputeDevice->waitForFences({**render.m_fence}, VK_TRUE, UINT64_MAX);
+
 	LogTrace("Shutting down\n");
 }
 
-void RenderAllWaveforms(vk::raii::CommandBuffer& cmdbuf, Session* session, shared_ptr<QueueHandle> queue)
+/**
+	@brief Copies the freshly downloaded waveforms to the GPU on a queue of their own
+
+	The copies still overlap with any rasterization already in flight on the GPU, but not with anything else this
+	thread does. The buffers are marked as current on the GPU as soon as the copies are recorded, so nobody else may
+	touch the waveforms until they land: we hold the waveform writer mutex and the data mutex (in that order, like
+	every other exclusive user) and block until the fence signals.
+
+	@param cmdbuf	Command buffer to record into
+	@param session	The session being processed
+	@param queue	Queue to submit to
+	@param fence	Signaled when the copies complete
+
+	@return True if anything was copied
+ */
+bool UploadWaveforms(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	vk::raii::Fence& fence)
 {
-	double tstart = GetTime();
+	TRACE_ZONE("UploadWaveforms");
 
 	//Must lock mutexes in this order to avoid deadlock
-	shared_lock<shared_mutex> lock1(session->GetWaveformDataMutex());
-	shared_lock<shared_mutex> lock2(g_vulkanActivityMutex);
-	lock_guard<mutex> lock3(session->GetRasterizedWaveformMutex());
+	lock_guard wlock(session->GetWaveformWriterMutex());
+	unique_lock lock1(session->GetWaveformDataMutex());
+	shared_lock lock2(g_vulkanActivityMutex);
+
+	cmdbuf.begin({});
+	bool recorded = session->RecordWaveformUploads(cmdbuf);
+	cmdbuf.end();
+	if(!recorded)
+		return false;
+
+	g_vkComputeDevice->resetFences({*fence});
+	{
+		QueueLock qlock(queue);
+		vk::SubmitInfo info({}, {}, *cmdbuf);
+		(*qlock).submit(info, *fence);
+	}
+
+	TRACE_ZONE("Wait for upload");
+	(void)g_vkComputeDevice->waitForFences({*fence}, VK_TRUE, UINT64_MAX);
+	return true;
+}
+
+/**
+	@brief Submits a rasterization pass without waiting for it to complete
+
+	@param cmdbuf		Command buffer to record into
+	@param session		The session being rendered
+	@param queue		Queue to submit to
+	@param render			Bookkeeping for the pass (must not have a pass pending already)
+	@param doneEvent		Event to signal once the rasterized waveforms are ready for the GUI
+	@param interruptible	If true, stop recording early if another re-render is requested in the meantime
+	@param previewOnly		If true, only draw raw instrument channels
+
+	@return False if the pass was interrupted. Whatever was recorded before then is still submitted.
+ */
+bool StartPendingRender(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	InFlightRender& render,
+	Event* doneEvent,
+	bool interruptible,
+	bool previewOnly)
+{
+	g_vkComputeDevice->resetFences({**render.m_fence});
+	render.m_tstart = GetTime();
+	render.m_timed = session->IsGpuProfilingEnabled();
+	bool complete = RenderAllWaveforms(
+		cmdbuf,
+		session,
+		queue,
+		render.m_channels,
+		render.m_timed ? render.m_timer.get() : nullptr,
+		render.m_fence.get(),
+		interruptible,
+		previewOnly);
+	render.m_doneEvent = doneEvent;
+	render.m_pending = true;
+	return complete;
+}
+
+/**
+	@brief Waits for a nonblocking rasterization pass to complete, then hands the result off to the GUI thread
+
+	Does nothing if there's no rasterization in flight.
+ */
+void FinishPendingRender(Session* session, InFlightRender& render, atomic<bool>* shuttingDown)
+{
+	if(!render.m_pending)
+		return;
+
+	TRACE_ZONE("FinishPendingRender");
+	{
+		TRACE_ZONE("Wait for rasterization");
+		double twait = GetTime();
+		(void)g_vkComputeDevice->waitForFences({**render.m_fence}, VK_TRUE, UINT64_MAX);
+		g_lastWaveformRasterizeWaitTime = (GetTime() - twait) * FS_PER_SECOND;
+		session->GetMetricHistory().Record("Rasterize wait", g_lastWaveformRasterizeWaitTime);
+	}
+	if(render.m_timed)
+	{
+		vector<GpuTiming> timings;
+		if(render.m_timer->Resolve(timings))
+			session->SetRasterizeGpuTimings(timings);
+	}
+	PublishRasterizedWaveforms(session, render.m_channels);
+	render.m_pending = false;
+	render.m_channels.clear();
+	if(render.m_latency)
+	{
+		render.m_latency->Mark(AcquisitionLatency::STAGE_RASTERIZED, GetTime());
+		render.m_latency = nullptr;
+	}
+	g_lastWaveformRenderTime = (GetTime() - render.m_tstart) * FS_PER_SECOND;
+	session->GetMetricHistory().Record("Rasterize time", g_lastWaveformRenderTime);
+
+	//Rasterized data is ready, tell the GUI about it (and let it commit the acquisition that's now on screen)
+	if(render.m_doneEvent == &g_waveformReadyEvent)
+		session->MarkAcquisitionRendered(render.m_point);
+	render.m_point = nullptr;
+	render.m_doneEvent->Signal();
+	WakeEventLoop();
+
+	//Don't get too far ahead of the GUI
+	if(render.m_doneEvent == &g_waveformReadyEvent)
+		WaitForPipelineSlot(session, session->GetWaveformPipelineDepth(), shuttingDown);
+}
+
+/**
+	@brief Blocks until fewer than (depth) acquisitions are waiting for the GUI thread to consume them
+ */
+void WaitForPipelineSlot(Session* session, size_t depth, atomic<bool>* shuttingDown)
+{
+	TRACE_ZONE("WaitForPipelineSlot");
+	double tstart = GetTime();
+	while(!*shuttingDown && (session->GetPendingAcquisitionCount() >= depth) )
+		g_waveformProcessedEvent.Block();
+	g_lastWaveformPipelineStallTime = (GetTime() - tstart) * FS_PER_SECOND;
+	session->GetMetricHistory().Record("Pipeline stall", g_lastWaveformPipelineStallTime);
+}
+
+/**
+	@brief Swaps the rasterized waveform buffers of every channel drawn by a completed rasterization pass
+
+	This is the only point where the WaveformThread and the GUI's tone mapping need to be synchronized, since the
+	rasterization itself only ever touches the back buffers.
+ */
+void PublishRasterizedWaveforms(Session* session, vector< shared_ptr<DisplayedChannel> >& channels)
+{
+	lock_guard lock(session->GetRasterizedWaveformMutex());
+	for(auto& chan : channels)
+		chan->SwapRasterizedWaveforms();
+}
+
+/**
+	@brief Rasterizes all visible waveforms
+
+	@param cmdbuf		Command buffer to record into
+	@param session		The session being rendered
+	@param queue		Queue to submit to
+	@param channels		Displayed channels referenced by the command buffer.
+						These must be kept alive until the rendering completes.
+	@param timer		If not null, timestamps are recorded around each shader dispatch. If fence is null, they're
+						read back and published before returning, otherwise that's up to the caller.
+	@param fence		If null, wait for the rendering to complete and publish the results before returning.
+						If not null, submit without waiting and signal this fence on completion. The caller is
+						responsible for waiting on it, then calling PublishRasterizedWaveforms().
+	@param interruptible	If true, stop recording (but still submit what we have) as soon as another re-render is
+							requested, since the view it was recorded for is already out of date
+	@param previewOnly		If true, only draw channels straight from instruments, and leave filter outputs alone
+
+	@return False if recording was interrupted
+ */
+bool RenderAllWaveforms(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	vector< shared_ptr<DisplayedChannel> >& channels,
+	GpuTimer* timer,
+	vk::raii::Fence* fence,
+	bool interruptible,
+	bool previewOnly)
+{
+	TRACE_ZONE("RenderAllWaveforms");
+	double tstart = GetTime();
+
+	//Must lock mutexes in this order to avoid deadlock.
+	//We don't need the rasterized waveform mutex since we only draw into back buffers, which the GUI never touches.
+	shared_lock lock1(session->GetWaveformDataMutex());
+	shared_lock lock2(g_vulkanActivityMutex);
 
 	//Keep references to all displayed channels open until the rendering finishes
 	//This prevents problems if we close a WaveformArea or remove a channel from it before the shader completes
-	vector< shared_ptr<DisplayedChannel> > channels;
+	channels.clear();
 	cmdbuf.begin({});
-	session->RenderWaveformTextures(cmdbuf, channels);
+	if(timer)
+		timer->Reset(cmdbuf);
+	bool complete = session->RenderWaveformTextures(cmdbuf, channels, timer, interruptible, previewOnly);
 	cmdbuf.end();
-	queue->SubmitAndBlock(cmdbuf);
+	if(fence)
+	{
+		TRACE_ZONE("Vulkan submit", "rasterize");
+		QueueLock qlock(queue);
+		vk::SubmitInfo info({}, {}, *cmdbuf);
+		(*qlock).submit(info, **fence);
+		return complete;
+	}
+	{
+		TRACE_ZONE("Vulkan submit", "rasterize");
+		queue->SubmitAndBlock(cmdbuf);
+	}
+	if(timer)
+	{
+		vector<GpuTiming> timings;
+		if(timer->Resolve(timings))
+			session->SetRasterizeGpuTimings(timings);
+	}
+	PublishRasterizedWaveforms(session, channels);
+	channels.clear();
 
 	g_lastWaveformRenderTime = (GetTime() - tstart) * FS_PER_SECOND;
+	session->GetMetricHistory().Record("Rasterize time", g_lastWaveformRenderTime);
+	return complete;
 }
@@ -35,6 +35,8 @@
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "ngscopeclient.h"
 #include "MainWindow.h"
+#include "GpuParallelBusFilter.h"
+#include "ParallelCSVImportFilter.h"
 #include "../scopeprotocols/scopeprotocols.h"
 #include "imgui_internal.h"
 
@@ -44,14 +46,20 @@ unique_ptr<MainWindow> g_mainWindow;
 
 GuiLogSink* g_guiLog;
 
+///@brief True while the main event loop is running (so WakeEventLoop() has a GLFW instance to post to)
+static atomic<bool> g_eventLoopRunning(false);
+
 #ifndef _WIN32
 void Relaunch(int argc, char* argv[]);
 #endif
 
 int main(int argc, char* argv[])
 {
+	double tstart = GetTime();
+
 	//Global settings
 	Severity console_verbosity = Severity::NOTICE;
+	PipelineBenchmarkConfig benchConfig;
 
 	for(int i=1; i<argc; i++)
 	{
@@ -61,15 +69,26 @@ int main(int argc, char* argv[])
 		if(ParseLoggerArguments(i, argc, argv, console_verbosity))
 			continue;
 
+		if(benchConfig.ParseArgument(i, argc, argv))
+			continue;
+
 		//TODO: other arguments
 
 	}
 
+	Tracer::SetThreadName("GUI");
+
 	//Set up logging
 	g_guiLog = new GuiLogSink(console_verbosity);
 	g_log_sinks.push_back(make_unique<ColoredSTDLogSink>(console_verbosity));
 	g_log_sinks.push_back(unique_ptr<GuiLogSink>(g_guiLog));
 
+	if(!benchConfig.m_usageError.empty())
+	{
+		LogError("%s\n", benchConfig.m_usageError.c_str());
+		return 1;
+	}
+
 	//Complain if the OpenMP wait policy isn't set right
 	const char* policy = getenv("OMP_WAIT_POLICY");
 	#ifndef _WIN32
@@ -101,32 +120,81 @@ int main(int argc, char* argv[])
 	#endif
 
 	//Initialize object creation tables for predefined libraries
+	//(timing each phase so we can keep an eye on startup time)
+	double tphase = GetTime();
+	double tlogSetup = tphase - tstart;
 	if(!VulkanInit())
 		return 1;
+	double tvulkan = GetTime() - tphase;
+
+	tphase = GetTime();
 	TransportStaticInit();
 	DriverStaticInit();
 	ScopeProtocolStaticInit();
+	AddDecoderClass(WaveformAccumulateFilter);
+	AddDecoderClass(ParallelCSVImportFilter);
+	AddDecoderClass(GpuParallelBusFilter);
+	double tstaticInit = GetTime() - tphase;
+
+	tphase = GetTime();
 	InitializePlugins();
+	double tplugins = GetTime() - tphase;
 
 	{
 		//Make the top level window
+		tphase = GetTime();
 		shared_ptr<QueueHandle> queue(g_vkQueueManager->GetRenderQueue("g_mainWindow.render"));
 		g_mainWindow = make_unique<MainWindow>(queue);
+		if(benchConfig.m_enabled)
+			g_mainWindow->StartBenchmark(benchConfig);
+		double twindow = GetTime() - tphase;
 
 		//Main event loop
 		auto& session = g_mainWindow->GetSession();
+		EnumRawPreference eventDrivenPref(session.GetPreferences(), "Power.Events.event_driven_ui");
+		RealPreference pollingTimeoutPref(session.GetPreferences(), "Power.Events.polling_timeout");
+		bool firstFrame = true;
+		g_eventLoopRunning = true;
 		while(!glfwWindowShouldClose(g_mainWindow->GetWindow()))
 		{
 			//Check which event loop model to use
-			if(session.GetPreferences().GetEnumRaw("Power.Events.event_driven_ui") == 1)
-				glfwWaitEventsTimeout(session.GetPreferences().GetReal("Power.Events.polling_timeout") / FS_PER_SECOND);
+			//(benchmarks always poll so the frame rate isn't limited by the polling timeout)
+			//In power mode, background threads call WakeEventLoop() when there's something new to draw,
+			//so the timeout only matters for things that change on their own (tooltips etc).
+			TRACE_ZONE("Event loop");
+			if( (eventDrivenPref.Get() == 1) &&
+				!g_mainWindow->IsBenchmarking())
+			{
+				double timeout = pollingTimeoutPref.Get() / FS_PER_SECOND;
+				if(timeout <= 0)
+					glfwWaitEvents();
+				else
+					glfwWaitEventsTimeout(timeout);
+			}
 			else
 				glfwPollEvents();
 
 			//Draw the main window
+			tphase = GetTime();
 			g_mainWindow->Render();
+
+			if(firstFrame)
+			{
+				firstFrame = false;
+
+				LogDebug("Startup time breakdown:\n");
+				LogIndenter li;
+				LogDebug("Logging and arguments: %6.1f ms\n", tlogSetup * 1000);
+				LogDebug("Vulkan init:           %6.1f ms\n", tvulkan * 1000);
+				LogDebug("Static init:           %6.1f ms\n", tstaticInit * 1000);
+				LogDebug("Plugins:               %6.1f ms\n", tplugins * 1000);
+				LogDebug("Main window:           %6.1f ms\n", twindow * 1000);
+				LogDebug("First frame:           %6.1f ms\n", (GetTime() - tphase) * 1000);
+				LogDebug("Total:                 %6.1f ms\n", (GetTime() - tstart) * 1000);
+			}
 		}
 
+		g_eventLoopRunning = false;
 		session.ClearBackgroundThreads();
 	}
 
@@ -150,6 +218,17 @@ void Relaunch(int argc, char* argv[])
 }
 #endif
 
+/**
+	@brief Wakes up the main event loop if it's blocked waiting for input, so it redraws right away
+
+	Safe to call from any thread.
+ */
+void WakeEventLoop()
+{
+	if(g_eventLoopRunning)
+		glfwPostEmptyEvent();
+}
+
 /**
 	@brief Helper function for right justified text in a table
  */
@@ -173,7 +252,7 @@ void RightJustifiedText(const string& str)
 bool RectIntersect(ImVec2 posA, ImVec2 sizeA, ImVec2 posB, ImVec2 sizeB)
 {
 	//Enlarge hitboxes by a small margin to keep spacing between nodes
-	float margin = 5;
+	float margin = RECT_INTERSECT_MARGIN;
 	posA.x -= margin;
 	posA.y -= margin;
 	posB.x -= margin;
@@ -39,11 +39,14 @@
 #include <misc/cpp/imgui_stdlib.h>
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_vulkan.h>
+#include <implot.h>
 
 #include "ImGuiDisabler.h"
 
 #include <atomic>
+#include <deque>
 #include <shared_mutex>
+#include <string_view>
 
 #include "BERTState.h"
 #include "PowerSupplyState.h"
@@ -51,7 +54,10 @@
 #include "MultimeterState.h"
 #include "LoadState.h"
 #include "GuiLogSink.h"
+#include "Tracer.h"
+#include "ProfiledMutex.h"
 #include "Event.h"
+#include "AsyncProperty.h"
 
 class Session;
 
@@ -61,12 +67,22 @@ public:
 	InstrumentThreadArgs(std::shared_ptr<SCPIInstrument> p, Session* sess)
 	: inst(p)
 	, session(sess)
+	, wakeEvent(nullptr)
+	, pollRate(nullptr)
+	, triggerRate(nullptr)
 	{}
 
 	std::shared_ptr<SCPIInstrument> inst;
 	std::atomic<bool>* shuttingDown;
 	Session* session;
 
+	//Wakes the thread early (trigger armed/stopped, waveform queue drained)
+	Event* wakeEvent;
+
+	//Measured poll and trigger rates, for display in the metrics dialog
+	std::atomic<float>* pollRate;
+	std::atomic<float>* triggerRate;
+
 	//Additional per-instrument-type state we can add
 	std::shared_ptr<LoadState> loadstate;
 	std::shared_ptr<MultimeterState> meterstate;
@@ -80,7 +96,12 @@ void WaveformThread(Session* session, std::atomic<bool>* shuttingDown);
 
 void RightJustifiedText(const std::string& str);
 
-extern std::shared_mutex g_vulkanActivityMutex;
+void WakeEventLoop();
+
+extern ProfiledMutex<std::shared_mutex> g_vulkanActivityMutex;
+
+///@brief Margin added around each rectangle by RectIntersect(), so nearly touching rectangles count as overlapping
+#define RECT_INTERSECT_MARGIN 5
 
 bool RectIntersect(ImVec2 posA, ImVec2 sizeA, ImVec2 posB, ImVec2 sizeB);
 bool RectContains(ImVec2 posA, ImVec2 sizeA, ImVec2 posB, ImVec2 sizeB);
@@ -0,0 +1,142 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Converts an analog waveform to the 16-bit codes of an arbitrary waveform generator
+
+	MODE_RANGE gives each thread a range of samples and writes their minimum and maximum, for the CPU to finish off.
+	MODE_QUANTIZE then runs one thread per pair of output points, linearly interpolating the source at each point and
+	scaling it to a code. Positions are computed in single precision, which is exact up to 16M points.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match ArbitraryWaveformQuantizeArgs::Mode
+#define MODE_RANGE		0
+#define MODE_QUANTIZE	1
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	uint	inLen;
+	uint	outLen;
+	uint	samplesPerThread;
+	uint	numThreads;
+	uint	stride;
+	uint	mode;
+	uint	bigEndian;
+
+	//Input samples per output point
+	float	ratio;
+
+	//Source value mapped to codeMin, and codes per volt
+	float	vmin;
+	float	scale;
+
+	float	codeMin;
+	float	codeMax;
+};
+
+//Source waveform
+layout(std430, binding=0) restrict readonly buffer buf_din
+{
+	float din[];
+};
+
+//Per thread: minimum, maximum
+layout(std430, binding=1) restrict writeonly buffer buf_ranges
+{
+	float ranges[];
+};
+
+//Output codes, two per word with the first in the low half
+layout(std430, binding=2) restrict writeonly buffer buf_codes
+{
+	uint codes[];
+};
+
+uint GetCode(uint j)
+{
+	float x = float(j) * ratio;
+	uint i0 = min(uint(x), inLen - 1);
+	uint i1 = min(i0 + 1, inLen - 1);
+	float v = mix(din[i0], din[i1], x - float(i0));
+
+	float c = clamp(round(codeMin + (v - vmin) * scale), codeMin, codeMax);
+	uint code = uint(int(c)) & 0xffff;
+	if(bigEndian != 0)
+		code = ( (code & 0xff) << 8 ) | (code >> 8);
+	return code;
+}
+
+void main()
+{
+	if(mode == MODE_RANGE)
+	{
+		uint tid = gl_GlobalInvocationID.x;
+		if(tid >= numThreads)
+			return;
+
+		uint start = tid * samplesPerThread;
+		uint end = min(start + samplesPerThread, inLen);
+
+		float vlo = din[start];
+		float vhi = vlo;
+		for(uint i=start+1; i<end; i++)
+		{
+			vlo = min(vlo, din[i]);
+			vhi = max(vhi, din[i]);
+		}
+
+		ranges[tid*2] = vlo;
+		ranges[tid*2 + 1] = vhi;
+	}
+
+	else
+	{
+		uint k = gl_GlobalInvocationID.y*stride + gl_GlobalInvocationID.x;
+		uint j = k*2;
+		if(j >= outLen)
+			return;
+
+		uint word = GetCode(j);
+		if(j+1 < outLen)
+			word |= GetCode(j+1) << 16;
+		codes[k] = word;
+	}
+}
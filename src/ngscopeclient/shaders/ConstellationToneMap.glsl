@@ -43,6 +43,7 @@ layout(std430, push_constant) uniform constants
 {
 	uint width;
 	uint height;
+	float rampRow;		//V coordinate of our color ramp within the gradient strip
 };
 
 layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
@@ -68,7 +69,7 @@ void main()
 	else
 	{
 		clamped += 0.5 / 255.0;
-		colorOut = texture(colorRamp, vec2(clamped, 0.5));
+		colorOut = texture(colorRamp, vec2(clamped, rampRow));
 	}
 	imageStore(
 		outputTex,
@@ -0,0 +1,151 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Totals the hits of an integrated eye pattern within each region of its mask, and at each margin step
+
+	Counts are 64-bit (low word, high word) since a long integration can put far more than 2^32 samples in the eye.
+	Each workgroup sums into shared memory first, so the global counters are only touched once per workgroup.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match MASK_TEST_MAX_POLYGONS and MASK_MARGIN_STEPS in MaskTester.h
+#define MAX_POLYGONS 16
+#define MAX_STEPS 64
+
+//Counter layout: total hits in the eye, then hits per region, then hits per margin step
+#define COUNTER_TOTAL	0
+#define COUNTER_REGIONS	1
+#define COUNTER_STEPS	(COUNTER_REGIONS + MAX_POLYGONS)
+#define NUM_COUNTERS	(COUNTER_STEPS + MAX_STEPS)
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+layout(std430, push_constant) uniform constants
+{
+	uint	width;
+	uint	height;
+	uint	numPolygons;
+	uint	numSteps;
+};
+
+//Integration buffer of the eye (actually 64-bit little endian signed ints)
+layout(std430, binding=0) restrict readonly buffer buf_accum
+{
+	uint accum[];
+};
+
+//Coverage map from EyeMaskCoverage
+layout(std430, binding=1) restrict readonly buffer buf_coverage
+{
+	uint coverage[];
+};
+
+//Output counters, as (low, high) pairs. Must be zeroed before the first dispatch.
+layout(std430, binding=2) restrict buffer buf_counters
+{
+	uint counters[];
+};
+
+shared uint g_lo[NUM_COUNTERS];
+shared uint g_hi[NUM_COUNTERS];
+
+//Adds a 64-bit value to a shared counter
+void AddShared(uint counter, uint lo, uint hi)
+{
+	uint old = atomicAdd(g_lo[counter], lo);
+	uint carry = (old + lo < old) ? 1u : 0u;
+	if( (hi + carry) != 0)
+		atomicAdd(g_hi[counter], hi + carry);
+}
+
+void main()
+{
+	for(uint c = gl_LocalInvocationID.x; c < NUM_COUNTERS; c += X_BLOCK_SIZE)
+	{
+		g_lo[c] = 0;
+		g_hi[c] = 0;
+	}
+	barrier();
+	memoryBarrierShared();
+
+	//Threads off the edge of the eye still take part in the barriers below
+	uint x = gl_GlobalInvocationID.x;
+	uint y = gl_GlobalInvocationID.y;
+	if( (x < width) && (y < height) )
+	{
+		uint i = y*width + x;
+		uint lo = accum[i*2];
+		uint hi = accum[i*2 + 1];
+		if( (lo != 0) || (hi != 0) )
+		{
+			AddShared(COUNTER_TOTAL, lo, hi);
+
+			uint regions = coverage[i*3];
+			for(uint p=0; p<numPolygons; p++)
+			{
+				if( (regions & (1u << p)) != 0)
+					AddShared(COUNTER_REGIONS + p, lo, hi);
+			}
+
+			uint steps_lo = coverage[i*3 + 1];
+			uint steps_hi = coverage[i*3 + 2];
+			for(uint k=0; k<numSteps; k++)
+			{
+				uint bit = (k < 32) ? (steps_lo & (1u << k)) : (steps_hi & (1u << (k - 32)));
+				if(bit != 0)
+					AddShared(COUNTER_STEPS + k, lo, hi);
+			}
+		}
+	}
+	barrier();
+	memoryBarrierShared();
+
+	//Fold the workgroup's totals into the global counters
+	for(uint c = gl_LocalInvocationID.x; c < NUM_COUNTERS; c += X_BLOCK_SIZE)
+	{
+		uint lo = g_lo[c];
+		uint hi = g_hi[c];
+		if( (lo == 0) && (hi == 0) )
+			continue;
+
+		uint old = atomicAdd(counters[c*2], lo);
+		uint carry = (old + lo < old) ? 1u : 0u;
+		if( (hi + carry) != 0)
+			atomicAdd(counters[c*2 + 1], hi + carry);
+	}
+}
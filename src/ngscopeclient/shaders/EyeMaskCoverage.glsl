@@ -0,0 +1,168 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Rasterizes the regions of an eye mask into a per-pixel coverage map, at a range of margins
+
+	For each pixel of the eye's integration buffer this records which regions cover it (at zero margin, for per-region
+	hit counts), and for each step of the margin search whether any region covers it once every region is grown
+	about its own centroid by that margin.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match MASK_TEST_MAX_POLYGONS in MaskTester.h
+#define MAX_POLYGONS 16
+
+//Must match MASK_MARGIN_STEPS in MaskTester.h
+#define MAX_STEPS 64
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+layout(std430, push_constant) uniform constants
+{
+	uint	width;
+	uint	height;
+	uint	numPolygons;
+	uint	numSteps;
+
+	//Time (fs from the clock edge) of the center of column 0, and fs per column
+	float	xoff;
+	float	xscale;
+
+	//Voltage of the center of row 0, and volts per row
+	float	yoff;
+	float	yscale;
+
+	//Margin of the last step of the search (the first step is always zero margin)
+	float	maxMargin;
+};
+
+//Three words per pixel: bitmask of regions at zero margin, then bitmask of margin steps (low, high)
+layout(std430, binding=0) restrict writeonly buffer buf_coverage
+{
+	uint coverage[];
+};
+
+//Index of the first vertex of each polygon, plus one past the end of the last
+layout(std430, binding=1) restrict readonly buffer polyStarts
+{
+	uint polyStart[];
+};
+
+//Polygon vertices (fs from the clock edge, volts)
+layout(std430, binding=2) restrict readonly buffer polyXs
+{
+	float polyX[];
+};
+
+layout(std430, binding=3) restrict readonly buffer polyYs
+{
+	float polyY[];
+};
+
+//Even-odd crossing test, so the polygon doesn't need to be convex
+bool PointInPolygon(uint poly, float x, float y)
+{
+	bool inside = false;
+	uint start = polyStart[poly];
+	uint end = polyStart[poly+1];
+	if(end - start < 3)
+		return false;
+
+	uint j = end - 1;
+	for(uint i = start; i < end; i++)
+	{
+		float xi = polyX[i];
+		float yi = polyY[i];
+		float xj = polyX[j];
+		float yj = polyY[j];
+
+		if( ((yi > y) != (yj > y)) && (x < (xj - xi) * (y - yi) / (yj - yi) + xi) )
+			inside = !inside;
+
+		j = i;
+	}
+
+	return inside;
+}
+
+void main()
+{
+	uint x = gl_GlobalInvocationID.x;
+	uint y = gl_GlobalInvocationID.y;
+	if( (x >= width) || (y >= height) )
+		return;
+
+	vec2 pos = vec2(xoff + float(x)*xscale, yoff + float(y)*yscale);
+
+	uint regions = 0;
+	uint steps_lo = 0;
+	uint steps_hi = 0;
+	for(uint p=0; p<numPolygons; p++)
+	{
+		//Centroid of the vertices, which the region is grown about
+		uint start = polyStart[p];
+		uint end = polyStart[p+1];
+		if(end <= start)
+			continue;
+		vec2 center = vec2(0, 0);
+		for(uint i = start; i < end; i++)
+			center += vec2(polyX[i], polyY[i]);
+		center /= float(end - start);
+
+		//Growing the region by m is the same as shrinking the pixel's offset from the centroid by 1 + m
+		for(uint k=0; k<numSteps; k++)
+		{
+			float margin = (numSteps > 1) ? (maxMargin * float(k) / float(numSteps - 1)) : 0.0;
+			vec2 scaled = center + (pos - center) / (1 + margin);
+			if(!PointInPolygon(p, scaled.x, scaled.y))
+				continue;
+
+			if(k == 0)
+				regions |= (1u << p);
+			if(k < 32)
+				steps_lo |= (1u << k);
+			else
+				steps_hi |= (1u << (k - 32));
+		}
+	}
+
+	uint i = y*width + x;
+	coverage[i*3] = regions;
+	coverage[i*3 + 1] = steps_lo;
+	coverage[i*3 + 2] = steps_hi;
+}
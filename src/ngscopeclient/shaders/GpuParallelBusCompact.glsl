@@ -0,0 +1,135 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Writes the cells of a parallel bus decode
+
+	MODE_COMPACT repeats the MODE_COUNT walk of GpuParallelBusScan, writing the start and value of each cell at the
+	index the prefix sum gave its thread. MODE_DURATION then runs one thread per cell and extends it to the start of
+	the next one (or the end of the waveform).
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match GpuParallelBusArgs::Mode
+#define MODE_COMPACT	2
+#define MODE_DURATION	3
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	uint	numSamples;
+	uint	stride;
+	uint	samplesPerThread;
+	uint	numThreads;
+	uint	numCells;
+	uint	mode;
+	uint	lane;
+};
+
+//One word per sample, one bit per lane
+layout(std430, binding=0) restrict readonly buffer buf_packed
+{
+	uint packed[];
+};
+
+//Index of the first cell starting in each thread's range
+layout(std430, binding=1) restrict readonly buffer buf_bases
+{
+	uint bases[];
+};
+
+//Cell offsets (actually 64-bit little endian signed ints)
+layout(std430, binding=2) restrict buffer buf_offsets
+{
+	uint offsets[];
+};
+
+//Cell durations (actually 64-bit little endian signed ints)
+layout(std430, binding=3) restrict writeonly buffer buf_durations
+{
+	uint durations[];
+};
+
+//Cell values
+layout(std430, binding=4) restrict writeonly buffer buf_values
+{
+	uint values[];
+};
+
+void main()
+{
+	if(mode == MODE_COMPACT)
+	{
+		uint tid = gl_GlobalInvocationID.x;
+		if(tid >= numThreads)
+			return;
+
+		uint start = tid * samplesPerThread;
+		uint end = min(start + samplesPerThread, numSamples);
+
+		uint n = bases[tid];
+		uint prev = (start > 0) ? packed[start-1] : ~packed[0];
+		for(uint i=start; i<end; i++)
+		{
+			uint v = packed[i];
+			if(v != prev)
+			{
+				offsets[n*2] = i;
+				offsets[n*2 + 1] = 0;
+				values[n] = v;
+				n ++;
+			}
+			prev = v;
+		}
+	}
+
+	else
+	{
+		uint i = gl_GlobalInvocationID.y*stride + gl_GlobalInvocationID.x;
+		if(i >= numCells)
+			return;
+
+		uint next = numSamples;
+		if(i+1 < numCells)
+			next = offsets[(i+1)*2];
+
+		durations[i*2] = next - offsets[i*2];
+		durations[i*2 + 1] = 0;
+	}
+}
@@ -0,0 +1,122 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Packs logic analyzer lanes into parallel bus words, and counts the value changes
+
+	MODE_PACK runs once per lane, one thread per sample, setting that lane's bit of each word.
+	MODE_COUNT gives each thread a range of samples and writes the number of cells which start in it.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match GpuParallelBusArgs::Mode
+#define MODE_PACK	0
+#define MODE_COUNT	1
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	uint	numSamples;
+	uint	stride;
+	uint	samplesPerThread;
+	uint	numThreads;
+	uint	numCells;
+	uint	mode;
+	uint	lane;
+};
+
+//One word per sample, one bit per lane
+layout(std430, binding=0) restrict buffer buf_packed
+{
+	uint packed[];
+};
+
+//Samples of the lane being packed (actually bools, 4 per int)
+layout(std430, binding=1) restrict readonly buffer buf_din
+{
+	uint din[];
+};
+
+//Number of cells starting in each thread's range
+layout(std430, binding=2) restrict writeonly buffer buf_counts
+{
+	uint counts[];
+};
+
+void main()
+{
+	if(mode == MODE_PACK)
+	{
+		uint i = gl_GlobalInvocationID.y*stride + gl_GlobalInvocationID.x;
+		if(i >= numSamples)
+			return;
+
+		uint bit = 0;
+		if( ( (din[i/4] >> (8*(i%4)) ) & 0xff ) != 0 )
+			bit = 1u << lane;
+
+		if(lane == 0)
+			packed[i] = bit;
+		else
+			packed[i] |= bit;
+	}
+
+	else
+	{
+		uint tid = gl_GlobalInvocationID.x;
+		if(tid >= numThreads)
+			return;
+
+		uint start = tid * samplesPerThread;
+		uint end = min(start + samplesPerThread, numSamples);
+
+		//The first sample always starts a cell
+		uint count = 0;
+		uint prev = (start > 0) ? packed[start-1] : ~packed[0];
+		for(uint i=start; i<end; i++)
+		{
+			uint v = packed[i];
+			if(v != prev)
+				count ++;
+			prev = v;
+		}
+
+		counts[tid] = count;
+	}
+}
@@ -0,0 +1,143 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Finds the first sample of a waveform matching a history search query
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match HistorySearchQuery::QueryType
+#define QUERY_BELOW			0
+#define QUERY_ABOVE			1
+#define QUERY_RISING_EDGE	2
+#define QUERY_FALLING_EDGE	3
+#define QUERY_GLITCH		4
+
+#define NO_MATCH 0xffffffff
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	uint	numSamples;
+	uint	samplesPerThread;
+	uint	numThreads;
+	uint	type;
+
+	//Longest glitch, in samples
+	uint	maxWidth;
+
+	float	threshold;
+};
+
+//Per thread: first match, number of matches, width of the first glitch (samples)
+layout(std430, binding=0) restrict writeonly buffer results
+{
+	uint result[];
+};
+
+//Waveform to search
+layout(std430, binding=1) restrict readonly buffer samples
+{
+	float din[];
+};
+
+void main()
+{
+	uint tid = gl_GlobalInvocationID.x;
+	if(tid >= numThreads)
+		return;
+
+	uint start = tid * samplesPerThread;
+	uint end = min(start + samplesPerThread, numSamples);
+
+	uint first = NO_MATCH;
+	uint count = 0;
+	uint firstWidth = 0;
+	for(uint i=start; i<end; i++)
+	{
+		float v = din[i];
+
+		bool match = false;
+		uint width = 0;
+		if(type == QUERY_BELOW)
+			match = (v < threshold);
+		else if(type == QUERY_ABOVE)
+			match = (v > threshold);
+		else if(i > 0)
+		{
+			float prev = din[i-1];
+			bool rising = (prev < threshold) && (v >= threshold);
+			bool falling = (prev >= threshold) && (v < threshold);
+
+			if(type == QUERY_RISING_EDGE)
+				match = rising;
+			else if(type == QUERY_FALLING_EDGE)
+				match = falling;
+			else if(rising || falling)
+			{
+				//Look for the signal crossing back again before the pulse is too wide to be a glitch
+				uint jend = min(numSamples, i + maxWidth);
+				for(uint j=i+1; j<jend; j++)
+				{
+					bool back = rising ? (din[j] < threshold) : (din[j] >= threshold);
+					if(back)
+					{
+						match = true;
+						width = j - i;
+						break;
+					}
+				}
+			}
+		}
+
+		if(match)
+		{
+			if(first == NO_MATCH)
+			{
+				first = i;
+				firstWidth = width;
+			}
+			count ++;
+		}
+	}
+
+	result[tid*3] = first;
+	result[tid*3 + 1] = count;
+	result[tid*3 + 2] = firstWidth;
+}
@@ -0,0 +1,167 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Counts how many samples of an acquisition fall within each region of an eye mask
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match MASK_TEST_MAX_POLYGONS in MaskTester.h
+#define MAX_POLYGONS 16
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	uint	numUIs;
+	uint	numSamples;
+	uint	numPolygons;
+
+	//Sample interval of the data, in fs
+	float	timescale;
+};
+
+//Hit counters, one per polygon
+layout(std430, binding=0) restrict buffer hits
+{
+	uint hitCount[];
+};
+
+//Sampled data
+layout(std430, binding=1) restrict readonly buffer samples
+{
+	float din[];
+};
+
+//First sample of each UI, its offset from the clock edge, and the length of the UI (fs)
+layout(std430, binding=2) restrict readonly buffer uiStarts
+{
+	uint uiStart[];
+};
+
+layout(std430, binding=3) restrict readonly buffer uiOffsets
+{
+	float uiOffset[];
+};
+
+layout(std430, binding=4) restrict readonly buffer uiLengths
+{
+	float uiLength[];
+};
+
+//Index of the first vertex of each polygon, plus one past the end of the last
+layout(std430, binding=5) restrict readonly buffer polyStarts
+{
+	uint polyStart[];
+};
+
+//Polygon vertices (fs from the clock edge, volts)
+layout(std430, binding=6) restrict readonly buffer polyXs
+{
+	float polyX[];
+};
+
+layout(std430, binding=7) restrict readonly buffer polyYs
+{
+	float polyY[];
+};
+
+//Even-odd crossing test, so the polygon doesn't need to be convex
+bool PointInPolygon(uint poly, float x, float y)
+{
+	bool inside = false;
+	uint start = polyStart[poly];
+	uint end = polyStart[poly+1];
+	if(end - start < 3)
+		return false;
+
+	uint j = end - 1;
+	for(uint i = start; i < end; i++)
+	{
+		float xi = polyX[i];
+		float yi = polyY[i];
+		float xj = polyX[j];
+		float yj = polyY[j];
+
+		if( ((yi > y) != (yj > y)) && (x < (xj - xi) * (y - yi) / (yj - yi) + xi) )
+			inside = !inside;
+
+		j = i;
+	}
+
+	return inside;
+}
+
+void main()
+{
+	//Count locally and only touch the global counters once per thread
+	uint localHits[MAX_POLYGONS];
+	for(uint p=0; p<numPolygons; p++)
+		localHits[p] = 0;
+
+	uint stride = gl_NumWorkGroups.x * X_BLOCK_SIZE;
+	for(uint ui = gl_GlobalInvocationID.x; ui < numUIs; ui += stride)
+	{
+		uint first = uiStart[ui];
+		float offset = uiOffset[ui];
+		float len = uiLength[ui];
+
+		for(uint i = first; i < numSamples; i++)
+		{
+			float dx = offset + float(i - first) * timescale;
+			if(dx >= len)
+				break;
+
+			//The eye shows two UIs, so each sample is drawn both after this edge and before the next one
+			float v = din[i];
+			for(uint p=0; p<numPolygons; p++)
+			{
+				if(PointInPolygon(p, dx, v))
+					localHits[p] ++;
+				if(PointInPolygon(p, dx - len, v))
+					localHits[p] ++;
+			}
+		}
+	}
+
+	for(uint p=0; p<numPolygons; p++)
+	{
+		if(localHits[p] != 0)
+			atomicAdd(hitCount[p], localHits[p]);
+	}
+}
@@ -0,0 +1,172 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Rasterizes the cells of a protocol waveform which are too narrow to draw individually
+
+	Each thread handles one column of pixels and writes the average color of every narrow sample touching the column.
+	Output is four planes of one float per column: number of samples (0 if empty), then red, green, and blue.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+//Maximum number of samples averaged in one column, to bound the cost of extremely dense waveforms
+#define MAX_SAMPLES_PER_COLUMN 4096
+
+//Output column data
+layout(std430, binding=0) restrict writeonly buffer buf_out
+{
+	float outval[];
+};
+
+//Sample offsets (actually 64-bit little endian signed ints)
+layout(std430, binding=1) restrict readonly buffer buf_offsets
+{
+	uint offsets[];
+};
+
+//Sample durations (actually 64-bit little endian signed ints)
+layout(std430, binding=2) restrict readonly buffer buf_durations
+{
+	uint durations[];
+};
+
+//Index of the first sample at or after the start of each column (width+1 entries)
+layout(std430, binding=3) restrict readonly buffer buf_index
+{
+	uint xind[];
+};
+
+//Smallest offset in each column (actually 64-bit little endian signed ints, width+1 entries)
+layout(std430, binding=4) restrict readonly buffer buf_targets
+{
+	uint targets[];
+};
+
+//Sample colors (packed RGBA, red in the low byte)
+layout(std430, binding=5) restrict readonly buffer buf_colors
+{
+	uint colors[];
+};
+
+//Same layout as the waveform rendering shader, most fields are unused
+layout(std430, push_constant) uniform constants
+{
+	uint innerXoff_lo;
+	uint innerXoff_hi;
+	uint windowHeight;
+	uint windowWidth;
+	uint memDepth;
+	uint offset_samples;
+	float alpha;
+	float xoff;
+	float xscale;
+	float ybase;
+	float yscale;
+	float yoff;
+	float persistScale;
+	uint firstColumn;
+};
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+//Returns true if the 64-bit signed value (ahi, alo) is less than (bhi, blo)
+bool LessThan(int ahi, uint alo, int bhi, uint blo)
+{
+	if(ahi != bhi)
+		return ahi < bhi;
+	return alo < blo;
+}
+
+void main()
+{
+	uint col = gl_GlobalInvocationID.x;
+	if(col >= windowWidth)
+		return;
+
+	uint startLo = targets[col*2];
+	int startHi = int(targets[col*2 + 1]);
+	uint endLo = targets[col*2 + 2];
+	int endHi = int(targets[col*2 + 3]);
+
+	//The sample before the first one in this column might extend into it
+	uint i = xind[col];
+	if(i > 0)
+		i --;
+
+	uint count = 0;
+	float red = 0;
+	float green = 0;
+	float blue = 0;
+	for(uint n=0; (n < MAX_SAMPLES_PER_COLUMN) && (i < memDepth); n++, i++)
+	{
+		uint offLo = offsets[i*2];
+		int offHi = int(offsets[i*2 + 1]);
+		if(!LessThan(offHi, offLo, endHi, endLo))
+			break;
+
+		//Wide samples are drawn as outlines with text on the CPU, skip them
+		uint durLo = durations[i*2];
+		int durHi = int(durations[i*2 + 1]);
+		float width = (float(durHi) * 4294967296.0 + float(durLo)) * xscale;
+		if(width >= 2.0)
+			continue;
+
+		//Skip samples which end before the column starts
+		uint carry;
+		uint sampleEndLo = uaddCarry(offLo, durLo, carry);
+		int sampleEndHi = offHi + durHi + int(carry);
+		if(LessThan(sampleEndHi, sampleEndLo, startHi, startLo))
+			continue;
+
+		uint c = colors[i];
+		red += float(c & 0xff);
+		green += float((c >> 8) & 0xff);
+		blue += float((c >> 16) & 0xff);
+		count ++;
+	}
+
+	outval[col] = float(count);
+	if(count > 0)
+	{
+		float scale = 1.0 / (255.0 * float(count));
+		outval[windowWidth + col] = red * scale;
+		outval[windowWidth*2 + col] = green * scale;
+		outval[windowWidth*3 + col] = blue * scale;
+	}
+	else
+	{
+		outval[windowWidth + col] = 0.0;
+		outval[windowWidth*2 + col] = 0.0;
+		outval[windowWidth*3 + col] = 0.0;
+	}
+}
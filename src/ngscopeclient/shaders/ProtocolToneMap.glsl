@@ -0,0 +1,92 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Converts the column data from ProtocolRasterize to an RGBA image of merged cells
+
+	Covered columns get a solid outline along the top and bottom edges and a darkened fill in between, matching how
+	the CPU path draws a run of narrow cells.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+//Thickness of the outline at the top and bottom of the cell, in pixels
+#define OUTLINE_WIDTH 2u
+
+layout(std430, binding=0) restrict readonly buffer buf_columns
+{
+	float columns[];
+};
+
+layout(binding=1, rgba32f) uniform image2D outputTex;
+
+layout(std430, push_constant) uniform constants
+{
+	uint width;
+	uint height;
+};
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+void main()
+{
+	if(gl_GlobalInvocationID.x >= width)
+		return;
+	if(gl_GlobalInvocationID.y >= height)
+		return;
+
+	uint col = gl_GlobalInvocationID.x;
+	uint row = gl_GlobalInvocationID.y;
+
+	//The texture is sized from the same button height, but don't trust rounding to agree
+	ivec2 texSize = imageSize(outputTex);
+	if( (int(col) >= texSize.x) || (int(row) >= texSize.y) )
+		return;
+
+	vec4 colorOut = vec4(0, 0, 0, 0);
+	if(columns[col] > 0.0)
+	{
+		colorOut.r = columns[width + col];
+		colorOut.g = columns[width*2 + col];
+		colorOut.b = columns[width*3 + col];
+		colorOut.a = 1.0;
+
+		//Darken the inside of the cell
+		if( (row >= OUTLINE_WIDTH) && (row + OUTLINE_WIDTH < height) )
+			colorOut.rgb *= 0.25;
+	}
+
+	imageStore(
+		outputTex,
+		ivec2(col, row),
+		colorOut);
+}
@@ -0,0 +1,98 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Counts the samples of an acquisition outside the tolerance band around a reference waveform
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	//Range of live samples to test
+	uint	first;
+	uint	end;
+
+	//Live sample i is compared against reference sample i + shift
+	int		shift;
+
+	//Maximum allowed distance from the reference
+	float	tolerance;
+};
+
+//Out-of-band sample count, then index of the first out-of-band sample
+layout(std430, binding=0) restrict buffer results
+{
+	uint result[];
+};
+
+//Live data
+layout(std430, binding=1) restrict readonly buffer samples
+{
+	float din[];
+};
+
+//Golden waveform
+layout(std430, binding=2) restrict readonly buffer reference
+{
+	float ref[];
+};
+
+void main()
+{
+	//Count locally and only touch the global results once per thread
+	uint localFailures = 0;
+	uint localFirst = 0xffffffff;
+
+	uint stride = gl_NumWorkGroups.x * X_BLOCK_SIZE;
+	for(uint i = first + gl_GlobalInvocationID.x; i < end; i += stride)
+	{
+		if(abs(din[i] - ref[int(i) + shift]) > tolerance)
+		{
+			localFailures ++;
+			localFirst = min(localFirst, i);
+		}
+	}
+
+	if(localFailures != 0)
+	{
+		atomicAdd(result[0], localFailures);
+		atomicMin(result[1], localFirst);
+	}
+}
@@ -0,0 +1,96 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Extracts the lags of interest from a circular cross-correlation and normalizes them by overlap length
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	int		startingDelta;
+	int		numDeltas;
+
+	int		fftLen;
+	int		priLen;
+
+	//Range of the resampled secondary which contains real data
+	int		secStart;
+	int		secEnd;
+
+	//Scale factor for the inverse FFT
+	float	scale;
+};
+
+//The output data
+layout(std430, binding=0) restrict writeonly buffer corr
+{
+	float corrOut[];
+};
+
+//Circular cross-correlation, indexed by lag modulo the FFT length
+layout(std430, binding=1) restrict readonly buffer circ
+{
+	float corrIn[];
+};
+
+void main()
+{
+	uint stride = gl_NumWorkGroups.x * X_BLOCK_SIZE;
+	for(uint i = gl_GlobalInvocationID.x; i < numDeltas; i += stride)
+	{
+		int d = int(i) + startingDelta;
+
+		//Number of primary samples which line up with real secondary samples at this lag
+		int first = max(0, secStart - d);
+		int last = min(priLen, secEnd - d);
+		int count = last - first;
+		if(count <= 0)
+		{
+			corrOut[i] = 0;
+			continue;
+		}
+
+		int index = d;
+		if(index < 0)
+			index += fftLen;
+		corrOut[i] = corrIn[index] * scale / float(count);
+	}
+}
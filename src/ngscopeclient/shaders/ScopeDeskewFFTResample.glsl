@@ -0,0 +1,122 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Resamples a waveform onto the primary's timebase and zero pads it, ready for FFT based cross-correlation
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+//for now, no fallback for no-int64
+#extension GL_ARB_gpu_shader_int64 : require
+
+#define X_BLOCK_SIZE 64
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	//Sample period of the input and output, in fs
+	int64_t srcTimescale;
+	int64_t dstTimescale;
+
+	//Time of output sample zero in the input's time frame, in fs
+	int64_t offset;
+
+	uint	srcLen;
+	uint	outLen;
+
+	//Range of output samples that fall within the input. Everything else is zero padding.
+	uint	validStart;
+	uint	validEnd;
+};
+
+//The output data
+layout(std430, binding=0) restrict writeonly buffer outbuf
+{
+	float outSamples[];
+};
+
+//Input sample data
+layout(std430, binding=1) restrict readonly buffer inbuf
+{
+	float inSamples[];
+};
+
+void main()
+{
+	//Grid-stride loop since the FFT length can exceed the maximum dispatch size
+	uint stride = gl_NumWorkGroups.x * X_BLOCK_SIZE;
+	for(uint i = gl_GlobalInvocationID.x; i < outLen; i += stride)
+	{
+		if( (i < validStart) || (i >= validEnd) )
+		{
+			outSamples[i] = 0;
+			continue;
+		}
+
+		int64_t t = int64_t(i) * dstTimescale + offset;
+		int64_t index = t / srcTimescale;
+
+		//If the output is coarser than the input (decimation, or a faster secondary), average every input sample
+		//within one output period centered on this point. Point sampling would alias everything above the
+		//output's Nyquist frequency back into the band we're correlating over.
+		if(dstTimescale > srcTimescale)
+		{
+			int64_t lo = t - dstTimescale/2;
+			int64_t hi = lo + dstTimescale;
+			int64_t first = (lo <= 0) ? 0 : (lo + srcTimescale - 1) / srcTimescale;
+			int64_t last = min((hi + srcTimescale - 1) / srcTimescale, int64_t(srcLen));
+
+			float sum = 0;
+			for(int64_t j = first; j < last; j++)
+				sum += inSamples[uint(j)];
+			if(last > first)
+				outSamples[i] = sum / float(last - first);
+			else
+				outSamples[i] = inSamples[uint(index)];
+			continue;
+		}
+
+		//Otherwise find the input samples on either side of this point and linearly interpolate between them
+		float frac = float(t - index*srcTimescale) / float(srcTimescale);
+
+		uint base = uint(index);
+		float v = inSamples[base];
+		if( (base + 1) < srcLen)
+			v += frac * (inSamples[base + 1] - v);
+		outSamples[i] = v;
+	}
+}
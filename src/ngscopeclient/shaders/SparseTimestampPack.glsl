@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Packs the 64-bit timestamps of a sparse waveform into blocks of 32-bit deltas from a 64-bit base
+
+	Each workgroup packs one block. If any sample of the block can't be represented (a delta or duration doesn't fit
+	in 32 bits, e.g. because offsets aren't sorted) the block is flagged as wide and the rasterizer falls back to the
+	original 64-bit data for it.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+//Number of samples per block. Must match SPARSE_PACK_BLOCK in WaveformArea.cpp and waveform-compute.glsl.
+#define SPARSE_PACK_BLOCK	1024
+
+//Flags in the third word of each block header
+#define BLOCK_WIDE				1	//block didn't fit, use 64-bit offsets and durations
+#define BLOCK_IMPLIED_DURATIONS	2	//every duration ends at the next sample's offset
+
+#define THREADS_PER_BLOCK	64
+
+//Sample offsets (actually 64-bit little endian signed ints)
+layout(std430, binding=0) restrict readonly buffer buf_offsets
+{
+	uint offsets[];
+};
+
+//Sample durations (actually 64-bit little endian signed ints)
+layout(std430, binding=1) restrict readonly buffer buf_durations
+{
+	uint durations[];
+};
+
+//Base offset (lo, hi) and flags of each block
+layout(std430, binding=2) restrict writeonly buffer buf_headers
+{
+	uvec4 headers[];
+};
+
+//Offset of each sample relative to the base of its block
+layout(std430, binding=3) restrict writeonly buffer buf_deltas
+{
+	uint deltas[];
+};
+
+//Duration of each sample, if it fits in 32 bits
+layout(std430, binding=4) restrict writeonly buffer buf_packedDurations
+{
+	uint packedDurations[];
+};
+
+layout(std430, push_constant) uniform constants
+{
+	uint memDepth;
+	uint packDurations;
+	uint stride;		//number of blocks per row of the dispatch
+};
+
+layout(local_size_x=THREADS_PER_BLOCK, local_size_y=1, local_size_z=1) in;
+
+shared uint g_flags;
+
+void main()
+{
+	uint block = gl_WorkGroupID.y*stride + gl_WorkGroupID.x;
+	uint start = block * SPARSE_PACK_BLOCK;
+	if(start >= memDepth)
+		return;
+	uint end = min(start + SPARSE_PACK_BLOCK, memDepth);
+
+	if(gl_LocalInvocationID.x == 0)
+	{
+		//The last sample of the waveform has nothing after it, so its block can't imply durations
+		g_flags = (end < memDepth) ? BLOCK_IMPLIED_DURATIONS : 0;
+	}
+	barrier();
+	memoryBarrierShared();
+
+	uint base_lo = offsets[start*2];
+	uint base_hi = offsets[start*2 + 1];
+
+	uint flags = BLOCK_IMPLIED_DURATIONS;
+	for(uint i = start + gl_LocalInvocationID.x; i < end; i += THREADS_PER_BLOCK)
+	{
+		//Delta from the base of the block, which has to be a non-negative 32-bit value
+		uint lo = offsets[i*2];
+		uint hi = offsets[i*2 + 1];
+		uint borrow;
+		uint delta_lo = usubBorrow(lo, base_lo, borrow);
+		uint delta_hi = hi - base_hi - borrow;
+		if(delta_hi != 0)
+			flags |= BLOCK_WIDE;
+		deltas[i] = delta_lo;
+
+		if(packDurations != 0)
+		{
+			uint dur_lo = durations[i*2];
+			uint dur_hi = durations[i*2 + 1];
+			if(dur_hi != 0)
+				flags |= BLOCK_WIDE;
+			packedDurations[i] = dur_lo;
+
+			//Durations are implied if each one runs right up to the next sample
+			if(i+1 < memDepth)
+			{
+				uint gap_lo = usubBorrow(offsets[i*2 + 2], lo, borrow);
+				uint gap_hi = offsets[i*2 + 3] - hi - borrow;
+				if( (gap_lo != dur_lo) || (gap_hi != dur_hi) )
+					flags &= ~BLOCK_IMPLIED_DURATIONS;
+			}
+		}
+	}
+
+	//Merge flags across the workgroup. A block only implies durations if every sample does.
+	if( (flags & BLOCK_WIDE) != 0)
+		atomicOr(g_flags, BLOCK_WIDE);
+	if( (packDurations == 0) || ( (flags & BLOCK_IMPLIED_DURATIONS) == 0) )
+		atomicAnd(g_flags, ~BLOCK_IMPLIED_DURATIONS);
+	barrier();
+	memoryBarrierShared();
+
+	if(gl_LocalInvocationID.x == 0)
+		headers[block] = uvec4(base_lo, base_hi, g_flags, 0);
+}
@@ -49,6 +49,7 @@ layout(std430, push_constant) uniform constants
 	float xscale;
 	uint yoff;
 	float yscale;
+	float rampRow;		//V coordinate of our color ramp within the gradient strip
 };
 
 layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
@@ -115,7 +116,7 @@ void main()
 	if(clampedValue <= 0)
 		colorOut = vec4(0,0,0,0);
 	else
-		colorOut = texture(colorRamp, vec2(clampedValue + (0.5 / 255.0), 0.5));
+		colorOut = texture(colorRamp, vec2(clampedValue + (0.5 / 255.0), rampRow));
 	imageStore(
 		outputTex,
 		ivec2(gl_GlobalInvocationID.x, gl_GlobalInvocationID.y),
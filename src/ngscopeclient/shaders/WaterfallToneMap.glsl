@@ -47,6 +47,9 @@ layout(std430, push_constant) uniform constants
 	uint outheight;
 	uint offset_samples;
 	float xscale;
+	uint firstRow;		//first output row to draw (rows below this are unchanged)
+	uint rowOffset;		//output rows are stored rotated by this many rows, so scrolling doesn't move pixels
+	float rampRow;		//V coordinate of our color ramp within the gradient strip
 };
 
 layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
@@ -55,11 +58,12 @@ void main()
 {
 	if(gl_GlobalInvocationID.x >= outwidth)
 		return;
-	if(gl_GlobalInvocationID.y >= outheight)
+	uint row = gl_GlobalInvocationID.y + firstRow;
+	if(row >= outheight)
 		return;
 
 	//Move the entire output display down if needed, so topmost (newest) row is always visible
-	uint yreal = gl_GlobalInvocationID.y + (height - outheight);
+	uint yreal = row + (height - outheight);
 
 	//Figure out which input pixel(s) contribute to this output pixel
 	uint istart = uint(floor(gl_GlobalInvocationID.x / xscale)) + offset_samples;
@@ -100,9 +104,9 @@ void main()
 	if(clampedValue <= 0)
 		colorOut = vec4(0,0,0,0);
 	else
-		colorOut = texture(colorRamp, vec2(clampedValue + (0.5 / 255.0), 0.5));
+		colorOut = texture(colorRamp, vec2(clampedValue + (0.5 / 255.0), rampRow));
 	imageStore(
 		outputTex,
-		ivec2(gl_GlobalInvocationID.x, gl_GlobalInvocationID.y),
+		ivec2(gl_GlobalInvocationID.x, (row + rowOffset) % outheight),
 		colorOut);
 }
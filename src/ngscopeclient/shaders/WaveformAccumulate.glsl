@@ -0,0 +1,126 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Folds a waveform into a running sum and min/max envelope, and writes the average and envelope outputs
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+#define X_BLOCK_SIZE 64
+
+//Must match WaveformAccumulateArgs::Mode
+#define MODE_ADD	0
+#define MODE_RESET	1
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	uint	numSamples;
+
+	//Threads per row of the dispatch, since deep waveforms can need more blocks than we can dispatch in X
+	uint	stride;
+
+	uint	mode;
+	uint	writeOutputs;
+
+	//1 / number of accumulated waveforms
+	float	scale;
+};
+
+layout(std430, binding=0) restrict readonly buffer buf_din
+{
+	float din[];
+};
+
+layout(std430, binding=1) restrict buffer buf_sum
+{
+	float sum[];
+};
+
+layout(std430, binding=2) restrict buffer buf_vmin
+{
+	float vmin[];
+};
+
+layout(std430, binding=3) restrict buffer buf_vmax
+{
+	float vmax[];
+};
+
+layout(std430, binding=4) restrict writeonly buffer buf_avgOut
+{
+	float avgOut[];
+};
+
+layout(std430, binding=5) restrict writeonly buffer buf_minOut
+{
+	float minOut[];
+};
+
+layout(std430, binding=6) restrict writeonly buffer buf_maxOut
+{
+	float maxOut[];
+};
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.y*stride + gl_GlobalInvocationID.x;
+	if(i >= numSamples)
+		return;
+
+	float v = din[i];
+	float s = v;
+	float lo = v;
+	float hi = v;
+	if(mode == MODE_ADD)
+	{
+		s += sum[i];
+		lo = min(vmin[i], v);
+		hi = max(vmax[i], v);
+	}
+
+	sum[i] = s;
+	vmin[i] = lo;
+	vmax[i] = hi;
+
+	if(writeOutputs != 0)
+	{
+		avgOut[i] = s * scale;
+		minOut[i] = lo;
+		maxOut[i] = hi;
+	}
+}
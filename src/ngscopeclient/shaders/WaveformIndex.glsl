@@ -0,0 +1,95 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Generates the per-column sample index buffer for rasterizing sparse waveforms
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+//Sample offsets (actually 64-bit little endian signed ints)
+layout(std430, binding=0) restrict readonly buffer buf_offsets
+{
+	uint offsets[];
+};
+
+//Smallest offset to be drawn by each column (actually 64-bit little endian signed ints)
+layout(std430, binding=1) restrict readonly buffer buf_targets
+{
+	uint targets[];
+};
+
+//Index of the first sample to draw in each column
+layout(std430, binding=2) restrict writeonly buffer buf_index
+{
+	uint xind[];
+};
+
+layout(std430, push_constant) uniform constants
+{
+	uint memDepth;
+	uint width;
+};
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+//Returns true if offsets[i] is less than the 64-bit signed value (hi, lo)
+bool OffsetLessThan(uint i, int hi, uint lo)
+{
+	int ohi = int(offsets[i*2 + 1]);
+	if(ohi != hi)
+		return ohi < hi;
+	return offsets[i*2] < lo;
+}
+
+void main()
+{
+	uint col = gl_GlobalInvocationID.x;
+	if(col >= width)
+		return;
+
+	uint lo = targets[col*2];
+	int hi = int(targets[col*2 + 1]);
+
+	//Find the first sample at or after the target (same semantics as BinarySearchForGequal)
+	uint first = 0;
+	uint last = memDepth;
+	while(first < last)
+	{
+		uint mid = first + (last - first) / 2;
+		if(OffsetLessThan(mid, hi, lo))
+			first = mid + 1;
+		else
+			last = mid;
+	}
+
+	xind[col] = first;
+}
@@ -0,0 +1,96 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Builds one level of a min/max decimation pyramid for a uniform analog waveform
+
+	Each output bin is a (min, max) pair covering "factor" input bins. The input is either raw samples, or the
+	(min, max) pairs of the previous level.
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+layout(std430, binding=0) restrict readonly buffer buf_in
+{
+	float din[];
+};
+
+layout(std430, binding=1) restrict writeonly buffer buf_out
+{
+	float dout[];
+};
+
+layout(std430, push_constant) uniform constants
+{
+	uint inputLen;		//Number of input bins (or samples, if not interleaved)
+	uint outputLen;		//Number of output bins
+	uint factor;		//Number of input bins per output bin
+	uint interleaved;	//Nonzero if the input is (min, max) pairs
+	uint stride;		//Number of threads in each row of the dispatch
+};
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+void main()
+{
+	uint nbin = gl_GlobalInvocationID.y*stride + gl_GlobalInvocationID.x;
+	if(nbin >= outputLen)
+		return;
+
+	uint start = nbin * factor;
+	uint end = min(start + factor, inputLen);
+
+	float vmin;
+	float vmax;
+	if(interleaved != 0)
+	{
+		vmin = din[start*2];
+		vmax = din[start*2 + 1];
+		for(uint i=start+1; i<end; i++)
+		{
+			vmin = min(vmin, din[i*2]);
+			vmax = max(vmax, din[i*2 + 1]);
+		}
+	}
+	else
+	{
+		vmin = din[start];
+		vmax = vmin;
+		for(uint i=start+1; i<end; i++)
+		{
+			vmin = min(vmin, din[i]);
+			vmax = max(vmax, din[i]);
+		}
+	}
+
+	dout[nbin*2] = vmin;
+	dout[nbin*2 + 1] = vmax;
+}
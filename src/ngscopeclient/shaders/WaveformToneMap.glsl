@@ -30,9 +30,10 @@
 #version 430
 #pragma shader_stage(compute)
 
+//fp32 pixels, or packed fp16 with two rows per word if halfPrecision is set
 layout(std430, binding=0) restrict readonly buffer buf_pixels
 {
-	float pixels[];
+	uint pixels[];
 };
 
 layout(binding=1, rgba32f) uniform image2D outputTex;
@@ -44,6 +45,8 @@ layout(std430, push_constant) uniform constants
 	float channelBlue;
 	uint width;
 	uint height;
+	float alpha;
+	uint halfPrecision;
 };
 
 layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
@@ -55,9 +58,19 @@ void main()
 	if(gl_GlobalInvocationID.y >= height)
 		return;
 
-	//Intensity graded grayscale input
-	uint npixel = gl_GlobalInvocationID.y*width + gl_GlobalInvocationID.x;
-	float pixval = pixels[npixel];
+	//Intensity graded grayscale input, scaled by the trace intensity setting
+	float pixval;
+	if(halfPrecision != 0)
+	{
+		vec2 rows = unpackHalf2x16(pixels[(gl_GlobalInvocationID.y / 2)*width + gl_GlobalInvocationID.x]);
+		if( (gl_GlobalInvocationID.y & 1) != 0)
+			pixval = rows.y;
+		else
+			pixval = rows.x;
+	}
+	else
+		pixval = uintBitsToFloat(pixels[gl_GlobalInvocationID.y*width + gl_GlobalInvocationID.x]);
+	pixval *= alpha;
 
 	//Logarithmic shading
 	float y = pow(pixval, 1.0 / 4);
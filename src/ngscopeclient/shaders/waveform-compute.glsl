@@ -41,8 +41,9 @@
 #extension GL_ARB_gpu_shader_int64 : require
 #endif
 
-//Maximum height of a single waveform, in pixels.
-//This is enough for a nearly fullscreen 4K window so should be plenty.
+//Height of one tile of a waveform, in pixels.
+//Each workgroup draws one column of one tile, taller waveforms are split into several tiles along the Y axis
+//(dispatch Y dimension). Must match RASTER_TILE_HEIGHT in WaveformArea.cpp.
 #define MAX_HEIGHT		2048
 
 //Number of threads per column of pixels
@@ -74,13 +75,24 @@ layout(std430, push_constant) uniform constants
 	float yscale;
 	float yoff;
 	float persistScale;
+	uint firstColumn;
 };
 
 //The output texture data
-layout(std430, binding=0) buffer outputTex
-{
-	float outval[];
-};
+#ifdef HALF_PRECISION
+	//Largest finite fp16 value, hit counts saturate here rather than overflowing to infinity
+	#define MAX_HALF	65504.0
+
+	layout(std430, binding=0) buffer outputTex
+	{
+		uint outval[];	//packed fp16, two consecutive rows per word
+	};
+#else
+	layout(std430, binding=0) buffer outputTex
+	{
+		float outval[];
+	};
+#endif
 
 #ifdef ANALOG_PATH
 	layout(std430, binding=1) buffer waveform_y
@@ -121,17 +133,52 @@ layout(std430, binding=3) buffer index
 };
 #endif
 
+#ifdef COMPACT_TIMESTAMPS
+	//Number of samples per block. Must match SPARSE_PACK_BLOCK in WaveformArea.cpp and SparseTimestampPack.glsl.
+	#define SPARSE_PACK_BLOCK	1024
+
+	#define BLOCK_WIDE				1
+	#define BLOCK_IMPLIED_DURATIONS	2
+
+	//Base offset (lo, hi) and flags of each block, as generated by SparseTimestampPack
+	layout(std430, binding=4) buffer blockHeaders
+	{
+		uvec4 headers[];
+	};
+
+	//Offset of each sample relative to the base of its block
+	layout(std430, binding=5) buffer xdeltas
+	{
+		uint deltas[];
+	};
+
+	//Durations of samples in blocks that don't imply them, used instead of the 64-bit ones unless the block is wide
+	layout(std430, binding=7) buffer packedDurs
+	{
+		uint packedDurations[];
+	};
+
+	#define DURATION_BINDING 6
+#else
+	#define DURATION_BINDING 4
+#endif
+
 #ifndef DENSE_PACK
-layout(std430, binding=4) buffer durs
+layout(std430, binding=DURATION_BINDING) buffer durs
 {
 #ifdef HAS_INT64
 	int64_t durations[];
-	#define FETCH_DURATION(i) float(durations[i])
+	#define FETCH_WIDE_DURATION(i) float(durations[i])
 #else
 	uint durations[];
-	#define FETCH_DURATION(i) ((float(durations[i*2 + 1]) * 4294967296.0) + float(durations[i]))
+	#define FETCH_WIDE_DURATION(i) ((float(durations[i*2 + 1]) * 4294967296.0) + float(durations[i]))
 #endif
 };
+	#ifdef COMPACT_TIMESTAMPS
+		#define FETCH_DURATION(i) FetchPackedDuration(i)
+	#else
+		#define FETCH_DURATION(i) FETCH_WIDE_DURATION(i)
+	#endif
 #else
 #define FETCH_DURATION(i) float(1)
 #endif
@@ -161,6 +208,12 @@ float FetchX(uint i)
 #ifdef HAS_INT64
 	#ifdef DENSE_PACK
 		return float(int64_t(i) + innerXoff);
+	#elif defined(COMPACT_TIMESTAMPS)
+		uvec4 header = headers[i / SPARSE_PACK_BLOCK];
+		if( (header.z & BLOCK_WIDE) != 0)
+			return float(xpos[i] + innerXoff);
+		int64_t base = int64_t(packUint2x32(header.xy));
+		return float(base + int64_t(deltas[i]) + innerXoff);
 	#else
 		return float(xpos[i] + innerXoff);
 	#endif
@@ -169,6 +222,22 @@ float FetchX(uint i)
 	#ifdef DENSE_PACK
 		uint xpos_lo = i;
 		uint xpos_hi = 0;
+	#elif defined(COMPACT_TIMESTAMPS)
+		//Add the delta to the base of the block, unless the block didn't fit
+		uint xpos_lo;
+		uint xpos_hi;
+		uvec4 header = headers[i / SPARSE_PACK_BLOCK];
+		if( (header.z & BLOCK_WIDE) != 0)
+		{
+			xpos_lo = xpos[i*2];
+			xpos_hi = xpos[i*2 + 1];
+		}
+		else
+		{
+			uint deltaCarry;
+			xpos_lo = uaddCarry(header.x, deltas[i], deltaCarry);
+			xpos_hi = header.y + deltaCarry;
+		}
 	#else
 		//Fetch the input
 		uint xpos_lo = xpos[i*2];
@@ -201,6 +270,20 @@ float FetchX(uint i)
 #endif
 }
 
+#if defined(COMPACT_TIMESTAMPS) && !defined(DENSE_PACK)
+//Gets the duration of a sample, from wherever its block stores it
+float FetchPackedDuration(uint i)
+{
+	uint flags = headers[i / SPARSE_PACK_BLOCK].z;
+	if( (flags & BLOCK_WIDE) != 0)
+		return FETCH_WIDE_DURATION(i);
+	else if( (flags & BLOCK_IMPLIED_DURATIONS) != 0)
+		return FetchX(i+1) - FetchX(i);
+	else
+		return float(packedDurations[i]);
+}
+#endif
+
 //Interpolate a Y coordinate
 float InterpolateY(vec2 left, vec2 right, float slope, float x)
 {
@@ -209,16 +292,21 @@ float InterpolateY(vec2 left, vec2 right, float slope, float x)
 
 void main()
 {
-	//Abort if window height is too big, or if we're off the end of the window
-	if(windowHeight > MAX_HEIGHT)
-		return;
-	if(gl_GlobalInvocationID.x >= windowWidth)
+	//X axis column we're drawing (we may only be redrawing the right side of the image)
+	uint col = gl_GlobalInvocationID.x + firstColumn;
+
+	//Rows of the image this workgroup is drawing
+	uint tileBase = gl_WorkGroupID.y * MAX_HEIGHT;
+
+	//Abort if we're off the end of the window
+	if( (col >= windowWidth) || (tileBase >= windowHeight) )
 		return;
 	if(memDepth < (1 + ADDTL_NEEDED_SAMPLES))
 		return;
+	uint tileHeight = min(windowHeight - tileBase, MAX_HEIGHT);
 
 	//Clear working buffer
-	for(uint y=gl_LocalInvocationID.y; y < windowHeight; y += ROWS_PER_BLOCK)
+	for(uint y=gl_LocalInvocationID.y; y < tileHeight; y += ROWS_PER_BLOCK)
 		g_workingBuffer[y] = 0;
 
 	//Setup for main loop
@@ -231,20 +319,20 @@ void main()
 	memoryBarrierShared();
 
 	#ifdef DENSE_PACK
-		uint istart = uint(floor(gl_GlobalInvocationID.x / xscale)) + offset_samples;
-		uint iend = uint(floor((gl_GlobalInvocationID.x + 1) / xscale)) + offset_samples;
+		uint istart = uint(floor(col / xscale)) + offset_samples;
+		uint iend = uint(floor((col + 1) / xscale)) + offset_samples;
 		if(iend <= 0)
 			l_done = true;
 	#else
-		uint istart = xind[gl_GlobalInvocationID.x];
-		if( (gl_GlobalInvocationID.x + 1) < windowWidth)
+		uint istart = xind[col];
+		if( (col + 1) < windowWidth)
 		{
-			uint iend = xind[gl_GlobalInvocationID.x + 1];
+			uint iend = xind[col + 1];
 			if(iend <= 0)
 				l_done = true;
 		}
 	#endif
-	uint i = istart + gl_GlobalInvocationID.y;
+	uint i = istart + gl_LocalInvocationID.y;
 
 	//Main loop
 	while(true)
@@ -286,7 +374,7 @@ void main()
 			#endif
 
 			//Skip offscreen samples
-			if( (right.x >= gl_GlobalInvocationID.x) && (left.x <= gl_GlobalInvocationID.x + 1) )
+			if( (right.x >= col) && (left.x <= col + 1) )
 			{
 				//To start, assume we're drawing the entire segment
 				float starty = left.y;
@@ -298,10 +386,10 @@ void main()
 
 						//Interpolate analog signals if either end is outside our column
 						float slope = (right.y - left.y) / (right.x - left.x);
-						if(left.x < gl_GlobalInvocationID.x)
-							starty = InterpolateY(left, right, slope, gl_GlobalInvocationID.x);
-						if(right.x > gl_GlobalInvocationID.x + 1)
-							endy = InterpolateY(left, right, slope, gl_GlobalInvocationID.x + 1);
+						if(left.x < col)
+							starty = InterpolateY(left, right, slope, col);
+						if(right.x > col + 1)
+							endy = InterpolateY(left, right, slope, col + 1);
 
 					#endif
 
@@ -311,7 +399,7 @@ void main()
 
 					//If we are very near the right edge, draw vertical line
 					starty = left.y;
-					if(abs(right.x - gl_GlobalInvocationID.x) <= 1)
+					if(abs(right.x - col) <= 1)
 						endy = right.y;
 
 					//otherwise draw a single pixel
@@ -325,9 +413,13 @@ void main()
 					endy = left.y;
 				#endif
 
-				//If start and end are both off screen, nothing to draw
+				//Move to tile relative coordinates
+				starty -= tileBase;
+				endy -= tileBase;
+
+				//If start and end are both off this tile, nothing to draw
 				if( ( (starty < 0) && (endy < 0) ) ||
-					( (starty >= windowHeight) && (endy >= windowHeight) ) )
+					( (starty >= tileHeight) && (endy >= tileHeight) ) )
 				{
 					updating = false;
 				}
@@ -343,8 +435,8 @@ void main()
 				{
 					updating = true;
 
-					starty = min(starty, windowHeight - 1);
-					endy = min(endy, windowHeight - 1);
+					starty = min(starty, tileHeight - 1);
+					endy = min(endy, tileHeight - 1);
 					starty = max(starty, 0);
 					endy = max(endy, 0);
 
@@ -357,7 +449,7 @@ void main()
 				updating = false;
 
 			//Check if we're at the end of the pixel
-			if(right.x > gl_GlobalInvocationID.x + 1)
+			if(right.x > col + 1)
 				l_done = true;
 		}
 
@@ -392,15 +484,33 @@ void main()
 	barrier();
 	memoryBarrierShared();
 
+#ifdef HALF_PRECISION
+	//Copy working buffer to packed fp16 output and apply persistence if needed.
+	//Each thread does a pair of rows since they share a word (tiles are an even number of rows, so never split a pair)
+	for(uint y=gl_LocalInvocationID.y*2; y<tileHeight; y+= ROWS_PER_BLOCK*2)
+	{
+		uint hiRow = 0;
+		if( (y+1) < tileHeight)
+			hiRow = g_workingBuffer[y+1];
+		vec2 fout = vec2(g_workingBuffer[y], hiRow) * alpha;
+		uint npix = (windowWidth * ( (tileBase + y) / 2) ) + col;
+
+		if(persistScale != 0)
+			fout += unpackHalf2x16(outval[npix]) * persistScale;
+
+		outval[npix] = packHalf2x16(min(fout, vec2(MAX_HALF)));
+	}
+#else
 	//Copy working buffer to float[] output and apply persistence if needed
-	for(uint y=gl_LocalInvocationID.y; y<windowHeight; y+= ROWS_PER_BLOCK)
+	for(uint y=gl_LocalInvocationID.y; y<tileHeight; y+= ROWS_PER_BLOCK)
 	{
 		float fout = g_workingBuffer[y] * alpha;
-		uint npix = (windowWidth * y) + gl_GlobalInvocationID.x;
+		uint npix = (windowWidth * (tileBase + y)) + col;
 
 		if(persistScale != 0)
 			fout += outval[npix] * persistScale;
 
 		outval[npix] = fout;
 	}
+#endif
 }
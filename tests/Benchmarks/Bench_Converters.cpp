@@ -0,0 +1,160 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Benchmarks for raw ADC sample conversion primitives
+ */
+
+#include "Benchmarks.h"
+
+using namespace std;
+
+template<class T>
+void BenchmarkConverter(
+	const string& name,
+	const string& shader,
+	bool hasShader,
+	void (*generic)(float*, const T*, float, float, size_t),
+	const vector<pair<string, void (*)(float*, const T*, float, float, size_t)>>& simd);
+
+void RunConverterBenchmarks()
+{
+	//8 bit samples
+	vector<pair<string, void (*)(float*, const int8_t*, float, float, size_t)>> simd8;
+	#ifdef __x86_64__
+		if(g_hasAvx2)
+			simd8.emplace_back("avx2", Oscilloscope::Convert8BitSamplesAVX2);
+	#endif
+	BenchmarkConverter<int8_t>(
+		"Convert8BitSamples",
+		"shaders/Convert8BitSamples.spv",
+		g_hasShaderInt8,
+		Oscilloscope::Convert8BitSamplesGeneric,
+		simd8);
+
+	//16 bit samples
+	vector<pair<string, void (*)(float*, const int16_t*, float, float, size_t)>> simd16;
+	#ifdef __x86_64__
+		if(g_hasAvx2)
+			simd16.emplace_back("avx2", Oscilloscope::Convert16BitSamplesAVX2);
+		if(g_hasAvx2 && g_hasFMA)
+			simd16.emplace_back("fma", Oscilloscope::Convert16BitSamplesFMA);
+		if(g_hasAvx512F)
+			simd16.emplace_back("avx512f", Oscilloscope::Convert16BitSamplesAVX512F);
+	#endif
+	BenchmarkConverter<int16_t>(
+		"Convert16BitSamples",
+		"shaders/Convert16BitSamples.spv",
+		g_hasShaderInt16,
+		Oscilloscope::Convert16BitSamplesGeneric,
+		simd16);
+}
+
+/**
+	@brief Benchmarks one sample format on every available implementation (generic C++, SIMD, and GPU)
+ */
+template<class T>
+void BenchmarkConverter(
+	const string& name,
+	const string& shader,
+	bool hasShader,
+	void (*generic)(float*, const T*, float, float, size_t),
+	const vector<pair<string, void (*)(float*, const T*, float, float, size_t)>>& simd)
+{
+	if(!g_bench->WantBenchmark(name))
+		return;
+
+	AcceleratorBuffer<T> data_in;
+	AcceleratorBuffer<float> data_out;
+	data_in.SetCpuAccessHint(AcceleratorBuffer<T>::HINT_LIKELY);
+	data_in.SetGpuAccessHint(AcceleratorBuffer<T>::HINT_LIKELY);
+	data_out.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	data_out.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+
+	unique_ptr<ComputePipeline> pipe;
+	if(hasShader)
+		pipe = make_unique<ComputePipeline>(shader, 2, sizeof(ConvertRawSamplesShaderArgs));
+
+	//The shader is dispatched as a 1D grid, so very deep buffers may exceed the device limits
+	auto maxBlocks = g_vkComputePhysicalDevice->getProperties().limits.maxComputeWorkGroupCount[0];
+
+	const float gain = 0.01f;
+	const float off = 0.5f;
+	uniform_int_distribution<int> indesc(numeric_limits<T>::min(), numeric_limits<T>::max());
+
+	for(auto depth : g_bench->m_depths)
+	{
+		//Generate random input (not timed)
+		data_in.resize(depth);
+		data_out.resize(depth);
+		data_in.PrepareForCpuAccess();
+		for(size_t i=0; i<depth; i++)
+			data_in[i] = indesc(g_rng);
+		data_in.MarkModifiedFromCpu();
+
+		//CPU implementations
+		data_out.PrepareForCpuAccess();
+		g_bench->Run(name, "cpu", depth, [&]()
+			{ generic(data_out.GetCpuPointer(), data_in.GetCpuPointer(), gain, off, depth); });
+		for(auto& it : simd)
+		{
+			auto fn = it.second;
+			g_bench->Run(name, it.first, depth, [&]()
+				{ fn(data_out.GetCpuPointer(), data_in.GetCpuPointer(), gain, off, depth); });
+		}
+		data_out.MarkModifiedFromCpu();
+
+		//Vulkan implementation
+		if(pipe && (GetComputeBlockCount(depth, 64) > maxBlocks))
+			LogNotice("%-24s %-8s %12zu   (skipped, exceeds maxComputeWorkGroupCount)\n", name.c_str(), "gpu", depth);
+		else if(pipe)
+		{
+			data_in.PrepareForGpuAccess();
+			data_out.PrepareForGpuAccess();
+
+			auto& cmdbuf = *g_bench->m_cmdbuf;
+			g_bench->Run(name, "gpu", depth, [&]()
+				{
+					cmdbuf.begin({});
+					pipe->BindBufferNonblocking(0, data_out, cmdbuf, true);
+					pipe->BindBufferNonblocking(1, data_in, cmdbuf);
+					ConvertRawSamplesShaderArgs args;
+					args.size = depth;
+					args.gain = gain;
+					args.offset = off;
+					pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(depth, 64));
+					cmdbuf.end();
+					g_bench->m_queue->SubmitAndBlock(cmdbuf);
+				});
+			data_out.MarkModifiedFromGpu();
+		}
+	}
+}
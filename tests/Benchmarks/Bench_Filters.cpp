@@ -0,0 +1,137 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Benchmarks for commonly used filters
+ */
+
+#include "Benchmarks.h"
+
+using namespace std;
+
+void BenchmarkFilter(
+	const string& name,
+	const vector<string>& inputs,
+	size_t maxDepth,
+	function<void(Filter*)> configure = nullptr);
+
+void RunFilterBenchmarks()
+{
+	bool gpuFilterEnabled = g_gpuFilterEnabled;
+
+	BenchmarkFilter("Subtract", {"IN+", "IN-"}, SIZE_MAX);
+
+	BenchmarkFilter("FIR Filter", {"in"}, SIZE_MAX, [](Filter* f)
+		{
+			auto fir = dynamic_cast<FIRFilter*>(f);
+			fir->SetFilterType(Filter::FIR_LOWPASS);
+			fir->SetFreqLow(100e6);
+			fir->SetFreqHigh(500e6);
+		});
+
+	BenchmarkFilter("FFT", {"din"}, SIZE_MAX, [](Filter* f)
+		{ dynamic_cast<FFTFilter*>(f)->SetWindowFunction(FFTFilter::WINDOW_BLACKMAN_HARRIS); });
+
+	//Output is several times larger than the input, so don't go as deep
+	BenchmarkFilter("Upsample", {"din"}, 10000000);
+
+	g_gpuFilterEnabled = gpuFilterEnabled;
+}
+
+/**
+	@brief Benchmarks a filter on both the CPU and GPU code paths over the configured memory depth sweep
+
+	@param name			Filter type, as passed to Filter::CreateFilter
+	@param inputs		Names of the filter's analog inputs, each fed from its own channel of the mock scope
+	@param maxDepth		Largest memory depth to test, for filters whose output is much larger than the input
+	@param configure	Optional callback to set filter parameters before running
+ */
+void BenchmarkFilter(
+	const string& name,
+	const vector<string>& inputs,
+	size_t maxDepth,
+	function<void(Filter*)> configure)
+{
+	if(!g_bench->WantBenchmark(name))
+		return;
+
+	auto filter = Filter::CreateFilter(name, "#ffffff");
+	if(!filter)
+	{
+		LogError("Couldn't create filter \"%s\"\n", name.c_str());
+		return;
+	}
+	filter->AddRef();
+	if(configure)
+		configure(filter);
+
+	//Create one input waveform per filter input
+	vector<unique_ptr<UniformAnalogWaveform>> wfms;
+	for(size_t i=0; i<inputs.size(); i++)
+	{
+		auto wfm = make_unique<UniformAnalogWaveform>();
+		wfm->m_timescale = 100000;		//10 Gsps
+		wfm->m_triggerPhase = 0;
+
+		auto chan = g_scope->GetOscilloscopeChannel(i);
+		chan->SetData(wfm.get(), 0);
+		filter->SetInput(inputs[i], chan);
+		wfms.push_back(std::move(wfm));
+	}
+
+	auto& cmdbuf = *g_bench->m_cmdbuf;
+	auto queue = g_bench->m_queue;
+	for(auto depth : g_bench->m_depths)
+	{
+		if(depth > maxDepth)
+			break;
+
+		//Generate input and make sure it's in the right spot (not timed)
+		for(auto& w : wfms)
+		{
+			FillRandomWaveform(w.get(), depth);
+			w->PrepareForGpuAccess();
+			w->PrepareForCpuAccess();
+		}
+
+		g_gpuFilterEnabled = false;
+		g_bench->Run(name, "cpu", depth, [&]() { filter->Refresh(cmdbuf, queue); });
+
+		g_gpuFilterEnabled = true;
+		g_bench->Run(name, "gpu", depth, [&]() { filter->Refresh(cmdbuf, queue); });
+	}
+
+	//Free the output before the inputs go away
+	filter->SetData(nullptr, 0);
+	for(size_t i=0; i<inputs.size(); i++)
+		g_scope->GetOscilloscopeChannel(i)->Detach(0);
+	filter->Release();
+}
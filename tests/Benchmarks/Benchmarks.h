@@ -0,0 +1,133 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declarations shared by all benchmarks
+ */
+
+#ifndef Benchmarks_h
+#define Benchmarks_h
+
+#include "../../lib/scopehal/scopehal.h"
+#include "../../lib/scopeprotocols/scopeprotocols.h"
+#include "MockOscilloscope.h"
+#include <random>
+#include <functional>
+
+extern MockOscilloscope* g_scope;
+extern std::minstd_rand g_rng;
+
+/**
+	@brief Result of running one benchmark at one memory depth
+ */
+class BenchmarkResult
+{
+public:
+
+	///@brief Name of the operation being benchmarked (filter or primitive name)
+	std::string m_name;
+
+	///@brief Implementation being benchmarked (e.g. "cpu", "avx2", "gpu")
+	std::string m_path;
+
+	///@brief Number of input samples processed per iteration
+	size_t m_depth;
+
+	///@brief Number of timed iterations
+	size_t m_iterations;
+
+	///@brief Fastest iteration, in seconds
+	double m_minTime;
+
+	///@brief Median iteration, in seconds
+	double m_medianTime;
+
+	///@brief Throughput based on the median iteration
+	double m_samplesPerSec;
+
+	///@brief Average number of heap allocations per iteration
+	double m_allocsPerIteration;
+
+	///@brief Average number of heap bytes allocated per iteration
+	double m_bytesPerIteration;
+};
+
+/**
+	@brief Global benchmark configuration and state
+ */
+class BenchmarkContext
+{
+public:
+	BenchmarkContext();
+
+	void Run(
+		const std::string& name,
+		const std::string& path,
+		size_t depth,
+		std::function<void()> op);
+
+	bool WantBenchmark(const std::string& name) const
+	{ return m_filter.empty() || (name.find(m_filter) != std::string::npos); }
+
+	///@brief Memory depths to sweep over
+	std::vector<size_t> m_depths;
+
+	///@brief Only run benchmarks whose name contains this string
+	std::string m_filter;
+
+	///@brief Minimum number of timed iterations per depth
+	size_t m_minIterations;
+
+	///@brief Keep iterating until at least this much time (in seconds) has been spent on a depth
+	double m_minTime;
+
+	///@brief Results collected so far
+	std::vector<BenchmarkResult> m_results;
+
+	///@brief Compute queue used by all benchmarks
+	std::shared_ptr<QueueHandle> m_queue;
+
+	///@brief Command pool for m_cmdbuf
+	std::unique_ptr<vk::raii::CommandPool> m_pool;
+
+	///@brief Command buffer used by all benchmarks
+	std::unique_ptr<vk::raii::CommandBuffer> m_cmdbuf;
+};
+
+extern BenchmarkContext* g_bench;
+
+void GetAllocationCounters(uint64_t& count, uint64_t& bytes);
+void FillRandomWaveform(UniformAnalogWaveform* wfm, size_t size, float fmin=-1, float fmax=1);
+
+void RunConverterBenchmarks();
+void RunFilterBenchmarks();
+
+#endif
@@ -0,0 +1,387 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Main code for Benchmarks
+ */
+
+#include "Benchmarks.h"
+#include <atomic>
+#include <new>
+
+using namespace std;
+
+minstd_rand g_rng;
+MockOscilloscope* g_scope;
+BenchmarkContext* g_bench = nullptr;
+
+void ShowUsage();
+bool WriteJSON(const string& path);
+string JSONEscape(const string& s);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Heap allocation tracking
+
+static atomic<uint64_t> g_allocCount{0};
+static atomic<uint64_t> g_allocBytes{0};
+
+void* operator new(size_t size)
+{
+	g_allocCount.fetch_add(1, memory_order_relaxed);
+	g_allocBytes.fetch_add(size, memory_order_relaxed);
+
+	void* ret = malloc(size ? size : 1);
+	if(!ret)
+		throw bad_alloc();
+	return ret;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t /*size*/) noexcept
+{
+	free(ptr);
+}
+
+/**
+	@brief Gets the total number of heap allocations (and bytes allocated) since startup
+
+	Only allocations made through operator new are counted. AcceleratorBuffer memory (pinned host memory, GPU memory,
+	and file backed buffers) is allocated through other APIs and is not included.
+ */
+void GetAllocationCounters(uint64_t& count, uint64_t& bytes)
+{
+	count = g_allocCount.load(memory_order_relaxed);
+	bytes = g_allocBytes.load(memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Entry point
+
+int main(int argc, char* argv[])
+{
+	Severity console_verbosity = Severity::NOTICE;
+
+	BenchmarkContext ctx;
+	g_bench = &ctx;
+
+	size_t minDepth = 1000;
+	size_t maxDepth = 100000000;
+	string jsonPath;
+	for(int i=1; i<argc; i++)
+	{
+		string s(argv[i]);
+
+		//Let the logger eat its args first
+		if(ParseLoggerArguments(i, argc, argv, console_verbosity))
+			continue;
+
+		if( (s == "--help") || (s == "-h") )
+		{
+			ShowUsage();
+			return 0;
+		}
+		else if( (s == "--json") && (i+1 < argc) )
+			jsonPath = argv[++i];
+		else if( (s == "--filter") && (i+1 < argc) )
+			ctx.m_filter = argv[++i];
+		else if( (s == "--min-depth") && (i+1 < argc) )
+			minDepth = stoull(argv[++i]);
+		else if( (s == "--max-depth") && (i+1 < argc) )
+			maxDepth = stoull(argv[++i]);
+		else if( (s == "--iterations") && (i+1 < argc) )
+			ctx.m_minIterations = max<size_t>(1, stoull(argv[++i]));
+		else if( (s == "--min-time") && (i+1 < argc) )
+			ctx.m_minTime = stod(argv[++i]);
+		else
+		{
+			fprintf(stderr, "Unrecognized argument \"%s\"\n", s.c_str());
+			ShowUsage();
+			return 1;
+		}
+	}
+
+	//Sweep memory depths in decades
+	for(size_t depth = 1000; depth <= maxDepth; depth *= 10)
+	{
+		if(depth >= minDepth)
+			ctx.m_depths.push_back(depth);
+	}
+
+	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(console_verbosity));
+
+	if(!VulkanInit(true))
+		return 1;
+	TransportStaticInit();
+	DriverStaticInit();
+	InitializePlugins();
+	ScopeProtocolStaticInit();
+
+	//Add search path
+	g_searchPaths.push_back(GetDirOfCurrentExecutable() + "/../../src/ngscopeclient/");
+
+	//Initialize the RNG with a fixed seed so every run sees the same data
+	g_rng.seed(0);
+
+	//Create some fake scope channels
+	g_scope = new MockOscilloscope("Benchmark Scope", "Antikernel Labs", "12345", "null", "mock", "");
+	g_scope->AddChannel(new OscilloscopeChannel(
+		g_scope, "CH1", "#ffffffff", Unit(Unit::UNIT_FS), Unit(Unit::UNIT_VOLTS)));
+	g_scope->AddChannel(new OscilloscopeChannel(
+		g_scope, "CH2", "#ffffffff", Unit(Unit::UNIT_FS), Unit(Unit::UNIT_VOLTS)));
+
+	//Create a queue and command buffer shared by all benchmarks
+	ctx.m_queue = g_vkQueueManager->GetComputeQueue("Benchmarks.queue");
+	vk::CommandPoolCreateInfo poolInfo(
+		vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+		ctx.m_queue->m_family );
+	ctx.m_pool = make_unique<vk::raii::CommandPool>(*g_vkComputeDevice, poolInfo);
+	vk::CommandBufferAllocateInfo bufinfo(**ctx.m_pool, vk::CommandBufferLevel::ePrimary, 1);
+	ctx.m_cmdbuf = make_unique<vk::raii::CommandBuffer>(
+		std::move(vk::raii::CommandBuffers(*g_vkComputeDevice, bufinfo).front()));
+
+	//Run everything
+	LogNotice("%-24s %-8s %12s %12s %12s %14s %10s\n",
+		"Benchmark", "Path", "Depth", "Median (ms)", "Min (ms)", "MSa/s", "Allocs/it");
+	RunConverterBenchmarks();
+	RunFilterBenchmarks();
+
+	int ret = 0;
+	if(!jsonPath.empty() && !WriteJSON(jsonPath))
+		ret = 1;
+
+	//Clean up
+	ctx.m_cmdbuf = nullptr;
+	ctx.m_pool = nullptr;
+	ctx.m_queue = nullptr;
+	delete g_scope;
+	ScopehalStaticCleanup();
+
+	return ret;
+}
+
+void ShowUsage()
+{
+	fprintf(stderr,
+		"Usage: Benchmarks [options]\n"
+		"\n"
+		"    --filter NAME      Only run benchmarks whose name contains NAME\n"
+		"    --json PATH        Write results to PATH in JSON format\n"
+		"    --min-depth N      Smallest memory depth to test (default 1000)\n"
+		"    --max-depth N      Largest memory depth to test (default 100000000)\n"
+		"    --iterations N     Minimum number of timed iterations per depth (default 3)\n"
+		"    --min-time SEC     Keep iterating until SEC seconds have elapsed at each depth (default 0.25)\n"
+		"\n"
+		"Standard logger arguments (--debug, --verbose, etc) are also accepted.\n"
+		);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BenchmarkContext
+
+BenchmarkContext::BenchmarkContext()
+	: m_minIterations(3)
+	, m_minTime(0.25)
+{
+}
+
+/**
+	@brief Runs a single benchmark at one memory depth and records the result
+
+	The operation is run once untimed so that caches are hot, buffers are allocated, and shaders are compiled.
+	It is then run repeatedly until both the minimum iteration count and minimum run time have been reached.
+
+	@param name		Name of the operation
+	@param path		Implementation being exercised ("cpu", "avx2", "gpu", etc)
+	@param depth	Number of samples processed by each call to op
+	@param op		The operation to benchmark
+ */
+void BenchmarkContext::Run(const string& name, const string& path, size_t depth, function<void()> op)
+{
+	//Warm up
+	op();
+
+	const size_t maxIterations = 10000;
+	vector<double> times;
+	uint64_t allocStart;
+	uint64_t bytesStart;
+	GetAllocationCounters(allocStart, bytesStart);
+	double total = 0;
+	while( (times.size() < maxIterations) && ( (times.size() < m_minIterations) || (total < m_minTime) ) )
+	{
+		double start = GetTime();
+		op();
+		double dt = GetTime() - start;
+		times.push_back(dt);
+		total += dt;
+	}
+	uint64_t allocEnd;
+	uint64_t bytesEnd;
+	GetAllocationCounters(allocEnd, bytesEnd);
+
+	//Do the bookkeeping after the timed loop so the vector growth is not counted as an allocation by op
+	sort(times.begin(), times.end());
+
+	BenchmarkResult result;
+	result.m_name = name;
+	result.m_path = path;
+	result.m_depth = depth;
+	result.m_iterations = times.size();
+	result.m_minTime = times[0];
+	result.m_medianTime = times[times.size() / 2];
+	result.m_samplesPerSec = depth / result.m_medianTime;
+	result.m_allocsPerIteration = static_cast<double>(allocEnd - allocStart) / times.size();
+	result.m_bytesPerIteration = static_cast<double>(bytesEnd - bytesStart) / times.size();
+	m_results.push_back(result);
+
+	LogNotice("%-24s %-8s %12zu %12.3f %12.3f %14.2f %10.1f\n",
+		name.c_str(),
+		path.c_str(),
+		depth,
+		result.m_medianTime * 1000,
+		result.m_minTime * 1000,
+		result.m_samplesPerSec * 1e-6,
+		result.m_allocsPerIteration);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+/**
+	@brief Writes all results to a JSON file so they can be tracked over time
+ */
+bool WriteJSON(const string& path)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	fprintf(fp, "{\n");
+	auto props = g_vkComputePhysicalDevice->getProperties();
+	fprintf(fp, "\t\"device\": \"%s\",\n", JSONEscape(string(props.deviceName.data())).c_str());
+	#ifdef __x86_64__
+		fprintf(fp, "\t\"avx2\": %s,\n", g_hasAvx2 ? "true" : "false");
+	#endif
+	fprintf(fp, "\t\"results\":\n");
+	fprintf(fp, "\t[\n");
+	for(size_t i=0; i<g_bench->m_results.size(); i++)
+	{
+		auto& r = g_bench->m_results[i];
+		fprintf(fp,
+			"\t\t{ \"name\": \"%s\", \"path\": \"%s\", \"depth\": %zu, \"iterations\": %zu, "
+			"\"median_sec\": %.9g, \"min_sec\": %.9g, \"samples_per_sec\": %.9g, "
+			"\"allocs_per_iteration\": %.3f, \"alloc_bytes_per_iteration\": %.1f }%s\n",
+			JSONEscape(r.m_name).c_str(),
+			JSONEscape(r.m_path).c_str(),
+			r.m_depth,
+			r.m_iterations,
+			r.m_medianTime,
+			r.m_minTime,
+			r.m_samplesPerSec,
+			r.m_allocsPerIteration,
+			r.m_bytesPerIteration,
+			(i+1 < g_bench->m_results.size()) ? "," : "");
+	}
+	fprintf(fp, "\t]\n");
+	fprintf(fp, "}\n");
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+	if(!ok)
+		LogError("Failed to write %s\n", path.c_str());
+	return ok;
+}
+
+string JSONEscape(const string& s)
+{
+	string ret;
+	for(auto c : s)
+	{
+		if( (c == '\"') || (c == '\\') )
+		{
+			ret += '\\';
+			ret += c;
+		}
+		else if(static_cast<unsigned char>(c) < 0x20)
+		{
+			char tmp[8];
+			snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+			ret += tmp;
+		}
+		else
+			ret += c;
+	}
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+/**
+	@brief Fills a waveform with random content, uniformly distributed from fmin to fmax
+ */
+void FillRandomWaveform(UniformAnalogWaveform* wfm, size_t size, float fmin, float fmax)
+{
+	auto rdist = uniform_real_distribution<float>(fmin, fmax);
+
+	wfm->PrepareForCpuAccess();
+	wfm->Resize(size);
+
+	for(size_t i=0; i<size; i++)
+		wfm->m_samples[i] = rdist(g_rng);
+
+	wfm->MarkModifiedFromCpu();
+
+	wfm->m_revision ++;
+	if(wfm->m_timescale == 0)
+		wfm->m_timescale = 1000;
+}